@@ -2,12 +2,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <iostream>
+#include <float.h>
 #include <math.h>
 #include <time.h>
 #include <cuda.h>
 #include <cuda_runtime.h>
 #include <unistd.h>
 #include "multipole_struct.h"
+#include "cuda_multipole_build.h"
+#include "cuda_precision.h"
 #include "error.h"
 #include "gravity_derivatives.h"
 
@@ -497,8 +500,32 @@ __device__ float grav_pot_eval(const float u) {
   return W;
 }
 
+#ifdef GRAVITY_LONG_RANGE_TABLE
+//device copy of kernel_long_grav_table, filled by long_grav_table_offload()
+__constant__ struct kernel_long_grav_table gpu_long_grav_table;
+#endif
+
 __device__ float long_grav_eval(const float r_over_r_s, float *corr_f, float *corr_pot){
-#ifdef GADGET2_LONG_RANGE_CORRECTION
+#if defined(GRAVITY_LONG_RANGE_TABLE)
+
+  /* Position in the table */
+  const float x = r_over_r_s * ((float)kernel_long_grav_table_size /
+                                kernel_long_grav_table_u_max);
+  const int i_x = (int)x;
+  const int i = i_x < kernel_long_grav_table_size
+                    ? i_x
+                    : kernel_long_grav_table_size - 1;
+  const float t = x - (float)i;
+
+  /* Zero beyond the end of the table */
+  const float mask = x < (float)kernel_long_grav_table_size ? 1.f : 0.f;
+
+  const float *c = gpu_long_grav_table.coeff[i];
+
+  *corr_f = mask * (((c[3] * t + c[2]) * t + c[1]) * t + c[0]);
+  *corr_pot = mask * (((c[7] * t + c[6]) * t + c[5]) * t + c[4]);
+
+#elif defined(GADGET2_LONG_RANGE_CORRECTION)
 
   const float two_over_sqrt_pi = ((float)M_2_SQRTPI);
 
@@ -768,7 +795,7 @@ __device__ void gravity_M2P(const struct multipole *const m, const float r_x, co
 __device__ void iact_grav_pp_full(const float r2, const float h2, const float h_inv, const float h_inv3, const float mass, float *f_ij, float *pot_ij) {
 
   /* Get the inverse distance */
-  const float r_inv = 1.f / sqrtf(r2 + FLT_MIN);
+  const float r_inv = rsqrtf(r2 + FLT_MIN);
 
   /* Should we soften ? */
   if (r2 >= h2) {
@@ -819,7 +846,7 @@ __device__ void iact_grav_pp_full(const float r2, const float h2, const float h_
 __device__ void iact_grav_pp_truncated(const float r2, const float h2, const float h_inv, const float h_inv3, const float mass, const float r_s_inv, float *f_ij, float *pot_ij){
 
   /* Get the inverse distance */
-  const float r_inv = 1.f / sqrtf(r2 + FLT_MIN);
+  const float r_inv = rsqrtf(r2 + FLT_MIN);
   const float r = r2 * r_inv;
 
   /* Should we soften ? */
@@ -919,244 +946,2174 @@ __device__ void iact_grav_pm_truncated(const float r_x, const float r_y, const f
   *f_z = l.F_001;
 }
 
-//PP FULL INTERACTIONS
-__device__ void grav_pp_full(int* active, int *mpole, float dim_0, float dim_1, float dim_2, float *h_i, float *h_j, float *mass_j_arr, float r_s_inv, const float *x_i, const float *x_j, const float *y_i, const float *y_j, const float *z_i, const float *z_j, float *a_x_i, float *a_y_i, float *a_z_i, float *pot_i, const int gcount_i, const int gcount_padded_j, const int periodic, int ci_active, int cj_active, int symmetric, int max_r_decision){
+//PRECISION MODES
+//the file is built with -fmad=false, so the strict mode rounds every product
+//and sum on its own, in the same order as the CPU. The other modes fuse the
+//multiply-adds explicitly (fmaf is not affected by the flag) and the mixed
+//one also carries a Kahan compensation next to each accumulator
 
-    int t = blockIdx.x*blockDim.x +threadIdx.x;
-    int T = blockDim.x*gridDim.x;
+//squared norm of a separation
+template <int PRECISION>
+__device__ __forceinline__ float grav_norm2(const float dx, const float dy, const float dz) {
 
-    for (int pid = t; pid < gcount_i; pid+=T) {
+  if (PRECISION == cuda_precision_strict) return dx * dx + dy * dy + dz * dz;
+  return fmaf(dx, dx, fmaf(dy, dy, dz * dz));
+}
+
+//adds a * b to the accumulator sum, comp being its compensation (only used
+//by the mixed mode, it must start at zero)
+template <int PRECISION>
+__device__ __forceinline__ void grav_accumulate(float *sum, float *comp, const float a, const float b) {
+
+  if (PRECISION == cuda_precision_strict) {
+    *sum += a * b;
+  } else if (PRECISION == cuda_precision_fma) {
+    *sum = fmaf(a, b, *sum);
+  } else {
+    const float y = fmaf(a, b, -*comp);
+    const float t = *sum + y;
+    *comp = (t - *sum) - y;
+    *sum = t;
+  }
+}
 
-    //Local accumulators for the acceleration and potential
+//PAIR INTERACTIONS
+//number of j-particles staged in shared memory at a time, all the kernels
+//calling grav_pp_block must be launched with this many threads per block
+#define GRAV_PP_TILE 128
+
+//computes the whole contribution of the particles and multipole of cell j
+//onto the particles first, first + stride, ... of cell i
+//the M2P vs. P2P choice comes from the cache, and the j-particles are read
+//tile by tile from shared memory which the whole block fills cooperatively
+//the potential and boundary conditions are fixed at compile time such that
+//only the code path needed by the pair is generated
+//with ATOMIC the results of the active particles are added to the outputs
+//(the device-resident accumulators shared by all the pairs of a step)
+//rather than written to them
+//PRECISION is one of the #cuda_precision modes
+template <int TRUNCATED, int PERIODIC, int ATOMIC, int PRECISION>
+__device__ void grav_pp_block(const int first, const int stride, const int gcount_i, const float *x_i, const float *y_i, const float *z_i, const float *h_i, const int *active_i, const int *mpole_i, const float *x_j, const float *y_j, const float *z_j, const float *h_j, const float *mass_j_arr, const int gcount_padded_j, const float *CoM_j, const struct multipole *multi_j, float dim_0, float dim_1, float dim_2, const float r_s_inv, float *a_x_i, float *a_y_i, float *a_z_i, float *pot_i) {
+
+  __shared__ float4 tile_pos[GRAV_PP_TILE];
+  __shared__ float tile_h[GRAV_PP_TILE];
+  __shared__ float tile_h_inv[GRAV_PP_TILE];
+
+  /* Every thread of the block goes through the tiles even if it has no
+   * particle to update, such that the barriers are reached by all */
+  for (int base = first; base < gcount_i; base += stride) {
+
+    const int pid = base + threadIdx.x;
+    const int valid = pid < gcount_i;
+    const int active = valid && active_i[pid];
+    const int do_m2p = active && mpole_i[pid];
+    const int do_p2p = active && !mpole_i[pid];
+
+    const float xi = valid ? x_i[pid] : 0.f;
+    const float yi = valid ? y_i[pid] : 0.f;
+    const float zi = valid ? z_i[pid] : 0.f;
+    const float hi = valid ? h_i[pid] : 0.f;
+    const float hi_inv = 1.f / hi;
+
+    /* Local accumulators for the acceleration and potential */
     float a_x = 0.f, a_y = 0.f, a_z = 0.f, pot = 0.f;
+    float c_x = 0.f, c_y = 0.f, c_z = 0.f, c_pot = 0.f;
 
-    // Loop over every particle in the other cell.
-    for (int pjd = 0; pjd < gcount_padded_j; pjd++) {
+    if (do_m2p) {
 
-      float mass_j = mass_j_arr[pjd];
+      /* Some powers of the softening length */
+      const float h = max(hi, multi_j->max_softening);
+      const float h_inv = 1.f / h;
 
-      // Compute the pairwise distance.
-      float dx = x_j[pjd] - x_i[pid];
-      float dy = y_j[pjd] - y_i[pid];
-      float dz = z_j[pjd] - z_i[pid];
+      /* Distance to the Multipole */
+      float dx = CoM_j[0] - xi;
+      float dy = CoM_j[1] - yi;
+      float dz = CoM_j[2] - zi;
 
-      // Correct for periodic BCs
-      dx = nearestf1(dx, dim_0);//*periodic;
-      dy = nearestf1(dy, dim_1);//*periodic;
-      dz = nearestf1(dz, dim_2);//*periodic;
+      /* Apply periodic BCs? */
+      if (PERIODIC) {
+        dx = nearestf1(dx, dim_0);
+        dy = nearestf1(dy, dim_1);
+        dz = nearestf1(dz, dim_2);
+      }
 
       const float r2 = dx * dx + dy * dy + dz * dz;
 
-      // Pick the maximal softening length of i and j
-      const float h = max(h_i[pid], h_j[pjd]);
-      const float h2 = h * h;
-      const float h_inv = 1.f / h;
-      const float h_inv_3 = h_inv * h_inv * h_inv;
-
-      // Interact!
-      float f_ij, pot_ij;
-      iact_grav_pp_full(r2, h2, h_inv, h_inv_3, mass_j, &f_ij, &pot_ij);
+      /* Interact! */
+      if (TRUNCATED)
+        iact_grav_pm_truncated(dx, dy, dz, r2, h, h_inv, r_s_inv, multi_j, &a_x, &a_y, &a_z, &pot);
+      else
+        iact_grav_pm_full(dx, dy, dz, r2, h, h_inv, multi_j, &a_x, &a_y, &a_z, &pot);
+    }
 
-      // Store it back
-      a_x += f_ij * dx;
-      a_y += f_ij * dy;
-      a_z += f_ij * dz;
-      pot += pot_ij;
+    /* Loop over the particles of the other cell, one tile at a time */
+    for (int tile = 0; tile < gcount_padded_j; tile += GRAV_PP_TILE) {
+
+      /* Stage the next tile, the inverse softening is computed once per
+       * particle here rather than once per pair below */
+      const int pjd_load = tile + threadIdx.x;
+      if (pjd_load < gcount_padded_j) {
+        tile_pos[threadIdx.x] = make_float4(x_j[pjd_load], y_j[pjd_load], z_j[pjd_load], mass_j_arr[pjd_load]);
+        tile_h[threadIdx.x] = h_j[pjd_load];
+        tile_h_inv[threadIdx.x] = 1.f / h_j[pjd_load];
+      }
+      __syncthreads();
+
+      if (do_p2p) {
+
+        const int count = min(GRAV_PP_TILE, gcount_padded_j - tile);
+        for (int k = 0; k < count; k++) {
+
+          const float4 pj = tile_pos[k];
+
+          /* Compute the pairwise distance. */
+          float dx = pj.x - xi;
+          float dy = pj.y - yi;
+          float dz = pj.z - zi;
+
+          /* Correct for periodic BCs */
+          if (PERIODIC) {
+            dx = nearestf1(dx, dim_0);
+            dy = nearestf1(dy, dim_1);
+            dz = nearestf1(dz, dim_2);
+          }
+
+          const float r2 = grav_norm2<PRECISION>(dx, dy, dz);
+
+          /* Pick the maximal softening length of i and j, 1/max(a, b) is
+           * exactly min(1/a, 1/b) so no division is needed here */
+          const float h = max(hi, tile_h[k]);
+          const float h2 = h * h;
+          const float h_inv = min(hi_inv, tile_h_inv[k]);
+          const float h_inv_3 = h_inv * h_inv * h_inv;
+
+          /* Interact! */
+          float f_ij, pot_ij;
+          if (TRUNCATED)
+            iact_grav_pp_truncated(r2, h2, h_inv, h_inv_3, pj.w, r_s_inv, &f_ij, &pot_ij);
+          else
+            iact_grav_pp_full(r2, h2, h_inv, h_inv_3, pj.w, &f_ij, &pot_ij);
+
+          /* Store it back */
+          grav_accumulate<PRECISION>(&a_x, &c_x, f_ij, dx);
+          grav_accumulate<PRECISION>(&a_y, &c_y, f_ij, dy);
+          grav_accumulate<PRECISION>(&a_z, &c_z, f_ij, dz);
+          grav_accumulate<PRECISION>(&pot, &c_pot, pot_ij, 1.f);
+        }
+      }
+      __syncthreads();
     }
 
-    // Store everything back in cache
-    a_x_i[pid] += a_x*active[pid]*(abs(mpole[pid]-1))*ci_active*abs(periodic-1);
-    a_y_i[pid] += a_y*active[pid]*(abs(mpole[pid]-1))*ci_active*abs(periodic-1);
-    a_z_i[pid] += a_z*active[pid]*(abs(mpole[pid]-1))*ci_active*abs(periodic-1);
-    pot_i[pid] += pot*active[pid]*(abs(mpole[pid]-1))*ci_active*abs(periodic-1);
-
-    a_x_i[pid] += a_x*active[pid]*(abs(mpole[pid]-1))*cj_active*symmetric*abs(periodic-1);
-    a_y_i[pid] += a_y*active[pid]*(abs(mpole[pid]-1))*cj_active*symmetric*abs(periodic-1);
-    a_z_i[pid] += a_z*active[pid]*(abs(mpole[pid]-1))*cj_active*symmetric*abs(periodic-1);
-    pot_i[pid] += pot*active[pid]*(abs(mpole[pid]-1))*cj_active*symmetric*abs(periodic-1);
-
-    a_x_i[pid] += a_x*active[pid]*(abs(mpole[pid]-1))*ci_active*periodic*max_r_decision;
-    a_y_i[pid] += a_y*active[pid]*(abs(mpole[pid]-1))*ci_active*periodic*max_r_decision;
-    a_z_i[pid] += a_z*active[pid]*(abs(mpole[pid]-1))*ci_active*periodic*max_r_decision;
-    pot_i[pid] += pot*active[pid]*(abs(mpole[pid]-1))*ci_active*periodic*max_r_decision;
-
-    a_x_i[pid] += a_x*active[pid]*(abs(mpole[pid]-1))*cj_active*symmetric*periodic*max_r_decision;
-    a_y_i[pid] += a_y*active[pid]*(abs(mpole[pid]-1))*cj_active*symmetric*periodic*max_r_decision;
-    a_z_i[pid] += a_z*active[pid]*(abs(mpole[pid]-1))*cj_active*symmetric*periodic*max_r_decision;
-    pot_i[pid] += pot*active[pid]*(abs(mpole[pid]-1))*cj_active*symmetric*periodic*max_r_decision;
+    if (ATOMIC) {
+      /* Other pairs may be updating the same particles concurrently */
+      if (active) {
+        atomicAdd(&a_x_i[pid], a_x);
+        atomicAdd(&a_y_i[pid], a_y);
+        atomicAdd(&a_z_i[pid], a_z);
+        atomicAdd(&pot_i[pid], pot);
+      }
+    } else if (valid) {
+      /* Every particle of the cell is written exactly once per pair */
+      a_x_i[pid] = a_x;
+      a_y_i[pid] = a_y;
+      a_z_i[pid] = a_z;
+      pot_i[pid] = pot;
+    }
   }
 }
 
-//PP TRUNCATED INTERACTIONS
-__device__ void grav_pp_truncated(int* active, int *mpole, float dim_0, float dim_1, float dim_2, float *h_i, float *h_j, float *mass_j_arr, const float r_s_inv, const float *x_i, const float *x_j, const float *y_i, const float *y_j, const float *z_i, const float *z_j, float *a_x_i, float *a_y_i, float *a_z_i, float *pot_i, const int gcount_i, const int gcount_padded_j, const int periodic, int ci_active, int cj_active, int symmetric, int max_r_decision){
+//runtime dispatch onto the specialised version above, used by the batched
+//kernel where the truncation decision is per pair (hence per block)
+template <int ATOMIC, int PRECISION>
+__device__ void grav_pp_batched_block(const int gcount_i, const float *x_i, const float *y_i, const float *z_i, const float *h_i, const int *active_i, const int *mpole_i, const float *x_j, const float *y_j, const float *z_j, const float *h_j, const float *mass_j_arr, const int gcount_padded_j, const float *CoM_j, const struct multipole *multi_j, const int periodic, const int truncated, float dim_0, float dim_1, float dim_2, const float r_s_inv, float *a_x_i, float *a_y_i, float *a_z_i, float *pot_i) {
+
+  if (truncated)
+    grav_pp_block<1, 1, ATOMIC, PRECISION>(0, blockDim.x, gcount_i, x_i, y_i, z_i, h_i, active_i, mpole_i, x_j, y_j, z_j, h_j, mass_j_arr, gcount_padded_j, CoM_j, multi_j, dim_0, dim_1, dim_2, r_s_inv, a_x_i, a_y_i, a_z_i, pot_i);
+  else if (periodic)
+    grav_pp_block<0, 1, ATOMIC, PRECISION>(0, blockDim.x, gcount_i, x_i, y_i, z_i, h_i, active_i, mpole_i, x_j, y_j, z_j, h_j, mass_j_arr, gcount_padded_j, CoM_j, multi_j, dim_0, dim_1, dim_2, r_s_inv, a_x_i, a_y_i, a_z_i, pot_i);
+  else
+    grav_pp_block<0, 0, ATOMIC, PRECISION>(0, blockDim.x, gcount_i, x_i, y_i, z_i, h_i, active_i, mpole_i, x_j, y_j, z_j, h_j, mass_j_arr, gcount_padded_j, CoM_j, multi_j, dim_0, dim_1, dim_2, r_s_inv, a_x_i, a_y_i, a_z_i, pot_i);
+}
 
-    int t = blockIdx.x*blockDim.x +threadIdx.x;
-    int T = blockDim.x*gridDim.x;
-    
-    /*for (int i = 0; i < gcount_i; i++){
-  	printf("x = %.16f ", x_i[i]);}
-    printf("\n");
-    
-    for (int i = 0; i < gcount_i; i++){
-  	printf("a_x = %.16f ", a_x_i[i]);}
-  printf("\n");*/
+//PAIR INTERACTIONS OF THE SMALL LEAVES
+//number of lanes sharing a particle of cell i in grav_pp_warp
+#define GRAV_PP_WARP 32
+
+//largest cell handed to the warp-per-particle kernel, above that the tiled
+//one above has enough threads to fill the device
+#define GRAV_PP_WARP_MAX_COUNT 512
+
+//adds up the values of all the lanes of the calling warp, lane 0 gets the
+//total
+__device__ __forceinline__ float grav_warp_sum(float v) {
+
+  for (int offset = GRAV_PP_WARP / 2; offset > 0; offset /= 2)
+    v += __shfl_down_sync(0xffffffff, v, offset);
+  return v;
+}
+
+//same contribution as grav_pp_block but with one warp per particle of cell
+//i, first, first + stride, ..., the lanes splitting the particles of cell j
+//between them, such that a small leaf does not leave most of the threads of
+//the launch idle
+//the j-particles are read straight from global memory, every warp of the
+//launch going through the same ones
+//the partial sums of the lanes are added in a tree at the end, which is not
+//the order of the CPU, so this is never used in the strict mode
+template <int TRUNCATED, int PERIODIC, int ATOMIC, int PRECISION>
+__device__ void grav_pp_warp(const int first, const int stride, const int gcount_i, const float *x_i, const float *y_i, const float *z_i, const float *h_i, const int *active_i, const int *mpole_i, const float *x_j, const float *y_j, const float *z_j, const float *h_j, const float *mass_j_arr, const int gcount_padded_j, const float *CoM_j, const struct multipole *multi_j, float dim_0, float dim_1, float dim_2, const float r_s_inv, float *a_x_i, float *a_y_i, float *a_z_i, float *pot_i) {
+
+  const int lane = threadIdx.x % GRAV_PP_WARP;
+
+  /* The whole warp works on the same particle, the shuffles below hence
+   * always see all the lanes */
+  for (int pid = first; pid < gcount_i; pid += stride) {
+
+    if (!active_i[pid]) {
+      if (!ATOMIC && lane == 0) {
+        a_x_i[pid] = 0.f;
+        a_y_i[pid] = 0.f;
+        a_z_i[pid] = 0.f;
+        pot_i[pid] = 0.f;
+      }
+      continue;
+    }
 
-  /* Loop over all particles in ci... */
-  for (int pid = t; pid < gcount_i; pid+=T){
+    const float xi = x_i[pid];
+    const float yi = y_i[pid];
+    const float zi = z_i[pid];
+    const float hi = h_i[pid];
+    const float hi_inv = 1.f / hi;
 
     /* Local accumulators for the acceleration and potential */
     float a_x = 0.f, a_y = 0.f, a_z = 0.f, pot = 0.f;
+    float c_x = 0.f, c_y = 0.f, c_z = 0.f, c_pot = 0.f;
+
+    if (mpole_i[pid]) {
+
+      /* A single interaction, done by the first lane */
+      if (lane == 0) {
+
+        /* Some powers of the softening length */
+        const float h = max(hi, multi_j->max_softening);
+        const float h_inv = 1.f / h;
+
+        /* Distance to the Multipole */
+        float dx = CoM_j[0] - xi;
+        float dy = CoM_j[1] - yi;
+        float dz = CoM_j[2] - zi;
+
+        /* Apply periodic BCs? */
+        if (PERIODIC) {
+          dx = nearestf1(dx, dim_0);
+          dy = nearestf1(dy, dim_1);
+          dz = nearestf1(dz, dim_2);
+        }
+
+        const float r2 = dx * dx + dy * dy + dz * dz;
+
+        /* Interact! */
+        if (TRUNCATED)
+          iact_grav_pm_truncated(dx, dy, dz, r2, h, h_inv, r_s_inv, multi_j, &a_x, &a_y, &a_z, &pot);
+        else
+          iact_grav_pm_full(dx, dy, dz, r2, h, h_inv, multi_j, &a_x, &a_y, &a_z, &pot);
+      }
+
+    } else {
+
+      /* Each lane takes every GRAV_PP_WARP-th particle of the other cell */
+      for (int pjd = lane; pjd < gcount_padded_j; pjd += GRAV_PP_WARP) {
+
+        /* Compute the pairwise distance. */
+        float dx = x_j[pjd] - xi;
+        float dy = y_j[pjd] - yi;
+        float dz = z_j[pjd] - zi;
+
+        /* Correct for periodic BCs */
+        if (PERIODIC) {
+          dx = nearestf1(dx, dim_0);
+          dy = nearestf1(dy, dim_1);
+          dz = nearestf1(dz, dim_2);
+        }
+
+        const float r2 = grav_norm2<PRECISION>(dx, dy, dz);
+
+        /* Pick the maximal softening length of i and j */
+        const float hj = h_j[pjd];
+        const float h = max(hi, hj);
+        const float h2 = h * h;
+        const float h_inv = min(hi_inv, 1.f / hj);
+        const float h_inv_3 = h_inv * h_inv * h_inv;
+
+        /* Interact! */
+        float f_ij, pot_ij;
+        if (TRUNCATED)
+          iact_grav_pp_truncated(r2, h2, h_inv, h_inv_3, mass_j_arr[pjd], r_s_inv, &f_ij, &pot_ij);
+        else
+          iact_grav_pp_full(r2, h2, h_inv, h_inv_3, mass_j_arr[pjd], &f_ij, &pot_ij);
+
+        /* Store it back */
+        grav_accumulate<PRECISION>(&a_x, &c_x, f_ij, dx);
+        grav_accumulate<PRECISION>(&a_y, &c_y, f_ij, dy);
+        grav_accumulate<PRECISION>(&a_z, &c_z, f_ij, dz);
+        grav_accumulate<PRECISION>(&pot, &c_pot, pot_ij, 1.f);
+      }
+    }
 
-    /* Loop over every particle in the other cell. */
-    for (int pjd = 0; pjd < gcount_padded_j; pjd++){
-    
-      //printf("%i %i %i %i %i %i %i %i\n", t, T, pid, gcount_i, s, S, pjd, gcount_padded_j);
+    /* Fold the compensations in and add the lanes up */
+    a_x = grav_warp_sum(a_x - c_x);
+    a_y = grav_warp_sum(a_y - c_y);
+    a_z = grav_warp_sum(a_z - c_z);
+    pot = grav_warp_sum(pot - c_pot);
+
+    if (lane == 0) {
+      if (ATOMIC) {
+        /* Other pairs may be updating the same particles concurrently */
+        atomicAdd(&a_x_i[pid], a_x);
+        atomicAdd(&a_y_i[pid], a_y);
+        atomicAdd(&a_z_i[pid], a_z);
+        atomicAdd(&pot_i[pid], pot);
+      } else {
+        a_x_i[pid] = a_x;
+        a_y_i[pid] = a_y;
+        a_z_i[pid] = a_z;
+        pot_i[pid] = pot;
+      }
+    }
+  }
+}
 
-      const float mass_j = mass_j_arr[pjd];
-	
-      //Compute the pairwise distance.
-      float dx = x_j[pjd] - x_i[pid];
-      float dy = y_j[pjd] - y_i[pid];
-      float dz = z_j[pjd] - z_i[pid];
+//SELF INTERACTIONS
+//computes the contribution of all the other particles of the cell onto
+//particle pid, no periodic wrapping is needed inside a cell
+//with ATOMIC the results are added to what the arrays already hold
+template <int TRUNCATED, int ATOMIC, int PRECISION>
+__device__ void grav_self_pp_particle(const int pid, const float *x, const float *y, const float *z, const float *h_arr, const float *mass_arr, const int gcount_padded, const float r_s_inv, float *a_x_i, float *a_y_i, float *a_z_i, float *pot_i) {
 
-      /* Correct for periodic BCs */
-      dx = nearestf1(dx, dim_0);//*periodic;
-      dy = nearestf1(dy, dim_1);//*periodic;
-      dz = nearestf1(dz, dim_2);//*periodic;
+  const float x_i = x[pid];
+  const float y_i = y[pid];
+  const float z_i = z[pid];
+  const float h_i = h_arr[pid];
 
-      const float r2 = dx * dx + dy * dy + dz * dz;
+  /* Local accumulators for the acceleration and potential */
+  float a_x = 0.f, a_y = 0.f, a_z = 0.f, pot = 0.f;
+  float c_x = 0.f, c_y = 0.f, c_z = 0.f, c_pot = 0.f;
 
-      /* Pick the maximal softening length of i and j */
-      const float h = max(h_i[pid], h_j[pjd]);
-      const float h2 = h * h;
-      const float h_inv = 1.f / h;
-      const float h_inv_3 = h_inv * h_inv * h_inv;
+  /* Loop over every other particle in the cell. */
+  for (int pjd = 0; pjd < gcount_padded; pjd++) {
 
-      /* Interact! */
-      float f_ij, pot_ij;
-      iact_grav_pp_truncated(r2, h2, h_inv, h_inv_3, mass_j, r_s_inv,
-                                    &f_ij, &pot_ij);
-
-      /* Store it back */
-      a_x += f_ij * dx;
-      a_y += f_ij * dy;
-      a_z += f_ij * dz;
-      pot += pot_ij;
-    }
+    /* No self interaction */
+    if (pid == pjd) continue;
 
-    /* Store everything back in cache */
-    a_x_i[pid] += a_x*active[pid]*(abs(mpole[pid]-1))*ci_active*periodic*abs(max_r_decision-1);
-    a_y_i[pid] += a_y*active[pid]*(abs(mpole[pid]-1))*ci_active*periodic*abs(max_r_decision-1);
-    a_z_i[pid] += a_z*active[pid]*(abs(mpole[pid]-1))*ci_active*periodic*abs(max_r_decision-1);
-    pot_i[pid] += pot*active[pid]*(abs(mpole[pid]-1))*ci_active*periodic*abs(max_r_decision-1);
+    /* Compute the pairwise (square) distance. */
+    const float dx = x[pjd] - x_i;
+    const float dy = y[pjd] - y_i;
+    const float dz = z[pjd] - z_i;
+    const float r2 = grav_norm2<PRECISION>(dx, dy, dz);
 
-    a_x_i[pid] += a_x*active[pid]*(abs(mpole[pid]-1))*cj_active*symmetric*periodic*abs(max_r_decision-1);
-    a_y_i[pid] += a_y*active[pid]*(abs(mpole[pid]-1))*cj_active*symmetric*periodic*abs(max_r_decision-1);
-    a_z_i[pid] += a_z*active[pid]*(abs(mpole[pid]-1))*cj_active*symmetric*periodic*abs(max_r_decision-1);
-    pot_i[pid] += pot*active[pid]*(abs(mpole[pid]-1))*cj_active*symmetric*periodic*abs(max_r_decision-1);
+    /* Pick the maximal softening length of i and j */
+    const float h = max(h_i, h_arr[pjd]);
+    const float h2 = h * h;
+    const float h_inv = 1.f / h;
+    const float h_inv_3 = h_inv * h_inv * h_inv;
+
+    /* Interact! */
+    float f_ij, pot_ij;
+    if (TRUNCATED)
+      iact_grav_pp_truncated(r2, h2, h_inv, h_inv_3, mass_arr[pjd], r_s_inv, &f_ij, &pot_ij);
+    else
+      iact_grav_pp_full(r2, h2, h_inv, h_inv_3, mass_arr[pjd], &f_ij, &pot_ij);
+
+    /* Store it back */
+    grav_accumulate<PRECISION>(&a_x, &c_x, f_ij, dx);
+    grav_accumulate<PRECISION>(&a_y, &c_y, f_ij, dy);
+    grav_accumulate<PRECISION>(&a_z, &c_z, f_ij, dz);
+    grav_accumulate<PRECISION>(&pot, &c_pot, pot_ij, 1.f);
+  }
+
+  if (ATOMIC) {
+    /* The pairs of the cell may be updating the same particles concurrently */
+    atomicAdd(&a_x_i[pid], a_x);
+    atomicAdd(&a_y_i[pid], a_y);
+    atomicAdd(&a_z_i[pid], a_z);
+    atomicAdd(&pot_i[pid], pot);
+  } else {
+    a_x_i[pid] = a_x;
+    a_y_i[pid] = a_y;
+    a_z_i[pid] = a_z;
+    pot_i[pid] = pot;
   }
-  
-  /*printf("gcount_i: %i ", gcount_i);
-  for (int i = 0; i < gcount_i; i++){
-  	printf("%.16f ", a_x_i[i]);}
-  printf("\n");*/
 }
 
-//PM FULL INTERACTIONS
-__device__ void grav_pm_full(int* active, int *mpole, const int gcount_padded_i, const float CoM_j[3], const struct multipole *multi_j, const int periodic, float dim_0, float dim_1, float dim_2, const float *x_i, const float *y_i, const float *z_i, int gcount_i, float *a_x_i, float *a_y_i, float *a_z_i, const float epsilon, float *pot_i, const int allow_multipole_j, const int allow_multipole_i, int ci_active, int cj_active, int symmetric, int max_r_decision) {
+//M2L INTERACTIONS
+//the three functions below are straight ports of
+//potential_derivatives_flip_signs(), potential_derivatives_compute_M2L() and
+//gravity_M2L_apply() such that the device gives the same field tensors as
+//the CPU
+__device__ void m2l_derivatives_flip_signs(struct potential_derivatives_M2L *pot) {
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 0
+  /* 1st order terms */
+  pot->D_100 = -pot->D_100;
+  pot->D_010 = -pot->D_010;
+  pot->D_001 = -pot->D_001;
+#endif
+
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 2
+  /* 3rd order terms */
+  pot->D_300 = -pot->D_300;
+  pot->D_030 = -pot->D_030;
+  pot->D_003 = -pot->D_003;
+  pot->D_210 = -pot->D_210;
+  pot->D_201 = -pot->D_201;
+  pot->D_021 = -pot->D_021;
+  pot->D_120 = -pot->D_120;
+  pot->D_012 = -pot->D_012;
+  pot->D_102 = -pot->D_102;
+  pot->D_111 = -pot->D_111;
+#endif
+
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 4
+  /* 5th order terms */
+  pot->D_500 = -pot->D_500;
+  pot->D_050 = -pot->D_050;
+  pot->D_005 = -pot->D_005;
+  pot->D_410 = -pot->D_410;
+  pot->D_401 = -pot->D_401;
+  pot->D_041 = -pot->D_041;
+  pot->D_140 = -pot->D_140;
+  pot->D_014 = -pot->D_014;
+  pot->D_104 = -pot->D_104;
+  pot->D_320 = -pot->D_320;
+  pot->D_302 = -pot->D_302;
+  pot->D_032 = -pot->D_032;
+  pot->D_230 = -pot->D_230;
+  pot->D_023 = -pot->D_023;
+  pot->D_203 = -pot->D_203;
+  pot->D_311 = -pot->D_311;
+  pot->D_131 = -pot->D_131;
+  pot->D_113 = -pot->D_113;
+  pot->D_122 = -pot->D_122;
+  pot->D_212 = -pot->D_212;
+  pot->D_221 = -pot->D_221;
+#endif
+}
 
-  int t = blockIdx.x*blockDim.x +threadIdx.x;
-  int T = blockDim.x*gridDim.x;
+__device__ void m2l_derivatives_compute(const float r_x, const float r_y, const float r_z, const float r2, const float r_inv, const float eps, const int periodic, const float r_s_inv, struct potential_derivatives_M2L *pot) {
 
-  /* Loop over all particles in ci... */
-  for (int pid = t; pid < gcount_padded_i; pid+=T) {
+  float Dt_1;
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 0
+  float Dt_2;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+  float Dt_3;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 2
+  float Dt_4;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 3
+  float Dt_5;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 4
+  float Dt_6;
+#endif
 
-    const float multi_epsilon = multi_j->max_softening;
+  /* Softened case */
+  if (r2 < eps * eps) {
 
-    /* Some powers of the softening length */
-    const float h_i = max(epsilon, multi_epsilon);
-    const float h_inv_i = 1.f / h_i;
+    const float eps_inv = 1.f / eps;
+    const float r = r2 * r_inv;
+    const float u = r * eps_inv;
 
-    /* Distance to the Multipole */
-    float dx = CoM_j[0] - x_i[pid];
-    float dy = CoM_j[1] - y_i[pid];
-    float dz = CoM_j[2] - z_i[pid];
+    Dt_1 = eps_inv * soft_1(u);
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 0
+    const float eps_inv2 = eps_inv * eps_inv;
+    Dt_2 = eps_inv2 * soft_2(u);
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+    const float eps_inv3 = eps_inv2 * eps_inv;
+    Dt_3 = eps_inv3 * soft_3(u);
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 2
+    const float eps_inv4 = eps_inv3 * eps_inv;
+    Dt_4 = eps_inv4 * soft_4(u);
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 3
+    const float eps_inv5 = eps_inv4 * eps_inv;
+    Dt_5 = eps_inv5 * soft_5(u);
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 4
+    const float eps_inv6 = eps_inv5 * eps_inv;
+    Dt_6 = eps_inv6 * soft_6(u);
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 5
+#error "Missing implementation for order >5"
+#endif
 
-    /* Apply periodic BCs? */
-    dx = nearestf1(dx, dim_0)*periodic;
-    dy = nearestf1(dy, dim_1)*periodic;
-    dz = nearestf1(dz, dim_2)*periodic;
+    /* Un-truncated un-softened case (Newtonian potential) */
+  } else if (!periodic) {
 
-    const float r2 = dx * dx + dy * dy + dz * dz;
+    Dt_1 = r_inv; /* 1 / r */
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+    Dt_2 = -1.f * Dt_1 * r_inv; /* -1 / r^2 */
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+    Dt_3 = -3.f * Dt_2 * r_inv; /* 3 / r^3 */
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 2
+    Dt_4 = -5.f * Dt_3 * r_inv; /* -15 / r^4 */
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 3
+    Dt_5 = -7.f * Dt_4 * r_inv; /* 105 / r^5 */
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 4
+    Dt_6 = -9.f * Dt_5 * r_inv; /* -945 / r^6 */
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 5
+#error "Missing implementation for order >5"
+#endif
 
-    /* Interact! */
-    float f_x, f_y, f_z, pot_ij;
-    iact_grav_pm_full(dx, dy, dz, r2, h_i, h_inv_i, multi_j, &f_x, &f_y, &f_z, &pot_ij);
+    /* Truncated case (long-range) */
+  } else {
 
-    /* Store it back */
-    /*a_x_i[pid] += f_x*active[pid]*mpole[pid]*ci_active*allow_multipole_j*abs(periodic-1);
-    a_y_i[pid] += f_y*active[pid]*mpole[pid]*ci_active*allow_multipole_j*abs(periodic-1);
-    a_z_i[pid] += f_z*active[pid]*mpole[pid]*ci_active*allow_multipole_j*abs(periodic-1);
-    pot_i[pid] += pot_ij*active[pid]*mpole[pid]*ci_active*allow_multipole_j*abs(periodic-1);
-
-    a_x_i[pid] += f_x*active[pid]*mpole[pid]*cj_active*symmetric*allow_multipole_i*abs(periodic-1);
-    a_y_i[pid] += f_y*active[pid]*mpole[pid]*cj_active*symmetric*allow_multipole_i*abs(periodic-1);
-    a_z_i[pid] += f_z*active[pid]*mpole[pid]*cj_active*symmetric*allow_multipole_i*abs(periodic-1);
-    pot_i[pid] += pot_ij*active[pid]*mpole[pid]*cj_active*symmetric*allow_multipole_i*abs(periodic-1);
-
-    a_x_i[pid] += f_x*active[pid]*mpole[pid]*ci_active*allow_multipole_j*periodic*max_r_decision;
-    a_y_i[pid] += f_y*active[pid]*mpole[pid]*ci_active*allow_multipole_j*periodic*max_r_decision;
-    a_z_i[pid] += f_z*active[pid]*mpole[pid]*ci_active*allow_multipole_j*periodic*max_r_decision;
-    pot_i[pid] += pot_ij*active[pid]*mpole[pid]*ci_active*allow_multipole_j*periodic*max_r_decision;
-
-    a_x_i[pid] += f_x*active[pid]*mpole[pid]*cj_active*symmetric*allow_multipole_i*periodic*max_r_decision;
-    a_y_i[pid] += f_y*active[pid]*mpole[pid]*cj_active*symmetric*allow_multipole_i*periodic*max_r_decision;
-    a_z_i[pid] += f_z*active[pid]*mpole[pid]*cj_active*symmetric*allow_multipole_i*periodic*max_r_decision;
-    pot_i[pid] += pot_ij*active[pid]*mpole[pid]*cj_active*symmetric*allow_multipole_i*periodic*max_r_decision;*/
-  }
-}
+    /* Get the derivatives of the truncated potential */
+    const float r = r2 * r_inv;
+    struct chi_derivatives derivs;
+    long_grav_derivatives(r, r_s_inv, &derivs);
 
-//PM TRUNCATED INTERACTIONS
-__device__ void grav_pm_truncated(int* active, int *mpole, const int gcount_padded_i, const float CoM_j[3], const struct multipole *multi_j, const int periodic, float dim_0, float dim_1, float dim_2, float r_s_inv, const float *x_i, const float *y_i, const float *z_i, int gcount_i, float *a_x_i, float *a_y_i, float *a_z_i, const float epsilon, float *pot_i, const int allow_multipole_j, const int allow_multipole_i, int ci_active, int cj_active, int symmetric, int max_r_decision) {
+    Dt_1 = derivs.chi_0 * r_inv;
 
-  int t = blockIdx.x*blockDim.x +threadIdx.x;
-  int T = blockDim.x*gridDim.x;
-  const float multi_epsilon = multi_j->max_softening;
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 0
 
-  /* Loop over all particles in ci... */
-  for (int pid = t; pid < gcount_padded_i; pid+=T) {
+    /* -chi^0 r_i^2 + chi^1 r_i^1 */
+    Dt_2 = derivs.chi_1 - derivs.chi_0 * r_inv;
+    Dt_2 = Dt_2 * r_inv;
 
-    /* Some powers of the softening length */
-    const float h_i = max(epsilon, multi_epsilon);
-    const float h_inv_i = 1.f / h_i;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
 
-    /* Distance to the Multipole */
-    float dx = CoM_j[0] - x_i[pid];
-    float dy = CoM_j[1] - y_i[pid];
-    float dz = CoM_j[2] - z_i[pid];
+    /* 3chi^0 r_i^3 - 3 chi^1 r_i^2 + chi^2 r_i^1 */
+    Dt_3 = derivs.chi_0 * r_inv - derivs.chi_1;
+    Dt_3 = Dt_3 * 3.f;
+    Dt_3 = Dt_3 * r_inv + derivs.chi_2;
+    Dt_3 = Dt_3 * r_inv;
 
-    /* Apply periodic BCs */
-    dx = nearestf1(dx, dim_0);
-    dy = nearestf1(dy, dim_1);
-    dz = nearestf1(dz, dim_2);
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 2
 
-    const float r2 = dx * dx + dy * dy + dz * dz;
+    /* -15chi^0 r_i^4 + 15 chi^1 r_i^3 - 6 chi^2 r_i^2  + chi^3 r_i^1 */
+    Dt_4 = -derivs.chi_0 * r_inv + derivs.chi_1;
+    Dt_4 = Dt_4 * 15.f;
+    Dt_4 = Dt_4 * r_inv - 6.f * derivs.chi_2;
+    Dt_4 = Dt_4 * r_inv + derivs.chi_3;
+    Dt_4 = Dt_4 * r_inv;
 
-    /* Interact! */
-    float f_x, f_y, f_z, pot_ij;
-    iact_grav_pm_truncated(dx, dy, dz, r2, h_i, h_inv_i, r_s_inv, multi_j, &f_x, &f_y, &f_z, &pot_ij);
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 3
 
-    /* Store it back */
-    /*a_x_i[pid] += f_x*active[pid]*mpole[pid]*ci_active*allow_multipole_j*periodic*abs(max_r_decision-1);
-    a_y_i[pid] += f_y*active[pid]*mpole[pid]*ci_active*allow_multipole_j*periodic*abs(max_r_decision-1);
-    a_z_i[pid] += f_z*active[pid]*mpole[pid]*ci_active*allow_multipole_j*periodic*abs(max_r_decision-1);
-    pot_i[pid] += pot_ij*active[pid]*mpole[pid]*ci_active*allow_multipole_j*periodic*abs(max_r_decision-1);
-
-    a_x_i[pid] += f_x*active[pid]*mpole[pid]*cj_active*symmetric*allow_multipole_i*periodic*abs(max_r_decision-1);
-    a_y_i[pid] += f_y*active[pid]*mpole[pid]*cj_active*symmetric*allow_multipole_i*periodic*abs(max_r_decision-1);
-    a_z_i[pid] += f_z*active[pid]*mpole[pid]*cj_active*symmetric*allow_multipole_i*periodic*abs(max_r_decision-1);
-    pot_i[pid] += pot_ij*active[pid]*mpole[pid]*cj_active*symmetric*allow_multipole_i*periodic*abs(max_r_decision-1);*/
+    /* 105chi^0 r_i^5 - 105 chi^1 r_i^4 + 45 chi^2 r_i^3 - 10 chi^3 r_i^2 +
+     * chi^4 r_i^1 */
+    Dt_5 = derivs.chi_0 * r_inv - derivs.chi_1;
+    Dt_5 = Dt_5 * 105.f;
+    Dt_5 = Dt_5 * r_inv + 45.f * derivs.chi_2;
+    Dt_5 = Dt_5 * r_inv - 10.f * derivs.chi_3;
+    Dt_5 = Dt_5 * r_inv + derivs.chi_4;
+    Dt_5 = Dt_5 * r_inv;
+
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 4
+
+    /* -945chi^0 r_i^6 + 945 chi^1 r_i^5 - 420 chi^2 r_i^4 + 105 chi^3 r_i^3 -
+     * 15 chi^4 r_i^2 + chi^5 r_i^1 */
+    Dt_6 = -derivs.chi_0 * r_inv + derivs.chi_1;
+    Dt_6 = Dt_6 * 945.f;
+    Dt_6 = Dt_6 * r_inv - 420.f * derivs.chi_2;
+    Dt_6 = Dt_6 * r_inv + 105.f * derivs.chi_3;
+    Dt_6 = Dt_6 * r_inv - 15.f * derivs.chi_4;
+    Dt_6 = Dt_6 * r_inv + derivs.chi_5;
+    Dt_6 = Dt_6 * r_inv;
+
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 5
+#error "Missing implementation for order >5"
+#endif
   }
-}
 
+  /* Alright, let's get the full terms */
+
+  /* Compute some powers of (r_x / r), (r_y / r) and (r_z / r) */
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 0
+  const float rx_r = r_x * r_inv;
+  const float ry_r = r_y * r_inv;
+  const float rz_r = r_z * r_inv;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+  const float rx_r2 = rx_r * rx_r;
+  const float ry_r2 = ry_r * ry_r;
+  const float rz_r2 = rz_r * rz_r;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 2
+  const float rx_r3 = rx_r2 * rx_r;
+  const float ry_r3 = ry_r2 * ry_r;
+  const float rz_r3 = rz_r2 * rz_r;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 3
+  const float rx_r4 = rx_r3 * rx_r;
+  const float ry_r4 = ry_r3 * ry_r;
+  const float rz_r4 = rz_r3 * rz_r;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 4
+  const float rx_r5 = rx_r4 * rx_r;
+  const float ry_r5 = ry_r4 * ry_r;
+  const float rz_r5 = rz_r4 * rz_r;
+#endif
+
+  /* Get the 0th order term */
+  pot->D_000 = Dt_1;
+
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+  /* 1st order derivatives */
+  pot->D_100 = rx_r * Dt_2;
+  pot->D_010 = ry_r * Dt_2;
+  pot->D_001 = rz_r * Dt_2;
+#endif
+
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+
+  Dt_2 *= r_inv;
+
+  /* 2nd order derivatives */
+  pot->D_200 = rx_r2 * Dt_3 + Dt_2;
+  pot->D_020 = ry_r2 * Dt_3 + Dt_2;
+  pot->D_002 = rz_r2 * Dt_3 + Dt_2;
+  pot->D_110 = rx_r * ry_r * Dt_3;
+  pot->D_101 = rx_r * rz_r * Dt_3;
+  pot->D_011 = ry_r * rz_r * Dt_3;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 2
+
+  Dt_3 *= r_inv;
+
+  /* 3rd order derivatives */
+  pot->D_300 = rx_r3 * Dt_4 + 3.f * rx_r * Dt_3;
+  pot->D_030 = ry_r3 * Dt_4 + 3.f * ry_r * Dt_3;
+  pot->D_003 = rz_r3 * Dt_4 + 3.f * rz_r * Dt_3;
+  pot->D_210 = rx_r2 * ry_r * Dt_4 + ry_r * Dt_3;
+  pot->D_201 = rx_r2 * rz_r * Dt_4 + rz_r * Dt_3;
+  pot->D_120 = ry_r2 * rx_r * Dt_4 + rx_r * Dt_3;
+  pot->D_021 = ry_r2 * rz_r * Dt_4 + rz_r * Dt_3;
+  pot->D_102 = rz_r2 * rx_r * Dt_4 + rx_r * Dt_3;
+  pot->D_012 = rz_r2 * ry_r * Dt_4 + ry_r * Dt_3;
+  pot->D_111 = rx_r * ry_r * rz_r * Dt_4;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 3
+
+  Dt_3 *= r_inv;
+  Dt_4 *= r_inv;
 
+  /* 4th order derivatives */
+  pot->D_400 = rx_r4 * Dt_5 + 6.f * rx_r2 * Dt_4 + 3.f * Dt_3;
+  pot->D_040 = ry_r4 * Dt_5 + 6.f * ry_r2 * Dt_4 + 3.f * Dt_3;
+  pot->D_004 = rz_r4 * Dt_5 + 6.f * rz_r2 * Dt_4 + 3.f * Dt_3;
+  pot->D_310 = rx_r3 * ry_r * Dt_5 + 3.f * rx_r * ry_r * Dt_4;
+  pot->D_301 = rx_r3 * rz_r * Dt_5 + 3.f * rx_r * rz_r * Dt_4;
+  pot->D_130 = ry_r3 * rx_r * Dt_5 + 3.f * ry_r * rx_r * Dt_4;
+  pot->D_031 = ry_r3 * rz_r * Dt_5 + 3.f * ry_r * rz_r * Dt_4;
+  pot->D_103 = rz_r3 * rx_r * Dt_5 + 3.f * rz_r * rx_r * Dt_4;
+  pot->D_013 = rz_r3 * ry_r * Dt_5 + 3.f * rz_r * ry_r * Dt_4;
+  pot->D_220 = rx_r2 * ry_r2 * Dt_5 + rx_r2 * Dt_4 + ry_r2 * Dt_4 + Dt_3;
+  pot->D_202 = rx_r2 * rz_r2 * Dt_5 + rx_r2 * Dt_4 + rz_r2 * Dt_4 + Dt_3;
+  pot->D_022 = ry_r2 * rz_r2 * Dt_5 + ry_r2 * Dt_4 + rz_r2 * Dt_4 + Dt_3;
+  pot->D_211 = rx_r2 * ry_r * rz_r * Dt_5 + ry_r * rz_r * Dt_4;
+  pot->D_121 = ry_r2 * rx_r * rz_r * Dt_5 + rx_r * rz_r * Dt_4;
+  pot->D_112 = rz_r2 * rx_r * ry_r * Dt_5 + rx_r * ry_r * Dt_4;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 4
+
+  Dt_4 *= r_inv;
+  Dt_5 *= r_inv;
+
+  /* 5th order derivatives */
+  pot->D_500 = rx_r5 * Dt_6 + 10.f * rx_r3 * Dt_5 + 15.f * rx_r * Dt_4;
+  pot->D_050 = ry_r5 * Dt_6 + 10.f * ry_r3 * Dt_5 + 15.f * ry_r * Dt_4;
+  pot->D_005 = rz_r5 * Dt_6 + 10.f * rz_r3 * Dt_5 + 15.f * rz_r * Dt_4;
+  pot->D_410 =
+      rx_r4 * ry_r * Dt_6 + 6.f * rx_r2 * ry_r * Dt_5 + 3.f * ry_r * Dt_4;
+  pot->D_401 =
+      rx_r4 * rz_r * Dt_6 + 6.f * rx_r2 * rz_r * Dt_5 + 3.f * rz_r * Dt_4;
+  pot->D_140 =
+      ry_r4 * rx_r * Dt_6 + 6.f * ry_r2 * rx_r * Dt_5 + 3.f * rx_r * Dt_4;
+  pot->D_041 =
+      ry_r4 * rz_r * Dt_6 + 6.f * ry_r2 * rz_r * Dt_5 + 3.f * rz_r * Dt_4;
+  pot->D_104 =
+      rz_r4 * rx_r * Dt_6 + 6.f * rz_r2 * rx_r * Dt_5 + 3.f * rx_r * Dt_4;
+  pot->D_014 =
+      rz_r4 * ry_r * Dt_6 + 6.f * rz_r2 * ry_r * Dt_5 + 3.f * ry_r * Dt_4;
+  pot->D_320 = rx_r3 * ry_r2 * Dt_6 + rx_r3 * Dt_5 + 3.f * rx_r * ry_r2 * Dt_5 +
+               3.f * rx_r * Dt_4;
+  pot->D_302 = rx_r3 * rz_r2 * Dt_6 + rx_r3 * Dt_5 + 3.f * rx_r * rz_r2 * Dt_5 +
+               3.f * rx_r * Dt_4;
+  pot->D_230 = ry_r3 * rx_r2 * Dt_6 + ry_r3 * Dt_5 + 3.f * ry_r * rx_r2 * Dt_5 +
+               3.f * ry_r * Dt_4;
+  pot->D_032 = ry_r3 * rz_r2 * Dt_6 + ry_r3 * Dt_5 + 3.f * ry_r * rz_r2 * Dt_5 +
+               3.f * ry_r * Dt_4;
+  pot->D_203 = rz_r3 * rx_r2 * Dt_6 + rz_r3 * Dt_5 + 3.f * rz_r * rx_r2 * Dt_5 +
+               3.f * rz_r * Dt_4;
+  pot->D_023 = rz_r3 * ry_r2 * Dt_6 + rz_r3 * Dt_5 + 3.f * rz_r * ry_r2 * Dt_5 +
+               3.f * rz_r * Dt_4;
+  pot->D_311 = rx_r3 * ry_r * rz_r * Dt_6 + 3.f * rx_r * ry_r * rz_r * Dt_5;
+  pot->D_131 = ry_r3 * rx_r * rz_r * Dt_6 + 3.f * rx_r * ry_r * rz_r * Dt_5;
+  pot->D_113 = rz_r3 * rx_r * ry_r * Dt_6 + 3.f * rx_r * ry_r * rz_r * Dt_5;
+  pot->D_122 = rx_r * ry_r2 * rz_r2 * Dt_6 + rx_r * ry_r2 * Dt_5 +
+               rx_r * rz_r2 * Dt_5 + rx_r * Dt_4;
+  pot->D_212 = ry_r * rx_r2 * rz_r2 * Dt_6 + ry_r * rx_r2 * Dt_5 +
+               ry_r * rz_r2 * Dt_5 + ry_r * Dt_4;
+  pot->D_221 = rz_r * rx_r2 * ry_r2 * Dt_6 + rz_r * rx_r2 * Dt_5 +
+               rz_r * ry_r2 * Dt_5 + rz_r * Dt_4;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 5
+#error "Missing implementation for orders >5"
+#endif
+}
+
+//the interaction counters are left to the host
+__device__ void gravity_M2L_apply(struct grav_tensor *restrict l_b, const struct multipole *restrict m_a, const struct potential_derivatives_M2L *pot) {
+
+  /* Record that this tensor has received contributions */
+  l_b->interacted = 1;
+
+  const float M_000 = m_a->M_000;
+  const float D_000 = pot->D_000;
+
+  /*  0th order term */
+  l_b->F_000 += M_000 * D_000;
+
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 0
+
+  /* The dipole term is zero when using the CoM */
+  /* The compiler will optimize out the terms in the equations */
+  /* below. We keep them written to maintain the logical structure. */
+  const float M_100 = 0.f;
+  const float M_010 = 0.f;
+  const float M_001 = 0.f;
+
+  const float D_100 = pot->D_100;
+  const float D_010 = pot->D_010;
+  const float D_001 = pot->D_001;
+
+  /*  1st order multipole term (addition to rank 0)*/
+  l_b->F_000 += M_100 * D_100 + M_010 * D_010 + M_001 * D_001;
+
+  /*  1st order multipole term (addition to rank 1)*/
+  l_b->F_100 += M_000 * D_100;
+  l_b->F_010 += M_000 * D_010;
+  l_b->F_001 += M_000 * D_001;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+
+  const float M_200 = m_a->M_200;
+  const float M_020 = m_a->M_020;
+  const float M_002 = m_a->M_002;
+  const float M_110 = m_a->M_110;
+  const float M_101 = m_a->M_101;
+  const float M_011 = m_a->M_011;
+
+  const float D_200 = pot->D_200;
+  const float D_020 = pot->D_020;
+  const float D_002 = pot->D_002;
+  const float D_110 = pot->D_110;
+  const float D_101 = pot->D_101;
+  const float D_011 = pot->D_011;
+
+  /*  2nd order multipole term (addition to rank 0)*/
+  l_b->F_000 += M_200 * D_200 + M_020 * D_020 + M_002 * D_002;
+  l_b->F_000 += M_110 * D_110 + M_101 * D_101 + M_011 * D_011;
+
+  /*  2nd order multipole term (addition to rank 1)*/
+  l_b->F_100 += M_100 * D_200 + M_010 * D_110 + M_001 * D_101;
+  l_b->F_010 += M_100 * D_110 + M_010 * D_020 + M_001 * D_011;
+  l_b->F_001 += M_100 * D_101 + M_010 * D_011 + M_001 * D_002;
+
+  /*  2nd order multipole term (addition to rank 2)*/
+  l_b->F_200 += M_000 * D_200;
+  l_b->F_020 += M_000 * D_020;
+  l_b->F_002 += M_000 * D_002;
+  l_b->F_110 += M_000 * D_110;
+  l_b->F_101 += M_000 * D_101;
+  l_b->F_011 += M_000 * D_011;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 2
+
+  const float M_300 = m_a->M_300;
+  const float M_030 = m_a->M_030;
+  const float M_003 = m_a->M_003;
+  const float M_210 = m_a->M_210;
+  const float M_201 = m_a->M_201;
+  const float M_021 = m_a->M_021;
+  const float M_120 = m_a->M_120;
+  const float M_012 = m_a->M_012;
+  const float M_102 = m_a->M_102;
+  const float M_111 = m_a->M_111;
+
+  const float D_300 = pot->D_300;
+  const float D_030 = pot->D_030;
+  const float D_003 = pot->D_003;
+  const float D_210 = pot->D_210;
+  const float D_201 = pot->D_201;
+  const float D_021 = pot->D_021;
+  const float D_120 = pot->D_120;
+  const float D_012 = pot->D_012;
+  const float D_102 = pot->D_102;
+  const float D_111 = pot->D_111;
+
+  /*  3rd order multipole term (addition to rank 0)*/
+  l_b->F_000 += M_300 * D_300 + M_030 * D_030 + M_003 * D_003;
+  l_b->F_000 += M_210 * D_210 + M_201 * D_201 + M_120 * D_120;
+  l_b->F_000 += M_021 * D_021 + M_102 * D_102 + M_012 * D_012;
+  l_b->F_000 += M_111 * D_111;
+
+  /*  3rd order multipole term (addition to rank 1)*/
+  l_b->F_100 += M_200 * D_300 + M_020 * D_120 + M_002 * D_102;
+  l_b->F_100 += M_110 * D_210 + M_101 * D_201 + M_011 * D_111;
+  l_b->F_010 += M_200 * D_210 + M_020 * D_030 + M_002 * D_012;
+  l_b->F_010 += M_110 * D_120 + M_101 * D_111 + M_011 * D_021;
+  l_b->F_001 += M_200 * D_201 + M_020 * D_021 + M_002 * D_003;
+  l_b->F_001 += M_110 * D_111 + M_101 * D_102 + M_011 * D_012;
+
+  /*  3rd order multipole term (addition to rank 2)*/
+  l_b->F_200 += M_100 * D_300 + M_010 * D_210 + M_001 * D_201;
+  l_b->F_020 += M_100 * D_120 + M_010 * D_030 + M_001 * D_021;
+  l_b->F_002 += M_100 * D_102 + M_010 * D_012 + M_001 * D_003;
+  l_b->F_110 += M_100 * D_210 + M_010 * D_120 + M_001 * D_111;
+  l_b->F_101 += M_100 * D_201 + M_010 * D_111 + M_001 * D_102;
+  l_b->F_011 += M_100 * D_111 + M_010 * D_021 + M_001 * D_012;
+
+  /*  3rd order multipole term (addition to rank 3)*/
+  l_b->F_300 += M_000 * D_300;
+  l_b->F_030 += M_000 * D_030;
+  l_b->F_003 += M_000 * D_003;
+  l_b->F_210 += M_000 * D_210;
+  l_b->F_201 += M_000 * D_201;
+  l_b->F_120 += M_000 * D_120;
+  l_b->F_021 += M_000 * D_021;
+  l_b->F_102 += M_000 * D_102;
+  l_b->F_012 += M_000 * D_012;
+  l_b->F_111 += M_000 * D_111;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 3
+
+  const float M_400 = m_a->M_400;
+  const float M_040 = m_a->M_040;
+  const float M_004 = m_a->M_004;
+  const float M_310 = m_a->M_310;
+  const float M_301 = m_a->M_301;
+  const float M_031 = m_a->M_031;
+  const float M_130 = m_a->M_130;
+  const float M_013 = m_a->M_013;
+  const float M_103 = m_a->M_103;
+  const float M_220 = m_a->M_220;
+  const float M_202 = m_a->M_202;
+  const float M_022 = m_a->M_022;
+  const float M_211 = m_a->M_211;
+  const float M_121 = m_a->M_121;
+  const float M_112 = m_a->M_112;
+
+  const float D_400 = pot->D_400;
+  const float D_040 = pot->D_040;
+  const float D_004 = pot->D_004;
+  const float D_310 = pot->D_310;
+  const float D_301 = pot->D_301;
+  const float D_031 = pot->D_031;
+  const float D_130 = pot->D_130;
+  const float D_013 = pot->D_013;
+  const float D_103 = pot->D_103;
+  const float D_220 = pot->D_220;
+  const float D_202 = pot->D_202;
+  const float D_022 = pot->D_022;
+  const float D_211 = pot->D_211;
+  const float D_121 = pot->D_121;
+  const float D_112 = pot->D_112;
+
+  /* Compute 4th order field tensor terms (addition to rank 0) */
+  l_b->F_000 += M_004 * D_004 + M_013 * D_013 + M_022 * D_022 + M_031 * D_031 +
+                M_040 * D_040 + M_103 * D_103 + M_112 * D_112 + M_121 * D_121 +
+                M_130 * D_130 + M_202 * D_202 + M_211 * D_211 + M_220 * D_220 +
+                M_301 * D_301 + M_310 * D_310 + M_400 * D_400;
+
+  /* Compute 4th order field tensor terms (addition to rank 1) */
+  l_b->F_001 += M_003 * D_004 + M_012 * D_013 + M_021 * D_022 + M_030 * D_031 +
+                M_102 * D_103 + M_111 * D_112 + M_120 * D_121 + M_201 * D_202 +
+                M_210 * D_211 + M_300 * D_301;
+  l_b->F_010 += M_003 * D_013 + M_012 * D_022 + M_021 * D_031 + M_030 * D_040 +
+                M_102 * D_112 + M_111 * D_121 + M_120 * D_130 + M_201 * D_211 +
+                M_210 * D_220 + M_300 * D_310;
+  l_b->F_100 += M_003 * D_103 + M_012 * D_112 + M_021 * D_121 + M_030 * D_130 +
+                M_102 * D_202 + M_111 * D_211 + M_120 * D_220 + M_201 * D_301 +
+                M_210 * D_310 + M_300 * D_400;
+
+  /* Compute 4th order field tensor terms (addition to rank 2) */
+  l_b->F_002 += M_002 * D_004 + M_011 * D_013 + M_020 * D_022 + M_101 * D_103 +
+                M_110 * D_112 + M_200 * D_202;
+  l_b->F_011 += M_002 * D_013 + M_011 * D_022 + M_020 * D_031 + M_101 * D_112 +
+                M_110 * D_121 + M_200 * D_211;
+  l_b->F_020 += M_002 * D_022 + M_011 * D_031 + M_020 * D_040 + M_101 * D_121 +
+                M_110 * D_130 + M_200 * D_220;
+  l_b->F_101 += M_002 * D_103 + M_011 * D_112 + M_020 * D_121 + M_101 * D_202 +
+                M_110 * D_211 + M_200 * D_301;
+  l_b->F_110 += M_002 * D_112 + M_011 * D_121 + M_020 * D_130 + M_101 * D_211 +
+                M_110 * D_220 + M_200 * D_310;
+  l_b->F_200 += M_002 * D_202 + M_011 * D_211 + M_020 * D_220 + M_101 * D_301 +
+                M_110 * D_310 + M_200 * D_400;
+
+  /* Compute 4th order field tensor terms (addition to rank 3) */
+  l_b->F_003 += M_001 * D_004 + M_010 * D_013 + M_100 * D_103;
+  l_b->F_012 += M_001 * D_013 + M_010 * D_022 + M_100 * D_112;
+  l_b->F_021 += M_001 * D_022 + M_010 * D_031 + M_100 * D_121;
+  l_b->F_030 += M_001 * D_031 + M_010 * D_040 + M_100 * D_130;
+  l_b->F_102 += M_001 * D_103 + M_010 * D_112 + M_100 * D_202;
+  l_b->F_111 += M_001 * D_112 + M_010 * D_121 + M_100 * D_211;
+  l_b->F_120 += M_001 * D_121 + M_010 * D_130 + M_100 * D_220;
+  l_b->F_201 += M_001 * D_202 + M_010 * D_211 + M_100 * D_301;
+  l_b->F_210 += M_001 * D_211 + M_010 * D_220 + M_100 * D_310;
+  l_b->F_300 += M_001 * D_301 + M_010 * D_310 + M_100 * D_400;
+
+  /* Compute 4th order field tensor terms (addition to rank 4) */
+  l_b->F_004 += M_000 * D_004;
+  l_b->F_013 += M_000 * D_013;
+  l_b->F_022 += M_000 * D_022;
+  l_b->F_031 += M_000 * D_031;
+  l_b->F_040 += M_000 * D_040;
+  l_b->F_103 += M_000 * D_103;
+  l_b->F_112 += M_000 * D_112;
+  l_b->F_121 += M_000 * D_121;
+  l_b->F_130 += M_000 * D_130;
+  l_b->F_202 += M_000 * D_202;
+  l_b->F_211 += M_000 * D_211;
+  l_b->F_220 += M_000 * D_220;
+  l_b->F_301 += M_000 * D_301;
+  l_b->F_310 += M_000 * D_310;
+  l_b->F_400 += M_000 * D_400;
+
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 4
+
+  const float M_500 = m_a->M_500;
+  const float M_050 = m_a->M_050;
+  const float M_005 = m_a->M_005;
+  const float M_410 = m_a->M_410;
+  const float M_401 = m_a->M_401;
+  const float M_041 = m_a->M_041;
+  const float M_140 = m_a->M_140;
+  const float M_014 = m_a->M_014;
+  const float M_104 = m_a->M_104;
+  const float M_320 = m_a->M_320;
+  const float M_302 = m_a->M_302;
+  const float M_230 = m_a->M_230;
+  const float M_032 = m_a->M_032;
+  const float M_203 = m_a->M_203;
+  const float M_023 = m_a->M_023;
+  const float M_122 = m_a->M_122;
+  const float M_212 = m_a->M_212;
+  const float M_221 = m_a->M_221;
+  const float M_311 = m_a->M_311;
+  const float M_131 = m_a->M_131;
+  const float M_113 = m_a->M_113;
+
+  const float D_500 = pot->D_500;
+  const float D_050 = pot->D_050;
+  const float D_005 = pot->D_005;
+  const float D_410 = pot->D_410;
+  const float D_401 = pot->D_401;
+  const float D_041 = pot->D_041;
+  const float D_140 = pot->D_140;
+  const float D_014 = pot->D_014;
+  const float D_104 = pot->D_104;
+  const float D_320 = pot->D_320;
+  const float D_302 = pot->D_302;
+  const float D_230 = pot->D_230;
+  const float D_032 = pot->D_032;
+  const float D_203 = pot->D_203;
+  const float D_023 = pot->D_023;
+  const float D_122 = pot->D_122;
+  const float D_212 = pot->D_212;
+  const float D_221 = pot->D_221;
+  const float D_311 = pot->D_311;
+  const float D_131 = pot->D_131;
+  const float D_113 = pot->D_113;
+
+  /* Compute 5th order field tensor terms (addition to rank 0) */
+  l_b->F_000 += M_005 * D_005 + M_014 * D_014 + M_023 * D_023 + M_032 * D_032 +
+                M_041 * D_041 + M_050 * D_050 + M_104 * D_104 + M_113 * D_113 +
+                M_122 * D_122 + M_131 * D_131 + M_140 * D_140 + M_203 * D_203 +
+                M_212 * D_212 + M_221 * D_221 + M_230 * D_230 + M_302 * D_302 +
+                M_311 * D_311 + M_320 * D_320 + M_401 * D_401 + M_410 * D_410 +
+                M_500 * D_500;
+
+  /* Compute 5th order field tensor terms (addition to rank 1) */
+  l_b->F_001 += M_004 * D_005 + M_013 * D_014 + M_022 * D_023 + M_031 * D_032 +
+                M_040 * D_041 + M_103 * D_104 + M_112 * D_113 + M_121 * D_122 +
+                M_130 * D_131 + M_202 * D_203 + M_211 * D_212 + M_220 * D_221 +
+                M_301 * D_302 + M_310 * D_311 + M_400 * D_401;
+  l_b->F_010 += M_004 * D_014 + M_013 * D_023 + M_022 * D_032 + M_031 * D_041 +
+                M_040 * D_050 + M_103 * D_113 + M_112 * D_122 + M_121 * D_131 +
+                M_130 * D_140 + M_202 * D_212 + M_211 * D_221 + M_220 * D_230 +
+                M_301 * D_311 + M_310 * D_320 + M_400 * D_410;
+  l_b->F_100 += M_004 * D_104 + M_013 * D_113 + M_022 * D_122 + M_031 * D_131 +
+                M_040 * D_140 + M_103 * D_203 + M_112 * D_212 + M_121 * D_221 +
+                M_130 * D_230 + M_202 * D_302 + M_211 * D_311 + M_220 * D_320 +
+                M_301 * D_401 + M_310 * D_410 + M_400 * D_500;
+
+  /* Compute 5th order field tensor terms (addition to rank 2) */
+  l_b->F_002 += M_003 * D_005 + M_012 * D_014 + M_021 * D_023 + M_030 * D_032 +
+                M_102 * D_104 + M_111 * D_113 + M_120 * D_122 + M_201 * D_203 +
+                M_210 * D_212 + M_300 * D_302;
+  l_b->F_011 += M_003 * D_014 + M_012 * D_023 + M_021 * D_032 + M_030 * D_041 +
+                M_102 * D_113 + M_111 * D_122 + M_120 * D_131 + M_201 * D_212 +
+                M_210 * D_221 + M_300 * D_311;
+  l_b->F_020 += M_003 * D_023 + M_012 * D_032 + M_021 * D_041 + M_030 * D_050 +
+                M_102 * D_122 + M_111 * D_131 + M_120 * D_140 + M_201 * D_221 +
+                M_210 * D_230 + M_300 * D_320;
+  l_b->F_101 += M_003 * D_104 + M_012 * D_113 + M_021 * D_122 + M_030 * D_131 +
+                M_102 * D_203 + M_111 * D_212 + M_120 * D_221 + M_201 * D_302 +
+                M_210 * D_311 + M_300 * D_401;
+  l_b->F_110 += M_003 * D_113 + M_012 * D_122 + M_021 * D_131 + M_030 * D_140 +
+                M_102 * D_212 + M_111 * D_221 + M_120 * D_230 + M_201 * D_311 +
+                M_210 * D_320 + M_300 * D_410;
+  l_b->F_200 += M_003 * D_203 + M_012 * D_212 + M_021 * D_221 + M_030 * D_230 +
+                M_102 * D_302 + M_111 * D_311 + M_120 * D_320 + M_201 * D_401 +
+                M_210 * D_410 + M_300 * D_500;
+
+  /* Compute 5th order field tensor terms (addition to rank 3) */
+  l_b->F_003 += M_002 * D_005 + M_011 * D_014 + M_020 * D_023 + M_101 * D_104 +
+                M_110 * D_113 + M_200 * D_203;
+  l_b->F_012 += M_002 * D_014 + M_011 * D_023 + M_020 * D_032 + M_101 * D_113 +
+                M_110 * D_122 + M_200 * D_212;
+  l_b->F_021 += M_002 * D_023 + M_011 * D_032 + M_020 * D_041 + M_101 * D_122 +
+                M_110 * D_131 + M_200 * D_221;
+  l_b->F_030 += M_002 * D_032 + M_011 * D_041 + M_020 * D_050 + M_101 * D_131 +
+                M_110 * D_140 + M_200 * D_230;
+  l_b->F_102 += M_002 * D_104 + M_011 * D_113 + M_020 * D_122 + M_101 * D_203 +
+                M_110 * D_212 + M_200 * D_302;
+  l_b->F_111 += M_002 * D_113 + M_011 * D_122 + M_020 * D_131 + M_101 * D_212 +
+                M_110 * D_221 + M_200 * D_311;
+  l_b->F_120 += M_002 * D_122 + M_011 * D_131 + M_020 * D_140 + M_101 * D_221 +
+                M_110 * D_230 + M_200 * D_320;
+  l_b->F_201 += M_002 * D_203 + M_011 * D_212 + M_020 * D_221 + M_101 * D_302 +
+                M_110 * D_311 + M_200 * D_401;
+  l_b->F_210 += M_002 * D_212 + M_011 * D_221 + M_020 * D_230 + M_101 * D_311 +
+                M_110 * D_320 + M_200 * D_410;
+  l_b->F_300 += M_002 * D_302 + M_011 * D_311 + M_020 * D_320 + M_101 * D_401 +
+                M_110 * D_410 + M_200 * D_500;
+
+  /* Compute 5th order field tensor terms (addition to rank 4) */
+  l_b->F_004 += M_001 * D_005 + M_010 * D_014 + M_100 * D_104;
+  l_b->F_013 += M_001 * D_014 + M_010 * D_023 + M_100 * D_113;
+  l_b->F_022 += M_001 * D_023 + M_010 * D_032 + M_100 * D_122;
+  l_b->F_031 += M_001 * D_032 + M_010 * D_041 + M_100 * D_131;
+  l_b->F_040 += M_001 * D_041 + M_010 * D_050 + M_100 * D_140;
+  l_b->F_103 += M_001 * D_104 + M_010 * D_113 + M_100 * D_203;
+  l_b->F_112 += M_001 * D_113 + M_010 * D_122 + M_100 * D_212;
+  l_b->F_121 += M_001 * D_122 + M_010 * D_131 + M_100 * D_221;
+  l_b->F_130 += M_001 * D_131 + M_010 * D_140 + M_100 * D_230;
+  l_b->F_202 += M_001 * D_203 + M_010 * D_212 + M_100 * D_302;
+  l_b->F_211 += M_001 * D_212 + M_010 * D_221 + M_100 * D_311;
+  l_b->F_220 += M_001 * D_221 + M_010 * D_230 + M_100 * D_320;
+  l_b->F_301 += M_001 * D_302 + M_010 * D_311 + M_100 * D_401;
+  l_b->F_310 += M_001 * D_311 + M_010 * D_320 + M_100 * D_410;
+  l_b->F_400 += M_001 * D_401 + M_010 * D_410 + M_100 * D_500;
+
+  /* Compute 5th order field tensor terms (addition to rank 5) */
+  l_b->F_005 += M_000 * D_005;
+  l_b->F_014 += M_000 * D_014;
+  l_b->F_023 += M_000 * D_023;
+  l_b->F_032 += M_000 * D_032;
+  l_b->F_041 += M_000 * D_041;
+  l_b->F_050 += M_000 * D_050;
+  l_b->F_104 += M_000 * D_104;
+  l_b->F_113 += M_000 * D_113;
+  l_b->F_122 += M_000 * D_122;
+  l_b->F_131 += M_000 * D_131;
+  l_b->F_140 += M_000 * D_140;
+  l_b->F_203 += M_000 * D_203;
+  l_b->F_212 += M_000 * D_212;
+  l_b->F_221 += M_000 * D_221;
+  l_b->F_230 += M_000 * D_230;
+  l_b->F_302 += M_000 * D_302;
+  l_b->F_311 += M_000 * D_311;
+  l_b->F_320 += M_000 * D_320;
+  l_b->F_401 += M_000 * D_401;
+  l_b->F_410 += M_000 * D_410;
+  l_b->F_500 += M_000 * D_500;
+
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 5
+#error "Missing implementation for order >5"
+#endif
+}
+
+//MULTIPOLE CONSTRUCTION
+//straight ports of the vector powers, gravity_multipole_add(),
+//gravity_multipole_compute_power(), gravity_M2M() and (on the SoA copy of the
+//gparts) gravity_P2M() such that the device builds the same multipoles as
+//the CPU. The operations are done in the same order and the file is built
+//with -fmad=false
+
+__device__ __forceinline__ double X_000(const double v[3]) {
+
+  return 1.;
+}
+
+__device__ __forceinline__ double X_100(const double v[3]) {
+
+  return v[0];
+}
+
+__device__ __forceinline__ double X_010(const double v[3]) {
+
+  return v[1];
+}
+
+__device__ __forceinline__ double X_001(const double v[3]) {
+
+  return v[2];
+}
+
+__device__ __forceinline__ double X_200(const double v[3]) {
+
+  return 0.5 * v[0] * v[0];
+}
+
+__device__ __forceinline__ double X_020(const double v[3]) {
+
+  return 0.5 * v[1] * v[1];
+}
+
+__device__ __forceinline__ double X_002(const double v[3]) {
+
+  return 0.5 * v[2] * v[2];
+}
+
+__device__ __forceinline__ double X_110(const double v[3]) {
+
+  return v[0] * v[1];
+}
+
+__device__ __forceinline__ double X_101(const double v[3]) {
+
+  return v[0] * v[2];
+}
+
+__device__ __forceinline__ double X_011(const double v[3]) {
+
+  return v[1] * v[2];
+}
+
+__device__ __forceinline__ double X_300(const double v[3]) {
+
+  return 0.1666666666666667 * v[0] * v[0] * v[0];
+}
+
+__device__ __forceinline__ double X_030(const double v[3]) {
+
+  return 0.1666666666666667 * v[1] * v[1] * v[1];
+}
+
+__device__ __forceinline__ double X_003(const double v[3]) {
+
+  return 0.1666666666666667 * v[2] * v[2] * v[2];
+}
+
+__device__ __forceinline__ double X_210(const double v[3]) {
+
+  return 0.5 * v[0] * v[0] * v[1];
+}
+
+__device__ __forceinline__ double X_201(const double v[3]) {
+
+  return 0.5 * v[0] * v[0] * v[2];
+}
+
+__device__ __forceinline__ double X_120(const double v[3]) {
+
+  return 0.5 * v[0] * v[1] * v[1];
+}
+
+__device__ __forceinline__ double X_021(const double v[3]) {
+
+  return 0.5 * v[1] * v[1] * v[2];
+}
+
+__device__ __forceinline__ double X_102(const double v[3]) {
+
+  return 0.5 * v[0] * v[2] * v[2];
+}
+
+__device__ __forceinline__ double X_012(const double v[3]) {
+
+  return 0.5 * v[1] * v[2] * v[2];
+}
+
+__device__ __forceinline__ double X_111(const double v[3]) {
+
+  return v[0] * v[1] * v[2];
+}
+
+__device__ __forceinline__ double X_400(const double v[3]) {
+
+  const double vv = v[0] * v[0];
+  return 0.041666666666666667 * vv * vv;
+}
+
+__device__ __forceinline__ double X_040(const double v[3]) {
+
+  const double vv = v[1] * v[1];
+  return 0.041666666666666667 * vv * vv;
+}
+
+__device__ __forceinline__ double X_004(const double v[3]) {
+
+  const double vv = v[2] * v[2];
+  return 0.041666666666666667 * vv * vv;
+}
+
+__device__ __forceinline__ double X_310(const double v[3]) {
+
+  return 0.1666666666666667 * v[0] * v[0] * v[0] * v[1];
+}
+
+__device__ __forceinline__ double X_301(const double v[3]) {
+
+  return 0.1666666666666667 * v[0] * v[0] * v[0] * v[2];
+}
+
+__device__ __forceinline__ double X_130(const double v[3]) {
+
+  return 0.1666666666666667 * v[0] * v[1] * v[1] * v[1];
+}
+
+__device__ __forceinline__ double X_031(const double v[3]) {
+
+  return 0.1666666666666667 * v[1] * v[1] * v[1] * v[2];
+}
+
+__device__ __forceinline__ double X_103(const double v[3]) {
+
+  return 0.1666666666666667 * v[0] * v[2] * v[2] * v[2];
+}
+
+__device__ __forceinline__ double X_013(const double v[3]) {
+
+  return 0.1666666666666667 * v[1] * v[2] * v[2] * v[2];
+}
+
+__device__ __forceinline__ double X_220(const double v[3]) {
+
+  return 0.25 * v[0] * v[0] * v[1] * v[1];
+}
+
+__device__ __forceinline__ double X_202(const double v[3]) {
+
+  return 0.25 * v[0] * v[0] * v[2] * v[2];
+}
+
+__device__ __forceinline__ double X_022(const double v[3]) {
+
+  return 0.25 * v[1] * v[1] * v[2] * v[2];
+}
+
+__device__ __forceinline__ double X_211(const double v[3]) {
+
+  return 0.5 * v[0] * v[0] * v[1] * v[2];
+}
+
+__device__ __forceinline__ double X_121(const double v[3]) {
+
+  return 0.5 * v[0] * v[1] * v[1] * v[2];
+}
+
+__device__ __forceinline__ double X_112(const double v[3]) {
+
+  return 0.5 * v[0] * v[1] * v[2] * v[2];
+}
+
+__device__ __forceinline__ double X_005(const double v[3]) {
+
+  return 8.333333333333333e-03 * v[2] * v[2] * v[2] * v[2] * v[2];
+}
+
+__device__ __forceinline__ double X_014(const double v[3]) {
+
+  return 4.166666666666666e-02 * v[1] * v[2] * v[2] * v[2] * v[2];
+}
+
+__device__ __forceinline__ double X_023(const double v[3]) {
+
+  return 8.333333333333333e-02 * v[1] * v[1] * v[2] * v[2] * v[2];
+}
+
+__device__ __forceinline__ double X_032(const double v[3]) {
+
+  return 8.333333333333333e-02 * v[1] * v[1] * v[1] * v[2] * v[2];
+}
+
+__device__ __forceinline__ double X_041(const double v[3]) {
+
+  return 4.166666666666666e-02 * v[1] * v[1] * v[1] * v[1] * v[2];
+}
+
+__device__ __forceinline__ double X_050(const double v[3]) {
+
+  return 8.333333333333333e-03 * v[1] * v[1] * v[1] * v[1] * v[1];
+}
+
+__device__ __forceinline__ double X_104(const double v[3]) {
+
+  return 4.166666666666666e-02 * v[0] * v[2] * v[2] * v[2] * v[2];
+}
+
+__device__ __forceinline__ double X_113(const double v[3]) {
+
+  return 1.666666666666667e-01 * v[0] * v[1] * v[2] * v[2] * v[2];
+}
+
+__device__ __forceinline__ double X_122(const double v[3]) {
+
+  return 2.500000000000000e-01 * v[0] * v[1] * v[1] * v[2] * v[2];
+}
+
+__device__ __forceinline__ double X_131(const double v[3]) {
+
+  return 1.666666666666667e-01 * v[0] * v[1] * v[1] * v[1] * v[2];
+}
+
+__device__ __forceinline__ double X_140(const double v[3]) {
+
+  return 4.166666666666666e-02 * v[0] * v[1] * v[1] * v[1] * v[1];
+}
+
+__device__ __forceinline__ double X_203(const double v[3]) {
+
+  return 8.333333333333333e-02 * v[0] * v[0] * v[2] * v[2] * v[2];
+}
+
+__device__ __forceinline__ double X_212(const double v[3]) {
+
+  return 2.500000000000000e-01 * v[0] * v[0] * v[1] * v[2] * v[2];
+}
+
+__device__ __forceinline__ double X_221(const double v[3]) {
+
+  return 2.500000000000000e-01 * v[0] * v[0] * v[1] * v[1] * v[2];
+}
+
+__device__ __forceinline__ double X_230(const double v[3]) {
+
+  return 8.333333333333333e-02 * v[0] * v[0] * v[1] * v[1] * v[1];
+}
+
+__device__ __forceinline__ double X_302(const double v[3]) {
+
+  return 8.333333333333333e-02 * v[0] * v[0] * v[0] * v[2] * v[2];
+}
+
+__device__ __forceinline__ double X_311(const double v[3]) {
+
+  return 1.666666666666667e-01 * v[0] * v[0] * v[0] * v[1] * v[2];
+}
+
+__device__ __forceinline__ double X_320(const double v[3]) {
+
+  return 8.333333333333333e-02 * v[0] * v[0] * v[0] * v[1] * v[1];
+}
+
+__device__ __forceinline__ double X_401(const double v[3]) {
+
+  return 4.166666666666666e-02 * v[0] * v[0] * v[0] * v[0] * v[2];
+}
+
+__device__ __forceinline__ double X_410(const double v[3]) {
+
+  return 4.166666666666666e-02 * v[0] * v[0] * v[0] * v[0] * v[1];
+}
+
+__device__ __forceinline__ double X_500(const double v[3]) {
+
+  return 8.333333333333333e-03 * v[0] * v[0] * v[0] * v[0] * v[0];
+}
+
+__device__ void gravity_multipole_add(struct multipole *ma, const struct multipole *mb) {
+
+  /* Maximum of both softenings */
+  ma->max_softening = max(ma->max_softening, mb->max_softening);
+
+  /* Minimum of both old accelerations */
+  ma->min_old_a_grav_norm =
+      min(ma->min_old_a_grav_norm, mb->min_old_a_grav_norm);
+
+  /* Minimum of both particle masses */
+  ma->min_mass = min(ma->min_mass, mb->min_mass);
+
+  /* Add 0th order term */
+  ma->M_000 += mb->M_000;
+
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 0
+  /* Add 1st order terms (all 0 since we expand around CoM) */
+  /* ma->M_100 += mb->M_100; */
+  /* ma->M_010 += mb->M_010; */
+  /* ma->M_001 += mb->M_001; */
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+  /* Add 2nd order terms */
+  ma->M_200 += mb->M_200;
+  ma->M_020 += mb->M_020;
+  ma->M_002 += mb->M_002;
+  ma->M_110 += mb->M_110;
+  ma->M_101 += mb->M_101;
+  ma->M_011 += mb->M_011;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 2
+  /* Add 3rd order terms */
+  ma->M_300 += mb->M_300;
+  ma->M_030 += mb->M_030;
+  ma->M_003 += mb->M_003;
+  ma->M_210 += mb->M_210;
+  ma->M_201 += mb->M_201;
+  ma->M_120 += mb->M_120;
+  ma->M_021 += mb->M_021;
+  ma->M_102 += mb->M_102;
+  ma->M_012 += mb->M_012;
+  ma->M_111 += mb->M_111;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 3
+  /* Add 4th order terms */
+  ma->M_400 += mb->M_400;
+  ma->M_040 += mb->M_040;
+  ma->M_004 += mb->M_004;
+  ma->M_310 += mb->M_310;
+  ma->M_301 += mb->M_301;
+  ma->M_130 += mb->M_130;
+  ma->M_031 += mb->M_031;
+  ma->M_103 += mb->M_103;
+  ma->M_013 += mb->M_013;
+  ma->M_220 += mb->M_220;
+  ma->M_202 += mb->M_202;
+  ma->M_022 += mb->M_022;
+  ma->M_211 += mb->M_211;
+  ma->M_121 += mb->M_121;
+  ma->M_112 += mb->M_112;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 4
+  /* 5th order terms */
+  ma->M_005 += mb->M_005;
+  ma->M_014 += mb->M_014;
+  ma->M_023 += mb->M_023;
+  ma->M_032 += mb->M_032;
+  ma->M_041 += mb->M_041;
+  ma->M_050 += mb->M_050;
+  ma->M_104 += mb->M_104;
+  ma->M_113 += mb->M_113;
+  ma->M_122 += mb->M_122;
+  ma->M_131 += mb->M_131;
+  ma->M_140 += mb->M_140;
+  ma->M_203 += mb->M_203;
+  ma->M_212 += mb->M_212;
+  ma->M_221 += mb->M_221;
+  ma->M_230 += mb->M_230;
+  ma->M_302 += mb->M_302;
+  ma->M_311 += mb->M_311;
+  ma->M_320 += mb->M_320;
+  ma->M_401 += mb->M_401;
+  ma->M_410 += mb->M_410;
+  ma->M_500 += mb->M_500;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 5
+#error "Missing implementation for order >5"
+#endif
+
+#if defined(SWIFT_DEBUG_CHECKS) || defined(SWIFT_GRAVITY_FORCE_CHECKS)
+  ma->num_gpart += mb->num_gpart;
+#endif
+}
+
+__device__ void gravity_multipole_compute_power(struct multipole *m) {
+
+  double power[SELF_GRAVITY_MULTIPOLE_ORDER + 1] = {0.};
+
+  /* 0th order terms */
+  m->power[0] = m->M_000;
+
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 0
+  /* 1st order terms (all 0 since we expand around CoM) */
+  // power[1] += m->M_001 * m->M_001;
+  // power[1] += m->M_010 * m->M_010;
+  // power[1] += m->M_100 * m->M_100;
+
+  // m->power[1] = sqrt(power[1]);
+  m->power[1] = 0.f;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+  /* 2nd order terms */
+  power[2] += m->M_002 * m->M_002;
+  power[2] += 5.000000000000000e-01 * m->M_011 * m->M_011;
+  power[2] += m->M_020 * m->M_020;
+  power[2] += 5.000000000000000e-01 * m->M_101 * m->M_101;
+  power[2] += 5.000000000000000e-01 * m->M_110 * m->M_110;
+  power[2] += m->M_200 * m->M_200;
+
+  m->power[2] = sqrt(power[2]);
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 2
+  /* 3rd order terms */
+  power[3] += m->M_003 * m->M_003;
+  power[3] += 3.333333333333333e-01 * m->M_012 * m->M_012;
+  power[3] += 3.333333333333333e-01 * m->M_021 * m->M_021;
+  power[3] += m->M_030 * m->M_030;
+  power[3] += 3.333333333333333e-01 * m->M_102 * m->M_102;
+  power[3] += 1.666666666666667e-01 * m->M_111 * m->M_111;
+  power[3] += 3.333333333333333e-01 * m->M_120 * m->M_120;
+  power[3] += 3.333333333333333e-01 * m->M_201 * m->M_201;
+  power[3] += 3.333333333333333e-01 * m->M_210 * m->M_210;
+  power[3] += m->M_300 * m->M_300;
+
+  m->power[3] = sqrt(power[3]);
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 3
+  /* 4th order terms */
+  power[4] += m->M_004 * m->M_004;
+  power[4] += 2.500000000000000e-01 * m->M_013 * m->M_013;
+  power[4] += 1.666666666666667e-01 * m->M_022 * m->M_022;
+  power[4] += 2.500000000000000e-01 * m->M_031 * m->M_031;
+  power[4] += m->M_040 * m->M_040;
+  power[4] += 2.500000000000000e-01 * m->M_103 * m->M_103;
+  power[4] += 8.333333333333333e-02 * m->M_112 * m->M_112;
+  power[4] += 8.333333333333333e-02 * m->M_121 * m->M_121;
+  power[4] += 2.500000000000000e-01 * m->M_130 * m->M_130;
+  power[4] += 1.666666666666667e-01 * m->M_202 * m->M_202;
+  power[4] += 8.333333333333333e-02 * m->M_211 * m->M_211;
+  power[4] += 1.666666666666667e-01 * m->M_220 * m->M_220;
+  power[4] += 2.500000000000000e-01 * m->M_301 * m->M_301;
+  power[4] += 2.500000000000000e-01 * m->M_310 * m->M_310;
+  power[4] += m->M_400 * m->M_400;
+
+  m->power[4] = sqrt(power[4]);
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 4
+  /* 5th order terms */
+  power[5] += m->M_005 * m->M_005;
+  power[5] += 2.000000000000000e-01 * m->M_014 * m->M_014;
+  power[5] += 1.000000000000000e-01 * m->M_023 * m->M_023;
+  power[5] += 1.000000000000000e-01 * m->M_032 * m->M_032;
+  power[5] += 2.000000000000000e-01 * m->M_041 * m->M_041;
+  power[5] += m->M_050 * m->M_050;
+  power[5] += 2.000000000000000e-01 * m->M_104 * m->M_104;
+  power[5] += 5.000000000000000e-02 * m->M_113 * m->M_113;
+  power[5] += 3.333333333333333e-02 * m->M_122 * m->M_122;
+  power[5] += 5.000000000000000e-02 * m->M_131 * m->M_131;
+  power[5] += 2.000000000000000e-01 * m->M_140 * m->M_140;
+  power[5] += 1.000000000000000e-01 * m->M_203 * m->M_203;
+  power[5] += 3.333333333333333e-02 * m->M_212 * m->M_212;
+  power[5] += 3.333333333333333e-02 * m->M_221 * m->M_221;
+  power[5] += 1.000000000000000e-01 * m->M_230 * m->M_230;
+  power[5] += 1.000000000000000e-01 * m->M_302 * m->M_302;
+  power[5] += 5.000000000000000e-02 * m->M_311 * m->M_311;
+  power[5] += 1.000000000000000e-01 * m->M_320 * m->M_320;
+  power[5] += 2.000000000000000e-01 * m->M_401 * m->M_401;
+  power[5] += 2.000000000000000e-01 * m->M_410 * m->M_410;
+  power[5] += m->M_500 * m->M_500;
+
+  m->power[5] = sqrt(power[5]);
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 5
+#error "Missing implementation for order >5"
+#endif
+}
+
+__device__ void gravity_M2M(struct multipole *m_a, const struct multipole *m_b, const double pos_a[3], const double pos_b[3]) {
+
+  /* "shift" the softening */
+  m_a->max_softening = m_b->max_softening;
+
+  /* "shift" the minimal acceleration */
+  m_a->min_old_a_grav_norm = m_b->min_old_a_grav_norm;
+
+  /* "shift" the minimal mass */
+  m_a->min_mass = m_b->min_mass;
+
+  /* Shift 0th order term */
+  m_a->M_000 = m_b->M_000;
+
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 0
+  const double dx[3] = {pos_a[0] - pos_b[0], pos_a[1] - pos_b[1],
+                        pos_a[2] - pos_b[2]};
+
+  /* Shift 1st order term (all 0 (after add) since we expand around CoM) */
+  // m_a->M_100 = m_b->M_100 + X_100(dx) * m_b->M_000;
+  // m_a->M_010 = m_b->M_010 + X_010(dx) * m_b->M_000;
+  // m_a->M_001 = m_b->M_001 + X_001(dx) * m_b->M_000;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+
+  /* Shift 2nd order terms (1st order mpole (all 0) commented out) */
+  m_a->M_002 =
+      m_b->M_002 /* + X_001(dx) * m_b->M_001 */ + X_002(dx) * m_b->M_000;
+  m_a->M_011 =
+      m_b->M_011 /* + X_001(dx) * m_b->M_010 */ /* + X_010(dx) * m_b->M_001 */ +
+      X_011(dx) * m_b->M_000;
+  m_a->M_020 =
+      m_b->M_020 /* + X_010(dx) * m_b->M_010 */ + X_020(dx) * m_b->M_000;
+  m_a->M_101 =
+      m_b->M_101 /* + X_001(dx) * m_b->M_100 */ /* + X_100(dx) * m_b->M_001 */ +
+      X_101(dx) * m_b->M_000;
+  m_a->M_110 =
+      m_b->M_110 /* + X_010(dx) * m_b->M_100 */ /* + X_100(dx) * m_b->M_010 */ +
+      X_110(dx) * m_b->M_000;
+  m_a->M_200 =
+      m_b->M_200 /* + X_100(dx) * m_b->M_100 */ + X_200(dx) * m_b->M_000;
+#endif
+
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 2
+
+  /* Shift 3rd order terms (1st order mpole (all 0) commented out) */
+  m_a->M_003 = m_b->M_003 +
+               X_001(dx) * m_b->M_002 /* + X_002(dx) * m_b->M_001 */ +
+               X_003(dx) * m_b->M_000;
+  m_a->M_012 = m_b->M_012 +
+               X_001(dx) * m_b->M_011 /* + X_002(dx) * m_b->M_010 */ +
+               X_010(dx) * m_b->M_002 /* + X_011(dx) * m_b->M_001 */ +
+               X_012(dx) * m_b->M_000;
+  m_a->M_021 = m_b->M_021 + X_001(dx) * m_b->M_020 +
+               X_010(dx) * m_b->M_011 /* + X_011(dx) * m_b->M_010 */
+                                      /* + X_020(dx) * m_b->M_001 */
+               + X_021(dx) * m_b->M_000;
+  m_a->M_030 = m_b->M_030 +
+               X_010(dx) * m_b->M_020 /* + X_020(dx) * m_b->M_010 */ +
+               X_030(dx) * m_b->M_000;
+  m_a->M_102 = m_b->M_102 +
+               X_001(dx) * m_b->M_101 /* + X_002(dx) * m_b->M_100 */ +
+               X_100(dx) * m_b->M_002 /* + X_101(dx) * m_b->M_001 */ +
+               X_102(dx) * m_b->M_000;
+  m_a->M_111 = m_b->M_111 + X_001(dx) * m_b->M_110 +
+               X_010(dx) * m_b->M_101 /* + X_011(dx) * m_b->M_100 */ +
+               X_100(dx) * m_b->M_011 /* + X_101(dx) * m_b->M_010 */
+                                      /* + X_110(dx) * m_b->M_001 */
+               + X_111(dx) * m_b->M_000;
+  m_a->M_120 = m_b->M_120 +
+               X_010(dx) * m_b->M_110 /* + X_020(dx) * m_b->M_100 */ +
+               X_100(dx) * m_b->M_020 /* + X_110(dx) * m_b->M_010 */ +
+               X_120(dx) * m_b->M_000;
+  m_a->M_201 = m_b->M_201 + X_001(dx) * m_b->M_200 +
+               X_100(dx) * m_b->M_101 /* + X_101(dx) * m_b->M_100 */
+                                      /* + X_200(dx) * m_b->M_001 */
+               + X_201(dx) * m_b->M_000;
+  m_a->M_210 = m_b->M_210 + X_010(dx) * m_b->M_200 +
+               X_100(dx) * m_b->M_110 /* + X_110(dx) * m_b->M_100 */
+                                      /* + X_200(dx) * m_b->M_010 */
+               + X_210(dx) * m_b->M_000;
+  m_a->M_300 = m_b->M_300 +
+               X_100(dx) * m_b->M_200 /* + X_200(dx) * m_b->M_100 */ +
+               X_300(dx) * m_b->M_000;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 3
+
+  /* Shift 4th order terms (1st order mpole (all 0) commented out) */
+  m_a->M_004 = m_b->M_004 + X_001(dx) * m_b->M_003 +
+               X_002(dx) * m_b->M_002 /* + X_003(dx) * m_b->M_001 */ +
+               X_004(dx) * m_b->M_000;
+  m_a->M_013 = m_b->M_013 + X_001(dx) * m_b->M_012 +
+               X_002(dx) * m_b->M_011 /* + X_003(dx) * m_b->M_010 */ +
+               X_010(dx) * m_b->M_003 +
+               X_011(dx) * m_b->M_002 /* + X_012(dx) * m_b->M_001 */ +
+               X_013(dx) * m_b->M_000;
+  m_a->M_022 = m_b->M_022 + X_001(dx) * m_b->M_021 + X_002(dx) * m_b->M_020 +
+               X_010(dx) * m_b->M_012 +
+               X_011(dx) * m_b->M_011 /* + X_012(dx) * m_b->M_010 */ +
+               X_020(dx) * m_b->M_002 /* + X_021(dx) * m_b->M_001 */ +
+               X_022(dx) * m_b->M_000;
+  m_a->M_031 = m_b->M_031 + X_001(dx) * m_b->M_030 + X_010(dx) * m_b->M_021 +
+               X_011(dx) * m_b->M_020 +
+               X_020(dx) * m_b->M_011 /* + X_021(dx) * m_b->M_010 */
+                                      /* + X_030(dx) * m_b->M_001 */
+               + X_031(dx) * m_b->M_000;
+  m_a->M_040 = m_b->M_040 + X_010(dx) * m_b->M_030 +
+               X_020(dx) * m_b->M_020 /* + X_030(dx) * m_b->M_010 */ +
+               X_040(dx) * m_b->M_000;
+  m_a->M_103 = m_b->M_103 + X_001(dx) * m_b->M_102 +
+               X_002(dx) * m_b->M_101 /* + X_003(dx) * m_b->M_100 */ +
+               X_100(dx) * m_b->M_003 +
+               X_101(dx) * m_b->M_002 /* + X_102(dx) * m_b->M_001 */ +
+               X_103(dx) * m_b->M_000;
+  m_a->M_112 = m_b->M_112 + X_001(dx) * m_b->M_111 + X_002(dx) * m_b->M_110 +
+               X_010(dx) * m_b->M_102 +
+               X_011(dx) * m_b->M_101 /* + X_012(dx) * m_b->M_100 */ +
+               X_100(dx) * m_b->M_012 +
+               X_101(dx) * m_b->M_011 /* + X_102(dx) * m_b->M_010 */ +
+               X_110(dx) * m_b->M_002 /* + X_111(dx) * m_b->M_001 */ +
+               X_112(dx) * m_b->M_000;
+  m_a->M_121 = m_b->M_121 + X_001(dx) * m_b->M_120 + X_010(dx) * m_b->M_111 +
+               X_011(dx) * m_b->M_110 +
+               X_020(dx) * m_b->M_101 /* + X_021(dx) * m_b->M_100 */ +
+               X_100(dx) * m_b->M_021 + X_101(dx) * m_b->M_020 +
+               X_110(dx) * m_b->M_011 /* + X_111(dx) * m_b->M_010 */
+                                      /* + X_120(dx) * m_b->M_001 */
+               + X_121(dx) * m_b->M_000;
+  m_a->M_130 = m_b->M_130 + X_010(dx) * m_b->M_120 +
+               X_020(dx) * m_b->M_110 /* + X_030(dx) * m_b->M_100 */ +
+               X_100(dx) * m_b->M_030 +
+               X_110(dx) * m_b->M_020 /* + X_120(dx) * m_b->M_010 */ +
+               X_130(dx) * m_b->M_000;
+  m_a->M_202 = m_b->M_202 + X_001(dx) * m_b->M_201 + X_002(dx) * m_b->M_200 +
+               X_100(dx) * m_b->M_102 +
+               X_101(dx) * m_b->M_101 /* + X_102(dx) * m_b->M_100 */ +
+               X_200(dx) * m_b->M_002 /* + X_201(dx) * m_b->M_001 */ +
+               X_202(dx) * m_b->M_000;
+  m_a->M_211 = m_b->M_211 + X_001(dx) * m_b->M_210 + X_010(dx) * m_b->M_201 +
+               X_011(dx) * m_b->M_200 + X_100(dx) * m_b->M_111 +
+               X_101(dx) * m_b->M_110 +
+               X_110(dx) * m_b->M_101 /* + X_111(dx) * m_b->M_100 */ +
+               X_200(dx) * m_b->M_011 /* + X_201(dx) * m_b->M_010 */
+                                      /* + X_210(dx) * m_b->M_001 */
+               + X_211(dx) * m_b->M_000;
+  m_a->M_220 = m_b->M_220 + X_010(dx) * m_b->M_210 + X_020(dx) * m_b->M_200 +
+               X_100(dx) * m_b->M_120 +
+               X_110(dx) * m_b->M_110 /* + X_120(dx) * m_b->M_100 */ +
+               X_200(dx) * m_b->M_020 /* + X_210(dx) * m_b->M_010 */ +
+               X_220(dx) * m_b->M_000;
+  m_a->M_301 = m_b->M_301 + X_001(dx) * m_b->M_300 + X_100(dx) * m_b->M_201 +
+               X_101(dx) * m_b->M_200 +
+               X_200(dx) * m_b->M_101 /* + X_201(dx) * m_b->M_100 */
+                                      /* + X_300(dx) * m_b->M_001 */
+               + X_301(dx) * m_b->M_000;
+  m_a->M_310 = m_b->M_310 + X_010(dx) * m_b->M_300 + X_100(dx) * m_b->M_210 +
+               X_110(dx) * m_b->M_200 +
+               X_200(dx) * m_b->M_110 /* + X_210(dx) * m_b->M_100 */
+                                      /* + X_300(dx) * m_b->M_010 */
+               + X_310(dx) * m_b->M_000;
+  m_a->M_400 = m_b->M_400 + X_100(dx) * m_b->M_300 +
+               X_200(dx) * m_b->M_200 /* + X_300(dx) * m_b->M_100 */ +
+               X_400(dx) * m_b->M_000;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 4
+
+  /* Shift 5th order terms (1st order mpole (all 0) commented out) */
+  m_a->M_005 = m_b->M_005 + X_001(dx) * m_b->M_004 + X_002(dx) * m_b->M_003 +
+               X_003(dx) * m_b->M_002 /* + X_004(dx) * m_b->M_001 */ +
+               X_005(dx) * m_b->M_000;
+  m_a->M_014 = m_b->M_014 + X_001(dx) * m_b->M_013 + X_002(dx) * m_b->M_012 +
+               X_003(dx) * m_b->M_011 /* + X_004(dx) * m_b->M_010 */ +
+               X_010(dx) * m_b->M_004 + X_011(dx) * m_b->M_003 +
+               X_012(dx) * m_b->M_002 /* + X_013(dx) * m_b->M_001 */ +
+               X_014(dx) * m_b->M_000;
+  m_a->M_023 = m_b->M_023 + X_001(dx) * m_b->M_022 + X_002(dx) * m_b->M_021 +
+               X_003(dx) * m_b->M_020 + X_010(dx) * m_b->M_013 +
+               X_011(dx) * m_b->M_012 +
+               X_012(dx) * m_b->M_011 /* + X_013(dx) * m_b->M_010 */ +
+               X_020(dx) * m_b->M_003 +
+               X_021(dx) * m_b->M_002 /* + X_022(dx) * m_b->M_001 */ +
+               X_023(dx) * m_b->M_000;
+  m_a->M_032 = m_b->M_032 + X_001(dx) * m_b->M_031 + X_002(dx) * m_b->M_030 +
+               X_010(dx) * m_b->M_022 + X_011(dx) * m_b->M_021 +
+               X_012(dx) * m_b->M_020 + X_020(dx) * m_b->M_012 +
+               X_021(dx) * m_b->M_011 /* + X_022(dx) * m_b->M_010 */ +
+               X_030(dx) * m_b->M_002 /* + X_031(dx) * m_b->M_001 */ +
+               X_032(dx) * m_b->M_000;
+  m_a->M_041 = m_b->M_041 + X_001(dx) * m_b->M_040 + X_010(dx) * m_b->M_031 +
+               X_011(dx) * m_b->M_030 + X_020(dx) * m_b->M_021 +
+               X_021(dx) * m_b->M_020 +
+               X_030(dx) * m_b->M_011 /* + X_031(dx) * m_b->M_010 */
+                                      /* + X_040(dx) * m_b->M_001 */
+               + X_041(dx) * m_b->M_000;
+  m_a->M_050 = m_b->M_050 + X_010(dx) * m_b->M_040 + X_020(dx) * m_b->M_030 +
+               X_030(dx) * m_b->M_020 /* + X_040(dx) * m_b->M_010 */ +
+               X_050(dx) * m_b->M_000;
+  m_a->M_104 = m_b->M_104 + X_001(dx) * m_b->M_103 + X_002(dx) * m_b->M_102 +
+               X_003(dx) * m_b->M_101 /* + X_004(dx) * m_b->M_100 */ +
+               X_100(dx) * m_b->M_004 + X_101(dx) * m_b->M_003 +
+               X_102(dx) * m_b->M_002 /* + X_103(dx) * m_b->M_001 */ +
+               X_104(dx) * m_b->M_000;
+  m_a->M_113 = m_b->M_113 + X_001(dx) * m_b->M_112 + X_002(dx) * m_b->M_111 +
+               X_003(dx) * m_b->M_110 + X_010(dx) * m_b->M_103 +
+               X_011(dx) * m_b->M_102 +
+               X_012(dx) * m_b->M_101 /* + X_013(dx) * m_b->M_100 */ +
+               X_100(dx) * m_b->M_013 + X_101(dx) * m_b->M_012 +
+               X_102(dx) * m_b->M_011 /* + X_103(dx) * m_b->M_010 */ +
+               X_110(dx) * m_b->M_003 +
+               X_111(dx) * m_b->M_002 /* + X_112(dx) * m_b->M_001 */ +
+               X_113(dx) * m_b->M_000;
+  m_a->M_122 = m_b->M_122 + X_001(dx) * m_b->M_121 + X_002(dx) * m_b->M_120 +
+               X_010(dx) * m_b->M_112 + X_011(dx) * m_b->M_111 +
+               X_012(dx) * m_b->M_110 + X_020(dx) * m_b->M_102 +
+               X_021(dx) * m_b->M_101 /* + X_022(dx) * m_b->M_100 */ +
+               X_100(dx) * m_b->M_022 + X_101(dx) * m_b->M_021 +
+               X_102(dx) * m_b->M_020 + X_110(dx) * m_b->M_012 +
+               X_111(dx) * m_b->M_011 /* + X_112(dx) * m_b->M_010 */ +
+               X_120(dx) * m_b->M_002 /* + X_121(dx) * m_b->M_001 */ +
+               X_122(dx) * m_b->M_000;
+  m_a->M_131 = m_b->M_131 + X_001(dx) * m_b->M_130 + X_010(dx) * m_b->M_121 +
+               X_011(dx) * m_b->M_120 + X_020(dx) * m_b->M_111 +
+               X_021(dx) * m_b->M_110 +
+               X_030(dx) * m_b->M_101 /* + X_031(dx) * m_b->M_100 */ +
+               X_100(dx) * m_b->M_031 + X_101(dx) * m_b->M_030 +
+               X_110(dx) * m_b->M_021 + X_111(dx) * m_b->M_020 +
+               X_120(dx) * m_b->M_011 /* + X_121(dx) * m_b->M_010 */
+                                      /* + X_130(dx) * m_b->M_001 */
+               + X_131(dx) * m_b->M_000;
+  m_a->M_140 = m_b->M_140 + X_010(dx) * m_b->M_130 + X_020(dx) * m_b->M_120 +
+               X_030(dx) * m_b->M_110 /* + X_040(dx) * m_b->M_100 */ +
+               X_100(dx) * m_b->M_040 + X_110(dx) * m_b->M_030 +
+               X_120(dx) * m_b->M_020 /* + X_130(dx) * m_b->M_010 */ +
+               X_140(dx) * m_b->M_000;
+  m_a->M_203 = m_b->M_203 + X_001(dx) * m_b->M_202 + X_002(dx) * m_b->M_201 +
+               X_003(dx) * m_b->M_200 + X_100(dx) * m_b->M_103 +
+               X_101(dx) * m_b->M_102 +
+               X_102(dx) * m_b->M_101 /* + X_103(dx) * m_b->M_100 */ +
+               X_200(dx) * m_b->M_003 +
+               X_201(dx) * m_b->M_002 /* + X_202(dx) * m_b->M_001 */ +
+               X_203(dx) * m_b->M_000;
+  m_a->M_212 = m_b->M_212 + X_001(dx) * m_b->M_211 + X_002(dx) * m_b->M_210 +
+               X_010(dx) * m_b->M_202 + X_011(dx) * m_b->M_201 +
+               X_012(dx) * m_b->M_200 + X_100(dx) * m_b->M_112 +
+               X_101(dx) * m_b->M_111 + X_102(dx) * m_b->M_110 +
+               X_110(dx) * m_b->M_102 +
+               X_111(dx) * m_b->M_101 /* + X_112(dx) * m_b->M_100 */ +
+               X_200(dx) * m_b->M_012 +
+               X_201(dx) * m_b->M_011 /* + X_202(dx) * m_b->M_010 */ +
+               X_210(dx) * m_b->M_002 /* + X_211(dx) * m_b->M_001 */ +
+               X_212(dx) * m_b->M_000;
+  m_a->M_221 = m_b->M_221 + X_001(dx) * m_b->M_220 + X_010(dx) * m_b->M_211 +
+               X_011(dx) * m_b->M_210 + X_020(dx) * m_b->M_201 +
+               X_021(dx) * m_b->M_200 + X_100(dx) * m_b->M_121 +
+               X_101(dx) * m_b->M_120 + X_110(dx) * m_b->M_111 +
+               X_111(dx) * m_b->M_110 +
+               X_120(dx) * m_b->M_101 /* + X_121(dx) * m_b->M_100 */ +
+               X_200(dx) * m_b->M_021 + X_201(dx) * m_b->M_020 +
+               X_210(dx) * m_b->M_011 /* + X_211(dx) * m_b->M_010 */
+                                      /* + X_220(dx) * m_b->M_001 */
+               + X_221(dx) * m_b->M_000;
+  m_a->M_230 = m_b->M_230 + X_010(dx) * m_b->M_220 + X_020(dx) * m_b->M_210 +
+               X_030(dx) * m_b->M_200 + X_100(dx) * m_b->M_130 +
+               X_110(dx) * m_b->M_120 +
+               X_120(dx) * m_b->M_110 /* + X_130(dx) * m_b->M_100 */ +
+               X_200(dx) * m_b->M_030 +
+               X_210(dx) * m_b->M_020 /* + X_220(dx) * m_b->M_010 */ +
+               X_230(dx) * m_b->M_000;
+  m_a->M_302 = m_b->M_302 + X_001(dx) * m_b->M_301 + X_002(dx) * m_b->M_300 +
+               X_100(dx) * m_b->M_202 + X_101(dx) * m_b->M_201 +
+               X_102(dx) * m_b->M_200 + X_200(dx) * m_b->M_102 +
+               X_201(dx) * m_b->M_101 /* + X_202(dx) * m_b->M_100 */ +
+               X_300(dx) * m_b->M_002 /* + X_301(dx) * m_b->M_001 */ +
+               X_302(dx) * m_b->M_000;
+  m_a->M_311 = m_b->M_311 + X_001(dx) * m_b->M_310 + X_010(dx) * m_b->M_301 +
+               X_011(dx) * m_b->M_300 + X_100(dx) * m_b->M_211 +
+               X_101(dx) * m_b->M_210 + X_110(dx) * m_b->M_201 +
+               X_111(dx) * m_b->M_200 + X_200(dx) * m_b->M_111 +
+               X_201(dx) * m_b->M_110 +
+               X_210(dx) * m_b->M_101 /* + X_211(dx) * m_b->M_100 */ +
+               X_300(dx) * m_b->M_011 /* + X_301(dx) * m_b->M_010 */
+                                      /* + X_310(dx) * m_b->M_001 */
+               + X_311(dx) * m_b->M_000;
+  m_a->M_320 = m_b->M_320 + X_010(dx) * m_b->M_310 + X_020(dx) * m_b->M_300 +
+               X_100(dx) * m_b->M_220 + X_110(dx) * m_b->M_210 +
+               X_120(dx) * m_b->M_200 + X_200(dx) * m_b->M_120 +
+               X_210(dx) * m_b->M_110 /* + X_220(dx) * m_b->M_100 */ +
+               X_300(dx) * m_b->M_020 /* + X_310(dx) * m_b->M_010 */ +
+               X_320(dx) * m_b->M_000;
+  m_a->M_401 = m_b->M_401 + X_001(dx) * m_b->M_400 + X_100(dx) * m_b->M_301 +
+               X_101(dx) * m_b->M_300 + X_200(dx) * m_b->M_201 +
+               X_201(dx) * m_b->M_200 +
+               X_300(dx) * m_b->M_101 /* + X_301(dx) * m_b->M_100 */
+                                      /* + X_400(dx) * m_b->M_001 */
+               + X_401(dx) * m_b->M_000;
+  m_a->M_410 = m_b->M_410 + X_010(dx) * m_b->M_400 + X_100(dx) * m_b->M_310 +
+               X_110(dx) * m_b->M_300 + X_200(dx) * m_b->M_210 +
+               X_210(dx) * m_b->M_200 +
+               X_300(dx) * m_b->M_110 /* + X_310(dx) * m_b->M_100 */
+                                      /* + X_400(dx) * m_b->M_010 */
+               + X_410(dx) * m_b->M_000;
+  m_a->M_500 = m_b->M_500 + X_100(dx) * m_b->M_400 + X_200(dx) * m_b->M_300 +
+               X_300(dx) * m_b->M_200 /* + X_400(dx) * m_b->M_100 */ +
+               X_500(dx) * m_b->M_000;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 5
+#error "Missing implementation for order >5"
+#endif
+
+#if defined(SWIFT_DEBUG_CHECKS) || defined(SWIFT_GRAVITY_FORCE_CHECKS)
+  m_a->num_gpart = m_b->num_gpart;
+#endif
+}
+
+//the gcount particles start at x, y, ...
+__device__ void gravity_P2M(struct cuda_tree_multipole *multi, const double *x, const double *y, const double *z, const float *v_x, const float *v_y, const float *v_z, const float *mass_arr, const float *epsilon_arr, const float *old_a_grav_norm, const int gcount) {
+
+  /* Temporary variables */
+  float epsilon_max = 0.f;
+  float min_old_a_grav_norm = FLT_MAX;
+  float min_mass = FLT_MAX;
+  double mass = 0.0;
+  double com[3] = {0.0, 0.0, 0.0};
+  double vel[3] = {0.f, 0.f, 0.f};
+
+  /* Collect the particle data for CoM. */
+  for (int k = 0; k < gcount; k++) {
+    const double m = mass_arr[k];
+    const float epsilon = epsilon_arr[k];
+
+    epsilon_max = max(epsilon_max, epsilon);
+    min_old_a_grav_norm = min(min_old_a_grav_norm, old_a_grav_norm[k]);
+    min_mass = min(min_mass, mass_arr[k]);
+    mass += m;
+    com[0] += x[k] * m;
+    com[1] += y[k] * m;
+    com[2] += z[k] * m;
+    vel[0] += v_x[k] * m;
+    vel[1] += v_y[k] * m;
+    vel[2] += v_z[k] * m;
+  }
+
+  /* Final operation on CoM */
+  const double imass = 1.0 / mass;
+  com[0] *= imass;
+  com[1] *= imass;
+  com[2] *= imass;
+  vel[0] *= imass;
+  vel[1] *= imass;
+  vel[2] *= imass;
+
+  /* Prepare some local counters */
+  double r_max2 = 0.;
+  float max_delta_vel[3] = {0., 0., 0.};
+  float min_delta_vel[3] = {0., 0., 0.};
+
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 0
+  /* double M_100 = 0., M_010 = 0., M_001 = 0.; */
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+  double M_200 = 0., M_020 = 0., M_002 = 0.;
+  double M_110 = 0., M_101 = 0., M_011 = 0.;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 2
+  double M_300 = 0., M_030 = 0., M_003 = 0.;
+  double M_210 = 0., M_201 = 0., M_120 = 0.;
+  double M_021 = 0., M_102 = 0., M_012 = 0.;
+  double M_111 = 0.;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 3
+  double M_400 = 0., M_040 = 0., M_004 = 0.;
+  double M_310 = 0., M_301 = 0., M_130 = 0.;
+  double M_031 = 0., M_103 = 0., M_013 = 0.;
+  double M_220 = 0., M_202 = 0., M_022 = 0.;
+  double M_211 = 0., M_121 = 0., M_112 = 0.;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 4
+  double M_005 = 0., M_014 = 0., M_023 = 0.;
+  double M_032 = 0., M_041 = 0., M_050 = 0.;
+  double M_104 = 0., M_113 = 0., M_122 = 0.;
+  double M_131 = 0., M_140 = 0., M_203 = 0.;
+  double M_212 = 0., M_221 = 0., M_230 = 0.;
+  double M_302 = 0., M_311 = 0., M_320 = 0.;
+  double M_401 = 0., M_410 = 0., M_500 = 0.;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 5
+#error "Missing implementation for order >5"
+#endif
+
+  /* Construce the higher order terms */
+  for (int k = 0; k < gcount; k++) {
+
+    const double dx[3] = {x[k] - com[0], y[k] - com[1], z[k] - com[2]};
+
+    /* Maximal distance CoM<->gpart */
+    r_max2 = max(r_max2, dx[0] * dx[0] + dx[1] * dx[1] + dx[2] * dx[2]);
+
+    /* Store the vector of the maximal vel difference */
+    max_delta_vel[0] = max(v_x[k], max_delta_vel[0]);
+    max_delta_vel[1] = max(v_y[k], max_delta_vel[1]);
+    max_delta_vel[2] = max(v_z[k], max_delta_vel[2]);
+
+    /* Store the vector of the minimal vel difference */
+    min_delta_vel[0] = min(v_x[k], min_delta_vel[0]);
+    min_delta_vel[1] = min(v_y[k], min_delta_vel[1]);
+    min_delta_vel[2] = min(v_z[k], min_delta_vel[2]);
+
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 0
+    const double m = mass_arr[k];
+
+    /* 1st order terms */
+    /* M_100 += -m * X_100(dx); */
+    /* M_010 += -m * X_010(dx); */
+    /* M_001 += -m * X_001(dx); */
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+
+    /* 2nd order terms */
+    M_200 += m * X_200(dx);
+    M_020 += m * X_020(dx);
+    M_002 += m * X_002(dx);
+    M_110 += m * X_110(dx);
+    M_101 += m * X_101(dx);
+    M_011 += m * X_011(dx);
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 2
+
+    /* 3rd order terms */
+    M_300 += -m * X_300(dx);
+    M_030 += -m * X_030(dx);
+    M_003 += -m * X_003(dx);
+    M_210 += -m * X_210(dx);
+    M_201 += -m * X_201(dx);
+    M_120 += -m * X_120(dx);
+    M_021 += -m * X_021(dx);
+    M_102 += -m * X_102(dx);
+    M_012 += -m * X_012(dx);
+    M_111 += -m * X_111(dx);
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 3
+
+    /* 4th order terms */
+    M_400 += m * X_400(dx);
+    M_040 += m * X_040(dx);
+    M_004 += m * X_004(dx);
+    M_310 += m * X_310(dx);
+    M_301 += m * X_301(dx);
+    M_130 += m * X_130(dx);
+    M_031 += m * X_031(dx);
+    M_103 += m * X_103(dx);
+    M_013 += m * X_013(dx);
+    M_220 += m * X_220(dx);
+    M_202 += m * X_202(dx);
+    M_022 += m * X_022(dx);
+    M_211 += m * X_211(dx);
+    M_121 += m * X_121(dx);
+    M_112 += m * X_112(dx);
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 4
+
+    /* 5th order terms */
+    M_005 += -m * X_005(dx);
+    M_014 += -m * X_014(dx);
+    M_023 += -m * X_023(dx);
+    M_032 += -m * X_032(dx);
+    M_041 += -m * X_041(dx);
+    M_050 += -m * X_050(dx);
+    M_104 += -m * X_104(dx);
+    M_113 += -m * X_113(dx);
+    M_122 += -m * X_122(dx);
+    M_131 += -m * X_131(dx);
+    M_140 += -m * X_140(dx);
+    M_203 += -m * X_203(dx);
+    M_212 += -m * X_212(dx);
+    M_221 += -m * X_221(dx);
+    M_230 += -m * X_230(dx);
+    M_302 += -m * X_302(dx);
+    M_311 += -m * X_311(dx);
+    M_320 += -m * X_320(dx);
+    M_401 += -m * X_401(dx);
+    M_410 += -m * X_410(dx);
+    M_500 += -m * X_500(dx);
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 5
+#error "Missing implementation for order >5"
+#endif
+  }
+
+  /* Store the data on the multipole. */
+  multi->r_max = sqrt(r_max2);
+  multi->CoM[0] = com[0];
+  multi->CoM[1] = com[1];
+  multi->CoM[2] = com[2];
+  multi->m_pole.max_softening = epsilon_max;
+  multi->m_pole.min_old_a_grav_norm = min_old_a_grav_norm;
+  multi->m_pole.min_mass = min_mass;
+  multi->m_pole.vel[0] = vel[0];
+  multi->m_pole.vel[1] = vel[1];
+  multi->m_pole.vel[2] = vel[2];
+  multi->m_pole.max_delta_vel[0] = max_delta_vel[0];
+  multi->m_pole.max_delta_vel[1] = max_delta_vel[1];
+  multi->m_pole.max_delta_vel[2] = max_delta_vel[2];
+  multi->m_pole.min_delta_vel[0] = min_delta_vel[0];
+  multi->m_pole.min_delta_vel[1] = min_delta_vel[1];
+  multi->m_pole.min_delta_vel[2] = min_delta_vel[2];
+  multi->m_pole.M_000 = mass;
+
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 0
+
+  /* 1st order terms (all 0 since we expand around CoM) */
+  // multi->m_pole.M_100 = M_100;
+  // multi->m_pole.M_010 = M_010;
+  // multi->m_pole.M_001 = M_001;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+
+  /* 2nd order terms */
+  multi->m_pole.M_200 = M_200;
+  multi->m_pole.M_020 = M_020;
+  multi->m_pole.M_002 = M_002;
+  multi->m_pole.M_110 = M_110;
+  multi->m_pole.M_101 = M_101;
+  multi->m_pole.M_011 = M_011;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 2
+
+  /* 3rd order terms */
+  multi->m_pole.M_300 = M_300;
+  multi->m_pole.M_030 = M_030;
+  multi->m_pole.M_003 = M_003;
+  multi->m_pole.M_210 = M_210;
+  multi->m_pole.M_201 = M_201;
+  multi->m_pole.M_120 = M_120;
+  multi->m_pole.M_021 = M_021;
+  multi->m_pole.M_102 = M_102;
+  multi->m_pole.M_012 = M_012;
+  multi->m_pole.M_111 = M_111;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 3
+
+  /* 4th order terms */
+  multi->m_pole.M_400 = M_400;
+  multi->m_pole.M_040 = M_040;
+  multi->m_pole.M_004 = M_004;
+  multi->m_pole.M_310 = M_310;
+  multi->m_pole.M_301 = M_301;
+  multi->m_pole.M_130 = M_130;
+  multi->m_pole.M_031 = M_031;
+  multi->m_pole.M_103 = M_103;
+  multi->m_pole.M_013 = M_013;
+  multi->m_pole.M_220 = M_220;
+  multi->m_pole.M_202 = M_202;
+  multi->m_pole.M_022 = M_022;
+  multi->m_pole.M_211 = M_211;
+  multi->m_pole.M_121 = M_121;
+  multi->m_pole.M_112 = M_112;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 4
+
+  /* 5th order terms */
+  multi->m_pole.M_005 = M_005;
+  multi->m_pole.M_014 = M_014;
+  multi->m_pole.M_023 = M_023;
+  multi->m_pole.M_032 = M_032;
+  multi->m_pole.M_041 = M_041;
+  multi->m_pole.M_050 = M_050;
+  multi->m_pole.M_104 = M_104;
+  multi->m_pole.M_113 = M_113;
+  multi->m_pole.M_122 = M_122;
+  multi->m_pole.M_131 = M_131;
+  multi->m_pole.M_140 = M_140;
+  multi->m_pole.M_203 = M_203;
+  multi->m_pole.M_212 = M_212;
+  multi->m_pole.M_221 = M_221;
+  multi->m_pole.M_230 = M_230;
+  multi->m_pole.M_302 = M_302;
+  multi->m_pole.M_311 = M_311;
+  multi->m_pole.M_320 = M_320;
+  multi->m_pole.M_401 = M_401;
+  multi->m_pole.M_410 = M_410;
+  multi->m_pole.M_500 = M_500;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 5
+#error "Missing implementation for order >5"
+#endif
+
+#if defined(SWIFT_DEBUG_CHECKS) || defined(SWIFT_GRAVITY_FORCE_CHECKS)
+  multi->m_pole.num_gpart = gcount;
+#endif
+}
@@ -1,293 +1,2492 @@
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <iostream>
 #include <math.h>
 #include <time.h>
 #include <cuda.h>
 #include <cuda_runtime.h>
+#include <cufft.h>
 #include <unistd.h>
 
 #include "externalfunctions.cu"
 #include "multipole_struct.h"
 
 /* Local Cuda includes */ 
+#include "cuda_exact_force.h"
+#include "cuda_fof.h"
+#include "cuda_gpart_mirror.h"
+#include "cuda_gravity_cache.h"
+#include "cuda_hydro.h"
+#include "cuda_lightcone.h"
+#include "cuda_mm_batch.h"
+#include "cuda_multipole_build.h"
+#include "cuda_multipole_mirror.h"
+#include "cuda_pair_batch.h"
+#include "cuda_pm_mesh.h"
+#include "cuda_precision.h"
+#include "cuda_rt.h"
 #include "cuda_streams.h"
+#include "cuda_timeline.h"
+#include "cuda_top_multipoles.h"
+#include "cuda_types.h"
+
+
+//ERROR CHECKING
+//checks everything issued since the last check at once, given what the
+//synchronisation returned: the launch errors are picked up by
+//cudaGetLastError() and the errors of the copies and kernels by the
+//synchronisation
+//a sticky error survives the clearing by cudaGetLastError(), the context is
+//then lost for good
+static enum cuda_fault cuda_sync_check(cudaError_t err, const char *what) {
+
+	const cudaError_t launch_err = cudaGetLastError();
+	if (err == cudaSuccess) err = launch_err;
+	if (err == cudaSuccess) return cuda_fault_none;
+
+	const int sticky = cudaPeekAtLastError() != cudaSuccess;
+	fprintf(stderr, "Device fault (%s) in %s: %s\n", sticky ? "sticky" : "transient", what, cudaGetErrorString(err));
+	return sticky ? cuda_fault_sticky : cuda_fault_transient;
+}
+
+//waits for the stream and checks what was issued on it
+static enum cuda_fault cuda_stream_sync_check(cudaStream_t stream, const char *what) {
+
+	return cuda_sync_check(cudaStreamSynchronize(stream), what);
+}
+
+//waits for the event and checks what was issued before it
+extern "C" enum cuda_fault cuda_event_sync_check(cudaEvent_t event, const char *what) {
+
+	return cuda_sync_check(cudaEventSynchronize(event), what);
+}
 
 
 //PP ALL INTERACTIONS
-__global__ void pair_grav_pp(int periodic, const float *CoM_i, const float *CoM_j, float rmax_i, float rmax_j, double min_trunc, int *active_i, int *mpole_i, int *active_j, int *mpole_j, float dim_0, float dim_1, float dim_2, float *h_i, float *h_j, float *mass_i_arr, float *mass_j_arr, const float r_s_inv, const float *x_i, const float *x_j, const float *y_i, const float *y_j, const float *z_i, const float *z_j, float *a_x_i, float *a_y_i, float *a_z_i, float *a_x_j, float *a_y_j, float *a_z_j, float *pot_i, float *pot_j, int gcount_i, int gcount_padded_i, int gcount_j, int gcount_padded_j, int ci_active, int cj_active, const int symmetric, const int allow_mpole, const struct multipole *restrict multi_i, const struct multipole *restrict multi_j, float *epsilon, const int allow_multipole_j, const int allow_multipole_i) {
+//the particles of one cell of the pair as seen by the kernel
+struct gpu_pair_cell {
+  const float *x, *y, *z, *h, *m;
+  const int *active, *mpole;
+  float *a_x, *a_y, *a_z, *pot;
+  const float *CoM;
+  const struct multipole *multi;
+  int gcount, gcount_padded;
+};
+
+//blockIdx.y = 0 updates ci from cj and, when the pair is symmetric,
+//blockIdx.y = 1 updates cj from ci, such that every block has a single
+//source cell to stage into shared memory
+//the host picks the specialisation such that there is no masking here
+//RESIDENT cells point into the device-resident gpart mirror and the results
+//are accumulated there
+template <int TRUNCATED, int PERIODIC, int RESIDENT, int PRECISION>
+__global__ void pair_grav_pp(const struct gpu_pair_cell ci, const struct gpu_pair_cell cj, float dim_0, float dim_1, float dim_2, const float r_s_inv) {
+
+  const int first = blockIdx.x * blockDim.x;
+  const int stride = blockDim.x * gridDim.x;
+
+  if (blockIdx.y == 0)
+    grav_pp_block<TRUNCATED, PERIODIC, RESIDENT, PRECISION>(first, stride, ci.gcount, ci.x, ci.y, ci.z, ci.h, ci.active, ci.mpole, cj.x, cj.y, cj.z, cj.h, cj.m, cj.gcount_padded, cj.CoM, cj.multi, dim_0, dim_1, dim_2, r_s_inv, ci.a_x, ci.a_y, ci.a_z, ci.pot);
+  else
+    grav_pp_block<TRUNCATED, PERIODIC, RESIDENT, PRECISION>(first, stride, cj.gcount, cj.x, cj.y, cj.z, cj.h, cj.active, cj.mpole, ci.x, ci.y, ci.z, ci.h, ci.m, ci.gcount_padded, ci.CoM, ci.multi, dim_0, dim_1, dim_2, r_s_inv, cj.a_x, cj.a_y, cj.a_z, cj.pot);
+}
+
+//same as pair_grav_pp with one warp per particle of the updated cell, for
+//the small leaves (see grav_pp_warp)
+template <int TRUNCATED, int PERIODIC, int RESIDENT, int PRECISION>
+__global__ void pair_grav_pp_warp(const struct gpu_pair_cell ci, const struct gpu_pair_cell cj, float dim_0, float dim_1, float dim_2, const float r_s_inv) {
+
+  const int warps = blockDim.x / GRAV_PP_WARP;
+  const int first = blockIdx.x * warps + threadIdx.x / GRAV_PP_WARP;
+  const int stride = warps * gridDim.x;
+
+  if (blockIdx.y == 0)
+    grav_pp_warp<TRUNCATED, PERIODIC, RESIDENT, PRECISION>(first, stride, ci.gcount, ci.x, ci.y, ci.z, ci.h, ci.active, ci.mpole, cj.x, cj.y, cj.z, cj.h, cj.m, cj.gcount_padded, cj.CoM, cj.multi, dim_0, dim_1, dim_2, r_s_inv, ci.a_x, ci.a_y, ci.a_z, ci.pot);
+  else
+    grav_pp_warp<TRUNCATED, PERIODIC, RESIDENT, PRECISION>(first, stride, cj.gcount, cj.x, cj.y, cj.z, cj.h, cj.active, cj.mpole, ci.x, ci.y, ci.z, ci.h, ci.m, ci.gcount_padded, ci.CoM, ci.multi, dim_0, dim_1, dim_2, r_s_inv, cj.a_x, cj.a_y, cj.a_z, cj.pot);
+}
+
+//the block size giving the best occupancy of the device for a kernel that
+//does not use dynamic shared memory, asked for once per kernel and process
+//(all the devices of a run are assumed to be alike)
+template <typename KERNEL>
+static int grav_launch_block_size(KERNEL kernel) {
+
+  static const int block_size = [kernel]() {
+    int min_grid = 0, block = 0;
+    if (cudaOccupancyMaxPotentialBlockSize(&min_grid, &block, kernel, 0, 0) != cudaSuccess || block < GRAV_PP_WARP) {
+      cudaGetLastError();
+      return 128;
+    }
+    return block;
+  }();
+  return block_size;
+}
+
+//launches pair_grav_pp_warp with a block size from the occupancy, but no
+//more warps per block than there are particles to update
+template <int TRUNCATED, int PERIODIC, int RESIDENT, int PRECISION>
+static void pair_grav_pp_warp_launch(const int count, const int symmetric, const struct gpu_pair_cell &ci, const struct gpu_pair_cell &cj, const float *dim, const float r_s_inv, cudaStream_t stream) {
+
+  const int block_size = grav_launch_block_size(pair_grav_pp_warp<TRUNCATED, PERIODIC, RESIDENT, PRECISION>);
+  const int threads = min(block_size / GRAV_PP_WARP, count) * GRAV_PP_WARP;
+  const int warps = threads / GRAV_PP_WARP;
+  const dim3 grid((count + warps - 1) / warps, symmetric ? 2 : 1);
+
+  pair_grav_pp_warp<TRUNCATED, PERIODIC, RESIDENT, PRECISION><<<grid, threads, 0, stream>>>(ci, cj, dim[0], dim[1], dim[2], r_s_inv);
+}
+
+//launches the variant of pair_grav_pp matching the pair, periodic is 0 for
+//the truncated pairs the host already moved to the right periodic image
+//the tiled kernel gives a single thread per particle and leaves most of the
+//device idle on a small leaf, those go to the warp-per-particle kernel
+//unless the strict mode asks for the summation order of the CPU
+template <int RESIDENT, int PRECISION>
+static void pair_grav_pp_launch_mode(const int truncated, const int periodic, const int symmetric, const struct gpu_pair_cell &ci, const struct gpu_pair_cell &cj, const float *dim, const float r_s_inv, cudaStream_t stream) {
+
+  const int count = (symmetric && cj.gcount > ci.gcount) ? cj.gcount : ci.gcount;
+
+  if (PRECISION != cuda_precision_strict && count <= GRAV_PP_WARP_MAX_COUNT) {
+    if (count == 0) return;
+    if (truncated && periodic)
+      pair_grav_pp_warp_launch<1, 1, RESIDENT, PRECISION>(count, symmetric, ci, cj, dim, r_s_inv, stream);
+    else if (truncated)
+      pair_grav_pp_warp_launch<1, 0, RESIDENT, PRECISION>(count, symmetric, ci, cj, dim, r_s_inv, stream);
+    else if (periodic)
+      pair_grav_pp_warp_launch<0, 1, RESIDENT, PRECISION>(count, symmetric, ci, cj, dim, r_s_inv, stream);
+    else
+      pair_grav_pp_warp_launch<0, 0, RESIDENT, PRECISION>(count, symmetric, ci, cj, dim, r_s_inv, stream);
+    return;
+  }
+
+  const dim3 grid((count + GRAV_PP_TILE - 1) / GRAV_PP_TILE, symmetric ? 2 : 1);
+
+  if (truncated && periodic)
+    pair_grav_pp<1, 1, RESIDENT, PRECISION><<<grid, GRAV_PP_TILE, 0, stream>>>(ci, cj, dim[0], dim[1], dim[2], r_s_inv);
+  else if (truncated)
+    pair_grav_pp<1, 0, RESIDENT, PRECISION><<<grid, GRAV_PP_TILE, 0, stream>>>(ci, cj, dim[0], dim[1], dim[2], r_s_inv);
+  else if (periodic)
+    pair_grav_pp<0, 1, RESIDENT, PRECISION><<<grid, GRAV_PP_TILE, 0, stream>>>(ci, cj, dim[0], dim[1], dim[2], r_s_inv);
+  else
+    pair_grav_pp<0, 0, RESIDENT, PRECISION><<<grid, GRAV_PP_TILE, 0, stream>>>(ci, cj, dim[0], dim[1], dim[2], r_s_inv);
+}
 
-	int max_r_decision = 0;
+//same as above for the #cuda_precision mode picked at run time
+template <int RESIDENT>
+static void pair_grav_pp_launch(const int precision, const int truncated, const int periodic, const int symmetric, const struct gpu_pair_cell &ci, const struct gpu_pair_cell &cj, const float *dim, const float r_s_inv, cudaStream_t stream) {
 
-      /* Can we use the Newtonian version or do we need the truncated one ? */
+  if (precision == cuda_precision_mixed)
+    pair_grav_pp_launch_mode<RESIDENT, cuda_precision_mixed>(truncated, periodic, symmetric, ci, cj, dim, r_s_inv, stream);
+  else if (precision == cuda_precision_fma)
+    pair_grav_pp_launch_mode<RESIDENT, cuda_precision_fma>(truncated, periodic, symmetric, ci, cj, dim, r_s_inv, stream);
+  else
+    pair_grav_pp_launch_mode<RESIDENT, cuda_precision_strict>(truncated, periodic, symmetric, ci, cj, dim, r_s_inv, stream);
+}
+
+//BATCHED PP INTERACTIONS
+//one block per (pair, direction), blockIdx.y = 0 updates ci, 1 updates cj
+//the flags always come from the batch, the particles either from the batch
+//or, when RESIDENT, from the gpart mirror at the cells' global offsets
+//the multipoles are read from the multipole mirror and are only there when
+//some particle of the updated cell uses them
+template <int RESIDENT, int PRECISION>
+__global__ void pair_grav_pp_batched(const struct cuda_pair_desc *pairs, const int periodic, float dim_0, float dim_1, float dim_2, const float r_s_inv, const float *x, const float *y, const float *z, const float *h, const float *mass, const int *active, const int *mpole, float *a_x, float *a_y, float *a_z, float *pot) {
 
-    /* Not periodic -> Can always use Newtonian potential */
-    /* Let's updated the active cell(s) only */
+  const struct cuda_pair_desc *p = &pairs[blockIdx.x];
 
-      /* First the P2P */
-      grav_pp_full(active_i, mpole_i, dim_0, dim_1, dim_2, h_i, h_j, mass_j_arr, r_s_inv, x_i, x_j, y_i, y_j, z_i, z_j, a_x_i, a_y_i, a_z_i, pot_i, gcount_i, gcount_padded_j, periodic, ci_active, 0, symmetric, max_r_decision);
+  if (blockIdx.y == 0) {
 
-      /* Then the M2P */
-      grav_pm_full(active_i, mpole_i, gcount_padded_i, CoM_j, multi_j, periodic, dim_0, dim_1, dim_2, x_i, y_i, z_i, gcount_i, a_x_i, a_y_i, a_z_i, *h_i, pot_i, allow_multipole_j, allow_multipole_i, ci_active, 0, symmetric, max_r_decision);
+    if (!p->update_i) return;
 
-      /* First the P2P */
-      grav_pp_full(active_j, mpole_j, dim_0, dim_1, dim_2, h_j, h_i, mass_i_arr, r_s_inv, x_j, x_i, y_j, y_i, z_j, z_i, a_x_j, a_y_j, a_z_j, pot_j, gcount_j, gcount_padded_i, periodic, 0, cj_active, symmetric, max_r_decision);
+    const size_t oi = RESIDENT ? p->goffset_i : p->offset_i;
+    const size_t oj = RESIDENT ? p->goffset_j : p->offset_j;
+    const int fi = p->offset_i;
+    const int count_j = RESIDENT ? p->gcount_j : p->gcount_padded_j;
+    const struct cuda_cell_multipole *mj = p->multi_j;
+    grav_pp_batched_block<RESIDENT, PRECISION>(p->gcount_i, x + oi, y + oi, z + oi, h + oi, active + fi, mpole + fi, x + oj, y + oj, z + oj, h + oj, mass + oj, count_j, mj != NULL ? mj->CoM : NULL, mj != NULL ? &mj->m_pole : NULL, periodic, p->truncated, dim_0, dim_1, dim_2, r_s_inv, a_x + oi, a_y + oi, a_z + oi, pot + oi);
 
-      /* Then the M2P */
-      grav_pm_full(active_j, mpole_j, gcount_padded_j, CoM_i, multi_i, periodic, dim_0, dim_1, dim_2, x_j, y_j, z_j, gcount_j, a_x_j, a_y_j, a_z_j, *h_j, pot_j, allow_multipole_i, allow_multipole_j, 0, cj_active, symmetric, max_r_decision);
+  } else {
 
-    /* Periodic BC */
+    if (!p->update_j) return;
 
-    /* Get the relative distance between the CoMs */
-    double d[3] = {CoM_j[0] - CoM_i[0], CoM_j[1] - CoM_i[1],
-                    CoM_j[2] - CoM_i[2]};
+    const size_t oi = RESIDENT ? p->goffset_j : p->offset_j;
+    const size_t oj = RESIDENT ? p->goffset_i : p->offset_i;
+    const int fi = p->offset_j;
+    const int count_j = RESIDENT ? p->gcount_i : p->gcount_padded_i;
+    const struct cuda_cell_multipole *mj = p->multi_i;
+    grav_pp_batched_block<RESIDENT, PRECISION>(p->gcount_j, x + oi, y + oi, z + oi, h + oi, active + fi, mpole + fi, x + oj, y + oj, z + oj, h + oj, mass + oj, count_j, mj != NULL ? mj->CoM : NULL, mj != NULL ? &mj->m_pole : NULL, periodic, p->truncated, dim_0, dim_1, dim_2, r_s_inv, a_x + oi, a_y + oi, a_z + oi, pot + oi);
+  }
+}
 
-    /* Correct for periodic BCs */
-    d[0] = nearestf1(d[0], dim_0);
-    d[1] = nearestf1(d[1], dim_1);
-    d[2] = nearestf1(d[2], dim_2);
+//launches pair_grav_pp_batched in the #cuda_precision mode picked at run time
+template <int RESIDENT>
+static void pair_grav_pp_batched_launch(const int precision, const dim3 grid, cudaStream_t stream, const struct cuda_pair_desc *pairs, const int periodic, const float *dim, const float r_s_inv, const float *x, const float *y, const float *z, const float *h, const float *mass, const int *active, const int *mpole, float *a_x, float *a_y, float *a_z, float *pot) {
 
-    const double r2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+  if (precision == cuda_precision_mixed)
+    pair_grav_pp_batched<RESIDENT, cuda_precision_mixed><<<grid, GRAV_PP_TILE, 0, stream>>>(pairs, periodic, dim[0], dim[1], dim[2], r_s_inv, x, y, z, h, mass, active, mpole, a_x, a_y, a_z, pot);
+  else if (precision == cuda_precision_fma)
+    pair_grav_pp_batched<RESIDENT, cuda_precision_fma><<<grid, GRAV_PP_TILE, 0, stream>>>(pairs, periodic, dim[0], dim[1], dim[2], r_s_inv, x, y, z, h, mass, active, mpole, a_x, a_y, a_z, pot);
+  else
+    pair_grav_pp_batched<RESIDENT, cuda_precision_strict><<<grid, GRAV_PP_TILE, 0, stream>>>(pairs, periodic, dim[0], dim[1], dim[2], r_s_inv, x, y, z, h, mass, active, mpole, a_x, a_y, a_z, pot);
+}
 
-    /* Get the maximal distance between any two particles */
-    const double max_r = sqrt(r2) + rmax_i + rmax_j;
+//issues the copies and the kernel of a batch of count particles and npairs
+//pairs on the stream, without waiting for them
+//with a resident mirror only the flags and descriptors travel and the
+//results stay on the device until the end of the step
+static void pp_batch_issue(struct cuda_pair_batch *b, const struct cuda_gpart_mirror *resident, const int precision, const int periodic, const float *dim, const float r_s_inv, const int count, const int npairs, cudaStream_t stream) {
 
-    if (max_r > min_trunc) {
-	max_r_decision = 0;}
-    else {
-	max_r_decision = 1;}
+	const size_t sizeF = count * sizeof(float);
+	const size_t sizeI = count * sizeof(int);
+	const dim3 grid(npairs, 2);
 
-    /* Do we need to use the truncated interactions ? */
-    
+	if (resident != NULL) {
 
-      /* Periodic but far-away cells must use the truncated potential */
+		cuda_timeline_gpu_phase(stream, cuda_timeline_h2d);
+		cudaMemcpyAsync(b->d_active, b->active, sizeI, cudaMemcpyHostToDevice, stream);
+		cudaMemcpyAsync(b->d_use_mpole, b->use_mpole, sizeI, cudaMemcpyHostToDevice, stream);
+		cudaMemcpyAsync(b->d_pairs, b->pairs, npairs * sizeof(struct cuda_pair_desc), cudaMemcpyHostToDevice, stream);
 
-      /* Let's updated the active cell(s) only */
-
-        /* First the (truncated) P2P */
-        grav_pp_truncated(active_i, mpole_i, dim_0, dim_1, dim_2, h_i, h_j, mass_j_arr, r_s_inv, x_i, x_j, y_i, y_j, z_i, z_j, a_x_i, a_y_i, a_z_i, pot_i, gcount_i, gcount_padded_j, periodic, ci_active, 0, symmetric, max_r_decision);
-	
-
-        /* Then the M2P */
-        grav_pm_truncated(active_i, mpole_i, gcount_padded_i, CoM_j, multi_j, periodic, dim_0, dim_1, dim_2, r_s_inv, x_i, y_i, z_i, gcount_i, a_x_i, a_y_i, a_z_i, *h_i, pot_i, allow_multipole_j, allow_multipole_i, ci_active, 0, symmetric, max_r_decision);
-
-        /* First the (truncated) P2P */
-	grav_pp_truncated(active_j, mpole_j, dim_0, dim_1, dim_2, h_j, h_i, mass_i_arr, r_s_inv, x_j, x_i, y_j, y_i, z_j, z_i, a_x_j, a_y_j, a_z_j, pot_j, gcount_j, gcount_padded_i, periodic, 0, cj_active, symmetric, max_r_decision);
-
-        /* Then the M2P */
-	grav_pm_truncated(active_j, mpole_j, gcount_padded_j, CoM_i, multi_i, periodic, dim_0, dim_1, dim_2, r_s_inv, x_i, y_i, z_i, gcount_j, a_x_j, a_y_j, a_z_j, *h_j, pot_j, allow_multipole_j, allow_multipole_i, 0, cj_active, symmetric, max_r_decision);
-
-      /* Periodic but close-by cells can use the full Newtonian potential */
-
-      /* Let's updated the active cell(s) only */
-
-        /* First the (Newtonian) P2P */
-        grav_pp_full(active_i, mpole_i, dim_0, dim_1, dim_2, h_i, h_j, mass_j_arr, r_s_inv, x_i, x_j, y_i, y_j, z_i, z_j, a_x_i, a_y_i, a_z_i, pot_i, gcount_i, gcount_padded_j, periodic, ci_active, 0, symmetric, max_r_decision);
-
-        /* Then the M2P */
-        grav_pm_full(active_i, mpole_i, gcount_padded_i, CoM_j, multi_j, periodic, dim_0, dim_1, dim_2, x_i, y_i, z_i, gcount_i, a_x_i, a_y_i, a_z_i, *h_i, pot_i, allow_multipole_j, allow_multipole_i, ci_active, 0, symmetric, max_r_decision);
-
-        /* First the (Newtonian) P2P */
-        grav_pp_full(active_j, mpole_j, dim_0, dim_1, dim_2, h_j, h_i, mass_i_arr, r_s_inv, x_j, x_i, y_j, y_i, z_j, z_i, a_x_j, a_y_j, a_z_j, pot_j, gcount_j, gcount_padded_i, periodic, 0, cj_active, symmetric, max_r_decision);
-
-        /* Then the M2P */
-        grav_pm_full(active_j, mpole_j, gcount_padded_j, CoM_i, multi_i, periodic, dim_0, dim_1, dim_2, x_j, y_j, z_j, gcount_j, a_x_j, a_y_j, a_z_j, *h_j, pot_j, allow_multipole_i, allow_multipole_j, 0, cj_active, symmetric, max_r_decision);
-
-}
-
-
-//do not touch these variables you dumbass you need them to be pointers girly
-extern "C" void pp_offload(int periodic, const float *CoM_i, const float *CoM_j, float rmax_i, float rmax_j, double min_trunc, int* active_i, int* mpole_i, int* active_j, int* mpole_j, float *dim, const float *x_i, const float *x_j_arr, const float *y_i, const float *y_j_arr, const float *z_i, const float *z_j_arr, float *pot_i, float *pot_j, float *a_x_i, float *a_y_i, float *a_z_i, float *a_x_j, float *a_y_j, float *a_z_j, float *mass_i_arr, float *mass_j_arr, const float *r_s_inv, float *h_i, float *h_j_arr, const int *gcount_i, const int *gcount_padded_i, const int *gcount_j, const int *gcount_padded_j, int ci_active, int cj_active, const int symmetric, const int allow_mpole, const struct multipole *restrict multi_i, const struct multipole *restrict multi_j, float *epsilon, const int *allow_multipole_j, const int *allow_multipole_i){
-
-	//cudaDeviceSynchronize();
-	
-	float a_x_i_new[*gcount_i];
-	float a_y_i_new[*gcount_i];
-	float a_z_i_new[*gcount_i];
-	float pot_i_new[*gcount_i];
-
-	float a_x_j_new[*gcount_j];
-	float a_y_j_new[*gcount_j];
-	float a_z_j_new[*gcount_j];
-	float pot_j_new[*gcount_j];
-
-	//create device pointers
-	float *d_h_i;
-	float *d_h_j;
-	float *d_mass_i;
-	float *d_mass_j;
-	float *d_x_i;
-	float *d_x_j;
-	float *d_y_i;
-	float *d_y_j;
-	float *d_z_i;
-	float *d_z_j;
-	float *d_a_x_i;
-	float *d_a_y_i;
-	float *d_a_z_i;
-	float *d_a_x_j;
-	float *d_a_y_j;
-	float *d_a_z_j;
-	float *d_pot_i;
-	float *d_pot_j;
-	int *d_active_i;
-	int *d_mpole_i;
-	int *d_active_j;
-	int *d_mpole_j;
-	float *d_CoM_i;
-	float *d_CoM_j;
-
-	//cudaDeviceSynchronize();
-
-        //cudaMalloc(&h_multi_j, 13*sizeof(float));
-        //cudaMemcpyAsync(h_multi_j, multi_j, 13*sizeof(float), cudaMemcpyHostToDevice);
-	multipole* d_multi_j;
-     	cudaMalloc(&d_multi_j, sizeof(multipole)); 
-     	cudaMemcpyAsync(d_multi_j, multi_j, sizeof(multipole), cudaMemcpyHostToDevice);
-	multipole* d_multi_i;
-     	cudaMalloc(&d_multi_i, sizeof(multipole)); 
-     	cudaMemcpyAsync(d_multi_i, multi_i, sizeof(multipole), cudaMemcpyHostToDevice);
-
-	//allocate memory on device
-	cudaMalloc(&d_h_i, *gcount_i * sizeof(float));
-	cudaMalloc(&d_h_j, *gcount_padded_j * sizeof(float));
-	cudaMalloc(&d_mass_i, *gcount_padded_i * sizeof(float));
-	cudaMalloc(&d_mass_j, *gcount_padded_j * sizeof(float));
-	cudaMalloc(&d_x_i, *gcount_i * sizeof(float));
-	cudaMalloc(&d_x_j, *gcount_padded_j * sizeof(float));
-	cudaMalloc(&d_y_i, *gcount_i * sizeof(float));
-	cudaMalloc(&d_y_j, *gcount_padded_j * sizeof(float));
-	cudaMalloc(&d_z_i, *gcount_i * sizeof(float));
-	cudaMalloc(&d_z_j, *gcount_padded_j * sizeof(float));
-	cudaMalloc(&d_a_x_i, *gcount_i * sizeof(float));
-	cudaMalloc(&d_a_y_i, *gcount_i * sizeof(float));
-	cudaMalloc(&d_a_z_i, *gcount_i * sizeof(float));
-	cudaMalloc(&d_a_x_j, *gcount_j * sizeof(float));
-	cudaMalloc(&d_a_y_j, *gcount_j * sizeof(float));
-	cudaMalloc(&d_a_z_j, *gcount_j * sizeof(float));
-	cudaMalloc(&d_pot_i, *gcount_i * sizeof(float));
-	cudaMalloc(&d_pot_j, *gcount_j * sizeof(float));
-	cudaMalloc(&d_active_i, *gcount_i * sizeof(int));
-	cudaMalloc(&d_mpole_i, *gcount_i * sizeof(int));
-	cudaMalloc(&d_active_j, *gcount_j * sizeof(int));
-	cudaMalloc(&d_mpole_j, *gcount_j * sizeof(int));
-	cudaMalloc(&d_CoM_i, 3 * sizeof(float));
-	cudaMalloc(&d_CoM_j, 3 * sizeof(float));
+		cuda_timeline_gpu_phase(stream, cuda_timeline_kernel);
+		pair_grav_pp_batched_launch<1>(precision, grid, stream, b->d_pairs, periodic, dim, r_s_inv, resident->x, resident->y, resident->z, resident->epsilon, resident->m, b->d_active, b->d_use_mpole, resident->a_x, resident->a_y, resident->a_z, resident->pot);
+		return;
+	}
 
 	//copy data to device
-	cudaMemcpyAsync(d_h_i, h_i, *gcount_i * sizeof(float), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_h_j, h_j_arr, *gcount_padded_j * sizeof(float), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_mass_i, mass_i_arr, *gcount_padded_i * sizeof(float), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_mass_j, mass_j_arr, *gcount_padded_j * sizeof(float), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_x_i, x_i, *gcount_i * sizeof(float), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_x_j, x_j_arr, *gcount_padded_j * sizeof(float), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_y_i, y_i, *gcount_i * sizeof(float), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_y_j, y_j_arr, *gcount_padded_j * sizeof(float), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_z_i, z_i, *gcount_i * sizeof(float), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_z_j, z_j_arr, *gcount_padded_j * sizeof(float), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_a_x_i, a_x_i, *gcount_i * sizeof(float), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_a_y_i, a_y_i, *gcount_i * sizeof(float), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_a_z_i, a_z_i, *gcount_i * sizeof(float), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_a_x_j, a_x_j, *gcount_j * sizeof(float), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_a_y_j, a_y_j, *gcount_j * sizeof(float), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_a_z_j, a_z_j, *gcount_j * sizeof(float), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_pot_i, pot_i, *gcount_i * sizeof(float), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_pot_j, pot_j, *gcount_j * sizeof(float), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_active_i, active_i, *gcount_i * sizeof(int), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_mpole_i, mpole_i, *gcount_i * sizeof(int), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_active_j, active_j, *gcount_j * sizeof(int), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_mpole_j, mpole_j, *gcount_j * sizeof(int), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_CoM_i, CoM_i, 3 * sizeof(float), cudaMemcpyHostToDevice);
-	cudaMemcpyAsync(d_CoM_j, CoM_j, 3 * sizeof(float), cudaMemcpyHostToDevice);
-	
-	//printf("%.16f %.16f\n", x_i[0], y_i[0]);
+	cuda_timeline_gpu_phase(stream, cuda_timeline_h2d);
+	cudaMemcpyAsync(b->d_x, b->x, sizeF, cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(b->d_y, b->y, sizeF, cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(b->d_z, b->z, sizeF, cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(b->d_epsilon, b->epsilon, sizeF, cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(b->d_m, b->m, sizeF, cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(b->d_active, b->active, sizeI, cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(b->d_use_mpole, b->use_mpole, sizeI, cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(b->d_pairs, b->pairs, npairs * sizeof(struct cuda_pair_desc), cudaMemcpyHostToDevice, stream);
 
-	cudaError_t err = cudaGetLastError();
-    	if (err != cudaSuccess) 
-	printf("Error1: %s\n", cudaGetErrorString(err));
+	//call kernel function, one block per pair and direction
+	cuda_timeline_gpu_phase(stream, cuda_timeline_kernel);
+	pair_grav_pp_batched_launch<0>(precision, grid, stream, b->d_pairs, periodic, dim, r_s_inv, b->d_x, b->d_y, b->d_z, b->d_epsilon, b->d_m, b->d_active, b->d_use_mpole, b->d_a_x, b->d_a_y, b->d_a_z, b->d_pot);
+
+	//copy data from device
+	cuda_timeline_gpu_phase(stream, cuda_timeline_d2h);
+	cudaMemcpyAsync(b->a_x, b->d_a_x, sizeF, cudaMemcpyDeviceToHost, stream);
+	cudaMemcpyAsync(b->a_y, b->d_a_y, sizeF, cudaMemcpyDeviceToHost, stream);
+	cudaMemcpyAsync(b->a_z, b->d_a_z, sizeF, cudaMemcpyDeviceToHost, stream);
+	cudaMemcpyAsync(b->pot, b->d_pot, sizeF, cudaMemcpyDeviceToHost, stream);
+}
+
+//replays the graph of the size class of the batch, capturing it the first
+//time that class is seen. The copies are rounded up to the class and the
+//extra pairs are blanked such that their blocks return straight away
+static void pp_batch_replay(struct cuda_pair_batch *b, const struct cuda_gpart_mirror *resident, const int precision, const int periodic, const float *dim, const float r_s_inv, cudaStream_t stream) {
+
+	const int count_bucket = cuda_pair_batch_graph_bucket(b->count);
+	const int pairs_bucket = cuda_pair_batch_graph_bucket(b->npairs);
+	const int count = (1 << count_bucket) < b->size ? (1 << count_bucket) : b->size;
+	const int npairs = (1 << pairs_bucket) < b->max_pairs ? (1 << pairs_bucket) : b->max_pairs;
+
+	memset(&b->pairs[b->npairs], 0, (npairs - b->npairs) * sizeof(struct cuda_pair_desc));
+
+	//the mirror moved since the resident graphs were captured
+	if (resident != NULL && resident->x != b->graph_mirror) {
+		for (int k = 0; k < CUDA_PAIR_BATCH_GRAPH_BUCKETS * CUDA_PAIR_BATCH_GRAPH_BUCKETS; k++) {
+			cudaGraphExec_t *g = &b->graphs[cuda_pair_batch_graph_index(1, 0, 0) + k];
+			if (*g != NULL) cudaGraphExecDestroy(*g);
+			*g = NULL;
+		}
+		b->graph_mirror = resident->x;
+	}
+
+	cudaGraphExec_t *exec = &b->graphs[cuda_pair_batch_graph_index(resident != NULL, count_bucket, pairs_bucket)];
+
+	if (*exec == NULL) {
+		cudaGraph_t graph;
+		cudaStreamBeginCapture(stream, cudaStreamCaptureModeThreadLocal);
+		pp_batch_issue(b, resident, precision, periodic, dim, r_s_inv, count, npairs, stream);
+		cudaStreamEndCapture(stream, &graph);
+
+		cudaError_t err = cudaGraphInstantiateWithFlags(exec, graph, 0);
+		if (err != cudaSuccess)
+		printf("Error batch graph instantiation: %s\n", cudaGetErrorString(err));
+		cudaGraphDestroy(graph);
+	}
+
+	cudaGraphLaunch(*exec, stream);
+}
+
+//sends a whole batch of pairs to the device, computes them with a single
+//kernel launch and brings the results back into the batch's host arrays
+//(or leaves them in the resident mirror)
+//with wait == 0 the batch is left in flight and b->done gets recorded
+//behind it, the host arrays must not be touched before it has fired and the
+//batch is checked by waiting for it with cuda_event_sync_check(), unless
+//the launch already failed
+extern "C" enum cuda_fault pp_batch_offload(struct cuda_pair_batch *b, const struct cuda_gpart_mirror *resident, const int precision, const int periodic, const float *dim, const float r_s_inv, const int wait, cudaStream_t stream) {
+
+	if (b->npairs == 0) return cuda_fault_none;
+
+	//the phases of a graph are not marked, the whole replay counts as a kernel
+	if (b->graphs != NULL) {
+		cuda_timeline_gpu_phase(stream, cuda_timeline_kernel);
+		pp_batch_replay(b, resident, precision, periodic, dim, r_s_inv, stream);
+	} else
+		pp_batch_issue(b, resident, precision, periodic, dim, r_s_inv, b->count, b->npairs, stream);
+	cuda_timeline_gpu_phase(stream, -1);
+
+	//the host arrays get re-used by the next batch
+	if (wait) return cuda_stream_sync_check(stream, "pair batch");
+
+	cudaEventRecord(b->done, stream);
+
+	//a failed launch must not be left to the next check made by this thread
+	if (cudaPeekAtLastError() != cudaSuccess)
+		return cuda_stream_sync_check(stream, "pair batch");
+	return cuda_fault_none;
+}
+
+//SELF PP INTERACTIONS
+//one thread per particle of the cell, inactive particles get zeros
+//RESIDENT cells point into the device-resident gpart mirror and the results
+//are accumulated there, the inactive particles are then left alone
+template <int TRUNCATED, int RESIDENT, int PRECISION>
+__global__ void self_grav_pp(const float r_s_inv, const struct gpu_pair_cell c) {
+
+  for (int pid = blockIdx.x * blockDim.x + threadIdx.x; pid < c.gcount; pid += blockDim.x * gridDim.x) {
+
+    if (c.active[pid]) {
+      grav_self_pp_particle<TRUNCATED, RESIDENT, PRECISION>(pid, c.x, c.y, c.z, c.h, c.m, c.gcount_padded, r_s_inv, c.a_x, c.a_y, c.a_z, c.pot);
+    } else if (!RESIDENT) {
+      c.a_x[pid] = 0.f;
+      c.a_y[pid] = 0.f;
+      c.a_z[pid] = 0.f;
+      c.pot[pid] = 0.f;
+    }
+  }
+}
+
+//launches self_grav_pp with a block size from the occupancy, but no larger
+//than the cell rounded up to a warp
+template <int TRUNCATED, int RESIDENT, int PRECISION>
+static void self_grav_pp_launch_mode(const float r_s_inv, const struct gpu_pair_cell &c, cudaStream_t stream) {
+
+  if (c.gcount == 0) return;
+
+  const int block_size = grav_launch_block_size(self_grav_pp<TRUNCATED, RESIDENT, PRECISION>);
+  const int threads = min(block_size, (c.gcount + GRAV_PP_WARP - 1) / GRAV_PP_WARP * GRAV_PP_WARP);
+  const int blocks = (c.gcount + threads - 1) / threads;
+
+  self_grav_pp<TRUNCATED, RESIDENT, PRECISION><<<blocks, threads, 0, stream>>>(r_s_inv, c);
+}
+
+//same as above for the #cuda_precision mode picked at run time
+template <int RESIDENT>
+static void self_grav_pp_launch(const int precision, const int truncated, const float r_s_inv, const struct gpu_pair_cell &c, cudaStream_t stream) {
+
+  if (truncated) {
+    if (precision == cuda_precision_mixed)
+      self_grav_pp_launch_mode<1, RESIDENT, cuda_precision_mixed>(r_s_inv, c, stream);
+    else if (precision == cuda_precision_fma)
+      self_grav_pp_launch_mode<1, RESIDENT, cuda_precision_fma>(r_s_inv, c, stream);
+    else
+      self_grav_pp_launch_mode<1, RESIDENT, cuda_precision_strict>(r_s_inv, c, stream);
+  } else {
+    if (precision == cuda_precision_mixed)
+      self_grav_pp_launch_mode<0, RESIDENT, cuda_precision_mixed>(r_s_inv, c, stream);
+    else if (precision == cuda_precision_fma)
+      self_grav_pp_launch_mode<0, RESIDENT, cuda_precision_fma>(r_s_inv, c, stream);
+    else
+      self_grav_pp_launch_mode<0, RESIDENT, cuda_precision_strict>(r_s_inv, c, stream);
+  }
+}
+
+//offloads the self-interaction of a leaf cell, the results are copied
+//straight back into the host cache
+//with a resident mirror, the particles are read from (and the results
+//accumulated into) the mirror at the cell's offset goffset and only the
+//flags are sent, nothing comes back until the end of the step
+extern "C" enum cuda_fault self_pp_offload(const int precision, const int truncated, const float r_s_inv, const float *x, const float *y, const float *z, const float *h, const float *mass, const int *active, float *a_x, float *a_y, float *a_z, float *pot, const int gcount, const int gcount_padded, struct cuda_gravity_cache *d_c, const struct cuda_gpart_mirror *resident, const size_t goffset, cudaStream_t stream) {
+
+	if (resident != NULL) {
+
+		cuda_timeline_gpu_phase(stream, cuda_timeline_h2d);
+		cudaMemcpyAsync(d_c->active, active, gcount * sizeof(int), cudaMemcpyHostToDevice, stream);
+
+		//no padding in the mirror, the sources stop at the real count
+		const struct gpu_pair_cell c = {resident->x + goffset, resident->y + goffset, resident->z + goffset, resident->epsilon + goffset, resident->m + goffset, d_c->active, NULL, resident->a_x + goffset, resident->a_y + goffset, resident->a_z + goffset, resident->pot + goffset, NULL, NULL, gcount, gcount};
 
-        //cudaDeviceSynchronize();
+		cuda_timeline_gpu_phase(stream, cuda_timeline_kernel);
+		self_grav_pp_launch<1>(precision, truncated, r_s_inv, c, stream);
+		cuda_timeline_gpu_phase(stream, -1);
+
+		//the host cache gets re-used by the next task
+		return cuda_stream_sync_check(stream, "resident self");
+	}
+
+	const size_t sizeF = gcount_padded * sizeof(float);
+
+	//copy data to device, the padded particles are sources too
+	cuda_timeline_gpu_phase(stream, cuda_timeline_h2d);
+	cudaMemcpyAsync(d_c->x, x, sizeF, cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(d_c->y, y, sizeF, cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(d_c->z, z, sizeF, cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(d_c->epsilon, h, sizeF, cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(d_c->m, mass, sizeF, cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(d_c->active, active, gcount * sizeof(int), cudaMemcpyHostToDevice, stream);
 
 	//call kernel function
-	pair_grav_pp<<<1024,1024>>>(periodic, d_CoM_i, d_CoM_j, rmax_i, rmax_j, min_trunc, d_active_i, d_mpole_i, d_active_j, d_mpole_j, dim[0], dim[1], dim[2], d_h_i, d_h_j, d_mass_i, d_mass_j, *r_s_inv, d_x_i, d_x_j, d_y_i, d_y_j, d_z_i, d_z_j, d_a_x_i, d_a_y_i, d_a_z_i, d_a_x_j, d_a_y_j, d_a_z_j, d_pot_i, d_pot_j, *gcount_i, *gcount_padded_i, *gcount_j, *gcount_padded_j, ci_active, cj_active, symmetric, allow_mpole, d_multi_i, d_multi_j, epsilon, *allow_multipole_j, *allow_multipole_i);
+	cuda_timeline_gpu_phase(stream, cuda_timeline_kernel);
+	const struct gpu_pair_cell c = {d_c->x, d_c->y, d_c->z, d_c->epsilon, d_c->m, d_c->active, NULL, d_c->a_x, d_c->a_y, d_c->a_z, d_c->pot, NULL, NULL, gcount, gcount_padded};
+	self_grav_pp_launch<0>(precision, truncated, r_s_inv, c, stream);
+
+	//copy data from device
+	cuda_timeline_gpu_phase(stream, cuda_timeline_d2h);
+	cudaMemcpyAsync(a_x, d_c->a_x, gcount * sizeof(float), cudaMemcpyDeviceToHost, stream);
+	cudaMemcpyAsync(a_y, d_c->a_y, gcount * sizeof(float), cudaMemcpyDeviceToHost, stream);
+	cudaMemcpyAsync(a_z, d_c->a_z, gcount * sizeof(float), cudaMemcpyDeviceToHost, stream);
+	cudaMemcpyAsync(pot, d_c->pot, gcount * sizeof(float), cudaMemcpyDeviceToHost, stream);
+	cuda_timeline_gpu_phase(stream, -1);
+
+	return cuda_stream_sync_check(stream, "self");
+}
+
+//sends one pair to the device and brings the results straight back into the
+//host caches of the cell(s) to update
+//the truncation decision is taken by the caller, update_i and update_j tell
+//which of the two cells need their particles updated
+//with a resident mirror, the particles are read from (and the results
+//accumulated into) the mirror at the cells' offsets goffset_i/goffset_j and
+//only the flags are sent
+//multi_i and multi_j point into the multipole mirror of the device
+extern "C" enum cuda_fault pp_offload(const int precision, const int periodic, const int truncated, const int update_i, const int update_j, const float *dim, const float r_s_inv, const struct cuda_cell_multipole *multi_i, const struct cuda_cell_multipole *multi_j, const float *x_i, const float *y_i, const float *z_i, const float *h_i, const float *mass_i, const int *active_i, const int *mpole_i, float *a_x_i, float *a_y_i, float *a_z_i, float *pot_i, const int gcount_i, const int gcount_padded_i, const float *x_j, const float *y_j, const float *z_j, const float *h_j, const float *mass_j, const int *active_j, const int *mpole_j, float *a_x_j, float *a_y_j, float *a_z_j, float *pot_j, const int gcount_j, const int gcount_padded_j, struct cuda_gravity_cache *d_ci, struct cuda_gravity_cache *d_cj, const struct cuda_gpart_mirror *resident, const size_t goffset_i, const size_t goffset_j, cudaStream_t stream) {
+
+	if (!update_i && !update_j) return cuda_fault_none;
+
+	//the multipoles are already on the device, NULL when no M2P reads them
+	const float *CoM_i = multi_i != NULL ? multi_i->CoM : NULL;
+	const float *CoM_j = multi_j != NULL ? multi_j->CoM : NULL;
+	const struct multipole *m_pole_i = multi_i != NULL ? &multi_i->m_pole : NULL;
+	const struct multipole *m_pole_j = multi_j != NULL ? &multi_j->m_pole : NULL;
+
+	if (resident != NULL) {
+
+		cuda_timeline_gpu_phase(stream, cuda_timeline_h2d);
+		if (update_i) {
+			cudaMemcpyAsync(d_ci->active, active_i, gcount_i * sizeof(int), cudaMemcpyHostToDevice, stream);
+			cudaMemcpyAsync(d_ci->use_mpole, mpole_i, gcount_i * sizeof(int), cudaMemcpyHostToDevice, stream);
+		}
+		if (update_j) {
+			cudaMemcpyAsync(d_cj->active, active_j, gcount_j * sizeof(int), cudaMemcpyHostToDevice, stream);
+			cudaMemcpyAsync(d_cj->use_mpole, mpole_j, gcount_j * sizeof(int), cudaMemcpyHostToDevice, stream);
+		}
+
+		//no padding in the mirror, the sources stop at the real count
+		const struct gpu_pair_cell ci = {resident->x + goffset_i, resident->y + goffset_i, resident->z + goffset_i, resident->epsilon + goffset_i, resident->m + goffset_i, d_ci->active, d_ci->use_mpole, resident->a_x + goffset_i, resident->a_y + goffset_i, resident->a_z + goffset_i, resident->pot + goffset_i, CoM_i, m_pole_i, gcount_i, gcount_i};
+		const struct gpu_pair_cell cj = {resident->x + goffset_j, resident->y + goffset_j, resident->z + goffset_j, resident->epsilon + goffset_j, resident->m + goffset_j, d_cj->active, d_cj->use_mpole, resident->a_x + goffset_j, resident->a_y + goffset_j, resident->a_z + goffset_j, resident->pot + goffset_j, CoM_j, m_pole_j, gcount_j, gcount_j};
+
+		cuda_timeline_gpu_phase(stream, cuda_timeline_kernel);
+		if (update_i)
+			pair_grav_pp_launch<1>(precision, truncated, periodic, update_j, ci, cj, dim, r_s_inv, stream);
+		else
+			pair_grav_pp_launch<1>(precision, truncated, periodic, 0, cj, ci, dim, r_s_inv, stream);
+		cuda_timeline_gpu_phase(stream, -1);
+
+		//the host caches get re-used by the next pair
+		return cuda_stream_sync_check(stream, "resident pair");
+	}
+
+	//both cells are needed as sources, padded particles included
+	cuda_timeline_gpu_phase(stream, cuda_timeline_h2d);
+
+	cudaMemcpyAsync(d_ci->x, x_i, gcount_padded_i * sizeof(float), cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(d_ci->y, y_i, gcount_padded_i * sizeof(float), cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(d_ci->z, z_i, gcount_padded_i * sizeof(float), cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(d_ci->epsilon, h_i, gcount_padded_i * sizeof(float), cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(d_ci->m, mass_i, gcount_padded_i * sizeof(float), cudaMemcpyHostToDevice, stream);
+
+	cudaMemcpyAsync(d_cj->x, x_j, gcount_padded_j * sizeof(float), cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(d_cj->y, y_j, gcount_padded_j * sizeof(float), cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(d_cj->z, z_j, gcount_padded_j * sizeof(float), cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(d_cj->epsilon, h_j, gcount_padded_j * sizeof(float), cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(d_cj->m, mass_j, gcount_padded_j * sizeof(float), cudaMemcpyHostToDevice, stream);
+
+	//the flags are only needed for the cell(s) we update
+	if (update_i) {
+		cudaMemcpyAsync(d_ci->active, active_i, gcount_i * sizeof(int), cudaMemcpyHostToDevice, stream);
+		cudaMemcpyAsync(d_ci->use_mpole, mpole_i, gcount_i * sizeof(int), cudaMemcpyHostToDevice, stream);
+	}
+	if (update_j) {
+		cudaMemcpyAsync(d_cj->active, active_j, gcount_j * sizeof(int), cudaMemcpyHostToDevice, stream);
+		cudaMemcpyAsync(d_cj->use_mpole, mpole_j, gcount_j * sizeof(int), cudaMemcpyHostToDevice, stream);
+	}
+
+	const struct gpu_pair_cell ci = {d_ci->x, d_ci->y, d_ci->z, d_ci->epsilon, d_ci->m, d_ci->active, d_ci->use_mpole, d_ci->a_x, d_ci->a_y, d_ci->a_z, d_ci->pot, CoM_i, m_pole_i, gcount_i, gcount_padded_i};
+	const struct gpu_pair_cell cj = {d_cj->x, d_cj->y, d_cj->z, d_cj->epsilon, d_cj->m, d_cj->active, d_cj->use_mpole, d_cj->a_x, d_cj->a_y, d_cj->a_z, d_cj->pot, CoM_j, m_pole_j, gcount_j, gcount_padded_j};
+
+	//call kernel function, the cell to update always goes first
+	cuda_timeline_gpu_phase(stream, cuda_timeline_kernel);
+	if (update_i)
+		pair_grav_pp_launch<0>(precision, truncated, periodic, update_j, ci, cj, dim, r_s_inv, stream);
+	else
+		pair_grav_pp_launch<0>(precision, truncated, periodic, 0, cj, ci, dim, r_s_inv, stream);
+
+	//copy data from device, straight into the (page-locked) host caches
+	cuda_timeline_gpu_phase(stream, cuda_timeline_d2h);
+	if (update_i) {
+		cudaMemcpyAsync(a_x_i, d_ci->a_x, gcount_i * sizeof(float), cudaMemcpyDeviceToHost, stream);
+		cudaMemcpyAsync(a_y_i, d_ci->a_y, gcount_i * sizeof(float), cudaMemcpyDeviceToHost, stream);
+		cudaMemcpyAsync(a_z_i, d_ci->a_z, gcount_i * sizeof(float), cudaMemcpyDeviceToHost, stream);
+		cudaMemcpyAsync(pot_i, d_ci->pot, gcount_i * sizeof(float), cudaMemcpyDeviceToHost, stream);
+	}
+	if (update_j) {
+		cudaMemcpyAsync(a_x_j, d_cj->a_x, gcount_j * sizeof(float), cudaMemcpyDeviceToHost, stream);
+		cudaMemcpyAsync(a_y_j, d_cj->a_y, gcount_j * sizeof(float), cudaMemcpyDeviceToHost, stream);
+		cudaMemcpyAsync(a_z_j, d_cj->a_z, gcount_j * sizeof(float), cudaMemcpyDeviceToHost, stream);
+		cudaMemcpyAsync(pot_j, d_cj->pot, gcount_j * sizeof(float), cudaMemcpyDeviceToHost, stream);
+	}
+
+	//only wait for this runner's own work, other runners keep their streams busy
+	//the copies and the launch are all checked there
+	cuda_timeline_gpu_phase(stream, -1);
+	return cuda_stream_sync_check(stream, "pair");
+}
 
-        //cudaDeviceSynchronize();
+//BATCHED M2L INTERACTIONS
+//one thread per interaction, each thread starts from empty field tensors
+//which the host then adds to the cells' ones
+__global__ void pair_grav_mm_batched(const struct cuda_mm_desc *pairs, const int npairs, const int periodic, const float r_s_inv, struct grav_tensor *l_a, struct grav_tensor *l_b) {
+
+  const int k = blockIdx.x * blockDim.x + threadIdx.x;
+  if (k >= npairs) return;
+
+  const struct cuda_mm_desc *p = &pairs[k];
+
+  /* Compute distance */
+  const float r2 = p->dx * p->dx + p->dy * p->dy + p->dz * p->dz;
+  const float r_inv = 1. / sqrtf(r2);
+
+  /* Compute all derivatives */
+  struct potential_derivatives_M2L pot;
+  m2l_derivatives_compute(p->dx, p->dy, p->dz, r2, r_inv, p->eps, periodic, r_s_inv, &pot);
+
+  /* Do the M2L tensor multiplication */
+  struct grav_tensor l;
+  memset(&l, 0, sizeof(struct grav_tensor));
+  gravity_M2L_apply(&l, &p->m_a, &pot);
+  l_b[k] = l;
+
+  if (p->symmetric) {
+
+    /* Flip the signs of odd derivatives */
+    m2l_derivatives_flip_signs(&pot);
+
+    /* Do the second M2L tensor multiplication */
+    memset(&l, 0, sizeof(struct grav_tensor));
+    gravity_M2L_apply(&l, &p->m_b, &pot);
+    l_a[k] = l;
+  }
+}
+
+//sends a whole batch of M2L interactions to the device and brings the
+//field tensors back into the batch's host arrays
+extern "C" void mm_batch_offload(struct cuda_mm_batch *b, const int periodic, const float r_s_inv, cudaStream_t stream) {
+
+	if (b->npairs == 0) return;
+
+	const size_t sizeT = b->npairs * sizeof(struct grav_tensor);
+
+	//copy data to device
+	cudaMemcpyAsync(b->d_pairs, b->pairs, b->npairs * sizeof(struct cuda_mm_desc), cudaMemcpyHostToDevice, stream);
+
+	//call kernel function, the tensors are large so keep the blocks small
+	const int threads = 64;
+	const int blocks = (b->npairs + threads - 1) / threads;
+	pair_grav_mm_batched<<<blocks, threads, 0, stream>>>(b->d_pairs, b->npairs, periodic, r_s_inv, b->d_l_a, b->d_l_b);
+
+	cudaError_t err = cudaGetLastError();
+	if (err != cudaSuccess)
+	printf("Error M2L launch: %s\n", cudaGetErrorString(err));
+
+	//copy data from device, l_a is only meaningful for the symmetric ones
+	cudaMemcpyAsync(b->l_a, b->d_l_a, sizeT, cudaMemcpyDeviceToHost, stream);
+	cudaMemcpyAsync(b->l_b, b->d_l_b, sizeT, cudaMemcpyDeviceToHost, stream);
+
+	cudaStreamSynchronize(stream);
 
 	cudaError_t err2 = cudaGetLastError();
-    	if (err2 != cudaSuccess)
-	printf("Error2: %s\n", cudaGetErrorString(err2));
+	if (err2 != cudaSuccess)
+	printf("Error M2L sync: %s\n", cudaGetErrorString(err2));
+}
 
-	//copy data from device
-	cudaMemcpyAsync(&a_x_i_new, d_a_x_i, *gcount_i*sizeof(float), cudaMemcpyDeviceToHost);
-	cudaMemcpyAsync(&a_y_i_new, d_a_y_i, *gcount_i*sizeof(float), cudaMemcpyDeviceToHost);
-	cudaMemcpyAsync(&a_z_i_new, d_a_z_i, *gcount_i*sizeof(float), cudaMemcpyDeviceToHost);
-	cudaMemcpyAsync(&pot_i_new, d_pot_i, *gcount_i*sizeof(float), cudaMemcpyDeviceToHost);
+//GPART DRIFT
+//one block per leaf, same arithmetic as drift_gpart() (no fused
+//multiply-adds) such that the device positions stay equal to the host ones
+__global__ void gpart_drift_leaves(const struct cuda_gpart_drift_list list, double *x_d, double *y_d, double *z_d, const float *v_x, const float *v_y, const float *v_z, const float *m, float *x, float *y, float *z, float *epsilon, float *a_x, float *a_y, float *a_z, float *pot, const float eps) {
 
-	cudaMemcpyAsync(&a_x_j_new, d_a_x_j, *gcount_j*sizeof(float), cudaMemcpyDeviceToHost);
-	cudaMemcpyAsync(&a_y_j_new, d_a_y_j, *gcount_j*sizeof(float), cudaMemcpyDeviceToHost);
-	cudaMemcpyAsync(&a_z_j_new, d_a_z_j, *gcount_j*sizeof(float), cudaMemcpyDeviceToHost);
-	cudaMemcpyAsync(&pot_j_new, d_pot_j, *gcount_j*sizeof(float), cudaMemcpyDeviceToHost);
+  const struct cuda_gpart_drift_leaf *leaf = &list.leaves[blockIdx.x];
+  const double dt = leaf->dt;
 
-        //printf("%.16f %.16f %.16f %.16f\n", a_x_i_new[0], a_y_i_new[0], a_z_i_new[0], pot_i_new[0]);
+  for (int i = threadIdx.x; i < leaf->count; i += blockDim.x) {
 
-	cudaDeviceSynchronize();
+    const size_t o = leaf->offset + i;
+
+    //inhibited particles do not move
+    if (m[o] != 0.f) {
+      const double xo = x_d[o] + v_x[o] * dt;
+      const double yo = y_d[o] + v_y[o] * dt;
+      const double zo = z_d[o] + v_z[o] * dt;
+      x_d[o] = xo;
+      y_d[o] = yo;
+      z_d[o] = zo;
+      x[o] = (float)xo;
+      y[o] = (float)yo;
+      z[o] = (float)zo;
+      epsilon[o] = eps;
+    }
+
+    //ready for this step's interactions
+    a_x[o] = 0.f;
+    a_y[o] = 0.f;
+    a_z[o] = 0.f;
+    pot[o] = 0.f;
+  }
+}
+
+//drifts the leaves of a list in the device-resident gpart mirror, the
+//caller synchronises the stream
+extern "C" void gpart_drift_offload(const struct cuda_gpart_drift_list *list, const struct cuda_gpart_mirror *g, const float epsilon, cudaStream_t stream) {
+
+	if (list->count == 0) return;
+
+	gpart_drift_leaves<<<list->count, 128, 0, stream>>>(*list, g->x_d, g->y_d, g->z_d, g->v_x, g->v_y, g->v_z, g->m, g->x, g->y, g->z, g->epsilon, g->a_x, g->a_y, g->a_z, g->pot, epsilon);
+
+	cudaError_t err = cudaGetLastError();
+	if (err != cudaSuccess)
+	printf("Error drift launch: %s\n", cudaGetErrorString(err));
+}
+
+//MULTIPOLE CONSTRUCTION
+//one thread per leaf of the flat tree, same as the leaf branch of
+//cell_make_multipoles()
+__global__ void multipole_build_P2M(const struct cuda_tree_cell *cells, const int nr_cells, const double *x, const double *y, const double *z, const float *v_x, const float *v_y, const float *v_z, const float *m, const float *epsilon, const float *old_a_grav_norm, struct cuda_tree_multipole *multipoles) {
+
+  const int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i >= nr_cells) return;
+
+  const struct cuda_tree_cell *c = &cells[i];
+  if (c->split) return;
+
+  struct cuda_tree_multipole *multi = &multipoles[i];
+  memset(multi, 0, sizeof(struct cuda_tree_multipole));
+  multi->m_pole.min_old_a_grav_norm = FLT_MAX;
+  multi->m_pole.min_mass = FLT_MAX;
+
+  if (c->count > 0) {
+
+    const size_t o = c->first;
+    gravity_P2M(multi, x + o, y + o, z + o, v_x + o, v_y + o, v_z + o, m + o, epsilon + o, old_a_grav_norm + o, c->count);
+
+    //compute the multipole power
+    gravity_multipole_compute_power(&multi->m_pole);
+
+  } else {
+
+    //no gparts in that leaf cell, set the values to something sensible
+    multi->CoM[0] = c->loc[0] + c->width[0] * 0.5;
+    multi->CoM[1] = c->loc[1] + c->width[1] * 0.5;
+    multi->CoM[2] = c->loc[2] + c->width[2] * 0.5;
+    multi->r_max = 0.;
+  }
+}
+
+//one thread per split cell of a level, same as the split branch of
+//cell_make_multipoles() once the level below is done
+__global__ void multipole_build_M2M(const struct cuda_tree_cell *cells, const int first, const int last, struct cuda_tree_multipole *multipoles) {
+
+  const int i = first + blockIdx.x * blockDim.x + threadIdx.x;
+  if (i >= last) return;
+
+  const struct cuda_tree_cell *c = &cells[i];
+  if (!c->split) return;
+
+  struct cuda_tree_multipole *multi = &multipoles[i];
+  memset(multi, 0, sizeof(struct cuda_tree_multipole));
+  multi->m_pole.min_old_a_grav_norm = FLT_MAX;
+  multi->m_pole.min_mass = FLT_MAX;
+
+  //compute CoM of all progenies
+  double CoM[3] = {0., 0., 0.};
+  double vel[3] = {0., 0., 0.};
+  float max_delta_vel[3] = {0.f, 0.f, 0.f};
+  float min_delta_vel[3] = {0.f, 0.f, 0.f};
+  double mass = 0.;
+
+  for (int k = 0; k < 8; ++k) {
+    if (c->progeny[k] >= 0) {
+      const struct cuda_tree_multipole *mp = &multipoles[c->progeny[k]];
+
+      mass += mp->m_pole.M_000;
+
+      CoM[0] += mp->CoM[0] * mp->m_pole.M_000;
+      CoM[1] += mp->CoM[1] * mp->m_pole.M_000;
+      CoM[2] += mp->CoM[2] * mp->m_pole.M_000;
+
+      vel[0] += mp->m_pole.vel[0] * mp->m_pole.M_000;
+      vel[1] += mp->m_pole.vel[1] * mp->m_pole.M_000;
+      vel[2] += mp->m_pole.vel[2] * mp->m_pole.M_000;
+
+      max_delta_vel[0] = max(mp->m_pole.max_delta_vel[0], max_delta_vel[0]);
+      max_delta_vel[1] = max(mp->m_pole.max_delta_vel[1], max_delta_vel[1]);
+      max_delta_vel[2] = max(mp->m_pole.max_delta_vel[2], max_delta_vel[2]);
+
+      min_delta_vel[0] = min(mp->m_pole.min_delta_vel[0], min_delta_vel[0]);
+      min_delta_vel[1] = min(mp->m_pole.min_delta_vel[1], min_delta_vel[1]);
+      min_delta_vel[2] = min(mp->m_pole.min_delta_vel[2], min_delta_vel[2]);
+    }
+  }
+
+  //final operation on the CoM and bulk velocity
+  const double mass_inv = 1. / mass;
+  multi->CoM[0] = CoM[0] * mass_inv;
+  multi->CoM[1] = CoM[1] * mass_inv;
+  multi->CoM[2] = CoM[2] * mass_inv;
+  multi->m_pole.vel[0] = vel[0] * mass_inv;
+  multi->m_pole.vel[1] = vel[1] * mass_inv;
+  multi->m_pole.vel[2] = vel[2] * mass_inv;
+
+  //min max velocity along each axis
+  multi->m_pole.max_delta_vel[0] = max_delta_vel[0];
+  multi->m_pole.max_delta_vel[1] = max_delta_vel[1];
+  multi->m_pole.max_delta_vel[2] = max_delta_vel[2];
+  multi->m_pole.min_delta_vel[0] = min_delta_vel[0];
+  multi->m_pole.min_delta_vel[1] = min_delta_vel[1];
+  multi->m_pole.min_delta_vel[2] = min_delta_vel[2];
+
+  //now shift progeny multipoles and add them up
+  struct multipole temp;
+  double r_max = 0.;
+  for (int k = 0; k < 8; ++k) {
+    if (c->progeny[k] >= 0) {
+      const struct cuda_tree_multipole *mp = &multipoles[c->progeny[k]];
+
+      //contribution to multipole
+      gravity_M2M(&temp, &mp->m_pole, multi->CoM, mp->CoM);
+      gravity_multipole_add(&multi->m_pole, &temp);
+
+      //upper limit of max CoM<->gpart distance
+      const double dx = multi->CoM[0] - mp->CoM[0];
+      const double dy = multi->CoM[1] - mp->CoM[1];
+      const double dz = multi->CoM[2] - mp->CoM[2];
+      const double r2 = dx * dx + dy * dy + dz * dz;
+      r_max = max(r_max, mp->r_max + sqrt(r2));
+    }
+  }
+
+  //alternative upper limit of max CoM<->gpart distance
+  const double dx = multi->CoM[0] > c->loc[0] + c->width[0] * 0.5
+                        ? multi->CoM[0] - c->loc[0]
+                        : c->loc[0] + c->width[0] - multi->CoM[0];
+  const double dy = multi->CoM[1] > c->loc[1] + c->width[1] * 0.5
+                        ? multi->CoM[1] - c->loc[1]
+                        : c->loc[1] + c->width[1] - multi->CoM[1];
+  const double dz = multi->CoM[2] > c->loc[2] + c->width[2] * 0.5
+                        ? multi->CoM[2] - c->loc[2]
+                        : c->loc[2] + c->width[2] - multi->CoM[2];
+
+  //take minimum of both limits
+  multi->r_max = min(r_max, sqrt(dx * dx + dy * dy + dz * dz));
+
+  //compute the multipole power
+  gravity_multipole_compute_power(&multi->m_pole);
+}
+
+//builds all the multipoles of a flat tree: P2M on all the leaves at once,
+//then one M2M launch per level from the bottom up, and brings them back
+//into the host array
+extern "C" void multipole_build_offload(struct cuda_multipole_build *b, const int nr_cells, const int nr_levels, const size_t nr_gparts, cudaStream_t stream) {
+
+	const size_t sizeD = nr_gparts * sizeof(double);
+	const size_t sizeF = nr_gparts * sizeof(float);
+
+	//copy data to device
+	cudaMemcpyAsync(b->d_cells, b->cells, nr_cells * sizeof(struct cuda_tree_cell), cudaMemcpyHostToDevice, stream);
+	if (nr_gparts > 0) {
+		cudaMemcpyAsync(b->d_x, b->x, sizeD, cudaMemcpyHostToDevice, stream);
+		cudaMemcpyAsync(b->d_y, b->y, sizeD, cudaMemcpyHostToDevice, stream);
+		cudaMemcpyAsync(b->d_z, b->z, sizeD, cudaMemcpyHostToDevice, stream);
+		cudaMemcpyAsync(b->d_v_x, b->v_x, sizeF, cudaMemcpyHostToDevice, stream);
+		cudaMemcpyAsync(b->d_v_y, b->v_y, sizeF, cudaMemcpyHostToDevice, stream);
+		cudaMemcpyAsync(b->d_v_z, b->v_z, sizeF, cudaMemcpyHostToDevice, stream);
+		cudaMemcpyAsync(b->d_m, b->m, sizeF, cudaMemcpyHostToDevice, stream);
+		cudaMemcpyAsync(b->d_epsilon, b->epsilon, sizeF, cudaMemcpyHostToDevice, stream);
+		cudaMemcpyAsync(b->d_old_a_grav_norm, b->old_a_grav_norm, sizeF, cudaMemcpyHostToDevice, stream);
+	}
+
+	//the multipoles are large so keep the blocks small
+	const int threads = 64;
+
+	//all the leaves, whatever their level
+	multipole_build_P2M<<<(nr_cells + threads - 1) / threads, threads, 0, stream>>>(b->d_cells, nr_cells, b->d_x, b->d_y, b->d_z, b->d_v_x, b->d_v_y, b->d_v_z, b->d_m, b->d_epsilon, b->d_old_a_grav_norm, b->d_multipoles);
+
+	cudaError_t err = cudaGetLastError();
+	if (err != cudaSuccess)
+	printf("Error P2M launch: %s\n", cudaGetErrorString(err));
+
+	//the deepest level only has leaves
+	for (int level = nr_levels - 2; level >= 0; --level) {
+		const int first = b->level_start[level];
+		const int last = b->level_start[level + 1];
+		multipole_build_M2M<<<(last - first + threads - 1) / threads, threads, 0, stream>>>(b->d_cells, first, last, b->d_multipoles);
+	}
+
+	cudaError_t err2 = cudaGetLastError();
+	if (err2 != cudaSuccess)
+	printf("Error M2M launch: %s\n", cudaGetErrorString(err2));
+
+	//copy data from device
+	cudaMemcpyAsync(b->multipoles, b->d_multipoles, nr_cells * sizeof(struct cuda_tree_multipole), cudaMemcpyDeviceToHost, stream);
+
+	cudaStreamSynchronize(stream);
 
 	cudaError_t err3 = cudaGetLastError();
-    	if (err3 != cudaSuccess)
-	printf("Error3: %s\n", cudaGetErrorString(err3));
-
-	for (int i = 0; i < *gcount_i; i++){
-		a_x_i[i] += a_x_i_new[i];
-		a_y_i[i] += a_y_i_new[i];
-		a_z_i[i] += a_z_i_new[i];
-		pot_i[i] += pot_i_new[i];}
-		
-	for (int i = 0; i < *gcount_j; i++){
-		a_x_j[i] += a_x_j_new[i];
-		a_y_j[i] += a_y_j_new[i];
-		a_z_j[i] += a_z_j_new[i];
-		pot_j[i] += pot_j_new[i];}
-
-	
-	/*printf("gpu gcount_i: %i ", *gcount_i);
-  	for (int i = 0; i < *gcount_i; i++){
-  		printf("%.16f ", a_x_i[i]);}
-  	printf("\n");*/
-
-	//printf("%f %f %f \n", a_x_i[0], a_y_i[0], a_z_i[0]);
-
-	//printf("RESULT2: %f %f %f %f ", a_x_new[0], a_y_new[0], a_z_new[0], pot_new[0]);
-
-	//free memory
-	cudaFree(d_h_i);
-	cudaFree(d_h_j);
-	cudaFree(d_mass_i);
-	cudaFree(d_mass_j);
-	cudaFree(d_x_i);
-	cudaFree(d_x_j);
-	cudaFree(d_y_i);
-	cudaFree(d_y_j);
-	cudaFree(d_z_i);
-	cudaFree(d_z_j);
-	cudaFree(d_a_x_i);
-	cudaFree(d_a_y_i);
-	cudaFree(d_a_z_i);
-	cudaFree(d_a_x_j);
-	cudaFree(d_a_y_j);
-	cudaFree(d_a_z_j);
-	cudaFree(d_pot_i);
-	cudaFree(d_pot_j);
-	cudaFree(d_active_i);
-	cudaFree(d_mpole_i);
-	cudaFree(d_active_j);
-	cudaFree(d_mpole_j);
-	cudaFree(d_CoM_i);
-	cudaFree(d_CoM_j);
-	cudaFree(d_multi_j);
-	cudaFree(d_multi_i);
-
-	cudaError_t err4 = cudaGetLastError();
-    	if (err4 != cudaSuccess)
-	printf("Error4: %s\n", cudaGetErrorString(err4));
-	
+	if (err3 != cudaSuccess)
+	printf("Error multipole build sync: %s\n", cudaGetErrorString(err3));
+}
+
+//copies the host's long-range correction table into the constant memory
+//of the current device
+extern "C" void long_grav_table_offload(const struct kernel_long_grav_table *t) {
+
+#ifdef GRAVITY_LONG_RANGE_TABLE
+	cudaError_t err = cudaMemcpyToSymbol(gpu_long_grav_table, t, sizeof(struct kernel_long_grav_table));
+	if (err != cudaSuccess)
+	printf("Error long-range table upload: %s\n", cudaGetErrorString(err));
+#endif
+}
+
+//LONG-RANGE INTERACTIONS
+//double precision version of nearest()
+__device__ double nearest1(const double dx, const double box_size) {
+
+  return ((dx > 0.5 * box_size)
+              ? (dx - box_size)
+              : ((dx < -0.5 * box_size) ? (dx + box_size) : dx));
+}
+
+//port of integer_powf()
+__device__ float integer_powf1(const float x, const unsigned int n) {
+
+  switch (n) {
+    case 0:
+      return 1.f;
+    case 1:
+      return x;
+    case 2:
+      return x * x;
+    case 3:
+      return x * x * x;
+    case 4: {
+      const float y = x * x;
+      return y * y;
+    }
+    case 5: {
+      const float y = x * x;
+      return x * y * y;
+    }
+    default:
+      return powf(x, (float)n);
+  }
+}
+
+//port of gravity_f_MAC_inverse()
+__device__ float gravity_f_MAC_inverse1(const float H, const float r_s_inv, const float r2) {
+
+  if (r2 < (25.f / 81.f) * H * H) {
+
+    /* Below softening radius */
+    return (25.f / 81.f) * H * H;
+
+  } else if (r_s_inv * r_s_inv * r2 > (25.f / 9.f)) {
+
+    /* Above truncation radius */
+    return (9.f / 25.f) * r_s_inv * r_s_inv * r2 * r2;
+
+  } else {
+
+    /* Normal Newtonian case */
+    return r2;
+  }
+}
+
+//port of gravity_M2L_accept() using the rebuild sizes
+__device__ int gravity_M2L_accept_top(const struct cuda_mac_props *props, const struct cuda_top_cell *A, const struct cuda_top_cell *B, const float r2, const int periodic) {
+
+  /* Order of the expansion */
+  const int p = 2;
+
+  /* Sizes of the multipoles */
+  const float rho_A = A->r_max_rebuild;
+  const float rho_B = B->r_max_rebuild;
+
+  /* Max size of both multipoles */
+  const float rho_max = max(rho_A, rho_B);
+
+  /* Get the softening */
+  const float max_softening = max(A->m_pole.max_softening, B->m_pole.max_softening);
+
+  /* Compute the error estimator (without the 1/M_B term that cancels out),
+   * binomial(2, n) = {1, 2, 1} */
+  const int binomial_p[3] = {1, 2, 1};
+  float E_BA_term = 0.f;
+  for (int n = 0; n <= p; ++n) {
+    E_BA_term += binomial_p[n] * B->m_pole.power[n] * integer_powf1(rho_A, p - n);
+  }
+  E_BA_term *= 8.f;
+  if (rho_A + rho_B > 0.f) {
+    E_BA_term *= rho_max;
+    E_BA_term /= (rho_A + rho_B);
+  }
+
+  /* Compute r^p = (r^2)^(p/2) */
+  const float r_to_p = integer_powf1(r2, (p / 2));
+
+  float f_MAC_inv;
+  if (periodic && props->consider_truncation_in_MAC) {
+    f_MAC_inv = gravity_f_MAC_inverse1(max_softening, props->r_s_inv, r2);
+  } else {
+    f_MAC_inv = r2;
+  }
+
+  /* Get the mimimal acceleration in A */
+  const float min_a_grav = A->m_pole.min_old_a_grav_norm;
+
+  /* Maximal mass */
+  const float M_max = max(A->m_pole.M_000, B->m_pole.M_000);
+
+  /* Get the relative tolerance */
+  const float eps = props->adaptive_tolerance;
+
+  /* Get the basic geometric critical angle */
+  const float theta_crit = props->theta_crit;
+  const float theta_crit2 = theta_crit * theta_crit;
+
+  /* Get the sum of the multipole sizes */
+  const float rho_sum = rho_A + rho_B;
+
+  if (props->use_advanced_MAC && props->use_gadget_tolerance) {
+
+    /* Gadget 4 paper -- eq. 36 */
+    const int power = SELF_GRAVITY_MULTIPOLE_ORDER - 1;
+    const float ratio = integer_powf1(rho_max / sqrtf(r2), power);
+    const int cond_1 = M_max * ratio < eps * min_a_grav * f_MAC_inv;
+
+    const int cond_2 = props->use_tree_below_softening || max_softening * max_softening < r2;
+
+    return cond_1 && cond_2;
+
+  } else if (props->use_advanced_MAC && !props->use_gadget_tolerance) {
+
+    /* Condition 1: We are in the converging part of the Taylor expansion */
+    const int cond_1 = rho_sum * rho_sum < r2;
+
+    /* Condition 2: We are not below softening */
+    const int cond_2 = props->use_tree_below_softening || max_softening * max_softening < r2;
+
+    /* Condition 3: The contribution is accurate enough */
+    const int cond_3 = E_BA_term < eps * min_a_grav * r_to_p * f_MAC_inv;
+
+    return cond_1 && cond_2 && cond_3;
+
+  } else {
+
+    /* Condition 1: We are obeying the purely geometric criterion */
+    const int cond_1 = rho_sum * rho_sum < theta_crit2 * r2;
+
+    /* Condition 2: We are not below softening */
+    const int cond_2 = props->use_tree_below_softening || max_softening * max_softening < r2;
+
+    return cond_1 && cond_2;
+  }
+}
+
+//port of cell_min_dist2_same_size() for cells of width w
+__device__ double top_cell_min_dist2(const double *loc_i, const double *loc_j, const double w[3], const int periodic, const double dim[3]) {
+
+  double d2 = 0.;
+  for (int k = 0; k < 3; k++) {
+
+    const double ci_min = loc_i[k], ci_max = loc_i[k] + w[k];
+    const double cj_min = loc_j[k], cj_max = loc_j[k] + w[k];
+
+    double d;
+    if (periodic)
+      d = fmin(fmin(fabs(nearest1(ci_min - cj_min, dim[k])), fabs(nearest1(ci_min - cj_max, dim[k]))), fmin(fabs(nearest1(ci_max - cj_min, dim[k])), fabs(nearest1(ci_max - cj_max, dim[k]))));
+    else
+      d = fmin(fmin(fabs(ci_min - cj_min), fabs(ci_min - cj_max)), fmin(fabs(ci_max - cj_min), fabs(ci_max - cj_max)));
+
+    d2 += d * d;
+  }
+  return d2;
+}
+
+//geometry of the long-range walk, passed by value to the kernel
+struct gpu_long_range_params {
+  double CoM_i[3];
+  double dim[3];
+  double width[3];
+  double max_distance2;
+  float r_s_inv;
+  int periodic;
+  int top;
+  int count;
+};
+
+//each block walks CUDA_LONG_RANGE_CHUNK top-level cells against the
+//top-level parent of the active cell and reduces its field tensor
+__global__ void grav_long_range(const struct cuda_top_cell *cells, const struct gpu_long_range_params lr, const struct cuda_mac_props props, struct cuda_long_range_result *results) {
+
+  __shared__ float red_f[CUDA_LONG_RANGE_THREADS];
+  __shared__ long long red_ll[CUDA_LONG_RANGE_THREADS];
+
+  const struct cuda_top_cell *top = &cells[lr.top];
+  const int first = blockIdx.x * CUDA_LONG_RANGE_CHUNK;
+  const int last = min(first + CUDA_LONG_RANGE_CHUNK, lr.count);
+
+  struct grav_tensor l;
+  memset(&l, 0, sizeof(struct grav_tensor));
+  long long num_tree = 0, num_pm = 0;
+  int interacted = 0;
+
+  for (int n = first + threadIdx.x; n < last; n += blockDim.x) {
+
+    /* Avoid self contributions */
+    if (n == lr.top) continue;
+
+    const struct cuda_top_cell *cj = &cells[n];
+
+    /* Skip empty cells */
+    if (cj->m_pole.M_000 == 0.f) continue;
+
+#if defined(SWIFT_DEBUG_CHECKS) || defined(SWIFT_GRAVITY_FORCE_CHECKS)
+    const long long num_gpart = cj->m_pole.num_gpart;
+#else
+    const long long num_gpart = 0;
+#endif
+
+    /* Can we escape early in the periodic BC case? */
+    if (lr.periodic) {
+
+      /* Beyond the distance where the truncated forces are 0 */
+      if (top_cell_min_dist2(top->loc, cj->loc, lr.width, lr.periodic, lr.dim) > lr.max_distance2) {
+        num_pm += num_gpart;
+        interacted = 1;
+        continue;
+      }
+    }
+
+    /* MAC with the rebuild data, as done by cell_can_use_pair_mm() */
+    double mx = top->CoM_rebuild[0] - cj->CoM_rebuild[0];
+    double my = top->CoM_rebuild[1] - cj->CoM_rebuild[1];
+    double mz = top->CoM_rebuild[2] - cj->CoM_rebuild[2];
+    if (lr.periodic) {
+      mx = nearest1(mx, lr.dim[0]);
+      my = nearest1(my, lr.dim[1]);
+      mz = nearest1(mz, lr.dim[2]);
+    }
+    const double mr2 = mx * mx + my * my + mz * mz;
+
+    if (!gravity_M2L_accept_top(&props, top, cj, mr2, lr.periodic) || !gravity_M2L_accept_top(&props, cj, top, mr2, lr.periodic)) continue;
+
+    /* As in gravity_M2L_nonsym() */
+    float dx = (float)(lr.CoM_i[0] - cj->CoM[0]);
+    float dy = (float)(lr.CoM_i[1] - cj->CoM[1]);
+    float dz = (float)(lr.CoM_i[2] - cj->CoM[2]);
+    if (lr.periodic) {
+      dx = nearest1(dx, lr.dim[0]);
+      dy = nearest1(dy, lr.dim[1]);
+      dz = nearest1(dz, lr.dim[2]);
+    }
+    const float r2 = dx * dx + dy * dy + dz * dz;
+    const float r_inv = 1. / sqrtf(r2);
+
+    struct potential_derivatives_M2L pot;
+    m2l_derivatives_compute(dx, dy, dz, r2, r_inv, cj->m_pole.max_softening, lr.periodic, lr.r_s_inv, &pot);
+    gravity_M2L_apply(&l, &cj->m_pole, &pot);
+
+    num_tree += num_gpart;
+    interacted = 1;
+  }
+
+  struct cuda_long_range_result *res = &results[blockIdx.x];
+
+  /* Reduce the field tensor over the block, one component at a time, the
+   * F_xxx terms sit at the start of the structure */
+  const int nr_terms = (SELF_GRAVITY_MULTIPOLE_ORDER + 1) * (SELF_GRAVITY_MULTIPOLE_ORDER + 2) * (SELF_GRAVITY_MULTIPOLE_ORDER + 3) / 6;
+  const float *l_terms = (const float *)&l;
+  float *res_terms = (float *)&res->l;
+
+  if (threadIdx.x == 0) memset(&res->l, 0, sizeof(struct grav_tensor));
+  __syncthreads();
+
+  for (int f = 0; f < nr_terms; f++) {
+    red_f[threadIdx.x] = l_terms[f];
+    __syncthreads();
+    for (int s = blockDim.x / 2; s > 0; s >>= 1) {
+      if (threadIdx.x < s) red_f[threadIdx.x] += red_f[threadIdx.x + s];
+      __syncthreads();
+    }
+    if (threadIdx.x == 0) res_terms[f] = red_f[0];
+    __syncthreads();
+  }
+
+  red_ll[threadIdx.x] = num_tree;
+  __syncthreads();
+  for (int s = blockDim.x / 2; s > 0; s >>= 1) {
+    if (threadIdx.x < s) red_ll[threadIdx.x] += red_ll[threadIdx.x + s];
+    __syncthreads();
+  }
+  if (threadIdx.x == 0) res->num_tree = red_ll[0];
+  __syncthreads();
+
+  red_ll[threadIdx.x] = num_pm;
+  __syncthreads();
+  for (int s = blockDim.x / 2; s > 0; s >>= 1) {
+    if (threadIdx.x < s) red_ll[threadIdx.x] += red_ll[threadIdx.x + s];
+    __syncthreads();
+  }
+  if (threadIdx.x == 0) res->num_pm = red_ll[0];
+
+  const int any = __syncthreads_or(interacted);
+  if (threadIdx.x == 0) res->interacted = any;
+}
+
+//walks all the top-level cells against the top-level parent (index top) of
+//one active cell with centre of mass CoM_i, one partial result per block is
+//brought back in the runner's slice of the results
+extern "C" int long_range_offload(struct cuda_top_multipoles *t, const int device, const int runner_id, const int top, const double *CoM_i, const struct cuda_mac_props *props, const int periodic, const double *dim, const double *width, const double max_distance2, const float r_s_inv, cudaStream_t stream) {
+
+	struct gpu_long_range_params lr;
+	for (int k = 0; k < 3; k++) {
+		lr.CoM_i[k] = CoM_i[k];
+		lr.dim[k] = dim[k];
+		lr.width[k] = width[k];
+	}
+	lr.max_distance2 = max_distance2;
+	lr.r_s_inv = r_s_inv;
+	lr.periodic = periodic;
+	lr.top = top;
+	lr.count = t->count;
+
+	struct cuda_long_range_result *d_res = t->d_results[device] + runner_id * t->max_blocks;
+	struct cuda_long_range_result *res = t->results + runner_id * t->max_blocks;
+
+	const int blocks = (t->count + CUDA_LONG_RANGE_CHUNK - 1) / CUDA_LONG_RANGE_CHUNK;
+	grav_long_range<<<blocks, CUDA_LONG_RANGE_THREADS, 0, stream>>>(t->d_cells[device], lr, *props, d_res);
+
+	cudaError_t err = cudaGetLastError();
+	if (err != cudaSuccess)
+	printf("Error long-range launch: %s\n", cudaGetErrorString(err));
+
+	cudaMemcpyAsync(res, d_res, blocks * sizeof(struct cuda_long_range_result), cudaMemcpyDeviceToHost, stream);
+
+	cudaStreamSynchronize(stream);
+
+	cudaError_t err2 = cudaGetLastError();
+	if (err2 != cudaSuccess)
+	printf("Error long-range sync: %s\n", cudaGetErrorString(err2));
+
+	return blocks;
+}
+
+//PM MESH
+//index of a (wrapped) mesh cell in the padded N x N x 2(N/2+1) layout of
+//the in-place real-to-complex transforms, as row_major_id_periodic()
+__device__ __forceinline__ size_t pm_mesh_index(const int i, const int j, const int k, const int N) {
+	const size_t pad_N = 2 * (N / 2 + 1);
+	return ((size_t)((i + N) % N) * N + (size_t)((j + N) % N)) * pad_N + (size_t)((k + N) % N);
+}
+
+//same as box_wrap(x, 0, dim)
+__device__ __forceinline__ double pm_mesh_box_wrap(const double x, const double dim) {
+	return x < 0. ? (x + dim) : ((x >= dim) ? (x - dim) : x);
+}
+
+//CIC coefficients of a position along one axis
+__device__ __forceinline__ void pm_mesh_CIC_coeffs(const double x, const double dim, const double fac, const int N, int *i, double *d, double *t) {
+	const double pos = pm_mesh_box_wrap(x, dim);
+	int ii = (int)(fac * pos);
+	if (ii >= N) ii = N - 1;
+	*i = ii;
+	*d = fac * pos - ii;
+	*t = 1. - *d;
+}
+
+//same as CIC_get() in mesh_gravity.c but reading the (wrapped) device mesh
+__device__ double pm_mesh_CIC_get(const double *pot, const int N, const int i, const int j, const int k, const double tx, const double ty, const double tz, const double dx, const double dy, const double dz) {
+	double temp;
+	temp = pot[pm_mesh_index(i + 0, j + 0, k + 0, N)] * tx * ty * tz;
+	temp += pot[pm_mesh_index(i + 0, j + 0, k + 1, N)] * tx * ty * dz;
+	temp += pot[pm_mesh_index(i + 0, j + 1, k + 0, N)] * tx * dy * tz;
+	temp += pot[pm_mesh_index(i + 0, j + 1, k + 1, N)] * tx * dy * dz;
+	temp += pot[pm_mesh_index(i + 1, j + 0, k + 0, N)] * dx * ty * tz;
+	temp += pot[pm_mesh_index(i + 1, j + 0, k + 1, N)] * dx * ty * dz;
+	temp += pot[pm_mesh_index(i + 1, j + 1, k + 0, N)] * dx * dy * tz;
+	temp += pot[pm_mesh_index(i + 1, j + 1, k + 1, N)] * dx * dy * dz;
+	return temp;
+}
+
+//CIC assignment of the gparts, one thread per particle, as
+//gpart_to_mesh_CIC()
+__global__ void pm_mesh_assign(const size_t count, const int N, const double fac, const double dim_0, const double dim_1, const double dim_2, const double *x, const double *y, const double *z, const double *m, double *rho) {
+
+	for (size_t p = blockIdx.x * (size_t)blockDim.x + threadIdx.x; p < count; p += (size_t)gridDim.x * blockDim.x) {
+
+		const double value = m[p];
+		if (value == 0.) continue;
+
+		int i, j, k;
+		double dx, dy, dz, tx, ty, tz;
+		pm_mesh_CIC_coeffs(x[p], dim_0, fac, N, &i, &dx, &tx);
+		pm_mesh_CIC_coeffs(y[p], dim_1, fac, N, &j, &dy, &ty);
+		pm_mesh_CIC_coeffs(z[p], dim_2, fac, N, &k, &dz, &tz);
+
+		atomicAdd(&rho[pm_mesh_index(i + 0, j + 0, k + 0, N)], value * tx * ty * tz);
+		atomicAdd(&rho[pm_mesh_index(i + 0, j + 0, k + 1, N)], value * tx * ty * dz);
+		atomicAdd(&rho[pm_mesh_index(i + 0, j + 1, k + 0, N)], value * tx * dy * tz);
+		atomicAdd(&rho[pm_mesh_index(i + 0, j + 1, k + 1, N)], value * tx * dy * dz);
+		atomicAdd(&rho[pm_mesh_index(i + 1, j + 0, k + 0, N)], value * dx * ty * tz);
+		atomicAdd(&rho[pm_mesh_index(i + 1, j + 0, k + 1, N)], value * dx * ty * dz);
+		atomicAdd(&rho[pm_mesh_index(i + 1, j + 1, k + 0, N)], value * dx * dy * tz);
+		atomicAdd(&rho[pm_mesh_index(i + 1, j + 1, k + 1, N)], value * dx * dy * dz);
+	}
+}
+
+//Green function and CIC deconvolution, one thread per Fourier mode, as
+//mesh_apply_Green_function_mapper()
+__global__ void pm_mesh_green(cufftDoubleComplex *frho, const int N, const double green_fac, const double a_smooth2, const double k_fac) {
+
+	const int N_half = N / 2;
+	const size_t count = (size_t)N * N * (N_half + 1);
+
+	for (size_t index = blockIdx.x * (size_t)blockDim.x + threadIdx.x; index < count; index += (size_t)gridDim.x * blockDim.x) {
+
+		const int k = index % (N_half + 1);
+		const int j = (index / (N_half + 1)) % N;
+		const int i = index / ((size_t)(N_half + 1) * N);
+
+		const int kx = (i > N_half ? i - N : i);
+		const double kx_d = (double)kx;
+		const double fx = k_fac * kx_d;
+		const double sinc_kx_inv = (kx != 0) ? fx / sin(fx) : 1.;
+
+		const int ky = (j > N_half ? j - N : j);
+		const double ky_d = (double)ky;
+		const double fy = k_fac * ky_d;
+		const double sinc_ky_inv = (ky != 0) ? fy / sin(fy) : 1.;
+
+		const int kz = (k > N_half ? k - N : k);
+		const double kz_d = (double)kz;
+		const double fz = k_fac * kz_d;
+		const double sinc_kz_inv = (kz != 0) ? fz / (sin(fz) + FLT_MIN) : 1.;
+
+		const double k2 = (kx_d * kx_d + ky_d * ky_d + kz_d * kz_d);
+
+		//the singularity at (0,0,0)
+		if (k2 == 0.) {
+			frho[index].x = 0.;
+			frho[index].y = 0.;
+			continue;
+		}
+
+		//fourier_kernel_long_grav_eval()
+		const double u2 = k2 * a_smooth2;
+#ifdef GADGET2_LONG_RANGE_CORRECTION
+		const double W = exp(-u2);
+#else
+		const double u = sqrt(u2);
+		const double arg = M_PI_2 * u;
+		const double W = arg / (sinh(arg) + FLT_MIN);
+#endif
+		const double green_cor = green_fac * W / (k2 + FLT_MIN);
+
+		const double CIC_cor = sinc_kx_inv * sinc_ky_inv * sinc_kz_inv;
+		const double CIC_cor2 = CIC_cor * CIC_cor;
+		const double CIC_cor4 = CIC_cor2 * CIC_cor2;
+
+		const double total_cor = green_cor * CIC_cor4;
+
+		frho[index].x *= total_cor;
+		frho[index].y *= total_cor;
+	}
+}
+
+//CIC interpolation of the potential and 5-point-stencil accelerations, one
+//thread per particle, as mesh_to_gpart_CIC()
+__global__ void pm_mesh_interpolate(const size_t count, const int N, const double fac, const double dim_0, const double dim_1, const double dim_2, const double *x, const double *y, const double *z, const double *pot, float *a_x, float *a_y, float *a_z, float *phi) {
+
+	for (size_t p = blockIdx.x * (size_t)blockDim.x + threadIdx.x; p < count; p += (size_t)gridDim.x * blockDim.x) {
+
+		int i, j, k;
+		double dx, dy, dz, tx, ty, tz;
+		pm_mesh_CIC_coeffs(x[p], dim_0, fac, N, &i, &dx, &tx);
+		pm_mesh_CIC_coeffs(y[p], dim_1, fac, N, &j, &dy, &ty);
+		pm_mesh_CIC_coeffs(z[p], dim_2, fac, N, &k, &dz, &tz);
+
+		double a[3] = {0., 0., 0.};
+
+		const double ph = pm_mesh_CIC_get(pot, N, i, j, k, tx, ty, tz, dx, dy, dz);
+
+		a[0] += (1. / 12.) * pm_mesh_CIC_get(pot, N, i + 2, j, k, tx, ty, tz, dx, dy, dz);
+		a[0] -= (2. / 3.) * pm_mesh_CIC_get(pot, N, i + 1, j, k, tx, ty, tz, dx, dy, dz);
+		a[0] += (2. / 3.) * pm_mesh_CIC_get(pot, N, i - 1, j, k, tx, ty, tz, dx, dy, dz);
+		a[0] -= (1. / 12.) * pm_mesh_CIC_get(pot, N, i - 2, j, k, tx, ty, tz, dx, dy, dz);
+
+		a[1] += (1. / 12.) * pm_mesh_CIC_get(pot, N, i, j + 2, k, tx, ty, tz, dx, dy, dz);
+		a[1] -= (2. / 3.) * pm_mesh_CIC_get(pot, N, i, j + 1, k, tx, ty, tz, dx, dy, dz);
+		a[1] += (2. / 3.) * pm_mesh_CIC_get(pot, N, i, j - 1, k, tx, ty, tz, dx, dy, dz);
+		a[1] -= (1. / 12.) * pm_mesh_CIC_get(pot, N, i, j - 2, k, tx, ty, tz, dx, dy, dz);
+
+		a[2] += (1. / 12.) * pm_mesh_CIC_get(pot, N, i, j, k + 2, tx, ty, tz, dx, dy, dz);
+		a[2] -= (2. / 3.) * pm_mesh_CIC_get(pot, N, i, j, k + 1, tx, ty, tz, dx, dy, dz);
+		a[2] += (2. / 3.) * pm_mesh_CIC_get(pot, N, i, j, k - 1, tx, ty, tz, dx, dy, dz);
+		a[2] -= (1. / 12.) * pm_mesh_CIC_get(pot, N, i, j, k - 2, tx, ty, tz, dx, dy, dz);
+
+		a_x[p] = fac * a[0];
+		a_y[p] = fac * a[1];
+		a_z[p] = fac * a[2];
+		phi[p] = ph;
+	}
+}
+
+//number of blocks of a grid-stride launch over count elements
+static int pm_mesh_blocks(const size_t count, const int threads) {
+	const size_t blocks = (count + threads - 1) / threads;
+	return blocks > 65535 ? 65535 : (int)blocks;
+}
+
+//makes the in-place cuFFT plans of an N^3 mesh
+extern "C" void pm_mesh_fft_plan(const int N, int *plan_r2c, int *plan_c2r) {
+
+	cufftHandle r2c, c2r;
+	if (cufftPlan3d(&r2c, N, N, N, CUFFT_D2Z) != CUFFT_SUCCESS)
+	printf("Error forward mesh FFT plan\n");
+	if (cufftPlan3d(&c2r, N, N, N, CUFFT_Z2D) != CUFFT_SUCCESS)
+	printf("Error inverse mesh FFT plan\n");
+	*plan_r2c = r2c;
+	*plan_c2r = c2r;
+}
+
+extern "C" void pm_mesh_fft_destroy(const int plan_r2c, const int plan_c2r) {
+
+	cufftDestroy(plan_r2c);
+	cufftDestroy(plan_c2r);
+}
+
+//sends the gparts and assigns them to the (zeroed) device mesh
+extern "C" void pm_mesh_assign_offload(struct cuda_pm_mesh *m, const size_t nr_gparts, const double fac, const double *dim) {
+
+	const int N = m->N;
+	const size_t sizeD = nr_gparts * sizeof(double);
+	const size_t sizeMesh = (size_t)N * N * (2 * (N / 2 + 1)) * sizeof(double);
+
+	cudaMemset(m->d_rho, 0, sizeMesh);
+
+	if (nr_gparts > 0) {
+		cudaMemcpy(m->d_x, m->x, sizeD, cudaMemcpyHostToDevice);
+		cudaMemcpy(m->d_y, m->y, sizeD, cudaMemcpyHostToDevice);
+		cudaMemcpy(m->d_z, m->z, sizeD, cudaMemcpyHostToDevice);
+		cudaMemcpy(m->d_m, m->m, sizeD, cudaMemcpyHostToDevice);
+
+		const int threads = 256;
+		const int blocks = pm_mesh_blocks(nr_gparts, threads);
+		pm_mesh_assign<<<blocks, threads>>>(nr_gparts, N, fac, dim[0], dim[1], dim[2], m->d_x, m->d_y, m->d_z, m->d_m, m->d_rho);
+	}
+
+	cudaDeviceSynchronize();
+
+	cudaError_t err = cudaGetLastError();
+	if (err != cudaSuccess)
+	printf("Error mesh assignment: %s\n", cudaGetErrorString(err));
+}
+
+//FFTs the device mesh, applies the Green function, transforms back and
+//interpolates the accelerations and potentials of the gparts
+extern "C" void pm_mesh_solve_offload(struct cuda_pm_mesh *m, const size_t nr_gparts, const double fac, const double *dim, const double green_fac, const double a_smooth2, const double k_fac) {
+
+	const int N = m->N;
+	const size_t sizeF = nr_gparts * sizeof(float);
+	cufftDoubleComplex *frho = (cufftDoubleComplex *)m->d_rho;
+
+	if (cufftExecD2Z(m->plan_r2c, m->d_rho, frho) != CUFFT_SUCCESS)
+	printf("Error forward mesh FFT\n");
+
+	const int threads = 256;
+	const size_t nr_modes = (size_t)N * N * (N / 2 + 1);
+	const int blocks_green = pm_mesh_blocks(nr_modes, threads);
+	pm_mesh_green<<<blocks_green, threads>>>(frho, N, green_fac, a_smooth2, k_fac);
+
+	if (cufftExecZ2D(m->plan_c2r, frho, m->d_rho) != CUFFT_SUCCESS)
+	printf("Error inverse mesh FFT\n");
+
+	if (nr_gparts > 0) {
+		const int blocks = pm_mesh_blocks(nr_gparts, threads);
+		pm_mesh_interpolate<<<blocks, threads>>>(nr_gparts, N, fac, dim[0], dim[1], dim[2], m->d_x, m->d_y, m->d_z, m->d_rho, m->d_a_x, m->d_a_y, m->d_a_z, m->d_pot);
+
+		cudaMemcpy(m->a_x, m->d_a_x, sizeF, cudaMemcpyDeviceToHost);
+		cudaMemcpy(m->a_y, m->d_a_y, sizeF, cudaMemcpyDeviceToHost);
+		cudaMemcpy(m->a_z, m->d_a_z, sizeF, cudaMemcpyDeviceToHost);
+		cudaMemcpy(m->pot, m->d_pot, sizeF, cudaMemcpyDeviceToHost);
+	}
+
+	cudaDeviceSynchronize();
+
+	cudaError_t err = cudaGetLastError();
+	if (err != cudaSuccess)
+	printf("Error mesh solve: %s\n", cudaGetErrorString(err));
+}
+
+//POWER SPECTRUM
+//makes the in-place forward cuFFT plan of an N^3 power spectrum grid
+extern "C" void power_spectrum_fft_plan(const int N, int *plan_r2c) {
+
+	cufftHandle r2c;
+	if (cufftPlan3d(&r2c, N, N, N, CUFFT_D2Z) != CUFFT_SUCCESS)
+	printf("Error forward power spectrum FFT plan\n");
+	*plan_r2c = r2c;
+}
+
+extern "C" void power_spectrum_fft_destroy(const int plan_r2c) {
+
+	cufftDestroy(plan_r2c);
+}
+
+//sends the padded grid, transforms it in place and brings it back
+extern "C" void power_spectrum_fft_offload(const int plan_r2c, double *d_grid, double *grid, const int N) {
+
+	const size_t sizeGrid = (size_t)N * N * (2 * (N / 2 + 1)) * sizeof(double);
+
+	cudaMemcpy(d_grid, grid, sizeGrid, cudaMemcpyHostToDevice);
+
+	if (cufftExecD2Z(plan_r2c, d_grid, (cufftDoubleComplex *)d_grid) != CUFFT_SUCCESS)
+	printf("Error forward power spectrum FFT\n");
+
+	cudaMemcpy(grid, d_grid, sizeGrid, cudaMemcpyDeviceToHost);
+
+	cudaError_t err = cudaGetLastError();
+	if (err != cudaSuccess)
+	printf("Error power spectrum FFT: %s\n", cudaGetErrorString(err));
+}
+
+//FOF LINKING
+#define FOF_LINK_THREADS 128
+
+//root of a gpart, halving the path on the way; the roots only ever point to
+//smaller indices so the walk ends (see Jaiganesh & Burtscher, ECL-CC)
+__device__ int fof_find_root(int *parent, int v) {
+
+	int cur = parent[v];
+	if (cur != v) {
+		int next, prev = v;
+		while (cur > (next = ((volatile int *)parent)[cur])) {
+			parent[prev] = next;
+			prev = cur;
+			cur = next;
+		}
+	}
+	return cur;
+}
+
+//hooks the larger of the two roots under the smaller one, retrying from the
+//new parent whenever another thread hooked it first
+__device__ void fof_hook(int *parent, int a, int b) {
+
+	int ra = fof_find_root(parent, a);
+	int rb = fof_find_root(parent, b);
+	while (ra != rb) {
+		if (ra < rb) {
+			const int old = atomicCAS(&parent[rb], rb, ra);
+			if (old == rb) break;
+			rb = fof_find_root(parent, old);
+		} else {
+			const int old = atomicCAS(&parent[ra], ra, rb);
+			if (old == ra) break;
+			ra = fof_find_root(parent, old);
+		}
+	}
+}
+
+//one block per pair of leaves: the gparts of cj are staged through shared
+//memory and every thread hooks its gparts of ci to the ones in range, with
+//the same (float) distance as fof_search_self_cell()/fof_search_pair_cells()
+__global__ void fof_link_leaves(const struct cuda_fof_leaf_pair *pairs, const double *x, const double *y, const double *z, const char *linkable, int *parent, const double l_x2) {
+
+	__shared__ double sx[FOF_LINK_THREADS], sy[FOF_LINK_THREADS], sz[FOF_LINK_THREADS];
+	__shared__ char sl[FOF_LINK_THREADS];
+
+	const struct cuda_fof_leaf_pair p = pairs[blockIdx.x];
+
+	for (int i_base = 0; i_base < p.count_i; i_base += blockDim.x) {
+
+		const int i = i_base + threadIdx.x;
+		const size_t gi = p.offset_i + i;
+		const int have_i = i < p.count_i && linkable[gi];
+		double pix = 0., piy = 0., piz = 0.;
+		if (have_i) {
+			pix = x[gi] - p.shift[0];
+			piy = y[gi] - p.shift[1];
+			piz = z[gi] - p.shift[2];
+		}
+
+		//the self pairs only look at j > i
+		for (int j_base = p.self ? i_base : 0; j_base < p.count_j; j_base += blockDim.x) {
+
+			__syncthreads();
+			const int j = j_base + threadIdx.x;
+			if (j < p.count_j) {
+				const size_t gj = p.offset_j + j;
+				sx[threadIdx.x] = x[gj];
+				sy[threadIdx.x] = y[gj];
+				sz[threadIdx.x] = z[gj];
+				sl[threadIdx.x] = linkable[gj];
+			} else {
+				sl[threadIdx.x] = 0;
+			}
+			__syncthreads();
+
+			if (!have_i) continue;
+
+			const int n = min((int)blockDim.x, p.count_j - j_base);
+			for (int k = 0; k < n; k++) {
+				if (!sl[k]) continue;
+				if (p.self && j_base + k <= i) continue;
+
+				float dx[3], r2 = 0.0f;
+				dx[0] = pix - sx[k];
+				dx[1] = piy - sy[k];
+				dx[2] = piz - sz[k];
+				for (int d = 0; d < 3; d++) r2 += dx[d] * dx[d];
+
+				if (r2 < l_x2) fof_hook(parent, (int)gi, (int)(p.offset_j + j_base + k));
+			}
+		}
+	}
+}
+
+//points every gpart straight at its root once all the hooking is done
+__global__ void fof_compress(const size_t count, int *parent) {
+
+	for (size_t v = blockIdx.x * (size_t)blockDim.x + threadIdx.x; v < count; v += (size_t)gridDim.x * blockDim.x) {
+		int root = parent[v];
+		while (root != parent[root]) root = parent[root];
+		parent[v] = root;
+	}
+}
+
+//sends the gparts and leaf pairs, links them and brings the roots back
+extern "C" void fof_link_offload(struct cuda_fof *f, const size_t nr_gparts, const double l_x2) {
+
+	if (nr_gparts == 0) return;
+
+	const size_t sizeD = nr_gparts * sizeof(double);
+	cudaMemcpy(f->d_x, f->x, sizeD, cudaMemcpyHostToDevice);
+	cudaMemcpy(f->d_y, f->y, sizeD, cudaMemcpyHostToDevice);
+	cudaMemcpy(f->d_z, f->z, sizeD, cudaMemcpyHostToDevice);
+	cudaMemcpy(f->d_linkable, f->linkable, nr_gparts * sizeof(char), cudaMemcpyHostToDevice);
+	cudaMemcpy(f->d_parent, f->parent, nr_gparts * sizeof(int), cudaMemcpyHostToDevice);
+
+	if (f->nr_pairs > 0) {
+		cudaMemcpy(f->d_pairs, f->pairs, f->nr_pairs * sizeof(struct cuda_fof_leaf_pair), cudaMemcpyHostToDevice);
+
+		//the grid is limited to 2^31 - 1 blocks
+		for (size_t first = 0; first < f->nr_pairs; first += INT_MAX) {
+			const size_t n = f->nr_pairs - first < INT_MAX ? f->nr_pairs - first : INT_MAX;
+			fof_link_leaves<<<(unsigned int)n, FOF_LINK_THREADS>>>(f->d_pairs + first, f->d_x, f->d_y, f->d_z, f->d_linkable, f->d_parent, l_x2);
+		}
+	}
+
+	const int threads = 256;
+	const int blocks = pm_mesh_blocks(nr_gparts, threads);
+	fof_compress<<<blocks, threads>>>(nr_gparts, f->d_parent);
+
+	cudaMemcpy(f->parent, f->d_parent, nr_gparts * sizeof(int), cudaMemcpyDeviceToHost);
+
+	cudaDeviceSynchronize();
+
+	cudaError_t err = cudaGetLastError();
+	if (err != cudaSuccess)
+	printf("Error FOF linking: %s\n", cudaGetErrorString(err));
+}
+
+//SPH DENSITY LOOP
+//the SPH kernel of the host, see cuda_hydro_init()
+__constant__ struct cuda_hydro_kernel gpu_hydro_kernel;
+
+#define HYDRO_DENSITY_THREADS 128
+
+//device version of kernel_deval()
+__device__ void hydro_kernel_deval(const float u, float *W, float *dW_dx) {
+
+	const struct cuda_hydro_kernel *k = &gpu_hydro_kernel;
+
+	//go to the range [0,1[ from [0,H[
+	const float x = u * k->gamma_inv;
+
+	//pick the correct branch of the kernel
+	const int temp = (int)(x * k->ivals_f);
+	const int ind = temp > k->ivals ? k->ivals : temp;
+	const float *coeffs = &k->coeffs[ind * (k->degree + 1)];
+
+	float w = coeffs[0] * x + coeffs[1];
+	float dw_dx = coeffs[0];
+	for (int i = 2; i <= k->degree; i++) {
+		dw_dx = dw_dx * x + w;
+		w = x * w + coeffs[i];
+	}
+
+	w = fmaxf(w, 0.f);
+	dw_dx = fminf(dw_dx, 0.f);
+
+	*W = w * k->norm;
+	*dW_dx = dw_dx * k->norm_dx;
+}
+
+//one thread per particle of ci to update, the particles of cj are staged
+//into shared memory one tile at a time
+//the sums are those of runner_iact_nonsym_density() and, with metals,
+//runner_iact_nonsym_chemistry(); they start from zero and are added to the
+//parts on the host
+//self is set when ci and cj are the same cell, the particle is then not
+//its own neighbour
+template <int NR_METALS>
+__global__ void hydro_density(const float *x_i, const float *y_i, const float *z_i, const float *h_i, const float *v_x_i, const float *v_y_i, const float *v_z_i, const int *flag_i, const int count_i, const float *x_j, const float *y_j, const float *z_j, const float *m_j, const float *v_x_j, const float *v_y_j, const float *v_z_j, const float *metals_j, const int *flag_j, const int count_j, const int self, const int nr_metals, float *rho, float *rho_dh, float *wcount, float *wcount_dh, float *div_v, float *rot_v_x, float *rot_v_y, float *rot_v_z, float *smoothed_metals) {
+
+	__shared__ float s_x[HYDRO_DENSITY_THREADS], s_y[HYDRO_DENSITY_THREADS], s_z[HYDRO_DENSITY_THREADS], s_m[HYDRO_DENSITY_THREADS];
+	__shared__ float s_v_x[HYDRO_DENSITY_THREADS], s_v_y[HYDRO_DENSITY_THREADS], s_v_z[HYDRO_DENSITY_THREADS];
+	__shared__ int s_flag[HYDRO_DENSITY_THREADS];
+
+	const int pid = blockIdx.x * blockDim.x + threadIdx.x;
+	const int update = pid < count_i && flag_i[pid] == 1;
+	const float dimension = gpu_hydro_kernel.dimension;
+
+	float pix = 0.f, piy = 0.f, piz = 0.f, hi = 1.f, hig2 = 0.f;
+	float piv_x = 0.f, piv_y = 0.f, piv_z = 0.f;
+	if (update) {
+		pix = x_i[pid];
+		piy = y_i[pid];
+		piz = z_i[pid];
+		hi = h_i[pid];
+		hig2 = hi * hi * gpu_hydro_kernel.gamma2;
+		piv_x = v_x_i[pid];
+		piv_y = v_y_i[pid];
+		piv_z = v_z_i[pid];
+	}
+	const float h_inv = 1.f / hi;
+
+	float rho_i = 0.f, rho_dh_i = 0.f, wcount_i = 0.f, wcount_dh_i = 0.f;
+	float div_v_i = 0.f, rot_v_x_i = 0.f, rot_v_y_i = 0.f, rot_v_z_i = 0.f;
+	float Z_i[NR_METALS > 0 ? NR_METALS : 1];
+	for (int k = 0; k < NR_METALS; k++) Z_i[k] = 0.f;
+	const int nr_Z = nr_metals < NR_METALS ? nr_metals : NR_METALS;
+
+	for (int tile = 0; tile < count_j; tile += HYDRO_DENSITY_THREADS) {
+
+		//stage the next sources
+		const int load = tile + threadIdx.x;
+		if (load < count_j) {
+			s_x[threadIdx.x] = x_j[load];
+			s_y[threadIdx.x] = y_j[load];
+			s_z[threadIdx.x] = z_j[load];
+			s_m[threadIdx.x] = m_j[load];
+			s_v_x[threadIdx.x] = v_x_j[load];
+			s_v_y[threadIdx.x] = v_y_j[load];
+			s_v_z[threadIdx.x] = v_z_j[load];
+			s_flag[threadIdx.x] = flag_j[load];
+		}
+		__syncthreads();
+
+		if (update) {
+			const int n = count_j - tile < HYDRO_DENSITY_THREADS ? count_j - tile : HYDRO_DENSITY_THREADS;
+			for (int j = 0; j < n; j++) {
+
+				//skip the inhibited particles and ourselves
+				if (s_flag[j] < 0) continue;
+				if (self && tile + j == pid) continue;
+
+				const float dx = pix - s_x[j];
+				const float dy = piy - s_y[j];
+				const float dz = piz - s_z[j];
+				const float r2 = dx * dx + dy * dy + dz * dz;
+				if (r2 >= hig2) continue;
+
+				const float mj = s_m[j];
+				const float r = sqrtf(r2);
+				const float ui = r * h_inv;
+				float wi, wi_dx;
+				hydro_kernel_deval(ui, &wi, &wi_dx);
+
+				rho_i += mj * wi;
+				rho_dh_i -= mj * (dimension * wi + ui * wi_dx);
+				wcount_i += wi;
+				wcount_dh_i -= (dimension * wi + ui * wi_dx);
+
+				const float r_inv = r ? 1.0f / r : 0.0f;
+				const float faci = mj * wi_dx * r_inv;
+
+				//dv dot r and dv cross r
+				const float dv_x = piv_x - s_v_x[j];
+				const float dv_y = piv_y - s_v_y[j];
+				const float dv_z = piv_z - s_v_z[j];
+				div_v_i -= faci * (dv_x * dx + dv_y * dy + dv_z * dz);
+				rot_v_x_i += faci * (dv_y * dz - dv_z * dy);
+				rot_v_y_i += faci * (dv_z * dx - dv_x * dz);
+				rot_v_z_i += faci * (dv_x * dy - dv_y * dx);
+
+				//the metals are read from global memory, there are too many
+				//of them to stage
+				const float *Z_j = &metals_j[(size_t)(tile + j) * nr_metals];
+				for (int k = 0; k < nr_Z; k++) Z_i[k] += mj * Z_j[k] * wi;
+			}
+		}
+		__syncthreads();
+	}
+
+	if (update) {
+		rho[pid] = rho_i;
+		rho_dh[pid] = rho_dh_i;
+		wcount[pid] = wcount_i;
+		wcount_dh[pid] = wcount_dh_i;
+		div_v[pid] = div_v_i;
+		rot_v_x[pid] = rot_v_x_i;
+		rot_v_y[pid] = rot_v_y_i;
+		rot_v_z[pid] = rot_v_z_i;
+		for (int k = 0; k < nr_Z; k++) smoothed_metals[(size_t)pid * nr_metals + k] = Z_i[k];
+	}
+}
+
+//sends the particles of a cache to the device
+static void hydro_cache_to_device(struct cuda_hydro_cache *c, const int nr_metals, cudaStream_t stream) {
+
+	const size_t sizeF = c->count * sizeof(float);
+	cudaMemcpyAsync(c->d_x, c->x, sizeF, cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(c->d_y, c->y, sizeF, cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(c->d_z, c->z, sizeF, cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(c->d_h, c->h, sizeF, cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(c->d_m, c->m, sizeF, cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(c->d_v_x, c->v_x, sizeF, cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(c->d_v_y, c->v_y, sizeF, cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(c->d_v_z, c->v_z, sizeF, cudaMemcpyHostToDevice, stream);
+	cudaMemcpyAsync(c->d_flag, c->flag, c->count * sizeof(int), cudaMemcpyHostToDevice, stream);
+	if (nr_metals > 0)
+		cudaMemcpyAsync(c->d_metals, c->metals, sizeF * nr_metals, cudaMemcpyHostToDevice, stream);
+}
+
+//brings the density sums of a cache back from the device
+static void hydro_cache_from_device(struct cuda_hydro_cache *c, const int nr_metals, cudaStream_t stream) {
+
+	const size_t sizeF = c->count * sizeof(float);
+	cudaMemcpyAsync(c->rho, c->d_rho, sizeF, cudaMemcpyDeviceToHost, stream);
+	cudaMemcpyAsync(c->rho_dh, c->d_rho_dh, sizeF, cudaMemcpyDeviceToHost, stream);
+	cudaMemcpyAsync(c->wcount, c->d_wcount, sizeF, cudaMemcpyDeviceToHost, stream);
+	cudaMemcpyAsync(c->wcount_dh, c->d_wcount_dh, sizeF, cudaMemcpyDeviceToHost, stream);
+	cudaMemcpyAsync(c->div_v, c->d_div_v, sizeF, cudaMemcpyDeviceToHost, stream);
+	cudaMemcpyAsync(c->rot_v_x, c->d_rot_v_x, sizeF, cudaMemcpyDeviceToHost, stream);
+	cudaMemcpyAsync(c->rot_v_y, c->d_rot_v_y, sizeF, cudaMemcpyDeviceToHost, stream);
+	cudaMemcpyAsync(c->rot_v_z, c->d_rot_v_z, sizeF, cudaMemcpyDeviceToHost, stream);
+	if (nr_metals > 0)
+		cudaMemcpyAsync(c->smoothed_metals, c->d_smoothed_metals, sizeF * nr_metals, cudaMemcpyDeviceToHost, stream);
+}
+
+//launches the density loop updating the flagged particles of ci from cj
+static void hydro_density_launch(struct cuda_hydro_cache *ci, struct cuda_hydro_cache *cj, const int self, const int nr_metals, cudaStream_t stream) {
+
+	if (ci->count == 0) return;
+
+	const int threads = HYDRO_DENSITY_THREADS;
+	const int blocks = (ci->count + threads - 1) / threads;
+	if (nr_metals > 0)
+		hydro_density<cuda_hydro_max_metals><<<blocks, threads, 0, stream>>>(ci->d_x, ci->d_y, ci->d_z, ci->d_h, ci->d_v_x, ci->d_v_y, ci->d_v_z, ci->d_flag, ci->count, cj->d_x, cj->d_y, cj->d_z, cj->d_m, cj->d_v_x, cj->d_v_y, cj->d_v_z, cj->d_metals, cj->d_flag, cj->count, self, nr_metals, ci->d_rho, ci->d_rho_dh, ci->d_wcount, ci->d_wcount_dh, ci->d_div_v, ci->d_rot_v_x, ci->d_rot_v_y, ci->d_rot_v_z, ci->d_smoothed_metals);
+	else
+		hydro_density<0><<<blocks, threads, 0, stream>>>(ci->d_x, ci->d_y, ci->d_z, ci->d_h, ci->d_v_x, ci->d_v_y, ci->d_v_z, ci->d_flag, ci->count, cj->d_x, cj->d_y, cj->d_z, cj->d_m, cj->d_v_x, cj->d_v_y, cj->d_v_z, cj->d_metals, cj->d_flag, cj->count, self, nr_metals, ci->d_rho, ci->d_rho_dh, ci->d_wcount, ci->d_wcount_dh, ci->d_div_v, ci->d_rot_v_x, ci->d_rot_v_y, ci->d_rot_v_z, ci->d_smoothed_metals);
+}
+
+//runs the density loop of a cell with itself (ci == cj) or of a pair of
+//cells, updating the flagged particles of the cell(s) to update; the
+//results are brought straight back into the host caches and are only valid
+//if no fault is returned
+extern "C" enum cuda_fault hydro_density_offload(struct cuda_hydro_cache *ci, struct cuda_hydro_cache *cj, const int update_i, const int update_j, const int nr_metals, cudaStream_t stream) {
+
+	const int self = (ci == cj);
+
+	//copy data to device
+	hydro_cache_to_device(ci, nr_metals, stream);
+	if (!self) hydro_cache_to_device(cj, nr_metals, stream);
+
+	//call kernel function
+	if (update_i) hydro_density_launch(ci, cj, self, nr_metals, stream);
+	if (update_j && !self) hydro_density_launch(cj, ci, 0, nr_metals, stream);
+
+	//copy data from device
+	if (update_i) hydro_cache_from_device(ci, nr_metals, stream);
+	if (update_j && !self) hydro_cache_from_device(cj, nr_metals, stream);
+
+	//check the launches, copies and kernels at once
+	return cuda_stream_sync_check(stream, self ? "hydro density self" : "hydro density pair");
+}
+
+//copies the host's SPH kernel into the constant memory of the current
+//device
+extern "C" void hydro_kernel_offload(const struct cuda_hydro_kernel *k) {
+
+	cudaError_t err = cudaMemcpyToSymbol(gpu_hydro_kernel, k, sizeof(struct cuda_hydro_kernel));
+	if (err != cudaSuccess)
+	printf("Error hydro kernel upload: %s\n", cudaGetErrorString(err));
+}
+
+//RT THERMOCHEMISTRY
+//the explicit SPHM1RT thermochemistry of rt_cooling_rates.h, one particle
+//per thread; the particles whose solution is not accurate enough go through
+//the implicit solver on the host
+#define RT_TCHEM_THREADS 128
+
+//recombination and collisional ionization coefficients (Hui and Gnedin 1997,
+//Theuns et al. 1998), see rt_compute_alphabeta_cgs()
+__device__ void rt_tchem_alphabeta(const double T, const int onthespot, double *alpha, double *beta) {
+
+	const double lambdaT = 315614.0 / T;
+	const double alphaAHII = 1.269e-13 * pow(lambdaT, 1.503) * pow(1.0 + pow(lambdaT / 0.522, 0.470), -1.923);
+	const double alphaBHII = 2.753e-14 * pow(lambdaT, 1.5) * pow(1.0 + pow(lambdaT / 2.740, 0.407), -2.242);
+	const double betaHI = 1.17e-10 * sqrt(T) * exp(-157809.1 / T) / (1.0 + sqrt(T / 1e5));
+
+	const double lambdaTI = 2.0 * 285335.0 / T;
+	const double lambdaTII = 2.0 * 631515.0 / T;
+	const double alphaAHeII = 3.0e-14 * pow(lambdaTI, 0.654);
+	const double alphaBHeII = 1.26e-14 * pow(lambdaTI, 0.750);
+	const double alphaDiHeII = 1.9e-3 * pow(T, -1.5) * exp(-4.7e5 / T) * (1.0 + 0.3 * exp(-9.4e4 / T));
+	const double alphaAHeIII = 2.538e-13 * pow(lambdaTII, 1.503) * pow(1.0 + pow(lambdaTII / 0.522, 0.470), -1.923);
+	const double alphaBHeIII = 5.506e-14 * pow(lambdaTII, 1.5) * pow(1.0 + pow(lambdaTII / 2.740, 0.407), -2.242);
+	const double betaHeI = 4.76e-11 * sqrt(T) * exp(-285335.4 / T) / (1.0 + sqrt(T / 1e5));
+	const double betaHeII = 1.14e-11 * sqrt(T) * exp(-631515.0 / T) / (1.0 + sqrt(T / 1e5));
+
+	for (int s = 0; s < cuda_rt_nr_species; s++) alpha[s] = beta[s] = 0.0;
+	beta[cuda_rt_sp_HI] = betaHI;
+	beta[cuda_rt_sp_HeI] = betaHeI;
+	beta[cuda_rt_sp_HeII] = betaHeII;
+	if (onthespot == 1) {
+		alpha[cuda_rt_sp_HII] = alphaBHII;
+		alpha[cuda_rt_sp_HeII] = alphaBHeII + alphaDiHeII;
+		alpha[cuda_rt_sp_HeIII] = alphaBHeIII;
+	} else {
+		alpha[cuda_rt_sp_HII] = alphaAHII;
+		alpha[cuda_rt_sp_HeII] = alphaAHeII + alphaDiHeII;
+		alpha[cuda_rt_sp_HeIII] = alphaAHeIII;
+	}
+}
+
+//cooling coefficients (Hui and Gnedin 1997, Theuns et al. 1998), see
+//rt_compute_cooling_gamma_cgs()
+__device__ void rt_tchem_cooling_gamma(const double T, const int onthespot, double *Gamma) {
+
+	const double log_T = log10(T);
+	const double lambdaT = 315614.0 / T;
+	const double gaunt = 1.1 + 0.34 * exp(-pow(5.5 - log_T, 2.0) / 3.0);
+	const double Gamma_colion_HI = 2.54e-21 * pow(T, 0.5) * exp(-157809.1 / T) / (1.0 + pow(T / 1.0e5, 0.5));
+	const double Gamma_line_HI = 7.5e-19 * exp(-118348.0 / T) / (1.0 + pow(T / 1.0e5, 0.5));
+	const double Gamma_recomA_HII = 1.778e-29 * T * pow(lambdaT, 1.965) * pow(1.0 + pow(lambdaT / 0.541, 0.502), -2.697);
+	const double Gamma_recomB_HII = 3.435e-30 * T * pow(lambdaT, 1.970) * pow(1.0 + pow(lambdaT / 2.250, 0.376), -3.720);
+	const double Gamma_ff_HII = 1.42e-27 * pow(T, 0.5) * gaunt;
+
+	const double lambdaTI = 2.0 * 285335.0 / T;
+	const double lambdaTII = 2.0 * 631515.0 / T;
+	const double Gamma_colion_HeI = 1.88e-21 * sqrt(T) * exp(-285335.4 / T) / (1.0 + pow(T / 1.0e5, 0.5));
+	const double Gamma_colion_HeII = 9.90e-22 * sqrt(T) * exp(-631515.0 / T) / (1.0 + pow(T / 1.0e5, 0.5));
+	const double Gamma_line_HeII = 5.54e-17 * pow(T, -0.397) * exp(-473638.0 / T) / (1.0 + pow(T / 1.0e5, 0.5));
+	const double Gamma_recomA_HeII = 1.38e-16 * T * 3.0e-14 * pow(lambdaTI, 0.654);
+	const double Gamma_recomB_HeII = 1.38e-16 * T * 1.26e-14 * pow(lambdaTI, 0.750);
+	const double Gamma_recomDi_HeII = 1.24e-13 * pow(T, -1.5) * exp(-4.7e5 / T) * (1.0 + 0.3 * exp(-9.4e4 / T));
+	const double Gamma_recomA_HeIII = 1.4224e-28 * T * pow(lambdaTII, 1.965) * pow(1.0 + pow(lambdaTII / 0.541, 0.502), -2.697);
+	const double Gamma_recomB_HeIII = 2.748e-29 * T * pow(lambdaTII, 1.970) * pow(1.0 + pow(lambdaTII / 2.250, 0.376), -3.720);
+	const double Gamma_ff_HeII = 1.42e-27 * pow(T, 0.5) * gaunt;
+	const double Gamma_ff_HeIII = 5.68e-27 * pow(T, 0.5) * gaunt;
+
+	Gamma[cuda_rt_sp_elec] = 0.0;
+	Gamma[cuda_rt_sp_HI] = Gamma_colion_HI + Gamma_line_HI;
+	Gamma[cuda_rt_sp_HII] = Gamma_ff_HII;
+	Gamma[cuda_rt_sp_HeI] = Gamma_colion_HeI;
+	Gamma[cuda_rt_sp_HeII] = Gamma_colion_HeII + Gamma_line_HeII + Gamma_ff_HeII;
+	Gamma[cuda_rt_sp_HeIII] = Gamma_ff_HeIII;
+	if (onthespot == 1) {
+		Gamma[cuda_rt_sp_HII] += Gamma_recomB_HII;
+		Gamma[cuda_rt_sp_HeII] += Gamma_recomB_HeII + Gamma_recomDi_HeII;
+		Gamma[cuda_rt_sp_HeIII] += Gamma_recomB_HeIII;
+	} else {
+		Gamma[cuda_rt_sp_HII] += Gamma_recomA_HII;
+		Gamma[cuda_rt_sp_HeII] += Gamma_recomA_HeII + Gamma_recomDi_HeII;
+		Gamma[cuda_rt_sp_HeIII] += Gamma_recomA_HeIII;
+	}
+}
+
+//photo-ionization cross sections and energies (BB1e5 and Verner+1996) of
+//the HI, HeI and HeII (second index) in the three groups (first index), see
+//rt_compute_photoionization_rate_cgs()
+__constant__ double rt_tchem_sigma[3][3] = {{2.99e-18, 0.0, 0.0}, {5.66e-19, 4.46e-18, 0.0}, {7.84e-20, 1.19e-18, 1.05e-18}};
+__constant__ double rt_tchem_epsilon[3][3] = {{6.17e-12, 0.0, 0.0}, {2.81e-11, 1.25e-11, 0.0}, {7.77e-11, 6.11e-11, 1.27e-11}};
+
+//the explicit solution of rt_compute_explicit_thermochemistry_solution() of
+//every problem; the ones the host would stop on get an infinite change,
+//for it to redo and report them
+__global__ void rt_tchem_explicit(struct cuda_rt_tchem *tchem, const int count, const struct cuda_rt_params params) {
+
+	const int pid = blockIdx.x * blockDim.x + threadIdx.x;
+	if (pid >= count) return;
+	struct cuda_rt_tchem *t = &tchem[pid];
+
+	const double T = t->T_cgs, n_H = t->n_H_cgs, cred = t->cred_cgs, dt = t->dt_cgs;
+	if (T == 0.0 || dt == 0.0 || n_H == 0.0) {
+		t->max_relative_change = INFINITY;
+		return;
+	}
+
+	//the coefficients
+	double alpha[cuda_rt_nr_species], beta[cuda_rt_nr_species], Gamma[cuda_rt_nr_species], sigma[3][3], epsilon[3][3];
+	if (params.useparams == 1) {
+		for (int s = 0; s < cuda_rt_nr_species; s++) alpha[s] = beta[s] = Gamma[s] = 0.0;
+		beta[cuda_rt_sp_HI] = params.beta_cgs_H;
+		alpha[cuda_rt_sp_HII] = params.onthespot == 1 ? params.alphaB_cgs_H : params.alphaA_cgs_H;
+		for (int i = 0; i < 3; i++)
+			for (int j = 0; j < 3; j++) {
+				sigma[i][j] = j == 0 ? params.sigma_cross_cgs_H[i] : 0.0;
+				epsilon[i][j] = 0.0;
+			}
+	} else {
+		rt_tchem_alphabeta(T, params.onthespot, alpha, beta);
+		rt_tchem_cooling_gamma(T, params.onthespot, Gamma);
+		for (int i = 0; i < 3; i++)
+			for (int j = 0; j < 3; j++) {
+				sigma[i][j] = rt_tchem_sigma[i][j];
+				epsilon[i][j] = rt_tchem_epsilon[i][j];
+			}
+	}
+
+	const double *a = t->abundances;
+	const double *ngamma = t->ngamma_cgs;
+	const int aindex[3] = {cuda_rt_sp_HI, cuda_rt_sp_HeI, cuda_rt_sp_HeII};
+	const double n_H2 = n_H * n_H;
+	const double a_e = a[cuda_rt_sp_elec];
+
+	//radiation absorption, see rt_compute_radiation_rate()
+	double absorption[3] = {0.0, 0.0, 0.0};
+	for (int i = 0; i < 3; i++)
+		for (int g = 0; g < 3; g++)
+			absorption[g] += sigma[g][i] * cred * ngamma[g] * a[aindex[i]] * n_H;
+
+	//chemistry, see rt_compute_chemistry_rate()
+	double rates[cuda_rt_nr_species];
+	for (int s = 0; s < cuda_rt_nr_species; s++) rates[s] = 0.0;
+	for (int i = 0; i < 3; i++) {
+		rates[aindex[0]] += -sigma[i][0] * cred * ngamma[i] * a[aindex[0]] * n_H;
+		rates[aindex[1]] += -sigma[i][1] * cred * ngamma[i] * a[aindex[1]] * n_H;
+		rates[aindex[2]] += -sigma[i][2] * cred * ngamma[i] * a[aindex[2]] * n_H;
+		rates[aindex[2]] += sigma[i][1] * cred * ngamma[i] * a[aindex[1]] * n_H;
+	}
+	rates[cuda_rt_sp_HI] += -beta[cuda_rt_sp_HI] * a_e * a[cuda_rt_sp_HI] * n_H * n_H;
+	rates[cuda_rt_sp_HeI] += -beta[cuda_rt_sp_HeI] * a_e * a[cuda_rt_sp_HeI] * n_H * n_H;
+	rates[cuda_rt_sp_HeII] += -beta[cuda_rt_sp_HeII] * a_e * a[cuda_rt_sp_HeII] * n_H * n_H;
+	rates[cuda_rt_sp_HeII] += beta[cuda_rt_sp_HeI] * a_e * a[cuda_rt_sp_HeI] * n_H * n_H;
+	rates[cuda_rt_sp_HI] += alpha[cuda_rt_sp_HII] * a_e * a[cuda_rt_sp_HII] * n_H * n_H;
+	rates[cuda_rt_sp_HeI] += alpha[cuda_rt_sp_HeII] * a_e * a[cuda_rt_sp_HeII] * n_H * n_H;
+	rates[cuda_rt_sp_HeII] += alpha[cuda_rt_sp_HeIII] * a_e * a[cuda_rt_sp_HeIII] * n_H * n_H;
+	rates[cuda_rt_sp_HeII] += -alpha[cuda_rt_sp_HeII] * a_e * a[cuda_rt_sp_HeII] * n_H * n_H;
+
+	//net cooling, see rt_compute_cooling_rate()
+	double cooling = 0.0;
+	for (int s = 0; s < cuda_rt_nr_species; s++) cooling += Gamma[s] * a_e * a[s];
+	cooling *= n_H2;
+	double heating = 0.0;
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			heating += epsilon[i][j] * sigma[i][j] * cred * ngamma[i] * a[aindex[j]] * n_H;
+	const double Lambda_net = heating - cooling;
+
+	//the explicit step and its largest relative change
+	double max_change = 0.0;
+	for (int s = 0; s < cuda_rt_nr_species; s++) {
+		t->new_abundances[s] = fmax(a[s] + rates[s] / n_H * dt, 0.0);
+		if (t->new_abundances[s] > 1e-15 && a[s] > 1e-15)
+			max_change = fmax(max_change, fabs(t->new_abundances[s] - a[s]) * (1.0 / a[s]));
+	}
+	const double u_new = fmax(t->u_cgs + Lambda_net * dt / t->rho_cgs, t->u_min_cgs);
+	max_change = fmax(max_change, fabs(u_new - t->u_cgs) / t->u_cgs);
+	for (int i = 0; i < 3; i++) {
+		t->new_ngamma_cgs[i] = fmax(ngamma[i] - absorption[i] * dt, 0.0);
+		if (t->new_ngamma_cgs[i] > 1e-8 * n_H && ngamma[i] > 1e-8 * n_H)
+			max_change = fmax(max_change, fabs(t->new_ngamma_cgs[i] - ngamma[i]) / ngamma[i]);
+	}
+
+	t->u_new_cgs = u_new;
+	t->max_relative_change = max_change;
+}
+
+//solves the explicit thermochemistry of all the particles of a cache; the
+//solutions are brought straight back into the host cache
+extern "C" void rt_tchem_offload(struct cuda_rt_cache *c, const struct cuda_rt_params *params, cudaStream_t stream) {
+
+	if (c->count == 0) return;
+
+	const size_t size = c->count * sizeof(struct cuda_rt_tchem);
+	cudaMemcpyAsync(c->d_tchem, c->tchem, size, cudaMemcpyHostToDevice, stream);
+
+	const int threads = RT_TCHEM_THREADS;
+	const int blocks = (c->count + threads - 1) / threads;
+	rt_tchem_explicit<<<blocks, threads, 0, stream>>>(c->d_tchem, c->count, *params);
+
+	cudaError_t err = cudaGetLastError();
+	if (err != cudaSuccess)
+	printf("Error RT thermochemistry launch: %s\n", cudaGetErrorString(err));
+
+	cudaMemcpyAsync(c->tchem, c->d_tchem, size, cudaMemcpyDeviceToHost, stream);
+	cudaStreamSynchronize(stream);
+
+	cudaError_t err2 = cudaGetLastError();
+	if (err2 != cudaSuccess)
+	printf("Error RT thermochemistry sync: %s\n", cudaGetErrorString(err2));
+}
+
+//LIGHTCONE SMOOTHING
+//the smoothing of the lightcone map updates of healpix_smoothing_mapper(),
+//one block per update; the discs are found on the host and the weighted
+//values accumulated atomically into a window of pixels of the local maps
+#define LIGHTCONE_SMOOTH_THREADS 128
+
+//same as isqrt64() of the HEALPix C API
+__device__ int64_t lightcone_isqrt(const int64_t v) {
+
+	int64_t res = sqrt(v + 0.5);
+	if (v < ((int64_t)1 << 50)) return res;
+	if (res * res > v) --res;
+	else if ((res + 1) * (res + 1) <= v) ++res;
+	return res;
+}
+
+//unit vector to the centre of a pixel of the RING scheme, same as
+//pix2vec_ring64() of the HEALPix C API
+__device__ void lightcone_pix2vec_ring(const int64_t nside, const int64_t pix, double *vec) {
+
+	const int64_t ncap = 2 * nside * (nside - 1);
+	const int64_t npix = 12 * nside * nside;
+	const double fact2 = 4. / npix;
+	double z, phi, s = -5.;
+
+	if (pix < ncap) {
+		//north polar cap
+		const int64_t iring = (1 + lightcone_isqrt(1 + 2 * pix)) >> 1;
+		const int64_t iphi = (pix + 1) - 2 * iring * (iring - 1);
+		const double tmp = (iring * iring) * fact2;
+		z = 1. - tmp;
+		if (z > 0.99) s = sqrt(tmp * (2. - tmp));
+		phi = (iphi - 0.5) * (0.5 * M_PI) / iring;
+	} else if (pix < npix - ncap) {
+		//equatorial region
+		const int64_t ip = pix - ncap;
+		const int64_t iring = ip / (4 * nside) + nside;
+		const int64_t iphi = ip % (4 * nside) + 1;
+		const double fodd = ((iring + nside) & 1) ? 1. : 0.5;
+		const double fact1 = (nside << 1) * fact2;
+		z = (2 * nside - iring) * fact1;
+		phi = (iphi - fodd) * M_PI / (2 * nside);
+	} else {
+		//south polar cap
+		const int64_t ip = npix - pix;
+		const int64_t iring = (1 + lightcone_isqrt(2 * ip - 1)) >> 1;
+		const int64_t iphi = 4 * iring + 1 - (ip - 2 * iring * (iring - 1));
+		const double tmp = (iring * iring) * fact2;
+		z = tmp - 1.;
+		if (z < -0.99) s = sqrt(tmp * (2. - tmp));
+		phi = (iphi - 0.5) * (0.5 * M_PI) / iring;
+	}
+
+	if (s < -2.) s = sqrt((1. - z) * (1. + z));
+	vec[0] = s * cos(phi);
+	vec[1] = s * sin(phi);
+	vec[2] = z;
+}
+
+//the projected kernel at the centre of a pixel, see projected_kernel_eval()
+__device__ double lightcone_pixel_weight(const struct cuda_lightcone_update &u, const int64_t nside, const int64_t pix, const double *kernel, const double du, const double inv_du, const double u_max) {
+
+	double pixel_vec[3];
+	lightcone_pix2vec_ring(nside, pix, pixel_vec);
+	const double dp = pixel_vec[0] * u.vec[0] + pixel_vec[1] * u.vec[1] + pixel_vec[2] * u.vec[2];
+	const double angle = dp < 1.0 ? acos(dp) : 0.0;
+
+	const double q = angle / u.radius;
+	if (q >= u_max) return 0.0;
+	const int i = q * inv_du;
+	const double f = (q - i * du) * inv_du;
+	return (1.0 - f) * kernel[i] + f * kernel[i + 1];
+}
+
+__global__ void lightcone_smooth(const struct cuda_lightcone_update *updates, const struct pixel_range *ranges, const double *values, const int nr_maps, const int64_t nside, const double *kernel, const double du, const double inv_du, const double u_max, const int64_t window_first, const int64_t window_count, double *window) {
+
+	__shared__ double s_weight[LIGHTCONE_SMOOTH_THREADS];
+	const struct cuda_lightcone_update u = updates[blockIdx.x];
+	const struct pixel_range *range = &ranges[u.first_range];
+
+	//total weight of all the pixels of the disc, local or not
+	double weight = 0.0;
+	for (int r = 0; r < u.nr_ranges; r++)
+		for (int64_t pix = range[r].first + threadIdx.x; pix <= range[r].last; pix += blockDim.x)
+			weight += lightcone_pixel_weight(u, nside, pix, kernel, du, inv_du, u_max);
+	s_weight[threadIdx.x] = weight;
+	__syncthreads();
+	for (int s = blockDim.x / 2; s > 0; s >>= 1) {
+		if (threadIdx.x < s) s_weight[threadIdx.x] += s_weight[threadIdx.x + s];
+		__syncthreads();
+	}
+	const double total_weight = s_weight[0];
+
+	//spread the values over the pixels of the window
+	const double *value = &values[(size_t)blockIdx.x * nr_maps];
+	for (int r = 0; r < u.nr_ranges; r++)
+		for (int64_t pix = range[r].first + threadIdx.x; pix <= range[r].last; pix += blockDim.x) {
+			if (pix < window_first || pix >= window_first + window_count) continue;
+			const double w = lightcone_pixel_weight(u, nside, pix, kernel, du, inv_du, u_max) / total_weight;
+			for (int m = 0; m < nr_maps; m++)
+				atomicAdd(&window[m * window_count + (pix - window_first)], value[m] * w);
+		}
+}
+
+//smooths the batch of updates of the lightcone onto its window; the window
+//is brought straight back to the host
+extern "C" void lightcone_smooth_offload(struct cuda_lightcone *l, const double du, const double inv_du, const double u_max, const int nside, const int64_t window_first, const size_t window_count) {
+
+	if (l->nr_updates == 0) return;
+
+	cudaMemcpy(l->d_updates, l->updates, l->nr_updates * sizeof(struct cuda_lightcone_update), cudaMemcpyHostToDevice);
+	cudaMemcpy(l->d_ranges, l->ranges, l->nr_ranges * sizeof(struct pixel_range), cudaMemcpyHostToDevice);
+	cudaMemcpy(l->d_values, l->values, (size_t)l->nr_updates * l->nr_maps * sizeof(double), cudaMemcpyHostToDevice);
+	const size_t sizeW = window_count * l->nr_maps * sizeof(double);
+	cudaMemset(l->d_window, 0, sizeW);
+
+	lightcone_smooth<<<l->nr_updates, LIGHTCONE_SMOOTH_THREADS>>>(l->d_updates, l->d_ranges, l->d_values, l->nr_maps, nside, l->d_kernel, du, inv_du, u_max, window_first, window_count, l->d_window);
+
+	cudaError_t err = cudaGetLastError();
+	if (err != cudaSuccess)
+	printf("Error lightcone smoothing launch: %s\n", cudaGetErrorString(err));
+
+	cudaMemcpy(l->window, l->d_window, sizeW, cudaMemcpyDeviceToHost);
+
+	cudaError_t err2 = cudaGetLastError();
+	if (err2 != cudaSuccess)
+	printf("Error lightcone smoothing sync: %s\n", cudaGetErrorString(err2));
+}
+
+//EXACT FORCE CHECKS
+//the brute-force calculation of gravity_exact_force_compute_mapper(), all in
+//double precision, one thread per tested gpart with the sources staged in
+//shared memory tile by tile
+#define EXACT_FORCE_THREADS 128
+
+//same as nearest()
+__device__ double exact_force_nearest(const double dx, const double box_size) {
+
+	return ((dx > 0.5 * box_size) ? (dx - box_size) : ((dx < -0.5 * box_size) ? (dx + box_size) : dx));
+}
+
+//same as kernel_grav_eval_force_double() and kernel_grav_eval_pot_double()
+__device__ void exact_force_softening(const double u, double *W_f, double *W_p) {
+
+#ifdef GADGET2_SOFTENING_CORRECTION
+	if (u < 0.5) {
+		*W_f = 10.666666666667 + u * u * (32.0 * u - 38.4);
+		*W_p = -2.8 + u * u * (5.333333333333 + u * u * (6.4 * u - 9.6));
+	} else {
+		*W_f = 21.333333333333 - 48.0 * u + 38.4 * u * u - 10.666666666667 * u * u * u - 0.066666666667 / (u * u * u);
+		*W_p = -3.2 + 0.066666666667 / u + u * u * (10.666666666667 + u * (-16.0 + u * (9.6 - 2.133333333333 * u)));
+	}
+#else
+	/* W(u) = 21u^5 - 90u^4 + 140u^3 - 84u^2 + 14 */
+	double W = 21. * u - 90.;
+	W = W * u + 140.;
+	W = W * u - 84.;
+	W = W * u;
+	*W_f = W * u + 14.;
+
+	/* W(u) = 3u^7 - 15u^6 + 28u^5 - 21u^4 + 7u^2 - 3 */
+	W = 3. * u - 15.;
+	W = W * u + 28.;
+	W = W * u - 21.;
+	W = W * u;
+	W = W * u + 7.;
+	W = W * u;
+	*W_p = W * u - 3;
+#endif
+}
+
+//same as kernel_long_grav_force_eval_double()
+__device__ double exact_force_long_range(const double u) {
+
+#ifdef GADGET2_LONG_RANGE_CORRECTION
+	const double one_over_sqrt_pi = M_2_SQRTPI * 0.5;
+	const double arg1 = u * 0.5;
+	const double arg2 = -arg1 * arg1;
+	return erfc(arg1) + u * one_over_sqrt_pi * exp(arg2);
+#else
+	const double x = 2. * u;
+	const double exp_x = exp(x);
+	const double alpha = 1. / (1. + exp_x);
+
+	/* We want 2*(x*alpha - x*alpha^2 - exp(x)*alpha + 1) */
+	double W = 1. - alpha;
+	W = W * x - exp_x;
+	W = W * alpha + 1.;
+	return 2. * W;
+#endif
+}
+
+//trilinear interpolation of one of the Ewald tables, see
+//gravity_exact_force_ewald_evaluate()
+__device__ double exact_force_ewald_interpolate(const float *__restrict__ table, const int n, const int i, const int j, const int k, const double dx, const double dy, const double dz) {
+
+	const double tx = 1. - dx;
+	const double ty = 1. - dy;
+	const double tz = 1. - dz;
+	const int n1 = n + 1;
+	const float *t = &table[((size_t)i * n1 + j) * n1 + k];
+
+	double v = 0.;
+	v += __ldg(&t[0]) * tx * ty * tz;
+	v += __ldg(&t[1]) * tx * ty * dz;
+	v += __ldg(&t[n1]) * tx * dy * tz;
+	v += __ldg(&t[n1 + 1]) * tx * dy * dz;
+	v += __ldg(&t[n1 * n1]) * dx * ty * tz;
+	v += __ldg(&t[n1 * n1 + 1]) * dx * ty * dz;
+	v += __ldg(&t[n1 * n1 + n1]) * dx * dy * tz;
+	v += __ldg(&t[n1 * n1 + n1 + 1]) * dx * dy * dz;
+	return v;
+}
+
+//same as gravity_exact_force_ewald_evaluate(), the four tables follow each
+//other in ewald
+__device__ void exact_force_ewald_evaluate(double rx, double ry, double rz, const float *__restrict__ ewald, const int n, const double fac, double corr_f[3], double *corr_p) {
+
+	const double s_x = (rx < 0.) ? 1. : -1.;
+	const double s_y = (ry < 0.) ? 1. : -1.;
+	const double s_z = (rz < 0.) ? 1. : -1.;
+	rx = fabs(rx);
+	ry = fabs(ry);
+	rz = fabs(rz);
+
+	int i = (int)(rx * fac);
+	if (i >= n) i = n - 1;
+	const double dx = rx * fac - i;
+
+	int j = (int)(ry * fac);
+	if (j >= n) j = n - 1;
+	const double dy = ry * fac - j;
+
+	int k = (int)(rz * fac);
+	if (k >= n) k = n - 1;
+	const double dz = rz * fac - k;
+
+	const size_t size = (size_t)(n + 1) * (n + 1) * (n + 1);
+	corr_f[0] = s_x * exact_force_ewald_interpolate(ewald, n, i, j, k, dx, dy, dz);
+	corr_f[1] = s_y * exact_force_ewald_interpolate(ewald + size, n, i, j, k, dx, dy, dz);
+	corr_f[2] = s_z * exact_force_ewald_interpolate(ewald + 2 * size, n, i, j, k, dx, dy, dz);
+	*corr_p = exact_force_ewald_interpolate(ewald + 3 * size, n, i, j, k, dx, dy, dz);
+}
+
+//the accelerations are stored as 3 consecutive values per tested gpart
+__global__ void exact_force(const int nr_tested, const size_t *index, const double *h, const size_t nr_gparts, const double *x, const double *y, const double *z, const double *m, const float *ewald, const int n_ewald, const double ewald_fac, const int periodic, const double dim_0, const double dim_1, const double dim_2, const double r_s_inv, double *a_grav_out, double *a_grav_short_out, double *a_grav_long_out, double *pot_out) {
+
+	__shared__ double sx[EXACT_FORCE_THREADS], sy[EXACT_FORCE_THREADS], sz[EXACT_FORCE_THREADS], sm[EXACT_FORCE_THREADS];
+
+	const int t = blockIdx.x * blockDim.x + threadIdx.x;
+	const int have_i = t < nr_tested;
+	const size_t gi = have_i ? index[t] : 0;
+	const double pix = have_i ? x[gi] : 0.;
+	const double piy = have_i ? y[gi] : 0.;
+	const double piz = have_i ? z[gi] : 0.;
+	const double hi = have_i ? h[t] : 1.;
+	const double hi_inv = 1. / hi;
+	const double hi_inv3 = hi_inv * hi_inv * hi_inv;
+
+	double a_grav[3] = {0., 0., 0.};
+	double a_grav_short[3] = {0., 0., 0.};
+	double a_grav_long[3] = {0., 0., 0.};
+	double pot = 0.;
+
+	for (size_t j_base = 0; j_base < nr_gparts; j_base += blockDim.x) {
+
+		//the whole block stages the next tile of sources
+		__syncthreads();
+		const size_t gj = j_base + threadIdx.x;
+		if (gj < nr_gparts) {
+			sx[threadIdx.x] = x[gj];
+			sy[threadIdx.x] = y[gj];
+			sz[threadIdx.x] = z[gj];
+			sm[threadIdx.x] = m[gj];
+		}
+		__syncthreads();
+
+		if (!have_i) continue;
+
+		const int count = nr_gparts - j_base < blockDim.x ? (int)(nr_gparts - j_base) : (int)blockDim.x;
+		for (int k = 0; k < count; k++) {
+
+			/* No self interaction */
+			if (j_base + k == gi) continue;
+
+			/* Compute the pairwise distance. */
+			double dx = sx[k] - pix;
+			double dy = sy[k] - piy;
+			double dz = sz[k] - piz;
+
+			/* Now apply periodic BC */
+			if (periodic) {
+				dx = exact_force_nearest(dx, dim_0);
+				dy = exact_force_nearest(dy, dim_1);
+				dz = exact_force_nearest(dz, dim_2);
+			}
+
+			const double r2 = dx * dx + dy * dy + dz * dz;
+			const double r_inv = 1. / sqrt(r2);
+			const double r = r2 * r_inv;
+			const double mj = sm[k];
+			double f, phi;
+
+			if (r >= hi) {
+
+				/* Get Newtonian gravity */
+				f = mj * r_inv * r_inv * r_inv;
+				phi = -mj * r_inv;
+
+			} else {
+
+				double Wf, Wp;
+				exact_force_softening(r * hi_inv, &Wf, &Wp);
+
+				/* Get softened gravity */
+				f = mj * hi_inv3 * Wf;
+				phi = mj * hi_inv * Wp;
+			}
+
+			a_grav[0] += f * dx;
+			a_grav[1] += f * dy;
+			a_grav[2] += f * dz;
+			pot += phi;
+
+			/* Apply Ewald correction and split between short and long range
+			 * as in gravity_exact_force_compute_mapper() */
+			if (periodic && r > 1e-5 * hi) {
+
+				const double corr_f_lr = exact_force_long_range(r * r_s_inv);
+
+				a_grav_short[0] += f * dx * corr_f_lr;
+				a_grav_short[1] += f * dy * corr_f_lr;
+				a_grav_short[2] += f * dz * corr_f_lr;
+
+				a_grav_long[0] += f * dx * (1. - corr_f_lr);
+				a_grav_long[1] += f * dy * (1. - corr_f_lr);
+				a_grav_long[2] += f * dz * (1. - corr_f_lr);
+
+				double corr_f[3], corr_pot;
+				exact_force_ewald_evaluate(dx, dy, dz, ewald, n_ewald, ewald_fac, corr_f, &corr_pot);
+
+				a_grav[0] += mj * corr_f[0];
+				a_grav[1] += mj * corr_f[1];
+				a_grav[2] += mj * corr_f[2];
+				pot += mj * corr_pot;
+
+				a_grav_long[0] += mj * corr_f[0];
+				a_grav_long[1] += mj * corr_f[1];
+				a_grav_long[2] += mj * corr_f[2];
+			}
+		}
+	}
+
+	if (!have_i) return;
+
+	for (int k = 0; k < 3; k++) {
+		a_grav_out[3 * t + k] = a_grav[k];
+		a_grav_short_out[3 * t + k] = a_grav_short[k];
+		a_grav_long_out[3 * t + k] = a_grav_long[k];
+	}
+	pot_out[t] = pot;
+}
+
+//allocates a device array for the exact force checks
+static void *exact_force_alloc(const size_t size) {
+
+	void *ptr = NULL;
+	const cudaError_t err = cudaMalloc(&ptr, size);
+	if (err != cudaSuccess)
+		error("Couldn't allocate device exact force arrays (%zd bytes): %s", size, cudaGetErrorString(err));
+	return ptr;
+}
+
+//computes the exact accelerations of the tested gparts on the current
+//device; everything is sent, computed and brought back in one go and the
+//results are only valid if no fault is returned
+extern "C" enum cuda_fault exact_force_offload(struct cuda_exact_force *f) {
+
+	if (f->nr_tested == 0) return cuda_fault_none;
+
+	const size_t sizeD = f->nr_gparts * sizeof(double);
+	const size_t sizeV = f->nr_tested * sizeof(double);
+	const size_t sizeT = (size_t)(f->n_ewald + 1) * (f->n_ewald + 1) * (f->n_ewald + 1);
+
+	double *d_x = (double *)exact_force_alloc(sizeD);
+	double *d_y = (double *)exact_force_alloc(sizeD);
+	double *d_z = (double *)exact_force_alloc(sizeD);
+	double *d_m = (double *)exact_force_alloc(sizeD);
+	size_t *d_index = (size_t *)exact_force_alloc(f->nr_tested * sizeof(size_t));
+	double *d_h = (double *)exact_force_alloc(sizeV);
+	double *d_a_grav = (double *)exact_force_alloc(3 * sizeV);
+	double *d_a_grav_short = (double *)exact_force_alloc(3 * sizeV);
+	double *d_a_grav_long = (double *)exact_force_alloc(3 * sizeV);
+	double *d_pot = (double *)exact_force_alloc(sizeV);
+	float *d_ewald = NULL;
+
+	cudaMemcpy(d_x, f->x, sizeD, cudaMemcpyHostToDevice);
+	cudaMemcpy(d_y, f->y, sizeD, cudaMemcpyHostToDevice);
+	cudaMemcpy(d_z, f->z, sizeD, cudaMemcpyHostToDevice);
+	cudaMemcpy(d_m, f->m, sizeD, cudaMemcpyHostToDevice);
+	cudaMemcpy(d_index, f->index, f->nr_tested * sizeof(size_t), cudaMemcpyHostToDevice);
+	cudaMemcpy(d_h, f->h, sizeV, cudaMemcpyHostToDevice);
+
+	//the tables are far larger than the constant memory, they are read
+	//through the read-only cache instead
+	if (f->periodic) {
+		d_ewald = (float *)exact_force_alloc(4 * sizeT * sizeof(float));
+		cudaMemcpy(d_ewald, f->fewald_x, sizeT * sizeof(float), cudaMemcpyHostToDevice);
+		cudaMemcpy(d_ewald + sizeT, f->fewald_y, sizeT * sizeof(float), cudaMemcpyHostToDevice);
+		cudaMemcpy(d_ewald + 2 * sizeT, f->fewald_z, sizeT * sizeof(float), cudaMemcpyHostToDevice);
+		cudaMemcpy(d_ewald + 3 * sizeT, f->potewald, sizeT * sizeof(float), cudaMemcpyHostToDevice);
+	}
+
+	const int blocks = (f->nr_tested + EXACT_FORCE_THREADS - 1) / EXACT_FORCE_THREADS;
+	exact_force<<<blocks, EXACT_FORCE_THREADS>>>(f->nr_tested, d_index, d_h, f->nr_gparts, d_x, d_y, d_z, d_m, d_ewald, f->n_ewald, f->ewald_fac, f->periodic, f->dim[0], f->dim[1], f->dim[2], f->r_s_inv, d_a_grav, d_a_grav_short, d_a_grav_long, d_pot);
+
+	cudaMemcpy(f->a_grav, d_a_grav, 3 * sizeV, cudaMemcpyDeviceToHost);
+	cudaMemcpy(f->a_grav_short, d_a_grav_short, 3 * sizeV, cudaMemcpyDeviceToHost);
+	cudaMemcpy(f->a_grav_long, d_a_grav_long, 3 * sizeV, cudaMemcpyDeviceToHost);
+	cudaMemcpy(f->pot, d_pot, sizeV, cudaMemcpyDeviceToHost);
+
+	//check the copies, the launch and the kernel at once
+	const enum cuda_fault fault = cuda_sync_check(cudaDeviceSynchronize(), "exact forces");
+
+	cudaFree(d_x);
+	cudaFree(d_y);
+	cudaFree(d_z);
+	cudaFree(d_m);
+	cudaFree(d_index);
+	cudaFree(d_h);
+	cudaFree(d_a_grav);
+	cudaFree(d_a_grav_short);
+	cudaFree(d_a_grav_long);
+	cudaFree(d_pot);
+	if (d_ewald != NULL) cudaFree(d_ewald);
+
+	return fault;
 }
@@ -0,0 +1,577 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "benchmark.h"
+
+/* System includes. */
+#include <float.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+/* MPI headers. */
+#ifdef WITH_MPI
+#include <mpi.h>
+#endif
+
+/* Local headers. */
+#include "adiabatic_index.h"
+#include "atomic.h"
+#include "clocks.h"
+#include "cosmology.h"
+#include "engine.h"
+#include "error.h"
+#include "hydro.h"
+#include "hydro_properties.h"
+#include "memuse.h"
+#include "parser.h"
+#include "part.h"
+#include "random.h"
+#include "threadpool.h"
+
+/*! Names of the benchmarks, as given to --benchmark */
+const char *benchmark_names[benchmark_count] = {"none", "cosmo-dmo",
+                                                "hydro-box"};
+
+/*! Names of the columns of the reports */
+const char *benchmark_timer_names[benchmark_timer_count] = {
+    "wall", "rebuild", "mesh", "gravity", "hydro", "comm", "other"};
+
+/*! Number of plane waves making up the perturbations of the ICs */
+#define benchmark_nr_modes 64
+
+/*! Size of the boxes at --scale=1 (internal units) */
+#define benchmark_dmo_box_size 100.
+#define benchmark_hydro_box_size 1.
+
+/*! Start of the cosmological benchmark (z = 31) */
+#define benchmark_dmo_a_begin 0.03125
+
+/*! RMS displacement of the cosmological ICs, in mean inter-particle
+ *  separations */
+#define benchmark_dmo_rms_displacement 0.2
+
+/*! Jitter of the lattice of the hydro ICs, in inter-particle separations */
+#define benchmark_hydro_jitter 0.05
+
+/*! RMS velocity of the hydro ICs, in units of the sound speed */
+#define benchmark_hydro_rms_velocity 0.1
+
+/**
+ * @brief A plane wave of the perturbations of the ICs.
+ */
+struct benchmark_mode {
+
+  /*! Wave vector. */
+  double k[3];
+
+  /*! Direction and amplitude of the perturbation. */
+  double amp[3];
+
+  /*! Phase. */
+  double phase;
+};
+
+/**
+ * @brief Get the #benchmark_type of a benchmark.
+ *
+ * @param name The name given on the command line.
+ */
+enum benchmark_type benchmark_get_type(const char *name) {
+
+  for (int k = benchmark_none + 1; k < benchmark_count; k++)
+    if (strcmp(name, benchmark_names[k]) == 0) return (enum benchmark_type)k;
+
+  char list[200] = "";
+  for (int k = benchmark_none + 1; k < benchmark_count; k++) {
+    strcat(list, " ");
+    strcat(list, benchmark_names[k]);
+  }
+  error("Unknown benchmark '%s', the choices are:%s.", name, list);
+  return benchmark_none;
+}
+
+/**
+ * @brief Prepare a benchmark run.
+ *
+ * @param b The #benchmark.
+ * @param type The benchmark to run.
+ * @param scale The scale of its ICs.
+ */
+void benchmark_init(struct benchmark *b, const enum benchmark_type type,
+                    const int scale) {
+
+  if (scale < 1) error("Invalid benchmark scale (%d), must be > 0.", scale);
+
+  bzero(b, sizeof(struct benchmark));
+  b->type = type;
+  b->scale = scale;
+  b->side = scale * benchmark_base_side;
+  b->nr_parts = (long long)b->side * b->side * b->side;
+  b->min_wall = DBL_MAX;
+}
+
+/**
+ * @brief Set one parameter, given in the "section:parameter:value" format.
+ */
+__attribute__((format(printf, 2, 3))) static void benchmark_set(
+    struct swift_params *params, const char *format, ...) {
+
+  char buff[PARSER_MAX_LINE_SIZE];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(buff, sizeof(buff), format, args);
+  va_end(args);
+  parser_set_param(params, buff);
+}
+
+/**
+ * @brief Fill an empty parameter structure with the parameters of a
+ * benchmark.
+ *
+ * No snapshot, statistics or restart files are written before the end of the
+ * run.
+ *
+ * @param b The #benchmark.
+ * @param params The #swift_params.
+ */
+void benchmark_set_params(const struct benchmark *b,
+                          struct swift_params *params) {
+
+  benchmark_set(params, "InitialConditions:file_name:none");
+  benchmark_set(params, "InitialConditions:periodic:1");
+  benchmark_set(params, "Restarts:enable:0");
+  benchmark_set(params, "Snapshots:basename:benchmark");
+  benchmark_set(params, "Scheduler:max_top_level_cells:%d", 16 * b->scale);
+  benchmark_set(params, "InternalUnitSystem:UnitCurrent_in_cgs:1");
+  benchmark_set(params, "InternalUnitSystem:UnitTemp_in_cgs:1");
+
+  switch (b->type) {
+
+    case benchmark_cosmo_dmo: {
+
+      /* Softening of 1/25th of the mean inter-particle separation */
+      const double soft = benchmark_dmo_box_size / benchmark_base_side / 25.;
+
+      benchmark_set(params, "InternalUnitSystem:UnitMass_in_cgs:1.98841e43");
+      benchmark_set(params,
+                    "InternalUnitSystem:UnitLength_in_cgs:3.08567758e24");
+      benchmark_set(params, "InternalUnitSystem:UnitVelocity_in_cgs:1e5");
+      benchmark_set(params, "Cosmology:Omega_cdm:0.2587");
+      benchmark_set(params, "Cosmology:Omega_lambda:0.693");
+      benchmark_set(params, "Cosmology:Omega_b:0.0482");
+      benchmark_set(params, "Cosmology:h:0.6777");
+      benchmark_set(params, "Cosmology:a_begin:%g", benchmark_dmo_a_begin);
+      benchmark_set(params, "Cosmology:a_end:1");
+      benchmark_set(params, "TimeIntegration:dt_min:1e-6");
+      benchmark_set(params, "TimeIntegration:dt_max:1e-2");
+      benchmark_set(params, "Gravity:eta:0.025");
+      benchmark_set(params, "Gravity:MAC:adaptive");
+      benchmark_set(params, "Gravity:theta_cr:0.7");
+      benchmark_set(params, "Gravity:epsilon_fmm:0.001");
+      benchmark_set(params, "Gravity:comoving_DM_softening:%g", soft);
+      benchmark_set(params, "Gravity:max_physical_DM_softening:%g", soft);
+      benchmark_set(params, "Gravity:mesh_side_length:%d", b->side);
+      benchmark_set(params, "Snapshots:scale_factor_first:1");
+      benchmark_set(params, "Snapshots:delta_time:2");
+      benchmark_set(params, "Statistics:scale_factor_first:1");
+      benchmark_set(params, "Statistics:delta_time:2");
+    } break;
+
+    case benchmark_hydro_box:
+      benchmark_set(params, "InternalUnitSystem:UnitMass_in_cgs:1");
+      benchmark_set(params, "InternalUnitSystem:UnitLength_in_cgs:1");
+      benchmark_set(params, "InternalUnitSystem:UnitVelocity_in_cgs:1");
+      benchmark_set(params, "TimeIntegration:time_begin:0");
+      benchmark_set(params, "TimeIntegration:time_end:1");
+      benchmark_set(params, "TimeIntegration:dt_min:1e-7");
+      benchmark_set(params, "TimeIntegration:dt_max:1e-2");
+      benchmark_set(params, "SPH:resolution_eta:1.2348");
+      benchmark_set(params, "SPH:CFL_condition:0.1");
+      benchmark_set(params, "Snapshots:time_first:1");
+      benchmark_set(params, "Snapshots:delta_time:1");
+      benchmark_set(params, "Statistics:time_first:1");
+      benchmark_set(params, "Statistics:delta_time:1");
+      break;
+
+    default:
+      error("Invalid benchmark type (%d).", b->type);
+  }
+}
+
+/**
+ * @brief Draw the plane waves of the perturbations of the ICs.
+ *
+ * The waves only depend on the benchmark, such that all the ranks, whatever
+ * their number, agree on them.
+ *
+ * @param modes The #benchmark_mode%s to fill.
+ * @param box_size The size of the box.
+ * @param n_max The largest wave number along each axis.
+ * @param longitudinal Are the perturbations along the wave vectors?
+ * @param rms The RMS of the sum of the waves.
+ */
+static void benchmark_draw_modes(struct benchmark_mode *modes,
+                                 const double box_size, const int n_max,
+                                 const int longitudinal, const double rms) {
+
+  long long draw = 0;
+  double sum2 = 0.;
+  for (int m = 0; m < benchmark_nr_modes; m++) {
+
+    /* A wave vector fitting in the periodic box */
+    int n[3] = {0, 0, 0};
+    while (n[0] == 0 && n[1] == 0 && n[2] == 0) {
+      for (int i = 0; i < 3; i++)
+        n[i] = (int)(random_unit_interval(m, draw++,
+                                          random_number_benchmark_ics) *
+                     (2 * n_max + 1)) -
+               n_max;
+    }
+    const double n2 = n[0] * n[0] + n[1] * n[1] + n[2] * n[2];
+    for (int i = 0; i < 3; i++) modes[m].k[i] = 2. * M_PI * n[i] / box_size;
+
+    /* Along the wave vector for a potential flow, any direction otherwise */
+    double dir[3];
+    if (longitudinal) {
+      for (int i = 0; i < 3; i++) dir[i] = n[i] / sqrt(n2);
+    } else {
+      const double cos_theta =
+          2. * random_unit_interval(m, draw++, random_number_benchmark_ics) -
+          1.;
+      const double phi =
+          2. * M_PI *
+          random_unit_interval(m, draw++, random_number_benchmark_ics);
+      const double sin_theta = sqrt(1. - cos_theta * cos_theta);
+      dir[0] = sin_theta * cos(phi);
+      dir[1] = sin_theta * sin(phi);
+      dir[2] = cos_theta;
+    }
+
+    /* Red spectrum: most of the power on the large scales */
+    const double amp = 1. / n2;
+    for (int i = 0; i < 3; i++) modes[m].amp[i] = amp * dir[i];
+    const double u_phase =
+        random_unit_interval(m, draw++, random_number_benchmark_ics);
+    modes[m].phase = 2. * M_PI * u_phase;
+    sum2 += 0.5 * amp * amp;
+  }
+
+  /* Normalise the sum of the waves */
+  const double norm = rms / sqrt(sum2);
+  for (int m = 0; m < benchmark_nr_modes; m++)
+    for (int i = 0; i < 3; i++) modes[m].amp[i] *= norm;
+}
+
+/**
+ * @brief The sum of the plane waves at a position.
+ *
+ * @param modes The #benchmark_mode%s.
+ * @param x The position.
+ * @param ret (return) The perturbation.
+ */
+static void benchmark_eval_modes(const struct benchmark_mode *modes,
+                                 const double x[3], double ret[3]) {
+
+  ret[0] = ret[1] = ret[2] = 0.;
+  for (int m = 0; m < benchmark_nr_modes; m++) {
+    const double s = sin(modes[m].k[0] * x[0] + modes[m].k[1] * x[1] +
+                         modes[m].k[2] * x[2] + modes[m].phase);
+    for (int i = 0; i < 3; i++) ret[i] += modes[m].amp[i] * s;
+  }
+}
+
+/**
+ * @brief Box-wrap a coordinate.
+ */
+static double benchmark_wrap(const double x, const double box_size) {
+  if (x < 0.) return x + box_size;
+  if (x >= box_size) return x - box_size;
+  return x;
+}
+
+/**
+ * @brief Generate the ICs of a benchmark.
+ *
+ * The particles start on a lattice of b->side particles a side. In the
+ * cosmological benchmark they are then moved with the Zel'dovich approximation
+ * by a displacement field made of a few plane waves. In the hydro one the
+ * lattice is jittered (in place of a glass) and the gas is given random
+ * subsonic velocities. Each rank makes a slab of lattice planes, the engine
+ * then distributes them.
+ *
+ * @param b The #benchmark.
+ * @param cosmo The #cosmology.
+ * @param hydro_props The #hydro_props.
+ * @param dim (return) The size of the box.
+ * @param parts (return) The gas particles.
+ * @param gparts (return) The gravity particles.
+ * @param Ngas (return) The number of gas particles on this rank.
+ * @param Ngpart (return) The number of gravity particles on this rank.
+ * @param nodeID The rank of this node.
+ * @param nr_nodes The number of nodes.
+ */
+void benchmark_generate_ics(const struct benchmark *b,
+                            const struct cosmology *cosmo,
+                            const struct hydro_props *hydro_props,
+                            double dim[3], struct part **parts,
+                            struct gpart **gparts, size_t *Ngas,
+                            size_t *Ngpart, const int nodeID,
+                            const int nr_nodes) {
+
+  const int side = b->side;
+  const int plane_first = (int)((long long)side * nodeID / nr_nodes);
+  const int plane_last = (int)((long long)side * (nodeID + 1) / nr_nodes);
+  const size_t count = (size_t)(plane_last - plane_first) * side * side;
+
+  struct benchmark_mode modes[benchmark_nr_modes];
+  *parts = NULL;
+  *gparts = NULL;
+  *Ngas = 0;
+  *Ngpart = 0;
+
+  switch (b->type) {
+
+    case benchmark_cosmo_dmo: {
+
+      const double box_size = benchmark_dmo_box_size * b->scale;
+      const double delta_x = box_size / side;
+      const double mass = (cosmo->Omega_cdm + cosmo->Omega_b) *
+                          cosmo->critical_density_0 * delta_x * delta_x *
+                          delta_x;
+
+      /* The growth rate, in the internal velocities a^2 dx/dt */
+      const double E2 = cosmo->H * cosmo->H / (cosmo->H0 * cosmo->H0);
+      const double Omega_m_a = (cosmo->Omega_cdm + cosmo->Omega_b) *
+                               cosmo->a3_inv / E2;
+      const double vel_fac =
+          cosmo->a * cosmo->a * cosmo->H * pow(Omega_m_a, 0.55);
+
+      benchmark_draw_modes(modes, box_size, side / 8 > 1 ? side / 8 : 1,
+                           /*longitudinal=*/1,
+                           benchmark_dmo_rms_displacement * delta_x);
+
+      if (swift_memalign("gparts", (void **)gparts, gpart_align,
+                         count * sizeof(struct gpart)) != 0)
+        error("Error while allocating memory for gravity particles");
+      bzero(*gparts, count * sizeof(struct gpart));
+
+      size_t k = 0;
+      for (int i = plane_first; i < plane_last; i++) {
+        for (int j = 0; j < side; j++) {
+          for (int l = 0; l < side; l++, k++) {
+            struct gpart *gp = &(*gparts)[k];
+            const double q[3] = {(i + 0.5) * delta_x, (j + 0.5) * delta_x,
+                                 (l + 0.5) * delta_x};
+            double psi[3];
+            benchmark_eval_modes(modes, q, psi);
+
+            for (int d = 0; d < 3; d++) {
+              gp->x[d] = benchmark_wrap(q[d] + psi[d], box_size);
+              gp->v_full[d] = vel_fac * psi[d];
+            }
+            gp->mass = mass;
+            gp->id_or_neg_offset = 1 + ((long long)i * side + j) * side + l;
+            gp->type = swift_type_dark_matter;
+          }
+        }
+      }
+
+      dim[0] = dim[1] = dim[2] = box_size;
+      *Ngpart = count;
+    } break;
+
+    case benchmark_hydro_box: {
+
+#ifndef HYDRO_DIMENSION_3D
+      error("The hydro benchmark needs a 3D hydro scheme.");
+#endif
+
+      const double box_size = benchmark_hydro_box_size * b->scale;
+      const double delta_x = box_size / side;
+      const double rho = 1., pressure = 1.;
+      const double mass = rho * delta_x * delta_x * delta_x;
+      const double u = pressure / rho * hydro_one_over_gamma_minus_one;
+      const double cs = sqrt(hydro_gamma * pressure / rho);
+
+      benchmark_draw_modes(modes, box_size, side / 8 > 1 ? side / 8 : 1,
+                           /*longitudinal=*/0,
+                           benchmark_hydro_rms_velocity * cs);
+
+      if (swift_memalign("parts", (void **)parts, part_align,
+                         count * sizeof(struct part)) != 0)
+        error("Error while allocating memory for SPH particles");
+      bzero(*parts, count * sizeof(struct part));
+
+      size_t k = 0;
+      for (int i = plane_first; i < plane_last; i++) {
+        for (int j = 0; j < side; j++) {
+          for (int l = 0; l < side; l++, k++) {
+            struct part *p = &(*parts)[k];
+            const long long id = 1 + ((long long)i * side + j) * side + l;
+            const int q[3] = {i, j, l};
+
+            for (int d = 0; d < 3; d++) {
+              const double jitter =
+                  random_unit_interval(id, d, random_number_benchmark_ics) -
+                  0.5;
+              p->x[d] = benchmark_wrap(
+                  (q[d] + 0.5 + 2. * benchmark_hydro_jitter * jitter) *
+                      delta_x,
+                  box_size);
+            }
+            double v[3];
+            benchmark_eval_modes(modes, p->x, v);
+            for (int d = 0; d < 3; d++) p->v[d] = v[d];
+
+            hydro_set_mass(p, mass);
+            p->h = hydro_props->eta_neighbours * delta_x;
+            p->id = id;
+            hydro_set_init_internal_energy(p, u);
+          }
+        }
+      }
+
+      dim[0] = dim[1] = dim[2] = box_size;
+      *Ngas = count;
+    } break;
+
+    default:
+      error("Invalid benchmark type (%d).", b->type);
+  }
+}
+
+/**
+ * @brief Prints the description of the run and the header of the steps.
+ *
+ * @param b The #benchmark.
+ * @param e The #engine.
+ */
+void benchmark_print_header(const struct benchmark *b, const struct engine *e) {
+
+  if (e->nodeID != 0) return;
+
+  printf("[benchmark] name=%s scale=%d particles=%lld ranks=%d threads=%d\n",
+         benchmark_names[b->type], b->scale, b->nr_parts, e->nr_nodes,
+         e->nr_threads);
+  printf("[benchmark] times in %s, task times per thread, max over ranks\n",
+         clocks_getunit());
+  printf("[benchmark] %6s", "step");
+  for (int k = 0; k < benchmark_timer_count; k++)
+    printf(" %10s", benchmark_timer_names[k]);
+  printf(" %12s\n", "updates");
+  fflush(stdout);
+}
+
+/*! Data of the collection mapper */
+struct benchmark_collect_data {
+  ticks tic_step;
+  long long ticks[benchmark_timer_count];
+};
+
+/**
+ * @brief Adds the run times of a chunk of tasks to their categories.
+ */
+static void benchmark_collect_mapper(void *map_data, int num_elements,
+                                     void *extra_data) {
+
+  const struct task *tasks = (const struct task *)map_data;
+  struct benchmark_collect_data *data =
+      (struct benchmark_collect_data *)extra_data;
+
+  long long local[benchmark_timer_count] = {0};
+  for (int i = 0; i < num_elements; i++) {
+    const struct task *t = &tasks[i];
+
+    /* Only the tasks that ran during this step */
+    if (t->implicit || t->tic <= data->tic_step || t->toc < t->tic) continue;
+
+    int timer;
+    switch (task_get_category(t)) {
+      case task_category_gravity:
+        timer = benchmark_timer_gravity;
+        break;
+      case task_category_hydro:
+        timer = benchmark_timer_hydro;
+        break;
+      case task_category_mpi:
+      case task_category_pack:
+        timer = benchmark_timer_comm;
+        break;
+      default:
+        timer = benchmark_timer_other;
+    }
+    local[timer] += t->toc - t->tic;
+  }
+
+  for (int k = 0; k < benchmark_timer_count; k++)
+    if (local[k] != 0) atomic_add(&data->ticks[k], local[k]);
+}
+
+/**
+ * @brief Collects and prints the times of the step that just ended.
+ *
+ * @param b The #benchmark.
+ * @param e The #engine.
+ */
+void benchmark_step(struct benchmark *b, struct engine *e) {
+
+  struct benchmark_collect_data data;
+  bzero(&data, sizeof(struct benchmark_collect_data));
+  data.tic_step = e->tic_step;
+  threadpool_map(&e->threadpool, benchmark_collect_mapper, e->sched.tasks,
+                 e->sched.nr_tasks, sizeof(struct task),
+                 threadpool_auto_chunk_size, &data);
+
+  double times[benchmark_timer_count];
+  times[benchmark_timer_wall] = e->wallclock_time;
+  times[benchmark_timer_rebuild] = clocks_from_ticks(e->step_rebuild_ticks);
+  times[benchmark_timer_mesh] = clocks_from_ticks(e->step_mesh_ticks);
+  for (int k = benchmark_timer_gravity; k < benchmark_timer_count; k++)
+    times[k] = clocks_from_ticks(data.ticks[k]) / e->nr_threads;
+
+#ifdef WITH_MPI
+  MPI_Allreduce(MPI_IN_PLACE, times, benchmark_timer_count, MPI_DOUBLE,
+                MPI_MAX, MPI_COMM_WORLD);
+#endif
+
+  const long long updates =
+      b->type == benchmark_hydro_box ? e->updates : e->g_updates;
+
+  b->nr_steps++;
+  for (int k = 0; k < benchmark_timer_count; k++) b->sums[k] += times[k];
+  b->min_wall = fmin(b->min_wall, times[benchmark_timer_wall]);
+  b->updates += updates;
+
+  if (e->nodeID != 0) return;
+  printf("[benchmark] %6d", e->step);
+  for (int k = 0; k < benchmark_timer_count; k++) printf(" %10.3f", times[k]);
+  printf(" %12lld\n", updates);
+  fflush(stdout);
+}
+
+/**
+ * @brief Prints the mean times of all the steps of the run.
+ *
+ * @param b The #benchmark.
+ * @param e The #engine.
+ */
+void benchmark_print_summary(const struct benchmark *b,
+                             const struct engine *e) {
+
+  if (e->nodeID != 0 || b->nr_steps == 0) return;
+
+  printf("[benchmark] %6s", "mean");
+  for (int k = 0; k < benchmark_timer_count; k++)
+    printf(" %10.3f", b->sums[k] / b->nr_steps);
+  printf(" %12lld\n", b->updates / b->nr_steps);
+
+  const double seconds = b->sums[benchmark_timer_wall] /
+                        clocks_from_ticks(clocks_get_cpufreq());
+  printf("[benchmark] steps=%d total=%.3f min=%.3f updates_per_second=%.4e\n",
+         b->nr_steps, b->sums[benchmark_timer_wall], b->min_wall,
+         seconds > 0. ? b->updates / seconds : 0.);
+  fflush(stdout);
+}
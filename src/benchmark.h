@@ -0,0 +1,96 @@
+#ifndef SWIFT_BENCHMARK_H
+#define SWIFT_BENCHMARK_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* System includes. */
+#include <stddef.h>
+
+/* Forward declarations */
+struct cosmology;
+struct engine;
+struct gpart;
+struct hydro_props;
+struct part;
+struct swift_params;
+
+/*! Number of particles on a side of the ICs at --scale=1 */
+#define benchmark_base_side 64
+
+/*! Number of steps run when none are asked for with --steps */
+#define benchmark_default_steps 32
+
+/**
+ * @brief The built-in benchmarks.
+ */
+enum benchmark_type {
+  benchmark_none = 0,
+  benchmark_cosmo_dmo,
+  benchmark_hydro_box,
+  benchmark_count
+};
+
+/**
+ * @brief The parts of a step the benchmarks report.
+ */
+enum benchmark_timer {
+  benchmark_timer_wall = 0,
+  benchmark_timer_rebuild,
+  benchmark_timer_mesh,
+  benchmark_timer_gravity,
+  benchmark_timer_hydro,
+  benchmark_timer_comm,
+  benchmark_timer_other,
+  benchmark_timer_count
+};
+
+/**
+ * @brief The state of a benchmark run.
+ */
+struct benchmark {
+
+  /*! Which benchmark is this? */
+  enum benchmark_type type;
+
+  /*! Its scale, the ICs have scale * #benchmark_base_side particles a side. */
+  int scale;
+
+  /*! Number of particles a side and in total. */
+  int side;
+  long long nr_parts;
+
+  /*! Number of steps done so far. */
+  int nr_steps;
+
+  /*! Sums of the times of all the steps (ms). */
+  double sums[benchmark_timer_count];
+
+  /*! Shortest step (ms). */
+  double min_wall;
+
+  /*! Sum of the particle updates of all the steps. */
+  long long updates;
+};
+
+extern const char *benchmark_names[benchmark_count];
+extern const char *benchmark_timer_names[benchmark_timer_count];
+
+enum benchmark_type benchmark_get_type(const char *name);
+void benchmark_init(struct benchmark *b, const enum benchmark_type type,
+                    const int scale);
+void benchmark_set_params(const struct benchmark *b,
+                          struct swift_params *params);
+void benchmark_generate_ics(const struct benchmark *b,
+                            const struct cosmology *cosmo,
+                            const struct hydro_props *hydro_props,
+                            double dim[3], struct part **parts,
+                            struct gpart **gparts, size_t *Ngas,
+                            size_t *Ngpart, const int nodeID,
+                            const int nr_nodes);
+void benchmark_print_header(const struct benchmark *b, const struct engine *e);
+void benchmark_step(struct benchmark *b, struct engine *e);
+void benchmark_print_summary(const struct benchmark *b,
+                             const struct engine *e);
+
+#endif /* SWIFT_BENCHMARK_H */
@@ -27,6 +27,7 @@
 #include "cell.h"
 #include "error.h"
 #include "part.h"
+#include "part_soa.h"
 #include "sort_part.h"
 #include "vector.h"
 
@@ -82,6 +83,9 @@ struct cache {
 
   /* Cache size. */
   int count;
+
+  /* Largest number of particles asked for since the last trim. */
+  int count_used;
 };
 
 /* Secondary cache struct to hold a list of interactions between two
@@ -173,6 +177,21 @@ __attribute__((always_inline)) INLINE void cache_init(struct cache *c,
   c->count = count;
 }
 
+/**
+ * @brief Make sure a cache can hold a given number of particles.
+ *
+ * The cache is allocated on first use and only grows afterwards.
+ *
+ * @param c The cache.
+ * @param count Number of particles we need room for.
+ */
+__attribute__((always_inline)) INLINE void cache_ensure(struct cache *c,
+                                                        int count) {
+
+  if (c->count_used < count) c->count_used = count;
+  if (c->count < count) cache_init(c, count);
+}
+
 /**
  * @brief Populate cache by reading in the particles in unsorted order.
  *
@@ -184,7 +203,7 @@ __attribute__((always_inline)) INLINE int cache_read_particles(
     const struct cell *restrict const ci,
     struct cache *restrict const ci_cache) {
 
-#if defined(GADGET2_SPH)
+#if defined(GADGET2_SPH) || defined(SPHENIX_SPH)
 
   /* Let the compiler know that the data is aligned and create pointers to the
    * arrays inside the cache. */
@@ -253,6 +272,125 @@ __attribute__((always_inline)) INLINE int cache_read_particles(
 #endif
 }
 
+#ifdef SWIFT_DEBUG_CHECKS
+/**
+ * @brief Check that the #part_soa copy of a #part is up to date.
+ *
+ * @param p The #part.
+ * @param soa The #part_soa.
+ * @param i The index of the #part in the #part_soa.
+ */
+__attribute__((always_inline)) INLINE void cache_check_part_soa(
+    const struct part *restrict p, const struct part_soa *restrict soa,
+    const size_t i) {
+
+  if (i >= soa->size) error("Reading past the part SoA copy.");
+  if (soa->time_bin[i] != p->time_bin)
+    error("Stale time-bin in the part SoA copy.");
+#if defined(GADGET2_SPH) || defined(SPHENIX_SPH)
+  if (p->time_bin >= time_bin_inhibited) return;
+  if (soa->x[i] != p->x[0] || soa->y[i] != p->x[1] || soa->z[i] != p->x[2] ||
+      soa->h[i] != p->h || soa->m[i] != p->mass || soa->vx[i] != p->v[0] ||
+      soa->vy[i] != p->v[1] || soa->vz[i] != p->v[2])
+    error("Stale part SoA copy for particle %lld.", p->id);
+#endif
+}
+#endif
+
+/**
+ * @brief Populate cache by reading in the particles in unsorted order from
+ * the #part_soa.
+ *
+ * Same as cache_read_particles() but streaming through the SoA copy rather
+ * than gathering from the #part.
+ *
+ * @param ci The #cell.
+ * @param ci_cache The cache.
+ * @param soa The #part_soa to read from.
+ * @param offset The index of the first #part of the cell in the #part_soa.
+ * @return uninhibited_count The no. of uninhibited particles.
+ */
+__attribute__((always_inline)) INLINE int cache_read_particles_soa(
+    const struct cell *restrict const ci, struct cache *restrict const ci_cache,
+    const struct part_soa *restrict soa, const size_t offset) {
+
+  /* Let the compiler know that the data is aligned and create pointers to the
+   * arrays inside the cache. */
+  swift_declare_aligned_ptr(float, x, ci_cache->x, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, y, ci_cache->y, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, z, ci_cache->z, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, h, ci_cache->h, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, m, ci_cache->m, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, vx, ci_cache->vx, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, vy, ci_cache->vy, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, vz, ci_cache->vz, SWIFT_CACHE_ALIGNMENT);
+
+  const int count = ci->hydro.count;
+  const double loc[3] = {ci->loc[0], ci->loc[1], ci->loc[2]};
+  const double max_dx = ci->hydro.dx_max_part;
+  const float pos_padded[3] = {-(2. * ci->width[0] + max_dx),
+                               -(2. * ci->width[1] + max_dx),
+                               -(2. * ci->width[2] + max_dx)};
+  const float h_padded = ci->hydro.h_max / 4.;
+
+  /* The cell's section of the SoA copy */
+  const double *restrict soa_x = soa->x + offset;
+  const double *restrict soa_y = soa->y + offset;
+  const double *restrict soa_z = soa->z + offset;
+  const float *restrict soa_h = soa->h + offset;
+  const float *restrict soa_m = soa->m + offset;
+  const float *restrict soa_vx = soa->vx + offset;
+  const float *restrict soa_vy = soa->vy + offset;
+  const float *restrict soa_vz = soa->vz + offset;
+  const timebin_t *restrict soa_time_bin = soa->time_bin + offset;
+
+#ifdef SWIFT_DEBUG_CHECKS
+  for (int i = 0; i < count; i++)
+    cache_check_part_soa(&ci->hydro.parts[i], soa, offset + i);
+#endif
+
+  /* Shift the particles positions to a local frame so single precision can be
+   * used instead of double precision. */
+  for (int i = 0; i < count; i++) {
+
+    /* Pad inhibited particles. */
+    if (soa_time_bin[i] >= time_bin_inhibited) {
+      x[i] = pos_padded[0];
+      y[i] = pos_padded[1];
+      z[i] = pos_padded[2];
+      h[i] = h_padded;
+
+      continue;
+    }
+
+    x[i] = (float)(soa_x[i] - loc[0]);
+    y[i] = (float)(soa_y[i] - loc[1]);
+    z[i] = (float)(soa_z[i] - loc[2]);
+    h[i] = soa_h[i];
+    m[i] = soa_m[i];
+    vx[i] = soa_vx[i];
+    vy[i] = soa_vy[i];
+    vz[i] = soa_vz[i];
+  }
+
+  /* Pad cache if the no. of particles is not a multiple of double the vector
+   * length. */
+  int count_align = count;
+  const int rem = count % (NUM_VEC_PROC * VEC_SIZE);
+  if (rem != 0) {
+    count_align += (NUM_VEC_PROC * VEC_SIZE) - rem;
+
+    /* Set positions to something outside of the range of any particle */
+    for (int i = count; i < count_align; i++) {
+      x[i] = pos_padded[0];
+      y[i] = pos_padded[1];
+      z[i] = pos_padded[2];
+    }
+  }
+
+  return count_align;
+}
+
 /**
  * @brief Populate cache by reading in the particles in unsorted order for
  * doself_subset.
@@ -265,7 +403,7 @@ __attribute__((always_inline)) INLINE int cache_read_particles_subset_self(
     const struct cell *restrict const ci,
     struct cache *restrict const ci_cache) {
 
-#if defined(GADGET2_SPH)
+#if defined(GADGET2_SPH) || defined(SPHENIX_SPH)
 
   /* Let the compiler know that the data is aligned and create pointers to the
    * arrays inside the cache. */
@@ -348,7 +486,7 @@ __attribute__((always_inline)) INLINE void cache_read_particles_subset_pair(
     const struct sort_entry *restrict sort_i, int *first_pi, int *last_pi,
     const double *loc, const int flipped) {
 
-#if defined(GADGET2_SPH)
+#if defined(GADGET2_SPH) || defined(SPHENIX_SPH)
 
   /* Let the compiler know that the data is aligned and create pointers to the
    * arrays inside the cache. */
@@ -689,7 +827,7 @@ __attribute__((always_inline)) INLINE void cache_read_two_partial_cells_sorted(
     vx[i] = parts_i[idx].v[0];
     vy[i] = parts_i[idx].v[1];
     vz[i] = parts_i[idx].v[2];
-#ifdef GADGET2_SPH
+#if defined(GADGET2_SPH) || defined(SPHENIX_SPH)
     m[i] = parts_i[idx].mass;
 #endif
   }
@@ -791,7 +929,7 @@ __attribute__((always_inline)) INLINE void cache_read_two_partial_cells_sorted(
     vxj[i] = parts_j[idx].v[0];
     vyj[i] = parts_j[idx].v[1];
     vzj[i] = parts_j[idx].v[2];
-#ifdef GADGET2_SPH
+#if defined(GADGET2_SPH) || defined(SPHENIX_SPH)
     mj[i] = parts_j[idx].mass;
 #endif
   }
@@ -841,6 +979,157 @@ __attribute__((always_inline)) INLINE void cache_read_two_partial_cells_sorted(
   }
 }
 
+/**
+ * @brief Read the particles of one cell of a pair into a #cache in sorted
+ * order from the #part_soa.
+ *
+ * @param c The #cell.
+ * @param cache The #cache.
+ * @param sort The array of sorted particle indices for the cell.
+ * @param first The first sorted particle to read.
+ * @param count The number of sorted particles to read.
+ * @param total_shift The position of the frame of the cache.
+ * @param max_dx The largest particle movement of the two cells.
+ * @param soa The #part_soa to read from.
+ * @param offset The index of the first #part of the cell in the #part_soa.
+ */
+__attribute__((always_inline)) INLINE void cache_read_sorted_soa(
+    const struct cell *restrict const c, struct cache *restrict const cache,
+    const struct sort_entry *restrict sort, const int first, const int count,
+    const double total_shift[3], const double max_dx,
+    const struct part_soa *restrict soa, const size_t offset) {
+
+  swift_declare_aligned_ptr(float, x, cache->x, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, y, cache->y, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, z, cache->z, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, h, cache->h, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, m, cache->m, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, vx, cache->vx, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, vy, cache->vy, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, vz, cache->vz, SWIFT_CACHE_ALIGNMENT);
+
+  const float pos_padded[3] = {-(2. * c->width[0] + max_dx),
+                               -(2. * c->width[1] + max_dx),
+                               -(2. * c->width[2] + max_dx)};
+  const float h_padded = c->hydro.h_max / 4.;
+
+  /* The cell's section of the SoA copy */
+  const double *restrict soa_x = soa->x + offset;
+  const double *restrict soa_y = soa->y + offset;
+  const double *restrict soa_z = soa->z + offset;
+  const float *restrict soa_h = soa->h + offset;
+  const float *restrict soa_m = soa->m + offset;
+  const float *restrict soa_vx = soa->vx + offset;
+  const float *restrict soa_vy = soa->vy + offset;
+  const float *restrict soa_vz = soa->vz + offset;
+  const timebin_t *restrict soa_time_bin = soa->time_bin + offset;
+
+  for (int i = 0; i < count; i++) {
+    const int idx = sort[i + first].i;
+
+#ifdef SWIFT_DEBUG_CHECKS
+    cache_check_part_soa(&c->hydro.parts[idx], soa, offset + idx);
+#endif
+
+    /* Put inhibited particles out of range. */
+    if (soa_time_bin[idx] >= time_bin_inhibited) {
+      x[i] = pos_padded[0];
+      y[i] = pos_padded[1];
+      z[i] = pos_padded[2];
+      h[i] = h_padded;
+
+      m[i] = 1.f;
+      vx[i] = 1.f;
+      vy[i] = 1.f;
+      vz[i] = 1.f;
+
+      continue;
+    }
+
+    x[i] = (float)(soa_x[idx] - total_shift[0]);
+    y[i] = (float)(soa_y[idx] - total_shift[1]);
+    z[i] = (float)(soa_z[idx] - total_shift[2]);
+    h[i] = soa_h[idx];
+    m[i] = soa_m[idx];
+    vx[i] = soa_vx[idx];
+    vy[i] = soa_vy[idx];
+    vz[i] = soa_vz[idx];
+  }
+
+  /* Pad cache with fake particles that exist outside the cell so will not
+   * interact. */
+  for (int i = count; i < count + VEC_SIZE; i++) {
+    x[i] = pos_padded[0];
+    y[i] = pos_padded[1];
+    z[i] = pos_padded[2];
+    h[i] = h_padded;
+
+    m[i] = 1.f;
+    vx[i] = 1.f;
+    vy[i] = 1.f;
+    vz[i] = 1.f;
+  }
+}
+
+/**
+ * @brief Populate caches by only reading particles that are within range of
+ * each other within the adjoining cell, in sorted order, from the
+ * #part_soa.
+ *
+ * Same as cache_read_two_partial_cells_sorted() but reading from the compact
+ * SoA copy of the two cells rather than from the #part.
+ *
+ * @param ci The i #cell.
+ * @param cj The j #cell.
+ * @param ci_cache The #cache for cell ci.
+ * @param cj_cache The #cache for cell cj.
+ * @param sort_i The array of sorted particle indices for cell ci.
+ * @param sort_j The array of sorted particle indices for cell ci.
+ * @param shift The amount to shift the particle positions to account for BCs
+ * @param first_pi The first particle in cell ci that is in range.
+ * @param last_pj The last particle in cell cj that is in range.
+ * @param soa The #part_soa to read from.
+ * @param offset_i The index of the first #part of ci in the #part_soa.
+ * @param offset_j The index of the first #part of cj in the #part_soa.
+ */
+__attribute__((always_inline)) INLINE void
+cache_read_two_partial_cells_sorted_soa(
+    const struct cell *restrict const ci, const struct cell *restrict const cj,
+    struct cache *restrict const ci_cache,
+    struct cache *restrict const cj_cache,
+    const struct sort_entry *restrict sort_i,
+    const struct sort_entry *restrict sort_j,
+    const double *restrict const shift, int *first_pi, int *last_pj,
+    const struct part_soa *restrict soa, const size_t offset_i,
+    const size_t offset_j) {
+
+  /* Make the number of particles to be read a multiple of the vector size,
+   * as in cache_read_two_partial_cells_sorted(). */
+  int rem = (ci->hydro.count - *first_pi) % VEC_SIZE;
+  if (rem != 0) {
+    int pad = VEC_SIZE - rem;
+    if (*first_pi - pad >= 0) *first_pi -= pad;
+  }
+
+  rem = (*last_pj + 1) % VEC_SIZE;
+  if (rem != 0) {
+    int pad = VEC_SIZE - rem;
+    if (*last_pj + pad < cj->hydro.count) *last_pj += pad;
+  }
+
+  /* Shift particles to the local frame and account for boundary conditions.*/
+  const double total_ci_shift[3] = {
+      cj->loc[0] + shift[0], cj->loc[1] + shift[1], cj->loc[2] + shift[2]};
+  const double total_cj_shift[3] = {cj->loc[0], cj->loc[1], cj->loc[2]};
+  const double max_dx = max(ci->hydro.dx_max_part, cj->hydro.dx_max_part);
+
+  cache_read_sorted_soa(ci, ci_cache, sort_i, *first_pi,
+                        ci->hydro.count - *first_pi, total_ci_shift, max_dx,
+                        soa, offset_i);
+  cache_read_sorted_soa(cj, cj_cache, sort_j, 0, *last_pj + 1, total_cj_shift,
+                        max_dx, soa, offset_j);
+}
+
 /**
  * @brief Populate caches by only reading particles that are within range of
  * each other within the adjoining cell.Also read the particles into the cache
@@ -1094,6 +1383,22 @@ static INLINE void cache_clean(struct cache *c) {
   c->count = 0;
 }
 
+/**
+ * @brief Free a #cache object that is much larger than what it was used for
+ * since the last call.
+ *
+ * The cache is then re-allocated at the size actually needed the next time it
+ * is used.
+ *
+ * @param c The #cache to trim.
+ * @param factor The ratio of the allocated to the used size above which the
+ * cache is freed.
+ */
+static INLINE void cache_trim(struct cache *c, const int factor) {
+  if (c->count > factor * (c->count_used + VEC_SIZE)) cache_clean(c);
+  c->count_used = 0;
+}
+
 #endif /* WITH_VECTORIZATION */
 
 #endif /* SWIFT_CACHE_H */
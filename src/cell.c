@@ -227,6 +227,47 @@ int cell_link_gparts(struct cell *c, struct gpart *gparts) {
   return c->grav.count;
 }
 
+#ifdef WITH_MPI
+/**
+ * @brief Link the cells recursively to the given #gpart_foreign array.
+ *
+ * @param c The #cell.
+ * @param gparts The #gpart_foreign array.
+ * @param base The #cell the positions in the array are relative to.
+ *
+ * @return The number of particles linked.
+ */
+static int cell_link_gparts_compact(struct cell *c,
+                                    struct gpart_foreign *gparts,
+                                    const struct cell *base) {
+#ifdef SWIFT_DEBUG_CHECKS
+  if (c->nodeID == engine_rank)
+    error("Linking foreign particles in a local cell!");
+
+  if (c->grav.parts_foreign != NULL)
+    error("Linking gparts into a cell that was already linked");
+#endif
+
+  c->grav.parts = NULL;
+  c->grav.parts_rebuild = NULL;
+  c->grav.parts_foreign = gparts;
+  c->grav.parts_foreign_base = base;
+
+  /* Fill the progeny recursively, depth-first. */
+  if (c->split) {
+    int offset = 0;
+    for (int k = 0; k < 8; k++) {
+      if (c->progeny[k] != NULL)
+        offset +=
+            cell_link_gparts_compact(c->progeny[k], &gparts[offset], base);
+    }
+  }
+
+  /* Return the total number of linked particles. */
+  return c->grav.count;
+}
+#endif /* WITH_MPI */
+
 /**
  * @brief Link the cells recursively to the given #spart array.
  *
@@ -392,6 +433,64 @@ int cell_link_foreign_gparts(struct cell *c, struct gpart *gparts) {
 #endif
 }
 
+/**
+ * @brief Recurse down foreign cells until reaching one with gravity
+ * tasks; then trigger the linking of the #gpart_foreign array from that
+ * level.
+ *
+ * The positions are relative to the cell of that level, which is the one
+ * the #gpart_foreign are received with.
+ *
+ * @param c The #cell.
+ * @param gparts The #gpart_foreign array.
+ *
+ * @return The number of particles linked.
+ */
+int cell_link_foreign_gparts_compact(struct cell *c,
+                                     struct gpart_foreign *gparts) {
+#ifdef WITH_MPI
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (c->nodeID == engine_rank)
+    error("Linking foreign particles in a local cell!");
+#endif
+
+  /* Do we have a gravity task at this level? */
+  if (cell_get_recv(c, task_subtype_gpart) != NULL) {
+
+    /* Recursively attach the gparts */
+    const int counts = cell_link_gparts_compact(c, gparts, c);
+#ifdef SWIFT_DEBUG_CHECKS
+    if (counts != c->grav.count)
+      error("Something is wrong with the foreign counts");
+#endif
+    return counts;
+  } else {
+    c->grav.parts = NULL;
+    c->grav.parts_rebuild = NULL;
+    c->grav.parts_foreign = gparts;
+    c->grav.parts_foreign_base = NULL;
+  }
+
+  /* Go deeper to find the level where the tasks are */
+  if (c->split) {
+    int count = 0;
+    for (int k = 0; k < 8; k++) {
+      if (c->progeny[k] != NULL) {
+        count +=
+            cell_link_foreign_gparts_compact(c->progeny[k], &gparts[count]);
+      }
+    }
+    return count;
+  } else {
+    return 0;
+  }
+
+#else
+  error("Calling linking of foregin particles in non-MPI mode.");
+#endif
+}
+
 /**
  * @brief Recursively nullify all the particle pointers in a cell hierarchy.
  *
@@ -410,6 +509,7 @@ void cell_unlink_foreign_particles(struct cell *c) {
 #endif
 
   c->grav.parts = NULL;
+  c->grav.parts_foreign = NULL;
   c->hydro.parts = NULL;
   c->stars.parts = NULL;
   c->black_holes.parts = NULL;
@@ -63,6 +63,12 @@ struct replication_list;
 
 #define cell_align 128
 
+/* Number of #gpart below which a leaf is not ordered any further. */
+#define cell_morton_min_count 8
+
+/* Number of levels a leaf is ordered over at most. */
+#define cell_morton_max_depth 10
+
 /* Global variables. */
 extern int cell_next_tag;
 
@@ -517,6 +523,12 @@ void cell_split(struct cell *c, ptrdiff_t parts_offset, ptrdiff_t sparts_offset,
                 struct cell_buff *buff, struct cell_buff *sbuff,
                 struct cell_buff *bbuff, struct cell_buff *gbuff,
                 struct cell_buff *sinkbuff);
+void cell_morton_order_gparts(struct cell *c, struct cell_buff *gbuff,
+                              struct part *parts, struct spart *sparts,
+                              struct bpart *bparts, struct sink *sinks);
+void cell_time_bin_order(struct cell *c, struct part *parts,
+                         struct spart *sparts, struct bpart *bparts,
+                         struct sink *sinks);
 void cell_sanitize(struct cell *c, int treated);
 int cell_locktree(struct cell *c);
 void cell_unlocktree(struct cell *c);
@@ -541,6 +553,9 @@ void cell_pack_bpart_swallow(const struct cell *c,
                              struct black_holes_bpart_data *data);
 void cell_unpack_bpart_swallow(struct cell *c,
                                const struct black_holes_bpart_data *data);
+void cell_pack_gpart_foreign(const struct cell *c, struct gpart_foreign *data);
+void cell_unpack_gpart_foreign(struct cell *c,
+                               const struct gpart_foreign *data);
 int cell_pack_tags(const struct cell *c, int *tags);
 int cell_unpack_tags(const int *tags, struct cell *c);
 int cell_pack_grid_extra(const struct cell *c,
@@ -549,6 +564,11 @@ int cell_unpack_grid_extra(const enum grid_construction_level *info,
                            struct cell *c, struct cell *construction_level);
 int cell_pack_end_step(const struct cell *c, struct pcell_step *pcell);
 int cell_unpack_end_step(struct cell *c, const struct pcell_step *pcell);
+size_t cell_pack_changed_max_size(const int count, const size_t record_size);
+size_t cell_pack_changed(const void *records, void **last, const int count,
+                         const size_t record_size, void *buff);
+void cell_unpack_changed(const void *buff, void **last, const int count,
+                         const size_t record_size);
 void cell_pack_timebin(const struct cell *const c, timebin_t *const t);
 void cell_unpack_timebin(struct cell *const c, timebin_t *const t);
 int cell_pack_multipoles(struct cell *c, struct gravity_tensors *m);
@@ -564,6 +584,8 @@ int cell_link_sparts(struct cell *c, struct spart *sparts);
 int cell_link_bparts(struct cell *c, struct bpart *bparts);
 int cell_link_foreign_parts(struct cell *c, struct part *parts);
 int cell_link_foreign_gparts(struct cell *c, struct gpart *gparts);
+int cell_link_foreign_gparts_compact(struct cell *c,
+                                     struct gpart_foreign *gparts);
 void cell_unlink_foreign_particles(struct cell *c);
 int cell_count_parts_for_tasks(const struct cell *c);
 int cell_count_gparts_for_tasks(const struct cell *c);
@@ -670,10 +692,12 @@ void cell_remove_sink(const struct engine *e, struct cell *c,
 void cell_remove_bpart(const struct engine *e, struct cell *c,
                        struct bpart *bp);
 struct spart *cell_add_spart(struct engine *e, struct cell *c);
+int cell_add_sparts(struct engine *e, struct cell *c, int count);
 struct gpart *cell_add_gpart(struct engine *e, struct cell *c);
 struct spart *cell_spawn_new_spart_from_part(struct engine *e, struct cell *c,
                                              const struct part *p,
-                                             const struct xpart *xp);
+                                             const struct xpart *xp,
+                                             struct spart *sp);
 struct spart *cell_spawn_new_spart_from_sink(struct engine *e, struct cell *c,
                                              const struct sink *s);
 struct gpart *cell_convert_part_to_gpart(const struct engine *e, struct cell *c,
@@ -681,7 +705,8 @@ struct gpart *cell_convert_part_to_gpart(const struct engine *e, struct cell *c,
 struct gpart *cell_convert_spart_to_gpart(const struct engine *e,
                                           struct cell *c, struct spart *sp);
 struct spart *cell_convert_part_to_spart(struct engine *e, struct cell *c,
-                                         struct part *p, struct xpart *xp);
+                                         struct part *p, struct xpart *xp,
+                                         struct spart *sp);
 struct sink *cell_convert_part_to_sink(struct engine *e, struct cell *c,
                                        struct part *p, struct xpart *xp);
 void cell_reorder_extra_parts(struct cell *c, const ptrdiff_t parts_offset);
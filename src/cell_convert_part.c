@@ -33,17 +33,18 @@
 
 /**
  * @brief Recursively update the pointer and counter for #spart after the
- * addition of a new particle.
+ * addition of some new particles.
  *
  * @param c The cell we are working on.
  * @param progeny_list The list of the progeny index at each level for the
- * leaf-cell where the particle was added.
+ * leaf-cell where the particles were added.
  * @param main_branch Are we in a cell directly above the leaf where the new
- * particle was added?
+ * particles were added?
+ * @param count The number of particles added.
  */
 void cell_recursively_shift_sparts(struct cell *c,
                                    const int progeny_list[space_cell_maxdepth],
-                                   const int main_branch) {
+                                   const int main_branch, const int count) {
   if (c->split) {
     /* No need to recurse in progenies located before the insestion point */
     const int first_progeny = main_branch ? progeny_list[(int)c->depth] : 0;
@@ -51,15 +52,16 @@ void cell_recursively_shift_sparts(struct cell *c,
     for (int k = first_progeny; k < 8; ++k) {
       if (c->progeny[k] != NULL)
         cell_recursively_shift_sparts(c->progeny[k], progeny_list,
-                                      main_branch && (k == first_progeny));
+                                      main_branch && (k == first_progeny),
+                                      count);
     }
   }
 
-  /* When directly above the leaf with the new particle: increase the particle
-   * count */
-  /* When after the leaf with the new particle: shift by one position */
+  /* When directly above the leaf with the new particles: increase the
+   * particle count */
+  /* When after the leaf with the new particles: shift by count positions */
   if (main_branch) {
-    c->stars.count++;
+    c->stars.count += count;
 
     /* Indicate that the cell is not sorted and cancel the pointer sorting
      * arrays. */
@@ -67,7 +69,7 @@ void cell_recursively_shift_sparts(struct cell *c,
     cell_free_stars_sorts(c);
 
   } else {
-    c->stars.parts++;
+    c->stars.parts += count;
   }
 }
 
@@ -137,27 +139,37 @@ void cell_recursively_shift_gparts(struct cell *c,
   } else {
     c->grav.parts++;
   }
+
+  /* The #gpart_soa copy (and its active lists) no longer matches */
+  c->grav.ti_soa = -1;
 }
 
 /**
- * @brief "Add" a #spart in a given #cell.
+ * @brief "Add" a series of #spart in a given #cell.
  *
- * This function will add a #spart at the start of the current cell's array by
- * shifting all the #spart in the top-level cell by one position. All the
+ * This function will add #spart at the start of the current cell's array by
+ * shifting all the #spart in the top-level cell by as many positions. All the
  * pointers and cell counts are updated accordingly.
  *
+ * A leaf forming several stars in the same step should reserve them all at
+ * once here: the top-level lock is taken and the particles after the leaf
+ * are moved only once, rather than once per star.
+ *
  * @param e The #engine.
  * @param c The leaf-cell in which to add the #spart.
+ * @param count The number of #spart we would like to add.
  *
- * @return A pointer to the newly added #spart. The spart has a been zeroed
- * and given a position within the cell as well as set to the minimal active
- * time bin.
+ * @return The number of #spart added, which is less than count if we ran out
+ * of free slots. They are the first ones of the cell, have been zeroed and
+ * given a position within the cell as well as set to the minimal active time
+ * bin.
  */
-struct spart *cell_add_spart(struct engine *e, struct cell *const c) {
+int cell_add_sparts(struct engine *e, struct cell *const c, int count) {
   /* Perform some basic consitency checks */
   if (c->nodeID != engine_rank) error("Adding spart on a foreign node");
   if (c->stars.ti_old_part != e->ti_current) error("Undrifted cell!");
   if (c->split) error("Addition of spart performed above the leaf level");
+  if (count <= 0) return 0;
 
   /* Progeny number at each level */
   int progeny[space_cell_maxdepth];
@@ -192,20 +204,26 @@ struct spart *cell_add_spart(struct engine *e, struct cell *const c) {
   /* Lock the top-level cell as we are going to operate on it */
   lock_lock(&top->stars.star_formation_lock);
 
-  /* Are there any extra particles left? */
-  if (top->stars.count == top->stars.count_total) {
+  /* Are there enough extra particles left? */
+  const int count_free = top->stars.count_total - top->stars.count;
+  if (count_free < count) {
 
     message("We ran out of free star particles!");
+    atomic_inc(&e->forcerebuild);
 
-    /* Release the local lock before exiting. */
-    if (lock_unlock(&top->stars.star_formation_lock) != 0)
-      error("Failed to unlock the top-level cell.");
+    /* Use what is left */
+    count = count_free;
+    if (count == 0) {
 
-    atomic_inc(&e->forcerebuild);
-    return NULL;
+      /* Release the local lock before exiting. */
+      if (lock_unlock(&top->stars.star_formation_lock) != 0)
+        error("Failed to unlock the top-level cell.");
+
+      return 0;
+    }
   }
 
-  /* Number of particles to shift in order to get a free space. */
+  /* Number of particles to shift in order to get the free space. */
   const size_t n_copy = &top->stars.parts[top->stars.count] - c->stars.parts;
 
 #ifdef SWIFT_DEBUG_CHECKS
@@ -216,26 +234,26 @@ struct spart *cell_add_spart(struct engine *e, struct cell *const c) {
   if (n_copy > 0) {
     // MATTHIEU: This can be improved. We don't need to copy everything, just
     // need to swap a few particles.
-    memmove(&c->stars.parts[1], &c->stars.parts[0],
+    memmove(&c->stars.parts[count], &c->stars.parts[0],
             n_copy * sizeof(struct spart));
 
-    /* Update the spart->gpart links (shift by 1) */
+    /* Update the spart->gpart links (shift by count) */
     for (size_t i = 0; i < n_copy; ++i) {
 
 #ifdef SWIFT_DEBUG_CHECKS
-      if (c->stars.parts[i + 1].gpart == NULL) {
+      if (c->stars.parts[i + count].gpart == NULL) {
         error("Incorrectly linked spart!");
       }
 #endif
-      c->stars.parts[i + 1].gpart->id_or_neg_offset--;
+      c->stars.parts[i + count].gpart->id_or_neg_offset -= count;
     }
   }
 
-  /* Recursively shift all the stars to get a free spot at the start of the
-   * current cell*/
-  cell_recursively_shift_sparts(top, progeny, /* main_branch=*/1);
+  /* Recursively shift all the stars to get the free spots at the start of
+   * the current cell*/
+  cell_recursively_shift_sparts(top, progeny, /* main_branch=*/1, count);
 
-  /* Make sure the gravity will be recomputed for this particle in the next
+  /* Make sure the gravity will be recomputed for these particles in the next
    * step
    */
   struct cell *top2 = c;
@@ -249,28 +267,47 @@ struct spart *cell_add_spart(struct engine *e, struct cell *const c) {
   if (lock_unlock(&top->stars.star_formation_lock) != 0)
     error("Failed to unlock the top-level cell.");
 
-  /* We now have an empty spart as the first particle in that cell */
-  struct spart *sp = &c->stars.parts[0];
-  bzero(sp, sizeof(struct spart));
+  /* We now have empty sparts as the first particles in that cell */
+  for (int k = 0; k < count; k++) {
+    struct spart *sp = &c->stars.parts[k];
+    bzero(sp, sizeof(struct spart));
 
-  /* Give it a decent position */
-  sp->x[0] = c->loc[0] + 0.5 * c->width[0];
-  sp->x[1] = c->loc[1] + 0.5 * c->width[1];
-  sp->x[2] = c->loc[2] + 0.5 * c->width[2];
+    /* Give it a decent position */
+    sp->x[0] = c->loc[0] + 0.5 * c->width[0];
+    sp->x[1] = c->loc[1] + 0.5 * c->width[1];
+    sp->x[2] = c->loc[2] + 0.5 * c->width[2];
 
-  /* Set it to the current time-bin */
-  sp->time_bin = e->min_active_bin;
+    /* Set it to the current time-bin */
+    sp->time_bin = e->min_active_bin;
 
 #ifdef SWIFT_DEBUG_CHECKS
-  /* Specify it was drifted to this point */
-  sp->ti_drift = e->ti_current;
+    /* Specify it was drifted to this point */
+    sp->ti_drift = e->ti_current;
 #endif
+  }
 
-  /* Register that we used one of the free slots. */
-  const size_t one = 1;
-  atomic_sub(&e->s->nr_extra_sparts, one);
+  /* Register that we used some of the free slots. */
+  const size_t used = count;
+  atomic_sub(&e->s->nr_extra_sparts, used);
 
-  return sp;
+  return count;
+}
+
+/**
+ * @brief "Add" a #spart in a given #cell.
+ *
+ * See cell_add_sparts().
+ *
+ * @param e The #engine.
+ * @param c The leaf-cell in which to add the #spart.
+ *
+ * @return A pointer to the newly added #spart or NULL if we ran out of free
+ * slots.
+ */
+struct spart *cell_add_spart(struct engine *e, struct cell *const c) {
+
+  if (cell_add_sparts(e, c, 1) == 0) return NULL;
+  return &c->stars.parts[0];
 }
 
 /**
@@ -861,12 +898,15 @@ struct gpart *cell_convert_spart_to_gpart(const struct engine *e,
  * @param c The #cell from which to remove the #part.
  * @param p The #part to remove (must be inside c).
  * @param xp The extended data of the #part.
+ * @param sp A #spart of the cell reserved with cell_add_sparts() or NULL to
+ * add one here.
  *
  * @return A fresh #spart with the same ID, position, velocity and
  * time-bin as the original #part.
  */
 struct spart *cell_convert_part_to_spart(struct engine *e, struct cell *c,
-                                         struct part *p, struct xpart *xp) {
+                                         struct part *p, struct xpart *xp,
+                                         struct spart *sp) {
   /* Quick cross-check */
   if (c->nodeID != e->nodeID)
     error("Can't remove a particle in a foreign cell.");
@@ -875,7 +915,7 @@ struct spart *cell_convert_part_to_spart(struct engine *e, struct cell *c,
     error("Trying to convert part without gpart friend to star!");
 
   /* Create a fresh (empty) spart */
-  struct spart *sp = cell_add_spart(e, c);
+  if (sp == NULL) sp = cell_add_spart(e, c);
 
   /* Did we run out of free spart slots? */
   if (sp == NULL) return NULL;
@@ -928,13 +968,16 @@ struct spart *cell_convert_part_to_spart(struct engine *e, struct cell *c,
  * @param c The #cell from which to remove the #part.
  * @param p The #part to remove (must be inside c).
  * @param xp The extended data of the #part.
+ * @param sp A #spart of the cell reserved with cell_add_sparts() or NULL to
+ * add one here.
  *
  * @return A fresh #spart with a different ID, but same position,
  * velocity and time-bin as the original #part.
  */
 struct spart *cell_spawn_new_spart_from_part(struct engine *e, struct cell *c,
                                              const struct part *p,
-                                             const struct xpart *xp) {
+                                             const struct xpart *xp,
+                                             struct spart *sp) {
   /* Quick cross-check */
   if (c->nodeID != e->nodeID)
     error("Can't spawn a particle in a foreign cell.");
@@ -943,7 +986,7 @@ struct spart *cell_spawn_new_spart_from_part(struct engine *e, struct cell *c,
     error("Trying to create a new spart from a part without gpart friend!");
 
   /* Create a fresh (empty) spart */
-  struct spart *sp = cell_add_spart(e, c);
+  if (sp == NULL) sp = cell_add_spart(e, c);
 
   /* Did we run out of free spart slots? */
   if (sp == NULL) return NULL;
@@ -966,6 +1009,11 @@ struct spart *cell_spawn_new_spart_from_part(struct engine *e, struct cell *c,
   /* Copy the gpart */
   *gp = *p->gpart;
 
+#ifdef WITH_FOF
+  /* The new particle was not there to be linked at the last FOF call */
+  gp->fof_data.core_id = fof_gpart_no_core;
+#endif
+
   /* Assign the ID. */
   sp->id = space_get_new_unique_id(e->s);
   gp->type = swift_type_stars;
@@ -1114,6 +1162,11 @@ struct spart *cell_spawn_new_spart_from_sink(struct engine *e, struct cell *c,
   /* Copy the gpart */
   *gp = *s->gpart;
 
+#ifdef WITH_FOF
+  /* The new particle was not there to be linked at the last FOF call */
+  gp->fof_data.core_id = fof_gpart_no_core;
+#endif
+
   /* Assign the ID. */
   sp->id = space_get_new_unique_id(e->s);
   gp->type = swift_type_stars;
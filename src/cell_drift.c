@@ -70,6 +70,31 @@ static struct replication_list *refine_replications(
   }
   return replication_list;
 }
+
+/**
+ * @brief The replication lists to check the particles of a leaf cell against
+ * during its drift.
+ *
+ * Returns NULL if no particle of the leaf can cross any of the lightcones,
+ * in which case the per-particle crossing checks are skipped.
+ *
+ * @param e The #engine
+ * @param c The leaf #cell
+ * @param replication_list The replication lists of the cell
+ * @param ti_old The start of the drift
+ * @param ti_current The end of the drift
+ */
+static struct replication_list *leaf_replications(
+    const struct engine *e, const struct cell *c,
+    struct replication_list *replication_list, const integertime_t ti_old,
+    const integertime_t ti_current) {
+  if (replication_list == NULL) return NULL;
+  if (!lightcone_array_cell_may_cross(e->lightcone_array_properties,
+                                      replication_list, e->cosmology, c, ti_old,
+                                      ti_current))
+    return NULL;
+  return replication_list;
+}
 #endif
 
 /**
@@ -237,6 +262,13 @@ void cell_drift_part(struct cell *c, const struct engine *e, int force,
     c->hydro.ti_old_part = ti_current;
 
   } else if (!c->split && force && ti_current > ti_old_part) {
+
+    /* Skip the crossing checks if no particle here can meet a lightcone */
+    struct replication_list *leaf_replication_list = replication_list;
+#ifdef WITH_LIGHTCONE
+    leaf_replication_list =
+        leaf_replications(e, c, replication_list, ti_old_part, ti_current);
+#endif
     /* Drift from the last time the cell was drifted to the current time */
     double dt_drift, dt_kick_grav, dt_kick_hydro, dt_therm;
     if (with_cosmology) {
@@ -272,7 +304,8 @@ void cell_drift_part(struct cell *c, const struct engine *e, int force,
 
       /* Drift... */
       drift_part(p, xp, dt_drift, dt_kick_hydro, dt_kick_grav, dt_therm,
-                 ti_old_part, ti_current, e, replication_list, c->loc);
+                 ti_old_part, ti_current, e, leaf_replication_list,
+                 c->loc);
 
       /* Update the tracers properties */
       tracers_after_drift(p, xp, e->internal_units, e->physical_constants,
@@ -474,6 +507,13 @@ void cell_drift_gpart(struct cell *c, const struct engine *e, int force,
     c->grav.ti_old_part = ti_current;
 
   } else if (!c->split && force && ti_current > ti_old_gpart) {
+
+    /* Skip the crossing checks if no particle here can meet a lightcone */
+    struct replication_list *leaf_replication_list = replication_list;
+#ifdef WITH_LIGHTCONE
+    leaf_replication_list =
+        leaf_replications(e, c, replication_list, ti_old_gpart, ti_current);
+#endif
     /* Drift from the last time the cell was drifted to the current time */
     double dt_drift;
     if (with_cosmology) {
@@ -500,7 +540,7 @@ void cell_drift_gpart(struct cell *c, const struct engine *e, int force,
 
       /* Drift... */
       drift_gpart(gp, dt_drift_k, ti_old_gpart, ti_current, grav_props, e,
-                  replication_list, c->loc);
+                  leaf_replication_list, c->loc);
 
 #ifdef SWIFT_DEBUG_CHECKS
       /* Make sure the particle does not drift by more than a box length. */
@@ -657,6 +697,13 @@ void cell_drift_spart(struct cell *c, const struct engine *e, int force,
     c->stars.ti_old_part = ti_current;
 
   } else if (!c->split && force && ti_current > ti_old_spart) {
+
+    /* Skip the crossing checks if no particle here can meet a lightcone */
+    struct replication_list *leaf_replication_list = replication_list;
+#ifdef WITH_LIGHTCONE
+    leaf_replication_list =
+        leaf_replications(e, c, replication_list, ti_old_spart, ti_current);
+#endif
     /* Drift from the last time the cell was drifted to the current time */
     double dt_drift;
     if (with_cosmology) {
@@ -676,8 +723,8 @@ void cell_drift_spart(struct cell *c, const struct engine *e, int force,
       if (spart_is_inhibited(sp, e)) continue;
 
       /* Drift... */
-      drift_spart(sp, dt_drift, ti_old_spart, ti_current, e, replication_list,
-                  c->loc);
+      drift_spart(sp, dt_drift, ti_old_spart, ti_current, e,
+                  leaf_replication_list, c->loc);
 
 #ifdef SWIFT_DEBUG_CHECKS
       /* Make sure the particle does not drift by more than a box length. */
@@ -862,6 +909,13 @@ void cell_drift_bpart(struct cell *c, const struct engine *e, int force,
 
   } else if (!c->split && force && ti_current > ti_old_bpart) {
 
+    /* Skip the crossing checks if no particle here can meet a lightcone */
+    struct replication_list *leaf_replication_list = replication_list;
+#ifdef WITH_LIGHTCONE
+    leaf_replication_list =
+        leaf_replications(e, c, replication_list, ti_old_bpart, ti_current);
+#endif
+
     /* Drift from the last time the cell was drifted to the current time */
     double dt_drift;
     if (with_cosmology) {
@@ -882,8 +936,8 @@ void cell_drift_bpart(struct cell *c, const struct engine *e, int force,
       if (bpart_is_inhibited(bp, e)) continue;
 
       /* Drift... */
-      drift_bpart(bp, dt_drift, ti_old_bpart, ti_current, e, replication_list,
-                  c->loc);
+      drift_bpart(bp, dt_drift, ti_old_bpart, ti_current, e,
+                  leaf_replication_list, c->loc);
 
 #ifdef SWIFT_DEBUG_CHECKS
       /* Make sure the particle does not drift by more than a box length. */
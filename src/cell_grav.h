@@ -40,6 +40,13 @@ struct cell_grav {
   /*! Pointer to the #spart data at rebuild time. */
   struct gpart *parts_rebuild;
 
+  /*! Pointer to the #gpart_foreign data of a foreign cell whose #gpart are
+   * only kept in that compact form. */
+  struct gpart_foreign *parts_foreign;
+
+  /*! The cell the positions of the #gpart_foreign are relative to. */
+  const struct cell *parts_foreign_base;
+
   /*! This cell's multipole. */
   struct gravity_tensors *multipole;
 
@@ -77,9 +84,6 @@ struct cell_grav {
   /*! The task to end the force calculation */
   struct task *end_force;
 
-  /*! Task for weighting neutrino particles */
-  struct task *neutrino_weight;
-
   /*! Minimum end of (integer) time step in this cell for gravity tasks. */
   integertime_t ti_end_min;
 
@@ -93,6 +97,10 @@ struct cell_grav {
   /*! Last (integer) time the cell's multipole was drifted forward in time. */
   integertime_t ti_old_multipole;
 
+  /*! Last (integer) time the #gpart_soa copy of the cell's gpart was
+   * refreshed (-1 if never). */
+  integertime_t ti_soa;
+
   /*! Spin lock for various uses (#gpart case). */
   swift_lock_type plock;
 
@@ -111,12 +119,24 @@ struct cell_grav {
   /*! Number of #gpart updated in this cell. */
   int updated;
 
+  /*! Nr of #gpart active at the last refresh of the #gpart_soa copy (leaves
+   * only). */
+  int active_count;
+
   /*! Is the #gpart data of this cell being used in a sub-cell? */
   int phold;
 
   /*! Is the #multipole data of this cell being used in a sub-cell? */
   int mhold;
 
+  /*! Index of this leaf in the #cuda_multipole_mirror (-1 if split). */
+  int mirror_index;
+
+  /*! Largest number of #gpart in the leaves of this tree as tuned by
+   * space_split_tune() (top-level cells only, 0 for #space_splitsize_grav).
+   */
+  int split_size;
+
   /*! Number of M-M tasks that are associated with this cell. */
   short int nr_mm_tasks;
 };
@@ -106,6 +106,10 @@ struct cell_hydro {
     /*! Last (integer) time the cell's part were drifted forward in time. */
     integertime_t ti_old_part;
 
+    /*! Last (integer) time the #part_soa copy of the cell's part was
+     * refreshed (-1 if never). */
+    integertime_t ti_soa;
+
     /*! Max smoothing length of active particles in this cell. */
     float h_max_active;
 
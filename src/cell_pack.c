@@ -25,6 +25,9 @@
 /* This object's header. */
 #include "cell.h"
 
+/* Local headers. */
+#include "gravity.h"
+
 /**
  * @brief Pack the data of the given cell and all it's sub-cells.
  *
@@ -227,6 +230,37 @@ void cell_unpack_bpart_swallow(struct cell *c,
   }
 }
 
+/**
+ * @brief Pack what the other ranks need of the #gpart of a cell.
+ *
+ * @param c The #cell.
+ * @param data (output) The array of #gpart_foreign we pack into.
+ */
+void cell_pack_gpart_foreign(const struct cell *c, struct gpart_foreign *data) {
+
+  const size_t count = c->grav.count;
+  const struct gpart *gparts = c->grav.parts;
+
+  for (size_t i = 0; i < count; ++i)
+    gravity_pack_foreign(&data[i], &gparts[i], c->loc);
+}
+
+/**
+ * @brief Update the #gpart of a foreign cell from what was received for them.
+ *
+ * @param c The #cell.
+ * @param data The array of #gpart_foreign we unpack from.
+ */
+void cell_unpack_gpart_foreign(struct cell *c,
+                               const struct gpart_foreign *data) {
+
+  const size_t count = c->grav.count;
+  struct gpart *gparts = c->grav.parts;
+
+  for (size_t i = 0; i < count; ++i)
+    gravity_unpack_foreign(&gparts[i], &data[i], c->loc);
+}
+
 /**
  * @brief Unpack the data of a given cell and its sub-cells.
  *
@@ -517,6 +551,101 @@ int cell_unpack_end_step(struct cell *c, const struct pcell_step *pcells) {
 #endif
 }
 
+/**
+ * @brief Maximal size in bytes of a message made by cell_pack_changed().
+ *
+ * @param count The number of records of the cell hierarchy.
+ * @param record_size The size in bytes of one record.
+ */
+size_t cell_pack_changed_max_size(const int count, const size_t record_size) {
+
+  return ((count + 63) / 64) * sizeof(uint64_t) + count * record_size;
+}
+
+/**
+ * @brief Pack the records of a cell hierarchy that changed since the last
+ * exchange.
+ *
+ * The message starts with a bitmap flagging the changed records, followed by
+ * these records only. The records are compared byte by byte, so the array of
+ * records has to be zeroed before being filled to not compare the padding.
+ *
+ * @param records The (zeroed then filled) records of the whole hierarchy.
+ * @param last The records sent last time, updated on exit. Allocated, in
+ * which case all the records are sent, if NULL.
+ * @param count The number of records.
+ * @param record_size The size in bytes of one record.
+ * @param buff (output) The message, of at least cell_pack_changed_max_size()
+ * bytes.
+ *
+ * @return The size in bytes of the message.
+ */
+size_t cell_pack_changed(const void *records, void **last, const int count,
+                         const size_t record_size, void *buff) {
+
+  const char *in = (const char *)records;
+  const int nr_words = (count + 63) / 64;
+  uint64_t *bitmap = (uint64_t *)buff;
+  char *out = (char *)buff + nr_words * sizeof(uint64_t);
+
+  /* Nothing sent yet? Everything has changed then. */
+  const int first = (*last == NULL);
+  if (first && (*last = malloc(count * record_size)) == NULL)
+    error("Failed to allocate the last sent records.");
+  char *old = (char *)*last;
+
+  bzero(bitmap, nr_words * sizeof(uint64_t));
+  size_t offset = 0;
+  for (int k = 0; k < count; k++) {
+    const char *rec = in + k * record_size;
+    if (first || memcmp(rec, old + k * record_size, record_size) != 0) {
+      bitmap[k / 64] |= ((uint64_t)1) << (k % 64);
+      memcpy(out + offset, rec, record_size);
+      memcpy(old + k * record_size, rec, record_size);
+      offset += record_size;
+    }
+  }
+
+  return nr_words * sizeof(uint64_t) + offset;
+}
+
+/**
+ * @brief Merge a message made by cell_pack_changed() into the records
+ * received so far.
+ *
+ * @param buff The message.
+ * @param last The records received so far, updated on exit. Allocated if
+ * NULL, in which case the message must contain all the records.
+ * @param count The number of records.
+ * @param record_size The size in bytes of one record.
+ */
+void cell_unpack_changed(const void *buff, void **last, const int count,
+                         const size_t record_size) {
+
+  const int nr_words = (count + 63) / 64;
+  const uint64_t *bitmap = (const uint64_t *)buff;
+  const char *in = (const char *)buff + nr_words * sizeof(uint64_t);
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (*last == NULL)
+    for (int k = 0; k < count; k++)
+      if (!(bitmap[k / 64] & (((uint64_t)1) << (k % 64))))
+        error("First message does not contain all the records.");
+#endif
+
+  if (*last == NULL && (*last = calloc(count, record_size)) == NULL)
+    error("Failed to allocate the last received records.");
+  char *old = (char *)*last;
+
+  size_t offset = 0;
+  for (int k = 0; k < count; k++) {
+    if (bitmap[k / 64] & (((uint64_t)1) << (k % 64))) {
+      memcpy(old + k * record_size, in + offset, record_size);
+      offset += record_size;
+    }
+  }
+}
+
 /**
  * @brief Pack the hydro timebin information of the given cell.
  *
@@ -22,6 +22,9 @@
 /* Config parameters. */
 #include <config.h>
 
+/* System includes. */
+#include <string.h>
+
 /* This object's header. */
 #include "cell.h"
 
@@ -462,6 +465,287 @@ void cell_split(struct cell *c, const ptrdiff_t parts_offset,
   }
 }
 
+/**
+ * @brief Re-link the particle of the other kind a #gpart belongs to after the
+ * #gpart has moved.
+ *
+ * @param gp The #gpart at its new position.
+ * @param parts The space's #part array.
+ * @param sparts The space's #spart array.
+ * @param bparts The space's #bpart array.
+ * @param sinks The space's #sink array.
+ */
+__attribute__((always_inline)) INLINE static void cell_relink_gpart(
+    struct gpart *gp, struct part *parts, struct spart *sparts,
+    struct bpart *bparts, struct sink *sinks) {
+
+  if (gp->type == swift_type_gas) {
+    parts[-gp->id_or_neg_offset].gpart = gp;
+  } else if (gp->type == swift_type_stars) {
+    sparts[-gp->id_or_neg_offset].gpart = gp;
+  } else if (gp->type == swift_type_sink) {
+    sinks[-gp->id_or_neg_offset].gpart = gp;
+  } else if (gp->type == swift_type_black_hole) {
+    bparts[-gp->id_or_neg_offset].gpart = gp;
+  }
+}
+
+/**
+ * @brief Recursively sort a range of #gpart into the eight octants of a box.
+ *
+ * @param gparts The #gpart to sort.
+ * @param gbuff The positions of the #gpart.
+ * @param count The number of #gpart.
+ * @param loc The corner of the box.
+ * @param width The width of the box.
+ * @param depth The number of levels left to sort over.
+ * @param parts The space's #part array.
+ * @param sparts The space's #spart array.
+ * @param bparts The space's #bpart array.
+ * @param sinks The space's #sink array.
+ */
+static void cell_morton_order_gparts_recursive(
+    struct gpart *gparts, struct cell_buff *gbuff, const int count,
+    const double loc[3], const double width[3], const int depth,
+    struct part *parts, struct spart *sparts, struct bpart *bparts,
+    struct sink *sinks) {
+
+  if (count < cell_morton_min_count || depth == 0) return;
+
+  const double pivot[3] = {loc[0] + 0.5 * width[0], loc[1] + 0.5 * width[1],
+                           loc[2] + 0.5 * width[2]};
+  int bucket_count[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  int bucket_offset[9];
+
+  /* Fill the buffer with the indices. */
+  for (int k = 0; k < count; k++) {
+    const int bid = (gbuff[k].x[0] > pivot[0]) * 4 +
+                    (gbuff[k].x[1] > pivot[1]) * 2 + (gbuff[k].x[2] > pivot[2]);
+    bucket_count[bid]++;
+    gbuff[k].ind = bid;
+  }
+
+  /* Set the buffer offsets. */
+  bucket_offset[0] = 0;
+  for (int k = 1; k <= 8; k++) {
+    bucket_offset[k] = bucket_offset[k - 1] + bucket_count[k - 1];
+    bucket_count[k - 1] = 0;
+  }
+
+  /* Run through the buckets, and swap particles to their correct spot. */
+  for (int bucket = 0; bucket < 8; bucket++) {
+    for (int k = bucket_offset[bucket] + bucket_count[bucket];
+         k < bucket_offset[bucket + 1]; k++) {
+      int bid = gbuff[k].ind;
+      if (bid != bucket) {
+        struct gpart gpart = gparts[k];
+        struct cell_buff temp_buff = gbuff[k];
+        while (bid != bucket) {
+          int j = bucket_offset[bid] + bucket_count[bid]++;
+          while (gbuff[j].ind == bid) {
+            j++;
+            bucket_count[bid]++;
+          }
+          memswap_unaligned(&gparts[j], &gpart, sizeof(struct gpart));
+          memswap(&gbuff[j], &temp_buff, sizeof(struct cell_buff));
+          cell_relink_gpart(&gparts[j], parts, sparts, bparts, sinks);
+          bid = temp_buff.ind;
+        }
+        gparts[k] = gpart;
+        gbuff[k] = temp_buff;
+        cell_relink_gpart(&gparts[k], parts, sparts, bparts, sinks);
+      }
+      bucket_count[bid]++;
+    }
+  }
+
+  /* And order each octant in turn. */
+  const double half[3] = {0.5 * width[0], 0.5 * width[1], 0.5 * width[2]};
+  for (int k = 0; k < 8; k++) {
+    const double sub_loc[3] = {loc[0] + ((k & 4) ? half[0] : 0.),
+                               loc[1] + ((k & 2) ? half[1] : 0.),
+                               loc[2] + ((k & 1) ? half[2] : 0.)};
+    cell_morton_order_gparts_recursive(
+        &gparts[bucket_offset[k]], &gbuff[bucket_offset[k]], bucket_count[k],
+        sub_loc, half, depth - 1, parts, sparts, bparts, sinks);
+  }
+}
+
+/**
+ * @brief Put the #gpart of a leaf cell in Morton order.
+ *
+ * The leaf is split into octants the same way as cell_split() would, over
+ * and over until they hold too few particles, such that the particles close
+ * in space are also close in memory. As the cells are split in that order
+ * too, the whole tree is then in Morton order.
+ *
+ * @param c The leaf #cell.
+ * @param gbuff The positions of its #gpart.
+ * @param parts The space's #part array.
+ * @param sparts The space's #spart array.
+ * @param bparts The space's #bpart array.
+ * @param sinks The space's #sink array.
+ */
+void cell_morton_order_gparts(struct cell *c, struct cell_buff *gbuff,
+                              struct part *parts, struct spart *sparts,
+                              struct bpart *bparts, struct sink *sinks) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (c->split) error("Ordering the gparts of a split cell.");
+#endif
+
+  cell_morton_order_gparts_recursive(c->grav.parts, gbuff, c->grav.count,
+                                     c->loc, c->width, cell_morton_max_depth,
+                                     parts, sparts, bparts, sinks);
+}
+
+/**
+ * @brief Index of the bucket a time-bin goes in when grouping particles.
+ *
+ * Only the valid time-bins are expected at rebuild time. Anything else goes
+ * at the end.
+ *
+ * @param time_bin The time-bin of the particle.
+ */
+__attribute__((always_inline)) INLINE static int cell_time_bin_bucket(
+    const timebin_t time_bin) {
+  return (time_bin >= 0 && time_bin <= num_time_bins) ? time_bin
+                                                      : num_time_bins + 1;
+}
+
+/**
+ * @brief Turn the bucket counts of a counting sort into offsets.
+ *
+ * @param bucket The counts, replaced by the offset of each bucket.
+ *
+ * @return 1 if the particles span more than one bucket, 0 if they are
+ * already grouped.
+ */
+static int cell_time_bin_offsets(int bucket[num_time_bins + 2]) {
+
+  int offset = 0, nr_used = 0;
+  for (int k = 0; k < num_time_bins + 2; k++) {
+    const int count = bucket[k];
+    nr_used += (count > 0);
+    bucket[k] = offset;
+    offset += count;
+  }
+  return nr_used > 1;
+}
+
+/**
+ * @brief Group the particles of a leaf cell by time-bin.
+ *
+ * The #part (with their #xpart), #gpart and #spart of the cell are put in
+ * increasing time-bin order with a stable counting sort, such that the
+ * Morton order within each bin is kept. As the active bins are always the
+ * smallest ones, the active particles of a step then sit at the start of
+ * the cell's arrays, in contiguous memory.
+ *
+ * The links between the #gpart and the particles of the other kinds are
+ * updated. The leaf boundaries are unchanged as particles only move within
+ * the cell.
+ *
+ * @param c The leaf #cell.
+ * @param parts The space's #part array.
+ * @param sparts The space's #spart array.
+ * @param bparts The space's #bpart array.
+ * @param sinks The space's #sink array.
+ */
+void cell_time_bin_order(struct cell *c, struct part *parts,
+                         struct spart *sparts, struct bpart *bparts,
+                         struct sink *sinks) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (c->split) error("Ordering the particles of a split cell.");
+#endif
+
+  int bucket[num_time_bins + 2];
+
+  /* First the gas and their extended data. */
+  const int count = c->hydro.count;
+  if (count > 1) {
+    struct part *cparts = c->hydro.parts;
+    struct xpart *cxparts = c->hydro.xparts;
+    bzero(bucket, sizeof(bucket));
+    for (int k = 0; k < count; k++)
+      bucket[cell_time_bin_bucket(cparts[k].time_bin)]++;
+
+    if (cell_time_bin_offsets(bucket)) {
+      struct part *temp = NULL;
+      struct xpart *xtemp = NULL;
+      if (swift_memalign("tempbinparts", (void **)&temp, part_align,
+                         count * sizeof(struct part)) != 0 ||
+          swift_memalign("tempbinxparts", (void **)&xtemp, xpart_align,
+                         count * sizeof(struct xpart)) != 0)
+        error("Failed to allocate the time-bin buffer.");
+      memcpy(temp, cparts, count * sizeof(struct part));
+      memcpy(xtemp, cxparts, count * sizeof(struct xpart));
+
+      const ptrdiff_t offset = cparts - parts;
+      for (int k = 0; k < count; k++) {
+        const int j = bucket[cell_time_bin_bucket(temp[k].time_bin)]++;
+        cparts[j] = temp[k];
+        cxparts[j] = xtemp[k];
+        if (cparts[j].gpart != NULL)
+          cparts[j].gpart->id_or_neg_offset = -(j + offset);
+      }
+      swift_free("tempbinparts", temp);
+      swift_free("tempbinxparts", xtemp);
+    }
+  }
+
+  /* Then the stars. */
+  const int scount = c->stars.count;
+  if (scount > 1) {
+    struct spart *csparts = c->stars.parts;
+    bzero(bucket, sizeof(bucket));
+    for (int k = 0; k < scount; k++)
+      bucket[cell_time_bin_bucket(csparts[k].time_bin)]++;
+
+    if (cell_time_bin_offsets(bucket)) {
+      struct spart *temp = NULL;
+      if (swift_memalign("tempbinsparts", (void **)&temp, spart_align,
+                         scount * sizeof(struct spart)) != 0)
+        error("Failed to allocate the time-bin buffer.");
+      memcpy(temp, csparts, scount * sizeof(struct spart));
+
+      const ptrdiff_t offset = csparts - sparts;
+      for (int k = 0; k < scount; k++) {
+        const int j = bucket[cell_time_bin_bucket(temp[k].time_bin)]++;
+        csparts[j] = temp[k];
+        if (csparts[j].gpart != NULL)
+          csparts[j].gpart->id_or_neg_offset = -(j + offset);
+      }
+      swift_free("tempbinsparts", temp);
+    }
+  }
+
+  /* And last the gparts, which point to their new partners. */
+  const int gcount = c->grav.count;
+  if (gcount > 1) {
+    struct gpart *cgparts = c->grav.parts;
+    bzero(bucket, sizeof(bucket));
+    for (int k = 0; k < gcount; k++)
+      bucket[cell_time_bin_bucket(cgparts[k].time_bin)]++;
+
+    if (cell_time_bin_offsets(bucket)) {
+      struct gpart *temp = NULL;
+      if (swift_memalign("tempbingparts", (void **)&temp, gpart_align,
+                         gcount * sizeof(struct gpart)) != 0)
+        error("Failed to allocate the time-bin buffer.");
+      memcpy(temp, cgparts, gcount * sizeof(struct gpart));
+
+      for (int k = 0; k < gcount; k++) {
+        const int j = bucket[cell_time_bin_bucket(temp[k].time_bin)]++;
+        cgparts[j] = temp[k];
+        cell_relink_gpart(&cgparts[j], parts, sparts, bparts, sinks);
+      }
+      swift_free("tempbingparts", temp);
+    }
+  }
+}
+
 /**
  * @brief Re-arrange the #part in a top-level cell such that all the extra
  * ones for on-the-fly creation are located at the end of the array.
@@ -2030,6 +2030,16 @@ int cell_unskip_gravity_tasks(struct cell *c, struct scheduler *s) {
         (cj_active && cj_nodeID == nodeID)) {
       scheduler_activate(s, t);
 
+#ifdef SWIFT_TASKS_WITHOUT_ATOMICS
+      /* Only the local active cells are written to, the others need no
+       * locks. Cleared when the task is unlocked. */
+      if (t->type == task_type_pair && t->subtype == task_subtype_grav)
+        t->flags = ((ci_active && ci_nodeID == nodeID) ? 0
+                                                        : task_grav_nolock_ci) |
+                   ((cj_active && cj_nodeID == nodeID) ? 0
+                                                        : task_grav_nolock_cj);
+#endif
+
       /* Set the drifting flags */
       if (t->type == task_type_self &&
           t->subtype == task_subtype_external_grav) {
@@ -2146,8 +2156,6 @@ int cell_unskip_gravity_tasks(struct cell *c, struct scheduler *s) {
     if (c->grav.down_in != NULL) scheduler_activate(s, c->grav.down_in);
     if (c->grav.long_range != NULL) scheduler_activate(s, c->grav.long_range);
     if (c->grav.end_force != NULL) scheduler_activate(s, c->grav.end_force);
-    if (c->grav.neutrino_weight != NULL)
-      scheduler_activate(s, c->grav.neutrino_weight);
 #ifdef WITH_CSDS
     if (c->csds != NULL) scheduler_activate(s, c->csds);
 #endif
@@ -139,6 +139,43 @@ __attribute__((always_inline)) INLINE static void runner_iact_nonsym_chemistry(
   }
 }
 
+/**
+ * @brief Metal mass exchanged by diffusion between two particles, one
+ * element after the other.
+ *
+ * The elements are stored contiguously and are independent of each other,
+ * such that the loop is vectorised across the elements.
+ *
+ * @param metal_mass_i The metal masses of particle i.
+ * @param metal_mass_j The metal masses of particle j.
+ * @param inv_mi The inverse of the mass of particle i.
+ * @param inv_mj The inverse of the mass of particle j.
+ * @param coef_i The diffusion factor of particle i.
+ * @param coef_j The diffusion factor of particle j.
+ * @param metal_mass_dt_i (return) The metal mass variations of particle i.
+ * @param metal_mass_dt_j (return) The metal mass variations of particle j,
+ * NULL for the non-symmetric version.
+ */
+__attribute__((always_inline)) INLINE static void chemistry_diffusion_flux(
+    const double *restrict metal_mass_i, const double *restrict metal_mass_j,
+    const float inv_mi, const float inv_mj, const float coef_i,
+    const float coef_j, double *restrict metal_mass_dt_i,
+    double *restrict metal_mass_dt_j) {
+
+  if (metal_mass_dt_j == NULL) {
+    for (int i = 0; i < GEAR_CHEMISTRY_ELEMENT_COUNT; i++) {
+      const double dm = metal_mass_i[i] * inv_mi - metal_mass_j[i] * inv_mj;
+      metal_mass_dt_i[i] += coef_i * dm;
+    }
+  } else {
+    for (int i = 0; i < GEAR_CHEMISTRY_ELEMENT_COUNT; i++) {
+      const double dm = metal_mass_i[i] * inv_mi - metal_mass_j[i] * inv_mj;
+      metal_mass_dt_i[i] += coef_i * dm;
+      metal_mass_dt_j[i] -= coef_j * dm;
+    }
+  }
+}
+
 /**
  * @brief do metal diffusion computation in the <FORCE LOOP>
  * (symmetric version)
@@ -178,8 +215,9 @@ __attribute__((always_inline)) INLINE static void runner_iact_diffusion(
 
     float wi, wj, dwi_dx, dwj_dx;
 
-    /* Get r */
+    /* Get r and 1/r */
     const float r = sqrtf(r2);
+    const float r_inv = 1.f / r;
 
     /* part j */
     /* Get the kernel for hj */
@@ -197,9 +235,6 @@ __attribute__((always_inline)) INLINE static void runner_iact_diffusion(
     const float xi = r * hi_inv;
     kernel_deval(xi, &wi, &dwi_dx);
 
-    /* Get 1/r */
-    const float r_inv = 1.f / sqrtf(r2);
-
     const float wi_dr = dwi_dx * r_inv;
     const float wj_dr = dwj_dx * r_inv;
 
@@ -207,21 +242,15 @@ __attribute__((always_inline)) INLINE static void runner_iact_diffusion(
     const float mi_dw_r = mi * wj_dr;
 
     /* Compute the diffusion coefficient <D> / <rho> in physical units. */
-    const float coef = 2. * (chi->diff_coef + chj->diff_coef) / (rhoi + rhoj);
+    const float coef = 2.f * (chi->diff_coef + chj->diff_coef) / (rhoi + rhoj);
 
     const float coef_i = coef * mj_dw_r;
     const float coef_j = coef * mi_dw_r;
 
     /* Compute the time derivative */
-    const float inv_mi = 1.f / hydro_get_mass(pi);
-    const float inv_mj = 1.f / hydro_get_mass(pj);
-    for (int i = 0; i < GEAR_CHEMISTRY_ELEMENT_COUNT; i++) {
-      const double mi_frac = chi->metal_mass[i] * inv_mi;
-      const double mj_frac = chj->metal_mass[i] * inv_mj;
-      const double dm = mi_frac - mj_frac;
-      chi->metal_mass_dt[i] += coef_i * dm;
-      chj->metal_mass_dt[i] -= coef_j * dm;
-    }
+    chemistry_diffusion_flux(chi->metal_mass, chj->metal_mass, 1.f / mi,
+                             1.f / mj, coef_i, coef_j, chi->metal_mass_dt,
+                             chj->metal_mass_dt);
   }
 }
 
@@ -262,8 +291,9 @@ __attribute__((always_inline)) INLINE static void runner_iact_nonsym_diffusion(
 
     float wi, dwi_dx;
 
-    /* Get r */
+    /* Get r and 1/r */
     const float r = sqrtf(r2);
+    const float r_inv = 1.f / r;
 
     /* part i */
     /* Get the kernel for hi */
@@ -273,26 +303,20 @@ __attribute__((always_inline)) INLINE static void runner_iact_nonsym_diffusion(
     const float xi = r * hi_inv;
     kernel_deval(xi, &wi, &dwi_dx);
 
-    /* Get 1/r */
-    const float r_inv = 1.f / sqrtf(r2);
     const float wi_dr = dwi_dx * r_inv;
 
     const float mj_dw_r = mj * wi_dr;
 
     /* Compute the diffusion coefficient <D> / <rho> in physical units. */
-    const float coef = 2. * (chi->diff_coef + chj->diff_coef) / (rhoi + rhoj);
+    const float coef = 2.f * (chi->diff_coef + chj->diff_coef) / (rhoi + rhoj);
 
     const float coef_i = coef * mj_dw_r;
 
     /* Compute the time derivative */
-    const float inv_mi = 1.f / hydro_get_mass(pi);
-    const float inv_mj = 1.f / hydro_get_mass(pj);
-    for (int i = 0; i < GEAR_CHEMISTRY_ELEMENT_COUNT; i++) {
-      const double mi_frac = chi->metal_mass[i] * inv_mi;
-      const double mj_frac = chj->metal_mass[i] * inv_mj;
-      const double dm = mi_frac - mj_frac;
-      chi->metal_mass_dt[i] += coef_i * dm;
-    }
+    chemistry_diffusion_flux(chi->metal_mass, chj->metal_mass,
+                             1.f / hydro_get_mass(pi), 1.f / mj, coef_i,
+                             /*coef_j=*/0.f, chi->metal_mass_dt,
+                             /*metal_mass_dt_j=*/NULL);
   }
 }
 
@@ -77,6 +77,14 @@ static MPI_Datatype mpicollectgroup1_type;
  */
 static MPI_Op mpicollectgroup1_reduce_op;
 
+/**
+ * @brief The local and reduced #mpicollectgroup1 of the reduction in flight
+ * and its request.
+ */
+static struct mpicollectgroup1 mpicollectgroup1_send;
+static struct mpicollectgroup1 mpicollectgroup1_recv;
+static MPI_Request mpicollectgroup1_req = MPI_REQUEST_NULL;
+
 #endif
 
 /**
@@ -263,6 +271,21 @@ void collectgroup1_init(
  */
 void collectgroup1_reduce(struct collectgroup1 *grp1) {
 
+  collectgroup1_reduce_begin(grp1);
+  collectgroup1_reduce_end(grp1);
+}
+
+/**
+ * @brief Start the reduction of the group across all nodes.
+ *
+ * The reduction runs in the background, the group must not be used until
+ * collectgroup1_reduce_end() has been called.
+ *
+ * @param grp1 the #collectgroup1 struct already initialised by a call
+ *             to collectgroup1_init.
+ */
+void collectgroup1_reduce_begin(const struct collectgroup1 *grp1) {
+
 #ifdef WITH_MPI
 
   /* Populate an MPI group struct and reduce this across all nodes. */
@@ -301,10 +324,27 @@ void collectgroup1_reduce(struct collectgroup1 *grp1) {
   mpigrp11.csds_file_size_gb = grp1->csds_file_size_gb;
 #endif
 
-  struct mpicollectgroup1 mpigrp12;
-  if (MPI_Allreduce(&mpigrp11, &mpigrp12, 1, mpicollectgroup1_type,
-                    mpicollectgroup1_reduce_op, MPI_COMM_WORLD) != MPI_SUCCESS)
+  mpicollectgroup1_send = mpigrp11;
+  if (MPI_Iallreduce(&mpicollectgroup1_send, &mpicollectgroup1_recv, 1,
+                     mpicollectgroup1_type, mpicollectgroup1_reduce_op,
+                     MPI_COMM_WORLD, &mpicollectgroup1_req) != MPI_SUCCESS)
+    error("Failed to reduce mpicollection1.");
+#endif
+}
+
+/**
+ * @brief Wait for the reduction started by collectgroup1_reduce_begin() and
+ * store its result in the group.
+ *
+ * @param grp1 the #collectgroup1 struct whose reduction was started.
+ */
+void collectgroup1_reduce_end(struct collectgroup1 *grp1) {
+
+#ifdef WITH_MPI
+
+  if (MPI_Wait(&mpicollectgroup1_req, MPI_STATUS_IGNORE) != MPI_SUCCESS)
     error("Failed to reduce mpicollection1.");
+  const struct mpicollectgroup1 mpigrp12 = mpicollectgroup1_recv;
 
   /* And update. */
   grp1->updated = mpigrp12.updated;
@@ -94,6 +94,8 @@ void collectgroup1_init(
     const struct star_formation_history sfh, float runtime,
     int flush_lightcone_maps, double deadtime, float csds_file_size_gb);
 void collectgroup1_reduce(struct collectgroup1 *grp1);
+void collectgroup1_reduce_begin(const struct collectgroup1 *grp1);
+void collectgroup1_reduce_end(struct collectgroup1 *grp1);
 #ifdef WITH_MPI
 void mpicollect_free_MPI_type(void);
 #endif
@@ -69,6 +69,75 @@
 #include <mpi.h>
 #endif
 
+/*! Maximal size in bytes of the buffer used to read a field of the ICs (0
+ * to read each field in one go). */
+size_t io_read_buffer_size = 0;
+
+/**
+ * @brief Returns the number of particles of a field to read in one pass.
+ *
+ * The pass is limited by #io_read_buffer_size such that the temporary
+ * buffer used to convert the data never exceeds this size.
+ *
+ * @param N The number of particles left to read.
+ * @param element_size The size in bytes of the field of one particle.
+ */
+size_t io_read_chunk_length(const size_t N, const size_t element_size) {
+
+  if (io_read_buffer_size == 0) return N;
+
+  size_t length = io_read_buffer_size / element_size;
+  if (length == 0) length = 1;
+  return (N < length) ? N : length;
+}
+
+/**
+ * @brief Decide on the (log2 of the) number of rows in the chunks of the
+ * particle datasets.
+ *
+ * By default, chunks of 2^20 rows are used. With Snapshots:cell_sized_chunks
+ * the chunks are instead sized to the power of two at most equal to the mean
+ * number of particles per top-level cell (clamped to [2^10, 2^20]). As the
+ * particles of a cell are contiguous in the file, reading one cell then only
+ * requires decompressing a few chunks.
+ *
+ * @param e The #engine.
+ * @param N The number of rows in the dataset.
+ * @param nr_cells The number of top-level cells whose particles are in the
+ * dataset.
+ */
+int io_log2_chunk_size(const struct engine* e, const long long N,
+                       const int nr_cells) {
+
+  const int log2_max_chunk_size = 20;
+  const int log2_min_chunk_size = 10;
+
+  if (!e->snapshot_cell_sized_chunks || nr_cells <= 0)
+    return log2_max_chunk_size;
+
+  const long long mean_count = N / nr_cells;
+  int log2_chunk_size = log2_min_chunk_size;
+  while (log2_chunk_size < log2_max_chunk_size &&
+         (1LL << (log2_chunk_size + 1)) <= mean_count)
+    log2_chunk_size++;
+  return log2_chunk_size;
+}
+
+/**
+ * @brief The seed of the random selection of the sub-sampled particles.
+ *
+ * By default the selection is drawn anew for each snapshot. With
+ * Snapshots:subsample_same_particles the draw only depends on the particle ID
+ * such that all the snapshots contain the same particles and those written
+ * with a smaller fraction are a subset of those written with a larger one.
+ *
+ * @param e The #engine.
+ */
+int io_get_subsample_seed(const struct engine* e) {
+
+  return e->snapshot_subsample_same_particles ? 0 : e->snapshot_output_count;
+}
+
 /**
  * @brief Converts a C data type to the HDF5 equivalent.
  *
@@ -77,7 +77,14 @@ enum IO_DATA_TYPE {
 /* Library header */
 #include <hdf5.h>
 
+/*! Maximal size in bytes of the buffer used to read a field of the ICs */
+extern size_t io_read_buffer_size;
+
 hid_t io_hdf5_type(enum IO_DATA_TYPE type);
+size_t io_read_chunk_length(const size_t N, const size_t element_size);
+int io_log2_chunk_size(const struct engine* e, const long long N,
+                       const int nr_cells);
+int io_get_subsample_seed(const struct engine* e);
 
 hsize_t io_get_number_element_in_attribute(hid_t attr);
 hsize_t io_get_number_element_in_dataset(hid_t dataset);
@@ -125,6 +132,12 @@ void io_write_cell_offsets(hid_t h_grp, const int cdim[3], const double dim[3],
                            const int num_fields[swift_type_count],
                            const struct unit_system* internal_units,
                            const struct unit_system* snapshot_units);
+long long io_count_cells_particles(hid_t h_file, const int ptype,
+                                   const int* cells, const int nr_cells);
+long long io_read_cells_field(hid_t h_file, const int ptype,
+                              const char* field_name, const int* cells,
+                              const int nr_cells, const enum IO_DATA_TYPE type,
+                              const int dimension, void* buffer);
 
 void io_read_unit_system(hid_t h_file, struct unit_system* ic_units,
                          const struct unit_system* internal_units,
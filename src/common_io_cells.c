@@ -759,4 +759,170 @@ void io_write_cell_offsets(hid_t h_grp, const int cdim[3], const double dim[3],
   free(max_nupart_pos);
 }
 
+/**
+ * @brief Read one of the per-cell meta-data arrays for a set of cells.
+ *
+ * @param h_file The open snapshot file.
+ * @param group The name of the sub-group of /Cells to read from.
+ * @param ptype The particle type.
+ * @param cells The indices of the top-level cells to read.
+ * @param nr_cells The number of cells to read.
+ * @param values (return) The values for each of the requested cells.
+ */
+static void io_read_cells_meta_data(hid_t h_file, const char* group,
+                                    const int ptype, const int* cells,
+                                    const int nr_cells, long long* values) {
+
+  char name[64];
+  snprintf(name, sizeof(name), "/Cells/%s/PartType%d", group, ptype);
+  const hid_t h_data = H5Dopen(h_file, name, H5P_DEFAULT);
+  if (h_data < 0) error("Error while opening cell meta-data '%s'.", name);
+
+  /* The arrays are small (one element per top-level cell) so read them all */
+  const hid_t h_space = H5Dget_space(h_data);
+  const hssize_t total_nr_cells = H5Sget_simple_extent_npoints(h_space);
+  H5Sclose(h_space);
+  if (total_nr_cells < 0)
+    error("Error while reading the size of cell meta-data '%s'.", name);
+
+  long long* all_values =
+      (long long*)malloc(sizeof(long long) * (total_nr_cells + 1));
+  if (all_values == NULL) error("Error allocating memory for '%s'.", name);
+  const herr_t h_err = H5Dread(h_data, io_hdf5_type(LONGLONG), H5S_ALL,
+                               H5S_ALL, H5P_DEFAULT, all_values);
+  if (h_err < 0) error("Error while reading cell meta-data '%s'.", name);
+  H5Dclose(h_data);
+
+  for (int i = 0; i < nr_cells; ++i) {
+    if (cells[i] < 0 || cells[i] >= total_nr_cells)
+      error("Invalid cell index %d (the snapshot has %lld cells).", cells[i],
+            (long long)total_nr_cells);
+    values[i] = all_values[cells[i]];
+  }
+  free(all_values);
+}
+
+/**
+ * @brief Count the particles of a given type in a set of top-level cells.
+ *
+ * Uses the cell meta-data written by io_write_cell_offsets() to the
+ * snapshot. This can be used to size the buffer passed to
+ * io_read_cells_field().
+ *
+ * @param h_file The open snapshot file.
+ * @param ptype The particle type.
+ * @param cells The indices of the top-level cells.
+ * @param nr_cells The number of cells.
+ */
+long long io_count_cells_particles(hid_t h_file, const int ptype,
+                                   const int* cells, const int nr_cells) {
+
+  if (nr_cells == 0) return 0;
+
+  long long* counts = (long long*)malloc(sizeof(long long) * nr_cells);
+  if (counts == NULL) error("Error allocating memory for cell counts.");
+  io_read_cells_meta_data(h_file, "Counts", ptype, cells, nr_cells, counts);
+
+  long long total = 0;
+  for (int i = 0; i < nr_cells; ++i) total += counts[i];
+  free(counts);
+  return total;
+}
+
+/**
+ * @brief Read one field of the particles in a set of top-level cells.
+ *
+ * Only the rows of the dataset belonging to the requested cells are
+ * read, using the cell counts and offsets written by
+ * io_write_cell_offsets(). The data is read by HDF5 straight into the
+ * caller's buffer without any intermediate copy. Consecutive cells which
+ * are also contiguous in the file are read with a single hyperslab.
+ *
+ * The particles are returned in the order of the cells in the list and
+ * the values are in the snapshot units. The offsets are relative to the
+ * file being read, so with distributed snapshots each file must be read
+ * with the cells it holds (see /Cells/Files).
+ *
+ * @param h_file The open snapshot file.
+ * @param ptype The particle type.
+ * @param field_name The name of the field (e.g. "Coordinates").
+ * @param cells The indices of the top-level cells to read.
+ * @param nr_cells The number of cells to read.
+ * @param type The type of the data in memory.
+ * @param dimension The number of components of the field.
+ * @param buffer (return) The data. Must be large enough for
+ * io_count_cells_particles() x dimension elements.
+ *
+ * @return The number of particles read.
+ */
+long long io_read_cells_field(hid_t h_file, const int ptype,
+                              const char* field_name, const int* cells,
+                              const int nr_cells, const enum IO_DATA_TYPE type,
+                              const int dimension, void* buffer) {
+
+  if (nr_cells == 0) return 0;
+
+  /* Where are the particles of each cell? */
+  long long* counts = (long long*)malloc(sizeof(long long) * nr_cells);
+  long long* offsets = (long long*)malloc(sizeof(long long) * nr_cells);
+  if (counts == NULL || offsets == NULL)
+    error("Error allocating memory for cell counts and offsets.");
+  io_read_cells_meta_data(h_file, "Counts", ptype, cells, nr_cells, counts);
+  io_read_cells_meta_data(h_file, "OffsetsInFile", ptype, cells, nr_cells,
+                          offsets);
+
+  /* Open the field */
+  char name[256];
+  snprintf(name, sizeof(name), "/PartType%d/%s", ptype, field_name);
+  const hid_t h_data = H5Dopen(h_file, name, H5P_DEFAULT);
+  if (h_data < 0) error("Error while opening data space for '%s'.", name);
+
+  const hid_t h_filespace = H5Dget_space(h_data);
+  const int rank = H5Sget_simple_extent_ndims(h_filespace);
+  hsize_t shape[2] = {0, 1};
+  H5Sget_simple_extent_dims(h_filespace, shape, NULL);
+  if ((rank == 1 && dimension != 1) ||
+      (rank == 2 && shape[1] != (hsize_t)dimension))
+    error("Field '%s' does not have %d components.", name, dimension);
+
+  const size_t row_size = io_sizeof_type(type) * dimension;
+  char* dest = (char*)buffer;
+  long long nr_read = 0;
+
+  for (int i = 0; i < nr_cells;) {
+
+    /* Merge the following cells as long as they are contiguous in the file */
+    long long start = offsets[i];
+    long long count = counts[i];
+    int j = i + 1;
+    while (j < nr_cells && offsets[j] == start + count) count += counts[j++];
+    i = j;
+
+    if (count == 0) continue;
+    if (start < 0 || (hsize_t)(start + count) > shape[0])
+      error("Cell rows [%lld, %lld) are out of range for '%s'.", start,
+            start + count, name);
+
+    const hsize_t h_start[2] = {(hsize_t)start, 0};
+    const hsize_t h_count[2] = {(hsize_t)count, (hsize_t)dimension};
+    H5Sselect_hyperslab(h_filespace, H5S_SELECT_SET, h_start, NULL, h_count,
+                        NULL);
+    const hid_t h_memspace = H5Screate_simple(rank, h_count, NULL);
+
+    const herr_t h_err = H5Dread(h_data, io_hdf5_type(type), h_memspace,
+                                 h_filespace, H5P_DEFAULT, dest);
+    if (h_err < 0) error("Error while reading data array '%s'.", name);
+    H5Sclose(h_memspace);
+
+    dest += count * row_size;
+    nr_read += count;
+  }
+
+  H5Sclose(h_filespace);
+  H5Dclose(h_data);
+  free(counts);
+  free(offsets);
+  return nr_read;
+}
+
 #endif /* HAVE_HDF5 */
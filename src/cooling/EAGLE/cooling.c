@@ -43,6 +43,7 @@
 #include "hydro.h"
 #include "interpolate.h"
 #include "io_properties.h"
+#include "memuse_shared.h"
 #include "parser.h"
 #include "part.h"
 #include "physical_constants.h"
@@ -163,28 +164,32 @@ void cooling_update(const struct phys_const *phys_const,
   /* Do we already have the correct tables loaded? */
   if (cooling->z_index == z_index) return;
 
-  /* Which table should we load ? */
-  if (z_index >= eagle_cooling_N_redshifts) {
+  /* Which table should we load? If the tables are shared, only one rank
+   * of the node reads them. */
+  if (memuse_shared_fill_begin()) {
+    if (z_index >= eagle_cooling_N_redshifts) {
 
-    if (z_index == eagle_cooling_N_redshifts + 1) {
+      if (z_index == eagle_cooling_N_redshifts + 1) {
 
-      /* Bewtween re-ionization and first table */
-      get_redshift_invariant_table(cooling, /* photodis=*/0);
+        /* Bewtween re-ionization and first table */
+        get_redshift_invariant_table(cooling, /* photodis=*/0);
 
-    } else {
+      } else {
 
-      /* Above re-ionization */
-      get_redshift_invariant_table(cooling, /* photodis=*/1);
-    }
+        /* Above re-ionization */
+        get_redshift_invariant_table(cooling, /* photodis=*/1);
+      }
 
-  } else {
+    } else {
 
-    /* Normal case: two tables bracketing the current z */
-    const int low_z_index = z_index;
-    const int high_z_index = z_index + 1;
+      /* Normal case: two tables bracketing the current z */
+      const int low_z_index = z_index;
+      const int high_z_index = z_index + 1;
 
-    get_cooling_table(cooling, low_z_index, high_z_index);
+      get_cooling_table(cooling, low_z_index, high_z_index);
+    }
   }
+  memuse_shared_fill_end();
 
   /* Store the currently loaded index */
   cooling->z_index = z_index;
@@ -1142,11 +1147,12 @@ void cooling_clean(struct cooling_function_data *cooling) {
   swift_free("cooling", cooling->SolarAbundances_inv);
 
   /* Free the tables */
-  swift_free("cooling-tables", cooling->table.metal_heating);
-  swift_free("cooling-tables", cooling->table.electron_abundance);
-  swift_free("cooling-tables", cooling->table.temperature);
-  swift_free("cooling-tables", cooling->table.H_plus_He_heating);
-  swift_free("cooling-tables", cooling->table.H_plus_He_electron_abundance);
+  memuse_shared_free("cooling-tables", cooling->table.metal_heating);
+  memuse_shared_free("cooling-tables", cooling->table.electron_abundance);
+  memuse_shared_free("cooling-tables", cooling->table.temperature);
+  memuse_shared_free("cooling-tables", cooling->table.H_plus_He_heating);
+  memuse_shared_free("cooling-tables",
+                     cooling->table.H_plus_He_electron_abundance);
 }
 
 /**
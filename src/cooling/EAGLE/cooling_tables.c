@@ -37,6 +37,7 @@
 #include "cooling_tables.h"
 #include "error.h"
 #include "interpolate.h"
+#include "memuse_shared.h"
 
 /**
  * @brief Names of the elements in the order they are stored in the files
@@ -316,40 +317,42 @@ void allocate_cooling_tables(struct cooling_function_data *restrict cooling) {
 
   /* Allocate arrays to store cooling tables. Arrays contain two tables of
    * cooling rates with one table being for the redshift above current redshift
-   * and one below. */
+   * and one below. They are shared by the ranks of a node if asked for. */
 
-  if (swift_memalign("cooling-tables", (void **)&cooling->table.metal_heating,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     eagle_cooling_N_loaded_redshifts *
-                         num_elements_metal_heating * sizeof(float)) != 0)
+  if (memuse_shared_memalign(
+          "cooling-tables", (void **)&cooling->table.metal_heating,
+          SWIFT_STRUCT_ALIGNMENT,
+          eagle_cooling_N_loaded_redshifts * num_elements_metal_heating *
+              sizeof(float)) != 0)
     error("Failed to allocate metal_heating array");
 
-  if (swift_memalign("cooling-tables",
-                     (void **)&cooling->table.electron_abundance,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     eagle_cooling_N_loaded_redshifts *
-                         num_elements_electron_abundance * sizeof(float)) != 0)
+  if (memuse_shared_memalign(
+          "cooling-tables", (void **)&cooling->table.electron_abundance,
+          SWIFT_STRUCT_ALIGNMENT,
+          eagle_cooling_N_loaded_redshifts * num_elements_electron_abundance *
+              sizeof(float)) != 0)
     error("Failed to allocate electron_abundance array");
 
-  if (swift_memalign("cooling-tables", (void **)&cooling->table.temperature,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     eagle_cooling_N_loaded_redshifts *
-                         num_elements_temperature * sizeof(float)) != 0)
+  if (memuse_shared_memalign(
+          "cooling-tables", (void **)&cooling->table.temperature,
+          SWIFT_STRUCT_ALIGNMENT,
+          eagle_cooling_N_loaded_redshifts * num_elements_temperature *
+              sizeof(float)) != 0)
     error("Failed to allocate temperature array");
 
-  if (swift_memalign("cooling-tables",
-                     (void **)&cooling->table.H_plus_He_heating,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     eagle_cooling_N_loaded_redshifts *
-                         num_elements_HpHe_heating * sizeof(float)) != 0)
+  if (memuse_shared_memalign(
+          "cooling-tables", (void **)&cooling->table.H_plus_He_heating,
+          SWIFT_STRUCT_ALIGNMENT,
+          eagle_cooling_N_loaded_redshifts * num_elements_HpHe_heating *
+              sizeof(float)) != 0)
     error("Failed to allocate H_plus_He_heating array");
 
-  if (swift_memalign("cooling-tables",
-                     (void **)&cooling->table.H_plus_He_electron_abundance,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     eagle_cooling_N_loaded_redshifts *
-                         num_elements_HpHe_electron_abundance *
-                         sizeof(float)) != 0)
+  if (memuse_shared_memalign(
+          "cooling-tables",
+          (void **)&cooling->table.H_plus_He_electron_abundance,
+          SWIFT_STRUCT_ALIGNMENT,
+          eagle_cooling_N_loaded_redshifts *
+              num_elements_HpHe_electron_abundance * sizeof(float)) != 0)
     error("Failed to allocate H_plus_He_electron_abundance array");
 }
 
@@ -45,6 +45,7 @@
 #include "hydro.h"
 #include "interpolate.h"
 #include "io_properties.h"
+#include "memuse_shared.h"
 #include "parser.h"
 #include "part.h"
 #include "physical_constants.h"
@@ -80,6 +81,10 @@ void cooling_update(const struct phys_const *phys_const,
                     struct cooling_function_data *cooling, struct space *s,
                     const double time) {
 
+  /* Read the redshifts of the tables we are about to use */
+  if (cooling->lazy_redshift_tables)
+    read_cooling_tables_around_redshift(cooling, cosmo->z);
+
   /* Extra energy for reionization? */
   if (!cooling->H_reion_done) {
 
@@ -513,7 +518,9 @@ double cooling_get_ycompton(const struct phys_const *phys_const,
 }
 
 /**
- * @brief Bisection integration scheme
+ * @brief Brackets the solution of the implicit cooling problem.
+ *
+ * First step of bisection_iter().
  *
  * @param u_ini_cgs Internal energy at beginning of hydro step in CGS.
  * @param n_H_cgs Hydrogen number density in CGS.
@@ -530,14 +537,18 @@ double cooling_get_ycompton(const struct phys_const *phys_const,
  * @param abundance_ratio Array of ratios of metal abundance to solar.
  * @param dt_cgs timestep in CGS.
  * @param ID ID of the particle (for debugging).
+ * @param u_lower (return) Lower bound of the solution.
+ * @param u_upper (return) Upper bound of the solution.
+ *
+ * @return 1 if the solution is the minimal energy, 0 otherwise.
  */
-static INLINE double bisection_iter(
+static INLINE int bisection_bracket(
     const double u_ini_cgs, const double n_H_cgs, const double redshift,
     int n_H_index, float d_n_H, int met_index, float d_met, int red_index,
     float d_red, double Lambda_He_reion_cgs, double ratefact_cgs,
     const struct cooling_function_data *cooling,
     const float abundance_ratio[colibre_cooling_N_elementtypes], double dt_cgs,
-    long long ID) {
+    long long ID, double *u_lower, double *u_upper) {
 
   /* Bracketing */
   double u_lower_cgs = max(u_ini_cgs, cooling->umin_cgs);
@@ -588,7 +599,7 @@ static INLINE double bisection_iter(
       /* If the energy is below or equal the minimum energy and we are still
        * cooling, return the minimum energy */
       if ((u_lower_cgs <= cooling->umin_cgs) && (LambdaNet_cgs < 0.))
-        return cooling->umin_cgs;
+        return 1;
 
       i++;
     }
@@ -660,6 +671,47 @@ static INLINE double bisection_iter(
     }
   }
 
+  *u_lower = u_lower_cgs;
+  *u_upper = u_upper_cgs;
+  return 0;
+}
+
+/**
+ * @brief Bisection integration scheme
+ *
+ * @param u_ini_cgs Internal energy at beginning of hydro step in CGS.
+ * @param n_H_cgs Hydrogen number density in CGS.
+ * @param redshift Current redshift.
+ * @param n_H_index Particle hydrogen number density index.
+ * @param d_n_H Particle hydrogen number density offset.
+ * @param met_index Particle metallicity index.
+ * @param d_met Particle metallicity offset.
+ * @param red_index Redshift index.
+ * @param d_red Redshift offset.
+ * @param Lambda_He_reion_cgs Cooling rate coming from He reionization.
+ * @param ratefact_cgs Multiplication factor to get a cooling rate.
+ * @param cooling #cooling_function_data structure.
+ * @param abundance_ratio Array of ratios of metal abundance to solar.
+ * @param dt_cgs timestep in CGS.
+ * @param ID ID of the particle (for debugging).
+ */
+static INLINE double bisection_iter(
+    const double u_ini_cgs, const double n_H_cgs, const double redshift,
+    int n_H_index, float d_n_H, int met_index, float d_met, int red_index,
+    float d_red, double Lambda_He_reion_cgs, double ratefact_cgs,
+    const struct cooling_function_data *cooling,
+    const float abundance_ratio[colibre_cooling_N_elementtypes], double dt_cgs,
+    long long ID) {
+
+  /* Bracketing */
+  double u_lower_cgs, u_upper_cgs;
+  if (bisection_bracket(u_ini_cgs, n_H_cgs, redshift, n_H_index, d_n_H,
+                        met_index, d_met, red_index, d_red,
+                        Lambda_He_reion_cgs, ratefact_cgs, cooling,
+                        abundance_ratio, dt_cgs, ID, &u_lower_cgs,
+                        &u_upper_cgs))
+    return cooling->umin_cgs;
+
   /********************************************/
   /* We now have an upper and lower bound.    */
   /* Let's iterate by reducing the bracketing */
@@ -675,7 +727,7 @@ static INLINE double bisection_iter(
     u_next_cgs = 0.5 * (u_lower_cgs + u_upper_cgs);
 
     /* New rate */
-    LambdaNet_cgs =
+    const double LambdaNet_cgs =
         Lambda_He_reion_cgs +
         colibre_cooling_rate(log10(u_next_cgs), redshift, n_H_cgs,
                              abundance_ratio, n_H_index, d_n_H, met_index,
@@ -699,82 +751,80 @@ static INLINE double bisection_iter(
 }
 
 /**
- * @brief Apply the cooling function to a particle.
- *
- * We want to compute u_new such that u_new = u_old + dt * du/dt(u_new, X),
- * where X stands for the metallicity, density and redshift. These are
- * kept constant.
- *
- * We first compute du/dt(u_old). If dt * du/dt(u_old) is small enough, we
- * use an explicit integration and use this as our solution.
- *
- * Otherwise, we try to find a solution to the implicit time-integration
- * problem. This leads to the root-finding problem:
- *
- * f(u_new) = u_new - u_old - dt * du/dt(u_new, X) = 0
- *
- * A bisection scheme is used.
- * This is done by first bracketing the solution and then iterating
- * towards the solution by reducing the window down to a certain tolerance.
- * Note there is always at least one solution since
- * f(+inf) is < 0 and f(-inf) is > 0.
+ * @brief What the solver needs to know about a particle, fixed over the
+ * iterations.
+ */
+struct cooling_solver_state {
+
+  /*! Internal energy at the last kick step */
+  float u_start;
+
+  /*! Internal energy at the end of the next kick step */
+  double u_0;
+
+  /*! The same in CGS */
+  double u_0_cgs;
+
+  /*! Time-step in CGS */
+  double dt_cgs;
+
+  /*! Hydrogen number density in CGS */
+  double n_H_cgs;
+
+  /*! Multiplication factor to get a cooling rate */
+  double ratefact_cgs;
+
+  /*! Cooling rate coming from He reionization */
+  double Lambda_He_reion_cgs;
+
+  /*! Ratios of metal abundance to solar */
+  float abundance_ratio[colibre_cooling_N_elementtypes];
+
+  /*! Metallicity and density indices and offsets in the tables */
+  float d_met, d_n_H;
+  int met_index, n_H_index;
+};
+
+/**
+ * @brief Compute the quantities of a particle that do not depend on its
+ * final internal energy.
  *
  * @param phys_const The physical constants in internal units.
  * @param us The internal system of units.
  * @param cosmo The current cosmological model.
  * @param hydro_properties the hydro_props struct
- * @param floor_props Properties of the entropy floor.
- * @param pressure_floor Properties of the pressure floor.
  * @param cooling The #cooling_function_data used in the run.
  * @param p Pointer to the particle data.
  * @param xp Pointer to the extended particle data.
  * @param dt The cooling time-step of this particle.
  * @param dt_therm The hydro time-step of this particle.
- * @param time Time since Big Bang
+ * @param s (return) The state of the solver for this particle.
  */
-void cooling_cool_part(const struct phys_const *phys_const,
-                       const struct unit_system *us,
-                       const struct cosmology *cosmo,
-                       const struct hydro_props *hydro_properties,
-                       const struct entropy_floor_properties *floor_props,
-                       const struct pressure_floor_props *pressure_floor,
-                       const struct cooling_function_data *cooling,
-                       struct part *p, struct xpart *xp, const float dt,
-                       const float dt_therm, const double time) {
-
-  /* No cooling happens over zero time */
-  if (dt == 0.) {
-
-    /* But we still set the subgrid properties to a valid state */
-    cooling_set_particle_subgrid_properties(
-        phys_const, us, cosmo, hydro_properties, floor_props, cooling, p, xp);
-
-    return;
-  }
-
-#ifdef SWIFT_DEBUG_CHECKS
-  if (cooling->Redshifts == NULL)
-    error(
-        "Cooling function has not been initialised. Did you forget the "
-        "--cooling runtime flag?");
-#endif
+static INLINE void cooling_solver_state_init(
+    const struct phys_const *phys_const, const struct unit_system *us,
+    const struct cosmology *cosmo, const struct hydro_props *hydro_properties,
+    const struct cooling_function_data *cooling, const struct part *p,
+    const struct xpart *xp, const float dt, const float dt_therm,
+    struct cooling_solver_state *s) {
 
   /* Get internal energy at the last kick step */
-  const float u_start = hydro_get_physical_internal_energy(p, xp, cosmo);
+  s->u_start = hydro_get_physical_internal_energy(p, xp, cosmo);
 
   /* Get the change in internal energy due to hydro forces */
   const float hydro_du_dt = hydro_get_physical_internal_energy_dt(p, cosmo);
 
   /* Get internal energy at the end of the next kick step (assuming dt does not
    * increase) */
-  double u_0 = (u_start + hydro_du_dt * dt_therm);
+  double u_0 = (s->u_start + hydro_du_dt * dt_therm);
 
   /* Check for minimal energy */
   u_0 = max(u_0, hydro_properties->minimal_internal_energy);
+  s->u_0 = u_0;
 
   /* Convert to CGS units */
-  const double u_0_cgs = u_0 * cooling->internal_energy_to_cgs;
+  s->u_0_cgs = u_0 * cooling->internal_energy_to_cgs;
   const double dt_cgs = dt * units_cgs_conversion_factor(us, UNIT_CONV_TIME);
+  s->dt_cgs = dt_cgs;
 
   /* Change in redshift over the course of this time-step
      (See cosmology theory document for the derivation) */
@@ -784,8 +834,7 @@ void cooling_cool_part(const struct phys_const *phys_const,
    * Note that we need to add S and Ca that are in the tables but not tracked
    * by the particles themselves.
    * The order is [H, He, C, N, O, Ne, Mg, Si, S, Ca, Fe, OA] */
-  float abundance_ratio[colibre_cooling_N_elementtypes];
-  float logZZsol = abundance_ratio_to_solar(p, cooling, abundance_ratio);
+  float logZZsol = abundance_ratio_to_solar(p, cooling, s->abundance_ratio);
 
   /* Get the Hydrogen and Helium mass fractions */
   float const *metal_fraction =
@@ -796,24 +845,19 @@ void cooling_cool_part(const struct phys_const *phys_const,
   const double n_H =
       hydro_get_physical_density(p, cosmo) * XH / phys_const->const_proton_mass;
   const double n_H_cgs = n_H * cooling->number_density_to_cgs;
+  s->n_H_cgs = n_H_cgs;
 
   /* ratefact = n_H * n_H / rho; Might lead to round-off error: replaced by
    * equivalent expression  below */
   const double ratefact_cgs = n_H_cgs * (XH * cooling->inv_proton_mass_cgs);
+  s->ratefact_cgs = ratefact_cgs;
 
-  /* compute hydrogen number density, metallicity and redshift indices and
-   * offsets (These are fixed for any value of u, so no need to recompute them)
-   */
-
-  float d_red, d_met, d_n_H;
-  int red_index, met_index, n_H_index;
-
-  get_index_1d(cooling->Redshifts, colibre_cooling_N_redshifts, cosmo->z,
-               &red_index, &d_red);
+  /* compute hydrogen number density and metallicity indices and offsets
+   * (These are fixed for any value of u, so no need to recompute them) */
   get_index_1d(cooling->Metallicity, colibre_cooling_N_metallicity, logZZsol,
-               &met_index, &d_met);
+               &s->met_index, &s->d_met);
   get_index_1d(cooling->nH, colibre_cooling_N_density, log10(n_H_cgs),
-               &n_H_index, &d_n_H);
+               &s->n_H_index, &s->d_n_H);
 
   /* Start by computing the cooling (heating actually) rate from Helium
      re-ionization as this needs to be added on no matter what */
@@ -823,32 +867,71 @@ void cooling_cool_part(const struct phys_const *phys_const,
       eagle_helium_reionization_extraheat(cosmo->z, delta_redshift, cooling);
 
   /* Convert this into a rate */
-  const double Lambda_He_reion_cgs =
-      Helium_reion_heat_cgs / (dt_cgs * ratefact_cgs);
+  s->Lambda_He_reion_cgs = Helium_reion_heat_cgs / (dt_cgs * ratefact_cgs);
+}
 
-  /* Let's compute the internal energy at the end of the step */
-  double u_final_cgs;
+/**
+ * @brief Try an explicit integration of the cooling of a particle.
+ *
+ * @param cosmo The current cosmological model.
+ * @param cooling The #cooling_function_data used in the run.
+ * @param s The state of the solver for this particle.
+ * @param red_index Redshift index.
+ * @param d_red Redshift offset.
+ * @param u_final_cgs (return) The internal energy at the end of the step in
+ * CGS, if the explicit solution is good enough.
+ * @return 1 if the explicit solution is taken, 0 if the implicit problem
+ * must be solved.
+ */
+static INLINE int cooling_solver_explicit(
+    const struct cosmology *cosmo, const struct cooling_function_data *cooling,
+    const struct cooling_solver_state *s, const int red_index,
+    const float d_red, double *u_final_cgs) {
 
   /* First try an explicit integration (note we ignore the derivative) */
   const double LambdaNet_cgs =
-      Lambda_He_reion_cgs +
-      colibre_cooling_rate(log10(u_0_cgs), cosmo->z, n_H_cgs, abundance_ratio,
-                           n_H_index, d_n_H, met_index, d_met, red_index, d_red,
-                           cooling, 0, 0, 0, 0);
+      s->Lambda_He_reion_cgs +
+      colibre_cooling_rate(log10(s->u_0_cgs), cosmo->z, s->n_H_cgs,
+                           s->abundance_ratio, s->n_H_index, s->d_n_H,
+                           s->met_index, s->d_met, red_index, d_red, cooling,
+                           0, 0, 0, 0);
 
   /* if cooling rate is small, take the explicit solution */
-  if (fabs(ratefact_cgs * LambdaNet_cgs * dt_cgs) <
-      explicit_tolerance * u_0_cgs) {
+  if (fabs(s->ratefact_cgs * LambdaNet_cgs * s->dt_cgs) <
+      explicit_tolerance * s->u_0_cgs) {
 
-    u_final_cgs = u_0_cgs + ratefact_cgs * LambdaNet_cgs * dt_cgs;
+    *u_final_cgs = s->u_0_cgs + s->ratefact_cgs * LambdaNet_cgs * s->dt_cgs;
+    return 1;
+  }
+  return 0;
+}
 
-  } else {
+/**
+ * @brief Apply the internal energy at the end of the step to a particle.
+ *
+ * @param phys_const The physical constants in internal units.
+ * @param us The internal system of units.
+ * @param cosmo The current cosmological model.
+ * @param hydro_properties the hydro_props struct
+ * @param floor_props Properties of the entropy floor.
+ * @param pressure_floor Properties of the pressure floor.
+ * @param cooling The #cooling_function_data used in the run.
+ * @param p Pointer to the particle data.
+ * @param xp Pointer to the extended particle data.
+ * @param dt_therm The hydro time-step of this particle.
+ * @param s The state of the solver for this particle.
+ * @param u_final_cgs The internal energy at the end of the step in CGS.
+ */
+static INLINE void cooling_solver_finish(
+    const struct phys_const *phys_const, const struct unit_system *us,
+    const struct cosmology *cosmo, const struct hydro_props *hydro_properties,
+    const struct entropy_floor_properties *floor_props,
+    const struct pressure_floor_props *pressure_floor,
+    const struct cooling_function_data *cooling, struct part *p,
+    struct xpart *xp, const float dt_therm,
+    const struct cooling_solver_state *s, const double u_final_cgs) {
 
-    u_final_cgs =
-        bisection_iter(u_0_cgs, n_H_cgs, cosmo->z, n_H_index, d_n_H, met_index,
-                       d_met, red_index, d_red, Lambda_He_reion_cgs,
-                       ratefact_cgs, cooling, abundance_ratio, dt_cgs, p->id);
-  }
+  const float u_start = s->u_start;
 
   /* Convert back to internal units */
   double u_final = u_final_cgs * cooling->internal_energy_from_cgs;
@@ -901,13 +984,249 @@ void cooling_cool_part(const struct phys_const *phys_const,
   }
 
   /* Store the radiated energy */
-  xp->cooling_data.radiated_energy -= hydro_get_mass(p) * (u_final - u_0);
+  xp->cooling_data.radiated_energy -= hydro_get_mass(p) * (u_final - s->u_0);
 
   /* set subgrid properties and hydrogen fractions */
   cooling_set_particle_subgrid_properties(
       phys_const, us, cosmo, hydro_properties, floor_props, cooling, p, xp);
 }
 
+/**
+ * @brief Apply the cooling function to a particle.
+ *
+ * We want to compute u_new such that u_new = u_old + dt * du/dt(u_new, X),
+ * where X stands for the metallicity, density and redshift. These are
+ * kept constant.
+ *
+ * We first compute du/dt(u_old). If dt * du/dt(u_old) is small enough, we
+ * use an explicit integration and use this as our solution.
+ *
+ * Otherwise, we try to find a solution to the implicit time-integration
+ * problem. This leads to the root-finding problem:
+ *
+ * f(u_new) = u_new - u_old - dt * du/dt(u_new, X) = 0
+ *
+ * A bisection scheme is used.
+ * This is done by first bracketing the solution and then iterating
+ * towards the solution by reducing the window down to a certain tolerance.
+ * Note there is always at least one solution since
+ * f(+inf) is < 0 and f(-inf) is > 0.
+ *
+ * @param phys_const The physical constants in internal units.
+ * @param us The internal system of units.
+ * @param cosmo The current cosmological model.
+ * @param hydro_properties the hydro_props struct
+ * @param floor_props Properties of the entropy floor.
+ * @param pressure_floor Properties of the pressure floor.
+ * @param cooling The #cooling_function_data used in the run.
+ * @param p Pointer to the particle data.
+ * @param xp Pointer to the extended particle data.
+ * @param dt The cooling time-step of this particle.
+ * @param dt_therm The hydro time-step of this particle.
+ * @param time Time since Big Bang
+ */
+void cooling_cool_part(const struct phys_const *phys_const,
+                       const struct unit_system *us,
+                       const struct cosmology *cosmo,
+                       const struct hydro_props *hydro_properties,
+                       const struct entropy_floor_properties *floor_props,
+                       const struct pressure_floor_props *pressure_floor,
+                       const struct cooling_function_data *cooling,
+                       struct part *p, struct xpart *xp, const float dt,
+                       const float dt_therm, const double time) {
+
+  /* No cooling happens over zero time */
+  if (dt == 0.) {
+
+    /* But we still set the subgrid properties to a valid state */
+    cooling_set_particle_subgrid_properties(
+        phys_const, us, cosmo, hydro_properties, floor_props, cooling, p, xp);
+
+    return;
+  }
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (cooling->Redshifts == NULL)
+    error(
+        "Cooling function has not been initialised. Did you forget the "
+        "--cooling runtime flag?");
+#endif
+
+  /* The redshift is the same for all the particles */
+  float d_red;
+  int red_index;
+  get_index_1d(cooling->Redshifts, colibre_cooling_N_redshifts, cosmo->z,
+               &red_index, &d_red);
+
+  struct cooling_solver_state s;
+  cooling_solver_state_init(phys_const, us, cosmo, hydro_properties, cooling,
+                            p, xp, dt, dt_therm, &s);
+
+  /* Let's compute the internal energy at the end of the step */
+  double u_final_cgs;
+  if (!cooling_solver_explicit(cosmo, cooling, &s, red_index, d_red,
+                               &u_final_cgs)) {
+
+    u_final_cgs = bisection_iter(
+        s.u_0_cgs, s.n_H_cgs, cosmo->z, s.n_H_index, s.d_n_H, s.met_index,
+        s.d_met, red_index, d_red, s.Lambda_He_reion_cgs, s.ratefact_cgs,
+        cooling, s.abundance_ratio, s.dt_cgs, p->id);
+  }
+
+  cooling_solver_finish(phys_const, us, cosmo, hydro_properties, floor_props,
+                        pressure_floor, cooling, p, xp, dt_therm, &s,
+                        u_final_cgs);
+}
+
+/**
+ * @brief Apply the cooling function to a batch of particles.
+ *
+ * Gives the same result as cooling_cool_part() called on each of them, but
+ * the implicit problems of the batch are solved together: the bisections
+ * advance in lockstep over the particles that have not converged yet, such
+ * that the independent table interpolations of a pass follow each other
+ * and the converged particles drop out of the next passes.
+ *
+ * @param phys_const The physical constants in internal units.
+ * @param us The internal system of units.
+ * @param cosmo The current cosmological model.
+ * @param hydro_properties the hydro_props struct
+ * @param floor_props Properties of the entropy floor.
+ * @param pressure_floor Properties of the pressure floor.
+ * @param cooling The #cooling_function_data used in the run.
+ * @param p Pointers to the particle data of the batch.
+ * @param xp Pointers to the extended particle data of the batch.
+ * @param dt The cooling time-steps of the particles of the batch.
+ * @param dt_therm The hydro time-steps of the particles of the batch.
+ * @param count The number of particles in the batch, at most
+ * #colibre_cooling_batch_size.
+ * @param time Time since Big Bang
+ */
+void cooling_cool_parts(const struct phys_const *phys_const,
+                        const struct unit_system *us,
+                        const struct cosmology *cosmo,
+                        const struct hydro_props *hydro_properties,
+                        const struct entropy_floor_properties *floor_props,
+                        const struct pressure_floor_props *pressure_floor,
+                        const struct cooling_function_data *cooling,
+                        struct part **p, struct xpart **xp,
+                        const float *dt, const float *dt_therm,
+                        const int count, const double time) {
+
+  if (count > colibre_cooling_batch_size)
+    error("Batch of %d particles larger than colibre_cooling_batch_size.",
+          count);
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (cooling->Redshifts == NULL)
+    error(
+        "Cooling function has not been initialised. Did you forget the "
+        "--cooling runtime flag?");
+#endif
+
+  /* The redshift is the same for all the particles */
+  float d_red;
+  int red_index;
+  get_index_1d(cooling->Redshifts, colibre_cooling_N_redshifts, cosmo->z,
+               &red_index, &d_red);
+
+  struct cooling_solver_state s[colibre_cooling_batch_size];
+  double u_final_cgs[colibre_cooling_batch_size];
+  double u_lower_cgs[colibre_cooling_batch_size];
+  double u_upper_cgs[colibre_cooling_batch_size];
+  double u_next_cgs[colibre_cooling_batch_size];
+  double LambdaNet_cgs[colibre_cooling_batch_size];
+
+  /* The particles left to the implicit solver */
+  int todo[colibre_cooling_batch_size];
+  int nr_todo = 0;
+
+  for (int k = 0; k < count; k++) {
+
+    /* No cooling happens over zero time */
+    if (dt[k] == 0.) {
+
+      /* But we still set the subgrid properties to a valid state */
+      cooling_set_particle_subgrid_properties(
+          phys_const, us, cosmo, hydro_properties, floor_props, cooling, p[k],
+          xp[k]);
+      continue;
+    }
+
+    cooling_solver_state_init(phys_const, us, cosmo, hydro_properties,
+                              cooling, p[k], xp[k], dt[k], dt_therm[k],
+                              &s[k]);
+
+    if (cooling_solver_explicit(cosmo, cooling, &s[k], red_index, d_red,
+                                &u_final_cgs[k]))
+      continue;
+
+    /* Bracketing */
+    if (bisection_bracket(s[k].u_0_cgs, s[k].n_H_cgs, cosmo->z,
+                          s[k].n_H_index, s[k].d_n_H, s[k].met_index,
+                          s[k].d_met, red_index, d_red,
+                          s[k].Lambda_He_reion_cgs, s[k].ratefact_cgs,
+                          cooling, s[k].abundance_ratio, s[k].dt_cgs, p[k]->id,
+                          &u_lower_cgs[k], &u_upper_cgs[k])) {
+      u_final_cgs[k] = cooling->umin_cgs;
+      continue;
+    }
+
+    todo[nr_todo++] = k;
+  }
+
+  /* Bisection iterations of all the particles left */
+  for (int i = 0; nr_todo > 0; i++) {
+
+    /* New guesses */
+    for (int j = 0; j < nr_todo; j++) {
+      const int k = todo[j];
+      u_next_cgs[k] = 0.5 * (u_lower_cgs[k] + u_upper_cgs[k]);
+    }
+
+    /* New rates */
+    for (int j = 0; j < nr_todo; j++) {
+      const int k = todo[j];
+      LambdaNet_cgs[k] =
+          s[k].Lambda_He_reion_cgs +
+          colibre_cooling_rate(log10(u_next_cgs[k]), cosmo->z, s[k].n_H_cgs,
+                               s[k].abundance_ratio, s[k].n_H_index,
+                               s[k].d_n_H, s[k].met_index, s[k].d_met,
+                               red_index, d_red, cooling, 0, 0, 0, 0);
+    }
+
+    /* Where do we go next? Keep the particles not converged yet */
+    int nr_left = 0;
+    for (int j = 0; j < nr_todo; j++) {
+      const int k = todo[j];
+      if (u_next_cgs[k] - s[k].u_0_cgs -
+              LambdaNet_cgs[k] * s[k].ratefact_cgs * s[k].dt_cgs >
+          0.0) {
+        u_upper_cgs[k] = u_next_cgs[k];
+      } else {
+        u_lower_cgs[k] = u_next_cgs[k];
+      }
+
+      if (i + 1 >= bisection_max_iterations)
+        error("Particle id %llu failed to converge", p[k]->id);
+
+      if (fabs(u_upper_cgs[k] - u_lower_cgs[k]) / u_next_cgs[k] >
+          bisection_tolerance)
+        todo[nr_left++] = k;
+      else
+        u_final_cgs[k] = u_upper_cgs[k];
+    }
+    nr_todo = nr_left;
+  }
+
+  for (int k = 0; k < count; k++) {
+    if (dt[k] == 0.) continue;
+    cooling_solver_finish(phys_const, us, cosmo, hydro_properties,
+                          floor_props, pressure_floor, cooling, p[k], xp[k],
+                          dt_therm[k], &s[k], u_final_cgs[k]);
+  }
+}
+
 /**
  * @brief Computes the cooling time-step.
  *
@@ -1588,6 +1907,10 @@ void cooling_init_backend(struct swift_params *parameter_file,
   cooling->rapid_cooling_threshold = parser_get_param_double(
       parameter_file, "PS2020Cooling:rapid_cooling_threshold");
 
+  /* Only read the redshifts of the tables once they are needed? */
+  cooling->lazy_redshift_tables = parser_get_opt_param_int(
+      parameter_file, "PS2020Cooling:lazy_redshift_tables", 0);
+
   /* Finally, read the tables */
   read_cooling_header(cooling);
   read_cooling_tables(cooling);
@@ -1648,21 +1971,21 @@ void cooling_clean(struct cooling_function_data *cooling) {
   free(cooling->MassFractions);
 
   /* Free the tables */
-  swift_free("cooling_table.Tcooling", cooling->table.Tcooling);
-  swift_free("cooling_table.Ucooling", cooling->table.Ucooling);
-  swift_free("cooling_table.Theating", cooling->table.Theating);
-  swift_free("cooling_table.Uheating", cooling->table.Uheating);
-  swift_free("cooling_table.Tefrac", cooling->table.Telectron_fraction);
-  swift_free("cooling_table.Uefrac", cooling->table.Uelectron_fraction);
-  swift_free("cooling_table.TfromU", cooling->table.T_from_U);
-  swift_free("cooling_table.UfromT", cooling->table.U_from_T);
-  swift_free("cooling_table.Umu", cooling->table.Umu);
-  swift_free("cooling_table.Tmu", cooling->table.Tmu);
-  swift_free("cooling_table.mueq", cooling->table.meanpartmass_Teq);
-  swift_free("cooling_table.Hfracs", cooling->table.logHfracs_Teq);
-  swift_free("cooling_table.Hfracs", cooling->table.logHfracs_all);
-  swift_free("cooling_table.Teq", cooling->table.logTeq);
-  swift_free("cooling_table.Peq", cooling->table.logPeq);
+  memuse_shared_free("cooling_table.Tcooling", cooling->table.Tcooling);
+  memuse_shared_free("cooling_table.Ucooling", cooling->table.Ucooling);
+  memuse_shared_free("cooling_table.Theating", cooling->table.Theating);
+  memuse_shared_free("cooling_table.Uheating", cooling->table.Uheating);
+  memuse_shared_free("cooling_table.Tefrac", cooling->table.Telectron_fraction);
+  memuse_shared_free("cooling_table.Uefrac", cooling->table.Uelectron_fraction);
+  memuse_shared_free("cooling_table.TfromU", cooling->table.T_from_U);
+  memuse_shared_free("cooling_table.UfromT", cooling->table.U_from_T);
+  memuse_shared_free("cooling_table.Umu", cooling->table.Umu);
+  memuse_shared_free("cooling_table.Tmu", cooling->table.Tmu);
+  memuse_shared_free("cooling_table.mueq", cooling->table.meanpartmass_Teq);
+  memuse_shared_free("cooling_table.Hfracs", cooling->table.logHfracs_Teq);
+  memuse_shared_free("cooling_table.Hfracs", cooling->table.logHfracs_all);
+  memuse_shared_free("cooling_table.Teq", cooling->table.logTeq);
+  memuse_shared_free("cooling_table.Peq", cooling->table.logPeq);
 }
 
 /**
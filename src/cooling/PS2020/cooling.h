@@ -28,6 +28,9 @@
 #include "cooling_properties.h"
 #include "cooling_tables.h"
 
+/*! Number of particles cooled together by cooling_cool_parts() */
+#define colibre_cooling_batch_size 32
+
 struct part;
 struct xpart;
 struct cosmology;
@@ -53,6 +56,17 @@ void cooling_cool_part(const struct phys_const *phys_const,
                        struct part *p, struct xpart *xp, const float dt,
                        const float dt_therm, const double time);
 
+void cooling_cool_parts(const struct phys_const *phys_const,
+                        const struct unit_system *us,
+                        const struct cosmology *cosmo,
+                        const struct hydro_props *hydro_properties,
+                        const struct entropy_floor_properties *floor_props,
+                        const struct pressure_floor_props *pressure_floor,
+                        const struct cooling_function_data *cooling,
+                        struct part **p, struct xpart **xp,
+                        const float *dt, const float *dt_therm,
+                        const int count, const double time);
+
 float cooling_timestep(const struct cooling_function_data *cooling,
                        const struct phys_const *phys_const,
                        const struct cosmology *cosmo,
@@ -120,6 +120,14 @@ struct cooling_function_data {
   /*! Filepath to the directory containing the HDF5 cooling tables */
   char cooling_table_path[colibre_table_path_name_length];
 
+  /*! Only read the redshifts of the tables when cooling_update() needs
+   * them? */
+  int lazy_redshift_tables;
+
+  /*! Range of the redshift indices of the tables read so far (empty if
+   * first > last) */
+  int z_index_first, z_index_last;
+
   /* Distance from EOS to use thermal equilibrium temperature for subgrid props
    */
   float dlogT_EOS;
@@ -40,6 +40,8 @@
 #include "error.h"
 #include "exp10.h"
 #include "interpolate.h"
+#include "memuse_shared.h"
+#include "minmax.h"
 
 /**
  * @brief Reads in PS2020 cooling table header. Consists of tables
@@ -232,17 +234,68 @@ void read_cooling_header(struct cooling_function_data *cooling) {
 #endif
 }
 
+#ifdef HAVE_HDF5
 /**
- * @brief Allocate space for cooling tables and read them
+ * @brief Read a range of redshifts of one of the cooling tables.
  *
- * @param cooling #cooling_function_data structure
+ * The redshift is the slowest-varying axis of all the tables, such that the
+ * range is a contiguous block of both the dataset and the array.
+ *
+ * @param dataset The open dataset.
+ * @param table The array for the whole table.
+ * @param z_first The first redshift index to read.
+ * @param z_last The last redshift index to read.
+ *
+ * @return The status of H5Dread().
  */
-void read_cooling_tables(struct cooling_function_data *restrict cooling) {
+static herr_t read_cooling_table_redshifts(const hid_t dataset, float *table,
+                                           const int z_first,
+                                           const int z_last) {
+
+  const hid_t file_space = H5Dget_space(dataset);
+  if (file_space < 0) error("Error getting the space of a cooling table");
+  const int rank = H5Sget_simple_extent_ndims(file_space);
+  if (rank < 1 || rank > 8)
+    error("Unexpected rank %d of a cooling table", rank);
+
+  hsize_t dims[8], start[8], count[8];
+  H5Sget_simple_extent_dims(file_space, dims, NULL);
+  if (dims[0] != colibre_cooling_N_redshifts)
+    error("Cooling table has %lld redshifts rather than %d",
+          (long long)dims[0], colibre_cooling_N_redshifts);
+
+  /* Select the redshifts, and all of the other axes */
+  hsize_t slice_size = 1;
+  for (int k = 1; k < rank; k++) {
+    start[k] = 0;
+    count[k] = dims[k];
+    slice_size *= dims[k];
+  }
+  start[0] = z_first;
+  count[0] = z_last - z_first + 1;
+  H5Sselect_hyperslab(file_space, H5S_SELECT_SET, start, NULL, count, NULL);
+  const hid_t mem_space = H5Screate_simple(rank, count, NULL);
+
+  const herr_t status =
+      H5Dread(dataset, H5T_NATIVE_FLOAT, mem_space, file_space, H5P_DEFAULT,
+              table + z_first * slice_size);
+
+  H5Sclose(mem_space);
+  H5Sclose(file_space);
+  return status;
+}
 
-  /* Abort early if we were not using the cooling module */
-  if (strcmp(cooling->cooling_table_path, "") == 0) return;
+/**
+ * @brief Read a range of redshifts of the cooling tables into their arrays.
+ *
+ * @param cooling #cooling_function_data structure
+ * @param z_first The first redshift index to read.
+ * @param z_last The last redshift index to read.
+ */
+static void read_cooling_tables_data(
+    struct cooling_function_data *restrict cooling, const int z_first,
+    const int z_last) {
 
-#ifdef HAVE_HDF5
   hid_t dataset;
   herr_t status;
 
@@ -252,113 +305,57 @@ void read_cooling_tables(struct cooling_function_data *restrict cooling) {
   if (tempfile_id < 0)
     error("unable to open file %s\n", cooling->cooling_table_path);
 
-  /* Allocate and read arrays to store cooling tables. */
+  /* Read the arrays of the cooling tables. */
 
   /* Mean particle mass (temperature) */
-  if (swift_memalign("cooling_table.Tmu", (void **)&cooling->table.Tmu,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     colibre_cooling_N_redshifts *
-                         colibre_cooling_N_temperature *
-                         colibre_cooling_N_metallicity *
-                         colibre_cooling_N_density * sizeof(float)) != 0)
-    error("Failed to allocate Tmu array\n");
-
   dataset = H5Dopen(tempfile_id, "/Tdep/MeanParticleMass", H5P_DEFAULT);
-  status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                   cooling->table.Tmu);
+  status = read_cooling_table_redshifts(dataset, cooling->table.Tmu, z_first,
+                                        z_last);
   if (status < 0) error("error reading Tmu\n");
   status = H5Dclose(dataset);
   if (status < 0) error("error closing mean particle mass dataset");
 
   /* Mean particle mass (internal energy) */
-  if (swift_memalign("cooling_table.Umu", (void **)&cooling->table.Umu,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     colibre_cooling_N_redshifts *
-                         colibre_cooling_N_internalenergy *
-                         colibre_cooling_N_metallicity *
-                         colibre_cooling_N_density * sizeof(float)) != 0)
-    error("Failed to allocate Umu array\n");
-
   dataset = H5Dopen(tempfile_id, "/Udep/MeanParticleMass", H5P_DEFAULT);
-  status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                   cooling->table.Umu);
+  status = read_cooling_table_redshifts(dataset, cooling->table.Umu, z_first,
+                                        z_last);
   if (status < 0) error("error reading Umu\n");
   status = H5Dclose(dataset);
   if (status < 0) error("error closing mean particle mass dataset");
 
   /* Cooling (temperature) */
-  if (swift_memalign(
-          "cooling_table.Tcooling", (void **)&cooling->table.Tcooling,
-          SWIFT_STRUCT_ALIGNMENT,
-          colibre_cooling_N_redshifts * colibre_cooling_N_temperature *
-              colibre_cooling_N_metallicity * colibre_cooling_N_density *
-              colibre_cooling_N_cooltypes * sizeof(float)) != 0)
-    error("Failed to allocate Tcooling array\n");
-
   dataset = H5Dopen(tempfile_id, "/Tdep/Cooling", H5P_DEFAULT);
-  status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                   cooling->table.Tcooling);
+  status = read_cooling_table_redshifts(dataset, cooling->table.Tcooling,
+                                        z_first, z_last);
   if (status < 0) error("error reading Tcooling\n");
   status = H5Dclose(dataset);
   if (status < 0) error("error closing cooling dataset");
 
   /* Cooling (internal energy) */
-  if (swift_memalign(
-          "cooling_table.Ucooling", (void **)&cooling->table.Ucooling,
-          SWIFT_STRUCT_ALIGNMENT,
-          colibre_cooling_N_redshifts * colibre_cooling_N_internalenergy *
-              colibre_cooling_N_metallicity * colibre_cooling_N_density *
-              colibre_cooling_N_cooltypes * sizeof(float)) != 0)
-    error("Failed to allocate Ucooling array\n");
-
   dataset = H5Dopen(tempfile_id, "/Udep/Cooling", H5P_DEFAULT);
-  status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                   cooling->table.Ucooling);
+  status = read_cooling_table_redshifts(dataset, cooling->table.Ucooling,
+                                        z_first, z_last);
   if (status < 0) error("error reading Ucooling\n");
   status = H5Dclose(dataset);
   if (status < 0) error("error closing cooling dataset");
 
   /* Heating (temperature) */
-  if (swift_memalign(
-          "cooling_table.Theating", (void **)&cooling->table.Theating,
-          SWIFT_STRUCT_ALIGNMENT,
-          colibre_cooling_N_redshifts * colibre_cooling_N_temperature *
-              colibre_cooling_N_metallicity * colibre_cooling_N_density *
-              colibre_cooling_N_heattypes * sizeof(float)) != 0)
-    error("Failed to allocate Theating array\n");
-
   dataset = H5Dopen(tempfile_id, "/Tdep/Heating", H5P_DEFAULT);
-  status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                   cooling->table.Theating);
+  status = read_cooling_table_redshifts(dataset, cooling->table.Theating,
+                                        z_first, z_last);
   if (status < 0) error("error reading Theating\n");
   status = H5Dclose(dataset);
   if (status < 0) error("error closing cooling dataset");
 
   /* Heating (internal energy) */
-  if (swift_memalign(
-          "cooling_table.Uheating", (void **)&cooling->table.Uheating,
-          SWIFT_STRUCT_ALIGNMENT,
-          colibre_cooling_N_redshifts * colibre_cooling_N_internalenergy *
-              colibre_cooling_N_metallicity * colibre_cooling_N_density *
-              colibre_cooling_N_heattypes * sizeof(float)) != 0)
-    error("Failed to allocate Uheating array\n");
-
   dataset = H5Dopen(tempfile_id, "/Udep/Heating", H5P_DEFAULT);
-  status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                   cooling->table.Uheating);
+  status = read_cooling_table_redshifts(dataset, cooling->table.Uheating,
+                                        z_first, z_last);
   if (status < 0) error("error reading Uheating\n");
   status = H5Dclose(dataset);
   if (status < 0) error("error closing cooling dataset");
 
   /* Electron fraction (temperature) */
-  if (swift_memalign(
-          "cooling_table.Tefrac", (void **)&cooling->table.Telectron_fraction,
-          SWIFT_STRUCT_ALIGNMENT,
-          colibre_cooling_N_redshifts * colibre_cooling_N_temperature *
-              colibre_cooling_N_metallicity * colibre_cooling_N_density *
-              colibre_cooling_N_electrontypes * sizeof(float)) != 0)
-    error("Failed to allocate Telectron_fraction array\n");
-
   /* Dataset is named /Tdep/ElectronFractions in the published version of the
    * tables and for historical reasons /Tdep/ElectronFractionsVol in the version
    * used in the PS2020 repository. Content is identical but we deal
@@ -372,21 +369,13 @@ void read_cooling_tables(struct cooling_function_data *restrict cooling) {
     error("Could not find the electron_fraction (temperature)!");
   }
 
-  status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                   cooling->table.Telectron_fraction);
+  status = read_cooling_table_redshifts(
+      dataset, cooling->table.Telectron_fraction, z_first, z_last);
   if (status < 0) error("error reading electron_fraction (temperature)\n");
   status = H5Dclose(dataset);
   if (status < 0) error("error closing cooling dataset");
 
   /* Electron fraction (internal energy) */
-  if (swift_memalign(
-          "cooling_table.Uefrac", (void **)&cooling->table.Uelectron_fraction,
-          SWIFT_STRUCT_ALIGNMENT,
-          colibre_cooling_N_redshifts * colibre_cooling_N_internalenergy *
-              colibre_cooling_N_metallicity * colibre_cooling_N_density *
-              colibre_cooling_N_electrontypes * sizeof(float)) != 0)
-    error("Failed to allocate Uelectron_fraction array\n");
-
   /* Dataset is named /Udep/ElectronFractions in the published version of the
    * tables and for historical reasons /Udep/ElectronFractionsVol in the version
    * used in the PS2020 repository. Content is identical but we deal
@@ -400,102 +389,56 @@ void read_cooling_tables(struct cooling_function_data *restrict cooling) {
     error("Could not find the electron_fraction (internal energy)!");
   }
 
-  status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                   cooling->table.Uelectron_fraction);
+  status = read_cooling_table_redshifts(
+      dataset, cooling->table.Uelectron_fraction, z_first, z_last);
   if (status < 0) error("error reading electron_fraction (internal energy)\n");
   status = H5Dclose(dataset);
   if (status < 0) error("error closing cooling dataset");
 
   /* Internal energy from temperature */
-  if (swift_memalign("cooling_table.UfromT", (void **)&cooling->table.U_from_T,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     colibre_cooling_N_redshifts *
-                         colibre_cooling_N_temperature *
-                         colibre_cooling_N_metallicity *
-                         colibre_cooling_N_density * sizeof(float)) != 0)
-    error("Failed to allocate U_from_T array\n");
-
   dataset = H5Dopen(tempfile_id, "/Tdep/U_from_T", H5P_DEFAULT);
-  status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                   cooling->table.U_from_T);
+  status = read_cooling_table_redshifts(dataset, cooling->table.U_from_T,
+                                        z_first, z_last);
   if (status < 0) error("error reading U_from_T array\n");
   status = H5Dclose(dataset);
   if (status < 0) error("error closing cooling dataset");
 
   /* Temperature from interal energy */
-  if (swift_memalign("cooling_table.TfromU", (void **)&cooling->table.T_from_U,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     colibre_cooling_N_redshifts *
-                         colibre_cooling_N_internalenergy *
-                         colibre_cooling_N_metallicity *
-                         colibre_cooling_N_density * sizeof(float)) != 0)
-    error("Failed to allocate T_from_U array\n");
-
   dataset = H5Dopen(tempfile_id, "/Udep/T_from_U", H5P_DEFAULT);
-  status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                   cooling->table.T_from_U);
+  status = read_cooling_table_redshifts(dataset, cooling->table.T_from_U,
+                                        z_first, z_last);
   if (status < 0) error("error reading T_from_U array\n");
   status = H5Dclose(dataset);
   if (status < 0) error("error closing cooling dataset");
 
   /* Thermal equilibrium temperature */
-  if (swift_memalign("cooling_table.Teq", (void **)&cooling->table.logTeq,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     colibre_cooling_N_redshifts *
-                         colibre_cooling_N_metallicity *
-                         colibre_cooling_N_density * sizeof(float)) != 0)
-    error("Failed to allocate logTeq array\n");
-
   dataset = H5Dopen(tempfile_id, "/ThermEq/Temperature", H5P_DEFAULT);
-  status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                   cooling->table.logTeq);
+  status = read_cooling_table_redshifts(dataset, cooling->table.logTeq, z_first,
+                                        z_last);
   if (status < 0) error("error reading Teq array\n");
   status = H5Dclose(dataset);
   if (status < 0) error("error closing logTeq dataset");
 
   /* Mean particle mass at thermal equilibrium temperature */
-  if (swift_memalign(
-          "cooling_table.mueq", (void **)&cooling->table.meanpartmass_Teq,
-          SWIFT_STRUCT_ALIGNMENT,
-
-          colibre_cooling_N_redshifts * colibre_cooling_N_metallicity *
-              colibre_cooling_N_density * sizeof(float)) != 0)
-    error("Failed to allocate mu array\n");
-
   dataset = H5Dopen(tempfile_id, "/ThermEq/MeanParticleMass", H5P_DEFAULT);
-  status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                   cooling->table.meanpartmass_Teq);
+  status = read_cooling_table_redshifts(
+      dataset, cooling->table.meanpartmass_Teq, z_first, z_last);
   if (status < 0) error("error reading mu array\n");
   status = H5Dclose(dataset);
   if (status < 0) error("error closing mu dataset");
 
   /* Hydrogen fractions at thermal equilibirum temperature */
-  if (swift_memalign(
-          "cooling_table.Hfracs", (void **)&cooling->table.logHfracs_Teq,
-          SWIFT_STRUCT_ALIGNMENT,
-          colibre_cooling_N_redshifts * colibre_cooling_N_metallicity *
-              colibre_cooling_N_density * 3 * sizeof(float)) != 0)
-    error("Failed to allocate hydrogen fractions array\n");
-
   dataset = H5Dopen(tempfile_id, "/ThermEq/HydrogenFractionsVol", H5P_DEFAULT);
-  status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                   cooling->table.logHfracs_Teq);
+  status = read_cooling_table_redshifts(dataset, cooling->table.logHfracs_Teq,
+                                        z_first, z_last);
   if (status < 0) error("error reading hydrogen fractions array\n");
   status = H5Dclose(dataset);
   if (status < 0) error("error closing hydrogen fractions dataset");
 
   /* All hydrogen fractions */
-  if (swift_memalign(
-          "cooling_table.Hfracs", (void **)&cooling->table.logHfracs_all,
-          SWIFT_STRUCT_ALIGNMENT,
-          colibre_cooling_N_redshifts * colibre_cooling_N_temperature *
-              colibre_cooling_N_metallicity * colibre_cooling_N_density * 3 *
-              sizeof(float)) != 0)
-    error("Failed to allocate big hydrogen fractions array\n");
-
   dataset = H5Dopen(tempfile_id, "/Tdep/HydrogenFractionsVol", H5P_DEFAULT);
-  status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                   cooling->table.logHfracs_all);
+  status = read_cooling_table_redshifts(dataset, cooling->table.logHfracs_all,
+                                        z_first, z_last);
   if (status < 0) error("error reading big hydrogen fractions array\n");
   status = H5Dclose(dataset);
   if (status < 0) error("error closing big hydrogen fractions dataset");
@@ -504,17 +447,10 @@ void read_cooling_tables(struct cooling_function_data *restrict cooling) {
   H5Fclose(tempfile_id);
 
   /* Pressure at thermal equilibrium temperature */
-  if (swift_memalign("cooling_table.Peq", (void **)&cooling->table.logPeq,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     colibre_cooling_N_redshifts *
-                         colibre_cooling_N_metallicity *
-                         colibre_cooling_N_density * sizeof(float)) != 0)
-    error("Failed to allocate logPeq array\n");
-
   const float log10_kB_cgs = cooling->log10_kB_cgs;
 
   /* Compute the pressures at thermal eq. */
-  for (int ired = 0; ired < colibre_cooling_N_redshifts; ired++) {
+  for (int ired = z_first; ired <= z_last; ired++) {
     for (int imet = 0; imet < colibre_cooling_N_metallicity; imet++) {
 
       const int index_XH =
@@ -535,6 +471,188 @@ void read_cooling_tables(struct cooling_function_data *restrict cooling) {
       }
     }
   }
+}
+#endif
+
+/**
+ * @brief Read a range of redshifts of the cooling tables, on one rank of the
+ * node if they are shared.
+ *
+ * @param cooling #cooling_function_data structure
+ * @param z_first The first redshift index to read.
+ * @param z_last The last redshift index to read, must extend the range read
+ * so far.
+ */
+static void read_cooling_tables_redshifts(
+    struct cooling_function_data *restrict cooling, const int z_first,
+    const int z_last) {
+
+#ifdef HAVE_HDF5
+  if (memuse_shared_fill_begin())
+    read_cooling_tables_data(cooling, z_first, z_last);
+  memuse_shared_fill_end();
+
+  cooling->z_index_first = min(cooling->z_index_first, z_first);
+  cooling->z_index_last = max(cooling->z_index_last, z_last);
+#else
+  error("Need HDF5 to read cooling tables");
+#endif
+}
+
+/**
+ * @brief Allocate space for cooling tables and read them
+ *
+ * The tables are shared by the ranks of a node if asked for, and then read
+ * by one of them.
+ *
+ * @param cooling #cooling_function_data structure
+ */
+void read_cooling_tables(struct cooling_function_data *restrict cooling) {
+
+  /* Abort early if we were not using the cooling module */
+  if (strcmp(cooling->cooling_table_path, "") == 0) return;
+
+#ifdef HAVE_HDF5
+
+  /* Allocate arrays to store cooling tables. */
+
+  /* Mean particle mass (temperature) */
+  if (memuse_shared_memalign(
+          "cooling_table.Tmu", (void **)&cooling->table.Tmu,
+          SWIFT_STRUCT_ALIGNMENT,
+          colibre_cooling_N_redshifts * colibre_cooling_N_temperature *
+              colibre_cooling_N_metallicity * colibre_cooling_N_density *
+              sizeof(float)) != 0)
+    error("Failed to allocate Tmu array\n");
+
+  /* Mean particle mass (internal energy) */
+  if (memuse_shared_memalign(
+          "cooling_table.Umu", (void **)&cooling->table.Umu,
+          SWIFT_STRUCT_ALIGNMENT,
+          colibre_cooling_N_redshifts * colibre_cooling_N_internalenergy *
+              colibre_cooling_N_metallicity * colibre_cooling_N_density *
+              sizeof(float)) != 0)
+    error("Failed to allocate Umu array\n");
+
+  /* Cooling (temperature) */
+  if (memuse_shared_memalign(
+          "cooling_table.Tcooling", (void **)&cooling->table.Tcooling,
+          SWIFT_STRUCT_ALIGNMENT,
+          colibre_cooling_N_redshifts * colibre_cooling_N_temperature *
+              colibre_cooling_N_metallicity * colibre_cooling_N_density *
+              colibre_cooling_N_cooltypes * sizeof(float)) != 0)
+    error("Failed to allocate Tcooling array\n");
+
+  /* Cooling (internal energy) */
+  if (memuse_shared_memalign(
+          "cooling_table.Ucooling", (void **)&cooling->table.Ucooling,
+          SWIFT_STRUCT_ALIGNMENT,
+          colibre_cooling_N_redshifts * colibre_cooling_N_internalenergy *
+              colibre_cooling_N_metallicity * colibre_cooling_N_density *
+              colibre_cooling_N_cooltypes * sizeof(float)) != 0)
+    error("Failed to allocate Ucooling array\n");
+
+  /* Heating (temperature) */
+  if (memuse_shared_memalign(
+          "cooling_table.Theating", (void **)&cooling->table.Theating,
+          SWIFT_STRUCT_ALIGNMENT,
+          colibre_cooling_N_redshifts * colibre_cooling_N_temperature *
+              colibre_cooling_N_metallicity * colibre_cooling_N_density *
+              colibre_cooling_N_heattypes * sizeof(float)) != 0)
+    error("Failed to allocate Theating array\n");
+
+  /* Heating (internal energy) */
+  if (memuse_shared_memalign(
+          "cooling_table.Uheating", (void **)&cooling->table.Uheating,
+          SWIFT_STRUCT_ALIGNMENT,
+          colibre_cooling_N_redshifts * colibre_cooling_N_internalenergy *
+              colibre_cooling_N_metallicity * colibre_cooling_N_density *
+              colibre_cooling_N_heattypes * sizeof(float)) != 0)
+    error("Failed to allocate Uheating array\n");
+
+  /* Electron fraction (temperature) */
+  if (memuse_shared_memalign(
+          "cooling_table.Tefrac", (void **)&cooling->table.Telectron_fraction,
+          SWIFT_STRUCT_ALIGNMENT,
+          colibre_cooling_N_redshifts * colibre_cooling_N_temperature *
+              colibre_cooling_N_metallicity * colibre_cooling_N_density *
+              colibre_cooling_N_electrontypes * sizeof(float)) != 0)
+    error("Failed to allocate Telectron_fraction array\n");
+
+  /* Electron fraction (internal energy) */
+  if (memuse_shared_memalign(
+          "cooling_table.Uefrac", (void **)&cooling->table.Uelectron_fraction,
+          SWIFT_STRUCT_ALIGNMENT,
+          colibre_cooling_N_redshifts * colibre_cooling_N_internalenergy *
+              colibre_cooling_N_metallicity * colibre_cooling_N_density *
+              colibre_cooling_N_electrontypes * sizeof(float)) != 0)
+    error("Failed to allocate Uelectron_fraction array\n");
+
+  /* Internal energy from temperature */
+  if (memuse_shared_memalign(
+          "cooling_table.UfromT", (void **)&cooling->table.U_from_T,
+          SWIFT_STRUCT_ALIGNMENT,
+          colibre_cooling_N_redshifts * colibre_cooling_N_temperature *
+              colibre_cooling_N_metallicity * colibre_cooling_N_density *
+              sizeof(float)) != 0)
+    error("Failed to allocate U_from_T array\n");
+
+  /* Temperature from interal energy */
+  if (memuse_shared_memalign(
+          "cooling_table.TfromU", (void **)&cooling->table.T_from_U,
+          SWIFT_STRUCT_ALIGNMENT,
+          colibre_cooling_N_redshifts * colibre_cooling_N_internalenergy *
+              colibre_cooling_N_metallicity * colibre_cooling_N_density *
+              sizeof(float)) != 0)
+    error("Failed to allocate T_from_U array\n");
+
+  /* Thermal equilibrium temperature */
+  if (memuse_shared_memalign(
+          "cooling_table.Teq", (void **)&cooling->table.logTeq,
+          SWIFT_STRUCT_ALIGNMENT,
+          colibre_cooling_N_redshifts * colibre_cooling_N_metallicity *
+              colibre_cooling_N_density * sizeof(float)) != 0)
+    error("Failed to allocate logTeq array\n");
+
+  /* Mean particle mass at thermal equilibrium temperature */
+  if (memuse_shared_memalign(
+          "cooling_table.mueq", (void **)&cooling->table.meanpartmass_Teq,
+          SWIFT_STRUCT_ALIGNMENT,
+          colibre_cooling_N_redshifts * colibre_cooling_N_metallicity *
+              colibre_cooling_N_density * sizeof(float)) != 0)
+    error("Failed to allocate mu array\n");
+
+  /* Hydrogen fractions at thermal equilibirum temperature */
+  if (memuse_shared_memalign(
+          "cooling_table.Hfracs", (void **)&cooling->table.logHfracs_Teq,
+          SWIFT_STRUCT_ALIGNMENT,
+          colibre_cooling_N_redshifts * colibre_cooling_N_metallicity *
+              colibre_cooling_N_density * 3 * sizeof(float)) != 0)
+    error("Failed to allocate hydrogen fractions array\n");
+
+  /* All hydrogen fractions */
+  if (memuse_shared_memalign(
+          "cooling_table.Hfracs", (void **)&cooling->table.logHfracs_all,
+          SWIFT_STRUCT_ALIGNMENT,
+          colibre_cooling_N_redshifts * colibre_cooling_N_temperature *
+              colibre_cooling_N_metallicity * colibre_cooling_N_density * 3 *
+              sizeof(float)) != 0)
+    error("Failed to allocate big hydrogen fractions array\n");
+
+  /* Pressure at thermal equilibrium temperature */
+  if (memuse_shared_memalign(
+          "cooling_table.Peq", (void **)&cooling->table.logPeq,
+          SWIFT_STRUCT_ALIGNMENT,
+          colibre_cooling_N_redshifts * colibre_cooling_N_metallicity *
+              colibre_cooling_N_density * sizeof(float)) != 0)
+    error("Failed to allocate logPeq array\n");
+
+  /* Read them all, unless cooling_update() reads the redshifts as they are
+   * needed */
+  cooling->z_index_first = colibre_cooling_N_redshifts;
+  cooling->z_index_last = -1;
+  if (!cooling->lazy_redshift_tables)
+    read_cooling_tables_redshifts(cooling, 0, colibre_cooling_N_redshifts - 1);
 
 #ifdef SWIFT_DEBUG_CHECKS
   message("Done reading in general cooling table");
@@ -544,3 +662,43 @@ void read_cooling_tables(struct cooling_function_data *restrict cooling) {
   error("Need HDF5 to read cooling tables");
 #endif
 }
+
+/**
+ * @brief Make sure that the two redshifts of the tables around a given one
+ * have been read.
+ *
+ * The redshifts read so far are kept as one range, extended on either side
+ * with what is missing. Collective over the ranks of a node when the tables
+ * are shared.
+ *
+ * @param cooling #cooling_function_data structure
+ * @param z The redshift.
+ */
+void read_cooling_tables_around_redshift(
+    struct cooling_function_data *restrict cooling, const float z) {
+
+  int ired;
+  float dred;
+  get_index_1d(cooling->Redshifts, colibre_cooling_N_redshifts, z, &ired,
+               &dred);
+
+  /* Interpolations always read the redshift above too */
+  const int first = ired;
+  const int last = ired + 1;
+  if (first >= cooling->z_index_first && last <= cooling->z_index_last)
+    return;
+
+  if (cooling->z_index_first > cooling->z_index_last) {
+
+    /* Nothing read yet */
+    read_cooling_tables_redshifts(cooling, first, last);
+
+  } else {
+
+    /* Extend the range on either side */
+    if (first < cooling->z_index_first)
+      read_cooling_tables_redshifts(cooling, first, cooling->z_index_first - 1);
+    if (last > cooling->z_index_last)
+      read_cooling_tables_redshifts(cooling, cooling->z_index_last + 1, last);
+  }
+}
@@ -114,5 +114,7 @@ struct cooling_function_data;
 void get_cooling_redshifts(struct cooling_function_data *cooling);
 void read_cooling_header(struct cooling_function_data *cooling);
 void read_cooling_tables(struct cooling_function_data *cooling);
+void read_cooling_tables_around_redshift(struct cooling_function_data *cooling,
+                                         const float z);
 
 #endif
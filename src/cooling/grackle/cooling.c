@@ -747,12 +747,14 @@ void cooling_copy_to_grackle(grackle_field_data* data, const struct part* p,
   cooling_copy_to_grackle2(data, p, xp, rho, species_densities);
   cooling_copy_to_grackle3(data, p, xp, rho, species_densities);
 
+  data->volumetric_heating_rate = NULL;
   if (cooling->chemistry_data.use_volumetric_heating_rate) {
     gr_float* volumetric_heating_rate = (gr_float*)malloc(sizeof(gr_float));
     *volumetric_heating_rate = cooling->volumetric_heating_rates;
     data->volumetric_heating_rate = volumetric_heating_rate;
   }
 
+  data->specific_heating_rate = NULL;
   if (cooling->chemistry_data.use_specific_heating_rate) {
     gr_float* specific_heating_rate = (gr_float*)malloc(sizeof(gr_float));
     *specific_heating_rate = cooling->specific_heating_rates;
@@ -807,8 +809,6 @@ void cooling_copy_to_grackle(grackle_field_data* data, const struct part* p,
     data->RT_H2_dissociation_rate = RT_H2_dissociation_rate;
 
   } else {
-    data->volumetric_heating_rate = NULL;
-    data->specific_heating_rate = NULL;
     data->RT_heating_rate = NULL;
     data->RT_HI_ionization_rate = NULL;
     data->RT_HeI_ionization_rate = NULL;
@@ -856,70 +856,104 @@ void cooling_copy_from_grackle(grackle_field_data* data, const struct part* p,
 }
 
 /**
- * @brief Apply the self shielding (if needed) by turning on/off the UV
- * background.
+ * @brief Is the UV background on for a particle, once the self shielding
+ * (if needed) is applied?
  *
  * @param cooling The #cooling_function_data used in the run.
- * @param chemistry The chemistry_data structure from grackle.
  * @param p Pointer to the particle data.
  * @param cosmo The #cosmology.
  */
-void cooling_apply_self_shielding(
+static int cooling_get_uv_background(
     const struct cooling_function_data* restrict cooling,
-    chemistry_data* restrict chemistry, const struct part* restrict p,
-    const struct cosmology* cosmo) {
+    const struct part* restrict p, const struct cosmology* cosmo) {
 
   /* Are we using self shielding or UV background? */
   if (!cooling->with_uv_background || cooling->self_shielding_method >= 0) {
-    return;
+    return cooling->chemistry_data.UVbackground;
   }
 
   /* Are we in a self shielding regime? */
   const float rho = hydro_get_physical_density(p, cosmo);
-  if (rho > cooling->self_shielding_threshold) {
-    chemistry->UVbackground = 0;
-  } else {
-    chemistry->UVbackground = 1;
-  }
+  return rho > cooling->self_shielding_threshold ? 0 : 1;
 }
 
 /**
- * @brief Compute the energy of a particle after dt and update the particle
- * chemistry data
+ * @brief Apply the self shielding (if needed) by turning on/off the UV
+ * background.
  *
- * @param phys_const The physical constants in internal units.
- * @param us The internal system of units.
- * @param cosmo The #cosmology.
- * @param hydro_props The #hydro_props.
  * @param cooling The #cooling_function_data used in the run.
+ * @param chemistry The chemistry_data structure from grackle.
  * @param p Pointer to the particle data.
- * @param xp Pointer to the particle extra data
- * @param dt The time-step of this particle.
- * @param dt_therm The time-step operator used for thermal quantities.
+ * @param cosmo The #cosmology.
+ */
+void cooling_apply_self_shielding(
+    const struct cooling_function_data* restrict cooling,
+    chemistry_data* restrict chemistry, const struct part* restrict p,
+    const struct cosmology* cosmo) {
+
+  chemistry->UVbackground = cooling_get_uv_background(cooling, p, cosmo);
+}
+
+/**
+ * @brief The fields of a batch of particles solved in one call to grackle,
+ * each stored contiguously as grackle wants them.
+ */
+struct cooling_grackle_batch {
+
+  /*! Density, internal energy and metal density */
+  gr_float density[grackle_cooling_batch_size];
+  gr_float internal_energy[grackle_cooling_batch_size];
+  gr_float metal_density[grackle_cooling_batch_size];
+
+  /*! Densities of the species of the network */
+  gr_float species_densities[12][grackle_cooling_batch_size];
+
+  /*! The heating and ionization rates (all constant) */
+  gr_float volumetric_heating_rate[grackle_cooling_batch_size];
+  gr_float specific_heating_rate[grackle_cooling_batch_size];
+  gr_float RT_heating_rate[grackle_cooling_batch_size];
+  gr_float RT_HI_ionization_rate[grackle_cooling_batch_size];
+  gr_float RT_HeI_ionization_rate[grackle_cooling_batch_size];
+  gr_float RT_HeII_ionization_rate[grackle_cooling_batch_size];
+  gr_float RT_H2_dissociation_rate[grackle_cooling_batch_size];
+};
+
+/**
+ * @brief Evolve the chemistry and energy of a batch of particles over the
+ * same time-step with a single call to grackle.
  *
- * @return du / dt
+ * @param cosmo The #cosmology.
+ * @param cooling The #cooling_function_data used in the run.
+ * @param p The particles.
+ * @param xp Their extra data, updated with the new fractions.
+ * @param energy (in/out) Their physical internal energies before and after
+ * dt.
+ * @param count The number of particles.
+ * @param dt The time-step of the particles.
+ * @param UVbackground Is the UV background on for these particles?
  */
-gr_float cooling_new_energy(const struct phys_const* phys_const,
-                            const struct unit_system* us,
-                            const struct cosmology* cosmo,
-                            const struct hydro_props* hydro_props,
-                            const struct cooling_function_data* cooling,
-                            const struct part* p, struct xpart* xp, double dt,
-                            double dt_therm) {
+static void cooling_solve_chemistry_batch(
+    const struct cosmology* cosmo, const struct cooling_function_data* cooling,
+    const struct part* const* p, struct xpart* const* xp, gr_float* energy,
+    const int count, const double dt, const int UVbackground) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (count < 1 || count > grackle_cooling_batch_size)
+    error("Invalid size of grackle batch (%d).", count);
+#endif
 
-  /* set current time */
   code_units units = cooling->units;
   chemistry_data chemistry_grackle = cooling->chemistry_data;
   chemistry_data_storage rates_grackle = cooling->chemistry_rates;
+  chemistry_grackle.UVbackground = UVbackground;
 
-  /* initialize data */
+  struct cooling_grackle_batch b;
   grackle_field_data data;
 
-  /* set values */
   /* grid */
-  int grid_dimension[GRACKLE_RANK] = {GRACKLE_NPART, 1, 1};
+  int grid_dimension[GRACKLE_RANK] = {count, 1, 1};
   int grid_start[GRACKLE_RANK] = {0, 0, 0};
-  int grid_end[GRACKLE_RANK] = {GRACKLE_NPART - 1, 0, 0};
+  int grid_end[GRACKLE_RANK] = {count - 1, 0, 0};
 
   data.grid_dx = 0.;
   data.grid_rank = GRACKLE_RANK;
@@ -927,32 +961,121 @@ gr_float cooling_new_energy(const struct phys_const* phys_const,
   data.grid_start = grid_start;
   data.grid_end = grid_end;
 
-  /* general particle data */
-  gr_float density = cooling_get_physical_density(p, cosmo, cooling);
-  gr_float energy = hydro_get_physical_internal_energy(p, xp, cosmo) +
-                    dt_therm * hydro_get_physical_internal_energy_dt(p, cosmo);
-  energy = max(energy, hydro_props->minimal_internal_energy);
-  /* keep this array here so you can point to and from it in
-   * copy to/from grackle */
-  gr_float species_densities[12];
-
-  /* initialize density */
-  data.density = &density;
-
-  /* initialize energy */
-  data.internal_energy = &energy;
-
   /* grackle 3.0 doc: "Currently not used" */
   data.x_velocity = NULL;
   data.y_velocity = NULL;
   data.z_velocity = NULL;
 
-  /* copy to grackle structure */
-  cooling_copy_to_grackle(&data, p, xp, density, species_densities, cooling,
-                          phys_const);
+  /* general particle data */
+  for (int k = 0; k < count; k++) {
+    b.density[k] = cooling_get_physical_density(p[k], cosmo, cooling);
+    b.internal_energy[k] = energy[k];
+    b.metal_density[k] =
+        chemistry_get_total_metal_mass_fraction_for_cooling(p[k]) *
+        b.density[k];
+  }
+  data.density = b.density;
+  data.internal_energy = b.internal_energy;
+  data.metal_density = b.metal_density;
 
-  /* Apply the self shielding if requested */
-  cooling_apply_self_shielding(cooling, &chemistry_grackle, p, cosmo);
+  /* The species */
+#if COOLING_GRACKLE_MODE > 0
+  for (int k = 0; k < count; k++) {
+    const struct cooling_xpart_data* cd = &xp[k]->cooling_data;
+    gr_float(*sd)[grackle_cooling_batch_size] = b.species_densities;
+    const gr_float rho = b.density[k];
+    sd[0][k] = cd->HI_frac * rho;
+    sd[1][k] = cd->HII_frac * rho;
+    sd[2][k] = cd->HeI_frac * rho;
+    sd[3][k] = cd->HeII_frac * rho;
+    sd[4][k] = cd->HeIII_frac * rho;
+    sd[5][k] = cd->e_frac * rho;
+#if COOLING_GRACKLE_MODE > 1
+    sd[6][k] = cd->HM_frac * rho;
+    sd[7][k] = cd->H2I_frac * rho;
+    sd[8][k] = cd->H2II_frac * rho;
+#endif
+#if COOLING_GRACKLE_MODE > 2
+    sd[9][k] = cd->DI_frac * rho;
+    sd[10][k] = cd->DII_frac * rho;
+    sd[11][k] = cd->HDI_frac * rho;
+#endif
+  }
+#endif
+#if COOLING_GRACKLE_MODE > 0
+  data.HI_density = b.species_densities[0];
+  data.HII_density = b.species_densities[1];
+  data.HeI_density = b.species_densities[2];
+  data.HeII_density = b.species_densities[3];
+  data.HeIII_density = b.species_densities[4];
+  data.e_density = b.species_densities[5];
+#else
+  data.HI_density = NULL;
+  data.HII_density = NULL;
+  data.HeI_density = NULL;
+  data.HeII_density = NULL;
+  data.HeIII_density = NULL;
+  data.e_density = NULL;
+#endif
+#if COOLING_GRACKLE_MODE > 1
+  data.HM_density = b.species_densities[6];
+  data.H2I_density = b.species_densities[7];
+  data.H2II_density = b.species_densities[8];
+#else
+  data.HM_density = NULL;
+  data.H2I_density = NULL;
+  data.H2II_density = NULL;
+#endif
+#if COOLING_GRACKLE_MODE > 2
+  data.DI_density = b.species_densities[9];
+  data.DII_density = b.species_densities[10];
+  data.HDI_density = b.species_densities[11];
+#else
+  data.DI_density = NULL;
+  data.DII_density = NULL;
+  data.HDI_density = NULL;
+#endif
+
+  /* The rates, in the units grackle wants (see cooling_copy_to_grackle()) */
+  data.volumetric_heating_rate = NULL;
+  if (cooling->chemistry_data.use_volumetric_heating_rate) {
+    for (int k = 0; k < count; k++)
+      b.volumetric_heating_rate[k] = cooling->volumetric_heating_rates;
+    data.volumetric_heating_rate = b.volumetric_heating_rate;
+  }
+
+  data.specific_heating_rate = NULL;
+  if (cooling->chemistry_data.use_specific_heating_rate) {
+    for (int k = 0; k < count; k++)
+      b.specific_heating_rate[k] = cooling->specific_heating_rates;
+    data.specific_heating_rate = b.specific_heating_rate;
+  }
+
+  if (cooling->chemistry_data.use_radiative_transfer) {
+    const float time_units = cooling->units.time_units;
+    for (int k = 0; k < count; k++) {
+      b.RT_heating_rate[k] = cooling->RT_heating_rate;
+      b.RT_HI_ionization_rate[k] =
+          cooling->RT_HI_ionization_rate / (1. / time_units);
+      b.RT_HeI_ionization_rate[k] =
+          cooling->RT_HeI_ionization_rate / (1. / time_units);
+      b.RT_HeII_ionization_rate[k] =
+          cooling->RT_HeII_ionization_rate / (1. / time_units);
+      b.RT_H2_dissociation_rate[k] =
+          cooling->RT_H2_dissociation_rate / (1. / time_units);
+    }
+    data.RT_heating_rate = b.RT_heating_rate;
+    data.RT_HI_ionization_rate = b.RT_HI_ionization_rate;
+    data.RT_HeI_ionization_rate = b.RT_HeI_ionization_rate;
+    data.RT_HeII_ionization_rate = b.RT_HeII_ionization_rate;
+    data.RT_H2_dissociation_rate = b.RT_H2_dissociation_rate;
+  } else {
+    data.RT_heating_rate = NULL;
+    data.RT_HI_ionization_rate = NULL;
+    data.RT_HeI_ionization_rate = NULL;
+    data.RT_HeII_ionization_rate = NULL;
+    data.RT_H2_dissociation_rate = NULL;
+  }
 
   /* solve chemistry */
   if (local_solve_chemistry(&chemistry_grackle, &rates_grackle, &units, &data,
@@ -960,8 +1083,83 @@ gr_float cooling_new_energy(const struct phys_const* phys_const,
     error("Error in solve_chemistry.");
   }
 
-  /* copy from grackle data to particle */
-  cooling_copy_from_grackle(&data, p, xp, density, cooling);
+  /* copy from grackle data to particles */
+  for (int k = 0; k < count; k++) {
+#if COOLING_GRACKLE_MODE > 0
+    struct cooling_xpart_data* cd = &xp[k]->cooling_data;
+    gr_float(*sd)[grackle_cooling_batch_size] = b.species_densities;
+    const gr_float rho = b.density[k];
+    cd->HI_frac = sd[0][k] / rho;
+    cd->HII_frac = sd[1][k] / rho;
+    cd->HeI_frac = sd[2][k] / rho;
+    cd->HeII_frac = sd[3][k] / rho;
+    cd->HeIII_frac = sd[4][k] / rho;
+    cd->e_frac = sd[5][k] / rho;
+#if COOLING_GRACKLE_MODE > 1
+    cd->HM_frac = sd[6][k] / rho;
+    cd->H2I_frac = sd[7][k] / rho;
+    cd->H2II_frac = sd[8][k] / rho;
+#endif
+#if COOLING_GRACKLE_MODE > 2
+    cd->DI_frac = sd[9][k] / rho;
+    cd->DII_frac = sd[10][k] / rho;
+    cd->HDI_frac = sd[11][k] / rho;
+#endif
+#endif
+
+    energy[k] = b.internal_energy[k];
+  }
+}
+
+/**
+ * @brief The internal energy grackle starts from: the current one, plus the
+ * change due to the hydro over the step, limited by the minimal energy.
+ *
+ * @param cosmo The #cosmology.
+ * @param hydro_props The #hydro_props.
+ * @param p Pointer to the particle data.
+ * @param xp Pointer to the particle extra data
+ * @param dt_therm The time-step operator used for thermal quantities.
+ */
+static gr_float cooling_get_energy_before_solve(
+    const struct cosmology* cosmo, const struct hydro_props* hydro_props,
+    const struct part* p, const struct xpart* xp, const double dt_therm) {
+
+  gr_float energy = hydro_get_physical_internal_energy(p, xp, cosmo) +
+                    dt_therm * hydro_get_physical_internal_energy_dt(p, cosmo);
+  return max(energy, hydro_props->minimal_internal_energy);
+}
+
+/**
+ * @brief Compute the energy of a particle after dt and update the particle
+ * chemistry data
+ *
+ * @param phys_const The physical constants in internal units.
+ * @param us The internal system of units.
+ * @param cosmo The #cosmology.
+ * @param hydro_props The #hydro_props.
+ * @param cooling The #cooling_function_data used in the run.
+ * @param p Pointer to the particle data.
+ * @param xp Pointer to the particle extra data
+ * @param dt The time-step of this particle.
+ * @param dt_therm The time-step operator used for thermal quantities.
+ *
+ * @return du / dt
+ */
+gr_float cooling_new_energy(const struct phys_const* phys_const,
+                            const struct unit_system* us,
+                            const struct cosmology* cosmo,
+                            const struct hydro_props* hydro_props,
+                            const struct cooling_function_data* cooling,
+                            const struct part* p, struct xpart* xp, double dt,
+                            double dt_therm) {
+
+  gr_float energy =
+      cooling_get_energy_before_solve(cosmo, hydro_props, p, xp, dt_therm);
+
+  /* A batch of one */
+  cooling_solve_chemistry_batch(cosmo, cooling, &p, &xp, &energy, 1, dt,
+                                cooling_get_uv_background(cooling, p, cosmo));
 
   return energy;
 }
@@ -1043,6 +1241,78 @@ gr_float cooling_time(const struct phys_const* phys_const,
   return cooling_time;
 }
 
+/**
+ * @brief Energy of a particle after the adiabatic changes of the step,
+ * limited by the minimal energy.
+ *
+ * The hydro rate of change of the energy is corrected when the limit is hit.
+ *
+ * @param cosmo The current cosmological model.
+ * @param hydro_props The #hydro_props.
+ * @param p Pointer to the particle data.
+ * @param xp Pointer to the particle' extended data.
+ * @param dt_therm The time-step operator used for thermal quantities.
+ */
+static float cooling_get_adiabatic_energy(const struct cosmology* cosmo,
+                                          const struct hydro_props* hydro_props,
+                                          struct part* p,
+                                          const struct xpart* xp,
+                                          const double dt_therm) {
+
+  /* Current energy */
+  const float u_old = hydro_get_physical_internal_energy(p, xp, cosmo);
+
+  /* Energy after the adiabatic cooling */
+  float u_ad_before =
+      u_old + dt_therm * hydro_get_physical_internal_energy_dt(p, cosmo);
+
+  /* We now need to check that we are not going to go below any of the limits */
+  const double u_minimal = hydro_props->minimal_internal_energy;
+  if (u_ad_before < u_minimal) {
+    u_ad_before = u_minimal;
+    const float du_dt = (u_ad_before - u_old) / dt_therm;
+    hydro_set_physical_internal_energy_dt(p, cosmo, du_dt);
+  }
+
+  return u_ad_before;
+}
+
+/**
+ * @brief Turn the energy of a particle after the cooling into its rate of
+ * change of energy and record the radiated energy.
+ *
+ * @param cosmo The current cosmological model.
+ * @param hydro_props The #hydro_props.
+ * @param p Pointer to the particle data.
+ * @param xp Pointer to the particle' extended data.
+ * @param u_ad_before The energy after the adiabatic changes.
+ * @param u_new The energy after the cooling.
+ * @param dt_therm The time-step operator used for thermal quantities.
+ */
+static void cooling_set_new_energy(const struct cosmology* cosmo,
+                                   const struct hydro_props* hydro_props,
+                                   struct part* p, struct xpart* xp,
+                                   const float u_ad_before, gr_float u_new,
+                                   const double dt_therm) {
+
+  /* Get the change in internal energy due to hydro forces */
+  float hydro_du_dt = hydro_get_physical_internal_energy_dt(p, cosmo);
+
+  /* We now need to check that we are not going to go below any of the limits */
+  const double u_minimal = hydro_props->minimal_internal_energy;
+  u_new = max(u_new, u_minimal);
+
+  /* Calculate the cooling rate */
+  float cool_du_dt = (u_new - u_ad_before) / dt_therm;
+  float du_dt = cool_du_dt + hydro_du_dt;
+
+  /* Update the internal energy time derivative */
+  hydro_set_physical_internal_energy_dt(p, cosmo, du_dt);
+
+  /* Store the radiated energy */
+  xp->cooling_data.radiated_energy -= hydro_get_mass(p) * cool_du_dt * dt_therm;
+}
+
 /**
  * @brief Apply the cooling function to a particle.
  *
@@ -1073,20 +1343,9 @@ void cooling_cool_part(const struct phys_const* phys_const,
   /* Nothing to do here? */
   if (dt == 0.) return;
 
-  /* Current energy */
-  const float u_old = hydro_get_physical_internal_energy(p, xp, cosmo);
-
   /* Energy after the adiabatic cooling */
-  float u_ad_before =
-      u_old + dt_therm * hydro_get_physical_internal_energy_dt(p, cosmo);
-
-  /* We now need to check that we are not going to go below any of the limits */
-  const double u_minimal = hydro_props->minimal_internal_energy;
-  if (u_ad_before < u_minimal) {
-    u_ad_before = u_minimal;
-    const float du_dt = (u_ad_before - u_old) / dt_therm;
-    hydro_set_physical_internal_energy_dt(p, cosmo, du_dt);
-  }
+  const float u_ad_before =
+      cooling_get_adiabatic_energy(cosmo, hydro_props, p, xp, dt_therm);
 
   /* Calculate energy after dt */
   gr_float u_new = 0;
@@ -1099,21 +1358,106 @@ void cooling_cool_part(const struct phys_const* phys_const,
                                xp, dt, dt_therm);
   }
 
-  /* Get the change in internal energy due to hydro forces */
-  float hydro_du_dt = hydro_get_physical_internal_energy_dt(p, cosmo);
+  cooling_set_new_energy(cosmo, hydro_props, p, xp, u_ad_before, u_new,
+                         dt_therm);
+}
 
-  /* We now need to check that we are not going to go below any of the limits */
-  u_new = max(u_new, u_minimal);
+/**
+ * @brief Apply the cooling function to a batch of particles.
+ *
+ * Same as cooling_cool_part() for each particle, but the particles with the
+ * same time-step and UV background go through grackle in a single call.
+ *
+ * @param phys_const The physical constants in internal units.
+ * @param us The internal system of units.
+ * @param cosmo The current cosmological model.
+ * @param hydro_props The #hydro_props.
+ * @param floor_props Properties of the entropy floor.
+ * @param pressure_floor Properties of the pressure floor.
+ * @param cooling The #cooling_function_data used in the run.
+ * @param p The particles.
+ * @param xp Their extended data.
+ * @param dt The time-steps of the particles.
+ * @param dt_therm The time-step operators used for thermal quantities.
+ * @param count The number of particles (at most grackle_cooling_batch_size).
+ * @param time The current time (since the Big Bang or start of the run) in
+ * internal units.
+ */
+void cooling_cool_parts(const struct phys_const* phys_const,
+                        const struct unit_system* us,
+                        const struct cosmology* cosmo,
+                        const struct hydro_props* hydro_props,
+                        const struct entropy_floor_properties* floor_props,
+                        const struct pressure_floor_props* pressure_floor,
+                        const struct cooling_function_data* cooling,
+                        struct part** p, struct xpart** xp, const float* dt,
+                        const float* dt_therm, const int count,
+                        const double time) {
+
+  if (count > grackle_cooling_batch_size)
+    error("Too many particles in a cooling batch (%d).", count);
+
+  /* Energies after the adiabatic cooling and after dt */
+  float u_ad_before[grackle_cooling_batch_size];
+  gr_float u_new[grackle_cooling_batch_size];
+
+  /* UV background of the particles still to go through grackle, -1 for the
+   * others */
+  int uv_background[grackle_cooling_batch_size];
+
+  for (int k = 0; k < count; k++) {
+
+    uv_background[k] = -1;
+
+    /* Nothing to do here? */
+    if (dt[k] == 0.f) continue;
+
+    u_ad_before[k] = cooling_get_adiabatic_energy(cosmo, hydro_props, p[k],
+                                                  xp[k], dt_therm[k]);
+
+    /* Is the cooling turn off */
+    if (time - xp[k]->cooling_data.time_last_event < cooling->thermal_time) {
+      u_new[k] = u_ad_before[k];
+    } else {
+      u_new[k] = cooling_get_energy_before_solve(cosmo, hydro_props, p[k],
+                                                 xp[k], dt_therm[k]);
+      uv_background[k] = cooling_get_uv_background(cooling, p[k], cosmo);
+    }
+  }
 
-  /* Calculate the cooling rate */
-  float cool_du_dt = (u_new - u_ad_before) / dt_therm;
-  float du_dt = cool_du_dt + hydro_du_dt;
+  /* Solve the particles sharing a time-step and a UV background together */
+  for (int k = 0; k < count; k++) {
+
+    const int uv = uv_background[k];
+    if (uv < 0) continue;
+
+    const struct part* group_p[grackle_cooling_batch_size];
+    struct xpart* group_xp[grackle_cooling_batch_size];
+    gr_float group_u[grackle_cooling_batch_size];
+    int group[grackle_cooling_batch_size];
+    int n = 0;
+    for (int l = k; l < count; l++) {
+      if (uv_background[l] == uv && dt[l] == dt[k]) {
+        group[n] = l;
+        group_p[n] = p[l];
+        group_xp[n] = xp[l];
+        group_u[n] = u_new[l];
+        uv_background[l] = -1;
+        n++;
+      }
+    }
 
-  /* Update the internal energy time derivative */
-  hydro_set_physical_internal_energy_dt(p, cosmo, du_dt);
+    cooling_solve_chemistry_batch(cosmo, cooling, group_p, group_xp, group_u,
+                                  n, dt[k], uv);
 
-  /* Store the radiated energy */
-  xp->cooling_data.radiated_energy -= hydro_get_mass(p) * cool_du_dt * dt_therm;
+    for (int i = 0; i < n; i++) u_new[group[i]] = group_u[i];
+  }
+
+  for (int k = 0; k < count; k++) {
+    if (dt[k] == 0.f) continue;
+    cooling_set_new_energy(cosmo, hydro_props, p[k], xp[k], u_ad_before[k],
+                           u_new[k], dt_therm[k]);
+  }
 }
 
 /**
@@ -1275,6 +1619,13 @@ void cooling_init_grackle(struct cooling_function_data* cooling) {
     error("Error in set_default_chemistry_parameters.");
   }
 
+  /* Each cooling task is already run by one of our threads. Grackle must not
+   * start OpenMP threads of its own on top of them (when it was built with
+   * OpenMP at all). */
+  int* omp_nthreads =
+      local_chemistry_data_access_int(chemistry, "omp_nthreads");
+  if (omp_nthreads != NULL) *omp_nthreads = 1;
+
   // Set parameter values for chemistry.
   chemistry->use_grackle = 1;
   chemistry->with_radiative_cooling = 1;
@@ -44,6 +44,9 @@ struct swift_params;
 #define GRACKLE_NPART 1
 #define GRACKLE_RANK 3
 
+/*! Number of particles cooled together by cooling_cool_parts() */
+#define grackle_cooling_batch_size 32
+
 void cooling_update(const struct phys_const* phys_const,
                     const struct cosmology* cosmo,
                     const struct pressure_floor_props* pressure_floor,
@@ -119,6 +122,17 @@ void cooling_cool_part(const struct phys_const* restrict phys_const,
                        const double dt, const double dt_therm,
                        const double time);
 
+void cooling_cool_parts(const struct phys_const* phys_const,
+                        const struct unit_system* us,
+                        const struct cosmology* cosmo,
+                        const struct hydro_props* hydro_properties,
+                        const struct entropy_floor_properties* floor_props,
+                        const struct pressure_floor_props* pressure_floor,
+                        const struct cooling_function_data* cooling,
+                        struct part** p, struct xpart** xp, const float* dt,
+                        const float* dt_therm, const int count,
+                        const double time);
+
 float cooling_get_temperature(
     const struct phys_const* restrict phys_const,
     const struct hydro_props* hydro_properties,
@@ -27,6 +27,15 @@
 
 /* Some standard headers */
 #include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/* MPI headers. */
+#ifdef WITH_MPI
+#include <mpi.h>
+#endif
 
 /* Local headers */
 #include "adiabatic_index.h"
@@ -48,6 +57,9 @@ const int cosmology_table_length = 30000;
 #ifdef HAVE_LIBGSL
 /*! Size of the GSL workspace */
 const size_t GSL_workspace_size = 100000;
+
+/*! Version of the on-disk cache of the tables, to change with the integrals */
+const int cosmology_tables_cache_version = 1;
 #endif
 
 /**
@@ -520,6 +532,257 @@ double neutrino_density_integrate(gsl_integration_workspace *space, double y) {
   return result;
 }
 
+/**
+ * @brief Number of MPI ranks sharing the computation of the tables, and the
+ * rank of this one.
+ *
+ * This is 1 when MPI is not (yet) running, e.g. in the tools and tests.
+ *
+ * @param rank (return) The rank of this node.
+ */
+static int cosmology_tables_nr_ranks(int *rank) {
+
+  int nr_ranks = 1;
+  *rank = 0;
+#ifdef WITH_MPI
+  int initialised = 0;
+  MPI_Initialized(&initialised);
+  if (initialised) {
+    MPI_Comm_size(MPI_COMM_WORLD, &nr_ranks);
+    MPI_Comm_rank(MPI_COMM_WORLD, rank);
+  }
+#endif
+  return nr_ranks;
+}
+
+/**
+ * @brief The range of entries of the tables computed by this rank.
+ *
+ * The entries computed by the other ranks are zero until
+ * cosmology_tables_share() adds them.
+ *
+ * @param first (return) The first entry.
+ * @param last (return) One past the last entry.
+ */
+static void cosmology_tables_range(int *first, int *last) {
+
+  int rank;
+  const int nr_ranks = cosmology_tables_nr_ranks(&rank);
+  *first = (long long)cosmology_table_length * rank / nr_ranks;
+  *last = (long long)cosmology_table_length * (rank + 1) / nr_ranks;
+}
+
+/**
+ * @brief Combine the entries of the tables computed by all the ranks.
+ *
+ * @param tables The tables, each of #cosmology_table_length entries.
+ * @param nr_tables The number of tables.
+ */
+static void cosmology_tables_share(double *const *tables, const int nr_tables) {
+
+  int rank;
+  if (cosmology_tables_nr_ranks(&rank) == 1) return;
+#ifdef WITH_MPI
+  for (int k = 0; k < nr_tables; k++)
+    if (MPI_Allreduce(MPI_IN_PLACE, tables[k], cosmology_table_length,
+                      MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD) != MPI_SUCCESS)
+      error("Failed to combine the cosmology tables.");
+#endif
+}
+
+/**
+ * @brief Fill the key of the on-disk cache of the tables: everything they
+ * are computed from.
+ *
+ * @param c The #cosmology.
+ * @param key (return) The key, of cosmology_tables_key_size(c) values.
+ */
+static void cosmology_tables_key(const struct cosmology *c, double *key) {
+
+  int n = 0;
+  key[n++] = cosmology_tables_cache_version;
+  key[n++] = cosmology_table_length;
+  key[n++] = hydro_gamma;
+  key[n++] = c->a_begin;
+  key[n++] = c->a_end;
+  key[n++] = c->H0;
+  key[n++] = c->Omega_cdm;
+  key[n++] = c->Omega_b;
+  key[n++] = c->Omega_lambda;
+  key[n++] = c->Omega_r;
+  key[n++] = c->Omega_g;
+  key[n++] = c->Omega_ur;
+  key[n++] = c->w_0;
+  key[n++] = c->w_a;
+  key[n++] = c->T_CMB_0;
+  key[n++] = c->T_nu_0;
+  key[n++] = c->T_nu_0_eV;
+  key[n++] = c->N_ur;
+  key[n++] = c->N_nu;
+  key[n++] = c->const_speed_light_c;
+  for (int i = 0; i < c->N_nu; i++) {
+    key[n++] = c->M_nu_eV[i];
+    key[n++] = c->deg_nu[i];
+  }
+}
+
+/**
+ * @brief Number of values in the key of the on-disk cache of the tables.
+ *
+ * @param c The #cosmology.
+ */
+static int cosmology_tables_key_size(const struct cosmology *c) {
+  return 20 + 2 * c->N_nu;
+}
+
+/**
+ * @brief Name of the file caching some tables, made of a hash of their key.
+ *
+ * @param c The #cosmology.
+ * @param name The name of the set of tables.
+ * @param key The key of the tables.
+ * @param file_name (return) The name of the file.
+ */
+static void cosmology_tables_cache_name(const struct cosmology *c,
+                                        const char *name, const double *key,
+                                        char *file_name) {
+
+  /* FNV-1a over the bytes of the key */
+  const unsigned char *bytes = (const unsigned char *)key;
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < cosmology_tables_key_size(c) * sizeof(double); i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+
+  snprintf(file_name, PARSER_MAX_LINE_SIZE + 64, "%s/cosmology_%s_%016llx.dat",
+           c->table_cache_dir, name, (unsigned long long)hash);
+}
+
+/**
+ * @brief Read some tables from the on-disk cache, if they are in it.
+ *
+ * Only rank 0 reads the file, the tables are broadcast to the other ranks.
+ *
+ * @param c The #cosmology.
+ * @param name The name of the set of tables.
+ * @param tables (return) The tables, each of #cosmology_table_length
+ * entries.
+ * @param nr_tables The number of tables.
+ * @param scalars (return) Single values stored along with the tables.
+ * @param nr_scalars The number of single values.
+ *
+ * @return 1 if the tables were read, 0 if they have to be computed.
+ */
+static int cosmology_tables_cache_read(const struct cosmology *c,
+                                       const char *name, double *const *tables,
+                                       const int nr_tables,
+                                       double *const *scalars,
+                                       const int nr_scalars) {
+
+  if (c->table_cache_dir[0] == '\0') return 0;
+
+  int rank;
+  cosmology_tables_nr_ranks(&rank);
+
+  int found = 0;
+  if (rank == 0) {
+    const int key_size = cosmology_tables_key_size(c);
+    double *key = (double *)malloc(2 * key_size * sizeof(double));
+    if (key == NULL) error("Failed to allocate cosmology tables key.");
+    cosmology_tables_key(c, key);
+
+    char file_name[PARSER_MAX_LINE_SIZE + 64];
+    cosmology_tables_cache_name(c, name, key, file_name);
+    FILE *file = fopen(file_name, "rb");
+    if (file != NULL) {
+
+      /* Make sure this is what we want, not just the same hash */
+      found = fread(&key[key_size], sizeof(double), key_size, file) ==
+                  (size_t)key_size &&
+              memcmp(key, &key[key_size], key_size * sizeof(double)) == 0;
+      for (int k = 0; k < nr_tables && found; k++)
+        found = fread(tables[k], sizeof(double), cosmology_table_length,
+                      file) == (size_t)cosmology_table_length;
+      for (int k = 0; k < nr_scalars && found; k++)
+        found = fread(scalars[k], sizeof(double), 1, file) == 1;
+      fclose(file);
+
+      if (found) message("Read the cosmology tables from '%s'.", file_name);
+    }
+    free(key);
+  }
+
+#ifdef WITH_MPI
+  if (cosmology_tables_nr_ranks(&rank) > 1) {
+    MPI_Bcast(&found, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    for (int k = 0; k < nr_tables && found; k++)
+      MPI_Bcast(tables[k], cosmology_table_length, MPI_DOUBLE, 0,
+                MPI_COMM_WORLD);
+    for (int k = 0; k < nr_scalars && found; k++)
+      MPI_Bcast(scalars[k], 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  }
+#endif
+
+  return found;
+}
+
+/**
+ * @brief Write some tables to the on-disk cache.
+ *
+ * Only rank 0 writes the file, to a temporary name first such that runs
+ * sharing the cache never read a partial file.
+ *
+ * @param c The #cosmology.
+ * @param name The name of the set of tables.
+ * @param tables The tables, each of #cosmology_table_length entries.
+ * @param nr_tables The number of tables.
+ * @param scalars Single values stored along with the tables.
+ * @param nr_scalars The number of single values.
+ */
+static void cosmology_tables_cache_write(const struct cosmology *c,
+                                         const char *name,
+                                         double *const *tables,
+                                         const int nr_tables,
+                                         double *const *scalars,
+                                         const int nr_scalars) {
+
+  int rank;
+  cosmology_tables_nr_ranks(&rank);
+  if (c->table_cache_dir[0] == '\0' || rank != 0) return;
+
+  double *key =
+      (double *)malloc(cosmology_tables_key_size(c) * sizeof(double));
+  if (key == NULL) error("Failed to allocate cosmology tables key.");
+  cosmology_tables_key(c, key);
+
+  char file_name[PARSER_MAX_LINE_SIZE + 64];
+  char tmp_name[PARSER_MAX_LINE_SIZE + 96];
+  cosmology_tables_cache_name(c, name, key, file_name);
+  snprintf(tmp_name, sizeof(tmp_name), "%s.%d.tmp", file_name, (int)getpid());
+
+  /* Not being able to cache the tables is not fatal */
+  FILE *file = fopen(tmp_name, "wb");
+  int written = file != NULL;
+  if (written)
+    written = fwrite(key, sizeof(double), cosmology_tables_key_size(c),
+                     file) == (size_t)cosmology_tables_key_size(c);
+  for (int k = 0; k < nr_tables && written; k++)
+    written = fwrite(tables[k], sizeof(double), cosmology_table_length,
+                     file) == (size_t)cosmology_table_length;
+  for (int k = 0; k < nr_scalars && written; k++)
+    written = fwrite(scalars[k], sizeof(double), 1, file) == 1;
+  if (file != NULL && fclose(file) != 0) written = 0;
+
+  if (written && rename(tmp_name, file_name) == 0)
+    message("Wrote the cosmology tables to '%s'.", file_name);
+  else {
+    warning("Could not write the cosmology tables to '%s'.", file_name);
+    if (file != NULL) remove(tmp_name);
+  }
+  free(key);
+}
+
 #endif
 
 /**
@@ -575,12 +838,25 @@ void cosmology_init_neutrino_tables(struct cosmology *c) {
                      cosmology_table_length * sizeof(double)) != 0)
     error("Failed to allocate cosmology interpolation table");
 
+  /* Find a safe redshift to start the neutrino density interpolation table */
+  neutrino_find_relativistic_redshift(c, 1e-7);
+
+  /* Did we already compute them? */
+  double *const tables[2] = {c->neutrino_density_early_table,
+                             c->neutrino_density_late_table};
+  if (cosmology_tables_cache_read(c, "neutrinos", tables, 2, NULL, 0)) return;
+
   /* Initalise the GSL workspace */
   gsl_integration_workspace *space =
       gsl_integration_workspace_alloc(GSL_workspace_size);
 
-  /* Find a safe redshift to start the neutrino density interpolation table */
-  neutrino_find_relativistic_redshift(c, 1e-7);
+  /* Each rank computes a slice of the tables */
+  int first, last;
+  cosmology_tables_range(&first, &last);
+  bzero(c->neutrino_density_early_table,
+        cosmology_table_length * sizeof(double));
+  bzero(c->neutrino_density_late_table,
+        cosmology_table_length * sizeof(double));
 
   const double pre_factor = 15. * pow(c->T_nu_0 * M_1_PI / c->T_CMB_0, 4);
   const double early_delta_a =
@@ -591,7 +867,7 @@ void cosmology_init_neutrino_tables(struct cosmology *c) {
   double result;
 
   /* Fill the early neutrino density table between (a_long_begin, a_long_mid) */
-  for (int i = 0; i < cosmology_table_length; i++) {
+  for (int i = first; i < last; i++) {
     double O_nu = 0.;
     double a = exp(c->log_a_long_begin + early_delta_a * (i + 1));
 
@@ -606,7 +882,7 @@ void cosmology_init_neutrino_tables(struct cosmology *c) {
   }
 
   /* Fill the late neutrino density table between (a_long_mid, a_long_end) */
-  for (int i = 0; i < cosmology_table_length; i++) {
+  for (int i = first; i < last; i++) {
     double O_nu = 0.;
     double a = exp(c->log_a_long_mid + late_delta_a * (i + 1));
 
@@ -623,6 +899,10 @@ void cosmology_init_neutrino_tables(struct cosmology *c) {
   /* Free the workspace */
   gsl_integration_workspace_free(space);
 
+  /* Gather the slices and keep the tables for next time */
+  cosmology_tables_share(tables, 2);
+  cosmology_tables_cache_write(c, "neutrinos", tables, 2, NULL, 0);
+
 #else
 
   error("Code not compiled with GSL. Can't compute cosmology integrals.");
@@ -630,51 +910,25 @@ void cosmology_init_neutrino_tables(struct cosmology *c) {
 #endif
 }
 
+#ifdef HAVE_LIBGSL
+
 /**
- * @brief Initialise the interpolation tables for the integrals.
+ * @brief Integrate the drift, kick, time and comoving distance tables and
+ * invert the last two.
+ *
+ * The integrals are shared between the MPI ranks.
+ *
+ * @param c The #cosmology.
+ * @param tables The drift, gravity kick, hydro kick, hydro kick correction,
+ * time and comoving distance tables, followed by the two inverted ones.
  */
-void cosmology_init_tables(struct cosmology *c) {
-
-#ifdef HAVE_LIBGSL
+static void cosmology_integrate_tables(struct cosmology *c,
+                                       double *const *tables) {
 
   /* Retrieve some constants */
   const double a_begin = c->a_begin;
   const double a_end = c->a_end;
 
-  /* Allocate memory for the interpolation tables */
-  if (swift_memalign("cosmo.table", (void **)&c->drift_fac_interp_table,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     cosmology_table_length * sizeof(double)) != 0)
-    error("Failed to allocate cosmology interpolation table");
-  if (swift_memalign("cosmo.table", (void **)&c->grav_kick_fac_interp_table,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     cosmology_table_length * sizeof(double)) != 0)
-    error("Failed to allocate cosmology interpolation table");
-  if (swift_memalign("cosmo.table", (void **)&c->hydro_kick_fac_interp_table,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     cosmology_table_length * sizeof(double)) != 0)
-    error("Failed to allocate cosmology interpolation table");
-  if (swift_memalign("cosmo.table", (void **)&c->hydro_kick_corr_interp_table,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     cosmology_table_length * sizeof(double)) != 0)
-    error("Failed to allocate cosmology interpolation table");
-  if (swift_memalign("cosmo.table", (void **)&c->time_interp_table,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     cosmology_table_length * sizeof(double)) != 0)
-    error("Failed to allocate cosmology interpolation table");
-  if (swift_memalign("cosmo.table", (void **)&c->scale_factor_interp_table,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     cosmology_table_length * sizeof(double)) != 0)
-    error("Failed to allocate cosmology interpolation table");
-  if (swift_memalign("cosmo.table", (void **)&c->comoving_distance_interp_table,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     cosmology_table_length * sizeof(double)) != 0)
-    error("Failed to allocate cosmology interpolation table");
-  if (swift_memalign(
-          "cosmo.table", (void **)&c->comoving_distance_inverse_interp_table,
-          SWIFT_STRUCT_ALIGNMENT, cosmology_table_length * sizeof(double)) != 0)
-    error("Failed to allocate cosmology interpolation table");
-
   /* Prepare a table of scale factors for the integral bounds */
   const double delta_a =
       (c->log_a_end - c->log_a_begin) / cosmology_table_length;
@@ -687,11 +941,17 @@ void cosmology_init_tables(struct cosmology *c) {
   gsl_integration_workspace *space =
       gsl_integration_workspace_alloc(GSL_workspace_size);
 
+  /* Each rank computes a slice of the tables */
+  int first, last;
+  cosmology_tables_range(&first, &last);
+  for (int k = 0; k < 6; k++)
+    bzero(tables[k], cosmology_table_length * sizeof(double));
+
   double result, abserr;
 
   /* Integrate the drift factor \int_{a_begin}^{a_table[i]} dt/a^2 */
   gsl_function F = {&drift_integrand, c};
-  for (int i = 0; i < cosmology_table_length; i++) {
+  for (int i = first; i < last; i++) {
     gsl_integration_qag(&F, a_begin, a_table[i], 0, 1.0e-10, GSL_workspace_size,
                         GSL_INTEG_GAUSS61, space, &result, &abserr);
 
@@ -701,7 +961,7 @@ void cosmology_init_tables(struct cosmology *c) {
 
   /* Integrate the kick factor \int_{a_begin}^{a_table[i]} dt/a */
   F.function = &gravity_kick_integrand;
-  for (int i = 0; i < cosmology_table_length; i++) {
+  for (int i = first; i < last; i++) {
     gsl_integration_qag(&F, a_begin, a_table[i], 0, 1.0e-10, GSL_workspace_size,
                         GSL_INTEG_GAUSS61, space, &result, &abserr);
 
@@ -711,7 +971,7 @@ void cosmology_init_tables(struct cosmology *c) {
 
   /* Integrate the kick factor \int_{a_begin}^{a_table[i]} dt/a^(3(g-1)+1) */
   F.function = &hydro_kick_integrand;
-  for (int i = 0; i < cosmology_table_length; i++) {
+  for (int i = first; i < last; i++) {
     gsl_integration_qag(&F, a_begin, a_table[i], 0, 1.0e-10, GSL_workspace_size,
                         GSL_INTEG_GAUSS61, space, &result, &abserr);
 
@@ -721,7 +981,7 @@ void cosmology_init_tables(struct cosmology *c) {
 
   /* Integrate the kick correction factor \int_{a_begin}^{a_table[i]} a dt */
   F.function = &hydro_kick_corr_integrand;
-  for (int i = 0; i < cosmology_table_length; i++) {
+  for (int i = first; i < last; i++) {
     gsl_integration_qag(&F, a_begin, a_table[i], 0, 1.0e-10, GSL_workspace_size,
                         GSL_INTEG_GAUSS61, space, &result, &abserr);
 
@@ -731,7 +991,7 @@ void cosmology_init_tables(struct cosmology *c) {
 
   /* Integrate the time \int_{a_begin}^{a_table[i]} dt */
   F.function = &time_integrand;
-  for (int i = 0; i < cosmology_table_length; i++) {
+  for (int i = first; i < last; i++) {
     gsl_integration_qag(&F, a_begin, a_table[i], 0, 1.0e-10, GSL_workspace_size,
                         GSL_INTEG_GAUSS61, space, &result, &abserr);
 
@@ -756,7 +1016,7 @@ void cosmology_init_tables(struct cosmology *c) {
 
   /* Integrate the comoving distance \int_{a_begin}^{a_table[i]} c dt/a */
   F.function = &comoving_distance_integrand;
-  for (int i = 0; i < cosmology_table_length; i++) {
+  for (int i = first; i < last; i++) {
     gsl_integration_qag(&F, a_begin, a_table[i], 0, 1.0e-10, GSL_workspace_size,
                         GSL_INTEG_GAUSS61, space, &result, &abserr);
 
@@ -776,6 +1036,13 @@ void cosmology_init_tables(struct cosmology *c) {
                       GSL_INTEG_GAUSS61, space, &result, &abserr);
   c->comoving_distance_start_to_end = result;
 
+  /* Free the workspace and temp array */
+  gsl_integration_workspace_free(space);
+  swift_free("cosmo.table", a_table);
+
+  /* Gather the slices */
+  cosmology_tables_share(tables, 6);
+
   /* Update the times */
   c->time_begin = cosmology_get_time_since_big_bang(c, c->a_begin);
   c->time_end = cosmology_get_time_since_big_bang(c, c->a_end);
@@ -796,10 +1063,75 @@ void cosmology_init_tables(struct cosmology *c) {
   const double delta_r = (r_begin - r_end) / cosmology_table_length;
   invert_table(c->comoving_distance_interp_table, c->log_a_begin, delta_r,
                delta_log_a, c->comoving_distance_inverse_interp_table);
+}
 
-  /* Free the workspace and temp array */
-  gsl_integration_workspace_free(space);
-  swift_free("cosmo.table", a_table);
+#endif
+
+/**
+ * @brief Initialise the interpolation tables for the integrals.
+ */
+void cosmology_init_tables(struct cosmology *c) {
+
+#ifdef HAVE_LIBGSL
+
+  /* Allocate memory for the interpolation tables */
+  if (swift_memalign("cosmo.table", (void **)&c->drift_fac_interp_table,
+                     SWIFT_STRUCT_ALIGNMENT,
+                     cosmology_table_length * sizeof(double)) != 0)
+    error("Failed to allocate cosmology interpolation table");
+  if (swift_memalign("cosmo.table", (void **)&c->grav_kick_fac_interp_table,
+                     SWIFT_STRUCT_ALIGNMENT,
+                     cosmology_table_length * sizeof(double)) != 0)
+    error("Failed to allocate cosmology interpolation table");
+  if (swift_memalign("cosmo.table", (void **)&c->hydro_kick_fac_interp_table,
+                     SWIFT_STRUCT_ALIGNMENT,
+                     cosmology_table_length * sizeof(double)) != 0)
+    error("Failed to allocate cosmology interpolation table");
+  if (swift_memalign("cosmo.table", (void **)&c->hydro_kick_corr_interp_table,
+                     SWIFT_STRUCT_ALIGNMENT,
+                     cosmology_table_length * sizeof(double)) != 0)
+    error("Failed to allocate cosmology interpolation table");
+  if (swift_memalign("cosmo.table", (void **)&c->time_interp_table,
+                     SWIFT_STRUCT_ALIGNMENT,
+                     cosmology_table_length * sizeof(double)) != 0)
+    error("Failed to allocate cosmology interpolation table");
+  if (swift_memalign("cosmo.table", (void **)&c->scale_factor_interp_table,
+                     SWIFT_STRUCT_ALIGNMENT,
+                     cosmology_table_length * sizeof(double)) != 0)
+    error("Failed to allocate cosmology interpolation table");
+  if (swift_memalign("cosmo.table", (void **)&c->comoving_distance_interp_table,
+                     SWIFT_STRUCT_ALIGNMENT,
+                     cosmology_table_length * sizeof(double)) != 0)
+    error("Failed to allocate cosmology interpolation table");
+  if (swift_memalign(
+          "cosmo.table", (void **)&c->comoving_distance_inverse_interp_table,
+          SWIFT_STRUCT_ALIGNMENT, cosmology_table_length * sizeof(double)) != 0)
+    error("Failed to allocate cosmology interpolation table");
+
+  /* Did we already compute them? */
+  double *const tables[8] = {c->drift_fac_interp_table,
+                             c->grav_kick_fac_interp_table,
+                             c->hydro_kick_fac_interp_table,
+                             c->hydro_kick_corr_interp_table,
+                             c->time_interp_table,
+                             c->comoving_distance_interp_table,
+                             c->scale_factor_interp_table,
+                             c->comoving_distance_inverse_interp_table};
+  double *const scalars[5] = {&c->time_interp_table_offset,
+                              &c->time_interp_table_max,
+                              &c->universe_age_at_present_day,
+                              &c->comoving_distance_interp_table_offset,
+                              &c->comoving_distance_start_to_end};
+  if (!cosmology_tables_cache_read(c, "integrals", tables, 8, scalars, 5)) {
+    cosmology_integrate_tables(c, tables);
+
+    /* Keep them for next time */
+    cosmology_tables_cache_write(c, "integrals", tables, 8, scalars, 5);
+  }
+
+  /* Update the times */
+  c->time_begin = cosmology_get_time_since_big_bang(c, c->a_begin);
+  c->time_end = cosmology_get_time_since_big_bang(c, c->a_end);
 
 #ifdef SWIFT_DEBUG_CHECKS
 
@@ -906,6 +1238,11 @@ void cosmology_init(struct swift_params *params, const struct unit_system *us,
                                       c->deg_nu);
   }
 
+  /* Where to cache the interpolation tables, if anywhere */
+  parser_get_opt_param_string(params, "Cosmology:table_cache_dir",
+                              c->table_cache_dir, "none");
+  if (strcmp(c->table_cache_dir, "none") == 0) c->table_cache_dir[0] = '\0';
+
   /* Read the start and end of the simulation */
   c->a_begin = parser_get_param_double(params, "Cosmology:a_begin");
   c->a_end = parser_get_param_double(params, "Cosmology:a_end");
@@ -1129,6 +1466,7 @@ void cosmology_init_no_cosmo(struct cosmology *c) {
   c->scale_factor_interp_table = NULL;
   c->comoving_distance_interp_table = NULL;
   c->comoving_distance_inverse_interp_table = NULL;
+  c->table_cache_dir[0] = '\0';
 
   c->time_begin = 0.;
   c->time_end = 0.;
@@ -270,6 +270,10 @@ struct cosmology {
 
   /*! Time at the present-day (a=1) */
   double universe_age_at_present_day;
+
+  /*! Directory caching the interpolation tables between runs (none if
+   * empty) */
+  char table_cache_dir[PARSER_MAX_LINE_SIZE];
 };
 
 void cosmology_update(struct cosmology *c, const struct phys_const *phys_const,
@@ -242,6 +242,33 @@ void csds_log_parts(struct csds_writer *log, const struct part *p,
                     const int log_all_fields,
                     const enum csds_special_flags flag, const int flag_data) {
 
+  csds_log_parts_selection(log, p, xp, /* ind= */ NULL, count, e,
+                           log_all_fields, flag, flag_data);
+}
+
+/**
+ * @brief Dump a selection of the #part of an array to the log.
+ *
+ * The records of all of them are reserved in the logfile at once, such that
+ * the logging of many particles does not contend on the logfile.
+ *
+ * @param log The #csds_writer.
+ * @param p The array of #part.
+ * @param xp The array of #xpart.
+ * @param ind The indices of the particles to dump in the arrays (NULL for the
+ * first count ones).
+ * @param count The number of particle to dump.
+ * @param e The #engine.
+ * @param log_all_fields Should we log all the fields?
+ * @param flag The value of the special flags.
+ * @param flag_data The data to write for the flag.
+ */
+void csds_log_parts_selection(struct csds_writer *log, const struct part *p,
+                              struct xpart *xp, const int *ind, int count,
+                              const struct engine *e, const int log_all_fields,
+                              const enum csds_special_flags flag,
+                              const int flag_data) {
+
   /* Build the special flag */
   const int size_special_flag = log->list_fields[CSDS_SPECIAL_FLAGS_INDEX].size;
   const uint32_t special_flags =
@@ -274,19 +301,21 @@ void csds_log_parts(struct csds_writer *log, const struct part *p,
 
   /* Write the particles */
   for (int i = 0; i < count; i++) {
+    const int k = ind != NULL ? ind[i] : i;
+
     /* reset the offset of the previous log */
     if (flag == csds_flag_create || flag == csds_flag_mpi_enter) {
-      xp[i].csds_data.last_offset = 0;
+      xp[k].csds_data.last_offset = 0;
     }
 
     /* Copy everything into the buffer */
-    csds_copy_part_fields(log, &p[i], &xp[i], e, mask,
-                          &xp[i].csds_data.last_offset, offset_new, buff,
+    csds_copy_part_fields(log, &p[k], &xp[k], e, mask,
+                          &xp[k].csds_data.last_offset, offset_new, buff,
                           special_flags);
 
     /* Update the pointers */
-    xp[i].csds_data.last_offset = offset_new;
-    xp[i].csds_data.steps_since_last_output = 0;
+    xp[k].csds_data.last_offset = offset_new;
+    xp[k].csds_data.steps_since_last_output = 0;
     buff += size;
     offset_new += size;
   }
@@ -398,6 +427,31 @@ void csds_log_spart(struct csds_writer *log, struct spart *sp,
 void csds_log_sparts(struct csds_writer *log, struct spart *sp, int count,
                      const struct engine *e, const int log_all_fields,
                      const enum csds_special_flags flag, const int flag_data) {
+
+  csds_log_sparts_selection(log, sp, /* ind= */ NULL, count, e, log_all_fields,
+                            flag, flag_data);
+}
+
+/**
+ * @brief Dump a selection of the #spart of an array to the log.
+ *
+ * The records of all of them are reserved in the logfile at once.
+ *
+ * @param log The #csds_writer
+ * @param sp The array of #spart.
+ * @param ind The indices of the particles to dump in the array (NULL for the
+ * first count ones).
+ * @param count The number of particle to dump.
+ * @param e The #engine.
+ * @param log_all_fields Should we log all the fields?
+ * @param flag The value of the special flags.
+ * @param flag_data The data to write for the flag.
+ */
+void csds_log_sparts_selection(struct csds_writer *log, struct spart *sp,
+                               const int *ind, int count,
+                               const struct engine *e, const int log_all_fields,
+                               const enum csds_special_flags flag,
+                               const int flag_data) {
   /* Build the special flag */
   const int size_special_flag = log->list_fields[CSDS_SPECIAL_FLAGS_INDEX].size;
   const uint32_t special_flags =
@@ -430,18 +484,20 @@ void csds_log_sparts(struct csds_writer *log, struct spart *sp, int count,
 #endif
 
   for (int i = 0; i < count; i++) {
+    const int k = ind != NULL ? ind[i] : i;
+
     /* reset the offset of the previous log */
     if (flag == csds_flag_create || flag == csds_flag_mpi_enter) {
-      sp[i].csds_data.last_offset = 0;
+      sp[k].csds_data.last_offset = 0;
     }
 
     /* Copy everything into the buffer */
-    csds_copy_spart_fields(log, &sp[i], e, mask, &sp[i].csds_data.last_offset,
+    csds_copy_spart_fields(log, &sp[k], e, mask, &sp[k].csds_data.last_offset,
                            offset_new, buff, special_flags);
 
     /* Update the pointers */
-    sp[i].csds_data.last_offset = offset_new;
-    sp[i].csds_data.steps_since_last_output = 0;
+    sp[k].csds_data.last_offset = offset_new;
+    sp[k].csds_data.steps_since_last_output = 0;
     buff += size;
     offset_new += size;
   }
@@ -552,6 +608,32 @@ void csds_log_gpart(struct csds_writer *log, struct gpart *p,
 void csds_log_gparts(struct csds_writer *log, struct gpart *p, int count,
                      const struct engine *e, const int log_all_fields,
                      const enum csds_special_flags flag, const int flag_data) {
+
+  csds_log_gparts_selection(log, p, /* ind= */ NULL, count, e, log_all_fields,
+                            flag, flag_data);
+}
+
+/**
+ * @brief Dump a selection of the #gpart of an array to the log.
+ *
+ * Only the dark matter ones are written. The records of all of them are
+ * reserved in the logfile at once.
+ *
+ * @param log The #csds_writer
+ * @param p The array of #gpart.
+ * @param ind The indices of the particles to dump in the array (NULL for the
+ * first count ones).
+ * @param count The number of particle to dump.
+ * @param e The #engine.
+ * @param log_all_fields Should we log all the fields?
+ * @param flag The value of the special flags.
+ * @param flag_data The data to write for the flag.
+ */
+void csds_log_gparts_selection(struct csds_writer *log, struct gpart *p,
+                               const int *ind, int count,
+                               const struct engine *e, const int log_all_fields,
+                               const enum csds_special_flags flag,
+                               const int flag_data) {
   /* Build the special flag */
   const int size_special_flag = log->list_fields[CSDS_SPECIAL_FLAGS_INDEX].size;
   const uint32_t special_flags =
@@ -562,9 +644,11 @@ void csds_log_gparts(struct csds_writer *log, struct gpart *p, int count,
   int count_dm = 0;
   // TODO: write only some fields
   for (int i = 0; i < count; i++) {
+    const int k = ind != NULL ? ind[i] : i;
+
     /* Log only the dark matter */
-    if (p[i].type != swift_type_dark_matter &&
-        p[i].type != swift_type_dark_matter_background)
+    if (p[k].type != swift_type_dark_matter &&
+        p[k].type != swift_type_dark_matter_background)
       continue;
 
     count_dm += 1;
@@ -594,23 +678,25 @@ void csds_log_gparts(struct csds_writer *log, struct gpart *p, int count,
 #endif
 
   for (int i = 0; i < count; i++) {
+    const int k = ind != NULL ? ind[i] : i;
+
     /* Log only the dark matter */
-    if (p[i].type != swift_type_dark_matter &&
-        p[i].type != swift_type_dark_matter_background)
+    if (p[k].type != swift_type_dark_matter &&
+        p[k].type != swift_type_dark_matter_background)
       continue;
 
     /* reset the offset of the previous log */
     if (flag == csds_flag_create || flag == csds_flag_mpi_enter) {
-      p[i].csds_data.last_offset = 0;
+      p[k].csds_data.last_offset = 0;
     }
 
     /* Copy everything into the buffer */
-    csds_copy_gpart_fields(log, &p[i], e, mask, &p[i].csds_data.last_offset,
+    csds_copy_gpart_fields(log, &p[k], e, mask, &p[k].csds_data.last_offset,
                            offset_new, buff, special_flags);
 
     /* Update the pointers */
-    p[i].csds_data.last_offset = offset_new;
-    p[i].csds_data.steps_since_last_output = 0;
+    p[k].csds_data.last_offset = offset_new;
+    p[k].csds_data.steps_since_last_output = 0;
     buff += size;
     offset_new += size;
   }
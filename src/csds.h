@@ -119,18 +119,33 @@ void csds_log_parts(struct csds_writer *log, const struct part *p,
                     struct xpart *xp, int count, const struct engine *e,
                     const int log_all_fields,
                     const enum csds_special_flags flag, const int flag_data);
+void csds_log_parts_selection(struct csds_writer *log, const struct part *p,
+                              struct xpart *xp, const int *ind, int count,
+                              const struct engine *e, const int log_all_fields,
+                              const enum csds_special_flags flag,
+                              const int flag_data);
 void csds_log_spart(struct csds_writer *log, struct spart *p,
                     const struct engine *e, const int log_all_fields,
                     const enum csds_special_flags flag, const int flag_data);
 void csds_log_sparts(struct csds_writer *log, struct spart *sp, int count,
                      const struct engine *e, const int log_all_fields,
                      const enum csds_special_flags flag, const int flag_data);
+void csds_log_sparts_selection(struct csds_writer *log, struct spart *sp,
+                               const int *ind, int count,
+                               const struct engine *e, const int log_all_fields,
+                               const enum csds_special_flags flag,
+                               const int flag_data);
 void csds_log_gpart(struct csds_writer *log, struct gpart *p,
                     const struct engine *e, const int log_all_fields,
                     const enum csds_special_flags flag, const int flag_data);
 void csds_log_gparts(struct csds_writer *log, struct gpart *gp, int count,
                      const struct engine *e, const int log_all_fields,
                      const enum csds_special_flags flag, const int flag_data);
+void csds_log_gparts_selection(struct csds_writer *log, struct gpart *p,
+                               const int *ind, int count,
+                               const struct engine *e, const int log_all_fields,
+                               const enum csds_special_flags flag,
+                               const int flag_data);
 void csds_init(struct csds_writer *log, const struct engine *e,
                struct swift_params *params);
 void csds_free(struct csds_writer *log);
@@ -0,0 +1,196 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "cuda_devices.h"
+
+/* System includes. */
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WITH_CUDA
+/* CUDA headers. */
+#include <cuda_runtime.h>
+#endif
+
+/* Local headers. */
+#include "cell.h"
+#include "clocks.h"
+#include "error.h"
+#include "runner.h"
+#include "space.h"
+
+/*! The GPUs driven by this rank. */
+struct cuda_devices gpu_devices;
+
+/**
+ * @brief Find the GPUs to use and initialise the #cuda_devices.
+ *
+ * Without any usable device (CPU-only node or build), none is used and all
+ * the work stays on the CPU, unless devices were explicitly asked for.
+ *
+ * @param requested The number of devices to use (0 for all the visible ones,
+ * < 0 for none).
+ * @param nr_runners The number of runners.
+ */
+void cuda_devices_init(const int requested, const int nr_runners) {
+
+  gpu_devices.count = 0;
+  gpu_devices.nr_runners = nr_runners;
+  gpu_devices.runner_device = (int *)calloc(nr_runners, sizeof(int));
+  if (gpu_devices.runner_device == NULL)
+    error("Failed to allocate the runner to device map.");
+
+  /* GPUs switched off? */
+  if (requested < 0) return;
+
+#ifdef WITH_CUDA
+  int visible = 0;
+  const cudaError_t err = cudaGetDeviceCount(&visible);
+  if (err != cudaSuccess) {
+
+    /* No driver or no device on this node, forget about it */
+    cudaGetLastError();
+    if (requested > 0)
+      error("Couldn't count the CUDA devices: %s", cudaGetErrorString(err));
+    return;
+  }
+  if (visible == 0) {
+    if (requested > 0) error("No CUDA device found.");
+    return;
+  }
+
+  int count = requested > 0 ? requested : visible;
+  if (count > visible)
+    error("Asked for %d CUDA devices but only %d are visible.", count,
+          visible);
+  if (count > CUDA_MAX_DEVICES) count = CUDA_MAX_DEVICES;
+  if (count > nr_runners) count = nr_runners;
+
+  gpu_devices.count = count;
+#else
+  if (requested > 0)
+    error("Asked for %d CUDA devices but SWIFT was compiled without CUDA.",
+          requested);
+#endif
+}
+
+/**
+ * @brief Frees the memory of the #cuda_devices.
+ */
+void cuda_devices_clean(void) {
+
+  free(gpu_devices.runner_device);
+  gpu_devices.runner_device = NULL;
+  gpu_devices.count = 0;
+}
+
+/**
+ * @brief Bind a runner to the device of the queue it reads from.
+ *
+ * @param runner_id The id of the #runner.
+ * @param qid The queue of the #runner.
+ * @param nr_queues The number of queues.
+ */
+void cuda_devices_set_runner(const int runner_id, const int qid,
+                             const int nr_queues) {
+
+  gpu_devices.runner_device[runner_id] = cuda_devices_of_queue(qid, nr_queues);
+}
+
+/**
+ * @brief Make a device the current one of the calling thread.
+ *
+ * @param device The device.
+ */
+void cuda_devices_use(const int device) {
+
+  if (gpu_devices.count <= 1) return;
+
+#ifdef WITH_CUDA
+  const cudaError_t err = cudaSetDevice(device);
+  if (err != cudaSuccess)
+    error("Couldn't switch to CUDA device %d: %s", device,
+          cudaGetErrorString(err));
+#endif
+}
+
+/**
+ * @brief The device a cell belongs to.
+ *
+ * The top-level cells are spread over the devices in contiguous chunks of
+ * index.
+ *
+ * @param s The #space.
+ * @param c The #cell.
+ */
+int cuda_devices_of_cell(const struct space *s, const struct cell *c) {
+
+  if (gpu_devices.count <= 1) return 0;
+
+  const long long index = c->top - s->cells_top;
+  return (int)(index * gpu_devices.count / s->nr_cells);
+}
+
+/**
+ * @brief Move a task to a queue read by the runners of the device its cell
+ * belongs to, if it is not on one already.
+ *
+ * @param s The #space.
+ * @param c The #cell of the task.
+ * @param qid The queue picked so far (-1 if none).
+ * @param nr_queues The number of queues.
+ * @return The queue to use (-1 if any will do).
+ */
+int cuda_devices_pick_queue(const struct space *s, const struct cell *c,
+                            const int qid, const int nr_queues) {
+
+  const int device = cuda_devices_of_cell(s, c);
+  if (qid >= 0 && cuda_devices_of_queue(qid, nr_queues) == device) return qid;
+
+  /* The queues of this device */
+  const int count = gpu_devices.count;
+  const int first = (device * nr_queues + count - 1) / count;
+  const int last = ((device + 1) * nr_queues + count - 1) / count;
+
+  /* More devices than queues? */
+  if (last <= first) return qid;
+
+  return first + rand() % (last - first);
+}
+
+/**
+ * @brief Print what every device did since the last call and reset the
+ * counters of the runners.
+ *
+ * Must be called when no task is running.
+ *
+ * @param runners The #runner array.
+ * @param nr_runners The number of runners.
+ * @param verbose Are we talkative?
+ *
+ * @return The time all the runners spent in offloaded calls.
+ */
+ticks cuda_devices_report(struct runner *runners, const int nr_runners,
+                          const int verbose) {
+
+  struct cuda_device_load load[CUDA_MAX_DEVICES];
+  bzero(load, sizeof(load));
+
+  ticks total = 0;
+  for (int k = 0; k < nr_runners; ++k) {
+    struct cuda_device_load *l = &load[cuda_devices_of_runner(k)];
+    l->calls += runners[k].gpu_load.calls;
+    l->work += runners[k].gpu_load.work;
+    l->time += runners[k].gpu_load.time;
+    total += runners[k].gpu_load.time;
+    bzero(&runners[k].gpu_load, sizeof(struct cuda_device_load));
+  }
+
+  if (!verbose) return total;
+
+  for (int d = 0; d < gpu_devices.count; ++d)
+    message("GPU %d: %lld calls, %e interactions, %.3f %s.", d, load[d].calls,
+            load[d].work, clocks_from_ticks(load[d].time), clocks_getunit());
+  return total;
+}
@@ -0,0 +1,110 @@
+#ifndef SWIFT_CUDA_DEVICES_H
+#define SWIFT_CUDA_DEVICES_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* Local headers */
+#include "cycle.h"
+#include "inline.h"
+
+/* Forward declarations */
+struct cell;
+struct runner;
+struct space;
+
+/*! Maximal number of GPUs a rank can drive. */
+#define CUDA_MAX_DEVICES 16
+
+/**
+ * @brief What one runner sent to its GPU since the last report.
+ */
+struct cuda_device_load {
+
+  /*! Number of offloaded calls. */
+  long long calls;
+
+  /*! Number of interactions offloaded. */
+  double work;
+
+  /*! Time spent in the offloaded calls. */
+  ticks time;
+};
+
+/**
+ * @brief The GPUs driven by this rank.
+ *
+ * Each runner drives one device and all its device buffers live there. The
+ * top-level cells are spread over the devices by contiguous index. The
+ * gravity tasks of a cell are queued for the runners of its device such
+ * that they find the particles of the cell in that device's #gpart mirror.
+ */
+struct cuda_devices {
+
+  /*! Number of devices in use (0 if everything runs on the CPU). */
+  int count;
+
+  /*! Device of each runner. */
+  int *runner_device;
+
+  /*! Number of runners. */
+  int nr_runners;
+};
+
+extern struct cuda_devices gpu_devices;
+
+/**
+ * @brief Are we sending any work to a GPU at all?
+ */
+static INLINE int cuda_devices_active(void) { return gpu_devices.count > 0; }
+
+/**
+ * @brief The device a given runner drives.
+ *
+ * @param runner_id The id of the #runner.
+ */
+static INLINE int cuda_devices_of_runner(const int runner_id) {
+
+  if (gpu_devices.count <= 1) return 0;
+  return gpu_devices.runner_device[runner_id];
+}
+
+/**
+ * @brief The device of the runners reading from a given task queue.
+ *
+ * @param qid The index of the queue.
+ * @param nr_queues The number of queues.
+ */
+static INLINE int cuda_devices_of_queue(const int qid, const int nr_queues) {
+
+  return qid * gpu_devices.count / nr_queues;
+}
+
+/**
+ * @brief Add an offloaded call to a runner's #cuda_device_load.
+ *
+ * @param l The #cuda_device_load.
+ * @param work The number of interactions in the call.
+ * @param dt The time the call took.
+ */
+static INLINE void cuda_device_load_add(struct cuda_device_load *l,
+                                        const double work, const ticks dt) {
+
+  l->calls++;
+  l->work += work;
+  l->time += dt;
+}
+
+/* Function prototypes. */
+void cuda_devices_init(const int requested, const int nr_runners);
+void cuda_devices_clean(void);
+void cuda_devices_set_runner(const int runner_id, const int qid,
+                             const int nr_queues);
+void cuda_devices_use(const int device);
+int cuda_devices_of_cell(const struct space *s, const struct cell *c);
+int cuda_devices_pick_queue(const struct space *s, const struct cell *c,
+                            const int qid, const int nr_queues);
+ticks cuda_devices_report(struct runner *runners, const int nr_runners,
+                          const int verbose);
+
+#endif /* SWIFT_CUDA_DEVICES_H */
@@ -0,0 +1,57 @@
+#ifndef SWIFT_CUDA_EXACT_FORCE_H
+#define SWIFT_CUDA_EXACT_FORCE_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* System includes. */
+#include <stddef.h>
+
+/**
+ * @brief The brute-force gravity calculation of the force checks as handed
+ * to the GPU.
+ *
+ * All the local #gpart are the sources, only the tested ones are sinks.
+ * Everything is in double precision like gravity_exact_force_compute_mapper()
+ * and the Ewald table is the one of gravity.c. The host arrays are filled by
+ * the caller, the device ones only live for the duration of the offload.
+ */
+struct cuda_exact_force {
+
+  /*! Positions and masses of all the local #gpart. */
+  double *x, *y, *z, *m;
+
+  /*! Number of local #gpart. */
+  size_t nr_gparts;
+
+  /*! Index in the arrays above and softening of each tested #gpart. */
+  size_t *index;
+  double *h;
+
+  /*! Number of tested #gpart. */
+  int nr_tested;
+
+  /*! (return) Accelerations (3 per tested #gpart, without G): total, times
+   * the short-range truncation, and what is left for the mesh (Ewald
+   * correction included). */
+  double *a_grav, *a_grav_short, *a_grav_long;
+
+  /*! (return) Potentials of the tested #gpart (without G). */
+  double *pot;
+
+  /*! The Ewald correction tables, each of (n_ewald + 1)^3 elements. */
+  const float *fewald_x, *fewald_y, *fewald_z, *potewald;
+
+  /*! Size of the Ewald tables and scaling from distance to table index. */
+  int n_ewald;
+  double ewald_fac;
+
+  /*! Box size and inverse of the long-range truncation scale. */
+  double dim[3];
+  double r_s_inv;
+
+  /*! Are we periodic? */
+  int periodic;
+};
+
+#endif /* SWIFT_CUDA_EXACT_FORCE_H */
@@ -0,0 +1,347 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "cuda_fof.h"
+
+/* System includes. */
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WITH_CUDA
+/* CUDA headers. */
+#include <cuda_runtime.h>
+#endif
+
+/* Local headers. */
+#include "clocks.h"
+#include "engine.h"
+#include "error.h"
+#include "fof.h"
+#include "space.h"
+#include "threadpool.h"
+
+/*! The one instance, driven by the main thread */
+struct cuda_fof gpu_fof;
+
+/* Links the gparts of the leaf pairs on the device (see grav_pp_offload.cu) */
+extern void fof_link_offload(struct cuda_fof *f, const size_t nr_gparts,
+                             const double l_x2);
+
+/**
+ * @brief Allocate one device array of the #cuda_fof.
+ *
+ * @param ptr (return) The device pointer.
+ * @param size The number of bytes to allocate.
+ */
+static void cuda_fof_alloc_device(void **ptr, const size_t size) {
+
+#ifdef WITH_CUDA
+  const cudaError_t err = cudaMalloc(ptr, size);
+  if (err != cudaSuccess)
+    error("Couldn't allocate device FOF arrays (%zd bytes): %s", size,
+          cudaGetErrorString(err));
+#else
+  error("SWIFT was not compiled with CUDA support.");
+#endif
+}
+
+/**
+ * @brief Allocate one host array of the #cuda_fof.
+ *
+ * @param ptr (return) The host pointer.
+ * @param size The number of bytes to allocate.
+ */
+static void cuda_fof_alloc_host(void **ptr, const size_t size) {
+
+#ifdef WITH_CUDA
+  /* Page-locked such that the copies are fast */
+  const cudaError_t err = cudaHostAlloc(ptr, size, cudaHostAllocPortable);
+  if (err != cudaSuccess)
+    error("Couldn't allocate host FOF arrays (%zd bytes): %s", size,
+          cudaGetErrorString(err));
+#else
+  error("SWIFT was not compiled with CUDA support.");
+#endif
+}
+
+/**
+ * @brief Initialise the (empty) #cuda_fof.
+ *
+ * @param active Are we going to link the #gpart on the GPU?
+ */
+void cuda_fof_init(const int active) {
+
+  bzero(&gpu_fof, sizeof(struct cuda_fof));
+  gpu_fof.active = active;
+}
+
+/**
+ * @brief Free the #gpart arrays of the #cuda_fof.
+ *
+ * @param f The #cuda_fof.
+ */
+static void cuda_fof_free_gparts(struct cuda_fof *f) {
+
+#ifdef WITH_CUDA
+  if (f->size > 0) {
+    cudaFreeHost(f->x);
+    cudaFreeHost(f->y);
+    cudaFreeHost(f->z);
+    cudaFreeHost(f->linkable);
+    cudaFreeHost(f->parent);
+    cudaFree(f->d_x);
+    cudaFree(f->d_y);
+    cudaFree(f->d_z);
+    cudaFree(f->d_linkable);
+    cudaFree(f->d_parent);
+  }
+#endif
+  f->size = 0;
+}
+
+/**
+ * @brief Free the leaf pair arrays of the #cuda_fof.
+ *
+ * @param f The #cuda_fof.
+ */
+static void cuda_fof_free_pairs(struct cuda_fof *f) {
+
+#ifdef WITH_CUDA
+  if (f->pairs_size > 0) {
+    cudaFreeHost(f->pairs);
+    cudaFree(f->d_pairs);
+  }
+#endif
+  f->pairs = NULL;
+  f->d_pairs = NULL;
+  f->pairs_size = 0;
+}
+
+/**
+ * @brief Free all the memory of the #cuda_fof.
+ */
+void cuda_fof_clean(void) {
+
+  struct cuda_fof *f = &gpu_fof;
+  cuda_fof_free_gparts(f);
+  cuda_fof_free_pairs(f);
+}
+
+/**
+ * @brief Append a pair of leaves (or a single leaf) to the list the device
+ * will link.
+ *
+ * The host list grows as needed and the device one is re-allocated to match
+ * when the list is sent.
+ *
+ * @param offset_i Offset of the first #gpart of the first leaf.
+ * @param count_i Number of #gpart in the first leaf.
+ * @param offset_j Offset of the first #gpart of the second leaf.
+ * @param count_j Number of #gpart in the second leaf.
+ * @param shift Periodic shift to subtract from the first leaf's positions.
+ * @param self Is this a single leaf linked with itself?
+ */
+void cuda_fof_add_leaf_pair(const size_t offset_i, const int count_i,
+                            const size_t offset_j, const int count_j,
+                            const double shift[3], const int self) {
+
+  struct cuda_fof *f = &gpu_fof;
+
+  if (f->nr_pairs == f->pairs_size) {
+    const size_t new_size = f->pairs_size > 0 ? 2 * f->pairs_size : 16384;
+    struct cuda_fof_leaf_pair *new_pairs;
+    cuda_fof_alloc_host((void **)&new_pairs,
+                        new_size * sizeof(struct cuda_fof_leaf_pair));
+    if (f->nr_pairs > 0)
+      memcpy(new_pairs, f->pairs,
+             f->nr_pairs * sizeof(struct cuda_fof_leaf_pair));
+    const size_t nr_pairs = f->nr_pairs;
+    cuda_fof_free_pairs(f);
+    cuda_fof_alloc_device((void **)&f->d_pairs,
+                          new_size * sizeof(struct cuda_fof_leaf_pair));
+    f->pairs = new_pairs;
+    f->pairs_size = new_size;
+    f->nr_pairs = nr_pairs;
+  }
+
+  struct cuda_fof_leaf_pair *p = &f->pairs[f->nr_pairs++];
+  p->offset_i = offset_i;
+  p->offset_j = offset_j;
+  p->count_i = count_i;
+  p->count_j = count_j;
+  p->shift[0] = shift[0];
+  p->shift[1] = shift[1];
+  p->shift[2] = shift[2];
+  p->self = self;
+}
+
+#ifdef WITH_FOF
+
+/**
+ * @brief Make sure the #cuda_fof can hold a given number of #gpart.
+ *
+ * @param f The #cuda_fof.
+ * @param nr_gparts The number of #gpart in the #space.
+ */
+static void cuda_fof_ensure(struct cuda_fof *f, const size_t nr_gparts) {
+
+  /* Leave some head-room for the next calls */
+  if (nr_gparts > f->size) {
+    cuda_fof_free_gparts(f);
+    const size_t size = nr_gparts + nr_gparts / 10 + 1;
+    const size_t sizeD = size * sizeof(double);
+    cuda_fof_alloc_host((void **)&f->x, sizeD);
+    cuda_fof_alloc_host((void **)&f->y, sizeD);
+    cuda_fof_alloc_host((void **)&f->z, sizeD);
+    cuda_fof_alloc_host((void **)&f->linkable, size * sizeof(char));
+    cuda_fof_alloc_host((void **)&f->parent, size * sizeof(int));
+    cuda_fof_alloc_device((void **)&f->d_x, sizeD);
+    cuda_fof_alloc_device((void **)&f->d_y, sizeD);
+    cuda_fof_alloc_device((void **)&f->d_z, sizeD);
+    cuda_fof_alloc_device((void **)&f->d_linkable, size * sizeof(char));
+    cuda_fof_alloc_device((void **)&f->d_parent, size * sizeof(int));
+    f->size = size;
+  }
+}
+
+/**
+ * @brief #threadpool mapper function copying the #gpart to the SoA arrays
+ * of the #cuda_fof.
+ *
+ * @param map_data The #gpart.
+ * @param num_elements The number of #gpart.
+ * @param extra_data The #space.
+ */
+static void cuda_fof_gparts_mapper(void *map_data, int num_elements,
+                                   void *extra_data) {
+
+  const struct space *s = (const struct space *)extra_data;
+  const struct gpart *gparts = (const struct gpart *)map_data;
+  const size_t offset = gparts - s->gparts;
+  const size_t *group_index = s->e->fof_properties->group_index;
+  struct cuda_fof *f = &gpu_fof;
+
+  for (int k = 0; k < num_elements; ++k) {
+    const struct gpart *gp = &gparts[k];
+    const size_t i = offset + k;
+
+    f->x[i] = gp->x[0];
+    f->y[i] = gp->x[1];
+    f->z[i] = gp->x[2];
+
+    /* Start from the seeded roots, which are never above the index */
+    f->parent[i] = (int)group_index[i];
+
+    /* Only the non-inhibited particles of the linking kind get linked as
+     * in fof_search_self_cell() */
+    f->linkable[i] = gp->time_bin < time_bin_inhibited &&
+                     (current_fof_linking_type & (1 << (gp->type + 1)));
+  }
+}
+
+/**
+ * @brief #threadpool mapper function copying the roots found by the GPU to
+ * the FOF group indices.
+ *
+ * @param map_data The group indices.
+ * @param num_elements The number of group indices.
+ * @param extra_data The start of the group indices.
+ */
+static void cuda_fof_write_back_mapper(void *map_data, int num_elements,
+                                       void *extra_data) {
+
+  size_t *group_index = (size_t *)map_data;
+  const size_t *group_index_start = (const size_t *)extra_data;
+  const size_t offset = group_index - group_index_start;
+  const struct cuda_fof *f = &gpu_fof;
+
+  for (int k = 0; k < num_elements; ++k)
+    group_index[k] = (size_t)f->parent[offset + k];
+}
+
+#endif /* WITH_FOF */
+
+/**
+ * @brief Link the local #gpart into FOF fragments on the GPU.
+ *
+ * Device version of running the fof_self and fof_pair tasks: the pairs of
+ * leaves within the linking length are collected on the host with the same
+ * recursion as the tasks and the device links them with the same distance
+ * criterion, starting from the roots already in fof_props->group_index. The
+ * roots it finds (the smallest index of each fragment) are written back.
+ * The linking to the foreign fragments over MPI and the attaching are then
+ * done on the CPU as usual.
+ *
+ * Must be called when no task is running, after engine_make_fof_tasks().
+ *
+ * @param e The #engine.
+ *
+ * @return 1 if the linking was done, 0 if it has to be done on the CPU.
+ */
+int cuda_fof_search(struct engine *e) {
+
+#ifdef WITH_FOF
+  struct cuda_fof *f = &gpu_fof;
+  const struct space *s = e->s;
+  struct fof_props *props = e->fof_properties;
+  const size_t nr_gparts = s->nr_gparts;
+  const double dim[3] = {s->dim[0], s->dim[1], s->dim[2]};
+  const double search_r2 = props->search_l_x2;
+
+  /* The device roots are ints */
+  if (!f->active || nr_gparts >= INT_MAX) return 0;
+
+  ticks tic = getticks();
+
+  cuda_fof_ensure(f, nr_gparts);
+
+  /* The particles, in SoA form */
+  if (nr_gparts > 0)
+    threadpool_map(&e->threadpool, cuda_fof_gparts_mapper, s->gparts,
+                   nr_gparts, sizeof(struct gpart), threadpool_auto_chunk_size,
+                   (void *)s);
+
+  /* The leaves reached by the local FOF tasks */
+  f->nr_pairs = 0;
+  for (int k = 0; k < e->sched.nr_tasks; ++k) {
+    const struct task *t = &e->sched.tasks[k];
+    if (t->type == task_type_fof_self) {
+      if (t->ci->nodeID != e->nodeID) continue;
+      rec_fof_collect_self(dim, search_r2, s->periodic, s->gparts, t->ci);
+    } else if (t->type == task_type_fof_pair) {
+      if (t->ci->nodeID != e->nodeID || t->cj->nodeID != e->nodeID) continue;
+      rec_fof_collect_pair(dim, search_r2, s->periodic, s->gparts, t->ci,
+                           t->cj);
+    }
+  }
+
+  if (e->verbose)
+    message("Preparing %zd leaf pairs for the GPU took %.3f %s.", f->nr_pairs,
+            clocks_from_ticks(getticks() - tic), clocks_getunit());
+
+  tic = getticks();
+
+  /* Hooking and pointer jumping on the device */
+#ifdef WITH_CUDA
+  fof_link_offload(f, nr_gparts, search_r2);
+#else
+  error("SWIFT was not compiled with CUDA support.");
+#endif
+
+  if (e->verbose)
+    message("GPU linking took %.3f %s.", clocks_from_ticks(getticks() - tic),
+            clocks_getunit());
+
+  /* And copy the roots to the group indices */
+  if (nr_gparts > 0)
+    threadpool_map(&e->threadpool, cuda_fof_write_back_mapper,
+                   props->group_index, nr_gparts, sizeof(size_t),
+                   threadpool_auto_chunk_size, props->group_index);
+
+  return 1;
+#else
+  return 0;
+#endif
+}
@@ -0,0 +1,77 @@
+#ifndef SWIFT_CUDA_FOF_H
+#define SWIFT_CUDA_FOF_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* System includes. */
+#include <stddef.h>
+
+/* Forward declarations */
+struct engine;
+
+/**
+ * @brief A pair of leaf cells (or a single leaf) whose #gpart are linked by
+ * one block of the device FOF kernel.
+ */
+struct cuda_fof_leaf_pair {
+
+  /*! Offsets of the first #gpart of the two leaves in space->gparts. */
+  size_t offset_i, offset_j;
+
+  /*! Periodic shift to subtract from the positions of the first leaf. */
+  double shift[3];
+
+  /*! Number of #gpart in the two leaves. */
+  int count_i, count_j;
+
+  /*! Is this a single leaf linked with itself? */
+  int self;
+};
+
+/**
+ * @brief Everything the GPU needs to link the local #gpart into FOF
+ * fragments.
+ *
+ * The positions and a linkable flag of every local #gpart are sent as SoA
+ * together with the list of leaf pairs within the linking length. The
+ * device then builds the connected components with lock-free hooking of the
+ * larger roots under the smaller ones and pointer jumping, and the
+ * resulting roots are brought back into fof_props->group_index.
+ */
+struct cuda_fof {
+
+  /*! Host and device copies of the #gpart positions. */
+  double *x, *y, *z, *d_x, *d_y, *d_z;
+
+  /*! Host and device copies of the linkable flags. */
+  char *linkable, *d_linkable;
+
+  /*! Host and device copies of the roots of each #gpart. */
+  int *parent, *d_parent;
+
+  /*! Number of #gpart we have room for. */
+  size_t size;
+
+  /*! Host and device copies of the leaf pairs. */
+  struct cuda_fof_leaf_pair *pairs, *d_pairs;
+
+  /*! Number of leaf pairs in the list and we have room for. */
+  size_t nr_pairs, pairs_size;
+
+  /*! Are we linking on the GPU at all? */
+  int active;
+};
+
+/* The one instance, driven by the main thread */
+extern struct cuda_fof gpu_fof;
+
+/* Function prototypes. */
+void cuda_fof_init(const int active);
+void cuda_fof_clean(void);
+void cuda_fof_add_leaf_pair(const size_t offset_i, const int count_i,
+                            const size_t offset_j, const int count_j,
+                            const double shift[3], const int self);
+int cuda_fof_search(struct engine *e);
+
+#endif /* SWIFT_CUDA_FOF_H */
@@ -0,0 +1,698 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "cuda_gpart_mirror.h"
+
+/* System includes. */
+#include <stdlib.h>
+
+#ifdef WITH_CUDA
+/* CUDA headers. */
+#include <cuda_runtime.h>
+#endif
+
+/* Local headers. */
+#include "active.h"
+#include "cell.h"
+#include "cosmology.h"
+#include "cuda_devices.h"
+#include "cuda_streams.h"
+#include "engine.h"
+#include "error.h"
+#include "gravity.h"
+#include "gravity_cache.h"
+#include "runner.h"
+#include "space.h"
+
+/*! One mirror per device, each holding the cells of that device */
+struct cuda_gpart_mirror gpu_gparts[CUDA_MAX_DEVICES];
+
+/* Drifts a list of leaves on the device (see grav_pp_offload.cu) */
+extern void gpart_drift_offload(const struct cuda_gpart_drift_list *list, const struct cuda_gpart_mirror *g, const float epsilon, cudaStream_t stream);
+
+/**
+ * @brief Allocate one array of the #cuda_gpart_mirror on the device.
+ *
+ * @param ptr (return) The device pointer.
+ * @param size The number of bytes to allocate.
+ */
+static void cuda_gpart_mirror_alloc(void **ptr, const size_t size) {
+
+#ifdef WITH_CUDA
+  const cudaError_t err = cudaMalloc(ptr, size);
+  if (err != cudaSuccess)
+    error("Couldn't allocate device gpart mirror (%zd bytes): %s", size,
+          cudaGetErrorString(err));
+#else
+  error("SWIFT was not compiled with CUDA support.");
+#endif
+}
+
+/**
+ * @brief Initialise the (empty) #cuda_gpart_mirror.
+ *
+ * @param active Are we going to use the mirror?
+ * @param drift Do we drift the positions on the device?
+ */
+void cuda_gpart_mirror_init(const int active, const int drift) {
+
+  for (int d = 0; d < CUDA_MAX_DEVICES; ++d) {
+    gpu_gparts[d].size = 0;
+    gpu_gparts[d].ti_drift = NULL;
+    gpu_gparts[d].nr_leaves = 0;
+    gpu_gparts[d].active = active;
+    gpu_gparts[d].drift = active && drift;
+  }
+}
+
+/**
+ * @brief Frees the (current) device memory of one #cuda_gpart_mirror.
+ *
+ * @param g The #cuda_gpart_mirror.
+ */
+static void cuda_gpart_mirror_free(struct cuda_gpart_mirror *g) {
+
+#ifdef WITH_CUDA
+  if (g->size > 0) {
+    cudaFree(g->x);
+    cudaFree(g->y);
+    cudaFree(g->z);
+    cudaFree(g->epsilon);
+    cudaFree(g->m);
+    cudaFree(g->a_x);
+    cudaFree(g->a_y);
+    cudaFree(g->a_z);
+    cudaFree(g->pot);
+    if (g->drift) {
+      cudaFree(g->x_d);
+      cudaFree(g->y_d);
+      cudaFree(g->z_d);
+      cudaFree(g->v_x);
+      cudaFree(g->v_y);
+      cudaFree(g->v_z);
+    }
+  }
+#endif
+  g->size = 0;
+}
+
+/**
+ * @brief Frees the device memory of the #cuda_gpart_mirror of all the
+ * devices.
+ */
+void cuda_gpart_mirror_clean(void) {
+
+  for (int d = 0; d < gpu_devices.count; ++d) {
+    cuda_devices_use(d);
+    cuda_gpart_mirror_free(&gpu_gparts[d]);
+    free(gpu_gparts[d].ti_drift);
+    gpu_gparts[d].ti_drift = NULL;
+    gpu_gparts[d].nr_leaves = 0;
+  }
+  cuda_devices_use(0);
+}
+
+/**
+ * @brief Make sure the #cuda_gpart_mirror of the current device can hold all
+ * the local #gpart.
+ *
+ * @param g The #cuda_gpart_mirror.
+ * @param nr_gparts The number of #gpart (including the spare ones) to make
+ * room for.
+ */
+static void cuda_gpart_mirror_ensure_device(struct cuda_gpart_mirror *g,
+                                            const size_t nr_gparts) {
+
+  if (g->size >= nr_gparts) return;
+
+  cuda_gpart_mirror_free(g);
+
+  /* Leave some head-room for the next rebuilds */
+  const size_t size = nr_gparts + nr_gparts / 10;
+  const size_t sizeBytesF = size * sizeof(float);
+
+  cuda_gpart_mirror_alloc((void **)&g->x, sizeBytesF);
+  cuda_gpart_mirror_alloc((void **)&g->y, sizeBytesF);
+  cuda_gpart_mirror_alloc((void **)&g->z, sizeBytesF);
+  cuda_gpart_mirror_alloc((void **)&g->epsilon, sizeBytesF);
+  cuda_gpart_mirror_alloc((void **)&g->m, sizeBytesF);
+  cuda_gpart_mirror_alloc((void **)&g->a_x, sizeBytesF);
+  cuda_gpart_mirror_alloc((void **)&g->a_y, sizeBytesF);
+  cuda_gpart_mirror_alloc((void **)&g->a_z, sizeBytesF);
+  cuda_gpart_mirror_alloc((void **)&g->pot, sizeBytesF);
+  if (g->drift) {
+    const size_t sizeBytesD = size * sizeof(double);
+    cuda_gpart_mirror_alloc((void **)&g->x_d, sizeBytesD);
+    cuda_gpart_mirror_alloc((void **)&g->y_d, sizeBytesD);
+    cuda_gpart_mirror_alloc((void **)&g->z_d, sizeBytesD);
+    cuda_gpart_mirror_alloc((void **)&g->v_x, sizeBytesF);
+    cuda_gpart_mirror_alloc((void **)&g->v_y, sizeBytesF);
+    cuda_gpart_mirror_alloc((void **)&g->v_z, sizeBytesF);
+  }
+
+#ifdef WITH_CUDA
+  if (cudaMemset(g->a_x, 0, sizeBytesF) != cudaSuccess ||
+      cudaMemset(g->a_y, 0, sizeBytesF) != cudaSuccess ||
+      cudaMemset(g->a_z, 0, sizeBytesF) != cudaSuccess ||
+      cudaMemset(g->pot, 0, sizeBytesF) != cudaSuccess)
+    error("Couldn't zero the device gpart mirror");
+#endif
+
+  /* Nothing is on the device anymore */
+  for (int k = 0; k < g->nr_leaves; ++k) g->ti_drift[k] = -1;
+
+  g->size = size;
+}
+
+/**
+ * @brief Make sure the #cuda_gpart_mirror of every device can hold all the
+ * local #gpart.
+ *
+ * Must be called when no task is running. The accumulators of a freshly
+ * allocated mirror are zeroed, they are then kept at zero between two
+ * uses by the uploads and downloads.
+ *
+ * The mirrors are indexed like space->gparts but each device only ever
+ * receives the particles of its own cells.
+ *
+ * @param nr_gparts The number of #gpart (including the spare ones) to make
+ * room for.
+ */
+void cuda_gpart_mirror_ensure(const size_t nr_gparts) {
+
+  if (!gpu_gparts[0].active) return;
+
+  for (int d = 0; d < gpu_devices.count; ++d) {
+    cuda_devices_use(d);
+    cuda_gpart_mirror_ensure_device(&gpu_gparts[d], nr_gparts);
+  }
+  cuda_devices_use(0);
+}
+
+/**
+ * @brief Make room for the drift time-stamps of all the leaves and mark them
+ * as to be sent.
+ *
+ * Must be called after every rebuild (the leaves are numbered by
+ * cuda_multipole_mirror_index()), when no task is running.
+ *
+ * @param nr_leaves The number of leaves in the #space.
+ */
+void cuda_gpart_mirror_reset_leaves(const int nr_leaves) {
+
+  if (!gpu_gparts[0].drift) return;
+
+  for (int d = 0; d < gpu_devices.count; ++d) {
+    struct cuda_gpart_mirror *g = &gpu_gparts[d];
+    if (nr_leaves > g->nr_leaves) {
+      free(g->ti_drift);
+      g->nr_leaves = 1.2 * nr_leaves + 1;
+      g->ti_drift =
+          (integertime_t *)malloc(g->nr_leaves * sizeof(integertime_t));
+      if (g->ti_drift == NULL)
+        error("Failed to allocate the gpart mirror time-stamps.");
+    }
+  }
+
+  cuda_gpart_mirror_invalidate();
+}
+
+/**
+ * @brief Mark the device positions of all the leaves as out of date.
+ *
+ * To be called whenever the host drifts the #gpart outside of the drift
+ * tasks (e.g. engine_drift_all()), when no task is running. The next drift
+ * task of every leaf then sends it in full.
+ */
+void cuda_gpart_mirror_invalidate(void) {
+
+  if (!gpu_gparts[0].drift) return;
+
+  for (int d = 0; d < gpu_devices.count; ++d) {
+    struct cuda_gpart_mirror *g = &gpu_gparts[d];
+    for (int k = 0; k < g->nr_leaves; ++k) g->ti_drift[k] = -1;
+  }
+}
+
+/**
+ * @brief The #cuda_gpart_mirror a runner can read the particles of a pair of
+ * cells from, if any.
+ *
+ * Both cells must belong to the device the runner drives.
+ *
+ * @param r The #runner.
+ * @param ci The first #cell.
+ * @param cj The other #cell.
+ * @return The mirror or NULL if the particles have to be sent.
+ */
+const struct cuda_gpart_mirror *cuda_gpart_mirror_of_pair(
+    const struct runner *r, const struct cell *ci, const struct cell *cj) {
+
+  const int device = cuda_devices_of_runner(r->id);
+  if (!gpu_gparts[device].active) return NULL;
+
+  const struct space *s = r->e->s;
+  if (cuda_devices_of_cell(s, ci) != device ||
+      cuda_devices_of_cell(s, cj) != device)
+    return NULL;
+
+  return &gpu_gparts[device];
+}
+
+#ifdef WITH_CUDA
+
+/**
+ * @brief Get the (page-locked) #gravity_cache of a #runner to use as a
+ * staging area.
+ *
+ * The caches are only allocated on first use, so we make sure there is room
+ * for at least a split cell's worth of #gpart.
+ *
+ * @param r The #runner.
+ */
+static struct gravity_cache *cuda_gpart_mirror_staging(struct runner *r) {
+
+  struct gravity_cache *const staging = &r->ci_gravity_cache;
+  gravity_cache_ensure(staging, space_splitsize_grav_max);
+  return staging;
+}
+
+/**
+ * @brief Copy the double precision positions of a range of #gpart to the
+ * device.
+ *
+ * The accumulator arrays of the runner's (page-locked) #gravity_cache are
+ * used as a staging area, each of them holding half as many doubles.
+ *
+ * @param r The #runner.
+ * @param g The #cuda_gpart_mirror.
+ * @param gparts The first #gpart of the range.
+ * @param gcount The number of #gpart in the range.
+ * @param stream The stream to use on the device of the mirror.
+ */
+static void cuda_gpart_mirror_send_positions(struct runner *r,
+                                             struct cuda_gpart_mirror *g,
+                                             const struct gpart *gparts,
+                                             const int gcount,
+                                             cudaStream_t stream) {
+
+  const size_t offset = gparts - r->e->s->gparts;
+  struct gravity_cache *const staging = cuda_gpart_mirror_staging(r);
+  double *const x = (double *)staging->a_x;
+  double *const y = (double *)staging->a_y;
+  double *const z = (double *)staging->a_z;
+  const int chunk = staging->count / 2;
+
+  for (int first = 0; first < gcount; first += chunk) {
+
+    const int n = min(chunk, gcount - first);
+    for (int i = 0; i < n; ++i) {
+      const struct gpart *gp = &gparts[first + i];
+      x[i] = gp->x[0];
+      y[i] = gp->x[1];
+      z[i] = gp->x[2];
+    }
+
+    const size_t o = offset + first;
+    const size_t bytes = n * sizeof(double);
+    cudaMemcpyAsync(g->x_d + o, x, bytes, cudaMemcpyHostToDevice, stream);
+    cudaMemcpyAsync(g->y_d + o, y, bytes, cudaMemcpyHostToDevice, stream);
+    cudaMemcpyAsync(g->z_d + o, z, bytes, cudaMemcpyHostToDevice, stream);
+
+    const cudaError_t err = cudaStreamSynchronize(stream);
+    if (err != cudaSuccess)
+      error("Failed to upload gpart positions to the device: %s",
+            cudaGetErrorString(err));
+  }
+}
+
+/**
+ * @brief Copy the velocities of a range of #gpart to the device.
+ *
+ * The runner's (page-locked) #gravity_cache is used as a staging area.
+ *
+ * @param r The #runner.
+ * @param g The #cuda_gpart_mirror.
+ * @param gparts The first #gpart of the range.
+ * @param gcount The number of #gpart in the range.
+ * @param stream The stream to use on the device of the mirror.
+ */
+static void cuda_gpart_mirror_send_velocities(struct runner *r,
+                                              struct cuda_gpart_mirror *g,
+                                              const struct gpart *gparts,
+                                              const int gcount,
+                                              cudaStream_t stream) {
+
+  const size_t offset = gparts - r->e->s->gparts;
+  struct gravity_cache *const staging = cuda_gpart_mirror_staging(r);
+
+  for (int first = 0; first < gcount; first += staging->count) {
+
+    const int n = min(staging->count, gcount - first);
+    for (int i = 0; i < n; ++i) {
+      const struct gpart *gp = &gparts[first + i];
+      staging->x[i] = gp->v_full[0];
+      staging->y[i] = gp->v_full[1];
+      staging->z[i] = gp->v_full[2];
+    }
+
+    const size_t o = offset + first;
+    const size_t bytes = n * sizeof(float);
+    cudaMemcpyAsync(g->v_x + o, staging->x, bytes, cudaMemcpyHostToDevice,
+                    stream);
+    cudaMemcpyAsync(g->v_y + o, staging->y, bytes, cudaMemcpyHostToDevice,
+                    stream);
+    cudaMemcpyAsync(g->v_z + o, staging->z, bytes, cudaMemcpyHostToDevice,
+                    stream);
+
+    const cudaError_t err = cudaStreamSynchronize(stream);
+    if (err != cudaSuccess)
+      error("Failed to upload gpart velocities to the device: %s",
+            cudaGetErrorString(err));
+  }
+}
+
+/**
+ * @brief Copy a range of #gpart to the device and zero their accumulators.
+ *
+ * The runner's (page-locked) #gravity_cache is used as a staging area.
+ *
+ * @param r The #runner.
+ * @param g The #cuda_gpart_mirror.
+ * @param gparts The first #gpart of the range.
+ * @param gcount The number of #gpart in the range.
+ * @param stream The stream to use on the device of the mirror.
+ */
+static void cuda_gpart_mirror_send(struct runner *r,
+                                   struct cuda_gpart_mirror *g,
+                                   const struct gpart *gparts,
+                                   const int gcount, cudaStream_t stream) {
+
+  const struct engine *e = r->e;
+  const size_t offset = gparts - e->s->gparts;
+  struct gravity_cache *const staging = cuda_gpart_mirror_staging(r);
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (offset + gcount > g->size)
+    error("Cell does not fit in the gpart mirror");
+  if (staging->count == 0) error("Empty staging cache");
+#endif
+
+  for (int first = 0; first < gcount; first += staging->count) {
+
+    const int n = min(staging->count, gcount - first);
+
+    /* Convert to floats */
+    for (int i = 0; i < n; ++i) {
+      const struct gpart *gp = &gparts[first + i];
+      staging->x[i] = (float)gp->x[0];
+      staging->y[i] = (float)gp->x[1];
+      staging->z[i] = (float)gp->x[2];
+      staging->epsilon[i] = gravity_get_softening(gp, e->gravity_properties);
+      staging->m[i] = (gp->time_bin == time_bin_inhibited) ? 0.f : gp->mass;
+    }
+
+    const size_t o = offset + first;
+    const size_t bytes = n * sizeof(float);
+    cudaMemcpyAsync(g->x + o, staging->x, bytes, cudaMemcpyHostToDevice,
+                    stream);
+    cudaMemcpyAsync(g->y + o, staging->y, bytes, cudaMemcpyHostToDevice,
+                    stream);
+    cudaMemcpyAsync(g->z + o, staging->z, bytes, cudaMemcpyHostToDevice,
+                    stream);
+    cudaMemcpyAsync(g->epsilon + o, staging->epsilon, bytes,
+                    cudaMemcpyHostToDevice, stream);
+    cudaMemcpyAsync(g->m + o, staging->m, bytes, cudaMemcpyHostToDevice,
+                    stream);
+    cudaMemsetAsync(g->a_x + o, 0, bytes, stream);
+    cudaMemsetAsync(g->a_y + o, 0, bytes, stream);
+    cudaMemsetAsync(g->a_z + o, 0, bytes, stream);
+    cudaMemsetAsync(g->pot + o, 0, bytes, stream);
+
+    /* The staging area gets re-used by the next chunk */
+    const cudaError_t err = cudaStreamSynchronize(stream);
+    if (err != cudaSuccess)
+      error("Failed to upload gparts to the device: %s",
+            cudaGetErrorString(err));
+  }
+
+  /* The device drifting its own copy also needs the exact positions and
+   * the velocities */
+  if (g->drift) {
+    cuda_gpart_mirror_send_positions(r, g, gparts, gcount, stream);
+    cuda_gpart_mirror_send_velocities(r, g, gparts, gcount, stream);
+  }
+}
+
+/**
+ * @brief Have the device drift the leaves of a list and empty it.
+ *
+ * @param r The #runner.
+ * @param g The #cuda_gpart_mirror.
+ * @param list The #cuda_gpart_drift_list.
+ * @param stream The stream to use on the device of the mirror.
+ */
+static void cuda_gpart_mirror_drift_list(struct runner *r,
+                                         const struct cuda_gpart_mirror *g,
+                                         struct cuda_gpart_drift_list *list,
+                                         cudaStream_t stream) {
+
+  if (list->count == 0) return;
+
+  /* In DM-only runs all the gparts have the current DM softening */
+  const float epsilon = r->e->gravity_properties->epsilon_DM_cur;
+  gpart_drift_offload(list, g, epsilon, stream);
+
+  const cudaError_t err = cudaStreamSynchronize(stream);
+  if (err != cudaSuccess)
+    error("Failed to drift gparts on the device: %s", cudaGetErrorString(err));
+
+  list->count = 0;
+}
+
+/**
+ * @brief Bring the device copy of the leaves of a cell to the time the host
+ * drifted them to, or to the current time.
+ *
+ * The leaves the device is in sync with are drifted there by the same
+ * amount as on the host. The others are sent in full first. The device copy
+ * of a leaf can be ahead of the host after a lazy drift (see
+ * gpart_soa_drift_lazy()), in which case it is left as is until the host
+ * catches up.
+ *
+ * @param r The #runner.
+ * @param g The #cuda_gpart_mirror.
+ * @param c The #cell.
+ * @param lazy Drift to the current time rather than to that of the host?
+ * @param list The #cuda_gpart_drift_list collecting the leaves to drift.
+ * @param stream The stream to use on the device of the mirror.
+ */
+static void cuda_gpart_mirror_sync_rec(struct runner *r,
+                                       struct cuda_gpart_mirror *g,
+                                       const struct cell *c, const int lazy,
+                                       struct cuda_gpart_drift_list *list,
+                                       cudaStream_t stream) {
+
+  if (c->grav.count == 0) return;
+
+  if (c->split) {
+    for (int k = 0; k < 8; ++k)
+      if (c->progeny[k] != NULL)
+        cuda_gpart_mirror_sync_rec(r, g, c->progeny[k], lazy, list, stream);
+    return;
+  }
+
+  const struct engine *e = r->e;
+  const int index = c->grav.mirror_index;
+  const integertime_t ti_old = c->grav.ti_old_part;
+  const integertime_t ti_target = lazy ? e->ti_current : ti_old;
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (index < 0 || index >= g->nr_leaves)
+    error("Cell is not a leaf of the gpart mirror");
+#endif
+
+  integertime_t ti_device = g->ti_drift[index];
+  if (ti_device >= ti_target) return;
+
+  if (ti_device < 0) {
+
+    /* Not on the device yet */
+    cuda_gpart_mirror_send(r, g, c->grav.parts, c->grav.count, stream);
+    ti_device = ti_old;
+  }
+
+  if (ti_device < ti_target) {
+
+    /* Same drift factor as in cell_drift_gpart() */
+    double dt_drift;
+    if (e->policy & engine_policy_cosmology)
+      dt_drift =
+          cosmology_get_drift_factor(e->cosmology, ti_device, ti_target);
+    else
+      dt_drift = (ti_target - ti_device) * e->time_base;
+
+    struct cuda_gpart_drift_leaf *leaf = &list->leaves[list->count++];
+    leaf->offset = c->grav.parts - e->s->gparts;
+    leaf->count = c->grav.count;
+    leaf->dt = dt_drift;
+    if (list->count == CUDA_GPART_DRIFT_LIST_SIZE)
+      cuda_gpart_mirror_drift_list(r, g, list, stream);
+  }
+
+  g->ti_drift[index] = ti_target;
+}
+
+#endif /* WITH_CUDA */
+
+/**
+ * @brief Refresh the device copy of the freshly drifted #gpart of a cell and
+ * zero their accumulators.
+ *
+ * The particles go to the mirror of the device the cell belongs to. In drift
+ * mode the device drifts its own copy, otherwise the particles are sent.
+ *
+ * @param r The #runner.
+ * @param c The #cell.
+ * @param lazy Was the cell only drifted into the #gpart_soa (drift mode
+ * only)?
+ */
+void cuda_gpart_mirror_upload(struct runner *r, const struct cell *c,
+                              const int lazy) {
+
+  if (!gpu_gparts[0].active) return;
+
+#ifdef WITH_CUDA
+  const struct engine *e = r->e;
+  const int home = cuda_devices_of_runner(r->id);
+  const int device = cuda_devices_of_cell(e->s, c);
+  struct cuda_gpart_mirror *const g = &gpu_gparts[device];
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (c->nodeID != e->nodeID) error("Uploading a foreign cell");
+#endif
+
+  /* The cells of another device go through its default stream */
+  const cudaStream_t stream =
+      device == home ? get_runner_cuda_stream(r->id) : NULL;
+  if (device != home) cuda_devices_use(device);
+
+  if (g->drift) {
+    struct cuda_gpart_drift_list list;
+    list.count = 0;
+    cuda_gpart_mirror_sync_rec(r, g, c, lazy, &list, stream);
+    cuda_gpart_mirror_drift_list(r, g, &list, stream);
+  } else {
+    cuda_gpart_mirror_send(r, g, c->grav.parts, c->grav.count, stream);
+  }
+
+  if (device != home) cuda_devices_use(home);
+#else
+  error("SWIFT was not compiled with CUDA support.");
+#endif
+}
+
+/**
+ * @brief Send the velocities of the #gpart of a freshly kicked cell to the
+ * device.
+ *
+ * Only needed in drift mode, the device then uses them for its next drifts.
+ *
+ * @param r The #runner.
+ * @param c The #cell.
+ */
+void cuda_gpart_mirror_upload_velocities(struct runner *r,
+                                         const struct cell *c) {
+
+  if (!gpu_gparts[0].drift) return;
+
+#ifdef WITH_CUDA
+  const struct engine *e = r->e;
+  if (c->grav.count == 0 || !cell_is_starting_gravity(c, e)) return;
+
+  const int home = cuda_devices_of_runner(r->id);
+  const int device = cuda_devices_of_cell(e->s, c);
+  struct cuda_gpart_mirror *const g = &gpu_gparts[device];
+
+  /* The cells of another device go through its default stream */
+  const cudaStream_t stream =
+      device == home ? get_runner_cuda_stream(r->id) : NULL;
+  if (device != home) cuda_devices_use(device);
+
+  cuda_gpart_mirror_send_velocities(r, g, c->grav.parts, c->grav.count,
+                                    stream);
+
+  if (device != home) cuda_devices_use(home);
+#else
+  error("SWIFT was not compiled with CUDA support.");
+#endif
+}
+
+/**
+ * @brief Add the accelerations accumulated on the device to the active
+ * #gpart of a cell and zero the device accumulators.
+ *
+ * @param r The #runner.
+ * @param c The #cell.
+ */
+void cuda_gpart_mirror_download(struct runner *r, struct cell *c) {
+
+  if (!gpu_gparts[0].active) return;
+
+#ifdef WITH_CUDA
+  const struct engine *e = r->e;
+  const int home = cuda_devices_of_runner(r->id);
+  const int device = cuda_devices_of_cell(e->s, c);
+  struct cuda_gpart_mirror *const g = &gpu_gparts[device];
+  struct gpart *gparts = c->grav.parts;
+  const int gcount = c->grav.count;
+  const size_t offset = gparts - e->s->gparts;
+  struct gravity_cache *const staging = cuda_gpart_mirror_staging(r);
+
+  /* The cells of another device go through its default stream */
+  const cudaStream_t stream =
+      device == home ? get_runner_cuda_stream(r->id) : NULL;
+  if (device != home) cuda_devices_use(device);
+
+  for (int first = 0; first < gcount; first += staging->count) {
+
+    const int n = min(staging->count, gcount - first);
+    const size_t o = offset + first;
+    const size_t bytes = n * sizeof(float);
+
+    cudaMemcpyAsync(staging->a_x, g->a_x + o, bytes, cudaMemcpyDeviceToHost,
+                    stream);
+    cudaMemcpyAsync(staging->a_y, g->a_y + o, bytes, cudaMemcpyDeviceToHost,
+                    stream);
+    cudaMemcpyAsync(staging->a_z, g->a_z + o, bytes, cudaMemcpyDeviceToHost,
+                    stream);
+    cudaMemcpyAsync(staging->pot, g->pot + o, bytes, cudaMemcpyDeviceToHost,
+                    stream);
+    cudaMemsetAsync(g->a_x + o, 0, bytes, stream);
+    cudaMemsetAsync(g->a_y + o, 0, bytes, stream);
+    cudaMemsetAsync(g->a_z + o, 0, bytes, stream);
+    cudaMemsetAsync(g->pot + o, 0, bytes, stream);
+
+    const cudaError_t err = cudaStreamSynchronize(stream);
+    if (err != cudaSuccess)
+      error("Failed to download accelerations from the device: %s",
+            cudaGetErrorString(err));
+
+    /* Only the active particles got something */
+    for (int i = 0; i < n; ++i) {
+      struct gpart *gp = &gparts[first + i];
+      if (gpart_is_active(gp, e)) {
+        gp->a_grav[0] += staging->a_x[i];
+        gp->a_grav[1] += staging->a_y[i];
+        gp->a_grav[2] += staging->a_z[i];
+        gravity_add_comoving_potential(gp, staging->pot[i]);
+      }
+    }
+  }
+
+  if (device != home) cuda_devices_use(home);
+#else
+  error("SWIFT was not compiled with CUDA support.");
+#endif
+}
@@ -0,0 +1,120 @@
+#ifndef SWIFT_CUDA_GPART_MIRROR_H
+#define SWIFT_CUDA_GPART_MIRROR_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* System includes. */
+#include <stddef.h>
+
+/* Local headers */
+#include "cuda_devices.h"
+#include "timeline.h"
+
+/* Forward declarations */
+struct cell;
+struct runner;
+
+/**
+ * @brief A device-resident copy of the #gpart of the local #space in SoA
+ * form, indexed like space->gparts.
+ *
+ * The positions, softenings and masses of a cell are uploaded once per step
+ * by its drift task such that the pair interactions only need to send the
+ * per-pair flags. The accelerations are accumulated on the device and
+ * brought back once per leaf at the end of the gravity calculation.
+ *
+ * In DM-only runs the device can instead drift its own (double precision)
+ * copy of the positions with the velocities sent by the kicks. The leaves
+ * are then only sent in full once per rebuild or after the host drifted
+ * them behind our back.
+ */
+struct cuda_gpart_mirror {
+
+  /*! #gpart positions. */
+  float *x, *y, *z;
+
+  /*! #gpart softening lengths. */
+  float *epsilon;
+
+  /*! #gpart masses (0 for the inhibited ones). */
+  float *m;
+
+  /*! Accumulated tree accelerations. */
+  float *a_x, *a_y, *a_z;
+
+  /*! Accumulated tree potentials. */
+  float *pot;
+
+  /*! #gpart positions the device drifts (drift mode only). */
+  double *x_d, *y_d, *z_d;
+
+  /*! #gpart velocities (drift mode only). */
+  float *v_x, *v_y, *v_z;
+
+  /*! Host-side time the device positions of each leaf were drifted to (-1
+   * if they have to be sent again), indexed by cell->grav.mirror_index. */
+  integertime_t *ti_drift;
+
+  /*! Number of #gpart we have room for. */
+  size_t size;
+
+  /*! Number of leaves we have time-stamps for. */
+  int nr_leaves;
+
+  /*! Are we using the mirror at all? */
+  int active;
+
+  /*! Do we drift the positions on the device rather than sending them? */
+  int drift;
+};
+
+/*! Maximal number of leaves drifted by one kernel launch. */
+#define CUDA_GPART_DRIFT_LIST_SIZE 128
+
+/**
+ * @brief A leaf whose #gpart the device has to drift.
+ */
+struct cuda_gpart_drift_leaf {
+
+  /*! Offset of the first #gpart of the leaf in space->gparts. */
+  size_t offset;
+
+  /*! Drift factor (time-step) of the leaf. */
+  double dt;
+
+  /*! Number of #gpart in the leaf. */
+  int count;
+};
+
+/**
+ * @brief The leaves drifted by one kernel launch, passed by value to the
+ * kernel.
+ */
+struct cuda_gpart_drift_list {
+
+  /*! The leaves. */
+  struct cuda_gpart_drift_leaf leaves[CUDA_GPART_DRIFT_LIST_SIZE];
+
+  /*! Number of leaves in the list. */
+  int count;
+};
+
+/* One instance per device */
+extern struct cuda_gpart_mirror gpu_gparts[CUDA_MAX_DEVICES];
+
+/* Function prototypes. */
+void cuda_gpart_mirror_init(const int active, const int drift);
+void cuda_gpart_mirror_clean(void);
+void cuda_gpart_mirror_ensure(const size_t nr_gparts);
+void cuda_gpart_mirror_reset_leaves(const int nr_leaves);
+void cuda_gpart_mirror_invalidate(void);
+void cuda_gpart_mirror_upload(struct runner *r, const struct cell *c,
+                              const int lazy);
+void cuda_gpart_mirror_upload_velocities(struct runner *r,
+                                         const struct cell *c);
+void cuda_gpart_mirror_download(struct runner *r, struct cell *c);
+const struct cuda_gpart_mirror *cuda_gpart_mirror_of_pair(
+    const struct runner *r, const struct cell *ci, const struct cell *cj);
+
+#endif /* SWIFT_CUDA_GPART_MIRROR_H */
@@ -0,0 +1,109 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "cuda_gravity_cache.h"
+
+#ifdef WITH_CUDA
+/* CUDA headers. */
+#include <cuda_runtime.h>
+#endif
+
+/* Local headers. */
+#include "error.h"
+#include "vector.h"
+
+/**
+ * @brief Allocate one array of a #cuda_gravity_cache on the device.
+ *
+ * @param ptr (return) The device pointer.
+ * @param size The number of bytes to allocate.
+ */
+static void cuda_gravity_cache_alloc(void **ptr, const size_t size) {
+
+#ifdef WITH_CUDA
+  const cudaError_t err = cudaMalloc(ptr, size);
+  if (err != cudaSuccess)
+    error("Couldn't allocate device gravity cache (%zd bytes): %s", size,
+          cudaGetErrorString(err));
+#else
+  error("SWIFT was not compiled with CUDA support.");
+#endif
+}
+
+/**
+ * @brief Frees the device memory allocated in a #cuda_gravity_cache
+ *
+ * @param c The #cuda_gravity_cache to free.
+ */
+void cuda_gravity_cache_clean(struct cuda_gravity_cache *c) {
+
+#ifdef WITH_CUDA
+  if (c->count > 0) {
+    cudaFree(c->x);
+    cudaFree(c->y);
+    cudaFree(c->z);
+    cudaFree(c->epsilon);
+    cudaFree(c->m);
+    cudaFree(c->a_x);
+    cudaFree(c->a_y);
+    cudaFree(c->a_z);
+    cudaFree(c->pot);
+    cudaFree(c->active);
+    cudaFree(c->use_mpole);
+  }
+#endif
+  c->count = 0;
+}
+
+/**
+ * @brief Allocates device memory for the #gpart caches used in the leaf-leaf
+ * interactions offloaded to the GPU.
+ *
+ * The sizes match the ones of the host-side #gravity_cache such that the
+ * padded caches can be copied over as a whole.
+ *
+ * @param c The #cuda_gravity_cache to allocate.
+ * @param count The number of #gpart to allocated for (space_splitsize is a good
+ * choice).
+ */
+void cuda_gravity_cache_init(struct cuda_gravity_cache *c, const int count) {
+
+  /* Size of the gravity cache */
+  const int padded_count = count - (count % VEC_SIZE) + VEC_SIZE;
+  const size_t sizeBytesF = padded_count * sizeof(float);
+  const size_t sizeBytesI = padded_count * sizeof(int);
+
+  /* Delete old stuff if any */
+  cuda_gravity_cache_clean(c);
+
+  cuda_gravity_cache_alloc((void **)&c->x, sizeBytesF);
+  cuda_gravity_cache_alloc((void **)&c->y, sizeBytesF);
+  cuda_gravity_cache_alloc((void **)&c->z, sizeBytesF);
+  cuda_gravity_cache_alloc((void **)&c->epsilon, sizeBytesF);
+  cuda_gravity_cache_alloc((void **)&c->m, sizeBytesF);
+  cuda_gravity_cache_alloc((void **)&c->a_x, sizeBytesF);
+  cuda_gravity_cache_alloc((void **)&c->a_y, sizeBytesF);
+  cuda_gravity_cache_alloc((void **)&c->a_z, sizeBytesF);
+  cuda_gravity_cache_alloc((void **)&c->pot, sizeBytesF);
+  cuda_gravity_cache_alloc((void **)&c->active, sizeBytesI);
+  cuda_gravity_cache_alloc((void **)&c->use_mpole, sizeBytesI);
+
+  c->count = padded_count;
+}
+
+/**
+ * @brief Make sure a #cuda_gravity_cache can hold a given number of #gpart.
+ *
+ * The cache only ever grows. As for the host-side #gravity_cache, we add a
+ * bit of head-room to avoid re-allocating for every small increase.
+ *
+ * @param c The #cuda_gravity_cache to (possibly) grow.
+ * @param gcount_padded The padded number of #gpart we need room for.
+ */
+void cuda_gravity_cache_ensure(struct cuda_gravity_cache *c,
+                               const int gcount_padded) {
+
+  if (c->count < gcount_padded)
+    cuda_gravity_cache_init(c, gcount_padded + VEC_SIZE);
+}
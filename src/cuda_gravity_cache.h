@@ -0,0 +1,60 @@
+#ifndef SWIFT_CUDA_GRAVITY_CACHE_H
+#define SWIFT_CUDA_GRAVITY_CACHE_H
+
+/* Config parameters. */
+#include <config.h>
+
+/**
+ * @brief The device-side mirror of a #gravity_cache.
+ *
+ * Each runner owns one of these per #gravity_cache. The arrays live in
+ * device memory and are only re-allocated when a cell with more particles
+ * than the current size is offloaded, such that the allocator is not hit
+ * for every pair task.
+ */
+struct cuda_gravity_cache {
+
+  /*! #gpart x position. */
+  float *x;
+
+  /*! #gpart y position. */
+  float *y;
+
+  /*! #gpart z position. */
+  float *z;
+
+  /*! #gpart softening length. */
+  float *epsilon;
+
+  /*! #gpart mass. */
+  float *m;
+
+  /*! #gpart x acceleration. */
+  float *a_x;
+
+  /*! #gpart y acceleration. */
+  float *a_y;
+
+  /*! #gpart z acceleration. */
+  float *a_z;
+
+  /*! #gpart potential. */
+  float *pot;
+
+  /*! Is this #gpart active ? */
+  int *active;
+
+  /*! Can this #gpart use a M2P interaction ? */
+  int *use_mpole;
+
+  /*! Cache size */
+  int count;
+};
+
+/* Function prototypes. */
+void cuda_gravity_cache_init(struct cuda_gravity_cache *c, const int count);
+void cuda_gravity_cache_clean(struct cuda_gravity_cache *c);
+void cuda_gravity_cache_ensure(struct cuda_gravity_cache *c,
+                               const int gcount_padded);
+
+#endif /* SWIFT_CUDA_GRAVITY_CACHE_H */
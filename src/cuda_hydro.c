@@ -0,0 +1,436 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "cuda_hydro.h"
+
+/* System includes. */
+#include <string.h>
+
+#ifdef WITH_CUDA
+/* CUDA headers. */
+#include <cuda_runtime.h>
+#endif
+
+/* Local headers. */
+#include "active.h"
+#include "cell.h"
+#include "chemistry.h"
+#include "cuda_devices.h"
+#include "cuda_streams.h"
+#include "cuda_types.h"
+#include "dimension.h"
+#include "engine.h"
+#include "error.h"
+#include "hydro.h"
+#include "kernel_hydro.h"
+#include "runner.h"
+#include "timers.h"
+
+/*! The one instance */
+struct cuda_hydro gpu_hydro;
+
+/* Uploads the SPH kernel to the current device (see grav_pp_offload.cu) */
+extern void hydro_kernel_offload(const struct cuda_hydro_kernel *k);
+
+/* Runs the density loop of one or two caches on the device (see
+ * grav_pp_offload.cu) */
+extern enum cuda_fault hydro_density_offload(struct cuda_hydro_cache *ci,
+                                             struct cuda_hydro_cache *cj,
+                                             const int update_i,
+                                             const int update_j,
+                                             const int nr_metals,
+                                             cudaStream_t stream);
+
+/**
+ * @brief Initialise the #cuda_hydro and send the SPH kernel to the devices.
+ *
+ * @param active Are we going to do the density loop on the GPU?
+ * @param split_threshold Number of interactions below which the cells stay
+ * on the CPU.
+ */
+void cuda_hydro_init(const int active, const double split_threshold) {
+
+  bzero(&gpu_hydro, sizeof(struct cuda_hydro));
+
+#ifdef CUDA_HYDRO_DENSITY
+  gpu_hydro.active = active;
+  gpu_hydro.split_threshold = split_threshold;
+#ifdef CHEMISTRY_EAGLE
+  gpu_hydro.nr_metals = chemistry_element_count + 2;
+#endif
+  if (gpu_hydro.nr_metals > cuda_hydro_max_metals)
+    error("Too many metals to smooth on the GPU (%d > %d).",
+          gpu_hydro.nr_metals, cuda_hydro_max_metals);
+
+  if (!gpu_hydro.active) return;
+
+  /* The kernel, as the CPU evaluates it */
+  struct cuda_hydro_kernel k;
+  bzero(&k, sizeof(struct cuda_hydro_kernel));
+  const int nr_coeffs = (kernel_degree + 1) * (kernel_ivals + 1);
+  if (nr_coeffs > cuda_hydro_max_kernel_coeffs)
+    error("Too many kernel coefficients for the GPU (%d > %d).", nr_coeffs,
+          cuda_hydro_max_kernel_coeffs);
+  memcpy(k.coeffs, kernel_coeffs, nr_coeffs * sizeof(float));
+  k.degree = kernel_degree;
+  k.ivals = kernel_ivals;
+  k.ivals_f = kernel_ivals_f;
+  k.gamma_inv = kernel_gamma_inv;
+  k.gamma2 = kernel_gamma2;
+  k.norm = kernel_constant * kernel_gamma_inv_dim;
+  k.norm_dx = kernel_constant * kernel_gamma_inv_dim_plus_one;
+  k.dimension = hydro_dimension;
+
+  /* Every device gets its copy */
+  for (int d = 0; d < gpu_devices.count; ++d) {
+    cuda_devices_use(d);
+    hydro_kernel_offload(&k);
+  }
+  cuda_devices_use(0);
+#else
+  if (active)
+    message(
+        "The density loop of this configuration cannot run on the GPU. "
+        "Ignoring Scheduler:gpu_hydro_density.");
+#endif
+}
+
+#ifdef CUDA_HYDRO_DENSITY
+
+/**
+ * @brief Allocate one device array of a #cuda_hydro_cache.
+ *
+ * @param ptr (return) The device pointer.
+ * @param size The number of bytes to allocate.
+ */
+static void cuda_hydro_alloc_device(void **ptr, const size_t size) {
+
+  const cudaError_t err = cudaMalloc(ptr, size);
+  if (err != cudaSuccess)
+    error("Couldn't allocate device hydro cache (%zd bytes): %s", size,
+          cudaGetErrorString(err));
+}
+
+/**
+ * @brief Allocate one host array of a #cuda_hydro_cache.
+ *
+ * @param ptr (return) The host pointer.
+ * @param size The number of bytes to allocate.
+ */
+static void cuda_hydro_alloc_host(void **ptr, const size_t size) {
+
+  /* Page-locked such that the copies are fast */
+  const cudaError_t err = cudaHostAlloc(ptr, size, cudaHostAllocPortable);
+  if (err != cudaSuccess)
+    error("Couldn't allocate host hydro cache (%zd bytes): %s", size,
+          cudaGetErrorString(err));
+}
+
+#endif /* CUDA_HYDRO_DENSITY */
+
+/**
+ * @brief Free the memory of a #cuda_hydro_cache.
+ *
+ * @param c The #cuda_hydro_cache.
+ */
+void cuda_hydro_cache_clean(struct cuda_hydro_cache *c) {
+
+#ifdef CUDA_HYDRO_DENSITY
+  if (c->size > 0) {
+    float *host[] = {c->x,       c->y,         c->z,       c->h,
+                     c->m,       c->v_x,       c->v_y,     c->v_z,
+                     c->rho,     c->rho_dh,    c->wcount,  c->wcount_dh,
+                     c->div_v,   c->rot_v_x,   c->rot_v_y, c->rot_v_z,
+                     c->metals,  c->smoothed_metals};
+    float *device[] = {c->d_x,       c->d_y,         c->d_z,
+                       c->d_h,       c->d_m,         c->d_v_x,
+                       c->d_v_y,     c->d_v_z,       c->d_rho,
+                       c->d_rho_dh,  c->d_wcount,    c->d_wcount_dh,
+                       c->d_div_v,   c->d_rot_v_x,   c->d_rot_v_y,
+                       c->d_rot_v_z, c->d_metals,    c->d_smoothed_metals};
+    for (size_t k = 0; k < sizeof(host) / sizeof(float *); k++)
+      if (host[k] != NULL) cudaFreeHost(host[k]);
+    for (size_t k = 0; k < sizeof(device) / sizeof(float *); k++)
+      if (device[k] != NULL) cudaFree(device[k]);
+    cudaFreeHost(c->flag);
+    cudaFree(c->d_flag);
+  }
+#endif
+  bzero(c, sizeof(struct cuda_hydro_cache));
+}
+
+#ifdef CUDA_HYDRO_DENSITY
+
+/**
+ * @brief Make sure a #cuda_hydro_cache can hold a given number of #part.
+ *
+ * @param c The #cuda_hydro_cache.
+ * @param count The number of #part we need room for.
+ */
+static void cuda_hydro_cache_ensure(struct cuda_hydro_cache *c,
+                                    const int count) {
+
+  if (count <= c->size) return;
+
+  /* Leave some head-room for the next cells */
+  cuda_hydro_cache_clean(c);
+  const int size = count + count / 10 + 1;
+  const size_t sizeF = size * sizeof(float);
+  const size_t sizeM = (size_t)size * gpu_hydro.nr_metals * sizeof(float);
+
+  float **host[] = {&c->x,      &c->y,       &c->z,       &c->h,
+                    &c->m,      &c->v_x,     &c->v_y,     &c->v_z,
+                    &c->rho,    &c->rho_dh,  &c->wcount,  &c->wcount_dh,
+                    &c->div_v,  &c->rot_v_x, &c->rot_v_y, &c->rot_v_z};
+  float **device[] = {&c->d_x,      &c->d_y,       &c->d_z,
+                      &c->d_h,      &c->d_m,       &c->d_v_x,
+                      &c->d_v_y,    &c->d_v_z,     &c->d_rho,
+                      &c->d_rho_dh, &c->d_wcount,  &c->d_wcount_dh,
+                      &c->d_div_v,  &c->d_rot_v_x, &c->d_rot_v_y,
+                      &c->d_rot_v_z};
+  for (size_t k = 0; k < sizeof(host) / sizeof(float **); k++) {
+    cuda_hydro_alloc_host((void **)host[k], sizeF);
+    cuda_hydro_alloc_device((void **)device[k], sizeF);
+  }
+  cuda_hydro_alloc_host((void **)&c->flag, size * sizeof(int));
+  cuda_hydro_alloc_device((void **)&c->d_flag, size * sizeof(int));
+
+  if (gpu_hydro.nr_metals > 0) {
+    cuda_hydro_alloc_host((void **)&c->metals, sizeM);
+    cuda_hydro_alloc_host((void **)&c->smoothed_metals, sizeM);
+    cuda_hydro_alloc_device((void **)&c->d_metals, sizeM);
+    cuda_hydro_alloc_device((void **)&c->d_smoothed_metals, sizeM);
+  }
+
+  c->size = size;
+}
+
+/**
+ * @brief Copy the #part of a cell to a #cuda_hydro_cache.
+ *
+ * The positions are taken relative to the same frame as in DOPAIR1() and
+ * DOSELF1().
+ *
+ * @param c The #cuda_hydro_cache.
+ * @param e The #engine.
+ * @param cell The #cell.
+ * @param loc The origin of the frame.
+ * @param update Do we update the active #part of this cell?
+ */
+static void cuda_hydro_cache_populate(struct cuda_hydro_cache *c,
+                                      const struct engine *e,
+                                      const struct cell *cell,
+                                      const double loc[3], const int update) {
+
+  const int count = cell->hydro.count;
+  const struct part *parts = cell->hydro.parts;
+  const int nr_metals = gpu_hydro.nr_metals;
+
+  cuda_hydro_cache_ensure(c, count);
+
+  for (int k = 0; k < count; k++) {
+    const struct part *p = &parts[k];
+
+    if (part_is_inhibited(p, e)) {
+      c->flag[k] = -1;
+      continue;
+    }
+    c->flag[k] = update && part_is_active(p, e);
+
+    c->x[k] = p->x[0] - loc[0];
+    c->y[k] = p->x[1] - loc[1];
+    c->z[k] = p->x[2] - loc[2];
+    c->h[k] = p->h;
+    c->m[k] = hydro_get_mass(p);
+    c->v_x[k] = p->v[0];
+    c->v_y[k] = p->v[1];
+    c->v_z[k] = p->v[2];
+
+#ifdef CHEMISTRY_EAGLE
+    float *Z = &c->metals[(size_t)k * nr_metals];
+    const struct chemistry_part_data *ch = &p->chemistry_data;
+    for (int i = 0; i < chemistry_element_count; i++)
+      Z[i] = ch->metal_mass_fraction[i];
+    Z[chemistry_element_count] = ch->metal_mass_fraction_total;
+    Z[chemistry_element_count + 1] = ch->iron_mass_fraction_from_SNIa;
+#else
+    (void)nr_metals;
+#endif
+  }
+
+  c->count = count;
+}
+
+/**
+ * @brief Add the results of a #cuda_hydro_cache to the #part of a cell.
+ *
+ * @param c The #cuda_hydro_cache.
+ * @param cell The #cell.
+ */
+static void cuda_hydro_cache_write_back(const struct cuda_hydro_cache *c,
+                                        struct cell *cell) {
+
+  struct part *parts = cell->hydro.parts;
+  const int nr_metals = gpu_hydro.nr_metals;
+
+  for (int k = 0; k < c->count; k++) {
+    if (c->flag[k] != 1) continue;
+    struct part *p = &parts[k];
+
+    p->rho += c->rho[k];
+    p->density.rho_dh += c->rho_dh[k];
+    p->density.wcount += c->wcount[k];
+    p->density.wcount_dh += c->wcount_dh[k];
+    p->viscosity.div_v += c->div_v[k];
+    p->density.rot_v[0] += c->rot_v_x[k];
+    p->density.rot_v[1] += c->rot_v_y[k];
+    p->density.rot_v[2] += c->rot_v_z[k];
+
+#ifdef CHEMISTRY_EAGLE
+    const float *Z = &c->smoothed_metals[(size_t)k * nr_metals];
+    struct chemistry_part_data *ch = &p->chemistry_data;
+    for (int i = 0; i < chemistry_element_count; i++)
+      ch->smoothed_metal_mass_fraction[i] += Z[i];
+    ch->smoothed_metal_mass_fraction_total += Z[chemistry_element_count];
+    ch->smoothed_iron_mass_fraction_from_SNIa +=
+        Z[chemistry_element_count + 1];
+#else
+    (void)nr_metals;
+#endif
+  }
+}
+
+/**
+ * @brief Decide what to do after a fault of the density loop on the device.
+ *
+ * Nothing has been written to the #part yet, so after a transient fault the
+ * caller can simply run the loop on the CPU. A sticky fault ends the run.
+ *
+ * @param fault What went wrong on the device.
+ * @param count The number of pairs of #part of the loop.
+ */
+static void cuda_hydro_check_fault(const enum cuda_fault fault,
+                                   const double count) {
+
+  if (fault == cuda_fault_sticky)
+    error("The CUDA context was lost, restart from the last checkpoint.");
+
+  warning(
+      "Device fault on a density loop of %.0f pairs of parts, re-running it "
+      "on the CPU.",
+      count);
+}
+
+#endif /* CUDA_HYDRO_DENSITY */
+
+/**
+ * @brief Compute the density loop of all the active #part of a cell with
+ * all the other ones on the GPU.
+ *
+ * Device version of DOSELF1() for the density loop.
+ *
+ * @param r The #runner.
+ * @param c The #cell.
+ *
+ * @return 1 if the loop was done, 0 if it has to be done on the CPU.
+ */
+int cuda_hydro_doself_density(struct runner *r, struct cell *c) {
+
+#ifdef CUDA_HYDRO_DENSITY
+  const struct engine *e = r->e;
+  const int count = c->hydro.count;
+
+  if (!gpu_hydro.active) return 0;
+  if ((double)count * (double)count < gpu_hydro.split_threshold) return 0;
+
+  TIMER_TIC;
+
+  struct cuda_hydro_cache *ci_cache = &r->ci_cuda_hydro_cache;
+  cuda_hydro_cache_populate(ci_cache, e, c, c->loc, /*update=*/1);
+
+  const ticks tic_gpu = getticks();
+  const enum cuda_fault fault = hydro_density_offload(
+      ci_cache, ci_cache, /*update_i=*/1, /*update_j=*/0, gpu_hydro.nr_metals,
+      get_runner_cuda_stream(r->id));
+
+  /* Leave the whole loop to the CPU if the device failed us */
+  if (fault != cuda_fault_none) {
+    cuda_hydro_check_fault(fault, (double)count * (double)count);
+    return 0;
+  }
+
+  cuda_device_load_add(&r->gpu_load, (double)count * (double)count,
+                       getticks() - tic_gpu);
+
+  cuda_hydro_cache_write_back(ci_cache, c);
+
+  TIMER_TOC(timer_doself_density);
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+/**
+ * @brief Compute the density loop between the active #part of two cells on
+ * the GPU.
+ *
+ * Device version of DOPAIR1() for the density loop. All the pairs of
+ * particles are tested on the device, there is no use for the sorts.
+ *
+ * @param r The #runner.
+ * @param ci The first #cell.
+ * @param cj The second #cell.
+ * @param shift The shift vector to apply to the particles in ci.
+ *
+ * @return 1 if the loop was done, 0 if it has to be done on the CPU.
+ */
+int cuda_hydro_dopair_density(struct runner *r, struct cell *ci,
+                              struct cell *cj, const double *shift) {
+
+#ifdef CUDA_HYDRO_DENSITY
+  const struct engine *e = r->e;
+  const int count_i = ci->hydro.count;
+  const int count_j = cj->hydro.count;
+
+  if (!gpu_hydro.active) return 0;
+  if ((double)count_i * (double)count_j < gpu_hydro.split_threshold)
+    return 0;
+
+  TIMER_TIC;
+
+  const int update_i = cell_is_active_hydro(ci, e);
+  const int update_j = cell_is_active_hydro(cj, e);
+
+  /* Both cells in the frame of cj, as on the CPU */
+  const double loc_i[3] = {cj->loc[0] + shift[0], cj->loc[1] + shift[1],
+                           cj->loc[2] + shift[2]};
+  struct cuda_hydro_cache *ci_cache = &r->ci_cuda_hydro_cache;
+  struct cuda_hydro_cache *cj_cache = &r->cj_cuda_hydro_cache;
+  cuda_hydro_cache_populate(ci_cache, e, ci, loc_i, update_i);
+  cuda_hydro_cache_populate(cj_cache, e, cj, cj->loc, update_j);
+
+  const ticks tic_gpu = getticks();
+  const enum cuda_fault fault =
+      hydro_density_offload(ci_cache, cj_cache, update_i, update_j,
+                            gpu_hydro.nr_metals, get_runner_cuda_stream(r->id));
+
+  /* Leave the whole loop to the CPU if the device failed us */
+  if (fault != cuda_fault_none) {
+    cuda_hydro_check_fault(fault, (double)count_i * (double)count_j);
+    return 0;
+  }
+
+  cuda_device_load_add(&r->gpu_load, (double)count_i * (double)count_j,
+                       getticks() - tic_gpu);
+
+  if (update_i) cuda_hydro_cache_write_back(ci_cache, ci);
+  if (update_j) cuda_hydro_cache_write_back(cj_cache, cj);
+
+  TIMER_TOC(timer_dopair_density);
+  return 1;
+#else
+  return 0;
+#endif
+}
@@ -0,0 +1,119 @@
+#ifndef SWIFT_CUDA_HYDRO_H
+#define SWIFT_CUDA_HYDRO_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* Forward declarations */
+struct cell;
+struct runner;
+
+/* The density loop can only go to the GPU if the device reproduces all of
+ * it: the SPHENIX hydro part and, at most, the smoothing of the EAGLE
+ * metallicities. All the other models must act as no-ops in that loop. */
+#if defined(WITH_CUDA) && defined(SPHENIX_SPH) && defined(NONE_MHD) && \
+    !defined(ADAPTIVE_SOFTENING) && !defined(RT_GEAR) && \
+    (defined(CHEMISTRY_NONE) || defined(CHEMISTRY_EAGLE)) && \
+    (defined(STAR_FORMATION_NONE) || defined(STAR_FORMATION_EAGLE)) && \
+    defined(PRESSURE_FLOOR_NONE) && defined(SINK_NONE) && \
+    !defined(SWIFT_HYDRO_DENSITY_CHECKS)
+#define CUDA_HYDRO_DENSITY
+#endif
+
+/*! Maximal number of polynomial coefficients of the SPH kernel on the GPU */
+#define cuda_hydro_max_kernel_coeffs 64
+
+/*! Maximal number of metal mass fractions smoothed on the GPU */
+#define cuda_hydro_max_metals 16
+
+/**
+ * @brief The SPH kernel, as sent to the constant memory of the devices.
+ */
+struct cuda_hydro_kernel {
+
+  /*! Coefficients of the polynomial of every branch. */
+  float coeffs[cuda_hydro_max_kernel_coeffs];
+
+  /*! Degree of the polynomial and number of branches. */
+  int degree, ivals;
+
+  /*! Number of branches, as a float. */
+  float ivals_f;
+
+  /*! Kernel support over the smoothing length, inverse and squared. */
+  float gamma_inv, gamma2;
+
+  /*! Normalisation of the kernel and of its derivative. */
+  float norm, norm_dx;
+
+  /*! Number of dimensions. */
+  float dimension;
+};
+
+/**
+ * @brief The #part of one cell as needed by the device density loop.
+ *
+ * Each runner owns two of these. The host side in page-locked memory and
+ * the device side only grow, such that the allocators are not hit for
+ * every task.
+ */
+struct cuda_hydro_cache {
+
+  /*! Positions (relative to the frame of the interaction), smoothing
+   * lengths, masses and velocities. */
+  float *x, *y, *z, *h, *m, *v_x, *v_y, *v_z;
+
+  /*! Metal mass fractions to smooth, nr_metals per #part. */
+  float *metals;
+
+  /*! 1 for the #part to update, 0 for neighbours only, -1 for the
+   * inhibited ones. */
+  int *flag;
+
+  /*! Results for the #part to update. */
+  float *rho, *rho_dh, *wcount, *wcount_dh, *div_v, *rot_v_x, *rot_v_y,
+      *rot_v_z;
+
+  /*! Smoothed metal mass fractions, nr_metals per #part. */
+  float *smoothed_metals;
+
+  /*! Device copies of all the above. */
+  float *d_x, *d_y, *d_z, *d_h, *d_m, *d_v_x, *d_v_y, *d_v_z, *d_metals;
+  int *d_flag;
+  float *d_rho, *d_rho_dh, *d_wcount, *d_wcount_dh, *d_div_v, *d_rot_v_x,
+      *d_rot_v_y, *d_rot_v_z, *d_smoothed_metals;
+
+  /*! Number of #part in the cache. */
+  int count;
+
+  /*! Number of #part we have room for. */
+  int size;
+};
+
+/**
+ * @brief What drives the SPH density loop on the GPU.
+ */
+struct cuda_hydro {
+
+  /*! Number of interactions (count_i * count_j) below which the cells stay
+   * on the CPU. */
+  double split_threshold;
+
+  /*! Number of metal mass fractions smoothed with the density. */
+  int nr_metals;
+
+  /*! Are we doing the density loop on the GPU at all? */
+  int active;
+};
+
+/* The one instance */
+extern struct cuda_hydro gpu_hydro;
+
+/* Function prototypes. */
+void cuda_hydro_init(const int active, const double split_threshold);
+void cuda_hydro_cache_clean(struct cuda_hydro_cache *c);
+int cuda_hydro_doself_density(struct runner *r, struct cell *c);
+int cuda_hydro_dopair_density(struct runner *r, struct cell *ci,
+                              struct cell *cj, const double *shift);
+
+#endif /* SWIFT_CUDA_HYDRO_H */
@@ -0,0 +1,235 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "cuda_lightcone.h"
+
+/* System includes. */
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WITH_CUDA
+/* CUDA headers. */
+#include <cuda_runtime.h>
+#endif
+
+/* Local headers. */
+#include "error.h"
+#include "lightcone/projected_kernel.h"
+
+/*! The one instance, driven by the main thread */
+struct cuda_lightcone gpu_lightcone;
+
+/* Smooths the batch of updates onto the window (see grav_pp_offload.cu) */
+extern void lightcone_smooth_offload(struct cuda_lightcone *l,
+                                     const double du, const double inv_du,
+                                     const double u_max, const int nside,
+                                     const int64_t window_first,
+                                     const size_t window_count);
+
+/**
+ * @brief Initialise the (empty) #cuda_lightcone.
+ *
+ * @param active Are we going to smooth the lightcone maps on the GPU?
+ */
+void cuda_lightcone_init(const int active) {
+
+  bzero(&gpu_lightcone, sizeof(struct cuda_lightcone));
+  gpu_lightcone.active = active;
+}
+
+/**
+ * @brief Free a pair of host and device arrays of the #cuda_lightcone.
+ *
+ * @param host The host (page-locked) array.
+ * @param device The device array.
+ * @param size (return) The number of elements we have room for.
+ */
+static void cuda_lightcone_free(void *host, void *device, size_t *size) {
+
+#ifdef WITH_CUDA
+  if (*size > 0) {
+    cudaFreeHost(host);
+    cudaFree(device);
+  }
+#endif
+  *size = 0;
+}
+
+/**
+ * @brief Free all the memory of the #cuda_lightcone.
+ */
+void cuda_lightcone_clean(void) {
+
+  struct cuda_lightcone *l = &gpu_lightcone;
+
+  cuda_lightcone_free(l->updates, l->d_updates, &l->size_updates);
+  cuda_lightcone_free(l->ranges, l->d_ranges, &l->size_ranges);
+  cuda_lightcone_free(l->values, l->d_values, &l->size_values);
+  cuda_lightcone_free(l->window, l->d_window, &l->size_window);
+#ifdef WITH_CUDA
+  if (l->d_kernel != NULL) cudaFree(l->d_kernel);
+#endif
+  l->d_kernel = NULL;
+  l->kernel = NULL;
+  cuda_lightcone_empty();
+}
+
+/**
+ * @brief Drop the batch of lightcone map updates without smoothing it.
+ */
+void cuda_lightcone_empty(void) {
+
+  gpu_lightcone.nr_updates = 0;
+  gpu_lightcone.nr_ranges = 0;
+  gpu_lightcone.nr_pixels = 0;
+}
+
+/**
+ * @brief Make sure a pair of host and device arrays of the #cuda_lightcone
+ * can hold a given number of elements.
+ *
+ * The content of the host array is kept.
+ *
+ * @param host (return) The host (page-locked) array.
+ * @param device (return) The device array.
+ * @param size (return) The number of elements we have room for.
+ * @param count The number of elements we need room for.
+ * @param used The number of elements of the host array in use.
+ * @param elem The size of one element.
+ */
+static void cuda_lightcone_ensure(void **host, void **device, size_t *size,
+                                  const size_t count, const size_t used,
+                                  const size_t elem) {
+
+  if (count <= *size) return;
+
+#ifdef WITH_CUDA
+  /* Leave some head-room for the next batches */
+  const size_t new_size = count + count / 10 + 1;
+  const size_t bytes = new_size * elem;
+
+  /* Page-locked such that the copies are fast */
+  void *new_host = NULL, *new_device = NULL;
+  cudaError_t err = cudaHostAlloc(&new_host, bytes, cudaHostAllocPortable);
+  if (err != cudaSuccess)
+    error("Couldn't allocate host lightcone arrays (%zd bytes): %s", bytes,
+          cudaGetErrorString(err));
+  err = cudaMalloc(&new_device, bytes);
+  if (err != cudaSuccess)
+    error("Couldn't allocate device lightcone arrays (%zd bytes): %s", bytes,
+          cudaGetErrorString(err));
+
+  if (*size > 0) {
+    memcpy(new_host, *host, used * elem);
+    cudaFreeHost(*host);
+    cudaFree(*device);
+  }
+  *host = new_host;
+  *device = new_device;
+  *size = new_size;
+#else
+  error("SWIFT was not compiled with CUDA support.");
+#endif
+}
+
+/**
+ * @brief Add a lightcone map update to the batch smoothed on the GPU.
+ *
+ * All the updates of a batch must contribute to the same number of maps.
+ *
+ * @param vec Unit vector to the particle.
+ * @param radius Angular smoothing length of the particle.
+ * @param values The values to add to each map (already scaled).
+ * @param nr_maps The number of maps.
+ * @param ranges The ranges of pixels of the disc of the particle.
+ * @param nr_ranges The number of ranges.
+ */
+void cuda_lightcone_add(const double vec[3], const double radius,
+                        const double *values, const int nr_maps,
+                        const struct pixel_range *ranges, const int nr_ranges) {
+
+  struct cuda_lightcone *l = &gpu_lightcone;
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (l->nr_updates > 0 && nr_maps != l->nr_maps)
+    error("Updates of a lightcone batch with different numbers of maps.");
+#endif
+  l->nr_maps = nr_maps;
+
+  cuda_lightcone_ensure((void **)&l->updates, (void **)&l->d_updates,
+                        &l->size_updates, l->nr_updates + 1, l->nr_updates,
+                        sizeof(struct cuda_lightcone_update));
+  cuda_lightcone_ensure((void **)&l->ranges, (void **)&l->d_ranges,
+                        &l->size_ranges, l->nr_ranges + nr_ranges,
+                        l->nr_ranges, sizeof(struct pixel_range));
+  cuda_lightcone_ensure((void **)&l->values, (void **)&l->d_values,
+                        &l->size_values, (size_t)(l->nr_updates + 1) * nr_maps,
+                        (size_t)l->nr_updates * nr_maps, sizeof(double));
+
+  struct cuda_lightcone_update *u = &l->updates[l->nr_updates];
+  for (int i = 0; i < 3; i++) u->vec[i] = vec[i];
+  u->radius = radius;
+  u->first_range = l->nr_ranges;
+  u->nr_ranges = nr_ranges;
+
+  memcpy(&l->ranges[l->nr_ranges], ranges,
+         nr_ranges * sizeof(struct pixel_range));
+  memcpy(&l->values[(size_t)l->nr_updates * nr_maps], values,
+         nr_maps * sizeof(double));
+  for (int i = 0; i < nr_ranges; i++)
+    l->nr_pixels += ranges[i].last - ranges[i].first + 1;
+
+  l->nr_updates++;
+  l->nr_ranges += nr_ranges;
+}
+
+/**
+ * @brief Smooth the batch of lightcone map updates on the GPU.
+ *
+ * The values of the updates are spread over the pixels of their discs with
+ * the same weights as healpix_smoothing_mapper() and accumulated in a window
+ * of pixels, one map after the other. The batch is emptied.
+ *
+ * @param kernel_table The projected kernel.
+ * @param nside The HEALPix resolution of the maps.
+ * @param window_first The first pixel of the window.
+ * @param window_count The number of pixels of the window.
+ *
+ * @return The window (window_count x nr_maps values), valid until the next
+ * batch.
+ */
+double *cuda_lightcone_smooth(const struct projected_kernel_table *kernel_table,
+                              const int nside, const pixel_index_t window_first,
+                              const size_t window_count) {
+
+  struct cuda_lightcone *l = &gpu_lightcone;
+
+#ifdef WITH_CUDA
+  /* The table only changes with the lightcone properties */
+  if (l->kernel != kernel_table->value) {
+    if (l->d_kernel != NULL) cudaFree(l->d_kernel);
+    const size_t sizeK = kernel_table->n * sizeof(double);
+    const cudaError_t err = cudaMalloc((void **)&l->d_kernel, sizeK);
+    if (err != cudaSuccess)
+      error("Couldn't allocate device projected kernel (%zd bytes): %s", sizeK,
+            cudaGetErrorString(err));
+    cudaMemcpy(l->d_kernel, kernel_table->value, sizeK,
+               cudaMemcpyHostToDevice);
+    l->kernel = kernel_table->value;
+  }
+
+  cuda_lightcone_ensure((void **)&l->window, (void **)&l->d_window,
+                        &l->size_window, window_count * l->nr_maps, 0,
+                        sizeof(double));
+
+  lightcone_smooth_offload(l, kernel_table->du, kernel_table->inv_du,
+                           kernel_table->u_max, nside, window_first,
+                           window_count);
+#else
+  error("SWIFT was not compiled with CUDA support.");
+#endif
+
+  cuda_lightcone_empty();
+  return l->window;
+}
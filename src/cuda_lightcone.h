@@ -0,0 +1,88 @@
+#ifndef SWIFT_CUDA_LIGHTCONE_H
+#define SWIFT_CUDA_LIGHTCONE_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* System includes. */
+#include <stddef.h>
+#include <stdint.h>
+
+/* Local headers. */
+#include "lightcone/healpix_util.h"
+
+/* Forward declarations */
+struct projected_kernel_table;
+
+/*! Largest number of pixels (times the number of maps) of a window */
+#define cuda_lightcone_max_window (1 << 24)
+
+/**
+ * @brief A lightcone map update to smooth as seen by the device.
+ */
+struct cuda_lightcone_update {
+
+  /*! Unit vector to the particle. */
+  double vec[3];
+
+  /*! Angular smoothing length of the particle. */
+  double radius;
+
+  /*! Index of the first of its #pixel_range and their number. */
+  int first_range, nr_ranges;
+};
+
+/**
+ * @brief The batch of lightcone map updates smoothed on the GPU.
+ *
+ * The discs of the updates are found on the host and their values spread
+ * over the local pixels of one window, with the weights of the projected
+ * kernel, on the device. The arrays only grow, such that the allocators are
+ * not hit for every batch.
+ */
+struct cuda_lightcone {
+
+  /*! Host (page-locked) and device copies of the updates of the batch, of
+   * the pixel ranges of their discs and of the values they add to each map
+   * (already scaled). */
+  struct cuda_lightcone_update *updates, *d_updates;
+  struct pixel_range *ranges, *d_ranges;
+  double *values, *d_values;
+
+  /*! Host (page-locked) and device copies of the window of pixels, one map
+   * after the other. */
+  double *window, *d_window;
+
+  /*! The projected kernel table on the device, and the host values it is a
+   * copy of. */
+  double *d_kernel;
+  const double *kernel;
+
+  /*! Number of updates, ranges and maps of the batch. */
+  int nr_updates, nr_ranges, nr_maps;
+
+  /*! Number of pixels in the discs of the batch. */
+  size_t nr_pixels;
+
+  /*! Number of updates, ranges, values and window pixels we have room for. */
+  size_t size_updates, size_ranges, size_values, size_window;
+
+  /*! Are we smoothing the lightcone maps on the GPU at all? */
+  int active;
+};
+
+/* The one instance, driven by the main thread */
+extern struct cuda_lightcone gpu_lightcone;
+
+/* Function prototypes. */
+void cuda_lightcone_init(const int active);
+void cuda_lightcone_clean(void);
+void cuda_lightcone_empty(void);
+void cuda_lightcone_add(const double vec[3], const double radius,
+                        const double *values, const int nr_maps,
+                        const struct pixel_range *ranges, const int nr_ranges);
+double *cuda_lightcone_smooth(const struct projected_kernel_table *kernel_table,
+                              const int nside, const pixel_index_t window_first,
+                              const size_t window_count);
+
+#endif /* SWIFT_CUDA_LIGHTCONE_H */
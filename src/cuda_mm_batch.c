@@ -0,0 +1,100 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "cuda_mm_batch.h"
+
+#ifdef WITH_CUDA
+/* CUDA headers. */
+#include <cuda_runtime.h>
+#endif
+
+/* Local headers. */
+#include "error.h"
+
+/**
+ * @brief Allocate one device array of a #cuda_mm_batch.
+ *
+ * @param ptr (return) The device pointer.
+ * @param size The number of bytes to allocate.
+ */
+static void cuda_mm_batch_alloc_device(void **ptr, const size_t size) {
+
+#ifdef WITH_CUDA
+  const cudaError_t err = cudaMalloc(ptr, size);
+  if (err != cudaSuccess)
+    error("Couldn't allocate device M2L batch (%zd bytes): %s", size,
+          cudaGetErrorString(err));
+#else
+  error("SWIFT was not compiled with CUDA support.");
+#endif
+}
+
+/**
+ * @brief Allocate one host array of a #cuda_mm_batch.
+ *
+ * @param ptr (return) The host pointer.
+ * @param size The number of bytes to allocate.
+ */
+static void cuda_mm_batch_alloc_host(void **ptr, const size_t size) {
+
+#ifdef WITH_CUDA
+  /* Page-locked such that the copies are asynchronous */
+  const cudaError_t err = cudaHostAlloc(ptr, size, cudaHostAllocPortable);
+  if (err != cudaSuccess)
+    error("Couldn't allocate host M2L batch (%zd bytes): %s", size,
+          cudaGetErrorString(err));
+#else
+  error("SWIFT was not compiled with CUDA support.");
+#endif
+}
+
+/**
+ * @brief Allocate the memory of a #cuda_mm_batch.
+ *
+ * @param b The #cuda_mm_batch.
+ * @param max_pairs The number of interactions to make room for. 0 keeps the
+ * M2L interactions on the CPU.
+ */
+void cuda_mm_batch_init(struct cuda_mm_batch *b, const int max_pairs) {
+
+  b->npairs = 0;
+  b->max_pairs = max_pairs;
+
+  if (max_pairs == 0) return;
+
+  const size_t sizePairs = max_pairs * sizeof(struct cuda_mm_desc);
+  const size_t sizeTensors = max_pairs * sizeof(struct grav_tensor);
+
+  cuda_mm_batch_alloc_host((void **)&b->pairs, sizePairs);
+  cuda_mm_batch_alloc_host((void **)&b->l_a, sizeTensors);
+  cuda_mm_batch_alloc_host((void **)&b->l_b, sizeTensors);
+  cuda_mm_batch_alloc_host((void **)&b->cells,
+                           2 * max_pairs * sizeof(struct cell *));
+
+  cuda_mm_batch_alloc_device((void **)&b->d_pairs, sizePairs);
+  cuda_mm_batch_alloc_device((void **)&b->d_l_a, sizeTensors);
+  cuda_mm_batch_alloc_device((void **)&b->d_l_b, sizeTensors);
+}
+
+/**
+ * @brief Free the memory of a #cuda_mm_batch.
+ *
+ * @param b The #cuda_mm_batch.
+ */
+void cuda_mm_batch_clean(struct cuda_mm_batch *b) {
+
+#ifdef WITH_CUDA
+  if (b->max_pairs > 0) {
+    cudaFreeHost(b->pairs);
+    cudaFreeHost(b->l_a);
+    cudaFreeHost(b->l_b);
+    cudaFreeHost(b->cells);
+    cudaFree(b->d_pairs);
+    cudaFree(b->d_l_a);
+    cudaFree(b->d_l_b);
+  }
+#endif
+  b->max_pairs = 0;
+  b->npairs = 0;
+}
@@ -0,0 +1,68 @@
+#ifndef SWIFT_CUDA_MM_BATCH_H
+#define SWIFT_CUDA_MM_BATCH_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* MPI headers, multipole_struct.h needs them. */
+#ifdef WITH_MPI
+#include <mpi.h>
+#endif
+
+/* Local headers */
+#include "multipole_struct.h"
+
+/* Forward declarations */
+struct cell;
+
+/**
+ * @brief Description of one M2L interaction in a #cuda_mm_batch.
+ *
+ * The field tensor of cell b always receives the contribution of the
+ * multipole of cell a. Symmetric interactions also give the field tensor of
+ * cell a the contribution of the multipole of cell b.
+ */
+struct cuda_mm_desc {
+
+  /*! Distance vector from a to b, with the periodic wrapping applied. */
+  float dx, dy, dz;
+
+  /*! Softening length to use for this interaction. */
+  float eps;
+
+  /*! Do we also need to update the field tensor of a? */
+  int symmetric;
+
+  /*! Multipoles of both cells. */
+  struct multipole m_a, m_b;
+};
+
+/**
+ * @brief A staging area accumulating the M2L interactions of one or more
+ * grav_mm tasks before sending them to the GPU in one go.
+ *
+ * Each runner owns one of these.
+ */
+struct cuda_mm_batch {
+
+  /*! Host (page-locked) and device copies of the interactions. */
+  struct cuda_mm_desc *pairs, *d_pairs;
+
+  /*! Host (page-locked) and device copies of the resulting field tensors. */
+  struct grav_tensor *l_a, *l_b, *d_l_a, *d_l_b;
+
+  /*! The cells a and b of each interaction, for the write-back. */
+  struct cell **cells;
+
+  /*! Number of interactions we have room for (0 to stay on the CPU). */
+  int max_pairs;
+
+  /*! Number of interactions currently in the batch. */
+  int npairs;
+};
+
+/* Function prototypes. */
+void cuda_mm_batch_init(struct cuda_mm_batch *b, const int max_pairs);
+void cuda_mm_batch_clean(struct cuda_mm_batch *b);
+
+#endif /* SWIFT_CUDA_MM_BATCH_H */
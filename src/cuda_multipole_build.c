@@ -0,0 +1,383 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "cuda_multipole_build.h"
+
+/* System includes. */
+#include <stdlib.h>
+
+#ifdef WITH_CUDA
+/* CUDA headers. */
+#include <cuda_runtime.h>
+#endif
+
+/* Local headers. */
+#include "cell.h"
+#include "engine.h"
+#include "error.h"
+#include "gravity.h"
+#include "multipole.h"
+#include "space.h"
+#include "threadpool.h"
+
+/*! The one instance, driven by the main thread during the rebuilds */
+struct cuda_multipole_build gpu_multipole_build;
+
+/* Builds the multipoles of the flat tree (see grav_pp_offload.cu) */
+extern void multipole_build_offload(struct cuda_multipole_build *b, const int nr_cells, const int nr_levels, const size_t nr_gparts, cudaStream_t stream);
+
+/**
+ * @brief Allocate one device array of the #cuda_multipole_build.
+ *
+ * @param ptr (return) The device pointer.
+ * @param size The number of bytes to allocate.
+ */
+static void cuda_multipole_build_alloc_device(void **ptr, const size_t size) {
+
+#ifdef WITH_CUDA
+  const cudaError_t err = cudaMalloc(ptr, size);
+  if (err != cudaSuccess)
+    error("Couldn't allocate device multipole tree (%zd bytes): %s", size,
+          cudaGetErrorString(err));
+#else
+  error("SWIFT was not compiled with CUDA support.");
+#endif
+}
+
+/**
+ * @brief Allocate one host array of the #cuda_multipole_build.
+ *
+ * @param ptr (return) The host pointer.
+ * @param size The number of bytes to allocate.
+ */
+static void cuda_multipole_build_alloc_host(void **ptr, const size_t size) {
+
+#ifdef WITH_CUDA
+  /* Page-locked such that the copies are asynchronous */
+  const cudaError_t err = cudaHostAlloc(ptr, size, cudaHostAllocPortable);
+  if (err != cudaSuccess)
+    error("Couldn't allocate host multipole tree (%zd bytes): %s", size,
+          cudaGetErrorString(err));
+#else
+  error("SWIFT was not compiled with CUDA support.");
+#endif
+}
+
+/**
+ * @brief Initialise the (empty) #cuda_multipole_build.
+ *
+ * @param active Are we going to build the multipoles on the GPU?
+ */
+void cuda_multipole_build_init(const int active) {
+
+  bzero(&gpu_multipole_build, sizeof(struct cuda_multipole_build));
+  gpu_multipole_build.active = active;
+}
+
+/**
+ * @brief Free the cell arrays of the #cuda_multipole_build.
+ *
+ * @param b The #cuda_multipole_build.
+ */
+static void cuda_multipole_build_free_cells(struct cuda_multipole_build *b) {
+
+  if (b->size_cells > 0) {
+#ifdef WITH_CUDA
+    cudaFreeHost(b->cells);
+    cudaFreeHost(b->multipoles);
+    cudaFree(b->d_cells);
+    cudaFree(b->d_multipoles);
+#endif
+    free(b->cell_ptrs);
+  }
+  b->size_cells = 0;
+}
+
+/**
+ * @brief Free the #gpart arrays of the #cuda_multipole_build.
+ *
+ * @param b The #cuda_multipole_build.
+ */
+static void cuda_multipole_build_free_gparts(struct cuda_multipole_build *b) {
+
+#ifdef WITH_CUDA
+  if (b->size_gparts > 0) {
+    cudaFreeHost(b->x);
+    cudaFreeHost(b->y);
+    cudaFreeHost(b->z);
+    cudaFreeHost(b->v_x);
+    cudaFreeHost(b->v_y);
+    cudaFreeHost(b->v_z);
+    cudaFreeHost(b->m);
+    cudaFreeHost(b->epsilon);
+    cudaFreeHost(b->old_a_grav_norm);
+    cudaFree(b->d_x);
+    cudaFree(b->d_y);
+    cudaFree(b->d_z);
+    cudaFree(b->d_v_x);
+    cudaFree(b->d_v_y);
+    cudaFree(b->d_v_z);
+    cudaFree(b->d_m);
+    cudaFree(b->d_epsilon);
+    cudaFree(b->d_old_a_grav_norm);
+  }
+#endif
+  b->size_gparts = 0;
+}
+
+/**
+ * @brief Free all the memory of the #cuda_multipole_build.
+ */
+void cuda_multipole_build_clean(void) {
+
+  struct cuda_multipole_build *b = &gpu_multipole_build;
+  cuda_multipole_build_free_cells(b);
+  cuda_multipole_build_free_gparts(b);
+  free(b->level_start);
+  b->level_start = NULL;
+  b->size_levels = 0;
+}
+
+/**
+ * @brief Make sure the #cuda_multipole_build can hold a given tree.
+ *
+ * @param b The #cuda_multipole_build.
+ * @param nr_cells The number of cells in the tree.
+ * @param nr_levels The number of levels in the tree.
+ * @param nr_gparts The number of #gpart in the #space.
+ */
+static void cuda_multipole_build_ensure(struct cuda_multipole_build *b,
+                                        const int nr_cells,
+                                        const int nr_levels,
+                                        const size_t nr_gparts) {
+
+  /* Leave some head-room for the next rebuilds */
+  if (nr_cells > b->size_cells) {
+    cuda_multipole_build_free_cells(b);
+    const int size = 1.2 * nr_cells + 1;
+    const size_t sizeCells = size * sizeof(struct cuda_tree_cell);
+    const size_t sizeMpoles = size * sizeof(struct cuda_tree_multipole);
+    cuda_multipole_build_alloc_host((void **)&b->cells, sizeCells);
+    cuda_multipole_build_alloc_host((void **)&b->multipoles, sizeMpoles);
+    cuda_multipole_build_alloc_device((void **)&b->d_cells, sizeCells);
+    cuda_multipole_build_alloc_device((void **)&b->d_multipoles, sizeMpoles);
+    b->cell_ptrs = (struct cell **)malloc(size * sizeof(struct cell *));
+    if (b->cell_ptrs == NULL)
+      error("Failed to allocate the multipole tree cell pointers.");
+    b->size_cells = size;
+  }
+
+  if (nr_levels + 1 > b->size_levels) {
+    free(b->level_start);
+    b->size_levels = nr_levels + 1;
+    b->level_start = (int *)malloc(b->size_levels * sizeof(int));
+    if (b->level_start == NULL)
+      error("Failed to allocate the multipole tree levels.");
+  }
+
+  if (nr_gparts > b->size_gparts) {
+    cuda_multipole_build_free_gparts(b);
+    const size_t size = nr_gparts + nr_gparts / 10 + 1;
+    const size_t sizeD = size * sizeof(double);
+    const size_t sizeF = size * sizeof(float);
+    cuda_multipole_build_alloc_host((void **)&b->x, sizeD);
+    cuda_multipole_build_alloc_host((void **)&b->y, sizeD);
+    cuda_multipole_build_alloc_host((void **)&b->z, sizeD);
+    cuda_multipole_build_alloc_host((void **)&b->v_x, sizeF);
+    cuda_multipole_build_alloc_host((void **)&b->v_y, sizeF);
+    cuda_multipole_build_alloc_host((void **)&b->v_z, sizeF);
+    cuda_multipole_build_alloc_host((void **)&b->m, sizeF);
+    cuda_multipole_build_alloc_host((void **)&b->epsilon, sizeF);
+    cuda_multipole_build_alloc_host((void **)&b->old_a_grav_norm, sizeF);
+    cuda_multipole_build_alloc_device((void **)&b->d_x, sizeD);
+    cuda_multipole_build_alloc_device((void **)&b->d_y, sizeD);
+    cuda_multipole_build_alloc_device((void **)&b->d_z, sizeD);
+    cuda_multipole_build_alloc_device((void **)&b->d_v_x, sizeF);
+    cuda_multipole_build_alloc_device((void **)&b->d_v_y, sizeF);
+    cuda_multipole_build_alloc_device((void **)&b->d_v_z, sizeF);
+    cuda_multipole_build_alloc_device((void **)&b->d_m, sizeF);
+    cuda_multipole_build_alloc_device((void **)&b->d_epsilon, sizeF);
+    cuda_multipole_build_alloc_device((void **)&b->d_old_a_grav_norm, sizeF);
+    b->size_gparts = size;
+  }
+}
+
+/**
+ * @brief Count the cells and levels of a cell hierarchy.
+ *
+ * @param c The #cell.
+ * @param level The level of the cell below its top-level cell.
+ * @param nr_cells (in/out) The number of cells found so far.
+ * @param nr_levels (in/out) The number of levels found so far.
+ */
+static void cuda_multipole_build_count_rec(const struct cell *c,
+                                           const int level, int *nr_cells,
+                                           int *nr_levels) {
+
+  (*nr_cells)++;
+  if (level + 1 > *nr_levels) *nr_levels = level + 1;
+
+  if (c->split)
+    for (int k = 0; k < 8; ++k)
+      if (c->progeny[k] != NULL)
+        cuda_multipole_build_count_rec(c->progeny[k], level + 1, nr_cells,
+                                       nr_levels);
+}
+
+/**
+ * @brief #threadpool mapper function copying the #gpart to the SoA arrays
+ * of the #cuda_multipole_build.
+ *
+ * @param map_data The #gpart.
+ * @param num_elements The number of #gpart.
+ * @param extra_data The #space.
+ */
+static void cuda_multipole_build_gparts_mapper(void *map_data,
+                                               int num_elements,
+                                               void *extra_data) {
+
+  const struct space *s = (const struct space *)extra_data;
+  const struct gravity_props *grav_props = s->e->gravity_properties;
+  const struct gpart *gparts = (const struct gpart *)map_data;
+  const size_t offset = gparts - s->gparts;
+  struct cuda_multipole_build *b = &gpu_multipole_build;
+
+  for (int k = 0; k < num_elements; ++k) {
+    const struct gpart *gp = &gparts[k];
+    const size_t i = offset + k;
+    b->x[i] = gp->x[0];
+    b->y[i] = gp->x[1];
+    b->z[i] = gp->x[2];
+    b->v_x[i] = gp->v_full[0];
+    b->v_y[i] = gp->v_full[1];
+    b->v_z[i] = gp->v_full[2];
+    b->m[i] = gp->mass;
+    b->epsilon[i] = gravity_get_softening(gp, grav_props);
+    b->old_a_grav_norm[i] = gp->old_a_grav_norm;
+  }
+}
+
+/**
+ * @brief #threadpool mapper function copying the multipoles built by the
+ * GPU to the cells.
+ *
+ * @param map_data The #cuda_tree_multipole.
+ * @param num_elements The number of cells.
+ * @param extra_data The time to stamp the multipoles with (-1 to leave it).
+ */
+static void cuda_multipole_build_write_back_mapper(void *map_data,
+                                                   int num_elements,
+                                                   void *extra_data) {
+
+  const integertime_t ti_current = *(const integertime_t *)extra_data;
+  const struct cuda_tree_multipole *multipoles =
+      (const struct cuda_tree_multipole *)map_data;
+  const struct cuda_multipole_build *b = &gpu_multipole_build;
+  const size_t offset = multipoles - b->multipoles;
+
+  for (int k = 0; k < num_elements; ++k) {
+    const struct cuda_tree_multipole *res = &multipoles[k];
+    struct cell *c = b->cell_ptrs[offset + k];
+    struct gravity_tensors *mp = c->grav.multipole;
+
+    gravity_reset(mp);
+    mp->m_pole = res->m_pole;
+    mp->CoM[0] = res->CoM[0];
+    mp->CoM[1] = res->CoM[1];
+    mp->CoM[2] = res->CoM[2];
+    mp->r_max = res->r_max;
+
+    /* Also update the values at rebuild time */
+    mp->r_max_rebuild = mp->r_max;
+    mp->CoM_rebuild[0] = mp->CoM[0];
+    mp->CoM_rebuild[1] = mp->CoM[1];
+    mp->CoM_rebuild[2] = mp->CoM[2];
+
+    if (ti_current >= 0) c->grav.ti_old_multipole = ti_current;
+  }
+}
+
+/**
+ * @brief Construct all the multipoles of a set of (local) top-level cell
+ * hierarchies on the GPU.
+ *
+ * Gives the same multipoles as cell_make_multipoles(). The trees are sent
+ * as flat arrays sorted level by level. The leaves, at any level, get their
+ * P2M in one kernel launch and every level then gets its M2M from the one
+ * below in one launch, starting from the bottom.
+ *
+ * Must be called when no task is running.
+ *
+ * @param s The #space.
+ * @param cell_ids The indices of the top-level cells in s->cells_top.
+ * @param nr_cells The number of top-level cells.
+ * @param ti_current The time to stamp the multipoles with (-1 to leave it).
+ */
+void cuda_multipole_build(struct space *s, const int *cell_ids,
+                          const int nr_cells, const integertime_t ti_current) {
+
+  struct cuda_multipole_build *b = &gpu_multipole_build;
+  if (nr_cells == 0) return;
+
+  /* How big is the tree? */
+  int nr_tree_cells = 0, nr_levels = 0;
+  for (int k = 0; k < nr_cells; ++k)
+    cuda_multipole_build_count_rec(&s->cells_top[cell_ids[k]], 0,
+                                   &nr_tree_cells, &nr_levels);
+  cuda_multipole_build_ensure(b, nr_tree_cells, nr_levels, s->nr_gparts);
+
+  /* Flatten it level by level */
+  for (int k = 0; k < nr_cells; ++k)
+    b->cell_ptrs[k] = &s->cells_top[cell_ids[k]];
+  b->level_start[0] = 0;
+  b->level_start[1] = nr_cells;
+  int next = nr_cells;
+  for (int level = 0; level < nr_levels; ++level) {
+    for (int i = b->level_start[level]; i < b->level_start[level + 1]; ++i) {
+      const struct cell *c = b->cell_ptrs[i];
+      struct cuda_tree_cell *tc = &b->cells[i];
+      for (int d = 0; d < 3; ++d) {
+        tc->loc[d] = c->loc[d];
+        tc->width[d] = c->width[d];
+      }
+      tc->first = c->grav.count > 0 ? c->grav.parts - s->gparts : 0;
+      tc->count = c->grav.count;
+      tc->split = c->split;
+      for (int k = 0; k < 8; ++k) {
+        if (c->split && c->progeny[k] != NULL) {
+          b->cell_ptrs[next] = c->progeny[k];
+          tc->progeny[k] = next++;
+        } else {
+          tc->progeny[k] = -1;
+        }
+      }
+    }
+    if (level + 1 < nr_levels) b->level_start[level + 2] = next;
+  }
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (next != nr_tree_cells) error("Lost some cells flattening the tree");
+#endif
+
+  /* The particles, in SoA form */
+  if (s->nr_gparts > 0)
+    threadpool_map(&s->e->threadpool, cuda_multipole_build_gparts_mapper,
+                   s->gparts, s->nr_gparts, sizeof(struct gpart),
+                   threadpool_auto_chunk_size, s);
+
+  /* Let the GPU do the work */
+#ifdef WITH_CUDA
+  multipole_build_offload(b, nr_tree_cells, nr_levels, s->nr_gparts,
+                          /*stream=*/NULL);
+#else
+  error("SWIFT was not compiled with CUDA support.");
+#endif
+
+  /* And copy the results to the cells */
+  integertime_t ti = ti_current;
+  threadpool_map(&s->e->threadpool, cuda_multipole_build_write_back_mapper,
+                 b->multipoles, nr_tree_cells,
+                 sizeof(struct cuda_tree_multipole),
+                 threadpool_auto_chunk_size, &ti);
+}
@@ -0,0 +1,115 @@
+#ifndef SWIFT_CUDA_MULTIPOLE_BUILD_H
+#define SWIFT_CUDA_MULTIPOLE_BUILD_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* System includes. */
+#include <stddef.h>
+
+/* MPI headers, multipole_struct.h needs them. */
+#ifdef WITH_MPI
+#include <mpi.h>
+#endif
+
+/* Local headers */
+#include "multipole_struct.h"
+#include "timeline.h"
+
+/* Forward declarations */
+struct cell;
+struct space;
+
+/**
+ * @brief A cell of the tree as seen by the multipole construction kernels.
+ */
+struct cuda_tree_cell {
+
+  /*! Corner and size of the cell. */
+  double loc[3], width[3];
+
+  /*! Offset of the first #gpart of the cell in space->gparts. */
+  size_t first;
+
+  /*! Number of #gpart in the cell. */
+  int count;
+
+  /*! Is the cell split? */
+  int split;
+
+  /*! Index of the progenies in the flat tree (-1 if none). */
+  int progeny[8];
+};
+
+/**
+ * @brief The multipole of a cell as built by the kernels.
+ */
+struct cuda_tree_multipole {
+
+  /*! The actual multipole. */
+  struct multipole m_pole;
+
+  /*! Centre of mass of the cell. */
+  double CoM[3];
+
+  /*! Upper limit of the CoM<->gpart distance. */
+  double r_max;
+};
+
+/**
+ * @brief The cell hierarchies of the local top-level cells as flat arrays,
+ * sorted level by level, and a SoA copy of their #gpart such that the GPU
+ * can build all the multipoles, bottom-up, one level per kernel launch.
+ *
+ * The host arrays are page-locked.
+ */
+struct cuda_multipole_build {
+
+  /*! Host and device copies of the flat tree. */
+  struct cuda_tree_cell *cells, *d_cells;
+
+  /*! Host and device copies of the resulting multipoles. */
+  struct cuda_tree_multipole *multipoles, *d_multipoles;
+
+  /*! The #cell behind each entry of the flat tree. */
+  struct cell **cell_ptrs;
+
+  /*! Index of the first cell of each level (plus one past the last). */
+  int *level_start;
+
+  /*! Host and device copies of the #gpart positions. */
+  double *x, *y, *z, *d_x, *d_y, *d_z;
+
+  /*! Host and device copies of the #gpart velocities. */
+  float *v_x, *v_y, *v_z, *d_v_x, *d_v_y, *d_v_z;
+
+  /*! Host and device copies of the #gpart masses and softenings. */
+  float *m, *epsilon, *d_m, *d_epsilon;
+
+  /*! Host and device copies of the #gpart acceleration norms of the last
+   * step. */
+  float *old_a_grav_norm, *d_old_a_grav_norm;
+
+  /*! Number of cells we have room for. */
+  int size_cells;
+
+  /*! Number of levels we have room for. */
+  int size_levels;
+
+  /*! Number of #gpart we have room for. */
+  size_t size_gparts;
+
+  /*! Are we building the multipoles on the GPU at all? */
+  int active;
+};
+
+/* The one instance */
+extern struct cuda_multipole_build gpu_multipole_build;
+
+/* Function prototypes. */
+void cuda_multipole_build_init(const int active);
+void cuda_multipole_build_clean(void);
+void cuda_multipole_build(struct space *s, const int *cell_ids,
+                          const int nr_cells, const integertime_t ti_current);
+
+#endif /* SWIFT_CUDA_MULTIPOLE_BUILD_H */
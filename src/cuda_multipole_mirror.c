@@ -0,0 +1,182 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "cuda_multipole_mirror.h"
+
+/* System includes. */
+#include <stdlib.h>
+
+#ifdef WITH_CUDA
+/* CUDA headers. */
+#include <cuda_runtime.h>
+#endif
+
+/* Local headers. */
+#include "atomic.h"
+#include "cell.h"
+#include "cuda_devices.h"
+#include "cuda_streams.h"
+#include "engine.h"
+#include "error.h"
+#include "runner.h"
+#include "space.h"
+
+/*! One mirror per device, each holding the leaves its runners used */
+struct cuda_multipole_mirror gpu_multipoles[CUDA_MAX_DEVICES];
+
+/**
+ * @brief Frees the memory of the #cuda_multipole_mirror of all the devices.
+ */
+void cuda_multipole_mirror_clean(void) {
+
+#ifdef WITH_CUDA
+  for (int d = 0; d < gpu_devices.count; ++d) {
+    struct cuda_multipole_mirror *m = &gpu_multipoles[d];
+    if (m->size > 0) {
+      cuda_devices_use(d);
+      cudaFree(m->multipoles);
+      free(m->ti_upload);
+    }
+    m->multipoles = NULL;
+    m->ti_upload = NULL;
+    m->size = 0;
+  }
+  cuda_devices_use(0);
+#endif
+}
+
+/**
+ * @brief Number the leaves of a cell hierarchy.
+ *
+ * @param c The #cell.
+ * @param count (in/out) The number of leaves found so far.
+ */
+static void cuda_multipole_mirror_index_rec(struct cell *c, int *count) {
+
+  if (c->split) {
+    c->grav.mirror_index = -1;
+    for (int k = 0; k < 8; ++k)
+      if (c->progeny[k] != NULL)
+        cuda_multipole_mirror_index_rec(c->progeny[k], count);
+  } else {
+    c->grav.mirror_index = (*count)++;
+  }
+}
+
+/**
+ * @brief Number all the leaves (local and foreign) of the #space and make
+ * room for them in the #cuda_multipole_mirror of every device.
+ *
+ * Must be called after every rebuild, when no task is running. All the
+ * leaves are marked as not sent yet.
+ *
+ * @param s The #space.
+ * @return The number of leaves.
+ */
+int cuda_multipole_mirror_index(struct space *s) {
+
+  int count = 0;
+  for (int k = 0; k < s->nr_cells; ++k)
+    cuda_multipole_mirror_index_rec(&s->cells_top[k], &count);
+
+#ifdef WITH_CUDA
+  for (int d = 0; d < gpu_devices.count; ++d) {
+    struct cuda_multipole_mirror *m = &gpu_multipoles[d];
+
+    /* Grow the arrays if need be */
+    if (count > m->size) {
+      cuda_devices_use(d);
+      if (m->size > 0) {
+        cudaFree(m->multipoles);
+        free(m->ti_upload);
+      }
+
+      /* Leave some room for the next rebuilds */
+      const int size = 1.2 * count + 1;
+      const size_t bytes = size * sizeof(struct cuda_cell_multipole);
+      const cudaError_t err = cudaMalloc((void **)&m->multipoles, bytes);
+      if (err != cudaSuccess)
+        error("Couldn't allocate device multipole mirror (%zd bytes): %s",
+              bytes, cudaGetErrorString(err));
+      m->ti_upload = (integertime_t *)malloc(size * sizeof(integertime_t));
+      if (m->ti_upload == NULL)
+        error("Failed to allocate the multipole mirror time-stamps.");
+      m->size = size;
+    }
+
+    for (int k = 0; k < m->size; ++k) m->ti_upload[k] = -1;
+  }
+  cuda_devices_use(0);
+#endif
+
+  return count;
+}
+
+/**
+ * @brief The device copy of the multipole of a leaf, sending it first if
+ * it has not been yet since its last drift.
+ *
+ * The copy lives on the device the runner drives. The first runner to ask
+ * for a leaf in a step sends it while the others wait for the copy to land.
+ *
+ * @param r The #runner.
+ * @param c The (leaf) #cell, with its multipole drifted to the current time.
+ * @return The device address of the multipole of the cell.
+ */
+const struct cuda_cell_multipole *cuda_multipole_mirror_get(
+    struct runner *r, const struct cell *c) {
+
+#ifdef WITH_CUDA
+  const struct engine *e = r->e;
+  const int device = cuda_devices_of_runner(r->id);
+  struct cuda_multipole_mirror *const m = &gpu_multipoles[device];
+  const int index = c->grav.mirror_index;
+  const integertime_t ti_current = e->ti_current;
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (index < 0 || index >= m->size)
+    error("Cell is not a leaf of the multipole mirror");
+  if (c->grav.ti_old_multipole != ti_current)
+    error("Sending an un-drifted multipole");
+#endif
+
+  integertime_t *const stamp = &m->ti_upload[index];
+  while (1) {
+
+    const integertime_t old = atomic_add(stamp, 0);
+    if (old == ti_current) break;
+
+    /* Someone else is sending it, wait */
+    if (old == CUDA_MULTIPOLE_MIRROR_BUSY) continue;
+
+    /* Our turn */
+    if (atomic_cas(stamp, old, CUDA_MULTIPOLE_MIRROR_BUSY) == old) {
+
+      const struct gravity_tensors *mpole = c->grav.multipole;
+      struct cuda_cell_multipole buffer;
+      buffer.m_pole = mpole->m_pole;
+      buffer.CoM[0] = (float)mpole->CoM[0];
+      buffer.CoM[1] = (float)mpole->CoM[1];
+      buffer.CoM[2] = (float)mpole->CoM[2];
+
+      const cudaStream_t stream = get_runner_cuda_stream(r->id);
+      cudaMemcpyAsync(&m->multipoles[index], &buffer, sizeof(buffer),
+                      cudaMemcpyHostToDevice, stream);
+      const cudaError_t err = cudaStreamSynchronize(stream);
+      if (err != cudaSuccess)
+        error("Failed to upload a multipole to the device: %s",
+              cudaGetErrorString(err));
+
+      /* The copy has landed, let the others use it */
+      atomic_swap(stamp, ti_current);
+      break;
+    }
+  }
+
+  return &m->multipoles[index];
+#else
+  error("SWIFT was not compiled with CUDA support.");
+  return NULL;
+#endif
+}
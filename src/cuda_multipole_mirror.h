@@ -0,0 +1,67 @@
+#ifndef SWIFT_CUDA_MULTIPOLE_MIRROR_H
+#define SWIFT_CUDA_MULTIPOLE_MIRROR_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* MPI headers, multipole_struct.h needs them. */
+#ifdef WITH_MPI
+#include <mpi.h>
+#endif
+
+/* Local headers */
+#include "cuda_devices.h"
+#include "multipole_struct.h"
+#include "timeline.h"
+
+/* Forward declarations */
+struct cell;
+struct runner;
+struct space;
+
+/*! Value of #cuda_multipole_mirror.ti_upload while a leaf is on its way. */
+#define CUDA_MULTIPOLE_MIRROR_BUSY (-2LL)
+
+/**
+ * @brief The information about a leaf cell the P2P kernels need for their
+ * M2P interactions.
+ */
+struct cuda_cell_multipole {
+
+  /*! The multipole of the cell. */
+  struct multipole m_pole;
+
+  /*! Centre of mass of the cell. */
+  float CoM[3];
+};
+
+/**
+ * @brief A device-resident copy of the multipoles of the leaf cells, indexed
+ * by cell->grav.mirror_index.
+ *
+ * The leaves are numbered at every rebuild. The multipole of a leaf is sent
+ * to a device by the first pair task running there after the multipole got
+ * drifted, all the other pairs of the step then only pass its address.
+ */
+struct cuda_multipole_mirror {
+
+  /*! Device-side multipoles. */
+  struct cuda_cell_multipole *multipoles;
+
+  /*! Host-side time at which each leaf was last sent. */
+  integertime_t *ti_upload;
+
+  /*! Number of leaves we have room for. */
+  int size;
+};
+
+/* One instance per device */
+extern struct cuda_multipole_mirror gpu_multipoles[CUDA_MAX_DEVICES];
+
+/* Function prototypes. */
+void cuda_multipole_mirror_clean(void);
+int cuda_multipole_mirror_index(struct space *s);
+const struct cuda_cell_multipole *cuda_multipole_mirror_get(
+    struct runner *r, const struct cell *c);
+
+#endif /* SWIFT_CUDA_MULTIPOLE_MIRROR_H */
@@ -0,0 +1,268 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "cuda_pair_batch.h"
+
+/* System includes. */
+#include <stdlib.h>
+
+#ifdef WITH_CUDA
+/* CUDA headers. */
+#include <cuda_runtime.h>
+#endif
+
+/* Local headers. */
+#include "error.h"
+
+/**
+ * @brief Allocate one device array of a #cuda_pair_batch.
+ *
+ * @param ptr (return) The device pointer.
+ * @param size The number of bytes to allocate.
+ */
+static void cuda_pair_batch_alloc_device(void **ptr, const size_t size) {
+
+#ifdef WITH_CUDA
+  const cudaError_t err = cudaMalloc(ptr, size);
+  if (err != cudaSuccess)
+    error("Couldn't allocate device pair batch (%zd bytes): %s", size,
+          cudaGetErrorString(err));
+#else
+  error("SWIFT was not compiled with CUDA support.");
+#endif
+}
+
+/**
+ * @brief Allocate one host array of a #cuda_pair_batch.
+ *
+ * @param ptr (return) The host pointer.
+ * @param size The number of bytes to allocate.
+ */
+static void cuda_pair_batch_alloc_host(void **ptr, const size_t size) {
+
+#ifdef WITH_CUDA
+  /* Page-locked such that the copies are asynchronous */
+  const cudaError_t err = cudaHostAlloc(ptr, size, cudaHostAllocPortable);
+  if (err != cudaSuccess)
+    error("Couldn't allocate host pair batch (%zd bytes): %s", size,
+          cudaGetErrorString(err));
+#else
+  error("SWIFT was not compiled with CUDA support.");
+#endif
+}
+
+/**
+ * @brief Free the particle arrays of a #cuda_pair_batch.
+ *
+ * @param b The #cuda_pair_batch.
+ */
+static void cuda_pair_batch_clean_particles(struct cuda_pair_batch *b) {
+
+#ifdef WITH_CUDA
+  if (b->size > 0) {
+    cudaFreeHost(b->x);
+    cudaFreeHost(b->y);
+    cudaFreeHost(b->z);
+    cudaFreeHost(b->epsilon);
+    cudaFreeHost(b->m);
+    cudaFreeHost(b->a_x);
+    cudaFreeHost(b->a_y);
+    cudaFreeHost(b->a_z);
+    cudaFreeHost(b->pot);
+    cudaFreeHost(b->active);
+    cudaFreeHost(b->use_mpole);
+
+    cudaFree(b->d_x);
+    cudaFree(b->d_y);
+    cudaFree(b->d_z);
+    cudaFree(b->d_epsilon);
+    cudaFree(b->d_m);
+    cudaFree(b->d_a_x);
+    cudaFree(b->d_a_y);
+    cudaFree(b->d_a_z);
+    cudaFree(b->d_pot);
+    cudaFree(b->d_active);
+    cudaFree(b->d_use_mpole);
+  }
+#endif
+  b->size = 0;
+}
+
+/**
+ * @brief Allocate the particle arrays of a #cuda_pair_batch.
+ *
+ * @param b The #cuda_pair_batch.
+ * @param size The number of particles to make room for.
+ */
+static void cuda_pair_batch_init_particles(struct cuda_pair_batch *b,
+                                           const int size) {
+
+  const size_t sizeBytesF = size * sizeof(float);
+  const size_t sizeBytesI = size * sizeof(int);
+
+  cuda_pair_batch_alloc_host((void **)&b->x, sizeBytesF);
+  cuda_pair_batch_alloc_host((void **)&b->y, sizeBytesF);
+  cuda_pair_batch_alloc_host((void **)&b->z, sizeBytesF);
+  cuda_pair_batch_alloc_host((void **)&b->epsilon, sizeBytesF);
+  cuda_pair_batch_alloc_host((void **)&b->m, sizeBytesF);
+  cuda_pair_batch_alloc_host((void **)&b->a_x, sizeBytesF);
+  cuda_pair_batch_alloc_host((void **)&b->a_y, sizeBytesF);
+  cuda_pair_batch_alloc_host((void **)&b->a_z, sizeBytesF);
+  cuda_pair_batch_alloc_host((void **)&b->pot, sizeBytesF);
+  cuda_pair_batch_alloc_host((void **)&b->active, sizeBytesI);
+  cuda_pair_batch_alloc_host((void **)&b->use_mpole, sizeBytesI);
+
+  cuda_pair_batch_alloc_device((void **)&b->d_x, sizeBytesF);
+  cuda_pair_batch_alloc_device((void **)&b->d_y, sizeBytesF);
+  cuda_pair_batch_alloc_device((void **)&b->d_z, sizeBytesF);
+  cuda_pair_batch_alloc_device((void **)&b->d_epsilon, sizeBytesF);
+  cuda_pair_batch_alloc_device((void **)&b->d_m, sizeBytesF);
+  cuda_pair_batch_alloc_device((void **)&b->d_a_x, sizeBytesF);
+  cuda_pair_batch_alloc_device((void **)&b->d_a_y, sizeBytesF);
+  cuda_pair_batch_alloc_device((void **)&b->d_a_z, sizeBytesF);
+  cuda_pair_batch_alloc_device((void **)&b->d_pot, sizeBytesF);
+  cuda_pair_batch_alloc_device((void **)&b->d_active, sizeBytesI);
+  cuda_pair_batch_alloc_device((void **)&b->d_use_mpole, sizeBytesI);
+
+  b->size = size;
+}
+
+/**
+ * @brief Destroy all the instantiated graphs of a #cuda_pair_batch.
+ *
+ * They are re-captured on demand. This must be done every time one of the
+ * arrays they copy from or to moves.
+ *
+ * @param b The #cuda_pair_batch.
+ */
+void cuda_pair_batch_clean_graphs(struct cuda_pair_batch *b) {
+
+  if (b->graphs == NULL) return;
+
+  const int nr_graphs =
+      2 * CUDA_PAIR_BATCH_GRAPH_BUCKETS * CUDA_PAIR_BATCH_GRAPH_BUCKETS;
+  for (int k = 0; k < nr_graphs; ++k) {
+#ifdef WITH_CUDA
+    if (b->graphs[k] != NULL) cudaGraphExecDestroy(b->graphs[k]);
+#endif
+    b->graphs[k] = NULL;
+  }
+  b->graph_mirror = NULL;
+}
+
+/**
+ * @brief Allocate the memory of a #cuda_pair_batch.
+ *
+ * @param b The #cuda_pair_batch.
+ * @param threshold The number of particles above which the batch is sent.
+ * @param size The number of particles to make room for.
+ * @param max_pairs The number of pairs to make room for (0 to keep the pairs
+ * on the CPU).
+ * @param use_graphs Replay the flushes as CUDA graphs?
+ * @param async Leave the last flush of every task in flight?
+ */
+void cuda_pair_batch_init(struct cuda_pair_batch *b, const int threshold,
+                          const int size, const int max_pairs,
+                          const int use_graphs, const int async) {
+
+  b->size = 0;
+  b->count = 0;
+  b->npairs = 0;
+  b->threshold = threshold;
+  b->graphs = NULL;
+  b->graph_mirror = NULL;
+  b->async = async && threshold > 0;
+  b->in_flight = NULL;
+  b->in_flight_ticks = 0;
+
+  /* Tells us when the flush in flight has landed */
+  if (b->async) {
+#ifdef WITH_CUDA
+    const cudaError_t err =
+        cudaEventCreateWithFlags(&b->done, cudaEventDisableTiming);
+    if (err != cudaSuccess)
+      error("Couldn't create the pair batch event: %s",
+            cudaGetErrorString(err));
+#else
+    error("SWIFT was not compiled with CUDA support.");
+#endif
+  }
+
+  /* One (lazily captured) graph per shape of the flush */
+  if (use_graphs && threshold > 0) {
+    const int nr_graphs =
+        2 * CUDA_PAIR_BATCH_GRAPH_BUCKETS * CUDA_PAIR_BATCH_GRAPH_BUCKETS;
+    b->graphs = (cudaGraphExec_t *)calloc(nr_graphs, sizeof(cudaGraphExec_t));
+    if (b->graphs == NULL) error("Couldn't allocate the pair batch graphs");
+  }
+
+  /* Nothing to allocate if batching is switched off */
+  if (size > 0) cuda_pair_batch_init_particles(b, size);
+
+  /* Nor if the pairs stay on the CPU */
+  b->max_pairs = 0;
+  if (max_pairs == 0) return;
+
+  cuda_pair_batch_alloc_host((void **)&b->pairs,
+                             max_pairs * sizeof(struct cuda_pair_desc));
+  cuda_pair_batch_alloc_host((void **)&b->cells,
+                             2 * max_pairs * sizeof(struct cell *));
+  cuda_pair_batch_alloc_device((void **)&b->d_pairs,
+                               max_pairs * sizeof(struct cuda_pair_desc));
+  b->max_pairs = max_pairs;
+}
+
+/**
+ * @brief Free the memory of a #cuda_pair_batch.
+ *
+ * @param b The #cuda_pair_batch.
+ */
+void cuda_pair_batch_clean(struct cuda_pair_batch *b) {
+
+  cuda_pair_batch_clean_graphs(b);
+  free(b->graphs);
+  b->graphs = NULL;
+
+#ifdef WITH_CUDA
+  if (b->async) cudaEventDestroy(b->done);
+#endif
+  b->async = 0;
+
+  cuda_pair_batch_clean_particles(b);
+
+#ifdef WITH_CUDA
+  if (b->max_pairs > 0) {
+    cudaFreeHost(b->pairs);
+    cudaFreeHost(b->cells);
+    cudaFree(b->d_pairs);
+  }
+#endif
+  b->max_pairs = 0;
+  b->count = 0;
+  b->npairs = 0;
+}
+
+/**
+ * @brief Make sure an empty #cuda_pair_batch can hold a given number of
+ * particles.
+ *
+ * This is only needed for pairs larger than the whole batch, hence we do not
+ * preserve the content.
+ *
+ * @param b The #cuda_pair_batch.
+ * @param count The number of particles to make room for.
+ */
+void cuda_pair_batch_ensure(struct cuda_pair_batch *b, const int count) {
+
+  if (b->size < count) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+    if (b->count != 0) error("Growing a non-empty pair batch");
+#endif
+
+    cuda_pair_batch_clean_graphs(b);
+    cuda_pair_batch_clean_particles(b);
+    cuda_pair_batch_init_particles(b, count);
+  }
+}
@@ -0,0 +1,172 @@
+#ifndef SWIFT_CUDA_PAIR_BATCH_H
+#define SWIFT_CUDA_PAIR_BATCH_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* System includes. */
+#include <stddef.h>
+
+/* Local headers */
+#include "align.h"
+#include "cuda_types.h"
+#include "cycle.h"
+#include "inline.h"
+
+/* Forward declarations */
+struct cell;
+struct cuda_cell_multipole;
+struct task;
+
+/*! Number of (power of two) size classes of the batches replayed as graphs. */
+#define CUDA_PAIR_BATCH_GRAPH_BUCKETS 32
+
+/**
+ * @brief Description of one leaf-leaf pair in a #cuda_pair_batch.
+ *
+ * This is copied to the device as-is and tells the batched kernel where the
+ * particles of each cell sit in the packed arrays and which interactions to
+ * compute.
+ */
+struct cuda_pair_desc {
+
+  /*! Index of the first particle of each cell in the packed arrays. */
+  int offset_i, offset_j;
+
+  /*! Index of the first particle of each cell in the #gpart mirror. */
+  size_t goffset_i, goffset_j;
+
+  /*! Number of particles in each cell. */
+  int gcount_i, gcount_j;
+
+  /*! Number of particles in each cell padded to the vector length. */
+  int gcount_padded_i, gcount_padded_j;
+
+  /*! Do we need to update the particles of each cell? */
+  int update_i, update_j;
+
+  /*! Do we need the truncated potential for this pair? */
+  int truncated;
+
+  /*! Device copies of the multipoles of both cells in the
+   * #cuda_multipole_mirror (NULL if not used by the M2P of the other cell). */
+  const struct cuda_cell_multipole *multi_i, *multi_j;
+};
+
+/**
+ * @brief A staging area accumulating many leaf-leaf pairs before sending
+ * them to the GPU in one go.
+ *
+ * The particle arrays are packed one cell after the other (each cell being
+ * padded such that every sub-array is aligned) and follow the layout of a
+ * #gravity_cache such that the caches can be populated and written back
+ * in-place.
+ *
+ * Each runner owns one of these.
+ */
+struct cuda_pair_batch {
+
+  /*! Host-side (page-locked) packed #gpart arrays. */
+  float *x, *y, *z, *epsilon, *m;
+  float *a_x, *a_y, *a_z, *pot;
+  int *active, *use_mpole;
+
+  /*! Device-side copies of the packed arrays. */
+  float *d_x, *d_y, *d_z, *d_epsilon, *d_m;
+  float *d_a_x, *d_a_y, *d_a_z, *d_pot;
+  int *d_active, *d_use_mpole;
+
+  /*! Host and device copies of the pair descriptors. */
+  struct cuda_pair_desc *pairs, *d_pairs;
+
+  /*! The cells of each pair (2 per pair), for the write-back. */
+  struct cell **cells;
+
+  /*! Number of particles we have room for in the packed arrays. */
+  int size;
+
+  /*! Number of particles currently in the packed arrays. */
+  int count;
+
+  /*! Number of pairs we have room for. */
+  int max_pairs;
+
+  /*! Number of pairs currently in the batch. */
+  int npairs;
+
+  /*! Number of particles above which the batch gets sent to the device. */
+  int threshold;
+
+  /*! Instantiated graphs of the flush, one per (resident, count class, pairs
+   * class), NULL if we are not using graphs. */
+  cudaGraphExec_t *graphs;
+
+  /*! The #gpart mirror the resident graphs read from. */
+  const float *graph_mirror;
+
+  /*! Do we leave the last flush of a task in flight rather than waiting for
+   * it? */
+  int async;
+
+  /*! Recorded on the runner's stream after a flush left in flight. */
+  cudaEvent_t done;
+
+  /*! The task whose flush is in flight (NULL if none). */
+  struct task *in_flight;
+
+  /*! Time the runner spent issuing the flush in flight. */
+  ticks in_flight_ticks;
+};
+
+/**
+ * @brief Number of particles a cell with a given padded count occupies in a
+ * #cuda_pair_batch.
+ *
+ * We round up such that every cell starts on a cache line and the host-side
+ * #gravity_cache functions can be used on the packed arrays.
+ *
+ * @param gcount_padded The padded number of particles in the cell.
+ */
+static INLINE int cuda_pair_batch_stride(const int gcount_padded) {
+
+  const int align = SWIFT_CACHE_ALIGNMENT / sizeof(float);
+  return ((gcount_padded + align - 1) / align) * align;
+}
+
+/**
+ * @brief Size class of a batch: the smallest k such that 2^k >= n.
+ *
+ * @param n The number of particles or pairs in the batch.
+ */
+static INLINE int cuda_pair_batch_graph_bucket(const int n) {
+
+  int k = 0;
+  while ((1 << k) < n) ++k;
+  return k;
+}
+
+/**
+ * @brief Index of the graph of a given shape in #cuda_pair_batch.graphs.
+ *
+ * @param resident Are the particles read from the #gpart mirror?
+ * @param count_bucket The size class of the number of particles.
+ * @param pairs_bucket The size class of the number of pairs.
+ */
+static INLINE int cuda_pair_batch_graph_index(const int resident,
+                                              const int count_bucket,
+                                              const int pairs_bucket) {
+
+  return (resident * CUDA_PAIR_BATCH_GRAPH_BUCKETS + count_bucket) *
+             CUDA_PAIR_BATCH_GRAPH_BUCKETS +
+         pairs_bucket;
+}
+
+/* Function prototypes. */
+void cuda_pair_batch_init(struct cuda_pair_batch *b, const int threshold,
+                          const int size, const int max_pairs,
+                          const int use_graphs, const int async);
+void cuda_pair_batch_clean(struct cuda_pair_batch *b);
+void cuda_pair_batch_clean_graphs(struct cuda_pair_batch *b);
+void cuda_pair_batch_ensure(struct cuda_pair_batch *b, const int count);
+
+#endif /* SWIFT_CUDA_PAIR_BATCH_H */
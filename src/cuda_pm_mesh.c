@@ -0,0 +1,404 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "cuda_pm_mesh.h"
+
+/* System includes. */
+#include <math.h>
+#include <stdlib.h>
+
+#ifdef WITH_MPI
+#include <mpi.h>
+#endif
+
+#ifdef WITH_CUDA
+/* CUDA headers. */
+#include <cuda_runtime.h>
+#endif
+
+/* Local headers. */
+#include "clocks.h"
+#include "engine.h"
+#include "error.h"
+#include "gravity.h"
+#include "mesh_gravity.h"
+#include "neutrino.h"
+#include "space.h"
+#include "threadpool.h"
+
+/*! The one instance, driven by the main thread */
+struct cuda_pm_mesh gpu_pm_mesh;
+
+/* Makes and destroys the cuFFT plans of a mesh (see grav_pp_offload.cu) */
+extern void pm_mesh_fft_plan(const int N, int *plan_r2c, int *plan_c2r);
+extern void pm_mesh_fft_destroy(const int plan_r2c, const int plan_c2r);
+
+/* CIC assignment of the gparts to the device mesh (see grav_pp_offload.cu) */
+extern void pm_mesh_assign_offload(struct cuda_pm_mesh *m, const size_t nr_gparts, const double fac, const double *dim);
+
+/* Rest of the PM calculation on the device mesh (see grav_pp_offload.cu) */
+extern void pm_mesh_solve_offload(struct cuda_pm_mesh *m, const size_t nr_gparts, const double fac, const double *dim, const double green_fac, const double a_smooth2, const double k_fac);
+
+#ifdef WITH_CUDA
+
+/**
+ * @brief Allocate one device array of the #cuda_pm_mesh.
+ *
+ * @param ptr (return) The device pointer.
+ * @param size The number of bytes to allocate.
+ */
+static void cuda_pm_mesh_alloc_device(void **ptr, const size_t size) {
+
+  const cudaError_t err = cudaMalloc(ptr, size);
+  if (err != cudaSuccess)
+    error("Couldn't allocate device PM mesh (%zd bytes): %s", size,
+          cudaGetErrorString(err));
+}
+
+/**
+ * @brief Allocate one host array of the #cuda_pm_mesh.
+ *
+ * @param ptr (return) The host pointer.
+ * @param size The number of bytes to allocate.
+ */
+static void cuda_pm_mesh_alloc_host(void **ptr, const size_t size) {
+
+  /* Page-locked such that the copies are fast */
+  const cudaError_t err = cudaHostAlloc(ptr, size, cudaHostAllocPortable);
+  if (err != cudaSuccess)
+    error("Couldn't allocate host PM mesh arrays (%zd bytes): %s", size,
+          cudaGetErrorString(err));
+}
+
+#endif /* WITH_CUDA */
+
+/**
+ * @brief Initialise the (empty) #cuda_pm_mesh.
+ *
+ * @param active Are we going to compute the mesh forces on the GPU?
+ */
+void cuda_pm_mesh_init(const int active) {
+
+  bzero(&gpu_pm_mesh, sizeof(struct cuda_pm_mesh));
+  gpu_pm_mesh.active = active;
+}
+
+/**
+ * @brief Free the #gpart arrays of the #cuda_pm_mesh.
+ *
+ * @param m The #cuda_pm_mesh.
+ */
+static void cuda_pm_mesh_free_gparts(struct cuda_pm_mesh *m) {
+
+#ifdef WITH_CUDA
+  if (m->size > 0) {
+    cudaFreeHost(m->x);
+    cudaFreeHost(m->y);
+    cudaFreeHost(m->z);
+    cudaFreeHost(m->m);
+    cudaFreeHost(m->a_x);
+    cudaFreeHost(m->a_y);
+    cudaFreeHost(m->a_z);
+    cudaFreeHost(m->pot);
+    cudaFree(m->d_x);
+    cudaFree(m->d_y);
+    cudaFree(m->d_z);
+    cudaFree(m->d_m);
+    cudaFree(m->d_a_x);
+    cudaFree(m->d_a_y);
+    cudaFree(m->d_a_z);
+    cudaFree(m->d_pot);
+  }
+#endif
+  m->size = 0;
+}
+
+/**
+ * @brief Free the mesh and FFT plans of the #cuda_pm_mesh.
+ *
+ * @param m The #cuda_pm_mesh.
+ */
+static void cuda_pm_mesh_free_mesh(struct cuda_pm_mesh *m) {
+
+#ifdef WITH_CUDA
+  if (m->N > 0) {
+    cudaFree(m->d_rho);
+    pm_mesh_fft_destroy(m->plan_r2c, m->plan_c2r);
+  }
+#endif
+  m->d_rho = NULL;
+  m->N = 0;
+}
+
+/**
+ * @brief Free all the memory of the #cuda_pm_mesh.
+ */
+void cuda_pm_mesh_clean(void) {
+
+  struct cuda_pm_mesh *m = &gpu_pm_mesh;
+  cuda_pm_mesh_free_gparts(m);
+  cuda_pm_mesh_free_mesh(m);
+}
+
+#ifdef WITH_CUDA
+
+/**
+ * @brief Make sure the #cuda_pm_mesh can hold a given mesh and number of
+ * #gpart.
+ *
+ * @param m The #cuda_pm_mesh.
+ * @param N The side-length of the mesh.
+ * @param nr_gparts The number of #gpart in the #space.
+ */
+static void cuda_pm_mesh_ensure(struct cuda_pm_mesh *m, const int N,
+                                const size_t nr_gparts) {
+
+  if (N != m->N) {
+    cuda_pm_mesh_free_mesh(m);
+    const size_t sizeMesh =
+        (size_t)N * (size_t)N * (size_t)(2 * (N / 2 + 1)) * sizeof(double);
+    cuda_pm_mesh_alloc_device((void **)&m->d_rho, sizeMesh);
+    pm_mesh_fft_plan(N, &m->plan_r2c, &m->plan_c2r);
+    m->N = N;
+  }
+
+  /* Leave some head-room for the next steps */
+  if (nr_gparts > m->size) {
+    cuda_pm_mesh_free_gparts(m);
+    const size_t size = nr_gparts + nr_gparts / 10 + 1;
+    const size_t sizeD = size * sizeof(double);
+    const size_t sizeF = size * sizeof(float);
+    cuda_pm_mesh_alloc_host((void **)&m->x, sizeD);
+    cuda_pm_mesh_alloc_host((void **)&m->y, sizeD);
+    cuda_pm_mesh_alloc_host((void **)&m->z, sizeD);
+    cuda_pm_mesh_alloc_host((void **)&m->m, sizeD);
+    cuda_pm_mesh_alloc_host((void **)&m->a_x, sizeF);
+    cuda_pm_mesh_alloc_host((void **)&m->a_y, sizeF);
+    cuda_pm_mesh_alloc_host((void **)&m->a_z, sizeF);
+    cuda_pm_mesh_alloc_host((void **)&m->pot, sizeF);
+    cuda_pm_mesh_alloc_device((void **)&m->d_x, sizeD);
+    cuda_pm_mesh_alloc_device((void **)&m->d_y, sizeD);
+    cuda_pm_mesh_alloc_device((void **)&m->d_z, sizeD);
+    cuda_pm_mesh_alloc_device((void **)&m->d_m, sizeD);
+    cuda_pm_mesh_alloc_device((void **)&m->d_a_x, sizeF);
+    cuda_pm_mesh_alloc_device((void **)&m->d_a_y, sizeF);
+    cuda_pm_mesh_alloc_device((void **)&m->d_a_z, sizeF);
+    cuda_pm_mesh_alloc_device((void **)&m->d_pot, sizeF);
+    m->size = size;
+  }
+}
+
+/**
+ * @brief What the #cuda_pm_mesh mappers need to know.
+ */
+struct cuda_pm_mesh_data {
+
+  /*! The #space. */
+  const struct space *s;
+
+  /*! The neutrino constants (delta-f weighting only). */
+  const struct neutrino_model *nu_model;
+
+  /*! Newton's constant. */
+  float const_G;
+};
+
+/**
+ * @brief #threadpool mapper function copying the #gpart to the SoA arrays
+ * of the #cuda_pm_mesh.
+ *
+ * @param map_data The #gpart.
+ * @param num_elements The number of #gpart.
+ * @param extra_data The #cuda_pm_mesh_data.
+ */
+static void cuda_pm_mesh_gparts_mapper(void *map_data, int num_elements,
+                                       void *extra_data) {
+
+  const struct cuda_pm_mesh_data *data =
+      (const struct cuda_pm_mesh_data *)extra_data;
+  const struct gpart *gparts = (const struct gpart *)map_data;
+  const size_t offset = gparts - data->s->gparts;
+  struct cuda_pm_mesh *m = &gpu_pm_mesh;
+
+  for (int k = 0; k < num_elements; ++k) {
+    const struct gpart *gp = &gparts[k];
+    const size_t i = offset + k;
+
+    m->x[i] = gp->x[0];
+    m->y[i] = gp->x[1];
+    m->z[i] = gp->x[2];
+
+    if (gp->time_bin == time_bin_inhibited) {
+      m->m[i] = 0.;
+      continue;
+    }
+
+    /* Compute weight (for neutrino delta-f weighting) */
+    double weight = 1.0;
+    if (gp->type == swift_type_neutrino)
+      gpart_neutrino_weight_mesh_only(gp, data->nu_model, &weight);
+
+    m->m[i] = gp->mass * weight;
+  }
+}
+
+/**
+ * @brief #threadpool mapper function copying the mesh accelerations and
+ * potentials computed by the GPU to the #gpart.
+ *
+ * Applies the same operations in the same order as
+ * mesh_to_gpart_CIC_mapper().
+ *
+ * @param map_data The #gpart.
+ * @param num_elements The number of #gpart.
+ * @param extra_data The #cuda_pm_mesh_data.
+ */
+static void cuda_pm_mesh_write_back_mapper(void *map_data, int num_elements,
+                                           void *extra_data) {
+
+  const struct cuda_pm_mesh_data *data =
+      (const struct cuda_pm_mesh_data *)extra_data;
+  struct gpart *gparts = (struct gpart *)map_data;
+  const size_t offset = gparts - data->s->gparts;
+  const struct cuda_pm_mesh *m = &gpu_pm_mesh;
+  const float const_G = data->const_G;
+
+  for (int k = 0; k < num_elements; ++k) {
+    struct gpart *gp = &gparts[k];
+    const size_t i = offset + k;
+
+    if (gp->time_bin == time_bin_inhibited) continue;
+
+    gp->a_grav_mesh[0] = m->a_x[i];
+    gp->a_grav_mesh[1] = m->a_y[i];
+    gp->a_grav_mesh[2] = m->a_z[i];
+#ifndef SWIFT_GRAVITY_NO_POTENTIAL
+    gp->potential_mesh = 0.f;
+#endif
+    gravity_add_comoving_mesh_potential(gp, m->pot[i]);
+
+    gp->a_grav_mesh[0] *= const_G;
+    gp->a_grav_mesh[1] *= const_G;
+    gp->a_grav_mesh[2] *= const_G;
+#ifndef SWIFT_GRAVITY_NO_POTENTIAL
+    gp->potential_mesh *= const_G;
+#endif
+  }
+}
+
+#endif /* WITH_CUDA */
+
+/**
+ * @brief Compute the mesh forces and potential of all the local #gpart on
+ * the GPU.
+ *
+ * Device version of the global (non-distributed) mesh calculation of
+ * mesh_gravity.c: the same CIC assignment, Green function (with the CIC
+ * deconvolution) and 5-point-stencil CIC interpolation, with cuFFT doing
+ * the transforms. Over MPI the density is summed over the ranks on the
+ * host between the assignment and the transforms.
+ *
+ * Must be called when no task is running.
+ *
+ * @param mesh The #pm_mesh.
+ * @param s The #space containing the particles.
+ * @param tp The #threadpool object used for the host-side copies.
+ * @param verbose Are we talkative?
+ */
+void cuda_pm_mesh_compute(struct pm_mesh *mesh, const struct space *s,
+                          struct threadpool *tp, const int verbose) {
+
+#ifdef WITH_CUDA
+  struct cuda_pm_mesh *m = &gpu_pm_mesh;
+  const int N = mesh->N;
+  const double box_size = s->dim[0];
+  const double dim[3] = {s->dim[0], s->dim[1], s->dim[2]};
+  const double cell_fac = N / box_size;
+  const size_t nr_gparts = s->nr_gparts;
+
+  cuda_pm_mesh_ensure(m, N, nr_gparts);
+
+  ticks tic = getticks();
+
+  /* Gather some neutrino constants if using delta-f weighting on the mesh */
+  struct neutrino_model nu_model;
+  bzero(&nu_model, sizeof(struct neutrino_model));
+  if (s->e->neutrino_properties->use_delta_f_mesh_only)
+    gather_neutrino_consts(s, &nu_model);
+
+  struct cuda_pm_mesh_data data;
+  data.s = s;
+  data.nu_model = &nu_model;
+  data.const_G = s->e->physical_constants->const_newton_G;
+
+  /* The particles, in SoA form */
+  if (nr_gparts > 0)
+    threadpool_map(tp, cuda_pm_mesh_gparts_mapper, s->gparts, nr_gparts,
+                   sizeof(struct gpart), threadpool_auto_chunk_size, &data);
+
+  /* CIC assignment on the device */
+  pm_mesh_assign_offload(m, nr_gparts, cell_fac, dim);
+
+  if (verbose)
+    message("GPU gpart assignment took %.3f %s.",
+            clocks_from_ticks(getticks() - tic), clocks_getunit());
+
+#ifdef WITH_MPI
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  tic = getticks();
+
+  /* Merge everybody's share of the density mesh, using the host mesh as
+   * buffer (the device one is padded along z) */
+  double *rho = mesh->potential_global;
+  const size_t pitch = 2 * (N / 2 + 1) * sizeof(double);
+  const size_t row = N * sizeof(double);
+  cudaError_t err = cudaMemcpy2D(rho, row, m->d_rho, pitch, row,
+                                 (size_t)N * N, cudaMemcpyDeviceToHost);
+  if (err != cudaSuccess)
+    error("Failed to fetch the device density mesh: %s",
+          cudaGetErrorString(err));
+
+  MPI_Allreduce(MPI_IN_PLACE, rho, N * N * N, MPI_DOUBLE, MPI_SUM,
+                MPI_COMM_WORLD);
+
+  err = cudaMemcpy2D(m->d_rho, pitch, rho, row, row, (size_t)N * N,
+                     cudaMemcpyHostToDevice);
+  if (err != cudaSuccess)
+    error("Failed to send the density mesh to the device: %s",
+          cudaGetErrorString(err));
+
+  if (verbose)
+    message("Mesh MPI-reduction took %.3f %s.",
+            clocks_from_ticks(getticks() - tic), clocks_getunit());
+#endif
+
+  tic = getticks();
+
+  /* Transforms, Green function and interpolation on the device */
+  const double green_fac = -1. / (M_PI * box_size);
+  const double a_smooth2 =
+      4. * M_PI * M_PI * mesh->r_s * mesh->r_s / (box_size * box_size);
+  const double k_fac = M_PI / (double)N;
+  pm_mesh_solve_offload(m, nr_gparts, cell_fac, dim, green_fac, a_smooth2,
+                        k_fac);
+
+  if (verbose)
+    message("GPU FFTs, Green function and interpolation took %.3f %s.",
+            clocks_from_ticks(getticks() - tic), clocks_getunit());
+
+  tic = getticks();
+
+  /* And copy the results to the particles */
+  if (nr_gparts > 0)
+    threadpool_map(tp, cuda_pm_mesh_write_back_mapper, s->gparts, nr_gparts,
+                   sizeof(struct gpart), threadpool_auto_chunk_size, &data);
+
+  if (verbose)
+    message("Copying the GPU mesh accelerations took %.3f %s.",
+            clocks_from_ticks(getticks() - tic), clocks_getunit());
+#else
+  error("SWIFT was not compiled with CUDA support.");
+#endif
+}
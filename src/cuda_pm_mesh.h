@@ -0,0 +1,63 @@
+#ifndef SWIFT_CUDA_PM_MESH_H
+#define SWIFT_CUDA_PM_MESH_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* System includes. */
+#include <stddef.h>
+
+/* Forward declarations */
+struct pm_mesh;
+struct space;
+struct threadpool;
+
+/**
+ * @brief Everything the GPU needs to compute the long-range PM forces of
+ * a global (non-distributed) mesh on the device: CIC assignment, forward
+ * FFT, Green function, inverse FFT and CIC interpolation of the potential
+ * and accelerations back to the #gpart.
+ *
+ * The mesh lives on the device in the padded layout of an in-place cuFFT
+ * real-to-complex transform, i.e. N x N x 2(N/2+1) doubles. The #gpart are
+ * sent and their results brought back as SoA through page-locked arrays.
+ */
+struct cuda_pm_mesh {
+
+  /*! Host and device copies of the #gpart positions. */
+  double *x, *y, *z, *d_x, *d_y, *d_z;
+
+  /*! Host and device copies of the #gpart masses (including the neutrino
+   * weights; 0 for the inhibited ones). */
+  double *m, *d_m;
+
+  /*! Host and device copies of the mesh accelerations and potentials. */
+  float *a_x, *a_y, *a_z, *pot, *d_a_x, *d_a_y, *d_a_z, *d_pot;
+
+  /*! The mesh on the device (density, then its transform, then the
+   * potential). */
+  double *d_rho;
+
+  /*! The cuFFT plans (cufftHandle) of the forward and inverse transforms. */
+  int plan_r2c, plan_c2r;
+
+  /*! Side-length of the mesh the plans and d_rho were made for. */
+  int N;
+
+  /*! Number of #gpart we have room for. */
+  size_t size;
+
+  /*! Are we computing the mesh forces on the GPU at all? */
+  int active;
+};
+
+/* The one instance, driven by the main thread */
+extern struct cuda_pm_mesh gpu_pm_mesh;
+
+/* Function prototypes. */
+void cuda_pm_mesh_init(const int active);
+void cuda_pm_mesh_clean(void);
+void cuda_pm_mesh_compute(struct pm_mesh *mesh, const struct space *s,
+                          struct threadpool *tp, const int verbose);
+
+#endif /* SWIFT_CUDA_PM_MESH_H */
@@ -0,0 +1,122 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "cuda_power_spectrum.h"
+
+/* System includes. */
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WITH_CUDA
+/* CUDA headers. */
+#include <cuda_runtime.h>
+#endif
+
+/* Local headers. */
+#include "cuda_pm_mesh.h"
+#include "error.h"
+
+/*! The one instance, driven by the main thread */
+struct cuda_power_spectrum gpu_power_spectrum;
+
+/* Makes and destroys the cuFFT plan of a grid (see grav_pp_offload.cu) */
+extern void power_spectrum_fft_plan(const int N, int *plan_r2c);
+extern void power_spectrum_fft_destroy(const int plan_r2c);
+
+/* In-place forward FFT of a grid on the device (see grav_pp_offload.cu) */
+extern void power_spectrum_fft_offload(const int plan_r2c, double *d_grid,
+                                       double *grid, const int N);
+
+/**
+ * @brief Initialise the (empty) #cuda_power_spectrum.
+ *
+ * @param active Are we going to do the power spectrum FFTs on the GPU?
+ */
+void cuda_power_spectrum_init(const int active) {
+
+  bzero(&gpu_power_spectrum, sizeof(struct cuda_power_spectrum));
+  gpu_power_spectrum.active = active;
+}
+
+/**
+ * @brief Free all the memory of the #cuda_power_spectrum.
+ */
+void cuda_power_spectrum_clean(void) {
+
+  struct cuda_power_spectrum *p = &gpu_power_spectrum;
+
+#ifdef WITH_CUDA
+  if (p->N > 0) {
+    cudaFree(p->d_grid);
+    power_spectrum_fft_destroy(p->plan_r2c);
+  }
+#endif
+  p->d_grid = NULL;
+  p->N = 0;
+}
+
+#ifdef WITH_CUDA
+
+/**
+ * @brief Make sure the #cuda_power_spectrum has a grid and plan of a given
+ * side-length.
+ *
+ * @param p The #cuda_power_spectrum.
+ * @param N The side-length of the grid.
+ */
+static void cuda_power_spectrum_ensure(struct cuda_power_spectrum *p,
+                                       const int N) {
+
+  if (N != p->N) {
+    cuda_power_spectrum_clean();
+    const size_t sizeGrid =
+        (size_t)N * (size_t)N * (size_t)(2 * (N / 2 + 1)) * sizeof(double);
+    const cudaError_t err = cudaMalloc((void **)&p->d_grid, sizeGrid);
+    if (err != cudaSuccess)
+      error("Couldn't allocate device power spectrum grid (%zd bytes): %s",
+            sizeGrid, cudaGetErrorString(err));
+    power_spectrum_fft_plan(N, &p->plan_r2c);
+    p->N = N;
+  }
+}
+
+#endif /* WITH_CUDA */
+
+/**
+ * @brief Do the in-place real-to-complex FFT of a power spectrum grid on the
+ * GPU.
+ *
+ * The grid is sent, transformed and brought back in the padded layout used
+ * by FFTW on the host, so the result is the same as that of
+ * fftw_execute_dft_r2c() on it. The mesh and plan of the #cuda_pm_mesh are
+ * used when they are of the right size, since the PM mesh is re-assigned
+ * from scratch at every mesh step anyway.
+ *
+ * @param grid The padded grid on the host (N x N x (N+2) doubles).
+ * @param N The side-length of the grid.
+ *
+ * @return 1 if the FFT was done, 0 if it has to be done on the CPU.
+ */
+int cuda_power_spectrum_fft(double *grid, const int N) {
+
+  struct cuda_power_spectrum *p = &gpu_power_spectrum;
+
+  /* The padding of the host grid only matches cuFFT's for even sizes */
+  if (!p->active || N % 2 != 0) return 0;
+
+#ifdef WITH_CUDA
+  if (gpu_pm_mesh.active && gpu_pm_mesh.N == N) {
+    power_spectrum_fft_offload(gpu_pm_mesh.plan_r2c, gpu_pm_mesh.d_rho, grid,
+                               N);
+  } else {
+    cuda_power_spectrum_ensure(p, N);
+    power_spectrum_fft_offload(p->plan_r2c, p->d_grid, grid, N);
+  }
+
+  return 1;
+#else
+  error("SWIFT was not compiled with CUDA support.");
+  return 0;
+#endif
+}
@@ -0,0 +1,40 @@
+#ifndef SWIFT_CUDA_POWER_SPECTRUM_H
+#define SWIFT_CUDA_POWER_SPECTRUM_H
+
+/* Config parameters. */
+#include <config.h>
+
+/**
+ * @brief Everything the GPU needs to do the forward FFTs of the power
+ * spectrum grids.
+ *
+ * The (folded) grids are assigned and reduced onto rank 0 as usual and only
+ * their real-to-complex transforms are done on the device, in the padded
+ * layout of an in-place cuFFT transform, i.e. N x N x 2(N/2+1) doubles.
+ * When the PM mesh is also on the GPU and has the same side-length, its
+ * device mesh and forward plan are used instead of making a second set.
+ */
+struct cuda_power_spectrum {
+
+  /*! The grid on the device (density contrast, then its transform). */
+  double *d_grid;
+
+  /*! The cuFFT plan (cufftHandle) of the forward transform. */
+  int plan_r2c;
+
+  /*! Side-length of the grid the plan and d_grid were made for. */
+  int N;
+
+  /*! Are we doing the power spectrum transforms on the GPU at all? */
+  int active;
+};
+
+/* The one instance, driven by the main thread */
+extern struct cuda_power_spectrum gpu_power_spectrum;
+
+/* Function prototypes. */
+void cuda_power_spectrum_init(const int active);
+void cuda_power_spectrum_clean(void);
+int cuda_power_spectrum_fft(double *grid, const int N);
+
+#endif /* SWIFT_CUDA_POWER_SPECTRUM_H */
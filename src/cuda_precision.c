@@ -0,0 +1,44 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "cuda_precision.h"
+
+/* System includes. */
+#include <string.h>
+
+/* Local headers. */
+#include "error.h"
+
+/*! The mode of the GPU P2P kernels. */
+enum cuda_precision gpu_precision = cuda_precision_strict;
+
+/*! Names of the modes as used in the parameter file. */
+static const char *cuda_precision_names[cuda_precision_count] = {
+    "strict", "fma", "mixed"};
+
+/**
+ * @brief Set the mode of the GPU P2P kernels from its name.
+ *
+ * @param name One of "strict", "fma" or "mixed".
+ */
+void cuda_precision_init(const char *name) {
+
+  for (int k = 0; k < cuda_precision_count; ++k) {
+    if (strcmp(name, cuda_precision_names[k]) == 0) {
+      gpu_precision = (enum cuda_precision)k;
+      return;
+    }
+  }
+  error("Unknown GPU precision mode '%s' (use strict, fma or mixed).", name);
+}
+
+/**
+ * @brief The name of a mode of the GPU P2P kernels.
+ *
+ * @param mode The #cuda_precision.
+ */
+const char *cuda_precision_name(const enum cuda_precision mode) {
+
+  return cuda_precision_names[mode];
+}
@@ -0,0 +1,35 @@
+#ifndef SWIFT_CUDA_PRECISION_H
+#define SWIFT_CUDA_PRECISION_H
+
+/* Config parameters. */
+#include <config.h>
+
+/**
+ * @brief The floating-point modes of the GPU P2P kernels.
+ *
+ * The device code is built with -fmad=false such that, in the strict mode,
+ * every product and sum is rounded on its own as on the CPU. The other modes
+ * explicitly fuse the multiply-adds of the interaction loops.
+ */
+enum cuda_precision {
+
+  /*! Separately rounded operations, same results as the CPU. */
+  cuda_precision_strict = 0,
+
+  /*! Fused multiply-adds in the interaction loops. */
+  cuda_precision_fma,
+
+  /*! Fused multiply-adds and compensated (Kahan) accumulators. */
+  cuda_precision_mixed,
+
+  /*! Number of modes. */
+  cuda_precision_count
+};
+
+extern enum cuda_precision gpu_precision;
+
+/* Function prototypes. */
+void cuda_precision_init(const char *name);
+const char *cuda_precision_name(const enum cuda_precision mode);
+
+#endif /* SWIFT_CUDA_PRECISION_H */
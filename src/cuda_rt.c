@@ -0,0 +1,216 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "cuda_rt.h"
+
+/* System includes. */
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WITH_CUDA
+/* CUDA headers. */
+#include <cuda_runtime.h>
+#endif
+
+/* Local headers. */
+#include "cuda_devices.h"
+#include "cuda_streams.h"
+#include "engine.h"
+#include "error.h"
+#include "rt.h"
+#include "runner.h"
+
+/*! The one instance */
+struct cuda_rt gpu_rt;
+
+/* Solves the explicit thermochemistry problems of a cache on the device (see
+ * grav_pp_offload.cu) */
+extern void rt_tchem_offload(struct cuda_rt_cache *c,
+                             const struct cuda_rt_params *params,
+                             cudaStream_t stream);
+
+/**
+ * @brief Initialise the #cuda_rt.
+ *
+ * @param active Are we going to do the thermochemistry on the GPU?
+ * @param min_count Number of #part below which the leaf cells stay on the
+ * CPU.
+ * @param rt_props The properties of the RT scheme.
+ */
+void cuda_rt_init(const int active, const int min_count,
+                  const struct rt_props *rt_props) {
+
+  bzero(&gpu_rt, sizeof(struct cuda_rt));
+
+#ifdef CUDA_RT_TCHEM
+  gpu_rt.active = active && !rt_props->skip_thermochemistry;
+  gpu_rt.min_count = min_count;
+
+  /* The device relies on the order of the species */
+  if ((int)rt_species_count != (int)cuda_rt_nr_species ||
+      (int)rt_sp_HI != (int)cuda_rt_sp_HI ||
+      (int)rt_sp_HeIII != (int)cuda_rt_sp_HeIII)
+    error("The species of the GPU thermochemistry do not match SPHM1RT.");
+
+  struct cuda_rt_params *params = &gpu_rt.params;
+  params->onthespot = rt_props->onthespot;
+  params->useparams = rt_props->useparams;
+  params->alphaA_cgs_H = rt_props->alphaA_cgs_H;
+  params->alphaB_cgs_H = rt_props->alphaB_cgs_H;
+  params->beta_cgs_H = rt_props->beta_cgs_H;
+  for (int i = 0; i < 3; i++)
+    params->sigma_cross_cgs_H[i] = rt_props->sigma_cross_cgs_H[i];
+#else
+  if (active)
+    message(
+        "The thermochemistry of this RT scheme cannot run on the GPU. "
+        "Ignoring Scheduler:gpu_rt_tchem.");
+#endif
+}
+
+/**
+ * @brief Free the memory of a #cuda_rt_cache.
+ *
+ * @param c The #cuda_rt_cache.
+ */
+void cuda_rt_cache_clean(struct cuda_rt_cache *c) {
+
+  if (c->size > 0) {
+#ifdef CUDA_RT_TCHEM
+    cudaFreeHost(c->tchem);
+    cudaFree(c->d_tchem);
+#endif
+    free(c->p);
+    free(c->xp);
+    free(c->dt);
+  }
+  bzero(c, sizeof(struct cuda_rt_cache));
+}
+
+#ifdef CUDA_RT_TCHEM
+
+/**
+ * @brief Make sure a #cuda_rt_cache can hold a given number of #part.
+ *
+ * The content is kept.
+ *
+ * @param c The #cuda_rt_cache.
+ * @param count The number of #part we need room for.
+ */
+static void cuda_rt_cache_ensure(struct cuda_rt_cache *c, const int count) {
+
+  if (count <= c->size) return;
+
+  /* Leave some head-room for the next cells */
+  const int size = count + count / 10 + 1;
+  const size_t sizeT = size * sizeof(struct cuda_rt_tchem);
+
+  /* Page-locked such that the copies are fast */
+  struct cuda_rt_tchem *tchem = NULL;
+  cudaError_t err =
+      cudaHostAlloc((void **)&tchem, sizeT, cudaHostAllocPortable);
+  if (err != cudaSuccess)
+    error("Couldn't allocate host RT cache (%zd bytes): %s", sizeT,
+          cudaGetErrorString(err));
+  struct cuda_rt_tchem *d_tchem = NULL;
+  err = cudaMalloc((void **)&d_tchem, sizeT);
+  if (err != cudaSuccess)
+    error("Couldn't allocate device RT cache (%zd bytes): %s", sizeT,
+          cudaGetErrorString(err));
+
+  if (c->size > 0) {
+    memcpy(tchem, c->tchem, c->count * sizeof(struct cuda_rt_tchem));
+    cudaFreeHost(c->tchem);
+    cudaFree(c->d_tchem);
+  }
+  c->tchem = tchem;
+  c->d_tchem = d_tchem;
+
+  c->p = (struct part **)realloc(c->p, size * sizeof(struct part *));
+  c->xp = (struct xpart **)realloc(c->xp, size * sizeof(struct xpart *));
+  c->dt = (double *)realloc(c->dt, size * sizeof(double));
+  if (c->p == NULL || c->xp == NULL || c->dt == NULL)
+    error("Couldn't allocate the RT cache.");
+
+  c->size = size;
+}
+
+#endif /* CUDA_RT_TCHEM */
+
+/**
+ * @brief Does the thermochemistry of a leaf cell go to the GPU?
+ *
+ * @param count The number of #part in the cell.
+ */
+int cuda_rt_tchem_on_gpu(const int count) {
+
+#ifdef CUDA_RT_TCHEM
+  return gpu_rt.active && count >= gpu_rt.min_count;
+#else
+  return 0;
+#endif
+}
+
+/**
+ * @brief Queue the thermochemistry of a #part for the GPU.
+ *
+ * Nothing is changed in the #part until cuda_rt_tchem_flush().
+ *
+ * @param r The #runner.
+ * @param p The #part.
+ * @param xp Its #xpart.
+ * @param dt The time-step of the #part.
+ */
+void cuda_rt_tchem_add(struct runner *r, struct part *p, struct xpart *xp,
+                       const double dt) {
+
+#ifdef CUDA_RT_TCHEM
+  const struct engine *e = r->e;
+  struct cuda_rt_cache *c = &r->cuda_rt_cache;
+
+  cuda_rt_cache_ensure(c, c->count + 1);
+  if (!rt_tchem_pack_explicit(p, xp, e->rt_props, e->cosmology,
+                              e->hydro_properties, e->physical_constants,
+                              e->internal_units, dt, &c->tchem[c->count]))
+    return;
+
+  c->p[c->count] = p;
+  c->xp[c->count] = xp;
+  c->dt[c->count] = dt;
+  c->count++;
+#else
+  error("No thermochemistry on the GPU for this RT scheme.");
+#endif
+}
+
+/**
+ * @brief Solve the thermochemistry of the queued #part.
+ *
+ * The explicit solutions come from the device. The #part for which they are
+ * not accurate enough then go through the implicit solver on the CPU.
+ *
+ * @param r The #runner.
+ */
+void cuda_rt_tchem_flush(struct runner *r) {
+
+#ifdef CUDA_RT_TCHEM
+  const struct engine *e = r->e;
+  struct cuda_rt_cache *c = &r->cuda_rt_cache;
+
+  if (c->count == 0) return;
+
+  const ticks tic_gpu = getticks();
+  rt_tchem_offload(c, &gpu_rt.params, get_runner_cuda_stream(r->id));
+  cuda_device_load_add(&r->gpu_load, (double)c->count, getticks() - tic_gpu);
+
+  for (int k = 0; k < c->count; k++)
+    rt_tchem_with_explicit(c->p[k], c->xp[k], e->rt_props, e->cosmology,
+                           e->hydro_properties, e->physical_constants,
+                           e->internal_units, c->dt[k], &c->tchem[k]);
+
+  c->count = 0;
+#else
+  error("No thermochemistry on the GPU for this RT scheme.");
+#endif
+}
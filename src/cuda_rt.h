@@ -0,0 +1,131 @@
+#ifndef SWIFT_CUDA_RT_H
+#define SWIFT_CUDA_RT_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* Forward declarations */
+struct part;
+struct runner;
+struct rt_props;
+struct xpart;
+
+/* Only the explicit SPHM1RT thermochemistry has a device version. The GEAR
+ * one is done by GRACKLE, which has none. */
+#if defined(WITH_CUDA) && defined(RT_SPHM1RT)
+#define CUDA_RT_TCHEM
+#endif
+
+/**
+ * @brief The species of the SPHM1RT network, in the order of its
+ * #rt_cooling_species.
+ */
+enum cuda_rt_species {
+  cuda_rt_sp_elec = 0,
+  cuda_rt_sp_HI,
+  cuda_rt_sp_HII,
+  cuda_rt_sp_HeI,
+  cuda_rt_sp_HeII,
+  cuda_rt_sp_HeIII,
+  cuda_rt_nr_species
+};
+
+/**
+ * @brief The explicit thermochemistry problem of one #part and its solution.
+ *
+ * Filled by rt_tchem_pack_explicit() before going to the device and read by
+ * rt_tchem_with_explicit() when back.
+ */
+struct cuda_rt_tchem {
+
+  /*! Temperature, hydrogen number density, (reduced) speed of light,
+   * time-step, density and internal energy and its floor (all CGS). */
+  double T_cgs, n_H_cgs, cred_cgs, dt_cgs, rho_cgs, u_cgs, u_min_cgs;
+
+  /*! Abundances of the species, in n_i/n_H. */
+  double abundances[cuda_rt_nr_species];
+
+  /*! Photon density of the three ionizing groups (CGS). */
+  double ngamma_cgs[3];
+
+  /*! The explicit solution: new internal energy (CGS), abundances and
+   * photon densities (CGS). */
+  double u_new_cgs, new_abundances[cuda_rt_nr_species], new_ngamma_cgs[3];
+
+  /*! Maximal relative change of all the variables over the step. */
+  double max_relative_change;
+};
+
+/**
+ * @brief The switches and constant coefficients of the thermochemistry, as
+ * passed to the device.
+ */
+struct cuda_rt_params {
+
+  /*! Use the on the spot approximation? */
+  int onthespot;
+
+  /*! Use the hydrogen coefficients of the parameter file rather than the
+   * ones computed from the temperature? */
+  int useparams;
+
+  /*! Case A and B recombination, and collisional ionization, coefficients
+   * of hydrogen (CGS, useparams only). */
+  double alphaA_cgs_H, alphaB_cgs_H, beta_cgs_H;
+
+  /*! Cross sections of the ionizing photons for hydrogen (CGS, useparams
+   * only). */
+  double sigma_cross_cgs_H[3];
+};
+
+/**
+ * @brief The #part of one leaf cell waiting for their thermochemistry.
+ *
+ * Each runner owns one of these. The arrays only grow, such that the
+ * allocators are not hit for every task.
+ */
+struct cuda_rt_cache {
+
+  /*! Host (page-locked) and device copies of the problems. */
+  struct cuda_rt_tchem *tchem, *d_tchem;
+
+  /*! The #part, #xpart and time-steps the problems are those of. */
+  struct part **p;
+  struct xpart **xp;
+  double *dt;
+
+  /*! Number of #part in the cache. */
+  int count;
+
+  /*! Number of #part we have room for. */
+  int size;
+};
+
+/**
+ * @brief What drives the thermochemistry on the GPU.
+ */
+struct cuda_rt {
+
+  /*! The constants of the solver. */
+  struct cuda_rt_params params;
+
+  /*! Number of #part below which the leaf cells stay on the CPU. */
+  int min_count;
+
+  /*! Are we doing the thermochemistry on the GPU at all? */
+  int active;
+};
+
+/* The one instance */
+extern struct cuda_rt gpu_rt;
+
+/* Function prototypes. */
+void cuda_rt_init(const int active, const int min_count,
+                  const struct rt_props *rt_props);
+void cuda_rt_cache_clean(struct cuda_rt_cache *c);
+int cuda_rt_tchem_on_gpu(const int count);
+void cuda_rt_tchem_add(struct runner *r, struct part *p, struct xpart *xp,
+                       const double dt);
+void cuda_rt_tchem_flush(struct runner *r);
+
+#endif /* SWIFT_CUDA_RT_H */
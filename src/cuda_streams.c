@@ -1,9 +1,12 @@
 /* This includes */
 #include "cuda_streams.h"
+#include "cuda_devices.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "error.h"
+
 /* Define the global singleton instance */
 struct cuda_streams *streams = NULL;
 
@@ -15,10 +18,15 @@ struct cuda_streams *streams = NULL;
  *
  * These must be destroyed with destroy_persistent_cuda_streams() when done.
  *
- * @param num_streams The number of CUDA streams to create.
+ * The streams are split evenly between the devices in #gpu_devices, the
+ * first ones on device 0, the next ones on device 1, etc.
+ *
+ * @param num_streams The number of CUDA streams to create (a multiple of the
+ * number of devices).
  * @return The number of streams created.
  */
 int engine_cuda_init_streams(int num_streams) {
+#ifdef WITH_CUDA
   if (streams == NULL) {
     // Allocate memory for the singleton structure
     streams = (struct cuda_streams *)malloc(sizeof(struct cuda_streams));
@@ -27,7 +35,9 @@ int engine_cuda_init_streams(int num_streams) {
               "Failed to allocate memory for CUDA streams singleton.\n");
       return 0;
     }
+    streams->streams = NULL;
     streams->nstreams = 0;
+    streams->ndevices = 0;
   }
 
   /* Check if the streams have already been created */
@@ -37,8 +47,17 @@ int engine_cuda_init_streams(int num_streams) {
   }
 
   /* Allocate and initialize an array of CUDA streams */
+  streams->streams = (cudaStream_t *)malloc(num_streams * sizeof(cudaStream_t));
+  if (streams->streams == NULL) {
+    fprintf(stderr, "Failed to allocate memory for %d CUDA streams.\n",
+            num_streams);
+    return 0;
+  }
+  const int ndevices = gpu_devices.count > 1 ? gpu_devices.count : 1;
+  const int per_device = num_streams / ndevices;
   int i;
-  for (i = 0; i < num_streams && i < MAX_STREAMS; i++) {
+  for (i = 0; i < num_streams; i++) {
+    if (ndevices > 1 && i % per_device == 0) cudaSetDevice(i / per_device);
     cudaError_t err =
         cudaStreamCreateWithFlags(&streams->streams[i], cudaStreamNonBlocking);
     if (err != cudaSuccess) {
@@ -47,15 +66,25 @@ int engine_cuda_init_streams(int num_streams) {
       for (int j = 0; j < i; j++) {
         cudaStreamDestroy(streams->streams[j]);
       }
+      free(streams->streams);
+      streams->streams = NULL;
       return 0;
     }
   }
 
+  /* Back to the default device */
+  if (ndevices > 1) cudaSetDevice(0);
+
   /* Set the number of streams created */
   streams->nstreams = i;
+  streams->ndevices = ndevices;
 
   /* Return the number of streams created */
   return streams->nstreams;
+#else
+  error("SWIFT was not compiled with CUDA support.");
+  return 0;
+#endif
 }
 
 /**
@@ -64,7 +93,7 @@ int engine_cuda_init_streams(int num_streams) {
  * This function is used to destroy the CUDA streams that were created at the
  * beginning of the run.
  */
-int destroy_persistent_cuda_streams() {
+int destroy_persistent_cuda_streams(void) {
   /* Check if the streams have been created */
   if (streams == NULL || streams->nstreams == 0) {
     /* If the streams have not been created, return an error code */
@@ -72,14 +101,17 @@ int destroy_persistent_cuda_streams() {
   }
 
   /* Destroy the CUDA streams */
+#ifdef WITH_CUDA
   for (int i = 0; i < streams->nstreams; i++) {
     cudaStreamDestroy(streams->streams[i]);
   }
+#endif
 
   /* Reset the number of streams created */
   streams->nstreams = 0;
 
   /* Free the singleton structure */
+  free(streams->streams);
   free(streams);
   streams = NULL;
 
@@ -99,3 +131,20 @@ cudaStream_t get_cuda_stream(int index) {
   }
   return NULL;
 }
+
+/**
+ * @brief Function to get the CUDA stream a given runner should use.
+ *
+ * Runners are mapped round-robin onto the streams of their device such that,
+ * when there are at least as many streams as runners, each runner owns its
+ * own stream and only ever has to synchronise with its own work.
+ *
+ * @param runner_id The id of the #runner.
+ * @return The CUDA stream to use for this runner.
+ */
+cudaStream_t get_runner_cuda_stream(int runner_id) {
+  if (streams == NULL || streams->nstreams == 0) return NULL;
+  const int per_device = streams->nstreams / streams->ndevices;
+  const int device = cuda_devices_of_runner(runner_id);
+  return streams->streams[device * per_device + runner_id % per_device];
+}
@@ -1,9 +1,8 @@
 #ifndef CUDA_STREAMS_H
 #define CUDA_STREAMS_H
 
-#include <cuda_runtime.h>
-
-#define MAX_STREAMS 16
+/* Local headers. */
+#include "cuda_types.h"
 
 /**
  * @brief A "singleton" structure for holding the CUDA streams.
@@ -15,8 +14,9 @@
  * @param nstreams The number of CUDA streams created.
  */
 struct cuda_streams {
-  cudaStream_t streams[MAX_STREAMS]; /*!< The streams themselves. */
-  int nstreams;                      /*!< The number of streams created. */
+  cudaStream_t *streams; /*!< The streams themselves. */
+  int nstreams;          /*!< The number of streams created. */
+  int ndevices;          /*!< The number of devices they are spread over. */
 };
 
 /* Declare the global singleton instance */
@@ -24,7 +24,8 @@ extern struct cuda_streams *streams;
 
 /* Function prototypes */
 int engine_cuda_init_streams(int num_streams);
-int destroy_persistent_cuda_streams();
+int destroy_persistent_cuda_streams(void);
 cudaStream_t get_cuda_stream(int index);
+cudaStream_t get_runner_cuda_stream(int runner_id);
 
 #endif  // CUDA_STREAMS_H
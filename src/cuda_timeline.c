@@ -0,0 +1,332 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "cuda_timeline.h"
+
+/* System includes. */
+#include <stdio.h>
+#include <string.h>
+
+#ifdef SWIFT_NVTX
+#include <nvToolsExt.h>
+#endif
+
+/* Local headers. */
+#include "clocks.h"
+#include "cuda_devices.h"
+#include "error.h"
+#include "memuse.h"
+#include "task.h"
+
+/*! Names of the phases in the task dumps and the NVTX ranges. */
+const char *cuda_timeline_phase_names[cuda_timeline_phase_count] = {
+    "populate", "h2d", "kernel", "d2h", "write_back"};
+
+#if defined(SWIFT_DEBUG_TASKS) && defined(WITH_CUDA)
+/*! For each device, an event that fired at a known number of ticks */
+static cudaEvent_t cuda_timeline_anchor[CUDA_MAX_DEVICES];
+static ticks cuda_timeline_anchor_tic[CUDA_MAX_DEVICES];
+static int cuda_timeline_anchored[CUDA_MAX_DEVICES];
+#endif
+
+#if defined(SWIFT_DEBUG_TASKS) || defined(SWIFT_NVTX)
+/*! The #cuda_timeline of the task running on this thread, if any. */
+static __thread struct cuda_timeline *cuda_timeline_current = NULL;
+#endif
+
+#ifdef SWIFT_DEBUG_TASKS
+/**
+ * @brief Add a phase to a #cuda_timeline.
+ *
+ * @param tl The #cuda_timeline.
+ * @param tic The start of the phase.
+ * @param toc The end of the phase.
+ * @param type The type of the task.
+ * @param subtype The subtype of the task.
+ * @param phase The #cuda_timeline_phase.
+ */
+static void cuda_timeline_add(struct cuda_timeline *tl, const ticks tic,
+                              const ticks toc, const short int type,
+                              const short int subtype, const short int phase) {
+
+  if (tl->count == tl->size) {
+    tl->size = tl->size == 0 ? 1024 : 2 * tl->size;
+    tl->records = (struct cuda_timeline_record *)swift_realloc(
+        "cuda_timeline", tl->records,
+        tl->size * sizeof(struct cuda_timeline_record));
+    if (tl->records == NULL) error("Failed to grow the GPU timeline.");
+  }
+
+  struct cuda_timeline_record *rec = &tl->records[tl->count++];
+  rec->tic = tic;
+  rec->toc = toc;
+  rec->type = type;
+  rec->subtype = subtype;
+  rec->phase = phase;
+}
+#endif
+
+#if defined(SWIFT_DEBUG_TASKS) && defined(WITH_CUDA)
+/**
+ * @brief Convert the closed device phases of a #cuda_timeline to records.
+ *
+ * The event times are taken relative to the anchor of the device, which
+ * fired at a known number of ticks.
+ *
+ * @param tl The #cuda_timeline.
+ * @param wait Wait for the phases still running (1) or stop at the first one
+ * (0)?
+ */
+static void cuda_timeline_resolve(struct cuda_timeline *tl, const int wait) {
+
+  const double ticks_per_ms = clocks_get_cpufreq() / 1000.;
+  const int device = tl->device;
+
+  while (tl->nr_pending > (tl->open ? 1 : 0)) {
+
+    struct cuda_timeline_pending *p = &tl->pending[tl->first_pending];
+    if (wait)
+      cudaEventSynchronize(p->end);
+    else if (cudaEventQuery(p->end) == cudaErrorNotReady)
+      break;
+
+    float ms_start = 0.f, ms_end = 0.f;
+    cudaEventElapsedTime(&ms_start, cuda_timeline_anchor[device], p->start);
+    cudaEventElapsedTime(&ms_end, cuda_timeline_anchor[device], p->end);
+    cuda_timeline_add(tl,
+                      cuda_timeline_anchor_tic[device] +
+                          (ticks)(ms_start * ticks_per_ms),
+                      cuda_timeline_anchor_tic[device] +
+                          (ticks)(ms_end * ticks_per_ms),
+                      p->type, p->subtype, p->phase);
+
+    tl->first_pending = (tl->first_pending + 1) % CUDA_TIMELINE_MAX_PENDING;
+    tl->nr_pending--;
+  }
+}
+#endif
+
+/**
+ * @brief Initialise the #cuda_timeline of a runner.
+ *
+ * The device of the runner must be the current one.
+ *
+ * @param tl The #cuda_timeline.
+ * @param device The device of the runner.
+ */
+void cuda_timeline_init(struct cuda_timeline *tl, const int device) {
+
+  bzero(tl, sizeof(struct cuda_timeline));
+  tl->device = device;
+  tl->type = -1;
+  tl->subtype = -1;
+
+#if defined(SWIFT_DEBUG_TASKS) && defined(WITH_CUDA)
+  /* Nothing to time without a GPU */
+  if (!cuda_devices_active()) return;
+
+  for (int k = 0; k < CUDA_TIMELINE_MAX_PENDING; k++) {
+    if (cudaEventCreate(&tl->pending[k].start) != cudaSuccess ||
+        cudaEventCreate(&tl->pending[k].end) != cudaSuccess)
+      error("Failed to create the events of the GPU timeline.");
+  }
+
+  /* The first runner of a device anchors the events to the ticks */
+  if (!cuda_timeline_anchored[device]) {
+    if (cudaEventCreate(&cuda_timeline_anchor[device]) != cudaSuccess)
+      error("Failed to create the anchor event of the GPU timeline.");
+    cudaEventRecord(cuda_timeline_anchor[device], /*stream=*/0);
+    cudaEventSynchronize(cuda_timeline_anchor[device]);
+    cuda_timeline_anchor_tic[device] = getticks();
+    cuda_timeline_anchored[device] = 1;
+  }
+#endif
+}
+
+/**
+ * @brief Forget the phases recorded so far, at the start of a step.
+ *
+ * @param tl The #cuda_timeline.
+ */
+void cuda_timeline_reset(struct cuda_timeline *tl) { tl->count = 0; }
+
+/**
+ * @brief Wait for all the device phases and convert them to records.
+ *
+ * @param tl The #cuda_timeline.
+ */
+void cuda_timeline_flush(struct cuda_timeline *tl) {
+#if defined(SWIFT_DEBUG_TASKS) && defined(WITH_CUDA)
+  cuda_timeline_resolve(tl, /*wait=*/1);
+#endif
+}
+
+/**
+ * @brief Free the memory of a #cuda_timeline.
+ *
+ * @param tl The #cuda_timeline.
+ */
+void cuda_timeline_clean(struct cuda_timeline *tl) {
+#ifdef SWIFT_DEBUG_TASKS
+#ifdef WITH_CUDA
+  if (cuda_devices_active()) {
+    cuda_devices_use(tl->device);
+    for (int k = 0; k < CUDA_TIMELINE_MAX_PENDING; k++) {
+      cudaEventDestroy(tl->pending[k].start);
+      cudaEventDestroy(tl->pending[k].end);
+    }
+  }
+#endif
+  swift_free("cuda_timeline", tl->records);
+#endif
+  bzero(tl, sizeof(struct cuda_timeline));
+}
+
+#if defined(SWIFT_DEBUG_TASKS) || defined(SWIFT_NVTX)
+
+/**
+ * @brief Start recording the GPU phases of a task on this thread.
+ *
+ * @param tl The #cuda_timeline of the runner.
+ * @param t The #task.
+ */
+void cuda_timeline_task_begin(struct cuda_timeline *tl, const struct task *t) {
+
+  cuda_timeline_current = tl;
+  tl->type = t->type;
+  tl->subtype = t->subtype;
+
+#ifdef SWIFT_NVTX
+  char name[64];
+  snprintf(name, sizeof(name), "%s/%s", taskID_names[t->type],
+           subtaskID_names[t->subtype]);
+  nvtxRangePushA(name);
+#endif
+}
+
+/**
+ * @brief Stop recording the GPU phases of a task on this thread.
+ *
+ * The phases the task left in flight are read later.
+ *
+ * @param tl The #cuda_timeline of the runner.
+ */
+void cuda_timeline_task_end(struct cuda_timeline *tl) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (tl->open) error("A GPU phase was left open at the end of a task.");
+#endif
+
+#if defined(SWIFT_DEBUG_TASKS) && defined(WITH_CUDA)
+  cuda_timeline_resolve(tl, /*wait=*/0);
+#endif
+#ifdef SWIFT_NVTX
+  nvtxRangePop();
+#endif
+
+  tl->type = -1;
+  tl->subtype = -1;
+  cuda_timeline_current = NULL;
+}
+
+/**
+ * @brief Start a phase that runs on the CPU.
+ *
+ * @param phase The #cuda_timeline_phase.
+ */
+void cuda_timeline_cpu_begin(const int phase) {
+
+  struct cuda_timeline *tl = cuda_timeline_current;
+  if (tl == NULL) return;
+
+#ifdef SWIFT_NVTX
+  nvtxRangePushA(cuda_timeline_phase_names[phase]);
+#endif
+#ifdef SWIFT_DEBUG_TASKS
+  tl->cpu_tic = getticks();
+#endif
+}
+
+/**
+ * @brief End a phase that runs on the CPU.
+ *
+ * @param phase The #cuda_timeline_phase.
+ */
+void cuda_timeline_cpu_end(const int phase) {
+
+  struct cuda_timeline *tl = cuda_timeline_current;
+  if (tl == NULL) return;
+
+#ifdef SWIFT_NVTX
+  nvtxRangePop();
+#endif
+#ifdef SWIFT_DEBUG_TASKS
+  cuda_timeline_add(tl, tl->cpu_tic, getticks(), tl->type, tl->subtype,
+                    phase);
+#endif
+}
+
+#endif /* SWIFT_DEBUG_TASKS || SWIFT_NVTX */
+
+#ifdef WITH_CUDA
+
+/**
+ * @brief Mark the boundary between two phases that run on the device.
+ *
+ * Ends the current device phase of the task (if any) and starts the given
+ * one. Nothing is recorded outside of the tasks or while the stream is being
+ * captured into a graph.
+ *
+ * @param stream The stream the work of the phase goes to.
+ * @param phase The #cuda_timeline_phase to start, -1 to only end the current
+ * one.
+ */
+void cuda_timeline_gpu_phase(cudaStream_t stream, const int phase) {
+
+#if defined(SWIFT_DEBUG_TASKS) || defined(SWIFT_NVTX)
+  struct cuda_timeline *tl = cuda_timeline_current;
+  if (tl == NULL) return;
+
+  enum cudaStreamCaptureStatus status;
+  if (cudaStreamIsCapturing(stream, &status) == cudaSuccess &&
+      status != cudaStreamCaptureStatusNone)
+    return;
+
+  /* Close the current phase */
+  if (tl->open) {
+#ifdef SWIFT_NVTX
+    nvtxRangePop();
+#endif
+#ifdef SWIFT_DEBUG_TASKS
+    const int last = (tl->first_pending + tl->nr_pending - 1) %
+                     CUDA_TIMELINE_MAX_PENDING;
+    cudaEventRecord(tl->pending[last].end, stream);
+#endif
+    tl->open = 0;
+  }
+
+  if (phase < 0) return;
+
+  /* And open the next one */
+#ifdef SWIFT_NVTX
+  nvtxRangePushA(cuda_timeline_phase_names[phase]);
+#endif
+#ifdef SWIFT_DEBUG_TASKS
+  if (tl->nr_pending == CUDA_TIMELINE_MAX_PENDING)
+    cuda_timeline_resolve(tl, /*wait=*/1);
+
+  const int next =
+      (tl->first_pending + tl->nr_pending) % CUDA_TIMELINE_MAX_PENDING;
+  struct cuda_timeline_pending *p = &tl->pending[next];
+  p->type = tl->type;
+  p->subtype = tl->subtype;
+  p->phase = phase;
+  cudaEventRecord(p->start, stream);
+  tl->nr_pending++;
+#endif
+  tl->open = 1;
+#endif
+}
+
+#endif /* WITH_CUDA */
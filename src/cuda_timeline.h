@@ -0,0 +1,138 @@
+#ifndef SWIFT_CUDA_TIMELINE_H
+#define SWIFT_CUDA_TIMELINE_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* Local headers. */
+#include "cuda_types.h"
+#include "cycle.h"
+
+/* Forward declarations. */
+struct task;
+
+/*! Number of GPU phases a #cuda_timeline can have in flight */
+#define CUDA_TIMELINE_MAX_PENDING 256
+
+/**
+ * @brief The phases of the work a task offloads.
+ *
+ * The first and last ones run on the CPU, the others on the device.
+ */
+enum cuda_timeline_phase {
+
+  /*! Filling the caches that get sent. */
+  cuda_timeline_populate = 0,
+
+  /*! Copies to the device. */
+  cuda_timeline_h2d,
+
+  /*! The kernels. */
+  cuda_timeline_kernel,
+
+  /*! Copies back from the device. */
+  cuda_timeline_d2h,
+
+  /*! Adding the results to the particles. */
+  cuda_timeline_write_back,
+
+  /*! Number of phases. */
+  cuda_timeline_phase_count
+};
+
+/**
+ * @brief One phase of the offloaded work of a task, in CPU ticks.
+ */
+struct cuda_timeline_record {
+
+  /*! Start and end of the phase. */
+  ticks tic, toc;
+
+  /*! Type and subtype of the task. */
+  short int type, subtype;
+
+  /*! The #cuda_timeline_phase. */
+  short int phase;
+};
+
+/**
+ * @brief A device phase whose events have not been read yet.
+ */
+struct cuda_timeline_pending {
+
+  /*! Events recorded on the stream at the start and end of the phase. */
+  cudaEvent_t start, end;
+
+  /*! Type and subtype of the task and the #cuda_timeline_phase. */
+  short int type, subtype, phase;
+};
+
+/**
+ * @brief The GPU phases of the tasks of one #runner.
+ *
+ * Only filled with task debugging, the device phases are timed with CUDA
+ * events and converted to CPU ticks once they have completed.
+ */
+struct cuda_timeline {
+
+  /*! The phases of the current step. */
+  struct cuda_timeline_record *records;
+  int count, size;
+
+  /*! The device phases in flight, in the order they were issued. */
+  struct cuda_timeline_pending pending[CUDA_TIMELINE_MAX_PENDING];
+  int first_pending, nr_pending;
+
+  /*! Is the last pending phase still open (no end event yet)? */
+  int open;
+
+  /*! The device of the runner, for the conversion to ticks. */
+  int device;
+
+  /*! Type and subtype of the running task, -1 when there is none. */
+  short int type, subtype;
+
+  /*! Start of the CPU phase in progress. */
+  ticks cpu_tic;
+};
+
+extern const char *cuda_timeline_phase_names[cuda_timeline_phase_count];
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The device code only marks the boundaries of its phases. */
+void cuda_timeline_gpu_phase(cudaStream_t stream, const int phase);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifndef __cplusplus
+
+#if defined(SWIFT_DEBUG_TASKS) || defined(SWIFT_NVTX)
+
+void cuda_timeline_task_begin(struct cuda_timeline *tl, const struct task *t);
+void cuda_timeline_task_end(struct cuda_timeline *tl);
+void cuda_timeline_cpu_begin(const int phase);
+void cuda_timeline_cpu_end(const int phase);
+
+#else
+
+/* Nothing to record. */
+#define cuda_timeline_task_begin(tl, t) (void)0
+#define cuda_timeline_task_end(tl) (void)0
+#define cuda_timeline_cpu_begin(phase) (void)0
+#define cuda_timeline_cpu_end(phase) (void)0
+
+#endif
+
+void cuda_timeline_init(struct cuda_timeline *tl, const int device);
+void cuda_timeline_reset(struct cuda_timeline *tl);
+void cuda_timeline_flush(struct cuda_timeline *tl);
+void cuda_timeline_clean(struct cuda_timeline *tl);
+
+#endif /* __cplusplus */
+
+#endif /* SWIFT_CUDA_TIMELINE_H */
@@ -0,0 +1,232 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "cuda_top_multipoles.h"
+
+#ifdef WITH_CUDA
+/* CUDA headers. */
+#include <cuda_runtime.h>
+#endif
+
+/* Local headers. */
+#include "cell.h"
+#include "engine.h"
+#include "error.h"
+#include "space.h"
+
+/*! The global instance */
+struct cuda_top_multipoles gpu_top_multipoles;
+
+#ifdef WITH_CUDA
+
+/**
+ * @brief Allocate one device array of the #cuda_top_multipoles.
+ *
+ * @param ptr (return) The device pointer.
+ * @param size The number of bytes to allocate.
+ */
+static void cuda_top_multipoles_alloc_device(void **ptr, const size_t size) {
+
+  const cudaError_t err = cudaMalloc(ptr, size);
+  if (err != cudaSuccess)
+    error("Couldn't allocate device top-level multipoles (%zd bytes): %s",
+          size, cudaGetErrorString(err));
+}
+
+/**
+ * @brief Allocate one host array of the #cuda_top_multipoles.
+ *
+ * @param ptr (return) The host pointer.
+ * @param size The number of bytes to allocate.
+ */
+static void cuda_top_multipoles_alloc_host(void **ptr, const size_t size) {
+
+  /* Page-locked such that the copies are asynchronous */
+  const cudaError_t err = cudaHostAlloc(ptr, size, cudaHostAllocPortable);
+  if (err != cudaSuccess)
+    error("Couldn't allocate host top-level multipoles (%zd bytes): %s", size,
+          cudaGetErrorString(err));
+}
+
+#endif /* WITH_CUDA */
+
+/**
+ * @brief Initialise the (empty) #cuda_top_multipoles.
+ *
+ * @param active Are we going to use the GPU for the long-range tasks?
+ * @param nr_threads The number of runners.
+ */
+void cuda_top_multipoles_init(const int active, const int nr_threads) {
+
+  struct cuda_top_multipoles *t = &gpu_top_multipoles;
+
+  t->count = 0;
+  t->size = 0;
+  t->nr_cells = 0;
+  t->max_blocks = 0;
+  t->nr_runners = nr_threads;
+  t->gathered = 0;
+  for (int d = 0; d < CUDA_MAX_DEVICES; ++d) t->valid[d] = 0;
+  t->active = active;
+  if (lock_init(&t->lock) != 0) error("Failed to init lock");
+}
+
+/**
+ * @brief Frees the memory of the #cuda_top_multipoles.
+ */
+void cuda_top_multipoles_clean(void) {
+
+  struct cuda_top_multipoles *t = &gpu_top_multipoles;
+
+#ifdef WITH_CUDA
+  for (int d = 0; d < gpu_devices.count; ++d) {
+    cuda_devices_use(d);
+    if (t->size > 0) cudaFree(t->d_cells[d]);
+    if (t->max_blocks > 0) cudaFree(t->d_results[d]);
+    t->valid[d] = 0;
+  }
+  cuda_devices_use(0);
+
+  if (t->size > 0) cudaFreeHost(t->cells);
+  if (t->max_blocks > 0) cudaFreeHost(t->results);
+#endif
+  if (t->nr_cells > 0) free(t->index);
+  t->size = 0;
+  t->nr_cells = 0;
+  t->max_blocks = 0;
+  t->gathered = 0;
+}
+
+/**
+ * @brief Make room for the current top-level grid and mark the device copy
+ * as out of date.
+ *
+ * Must be called when no task is running.
+ *
+ * @param e The #engine.
+ */
+void cuda_top_multipoles_prepare(const struct engine *e) {
+
+  struct cuda_top_multipoles *t = &gpu_top_multipoles;
+  if (!t->active) return;
+
+#ifdef WITH_CUDA
+  const struct space *s = e->s;
+
+  /* The top-level grid changed? */
+  if (t->nr_cells != s->nr_cells) {
+
+    if (t->nr_cells > 0) free(t->index);
+    if (t->max_blocks > 0) {
+      cudaFreeHost(t->results);
+      for (int d = 0; d < gpu_devices.count; ++d) {
+        cuda_devices_use(d);
+        cudaFree(t->d_results[d]);
+      }
+    }
+
+    t->index = (int *)malloc(s->nr_cells * sizeof(int));
+    if (t->index == NULL) error("Failed to allocate top-level cell indices");
+    t->nr_cells = s->nr_cells;
+
+    t->max_blocks =
+        (s->nr_cells + CUDA_LONG_RANGE_CHUNK - 1) / CUDA_LONG_RANGE_CHUNK;
+    const size_t sizeResults = (size_t)t->nr_runners * t->max_blocks *
+                               sizeof(struct cuda_long_range_result);
+    cuda_top_multipoles_alloc_host((void **)&t->results, sizeResults);
+    for (int d = 0; d < gpu_devices.count; ++d) {
+      cuda_devices_use(d);
+      cuda_top_multipoles_alloc_device((void **)&t->d_results[d],
+                                       sizeResults);
+    }
+  }
+
+  /* Enough room for the cells with particles? */
+  if (t->size < s->nr_cells_with_particles) {
+
+    if (t->size > 0) cudaFreeHost(t->cells);
+    const size_t sizeCells = s->nr_cells * sizeof(struct cuda_top_cell);
+    cuda_top_multipoles_alloc_host((void **)&t->cells, sizeCells);
+
+    for (int d = 0; d < gpu_devices.count; ++d) {
+      cuda_devices_use(d);
+      if (t->size > 0) cudaFree(t->d_cells[d]);
+      cuda_top_multipoles_alloc_device((void **)&t->d_cells[d], sizeCells);
+    }
+    t->size = s->nr_cells;
+  }
+  cuda_devices_use(0);
+
+  t->gathered = 0;
+  for (int d = 0; d < gpu_devices.count; ++d) t->valid[d] = 0;
+#else
+  error("SWIFT was not compiled with CUDA support.");
+#endif
+}
+
+/**
+ * @brief Copy the top-level multipoles to a device if this was not done yet
+ * during this launch.
+ *
+ * Called by the long-range tasks, the first one to get here does the work
+ * while the others wait.
+ *
+ * @param e The #engine.
+ * @param device The device of the calling runner (the current one).
+ */
+void cuda_top_multipoles_refresh(const struct engine *e, const int device) {
+
+  struct cuda_top_multipoles *t = &gpu_top_multipoles;
+
+  lock_lock(&t->lock);
+
+  /* Someone did it already? */
+  if (!t->gathered) {
+
+    const struct space *s = e->s;
+    const struct cell *cells = s->cells_top;
+    const int *cells_with_particles = s->cells_with_particles_top;
+    const int nr_cells_with_particles = s->nr_cells_with_particles;
+
+    for (int k = 0; k < s->nr_cells; ++k) t->index[k] = -1;
+
+    /* Gather what the kernel needs */
+    for (int n = 0; n < nr_cells_with_particles; ++n) {
+
+      const struct cell *c = &cells[cells_with_particles[n]];
+      const struct gravity_tensors *m = c->grav.multipole;
+      struct cuda_top_cell *tc = &t->cells[n];
+
+      tc->m_pole = m->m_pole;
+      for (int k = 0; k < 3; ++k) {
+        tc->CoM[k] = m->CoM[k];
+        tc->CoM_rebuild[k] = m->CoM_rebuild[k];
+        tc->loc[k] = c->loc[k];
+      }
+      tc->r_max_rebuild = m->r_max_rebuild;
+      t->index[cells_with_particles[n]] = n;
+    }
+    t->count = nr_cells_with_particles;
+    t->gathered = 1;
+  }
+
+  if (!t->valid[device]) {
+
+#ifdef WITH_CUDA
+    const cudaError_t err =
+        cudaMemcpy(t->d_cells[device], t->cells,
+                   t->count * sizeof(struct cuda_top_cell),
+                   cudaMemcpyHostToDevice);
+    if (err != cudaSuccess)
+      error("Failed to upload the top-level multipoles: %s",
+            cudaGetErrorString(err));
+#else
+    error("SWIFT was not compiled with CUDA support.");
+#endif
+
+    t->valid[device] = 1;
+  }
+
+  if (lock_unlock(&t->lock) != 0) error("Failed to unlock");
+}
@@ -0,0 +1,138 @@
+#ifndef SWIFT_CUDA_TOP_MULTIPOLES_H
+#define SWIFT_CUDA_TOP_MULTIPOLES_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* MPI headers, multipole_struct.h needs them. */
+#ifdef WITH_MPI
+#include <mpi.h>
+#endif
+
+/* Local headers */
+#include "cuda_devices.h"
+#include "lock.h"
+#include "multipole_struct.h"
+
+/* Forward declarations */
+struct engine;
+
+/*! Number of threads per block of the long-range kernel. */
+#define CUDA_LONG_RANGE_THREADS 128
+
+/*! Number of top-level cells each block of the long-range kernel handles. */
+#define CUDA_LONG_RANGE_CHUNK 4096
+
+/**
+ * @brief The information about a top-level cell the long-range gravity
+ * kernel needs.
+ */
+struct cuda_top_cell {
+
+  /*! The multipole of the cell. */
+  struct multipole m_pole;
+
+  /*! Centre of mass of the cell, now and at the last rebuild. */
+  double CoM[3], CoM_rebuild[3];
+
+  /*! Bottom-left corner of the cell. */
+  double loc[3];
+
+  /*! Upper limit of the CoM<->gpart distance at the last rebuild. */
+  float r_max_rebuild;
+};
+
+/**
+ * @brief The subset of the #gravity_props entering the MAC.
+ */
+struct cuda_mac_props {
+
+  /*! Opening angle of the geometric criterion. */
+  float theta_crit;
+
+  /*! Tolerance of the adaptive criterion. */
+  float adaptive_tolerance;
+
+  /*! Inverse of the mesh smoothing scale. */
+  float r_s_inv;
+
+  /*! Flags copied from the #gravity_props. */
+  int use_advanced_MAC, use_gadget_tolerance, use_tree_below_softening;
+  int consider_truncation_in_MAC;
+};
+
+/**
+ * @brief What one block of the long-range kernel gives back.
+ */
+struct cuda_long_range_result {
+
+  /*! The contribution to the field tensor (counters not set). */
+  struct grav_tensor l;
+
+  /*! Number of #gpart interacted with through M2L and the mesh. */
+  long long num_tree, num_pm;
+
+  /*! Did any cell contribute? */
+  int interacted;
+};
+
+/**
+ * @brief A device copy of the top-level cells with particles, shared by all
+ * the long-range gravity tasks of a launch.
+ *
+ * The buffers are sized and the copy invalidated at every engine_launch().
+ * The copy is then refreshed by the first long-range task needing it on
+ * each device.
+ */
+struct cuda_top_multipoles {
+
+  /*! Host (page-locked) copy of the top-level cells. */
+  struct cuda_top_cell *cells;
+
+  /*! Device copies of the top-level cells. */
+  struct cuda_top_cell *d_cells[CUDA_MAX_DEVICES];
+
+  /*! Position in the arrays above of every top-level cell (-1 if empty). */
+  int *index;
+
+  /*! Host (page-locked) results (one slice per runner). */
+  struct cuda_long_range_result *results;
+
+  /*! Device results (one slice per runner). */
+  struct cuda_long_range_result *d_results[CUDA_MAX_DEVICES];
+
+  /*! Number of cells in the arrays and how many we have room for. */
+  int count, size;
+
+  /*! Number of top-level cells. */
+  int nr_cells;
+
+  /*! Number of results per runner. */
+  int max_blocks;
+
+  /*! Number of runners. */
+  int nr_runners;
+
+  /*! Is the host copy up to date? */
+  int gathered;
+
+  /*! Is the copy of each device up to date? */
+  int valid[CUDA_MAX_DEVICES];
+
+  /*! Lock protecting the refresh. */
+  swift_lock_type lock;
+
+  /*! Are we using the GPU for the long-range tasks at all? */
+  int active;
+};
+
+/* The global instance */
+extern struct cuda_top_multipoles gpu_top_multipoles;
+
+/* Function prototypes. */
+void cuda_top_multipoles_init(const int active, const int nr_threads);
+void cuda_top_multipoles_clean(void);
+void cuda_top_multipoles_prepare(const struct engine *e);
+void cuda_top_multipoles_refresh(const struct engine *e, const int device);
+
+#endif /* SWIFT_CUDA_TOP_MULTIPOLES_H */
@@ -0,0 +1,39 @@
+#ifndef SWIFT_CUDA_TYPES_H
+#define SWIFT_CUDA_TYPES_H
+
+/* Config parameters. */
+#include <config.h>
+
+#ifdef WITH_CUDA
+
+/* CUDA headers. */
+#include <cuda_runtime.h>
+
+#else
+
+/* CPU-only build: the handles the GPU structures hold are never created but
+ * the structures still exist, such that the rest of the code does not need
+ * to know. */
+typedef struct CUstream_st *cudaStream_t;
+typedef struct CUevent_st *cudaEvent_t;
+typedef struct CUgraphExec_st *cudaGraphExec_t;
+
+#endif /* WITH_CUDA */
+
+/**
+ * @brief What went wrong on the device, as found at the synchronisation of an
+ * offloaded piece of work.
+ */
+enum cuda_fault {
+
+  /*! All went fine. */
+  cuda_fault_none = 0,
+
+  /*! The work failed but the device is still usable. */
+  cuda_fault_transient,
+
+  /*! The device context is lost, nothing on it can be trusted any more. */
+  cuda_fault_sticky
+};
+
+#endif /* SWIFT_CUDA_TYPES_H */
@@ -0,0 +1,160 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "cuda_work_split.h"
+
+/* System includes. */
+#include <float.h>
+#include <string.h>
+
+/* Local headers. */
+#include "error.h"
+#include "runner.h"
+
+/*! The split of the P2P pairs between the CPU and the GPU. */
+struct cuda_work_split gpu_work_split;
+
+/**
+ * @brief Fit a #cuda_cost_model to a set of timings.
+ *
+ * If the work of the calls does not vary enough to constrain both terms,
+ * only the cost per interaction is updated.
+ *
+ * @param m The #cuda_cost_model to refine.
+ * @param samples The measured timings.
+ * @param relax The weight given to the new fit (1 to replace the model).
+ */
+static void cuda_cost_model_fit(struct cuda_cost_model *m,
+                                const struct cuda_split_samples *samples,
+                                double relax) {
+
+  if (samples->calls == 0 || samples->w <= 0.) return;
+
+  const double n = (double)samples->calls;
+  const double denom = n * samples->ww - samples->w * samples->w;
+
+  /* The fixed cost is per pair, not per call */
+  const double pairs_per_call = (double)samples->pairs / n;
+
+  double cost, overhead;
+  if (samples->calls > 1 && denom > 1e-3 * n * samples->ww) {
+    cost = (n * samples->wt - samples->w * samples->t) / denom;
+    overhead = (samples->t - cost * samples->w) / n / pairs_per_call;
+  } else {
+    overhead = m->overhead;
+    cost = (samples->t - overhead * samples->pairs) / samples->w;
+  }
+
+  /* Noise can make the fit come out negative */
+  if (cost <= 0.) cost = m->cost;
+  if (overhead < 0.) overhead = 0.;
+
+  /* Nothing to relax towards if this is the first fit */
+  if (m->cost <= 0.) relax = 1.;
+
+  m->cost = (1. - relax) * m->cost + relax * cost;
+  m->overhead = (1. - relax) * m->overhead + relax * overhead;
+}
+
+/**
+ * @brief Compute the cross-over point of the two cost models.
+ *
+ * @param s The #cuda_work_split.
+ */
+static void cuda_work_split_set_threshold(struct cuda_work_split *s) {
+
+  /* Keep the current value until both sides have been measured */
+  if (s->cpu.cost <= 0. || s->gpu.cost <= 0.) return;
+
+  /* A GPU slower per interaction never wins */
+  if (s->gpu.cost >= s->cpu.cost) {
+    s->threshold = DBL_MAX;
+    return;
+  }
+
+  const double threshold =
+      (s->gpu.overhead - s->cpu.overhead) / (s->cpu.cost - s->gpu.cost);
+  s->threshold = threshold > 0. ? threshold : 0.;
+}
+
+/**
+ * @brief Initialise the #cuda_work_split.
+ *
+ * @param s The #cuda_work_split.
+ * @param active Do we split the pairs at all?
+ * @param threshold The initial number of interactions below which pairs run
+ * on the CPU, <= 0 to wait for cuda_work_split_calibrate().
+ */
+void cuda_work_split_init(struct cuda_work_split *s, const int active,
+                          const double threshold) {
+
+  bzero(s, sizeof(struct cuda_work_split));
+  s->active = active;
+  s->threshold = threshold > 0. ? threshold : 0.;
+}
+
+/**
+ * @brief Set the cost models from the timings of the start-up benchmark.
+ *
+ * @param s The #cuda_work_split.
+ * @param cpu The timings of the CPU kernels.
+ * @param gpu The timings of the GPU kernels.
+ */
+void cuda_work_split_calibrate(struct cuda_work_split *s,
+                               const struct cuda_split_samples *cpu,
+                               const struct cuda_split_samples *gpu) {
+
+  cuda_cost_model_fit(&s->cpu, cpu, /*relax=*/1.);
+  cuda_cost_model_fit(&s->gpu, gpu, /*relax=*/1.);
+  cuda_work_split_set_threshold(s);
+}
+
+/**
+ * @brief Refine the cost models with the timings the runners measured in the
+ * last engine_launch and reset them.
+ *
+ * This must be called when no task is running.
+ *
+ * @param s The #cuda_work_split.
+ * @param runners The #runner array.
+ * @param nr_runners The number of runners.
+ * @param verbose Are we talkative?
+ */
+void cuda_work_split_update(struct cuda_work_split *s, struct runner *runners,
+                            const int nr_runners, const int verbose) {
+
+  if (!s->active) return;
+
+  /* Gather the timings of all the runners */
+  struct cuda_split_samples cpu, gpu;
+  bzero(&cpu, sizeof(struct cuda_split_samples));
+  bzero(&gpu, sizeof(struct cuda_split_samples));
+  for (int k = 0; k < nr_runners; ++k) {
+    const struct cuda_split_timings *t = &runners[k].gpu_split_timings;
+    cpu.w += t->cpu.w;
+    cpu.t += t->cpu.t;
+    cpu.ww += t->cpu.ww;
+    cpu.wt += t->cpu.wt;
+    cpu.calls += t->cpu.calls;
+    cpu.pairs += t->cpu.pairs;
+    gpu.w += t->gpu.w;
+    gpu.t += t->gpu.t;
+    gpu.ww += t->gpu.ww;
+    gpu.wt += t->gpu.wt;
+    gpu.calls += t->gpu.calls;
+    gpu.pairs += t->gpu.pairs;
+    bzero(&runners[k].gpu_split_timings, sizeof(struct cuda_split_timings));
+  }
+
+  /* Nothing new to learn from? */
+  if (cpu.calls == 0 && gpu.calls == 0) return;
+
+  cuda_cost_model_fit(&s->cpu, &cpu, CUDA_WORK_SPLIT_RELAX);
+  cuda_cost_model_fit(&s->gpu, &gpu, CUDA_WORK_SPLIT_RELAX);
+  cuda_work_split_set_threshold(s);
+
+  if (verbose)
+    message("P2P pairs with fewer than %e interactions run on the CPU.",
+            s->threshold);
+}
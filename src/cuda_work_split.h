@@ -0,0 +1,137 @@
+#ifndef SWIFT_CUDA_WORK_SPLIT_H
+#define SWIFT_CUDA_WORK_SPLIT_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* Local headers */
+#include "cuda_devices.h"
+#include "cycle.h"
+#include "inline.h"
+
+/* Forward declarations */
+struct runner;
+
+/*! Weight given to the latest measurements when refining the models. */
+#define CUDA_WORK_SPLIT_RELAX 0.25
+
+/*! Smallest number of particles per cell used by the calibration. */
+#define CUDA_WORK_SPLIT_CALIBRATION_MIN 8
+
+/*! Number of repeats of each size in the calibration. */
+#define CUDA_WORK_SPLIT_CALIBRATION_REPEATS 3
+
+/**
+ * @brief Linear cost model t = overhead + cost * work of one pair kernel,
+ * where the work is the number of interactions gcount_i * gcount_j.
+ */
+struct cuda_cost_model {
+
+  /*! Fixed cost of one pair (ticks). */
+  double overhead;
+
+  /*! Cost of one interaction (ticks). */
+  double cost;
+};
+
+/**
+ * @brief Running sums of the measured timings of one kind of kernel calls,
+ * used to fit a #cuda_cost_model.
+ *
+ * One call can contain many pairs (e.g. a whole GPU batch).
+ */
+struct cuda_split_samples {
+
+  /*! Sums of the work, time, work^2 and work * time of the calls. */
+  double w, t, ww, wt;
+
+  /*! Number of calls and of pairs recorded. */
+  long long calls, pairs;
+};
+
+/**
+ * @brief The timings one runner has accumulated since the last update of
+ * the split.
+ */
+struct cuda_split_timings {
+
+  /*! Pairs run on the CPU. */
+  struct cuda_split_samples cpu;
+
+  /*! Pairs run on the GPU. */
+  struct cuda_split_samples gpu;
+};
+
+/**
+ * @brief Decides which of the CPU or the GPU runs a given P2P pair.
+ *
+ * The GPU has a large fixed cost per pair (launch, copies, synchronisation)
+ * but a much smaller cost per interaction. Pairs with fewer interactions
+ * than the cross-over point of the two cost models stay on the CPU.
+ */
+struct cuda_work_split {
+
+  /*! Cost model of the CPU kernels. */
+  struct cuda_cost_model cpu;
+
+  /*! Cost model of the GPU kernels. */
+  struct cuda_cost_model gpu;
+
+  /*! Pairs with fewer interactions than this run on the CPU. */
+  double threshold;
+
+  /*! Are we splitting the work at all? */
+  int active;
+};
+
+extern struct cuda_work_split gpu_work_split;
+
+/**
+ * @brief Should a pair of cells be sent to the GPU?
+ *
+ * Never without a GPU in use, always when the work is not split.
+ *
+ * @param s The #cuda_work_split.
+ * @param gcount_i The number of particles in the first cell.
+ * @param gcount_j The number of particles in the other cell.
+ */
+static INLINE int cuda_work_split_use_gpu(const struct cuda_work_split *s,
+                                          const int gcount_i,
+                                          const int gcount_j) {
+
+  if (!cuda_devices_active()) return 0;
+  if (!s->active) return 1;
+  return (double)gcount_i * (double)gcount_j >= s->threshold;
+}
+
+/**
+ * @brief Record the timing of one kernel call.
+ *
+ * @param samples The #cuda_split_samples to add to.
+ * @param work The number of interactions computed by the call.
+ * @param pairs The number of pairs in the call.
+ * @param dt The time the call took.
+ */
+static INLINE void cuda_split_samples_add(struct cuda_split_samples *samples,
+                                          const double work, const int pairs,
+                                          const ticks dt) {
+
+  const double t = (double)dt;
+  samples->w += work;
+  samples->t += t;
+  samples->ww += work * work;
+  samples->wt += work * t;
+  samples->calls++;
+  samples->pairs += pairs;
+}
+
+/* Function prototypes. */
+void cuda_work_split_init(struct cuda_work_split *s, const int active,
+                          const double threshold);
+void cuda_work_split_calibrate(struct cuda_work_split *s,
+                               const struct cuda_split_samples *cpu,
+                               const struct cuda_split_samples *gpu);
+void cuda_work_split_update(struct cuda_work_split *s, struct runner *runners,
+                            const int nr_runners, const int verbose);
+
+#endif /* SWIFT_CUDA_WORK_SPLIT_H */
@@ -46,6 +46,7 @@
 #include "gravity_properties.h"
 #include "hydro_io.h"
 #include "hydro_properties.h"
+#include "io_async.h"
 #include "io_compression.h"
 #include "io_properties.h"
 #include "memuse.h"
@@ -129,8 +130,8 @@ void write_distributed_array(
   if (h_space < 0)
     error("Error while creating data space for field '%s'.", props.name);
 
-  /* Decide what chunk size to use based on compression */
-  int log2_chunk_size = 20;
+  /* Decide what chunk size to use */
+  const int log2_chunk_size = io_log2_chunk_size(e, N, e->s->nr_local_cells);
 
   int rank;
   hsize_t shape[2];
@@ -164,6 +165,17 @@ void write_distributed_array(
   /* Dataset properties */
   hid_t h_prop = H5Pcreate(H5P_DATASET_CREATE);
 
+  /* Is the data written by the background thread, or are the chunks
+   * compressed by our threads and written directly? */
+  const int staged = e->snapshot_asynchronous && N > 0;
+#ifdef IO_PARALLEL_COMPRESSION
+  const int direct_chunks = e->snapshot_parallel_compression && !staged &&
+                            N > 0 && e->snapshot_compression > 0 &&
+                            lossy_compression == compression_write_lossless;
+#else
+  const int direct_chunks = 0;
+#endif
+
   /* Create filters and set compression level if we have something to write */
   char comp_buffer[32] = "None";
   if (N > 0) {
@@ -193,10 +205,14 @@ void write_distributed_array(
               props.name);
     }
 
-    /* Impose check-sum to verify data corruption */
-    h_err = H5Pset_fletcher32(h_prop);
-    if (h_err < 0)
-      error("Error while setting checksum options for field '%s'.", props.name);
+    /* Impose check-sum to verify data corruption, unless we filter the
+     * chunks ourselves. */
+    if (!direct_chunks) {
+      h_err = H5Pset_fletcher32(h_prop);
+      if (h_err < 0)
+        error("Error while setting checksum options for field '%s'.",
+              props.name);
+    }
   }
 
   /* Create dataset */
@@ -208,10 +224,22 @@ void write_distributed_array(
   tic = getticks();
 #endif
 
-  /* Write temporary buffer to HDF5 dataspace */
-  h_err = H5Dwrite(h_data, io_hdf5_type(props.type), h_space, H5S_ALL,
-                   H5P_DEFAULT, temp);
-  if (h_err < 0) error("Error while writing data array '%s'.", props.name);
+  /* Write temporary buffer to HDF5 dataspace, or leave that to the
+   * background thread once the file is complete. */
+  if (staged) {
+    io_async_stage(fileName, partTypeGroupName, props.name,
+                   io_hdf5_type(props.type), temp);
+  } else if (direct_chunks) {
+#ifdef IO_PARALLEL_COMPRESSION
+    io_write_compressed_chunks((struct threadpool*)&e->threadpool, h_data,
+                               temp, N, props.dimension, typeSize,
+                               chunk_shape[0], e->snapshot_compression);
+#endif
+  } else {
+    h_err = H5Dwrite(h_data, io_hdf5_type(props.type), h_space, H5S_ALL,
+                     H5P_DEFAULT, temp);
+    if (h_err < 0) error("Error while writing data array '%s'.", props.name);
+  }
 
 #ifdef IO_SPEED_MEASUREMENT
   ticks toc = getticks();
@@ -264,7 +292,7 @@ void write_distributed_array(
   io_write_attribute_s(h_data, "Description", props.description);
 
   /* Free and close everything */
-  swift_free("writebuff", temp);
+  if (!staged) swift_free("writebuff", temp);
   H5Tclose(h_type);
   H5Pclose(h_prop);
   H5Dclose(h_data);
@@ -609,6 +637,8 @@ void write_virtual_file(struct engine* e, const char* fileName_base,
     io_write_attribute_s(h_grp, "OutputType", "SubSampled");
     io_write_attribute(h_grp, "SubSampleFractions", FLOAT, subsample_fraction,
                        swift_type_count);
+    io_write_attribute_i(h_grp, "SubSampleSameParticles",
+                         e->snapshot_subsample_same_particles);
   } else {
     io_write_attribute_s(h_grp, "OutputType", "FullVolume");
   }
@@ -906,6 +936,9 @@ void write_output_distributed(struct engine* e,
     if (!subsample[i]) subsample_fraction[i] = 1.f;
   }
 
+  /* Seed of the selection of the sub-sampled particles */
+  const int subsample_seed = io_get_subsample_seed(e);
+
   /* Number of particles that we will write */
   size_t Ngas_written, Ndm_written, Ndm_background, Ndm_neutrino,
       Nsinks_written, Nstars_written, Nblackholes_written;
@@ -913,7 +946,7 @@ void write_output_distributed(struct engine* e,
   if (subsample[swift_type_gas]) {
     Ngas_written = io_count_gas_to_write(e->s, /*subsample=*/1,
                                          subsample_fraction[swift_type_gas],
-                                         e->snapshot_output_count);
+                                         subsample_seed);
   } else {
     Ngas_written =
         e->s->nr_parts - e->s->nr_inhibited_parts - e->s->nr_extra_parts;
@@ -922,7 +955,7 @@ void write_output_distributed(struct engine* e,
   if (subsample[swift_type_stars]) {
     Nstars_written = io_count_stars_to_write(
         e->s, /*subsample=*/1, subsample_fraction[swift_type_stars],
-        e->snapshot_output_count);
+        subsample_seed);
   } else {
     Nstars_written =
         e->s->nr_sparts - e->s->nr_inhibited_sparts - e->s->nr_extra_sparts;
@@ -931,7 +964,7 @@ void write_output_distributed(struct engine* e,
   if (subsample[swift_type_black_hole]) {
     Nblackholes_written = io_count_black_holes_to_write(
         e->s, /*subsample=*/1, subsample_fraction[swift_type_black_hole],
-        e->snapshot_output_count);
+        subsample_seed);
   } else {
     Nblackholes_written =
         e->s->nr_bparts - e->s->nr_inhibited_bparts - e->s->nr_extra_bparts;
@@ -940,7 +973,7 @@ void write_output_distributed(struct engine* e,
   if (subsample[swift_type_sink]) {
     Nsinks_written = io_count_sinks_to_write(
         e->s, /*subsample=*/1, subsample_fraction[swift_type_sink],
-        e->snapshot_output_count);
+        subsample_seed);
   } else {
     Nsinks_written =
         e->s->nr_sinks - e->s->nr_inhibited_sinks - e->s->nr_extra_sinks;
@@ -948,13 +981,12 @@ void write_output_distributed(struct engine* e,
 
   Ndm_written = io_count_dark_matter_to_write(
       e->s, subsample[swift_type_dark_matter],
-      subsample_fraction[swift_type_dark_matter], e->snapshot_output_count);
+      subsample_fraction[swift_type_dark_matter], subsample_seed);
 
   if (with_DM_background) {
     Ndm_background = io_count_background_dark_matter_to_write(
         e->s, subsample[swift_type_dark_matter_background],
-        subsample_fraction[swift_type_dark_matter_background],
-        e->snapshot_output_count);
+        subsample_fraction[swift_type_dark_matter_background], subsample_seed);
   } else {
     Ndm_background = 0;
   }
@@ -962,7 +994,7 @@ void write_output_distributed(struct engine* e,
   if (with_neutrinos) {
     Ndm_neutrino = io_count_neutrinos_to_write(
         e->s, subsample[swift_type_neutrino],
-        subsample_fraction[swift_type_neutrino], e->snapshot_output_count);
+        subsample_fraction[swift_type_neutrino], subsample_seed);
   } else {
     Ndm_neutrino = 0;
   }
@@ -1120,6 +1152,8 @@ void write_output_distributed(struct engine* e,
     io_write_attribute_s(h_grp, "OutputType", "SubSampled");
     io_write_attribute(h_grp, "SubSampleFractions", FLOAT, subsample_fraction,
                        swift_type_count);
+    io_write_attribute_i(h_grp, "SubSampleSameParticles",
+                         e->snapshot_subsample_same_particles);
   } else {
     io_write_attribute_s(h_grp, "OutputType", "FullVolume");
   }
@@ -1145,8 +1179,8 @@ void write_output_distributed(struct engine* e,
   io_write_cell_offsets(h_grp, e->s->cdim, e->s->dim, e->s->cells_top,
                         e->s->nr_cells, e->s->width, mpi_rank,
                         /*distributed=*/1, subsample, subsample_fraction,
-                        e->snapshot_output_count, N_total, global_offsets,
-                        to_write, numFields, internal_units, snapshot_units);
+                        subsample_seed, N_total, global_offsets, to_write,
+                        numFields, internal_units, snapshot_units);
   H5Gclose(h_grp);
 
   /* Loop over all particle types */
@@ -1223,7 +1257,7 @@ void write_output_distributed(struct engine* e,
           io_collect_parts_to_write(
               parts, xparts, parts_written, xparts_written,
               subsample[swift_type_gas], subsample_fraction[swift_type_gas],
-              e->snapshot_output_count, Ngas, Ngas_written);
+              subsample_seed, Ngas, Ngas_written);
 
           /* Select the fields to write */
           io_select_hydro_fields(parts_written, xparts_written, with_cosmology,
@@ -1269,7 +1303,7 @@ void write_output_distributed(struct engine* e,
               gparts, e->s->gpart_group_data, gparts_written,
               gpart_group_data_written, subsample[swift_type_dark_matter],
               subsample_fraction[swift_type_dark_matter],
-              e->snapshot_output_count, Ntot, Ndm_written, with_stf);
+              subsample_seed, Ntot, Ndm_written, with_stf);
 
           /* Select the fields to write */
           io_select_dm_fields(gparts_written, gpart_group_data_written,
@@ -1304,7 +1338,7 @@ void write_output_distributed(struct engine* e,
             gpart_group_data_written,
             subsample[swift_type_dark_matter_background],
             subsample_fraction[swift_type_dark_matter_background],
-            e->snapshot_output_count, Ntot, Ndm_background, with_stf);
+            subsample_seed, Ntot, Ndm_background, with_stf);
 
         /* Select the fields to write */
         io_select_dm_fields(gparts_written, gpart_group_data_written, with_fof,
@@ -1336,8 +1370,8 @@ void write_output_distributed(struct engine* e,
         io_collect_gparts_neutrino_to_write(
             gparts, e->s->gpart_group_data, gparts_written,
             gpart_group_data_written, subsample[swift_type_neutrino],
-            subsample_fraction[swift_type_neutrino], e->snapshot_output_count,
-            Ntot, Ndm_neutrino, with_stf);
+            subsample_fraction[swift_type_neutrino], subsample_seed, Ntot,
+            Ndm_neutrino, with_stf);
 
         /* Select the fields to write */
         io_select_neutrino_fields(gparts_written, gpart_group_data_written,
@@ -1368,8 +1402,8 @@ void write_output_distributed(struct engine* e,
           /* Collect the particles we want to write */
           io_collect_sinks_to_write(
               sinks, sinks_written, subsample[swift_type_sink],
-              subsample_fraction[swift_type_sink], e->snapshot_output_count,
-              Nsinks, Nsinks_written);
+              subsample_fraction[swift_type_sink], subsample_seed, Nsinks,
+              Nsinks_written);
 
           /* Select the fields to write */
           io_select_sink_fields(sinks_written, with_cosmology, with_fof,
@@ -1401,8 +1435,8 @@ void write_output_distributed(struct engine* e,
           /* Collect the particles we want to write */
           io_collect_sparts_to_write(
               sparts, sparts_written, subsample[swift_type_stars],
-              subsample_fraction[swift_type_stars], e->snapshot_output_count,
-              Nstars, Nstars_written);
+              subsample_fraction[swift_type_stars], subsample_seed, Nstars,
+              Nstars_written);
 
           /* Select the fields to write */
           io_select_star_fields(sparts_written, with_cosmology, with_fof,
@@ -1435,7 +1469,7 @@ void write_output_distributed(struct engine* e,
           io_collect_bparts_to_write(
               bparts, bparts_written, subsample[swift_type_black_hole],
               subsample_fraction[swift_type_black_hole],
-              e->snapshot_output_count, Nblackholes, Nblackholes_written);
+              subsample_seed, Nblackholes, Nblackholes_written);
 
           /* Select the fields to write */
           io_select_bh_fields(bparts_written, with_cosmology, with_fof,
@@ -1553,8 +1587,8 @@ void write_output_distributed(struct engine* e,
   io_write_cell_offsets(h_grp_cells, e->s->cdim, e->s->dim, e->s->cells_top,
                         e->s->nr_cells, e->s->width, mpi_rank,
                         /*distributed=*/0, subsample, subsample_fraction,
-                        e->snapshot_output_count, N_total, global_offsets,
-                        to_write, numFields, internal_units, snapshot_units);
+                        subsample_seed, N_total, global_offsets, to_write,
+                        numFields, internal_units, snapshot_units);
 
   /* Close everything */
   if (mpi_rank == 0) {
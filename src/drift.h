@@ -105,6 +105,15 @@ __attribute__((always_inline)) INLINE static void drift_gpart(
   gp->x[1] += gp->v_full[1] * dt_drift;
   gp->x[2] += gp->v_full[2] * dt_drift;
 
+#ifdef WITH_FOF
+  /* Bound the distance moved since the last FOF call (the L1 norm of the
+   * velocity is never smaller than its length and needs no root) */
+  gp->fof_data.drift_since_fof += (fabsf(gp->v_full[0]) +
+                                   fabsf(gp->v_full[1]) +
+                                   fabsf(gp->v_full[2])) *
+                                  dt_drift;
+#endif
+
   gravity_predict_extra(gp, grav_props);
 
 #ifdef WITH_LIGHTCONE
@@ -68,9 +68,12 @@
 #include "equation_of_state.h"
 #include "error.h"
 #include "extra_io.h"
+#include "io_async.h"
+#include "io_compression.h"
 #include "feedback.h"
 #include "fof.h"
 #include "forcing.h"
+#include "gpart_soa.h"
 #include "gravity.h"
 #include "gravity_cache.h"
 #include "hydro.h"
@@ -79,13 +82,20 @@
 #include "line_of_sight.h"
 #include "map.h"
 #include "memuse.h"
+#include "memuse_arena.h"
+#include "memuse_phases.h"
+#include "metrics_export.h"
 #include "minmax.h"
+#include "mpi_aggregate.h"
+#include "mpi_comm_stats.h"
+#include "mpi_progress.h"
 #include "mpiuse.h"
 #include "multipole_struct.h"
 #include "neutrino.h"
 #include "neutrino_properties.h"
 #include "output_list.h"
 #include "output_options.h"
+#include "part_soa.h"
 #include "partition.h"
 #include "potential.h"
 #include "power_spectrum.h"
@@ -107,7 +117,17 @@
 #include "velociraptor_interface.h"
 
 /* Local Cuda headers. */
+#include "cuda_devices.h"
+#include "cuda_fof.h"
+#include "cuda_gpart_mirror.h"
+#include "cuda_lightcone.h"
+#include "cuda_multipole_build.h"
+#include "cuda_multipole_mirror.h"
+#include "cuda_pm_mesh.h"
+#include "cuda_power_spectrum.h"
 #include "cuda_streams.h"
+#include "cuda_top_multipoles.h"
+#include "cuda_work_split.h"
 
 const char *engine_policy_names[] = {"none",
                                      "rand",
@@ -139,7 +159,8 @@ const char *engine_policy_names[] = {"none",
                                      "rt",
                                      "power spectra",
                                      "moving mesh",
-                                     "moving mesh hydro"};
+                                     "moving mesh hydro",
+                                     "gravity only"};
 
 const int engine_default_snapshot_subsample[swift_type_count] = {0};
 
@@ -207,6 +228,8 @@ void engine_repartition(struct engine *e) {
    * bug that doesn't handle this case well. */
   if (e->nr_nodes == 1) return;
 
+  const enum memuse_phase phase = memuse_phases_begin(memuse_phase_repartition);
+
   /* Generate the fixed costs include file. */
   if (e->step > 3 && e->reparttype->trigger <= 1.f) {
     task_dump_stats("partition_fixed_costs.h", e,
@@ -214,6 +237,19 @@ void engine_repartition(struct engine *e) {
                     /* header = */ 1, /* allranks = */ 1);
   }
 
+  /* Report the volume of the messages the old partition needed. */
+  double comm_bytes[2 * e->nr_nodes];
+  mpi_comm_stats_get_node_bytes(comm_bytes, /*reset=*/1);
+  if (e->verbose) {
+    double recv_bytes = 0., send_bytes = 0.;
+    for (int k = 0; k < e->nr_nodes; k++) {
+      recv_bytes += comm_bytes[k];
+      send_bytes += comm_bytes[e->nr_nodes + k];
+    }
+    message("received %.3f MB and sent %.3f MB since the last repartition.",
+            recv_bytes / (1024. * 1024.), send_bytes / (1024. * 1024.));
+  }
+
   /* Do the repartitioning. */
   partition_repartition(e->reparttype, e->nodeID, e->nr_nodes, e->s,
                         e->sched.tasks, e->sched.nr_tasks);
@@ -253,6 +289,7 @@ void engine_repartition(struct engine *e) {
 
   /* Flag that a repartition has taken place */
   e->step_props |= engine_step_prop_repartition;
+  memuse_phases_end(phase);
 
   if (e->verbose)
     message("took %.3f %s.", clocks_from_ticks(getticks() - tic),
@@ -524,13 +561,23 @@ void engine_exchange_grid_extra(struct engine *e) {
 #endif
 }
 
+#ifdef WITH_MPI
+/*! The top-level multipoles being reduced and the request of the reduction */
+static struct gravity_tensors *engine_top_multipoles_reduced = NULL;
+static MPI_Request engine_top_multipoles_req = MPI_REQUEST_NULL;
+#endif
+
 /**
- * @brief Exchanges the top-level multipoles between all the nodes
+ * @brief Starts exchanging the top-level multipoles between all the nodes
  * such that every node has a multipole for each top-level cell.
  *
+ * The reduction runs in the background until
+ * engine_exchange_top_multipoles_end() is called, so the cells can be
+ * exchanged with the neighbouring nodes in the meantime.
+ *
  * @param e The #engine.
  */
-void engine_exchange_top_multipoles(struct engine *e) {
+void engine_exchange_top_multipoles_begin(struct engine *e) {
 
 #ifdef WITH_MPI
 
@@ -567,12 +614,52 @@ void engine_exchange_top_multipoles(struct engine *e) {
    * each multipole is only present once, the bit-by-bit XOR will
    * create the desired result.
    */
-  int err = MPI_Allreduce(MPI_IN_PLACE, e->s->multipoles_top, e->s->nr_cells,
-                          multipole_mpi_type, multipole_mpi_reduce_op,
-                          MPI_COMM_WORLD);
+  const size_t size = e->s->nr_cells * sizeof(struct gravity_tensors);
+  if (swift_memalign("multipoles_top_reduced",
+                     (void **)&engine_top_multipoles_reduced,
+                     SWIFT_CACHE_ALIGNMENT, size) != 0)
+    error("Unable to allocate memory for the top-level multipoles.");
+  memcpy(engine_top_multipoles_reduced, e->s->multipoles_top, size);
+
+  int err = MPI_Iallreduce(MPI_IN_PLACE, engine_top_multipoles_reduced,
+                           e->s->nr_cells, multipole_mpi_type,
+                           multipole_mpi_reduce_op, MPI_COMM_WORLD,
+                           &engine_top_multipoles_req);
+  if (err != MPI_SUCCESS)
+    mpi_error(err, "Failed to all-reduce the top-level multipoles.");
+
+  if (e->verbose)
+    message("took %.3f %s.", clocks_from_ticks(getticks() - tic),
+            clocks_getunit());
+#else
+  error("SWIFT was not compiled with MPI support.");
+#endif
+}
+
+/**
+ * @brief Waits for the exchange of the top-level multipoles started by
+ * engine_exchange_top_multipoles_begin() and stores the result.
+ *
+ * The proxy cells unpacked in the meantime received the same multipoles
+ * from their own node, so overwriting them changes nothing.
+ *
+ * @param e The #engine.
+ */
+void engine_exchange_top_multipoles_end(struct engine *e) {
+
+#ifdef WITH_MPI
+
+  ticks tic = getticks();
+
+  int err = MPI_Wait(&engine_top_multipoles_req, MPI_STATUS_IGNORE);
   if (err != MPI_SUCCESS)
     mpi_error(err, "Failed to all-reduce the top-level multipoles.");
 
+  memcpy(e->s->multipoles_top, engine_top_multipoles_reduced,
+         e->s->nr_cells * sizeof(struct gravity_tensors));
+  swift_free("multipoles_top_reduced", engine_top_multipoles_reduced);
+  engine_top_multipoles_reduced = NULL;
+
 #ifdef SWIFT_DEBUG_CHECKS
   long long counter = 0;
 
@@ -833,15 +920,25 @@ void engine_allocate_foreign_particles(struct engine *e, const int fof) {
       error("Failed to allocate foreign part data.");
   }
 
-  /* Allocate space for the foreign particles we will receive */
+  /* Allocate space for the foreign particles we will receive, only in their
+   * compact form if that is all we keep of them */
+  const int compact_gparts = e->sched.compact_foreign_gparts_in_memory;
+  const size_t sizeof_gpart_foreign =
+      compact_gparts ? sizeof(struct gpart_foreign) : sizeof(struct gpart);
   size_t old_size_gparts_foreign = s->size_gparts_foreign;
   if (count_gparts_in > s->size_gparts_foreign) {
     if (s->gparts_foreign != NULL)
       swift_free("gparts_foreign", s->gparts_foreign);
+    if (s->gparts_foreign_compact != NULL)
+      swift_free("gparts_foreign", s->gparts_foreign_compact);
+    s->gparts_foreign = NULL;
+    s->gparts_foreign_compact = NULL;
     s->size_gparts_foreign = engine_foreign_alloc_margin * count_gparts_in;
-    if (swift_memalign("gparts_foreign", (void **)&s->gparts_foreign,
+    if (swift_memalign("gparts_foreign",
+                       compact_gparts ? (void **)&s->gparts_foreign_compact
+                                      : (void **)&s->gparts_foreign,
                        gpart_align,
-                       sizeof(struct gpart) * s->size_gparts_foreign) != 0)
+                       sizeof_gpart_foreign * s->size_gparts_foreign) != 0)
       error("Failed to allocate foreign gpart data.");
   }
 
@@ -881,7 +978,7 @@ void engine_allocate_foreign_particles(struct engine *e, const int fof) {
         s->size_parts_foreign, s->size_gparts_foreign, s->size_sparts_foreign,
         s->size_bparts_foreign,
         s->size_parts_foreign * sizeof(struct part) / (1024 * 1024),
-        s->size_gparts_foreign * sizeof(struct gpart) / (1024 * 1024),
+        s->size_gparts_foreign * sizeof_gpart_foreign / (1024 * 1024),
         s->size_sparts_foreign * sizeof(struct spart) / (1024 * 1024),
         s->size_bparts_foreign * sizeof(struct bpart) / (1024 * 1024));
 
@@ -899,7 +996,7 @@ void engine_allocate_foreign_particles(struct engine *e, const int fof) {
           (s->size_parts_foreign - old_size_parts_foreign) *
               sizeof(struct part) / (1024 * 1024),
           (s->size_gparts_foreign - old_size_gparts_foreign) *
-              sizeof(struct gpart) / (1024 * 1024),
+              sizeof_gpart_foreign / (1024 * 1024),
           (s->size_sparts_foreign - old_size_sparts_foreign) *
               sizeof(struct spart) / (1024 * 1024),
           (s->size_bparts_foreign - old_size_bparts_foreign) *
@@ -910,6 +1007,7 @@ void engine_allocate_foreign_particles(struct engine *e, const int fof) {
   /* Unpack the cells and link to the particle data. */
   struct part *parts = s->parts_foreign;
   struct gpart *gparts = s->gparts_foreign;
+  struct gpart_foreign *gparts_compact = s->gparts_foreign_compact;
   struct spart *sparts = s->sparts_foreign;
   struct bpart *bparts = s->bparts_foreign;
   for (int k = 0; k < nr_proxies; k++) {
@@ -922,7 +1020,14 @@ void engine_allocate_foreign_particles(struct engine *e, const int fof) {
         parts = &parts[count_parts];
       }
 
-      if (e->proxies[k].cells_in_type[j] & proxy_cell_type_gravity) {
+      if (compact_gparts &&
+          e->proxies[k].cells_in_type[j] & proxy_cell_type_gravity) {
+
+        const size_t count_gparts = cell_link_foreign_gparts_compact(
+            e->proxies[k].cells_in[j], gparts_compact);
+        gparts_compact = &gparts_compact[count_gparts];
+
+      } else if (e->proxies[k].cells_in_type[j] & proxy_cell_type_gravity) {
 
         const size_t count_gparts =
             cell_link_foreign_gparts(e->proxies[k].cells_in[j], gparts);
@@ -948,7 +1053,10 @@ void engine_allocate_foreign_particles(struct engine *e, const int fof) {
 
   /* Update the counters */
   s->nr_parts_foreign = parts - s->parts_foreign;
-  s->nr_gparts_foreign = gparts - s->gparts_foreign;
+  if (compact_gparts)
+    s->nr_gparts_foreign = gparts_compact - s->gparts_foreign_compact;
+  else
+    s->nr_gparts_foreign = gparts - s->gparts_foreign;
   s->nr_sparts_foreign = sparts - s->sparts_foreign;
   s->nr_bparts_foreign = bparts - s->bparts_foreign;
 
@@ -1245,6 +1353,28 @@ int engine_estimate_nr_tasks(const struct engine *e) {
   return (int)(ncells * tasks_per_cell);
 }
 
+/**
+ * @brief Free the caches of the runners that are much larger than what they
+ * were used for since the last rebuild.
+ *
+ * The caches are re-allocated on their next use, at the size the current
+ * tree needs. The runners are idle during a rebuild so we can do this from
+ * here.
+ *
+ * @param e The #engine.
+ */
+static void engine_trim_runner_caches(struct engine *e) {
+
+  for (int k = 0; k < e->nr_threads; k++) {
+    gravity_cache_trim(&e->runners[k].ci_gravity_cache, e->cache_trim_factor);
+    gravity_cache_trim(&e->runners[k].cj_gravity_cache, e->cache_trim_factor);
+#ifdef WITH_VECTORIZATION
+    cache_trim(&e->runners[k].ci_cache, e->cache_trim_factor);
+    cache_trim(&e->runners[k].cj_cache, e->cache_trim_factor);
+#endif
+  }
+}
+
 /**
  * @brief Rebuild the space and tasks.
  *
@@ -1257,6 +1387,7 @@ void engine_rebuild(struct engine *e, const int repartitioned,
                     const int clean_smoothing_length_values) {
 
   const ticks tic = getticks();
+  const enum memuse_phase phase = memuse_phases_begin(memuse_phase_rebuild);
 
   /* Clear the forcerebuild flag, whatever it was. */
   e->forcerebuild = 0;
@@ -1266,6 +1397,10 @@ void engine_rebuild(struct engine *e, const int repartitioned,
   if (e->verbose && !repartitioned)
     scheduler_report_task_times(&e->sched, e->nr_threads);
 
+  /* Adapt the leaf sizes to the cost of the tasks we are about to drop */
+  if (space_split_tune_time > 0.f && e->s->with_self_gravity && !repartitioned)
+    space_split_tune(e->s, &e->sched, e->verbose);
+
   /* Give some breathing space */
   scheduler_free_tasks(&e->sched);
 
@@ -1276,7 +1411,20 @@ void engine_rebuild(struct engine *e, const int repartitioned,
 #endif
 
   /* Re-build the space. */
+  const int phase_reset = e->verbose ? memuse_phase_begin() : 0;
   space_rebuild(e->s, repartitioned, e->verbose);
+  e->time_bin_changes++;
+  e->collect_cache.valid = 0;
+  e->active_cells_top = NULL;
+  if (e->verbose)
+    message("Peak memory use of the rebuild: %.3f MB%s.",
+            memuse_phase_peak() / 1024., phase_reset ? "" : " (since start)");
+
+  /* Put the cells close to the runners that will work on them */
+  if (e->numa_cell_placement) engine_numa_place_cells(e);
+
+  /* Hand back the memory of the caches the new tree does not need */
+  if (e->cache_trim_factor > 0) engine_trim_runner_caches(e);
 
   /* Report the number of cells and memory */
   if (e->verbose)
@@ -1379,13 +1527,21 @@ void engine_rebuild(struct engine *e, const int repartitioned,
 /* If in parallel, exchange the cell structure, top-level and neighbouring
  * multipoles. To achieve this, free the foreign particle buffers first. */
 #ifdef WITH_MPI
-  if (e->policy & engine_policy_self_gravity) engine_exchange_top_multipoles(e);
+  if (e->policy & engine_policy_self_gravity)
+    engine_exchange_top_multipoles_begin(e);
 
   space_free_foreign_parts(e->s, /*clear_cell_pointers=*/1);
 
   engine_exchange_cells(e);
+
+  if (e->policy & engine_policy_self_gravity)
+    engine_exchange_top_multipoles_end(e);
 #endif
 
+  /* Number the leaves whose multipoles and gparts the GPU reads */
+  if (e->policy & engine_policy_self_gravity)
+    cuda_gpart_mirror_reset_leaves(cuda_multipole_mirror_index(e->s));
+
 #ifdef SWIFT_DEBUG_CHECKS
 
   /* Let's check that what we received makes sense */
@@ -1466,6 +1622,8 @@ void engine_rebuild(struct engine *e, const int repartitioned,
 
   /* Flag that a rebuild has taken place */
   e->step_props |= engine_step_prop_rebuild;
+  e->step_rebuild_ticks += getticks() - tic;
+  memuse_phases_end(phase);
 
   if (e->verbose)
     message("took %.3f %s.", clocks_from_ticks(getticks() - tic),
@@ -1570,8 +1728,10 @@ int engine_prepare(struct engine *e) {
   }
 #endif
 
-  /* Re-rank the tasks every now and then. XXX this never executes. */
-  if (e->tasks_age % engine_tasksreweight == 1) {
+  /* Re-rank the tasks every now and then. XXX this never executes, unless
+   * the weights follow the measured task costs, which change every step. */
+  if (e->tasks_age % engine_tasksreweight == 1 ||
+      (e->sched.measured_weights && e->tasks_age > 0)) {
     scheduler_reweight(&e->sched, e->verbose);
   }
   e->tasks_age += 1;
@@ -1637,8 +1797,13 @@ void engine_print_stats(struct engine *e) {
   struct statistics stats;
   stats_init(&stats);
 
-  /* Collect the stats on this node */
-  stats_collect(e->s, &stats);
+  /* Collect the stats on this node, unless the last drift already did */
+  if (e->drift_stats != NULL) {
+    stats_threads_reduce(e->drift_stats, e->threadpool.num_threads, &stats);
+    e->drift_stats = NULL;
+  } else {
+    stats_collect(e->s, &stats);
+  }
 
 /* Aggregate the data from the different nodes. */
 #ifdef WITH_MPI
@@ -1708,7 +1873,7 @@ void engine_skip_force_and_kick(struct engine *e) {
         t->type == task_type_bh_out || t->type == task_type_rt_ghost1 ||
         t->type == task_type_rt_ghost2 || t->type == task_type_rt_tchem ||
         t->type == task_type_rt_advance_cell_time ||
-        t->type == task_type_neutrino_weight || t->type == task_type_csds ||
+        t->type == task_type_csds ||
         t->subtype == task_subtype_force ||
         t->subtype == task_subtype_limiter ||
         t->subtype == task_subtype_gradient ||
@@ -1767,6 +1932,32 @@ void engine_skip_drift(struct engine *e) {
   space_map_cells_pre(e->s, 1, cell_clear_drift_flags, NULL);
 }
 
+/**
+ * @brief Computes the long-range mesh forces of the #gpart.
+ *
+ * In gravity-only runs, the computation can instead be left to the next
+ * engine_launch(), which runs it on the main thread and the threadpool
+ * while the runners go through the short-range gravity tasks. Only the
+ * end_grav_force tasks, and hence everything using the mesh forces after
+ * them, wait for it. Nothing else moves or changes the #gpart the mesh
+ * reads in such runs.
+ *
+ * @param e The #engine.
+ */
+void engine_compute_mesh_forces(struct engine *e) {
+
+  if (e->mesh->overlap_tasks && (e->policy & engine_policy_gravity_only)) {
+    e->mesh->overlap_pending = 1;
+    return;
+  }
+
+  const ticks tic = getticks();
+  const enum memuse_phase phase = memuse_phases_begin(memuse_phase_mesh);
+  pm_mesh_compute_potential(e->mesh, e->s, &e->threadpool, e->verbose);
+  memuse_phases_end(phase);
+  e->step_mesh_ticks += getticks() - tic;
+}
+
 /**
  * @brief Launch the runners.
  *
@@ -1786,13 +1977,35 @@ void engine_launch(struct engine *e, const char *call) {
     runner_reset_active_time(&e->runners[i]);
   }
 
+  /* Make room on the GPU for the gparts the tasks may upload */
+  cuda_gpart_mirror_ensure(e->s->size_gparts);
+
+  /* And in the host SoA copies the drift tasks fill */
+  gpart_soa_ensure(e->s->size_gparts);
+  part_soa_ensure(e->s->size_parts);
+
+  /* The top-level multipoles may have moved since the last launch */
+  cuda_top_multipoles_prepare(e);
+
   /* Prepare the scheduler. */
   atomic_inc(&e->sched.waiting);
 
+  /* Do we compute the mesh while the tasks run? If so, hold back the end of
+   * the gravity and keep the runners from going home without it. */
+  const int mesh_overlap = e->mesh->overlap_pending;
+  if (mesh_overlap) {
+    e->sched.hold_end_grav_force = 1;
+    atomic_inc(&e->sched.waiting);
+  }
+
+  /* Keep the messages moving while the runners are busy. */
+  mpi_progress_start();
+
   /* Cry havoc and let loose the dogs of war. */
   swift_barrier_wait(&e->run_barrier);
 
-  /* Load the tasks. */
+  /* Lay out the aggregated messages of the active tasks and load them. */
+  mpi_aggregate_prepare(&e->sched);
   scheduler_start(&e->sched);
 
   /* Remove the safeguard. */
@@ -1801,12 +2014,36 @@ void engine_launch(struct engine *e, const char *call) {
   pthread_cond_broadcast(&e->sched.sleep_cond);
   pthread_mutex_unlock(&e->sched.sleep_mutex);
 
+  /* The threadpool is ours again: compute the mesh and let the gravity
+   * finish. */
+  if (mesh_overlap) {
+    const ticks tic_mesh = getticks();
+    const enum memuse_phase phase = memuse_phases_begin(memuse_phase_mesh);
+    pm_mesh_compute_potential(e->mesh, e->s, &e->threadpool, e->verbose);
+    memuse_phases_end(phase);
+    e->step_mesh_ticks += getticks() - tic_mesh;
+    e->mesh->overlap_pending = 0;
+    scheduler_release_end_grav_force(&e->sched);
+  }
+
   /* Sit back and wait for the runners to come home. */
   swift_barrier_wait(&e->wait_barrier);
+  mpi_progress_stop();
+
+  /* Make sure the aggregated messages have left. */
+  mpi_aggregate_wait();
 
   /* Store the wallclock time */
   e->sched.total_ticks += getticks() - tic;
 
+  /* Move the CPU/GPU split of the P2P pairs towards what was measured */
+  cuda_work_split_update(&gpu_work_split, e->runners, e->nr_threads,
+                         e->verbose);
+
+  /* How busy was each GPU? */
+  e->step_gpu_ticks +=
+      cuda_devices_report(e->runners, e->nr_threads, e->verbose);
+
   /* accumulate active counts for all runners */
   ticks active_time = 0;
   for (int i = 0; i < e->nr_threads; ++i) {
@@ -1824,6 +2061,108 @@ void engine_launch(struct engine *e, const char *call) {
             clocks_getunit());
 }
 
+/**
+ * @brief Hand the runners over to a series of launches of the sub-cycles.
+ *
+ * Rather than going back to the barriers after each launch, the runners
+ * keep waiting for tasks in the scheduler, which a hold on its waiting
+ * counter keeps from going home, until engine_launch_sub_cycles_end(). The
+ * launches in between, engine_launch_sub_cycle(), only load the tasks and
+ * wait for them to be done. The GPU state of the step is the one the regular
+ * launch prepared: the sub-cycles don't change the sizes of the particle
+ * arrays.
+ *
+ * @param e The #engine.
+ */
+static void engine_launch_sub_cycles_begin(struct engine *e) {
+
+  /* The hold over all the sub-cycles */
+  atomic_inc(&e->sched.waiting);
+
+  /* Off they go, there is nothing to run yet. */
+  swift_barrier_wait(&e->run_barrier);
+}
+
+/**
+ * @brief Run the active tasks of a sub-cycle with the runners handed over by
+ * engine_launch_sub_cycles_begin().
+ *
+ * @param e The #engine.
+ * @param call Where was this function called from?
+ */
+static void engine_launch_sub_cycle(struct engine *e, const char *call) {
+  const ticks tic = getticks();
+  struct scheduler *s = &e->sched;
+
+#ifdef SWIFT_DEBUG_CHECKS
+  /* Re-set all the cell task counters to 0 */
+  space_reset_task_counters(e->s);
+  s->last_successful_task_fetch = 0LL;
+#endif
+
+  /* The runners are idle between the sub-cycles, count from here. */
+  ticks active_time = 0;
+  for (int i = 0; i < e->nr_threads; ++i)
+    active_time -= runner_get_active_time(&e->runners[i]);
+
+  /* Prepare the scheduler. */
+  atomic_inc(&s->waiting);
+  mpi_progress_start();
+  mpi_aggregate_prepare(s);
+  scheduler_start(s);
+
+  /* Remove the safeguard and wait until only our hold is left. */
+  pthread_mutex_lock(&s->sleep_mutex);
+  atomic_dec(&s->waiting);
+  pthread_cond_broadcast(&s->sleep_cond);
+  while (s->waiting > 1) pthread_cond_wait(&s->sleep_cond, &s->sleep_mutex);
+  pthread_mutex_unlock(&s->sleep_mutex);
+  mpi_progress_stop();
+
+  /* Make sure the aggregated messages have left. */
+  mpi_aggregate_wait();
+
+  /* Store the wallclock time */
+  s->total_ticks += getticks() - tic;
+
+  for (int i = 0; i < e->nr_threads; ++i)
+    active_time += runner_get_active_time(&e->runners[i]);
+  s->deadtime.active_ticks += active_time;
+  s->deadtime.waiting_ticks += getticks() - tic;
+
+  if (e->verbose)
+    message("(%s) took %.3f %s.", call, clocks_from_ticks(getticks() - tic),
+            clocks_getunit());
+}
+
+/**
+ * @brief Send the runners handed over by engine_launch_sub_cycles_begin()
+ * back to the barriers.
+ *
+ * @param e The #engine.
+ */
+static void engine_launch_sub_cycles_end(struct engine *e) {
+
+  /* Remove the hold. */
+  pthread_mutex_lock(&e->sched.sleep_mutex);
+  atomic_dec(&e->sched.waiting);
+  pthread_cond_broadcast(&e->sched.sleep_cond);
+  pthread_mutex_unlock(&e->sched.sleep_mutex);
+
+  /* Sit back and wait for the runners to come home. */
+  swift_barrier_wait(&e->wait_barrier);
+
+  /* The work split and device loads are measured over the sub-cycles */
+  cuda_work_split_update(&gpu_work_split, e->runners, e->nr_threads,
+                         e->verbose);
+  e->step_gpu_ticks +=
+      cuda_devices_report(e->runners, e->nr_threads, e->verbose);
+
+#ifdef SWIFT_DEBUG_CHECKS
+  e->sched.last_successful_task_fetch = 0LL;
+#endif
+}
+
 /**
  * @brief Calls the 'first init' function on the particles of all types.
  *
@@ -1959,6 +2298,15 @@ void engine_run_rt_sub_cycles(struct engine *e) {
    * This is used for a consistency/debugging check. */
   integertime_t rt_integration_end = e->ti_current_subcycle + rt_step_size;
 
+  /* Keep the runners and the waits of the tasks over the sub-cycles? */
+  const int persistent = e->rt_persistent_sub_cycles && nr_rt_cycles > 1;
+  if (persistent) {
+    for (int i = 0; i < e->nr_threads; ++i)
+      runner_reset_active_time(&e->runners[i]);
+    scheduler_rearm_begin(&e->sched);
+    engine_launch_sub_cycles_begin(e);
+  }
+
   for (int sub_cycle = 1; sub_cycle < nr_rt_cycles; ++sub_cycle) {
 
     /* Keep track of the wall-clock time of each additional sub-cycle. */
@@ -1994,7 +2342,10 @@ void engine_run_rt_sub_cycles(struct engine *e) {
     /* Do the actual work now. */
     engine_unskip_rt_sub_cycle(e);
     TIMER_TIC;
-    engine_launch(e, "cycles");
+    if (persistent)
+      engine_launch_sub_cycle(e, "cycles");
+    else
+      engine_launch(e, "cycles");
     TIMER_TOC(timer_runners);
 
     /* Compute the local accumulated deadtime. */
@@ -2045,6 +2396,11 @@ void engine_run_rt_sub_cycles(struct engine *e) {
     }
   }
 
+  if (persistent) {
+    engine_launch_sub_cycles_end(e);
+    scheduler_rearm_end(&e->sched);
+  }
+
   if (rt_integration_end != e->ti_end_min)
     error(
         "End of sub-cycling doesn't add up: got %lld should have %lld. Started "
@@ -2077,6 +2433,8 @@ void engine_init_particles(struct engine *e, int flag_entropy_ICs,
   /* reset the deadtime information in the scheduler */
   e->sched.deadtime.active_ticks = 0;
   e->sched.deadtime.waiting_ticks = 0;
+  for (int i = 0; i < e->nr_threads; ++i)
+    runner_reset_idle_times(&e->runners[i]);
 
   /* Update the softening lengths */
   if (e->policy & engine_policy_self_gravity)
@@ -2105,7 +2463,7 @@ void engine_init_particles(struct engine *e, int flag_entropy_ICs,
   if ((e->policy & engine_policy_self_gravity) && e->s->periodic) {
 
     /* Compute mesh forces */
-    pm_mesh_compute_potential(e->mesh, e->s, &e->threadpool, e->verbose);
+    engine_compute_mesh_forces(e);
 
     /* Compute mesh time-step length */
     engine_recompute_displacement_constraint(e);
@@ -2445,6 +2803,15 @@ int engine_step(struct engine *e) {
   MPI_Barrier(MPI_COMM_WORLD);
 #endif
   e->tic_step = getticks();
+  e->step_rebuild_ticks = 0;
+  e->step_mesh_ticks = 0;
+  e->step_gpu_ticks = 0;
+
+#ifdef SWIFT_DEBUG_TASKS
+  /* The GPU phases of the last step have been dumped, if needed */
+  for (int k = 0; k < e->nr_threads; k++)
+    cuda_timeline_reset(&e->runners[k].gpu_timeline);
+#endif
 
   if (e->nodeID == 0) {
 
@@ -2737,7 +3104,7 @@ int engine_step(struct engine *e) {
     if (!drifted_all) engine_drift_all(e, /*drift_mpole=*/0);
 
     /* ... and recompute */
-    pm_mesh_compute_potential(e->mesh, e->s, &e->threadpool, e->verbose);
+    engine_compute_mesh_forces(e);
 
     /* Check whether we need to update the mesh time-step length */
     engine_recompute_displacement_constraint(e);
@@ -2771,9 +3138,27 @@ int engine_step(struct engine *e) {
 
   /* Start all the tasks. */
   TIMER_TIC;
+  const enum memuse_phase phase = memuse_phases_begin(memuse_phase_tasks);
   engine_launch(e, "tasks");
+  memuse_phases_end(phase);
   TIMER_TOC(timer_runners);
 
+  /* Bin the times of the tasks, and write the histograms if it is time */
+  if (e->sched.histograms.frequency != 0) {
+    task_histograms_collect(&e->sched.histograms, &e->sched, e->tic_step);
+    if (e->step % e->sched.histograms.frequency == 0)
+      task_histograms_write(&e->sched.histograms, e->step);
+  }
+
+  /* Analyse the critical path of the tasks if it is time */
+  if (e->sched.critical_path.frequency != 0 &&
+      e->step % e->sched.critical_path.frequency == 0)
+    task_critical_path_analyse(&e->sched.critical_path, &e->sched, e->runners,
+                               e->nr_threads, e->tic_step, e->step);
+
+  /* Write the summary of the MPI messages if it is time */
+  mpi_comm_stats_end_step(e->step);
+
   /* Now record the CPU times used by the tasks. */
 #ifdef WITH_MPI
   double end_usertime = 0.0;
@@ -2783,6 +3168,15 @@ int engine_step(struct engine *e) {
   e->systime_last_step = end_systime - start_systime;
 #endif
 
+  /* Compute the local accumulated deadtime. */
+  const ticks deadticks = (e->nr_threads * e->sched.deadtime.waiting_ticks) -
+                          e->sched.deadtime.active_ticks;
+  e->local_deadtime = clocks_from_ticks(deadticks);
+
+  /* Start collecting the information about the next time-step, the checks
+   * below run while it is reduced across the nodes. */
+  engine_collect_end_of_step_begin(e);
+
 #ifdef SWIFT_HYDRO_DENSITY_CHECKS
   /* Run the brute-force hydro calculation for some parts */
   if (e->policy & engine_policy_hydro)
@@ -2833,13 +3227,8 @@ int engine_step(struct engine *e) {
   space_check_unskip_flags(e->s);
 #endif
 
-  /* Compute the local accumulated deadtime. */
-  const ticks deadticks = (e->nr_threads * e->sched.deadtime.waiting_ticks) -
-                          e->sched.deadtime.active_ticks;
-  e->local_deadtime = clocks_from_ticks(deadticks);
-
   /* Collect information about the next time-step */
-  engine_collect_end_of_step(e, 1);
+  engine_collect_end_of_step_end(e, 1);
   e->forcerebuild = e->collect_group1.forcerebuild;
   e->updates_since_rebuild += e->collect_group1.updated;
   e->g_updates_since_rebuild += e->collect_group1.g_updated;
@@ -2902,6 +3291,9 @@ int engine_step(struct engine *e) {
     rt_debugging_checks_end_of_step(e, e->verbose);
 #endif
 
+  /* Write the memory use of the phases if it is time */
+  memuse_phases_end_step(e->step);
+
   TIMER_TOC2(timer_step);
 
   clocks_gettime(&time2);
@@ -2910,6 +3302,9 @@ int engine_step(struct engine *e) {
   /* Time in ticks at the end of this step. */
   e->toc_step = getticks();
 
+  /* Export the metrics of the step if it is time */
+  metrics_export_end_step(e);
+
   return force_stop;
 }
 
@@ -2956,9 +3351,13 @@ void engine_reconstruct_multipoles(struct engine *e) {
   }
 #endif
 
-  threadpool_map(&e->threadpool, engine_do_reconstruct_multipoles_mapper,
-                 e->s->cells_top, e->s->nr_cells, sizeof(struct cell),
-                 threadpool_auto_chunk_size, e);
+  if (gpu_multipole_build.active)
+    cuda_multipole_build(e->s, e->s->local_cells_top, e->s->nr_local_cells,
+                         e->ti_current);
+  else
+    threadpool_map(&e->threadpool, engine_do_reconstruct_multipoles_mapper,
+                   e->s->cells_top, e->s->nr_cells, sizeof(struct cell),
+                   threadpool_auto_chunk_size, e);
 
   if (e->verbose)
     message("took %.3f %s.", clocks_from_ticks(getticks() - tic),
@@ -3189,6 +3588,170 @@ void engine_numa_policies(int rank, int verbose) {
 #endif
 }
 
+#if defined(HAVE_LIBNUMA) && defined(_GNU_SOURCE)
+/**
+ * @brief Moves the pages holding a range of memory to a NUMA node.
+ *
+ * @param start The start of the range.
+ * @param end The end of the range.
+ * @param node The NUMA node to move to.
+ * @param page_size The size of the memory pages.
+ */
+static void engine_numa_move(const void *start, const void *end,
+                             const int node, const size_t page_size) {
+
+  if (start == NULL || end <= start) return;
+  if (node < 0 || node >= (int)(8 * sizeof(unsigned long))) return;
+
+  /* Round the range to whole pages */
+  const size_t first = (size_t)start & ~(page_size - 1);
+  const size_t last = ((size_t)end + page_size - 1) & ~(page_size - 1);
+
+  /* Prefer that node and move what is already there. This is only a hint,
+   * so failures are not fatal. */
+  unsigned long nodemask = 1UL << node;
+  mbind((void *)first, last - first, MPOL_PREFERRED, &nodemask,
+        8 * sizeof(unsigned long) + 1, MPOL_MF_MOVE);
+}
+
+/**
+ * @brief Recursively gives a #cell and all its progenies to a queue.
+ *
+ * @param c The #cell.
+ * @param qid The ID of the queue.
+ */
+static void engine_numa_set_owner(struct cell *c, const short int qid) {
+
+  c->owner = qid;
+  if (c->split)
+    for (int k = 0; k < 8; k++)
+      if (c->progeny[k] != NULL) engine_numa_set_owner(c->progeny[k], qid);
+}
+#endif
+
+/**
+ * @brief Places the local top-level cells and their particles on the NUMA
+ * nodes of the queues.
+ *
+ * The local top-level cells are split in ranges of consecutive cells with
+ * similar numbers of particles, one per NUMA node the queues are on. The
+ * pages holding the particles of each range are moved to its node and the
+ * cells are given in turn to the queues of that node. The tasks of these
+ * cells are then enqueued to runners close to their data, and the queues
+ * steal from their own node first.
+ *
+ * Does nothing unless the runners are pinned and libnuma is available.
+ *
+ * @param e The #engine.
+ */
+void engine_numa_place_cells(struct engine *e) {
+
+#if defined(HAVE_LIBNUMA) && defined(_GNU_SOURCE)
+
+  const ticks tic = getticks();
+
+  struct space *s = e->s;
+  const struct scheduler *sched = &e->sched;
+  const int nr_queues = sched->nr_queues;
+  const int *local_cells = s->local_cells_top;
+  const int nr_local_cells = s->nr_local_cells;
+
+  if (numa_available() < 0 || nr_local_cells == 0) return;
+
+  /* Gather the queues of each domain */
+  int nr_domains = 0;
+  int domains[nr_queues], queue_count[nr_queues], queues[nr_queues];
+  for (int q = 0; q < nr_queues; q++) {
+    int d;
+    for (d = 0; d < nr_domains; d++)
+      if (domains[d] == sched->queue_domain[q]) break;
+    if (d == nr_domains) {
+      domains[nr_domains] = sched->queue_domain[q];
+      queue_count[nr_domains] = 0;
+      nr_domains++;
+    }
+    queue_count[d]++;
+  }
+
+  /* Nothing to gain on a single node */
+  if (nr_domains < 2) return;
+
+  int queue_offset[nr_domains], next_queue[nr_domains];
+  for (int d = 0, offset = 0; d < nr_domains; d++) {
+    queue_offset[d] = offset;
+    next_queue[d] = 0;
+    offset += queue_count[d];
+    queue_count[d] = 0;
+  }
+  for (int q = 0; q < nr_queues; q++) {
+    int d;
+    for (d = 0; d < nr_domains; d++)
+      if (domains[d] == sched->queue_domain[q]) break;
+    queues[queue_offset[d] + queue_count[d]++] = q;
+  }
+
+  /* Total number of particles in the local cells */
+  size_t total = 0;
+  for (int i = 0; i < nr_local_cells; i++) {
+    const struct cell *c = &s->cells_top[local_cells[i]];
+    total += c->hydro.count + c->grav.count + c->stars.count +
+             c->sinks.count + c->black_holes.count;
+  }
+  if (total == 0) return;
+
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+
+  /* Walk the cells in order, moving each node's range once it is done */
+  const void *start[6] = {NULL}, *end[6] = {NULL};
+  size_t done = 0;
+  int current = 0;
+  for (int i = 0; i <= nr_local_cells; i++) {
+
+    struct cell *c = (i < nr_local_cells) ? &s->cells_top[local_cells[i]]
+                                          : NULL;
+    const int d = (c != NULL) ? (int)(done * nr_domains / total) : -1;
+
+    /* Done with the previous range? */
+    if (d != current) {
+      for (int k = 0; k < 6; k++)
+        engine_numa_move(start[k], end[k], domains[current], page_size);
+      for (int k = 0; k < 6; k++) start[k] = end[k] = NULL;
+      current = d;
+    }
+    if (c == NULL) break;
+
+    /* Extend the range of this node to the particles of the cell */
+    const void *cell_start[6] = {c->hydro.parts,  c->hydro.xparts,
+                                 c->grav.parts,   c->stars.parts,
+                                 c->sinks.parts,  c->black_holes.parts};
+    const void *cell_end[6] = {
+        c->hydro.parts + c->hydro.count,   c->hydro.xparts + c->hydro.count,
+        c->grav.parts + c->grav.count,     c->stars.parts + c->stars.count,
+        c->sinks.parts + c->sinks.count,
+        c->black_holes.parts + c->black_holes.count};
+    for (int k = 0; k < 6; k++) {
+      if (cell_start[k] == NULL || cell_end[k] == cell_start[k]) continue;
+      if (start[k] == NULL || cell_start[k] < start[k])
+        start[k] = cell_start[k];
+      if (end[k] == NULL || cell_end[k] > end[k]) end[k] = cell_end[k];
+    }
+
+    /* And give the cell to the next queue of the node */
+    const int qid =
+        queues[queue_offset[d] + next_queue[d]++ % queue_count[d]];
+    engine_numa_set_owner(c, qid);
+
+    done += c->hydro.count + c->grav.count + c->stars.count + c->sinks.count +
+            c->black_holes.count;
+  }
+
+  if (e->verbose)
+    message("Placing the cells on %d NUMA nodes took %.3f %s.", nr_domains,
+            clocks_from_ticks(getticks() - tic), clocks_getunit());
+
+#endif
+}
+
 /**
  * @brief init an engine struct with the necessary properties for the
  *        simulation.
@@ -3275,9 +3838,25 @@ void engine_init(
   e->total_nr_bparts = Nblackholes;
   e->total_nr_DM_background_gparts = Nbackground_gparts;
   e->total_nr_neutrino_gparts = Nnuparts;
+
+  /* With nothing but gravity and no baryons, the time-integration tasks can
+   * ignore all the other sub-systems of the cells. */
+  const int non_gravity_policies =
+      engine_policy_hydro | engine_policy_stars | engine_policy_cooling |
+      engine_policy_temperature | engine_policy_star_formation |
+      engine_policy_feedback | engine_policy_black_holes | engine_policy_sinks |
+      engine_policy_rt | engine_policy_grid | engine_policy_grid_hydro |
+      engine_policy_timestep_limiter | engine_policy_csds;
+  if ((policy &
+       (engine_policy_self_gravity | engine_policy_external_gravity)) &&
+      !(policy & non_gravity_policies) && Ngas == 0 && Nstars == 0 &&
+      Nsinks == 0 && Nblackholes == 0)
+    e->policy |= engine_policy_gravity_only;
+
   e->proxy_ind = NULL;
   e->nr_proxies = 0;
   e->ti_old = 0;
+  e->time_bin_changes = 0;
   e->ti_current = 0;
   e->ti_earliest_undrifted = 0;
   e->time_step = 0.;
@@ -3319,6 +3898,8 @@ void engine_init(
   parser_get_opt_param_float_array(params, "Snapshots:subsample_fraction",
                                    swift_type_count,
                                    e->snapshot_subsample_fraction);
+  e->snapshot_subsample_same_particles =
+      parser_get_opt_param_int(params, "Snapshots:subsample_same_particles", 0);
   e->snapshot_run_on_dump =
       parser_get_opt_param_int(params, "Snapshots:run_on_dump", 0);
   if (e->snapshot_run_on_dump) {
@@ -3329,6 +3910,29 @@ void engine_init(
       parser_get_opt_param_int(params, "Snapshots:compression", 0);
   e->snapshot_distributed =
       parser_get_opt_param_int(params, "Snapshots:distributed", 0);
+  e->snapshot_asynchronous =
+      parser_get_opt_param_int(params, "Snapshots:asynchronous", 0);
+  if (e->snapshot_asynchronous) {
+#if defined(HAVE_HDF5) && defined(WITH_MPI)
+    if (!e->snapshot_distributed)
+      error("Snapshots:asynchronous requires Snapshots:distributed.");
+    io_async_check();
+#else
+    error("Snapshots:asynchronous requires MPI and HDF5.");
+#endif
+  }
+  e->snapshot_parallel_compression =
+      parser_get_opt_param_int(params, "Snapshots:parallel_compression", 0);
+#ifndef IO_PARALLEL_COMPRESSION
+  if (e->snapshot_parallel_compression)
+    error(
+        "Snapshots:parallel_compression requires zlib and HDF5 1.10.3 or "
+        "newer.");
+#endif
+  e->snapshot_cell_sized_chunks =
+      parser_get_opt_param_int(params, "Snapshots:cell_sized_chunks", 0);
+  e->snapshot_tune_mpi_hints =
+      parser_get_opt_param_int(params, "Snapshots:tune_mpi_hints", 0);
   e->snapshot_lustre_OST_count =
       parser_get_opt_param_int(params, "Snapshots:lustre_OST_count", 0);
   e->snapshot_invoke_stf =
@@ -3351,6 +3955,13 @@ void engine_init(
       params, "Scheduler:free_foreign_during_restart", 0);
   e->free_foreign_when_rebuilding = parser_get_opt_param_int(
       params, "Scheduler:free_foreign_during_rebuild", 0);
+  e->numa_cell_placement =
+      parser_get_opt_param_int(params, "Scheduler:numa_cell_placement", 0);
+  e->cache_trim_factor =
+      parser_get_opt_param_int(params, "Scheduler:cache_trim_factor", 4);
+  memuse_arena_init(
+      &memuse_transient_arena, "transient_arena",
+      parser_get_opt_param_int(params, "Scheduler:transient_arena_keep", 0));
   e->snapshot_output_count = 0;
   e->stf_output_count = 0;
   e->los_output_count = 0;
@@ -3375,6 +3986,7 @@ void engine_init(
   e->ti_next_stf = 0;
   e->ti_next_fof = 0;
   e->ti_next_ps = 0;
+  e->ti_next_proj = 0;
   e->verbose = verbose;
   e->wallclock_time = 0.f;
   e->physical_constants = physical_constants;
@@ -3483,6 +4095,17 @@ void engine_init(
         parser_get_opt_param_double(params, "LineOfSight:delta_time", -1.);
   }
 
+  /* Initialise projection maps output. */
+  projection_maps_init(&e->projection_maps, params);
+  if (e->projection_maps.enabled) {
+    e->time_first_proj =
+        parser_get_opt_param_double(params, "ProjectionMaps:time_first", 0.);
+    e->a_first_proj = parser_get_opt_param_double(
+        params, "ProjectionMaps:scale_factor_first", 0.1);
+    e->delta_time_proj =
+        parser_get_opt_param_double(params, "ProjectionMaps:delta_time", -1.);
+  }
+
   /* Initialise power spectrum output. */
   if (e->policy & engine_policy_power_spectra) {
     e->time_first_ps_output =
@@ -3535,9 +4158,6 @@ void engine_init(
     csds_init(e->csds, e, params);
   }
 #endif
-
-  /* In GPU land, we need to create our cuda streams. */
-  engine_cuda_init_streams(/*TODO: don't hardcode this. num_streams*/ 16);
 }
 
 /**
@@ -3726,7 +4346,19 @@ void engine_recompute_displacement_constraint(struct engine *e) {
   /* What is the allowed time-step size
    * Note: The cosmology factor is 1 in non-cosmo runs */
   double dt_mesh = e->dt_max_RMS_displacement * e->cosmology->time_step_factor;
-  dt_mesh = min(dt_mesh, e->dt_max);
+
+  /* The dynamical time on the scale of the mesh, if known, replaces the
+   * maximal time-step of the particles such that the mesh can be computed
+   * less often than the top time-bin is active. When the mesh is computed
+   * alongside the tasks, this is the one of its last computation. */
+  const double dt_mesh_dyn = pm_mesh_dynamical_timestep(e->mesh, e->cosmology);
+  if (dt_mesh_dyn < FLT_MAX)
+    dt_mesh = min(dt_mesh, dt_mesh_dyn * e->cosmology->time_step_factor);
+  else
+    dt_mesh = min(dt_mesh, e->dt_max);
+
+  /* Stay on the time-line */
+  dt_mesh = min(dt_mesh, max_nr_timesteps * e->time_base);
 
   /* Convert to integer time */
   integertime_t new_dti = (integertime_t)(dt_mesh * e->time_base_inv);
@@ -3780,8 +4412,34 @@ void engine_clean(struct engine *e, const int fof, const int restart) {
 #endif
     gravity_cache_clean(&e->runners[k].ci_gravity_cache);
     gravity_cache_clean(&e->runners[k].cj_gravity_cache);
+    cuda_gravity_cache_clean(&e->runners[k].ci_cuda_gravity_cache);
+    cuda_gravity_cache_clean(&e->runners[k].cj_cuda_gravity_cache);
+    cuda_pair_batch_clean(&e->runners[k].gpu_pair_batch);
+    cuda_mm_batch_clean(&e->runners[k].gpu_mm_batch);
+    cuda_timeline_clean(&e->runners[k].gpu_timeline);
+    task_counters_clean(&e->runners[k].counters);
+    cuda_hydro_cache_clean(&e->runners[k].ci_cuda_hydro_cache);
+    cuda_hydro_cache_clean(&e->runners[k].cj_cuda_hydro_cache);
+    cuda_rt_cache_clean(&e->runners[k].cuda_rt_cache);
+    hydro_ngb_list_clean(&e->runners[k].ghost_ngb_list);
+    runner_scratch_clean(&e->runners[k].scratch);
   }
+  cuda_gpart_mirror_clean();
+  cuda_multipole_mirror_clean();
+  cuda_multipole_build_clean();
+  cuda_top_multipoles_clean();
+  cuda_pm_mesh_clean();
+  cuda_fof_clean();
+  cuda_power_spectrum_clean();
+  cuda_lightcone_clean();
+  gpart_soa_clean();
+  part_soa_clean();
+  memuse_arena_clean(&memuse_transient_arena);
+  destroy_persistent_cuda_streams();
+  cuda_devices_clean();
   swift_free("runners", e->runners);
+  engine_unskip_cache_clean(e);
+  engine_collect_cache_clean(e);
   free(e->snapshot_units);
 
   output_list_clean(&e->output_list_snapshots);
@@ -3789,6 +4447,7 @@ void engine_clean(struct engine *e, const int fof, const int restart) {
   output_list_clean(&e->output_list_stf);
   output_list_clean(&e->output_list_los);
   output_list_clean(&e->output_list_ps);
+  output_list_clean(&e->output_list_proj);
 
   output_options_clean(e->output_options);
 
@@ -3810,6 +4469,7 @@ void engine_clean(struct engine *e, const int fof, const int restart) {
   }
   free(e->proxy_ind);
   free(e->proxies);
+  if (e->proxy_comm != MPI_COMM_NULL) MPI_Comm_free(&e->proxy_comm);
 
   /* Free types */
   part_free_mpi_types();
@@ -3817,6 +4477,9 @@ void engine_clean(struct engine *e, const int fof, const int restart) {
   stats_free_mpi_type();
   proxy_free_mpi_type();
   task_free_mpi_comms();
+  mpi_aggregate_clean();
+  mpi_comm_stats_clean();
+  mpi_progress_clean();
   if (!fof) mpicollect_free_MPI_type();
 #endif
 
@@ -3874,6 +4537,7 @@ void engine_clean(struct engine *e, const int fof, const int restart) {
     if (e->output_list_stf) free((void *)e->output_list_stf);
     if (e->output_list_los) free((void *)e->output_list_los);
     if (e->output_list_ps) free((void *)e->output_list_ps);
+    if (e->output_list_proj) free((void *)e->output_list_proj);
 #ifdef WITH_CSDS
     if (e->policy & engine_policy_csds) free((void *)e->csds);
 #endif
@@ -43,6 +43,7 @@
 #include "output_options.h"
 #include "parser.h"
 #include "partition.h"
+#include "projection_maps.h"
 #include "runner.h"
 #include "scheduler.h"
 #include "space.h"
@@ -55,6 +56,7 @@ struct black_holes_properties;
 struct extra_io_properties;
 struct external_potential;
 struct forcing_terms;
+struct statistics;
 
 /**
  * @brief The different policies the #engine can follow.
@@ -91,8 +93,9 @@ enum engine_policy {
   engine_policy_power_spectra = (1 << 27),
   engine_policy_grid = (1 << 28),
   engine_policy_grid_hydro = (1 << 29),
+  engine_policy_gravity_only = (1 << 30),
 };
-#define engine_maxpolicy 30
+#define engine_maxpolicy 31
 extern const char *engine_policy_names[engine_maxpolicy + 1];
 
 /**
@@ -141,6 +144,50 @@ extern int engine_rank;
  */
 extern int engine_current_step;
 
+/**
+ * @brief The active top-level cells of the max active bins that came up
+ * since the particles last changed bins, see engine_unskip().
+ */
+struct engine_unskip_cache {
+
+  /*! The indices of the active cells, one list per max active bin. */
+  int *cells[num_time_bins + 1];
+
+  /*! Number of cells in each list, and number they have room for. */
+  int count[num_time_bins + 1], size[num_time_bins + 1];
+
+  /*! Value of engine::time_bin_changes each list was built at, -1 if never
+   * built. */
+  long long stamp[num_time_bins + 1];
+};
+
+/*! Number of trailing zero bits an integer time can have, plus one */
+#define engine_collect_cache_nr_keys 64
+
+/**
+ * @brief What the end-of-step collection remembers of the local top-level
+ * cells, such that it then only needs to look at the active ones.
+ */
+struct engine_collect_cache {
+
+  /*! Number of trailing zero bits of the grav.ti_end_min of each top-level
+   * cell when it was last collected, -1 for the ones not counted. */
+  signed char *key;
+
+  /*! Number of top-level cells key has room for. */
+  int size;
+
+  /*! Number of counted local top-level cells for each key. */
+  int count[engine_collect_cache_nr_keys];
+
+  /*! The hydro, RT, stars, sinks and black holes end-of-step times of the
+   * last collection over all the cells. */
+  integertime_t ti_end_min[5], ti_beg_max[5];
+
+  /*! Is all of this up to date? */
+  int valid;
+};
+
 /* Data structure for the engine. */
 struct engine {
 
@@ -209,6 +256,36 @@ struct engine {
   /* Maximal number of radiative transfer sub-cycles per hydro step */
   int max_nr_rt_subcycles;
 
+  /* Keep the runners in the scheduler and re-arm the same tasks from their
+   * recorded waits over the RT sub-cycles? */
+  int rt_persistent_sub_cycles;
+
+  /* Finish the hydro force of the particles in the cooling tasks, just
+   * before cooling them, rather than in a task of its own? */
+  int fuse_end_force_cooling;
+
+  /* Reuse the active top-level cells found the last time the same max active
+   * bin came up, as long as no particle changed bin since? */
+  int unskip_cache_active;
+
+  /* The cached lists of active top-level cells */
+  struct engine_unskip_cache unskip_cache;
+
+  /* Number of rebuilds, and of time-step tasks that changed the time-bin of
+   * a particle, since the start */
+  long long time_bin_changes;
+
+  /* Collect the end of the steps from the active top-level cells only? */
+  int collect_cache_active;
+
+  /* What the collection knows of the other top-level cells */
+  struct engine_collect_cache collect_cache;
+
+  /* The active local top-level cells found by engine_unskip() in this step,
+   * NULL if it did not run */
+  int *active_cells_top;
+  int nr_active_cells_top;
+
   /* Time step */
   double time_step;
 
@@ -348,8 +425,13 @@ struct engine {
   char snapshot_dump_command[PARSER_MAX_LINE_SIZE];
   int snapshot_subsample[swift_type_count];
   float snapshot_subsample_fraction[swift_type_count];
+  int snapshot_subsample_same_particles;
   int snapshot_run_on_dump;
   int snapshot_distributed;
+  int snapshot_asynchronous;
+  int snapshot_parallel_compression;
+  int snapshot_cell_sized_chunks;
+  int snapshot_tune_mpi_hints;
   int snapshot_lustre_OST_count;
   int snapshot_compression;
   int snapshot_invoke_stf;
@@ -430,6 +512,9 @@ struct engine {
   /* File handle for the statistics */
   FILE *file_stats;
 
+  /* Per-thread statistics to collect while drifting everything, if any */
+  struct statistics *drift_stats;
+
   /* File handle for the timesteps information */
   FILE *file_timesteps;
 
@@ -457,6 +542,10 @@ struct engine {
   ticks tic_step, toc_step;
 
 #ifdef WITH_MPI
+  /* Graph communicator over the proxies, the neighbours being in the order
+   * of the proxies (see engine_makeproxies()). */
+  MPI_Comm proxy_comm;
+
   /* CPU times that the tasks used in the last step. */
   double usertime_last_step;
   double systime_last_step;
@@ -472,6 +561,12 @@ struct engine {
   /* Wallclock time of the last time-step */
   float wallclock_time;
 
+  /* Wallclock ticks the last time-step spent rebuilding and on the mesh */
+  ticks step_rebuild_ticks, step_mesh_ticks;
+
+  /* Ticks the runners spent in offloaded GPU calls in the last time-step */
+  ticks step_gpu_ticks;
+
   /* Are we in the process of restaring a simulation? */
   int restarting;
 
@@ -592,12 +687,31 @@ struct engine {
   /* Number of Lustre OSTs on the system to use as rank-based striping offset */
   int restart_lustre_OST_count;
 
+  /* zlib level used to compress the large blocks of the restart files */
+  int restart_compression;
+
+  /* Size of the buffer used to write the restart files (0 for default) */
+  size_t restart_buffer_size;
+
+  /* Node-local directory the restart files are written to before being
+   * copied to the restart directory in the background ("none" to write them
+   * there directly). */
+  char restart_local_dir[PARSER_MAX_LINE_SIZE];
+
   /* Do we free the foreign data before writing restart files? */
   int free_foreign_when_dumping_restart;
 
   /* Do we free the foreign data before rebuilding the tree? */
   int free_foreign_when_rebuilding;
 
+  /* Do we place the cells and their particles on the NUMA nodes of the
+   * queues after each rebuild? */
+  int numa_cell_placement;
+
+  /* Runner caches larger than this many times what they were used for
+   * between two rebuilds are freed at the rebuild (0 to never free them). */
+  int cache_trim_factor;
+
   /* Name of the restart file directory. */
   const char *restart_dir;
 
@@ -663,6 +777,14 @@ struct engine {
   integertime_t ti_next_los;
   int los_output_count;
 
+  /* Projection maps properties and outputs information. */
+  struct projection_maps_props projection_maps;
+  struct output_list *output_list_proj;
+  double a_first_proj;
+  double time_first_proj;
+  double delta_time_proj;
+  integertime_t ti_next_proj;
+
   /* Lightcone information */
   int flush_lightcone_maps;
 
@@ -689,9 +811,14 @@ void engine_compute_next_stf_time(struct engine *e);
 void engine_compute_next_fof_time(struct engine *e);
 void engine_compute_next_statistics_time(struct engine *e);
 void engine_compute_next_los_time(struct engine *e);
+void engine_compute_next_projection_time(struct engine *e);
 void engine_compute_next_ps_time(struct engine *e);
 void engine_recompute_displacement_constraint(struct engine *e);
 void engine_unskip(struct engine *e);
+void engine_unskip_cache_reset(struct engine *e);
+void engine_unskip_cache_clean(struct engine *e);
+void engine_collect_cache_reset(struct engine *e);
+void engine_collect_cache_clean(struct engine *e);
 void engine_unskip_rt_sub_cycle(struct engine *e);
 void engine_drift_all(struct engine *e, const int drift_mpoles);
 void engine_drift_top_multipoles(struct engine *e);
@@ -701,8 +828,11 @@ void engine_print_stats(struct engine *e);
 void engine_io(struct engine *e);
 void engine_io_check_snapshot_triggers(struct engine *e);
 void engine_collect_end_of_step(struct engine *e, int apply);
+void engine_collect_end_of_step_begin(struct engine *e);
+void engine_collect_end_of_step_end(struct engine *e, int apply);
 void engine_collect_end_of_sub_cycle(struct engine *e);
 void engine_dump_snapshot(struct engine *e, const int fof);
+void engine_dump_snapshot_wait(struct engine *e);
 void engine_run_on_dump(struct engine *e);
 void engine_init_output_lists(struct engine *e, struct swift_params *params,
                               const struct output_options *output_options);
@@ -737,6 +867,7 @@ void engine_config(int restart, int fof, struct engine *e,
                    int verbose, const char *restart_dir,
                    const char *restart_file, struct repartition *reparttype);
 void engine_launch(struct engine *e, const char *call);
+void engine_compute_mesh_forces(struct engine *e);
 int engine_prepare(struct engine *e);
 void engine_run_rt_sub_cycles(struct engine *e);
 void engine_init_particles(struct engine *e, int flag_entropy_ICs,
@@ -782,6 +913,7 @@ void engine_init_split_gas_particles(struct engine *e);
 cpu_set_t *engine_entry_affinity(void);
 #endif
 void engine_numa_policies(int rank, int verbose);
+void engine_numa_place_cells(struct engine *e);
 
 /* Struct dump/restore support. */
 void engine_struct_dump(struct engine *e, FILE *stream);
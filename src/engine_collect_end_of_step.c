@@ -25,6 +25,10 @@
 /* This object's header. */
 #include "engine.h"
 
+/* System includes. */
+#include <stdlib.h>
+#include <string.h>
+
 /* Local headers. */
 #include "active.h"
 #include "lightcone/lightcone_array.h"
@@ -190,6 +194,175 @@ void engine_collect_end_of_step_mapper(void *map_data, int num_elements,
   if (lock_unlock(&s->lock) != 0) error("Failed to unlock the space");
 }
 
+/**
+ * @brief The key of a cell in the #engine_collect_cache.
+ *
+ * On the time-line, the end of the step of a cell is the first multiple of
+ * 2^n after the current time, with n the number of trailing zero bits of
+ * that end. This stays true for as long as the cell is not active.
+ *
+ * @param c The #cell.
+ * @param ti_current The current integer time.
+ * @return The key, -1 if the cell does not count.
+ */
+static int engine_collect_cache_key(const struct cell *c,
+                                    const integertime_t ti_current) {
+
+  if (c->grav.count == 0 || c->grav.ti_end_min <= ti_current) return -1;
+  return __builtin_ctzll((unsigned long long)c->grav.ti_end_min);
+}
+
+/**
+ * @brief Forget what the end-of-step collection knows of the cells, without
+ * freeing it.
+ *
+ * To be used on a fresh #engine or one just read from a restart file, where
+ * the pointers are not valid.
+ *
+ * @param e The #engine.
+ */
+void engine_collect_cache_reset(struct engine *e) {
+
+  bzero(&e->collect_cache, sizeof(struct engine_collect_cache));
+  e->active_cells_top = NULL;
+  e->nr_active_cells_top = 0;
+}
+
+/**
+ * @brief Free what the end-of-step collection knows of the cells.
+ *
+ * @param e The #engine.
+ */
+void engine_collect_cache_clean(struct engine *e) {
+
+  free(e->collect_cache.key);
+  engine_collect_cache_reset(e);
+}
+
+/**
+ * @brief Remember the result of a collection over all the local top-level
+ * cells.
+ *
+ * @param e The #engine.
+ * @param data The collected data.
+ */
+static void engine_collect_cache_fill(struct engine *e,
+                                      const struct end_of_step_data *data) {
+
+  struct engine_collect_cache *cache = &e->collect_cache;
+  const struct space *s = e->s;
+
+  if (cache->size < s->nr_cells) {
+    free(cache->key);
+    cache->size = s->nr_cells;
+    cache->key = (signed char *)malloc(cache->size * sizeof(signed char));
+    if (cache->key == NULL) error("Failed to allocate the collection cache.");
+  }
+
+  memset(cache->key, -1, s->nr_cells * sizeof(signed char));
+  bzero(cache->count, engine_collect_cache_nr_keys * sizeof(int));
+  for (int k = 0; k < s->nr_local_cells; k++) {
+    const int cid = s->local_cells_top[k];
+    const int key = engine_collect_cache_key(&s->cells_top[cid], e->ti_current);
+    cache->key[cid] = key;
+    if (key >= 0) cache->count[key]++;
+  }
+
+  cache->ti_end_min[0] = data->ti_hydro_end_min;
+  cache->ti_end_min[1] = data->ti_rt_end_min;
+  cache->ti_end_min[2] = data->ti_stars_end_min;
+  cache->ti_end_min[3] = data->ti_sinks_end_min;
+  cache->ti_end_min[4] = data->ti_black_holes_end_min;
+  cache->ti_beg_max[0] = data->ti_hydro_beg_max;
+  cache->ti_beg_max[1] = data->ti_rt_beg_max;
+  cache->ti_beg_max[2] = data->ti_stars_beg_max;
+  cache->ti_beg_max[3] = data->ti_sinks_beg_max;
+  cache->ti_beg_max[4] = data->ti_black_holes_beg_max;
+  cache->valid = 1;
+}
+
+/**
+ * @brief Collect the data from the end of the step from the active local
+ * top-level cells only.
+ *
+ * The others have not changed since they were last collected. Their earliest
+ * end of step follows from the counts of the #engine_collect_cache and their
+ * last beginning of step is before the one of the active cells.
+ *
+ * Only valid in gravity-only runs, where nothing but the gravity of the cells
+ * changes between two rebuilds and no star forms.
+ *
+ * @param e The #engine.
+ * @param data The data to fill.
+ * @return 0 if no active cell is local, in which case nothing was done.
+ */
+static int engine_collect_end_of_step_active(struct engine *e,
+                                             struct end_of_step_data *data) {
+
+  struct engine_collect_cache *cache = &e->collect_cache;
+  struct space *s = e->s;
+  const integertime_t ti_current = e->ti_current;
+
+  /* Update the few cells that changed */
+  int nr_local_active = 0;
+  for (int k = 0; k < e->nr_active_cells_top; k++) {
+    const int cid = e->active_cells_top[k];
+    struct cell *c = &s->cells_top[cid];
+    if (c->nodeID != e->nodeID) continue;
+    nr_local_active++;
+
+    data->g_updated += c->grav.updated;
+    data->ti_gravity_beg_max =
+        max(data->ti_gravity_beg_max, c->grav.ti_beg_max);
+    c->grav.updated = 0;
+
+    const int key = engine_collect_cache_key(c, ti_current);
+    if (cache->key[cid] >= 0) cache->count[cache->key[cid]]--;
+    if (key >= 0) cache->count[key]++;
+    cache->key[cid] = key;
+  }
+  if (nr_local_active == 0) return 0;
+
+  /* The earliest end of step of all the cells */
+  for (int key = 0; key < engine_collect_cache_nr_keys; key++) {
+    if (cache->count[key] == 0) continue;
+    const integertime_t ti_end = ((ti_current >> key) + 1) << key;
+    data->ti_gravity_end_min = min(data->ti_gravity_end_min, ti_end);
+  }
+
+  data->ti_hydro_end_min = cache->ti_end_min[0];
+  data->ti_rt_end_min = cache->ti_end_min[1];
+  data->ti_stars_end_min = cache->ti_end_min[2];
+  data->ti_sinks_end_min = cache->ti_end_min[3];
+  data->ti_black_holes_end_min = cache->ti_end_min[4];
+  data->ti_hydro_beg_max = cache->ti_beg_max[0];
+  data->ti_rt_beg_max = cache->ti_beg_max[1];
+  data->ti_stars_beg_max = cache->ti_beg_max[2];
+  data->ti_sinks_beg_max = cache->ti_beg_max[3];
+  data->ti_black_holes_beg_max = cache->ti_beg_max[4];
+
+#ifdef SWIFT_DEBUG_CHECKS
+  /* Check against all the cells */
+  integertime_t ti_end_min = max_nr_timesteps, ti_beg_max = 0;
+  for (int k = 0; k < s->nr_local_cells; k++) {
+    const struct cell *c = &s->cells_top[s->local_cells_top[k]];
+    if (c->grav.count == 0) continue;
+    if (c->grav.ti_end_min > ti_current)
+      ti_end_min = min(ti_end_min, c->grav.ti_end_min);
+    ti_beg_max = max(ti_beg_max, c->grav.ti_beg_max);
+  }
+  if (ti_end_min != data->ti_gravity_end_min ||
+      ti_beg_max != data->ti_gravity_beg_max)
+    error(
+        "Collected wrong times from the active cells: end %lld (should be "
+        "%lld), beginning %lld (should be %lld)",
+        data->ti_gravity_end_min, ti_end_min, data->ti_gravity_beg_max,
+        ti_beg_max);
+#endif
+
+  return 1;
+}
+
 /**
  * @brief Collects the next time-step and rebuild flag.
  *
@@ -209,6 +382,27 @@ void engine_collect_end_of_step_mapper(void *map_data, int num_elements,
  */
 void engine_collect_end_of_step(struct engine *e, int apply) {
 
+  engine_collect_end_of_step_begin(e);
+  engine_collect_end_of_step_end(e, apply);
+}
+
+#if defined(WITH_MPI) && defined(SWIFT_DEBUG_CHECKS)
+/*! The local values of the reduction in flight, to check its result. */
+static struct collectgroup1 engine_collect_local_group1;
+#endif
+
+/**
+ * @brief Collects the next time-step and rebuild flag of this node and starts
+ * reducing them across all the nodes.
+ *
+ * Work that does not need the results can be done until
+ * engine_collect_end_of_step_end() is called, hiding the latency of the
+ * reduction.
+ *
+ * @param e The #engine.
+ */
+void engine_collect_end_of_step_begin(struct engine *e) {
+
   const ticks tic = getticks();
   struct space *s = e->s;
   struct end_of_step_data data;
@@ -242,10 +436,17 @@ void engine_collect_end_of_step(struct engine *e, int apply) {
   /* Initialize the total SFH of the simulation to zero */
   star_formation_logger_init(&data.sfh);
 
-  /* Collect information from the local top-level cells */
-  threadpool_map(&e->threadpool, engine_collect_end_of_step_mapper,
-                 s->local_cells_top, s->nr_local_cells, sizeof(int),
-                 threadpool_auto_chunk_size, &data);
+  /* Collect information from the local top-level cells, or only from the
+   * active ones if we know the others */
+  if (!(e->collect_cache_active && e->collect_cache.valid &&
+        e->active_cells_top != NULL &&
+        engine_collect_end_of_step_active(e, &data))) {
+    threadpool_map(&e->threadpool, engine_collect_end_of_step_mapper,
+                   s->local_cells_top, s->nr_local_cells, sizeof(int),
+                   threadpool_auto_chunk_size, &data);
+    if (e->collect_cache_active) engine_collect_cache_fill(e, &data);
+  }
+  e->active_cells_top = NULL;
 
   /* Get the number of inhibited particles from the space-wide counters
    * since these have been updated atomically during the time-steps. */
@@ -269,12 +470,42 @@ void engine_collect_end_of_step(struct engine *e, int apply) {
       data.sfh, data.runtime, data.flush_lightcone_maps, data.deadtime,
       data.csds_file_size_gb);
 
+/* Start aggregating collective data from the different nodes for this
+ * step. */
+#ifdef WITH_MPI
+#ifdef SWIFT_DEBUG_CHECKS
+  engine_collect_local_group1 = e->collect_group1;
+#endif
+  collectgroup1_reduce_begin(&e->collect_group1);
+#endif
+
+  if (e->verbose)
+    message("took %.3f %s.", clocks_from_ticks(getticks() - tic),
+            clocks_getunit());
+}
+
+/**
+ * @brief Waits for the reduction started by engine_collect_end_of_step_begin()
+ * and applies its result.
+ *
+ * Note that the results are stored in e->collect_group1 struct not in the
+ * engine fields, unless apply is true.
+ *
+ * @param e The #engine.
+ * @param apply whether to apply the results to the engine or just keep in the
+ *              group1 struct.
+ */
+void engine_collect_end_of_step_end(struct engine *e, int apply) {
+
+  const ticks tic = getticks();
+
 /* Aggregate collective data from the different nodes for this step. */
 #ifdef WITH_MPI
-  collectgroup1_reduce(&e->collect_group1);
+  collectgroup1_reduce_end(&e->collect_group1);
 
 #ifdef SWIFT_DEBUG_CHECKS
   {
+    const struct collectgroup1 data = engine_collect_local_group1;
     /* Check the above using the original MPI calls. */
     integertime_t in_i[2], out_i[2];
     in_i[0] = 0;
@@ -333,7 +564,7 @@ void engine_collect_end_of_step(struct engine *e, int apply) {
             e->collect_group1.b_inhibited);
 
     int buff = 0;
-    if (MPI_Allreduce(&e->forcerebuild, &buff, 1, MPI_INT, MPI_MAX,
+    if (MPI_Allreduce(&data.forcerebuild, &buff, 1, MPI_INT, MPI_MAX,
                       MPI_COMM_WORLD) != MPI_SUCCESS)
       error("Failed to aggregate the rebuild flag across nodes.");
     if (!!buff != !!e->collect_group1.forcerebuild)
@@ -23,7 +23,9 @@
 #include <config.h>
 
 /* System includes. */
+#include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -36,19 +38,43 @@
 #include "engine.h"
 
 /* Local headers. */
+#include "cuda_devices.h"
+#include "cuda_fof.h"
+#include "cuda_gpart_mirror.h"
+#include "cuda_hydro.h"
+#include "cuda_lightcone.h"
+#include "cuda_multipole_build.h"
+#include "cuda_pm_mesh.h"
+#include "cuda_power_spectrum.h"
+#include "cuda_precision.h"
+#include "cuda_rt.h"
+#include "cuda_streams.h"
+#include "cuda_top_multipoles.h"
+#include "cuda_work_split.h"
 #include "fof.h"
+#include "gpart_soa.h"
+#include "kernel_long_gravity.h"
 #include "line_of_sight.h"
+#include "metrics_export.h"
+#include "mpi_aggregate.h"
+#include "mpi_comm_stats.h"
+#include "mpi_progress.h"
 #include "mpiuse.h"
 #include "part.h"
+#include "part_soa.h"
 #include "pressure_floor.h"
 #include "proxy.h"
 #include "rt.h"
+#include "runner_doiact_grav.h"
+#include "runner_doiact_hydro_vec.h"
 #include "star_formation.h"
 #include "star_formation_logger.h"
 #include "stars_io.h"
 #include "statistics.h"
 #include "version.h"
 
+extern void long_grav_table_offload(const struct kernel_long_grav_table *t);
+
 extern int engine_max_parts_per_ghost;
 extern int engine_max_sparts_per_ghost;
 extern int engine_max_parts_per_cooling;
@@ -188,6 +214,9 @@ void engine_config(int restart, int fof, struct engine *e,
   e->nr_nodes = nr_nodes;
   e->proxy_ind = NULL;
   e->nr_proxies = 0;
+#ifdef WITH_MPI
+  e->proxy_comm = MPI_COMM_NULL;
+#endif
   e->forcerebuild = 1;
   e->forcerepart = 0;
   e->restarting = restart;
@@ -195,6 +224,7 @@ void engine_config(int restart, int fof, struct engine *e,
   e->links = NULL;
   e->nr_links = 0;
   e->file_stats = NULL;
+  e->drift_stats = NULL;
   e->file_timesteps = NULL;
   e->file_rt_subcycles = NULL;
   e->sfh_logger = NULL;
@@ -257,6 +287,42 @@ void engine_config(int restart, int fof, struct engine *e,
     message("Number of task queues set to %d", nr_queues);
   e->s->nr_queues = nr_queues;
 
+  /* Get the number of GPUs to drive from this rank (0 for all of them, < 0
+   * for none) */
+  const int nr_gpu_devices =
+      parser_get_opt_param_int(params, "Scheduler:gpu_devices", 0);
+  cuda_devices_init(nr_gpu_devices, e->nr_threads);
+  if (gpu_devices.count > 1)
+    message("Driving %d CUDA devices from this rank", gpu_devices.count);
+  if (!cuda_devices_active())
+    message("No CUDA device in use, all the work stays on the CPU");
+
+  /* Get the number of CUDA streams to spread the runners over */
+  int nr_gpu_streams =
+      parser_get_opt_param_int(params, "Scheduler:gpu_streams", e->nr_threads);
+  if (nr_gpu_streams <= 0) nr_gpu_streams = e->nr_threads;
+
+  /* Same number of streams on every device */
+  if (cuda_devices_active()) {
+    if (nr_gpu_streams % gpu_devices.count != 0)
+      nr_gpu_streams += gpu_devices.count - nr_gpu_streams % gpu_devices.count;
+    if (engine_cuda_init_streams(nr_gpu_streams) != nr_gpu_streams)
+      error("Failed to create %d CUDA streams.", nr_gpu_streams);
+    if (nr_gpu_streams != nr_task_threads)
+      message("Number of CUDA streams set to %d", nr_gpu_streams);
+  }
+
+#if defined(GRAVITY_LONG_RANGE_TABLE) && defined(WITH_CUDA)
+  /* Give every device its copy of the long-range correction table */
+  if (e->policy & engine_policy_self_gravity) {
+    for (int d = 0; d < gpu_devices.count; ++d) {
+      cuda_devices_use(d);
+      long_grav_table_offload(&kernel_long_grav_table);
+    }
+    cuda_devices_use(0);
+  }
+#endif
+
   /* Get the frequency of the dependency graph dumping */
   e->sched.frequency_dependency = parser_get_opt_param_int(
       params, "Scheduler:dependency_graph_frequency", 0);
@@ -274,6 +340,29 @@ void engine_config(int restart, int fof, struct engine *e,
     error("Scheduler:task_level_output_frequency should be >= 0");
   }
 
+  /* Get the frequency of the task time histograms output */
+  const int frequency_task_histograms = parser_get_opt_param_int(
+      params, "Scheduler:task_histograms_frequency", 0);
+  if (frequency_task_histograms < 0) {
+    error("Scheduler:task_histograms_frequency should be >= 0");
+  }
+  task_histograms_init(&e->sched.histograms, frequency_task_histograms,
+                       e->nodeID, restart);
+
+  /* Get the frequency of the critical path analyses */
+  const int frequency_critical_path = parser_get_opt_param_int(
+      params, "Scheduler:critical_path_frequency", 0);
+  if (frequency_critical_path < 0) {
+    error("Scheduler:critical_path_frequency should be >= 0");
+  }
+  const int critical_path_nr_tasks = parser_get_opt_param_int(
+      params, "Scheduler:critical_path_nr_tasks", 5);
+  if (critical_path_nr_tasks < 0) {
+    error("Scheduler:critical_path_nr_tasks should be >= 0");
+  }
+  task_critical_path_init(&e->sched.critical_path, frequency_critical_path,
+                          critical_path_nr_tasks, e->nodeID, restart);
+
 #if defined(SWIFT_DEBUG_CHECKS)
   e->sched.deadlock_waiting_time_ms = parser_get_opt_param_float(
       params, "Scheduler:deadlock_waiting_time_s", -1.f);
@@ -801,6 +890,9 @@ void engine_config(int restart, int fof, struct engine *e,
       los_io_output_check(e);
     }
 
+    /* Find the time of the first projection maps output */
+    if (e->projection_maps.enabled) engine_compute_next_projection_time(e);
+
     /* Find the time of the first stf output */
     if (e->policy & engine_policy_structure_finding) {
       engine_compute_next_stf_time(e);
@@ -835,6 +927,32 @@ void engine_config(int restart, int fof, struct engine *e,
     e->restart_lustre_OST_count =
         parser_get_opt_param_int(params, "Restarts:lustre_OST_count", 0);
 
+    /* Level of compression of the large blocks of the restart files. Can be
+     * changed on restart. */
+    e->restart_compression =
+        parser_get_opt_param_int(params, "Restarts:compression", 0);
+    if (e->restart_compression < 0 || e->restart_compression > 9)
+      error("Restarts:compression must be between 0 and 9.");
+#ifndef HAVE_ZLIB
+    if (e->restart_compression > 0)
+      error("Restarts:compression requires SWIFT to be built with zlib.");
+#endif
+
+    /* Size of the buffer through which the restart files are written. */
+    e->restart_buffer_size =
+        parser_get_opt_param_float(params, "Restarts:buffer_size_MB", 0.f) *
+        1024 * 1024;
+
+    /* Node-local directory to stage the restart files in. Can be changed on
+     * restart. */
+    parser_get_opt_param_string(params, "Restarts:local_subdir",
+                                e->restart_local_dir, "none");
+    if (strcmp(e->restart_local_dir, "none") != 0 &&
+        access(e->restart_local_dir, W_OK | X_OK) != 0 &&
+        mkdir(e->restart_local_dir, 0777) != 0 && errno != EEXIST)
+      error("Failed to create local restart directory: %s (%s)",
+            e->restart_local_dir, strerror(errno));
+
     /* Hours between restart dumps. Can be changed on restart. */
     float dhours =
         parser_get_opt_param_float(params, "Restarts:delta_hours", 5.0f);
@@ -920,6 +1038,107 @@ void engine_config(int restart, int fof, struct engine *e,
   e->sched.mpi_message_limit =
       parser_get_opt_param_int(params, "Scheduler:mpi_message_limit", 4) * 1024;
 
+  /* Base the task priorities on the time they took the last time they ran
+   * rather than on their modelled cost. */
+  e->sched.measured_weights =
+      parser_get_opt_param_int(params, "Scheduler:measured_task_weights", 0);
+
+  /* How long do idle runners keep looking for tasks before going to sleep?
+   * User provides the time in micro-seconds. */
+  const float idle_spin_time_us =
+      parser_get_opt_param_float(params, "Scheduler:idle_spin_time_us", 0.f);
+  if (idle_spin_time_us < 0.f)
+    error("Scheduler:idle_spin_time_us should be >= 0");
+  e->sched.idle_spin_ticks =
+      (ticks)(idle_spin_time_us * 1e-6 * clocks_get_cpufreq());
+
+  /* Run the RT sub-cycles of a step in a single hand-over of the runners,
+   * re-arming the tasks from the waits recorded by the first one. */
+  e->rt_persistent_sub_cycles =
+      parser_get_opt_param_int(params, "Scheduler:rt_persistent_sub_cycles", 1);
+
+  /* Walk the gas of the cooling tasks once for the end of the force loop
+   * and the cooling rather than the super-cells first. */
+  e->fuse_end_force_cooling =
+      parser_get_opt_param_int(params, "Scheduler:fuse_end_force_cooling", 1);
+
+  /* Reuse the active top-level cells found the last time the same max
+   * active bin came up? Only the gparts must set the activity of the cells,
+   * all on this rank and none leaving the box. */
+  e->unskip_cache_active =
+      parser_get_opt_param_int(params, "Scheduler:unskip_cache", 0);
+  if (!(e->policy & engine_policy_gravity_only) || e->nr_nodes > 1 ||
+      !e->s->periodic)
+    e->unskip_cache_active = 0;
+  engine_unskip_cache_reset(e);
+
+  /* Collect the end of the steps from the active top-level cells only? The
+   * other cells must not change between the rebuilds, which only holds when
+   * the time-step tasks are the only ones touching them. */
+  e->collect_cache_active =
+      parser_get_opt_param_int(params, "Scheduler:collect_active_cells", 0);
+  if (!(e->policy & engine_policy_gravity_only)) e->collect_cache_active = 0;
+  engine_collect_cache_reset(e);
+
+  /* Don't split the gravity tasks into ones too small to be worth their
+   * overheads. */
+  e->sched.grav_task_min_interactions = parser_get_opt_param_longlong(
+      params, "Scheduler:grav_task_min_interactions", 0LL);
+
+  /* Send only what the gravity needs of the foreign gparts every step? */
+  e->sched.compact_foreign_gparts =
+      parser_get_opt_param_int(params, "Scheduler:mpi_compact_gparts", 0);
+
+  /* And keep them in that form rather than as whole gparts? */
+  e->sched.compact_foreign_gparts_in_memory = parser_get_opt_param_int(
+      params, "Scheduler:mpi_compact_gparts_in_memory", 0);
+  if (e->sched.compact_foreign_gparts_in_memory) {
+    if (!e->sched.compact_foreign_gparts)
+      error(
+          "Scheduler:mpi_compact_gparts_in_memory requires "
+          "Scheduler:mpi_compact_gparts.");
+    if (e->policy & engine_policy_fof)
+      error(
+          "Scheduler:mpi_compact_gparts_in_memory cannot be used with FOF, "
+          "which needs the whole foreign gparts.");
+#ifdef SWIFT_DEBUG_CHECKS
+    error(
+        "Scheduler:mpi_compact_gparts_in_memory cannot be used with the "
+        "debugging checks, which need the whole foreign gparts.");
+#endif
+  }
+
+  /* Only send the cells that changed since the last rebuild? */
+  proxy_cells_delta =
+      parser_get_opt_param_int(params, "Scheduler:mpi_cells_delta", 0);
+
+  /* Send the high-order multipoles of the cells in half precision? */
+  proxy_cells_half_multipoles = parser_get_opt_param_int(
+      params, "Scheduler:mpi_cells_half_multipoles", 0);
+
+  /* Send the gparts to each node as one message rather than one per cell? */
+  mpi_aggregate_init(
+      parser_get_opt_param_int(params, "Scheduler:mpi_aggregate_gparts", 0),
+      nr_nodes);
+
+  /* Get the frequency of the summaries of the MPI messages */
+  const int frequency_mpi_comm_stats = parser_get_opt_param_int(
+      params, "Scheduler:mpi_comm_stats_frequency", 0);
+  if (frequency_mpi_comm_stats < 0) {
+    error("Scheduler:mpi_comm_stats_frequency should be >= 0");
+  }
+  mpi_comm_stats_init(frequency_mpi_comm_stats, nr_nodes, nodeID, restart);
+
+  /* Export the metrics of the run for monitoring? */
+  metrics_export_init(params);
+
+  /* Drive the MPI progress from a thread of its own? */
+  mpi_progress_init(
+      parser_get_opt_param_int(params, "Scheduler:mpi_progress_thread", 0),
+      parser_get_opt_param_float(params, "Scheduler:mpi_progress_interval_us",
+                                 10.f),
+      nr_nodes);
+
   if (restart) {
 
     /* Overwrite the constants for the scheduler */
@@ -939,6 +1158,14 @@ void engine_config(int restart, int fof, struct engine *e,
         params, "Scheduler:cell_sub_size_self_grav", space_subsize_self_grav);
     space_splitsize = parser_get_opt_param_int(
         params, "Scheduler:cell_split_size", space_splitsize);
+    space_splitsize_grav = parser_get_opt_param_int(
+        params, "Scheduler:cell_split_size_grav", space_splitsize_grav);
+    space_splitsize_grav_min =
+        min(space_splitsize_grav_min, space_splitsize_grav);
+    space_splitsize_grav_max =
+        max(space_splitsize_grav_max, space_splitsize_grav);
+    space_split_tune_time = parser_get_opt_param_float(
+        params, "Scheduler:cell_split_tune_time", space_split_tune_time);
     space_subdepth_diff_grav =
         parser_get_opt_param_int(params, "Scheduler:cell_subdepth_diff_grav",
                                  space_subdepth_diff_grav_default);
@@ -973,6 +1200,183 @@ void engine_config(int restart, int fof, struct engine *e,
         engine_max_parts_per_cooling);
   }
 
+  /* Number of particles to accumulate before sending pairs to the GPU */
+  int gpu_pair_batch_size = parser_get_opt_param_int(
+      params, "Scheduler:gpu_pair_batch_size", 32768);
+  if (gpu_pair_batch_size < 0)
+    error("Scheduler:gpu_pair_batch_size should be >= 0");
+  if (!cuda_devices_active()) gpu_pair_batch_size = 0;
+
+  /* Room for the threshold plus the pair that takes us over it */
+  const int gpu_pair_batch_max_cell =
+      cuda_pair_batch_stride(space_splitsize_grav_max -
+                             (space_splitsize_grav_max % VEC_SIZE) + VEC_SIZE);
+  const int gpu_pair_batch_alloc =
+      gpu_pair_batch_size > 0
+          ? gpu_pair_batch_size + 2 * gpu_pair_batch_max_cell
+          : 0;
+  int gpu_pair_batch_max_pairs =
+      gpu_pair_batch_alloc / (2 * SWIFT_CACHE_ALIGNMENT / sizeof(float)) + 1;
+  if (!cuda_devices_active()) gpu_pair_batch_max_pairs = 0;
+
+  /* Replay the batch flushes as CUDA graphs instead of issuing every copy? */
+  const int gpu_graphs =
+      parser_get_opt_param_int(params, "Scheduler:gpu_graphs", 0);
+  const int gpu_async =
+      parser_get_opt_param_int(params, "Scheduler:gpu_async", 1);
+
+  /* Floating-point mode of the GPU P2P kernels */
+  char gpu_precision_name[PARSER_MAX_LINE_SIZE];
+  parser_get_opt_param_string(params, "Scheduler:gpu_precision",
+                              gpu_precision_name, "strict");
+  cuda_precision_init(gpu_precision_name);
+
+  /* Number of M2L interactions to accumulate before sending them to the GPU
+   * (0 keeps them on the CPU) */
+  int gpu_mm_batch_size =
+      parser_get_opt_param_int(params, "Scheduler:gpu_mm_batch_size", 512);
+  if (gpu_mm_batch_size < 0)
+    error("Scheduler:gpu_mm_batch_size should be >= 0");
+  if (!cuda_devices_active()) gpu_mm_batch_size = 0;
+
+  /* Keep a copy of the gparts on the GPU for the whole step? The foreign
+   * gparts do not live in the space's array so this is only possible on a
+   * single rank. */
+  int gpu_resident_gparts =
+      parser_get_opt_param_int(params, "Scheduler:gpu_resident_gparts", 1);
+  if (!(e->policy & engine_policy_self_gravity)) gpu_resident_gparts = 0;
+  if (!cuda_devices_active()) gpu_resident_gparts = 0;
+  if (gpu_resident_gparts && nr_nodes > 1) {
+    if (nodeID == 0)
+      message("WARNING: Scheduler:gpu_resident_gparts ignored over MPI.");
+    gpu_resident_gparts = 0;
+  }
+
+  /* Let the device drift its own copy of the gparts? This is only possible
+   * when nothing else than the drift tasks moves them or changes their
+   * softening and mass, i.e. in periodic DM-only runs. */
+  int gpu_drift = parser_get_opt_param_int(params, "Scheduler:gpu_drift", 1);
+  if (e->s->nr_parts > 0 || e->s->nr_sparts > 0 || e->s->nr_bparts > 0 ||
+      e->s->nr_sinks > 0 || e->s->with_DM_background ||
+      e->s->with_neutrinos || !e->s->periodic)
+    gpu_drift = 0;
+#ifdef SWIFT_FIXED_BOUNDARY_PARTICLES
+  gpu_drift = 0;
+#endif
+  cuda_gpart_mirror_init(gpu_resident_gparts, gpu_drift);
+
+  /* Fill the gravity caches from a SoA copy of the gparts made by the drift
+   * tasks? Not with adaptive softening as the ghosts change it after the
+   * drift. */
+  int gpart_soa_use =
+      parser_get_opt_param_int(params, "Scheduler:gpart_soa", 1);
+  if (!(e->policy & engine_policy_self_gravity)) gpart_soa_use = 0;
+#ifdef ADAPTIVE_SOFTENING
+  gpart_soa_use = 0;
+#endif
+
+  /* Let the cells with no active gpart only drift into that copy? Only when
+   * the gravity tasks are the sole readers of the gparts, i.e. in the same
+   * runs as gpu_drift. The debugging checks want every gpart read to have
+   * been drifted. */
+  int gpart_soa_lazy_drift =
+      parser_get_opt_param_int(params, "Scheduler:gpart_soa_lazy_drift", 0);
+  if (e->s->nr_parts > 0 || e->s->nr_sparts > 0 || e->s->nr_bparts > 0 ||
+      e->s->nr_sinks > 0 || e->s->with_neutrinos || !e->s->periodic ||
+      (e->policy & engine_policy_drift_all))
+    gpart_soa_lazy_drift = 0;
+  if (gpu_gparts[0].active && !gpu_gparts[0].drift) gpart_soa_lazy_drift = 0;
+#if defined(SWIFT_DEBUG_CHECKS) || defined(SWIFT_FIXED_BOUNDARY_PARTICLES)
+  gpart_soa_lazy_drift = 0;
+#endif
+  gpart_soa_init(gpart_soa_use, gpart_soa_lazy_drift);
+
+  /* Same for the part and the caches of the vectorised density loop, the
+   * only ones reading them. */
+  int part_soa_use = parser_get_opt_param_int(params, "Scheduler:part_soa", 1);
+  if (!(e->policy & engine_policy_hydro)) part_soa_use = 0;
+#ifndef HYDRO_DENSITY_VEC
+  part_soa_use = 0;
+#endif
+  part_soa_init(part_soa_use);
+
+  /* Walk the top-level grid of the long-range tasks on the GPU? */
+  int gpu_long_range =
+      parser_get_opt_param_int(params, "Scheduler:gpu_long_range", 1);
+  if (!(e->policy & engine_policy_self_gravity)) gpu_long_range = 0;
+  if (!cuda_devices_active()) gpu_long_range = 0;
+  cuda_top_multipoles_init(gpu_long_range, e->nr_threads);
+
+  /* Build the multipoles of the tree on the GPU at the rebuilds? */
+  int gpu_multipoles =
+      parser_get_opt_param_int(params, "Scheduler:gpu_multipoles", 1);
+  if (!(e->policy & engine_policy_self_gravity)) gpu_multipoles = 0;
+  if (!cuda_devices_active()) gpu_multipoles = 0;
+  cuda_multipole_build_init(gpu_multipoles);
+
+  /* Compute the long-range PM forces on the GPU? Only the global CIC mesh is
+   * done there, the distributed and higher-order ones stay on the CPU. */
+  int gpu_mesh = parser_get_opt_param_int(params, "Scheduler:gpu_mesh", 1);
+  if (!(e->policy & engine_policy_self_gravity) || !e->s->periodic ||
+      e->mesh->distributed_mesh || e->mesh->assignment_order != 2 ||
+      e->mesh->interlacing || !cuda_devices_active())
+    gpu_mesh = 0;
+  cuda_pm_mesh_init(gpu_mesh);
+
+  /* Link the local particles of the FOF searches on the GPU? */
+  int gpu_fof_linking =
+      parser_get_opt_param_int(params, "Scheduler:gpu_fof", 1);
+  if (!(e->policy & engine_policy_fof)) gpu_fof_linking = 0;
+  if (!cuda_devices_active()) gpu_fof_linking = 0;
+  cuda_fof_init(gpu_fof_linking);
+
+  /* Do the forward FFTs of the power spectra on the GPU? */
+  int gpu_power =
+      parser_get_opt_param_int(params, "Scheduler:gpu_power_spectrum", 1);
+  if (!(e->policy & engine_policy_power_spectra)) gpu_power = 0;
+  if (!cuda_devices_active()) gpu_power = 0;
+  cuda_power_spectrum_init(gpu_power);
+
+  /* Smooth the particles onto the lightcone maps on the GPU? */
+  int gpu_lightcone_smoothing =
+      parser_get_opt_param_int(params, "Scheduler:gpu_lightcone", 1);
+#ifndef WITH_LIGHTCONE
+  gpu_lightcone_smoothing = 0;
+#endif
+  if (!cuda_devices_active()) gpu_lightcone_smoothing = 0;
+  cuda_lightcone_init(gpu_lightcone_smoothing);
+
+  /* Keep the P2P pairs too small for the GPU on the CPU? The threshold is in
+   * number of interactions (<= 0 to measure it at start-up). */
+  int gpu_pair_split =
+      parser_get_opt_param_int(params, "Scheduler:gpu_pair_split", 1);
+  if (!(e->policy & engine_policy_self_gravity)) gpu_pair_split = 0;
+  if (!cuda_devices_active()) gpu_pair_split = 0;
+  const double gpu_pair_split_threshold = parser_get_opt_param_double(
+      params, "Scheduler:gpu_pair_split_threshold", 0.);
+  cuda_work_split_init(&gpu_work_split, gpu_pair_split,
+                       gpu_pair_split_threshold);
+
+  /* Do the SPH density loop on the GPU? The cells with fewer interactions
+   * than the threshold stay on the CPU. */
+  int gpu_hydro_density =
+      parser_get_opt_param_int(params, "Scheduler:gpu_hydro_density", 1);
+  if (!(e->policy & engine_policy_hydro)) gpu_hydro_density = 0;
+  if (!cuda_devices_active()) gpu_hydro_density = 0;
+  const double gpu_hydro_split_threshold = parser_get_opt_param_double(
+      params, "Scheduler:gpu_hydro_split_threshold", 4096.);
+  cuda_hydro_init(gpu_hydro_density, gpu_hydro_split_threshold);
+
+  /* Do the thermochemistry of the RT on the GPU? The leaf cells with fewer
+   * particles than the threshold stay on the CPU. */
+  int gpu_rt_tchem =
+      parser_get_opt_param_int(params, "Scheduler:gpu_rt_tchem", 1);
+  if (!(e->policy & engine_policy_rt)) gpu_rt_tchem = 0;
+  if (!cuda_devices_active()) gpu_rt_tchem = 0;
+  const int gpu_rt_tchem_min_count =
+      parser_get_opt_param_int(params, "Scheduler:gpu_rt_tchem_min_count", 64);
+  cuda_rt_init(gpu_rt_tchem, gpu_rt_tchem_min_count, e->rt_props);
+
   /* Allocate and init the threads. */
   if (swift_memalign("runners", (void **)&e->runners, SWIFT_CACHE_ALIGNMENT,
                      e->nr_threads * sizeof(struct runner)) != 0)
@@ -981,6 +1385,7 @@ void engine_config(int restart, int fof, struct engine *e,
   for (int k = 0; k < e->nr_threads; k++) {
     e->runners[k].id = k;
     e->runners[k].e = e;
+    runner_reset_idle_times(&e->runners[k]);
     if (pthread_create(&e->runners[k].thread, NULL, &runner_main,
                        &e->runners[k]) != 0)
       error("Failed to create runner thread.");
@@ -1008,6 +1413,13 @@ void engine_config(int restart, int fof, struct engine *e,
                                  &cpuset) != 0)
         error("Failed to set thread affinity.");
 
+#if defined(HAVE_LIBNUMA) && defined(_GNU_SOURCE)
+      /* Steal from the queues of the same NUMA node first */
+      if (numa_available() >= 0)
+        e->sched.queue_domain[e->runners[k].qid] =
+            numa_node_of_cpu(cpuid[coreid]);
+#endif
+
 #else
       error("SWIFT was not compiled with affinity enabled.");
 #endif
@@ -1016,28 +1428,56 @@ void engine_config(int restart, int fof, struct engine *e,
       e->runners[k].qid = k * nr_queues / e->nr_threads;
     }
 
-    /* Allocate particle caches. */
-    e->runners[k].ci_gravity_cache.count = 0;
-    e->runners[k].cj_gravity_cache.count = 0;
-    gravity_cache_init(&e->runners[k].ci_gravity_cache, space_splitsize);
-    gravity_cache_init(&e->runners[k].cj_gravity_cache, space_splitsize);
+    /* The runner drives the GPU of its queue, its buffers go there */
+    cuda_devices_set_runner(k, e->runners[k].qid, nr_queues);
+    cuda_devices_use(cuda_devices_of_runner(k));
+    bzero(&e->runners[k].gpu_load, sizeof(struct cuda_device_load));
+
+    /* The particle caches are allocated on first use. */
+    bzero(&e->runners[k].ci_gravity_cache, sizeof(struct gravity_cache));
+    bzero(&e->runners[k].cj_gravity_cache, sizeof(struct gravity_cache));
+    bzero(&e->runners[k].ci_cuda_gravity_cache,
+          sizeof(struct cuda_gravity_cache));
+    bzero(&e->runners[k].cj_cuda_gravity_cache,
+          sizeof(struct cuda_gravity_cache));
+    cuda_pair_batch_init(&e->runners[k].gpu_pair_batch, gpu_pair_batch_size,
+                         gpu_pair_batch_alloc, gpu_pair_batch_max_pairs,
+                         gpu_graphs, gpu_async);
+    cuda_mm_batch_init(&e->runners[k].gpu_mm_batch, gpu_mm_batch_size);
+    bzero(&e->runners[k].gpu_split_timings, sizeof(struct cuda_split_timings));
+    cuda_timeline_init(&e->runners[k].gpu_timeline, cuda_devices_of_runner(k));
+    bzero(&e->runners[k].ci_cuda_hydro_cache, sizeof(struct cuda_hydro_cache));
+    bzero(&e->runners[k].cj_cuda_hydro_cache, sizeof(struct cuda_hydro_cache));
+    bzero(&e->runners[k].cuda_rt_cache, sizeof(struct cuda_rt_cache));
+    bzero(&e->runners[k].ghost_ngb_list, sizeof(struct hydro_ngb_list));
+    bzero(&e->runners[k].scratch, sizeof(struct runner_scratch));
 #ifdef WITH_VECTORIZATION
-    e->runners[k].ci_cache.count = 0;
-    e->runners[k].cj_cache.count = 0;
-    cache_init(&e->runners[k].ci_cache, CACHE_SIZE);
-    cache_init(&e->runners[k].cj_cache, CACHE_SIZE);
+    bzero(&e->runners[k].ci_cache, sizeof(struct cache));
+    bzero(&e->runners[k].cj_cache, sizeof(struct cache));
 #endif
 
     if (verbose) {
       if (with_aff)
-        message("runner %i on cpuid=%i with qid=%i.", e->runners[k].id,
-                e->runners[k].cpuid, e->runners[k].qid);
+        message("runner %i on cpuid=%i with qid=%i (domain %i).",
+                e->runners[k].id, e->runners[k].cpuid, e->runners[k].qid,
+                e->sched.queue_domain[e->runners[k].qid]);
       else
         message("runner %i using qid=%i no cpuid.", e->runners[k].id,
                 e->runners[k].qid);
     }
   }
 
+  /* Time the P2P kernels on both sides to find where the GPU starts to pay
+   * off. The runners are still waiting at the barrier. */
+  if (gpu_work_split.active && gpu_work_split.threshold <= 0.) {
+    cuda_devices_use(cuda_devices_of_runner(0));
+    runner_dopair_grav_pp_calibrate(&e->runners[0]);
+    if (verbose)
+      message("P2P pairs with fewer than %e interactions run on the CPU.",
+              gpu_work_split.threshold);
+  }
+  cuda_devices_use(0);
+
 #ifdef WITH_CSDS
   if ((e->policy & engine_policy_csds) && !restart) {
     /* Write the particle csds header */
@@ -27,7 +27,10 @@
 
 /* This object's header. */
 #include "engine.h"
+#include "cuda_gpart_mirror.h"
 #include "lightcone/lightcone_array.h"
+#include "memuse_phases.h"
+#include "statistics.h"
 
 /**
  * @brief Mapper function to drift *all* the #part to the current time.
@@ -73,6 +76,9 @@ void engine_do_drift_all_part_mapper(void *map_data, int num_elements,
 
       /* Drift all the particles */
       cell_drift_part(c, e, /* force the drift=*/1, NULL);
+
+      /* Collect the statistics while the particles are in cache */
+      if (e->drift_stats != NULL) stats_collect_cell_part(s, c, e->drift_stats);
     }
   }
 }
@@ -121,6 +127,10 @@ void engine_do_drift_all_gpart_mapper(void *map_data, int num_elements,
 
       /* Drift all the particles */
       cell_drift_gpart(c, e, /* force the drift=*/1, /*replication_list=*/NULL);
+
+      /* Collect the statistics while the particles are in cache */
+      if (e->drift_stats != NULL)
+        stats_collect_cell_gpart(s, c, e->drift_stats);
     }
   }
 }
@@ -169,6 +179,10 @@ void engine_do_drift_all_spart_mapper(void *map_data, int num_elements,
 
       /* Drift all the particles */
       cell_drift_spart(c, e, /* force the drift=*/1, NULL);
+
+      /* Collect the statistics while the particles are in cache */
+      if (e->drift_stats != NULL)
+        stats_collect_cell_spart(s, c, e->drift_stats);
     }
   }
 }
@@ -217,6 +231,10 @@ void engine_do_drift_all_bpart_mapper(void *map_data, int num_elements,
 
       /* Drift all the particles */
       cell_drift_bpart(c, e, /* force the drift=*/1, NULL);
+
+      /* Collect the statistics while the particles are in cache */
+      if (e->drift_stats != NULL)
+        stats_collect_cell_bpart(s, c, e->drift_stats);
     }
   }
 }
@@ -265,6 +283,9 @@ void engine_do_drift_all_sink_mapper(void *map_data, int num_elements,
 
       /* Drift all the particles */
       cell_drift_sink(c, e, /* force the drift=*/1);
+
+      /* Collect the statistics while the particles are in cache */
+      if (e->drift_stats != NULL) stats_collect_cell_sink(s, c, e->drift_stats);
     }
   }
 }
@@ -323,6 +344,7 @@ void engine_do_drift_all_multipole_mapper(void *map_data, int num_elements,
 void engine_drift_all(struct engine *e, const int drift_mpoles) {
 
   const ticks tic = getticks();
+  const enum memuse_phase phase = memuse_phases_begin(memuse_phase_drift_all);
 
   if (e->nodeID == 0 && e->verbose) {
     if (e->policy & engine_policy_cosmology)
@@ -344,13 +366,16 @@ void engine_drift_all(struct engine *e, const int drift_mpoles) {
 
     /* Normal case: We have a list of local cells with tasks to play with */
 
-    if (e->s->nr_parts > 0) {
-      threadpool_map(&e->threadpool, engine_do_drift_all_part_mapper,
+    /* The gparts go first such that the external potential energies in the
+     * statistics of the other kinds, if we collect them, use the drifted
+     * positions */
+    if (e->s->nr_gparts > 0) {
+      threadpool_map(&e->threadpool, engine_do_drift_all_gpart_mapper,
                      e->s->local_cells_top, e->s->nr_local_cells, sizeof(int),
                      threadpool_auto_chunk_size, e);
     }
-    if (e->s->nr_gparts > 0) {
-      threadpool_map(&e->threadpool, engine_do_drift_all_gpart_mapper,
+    if (e->s->nr_parts > 0) {
+      threadpool_map(&e->threadpool, engine_do_drift_all_part_mapper,
                      e->s->local_cells_top, e->s->nr_local_cells, sizeof(int),
                      threadpool_auto_chunk_size, e);
     }
@@ -416,6 +441,9 @@ void engine_drift_all(struct engine *e, const int drift_mpoles) {
   /* Synchronize particle positions */
   space_synchronize_particle_positions(e->s);
 
+  /* The device copy of the gparts is now behind */
+  cuda_gpart_mirror_invalidate();
+
 #ifdef SWIFT_DEBUG_CHECKS
   /* Check that all cells have been drifted to the current time. */
   space_check_drift_point(
@@ -442,6 +470,8 @@ void engine_drift_all(struct engine *e, const int drift_mpoles) {
                         /*flush_map_updates=*/1, /*flush_particles=*/1,
                         /*end_file=*/0, /*dump_all_shells=*/0);
 #endif
+
+  memuse_phases_end(phase);
 }
 
 /**
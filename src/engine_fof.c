@@ -26,7 +26,9 @@
 #include "engine.h"
 
 /* Local headers. */
+#include "cuda_fof.h"
 #include "fof.h"
+#include "memuse_phases.h"
 
 /**
  * @brief Activate all the #gpart communications in preparation
@@ -128,6 +130,30 @@ void engine_activate_fof_attach_tasks(struct engine *e) {
             clocks_getunit());
 }
 
+/**
+ * @brief Link the local particles at the current search length of the FOF
+ * properties, on the GPU or by running the FOF tasks.
+ *
+ * @param e The #engine to act on.
+ */
+#ifdef WITH_FOF
+static void engine_fof_link_local(struct engine *e) {
+
+  /* Link the local particles on the GPU, or run the tasks for it. */
+  if (!cuda_fof_search(e)) {
+
+    /* Activate the tasks */
+    engine_activate_fof_tasks(e);
+
+    /* Print the number of active tasks ? */
+    if (e->verbose) engine_print_task_counts(e);
+
+    /* Perform local FOF tasks for linkable particles. */
+    engine_launch(e, "fof");
+  }
+}
+#endif
+
 /**
  * @brief Run a FOF search.
  *
@@ -146,6 +172,7 @@ void engine_fof(struct engine *e, const int dump_results,
 #ifdef WITH_FOF
 
   const ticks tic = getticks();
+  const enum memuse_phase phase = memuse_phases_begin(memuse_phase_fof);
 
   /* Start by cleaning up the foreign buffers */
   if (foreign_buffers_allocated) {
@@ -160,14 +187,23 @@ void engine_fof(struct engine *e, const int dump_results,
   /* Make FOF tasks */
   engine_make_fof_tasks(e);
 
-  /* and activate them. */
-  engine_activate_fof_tasks(e);
+  /* Start from the last cores and find the new ones at a reduced length */
+  struct fof_props *props = e->fof_properties;
+  if (props->warm_start_margin > 0.) {
+
+    fof_warm_start_seed(props, e->s);
 
-  /* Print the number of active tasks ? */
-  if (e->verbose) engine_print_task_counts(e);
+    const double core_l_x =
+        (1. - props->warm_start_margin) * sqrt(props->l_x2);
+    props->search_l_x2 = core_l_x * core_l_x;
+    engine_fof_link_local(e);
+
+    fof_warm_start_store_cores(props, e->s);
+    props->search_l_x2 = props->l_x2;
+  }
 
-  /* Perform local FOF tasks for linkable particles. */
-  engine_launch(e, "fof");
+  /* Link the local particles */
+  engine_fof_link_local(e);
 
   /* Compute group sizes (only of local fragments with MPI) */
   fof_compute_local_sizes(e->fof_properties, e->s);
@@ -224,6 +260,7 @@ void engine_fof(struct engine *e, const int dump_results,
     engine_allocate_foreign_particles(e, /*fof=*/0);
 #endif
   }
+  memuse_phases_end(phase);
 
   if (engine_rank == 0)
     message("Complete FOF search took: %.3f %s.",
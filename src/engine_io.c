@@ -34,14 +34,17 @@
 #include "active.h"
 #include "csds_io.h"
 #include "distributed_io.h"
+#include "io_async.h"
 #include "kick.h"
 #include "lightcone/lightcone.h"
 #include "lightcone/lightcone_array.h"
 #include "line_of_sight.h"
+#include "memuse_phases.h"
 #include "parallel_io.h"
 #include "power_spectrum.h"
 #include "serial_io.h"
 #include "single_io.h"
+#include "statistics.h"
 #include "tracers.h"
 
 /* Standard includes */
@@ -199,6 +202,9 @@ int engine_dump_restarts(struct engine *e, const int drifted_all,
 
     if (dump) {
 
+      const enum memuse_phase phase =
+          memuse_phases_begin(memuse_phase_restart);
+
       if (e->nodeID == 0) {
 
         /* Flush the time-step file to avoid gaps in case of crashes
@@ -208,6 +214,9 @@ int engine_dump_restarts(struct engine *e, const int drifted_all,
         message("Writing restart files");
       }
 
+      /* The last staged files must have reached the restart directory. */
+      restart_drain_wait();
+
       /* Clean out the previous saved files, if found. Do this now as we are
        * MPI synchronized. */
       restart_remove_previous(e->restart_file);
@@ -254,6 +263,8 @@ int engine_dump_restarts(struct engine *e, const int drifted_all,
 
       /* Flag that we dumped the restarts */
       e->step_props |= engine_step_prop_restarts;
+
+      memuse_phases_end(phase);
     }
   }
 
@@ -264,14 +275,56 @@ int engine_dump_restarts(struct engine *e, const int drifted_all,
   return exit_run;
 }
 
+/*! Is a snapshot being written in the background? */
+static int engine_snapshot_writing = 0;
+
+/**
+ * @brief Wait for the snapshot being written in the background, if any, then
+ *        run the post-dump command.
+ *
+ * Must be called by all the ranks.
+ *
+ * @param e The #engine.
+ */
+void engine_dump_snapshot_wait(struct engine *e) {
+
+  if (!engine_snapshot_writing) return;
+
+  const ticks tic = getticks();
+#if defined(HAVE_HDF5)
+  io_async_wait();
+#endif
+#ifdef WITH_MPI
+  MPI_Barrier(MPI_COMM_WORLD);
+#endif
+  engine_snapshot_writing = 0;
+
+  if (e->verbose)
+    message("waiting for the snapshot writing took %.3f %s.",
+            clocks_from_ticks(getticks() - tic), clocks_getunit());
+
+  /* Run the post-dump command if required */
+  if (e->nodeID == 0) {
+    engine_run_on_dump(e);
+  }
+}
+
 /**
  * @brief Writes a snapshot with the current state of the engine
  *
+ * When asynchronous, the fields are staged in memory and written by a
+ * background thread, see #engine_dump_snapshot_wait.
+ *
  * @param e The #engine.
  * @param fof Is this a stand-alone FOF call?
  */
 void engine_dump_snapshot(struct engine *e, const int fof) {
 
+  /* The last snapshot needs to be out first. */
+  engine_dump_snapshot_wait(e);
+
+  const enum memuse_phase phase = memuse_phases_begin(memuse_phase_snapshot);
+
   struct clocks_time time1, time2;
   clocks_gettime(&time1);
 
@@ -367,12 +420,22 @@ void engine_dump_snapshot(struct engine *e, const int fof) {
 
   /* Flag that we dumped a snapshot */
   e->step_props |= engine_step_prop_snapshot;
+  memuse_phases_end(phase);
 
   clocks_gettime(&time2);
   if (e->verbose)
     message("writing particle properties took %.3f %s.",
             (float)clocks_diff(&time1, &time2), clocks_getunit());
 
+  /* Let the data go to disk while we carry on. */
+  if (e->snapshot_asynchronous) {
+#if defined(HAVE_HDF5)
+    io_async_launch();
+#endif
+    engine_snapshot_writing = 1;
+    return;
+  }
+
   /* Run the post-dump command if required */
   if (e->nodeID == 0) {
     engine_run_on_dump(e);
@@ -419,6 +482,7 @@ void engine_io(struct engine *e) {
   const int with_los = (e->policy & engine_policy_line_of_sight);
   const int with_fof = (e->policy & engine_policy_fof);
   const int with_power = (e->policy & engine_policy_power_spectra);
+  const int with_proj = e->projection_maps.enabled;
 
   /* What kind of output are we getting? */
   enum output_type {
@@ -428,6 +492,7 @@ void engine_io(struct engine *e) {
     output_ps,
     output_stf,
     output_los,
+    output_proj,
   };
 
   /* What kind of output do we want? And at which time ?
@@ -481,6 +546,16 @@ void engine_io(struct engine *e) {
     }
   }
 
+  /* Do we want to write projection maps? */
+  if (with_proj) {
+    if (e->ti_end_min > e->ti_next_proj && e->ti_next_proj > 0) {
+      if (e->ti_next_proj < ti_output) {
+        ti_output = e->ti_next_proj;
+        type = output_proj;
+      }
+    }
+  }
+
   /* Store information before attempting extra dump-related drifts */
   const integertime_t ti_current = e->ti_current;
   const timebin_t max_active_bin = e->max_active_bin;
@@ -498,7 +573,10 @@ void engine_io(struct engine *e) {
       e->time = ti_output * e->time_base + e->time_begin;
     }
 
-    /* Drift everyone */
+    /* Drift everyone, collecting the statistics on the way if they are what
+     * we are about to write */
+    if (type == output_statistics)
+      e->drift_stats = stats_threads_init(e->threadpool.num_threads);
     engine_drift_all(e, /*drift_mpole=*/0);
 
     /* Write some form of output */
@@ -630,6 +708,16 @@ void engine_io(struct engine *e) {
 
         break;
 
+      case output_proj:
+
+        /* Project the box */
+        projection_maps_write(e);
+
+        /* Move on */
+        engine_compute_next_projection_time(e);
+
+        break;
+
       default:
         error("Invalid dump type");
     }
@@ -684,6 +772,16 @@ void engine_io(struct engine *e) {
       }
     }
 
+    /* Do projection maps ? */
+    if (with_proj) {
+      if (e->ti_end_min > e->ti_next_proj && e->ti_next_proj > 0) {
+        if (e->ti_next_proj < ti_output) {
+          ti_output = e->ti_next_proj;
+          type = output_proj;
+        }
+      }
+    }
+
   } /* While loop over output types */
 
   /* Restore the information we stored */
@@ -965,6 +1063,77 @@ void engine_compute_next_los_time(struct engine *e) {
   }
 }
 
+/**
+ * @brief Computes the next time (on the time line) for a projection maps dump
+ *
+ * @param e The #engine.
+ */
+void engine_compute_next_projection_time(struct engine *e) {
+  /* Do output_list file case */
+  if (e->output_list_proj) {
+    output_list_read_next_time(e->output_list_proj, e, "projection maps",
+                               &e->ti_next_proj);
+    return;
+  }
+
+  /* Find upper-bound on last output */
+  double time_end;
+  if (e->policy & engine_policy_cosmology)
+    time_end = e->cosmology->a_end * e->delta_time_proj;
+  else
+    time_end = e->time_end + e->delta_time_proj;
+
+  /* Find next projection above current time */
+  double time;
+  if (e->policy & engine_policy_cosmology)
+    time = e->a_first_proj;
+  else
+    time = e->time_first_proj;
+
+  int found_proj_time = 0;
+  while (time < time_end) {
+
+    /* Output time on the integer timeline */
+    if (e->policy & engine_policy_cosmology)
+      e->ti_next_proj = log(time / e->cosmology->a_begin) / e->time_base;
+    else
+      e->ti_next_proj = (time - e->time_begin) / e->time_base;
+
+    /* Found it? */
+    if (e->ti_next_proj > e->ti_current) {
+      found_proj_time = 1;
+      break;
+    }
+
+    if (e->policy & engine_policy_cosmology)
+      time *= e->delta_time_proj;
+    else
+      time += e->delta_time_proj;
+  }
+
+  /* Deal with last projection */
+  if (!found_proj_time) {
+    e->ti_next_proj = -1;
+    if (e->verbose) message("No further projection maps output time.");
+  } else {
+
+    /* Be nice, talk... */
+    if (e->policy & engine_policy_cosmology) {
+      const double next_proj_time =
+          exp(e->ti_next_proj * e->time_base) * e->cosmology->a_begin;
+      if (e->verbose)
+        message("Next output time for projection maps set to a=%e.",
+                next_proj_time);
+    } else {
+      const double next_proj_time =
+          e->ti_next_proj * e->time_base + e->time_begin;
+      if (e->verbose)
+        message("Next output time for projection maps set to t=%e.",
+                next_proj_time);
+    }
+  }
+}
+
 /**
  * @brief Computes the next time (on the time line) for structure finding
  *
@@ -1246,6 +1415,24 @@ void engine_init_output_lists(struct engine *e, struct swift_params *params,
     }
   }
 
+  /* Deal with projection maps */
+  if (e->projection_maps.enabled) {
+
+    e->output_list_proj = NULL;
+    output_list_init(&e->output_list_proj, e, "ProjectionMaps",
+                     &e->delta_time_proj);
+
+    if (e->output_list_proj) {
+      engine_compute_next_projection_time(e);
+
+      if (e->policy & engine_policy_cosmology)
+        e->a_first_proj =
+            exp(e->ti_next_proj * e->time_base) * e->cosmology->a_begin;
+      else
+        e->time_first_proj = e->ti_next_proj * e->time_base + e->time_begin;
+    }
+  }
+
   /* Deal with power-spectra */
   if (e->policy & engine_policy_power_spectra) {
 
@@ -1272,13 +1272,6 @@ void engine_make_hierarchical_tasks_common(struct engine *e, struct cell *c) {
       c->kick2 = scheduler_addtask(s, task_type_kick2, task_subtype_none, 0, 0,
                                    c, NULL);
 
-      /* Weighting task for neutrinos after the last kick */
-      if (e->neutrino_properties->use_delta_f) {
-        c->grav.neutrino_weight = scheduler_addtask(
-            s, task_type_neutrino_weight, task_subtype_none, 0, 0, c, NULL);
-        scheduler_addunlock(s, c->kick1, c->grav.neutrino_weight);
-      }
-
 #if defined(WITH_CSDS)
       struct task *kick2_or_csds;
       if (with_csds) {
@@ -1621,9 +1614,13 @@ void engine_make_hierarchical_tasks_hydro(struct engine *e, struct cell *c,
       c->hydro.drift = scheduler_addtask(s, task_type_drift_part,
                                          task_subtype_none, 0, 0, c, NULL);
 
-      /* Add the task finishing the force calculation */
-      c->hydro.end_force = scheduler_addtask(s, task_type_end_hydro_force,
-                                             task_subtype_none, 0, 0, c, NULL);
+      /* Add the task finishing the force calculation. When fused, the
+       * cooling tasks do its work and it only gathers the dependencies. */
+      const int end_force_in_cooling =
+          with_cooling && e->fuse_end_force_cooling;
+      c->hydro.end_force = scheduler_addtask(
+          s, task_type_end_hydro_force, task_subtype_none, 0,
+          /* implicit = */ end_force_in_cooling, c, NULL);
 
       /* Generate the ghost tasks. */
       c->hydro.ghost_in =
@@ -2226,20 +2223,27 @@ void engine_count_and_link_tasks_mapper(void *map_data, int num_elements,
 }
 
 /**
- * @brief Creates all the task dependencies for the gravity
+ * @brief Creates all the task dependencies for the gravity.
  *
- * @param e The #engine
+ * This only adds unlocks, which is thread-safe, so the tasks can be
+ * processed in parallel.
+ *
+ * @param map_data The tasks.
+ * @param num_elements The number of tasks.
+ * @param extra_data The #engine.
  */
-void engine_link_gravity_tasks(struct engine *e) {
+void engine_link_gravity_tasks_mapper(void *map_data, int num_elements,
+                                      void *extra_data) {
 
+  struct engine *e = (struct engine *)extra_data;
   struct scheduler *sched = &e->sched;
   const int nodeID = e->nodeID;
-  const int nr_tasks = sched->nr_tasks;
+  struct task *tasks = (struct task *)map_data;
 
-  for (int k = 0; k < nr_tasks; k++) {
+  for (int k = 0; k < num_elements; k++) {
 
     /* Get a pointer to the task. */
-    struct task *t = &sched->tasks[k];
+    struct task *t = &tasks[k];
 
     if (t->type == task_type_none) continue;
 
@@ -2452,6 +2456,12 @@ static inline void engine_make_hydro_loops_dependencies(
  * corresponding to the second hydro loop over neighbours.
  * With all the relevant tasks for a given cell available, we construct
  * all the dependencies for that cell.
+ *
+ * Note that the gradient loop cannot be folded into the density one, not
+ * even once h has converged: its interactions (e.g. the signal velocity and
+ * del^2 u of SPHENIX) need the final density and sound speed of *both*
+ * particles, and those of pj are only known once the ghost of its own cell
+ * has run, i.e. after all of its density interactions.
  */
 void engine_make_extra_hydroloop_tasks_mapper(void *map_data, int num_elements,
                                               void *extra_data) {
@@ -4634,6 +4644,38 @@ void engine_make_fof_tasks(struct engine *e) {
             clocks_getunit());
 }
 
+/**
+ * @brief Report how sparse the black hole loops are.
+ *
+ * The BH loop tasks only exist for the cells and pairs with black holes, the
+ * other hydro loops get none.
+ *
+ * @param e The #engine.
+ */
+static void engine_report_black_hole_tasks(const struct engine *e) {
+
+  const struct scheduler *sched = &e->sched;
+
+  /* The loops made for each hydro loop with black holes */
+  const int nr_bh_loops = 5;
+
+  int nr_hydro = 0, nr_with_bh = 0;
+  for (int k = 0; k < sched->nr_tasks; k++) {
+    const struct task *t = &sched->tasks[k];
+    if (t->type != task_type_self && t->type != task_type_pair &&
+        t->type != task_type_sub_self && t->type != task_type_sub_pair)
+      continue;
+    if (t->subtype == task_subtype_density) nr_hydro++;
+    if (t->subtype == task_subtype_bh_density) nr_with_bh++;
+  }
+
+  message(
+      "%d of the %d hydro loops have black holes: made %d BH loop tasks, "
+      "skipped %d.",
+      nr_with_bh, nr_hydro, nr_bh_loops * nr_with_bh,
+      nr_bh_loops * (nr_hydro - nr_with_bh));
+}
+
 /**
  * @brief Fill the #space's task list.
  *
@@ -4766,11 +4808,16 @@ void engine_maketasks(struct engine *e) {
     message("Making extra hydroloop tasks took %.3f %s.",
             clocks_from_ticks(getticks() - tic2), clocks_getunit());
 
+  if (e->verbose && (e->policy & engine_policy_black_holes))
+    engine_report_black_hole_tasks(e);
+
   tic2 = getticks();
 
   /* Add the dependencies for the gravity stuff */
   if (e->policy & (engine_policy_self_gravity | engine_policy_external_gravity))
-    engine_link_gravity_tasks(e);
+    threadpool_map(&e->threadpool, engine_link_gravity_tasks_mapper,
+                   sched->tasks, sched->nr_tasks, sizeof(struct task),
+                   threadpool_auto_chunk_size, e);
 
   if (e->verbose)
     message("Linking gravity tasks took %.3f %s.",
@@ -295,6 +295,21 @@ void engine_makeproxies(struct engine *e) {
     }
   }
 
+  /* Connect the proxies in a graph for the neighbourhood collectives. The
+   * proxies of two nodes always come in pairs, so the sources are the
+   * destinations. */
+  if (e->proxy_comm != MPI_COMM_NULL) MPI_Comm_free(&e->proxy_comm);
+  int neighbours[engine_maxproxies], weights[engine_maxproxies];
+  for (int k = 0; k < e->nr_proxies; k++) {
+    neighbours[k] = proxies[k].nodeID;
+    weights[k] = 1;
+  }
+  if (MPI_Dist_graph_create_adjacent(MPI_COMM_WORLD, e->nr_proxies, neighbours,
+                                     weights, e->nr_proxies, neighbours,
+                                     weights, MPI_INFO_NULL, /*reorder=*/0,
+                                     &e->proxy_comm) != MPI_SUCCESS)
+    error("Failed to create the graph communicator of the proxies.");
+
   /* Be clear about the time */
   if (e->verbose)
     message("took %.3f %s.", clocks_from_ticks(getticks() - tic),
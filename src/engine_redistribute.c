@@ -27,6 +27,7 @@
 
 /* Local headers. */
 #include "memswap.h"
+#include "memuse.h"
 
 #ifdef WITH_MPI
 /**
@@ -537,6 +538,7 @@ void engine_redistribute(struct engine *e) {
   struct spart *sparts = s->sparts;
   struct bpart *bparts = s->bparts;
   ticks tic = getticks();
+  const int phase_reset = e->verbose ? memuse_phase_begin() : 0;
 
   size_t nr_parts = s->nr_parts;
   size_t nr_gparts = s->nr_gparts;
@@ -678,7 +680,7 @@ void engine_redistribute(struct engine *e) {
   /* Sort the particles according to their cell index. */
   if (nr_parts > 0)
     space_parts_sort(s->parts, s->xparts, dest, &counts[nodeID * nr_nodes],
-                     nr_nodes, 0);
+                     nr_nodes, 0, s->parallel_sort ? &e->threadpool : NULL);
 
 #ifdef SWIFT_DEBUG_CHECKS
   /* Verify that the part have been sorted correctly. */
@@ -877,7 +879,8 @@ void engine_redistribute(struct engine *e) {
   /* Sort the gparticles according to their cell index. */
   if (nr_gparts > 0)
     space_gparts_sort(s->gparts, s->parts, s->sinks, s->sparts, s->bparts,
-                      g_dest, &g_counts[nodeID * nr_nodes], nr_nodes);
+                      g_dest, &g_counts[nodeID * nr_nodes], nr_nodes,
+                      s->parallel_sort ? &e->threadpool : NULL);
 
 #ifdef SWIFT_DEBUG_CHECKS
   /* Verify that the gpart have been sorted correctly. */
@@ -1215,9 +1218,12 @@ void engine_redistribute(struct engine *e) {
   /* Flag that a redistribute has taken place */
   e->step_props |= engine_step_prop_redistribute;
 
-  if (e->verbose)
+  if (e->verbose) {
+    message("Peak memory use: %.3f MB%s.", memuse_phase_peak() / 1024.,
+            phase_reset ? "" : " (since start)");
     message("took %.3f %s.", clocks_from_ticks(getticks() - tic),
             clocks_getunit());
+  }
 #else
   error("SWIFT was not compiled with MPI support.");
 #endif
@@ -64,6 +64,27 @@ struct data_split {
   FILE *extra_split_logger;
 };
 
+/**
+ * @brief Data structure used by the copy mapper functions
+ */
+struct data_copy {
+
+  /*! The arrays to copy */
+  const struct part *const parts;
+  const struct xpart *const xparts;
+  const struct gpart *const gparts;
+
+  /*! The arrays to copy them to (#part also re-linked to the new #gpart) */
+  struct part *const parts_new;
+  struct xpart *const xparts_new;
+  struct gpart *const gparts_new;
+
+  /*! The other arrays to re-link to the new #gpart */
+  struct sink *const sinks;
+  struct spart *const sparts;
+  struct bpart *const bparts;
+};
+
 /**
  * @brief Mapper function to count the number of #part above the mass threshold
  * for splitting.
@@ -130,6 +151,20 @@ void engine_split_gas_particle_split_mapper(void *restrict map_data, int count,
   /* RNG seed for this thread's generation of new IDs */
   unsigned int seedp = (unsigned int)offset + e->ti_current % INT_MAX;
 
+  /* Count the particles to split in this chunk */
+  size_t nr_split = 0;
+  for (int i = 0; i < count; ++i) {
+    if (part_is_inhibited(&parts[i], e)) continue;
+    if (hydro_get_mass(&parts[i]) > mass_threshold) ++nr_split;
+  }
+  if (nr_split == 0) return;
+
+  /* Reserve a range of slots (and IDs) for the new particles of the chunk */
+  size_t k_parts = atomic_add(data->k_parts, nr_split);
+  size_t k_gparts = with_gravity ? atomic_add(data->k_gparts, nr_split) : 0;
+  long long k_id =
+      generate_random_ids ? 0 : atomic_add(count_id, (long long)nr_split);
+
   /* Loop over the chunk of the part array assigned to this thread */
   for (int i = 0; i < count; ++i) {
 
@@ -142,26 +177,9 @@ void engine_split_gas_particle_split_mapper(void *restrict map_data, int count,
     const float gas_mass = hydro_get_mass(p);
     const float h = p->h;
 
-    /* Found a particle to split */
+    /* Found a particle to split, it goes in the next reserved slot */
     if (gas_mass > mass_threshold) {
 
-      /* Make sure only one thread is here */
-      lock_lock(&data->lock);
-
-      /* Where should we put the new particle in the array? */
-      const size_t k_parts = *data->k_parts;
-      const size_t k_gparts = *data->k_gparts;
-
-      /* Make the next slot available for the next particle */
-      (*data->k_parts)++;
-      if (with_gravity) (*data->k_gparts)++;
-
-      /* Release the lock and continue in parallel */
-      if (lock_unlock(&data->lock) != 0)
-        error("Impossible to unlock particle splitting");
-
-      /* We now know where to put the new particle we are going to create. */
-
       /* Current other fields associated to this particle */
       struct xpart *xp = &xparts[i];
       struct gpart *gp = p->gpart;
@@ -180,7 +198,7 @@ void engine_split_gas_particle_split_mapper(void *restrict map_data, int count,
          * respect the parity. */
         global_parts[k_parts].id += 2 * (long long)rand_r(&seedp);
       } else {
-        global_parts[k_parts].id = offset_id + 2 * atomic_inc(count_id);
+        global_parts[k_parts].id = offset_id + 2 * k_id++;
       }
 
       /* Update splitting tree */
@@ -265,6 +283,53 @@ void engine_split_gas_particle_split_mapper(void *restrict map_data, int count,
       /* Mark the particles as not having been swallowed by a sink */
       sink_mark_part_as_not_swallowed(&p->sink_data);
       sink_mark_part_as_not_swallowed(&global_parts[k_parts].sink_data);
+
+      /* Move on to the next reserved slot */
+      k_parts++;
+      if (with_gravity) k_gparts++;
+    }
+  }
+}
+
+/**
+ * @brief Mapper function to copy the #part and #xpart to their new arrays.
+ */
+void engine_split_gas_particle_parts_copy_mapper(void *restrict map_data,
+                                                 int count,
+                                                 void *restrict extra_data) {
+
+  const struct data_copy *data = (const struct data_copy *)extra_data;
+  const size_t first = (struct part *)map_data - data->parts;
+
+  memcpy(&data->parts_new[first], &data->parts[first],
+         count * sizeof(struct part));
+  memcpy(&data->xparts_new[first], &data->xparts[first],
+         count * sizeof(struct xpart));
+}
+
+/**
+ * @brief Mapper function to copy the #gpart to their new array and re-link
+ * the other particles to them.
+ */
+void engine_split_gas_particle_gparts_copy_mapper(void *restrict map_data,
+                                                  int count,
+                                                  void *restrict extra_data) {
+
+  const struct data_copy *data = (const struct data_copy *)extra_data;
+  const size_t first = (struct gpart *)map_data - data->gparts;
+  struct gpart *gparts = data->gparts_new;
+
+  memcpy(&gparts[first], &data->gparts[first], count * sizeof(struct gpart));
+
+  for (size_t k = first; k < first + count; k++) {
+    if (gparts[k].type == swift_type_gas) {
+      data->parts_new[-gparts[k].id_or_neg_offset].gpart = &gparts[k];
+    } else if (gparts[k].type == swift_type_stars) {
+      data->sparts[-gparts[k].id_or_neg_offset].gpart = &gparts[k];
+    } else if (gparts[k].type == swift_type_black_hole) {
+      data->bparts[-gparts[k].id_or_neg_offset].gpart = &gparts[k];
+    } else if (gparts[k].type == swift_type_sink) {
+      data->sinks[-gparts[k].id_or_neg_offset].gpart = &gparts[k];
     }
   }
 }
@@ -274,9 +339,11 @@ void engine_split_gas_particle_split_mapper(void *restrict map_data, int count,
  * and split them into 2.
  *
  * This may reallocate the space arrays as new particles are created.
- * This is an expensive function as it has to loop multiple times over
- * the local array of particles. In case of reallocations, it may
- * also have to loop over the gravity and other arrays.
+ * They are then grown by as many particles again as are split now, such
+ * that a phase of splitting does not reallocate them at every rebuild. The
+ * copies, and the re-linking of the particles to the new #gpart, are done
+ * in parallel. Each chunk of particles reserves the slots of the particles
+ * it creates at once, so the splitting itself is parallel too.
  *
  * This is done on a node-by-node basis. No MPI required here.
  *
@@ -326,7 +393,7 @@ void engine_split_gas_particles(struct engine *e) {
     message("Splitting %zd particles above the mass threshold", counter);
 
   /* Number of particles to create */
-  const long long count_new_gas = counter * particle_split_factor;
+  const long long count_new_gas = counter * (particle_split_factor - 1);
 
   /* Get the global offset to generate new IDs (the *2 is to respect the ID
    * parity) */
@@ -361,7 +428,7 @@ void engine_split_gas_particles(struct engine *e) {
   if (s->nr_parts + count_new_gas > s->size_parts) {
 
     const size_t nr_parts_new = s->nr_parts + count_new_gas;
-    s->size_parts = engine_parts_size_grow * nr_parts_new;
+    s->size_parts = engine_parts_size_grow * nr_parts_new + count_new_gas;
 
     if (e->verbose) message("Reallocating the part array!");
 
@@ -375,10 +442,7 @@ void engine_split_gas_particles(struct engine *e) {
     swift_align_information(struct part, s->parts, part_align);
     swift_align_information(struct part, parts_new, part_align);
 
-    memcpy(parts_new, s->parts, sizeof(struct part) * s->nr_parts);
-    swift_free("parts", s->parts);
-
-    /* Allocate a larger array and copy over */
+    /* Allocate a larger array */
     struct xpart *xparts_new = NULL;
     if (swift_memalign("xparts", (void **)&xparts_new, xpart_align,
                        sizeof(struct xpart) * s->size_parts) != 0)
@@ -388,7 +452,15 @@ void engine_split_gas_particles(struct engine *e) {
     swift_align_information(struct xpart, s->xparts, xpart_align);
     swift_align_information(struct xpart, xparts_new, xpart_align);
 
-    memcpy(xparts_new, s->xparts, sizeof(struct xpart) * s->nr_parts);
+    /* Copy both over in parallel, the gparts only store offsets */
+    struct data_copy data_copy = {.parts = s->parts,
+                                  .xparts = s->xparts,
+                                  .parts_new = parts_new,
+                                  .xparts_new = xparts_new};
+    threadpool_map(&e->threadpool, engine_split_gas_particle_parts_copy_mapper,
+                   s->parts, s->nr_parts, sizeof(struct part),
+                   threadpool_auto_chunk_size, &data_copy);
+    swift_free("parts", s->parts);
     swift_free("xparts", s->xparts);
 
     s->xparts = xparts_new;
@@ -399,7 +471,7 @@ void engine_split_gas_particles(struct engine *e) {
   if (with_gravity && s->nr_gparts + count_new_gas > s->size_gparts) {
 
     const size_t nr_gparts_new = s->nr_gparts + count_new_gas;
-    s->size_gparts = engine_parts_size_grow * nr_gparts_new;
+    s->size_gparts = engine_parts_size_grow * nr_gparts_new + count_new_gas;
 
     if (e->verbose) message("Reallocating the gpart array!");
 
@@ -413,14 +485,18 @@ void engine_split_gas_particles(struct engine *e) {
     swift_align_information(struct gpart, s->gparts, gpart_align);
     swift_align_information(struct gpart, gparts_new, gpart_align);
 
-    /* Copy the particles */
-    memcpy(gparts_new, s->gparts, sizeof(struct gpart) * s->nr_gparts);
+    /* Copy the particles and correct the pointers of the other particle
+     * arrays in the same parallel pass */
+    struct data_copy data_copy = {.gparts = s->gparts,
+                                  .gparts_new = gparts_new,
+                                  .parts_new = s->parts,
+                                  .sinks = s->sinks,
+                                  .sparts = s->sparts,
+                                  .bparts = s->bparts};
+    threadpool_map(&e->threadpool, engine_split_gas_particle_gparts_copy_mapper,
+                   s->gparts, s->nr_gparts, sizeof(struct gpart),
+                   threadpool_auto_chunk_size, &data_copy);
     swift_free("gparts", s->gparts);
-
-    /* We now need to correct all the pointers of the other particle arrays */
-    part_relink_all_parts_to_gparts(gparts_new, s->nr_gparts, s->parts,
-                                    s->sinks, s->sparts, s->bparts,
-                                    &e->threadpool);
     s->gparts = gparts_new;
   }
 
@@ -33,6 +33,75 @@
 /* Local headers. */
 #include "proxy.h"
 
+#ifdef WITH_MPI
+/**
+ * @brief Build the MPI type of all the strays exchanged with one proxy.
+ *
+ * The particles of all types are described by their absolute addresses,
+ * such that they are sent from (or received into) their arrays directly,
+ * in a single message.
+ *
+ * @param parts The #part (and, below, #xpart) to exchange.
+ * @param xparts The #xpart.
+ * @param nr_parts The number of #part.
+ * @param gparts The #gpart.
+ * @param nr_gparts The number of #gpart.
+ * @param sparts The #spart.
+ * @param nr_sparts The number of #spart.
+ * @param bparts The #bpart.
+ * @param nr_bparts The number of #bpart.
+ * @param type (return) The MPI type.
+ *
+ * @return The number of elements of the type to exchange, 0 if there are no
+ * particles at all (the type is then not committed).
+ */
+static int engine_strays_make_type(void *parts, void *xparts,
+                                   const int nr_parts, void *gparts,
+                                   const int nr_gparts, void *sparts,
+                                   const int nr_sparts, void *bparts,
+                                   const int nr_bparts, MPI_Datatype *type) {
+
+  int lengths[5];
+  MPI_Aint displs[5];
+  MPI_Datatype types[5];
+  int n = 0;
+
+  if (nr_parts > 0) {
+    lengths[n] = nr_parts;
+    MPI_Get_address(parts, &displs[n]);
+    types[n++] = part_mpi_type;
+    lengths[n] = nr_parts;
+    MPI_Get_address(xparts, &displs[n]);
+    types[n++] = xpart_mpi_type;
+  }
+  if (nr_gparts > 0) {
+    lengths[n] = nr_gparts;
+    MPI_Get_address(gparts, &displs[n]);
+    types[n++] = gpart_mpi_type;
+  }
+  if (nr_sparts > 0) {
+    lengths[n] = nr_sparts;
+    MPI_Get_address(sparts, &displs[n]);
+    types[n++] = spart_mpi_type;
+  }
+  if (nr_bparts > 0) {
+    lengths[n] = nr_bparts;
+    MPI_Get_address(bparts, &displs[n]);
+    types[n++] = bpart_mpi_type;
+  }
+
+  if (n == 0) {
+    *type = MPI_BYTE;
+    return 0;
+  }
+
+  if (MPI_Type_create_struct(n, lengths, displs, types, type) != MPI_SUCCESS ||
+      MPI_Type_commit(type) != MPI_SUCCESS)
+    error("Failed to create the MPI type of the strays.");
+  return 1;
+}
+#endif
+
 /**
  * @brief Exchange straying particles with other nodes.
  *
@@ -58,6 +127,11 @@
  * @param Nbpart The number of stray bparts, contains the number of bparts
  *        received on return.
  *
+ * The numbers of particles and then the particles of all types are
+ * exchanged with all the proxies at once, through neighbourhood collectives
+ * over the graph of the proxies. The particles are received straight into
+ * their place in the particle arrays, in the order of the proxies.
+ *
  * Note that this function does not mess-up the linkage between parts and
  * gparts, i.e. the received particles have correct linkeage.
  */
@@ -251,30 +325,28 @@ void engine_exchange_strays(struct engine *e, const size_t offset_parts,
 #endif
   }
 
-  /* Launch the proxies. */
-  MPI_Request reqs_in[5 * engine_maxproxies];
-  MPI_Request reqs_out[5 * engine_maxproxies];
+  /* Exchange the numbers of particles with all the proxies. */
+  int counts_out[4 * engine_maxproxies], counts_in[4 * engine_maxproxies];
   for (int k = 0; k < e->nr_proxies; k++) {
-    proxy_parts_exchange_first(&e->proxies[k]);
-    reqs_in[k] = e->proxies[k].req_parts_count_in;
-    reqs_out[k] = e->proxies[k].req_parts_count_out;
+    counts_out[4 * k + 0] = e->proxies[k].nr_parts_out;
+    counts_out[4 * k + 1] = e->proxies[k].nr_gparts_out;
+    counts_out[4 * k + 2] = e->proxies[k].nr_sparts_out;
+    counts_out[4 * k + 3] = e->proxies[k].nr_bparts_out;
+  }
+  if (e->proxy_comm != MPI_COMM_NULL) {
+    if (MPI_Neighbor_alltoall(counts_out, 4, MPI_INT, counts_in, 4, MPI_INT,
+                              e->proxy_comm) != MPI_SUCCESS)
+      error("Failed to exchange the numbers of strays.");
+  } else if (e->nr_proxies > 0) {
+    error("Proxies without their graph communicator.");
   }
-
-  /* Wait for each count to come in and start the recv. */
   for (int k = 0; k < e->nr_proxies; k++) {
-    int pid = MPI_UNDEFINED;
-    if (MPI_Waitany(e->nr_proxies, reqs_in, &pid, MPI_STATUS_IGNORE) !=
-            MPI_SUCCESS ||
-        pid == MPI_UNDEFINED)
-      error("MPI_Waitany failed.");
-    // message( "request from proxy %i has arrived." , pid );
-    proxy_parts_exchange_second(&e->proxies[pid]);
+    e->proxies[k].nr_parts_in = counts_in[4 * k + 0];
+    e->proxies[k].nr_gparts_in = counts_in[4 * k + 1];
+    e->proxies[k].nr_sparts_in = counts_in[4 * k + 2];
+    e->proxies[k].nr_bparts_in = counts_in[4 * k + 3];
   }
 
-  /* Wait for all the sends to have finished too. */
-  if (MPI_Waitall(e->nr_proxies, reqs_out, MPI_STATUSES_IGNORE) != MPI_SUCCESS)
-    error("MPI_Waitall on sends failed.");
-
   /* Count the total number of incoming particles and make sure we have
      enough space to accommodate them. */
   int count_parts_in = 0;
@@ -378,166 +450,113 @@ void engine_exchange_strays(struct engine *e, const size_t offset_parts,
     }
   }
 
-  /* Collect the requests for the particle data from the proxies. */
-  int nr_in = 0, nr_out = 0;
+  /* Describe the particles sent to and received from each proxy. */
+  MPI_Datatype types_out[engine_maxproxies], types_in[engine_maxproxies];
+  int nr_types_out[engine_maxproxies], nr_types_in[engine_maxproxies];
+  MPI_Aint displs[engine_maxproxies];
+  int count_parts = 0, count_gparts = 0, count_sparts = 0, count_bparts = 0;
   for (int k = 0; k < e->nr_proxies; k++) {
-    if (e->proxies[k].nr_parts_in > 0) {
-      reqs_in[5 * k] = e->proxies[k].req_parts_in;
-      reqs_in[5 * k + 1] = e->proxies[k].req_xparts_in;
-      nr_in += 2;
-    } else {
-      reqs_in[5 * k] = reqs_in[5 * k + 1] = MPI_REQUEST_NULL;
-    }
-    if (e->proxies[k].nr_gparts_in > 0) {
-      reqs_in[5 * k + 2] = e->proxies[k].req_gparts_in;
-      nr_in += 1;
-    } else {
-      reqs_in[5 * k + 2] = MPI_REQUEST_NULL;
-    }
-    if (e->proxies[k].nr_sparts_in > 0) {
-      reqs_in[5 * k + 3] = e->proxies[k].req_sparts_in;
-      nr_in += 1;
-    } else {
-      reqs_in[5 * k + 3] = MPI_REQUEST_NULL;
-    }
-    if (e->proxies[k].nr_bparts_in > 0) {
-      reqs_in[5 * k + 4] = e->proxies[k].req_bparts_in;
-      nr_in += 1;
-    } else {
-      reqs_in[5 * k + 4] = MPI_REQUEST_NULL;
-    }
-
-    if (e->proxies[k].nr_parts_out > 0) {
-      reqs_out[5 * k] = e->proxies[k].req_parts_out;
-      reqs_out[5 * k + 1] = e->proxies[k].req_xparts_out;
-      nr_out += 2;
-    } else {
-      reqs_out[5 * k] = reqs_out[5 * k + 1] = MPI_REQUEST_NULL;
-    }
-    if (e->proxies[k].nr_gparts_out > 0) {
-      reqs_out[5 * k + 2] = e->proxies[k].req_gparts_out;
-      nr_out += 1;
-    } else {
-      reqs_out[5 * k + 2] = MPI_REQUEST_NULL;
-    }
-    if (e->proxies[k].nr_sparts_out > 0) {
-      reqs_out[5 * k + 3] = e->proxies[k].req_sparts_out;
-      nr_out += 1;
-    } else {
-      reqs_out[5 * k + 3] = MPI_REQUEST_NULL;
-    }
-    if (e->proxies[k].nr_bparts_out > 0) {
-      reqs_out[5 * k + 4] = e->proxies[k].req_bparts_out;
-      nr_out += 1;
-    } else {
-      reqs_out[5 * k + 4] = MPI_REQUEST_NULL;
-    }
+    struct proxy *prox = &e->proxies[k];
+    nr_types_out[k] = engine_strays_make_type(
+        prox->parts_out, prox->xparts_out, prox->nr_parts_out,
+        prox->gparts_out, prox->nr_gparts_out, prox->sparts_out,
+        prox->nr_sparts_out, prox->bparts_out, prox->nr_bparts_out,
+        &types_out[k]);
+    nr_types_in[k] = engine_strays_make_type(
+        &s->parts[offset_parts + count_parts],
+        &s->xparts[offset_parts + count_parts], prox->nr_parts_in,
+        &s->gparts[offset_gparts + count_gparts], prox->nr_gparts_in,
+        &s->sparts[offset_sparts + count_sparts], prox->nr_sparts_in,
+        &s->bparts[offset_bparts + count_bparts], prox->nr_bparts_in,
+        &types_in[k]);
+    displs[k] = 0;
+
+    count_parts += prox->nr_parts_in;
+    count_gparts += prox->nr_gparts_in;
+    count_sparts += prox->nr_sparts_in;
+    count_bparts += prox->nr_bparts_in;
   }
 
-  /* Wait for each part array to come in and collect the new
-     parts from the proxies. */
-  int count_parts = 0, count_gparts = 0, count_sparts = 0, count_bparts = 0;
-  for (int k = 0; k < nr_in; k++) {
-    int err, pid;
-    if ((err = MPI_Waitany(5 * e->nr_proxies, reqs_in, &pid,
-                           MPI_STATUS_IGNORE)) != MPI_SUCCESS) {
+  /* Exchange the particles of all types with all the proxies at once. */
+  if (e->proxy_comm != MPI_COMM_NULL) {
+    int err;
+    if ((err = MPI_Neighbor_alltoallw(MPI_BOTTOM, nr_types_out, displs,
+                                      types_out, MPI_BOTTOM, nr_types_in,
+                                      displs, types_in, e->proxy_comm)) !=
+        MPI_SUCCESS) {
       char buff[MPI_MAX_ERROR_STRING];
       int res;
       MPI_Error_string(err, buff, &res);
-      error("MPI_Waitany failed (%s).", buff);
+      error("Failed to exchange the strays (%s).", buff);
     }
-    if (pid == MPI_UNDEFINED) break;
-    // message( "request from proxy %i has arrived." , pid / 5 );
-    pid = 5 * (pid / 5);
-
-    /* If all the requests for a given proxy have arrived... */
-    if (reqs_in[pid + 0] == MPI_REQUEST_NULL &&
-        reqs_in[pid + 1] == MPI_REQUEST_NULL &&
-        reqs_in[pid + 2] == MPI_REQUEST_NULL &&
-        reqs_in[pid + 3] == MPI_REQUEST_NULL &&
-        reqs_in[pid + 4] == MPI_REQUEST_NULL) {
-      /* Copy the particle data to the part/xpart/gpart arrays. */
-      struct proxy *prox = &e->proxies[pid / 5];
-      memcpy(&s->parts[offset_parts + count_parts], prox->parts_in,
-             sizeof(struct part) * prox->nr_parts_in);
-      memcpy(&s->xparts[offset_parts + count_parts], prox->xparts_in,
-             sizeof(struct xpart) * prox->nr_parts_in);
-      memcpy(&s->gparts[offset_gparts + count_gparts], prox->gparts_in,
-             sizeof(struct gpart) * prox->nr_gparts_in);
-      memcpy(&s->sparts[offset_sparts + count_sparts], prox->sparts_in,
-             sizeof(struct spart) * prox->nr_sparts_in);
-      memcpy(&s->bparts[offset_bparts + count_bparts], prox->bparts_in,
-             sizeof(struct bpart) * prox->nr_bparts_in);
+  }
+  for (int k = 0; k < e->nr_proxies; k++) {
+    if (nr_types_out[k] > 0) MPI_Type_free(&types_out[k]);
+    if (nr_types_in[k] > 0) MPI_Type_free(&types_in[k]);
+  }
+
+  /* Collect the new particles of each proxy. */
+  count_parts = 0, count_gparts = 0, count_sparts = 0, count_bparts = 0;
+  for (int k = 0; k < e->nr_proxies; k++) {
+    struct proxy *prox = &e->proxies[k];
 
 #ifdef WITH_CSDS
-      if (e->policy & engine_policy_csds) {
-        struct part *parts = &s->parts[offset_parts + count_parts];
-        struct xpart *xparts = &s->xparts[offset_parts + count_parts];
-        struct spart *sparts = &s->sparts[offset_sparts + count_sparts];
-        struct gpart *gparts = &s->gparts[offset_gparts + count_gparts];
-
-        /* Log the gas particles */
-        csds_log_parts(e->csds, parts, xparts, prox->nr_parts_in, e,
-                       /* log_all_fields */ 1, csds_flag_mpi_enter,
-                       prox->nodeID);
-
-        /* Log the stellar particles */
-        csds_log_sparts(e->csds, sparts, prox->nr_sparts_in, e,
-                        /* log_all_fields */ 1, csds_flag_mpi_enter,
-                        prox->nodeID);
-
-        /* Log the gparts */
-        csds_log_gparts(e->csds, gparts, prox->nr_gparts_in, e,
-                        /* log_all_fields */ 1, csds_flag_mpi_enter,
-                        prox->nodeID);
-
-        /* Log the bparts */
-        if (prox->nr_bparts_in > 0) {
-          error("TODO");
-        }
+    if (e->policy & engine_policy_csds) {
+      struct part *parts = &s->parts[offset_parts + count_parts];
+      struct xpart *xparts = &s->xparts[offset_parts + count_parts];
+      struct spart *sparts = &s->sparts[offset_sparts + count_sparts];
+      struct gpart *gparts = &s->gparts[offset_gparts + count_gparts];
+
+      /* Log the gas particles */
+      csds_log_parts(e->csds, parts, xparts, prox->nr_parts_in, e,
+                     /* log_all_fields */ 1, csds_flag_mpi_enter,
+                     prox->nodeID);
+
+      /* Log the stellar particles */
+      csds_log_sparts(e->csds, sparts, prox->nr_sparts_in, e,
+                      /* log_all_fields */ 1, csds_flag_mpi_enter,
+                      prox->nodeID);
+
+      /* Log the gparts */
+      csds_log_gparts(e->csds, gparts, prox->nr_gparts_in, e,
+                      /* log_all_fields */ 1, csds_flag_mpi_enter,
+                      prox->nodeID);
+
+      /* Log the bparts */
+      if (prox->nr_bparts_in > 0) {
+        error("TODO");
       }
+    }
 #endif
-      /* for (int k = offset; k < offset + count; k++)
-         message(
-            "received particle %lli, x=[%.3e %.3e %.3e], h=%.3e, from node %i.",
-            s->parts[k].id, s->parts[k].x[0], s->parts[k].x[1],
-            s->parts[k].x[2], s->parts[k].h, p->nodeID); */
-
-      /* Re-link the gparts. */
-      for (int kk = 0; kk < prox->nr_gparts_in; kk++) {
-        struct gpart *gp = &s->gparts[offset_gparts + count_gparts + kk];
-
-        if (gp->type == swift_type_gas) {
-          struct part *p =
-              &s->parts[offset_parts + count_parts - gp->id_or_neg_offset];
-          gp->id_or_neg_offset = s->parts - p;
-          p->gpart = gp;
-        } else if (gp->type == swift_type_stars) {
-          struct spart *sp =
-              &s->sparts[offset_sparts + count_sparts - gp->id_or_neg_offset];
-          gp->id_or_neg_offset = s->sparts - sp;
-          sp->gpart = gp;
-        } else if (gp->type == swift_type_black_hole) {
-          struct bpart *bp =
-              &s->bparts[offset_bparts + count_bparts - gp->id_or_neg_offset];
-          gp->id_or_neg_offset = s->bparts - bp;
-          bp->gpart = gp;
-        }
-      }
 
-      /* Advance the counters. */
-      count_parts += prox->nr_parts_in;
-      count_gparts += prox->nr_gparts_in;
-      count_sparts += prox->nr_sparts_in;
-      count_bparts += prox->nr_bparts_in;
+    /* Re-link the gparts. */
+    for (int kk = 0; kk < prox->nr_gparts_in; kk++) {
+      struct gpart *gp = &s->gparts[offset_gparts + count_gparts + kk];
+
+      if (gp->type == swift_type_gas) {
+        struct part *p =
+            &s->parts[offset_parts + count_parts - gp->id_or_neg_offset];
+        gp->id_or_neg_offset = s->parts - p;
+        p->gpart = gp;
+      } else if (gp->type == swift_type_stars) {
+        struct spart *sp =
+            &s->sparts[offset_sparts + count_sparts - gp->id_or_neg_offset];
+        gp->id_or_neg_offset = s->sparts - sp;
+        sp->gpart = gp;
+      } else if (gp->type == swift_type_black_hole) {
+        struct bpart *bp =
+            &s->bparts[offset_bparts + count_bparts - gp->id_or_neg_offset];
+        gp->id_or_neg_offset = s->bparts - bp;
+        bp->gpart = gp;
+      }
     }
-  }
 
-  /* Wait for all the sends to have finished too. */
-  if (nr_out > 0)
-    if (MPI_Waitall(5 * e->nr_proxies, reqs_out, MPI_STATUSES_IGNORE) !=
-        MPI_SUCCESS)
-      error("MPI_Waitall on sends failed.");
+    /* Advance the counters. */
+    count_parts += prox->nr_parts_in;
+    count_gparts += prox->nr_gparts_in;
+    count_sparts += prox->nr_sparts_in;
+    count_bparts += prox->nr_bparts_in;
+  }
 
   /* Free the proxy memory */
   for (int k = 0; k < e->nr_proxies; k++) {
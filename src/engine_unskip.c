@@ -24,6 +24,10 @@
 /* This object's header. */
 #include "engine.h"
 
+/* System includes. */
+#include <stdlib.h>
+#include <string.h>
+
 /* Local headers. */
 #include "active.h"
 #include "cell.h"
@@ -373,9 +377,78 @@ void engine_do_unskip_mapper(void *map_data, int num_elements,
   }
 }
 
+/**
+ * @brief Store the active top-level cells of a max active bin.
+ *
+ * @param cache The #engine_unskip_cache.
+ * @param bin The max active bin.
+ * @param cells The indices of the active cells.
+ * @param count The number of active cells.
+ * @param stamp The current engine::time_bin_changes.
+ */
+static void engine_unskip_cache_store(struct engine_unskip_cache *cache,
+                                      const timebin_t bin, const int *cells,
+                                      const int count, const long long stamp) {
+
+  /* Grow the list if needed, it is only freed at the end */
+  if (count > cache->size[bin]) {
+    free(cache->cells[bin]);
+    cache->cells[bin] = (int *)malloc(count * sizeof(int));
+    if (cache->cells[bin] == NULL)
+      error("Couldn't allocate the cached list of active cells.");
+    cache->size[bin] = count;
+  }
+  if (count > 0) memcpy(cache->cells[bin], cells, count * sizeof(int));
+  cache->count[bin] = count;
+  cache->stamp[bin] = stamp;
+}
+
+/**
+ * @brief Forget the cached lists of active cells, without freeing them.
+ *
+ * To be used on a fresh #engine or one just read from a restart file, where
+ * the pointers are not valid.
+ *
+ * @param e The #engine.
+ */
+void engine_unskip_cache_reset(struct engine *e) {
+
+  struct engine_unskip_cache *cache = &e->unskip_cache;
+  for (int k = 0; k <= num_time_bins; k++) {
+    cache->cells[k] = NULL;
+    cache->count[k] = 0;
+    cache->size[k] = 0;
+    cache->stamp[k] = -1;
+  }
+}
+
+/**
+ * @brief Free the cached lists of active cells.
+ *
+ * @param e The #engine.
+ */
+void engine_unskip_cache_clean(struct engine *e) {
+
+  for (int k = 0; k <= num_time_bins; k++) free(e->unskip_cache.cells[k]);
+  engine_unskip_cache_reset(e);
+}
+
 /**
  * @brief Unskip all the tasks that act on active cells at this time.
  *
+ * Only the active top-level cells are visited, and the recursion below them
+ * stops at the first inactive cell, so the cost scales with the number of
+ * active cells and of the tasks attached to them rather than with the size
+ * of the task graph.
+ *
+ * In gravity-only runs, the activity of a cell only depends on the smallest
+ * time-bin of its particles. Until a particle changes bin, the same max
+ * active bin hence always finds the same active top-level cells. When
+ * engine::unskip_cache_active is set, these are kept from the first time
+ * each bin comes up and reused rather than looked for in all the cells. Any
+ * change of time-bin, or rebuild, increases engine::time_bin_changes and
+ * makes the lists stale.
+ *
  * @param e The #engine.
  */
 void engine_unskip(struct engine *e) {
@@ -400,36 +473,67 @@ void engine_unskip(struct engine *e) {
   ProfilerStart(filename);
 #endif  // WITH_PROFILER
 
-  /* Move the active local cells to the top of the list. */
+  /* Did we already find the active cells of this bin, and has no particle
+   * changed bin since? */
+  struct engine_unskip_cache *cache = &e->unskip_cache;
+  const timebin_t bin = e->max_active_bin;
+  const int use_cache = e->unskip_cache_active && bin >= 0 &&
+                        bin <= num_time_bins;
+  const int cache_hit =
+      use_cache && cache->stamp[bin] == e->time_bin_changes;
+
   int *local_cells = e->s->local_cells_with_tasks_top;
   int num_active_cells = 0;
-  for (int k = 0; k < s->nr_local_cells_with_tasks; k++) {
-    struct cell *c = &s->cells_top[local_cells[k]];
+  if (cache_hit) {
 
-    if (cell_is_empty(c)) continue;
+    /* Use the list we found then (no exchange to activate, the cache is
+     * only used on a single rank) */
+    local_cells = cache->cells[bin];
+    num_active_cells = cache->count[bin];
 
-    if ((with_hydro && cell_is_active_hydro(c, e)) ||
-        (with_self_grav && cell_is_active_gravity(c, e)) ||
-        (with_ext_grav && c->nodeID == nodeID &&
-         cell_is_active_gravity(c, e)) ||
-        (with_feedback && cell_is_active_stars(c, e)) ||
-        (with_stars && c->nodeID == nodeID && cell_is_active_stars(c, e)) ||
-        (with_sinks && cell_is_active_sinks(c, e)) ||
-        (with_black_holes && cell_is_active_black_holes(c, e)) ||
-        (with_rt && cell_is_rt_active(c, e))) {
+  } else {
 
-      if (num_active_cells != k)
-        memswap(&local_cells[k], &local_cells[num_active_cells], sizeof(int));
-      num_active_cells += 1;
-    }
+    /* Move the active local cells to the top of the list. */
+    for (int k = 0; k < s->nr_local_cells_with_tasks; k++) {
+      struct cell *c = &s->cells_top[local_cells[k]];
+
+      if (cell_is_empty(c)) continue;
+
+      if ((with_hydro && cell_is_active_hydro(c, e)) ||
+          (with_self_grav && cell_is_active_gravity(c, e)) ||
+          (with_ext_grav && c->nodeID == nodeID &&
+           cell_is_active_gravity(c, e)) ||
+          (with_feedback && cell_is_active_stars(c, e)) ||
+          (with_stars && c->nodeID == nodeID && cell_is_active_stars(c, e)) ||
+          (with_sinks && cell_is_active_sinks(c, e)) ||
+          (with_black_holes && cell_is_active_black_holes(c, e)) ||
+          (with_rt && cell_is_rt_active(c, e))) {
+
+        if (num_active_cells != k)
+          memswap(&local_cells[k], &local_cells[num_active_cells],
+                  sizeof(int));
+        num_active_cells += 1;
+      }
 
-    /* Activate the top-level timestep exchange */
+      /* Activate the top-level timestep exchange */
 #ifdef WITH_MPI
-    scheduler_activate_all_subtype(&e->sched, c->mpi.send, task_subtype_tend);
-    scheduler_activate_all_subtype(&e->sched, c->mpi.recv, task_subtype_tend);
+      scheduler_activate_all_subtype(&e->sched, c->mpi.send,
+                                     task_subtype_tend);
+      scheduler_activate_all_subtype(&e->sched, c->mpi.recv,
+                                     task_subtype_tend);
 #endif
+    }
+
+    /* Remember them for the next time this bin comes up */
+    if (use_cache)
+      engine_unskip_cache_store(cache, bin, local_cells, num_active_cells,
+                                e->time_bin_changes);
   }
 
+  /* The end of the step only has to be collected from these */
+  e->active_cells_top = local_cells;
+  e->nr_active_cells_top = num_active_cells;
+
   /* What kind of tasks do we have? */
   struct unskip_data data;
   bzero(&data, sizeof(struct unskip_data));
@@ -1664,6 +1664,7 @@ __attribute__((always_inline)) INLINE static void eos_init(
     load_table_SESAME(&e->SESAME_iron, SESAME_iron_table_file);
     prepare_table_SESAME(&e->SESAME_iron);
     convert_units_SESAME(&e->SESAME_iron, us);
+    index_table_SESAME(&e->SESAME_iron);
   }
   if (parser_get_opt_param_int(params, "EoS:planetary_use_SESAME_basalt", 0)) {
     char SESAME_basalt_table_file[PARSER_MAX_LINE_SIZE];
@@ -1673,6 +1674,7 @@ __attribute__((always_inline)) INLINE static void eos_init(
     load_table_SESAME(&e->SESAME_basalt, SESAME_basalt_table_file);
     prepare_table_SESAME(&e->SESAME_basalt);
     convert_units_SESAME(&e->SESAME_basalt, us);
+    index_table_SESAME(&e->SESAME_basalt);
   }
   if (parser_get_opt_param_int(params, "EoS:planetary_use_SESAME_water", 0)) {
     char SESAME_water_table_file[PARSER_MAX_LINE_SIZE];
@@ -1682,6 +1684,7 @@ __attribute__((always_inline)) INLINE static void eos_init(
     load_table_SESAME(&e->SESAME_water, SESAME_water_table_file);
     prepare_table_SESAME(&e->SESAME_water);
     convert_units_SESAME(&e->SESAME_water, us);
+    index_table_SESAME(&e->SESAME_water);
   }
   if (parser_get_opt_param_int(params, "EoS:planetary_use_SS08_water", 0)) {
     char SS08_water_table_file[PARSER_MAX_LINE_SIZE];
@@ -1691,6 +1694,7 @@ __attribute__((always_inline)) INLINE static void eos_init(
     load_table_SESAME(&e->SS08_water, SS08_water_table_file);
     prepare_table_SESAME(&e->SS08_water);
     convert_units_SESAME(&e->SS08_water, us);
+    index_table_SESAME(&e->SS08_water);
   }
 
   // ANEOS -- using SESAME-style tables
@@ -1704,6 +1708,7 @@ __attribute__((always_inline)) INLINE static void eos_init(
     load_table_SESAME(&e->ANEOS_forsterite, ANEOS_forsterite_table_file);
     prepare_table_SESAME(&e->ANEOS_forsterite);
     convert_units_SESAME(&e->ANEOS_forsterite, us);
+    index_table_SESAME(&e->ANEOS_forsterite);
   }
   if (parser_get_opt_param_int(params, "EoS:planetary_use_ANEOS_iron", 0)) {
     char ANEOS_iron_table_file[PARSER_MAX_LINE_SIZE];
@@ -1713,6 +1718,7 @@ __attribute__((always_inline)) INLINE static void eos_init(
     load_table_SESAME(&e->ANEOS_iron, ANEOS_iron_table_file);
     prepare_table_SESAME(&e->ANEOS_iron);
     convert_units_SESAME(&e->ANEOS_iron, us);
+    index_table_SESAME(&e->ANEOS_iron);
   }
   if (parser_get_opt_param_int(params, "EoS:planetary_use_ANEOS_Fe85Si15", 0)) {
     char ANEOS_Fe85Si15_table_file[PARSER_MAX_LINE_SIZE];
@@ -1722,6 +1728,7 @@ __attribute__((always_inline)) INLINE static void eos_init(
     load_table_SESAME(&e->ANEOS_Fe85Si15, ANEOS_Fe85Si15_table_file);
     prepare_table_SESAME(&e->ANEOS_Fe85Si15);
     convert_units_SESAME(&e->ANEOS_Fe85Si15, us);
+    index_table_SESAME(&e->ANEOS_Fe85Si15);
   }
 
   // Custom generic tables -- using SESAME-style tables
@@ -1739,6 +1746,7 @@ __attribute__((always_inline)) INLINE static void eos_init(
       load_table_SESAME(&e->custom[i_custom], custom_table_file);
       prepare_table_SESAME(&e->custom[i_custom]);
       convert_units_SESAME(&e->custom[i_custom], us);
+      index_table_SESAME(&e->custom[i_custom]);
     }
   }
 }
@@ -50,6 +50,13 @@ struct SESAME_params {
   int version_date, num_rho, num_T;
   float u_tiny, P_tiny, c_tiny, s_tiny;
   enum eos_planetary_material_id mat_id;
+
+  // Uniform grids of indices into the log(rho) array and into the log(u)
+  // array at each density, to find the bracketing table entries in O(1)
+  int *index_grid_log_rho;
+  int *index_grid_log_u_rho;
+  float log_rho_grid_min, inv_log_rho_grid_step;
+  float *log_u_grid_min, *inv_log_u_grid_step;
 };
 
 // Parameter values for each material
@@ -350,6 +357,131 @@ INLINE static void convert_units_SESAME(struct SESAME_params *mat,
       units_cgs_conversion_factor(us, UNIT_CONV_PHYSICAL_ENTROPY_PER_UNIT_MASS);
 }
 
+/**
+ * @brief Build a uniform grid of indices into a monotonically increasing
+ * array, with one bin per array element.
+ *
+ * grid[b] is the index of the element bracketing the lower edge of bin b, so
+ * a value in bin b is bracketed by one of the elements grid[b] to grid[b + 1].
+ *
+ * @param array The array (of length n).
+ * @param n The number of elements.
+ * @param x_min (return) The lower edge of the grid.
+ * @param inv_dx (return) The inverse of the width of the bins.
+ * @param grid (return) The n + 1 indices of the bin edges.
+ */
+INLINE static void build_index_grid_SESAME(const float *array, const int n,
+                                           float *x_min, float *inv_dx,
+                                           int *grid) {
+
+  const float range = array[n - 1] - array[0];
+  *x_min = array[0];
+  *inv_dx = (range > 0.f) ? n / range : 0.f;
+
+  for (int b = 0; b <= n; b++) {
+    const float x = array[0] + range * ((float)b / n);
+    int index = find_value_in_monot_incr_array(x, array, n);
+    if (index < 0) index = 0;
+    if (index > n - 1) index = n - 1;
+    grid[b] = index;
+  }
+}
+
+/**
+ * @brief Same as find_value_in_monot_incr_array() but starting from the
+ * bracketing entries given by a grid made by build_index_grid_SESAME().
+ *
+ * Tables with a roughly uniform spacing in log space leave only a few
+ * elements to bisect, so this is O(1) rather than O(log n).
+ *
+ * @param x The value to find.
+ * @param array The array (of length n).
+ * @param n The number of elements.
+ * @param x_min The lower edge of the grid.
+ * @param inv_dx The inverse of the width of the bins.
+ * @param grid The n + 1 indices of the bin edges.
+ */
+INLINE static int find_value_in_index_grid_SESAME(const float x,
+                                                  const float *array,
+                                                  const int n,
+                                                  const float x_min,
+                                                  const float inv_dx,
+                                                  const int *grid) {
+
+  // Outside the array
+  if (x < array[0]) return -1;
+  if (array[n - 1] <= x) return n;
+
+  // Bin of the grid (also catches NaNs)
+  const float bin = (x - x_min) * inv_dx;
+  int b = (bin > 0.f) ? (int)bin : 0;
+  if (b > n - 1) b = n - 1;
+
+  int index_low = grid[b];
+  int index_high = grid[b + 1] + 1;
+  if (index_high > n - 1) index_high = n - 1;
+
+  // Guard against the rounding of the bin edges
+  while (index_low > 0 && array[index_low] > x) index_low--;
+  while (index_high < n - 1 && array[index_high] <= x) index_high++;
+
+  // Until array[index_low] <= x < array[index_high=index_low+1]
+  while (index_high - index_low > 1) {
+    const int index_mid = (index_high + index_low) / 2;
+
+    if (array[index_mid] <= x)
+      index_low = index_mid;
+    else
+      index_high = index_mid;
+  }
+
+  return index_low;
+}
+
+// Index grids of the tables, once in internal units
+INLINE static void index_table_SESAME(struct SESAME_params *mat) {
+
+  mat->index_grid_log_rho = (int *)malloc((mat->num_rho + 1) * sizeof(int));
+  mat->index_grid_log_u_rho =
+      (int *)malloc(mat->num_rho * (mat->num_T + 1) * sizeof(int));
+  mat->log_u_grid_min = (float *)malloc(mat->num_rho * sizeof(float));
+  mat->inv_log_u_grid_step = (float *)malloc(mat->num_rho * sizeof(float));
+  if (mat->index_grid_log_rho == NULL || mat->index_grid_log_u_rho == NULL ||
+      mat->log_u_grid_min == NULL || mat->inv_log_u_grid_step == NULL)
+    error("Failed to allocate the index grids of the SESAME EoS table");
+
+  build_index_grid_SESAME(mat->table_log_rho, mat->num_rho,
+                          &mat->log_rho_grid_min, &mat->inv_log_rho_grid_step,
+                          mat->index_grid_log_rho);
+
+  for (int i_rho = 0; i_rho < mat->num_rho; i_rho++) {
+    const int offset = i_rho * (mat->num_T + 1);
+    build_index_grid_SESAME(mat->table_log_u_rho_T + i_rho * mat->num_T,
+                            mat->num_T, &mat->log_u_grid_min[i_rho],
+                            &mat->inv_log_u_grid_step[i_rho],
+                            mat->index_grid_log_u_rho + offset);
+  }
+}
+
+// Index of the bracketing log(rho) table entry
+INLINE static int find_log_rho_SESAME(const float log_rho,
+                                      const struct SESAME_params *mat) {
+
+  return find_value_in_index_grid_SESAME(
+      log_rho, mat->table_log_rho, mat->num_rho, mat->log_rho_grid_min,
+      mat->inv_log_rho_grid_step, mat->index_grid_log_rho);
+}
+
+// Index of the bracketing log(u) table entry at the density of index i_rho
+INLINE static int find_log_u_SESAME(const float log_u, const int i_rho,
+                                    const struct SESAME_params *mat) {
+
+  return find_value_in_index_grid_SESAME(
+      log_u, mat->table_log_u_rho_T + i_rho * mat->num_T, mat->num_T,
+      mat->log_u_grid_min[i_rho], mat->inv_log_u_grid_step[i_rho],
+      mat->index_grid_log_u_rho + i_rho * (mat->num_T + 1));
+}
+
 // gas_internal_energy_from_entropy
 INLINE static float SESAME_internal_energy_from_entropy(
     float density, float entropy, const struct SESAME_params *mat) {
@@ -493,14 +625,7 @@ INLINE static float SESAME_pressure_from_internal_energy(
 
   // 2D interpolation (bilinear with log(rho), log(u)) to find P(rho, u))
   // Density index
-  idx_rho =
-      find_value_in_monot_incr_array(log_rho, mat->table_log_rho, mat->num_rho);
-
-  // Sp. int. energy at this and the next density (in relevant slice of u array)
-  idx_u_1 = find_value_in_monot_incr_array(
-      log_u, mat->table_log_u_rho_T + idx_rho * mat->num_T, mat->num_T);
-  idx_u_2 = find_value_in_monot_incr_array(
-      log_u, mat->table_log_u_rho_T + (idx_rho + 1) * mat->num_T, mat->num_T);
+  idx_rho = find_log_rho_SESAME(log_rho, mat);
 
   // If outside the table then extrapolate from the edge and edge-but-one values
   if (idx_rho <= -1) {
@@ -508,6 +633,11 @@ INLINE static float SESAME_pressure_from_internal_energy(
   } else if (idx_rho >= mat->num_rho) {
     idx_rho = mat->num_rho - 2;
   }
+
+  // Sp. int. energy at this and the next density (in relevant slice of u array)
+  idx_u_1 = find_log_u_SESAME(log_u, idx_rho, mat);
+  idx_u_2 = find_log_u_SESAME(log_u, idx_rho + 1, mat);
+
   if (idx_u_1 <= -1) {
     idx_u_1 = 0;
   } else if (idx_u_1 >= mat->num_T) {
@@ -618,14 +748,7 @@ INLINE static float SESAME_soundspeed_from_internal_energy(
 
   // 2D interpolation (bilinear with log(rho), log(u)) to find c(rho, u))
   // Density index
-  idx_rho =
-      find_value_in_monot_incr_array(log_rho, mat->table_log_rho, mat->num_rho);
-
-  // Sp. int. energy at this and the next density (in relevant slice of u array)
-  idx_u_1 = find_value_in_monot_incr_array(
-      log_u, mat->table_log_u_rho_T + idx_rho * mat->num_T, mat->num_T);
-  idx_u_2 = find_value_in_monot_incr_array(
-      log_u, mat->table_log_u_rho_T + (idx_rho + 1) * mat->num_T, mat->num_T);
+  idx_rho = find_log_rho_SESAME(log_rho, mat);
 
   // If outside the table then extrapolate from the edge and edge-but-one values
   if (idx_rho <= -1) {
@@ -633,6 +756,11 @@ INLINE static float SESAME_soundspeed_from_internal_energy(
   } else if (idx_rho >= mat->num_rho) {
     idx_rho = mat->num_rho - 2;
   }
+
+  // Sp. int. energy at this and the next density (in relevant slice of u array)
+  idx_u_1 = find_log_u_SESAME(log_u, idx_rho, mat);
+  idx_u_2 = find_log_u_SESAME(log_u, idx_rho + 1, mat);
+
   if (idx_u_1 <= -1) {
     idx_u_1 = 0;
   } else if (idx_u_1 >= mat->num_T) {
@@ -24,103 +24,199 @@
 #include <limits.h>
 #include <stdlib.h>
 
+/* This object's header. */
+#include "exchange_structs.h"
+
 /* Local headers */
 #include "error.h"
 
+#ifdef WITH_MPI
+
 /**
- * @brief Given an array of structs of size element_size, send
- * nr_send[i] elements to each node i. Allocates the receive
- * buffer recvbuf to the appropriate size and returns its size
- * in nr_recv_tot.
+ * @brief Prepare an exchange of structs of size element_size, where
+ * nr_send[i] elements are sent to and nr_recv[i] elements received from
+ * each node i. Nothing is posted yet.
  *
+ * The elements to or from each node are contiguous in the buffers, in the
+ * order of the nodes.
+ *
+ * @param h The #exchange_structs_handle to initialise.
  * @param nr_send Number of elements to send to each node
- * @param nr_recv Number of elements to receive from each node
  * @param sendbuf The elements to send
+ * @param nr_recv Number of elements to receive from each node
  * @param recvbuf The output buffer
- *
+ * @param element_size The size of one element in bytes
  */
-void exchange_structs(size_t *nr_send, void *sendbuf, size_t *nr_recv,
-                      void *recvbuf, size_t element_size) {
+void exchange_structs_init(struct exchange_structs_handle *h,
+                           const size_t *nr_send, void *sendbuf,
+                           const size_t *nr_recv, void *recvbuf,
+                           const size_t element_size) {
 
-#ifdef WITH_MPI
+  /* Determine the number of ranks */
+  MPI_Comm_size(MPI_COMM_WORLD, &h->nr_nodes);
+  const int nr_nodes = h->nr_nodes;
 
-  /* Determine rank, number of ranks */
-  int nr_nodes, nodeID;
-  MPI_Comm_size(MPI_COMM_WORLD, &nr_nodes);
-  MPI_Comm_rank(MPI_COMM_WORLD, &nodeID);
+  h->nr_send = nr_send;
+  h->nr_recv = nr_recv;
+  h->sendbuf = (char *)sendbuf;
+  h->recvbuf = (char *)recvbuf;
+  h->element_size = element_size;
 
   /* Compute send offsets */
-  size_t *send_offset = (size_t *)malloc(nr_nodes * sizeof(size_t));
-  send_offset[0] = 0;
+  h->send_offset = (size_t *)malloc(nr_nodes * sizeof(size_t));
+  h->send_offset[0] = 0;
   for (int i = 1; i < nr_nodes; i += 1) {
-    send_offset[i] = send_offset[i - 1] + nr_send[i - 1];
+    h->send_offset[i] = h->send_offset[i - 1] + nr_send[i - 1];
   }
 
   /* Compute receive offsets */
-  size_t *recv_offset = (size_t *)malloc(nr_nodes * sizeof(size_t));
-  recv_offset[0] = 0;
+  h->recv_offset = (size_t *)malloc(nr_nodes * sizeof(size_t));
+  h->recv_offset[0] = 0;
   for (int i = 1; i < nr_nodes; i += 1) {
-    recv_offset[i] = recv_offset[i - 1] + nr_recv[i - 1];
+    h->recv_offset[i] = h->recv_offset[i - 1] + nr_recv[i - 1];
   }
 
   /* Allocate request objects (one send and receive per node) */
-  MPI_Request *request =
-      (MPI_Request *)malloc(2 * sizeof(MPI_Request) * nr_nodes);
+  h->request = (MPI_Request *)malloc(2 * sizeof(MPI_Request) * nr_nodes);
+  for (int i = 0; i < 2 * nr_nodes; i++) h->request[i] = MPI_REQUEST_NULL;
 
   /* Make type to communicate the struct */
-  MPI_Datatype value_mpi_type;
-  if (MPI_Type_contiguous(element_size, MPI_BYTE, &value_mpi_type) !=
+  if (MPI_Type_contiguous(element_size, MPI_BYTE, &h->value_mpi_type) !=
           MPI_SUCCESS ||
-      MPI_Type_commit(&value_mpi_type) != MPI_SUCCESS) {
+      MPI_Type_commit(&h->value_mpi_type) != MPI_SUCCESS) {
     error("Failed to create MPI type for struct to exchange.");
   }
+}
 
-  /*
-   * Post the send operations. This is an alltoallv really but
-   * we want to avoid the limits imposed by int counts and offsets
-   * in MPI_Alltoallv.
-   */
-  for (int i = 0; i < nr_nodes; i += 1) {
-    if (nr_send[i] > 0) {
-
-      /* TODO: handle very large messages */
-      if (nr_send[i] > INT_MAX)
-        error("exchange_structs() fails if nr_send > INT_MAX!");
-
-      char *buf = (char *)sendbuf;
-      MPI_Isend(&(buf[send_offset[i] * element_size]), (int)nr_send[i],
-                value_mpi_type, i, 0, MPI_COMM_WORLD, &(request[i]));
-    } else {
-      request[i] = MPI_REQUEST_NULL;
-    }
+/**
+ * @brief Post the send of the elements going to one node.
+ *
+ * @param h The #exchange_structs_handle.
+ * @param i The node to send to.
+ */
+void exchange_structs_post_send(struct exchange_structs_handle *h,
+                                const int i) {
+
+  if (h->nr_send[i] > 0) {
+
+    /* TODO: handle very large messages */
+    if (h->nr_send[i] > INT_MAX)
+      error("exchange_structs() fails if nr_send > INT_MAX!");
+
+    MPI_Isend(&(h->sendbuf[h->send_offset[i] * h->element_size]),
+              (int)h->nr_send[i], h->value_mpi_type, i, 0, MPI_COMM_WORLD,
+              &(h->request[i]));
   }
+}
 
-  /* Post the receives */
-  for (int i = 0; i < nr_nodes; i += 1) {
-    if (nr_recv[i] > 0) {
+/**
+ * @brief Post the receive of the elements coming from one node.
+ *
+ * @param h The #exchange_structs_handle.
+ * @param i The node to receive from.
+ */
+void exchange_structs_post_recv(struct exchange_structs_handle *h,
+                                const int i) {
+
+  if (h->nr_recv[i] > 0) {
+
+    /* TODO: handle very large messages */
+    if (h->nr_recv[i] > INT_MAX)
+      error("exchange_structs() fails if nr_recv > INT_MAX!");
 
-      /* TODO: handle very large messages */
-      if (nr_recv[i] > INT_MAX)
-        error("exchange_structs() fails if nr_recv > INT_MAX!");
+    MPI_Irecv(&(h->recvbuf[h->recv_offset[i] * h->element_size]),
+              (int)h->nr_recv[i], h->value_mpi_type, i, 0, MPI_COMM_WORLD,
+              &(h->request[i + h->nr_nodes]));
+  }
+}
 
-      char *buf = (char *)recvbuf;
-      MPI_Irecv(&(buf[recv_offset[i] * element_size]), (int)nr_recv[i],
-                value_mpi_type, i, 0, MPI_COMM_WORLD, &(request[i + nr_nodes]));
-    } else {
-      request[i + nr_nodes] = MPI_REQUEST_NULL;
-    }
+/**
+ * @brief Wait for the elements coming from a node to have arrived.
+ *
+ * @param h The #exchange_structs_handle.
+ * @param i The node to wait for, or -1 for whichever node completes first
+ * among the pending receives.
+ * @param offset (return) The index of the first element from that node in
+ * the receive buffer.
+ * @param count (return) The number of elements from that node.
+ *
+ * @return The node whose elements have arrived, or -1 if there are no
+ * pending receives left (only possible if i is -1).
+ */
+int exchange_structs_wait_recv(struct exchange_structs_handle *h, const int i,
+                               size_t *offset, size_t *count) {
+
+  int node = i;
+  if (i >= 0) {
+    MPI_Wait(&h->request[i + h->nr_nodes], MPI_STATUS_IGNORE);
+  } else {
+    int index;
+    MPI_Waitany(h->nr_nodes, &h->request[h->nr_nodes], &index,
+                MPI_STATUS_IGNORE);
+    if (index == MPI_UNDEFINED) return -1;
+    node = index;
   }
 
+  *offset = h->recv_offset[node];
+  *count = h->nr_recv[node];
+  return node;
+}
+
+/**
+ * @brief Wait for all the posted sends and receives of an exchange to
+ * complete and release its resources.
+ *
+ * @param h The #exchange_structs_handle.
+ */
+void exchange_structs_end(struct exchange_structs_handle *h) {
+
   /* Wait for everything to complete */
-  MPI_Waitall(2 * nr_nodes, request, MPI_STATUSES_IGNORE);
+  MPI_Waitall(2 * h->nr_nodes, h->request, MPI_STATUSES_IGNORE);
 
   /* Done with the MPI type */
-  MPI_Type_free(&value_mpi_type);
+  MPI_Type_free(&h->value_mpi_type);
 
   /* Tidy up */
-  free(recv_offset);
-  free(send_offset);
-  free(request);
+  free(h->recv_offset);
+  free(h->send_offset);
+  free(h->request);
+  h->recv_offset = NULL;
+  h->send_offset = NULL;
+  h->request = NULL;
+}
+
+#endif /* WITH_MPI */
+
+/**
+ * @brief Given an array of structs of size element_size, send
+ * nr_send[i] elements to each node i. Allocates the receive
+ * buffer recvbuf to the appropriate size and returns its size
+ * in nr_recv_tot.
+ *
+ * @param nr_send Number of elements to send to each node
+ * @param nr_recv Number of elements to receive from each node
+ * @param sendbuf The elements to send
+ * @param recvbuf The output buffer
+ *
+ */
+void exchange_structs(size_t *nr_send, void *sendbuf, size_t *nr_recv,
+                      void *recvbuf, size_t element_size) {
+
+#ifdef WITH_MPI
+
+  struct exchange_structs_handle h;
+  exchange_structs_init(&h, nr_send, sendbuf, nr_recv, recvbuf, element_size);
+
+  /*
+   * Post the send and receive operations. This is an alltoallv really but
+   * we want to avoid the limits imposed by int counts and offsets
+   * in MPI_Alltoallv.
+   */
+  for (int i = 0; i < h.nr_nodes; i += 1) exchange_structs_post_send(&h, i);
+  for (int i = 0; i < h.nr_nodes; i += 1) exchange_structs_post_recv(&h, i);
+
+  /* Wait for everything to complete */
+  exchange_structs_end(&h);
 #else
   error("should only be called in MPI mode");
 #endif
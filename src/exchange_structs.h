@@ -20,6 +20,56 @@
 #ifndef SWIFT_EXCHANGE_STRUCTS_H
 #define SWIFT_EXCHANGE_STRUCTS_H
 
+/* Config parameters. */
+#include <config.h>
+
+/* Standard headers */
+#include <stddef.h>
+
+#ifdef WITH_MPI
+#include <mpi.h>
+
+/**
+ * @brief The state of an exchange of structs whose sends and receives are
+ * posted, and the received data used, node by node.
+ */
+struct exchange_structs_handle {
+
+  /*! Number of ranks */
+  int nr_nodes;
+
+  /*! Number of elements to send to and to receive from each node */
+  const size_t *nr_send, *nr_recv;
+
+  /*! Offsets of the elements of each node in the buffers */
+  size_t *send_offset, *recv_offset;
+
+  /*! The buffers */
+  char *sendbuf, *recvbuf;
+
+  /*! Size of one element in bytes */
+  size_t element_size;
+
+  /*! MPI type of one element */
+  MPI_Datatype value_mpi_type;
+
+  /*! The sends then the receives of each node */
+  MPI_Request *request;
+};
+
+void exchange_structs_init(struct exchange_structs_handle *h,
+                           const size_t *nr_send, void *sendbuf,
+                           const size_t *nr_recv, void *recvbuf,
+                           const size_t element_size);
+void exchange_structs_post_send(struct exchange_structs_handle *h,
+                                const int i);
+void exchange_structs_post_recv(struct exchange_structs_handle *h,
+                                const int i);
+int exchange_structs_wait_recv(struct exchange_structs_handle *h, const int i,
+                               size_t *offset, size_t *count);
+void exchange_structs_end(struct exchange_structs_handle *h);
+#endif /* WITH_MPI */
+
 void exchange_structs(size_t *nr_send, void *sendbuf, size_t *nr_recv,
                       void *recvbuf, size_t element_size);
 
@@ -322,6 +322,96 @@ INLINE static void evolve_SNIa(
   }
 }
 
+/**
+ * @brief Integrate the yields of an enrichment channel over the IMF between
+ * two masses.
+ *
+ * The yields are linear in the metallicity interpolation and in the
+ * abundances of the star, so are their integrals: each tabulated row is
+ * integrated on its own from its cumulative table, and the rows are then
+ * combined.
+ *
+ * @param log10_min_mass log10 mass lower integration bound
+ * @param log10_max_mass log10 mass upper integration bound
+ * @param Z The total metallicity of the star (metal mass fraction).
+ * @param abundances The individual metal abundances (mass fractions) of the
+ * star.
+ * @param table The #yield_table of the channel.
+ * @param N_metals The number of metallicity bins of the table.
+ * @param props Properties of the feedback model.
+ * @param metal_mass_released (return) The mass of each element released.
+ * @param metal_mass_released_total (return) The metal mass released.
+ * @param mass_ejected (return) The mass ejected.
+ */
+INLINE static void integrate_yields(
+    const double log10_min_mass, const double log10_max_mass, const double Z,
+    const float* const abundances, const struct yield_table* table,
+    const int N_metals, const struct feedback_props* props,
+    double metal_mass_released[chemistry_element_count],
+    double* metal_mass_released_total, double* mass_ejected) {
+
+  const int N_bins = eagle_feedback_N_imf_bins;
+
+  /* determine which IMF mass bins contribute to the integral */
+  struct imf_integration_bounds bounds;
+  determine_imf_integration_bounds(log10_min_mass, log10_max_mass, &bounds,
+                                   props);
+
+  /* determine which metallicity bin and offset this star belongs to */
+  int index_Z_lo = 0, index_Z_hi = 0;
+  float dZ = 0.f;
+  determine_bin_yields(&index_Z_lo, &index_Z_hi, &dZ, log10(Z),
+                       table->metallicity, N_metals);
+
+  /* Elements already in the stars that are ejected */
+  const int lo_index_2d = row_major_index_2d(index_Z_lo, 0, N_metals, N_bins);
+  const int hi_index_2d = row_major_index_2d(index_Z_hi, 0, N_metals, N_bins);
+  const double ejecta_lo = integrate_imf_cumulative(
+      &bounds, table->ejecta_IMF_resampled + lo_index_2d,
+      table->ejecta_IMF_cumulative + lo_index_2d, props);
+  const double ejecta_hi = integrate_imf_cumulative(
+      &bounds, table->ejecta_IMF_resampled + hi_index_2d,
+      table->ejecta_IMF_cumulative + hi_index_2d, props);
+
+  /*******************************
+   * Compute metal mass produced *
+   *******************************/
+  for (int elem = 0; elem < chemistry_element_count; elem++) {
+
+    const int lo_index_3d = row_major_index_3d(
+        index_Z_lo, elem, 0, N_metals, chemistry_element_count, N_bins);
+    const int hi_index_3d = row_major_index_3d(
+        index_Z_hi, elem, 0, N_metals, chemistry_element_count, N_bins);
+    const double yield_lo = integrate_imf_cumulative(
+        &bounds, table->yield_IMF_resampled + lo_index_3d,
+        table->yield_IMF_cumulative + lo_index_3d, props);
+    const double yield_hi = integrate_imf_cumulative(
+        &bounds, table->yield_IMF_resampled + hi_index_3d,
+        table->yield_IMF_cumulative + hi_index_3d, props);
+
+    metal_mass_released[elem] =
+        (1.f - dZ) * (yield_lo + abundances[elem] * ejecta_lo) +
+        (0.f + dZ) * (yield_hi + abundances[elem] * ejecta_hi);
+  }
+
+  /*************************************
+   * Compute total metal mass produced *
+   *************************************/
+  const double total_lo = integrate_imf_cumulative(
+      &bounds, table->total_metals_IMF_resampled + lo_index_2d,
+      table->total_metals_IMF_cumulative + lo_index_2d, props);
+  const double total_hi = integrate_imf_cumulative(
+      &bounds, table->total_metals_IMF_resampled + hi_index_2d,
+      table->total_metals_IMF_cumulative + hi_index_2d, props);
+  *metal_mass_released_total = (1.f - dZ) * (total_lo + Z * ejecta_lo) +
+                               (0.f + dZ) * (total_hi + Z * ejecta_hi);
+
+  /************************************************
+   * Compute the total mass ejected from the star *
+   ************************************************/
+  *mass_ejected = (1.f - dZ) * ejecta_lo + dZ * ejecta_hi;
+}
+
 /**
  * @brief compute enrichment and feedback due to SNII. To do this, integrate the
  * IMF weighted by the yields read from tables for each of the quantities of
@@ -343,18 +433,6 @@ INLINE static void evolve_SNII(
     const struct feedback_props* props,
     struct feedback_spart_data* const feedback_data) {
 
-  /* Pull out common arrays */
-
-  /* Metal mass produced by the star */
-  const double* const total_yields =
-      props->yield_SNII.total_metals_IMF_resampled;
-
-  /* Individual elements produced by the star */
-  const double* const metal_yields = props->yield_SNII.yield_IMF_resampled;
-
-  /* Elements already in the stars that are ejected */
-  const double* const ejecta = props->yield_SNII.ejecta_IMF_resampled;
-
   /* If mass at beginning of step is less than tabulated lower bound for IMF,
    * limit it.*/
   if (log10_min_mass < props->log10_SNII_min_mass_msun)
@@ -369,97 +447,13 @@ INLINE static void evolve_SNII(
    * step */
   if (log10_min_mass >= log10_max_mass) return;
 
-  /* determine which IMF mass bins contribute to the integral */
-  int low_imf_mass_bin_index, high_imf_mass_bin_index;
-  determine_imf_bins(log10_min_mass, log10_max_mass, &low_imf_mass_bin_index,
-                     &high_imf_mass_bin_index, props);
-
-  /* determine which metallicity bin and offset this star belongs to */
-  int index_Z_lo = 0, index_Z_hi = 0;
-  float dZ = 0.;
-  determine_bin_yields(&index_Z_lo, &index_Z_hi, &dZ, log10(Z),
-                       props->yield_SNII.metallicity,
-                       eagle_feedback_SNII_N_metals);
-
-  /* Allocate temporary array for calculating imf weights */
-  double stellar_yields[eagle_feedback_N_imf_bins];
-
-  /*******************************
-   * Compute metal mass produced *
-   *******************************/
+  /* Integrate the yields over the IMF */
   double metal_mass_released[chemistry_element_count];
-
-  /* Loop over all the elements */
-  for (int elem = 0; elem < chemistry_element_count; elem++) {
-
-    /* Loop over all the relevent IMF mass bins */
-    for (int mass_bin_index = low_imf_mass_bin_index;
-         mass_bin_index < high_imf_mass_bin_index + 1; mass_bin_index++) {
-
-      const int lo_index_3d = row_major_index_3d(
-          index_Z_lo, elem, mass_bin_index, eagle_feedback_SNII_N_metals,
-          chemistry_element_count, eagle_feedback_N_imf_bins);
-      const int hi_index_3d = row_major_index_3d(
-          index_Z_hi, elem, mass_bin_index, eagle_feedback_SNII_N_metals,
-          chemistry_element_count, eagle_feedback_N_imf_bins);
-
-      const int lo_index_2d = row_major_index_2d(index_Z_lo, mass_bin_index,
-                                                 eagle_feedback_SNII_N_metals,
-                                                 eagle_feedback_N_imf_bins);
-      const int hi_index_2d = row_major_index_2d(index_Z_hi, mass_bin_index,
-                                                 eagle_feedback_SNII_N_metals,
-                                                 eagle_feedback_N_imf_bins);
-      stellar_yields[mass_bin_index] =
-          (1.f - dZ) * (metal_yields[lo_index_3d] +
-                        abundances[elem] * ejecta[lo_index_2d]) +
-          (0.f + dZ) * (metal_yields[hi_index_3d] +
-                        abundances[elem] * ejecta[hi_index_2d]);
-    }
-    metal_mass_released[elem] = integrate_imf(
-        log10_min_mass, log10_max_mass, eagle_imf_integration_yield_weight,
-        stellar_yields, props);
-  }
-
-  /*************************************
-   * Compute total metal mass produced *
-   *************************************/
-  for (int mass_bin_index = low_imf_mass_bin_index;
-       mass_bin_index < high_imf_mass_bin_index + 1; mass_bin_index++) {
-
-    const int lo_index_2d = row_major_index_2d(index_Z_lo, mass_bin_index,
-                                               eagle_feedback_SNII_N_metals,
-                                               eagle_feedback_N_imf_bins);
-    const int hi_index_2d = row_major_index_2d(index_Z_hi, mass_bin_index,
-                                               eagle_feedback_SNII_N_metals,
-                                               eagle_feedback_N_imf_bins);
-
-    stellar_yields[mass_bin_index] =
-        (1.f - dZ) * (total_yields[lo_index_2d] + Z * ejecta[lo_index_2d]) +
-        (0.f + dZ) * (total_yields[hi_index_2d] + Z * ejecta[hi_index_2d]);
-  }
-  double metal_mass_released_total =
-      integrate_imf(log10_min_mass, log10_max_mass,
-                    eagle_imf_integration_yield_weight, stellar_yields, props);
-
-  /************************************************
-   * Compute the total mass ejected from the star *
-   ************************************************/
-  for (int mass_bin_index = low_imf_mass_bin_index;
-       mass_bin_index < high_imf_mass_bin_index + 1; mass_bin_index++) {
-
-    const int lo_index_2d = row_major_index_2d(index_Z_lo, mass_bin_index,
-                                               eagle_feedback_SNII_N_metals,
-                                               eagle_feedback_N_imf_bins);
-    const int hi_index_2d = row_major_index_2d(index_Z_hi, mass_bin_index,
-                                               eagle_feedback_SNII_N_metals,
-                                               eagle_feedback_N_imf_bins);
-
-    stellar_yields[mass_bin_index] =
-        (1 - dZ) * ejecta[lo_index_2d] + dZ * ejecta[hi_index_2d];
-  }
-  const double mass_ejected =
-      integrate_imf(log10_min_mass, log10_max_mass,
-                    eagle_imf_integration_yield_weight, stellar_yields, props);
+  double metal_mass_released_total, mass_ejected;
+  integrate_yields(log10_min_mass, log10_max_mass, Z, abundances,
+                   &props->yield_SNII, eagle_feedback_SNII_N_metals, props,
+                   metal_mass_released, &metal_mass_released_total,
+                   &mass_ejected);
 
   /* Zero all negative values */
   for (int i = 0; i < chemistry_element_count; i++)
@@ -515,18 +509,6 @@ INLINE static void evolve_AGB(const double log10_min_mass,
                               const struct feedback_props* props,
                               struct feedback_spart_data* const feedback_data) {
 
-  /* Pull out common arrays */
-
-  /* Metal mass produced by the star */
-  const double* const total_yields =
-      props->yield_AGB.total_metals_IMF_resampled;
-
-  /* Individual elements produced by the star */
-  const double* const metal_yields = props->yield_AGB.yield_IMF_resampled;
-
-  /* Elements already in the stars that are ejected */
-  const double* const ejecta = props->yield_AGB.ejecta_IMF_resampled;
-
   /* If mass at end of step is greater than tabulated lower bound for IMF, limit
    * it.*/
   if (log10_max_mass > props->log10_SNII_min_mass_msun)
@@ -536,100 +518,13 @@ INLINE static void evolve_AGB(const double log10_min_mass,
    * step */
   if (log10_min_mass >= log10_max_mass) return;
 
-  /* determine which IMF mass bins contribute to the integral */
-  int low_imf_mass_bin_index, high_imf_mass_bin_index;
-  determine_imf_bins(log10_min_mass, log10_max_mass, &low_imf_mass_bin_index,
-                     &high_imf_mass_bin_index, props);
-
-  /* determine which metallicity bin and offset this star belongs to */
-  int index_Z_lo = 0, index_Z_hi = 0;
-  float dZ = 0.f;
-  determine_bin_yields(&index_Z_lo, &index_Z_hi, &dZ, log10(Z),
-                       props->yield_AGB.metallicity,
-                       eagle_feedback_AGB_N_metals);
-
-  /* Allocate temporary array for calculating imf weights */
-  double stellar_yields[eagle_feedback_N_imf_bins];
-
-  /*******************************
-   * Compute metal mass produced *
-   *******************************/
+  /* Integrate the yields over the IMF */
   double metal_mass_released[chemistry_element_count];
-
-  /* Loop over all the elements */
-  for (int elem = 0; elem < chemistry_element_count; elem++) {
-
-    /* Loop over all the relevent IMF mass bins */
-    for (int mass_bin_index = low_imf_mass_bin_index;
-         mass_bin_index < high_imf_mass_bin_index + 1; mass_bin_index++) {
-
-      const int lo_index_3d = row_major_index_3d(
-          index_Z_lo, elem, mass_bin_index, eagle_feedback_AGB_N_metals,
-          chemistry_element_count, eagle_feedback_N_imf_bins);
-      const int hi_index_3d = row_major_index_3d(
-          index_Z_hi, elem, mass_bin_index, eagle_feedback_AGB_N_metals,
-          chemistry_element_count, eagle_feedback_N_imf_bins);
-
-      const int lo_index_2d = row_major_index_2d(index_Z_lo, mass_bin_index,
-                                                 eagle_feedback_AGB_N_metals,
-                                                 eagle_feedback_N_imf_bins);
-      const int hi_index_2d = row_major_index_2d(index_Z_hi, mass_bin_index,
-                                                 eagle_feedback_AGB_N_metals,
-                                                 eagle_feedback_N_imf_bins);
-      stellar_yields[mass_bin_index] =
-          (1.f - dZ) * (metal_yields[lo_index_3d] +
-                        abundances[elem] * ejecta[lo_index_2d]) +
-          (0.f + dZ) * (metal_yields[hi_index_3d] +
-                        abundances[elem] * ejecta[hi_index_2d]);
-    }
-
-    metal_mass_released[elem] = integrate_imf(
-        log10_min_mass, log10_max_mass, eagle_imf_integration_yield_weight,
-        stellar_yields, props);
-  }
-
-  /*************************************
-   * Compute total metal mass produced *
-   *************************************/
-  for (int mass_bin_index = low_imf_mass_bin_index;
-       mass_bin_index < high_imf_mass_bin_index + 1; mass_bin_index++) {
-
-    const int lo_index_2d = row_major_index_2d(index_Z_lo, mass_bin_index,
-                                               eagle_feedback_AGB_N_metals,
-                                               eagle_feedback_N_imf_bins);
-    const int hi_index_2d = row_major_index_2d(index_Z_hi, mass_bin_index,
-                                               eagle_feedback_AGB_N_metals,
-                                               eagle_feedback_N_imf_bins);
-
-    stellar_yields[mass_bin_index] =
-        (1.f - dZ) * (total_yields[lo_index_2d] + Z * ejecta[lo_index_2d]) +
-        (0.f + dZ) * (total_yields[hi_index_2d] + Z * ejecta[hi_index_2d]);
-  }
-
-  double metal_mass_released_total =
-      integrate_imf(log10_min_mass, log10_max_mass,
-                    eagle_imf_integration_yield_weight, stellar_yields, props);
-
-  /************************************************
-   * Compute the total mass ejected from the star *
-   ************************************************/
-
-  for (int mass_bin_index = low_imf_mass_bin_index;
-       mass_bin_index < high_imf_mass_bin_index + 1; mass_bin_index++) {
-
-    const int lo_index_2d = row_major_index_2d(index_Z_lo, mass_bin_index,
-                                               eagle_feedback_AGB_N_metals,
-                                               eagle_feedback_N_imf_bins);
-    const int hi_index_2d = row_major_index_2d(index_Z_hi, mass_bin_index,
-                                               eagle_feedback_AGB_N_metals,
-                                               eagle_feedback_N_imf_bins);
-
-    stellar_yields[mass_bin_index] =
-        (1.f - dZ) * ejecta[lo_index_2d] + dZ * ejecta[hi_index_2d];
-  }
-  const double mass_ejected =
-      integrate_imf(log10_min_mass, log10_max_mass,
-                    eagle_imf_integration_yield_weight, stellar_yields, props);
+  double metal_mass_released_total, mass_ejected;
+  integrate_yields(log10_min_mass, log10_max_mass, Z, abundances,
+                   &props->yield_AGB, eagle_feedback_AGB_N_metals, props,
+                   metal_mass_released, &metal_mass_released_total,
+                   &mass_ejected);
 
   /* Zero all negative values */
   for (int i = 0; i < chemistry_element_count; i++)
@@ -679,6 +574,9 @@ void zero_yield_table_pointers(struct yield_table* table) {
   table->ejecta = NULL;
   table->total_metals_IMF_resampled = NULL;
   table->total_metals = NULL;
+  table->yield_IMF_cumulative = NULL;
+  table->ejecta_IMF_cumulative = NULL;
+  table->total_metals_IMF_cumulative = NULL;
 }
 
 /**
@@ -712,6 +610,9 @@ void feedback_restore_tables(struct feedback_props* fp) {
   /* Resample ejecta contribution to enrichment from mass bins used in tables to
    * mass bins used in IMF  */
   compute_ejecta(fp);
+
+  /* Integrate the resampled yields over the IMF once and for all */
+  compute_cumulative_yields(fp);
 }
 
 #endif /* SWIFT_EAGLE_FEEDBACK_ENRICHMENT_H */
@@ -190,6 +190,196 @@ INLINE static double integrate_imf(
   return result * imf_log10_mass_bin_size * M_LN10;
 }
 
+/*! Spans of IMF mass bins up to which the integrals of the tabulated yields
+ * are summed rather than taken from their cumulative tables, whose difference
+ * would lose precision over a few bins. */
+#define eagle_imf_cumulative_min_span 8
+
+/**
+ * @brief The IMF mass bins and end corrections of the trapezoidal integration
+ * of integrate_imf() between two masses.
+ *
+ * They only depend on the masses, such that they are found once per star and
+ * channel and then used for all the tabulated yields, see
+ * integrate_imf_cumulative().
+ */
+struct imf_integration_bounds {
+
+  /*! First and last IMF mass bins of the integral */
+  int i_min, i_max;
+
+  /*! Weights of the integrand at i_min, i_min + 1, i_max - 1 and i_max
+   * removed to account for the partial end bins */
+  double w_min, w_min_next, w_max_prev, w_max;
+};
+
+/**
+ * @brief Find the #imf_integration_bounds of the IMF between two masses.
+ *
+ * @param log10_min_mass log10 mass lower integration bound
+ * @param log10_max_mass log10 mass upper integration bound
+ * @param bounds (return) The #imf_integration_bounds.
+ * @param feedback_props the #feedback_props data structure
+ */
+INLINE static void determine_imf_integration_bounds(
+    const double log10_min_mass, const double log10_max_mass,
+    struct imf_integration_bounds *bounds,
+    const struct feedback_props *feedback_props) {
+
+  const double *imf_mass_bin_log10 = feedback_props->imf_mass_bin_log10;
+  const double imf_log10_mass_bin_size =
+      imf_mass_bin_log10[1] - imf_mass_bin_log10[0];
+
+  determine_imf_bins(log10_min_mass, log10_max_mass, &bounds->i_min,
+                     &bounds->i_max, feedback_props);
+  const int i_min = bounds->i_min, i_max = bounds->i_max;
+
+  bounds->w_min = 0.;
+  bounds->w_min_next = 0.;
+  bounds->w_max_prev = 0.;
+  bounds->w_max = 0.;
+
+  /* Correct first bin */
+  const double first_bin_offset =
+      (log10_min_mass - imf_mass_bin_log10[i_min]) / imf_log10_mass_bin_size;
+  if (first_bin_offset < 0.5) {
+    bounds->w_min = first_bin_offset;
+  } else {
+    bounds->w_min = 0.5;
+    bounds->w_min_next = first_bin_offset - 0.5;
+  }
+
+  /* Correct last bin */
+  const double last_bin_offset =
+      (log10_max_mass - imf_mass_bin_log10[i_max - 1]) /
+      imf_log10_mass_bin_size;
+  if (last_bin_offset < 0.5) {
+    bounds->w_max = 0.5;
+    bounds->w_max_prev = 0.5 - last_bin_offset;
+  } else {
+    bounds->w_max = 1.0 - last_bin_offset;
+  }
+}
+
+/**
+ * @brief Integrate the IMF weighted by a tabulated yield, as integrate_imf()
+ * does, using the cumulative table of that yield.
+ *
+ * The cost does not depend on the number of IMF mass bins between the
+ * bounds: only the end bins are visited.
+ *
+ * @param bounds The #imf_integration_bounds of the integral.
+ * @param stellar_yields The yield in each IMF mass bin.
+ * @param cumulative The cumulative table of the yield, as computed by
+ * compute_cumulative_yield_table().
+ * @param feedback_props the #feedback_props data structure
+ */
+INLINE static double integrate_imf_cumulative(
+    const struct imf_integration_bounds *bounds,
+    const double *const stellar_yields, const double *const cumulative,
+    const struct feedback_props *feedback_props) {
+
+  const double *imf = feedback_props->imf;
+  const double *imf_mass_bin = feedback_props->imf_mass_bin;
+  const double imf_log10_mass_bin_size = feedback_props->imf_mass_bin_log10[1] -
+                                         feedback_props->imf_mass_bin_log10[0];
+  const int i_min = bounds->i_min, i_max = bounds->i_max;
+
+  /* Integrand at the end bins */
+  const double f_min = stellar_yields[i_min] * imf[i_min] * imf_mass_bin[i_min];
+  const double f_min_next =
+      stellar_yields[i_min + 1] * imf[i_min + 1] * imf_mass_bin[i_min + 1];
+  const double f_max_prev =
+      stellar_yields[i_max - 1] * imf[i_max - 1] * imf_mass_bin[i_max - 1];
+  const double f_max = stellar_yields[i_max] * imf[i_max] * imf_mass_bin[i_max];
+
+  /* Trapezoidal rule over the whole bins */
+  double result;
+  if (i_max - i_min <= eagle_imf_cumulative_min_span) {
+    result = -0.5 * (f_min + f_max);
+    for (int i = i_min; i < i_max + 1; i++)
+      result += stellar_yields[i] * imf[i] * imf_mass_bin[i];
+  } else {
+    result = cumulative[i_max] - cumulative[i_min];
+  }
+
+  /* Remove the parts of the end bins outside the bounds */
+  result -= bounds->w_min * f_min + bounds->w_min_next * f_min_next;
+  result -= bounds->w_max * f_max + bounds->w_max_prev * f_max_prev;
+
+  return result * imf_log10_mass_bin_size * M_LN10;
+}
+
+/**
+ * @brief Allocate and fill the cumulative table of a set of yields tabulated
+ * in the IMF mass bins.
+ *
+ * Entry i of each row is the trapezoidal integral of the IMF weighted by the
+ * yield from the first IMF mass bin to bin i, without the log10 bin size
+ * factor: integrate_imf_cumulative() takes the difference of two entries.
+ *
+ * @param yields The yields, eagle_feedback_N_imf_bins consecutive values per
+ * row.
+ * @param nr_rows The number of rows.
+ * @param feedback_props the #feedback_props data structure (with the IMF)
+ */
+INLINE static double *compute_cumulative_yield_table(
+    const double *const yields, const int nr_rows,
+    const struct feedback_props *feedback_props) {
+
+  const double *imf = feedback_props->imf;
+  const double *imf_mass_bin = feedback_props->imf_mass_bin;
+  const int N_bins = eagle_feedback_N_imf_bins;
+
+  double *cumulative = NULL;
+  if (swift_memalign("feedback-tables", (void **)&cumulative,
+                     SWIFT_STRUCT_ALIGNMENT,
+                     nr_rows * N_bins * sizeof(double)) != 0)
+    error("Failed to allocate cumulative yield table");
+
+  for (int row = 0; row < nr_rows; row++) {
+    const double *y = yields + row * N_bins;
+    double *c = cumulative + row * N_bins;
+
+    c[0] = 0.;
+    for (int i = 1; i < N_bins; i++)
+      c[i] = c[i - 1] + 0.5 * (y[i - 1] * imf[i - 1] * imf_mass_bin[i - 1] +
+                               y[i] * imf[i] * imf_mass_bin[i]);
+  }
+  return cumulative;
+}
+
+/**
+ * @brief Compute the cumulative tables of the AGB and SNII yields resampled
+ * to the IMF mass bins.
+ *
+ * @param feedback_props the #feedback_props data structure (with the IMF and
+ * the resampled yields)
+ */
+INLINE static void compute_cumulative_yields(
+    struct feedback_props *feedback_props) {
+
+  struct yield_table *AGB = &feedback_props->yield_AGB;
+  AGB->yield_IMF_cumulative = compute_cumulative_yield_table(
+      AGB->yield_IMF_resampled,
+      eagle_feedback_AGB_N_metals * chemistry_element_count, feedback_props);
+  AGB->ejecta_IMF_cumulative = compute_cumulative_yield_table(
+      AGB->ejecta_IMF_resampled, eagle_feedback_AGB_N_metals, feedback_props);
+  AGB->total_metals_IMF_cumulative = compute_cumulative_yield_table(
+      AGB->total_metals_IMF_resampled, eagle_feedback_AGB_N_metals,
+      feedback_props);
+
+  struct yield_table *SNII = &feedback_props->yield_SNII;
+  SNII->yield_IMF_cumulative = compute_cumulative_yield_table(
+      SNII->yield_IMF_resampled,
+      eagle_feedback_SNII_N_metals * chemistry_element_count, feedback_props);
+  SNII->ejecta_IMF_cumulative = compute_cumulative_yield_table(
+      SNII->ejecta_IMF_resampled, eagle_feedback_SNII_N_metals, feedback_props);
+  SNII->total_metals_IMF_cumulative = compute_cumulative_yield_table(
+      SNII->total_metals_IMF_resampled, eagle_feedback_SNII_N_metals,
+      feedback_props);
+}
+
 /**
  * @brief Allocate space for IMF table and compute values to populate this
  * table.
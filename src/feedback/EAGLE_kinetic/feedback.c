@@ -667,6 +667,9 @@ void feedback_props_init(struct feedback_props* fp,
    * mass bins used in IMF  */
   compute_ejecta(fp);
 
+  /* Integrate the resampled yields over the IMF once and for all */
+  compute_cumulative_yields(fp);
+
   if (engine_rank == 0) message("initialized stellar feedback");
 }
 
@@ -700,6 +703,12 @@ void feedback_clean(struct feedback_props* fp) {
   swift_free("feedback-tables", fp->yield_SNII.ejecta_IMF_resampled);
   swift_free("feedback-tables", fp->yield_SNII.total_metals);
   swift_free("feedback-tables", fp->yield_SNII.total_metals_IMF_resampled);
+  swift_free("feedback-tables", fp->yield_AGB.yield_IMF_cumulative);
+  swift_free("feedback-tables", fp->yield_AGB.ejecta_IMF_cumulative);
+  swift_free("feedback-tables", fp->yield_AGB.total_metals_IMF_cumulative);
+  swift_free("feedback-tables", fp->yield_SNII.yield_IMF_cumulative);
+  swift_free("feedback-tables", fp->yield_SNII.ejecta_IMF_cumulative);
+  swift_free("feedback-tables", fp->yield_SNII.total_metals_IMF_cumulative);
   swift_free("feedback-tables", fp->lifetimes.mass);
   swift_free("feedback-tables", fp->lifetimes.metallicity);
   swift_free("feedback-tables", fp->yield_mass_bins);
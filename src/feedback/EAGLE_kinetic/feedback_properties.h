@@ -57,6 +57,12 @@ struct yield_table {
 
   /* Array to store table of total mass released being read in */
   double *total_metals;
+
+  /*! Cumulative IMF-weighted integrals of the three resampled tables (see
+   * compute_cumulative_yield_table()) */
+  double *yield_IMF_cumulative;
+  double *ejecta_IMF_cumulative;
+  double *total_metals_IMF_cumulative;
 };
 
 /**
@@ -25,6 +25,7 @@
 /* Some standard headers. */
 #include <errno.h>
 #include <libgen.h>
+#include <stddef.h>
 #include <unistd.h>
 
 /* MPI headers. */
@@ -38,6 +39,7 @@
 /* Local headers. */
 #include "black_holes.h"
 #include "common_io.h"
+#include "cuda_fof.h"
 #include "engine.h"
 #include "fof_catalogue_io.h"
 #include "hashmap.h"
@@ -51,9 +53,16 @@
 #define fof_props_default_group_id_offset 1
 #define fof_props_default_group_link_size 20000
 
+/*! Inner edge of the SO radial bins, in units of the search radius */
+#define fof_so_min_radius_ratio 1e-2
+
+/*! Number of groups each rank treats per round of the SO search */
+#define fof_so_batch_size 16384
+
+/*! Number of times the SO search radius of a group can be doubled */
+#define fof_so_max_doublings 6
+
 /* Constants. */
-#define UNION_BY_SIZE_OVER_MPI (1)
-#define FOF_COMPRESS_PATHS_MIN_LENGTH (2)
 
 /* The FoF policy we are running */
 int current_fof_linking_type;
@@ -83,6 +92,8 @@ MPI_Datatype fof_mpi_type;
 MPI_Datatype group_length_mpi_type;
 MPI_Datatype fof_final_index_type;
 MPI_Datatype fof_final_mass_type;
+MPI_Datatype fof_so_sphere_type;
+MPI_Datatype fof_so_profile_type;
 
 /*! Offset between the first particle on this MPI rank and the first particle in
  * the global order */
@@ -168,6 +179,21 @@ void fof_init(struct fof_props *props, struct swift_params *params,
   if (props->l_x_ratio <= 0. && props->l_x_absolute == -1.)
     error("The FOF linking length ratio can't be negative!");
 
+  /* Read the margin left for the drifts in between warm-started calls */
+  props->warm_start_margin =
+      parser_get_opt_param_double(params, "FOF:warm_start_margin", 0.);
+
+  if (props->warm_start_margin < 0. || props->warm_start_margin >= 1.)
+    error("The FOF warm start margin must be in [0, 1)!");
+
+  /* Are we computing spherical overdensity masses for the catalogues? */
+  props->compute_so_masses =
+      parser_get_opt_param_int(params, "FOF:compute_SO_masses", 0);
+
+  /* No cores to start from yet */
+  props->warm_start_core_l_x = 0.;
+  props->warm_start_nr_labelled = 0;
+
   if (!stand_alone_fof && props->seed_black_holes_enabled) {
 
     /* Read the minimal halo mass for black hole seeding */
@@ -219,11 +245,11 @@ void fof_init(struct fof_props *props, struct swift_params *params,
     printf("\n");
   }
 
-#if defined(WITH_MPI) && defined(UNION_BY_SIZE_OVER_MPI)
+#if defined(WITH_MPI)
   if (engine_rank == 0)
     message(
-        "Performing FOF over MPI using union by size and union by rank "
-        "locally.");
+        "Performing FOF over MPI using label propagation across ranks and "
+        "union by rank locally.");
 #else
   message("Performing FOF using union by rank.");
 #endif
@@ -257,6 +283,17 @@ void fof_create_mpi_types(void) {
       MPI_Type_commit(&fof_final_mass_type) != MPI_SUCCESS) {
     error("Failed to create MPI type for fof_final_mass.");
   }
+  /* Define types for sending the SO spheres and profiles */
+  if (MPI_Type_contiguous(sizeof(struct fof_so_sphere), MPI_BYTE,
+                          &fof_so_sphere_type) != MPI_SUCCESS ||
+      MPI_Type_commit(&fof_so_sphere_type) != MPI_SUCCESS) {
+    error("Failed to create MPI type for fof_so_sphere.");
+  }
+  if (MPI_Type_contiguous(sizeof(struct fof_so_profile), MPI_BYTE,
+                          &fof_so_profile_type) != MPI_SUCCESS ||
+      MPI_Type_commit(&fof_so_profile_type) != MPI_SUCCESS) {
+    error("Failed to create MPI type for fof_so_profile.");
+  }
 #else
   error("Calling an MPI function in non-MPI code.");
 #endif
@@ -443,6 +480,9 @@ void fof_allocate(const struct space *s, struct fof_props *props) {
         "check more than one layer of top-level cells for links.");
 #endif
 
+  /* The local linking uses the full length unless told otherwise */
+  props->search_l_x2 = props->l_x2;
+
   /* Allocate and initialise a group index array. */
   if (swift_memalign("fof_group_index", (void **)&props->group_index, 64,
                      s->nr_gparts * sizeof(size_t)) != 0)
@@ -566,6 +606,26 @@ int compare_fof_final_index_global_root(const void *a, const void *b) {
     return 0;
 }
 
+/**
+ * @brief Comparison function for qsort call comparing the foreign roots of
+ * #fof_mpi links.
+ *
+ * @param a The first #fof_mpi object.
+ * @param b The second #fof_mpi object.
+ * @return 1 if the group_j of a is larger than the one of b, -1 if smaller and
+ * 0 if they are equal.
+ */
+int compare_fof_mpi_group_j(const void *a, const void *b) {
+  struct fof_mpi *fof_mpi_a = (struct fof_mpi *)a;
+  struct fof_mpi *fof_mpi_b = (struct fof_mpi *)b;
+  if (fof_mpi_b->group_j < fof_mpi_a->group_j)
+    return 1;
+  else if (fof_mpi_b->group_j > fof_mpi_a->group_j)
+    return -1;
+  else
+    return 0;
+}
+
 /**
  * @brief Comparison function for qsort call comparing group global roots
  *
@@ -714,7 +774,10 @@ __attribute__((always_inline)) INLINE static int gpart_is_ignorable(
  *
  * We follow the group_index array until reaching the root of the group.
  *
- * Also performs path compression if the path is long.
+ * Also halves the path on the way by pointing every node visited at its
+ * grandparent. This is lock-free: the CAS only succeeds if the parent has not
+ * changed since being read and the grandparent is always an ancestor, so the
+ * trees only ever get shallower.
  *
  * @param i The index of the particle.
  * @param group_index Array of group root indices.
@@ -723,25 +786,43 @@ __attribute__((always_inline)) INLINE static size_t fof_find(
     const size_t i, size_t *group_index) {
 
   size_t root = i;
-  int tree_depth = 0;
 
-  while (root != group_index[root]) {
-#ifdef PATH_HALVING
-    atomic_cas(&group_index[root], group_index[root],
-               group_index[group_index[root]]);
-#endif
-    root = group_index[root];
-    tree_depth++;
-  }
+  while (1) {
+    const size_t parent = group_index[root];
+    if (parent == root) break;
 
-  /* Only perform path compression on trees with a depth of
-   * FOF_COMPRESS_PATHS_MIN_LENGTH or higher. */
-  if (tree_depth >= FOF_COMPRESS_PATHS_MIN_LENGTH)
-    atomic_cas(&group_index[i], group_index[i], root);
+    const size_t grandparent = group_index[parent];
+    if (grandparent != parent)
+      atomic_cas(&group_index[root], parent, grandparent);
+
+    root = grandparent;
+  }
 
   return root;
 }
 
+/**
+ * @brief Mapper function pointing every particle straight at its root.
+ *
+ * Run once the local linking is done such that the later passes over the
+ * groups find the roots in a single read.
+ *
+ * @param map_data The array of group indices.
+ * @param num_elements Chunk size.
+ * @param extra_data Pointer to first group index.
+ */
+static void fof_flatten_group_index_mapper(void *map_data, int num_elements,
+                                           void *extra_data) {
+  size_t *group_index = (size_t *)map_data;
+  size_t *group_index_start = (size_t *)extra_data;
+
+  const ptrdiff_t offset = group_index - group_index_start;
+
+  for (int i = 0; i < num_elements; ++i) {
+    group_index[i] = fof_find(i + offset, group_index_start);
+  }
+}
+
 /**
  * @brief Atomically update the root of a group
  *
@@ -959,8 +1040,123 @@ __attribute__((always_inline)) INLINE static void fof_compute_send_recv_offsets(
   for (int i = 0; i < nr_nodes; i++) (*nrecv) += (*recvcount)[i];
 }
 
+/* Determine range of global indexes (i.e. particles) on each node. */
+static void fof_get_node_ranges(const size_t nr_gparts, const int nr_nodes,
+                                size_t **first_on_node,
+                                size_t **num_on_node) {
+
+  *num_on_node = (size_t *)malloc(nr_nodes * sizeof(size_t));
+  MPI_Allgather(&nr_gparts, sizeof(size_t), MPI_BYTE, *num_on_node,
+                sizeof(size_t), MPI_BYTE, MPI_COMM_WORLD);
+  *first_on_node = (size_t *)malloc(nr_nodes * sizeof(size_t));
+  (*first_on_node)[0] = 0;
+  for (int i = 1; i < nr_nodes; i++)
+    (*first_on_node)[i] = (*first_on_node)[i - 1] + (*num_on_node)[i - 1];
+}
+
+/* Determine how many entries of a list sorted by a global index go to the
+ * node holding that index. The key is found key_offset bytes into each
+ * entry. */
+static int *fof_count_per_node(const void *list, const size_t n,
+                               const size_t stride, const size_t key_offset,
+                               const size_t *first_on_node,
+                               const size_t *num_on_node,
+                               const int nr_nodes) {
+
+  int *sendcount = (int *)calloc(nr_nodes, sizeof(int));
+  int dest = 0;
+  for (size_t i = 0; i < n; i++) {
+    const size_t key =
+        *(const size_t *)((const char *)list + i * stride + key_offset);
+    while (dest < nr_nodes &&
+           ((key >= first_on_node[dest] + num_on_node[dest]) ||
+            (num_on_node[dest] == 0)))
+      dest++;
+    if (dest >= nr_nodes) error("Node index out of range!");
+    sendcount[dest]++;
+  }
+  return sendcount;
+}
+
+/* Send a list of #fof_final_index to the nodes holding their global_root.
+ * The list gets sorted by global_root and the exchange arrays are kept such
+ * that the receivers can answer with the reverse exchange. */
+static struct fof_final_index *fof_send_to_root_nodes(
+    struct fof_final_index *fof_index_send, const size_t nsend,
+    const size_t *first_on_node, const size_t *num_on_node,
+    const int nr_nodes, int **sendcount, int **recvcount, int **sendoffset,
+    int **recvoffset, size_t *nrecv) {
+
+  qsort(fof_index_send, nsend, sizeof(struct fof_final_index),
+        compare_fof_final_index_global_root);
+
+  *sendcount = fof_count_per_node(
+      fof_index_send, nsend, sizeof(struct fof_final_index),
+      offsetof(struct fof_final_index, global_root), first_on_node,
+      num_on_node, nr_nodes);
+
+  fof_compute_send_recv_offsets(nr_nodes, *sendcount, recvcount, sendoffset,
+                                recvoffset, nrecv);
+
+  struct fof_final_index *fof_index_recv =
+      (struct fof_final_index *)swift_malloc(
+          "fof_index_recv", *nrecv * sizeof(struct fof_final_index));
+
+  MPI_Alltoallv(fof_index_send, *sendcount, *sendoffset, fof_final_index_type,
+                fof_index_recv, *recvcount, *recvoffset, fof_final_index_type,
+                MPI_COMM_WORLD);
+
+  return fof_index_recv;
+}
+
+/* Free the arrays of an exchange done by fof_send_to_root_nodes(). */
+static void fof_free_exchange(int *sendcount, int *recvcount, int *sendoffset,
+                              int *recvoffset) {
+  free(sendcount);
+  free(recvcount);
+  free(sendoffset);
+  free(recvoffset);
+}
+
 #endif /* WITH_MPI */
 
+/**
+ * @brief Returns the root shared by all the linkable #gpart of a leaf-cell.
+ *
+ * Once found, it stays true as the groups only ever merge and the pairs of
+ * particles in the cell have nothing left to link.
+ *
+ * @param c The #cell.
+ * @param space_gparts The start of the #gpart array in the #space structure.
+ * @param group_index Array of group root indices.
+ *
+ * @return The common root or (size_t)-1 if there is none.
+ */
+static size_t fof_cell_common_root(const struct cell *c,
+                                   const struct gpart *const space_gparts,
+                                   size_t *group_index) {
+
+  const size_t count = c->grav.count;
+  const struct gpart *gparts = c->grav.parts;
+  size_t *const offset = group_index + (ptrdiff_t)(gparts - space_gparts);
+
+  size_t root = (size_t)-1;
+  for (size_t i = 0; i < count; i++) {
+
+    const struct gpart *gp = &gparts[i];
+    if (gp->time_bin >= time_bin_inhibited) continue;
+    if (!gpart_is_linkable(gp)) continue;
+
+    const size_t root_i = fof_find(offset[i], group_index);
+    if (root == (size_t)-1)
+      root = root_i;
+    else if (root_i != root)
+      return (size_t)-1;
+  }
+
+  return root;
+}
+
 /**
  * @brief Perform a FOF search using union-find on a given leaf-cell
  *
@@ -991,6 +1187,11 @@ void fof_search_self_cell(const struct fof_props *props, const double l_x2,
     error("Performing self FOF search on foreign cell.");
 #endif
 
+  /* Nothing to do in a cell the seeded cores already span */
+  if (props->warm_start_margin > 0. &&
+      fof_cell_common_root(c, space_gparts, group_index) != (size_t)-1)
+    return;
+
   /* Loop over particles and find which particles belong in the same group. */
   for (size_t i = 0; i < count; i++) {
 
@@ -1103,6 +1304,14 @@ void fof_search_pair_cells(const struct fof_props *props, const double dim[3],
   if (ci->nodeID != cj->nodeID) error("Searching foreign cells!");
 #endif
 
+  /* Nothing to do if the seeded cores already link the two cells */
+  if (props->warm_start_margin > 0.) {
+    const size_t root_ci = fof_cell_common_root(ci, space_gparts, group_index);
+    if (root_ci != (size_t)-1 &&
+        root_ci == fof_cell_common_root(cj, space_gparts, group_index))
+      return;
+  }
+
   /* Account for boundary conditions.*/
   double shift[3] = {0.0, 0.0, 0.0};
 
@@ -1195,6 +1404,153 @@ void fof_search_pair_cells(const struct fof_props *props, const double dim[3],
   }
 }
 
+/**
+ * @brief Seed the group indices with the cores of the last FOF call.
+ *
+ * The cores were linked with a length shorter than the current linking
+ * length by more than twice the distance any of their particles can have
+ * drifted since. All their links are hence still in range and all their
+ * particles still in the same group, so the linking only has to add the
+ * links between the cores. Particles spawned since carry no core.
+ *
+ * Nothing is seeded if a labelled particle was removed or stopped being
+ * linkable (it may have been the only bridge in its core) or if the
+ * particles drifted too far.
+ *
+ * @param props The properties of the FOF scheme.
+ * @param s The #space.
+ *
+ * @return 1 if the group indices were seeded, 0 otherwise.
+ */
+int fof_warm_start_seed(struct fof_props *props, const struct space *s) {
+
+  const ticks tic = getticks();
+  const struct gpart *gparts = s->gparts;
+  const size_t nr_gparts = s->nr_gparts;
+  size_t *group_index = props->group_index;
+
+  /* Count the labelled particles left and find the largest drift */
+  long long nr_labelled = 0;
+  float drift_max = 0.f;
+  for (size_t i = 0; i < nr_gparts; ++i) {
+    const struct gpart *gp = &gparts[i];
+    if (gp->time_bin >= time_bin_inhibited || !gpart_is_linkable(gp) ||
+        gp->fof_data.core_id == fof_gpart_no_core)
+      continue;
+    nr_labelled++;
+    drift_max = max(drift_max, gp->fof_data.drift_since_fof);
+  }
+
+#ifdef WITH_MPI
+  MPI_Allreduce(MPI_IN_PLACE, &nr_labelled, 1, MPI_LONG_LONG, MPI_SUM,
+                MPI_COMM_WORLD);
+  MPI_Allreduce(MPI_IN_PLACE, &drift_max, 1, MPI_FLOAT, MPI_MAX,
+                MPI_COMM_WORLD);
+#endif
+
+  /* Length all the links of the seeded cores are below */
+  const double seed_l_x = props->warm_start_core_l_x + 2. * drift_max;
+
+  if (props->warm_start_nr_labelled == 0 ||
+      nr_labelled != props->warm_start_nr_labelled ||
+      seed_l_x >= sqrt(props->l_x2)) {
+
+    if (s->e->nodeID == 0 && props->warm_start_nr_labelled > 0)
+      message(
+          "Not warm-starting: %lld of %lld core particles left, drifted by "
+          "up to %e.",
+          nr_labelled, props->warm_start_nr_labelled, drift_max);
+
+    props->warm_start_core_l_x = 0.;
+    return 0;
+  }
+
+  /* Point every particle at the first one of its core */
+  hashmap_t map;
+  hashmap_init(&map);
+  for (size_t i = 0; i < nr_gparts; ++i) {
+    const struct gpart *gp = &gparts[i];
+    if (gp->time_bin >= time_bin_inhibited || !gpart_is_linkable(gp) ||
+        gp->fof_data.core_id == fof_gpart_no_core)
+      continue;
+
+    int created_new_element = 0;
+    hashmap_value_t *first =
+        hashmap_get_new(&map, gp->fof_data.core_id, &created_new_element);
+    if (first == NULL)
+      error("Couldn't find key (%zu) or create new one.",
+            gp->fof_data.core_id);
+    if (created_new_element) first->value_st = i;
+    group_index[i] = first->value_st;
+  }
+  hashmap_free(&map);
+
+  /* The cores found next may contain these links */
+  props->warm_start_core_l_x = seed_l_x;
+
+  if (s->e->verbose)
+    message("Seeding the cores took %.3f %s.",
+            clocks_from_ticks(getticks() - tic), clocks_getunit());
+
+  return 1;
+}
+
+/**
+ * @brief Label the particles with the cores found by the local linking at
+ * the reduced length, for the next call to start from.
+ *
+ * The labels are the global index of the root of each core and the drift
+ * bounds start again from zero.
+ *
+ * @param props The properties of the FOF scheme.
+ * @param s The #space.
+ */
+void fof_warm_start_store_cores(struct fof_props *props, struct space *s) {
+
+  const ticks tic = getticks();
+  struct gpart *gparts = s->gparts;
+  const size_t nr_gparts = s->nr_gparts;
+  size_t *group_index = props->group_index;
+
+  /* Make the labels unique across the ranks */
+  size_t label_offset = 0;
+#ifdef WITH_MPI
+  const long long nr_gparts_local = nr_gparts;
+  long long nr_gparts_cumulative;
+  MPI_Scan(&nr_gparts_local, &nr_gparts_cumulative, 1, MPI_LONG_LONG, MPI_SUM,
+           MPI_COMM_WORLD);
+  label_offset = nr_gparts_cumulative - nr_gparts_local;
+#endif
+
+  long long nr_labelled = 0;
+  for (size_t i = 0; i < nr_gparts; ++i) {
+    struct gpart *gp = &gparts[i];
+    gp->fof_data.drift_since_fof = 0.f;
+
+    if (gp->time_bin >= time_bin_inhibited || !gpart_is_linkable(gp)) {
+      gp->fof_data.core_id = fof_gpart_no_core;
+      continue;
+    }
+
+    gp->fof_data.core_id = label_offset + fof_find(i, group_index);
+    nr_labelled++;
+  }
+
+#ifdef WITH_MPI
+  MPI_Allreduce(MPI_IN_PLACE, &nr_labelled, 1, MPI_LONG_LONG, MPI_SUM,
+                MPI_COMM_WORLD);
+#endif
+
+  /* The seeded links may be longer than the ones found since */
+  props->warm_start_nr_labelled = nr_labelled;
+  props->warm_start_core_l_x =
+      max(props->warm_start_core_l_x, sqrt(props->search_l_x2));
+
+  if (s->e->verbose)
+    message("Labelling the cores took %.3f %s.",
+            clocks_from_ticks(getticks() - tic), clocks_getunit());
+}
+
 #ifdef WITH_MPI
 
 /**
@@ -1542,6 +1898,100 @@ void rec_fof_search_self(const struct fof_props *props, const double dim[3],
     fof_search_self_cell(props, search_r2, space_gparts, c);
 }
 
+/**
+ * @brief Recursively collect the pairs of leaves of two cells that are within
+ * the linking length of each other for the GPU FOF search.
+ *
+ * Follows the same recursion as rec_fof_search_pair().
+ *
+ * @param dim The dimension of the space.
+ * @param search_r2 the square of the FOF linking length.
+ * @param periodic Are we using periodic BCs?
+ * @param space_gparts The start of the #gpart array in the #space structure.
+ * @param ci The first #cell.
+ * @param cj The second #cell.
+ */
+void rec_fof_collect_pair(const double dim[3], const double search_r2,
+                          const int periodic,
+                          const struct gpart *const space_gparts,
+                          const struct cell *ci, const struct cell *cj) {
+
+  /* Return if cells are out of range of each other. */
+  if (cell_min_dist(ci, cj, dim) > search_r2) return;
+
+  if (ci->split && cj->split) {
+    for (int k = 0; k < 8; k++)
+      if (ci->progeny[k] != NULL)
+        for (int l = 0; l < 8; l++)
+          if (cj->progeny[l] != NULL)
+            rec_fof_collect_pair(dim, search_r2, periodic, space_gparts,
+                                 ci->progeny[k], cj->progeny[l]);
+  } else if (ci->split) {
+    for (int k = 0; k < 8; k++)
+      if (ci->progeny[k] != NULL)
+        rec_fof_collect_pair(dim, search_r2, periodic, space_gparts,
+                             ci->progeny[k], cj);
+  } else if (cj->split) {
+    for (int k = 0; k < 8; k++)
+      if (cj->progeny[k] != NULL)
+        rec_fof_collect_pair(dim, search_r2, periodic, space_gparts, ci,
+                             cj->progeny[k]);
+  } else if (ci->grav.count > 0 && cj->grav.count > 0) {
+
+    /* Same shift as in fof_search_pair_cells() */
+    double shift[3] = {0.0, 0.0, 0.0};
+    for (int k = 0; k < 3; k++) {
+      const double diff = cj->loc[k] - ci->loc[k];
+      if (periodic && diff < -dim[k] * 0.5)
+        shift[k] = dim[k];
+      else if (periodic && diff > dim[k] * 0.5)
+        shift[k] = -dim[k];
+    }
+
+    cuda_fof_add_leaf_pair(ci->grav.parts - space_gparts, ci->grav.count,
+                           cj->grav.parts - space_gparts, cj->grav.count,
+                           shift, /*self=*/0);
+  }
+}
+
+/**
+ * @brief Recursively collect the leaves of a cell and the pairs of leaves
+ * within the linking length of each other for the GPU FOF search.
+ *
+ * Follows the same recursion as rec_fof_search_self().
+ *
+ * @param dim The dimension of the space.
+ * @param search_r2 the square of the FOF linking length.
+ * @param periodic Are we using periodic BCs?
+ * @param space_gparts The start of the #gpart array in the #space structure.
+ * @param c The #cell.
+ */
+void rec_fof_collect_self(const double dim[3], const double search_r2,
+                          const int periodic,
+                          const struct gpart *const space_gparts,
+                          const struct cell *c) {
+
+  if (c->split) {
+    for (int k = 0; k < 8; k++) {
+      if (c->progeny[k] != NULL) {
+
+        rec_fof_collect_self(dim, search_r2, periodic, space_gparts,
+                             c->progeny[k]);
+
+        for (int l = k + 1; l < 8; l++)
+          if (c->progeny[l] != NULL)
+            rec_fof_collect_pair(dim, search_r2, periodic, space_gparts,
+                                 c->progeny[k], c->progeny[l]);
+      }
+    }
+  } else if (c->grav.count > 1) {
+    const double shift[3] = {0.0, 0.0, 0.0};
+    cuda_fof_add_leaf_pair(c->grav.parts - space_gparts, c->grav.count,
+                           c->grav.parts - space_gparts, c->grav.count, shift,
+                           /*self=*/1);
+  }
+}
+
 /**
  * @brief Perform the attaching operation using union-find on a given leaf-cell
  *
@@ -3417,67 +3867,16 @@ void fof_build_list_of_purely_local_groups(struct fof_props *props,
 #ifdef WITH_MPI
 
   struct engine *e = s->e;
+  const int nr_nodes = e->nr_nodes;
 
   /* Abort if only one node */
-  if (e->nr_nodes == 1) return;
+  if (nr_nodes == 1) return;
 
   /* Local copy of the variable set in the mapper */
   const size_t nr_gparts = s->nr_gparts;
   size_t *restrict group_index = props->group_index;
   const int group_link_count = props->group_link_count;
-
-  /* Sum the total number of links across MPI domains over each MPI rank. */
-  int global_group_link_count = 0;
-  MPI_Allreduce(&group_link_count, &global_group_link_count, 1, MPI_INT,
-                MPI_SUM, MPI_COMM_WORLD);
-
-  if (global_group_link_count < 0)
-    error("Overflow of the size of the global list of foregin links");
-
-  struct fof_mpi *global_group_links = NULL;
-  int *displ = NULL, *group_link_counts = NULL;
-
-  if (swift_memalign("fof_global_group_links", (void **)&global_group_links,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     global_group_link_count * sizeof(struct fof_mpi)) != 0)
-    error("Error while allocating memory for the global list of group links");
-
-  if (posix_memalign((void **)&group_link_counts, SWIFT_STRUCT_ALIGNMENT,
-                     e->nr_nodes * sizeof(int)) != 0)
-    error(
-        "Error while allocating memory for the number of group links on each "
-        "MPI rank");
-
-  if (posix_memalign((void **)&displ, SWIFT_STRUCT_ALIGNMENT,
-                     e->nr_nodes * sizeof(int)) != 0)
-    error(
-        "Error while allocating memory for the displacement in memory for the "
-        "global group link list");
-
-  /* Gather the total number of links on each rank. */
-  MPI_Allgather(&group_link_count, 1, MPI_INT, group_link_counts, 1, MPI_INT,
-                MPI_COMM_WORLD);
-
-  /* Set the displacements into the global link list using the link counts from
-   * each rank */
-  displ[0] = 0;
-  for (int i = 1; i < e->nr_nodes; i++) {
-    displ[i] = displ[i - 1] + group_link_counts[i - 1];
-    if (displ[i] < 0) error("Number of group links overflowing!");
-  }
-
-  /* Gather the global link list on all ranks. */
-  MPI_Allgatherv(props->group_links, group_link_count, fof_mpi_type,
-                 global_group_links, group_link_counts, displ, fof_mpi_type,
-                 MPI_COMM_WORLD);
-
-  /* Clean up memory. */
-  free(group_link_counts);
-  free(displ);
-
-  /* We now have a list of all the fragment connections.
-   * We can iterate over the *local* groups to identify the ones which
-   * are *not* appearing in the list */
+  const struct fof_mpi *group_links = props->group_links;
 
   if (posix_memalign((void **)&props->is_purely_local, SWIFT_STRUCT_ALIGNMENT,
                      nr_gparts * sizeof(char)) != 0)
@@ -3486,31 +3885,48 @@ void fof_build_list_of_purely_local_groups(struct fof_props *props,
   /* Start by pretending every group is purely local */
   for (size_t i = 0; i < nr_gparts; ++i) props->is_purely_local[i] = 1;
 
-  /* Now loop over the list of inter-rank connections and flag each halo present
-   * in the list */
-  for (int k = 0; k < global_group_link_count; ++k) {
+  /* Flag the local end of our inter-rank connections and send the foreign
+   * end to the node holding it (it may not have found the link itself) */
+  struct fof_final_index *fof_index_send =
+      (struct fof_final_index *)swift_malloc(
+          "fof_index_send", group_link_count * sizeof(struct fof_final_index));
 
-    const size_t group_i = global_group_links[k].group_i;
-    const size_t group_j = global_group_links[k].group_j;
+  for (int k = 0; k < group_link_count; ++k) {
 
     const size_t root_i =
-        fof_find_global(group_i - node_offset, group_index, nr_gparts);
-    const size_t root_j =
-        fof_find_global(group_j - node_offset, group_index, nr_gparts);
+        fof_find_global(group_links[k].group_i - node_offset, group_index,
+                        nr_gparts);
+    if (is_local(root_i, nr_gparts))
+      props->is_purely_local[root_i - node_offset] = 0;
 
-    if (is_local(root_i, nr_gparts)) {
-      const size_t local_root = root_i - node_offset;
-      props->is_purely_local[local_root] = 0;
-    }
+    fof_index_send[k].local_root = group_links[k].group_i;
+    fof_index_send[k].global_root = group_links[k].group_j;
+  }
 
-    if (is_local(root_j, nr_gparts)) {
-      const size_t local_root = root_j - node_offset;
-      props->is_purely_local[local_root] = 0;
-    }
+  size_t *first_on_node = NULL, *num_on_node = NULL;
+  fof_get_node_ranges(nr_gparts, nr_nodes, &first_on_node, &num_on_node);
+
+  int *sendcount = NULL, *recvcount = NULL, *sendoffset = NULL,
+      *recvoffset = NULL;
+  size_t nrecv = 0;
+  struct fof_final_index *fof_index_recv = fof_send_to_root_nodes(
+      fof_index_send, group_link_count, first_on_node, num_on_node, nr_nodes,
+      &sendcount, &recvcount, &sendoffset, &recvoffset, &nrecv);
+
+  for (size_t k = 0; k < nrecv; ++k) {
+
+    const size_t root_j = fof_find_global(
+        fof_index_recv[k].global_root - node_offset, group_index, nr_gparts);
+    if (is_local(root_j, nr_gparts))
+      props->is_purely_local[root_j - node_offset] = 0;
   }
 
-  /* Clean up the last allocated array */
-  swift_free("fof_global_group_links", global_group_links);
+  /* Clean up memory. */
+  fof_free_exchange(sendcount, recvcount, sendoffset, recvoffset);
+  free(first_on_node);
+  free(num_on_node);
+  swift_free("fof_index_send", fof_index_send);
+  swift_free("fof_index_recv", fof_index_recv);
 #endif
 }
 
@@ -3617,11 +4033,16 @@ void fof_finalise_attachables(struct fof_props *props, const struct space *s) {
 }
 
 /**
- * @brief Process all the group fragments spanning more than
- * one rank to link them.
+ * @brief Link the fragments of the groups spread over several ranks.
  *
- * This is the final global union-find pass which concludes
- * the MPI-FOF-algorithm.
+ * The fragments (identified by their local root) and the links between them
+ * form a graph whose connected components are the groups. These are found
+ * with rounds of label propagation: every fragment sends its label (the
+ * smallest fragment it is known to be linked to) along its links, then looks
+ * up the label of its label (pointer jumping) on the node holding it. All the
+ * messages go to the nodes holding the fragments, nothing is gathered
+ * globally. When no label changes any more, every fragment is labelled with
+ * the smallest fragment of its group, which becomes the root.
  *
  * @param props The properties fof the FOF scheme.
  * @param s The #space we work with.
@@ -3633,9 +4054,10 @@ void fof_link_foreign_fragments(struct fof_props *props,
 
   struct engine *e = s->e;
   const int verbose = e->verbose;
+  const int nr_nodes = e->nr_nodes;
 
   /* Abort if only one node */
-  if (e->nr_nodes == 1) return;
+  if (nr_nodes == 1) return;
 
   const size_t nr_gparts = s->nr_gparts;
   size_t *restrict group_index = props->group_index;
@@ -3643,7 +4065,6 @@ void fof_link_foreign_fragments(struct fof_props *props,
 
   const ticks tic_total = getticks();
   ticks tic = getticks();
-  const ticks comms_tic = getticks();
 
   if (verbose)
     message(
@@ -3652,225 +4073,234 @@ void fof_link_foreign_fragments(struct fof_props *props,
 
   /* Local copy of the variable set in the mapper */
   const int group_link_count = props->group_link_count;
+  struct fof_mpi *group_links = props->group_links;
 
-  /* Sum the total number of links across MPI domains over each MPI rank. */
-  int global_group_link_count = 0;
-  MPI_Allreduce(&group_link_count, &global_group_link_count, 1, MPI_INT,
-                MPI_SUM, MPI_COMM_WORLD);
+  size_t *first_on_node = NULL, *num_on_node = NULL;
+  fof_get_node_ranges(nr_gparts, nr_nodes, &first_on_node, &num_on_node);
 
-  if (global_group_link_count < 0)
-    error("Overflow of the size of the global list of foreign links");
+  /* Send every link to the node holding its foreign end such that both ends
+   * know about it even if it was only found from one side. */
+  qsort(group_links, group_link_count, sizeof(struct fof_mpi),
+        compare_fof_mpi_group_j);
 
-  struct fof_mpi *global_group_links = NULL;
-  int *displ = NULL, *group_link_counts = NULL;
+  int *sendcount = fof_count_per_node(
+      group_links, group_link_count, sizeof(struct fof_mpi),
+      offsetof(struct fof_mpi, group_j), first_on_node, num_on_node, nr_nodes);
 
-  if (swift_memalign("fof_global_group_links", (void **)&global_group_links,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     global_group_link_count * sizeof(struct fof_mpi)) != 0)
-    error("Error while allocating memory for the global list of group links");
-
-  if (posix_memalign((void **)&group_link_counts, SWIFT_STRUCT_ALIGNMENT,
-                     e->nr_nodes * sizeof(int)) != 0)
-    error(
-        "Error while allocating memory for the number of group links on each "
-        "MPI rank");
+  int *recvcount = NULL, *sendoffset = NULL, *recvoffset = NULL;
+  size_t nr_reverse_links = 0;
+  fof_compute_send_recv_offsets(nr_nodes, sendcount, &recvcount, &sendoffset,
+                                &recvoffset, &nr_reverse_links);
 
-  if (posix_memalign((void **)&displ, SWIFT_STRUCT_ALIGNMENT,
-                     e->nr_nodes * sizeof(int)) != 0)
-    error(
-        "Error while allocating memory for the displacement in memory for the "
-        "global group link list");
+  struct fof_mpi *reverse_links = (struct fof_mpi *)swift_malloc(
+      "fof_reverse_links", nr_reverse_links * sizeof(struct fof_mpi));
 
-  /* Gather the total number of links on each rank. */
-  MPI_Allgather(&group_link_count, 1, MPI_INT, group_link_counts, 1, MPI_INT,
+  MPI_Alltoallv(group_links, sendcount, sendoffset, fof_mpi_type,
+                reverse_links, recvcount, recvoffset, fof_mpi_type,
                 MPI_COMM_WORLD);
 
-  /* Set the displacements into the global link list using the link counts from
-   * each rank */
-  displ[0] = 0;
-  for (int i = 1; i < e->nr_nodes; i++) {
-    displ[i] = displ[i - 1] + group_link_counts[i - 1];
-    if (displ[i] < 0) error("Number of group links overflowing!");
-  }
-
-  /* Gather the global link list on all ranks. */
-  MPI_Allgatherv(props->group_links, group_link_count, fof_mpi_type,
-                 global_group_links, group_link_counts, displ, fof_mpi_type,
-                 MPI_COMM_WORLD);
-
-  /* Clean up memory. */
-  free(group_link_counts);
-  free(displ);
-  swift_free("fof_group_links", props->group_links);
-  props->group_links = NULL;
-
-  if (verbose) {
-    message("Communication took: %.3f %s.",
-            clocks_from_ticks(getticks() - comms_tic), clocks_getunit());
+  fof_free_exchange(sendcount, recvcount, sendoffset, recvoffset);
 
-    message("Global comms took: %.3f %s.", clocks_from_ticks(getticks() - tic),
-            clocks_getunit());
-  }
+  if (verbose)
+    message("Exchanging %d links took: %.3f %s.", group_link_count,
+            clocks_from_ticks(getticks() - tic), clocks_getunit());
 
   tic = getticks();
 
-  /* Transform the group IDs to a local list going from 0-group_count so a
-   * union-find can be performed.
-   * Each member of a link is stored separately --> Need 2x as many entries */
-  size_t *global_group_index = NULL, *global_group_id = NULL,
-         *global_group_size = NULL;
-  const int global_group_list_size = 2 * global_group_link_count;
+  /* List the local fragments with their label and size and the links from
+   * each of them to a foreign fragment. */
+  const size_t nr_links = group_link_count + nr_reverse_links;
+  size_t *fragment_id = NULL, *fragment_label = NULL, *fragment_size = NULL;
+  size_t *link_fragment = NULL, *link_foreign = NULL;
+  if (swift_memalign("fof_fragment_id", (void **)&fragment_id,
+                     SWIFT_STRUCT_ALIGNMENT, nr_links * sizeof(size_t)) != 0 ||
+      swift_memalign("fof_fragment_label", (void **)&fragment_label,
+                     SWIFT_STRUCT_ALIGNMENT, nr_links * sizeof(size_t)) != 0 ||
+      swift_memalign("fof_fragment_size", (void **)&fragment_size,
+                     SWIFT_STRUCT_ALIGNMENT, nr_links * sizeof(size_t)) != 0 ||
+      swift_memalign("fof_link_fragment", (void **)&link_fragment,
+                     SWIFT_STRUCT_ALIGNMENT, nr_links * sizeof(size_t)) != 0 ||
+      swift_memalign("fof_link_foreign", (void **)&link_foreign,
+                     SWIFT_STRUCT_ALIGNMENT, nr_links * sizeof(size_t)) != 0)
+    error("Error while allocating memory for the list of local fragments");
 
-  if (swift_memalign("fof_global_group_index", (void **)&global_group_index,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     global_group_list_size * sizeof(size_t)) != 0)
-    error(
-        "Error while allocating memory for the displacement in memory for the "
-        "global group link list");
-
-  if (swift_memalign("fof_global_group_id", (void **)&global_group_id,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     global_group_list_size * sizeof(size_t)) != 0)
-    error(
-        "Error while allocating memory for the displacement in memory for the "
-        "global group link list");
-
-  if (swift_memalign("fof_global_group_size", (void **)&global_group_size,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     global_group_list_size * sizeof(size_t)) != 0)
-    error(
-        "Error while allocating memory for the displacement in memory for the "
-        "global group link list");
-
-  bzero(global_group_size, global_group_list_size * sizeof(size_t));
-
-  /* Create hash table. */
   hashmap_t map;
   hashmap_init(&map);
 
-  /* Store each group ID and its properties. */
-  int group_count = 0;
-  for (int k = 0; k < global_group_link_count; k++) {
+  size_t nr_fragments = 0;
+  for (size_t k = 0; k < nr_links; k++) {
+
+    /* Our links have the local fragment first, the reverse ones second */
+    const int reverse = k >= (size_t)group_link_count;
+    const struct fof_mpi *fof_link =
+        reverse ? &reverse_links[k - group_link_count] : &group_links[k];
+    const size_t fragment = reverse ? fof_link->group_j : fof_link->group_i;
+    const size_t size =
+        reverse ? fof_link->group_j_size : fof_link->group_i_size;
 
-    const size_t group_i = global_group_links[k].group_i;
-    const size_t group_j = global_group_links[k].group_j;
+    int created_new_element = 0;
+    hashmap_value_t *offset =
+        hashmap_get_new(&map, fragment, &created_new_element);
+    if (offset == NULL)
+      error("Couldn't find key (%zu) or create new one.", fragment);
 
-    global_group_size[group_count] += global_group_links[k].group_i_size;
-    global_group_id[group_count] = group_i;
-    hashmap_add_group(group_i, group_count, &map);
-    group_count++;
+    if (created_new_element) {
+      (*offset).value_st = nr_fragments;
+      fragment_id[nr_fragments] = fragment;
+      fragment_label[nr_fragments] = fragment;
+      fragment_size[nr_fragments] = size;
+      nr_fragments++;
+    }
 
-    global_group_size[group_count] += global_group_links[k].group_j_size;
-    global_group_id[group_count] = group_j;
-    hashmap_add_group(group_j, group_count, &map);
-    group_count++;
+    link_fragment[k] = (*offset).value_st;
+    link_foreign[k] = reverse ? fof_link->group_i : fof_link->group_j;
   }
 
+  swift_free("fof_group_links", props->group_links);
+  swift_free("fof_reverse_links", reverse_links);
+  props->group_links = NULL;
+
   if (verbose)
-    message("Global list compression took: %.3f %s.",
+    message("Listing %zu local fragments took: %.3f %s.", nr_fragments,
             clocks_from_ticks(getticks() - tic), clocks_getunit());
 
   tic = getticks();
 
-  /* Create a global_group_index list of groups across MPI domains so that you
-   * can perform a union-find locally on each node.
-   * The value of which is an offset into global_group_id, which is the actual
-   * root. */
-  for (int i = 0; i < group_count; i++) global_group_index[i] = i;
+  /* Room for the messages of one round */
+  const size_t max_nsend = max(nr_links, nr_fragments);
+  struct fof_final_index *fof_index_send =
+      (struct fof_final_index *)swift_malloc(
+          "fof_index_send", max_nsend * sizeof(struct fof_final_index));
 
-  /* Store the original group size before incrementing in the Union-Find. */
-  size_t *orig_global_group_size = NULL;
+  int round = 0;
+  long long round_stats[3];
+  do {
 
-  if (swift_memalign("fof_orig_global_group_size",
-                     (void **)&orig_global_group_size, SWIFT_STRUCT_ALIGNMENT,
-                     group_count * sizeof(size_t)) != 0)
-    error(
-        "Error while allocating memory for the displacement in memory for the "
-        "global group link list");
+    long long nr_lowered = 0;
 
-  memcpy(orig_global_group_size, global_group_size,
-         group_count * sizeof(size_t));
+    /* Push our labels along the links: global_root is the foreign
+     * fragment, local_root the label */
+    for (size_t k = 0; k < nr_links; k++) {
+      fof_index_send[k].global_root = link_foreign[k];
+      fof_index_send[k].local_root = fragment_label[link_fragment[k]];
+    }
 
-  /* Perform a union-find on the group links. */
-  for (int k = 0; k < global_group_link_count; k++) {
+    size_t nrecv = 0;
+    struct fof_final_index *fof_index_recv = fof_send_to_root_nodes(
+        fof_index_send, nr_links, first_on_node, num_on_node, nr_nodes,
+        &sendcount, &recvcount, &sendoffset, &recvoffset, &nrecv);
+    fof_free_exchange(sendcount, recvcount, sendoffset, recvoffset);
+
+    for (size_t k = 0; k < nrecv; k++) {
+      const size_t f =
+          hashmap_find_group_offset(fof_index_recv[k].global_root, &map);
+      if (fof_index_recv[k].local_root < fragment_label[f]) {
+        fragment_label[f] = fof_index_recv[k].local_root;
+        nr_lowered++;
+      }
+    }
+    swift_free("fof_index_recv", fof_index_recv);
+
+    /* Look up the label of our labels: global_root is the label, local_root
+     * the fragment asking */
+    size_t nr_queries = 0;
+    for (size_t f = 0; f < nr_fragments; f++) {
+      if (fragment_label[f] == fragment_id[f]) continue;
+      fof_index_send[nr_queries].global_root = fragment_label[f];
+      fof_index_send[nr_queries].local_root = f;
+      nr_queries++;
+    }
 
-    /* Use the hash table to find the group offsets in the index array. */
-    const size_t find_i =
-        hashmap_find_group_offset(global_group_links[k].group_i, &map);
-    const size_t find_j =
-        hashmap_find_group_offset(global_group_links[k].group_j, &map);
+    fof_index_recv = fof_send_to_root_nodes(
+        fof_index_send, nr_queries, first_on_node, num_on_node, nr_nodes,
+        &sendcount, &recvcount, &sendoffset, &recvoffset, &nrecv);
 
-    /* Use the offset to find the group's root. */
-    const size_t root_i = fof_find(find_i, global_group_index);
-    const size_t root_j = fof_find(find_j, global_group_index);
+    /* Answer with the label in global_root */
+    for (size_t k = 0; k < nrecv; k++) {
+      const size_t f =
+          hashmap_find_group_offset(fof_index_recv[k].global_root, &map);
+      fof_index_recv[k].global_root = fragment_label[f];
+    }
 
-    const size_t group_i = global_group_id[root_i];
-    const size_t group_j = global_group_id[root_j];
+    /* Send the result back */
+    MPI_Alltoallv(fof_index_recv, recvcount, recvoffset, fof_final_index_type,
+                  fof_index_send, sendcount, sendoffset, fof_final_index_type,
+                  MPI_COMM_WORLD);
+    fof_free_exchange(sendcount, recvcount, sendoffset, recvoffset);
+    swift_free("fof_index_recv", fof_index_recv);
+
+    for (size_t k = 0; k < nr_queries; k++) {
+      const size_t f = fof_index_send[k].local_root;
+      if (fof_index_send[k].global_root < fragment_label[f]) {
+        fragment_label[f] = fof_index_send[k].global_root;
+        nr_lowered++;
+      }
+    }
 
-    if (group_i == group_j) continue;
+    /* Has anything changed anywhere? */
+    round_stats[0] = nr_lowered;
+    round_stats[1] = nr_links;
+    round_stats[2] = nr_queries;
+    MPI_Allreduce(MPI_IN_PLACE, round_stats, 3, MPI_LONG_LONG, MPI_SUM,
+                  MPI_COMM_WORLD);
 
-    /* Update roots accordingly. */
-    const size_t size_i = global_group_size[root_i];
-    const size_t size_j = global_group_size[root_j];
-#ifdef UNION_BY_SIZE_OVER_MPI
-    if (size_i < size_j) {
-      global_group_index[root_i] = root_j;
-      global_group_size[root_j] += size_i;
-    } else {
-      global_group_index[root_j] = root_i;
-      global_group_size[root_i] += size_j;
-    }
-#else
-    if (group_j < group_i) {
-      global_group_index[root_i] = root_j;
-      global_group_size[root_j] += size_i;
-    } else {
-      global_group_index[root_j] = root_i;
-      global_group_size[root_i] += size_j;
-    }
-#endif
-  }
+    if (verbose && engine_rank == 0)
+      message(
+          "Round %d: sent %lld labels and %lld look-ups, lowered %lld labels.",
+          round, round_stats[1], round_stats[2], round_stats[0]);
+
+    round++;
+
+  } while (round_stats[0] > 0);
 
   hashmap_free(&map);
 
   if (verbose)
-    message("global_group_index construction took: %.3f %s.",
+    message("Label propagation (%d rounds) took: %.3f %s.", round,
             clocks_from_ticks(getticks() - tic), clocks_getunit());
 
   tic = getticks();
 
-  /* Update each group locally with new root information. */
-  for (int i = 0; i < group_count; i++) {
+  /* Point the fragments at their new root and move their size over to it:
+   * global_root is the new root, local_root the size */
+  size_t nsend = 0;
+  for (size_t f = 0; f < nr_fragments; f++) {
 
-    const size_t group_id = global_group_id[i];
-    const size_t offset = fof_find(global_group_index[i], global_group_index);
-    const size_t new_root = global_group_id[offset];
+    const size_t new_root = fragment_label[f];
+    if (new_root == fragment_id[f]) continue;
 
-    /* If the group is local update its root and size. */
-    if (is_local(group_id, nr_gparts) && new_root != group_id) {
-      group_index[group_id - node_offset] = new_root;
+    group_index[fragment_id[f] - node_offset] = new_root;
+    group_size[fragment_id[f] - node_offset] -= fragment_size[f];
 
-      group_size[group_id - node_offset] -= orig_global_group_size[i];
-    }
+    fof_index_send[nsend].global_root = new_root;
+    fof_index_send[nsend].local_root = fragment_size[f];
+    nsend++;
+  }
 
-    /* If the group linked to a local root update its size. */
-    if (is_local(new_root, nr_gparts) && new_root != group_id) {
+  size_t nrecv = 0;
+  struct fof_final_index *fof_index_recv = fof_send_to_root_nodes(
+      fof_index_send, nsend, first_on_node, num_on_node, nr_nodes, &sendcount,
+      &recvcount, &sendoffset, &recvoffset, &nrecv);
+  fof_free_exchange(sendcount, recvcount, sendoffset, recvoffset);
 
-      /* Use group sizes before Union-Find */
-      group_size[new_root - node_offset] += orig_global_group_size[i];
-    }
-  }
+  for (size_t k = 0; k < nrecv; k++)
+    group_size[fof_index_recv[k].global_root - node_offset] +=
+        fof_index_recv[k].local_root;
 
   if (verbose)
     message("Updating groups locally took: %.3f %s.",
             clocks_from_ticks(getticks() - tic), clocks_getunit());
 
   /* Clean up memory. */
-  swift_free("fof_global_group_links", global_group_links);
-  swift_free("fof_global_group_index", global_group_index);
-  swift_free("fof_global_group_size", global_group_size);
-  swift_free("fof_global_group_id", global_group_id);
-  swift_free("fof_orig_global_group_size", orig_global_group_size);
+  swift_free("fof_index_send", fof_index_send);
+  swift_free("fof_index_recv", fof_index_recv);
+  swift_free("fof_fragment_id", fragment_id);
+  swift_free("fof_fragment_label", fragment_label);
+  swift_free("fof_fragment_size", fragment_size);
+  swift_free("fof_link_fragment", link_fragment);
+  swift_free("fof_link_foreign", link_foreign);
+  free(first_on_node);
+  free(num_on_node);
 
   if (verbose) {
     message("link_foreign_fragmens() took (FOF SCALING): %.3f %s.",
@@ -3916,6 +4346,16 @@ void fof_compute_local_sizes(struct fof_props *props, struct space *s) {
   node_offset = nr_gparts_cumulative - nr_gparts_local;
 #endif
 
+  /* Point all the particles at their root */
+  const ticks tic_flatten = getticks();
+
+  threadpool_map(&s->e->threadpool, fof_flatten_group_index_mapper,
+                 props->group_index, nr_gparts, sizeof(size_t),
+                 threadpool_auto_chunk_size, props->group_index);
+  if (verbose)
+    message("FOF flattening the groups took: %.3f %s.",
+            clocks_from_ticks(getticks() - tic_flatten), clocks_getunit());
+
   /* Compute the group sizes of the local fragments
    * (in non-MPI land that is the final group size of the haloes) */
   const ticks tic_calc_group_size = getticks();
@@ -3933,6 +4373,502 @@ void fof_compute_local_sizes(struct fof_props *props, struct space *s) {
             clocks_getunit());
 }
 
+/**
+ * @brief Range of top-level cells overlapping the bounding box of a sphere.
+ *
+ * In a periodic box the range may run past the edges of the grid and the
+ * indices have to be wrapped.
+ *
+ * @param s The #space.
+ * @param sphere The #fof_so_sphere.
+ * @param lo (return) The first cell index along each axis.
+ * @param hi (return) The last cell index along each axis.
+ */
+static void fof_so_top_level_range(const struct space *s,
+                                   const struct fof_so_sphere *sphere,
+                                   int lo[3], int hi[3]) {
+
+  for (int k = 0; k < 3; k++) {
+    double lo_k = floor((sphere->centre[k] - sphere->radius) * s->iwidth[k]);
+    double hi_k = floor((sphere->centre[k] + sphere->radius) * s->iwidth[k]);
+
+    if (s->periodic) {
+      if (hi_k - lo_k + 1. >= s->cdim[k]) {
+        lo_k = 0.;
+        hi_k = s->cdim[k] - 1.;
+      }
+    } else {
+      lo_k = max(lo_k, 0.);
+      hi_k = min(hi_k, s->cdim[k] - 1.);
+    }
+    lo[k] = (int)lo_k;
+    hi[k] = (int)hi_k;
+  }
+}
+
+/**
+ * @brief Top-level cell of a (possibly wrapped) index triplet.
+ *
+ * @param s The #space.
+ * @param i The index along x.
+ * @param j The index along y.
+ * @param k The index along z.
+ */
+static const struct cell *fof_so_top_level_cell(const struct space *s, int i,
+                                                int j, int k) {
+
+  const int *cdim = s->cdim;
+  i = (i % cdim[0] + cdim[0]) % cdim[0];
+  j = (j % cdim[1] + cdim[1]) % cdim[1];
+  k = (k % cdim[2] + cdim[2]) % cdim[2];
+  return &s->cells_top[cell_getid(cdim, i, j, k)];
+}
+
+/**
+ * @brief Flag the ranks owning a top-level cell overlapping a sphere.
+ *
+ * @param s The #space.
+ * @param sphere The #fof_so_sphere.
+ * @param send_to (return) 1 for the ranks to send the sphere to, 0 otherwise.
+ */
+static void fof_so_sphere_ranks(const struct space *s,
+                                const struct fof_so_sphere *sphere,
+                                char *send_to) {
+
+  bzero(send_to, s->e->nr_nodes * sizeof(char));
+
+  int lo[3], hi[3];
+  fof_so_top_level_range(s, sphere, lo, hi);
+  for (int i = lo[0]; i <= hi[0]; i++)
+    for (int j = lo[1]; j <= hi[1]; j++)
+      for (int k = lo[2]; k <= hi[2]; k++)
+        send_to[fof_so_top_level_cell(s, i, j, k)->nodeID] = 1;
+}
+
+/**
+ * @brief The current search sphere of a group.
+ *
+ * @param props The properties of the FOF scheme.
+ * @param radius The search radius of each group.
+ * @param group The index of the group on this rank.
+ * @param batch_index The index of the group in the current batch.
+ */
+static struct fof_so_sphere fof_so_make_sphere(const struct fof_props *props,
+                                               const double *radius,
+                                               const size_t group,
+                                               const size_t batch_index) {
+
+  struct fof_so_sphere sphere;
+  for (int k = 0; k < 3; k++)
+    sphere.centre[k] = props->group_centre_of_mass[group * 3 + k];
+  sphere.radius = radius[group];
+  sphere.group = (long long)batch_index;
+  return sphere;
+}
+
+/**
+ * @brief Add the mass of the #gpart of a cell to the binned profile of a
+ * sphere, recursing only into the progeny overlapping it.
+ *
+ * @param c The #cell.
+ * @param sphere The #fof_so_sphere.
+ * @param periodic Are we using periodic boundary conditions?
+ * @param dim The dimensions of the simulation box.
+ * @param mass (return) The mass in each radial bin.
+ */
+static void fof_so_profile_rec(const struct cell *c,
+                               const struct fof_so_sphere *sphere,
+                               const int periodic, const double dim[3],
+                               double *mass) {
+
+  const double radius2 = sphere->radius * sphere->radius;
+
+  /* Distance from the centre to the cell */
+  double r2 = 0.;
+  for (int k = 0; k < 3; k++) {
+    double d = sphere->centre[k] - (c->loc[k] + 0.5 * c->width[k]);
+    if (periodic) d = nearest(d, dim[k]);
+    const double d_edge = max(fabs(d) - 0.5 * c->width[k], 0.);
+    r2 += d_edge * d_edge;
+  }
+  if (r2 >= radius2) return;
+
+  if (c->split) {
+    for (int k = 0; k < 8; k++)
+      if (c->progeny[k] != NULL)
+        fof_so_profile_rec(c->progeny[k], sphere, periodic, dim, mass);
+    return;
+  }
+
+  const double r_min = sphere->radius * fof_so_min_radius_ratio;
+  const double bins_per_log_r =
+      (fof_so_num_bins - 1) / log(1. / fof_so_min_radius_ratio);
+
+  for (int i = 0; i < c->grav.count; i++) {
+    const struct gpart *gp = &c->grav.parts[i];
+
+    /* Ignore inhibited particles */
+    if (gp->time_bin >= time_bin_inhibited) continue;
+
+    double dx[3];
+    for (int k = 0; k < 3; k++) {
+      dx[k] = gp->x[k] - sphere->centre[k];
+      if (periodic) dx[k] = nearest(dx[k], dim[k]);
+    }
+    const double r2_p = dx[0] * dx[0] + dx[1] * dx[1] + dx[2] * dx[2];
+    if (r2_p >= radius2) continue;
+
+    /* Bin 0 is the inner sphere, the others are logarithmic shells */
+    const double r = sqrt(r2_p);
+    int bin = 0;
+    if (r > r_min) {
+      bin = max((int)ceil(log(r / r_min) * bins_per_log_r), 1);
+      bin = min(bin, fof_so_num_bins - 1);
+    }
+    mass[bin] += gp->mass;
+  }
+}
+
+/**
+ * @brief What the #fof_so_profiles_mapper needs.
+ */
+struct fof_so_profile_data {
+
+  /*! The #space. */
+  const struct space *s;
+
+  /*! The spheres to compute local profiles for. */
+  const struct fof_so_sphere *spheres;
+
+  /*! The profiles, in the same order as the spheres. */
+  struct fof_so_profile *profiles;
+};
+
+/**
+ * @brief #threadpool mapper function binning the mass of the local #gpart
+ * in a set of spheres.
+ *
+ * @param map_data The #fof_so_sphere.
+ * @param num_elements The number of spheres.
+ * @param extra_data The #fof_so_profile_data.
+ */
+static void fof_so_profiles_mapper(void *map_data, int num_elements,
+                                   void *extra_data) {
+
+  const struct fof_so_sphere *spheres = (const struct fof_so_sphere *)map_data;
+  const struct fof_so_profile_data *data =
+      (const struct fof_so_profile_data *)extra_data;
+  const struct space *s = data->s;
+  const int nodeID = s->e->nodeID;
+  struct fof_so_profile *profiles = data->profiles + (spheres - data->spheres);
+
+  for (int n = 0; n < num_elements; n++) {
+    const struct fof_so_sphere *sphere = &spheres[n];
+    struct fof_so_profile *profile = &profiles[n];
+
+    profile->group = sphere->group;
+    bzero(profile->mass, fof_so_num_bins * sizeof(double));
+
+    int lo[3], hi[3];
+    fof_so_top_level_range(s, sphere, lo, hi);
+
+    for (int i = lo[0]; i <= hi[0]; i++) {
+      for (int j = lo[1]; j <= hi[1]; j++) {
+        for (int k = lo[2]; k <= hi[2]; k++) {
+          const struct cell *c = fof_so_top_level_cell(s, i, j, k);
+          if (c->nodeID != nodeID || c->grav.count == 0) continue;
+          fof_so_profile_rec(c, sphere, s->periodic, s->dim, profile->mass);
+        }
+      }
+    }
+  }
+}
+
+/**
+ * @brief Find the radius within which the mean density of a binned profile
+ * drops below a threshold.
+ *
+ * The cumulative mean density is evaluated at the outer edge of every bin
+ * and we look for the outermost edge still above the threshold, such that
+ * an empty (or under-dense) centre does not stop the search. The radius is
+ * interpolated in log-log space between that edge and the next one.
+ *
+ * @param mass The mass in each radial bin.
+ * @param radius The radius of the profile's sphere.
+ * @param rho_threshold The (co-moving) density threshold.
+ * @param R (return) The radius of the overdensity (0 if no edge is above the
+ * threshold).
+ * @param M (return) The mass within R.
+ *
+ * @return 1 if the radius was found, 0 if the whole sphere is above the
+ * threshold.
+ */
+static int fof_so_find_radius(const double *mass, const double radius,
+                              const double rho_threshold, double *R,
+                              double *M) {
+
+  const double r_min = radius * fof_so_min_radius_ratio;
+  const double four_pi_over_three = 4. * M_PI / 3.;
+
+  /* Mean enclosed density at the outer edge of each bin */
+  double edge[fof_so_num_bins], rho[fof_so_num_bins];
+  double mass_in = 0.;
+  for (int b = 0; b < fof_so_num_bins; b++) {
+    mass_in += mass[b];
+    edge[b] = r_min * pow(1. / fof_so_min_radius_ratio,
+                          (double)b / (double)(fof_so_num_bins - 1));
+    rho[b] = mass_in / (four_pi_over_three * edge[b] * edge[b] * edge[b]);
+  }
+
+  /* Still over-dense at the edge of the sphere? */
+  if (rho[fof_so_num_bins - 1] >= rho_threshold) return 0;
+
+  for (int b = fof_so_num_bins - 2; b >= 0; b--) {
+    if (rho[b] >= rho_threshold) {
+      const double f =
+          log(rho_threshold / rho[b]) / log(rho[b + 1] / rho[b]);
+      *R = edge[b] * pow(edge[b + 1] / edge[b], f);
+      *M = rho_threshold * four_pi_over_three * (*R) * (*R) * (*R);
+      return 1;
+    }
+  }
+
+  /* Nothing dense enough, even in the centre */
+  *R = 0.;
+  *M = 0.;
+  return 1;
+}
+
+/**
+ * @brief Compute the spherical overdensity masses M200c and M500c of the
+ * groups whose global root is on this rank.
+ *
+ * Each group gets a sphere around its centre of mass of twice the radius
+ * its FOF mass would have at 200 times the critical density. The spheres are
+ * sent to the ranks owning the top-level cells they overlap, which bin the
+ * mass of all their #gpart (of any type) in logarithmic shells by walking the
+ * trees of these cells. The owner sums the profiles and finds the radii where
+ * the mean enclosed density drops below the thresholds. Groups whose whole
+ * sphere is still above 200 times the critical density get their radius
+ * doubled for the next round. The groups are done in batches so that the
+ * memory used does not grow with their number.
+ *
+ * @param props The properties of the FOF scheme.
+ * @param cosmo The current cosmological model.
+ * @param s The #space containing the particles.
+ * @param num_groups_local The number of groups whose global root is on this
+ * rank.
+ */
+static void fof_compute_so_masses(struct fof_props *props,
+                                  const struct cosmology *cosmo,
+                                  const struct space *s,
+                                  const size_t num_groups_local) {
+
+  const ticks tic = getticks();
+  const int nr_nodes = s->e->nr_nodes;
+
+  if (cosmo->critical_density <= 0.)
+    error("Spherical overdensity masses need a cosmological run.");
+
+  /* The thresholds in co-moving units */
+  const double a3 = cosmo->a * cosmo->a * cosmo->a;
+  const double rho_200 = 200. * cosmo->critical_density * a3;
+  const double rho_500 = 500. * cosmo->critical_density * a3;
+
+  if (swift_memalign("fof_group_M200c", (void **)&props->group_M200c, 32,
+                     num_groups_local * sizeof(double)) != 0 ||
+      swift_memalign("fof_group_R200c", (void **)&props->group_R200c, 32,
+                     num_groups_local * sizeof(double)) != 0 ||
+      swift_memalign("fof_group_M500c", (void **)&props->group_M500c, 32,
+                     num_groups_local * sizeof(double)) != 0 ||
+      swift_memalign("fof_group_R500c", (void **)&props->group_R500c, 32,
+                     num_groups_local * sizeof(double)) != 0)
+    error("Failed to allocate list of group SO masses for FOF search.");
+
+  /* The search radius and number of doublings of each group */
+  double *radius = (double *)malloc(num_groups_local * sizeof(double));
+  char *doublings = (char *)calloc(num_groups_local, sizeof(char));
+
+  /* Queue of the groups still to do */
+  size_t *queue = (size_t *)malloc(num_groups_local * sizeof(size_t));
+  size_t queue_head = 0, queue_size = num_groups_local;
+
+  for (size_t i = 0; i < num_groups_local; i++) {
+    const double R_est =
+        cbrt(3. * props->group_mass[i] / (4. * M_PI * rho_200));
+    radius[i] = 2. * R_est;
+    queue[i] = i;
+  }
+
+  const size_t batch_size = min(num_groups_local, (size_t)fof_so_batch_size);
+  size_t *batch = (size_t *)malloc(batch_size * sizeof(size_t));
+  double *batch_mass =
+      (double *)malloc(batch_size * fof_so_num_bins * sizeof(double));
+  char *send_to = (char *)malloc(nr_nodes * sizeof(char));
+  int *sendcount = (int *)malloc(nr_nodes * sizeof(int));
+
+  long long num_not_found = 0;
+  int num_rounds = 0;
+
+  long long num_left = (long long)queue_size;
+#ifdef WITH_MPI
+  MPI_Allreduce(MPI_IN_PLACE, &num_left, 1, MPI_LONG_LONG, MPI_SUM,
+                MPI_COMM_WORLD);
+#endif
+
+  while (num_left > 0) {
+
+    /* Take the next batch off the queue */
+    const size_t nr_batch = min(queue_size, batch_size);
+    for (size_t n = 0; n < nr_batch; n++) {
+      batch[n] = queue[queue_head];
+      queue_head = (queue_head + 1) % num_groups_local;
+    }
+    queue_size -= nr_batch;
+
+    /* Count the ranks each sphere has to go to */
+    for (int r = 0; r < nr_nodes; r++) sendcount[r] = 0;
+    for (size_t n = 0; n < nr_batch; n++) {
+      const struct fof_so_sphere sphere =
+          fof_so_make_sphere(props, radius, batch[n], n);
+      fof_so_sphere_ranks(s, &sphere, send_to);
+      for (int r = 0; r < nr_nodes; r++) sendcount[r] += send_to[r];
+    }
+
+    /* And make the list of spheres, sorted by rank */
+    size_t nsend = 0;
+    for (int r = 0; r < nr_nodes; r++) nsend += sendcount[r];
+    struct fof_so_sphere *sphere_send = (struct fof_so_sphere *)swift_malloc(
+        "fof_so_sphere_send", nsend * sizeof(struct fof_so_sphere));
+
+    int *fill = (int *)malloc(nr_nodes * sizeof(int));
+    fill[0] = 0;
+    for (int r = 1; r < nr_nodes; r++) fill[r] = fill[r - 1] + sendcount[r - 1];
+
+    for (size_t n = 0; n < nr_batch; n++) {
+      const struct fof_so_sphere sphere =
+          fof_so_make_sphere(props, radius, batch[n], n);
+      fof_so_sphere_ranks(s, &sphere, send_to);
+      for (int r = 0; r < nr_nodes; r++)
+        if (send_to[r]) sphere_send[fill[r]++] = sphere;
+    }
+    free(fill);
+
+#ifdef WITH_MPI
+    /* Send the spheres to the ranks they overlap */
+    int *recvcount = NULL, *sendoffset = NULL, *recvoffset = NULL;
+    size_t nrecv = 0;
+    fof_compute_send_recv_offsets(nr_nodes, sendcount, &recvcount, &sendoffset,
+                                  &recvoffset, &nrecv);
+
+    struct fof_so_sphere *sphere_recv = (struct fof_so_sphere *)swift_malloc(
+        "fof_so_sphere_recv", nrecv * sizeof(struct fof_so_sphere));
+    MPI_Alltoallv(sphere_send, sendcount, sendoffset, fof_so_sphere_type,
+                  sphere_recv, recvcount, recvoffset, fof_so_sphere_type,
+                  MPI_COMM_WORLD);
+#else
+    const size_t nrecv = nsend;
+    struct fof_so_sphere *sphere_recv = sphere_send;
+#endif
+
+    /* Bin the local particles in the spheres we received */
+    struct fof_so_profile *profile_recv = (struct fof_so_profile *)swift_malloc(
+        "fof_so_profile_recv", nrecv * sizeof(struct fof_so_profile));
+    struct fof_so_profile_data profile_data = {s, sphere_recv, profile_recv};
+    if (nrecv > 0)
+      threadpool_map(&s->e->threadpool, fof_so_profiles_mapper, sphere_recv,
+                     nrecv, sizeof(struct fof_so_sphere),
+                     threadpool_auto_chunk_size, &profile_data);
+
+#ifdef WITH_MPI
+    /* Send the profiles back to the owners of the groups */
+    struct fof_so_profile *profile_send = (struct fof_so_profile *)swift_malloc(
+        "fof_so_profile_send", nsend * sizeof(struct fof_so_profile));
+    MPI_Alltoallv(profile_recv, recvcount, recvoffset, fof_so_profile_type,
+                  profile_send, sendcount, sendoffset, fof_so_profile_type,
+                  MPI_COMM_WORLD);
+    swift_free("fof_so_profile_recv", profile_recv);
+    swift_free("fof_so_sphere_recv", sphere_recv);
+    free(recvcount);
+    free(sendoffset);
+    free(recvoffset);
+#else
+    struct fof_so_profile *profile_send = profile_recv;
+#endif
+
+    /* Sum the contributions of all the ranks */
+    bzero(batch_mass, nr_batch * fof_so_num_bins * sizeof(double));
+    for (size_t n = 0; n < nsend; n++) {
+      double *mass = &batch_mass[profile_send[n].group * fof_so_num_bins];
+      for (int b = 0; b < fof_so_num_bins; b++)
+        mass[b] += profile_send[n].mass[b];
+    }
+
+#ifdef WITH_MPI
+    swift_free("fof_so_profile_send", profile_send);
+#else
+    swift_free("fof_so_profile_recv", profile_recv);
+#endif
+    swift_free("fof_so_sphere_send", sphere_send);
+
+    /* Find the radii, or try again with a larger sphere */
+    for (size_t n = 0; n < nr_batch; n++) {
+      const size_t gi = batch[n];
+      const double *mass = &batch_mass[n * fof_so_num_bins];
+
+      double R200 = 0., M200 = 0., R500 = 0., M500 = 0.;
+      const int found_200 =
+          fof_so_find_radius(mass, radius[gi], rho_200, &R200, &M200);
+
+      if (!found_200 && doublings[gi] < fof_so_max_doublings) {
+        radius[gi] *= 2.;
+        doublings[gi]++;
+        queue[(queue_head + queue_size) % num_groups_local] = gi;
+        queue_size++;
+        continue;
+      }
+
+      if (!found_200) num_not_found++;
+      const int found_500 =
+          fof_so_find_radius(mass, radius[gi], rho_500, &R500, &M500);
+      if (!found_500) R500 = M500 = 0.;
+
+      props->group_M200c[gi] = M200;
+      props->group_R200c[gi] = R200;
+      props->group_M500c[gi] = M500;
+      props->group_R500c[gi] = R500;
+    }
+
+    num_left = (long long)queue_size;
+#ifdef WITH_MPI
+    MPI_Allreduce(MPI_IN_PLACE, &num_left, 1, MPI_LONG_LONG, MPI_SUM,
+                  MPI_COMM_WORLD);
+#endif
+    num_rounds++;
+  }
+
+#ifdef WITH_MPI
+  MPI_Allreduce(MPI_IN_PLACE, &num_not_found, 1, MPI_LONG_LONG, MPI_SUM,
+                MPI_COMM_WORLD);
+#endif
+  if (engine_rank == 0 && num_not_found > 0)
+    message("WARNING: M200c of %lld groups not found within %d doublings of "
+            "their search radius.",
+            num_not_found, fof_so_max_doublings);
+
+  free(radius);
+  free(doublings);
+  free(queue);
+  free(batch);
+  free(batch_mass);
+  free(send_to);
+  free(sendcount);
+
+  if (s->e->verbose)
+    message("Computing the SO masses took %d rounds and %.3f %s.", num_rounds,
+            clocks_from_ticks(getticks() - tic), clocks_getunit());
+}
+
 /**
  * @brief Compute all the group properties
  *
@@ -4282,6 +5218,10 @@ void fof_compute_group_props(struct fof_props *props,
     message("Computing group properties took: %.3f %s.",
             clocks_from_ticks(getticks() - tic_seeding), clocks_getunit());
 
+  /* Spherical overdensity masses, only for the catalogues */
+  if (dump_results && props->compute_so_masses)
+    fof_compute_so_masses(props, cosmo, s, num_groups_local);
+
   /* Dump group data. */
   if (dump_results) {
 #ifdef HAVE_HDF5
@@ -4327,6 +5267,17 @@ void fof_compute_group_props(struct fof_props *props,
   props->max_part_density_index = NULL;
   props->max_part_density = NULL;
 
+  if (dump_results && props->compute_so_masses) {
+    swift_free("fof_group_M200c", props->group_M200c);
+    swift_free("fof_group_R200c", props->group_R200c);
+    swift_free("fof_group_M500c", props->group_M500c);
+    swift_free("fof_group_R500c", props->group_R500c);
+  }
+  props->group_M200c = NULL;
+  props->group_R200c = NULL;
+  props->group_M500c = NULL;
+  props->group_R500c = NULL;
+
   swift_free("fof_distance", props->distance_to_link);
   swift_free("fof_group_index", props->group_index);
   swift_free("fof_attach_index", props->attach_index);
@@ -4366,6 +5317,10 @@ void fof_struct_dump(const struct fof_props *props, FILE *stream) {
   temp.group_centre_of_mass = NULL;
   temp.max_part_density_index = NULL;
   temp.max_part_density = NULL;
+  temp.group_M200c = NULL;
+  temp.group_R200c = NULL;
+  temp.group_M500c = NULL;
+  temp.group_R500c = NULL;
   temp.group_links = NULL;
 
   restart_write_blocks((void *)&temp, sizeof(struct fof_props), 1, stream,
@@ -37,6 +37,9 @@ struct phys_const;
 struct black_holes_props;
 struct cosmology;
 
+/* The FoF policy we are running */
+extern int current_fof_linking_type;
+
 struct fof_props {
 
   /*! Whether we're doing periodic FoF calls to seed black holes. */
@@ -54,6 +57,22 @@ struct fof_props {
   /*! The square of the linking length. */
   double l_x2;
 
+  /*! The square of the linking length used by the local linking tasks. */
+  double search_l_x2;
+
+  /*! Fraction of the linking length left for the particles to drift in
+   * between two warm-started calls (0 to always start from scratch). */
+  double warm_start_margin;
+
+  /*! The (reduced) linking length of the cores of the last call. */
+  double warm_start_core_l_x;
+
+  /*! Total number of particles labelled with a core at the last call. */
+  long long warm_start_nr_labelled;
+
+  /*! Are we computing spherical overdensity masses for the catalogues? */
+  int compute_so_masses;
+
   /*! The minimum halo mass for black hole seeding. */
   double seed_halo_mass;
 
@@ -120,6 +139,13 @@ struct fof_props {
   /*! Maximal density of all parts of each group. */
   float *max_part_density;
 
+  /*! Mass and radius of the sphere of mean density 200 times the critical
+   * density around the centre of mass of each group. */
+  double *group_M200c, *group_R200c;
+
+  /*! Same for 500 times the critical density. */
+  double *group_M500c, *group_R500c;
+
   /* ------------ MPI-related arrays --------------- */
 
   /*! The number of links between pairs of particles on this node and
@@ -141,6 +167,33 @@ struct group_length {
 
 } SWIFT_STRUCT_ALIGN;
 
+/*! Number of logarithmic radial bins of the spherical overdensity profiles */
+#define fof_so_num_bins 64
+
+/* Sphere around a group in which its spherical overdensity masses are
+ * searched for. */
+struct fof_so_sphere {
+
+  /* Centre of the sphere (the centre of mass of the group). */
+  double centre[3];
+
+  /* Radius of the sphere. */
+  double radius;
+
+  /* Index of the group in the current batch of the rank owning it. */
+  long long group;
+};
+
+/* Binned mass profile of the particles of one rank in a #fof_so_sphere. */
+struct fof_so_profile {
+
+  /* Index of the group in the current batch of the rank owning it. */
+  long long group;
+
+  /* Mass in each radial bin. */
+  double mass[fof_so_num_bins];
+};
+
 #ifdef WITH_MPI
 
 /* MPI message required for FOF. */
@@ -195,6 +248,8 @@ void fof_init(struct fof_props *props, struct swift_params *params,
               const int stand_alone_fof);
 void fof_create_mpi_types(void);
 void fof_allocate(const struct space *s, struct fof_props *props);
+int fof_warm_start_seed(struct fof_props *props, const struct space *s);
+void fof_warm_start_store_cores(struct fof_props *props, struct space *s);
 void fof_compute_local_sizes(struct fof_props *props, struct space *s);
 void fof_search_foreign_cells(struct fof_props *props, const struct space *s);
 void fof_link_attachable_particles(struct fof_props *props,
@@ -218,6 +273,14 @@ void rec_fof_search_pair(const struct fof_props *props, const double dim[3],
                          const double search_r2, const int periodic,
                          const struct gpart *const space_gparts,
                          struct cell *restrict ci, struct cell *restrict cj);
+void rec_fof_collect_self(const double dim[3], const double search_r2,
+                          const int periodic,
+                          const struct gpart *const space_gparts,
+                          const struct cell *c);
+void rec_fof_collect_pair(const double dim[3], const double search_r2,
+                          const int periodic,
+                          const struct gpart *const space_gparts,
+                          const struct cell *ci, const struct cell *cj);
 void rec_fof_attach_self(const struct fof_props *props, const double dim[3],
                          const double search_r2, const int periodic,
                          const struct gpart *const space_gparts,
@@ -359,6 +359,50 @@ void write_fof_virtual_file(const struct fof_props* props,
                                compression_write_lossless, e->internal_units,
                                e->snapshot_units);
 
+  /* Spherical overdensity masses, if we computed them */
+  if (props->compute_so_masses) {
+    output_prop = io_make_output_field_(
+        "M200c", DOUBLE, 1, UNIT_CONV_MASS, 0.f, (char*)props->group_M200c,
+        sizeof(double),
+        "Mass within the sphere around the FOF centre of mass of mean "
+        "density 200 times the critical density",
+        /*physical=*/0, /*convertible_to_comoving=*/1);
+    write_virtual_fof_hdf5_array(
+        e, h_grp, file_name_base, "Groups", output_prop, num_groups_total,
+        N_counts, compression_write_lossless, e->internal_units,
+        e->snapshot_units);
+    output_prop = io_make_output_field_(
+        "R200c", DOUBLE, 1, UNIT_CONV_LENGTH, 1.f, (char*)props->group_R200c,
+        sizeof(double),
+        "Radius of the sphere around the FOF centre of mass of mean "
+        "density 200 times the critical density",
+        /*physical=*/0, /*convertible_to_comoving=*/1);
+    write_virtual_fof_hdf5_array(
+        e, h_grp, file_name_base, "Groups", output_prop, num_groups_total,
+        N_counts, compression_write_lossless, e->internal_units,
+        e->snapshot_units);
+    output_prop = io_make_output_field_(
+        "M500c", DOUBLE, 1, UNIT_CONV_MASS, 0.f, (char*)props->group_M500c,
+        sizeof(double),
+        "Mass within the sphere around the FOF centre of mass of mean "
+        "density 500 times the critical density",
+        /*physical=*/0, /*convertible_to_comoving=*/1);
+    write_virtual_fof_hdf5_array(
+        e, h_grp, file_name_base, "Groups", output_prop, num_groups_total,
+        N_counts, compression_write_lossless, e->internal_units,
+        e->snapshot_units);
+    output_prop = io_make_output_field_(
+        "R500c", DOUBLE, 1, UNIT_CONV_LENGTH, 1.f, (char*)props->group_R500c,
+        sizeof(double),
+        "Radius of the sphere around the FOF centre of mass of mean "
+        "density 500 times the critical density",
+        /*physical=*/0, /*convertible_to_comoving=*/1);
+    write_virtual_fof_hdf5_array(
+        e, h_grp, file_name_base, "Groups", output_prop, num_groups_total,
+        N_counts, compression_write_lossless, e->internal_units,
+        e->snapshot_units);
+  }
+
   /* Close everything */
   H5Gclose(h_grp);
   H5Fclose(h_file);
@@ -603,6 +647,46 @@ void write_fof_hdf5_catalogue(const struct fof_props* props,
                        num_groups_local, compression_write_lossless,
                        e->internal_units, e->snapshot_units);
 
+  /* Spherical overdensity masses, if we computed them */
+  if (props->compute_so_masses) {
+    output_prop = io_make_output_field_(
+        "M200c", DOUBLE, 1, UNIT_CONV_MASS, 0.f, (char*)props->group_M200c,
+        sizeof(double),
+        "Mass within the sphere around the FOF centre of mass of mean "
+        "density 200 times the critical density",
+        /*physical=*/0, /*convertible_to_comoving=*/1);
+    write_fof_hdf5_array(e, h_grp, file_name, "Groups", output_prop,
+                         num_groups_local, compression_write_lossless,
+                         e->internal_units, e->snapshot_units);
+    output_prop = io_make_output_field_(
+        "R200c", DOUBLE, 1, UNIT_CONV_LENGTH, 1.f, (char*)props->group_R200c,
+        sizeof(double),
+        "Radius of the sphere around the FOF centre of mass of mean "
+        "density 200 times the critical density",
+        /*physical=*/0, /*convertible_to_comoving=*/1);
+    write_fof_hdf5_array(e, h_grp, file_name, "Groups", output_prop,
+                         num_groups_local, compression_write_lossless,
+                         e->internal_units, e->snapshot_units);
+    output_prop = io_make_output_field_(
+        "M500c", DOUBLE, 1, UNIT_CONV_MASS, 0.f, (char*)props->group_M500c,
+        sizeof(double),
+        "Mass within the sphere around the FOF centre of mass of mean "
+        "density 500 times the critical density",
+        /*physical=*/0, /*convertible_to_comoving=*/1);
+    write_fof_hdf5_array(e, h_grp, file_name, "Groups", output_prop,
+                         num_groups_local, compression_write_lossless,
+                         e->internal_units, e->snapshot_units);
+    output_prop = io_make_output_field_(
+        "R500c", DOUBLE, 1, UNIT_CONV_LENGTH, 1.f, (char*)props->group_R500c,
+        sizeof(double),
+        "Radius of the sphere around the FOF centre of mass of mean "
+        "density 500 times the critical density",
+        /*physical=*/0, /*convertible_to_comoving=*/1);
+    write_fof_hdf5_array(e, h_grp, file_name, "Groups", output_prop,
+                         num_groups_local, compression_write_lossless,
+                         e->internal_units, e->snapshot_units);
+  }
+
   /* Close everything */
   H5Gclose(h_grp);
   H5Fclose(h_file);
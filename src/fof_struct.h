@@ -34,8 +34,18 @@ struct fof_gpart_data {
 
   /*! Size of the FOF group of this particle */
   size_t group_size;
+
+  /*! Label of the core (linked at the reduced length) the particle was in at
+   * the last warm-started FOF call, fof_gpart_no_core if none */
+  size_t core_id;
+
+  /*! Upper bound on the distance drifted since the last FOF call */
+  float drift_since_fof;
 };
 
+/*! Core label of the particles not linked in the last FOF call */
+#define fof_gpart_no_core ((size_t)-1)
+
 #else
 
 /**
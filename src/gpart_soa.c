@@ -0,0 +1,322 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "gpart_soa.h"
+
+/* System includes. */
+#include <stdlib.h>
+#include <strings.h>
+
+/* Local headers. */
+#include "active.h"
+#include "cell.h"
+#include "engine.h"
+#include "error.h"
+#include "gravity.h"
+#include "memuse.h"
+#include "space.h"
+#include "task.h"
+
+/*! The one instance, shared by all the runners */
+struct gpart_soa gpart_soa;
+
+/**
+ * @brief Initialise the (empty) #gpart_soa.
+ *
+ * @param active Are we going to fill the gravity caches from it?
+ * @param lazy_drift Do the cells with no active #gpart only drift into it?
+ */
+void gpart_soa_init(const int active, const int lazy_drift) {
+
+  bzero(&gpart_soa, sizeof(struct gpart_soa));
+  gpart_soa.active = active;
+  gpart_soa.lazy_drift = active && lazy_drift;
+}
+
+/**
+ * @brief Frees the memory of the #gpart_soa.
+ */
+void gpart_soa_clean(void) {
+
+  struct gpart_soa *g = &gpart_soa;
+  if (g->size > 0) {
+    swift_free("gpart_soa", g->x);
+    swift_free("gpart_soa", g->y);
+    swift_free("gpart_soa", g->z);
+    swift_free("gpart_soa", g->m);
+    swift_free("gpart_soa", g->epsilon);
+    swift_free("gpart_soa", g->old_a_grav_norm);
+    swift_free("gpart_soa", g->time_bin);
+    swift_free("gpart_soa", g->active_index);
+  }
+  g->x = g->y = g->z = NULL;
+  g->m = g->epsilon = g->old_a_grav_norm = NULL;
+  g->time_bin = NULL;
+  g->active_index = NULL;
+  g->size = 0;
+}
+
+/**
+ * @brief Allocate one array of the #gpart_soa.
+ *
+ * @param ptr (return) The pointer.
+ * @param size The number of bytes to allocate.
+ */
+static void gpart_soa_alloc(void **ptr, const size_t size) {
+
+  if (swift_memalign("gpart_soa", ptr, SWIFT_CACHE_ALIGNMENT, size) != 0)
+    error("Couldn't allocate the gpart SoA copy (%zd bytes).", size);
+}
+
+/**
+ * @brief Make sure the #gpart_soa has room for all the local #gpart.
+ *
+ * Must be called when no task is running. Growing the arrays loses their
+ * content, which is fine as this only happens after a rebuild.
+ *
+ * @param nr_gparts The size of the #gpart array of the #space.
+ */
+void gpart_soa_ensure(const size_t nr_gparts) {
+
+  struct gpart_soa *g = &gpart_soa;
+  if (!g->active || nr_gparts <= g->size) return;
+
+  gpart_soa_clean();
+
+  gpart_soa_alloc((void **)&g->x, nr_gparts * sizeof(double));
+  gpart_soa_alloc((void **)&g->y, nr_gparts * sizeof(double));
+  gpart_soa_alloc((void **)&g->z, nr_gparts * sizeof(double));
+  gpart_soa_alloc((void **)&g->m, nr_gparts * sizeof(float));
+  gpart_soa_alloc((void **)&g->epsilon, nr_gparts * sizeof(float));
+  gpart_soa_alloc((void **)&g->old_a_grav_norm, nr_gparts * sizeof(float));
+  gpart_soa_alloc((void **)&g->time_bin, nr_gparts * sizeof(timebin_t));
+  gpart_soa_alloc((void **)&g->active_index, nr_gparts * sizeof(int));
+  g->size = nr_gparts;
+}
+
+/**
+ * @brief Mark the copy of a cell hierarchy as up to date and compact the
+ * active #gpart of its leaves.
+ *
+ * @param e The #engine.
+ * @param c The #cell.
+ */
+static void gpart_soa_stamp_rec(const struct engine *e, struct cell *c) {
+
+  c->grav.ti_soa = e->ti_current;
+  if (c->split) {
+    for (int k = 0; k < 8; ++k)
+      if (c->progeny[k] != NULL) gpart_soa_stamp_rec(e, c->progeny[k]);
+    return;
+  }
+
+  const struct gpart_soa *g = &gpart_soa;
+  const size_t offset = c->grav.parts - e->s->gparts;
+  const timebin_t max_active_bin = e->max_active_bin;
+  const timebin_t *restrict time_bin = g->time_bin + offset;
+  int *restrict active_index = g->active_index + offset;
+  const int count = c->grav.count;
+
+  /* Branch-free: always write, only move on for the active ones */
+  int active_count = 0;
+  for (int i = 0; i < count; ++i) {
+    active_index[active_count] = i;
+    active_count += (time_bin[i] <= max_active_bin);
+  }
+  c->grav.active_count = active_count;
+}
+
+/**
+ * @brief Copy some #gpart to the #gpart_soa, drifting their positions on the
+ * way.
+ *
+ * @param grav_props The #gravity_props.
+ * @param gparts The first #gpart.
+ * @param count The number of #gpart.
+ * @param offset The index of the first #gpart in space->gparts.
+ * @param dt_drift The drift factor from the time of the #gpart to now.
+ * @param predict Predict the softening as the drift would?
+ */
+__attribute__((always_inline)) INLINE static void gpart_soa_copy(
+    const struct gravity_props *grav_props, const struct gpart *gparts,
+    const int count, const size_t offset, const double dt_drift,
+    const int predict) {
+
+  struct gpart_soa *g = &gpart_soa;
+  double *restrict x = g->x + offset;
+  double *restrict y = g->y + offset;
+  double *restrict z = g->z + offset;
+  float *restrict m = g->m + offset;
+  float *restrict epsilon = g->epsilon + offset;
+  float *restrict old_a_grav_norm = g->old_a_grav_norm + offset;
+  timebin_t *restrict time_bin = g->time_bin + offset;
+
+  for (int i = 0; i < count; ++i) {
+    const struct gpart *gp = &gparts[i];
+    x[i] = gp->x[0] + gp->v_full[0] * dt_drift;
+    y[i] = gp->x[1] + gp->v_full[1] * dt_drift;
+    z[i] = gp->x[2] + gp->v_full[2] * dt_drift;
+    m[i] = gp->time_bin == time_bin_inhibited ? 0.f : gp->mass;
+    if (predict) {
+      struct gpart gp_predicted = *gp;
+      gravity_predict_extra(&gp_predicted, grav_props);
+      epsilon[i] = gravity_get_softening(&gp_predicted, grav_props);
+    } else {
+      epsilon[i] = gravity_get_softening(gp, grav_props);
+    }
+    old_a_grav_norm[i] = gp->old_a_grav_norm;
+    time_bin[i] = gp->time_bin;
+  }
+}
+
+/**
+ * @brief Refresh the #gpart_soa copy of the #gpart of a freshly drifted
+ * local cell.
+ *
+ * Nothing else touches the positions, masses, softenings and time bins of
+ * the #gpart between the drift and the end of the gravity tasks of a step,
+ * so the copy is exact for the rest of the step.
+ *
+ * @param e The #engine.
+ * @param c The #cell.
+ */
+void gpart_soa_fill(const struct engine *e, struct cell *c) {
+
+  struct gpart_soa *g = &gpart_soa;
+  if (!g->active || c->nodeID != e->nodeID || c->grav.count == 0) return;
+
+  const int count = c->grav.count;
+  const size_t offset = c->grav.parts - e->s->gparts;
+
+  /* Not room for it (yet), the caches will read the gparts directly */
+  if (offset + count > g->size) return;
+
+  gpart_soa_copy(e->gravity_properties, c->grav.parts, count, offset,
+                 /*dt_drift=*/0., /*predict=*/0);
+
+  gpart_soa_stamp_rec(e, c);
+}
+
+#ifdef WITH_MPI
+/**
+ * @brief Is a cell, or one of its progenies, sending its #gpart this step?
+ *
+ * @param c The #cell.
+ */
+static int gpart_soa_is_sent_rec(const struct cell *c) {
+
+  for (const struct link *l = c->mpi.send; l != NULL; l = l->next)
+    if (l->t->subtype == task_subtype_gpart && !l->t->skip) return 1;
+
+  if (c->split)
+    for (int k = 0; k < 8; ++k)
+      if (c->progeny[k] != NULL && gpart_soa_is_sent_rec(c->progeny[k]))
+        return 1;
+
+  return 0;
+}
+#endif
+
+/**
+ * @brief Drift the positions of the #gpart of a cell hierarchy into the
+ * #gpart_soa only and clear its drift flags.
+ *
+ * Each leaf goes from the time it was last drifted to, as in
+ * cell_drift_gpart().
+ *
+ * @param e The #engine.
+ * @param c The #cell.
+ */
+static void gpart_soa_drift_rec(const struct engine *e, struct cell *c) {
+
+  if (c->split) {
+    for (int k = 0; k < 8; ++k)
+      if (c->progeny[k] != NULL) gpart_soa_drift_rec(e, c->progeny[k]);
+  } else if (c->grav.count > 0) {
+
+    const integertime_t ti_old_gpart = c->grav.ti_old_part;
+    const integertime_t ti_current = e->ti_current;
+
+    double dt_drift = 0.;
+    if (ti_current > ti_old_gpart) {
+      if (e->policy & engine_policy_cosmology)
+        dt_drift =
+            cosmology_get_drift_factor(e->cosmology, ti_old_gpart, ti_current);
+      else
+        dt_drift = (ti_current - ti_old_gpart) * e->time_base;
+    }
+
+    gpart_soa_copy(e->gravity_properties, c->grav.parts, c->grav.count,
+                   c->grav.parts - e->s->gparts, dt_drift, /*predict=*/1);
+  }
+
+  cell_clear_flag(c, cell_flag_do_grav_drift | cell_flag_do_grav_sub_drift);
+}
+
+/**
+ * @brief Drift a local cell with no active #gpart into the #gpart_soa copy
+ * only.
+ *
+ * In the runs allowing it (see engine_config()), the #gpart of a cell that
+ * nothing kicks in this step are only read as sources by the gravity caches,
+ * i.e. through the copy. Their drifted positions are then written there, and
+ * the #gpart stay at the time of their last drift, from which the next full
+ * drift will take them. This avoids writing back the whole #gpart array of
+ * the cells that are only neighbours of the active ones.
+ *
+ * @param e The #engine.
+ * @param c The #cell.
+ *
+ * @return 1 if the cell was dealt with, 0 if it must be drifted in full.
+ */
+int gpart_soa_drift_lazy(const struct engine *e, struct cell *c) {
+
+  const struct gpart_soa *g = &gpart_soa;
+  if (!g->active || !g->lazy_drift || c->nodeID != e->nodeID ||
+      c->grav.count == 0 || cell_is_active_gravity(c, e))
+    return 0;
+
+  /* Not room for it (yet), the caches will read the gparts directly */
+  const size_t offset = c->grav.parts - e->s->gparts;
+  if (offset + c->grav.count > g->size) return 0;
+
+#ifdef WITH_MPI
+  /* The other ranks get the gparts themselves */
+  for (const struct cell *parent = c->parent; parent != NULL;
+       parent = parent->parent)
+    for (const struct link *l = parent->mpi.send; l != NULL; l = l->next)
+      if (l->t->subtype == task_subtype_gpart && !l->t->skip) return 0;
+  if (gpart_soa_is_sent_rec(c)) return 0;
+#endif
+
+  gpart_soa_drift_rec(e, c);
+  gpart_soa_stamp_rec(e, c);
+  return 1;
+}
+
+/**
+ * @brief The #gpart of a local leaf cell that were active when its
+ * #gpart_soa copy was refreshed in this step.
+ *
+ * The list stays valid until the #gpart of the cell are moved (see
+ * cell_recursively_shift_gparts()). Changes of time bins and types do not
+ * alter it, so the callers still check each #gpart they visit.
+ *
+ * @param e The #engine.
+ * @param c The leaf #cell.
+ * @param count (return) The number of #gpart in the list.
+ *
+ * @return The indices of the #gpart in c->grav.parts, or NULL if the cell has
+ * no up to date list, in which case all its #gpart must be visited.
+ */
+const int *gpart_soa_active_list(const struct engine *e, const struct cell *c,
+                                 int *count) {
+
+  if (!gpart_soa.active || c->split || c->nodeID != e->nodeID ||
+      c->grav.ti_soa != e->ti_current)
+    return NULL;
+
+  *count = c->grav.active_count;
+  return gpart_soa.active_index + (c->grav.parts - e->s->gparts);
+}
@@ -0,0 +1,70 @@
+#ifndef SWIFT_GPART_SOA_H
+#define SWIFT_GPART_SOA_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* System includes. */
+#include <stddef.h>
+
+/* Local headers */
+#include "timeline.h"
+
+/* Forward declarations */
+struct cell;
+struct engine;
+
+/**
+ * @brief A host-side copy of the fields of the local #gpart the gravity
+ * caches read, in SoA form and indexed like space->gparts.
+ *
+ * The drift task of a cell refreshes its particles once per step, after
+ * which all the caches of the step are filled by streaming through these
+ * arrays rather than gathering from the #gpart. The refresh also compacts
+ * the active #gpart of each leaf cell into a list of indices, such that the
+ * end of the force and the kicks of the step only visit those.
+ */
+struct gpart_soa {
+
+  /*! #gpart positions. */
+  double *x, *y, *z;
+
+  /*! #gpart masses (0 for the inhibited ones). */
+  float *m;
+
+  /*! #gpart softening lengths. */
+  float *epsilon;
+
+  /*! #gpart norms of the acceleration of the last step. */
+  float *old_a_grav_norm;
+
+  /*! #gpart time bins. */
+  timebin_t *time_bin;
+
+  /*! Indices of the active #gpart of each leaf cell, relative to its first
+   * #gpart and stored from the same offset. */
+  int *active_index;
+
+  /*! Number of #gpart we have room for. */
+  size_t size;
+
+  /*! Are we using the copy at all? */
+  int active;
+
+  /*! Do the cells with no active #gpart only drift into the copy? */
+  int lazy_drift;
+};
+
+/* The one instance */
+extern struct gpart_soa gpart_soa;
+
+/* Function prototypes. */
+void gpart_soa_init(const int active, const int lazy_drift);
+void gpart_soa_clean(void);
+void gpart_soa_ensure(const size_t nr_gparts);
+void gpart_soa_fill(const struct engine *e, struct cell *c);
+int gpart_soa_drift_lazy(const struct engine *e, struct cell *c);
+const int *gpart_soa_active_list(const struct engine *e, const struct cell *c,
+                                 int *count);
+
+#endif /* SWIFT_GPART_SOA_H */
@@ -35,6 +35,10 @@
 
 /* Local headers. */
 #include "active.h"
+#include "cuda_devices.h"
+#include "cuda_exact_force.h"
+#include "cuda_precision.h"
+#include "cuda_types.h"
 #include "error.h"
 #include "kernel_gravity.h"
 #include "kernel_long_gravity.h"
@@ -623,11 +627,150 @@ void gravity_exact_force_compute_mapper(void *map_data, int nr_gparts,
 #endif
 }
 
+#ifdef SWIFT_GRAVITY_FORCE_CHECKS
+
+/* Brute-force calculation on the device (see grav_pp_offload.cu) */
+extern enum cuda_fault exact_force_offload(struct cuda_exact_force *f);
+
+/**
+ * @brief Run the brute-force gravity calculation of
+ * gravity_exact_force_compute_mapper() on the GPU.
+ *
+ * @param s The #space to use.
+ * @param e The #engine (to access the current time).
+ * @param const_G Newton's constant.
+ *
+ * @return The number of #gpart whose forces were computed, or -1 if the
+ * device failed and the forces have to be computed on the CPU.
+ */
+static int gravity_exact_force_compute_gpu(struct space *s,
+                                           const struct engine *e,
+                                           const double const_G) {
+
+#ifdef WITH_CUDA
+
+  const struct part *parts = s->parts;
+  const struct spart *sparts = s->sparts;
+  const struct bpart *bparts = s->bparts;
+  const size_t nr_gparts = s->nr_gparts;
+
+  struct cuda_exact_force f;
+  bzero(&f, sizeof(struct cuda_exact_force));
+  f.nr_gparts = nr_gparts;
+  f.fewald_x = &fewald_x[0][0][0];
+  f.fewald_y = &fewald_y[0][0][0];
+  f.fewald_z = &fewald_z[0][0][0];
+  f.potewald = &potewald[0][0][0];
+  f.n_ewald = Newald;
+  f.ewald_fac = ewald_fac;
+  f.periodic = s->periodic;
+  for (int k = 0; k < 3; k++) f.dim[k] = s->dim[k];
+  f.r_s_inv = e->mesh->r_s_inv;
+
+  f.x = (double *)malloc(nr_gparts * sizeof(double));
+  f.y = (double *)malloc(nr_gparts * sizeof(double));
+  f.z = (double *)malloc(nr_gparts * sizeof(double));
+  f.m = (double *)malloc(nr_gparts * sizeof(double));
+  if (f.x == NULL || f.y == NULL || f.z == NULL || f.m == NULL)
+    error("Failed to allocate the exact force source arrays.");
+
+  /* The sources, and the list of particles to test */
+  size_t size_tested = 0;
+  for (size_t i = 0; i < nr_gparts; ++i) {
+
+    const struct gpart *gpi = &s->gparts[i];
+
+#ifdef SWIFT_DEBUG_CHECKS
+    if (gpi->time_bin == time_bin_not_created) {
+      error("Found an extra particle in the gravity check.");
+    }
+#endif
+
+    f.x[i] = gpi->x[0];
+    f.y[i] = gpi->x[1];
+    f.z[i] = gpi->x[2];
+    f.m[i] = gpi->mass;
+
+    /* Get the particle ID */
+    long long id = 0;
+    if (gpi->type == swift_type_gas)
+      id = parts[-gpi->id_or_neg_offset].id;
+    else if (gpi->type == swift_type_stars)
+      id = sparts[-gpi->id_or_neg_offset].id;
+    else if (gpi->type == swift_type_black_hole)
+      id = bparts[-gpi->id_or_neg_offset].id;
+    else
+      id = gpi->id_or_neg_offset;
+
+    /* Is the particle active and part of the subset to be tested ? */
+    if (id % SWIFT_GRAVITY_FORCE_CHECKS != 0 || !gpart_is_active(gpi, e))
+      continue;
+
+    if ((size_t)f.nr_tested == size_tested) {
+      size_tested = size_tested > 0 ? 2 * size_tested : 1024;
+      f.index = (size_t *)realloc(f.index, size_tested * sizeof(size_t));
+      f.h = (double *)realloc(f.h, size_tested * sizeof(double));
+      if (f.index == NULL || f.h == NULL)
+        error("Failed to allocate the exact force test list.");
+    }
+    f.index[f.nr_tested] = i;
+    f.h[f.nr_tested] = gravity_get_softening(gpi, e->gravity_properties);
+    f.nr_tested++;
+  }
+
+  f.a_grav = (double *)malloc(3 * f.nr_tested * sizeof(double));
+  f.a_grav_short = (double *)malloc(3 * f.nr_tested * sizeof(double));
+  f.a_grav_long = (double *)malloc(3 * f.nr_tested * sizeof(double));
+  f.pot = (double *)malloc(f.nr_tested * sizeof(double));
+  if (f.a_grav == NULL || f.a_grav_short == NULL || f.a_grav_long == NULL ||
+      f.pot == NULL)
+    error("Failed to allocate the exact force results.");
+
+  const enum cuda_fault fault = exact_force_offload(&f);
+
+  /* Never take a failed device's results as the reference */
+  if (fault == cuda_fault_sticky)
+    error("The CUDA context was lost while computing the exact forces.");
+  if (fault != cuda_fault_none)
+    warning("Device fault in the exact forces, computing them on the CPU.");
+
+  /* Store the exact answer */
+  const int count = fault == cuda_fault_none ? f.nr_tested : 0;
+  for (int t = 0; t < count; ++t) {
+    struct gpart *gpi = &s->gparts[f.index[t]];
+    for (int k = 0; k < 3; k++) {
+      gpi->a_grav_exact[k] = f.a_grav[3 * t + k] * const_G;
+      gpi->a_grav_exact_short[k] = f.a_grav_short[3 * t + k] * const_G;
+      gpi->a_grav_exact_long[k] = f.a_grav_long[3 * t + k] * const_G;
+    }
+    gpi->potential_exact = f.pot[t] * const_G;
+  }
+
+  free(f.x);
+  free(f.y);
+  free(f.z);
+  free(f.m);
+  free(f.index);
+  free(f.h);
+  free(f.a_grav);
+  free(f.a_grav_short);
+  free(f.a_grav_long);
+  free(f.pot);
+
+  return fault == cuda_fault_none ? f.nr_tested : -1;
+#else
+  error("SWIFT was not compiled with CUDA support.");
+  return 0;
+#endif
+}
+
+#endif /* SWIFT_GRAVITY_FORCE_CHECKS */
+
 /**
  * @brief Run a brute-force gravity calculation for a subset of particles.
  *
  * All gpart with ID modulo SWIFT_GRAVITY_FORCE_CHECKS will get their forces
- * computed.
+ * computed. This is done on the GPU when we have one.
  *
  * @param s The #space to use.
  * @param e The #engine (to access the current time).
@@ -652,9 +795,16 @@ void gravity_exact_force_compute(struct space *s, const struct engine *e) {
   data.counter_global = 0;
   data.const_G = e->physical_constants->const_newton_G;
 
-  threadpool_map(&s->e->threadpool, gravity_exact_force_compute_mapper,
-                 s->gparts, s->nr_gparts, sizeof(struct gpart),
-                 threadpool_auto_chunk_size, &data);
+  if (cuda_devices_active())
+    data.counter_global = gravity_exact_force_compute_gpu(s, e, data.const_G);
+
+  /* On the CPU, possibly again after a device fault */
+  if (!cuda_devices_active() || data.counter_global < 0) {
+    data.counter_global = 0;
+    threadpool_map(&s->e->threadpool, gravity_exact_force_compute_mapper,
+                   s->gparts, s->nr_gparts, sizeof(struct gpart),
+                   threadpool_auto_chunk_size, &data);
+  }
 
   message("Computed exact gravity for %d gparts (took %.3f %s). ",
           data.counter_global, clocks_from_ticks(getticks() - tic),
@@ -665,6 +815,84 @@ void gravity_exact_force_compute(struct space *s, const struct engine *e) {
 #endif
 }
 
+#ifdef SWIFT_GRAVITY_FORCE_CHECKS
+
+/* qsort support. */
+static int gravity_float_cmp(const void *p1, const void *p2) {
+  const float v1 = *(const float *)p1;
+  const float v2 = *(const float *)p2;
+  return (v1 > v2) - (v1 < v2);
+}
+
+/**
+ * @brief Report the distribution of the relative errors of the SWIFT
+ * accelerations against the exact ones.
+ *
+ * This tells whether the #cuda_precision mode in use still meets the error
+ * budget.
+ *
+ * @param s The #space.
+ * @param e The #engine.
+ * @param rel_tol The relative error we aim for.
+ */
+static void gravity_exact_force_report(const struct space *s,
+                                       const struct engine *e,
+                                       const float rel_tol) {
+
+  const struct part *parts = s->parts;
+  const struct spart *sparts = s->sparts;
+  const struct bpart *bparts = s->bparts;
+
+  float *errors = (float *)malloc(s->nr_gparts * sizeof(float));
+  if (errors == NULL) error("Failed to allocate the force error array.");
+
+  size_t count = 0, above = 0;
+  for (size_t i = 0; i < s->nr_gparts; ++i) {
+
+    const struct gpart *gpi = &s->gparts[i];
+
+    long long id = 0;
+    if (gpi->type == swift_type_gas)
+      id = parts[-gpi->id_or_neg_offset].id;
+    else if (gpi->type == swift_type_stars)
+      id = sparts[-gpi->id_or_neg_offset].id;
+    else if (gpi->type == swift_type_black_hole)
+      id = bparts[-gpi->id_or_neg_offset].id;
+    else
+      id = gpi->id_or_neg_offset;
+
+    if (id % SWIFT_GRAVITY_FORCE_CHECKS != 0 || !gpart_is_starting(gpi, e))
+      continue;
+
+    double diff2 = 0., norm2 = 0.;
+    for (int k = 0; k < 3; ++k) {
+      const double a_swift = gpi->a_grav[k] + gpi->a_grav_mesh[k];
+      const double diff = a_swift - gpi->a_grav_exact[k];
+      diff2 += diff * diff;
+      norm2 += gpi->a_grav_exact[k] * gpi->a_grav_exact[k];
+    }
+    if (norm2 == 0.) continue;
+
+    errors[count] = sqrt(diff2 / norm2);
+    if (errors[count] > rel_tol) above++;
+    count++;
+  }
+
+  if (count > 0) {
+    qsort(errors, count, sizeof(float), gravity_float_cmp);
+    message(
+        "GPU precision '%s': relative force error median=%e 99%%=%e max=%e, "
+        "%zd/%zd particles above %e.",
+        cuda_precision_name(gpu_precision), errors[count / 2],
+        errors[(size_t)(0.99 * (count - 1))], errors[count - 1], above, count,
+        rel_tol);
+  }
+
+  free(errors);
+}
+
+#endif
+
 /**
  * @brief Check the accuracy of the gravity calculation by comparing the
  * accelerations
@@ -812,6 +1040,9 @@ void gravity_exact_force_check(struct space *s, const struct engine *e,
 
     /* Be nice */
     fclose(file_exact);
+
+    /* The exact forces are only there when we just computed them */
+    gravity_exact_force_report(s, e, rel_tol);
   }
 #else
   error("Gravity checking function called without the corresponding flag.");
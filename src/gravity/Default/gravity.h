@@ -337,4 +337,57 @@ __attribute__((always_inline)) INLINE static void gravity_first_init_gpart(
   gravity_init_gpart(gp);
 }
 
+/**
+ * @brief Copies what the other ranks need of a #gpart into a #gpart_foreign.
+ *
+ * @param gpf The #gpart_foreign to fill.
+ * @param gp The particle.
+ * @param loc The corner of the #cell the particle is sent with.
+ */
+__attribute__((always_inline)) INLINE static void gravity_pack_foreign(
+    struct gpart_foreign* gpf, const struct gpart* gp, const double loc[3]) {
+
+  gpf->x[0] = gp->x[0] - loc[0];
+  gpf->x[1] = gp->x[1] - loc[1];
+  gpf->x[2] = gp->x[2] - loc[2];
+  gpf->mass = gp->mass;
+  gpf->time_bin = gp->time_bin;
+#ifdef SWIFT_DEBUG_CHECKS
+  gpf->ti_drift = gp->ti_drift;
+#endif
+}
+
+/**
+ * @brief Updates a foreign #gpart from the #gpart_foreign received for it.
+ *
+ * @param gp The particle.
+ * @param gpf The #gpart_foreign received.
+ * @param loc The corner of the #cell the particle was received with.
+ */
+__attribute__((always_inline)) INLINE static void gravity_unpack_foreign(
+    struct gpart* gp, const struct gpart_foreign* gpf, const double loc[3]) {
+
+  gp->x[0] = loc[0] + gpf->x[0];
+  gp->x[1] = loc[1] + gpf->x[1];
+  gp->x[2] = loc[2] + gpf->x[2];
+  gp->mass = gpf->mass;
+  gp->time_bin = gpf->time_bin;
+#ifdef SWIFT_DEBUG_CHECKS
+  gp->ti_drift = gpf->ti_drift;
+#endif
+}
+
+/**
+ * @brief Returns the softening of a #gpart_foreign.
+ *
+ * @param gpf The #gpart_foreign.
+ * @param grav_props The properties of the gravity scheme.
+ */
+__attribute__((always_inline)) INLINE static float
+gravity_foreign_get_softening(const struct gpart_foreign* gpf,
+                              const struct gravity_props* restrict grav_props) {
+
+  return grav_props->epsilon_DM_cur;
+}
+
 #endif /* SWIFT_DEFAULT_GRAVITY_H */
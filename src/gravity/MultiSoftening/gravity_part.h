@@ -121,4 +121,31 @@ struct gpart {
 #endif
 };
 
+/**
+ * @brief The part of a #gpart sent to the other ranks every step.
+ *
+ * The positions are relative to the corner of the #cell being sent, which
+ * is as precise as the gravity interactions need them.
+ */
+struct gpart_foreign {
+
+  /*! Particle position relative to the cell. */
+  float x[3];
+
+  /*! Particle mass. */
+  float mass;
+
+  /*! Current co-moving spline softening of the particle */
+  float epsilon;
+
+  /*! Time-step length */
+  timebin_t time_bin;
+
+#ifdef SWIFT_DEBUG_CHECKS
+
+  /* Time of the last drift */
+  integertime_t ti_drift;
+#endif
+};
+
 #endif /* SWIFT_MULTI_SOFTENING_GRAVITY_PART_H */
@@ -22,10 +22,17 @@
 /* Config parameters. */
 #include <config.h>
 
+#ifdef SWIFT_CUDA_PINNED_CACHES
+/* CUDA headers */
+#include <cuda_runtime.h>
+#endif
+
 /* Local headers */
 #include "accumulate.h"
 #include "align.h"
+#include "cuda_devices.h"
 #include "error.h"
+#include "gpart_soa.h"
 #include "gravity.h"
 #include "multipole_accept.h"
 #include "vector.h"
@@ -72,8 +79,54 @@ struct gravity_cache {
 
   /*! Cache size */
   int count;
+
+  /*! Largest padded number of #gpart asked for since the last trim */
+  int count_used;
 };
 
+/**
+ * @brief Allocates one array of a #gravity_cache.
+ *
+ * When compiled with pinned caches and running with a GPU, the memory is
+ * page-locked such that the copies to and from the GPU can be truly
+ * asynchronous.
+ *
+ * @param ptr (return) The newly allocated array.
+ * @param size The number of bytes to allocate.
+ * @return 0 on success.
+ */
+static INLINE int gravity_cache_alloc_array(void **ptr, const size_t size) {
+
+#ifdef SWIFT_CUDA_PINNED_CACHES
+  if (cuda_devices_active()) {
+#ifdef SWIFT_CUDA_MAPPED_CACHES
+    const unsigned int flags = cudaHostAllocPortable | cudaHostAllocMapped;
+#else
+    const unsigned int flags = cudaHostAllocPortable;
+#endif
+    /* Page-locked memory is page-aligned, hence also cache-aligned */
+    return cudaHostAlloc(ptr, size, flags) != cudaSuccess;
+  }
+#endif
+  return swift_memalign("gravity_cache", ptr, SWIFT_CACHE_ALIGNMENT, size);
+}
+
+/**
+ * @brief Frees one array of a #gravity_cache.
+ *
+ * @param ptr The array to free.
+ */
+static INLINE void gravity_cache_free_array(void *ptr) {
+
+#ifdef SWIFT_CUDA_PINNED_CACHES
+  if (cuda_devices_active()) {
+    cudaFreeHost(ptr);
+    return;
+  }
+#endif
+  swift_free("gravity_cache", ptr);
+}
+
 /**
  * @brief Frees the memory allocated in a #gravity_cache
  *
@@ -82,17 +135,17 @@ struct gravity_cache {
 static INLINE void gravity_cache_clean(struct gravity_cache *c) {
 
   if (c->count > 0) {
-    swift_free("gravity_cache", c->x);
-    swift_free("gravity_cache", c->y);
-    swift_free("gravity_cache", c->z);
-    swift_free("gravity_cache", c->epsilon);
-    swift_free("gravity_cache", c->m);
-    swift_free("gravity_cache", c->a_x);
-    swift_free("gravity_cache", c->a_y);
-    swift_free("gravity_cache", c->a_z);
-    swift_free("gravity_cache", c->pot);
-    swift_free("gravity_cache", c->active);
-    swift_free("gravity_cache", c->use_mpole);
+    gravity_cache_free_array(c->x);
+    gravity_cache_free_array(c->y);
+    gravity_cache_free_array(c->z);
+    gravity_cache_free_array(c->epsilon);
+    gravity_cache_free_array(c->m);
+    gravity_cache_free_array(c->a_x);
+    gravity_cache_free_array(c->a_y);
+    gravity_cache_free_array(c->a_z);
+    gravity_cache_free_array(c->pot);
+    gravity_cache_free_array(c->active);
+    gravity_cache_free_array(c->use_mpole);
   }
   c->count = 0;
 }
@@ -119,34 +172,57 @@ static INLINE void gravity_cache_init(struct gravity_cache *c,
   gravity_cache_clean(c);
 
   int e = 0;
-  e += swift_memalign("gravity_cache", (void **)&c->x, SWIFT_CACHE_ALIGNMENT,
-                      sizeBytesF);
-  e += swift_memalign("gravity_cache", (void **)&c->y, SWIFT_CACHE_ALIGNMENT,
-                      sizeBytesF);
-  e += swift_memalign("gravity_cache", (void **)&c->z, SWIFT_CACHE_ALIGNMENT,
-                      sizeBytesF);
-  e += swift_memalign("gravity_cache", (void **)&c->epsilon,
-                      SWIFT_CACHE_ALIGNMENT, sizeBytesF);
-  e += swift_memalign("gravity_cache", (void **)&c->m, SWIFT_CACHE_ALIGNMENT,
-                      sizeBytesF);
-  e += swift_memalign("gravity_cache", (void **)&c->a_x, SWIFT_CACHE_ALIGNMENT,
-                      sizeBytesF);
-  e += swift_memalign("gravity_cache", (void **)&c->a_y, SWIFT_CACHE_ALIGNMENT,
-                      sizeBytesF);
-  e += swift_memalign("gravity_cache", (void **)&c->a_z, SWIFT_CACHE_ALIGNMENT,
-                      sizeBytesF);
-  e += swift_memalign("gravity_cache", (void **)&c->pot, SWIFT_CACHE_ALIGNMENT,
-                      sizeBytesF);
-  e += swift_memalign("gravity_cache", (void **)&c->active,
-                      SWIFT_CACHE_ALIGNMENT, sizeBytesI);
-  e += swift_memalign("gravity_cache", (void **)&c->use_mpole,
-                      SWIFT_CACHE_ALIGNMENT, sizeBytesI);
+  e += gravity_cache_alloc_array((void **)&c->x, sizeBytesF);
+  e += gravity_cache_alloc_array((void **)&c->y, sizeBytesF);
+  e += gravity_cache_alloc_array((void **)&c->z, sizeBytesF);
+  e += gravity_cache_alloc_array((void **)&c->epsilon, sizeBytesF);
+  e += gravity_cache_alloc_array((void **)&c->m, sizeBytesF);
+  e += gravity_cache_alloc_array((void **)&c->a_x, sizeBytesF);
+  e += gravity_cache_alloc_array((void **)&c->a_y, sizeBytesF);
+  e += gravity_cache_alloc_array((void **)&c->a_z, sizeBytesF);
+  e += gravity_cache_alloc_array((void **)&c->pot, sizeBytesF);
+  e += gravity_cache_alloc_array((void **)&c->active, sizeBytesI);
+  e += gravity_cache_alloc_array((void **)&c->use_mpole, sizeBytesI);
 
   if (e != 0) error("Couldn't allocate gravity cache, size: %d", padded_count);
 
   c->count = padded_count;
 }
 
+/**
+ * @brief Make sure a #gravity_cache can hold a given number of #gpart.
+ *
+ * The cache is allocated on first use and grows with a bit of head-room such
+ * that we don't re-allocate for every small increase.
+ *
+ * @param c The #gravity_cache to (possibly) grow.
+ * @param gcount_padded The padded number of #gpart we need room for.
+ */
+static INLINE void gravity_cache_ensure(struct gravity_cache *c,
+                                        const int gcount_padded) {
+
+  if (c->count_used < gcount_padded) c->count_used = gcount_padded;
+  if (c->count < gcount_padded) gravity_cache_init(c, gcount_padded + VEC_SIZE);
+}
+
+/**
+ * @brief Frees a #gravity_cache that is much larger than what it was used
+ * for since the last call.
+ *
+ * The cache is then re-allocated at the size actually needed the next time
+ * it is used.
+ *
+ * @param c The #gravity_cache to trim.
+ * @param factor The ratio of the allocated to the used size above which the
+ * cache is freed.
+ */
+static INLINE void gravity_cache_trim(struct gravity_cache *c,
+                                      const int factor) {
+
+  if (c->count > factor * (c->count_used + VEC_SIZE)) gravity_cache_clean(c);
+  c->count_used = 0;
+}
+
 /**
  * @brief Zero all the output fields (acceleration and potential) of a
  * #gravity_cache.
@@ -212,7 +288,7 @@ INLINE static void gravity_cache_populate(
 #endif
 
   /* Do we need to grow the cache? */
-  if (c->count < gcount_padded) gravity_cache_init(c, gcount_padded + VEC_SIZE);
+  gravity_cache_ensure(c, gcount_padded);
 
   /* Make the compiler understand we are in happy vectorization land */
   swift_declare_aligned_ptr(float, x, c->x, SWIFT_CACHE_ALIGNMENT);
@@ -321,7 +397,7 @@ INLINE static void gravity_cache_populate_no_mpole(
 #endif
 
   /* Do we need to grow the cache? */
-  if (c->count < gcount_padded) gravity_cache_init(c, gcount_padded + VEC_SIZE);
+  gravity_cache_ensure(c, gcount_padded);
 
   /* Make the compiler understand we are in happy vectorization land */
   swift_declare_aligned_ptr(float, x, c->x, SWIFT_CACHE_ALIGNMENT);
@@ -380,6 +456,309 @@ INLINE static void gravity_cache_populate_no_mpole(
   gravity_cache_zero_output(c, gcount_padded);
 }
 
+/**
+ * @brief Fills a #gravity_cache structure with the #gpart_foreign of a foreign
+ * cell and shift them.
+ *
+ * The particles of a foreign cell only source forces, so none of them is
+ * flagged as using the multipole of the other cell.
+ *
+ * @param max_active_bin The largest active bin in the current time-step.
+ * @param c The #gravity_cache to fill.
+ * @param gparts The #gpart_foreign array to read from.
+ * @param gcount The number of particles to read.
+ * @param gcount_padded The number of particle to read padded to the next
+ * multiple of the vector length.
+ * @param loc The position the particles are relative to.
+ * @param shift A shift to apply to all the particles.
+ * @param cell The cell we play with (to get reasonable padding positions).
+ * @param grav_props The global gravity properties.
+ */
+INLINE static void gravity_cache_populate_foreign(
+    const timebin_t max_active_bin, struct gravity_cache *c,
+    const struct gpart_foreign *restrict gparts, const int gcount,
+    const int gcount_padded, const double loc[3], const double shift[3],
+    const struct cell *cell, const struct gravity_props *grav_props) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (gcount_padded < gcount) error("Invalid padded cache size. Too small.");
+  if (gcount_padded % VEC_SIZE != 0)
+    error("Padded gravity cache size invalid. Not a multiple of SIMD length.");
+#endif
+
+  /* Do we need to grow the cache? */
+  gravity_cache_ensure(c, gcount_padded);
+
+  /* Make the compiler understand we are in happy vectorization land */
+  swift_declare_aligned_ptr(float, x, c->x, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, y, c->y, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, z, c->z, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, epsilon, c->epsilon, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, m, c->m, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(int, active, c->active, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(int, use_mpole, c->use_mpole,
+                            SWIFT_CACHE_ALIGNMENT);
+  swift_assume_size(gcount_padded, VEC_SIZE);
+
+  /* The shift from the positions in the array to the ones in the cache */
+  const double offset[3] = {loc[0] - shift[0], loc[1] - shift[1],
+                            loc[2] - shift[2]};
+
+  /* Fill the input caches */
+  for (int i = 0; i < gcount; ++i) {
+    x[i] = (float)(offset[0] + gparts[i].x[0]);
+    y[i] = (float)(offset[1] + gparts[i].x[1]);
+    z[i] = (float)(offset[2] + gparts[i].x[2]);
+    epsilon[i] = gravity_foreign_get_softening(&gparts[i], grav_props);
+
+    /* Make a dummy particle out of the inhibted ones */
+    if (gparts[i].time_bin == time_bin_inhibited) {
+      m[i] = 0.f;
+      active[i] = 0;
+    } else {
+      m[i] = gparts[i].mass;
+      active[i] = (int)(gparts[i].time_bin <= max_active_bin);
+    }
+    use_mpole[i] = 0;
+  }
+
+  /* Particles used for padding should get impossible positions
+   * that have a reasonable magnitude. We use the cell width for this */
+  const float pos_padded[3] = {-2.f * (float)cell->width[0],
+                               -2.f * (float)cell->width[1],
+                               -2.f * (float)cell->width[2]};
+  const float eps_padded = epsilon[0];
+
+  /* Pad the caches */
+  for (int i = gcount; i < gcount_padded; ++i) {
+    x[i] = pos_padded[0];
+    y[i] = pos_padded[1];
+    z[i] = pos_padded[2];
+    epsilon[i] = eps_padded;
+    m[i] = 0.f;
+    active[i] = 0;
+    use_mpole[i] = 0;
+  }
+
+  /* Zero the output as well */
+  gravity_cache_zero_output(c, gcount_padded);
+}
+
+/**
+ * @brief Fills a #gravity_cache structure with the #gpart of a cell read from
+ * the #gpart_soa, shift them and check whether they can use the multipole of
+ * the other cell.
+ *
+ * Same as gravity_cache_populate() but streaming through the SoA copy rather
+ * than gathering from the #gpart.
+ *
+ * @param max_active_bin The largest active bin in the current time-step.
+ * @param allow_mpole Are we allowing the use of M2P interactions ?
+ * @param periodic Are we using periodic BCs ?
+ * @param dim The size of the simulation volume along each dimension.
+ * @param c The #gravity_cache to fill.
+ * @param soa The #gpart_soa to read from.
+ * @param offset The index of the first #gpart of the cell in the #gpart_soa.
+ * @param gcount The number of particles to read.
+ * @param gcount_padded The number of particle to read padded to the next
+ * multiple of the vector length.
+ * @param shift A shift to apply to all the particles.
+ * @param CoM The position of the multipole.
+ * @param multipole The mulipole to check for.
+ * @param cell The cell we play with (to get reasonable padding positions).
+ * @param grav_props The global gravity properties.
+ */
+INLINE static void gravity_cache_populate_soa(
+    const timebin_t max_active_bin, const int allow_mpole, const int periodic,
+    const float dim[3], struct gravity_cache *c,
+    const struct gpart_soa *soa, const size_t offset, const int gcount,
+    const int gcount_padded, const double shift[3], const float CoM[3],
+    const struct gravity_tensors *multipole, const struct cell *cell,
+    const struct gravity_props *grav_props) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (gcount_padded < gcount) error("Invalid padded cache size. Too small.");
+  if (gcount_padded % VEC_SIZE != 0)
+    error("Padded gravity cache size invalid. Not a multiple of SIMD length.");
+  if (offset + gcount > soa->size) error("Reading past the gpart SoA copy.");
+#endif
+
+  /* Do we need to grow the cache? */
+  gravity_cache_ensure(c, gcount_padded);
+
+  /* Make the compiler understand we are in happy vectorization land */
+  swift_declare_aligned_ptr(float, x, c->x, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, y, c->y, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, z, c->z, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, epsilon, c->epsilon, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, m, c->m, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(int, active, c->active, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(int, use_mpole, c->use_mpole,
+                            SWIFT_CACHE_ALIGNMENT);
+  swift_assume_size(gcount_padded, VEC_SIZE);
+
+  /* The cell's section of the SoA copy */
+  const double *restrict soa_x = soa->x + offset;
+  const double *restrict soa_y = soa->y + offset;
+  const double *restrict soa_z = soa->z + offset;
+  const float *restrict soa_m = soa->m + offset;
+  const float *restrict soa_epsilon = soa->epsilon + offset;
+  const float *restrict soa_old_a_grav = soa->old_a_grav_norm + offset;
+  const timebin_t *restrict soa_time_bin = soa->time_bin + offset;
+
+  /* Fill the input caches */
+#if !defined(SWIFT_DEBUG_CHECKS) && _OPENMP >= 201307
+#pragma omp simd
+#endif
+  for (int i = 0; i < gcount; ++i) {
+
+    x[i] = (float)(soa_x[i] - shift[0]);
+    y[i] = (float)(soa_y[i] - shift[1]);
+    z[i] = (float)(soa_z[i] - shift[2]);
+    epsilon[i] = soa_epsilon[i];
+
+#ifdef SWIFT_DEBUG_CHECKS
+    if (soa_time_bin[i] == time_bin_not_created) {
+      error("Found an extra gpart in the gravity cache");
+    }
+#endif
+
+    /* The inhibited ones have a mass of 0 in the copy */
+    m[i] = soa_m[i];
+    active[i] = (int)(soa_time_bin[i] <= max_active_bin &&
+                      soa_time_bin[i] != time_bin_inhibited);
+
+    /* Distance to the CoM of the other cell. */
+    float dx = x[i] - CoM[0];
+    float dy = y[i] - CoM[1];
+    float dz = z[i] - CoM[2];
+
+    /* Apply periodic BC */
+    if (periodic) {
+      dx = nearestf(dx, dim[0]);
+      dy = nearestf(dy, dim[1]);
+      dz = nearestf(dz, dim[2]);
+    }
+    const float r2 = dx * dx + dy * dy + dz * dz;
+
+    /* Check whether we can use the multipole instead of P-P */
+    use_mpole[i] =
+        allow_mpole &&
+        gravity_M2P_accept_values(grav_props, soa_epsilon[i],
+                                  soa_old_a_grav[i], multipole, r2, periodic);
+  }
+
+  /* Particles used for padding should get impossible positions
+   * that have a reasonable magnitude. We use the cell width for this */
+  const float pos_padded[3] = {-2.f * (float)cell->width[0],
+                               -2.f * (float)cell->width[1],
+                               -2.f * (float)cell->width[2]};
+  const float eps_padded = epsilon[0];
+
+  /* Pad the caches */
+  for (int i = gcount; i < gcount_padded; ++i) {
+    x[i] = pos_padded[0];
+    y[i] = pos_padded[1];
+    z[i] = pos_padded[2];
+    epsilon[i] = eps_padded;
+    m[i] = 0.f;
+    active[i] = 0;
+    use_mpole[i] = 0;
+  }
+
+  /* Zero the output as well */
+  gravity_cache_zero_output(c, gcount_padded);
+}
+
+/**
+ * @brief Fills a #gravity_cache structure with the #gpart of a cell read from
+ * the #gpart_soa and shift them.
+ *
+ * Same as gravity_cache_populate_no_mpole() but streaming through the SoA
+ * copy rather than gathering from the #gpart.
+ *
+ * @param max_active_bin The largest active bin in the current time-step.
+ * @param c The #gravity_cache to fill.
+ * @param soa The #gpart_soa to read from.
+ * @param offset The index of the first #gpart of the cell in the #gpart_soa.
+ * @param gcount The number of particles to read.
+ * @param gcount_padded The number of particle to read padded to the next
+ * multiple of the vector length.
+ * @param shift A shift to apply to all the particles.
+ * @param cell The cell we play with (to get reasonable padding positions).
+ */
+INLINE static void gravity_cache_populate_no_mpole_soa(
+    const timebin_t max_active_bin, struct gravity_cache *c,
+    const struct gpart_soa *soa, const size_t offset, const int gcount,
+    const int gcount_padded, const double shift[3], const struct cell *cell) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (gcount_padded < gcount) error("Invalid padded cache size. Too small.");
+  if (gcount_padded % VEC_SIZE != 0)
+    error("Padded gravity cache size invalid. Not a multiple of SIMD length.");
+  if (offset + gcount > soa->size) error("Reading past the gpart SoA copy.");
+#endif
+
+  /* Do we need to grow the cache? */
+  gravity_cache_ensure(c, gcount_padded);
+
+  /* Make the compiler understand we are in happy vectorization land */
+  swift_declare_aligned_ptr(float, x, c->x, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, y, c->y, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, z, c->z, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, epsilon, c->epsilon, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, m, c->m, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(int, active, c->active, SWIFT_CACHE_ALIGNMENT);
+  swift_assume_size(gcount_padded, VEC_SIZE);
+
+  /* The cell's section of the SoA copy */
+  const double *restrict soa_x = soa->x + offset;
+  const double *restrict soa_y = soa->y + offset;
+  const double *restrict soa_z = soa->z + offset;
+  const float *restrict soa_m = soa->m + offset;
+  const float *restrict soa_epsilon = soa->epsilon + offset;
+  const timebin_t *restrict soa_time_bin = soa->time_bin + offset;
+
+  /* Fill the input caches */
+  for (int i = 0; i < gcount; ++i) {
+    x[i] = (float)(soa_x[i] - shift[0]);
+    y[i] = (float)(soa_y[i] - shift[1]);
+    z[i] = (float)(soa_z[i] - shift[2]);
+    epsilon[i] = soa_epsilon[i];
+
+#ifdef SWIFT_DEBUG_CHECKS
+    if (soa_time_bin[i] == time_bin_not_created) {
+      error("Found an extra gpart in the gravity cache");
+    }
+#endif
+
+    /* The inhibited ones have a mass of 0 in the copy */
+    m[i] = soa_m[i];
+    active[i] = (int)(soa_time_bin[i] <= max_active_bin &&
+                      soa_time_bin[i] != time_bin_inhibited);
+  }
+
+  /* Particles used for padding should get impossible positions
+   * that have a reasonable magnitude. We use the cell width for this */
+  const float pos_padded[3] = {-2.f * (float)cell->width[0],
+                               -2.f * (float)cell->width[1],
+                               -2.f * (float)cell->width[2]};
+  const float eps_padded = epsilon[0];
+
+  /* Pad the caches */
+  for (int i = gcount; i < gcount_padded; ++i) {
+    x[i] = pos_padded[0];
+    y[i] = pos_padded[1];
+    z[i] = pos_padded[2];
+    epsilon[i] = eps_padded;
+    m[i] = 0.f;
+    active[i] = 0;
+  }
+
+  /* Zero the output as well */
+  gravity_cache_zero_output(c, gcount_padded);
+}
+
 /**
  * @brief Fills a #gravity_cache structure with some #gpart and make them use
  * the multi-pole.
@@ -411,7 +790,7 @@ INLINE static void gravity_cache_populate_all_mpole(
 #endif
 
   /* Do we need to grow the cache? */
-  if (c->count < gcount_padded) gravity_cache_init(c, gcount_padded + VEC_SIZE);
+  gravity_cache_ensure(c, gcount_padded);
 
   /* Make the compiler understand we are in happy vectorization land */
   swift_declare_aligned_ptr(float, x, c->x, SWIFT_CACHE_ALIGNMENT);
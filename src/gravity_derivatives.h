@@ -201,7 +201,7 @@ potential_derivatives_flip_signs(struct potential_derivatives_M2L *pot) {
 
 /**
  * @brief Compute all the relevent derivatives of the softened and truncated
- * gravitational potential for the M2L kernel.
+ * gravitational potential for the M2L kernel, up to a given order.
  *
  * @param r_x x-component of distance vector
  * @param r_y y-component of distance vector
@@ -211,14 +211,15 @@ potential_derivatives_flip_signs(struct potential_derivatives_M2L *pot) {
  * @param eps Softening length.
  * @param periodic Is the calculation periodic ?
  * @param r_s_inv Inverse of the long-range gravity mesh smoothing length.
+ * @param order The order up to which the derivatives are needed.
  * @param pot (return) The structure containing all the derivatives.
  */
 __attribute__((always_inline, nonnull)) INLINE static void
-potential_derivatives_compute_M2L(const float r_x, const float r_y,
-                                  const float r_z, const float r2,
-                                  const float r_inv, const float eps,
-                                  const int periodic, const float r_s_inv,
-                                  struct potential_derivatives_M2L *pot) {
+potential_derivatives_compute_M2L_order(
+    const float r_x, const float r_y, const float r_z, const float r2,
+    const float r_inv, const float eps, const int periodic,
+    const float r_s_inv, const int order,
+    struct potential_derivatives_M2L *pot) {
 
   float Dt_1;
 #if SELF_GRAVITY_MULTIPOLE_ORDER > 0
@@ -397,6 +398,8 @@ potential_derivatives_compute_M2L(const float r_x, const float r_y,
   pot->D_001 = rz_r * Dt_2;
 #endif
 
+  if (order < 2) return;
+
 #if SELF_GRAVITY_MULTIPOLE_ORDER > 1
 
   Dt_2 *= r_inv;
@@ -409,6 +412,9 @@ potential_derivatives_compute_M2L(const float r_x, const float r_y,
   pot->D_101 = rx_r * rz_r * Dt_3;
   pot->D_011 = ry_r * rz_r * Dt_3;
 #endif
+
+  if (order < 3) return;
+
 #if SELF_GRAVITY_MULTIPOLE_ORDER > 2
 
   Dt_3 *= r_inv;
@@ -425,6 +431,9 @@ potential_derivatives_compute_M2L(const float r_x, const float r_y,
   pot->D_012 = rz_r2 * ry_r * Dt_4 + ry_r * Dt_3;
   pot->D_111 = rx_r * ry_r * rz_r * Dt_4;
 #endif
+
+  if (order < 4) return;
+
 #if SELF_GRAVITY_MULTIPOLE_ORDER > 3
 
   Dt_3 *= r_inv;
@@ -447,6 +456,9 @@ potential_derivatives_compute_M2L(const float r_x, const float r_y,
   pot->D_121 = ry_r2 * rx_r * rz_r * Dt_5 + rx_r * rz_r * Dt_4;
   pot->D_112 = rz_r2 * rx_r * ry_r * Dt_5 + rx_r * ry_r * Dt_4;
 #endif
+
+  if (order < 5) return;
+
 #if SELF_GRAVITY_MULTIPOLE_ORDER > 4
 
   Dt_4 *= r_inv;
@@ -495,6 +507,32 @@ potential_derivatives_compute_M2L(const float r_x, const float r_y,
 #endif
 }
 
+/**
+ * @brief Compute all the relevent derivatives of the softened and truncated
+ * gravitational potential for the M2L kernel.
+ *
+ * @param r_x x-component of distance vector
+ * @param r_y y-component of distance vector
+ * @param r_z z-component of distance vector
+ * @param r2 Square norm of distance vector
+ * @param r_inv Inverse norm of distance vector
+ * @param eps Softening length.
+ * @param periodic Is the calculation periodic ?
+ * @param r_s_inv Inverse of the long-range gravity mesh smoothing length.
+ * @param pot (return) The structure containing all the derivatives.
+ */
+__attribute__((always_inline, nonnull)) INLINE static void
+potential_derivatives_compute_M2L(const float r_x, const float r_y,
+                                  const float r_z, const float r2,
+                                  const float r_inv, const float eps,
+                                  const int periodic, const float r_s_inv,
+                                  struct potential_derivatives_M2L *pot) {
+
+  potential_derivatives_compute_M2L_order(r_x, r_y, r_z, r2, r_inv, eps,
+                                          periodic, r_s_inv,
+                                          SELF_GRAVITY_MULTIPOLE_ORDER, pot);
+}
+
 /**
  * @brief Compute all the relevent derivatives of the softened and truncated
  * gravitational potential for the M2P kernel.
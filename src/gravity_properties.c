@@ -33,6 +33,7 @@
 #include "gravity.h"
 #include "kernel_gravity.h"
 #include "kernel_long_gravity.h"
+#include "mesh_assignment.h"
 #include "restart.h"
 
 #define gravity_props_default_a_smooth 1.25f
@@ -71,8 +72,32 @@ void gravity_props_init(struct gravity_props *p, struct swift_params *params,
     p->distributed_mesh =
         parser_get_opt_param_int(params, "Gravity:distributed_mesh",
                                  gravity_props_default_distributed_mesh);
+    p->distributed_mesh_pencils = parser_get_opt_param_int(
+        params, "Gravity:distributed_mesh_pencils", 0);
     p->mesh_uses_local_patches =
         parser_get_opt_param_int(params, "Gravity:mesh_uses_local_patches", 1);
+    p->mesh_fftw_measure =
+        parser_get_opt_param_int(params, "Gravity:mesh_fftw_measure", 0);
+    p->mesh_overlap_tasks =
+        parser_get_opt_param_int(params, "Gravity:mesh_overlap_tasks", 0);
+    p->mesh_assignment_order =
+        parser_get_opt_param_int(params, "Gravity:mesh_assignment_order", 2);
+    p->mesh_interlacing =
+        parser_get_opt_param_int(params, "Gravity:mesh_interlacing", 0);
+    p->mesh_eta = parser_get_opt_param_float(params, "Gravity:mesh_eta", 0.f);
+
+    /* The FFTW wisdom, if any, lives next to the restart files */
+    p->mesh_fftw_wisdom_file[0] = '\0';
+    if (parser_get_opt_param_int(params, "Gravity:mesh_fftw_wisdom", 0)) {
+      char restart_dir[PARSER_MAX_LINE_SIZE];
+      parser_get_opt_param_string(params, "Restarts:subdir", restart_dir,
+                                  "restart");
+      if (strlen(restart_dir) + strlen("/mesh_fftw_wisdom") >=
+          PARSER_MAX_LINE_SIZE)
+        error("Restart directory name too long for the FFTW wisdom file.");
+      strcpy(p->mesh_fftw_wisdom_file, restart_dir);
+      strcat(p->mesh_fftw_wisdom_file, "/mesh_fftw_wisdom");
+    }
     p->a_smooth = parser_get_opt_param_float(params, "Gravity:a_smooth",
                                              gravity_props_default_a_smooth);
     p->r_cut_max_ratio = parser_get_opt_param_float(
@@ -83,13 +108,30 @@ void gravity_props_init(struct gravity_props *p, struct swift_params *params,
     p->r_s = p->a_smooth * dim[0] / p->mesh_size;
     p->r_s_inv = 1. / p->r_s;
 
+#ifdef GRAVITY_LONG_RANGE_TABLE
+    /* Tabulate the truncation of the P2P interactions */
+    kernel_long_grav_table_init();
+#endif
+
     /* Some basic checks of what we read */
     if (p->mesh_size % 2 != 0)
       error("The mesh side-length must be an even number.");
 
+    if (p->mesh_eta < 0.f) error("The mesh eta must be >= 0.");
+
     if (p->a_smooth <= 0.)
       error("The mesh smoothing scale 'a_smooth' must be > 0.");
 
+    if (p->mesh_assignment_order < 2 ||
+        p->mesh_assignment_order > mesh_assignment_max_order)
+      error("The mesh assignment order must be 2 (CIC), 3 (TSC) or 4 (PCS).");
+
+    if (p->distributed_mesh &&
+        (p->mesh_assignment_order != 2 || p->mesh_interlacing))
+      error(
+          "The distributed mesh only supports CIC assignment without "
+          "interlacing.");
+
 #if !defined(WITH_MPI) || !defined(HAVE_MPI_FFTW)
     if (p->distributed_mesh)
       error(
@@ -110,6 +152,13 @@ void gravity_props_init(struct gravity_props *p, struct swift_params *params,
   } else {
     p->mesh_size = 0;
     p->distributed_mesh = 0;
+    p->distributed_mesh_pencils = 0;
+    p->mesh_fftw_measure = 0;
+    p->mesh_overlap_tasks = 0;
+    p->mesh_assignment_order = 2;
+    p->mesh_interlacing = 0;
+    p->mesh_eta = 0.f;
+    p->mesh_fftw_wisdom_file[0] = '\0';
     p->a_smooth = 0.f;
     p->r_s = FLT_MAX;
     p->r_s_inv = 0.f;
@@ -151,6 +200,14 @@ void gravity_props_init(struct gravity_props *p, struct swift_params *params,
     p->adaptive_tolerance =
         parser_get_param_float(params, "Gravity:epsilon_fmm");
 
+  /* Tolerance for lowering the order of the M2L interactions */
+  p->adaptive_order_tolerance = 0.f;
+  if (p->use_adaptive_tolerance)
+    p->adaptive_order_tolerance =
+        parser_get_opt_param_float(params, "Gravity:epsilon_order", 0.f);
+  if (p->adaptive_order_tolerance < 0.f)
+    error("Gravity:epsilon_order must be >= 0.");
+
   /* Consider truncated forces in the MAC? */
   if (p->use_adaptive_tolerance)
     p->consider_truncation_in_MAC =
@@ -160,6 +217,26 @@ void gravity_props_init(struct gravity_props *p, struct swift_params *params,
   p->use_tree_below_softening =
       parser_get_opt_param_int(params, "Gravity:use_tree_below_softening", 0);
 
+  /* Are we treating the background particles via their multipoles only? */
+  p->background_mass_threshold = parser_get_opt_param_float(
+      params, "Gravity:background_mass_threshold", 0.f);
+  p->background_buffer_distance = parser_get_opt_param_float(
+      params, "Gravity:background_buffer_distance", 0.f);
+  if (p->background_buffer_distance < 0.f)
+    error("The background buffer distance must be positive.");
+
+  /* Are we re-using the tree walks between rebuilds? */
+  p->reuse_tree_walk =
+      parser_get_opt_param_int(params, "Gravity:reuse_tree_walk", 1);
+
+  /* Are we walking the tree once per active leaf? */
+  p->use_group_walk =
+      parser_get_opt_param_int(params, "Gravity:group_walk", 0);
+
+  /* Are we walking the pairs of cells one tree level at a time? */
+  p->use_breadth_first_walk =
+      parser_get_opt_param_int(params, "Gravity:breadth_first_walk", 0);
+
 #ifdef GADGET2_SOFTENING_CORRECTION
   if (p->use_tree_below_softening)
     error(
@@ -322,11 +399,20 @@ void gravity_props_print(const struct gravity_props *p) {
       message("Self-gravity opening angle:  epsilon_fmm=%.6f",
               p->adaptive_tolerance);
     }
+    if (p->adaptive_order_tolerance > 0.f)
+      message("Self-gravity adaptive M2L order:  epsilon_order=%.6f",
+              p->adaptive_order_tolerance);
   } else {
     message("Self-gravity opening angle scheme:  fixed");
     message("Self-gravity opening angle:  theta_cr=%.4f", p->theta_crit);
   }
 
+  if (p->background_mass_threshold > 0.f)
+    message(
+        "Self-gravity background particles (m >= %e) via multipoles only "
+        "beyond: %e",
+        p->background_mass_threshold, p->background_buffer_distance);
+
   message("Self-gravity softening functional form: %s",
           kernel_gravity_softening_name);
 
@@ -372,6 +458,20 @@ void gravity_props_print(const struct gravity_props *p) {
   message("Self-gravity mesh side-length: N=%d", p->mesh_size);
   message("Self-gravity mesh smoothing-scale: a_smooth=%f", p->a_smooth);
   message("Self-gravity distributed mesh enabled: %d", p->distributed_mesh);
+  if (p->distributed_mesh)
+    message("Self-gravity distributed mesh in pencils: %d",
+            p->distributed_mesh_pencils);
+  message("Self-gravity mesh FFTW plans measured: %d", p->mesh_fftw_measure);
+  message("Self-gravity mesh overlapping the tree tasks: %d",
+          p->mesh_overlap_tasks);
+  message("Self-gravity mesh assignment order: %d (interlacing: %d)",
+          p->mesh_assignment_order, p->mesh_interlacing);
+  if (p->mesh_eta > 0.f)
+    message("Self-gravity mesh time-step dynamical factor: eta=%f",
+            p->mesh_eta);
+  if (p->mesh_fftw_wisdom_file[0] != '\0')
+    message("Self-gravity mesh FFTW wisdom file: '%s'",
+            p->mesh_fftw_wisdom_file);
 
   message("Self-gravity tree cut-off ratio: r_cut_max=%f", p->r_cut_max_ratio);
   message("Self-gravity truncation cut-off ratio: r_cut_min=%f",
@@ -381,6 +481,12 @@ void gravity_props_print(const struct gravity_props *p) {
           kernel_long_gravity_truncation_name);
 
   message("Self-gravity tree update frequency: f=%f", p->rebuild_frequency);
+
+  message("Self-gravity tree-walk re-use: %d", p->reuse_tree_walk);
+
+  message("Self-gravity group walk: %d", p->use_group_walk);
+
+  message("Self-gravity breadth-first walk: %d", p->use_breadth_first_walk);
 }
 
 #if defined(HAVE_HDF5)
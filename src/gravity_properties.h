@@ -26,6 +26,9 @@
 #include <hdf5.h>
 #endif
 
+/* Local includes. */
+#include "parser.h"
+
 /* Forward declarations */
 struct cosmology;
 struct phys_const;
@@ -73,15 +76,35 @@ struct gravity_props {
   /*! Accuracy parameter of the advanced MAC */
   float adaptive_tolerance;
 
+  /*! Accuracy parameter for the choice of the order of each M2L interaction
+   * (0 to always use the full order) */
+  float adaptive_order_tolerance;
+
   /*! Tree opening angle (Multipole acceptance criterion) */
   double theta_crit;
 
   /*! Are we allowing tree gravity below softening? */
   int use_tree_below_softening;
 
+  /*! Mass above which a #gpart is a background particle (0 for none) */
+  float background_mass_threshold;
+
+  /*! Distance beyond which the multipoles of background particles are always
+   * used */
+  float background_buffer_distance;
+
   /*! Are we applying long-range truncation to the forces in the MAC? */
   int consider_truncation_in_MAC;
 
+  /*! Are we re-using the tree walks of the gravity tasks between steps? */
+  int reuse_tree_walk;
+
+  /*! Are the gravity tasks walking the tree once per active leaf? */
+  int use_group_walk;
+
+  /*! Are the pairs of cells walked one level of the trees at a time? */
+  int use_breadth_first_walk;
+
   /* ------------- Properties of the softened gravity ------------------ */
 
   /*! Co-moving softening length for for high-res. DM particles */
@@ -134,10 +157,34 @@ struct gravity_props {
   /*! Whether mesh is distributed between MPI ranks when we use MPI  */
   int distributed_mesh;
 
+  /*! Whether the distributed mesh uses pencils rather than FFTW-MPI slabs */
+  int distributed_mesh_pencils;
+
   /*! Whether or not to use local patches rather than
    * direct atomic writes to the mesh when running without MPI */
   int mesh_uses_local_patches;
 
+  /*! Are we measuring (rather than estimating) the FFTW plans of the mesh? */
+  int mesh_fftw_measure;
+
+  /*! Are we computing the mesh alongside the tree tasks when possible? */
+  int mesh_overlap_tasks;
+
+  /*! Order of the mass assignment scheme of the mesh (2: CIC, 3: TSC, 4: PCS)
+   */
+  int mesh_assignment_order;
+
+  /*! Are we interlacing a second mesh shifted by half a cell? */
+  int mesh_interlacing;
+
+  /*! Constant multiplier of the mesh-scale dynamical time limiting the mesh
+   * time-step (0 for none) */
+  float mesh_eta;
+
+  /*! File to load and save the FFTW wisdom of the mesh from (empty for none)
+   */
+  char mesh_fftw_wisdom_file[PARSER_MAX_LINE_SIZE];
+
   /*! Mesh smoothing scale in units of top-level cell size */
   float a_smooth;
 
@@ -20,125 +20,143 @@
 /*
  * Generic hashmap manipulation functions
  *
- * Originally by Elliot C Back -
- * http://elliottback.com/wp/hashmap-implementation-in-c/
- *
- * Modified by Pete Warden to fix a serious performance problem, support strings
- * as keys and removed thread synchronization - http://petewarden.typepad.com
+ * Open-addressing hash table probing the control bytes of a whole group of
+ * slots at once (see hashmap.h).
  */
+
+/* Config parameters. */
+#include <config.h>
+
 #include "hashmap.h"
 
 #include "error.h"
 #include "memuse.h"
 
 #include <float.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define INITIAL_NUM_CHUNKS (1)
+#if defined(HAVE_IMMINTRIN_H) && defined(__SSE2__)
+/* Include the header file with the intrinsics for Intel architecture. */
+#include <immintrin.h>
+#define HASHMAP_USE_SSE2
+#endif
+
 #define HASHMAP_GROWTH_FACTOR (2)
-#define HASHMAP_MAX_FILL_RATIO (1.0)
-#define HASHMAP_MAX_CHUNK_FILL_RATIO (0.5)
+
+/* Largest fraction of the slots in use (num / den) before re-hashing. */
+#define HASHMAP_MAX_FILL_NUM (7)
+#define HASHMAP_MAX_FILL_DEN (8)
+
+/* Number of keys ahead of the current one whose groups are pre-fetched by
+ * the bulk operations. */
+#define HASHMAP_PREFETCH_DISTANCE (8)
 
 /**
- * @brief Pre-allocate a number of chunks for the graveyard.
+ * @brief Hash a key, mixing all of its bits (MurmurHash3's finaliser).
+ *
+ * The lowest 7 bits go to the control bytes and the others pick the groups,
+ * such that the keys of one group rarely share their control byte.
  */
-void hashmap_allocate_chunks(hashmap_t *m, int num_chunks) {
-  /* Allocate a fresh set of chunks. */
-  hashmap_chunk_t *alloc;
-  if ((alloc = (hashmap_chunk_t *)swift_calloc(
-           "hashmap", num_chunks, sizeof(hashmap_chunk_t))) == NULL) {
-    error("Unable to allocate chunks.");
-  }
-
-  /* Hook up the alloc, so that we can clean it up later. */
-  if (m->allocs_count == m->allocs_size) {
-    m->allocs_size *= 2;
+static inline uint64_t hashmap_hash(const hashmap_key_t key) {
+  uint64_t h = (uint64_t)key;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
 
-    void **new_allocs =
-        (void **)swift_malloc("hashmap", sizeof(void *) * m->allocs_size);
-    if (new_allocs == NULL) error("Unable to allocate new chunks.");
+/**
+ * @brief Bitmask of the slots of a group with a given control byte.
+ *
+ * @param ctrl The (aligned) control bytes of the group.
+ * @param c The control byte to look for.
+ */
+static inline unsigned int hashmap_group_match(const hashmap_ctrl_t *ctrl,
+                                               const hashmap_ctrl_t c) {
+#ifdef HASHMAP_USE_SSE2
+  const __m128i group = _mm_load_si128((const __m128i *)ctrl);
+  return (unsigned int)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(group, _mm_set1_epi8(c)));
+#else
+  unsigned int mask = 0;
+  for (int k = 0; k < HASHMAP_GROUP_SIZE; k++)
+    mask |= (unsigned int)(ctrl[k] == c) << k;
+  return mask;
+#endif
+}
 
-    memcpy(new_allocs, m->allocs, sizeof(void *) * m->allocs_count);
-    swift_free("hashmap", m->allocs);
-    m->allocs = new_allocs;
-  }
-  m->allocs[m->allocs_count++] = alloc;
+/**
+ * @brief Bitmask of the empty slots of a group.
+ *
+ * @param ctrl The (aligned) control bytes of the group.
+ */
+static inline unsigned int hashmap_group_match_empty(
+    const hashmap_ctrl_t *ctrl) {
+#ifdef HASHMAP_USE_SSE2
+  /* Only the empty control byte has its sign bit set */
+  const __m128i group = _mm_load_si128((const __m128i *)ctrl);
+  return (unsigned int)_mm_movemask_epi8(group);
+#else
+  return hashmap_group_match(ctrl, HASHMAP_CTRL_EMPTY);
+#endif
+}
 
-  /* Link the chunks together. */
-  for (int k = 0; k < num_chunks - 1; k++) {
-    alloc[k].next = &alloc[k + 1];
-  }
+/**
+ * @brief Allocate the (empty) slots of a hashmap.
+ *
+ * @param m The hashmap.
+ * @param table_size The number of slots, a power of two.
+ */
+static void hashmap_allocate_table(hashmap_t *m, const size_t table_size) {
 
-  /* Last chunk points to current graveyard. */
-  alloc[num_chunks - 1].next = m->graveyard;
+  if (swift_memalign("hashmap", (void **)&m->ctrl, HASHMAP_GROUP_SIZE,
+                     table_size * sizeof(hashmap_ctrl_t)) != 0)
+    error("Unable to allocate hashmap control bytes.");
+  if ((m->data = (hashmap_element_t *)swift_malloc(
+           "hashmap", table_size * sizeof(hashmap_element_t))) == NULL)
+    error("Unable to allocate hashmap elements.");
 
-  /* Graveyard points to first new chunk. */
-  m->graveyard = alloc;
+  memset(m->ctrl, HASHMAP_CTRL_EMPTY, table_size * sizeof(hashmap_ctrl_t));
+  m->table_size = table_size;
+  m->size = 0;
 }
 
 void hashmap_init(hashmap_t *m) {
-  /* Allocate the first (empty) list of chunks. */
-  m->nr_chunks = INITIAL_NUM_CHUNKS;
-  if ((m->chunks = (hashmap_chunk_t **)swift_calloc(
-           "hashmap", m->nr_chunks, sizeof(hashmap_chunk_t *))) == NULL) {
-    error("Unable to allocate hashmap chunks.");
-  }
-
-  /* The graveyard is currently empty. */
-  m->graveyard = NULL;
-  m->allocs = NULL;
-
-  /* Init the array of allocations. */
-  m->allocs_size = HASHMAP_ALLOCS_INITIAL_SIZE;
-  if ((m->allocs = (void **)swift_malloc(
-           "hashmap", sizeof(void *) * m->allocs_size)) == NULL) {
-    error("Unable to allocate allocs pointer array.");
-  }
-  m->allocs_count = 0;
 
-  /* Set initial sizes. */
-  m->table_size = m->nr_chunks * HASHMAP_ELEMENTS_PER_CHUNK;
-  m->size = 0;
+  hashmap_allocate_table(m, HASHMAP_MIN_TABLE_SIZE);
 
   /* Inform the men. */
   if (HASHMAP_DEBUG_OUTPUT) {
     message(
         "Created hash table of size: %zu each element is %zu bytes. Allocated "
-        "%zu empty chunks.",
+        "%zu slots.",
         m->table_size * sizeof(hashmap_element_t), sizeof(hashmap_element_t),
-        m->nr_chunks);
+        m->table_size);
   }
 }
 
 /**
- * @brief Put a used chunk back into the recycling bin.
+ * @brief Index of the first group of the probe sequence of a hash.
  */
-void hashmap_release_chunk(hashmap_t *m, hashmap_chunk_t *chunk) {
-  /* Clear all the chunk's data. */
-  memset(chunk, 0, sizeof(hashmap_chunk_t));
-
-  /* Hook it up with the other stiffs in the graveyard. */
-  chunk->next = m->graveyard;
-  m->graveyard = chunk;
+static inline size_t hashmap_first_group(const hashmap_t *m,
+                                         const uint64_t hash) {
+  return (hash >> 7) & (m->table_size / HASHMAP_GROUP_SIZE - 1);
 }
 
 /**
- * @brief Return a new chunk, either recycled or freshly allocated.
+ * @brief Pre-fetch the first group of the probe sequence of a key.
  */
-hashmap_chunk_t *hashmap_get_chunk(hashmap_t *m) {
-  int num_chunks = m->nr_chunks * HASHMAP_ALLOC_SIZE_FRACTION;
-  if (!num_chunks) num_chunks = 1;
-  if (m->graveyard == NULL) {
-    hashmap_allocate_chunks(m, num_chunks);
-  }
-
-  hashmap_chunk_t *res = (hashmap_chunk_t *)m->graveyard;
-  m->graveyard = (hashmap_chunk_t *)res->next;
-  res->next = NULL;
-
-  return res;
+static inline void hashmap_prefetch(const hashmap_t *m,
+                                    const hashmap_key_t key) {
+  const size_t offset =
+      hashmap_first_group(m, hashmap_hash(key)) * HASHMAP_GROUP_SIZE;
+  __builtin_prefetch(&m->ctrl[offset]);
+  __builtin_prefetch(&m->data[offset]);
 }
 
 /**
@@ -148,18 +166,21 @@ hashmap_chunk_t *hashmap_get_chunk(hashmap_t *m) {
  * The returned element is either the one that already existed in the hashmap,
  * or a newly-reseverd element initialized to zero.
  *
- * If the hashmap is full, NULL is returned.
+ * If the hashmap is too full to take a new element, NULL is returned.
  *
- * We use `rand_r` as a hashing function. The key is first hashed to obtain an
- * initial global position. If there is a collision, the hashing function is
- * re-applied to the key to obtain a new offset *within the same bucket*. This
- * is repeated for at most HASHMAP_MAX_CHAIN_LENGTH steps, at which point
- * insertion fails.
+ * The groups of slots are probed in a triangular sequence starting from the
+ * one picked by the hash of the key, which visits all of them since their
+ * number is a power of two. Within a group, only the elements whose control
+ * byte matches the hash are compared to the key. As elements are never
+ * removed, the key is not in the table if the group has an empty slot, which
+ * is where it is inserted.
  */
-hashmap_element_t *hashmap_find(hashmap_t *m, hashmap_key_t key, int create_new,
-                                int *chain_length, int *created_new_element) {
+static hashmap_element_t *hashmap_find(hashmap_t *m, hashmap_key_t key,
+                                       int create_new, int *chain_length,
+                                       int *created_new_element) {
   /* If full, return immediately */
-  if (create_new && m->size > m->table_size * HASHMAP_MAX_FILL_RATIO) {
+  if (create_new && (m->size + 1) * HASHMAP_MAX_FILL_DEN >
+                        m->table_size * HASHMAP_MAX_FILL_NUM) {
     if (HASHMAP_DEBUG_OUTPUT) {
       message("hashmap is too full (%zu of %zu elements used), re-hashing.",
               m->size, m->table_size);
@@ -167,90 +188,52 @@ hashmap_element_t *hashmap_find(hashmap_t *m, hashmap_key_t key, int create_new,
     return NULL;
   }
 
-  /* We will use rand_r as our hash function. */
-  unsigned int curr = (unsigned int)key;
+  const uint64_t hash = hashmap_hash(key);
+  const hashmap_ctrl_t tag = (hashmap_ctrl_t)(hash & 0x7f);
+  const size_t group_mask = m->table_size / HASHMAP_GROUP_SIZE - 1;
+  size_t group = hashmap_first_group(m, hash);
 
-  /* Get offsets to the entry, its chunk, it's mask, etc. */
-  const size_t offset = rand_r(&curr) % m->table_size;
-  const size_t chunk_offset = offset / HASHMAP_ELEMENTS_PER_CHUNK;
-  size_t offset_in_chunk = offset - chunk_offset * HASHMAP_ELEMENTS_PER_CHUNK;
+  for (size_t i = 0;; i++) {
+    /* Record the chain_length, if not NULL. */
+    if (chain_length) *chain_length = (int)i;
 
-  /* Allocate the chunk if needed. */
-  if (m->chunks[chunk_offset] == NULL) {
-    /* Quit here if we don't want to create a new entry. */
-    if (!create_new) return NULL;
+    hashmap_ctrl_t *ctrl = &m->ctrl[group * HASHMAP_GROUP_SIZE];
+    hashmap_element_t *data = &m->data[group * HASHMAP_GROUP_SIZE];
 
-    /* Get a new chunk for this offset. */
-    m->chunks[chunk_offset] = hashmap_get_chunk(m);
-  }
-  hashmap_chunk_t *chunk = m->chunks[chunk_offset];
-
-  /* Count the number of free elements in this chunk and bail if it is too low.
-   */
-  int chunk_count = 0;
-  for (int k = 0; k < HASHMAP_MASKS_PER_CHUNK; k++) {
-    chunk_count += __builtin_popcountll(chunk->masks[k]);
-  }
-  if (create_new &&
-      chunk_count > HASHMAP_ELEMENTS_PER_CHUNK * HASHMAP_MAX_CHUNK_FILL_RATIO) {
-    if (HASHMAP_DEBUG_OUTPUT) {
-      message(
-          "chunk %zu is too full (%i of %i elements used, fill ratio is "
-          "%.2f%%), re-hashing.",
-          chunk_offset, chunk_count, HASHMAP_ELEMENTS_PER_CHUNK,
-          (100.0 * m->size) / m->table_size);
+    /* Is the key in one of the slots with the right tag? */
+    for (unsigned int match = hashmap_group_match(ctrl, tag); match != 0;
+         match &= match - 1) {
+      const int k = __builtin_ctz(match);
+      if (data[k].key == key) return &data[k];
     }
-    return NULL;
-  }
-
-  /* Linear probing (well, not really, but whatever). */
-  for (int i = 0; i < HASHMAP_MAX_CHAIN_LENGTH; i++) {
-    /* Record the chain_length, if not NULL. */
-    if (chain_length) *chain_length = i;
-
-    /* Compute the offsets within the masks of this chunk. */
-    const int mask_offset = offset_in_chunk / HASHMAP_BITS_PER_MASK;
-    const int offset_in_mask =
-        offset_in_chunk - mask_offset * HASHMAP_BITS_PER_MASK;
 
-    /* Is the offset empty? */
-    hashmap_mask_t search_mask = ((hashmap_mask_t)1) << offset_in_mask;
-    if (!(chunk->masks[mask_offset] & search_mask)) {
+    /* An empty slot ends the probe sequence. */
+    const unsigned int empty = hashmap_group_match_empty(ctrl);
+    if (empty != 0) {
       /* Quit here if we don't want to create a new element. */
       if (!create_new) return NULL;
 
       /* Mark this element as taken and increase the size counter. */
-      chunk->masks[mask_offset] |= search_mask;
+      const int k = __builtin_ctz(empty);
+      ctrl[k] = tag;
       m->size += 1;
       if (created_new_element) *created_new_element = 1;
 
       /* Set the key. */
-      chunk->data[offset_in_chunk].key = key;
-      chunk->data[offset_in_chunk].value.value_array2_dbl[0] = -FLT_MAX;
-      chunk->data[offset_in_chunk].value.value_array2_dbl[1] = -FLT_MAX;
-      chunk->data[offset_in_chunk].value.value_array2_dbl[2] = -FLT_MAX;
+      hashmap_element_t *element = &data[k];
+      element->key = key;
+      memset(&element->value, 0, sizeof(hashmap_value_t));
+      element->value.value_array2_dbl[0] = -FLT_MAX;
+      element->value.value_array2_dbl[1] = -FLT_MAX;
+      element->value.value_array2_dbl[2] = -FLT_MAX;
 
       /* Return a pointer to the new element. */
-      return &chunk->data[offset_in_chunk];
-    }
-
-    /* Does the offset by chance contain the key we are looking for? */
-    else if (chunk->data[offset_in_chunk].key == key) {
-      return &chunk->data[offset_in_chunk];
-    }
-
-    /* None of the above, so this is a collision. Re-hash, but within the same
-       chunk. I guess this is Hopscotch Hashing? */
-    else {
-      offset_in_chunk = rand_r(&curr) % HASHMAP_ELEMENTS_PER_CHUNK;
+      return element;
     }
-  }
 
-  /* We lucked out, so return nothing. */
-  if (HASHMAP_DEBUG_OUTPUT) {
-    message("maximum chain length exceeded, re-hashing.");
+    /* Collision, move on to the next group. */
+    group = (group + i + 1) & group_mask;
   }
-  return NULL;
 }
 
 /**
@@ -259,98 +242,55 @@ hashmap_element_t *hashmap_find(hashmap_t *m, hashmap_key_t key, int create_new,
 void hashmap_grow(hashmap_t *m, size_t new_size) {
   /* Hold on to the old data. */
   const size_t old_table_size = m->table_size;
-  hashmap_chunk_t **old_chunks = m->chunks;
+#ifdef SWIFT_DEBUG_CHECKS
+  const size_t old_size = m->size;
+#endif
+  hashmap_ctrl_t *old_ctrl = m->ctrl;
+  hashmap_element_t *old_data = m->data;
 
-  /* Re-allocate the chunk array. */
-  if (new_size == 0) new_size = m->table_size * HASHMAP_GROWTH_FACTOR;
-  m->nr_chunks =
-      (new_size + HASHMAP_ELEMENTS_PER_CHUNK - 1) / HASHMAP_ELEMENTS_PER_CHUNK;
-  m->table_size = m->nr_chunks * HASHMAP_ELEMENTS_PER_CHUNK;
+  /* Number of slots to hold the elements without re-hashing. */
+  size_t min_table_size;
+  if (new_size == 0)
+    min_table_size = old_table_size * HASHMAP_GROWTH_FACTOR;
+  else
+    min_table_size =
+        (new_size * HASHMAP_MAX_FILL_DEN) / HASHMAP_MAX_FILL_NUM + 1;
+  if (min_table_size < old_table_size) min_table_size = old_table_size;
+  size_t table_size = HASHMAP_MIN_TABLE_SIZE;
+  while (table_size < min_table_size) table_size *= 2;
+  if (table_size == old_table_size) return;
 
   if (HASHMAP_DEBUG_OUTPUT) {
     message("Increasing hash table size from %zu (%zu kb) to %zu (%zu kb).",
             old_table_size, old_table_size * sizeof(hashmap_element_t) / 1024,
-            m->table_size, m->table_size * sizeof(hashmap_element_t) / 1024);
+            table_size, table_size * sizeof(hashmap_element_t) / 1024);
   }
 
-  if ((m->chunks = (hashmap_chunk_t **)swift_calloc(
-           "hashmap", m->nr_chunks, sizeof(hashmap_chunk_t *))) == NULL) {
-    error("Unable to allocate hashmap chunks.");
-  }
-
-  /* Reset size. */
-  m->size = 0;
-
-  /* Buffer of stray elements, in case we get overflows while re-hashing. */
-  hashmap_element_t *strays = NULL;
-  size_t strays_count = 0;
-  size_t strays_size = 0;
-
-  /* Iterate over the chunks and add their entries to the new table. */
-  for (size_t cid = 0; cid < old_table_size / HASHMAP_ELEMENTS_PER_CHUNK;
-       cid++) {
-    /* Skip empty chunks. */
-    hashmap_chunk_t *chunk = old_chunks[cid];
-    if (!chunk) continue;
-
-    /* Loop over the masks in this chunk. */
-    for (int mid = 0; mid < HASHMAP_MASKS_PER_CHUNK; mid++) {
-      /* Skip empty masks. */
-      if (chunk->masks[mid] == 0) continue;
-
-      /* Loop over the mask entries. */
-      for (int eid = 0; eid < HASHMAP_BITS_PER_MASK; eid++) {
-        hashmap_mask_t element_mask = ((hashmap_mask_t)1) << eid;
-        if (chunk->masks[mid] & element_mask) {
-          hashmap_element_t *element =
-              &chunk->data[mid * HASHMAP_BITS_PER_MASK + eid];
-
-          /* Copy the element over to the new hashmap. */
-          hashmap_element_t *new_element =
-              hashmap_find(m, element->key, /*create_new=*/1,
-                           /*chain_length=*/NULL, /*created_new_element=*/NULL);
-
-          if (new_element) {
-            new_element->value = element->value;
-          }
-          /* If copying failed, then we have an overflow in the new hashmap.
-             If this happens, store the offending element in the strays buffer
-             for now. */
-          else {
-            /* (Re)allocate strays buffer? */
-            if (strays_count == strays_size) {
-              hashmap_element_t *temp_buff;
-              strays_size = strays_size ? strays_size * 2 : 10;
-              if ((temp_buff = (hashmap_element_t *)swift_malloc(
-                       "hashmap_strays",
-                       sizeof(hashmap_element_t) * strays_size)) == NULL)
-                error("Failed to (re)allocate strays buffer.");
-              memcpy(temp_buff, strays,
-                     sizeof(hashmap_element_t) * strays_count);
-              swift_free("hashmap_strays", strays);
-              strays = temp_buff;
-            }
-            strays[strays_count++] = *element;
-          }
-        }
-      }
+  hashmap_allocate_table(m, table_size);
+
+  /* Iterate over the groups and add their entries to the new table. */
+  for (size_t offset = 0; offset < old_table_size;
+       offset += HASHMAP_GROUP_SIZE) {
+    unsigned int full = ~hashmap_group_match_empty(&old_ctrl[offset]) &
+                        ((1u << HASHMAP_GROUP_SIZE) - 1);
+    for (; full != 0; full &= full - 1) {
+      const hashmap_element_t *element =
+          &old_data[offset + __builtin_ctz(full)];
+
+      /* Copy the element over to the new hashmap. */
+      hashmap_element_t *new_element =
+          hashmap_find(m, element->key, /*create_new=*/1,
+                       /*chain_length=*/NULL, /*created_new_element=*/NULL);
+      new_element->value = element->value;
     }
-
-    /* We're through with this chunk, recycle it. */
-    hashmap_release_chunk(m, chunk);
   }
 
-  /* Free the old list of chunks. */
-  swift_free("hashmap", old_chunks);
+#ifdef SWIFT_DEBUG_CHECKS
+  if (m->size != old_size) error("Lost elements while re-hashing.");
+#endif
 
-  /* If we have any strays, add them back to the hashmap. This will inevitably
-     trigger a rehashing, but that's not our problem. */
-  if (strays_count) {
-    for (size_t k = 0; k < strays_count; k++) {
-      hashmap_put(m, strays[k].key, strays[k].value);
-    }
-    swift_free("hashmap_strays", strays);
-  }
+  swift_free("hashmap", old_ctrl);
+  swift_free("hashmap", old_data);
 }
 
 void hashmap_put(hashmap_t *m, hashmap_key_t key, hashmap_value_t value) {
@@ -403,50 +343,55 @@ hashmap_value_t *hashmap_lookup(hashmap_t *m, hashmap_key_t key) {
   return element ? &element->value : NULL;
 }
 
+void hashmap_put_many(hashmap_t *m, const hashmap_key_t *keys,
+                      const hashmap_value_t *values, size_t count) {
+
+  /* Make room for all of them at once. */
+  if ((m->size + count) * HASHMAP_MAX_FILL_DEN >
+      m->table_size * HASHMAP_MAX_FILL_NUM)
+    hashmap_grow(m, m->size + count);
+
+  for (size_t k = 0; k < count; k++) {
+    if (k + HASHMAP_PREFETCH_DISTANCE < count)
+      hashmap_prefetch(m, keys[k + HASHMAP_PREFETCH_DISTANCE]);
+    hashmap_put(m, keys[k], values[k]);
+  }
+}
+
+void hashmap_lookup_many(hashmap_t *m, const hashmap_key_t *keys,
+                         size_t count, hashmap_value_t **values) {
+
+  for (size_t k = 0; k < count; k++) {
+    if (k + HASHMAP_PREFETCH_DISTANCE < count)
+      hashmap_prefetch(m, keys[k + HASHMAP_PREFETCH_DISTANCE]);
+    values[k] = hashmap_lookup(m, keys[k]);
+  }
+}
+
 void hashmap_iterate(hashmap_t *m, hashmap_mapper_t f, void *data) {
-  /* Loop over the chunks. */
-  for (size_t cid = 0; cid < m->nr_chunks; cid++) {
-    hashmap_chunk_t *chunk = m->chunks[cid];
-    if (!chunk) continue;
-
-    /* Loop over the masks. */
-    for (int mid = 0; mid < HASHMAP_MASKS_PER_CHUNK; mid++) {
-      hashmap_mask_t mask = chunk->masks[mid];
-      if (!mask) continue;
-
-      /* Loop over each element in the mask. */
-      for (int eid = 0;
-           eid < HASHMAP_BITS_PER_MASK &&
-           mid * HASHMAP_BITS_PER_MASK + eid < HASHMAP_ELEMENTS_PER_CHUNK;
-           eid++) {
-        /* If the element exists, call the function on it. */
-        if (mask & (((hashmap_mask_t)1) << eid)) {
-          hashmap_element_t *element =
-              &chunk->data[mid * HASHMAP_BITS_PER_MASK + eid];
-          f(element->key, &element->value, data);
-        }
-      }
+  /* Loop over the groups. */
+  for (size_t offset = 0; offset < m->table_size;
+       offset += HASHMAP_GROUP_SIZE) {
+
+    /* Loop over the elements in use in this group. */
+    unsigned int full = ~hashmap_group_match_empty(&m->ctrl[offset]) &
+                        ((1u << HASHMAP_GROUP_SIZE) - 1);
+    for (; full != 0; full &= full - 1) {
+      hashmap_element_t *element = &m->data[offset + __builtin_ctz(full)];
+      f(element->key, &element->value, data);
     }
   }
 }
 
 void hashmap_free(hashmap_t *m) {
-  /* Free the list of active chunks. Note that the actual chunks will be freed
-     as part of the allocs below. */
-  swift_free("hashmap", m->chunks);
+  swift_free("hashmap", m->ctrl);
+  swift_free("hashmap", m->data);
 
   /* Re-set some pointers and values, just in case. */
-  m->chunks = NULL;
-  m->graveyard = NULL;
+  m->ctrl = NULL;
+  m->data = NULL;
   m->size = 0;
   m->table_size = 0;
-  m->nr_chunks = 0;
-
-  /* Free the chunk allocs. */
-  for (size_t k = 0; k < m->allocs_count; k++) {
-    swift_free("hashmap", m->allocs[k]);
-  }
-  swift_free("hashmap", m->allocs);
 }
 
 size_t hashmap_size(hashmap_t *m) {
@@ -463,36 +408,20 @@ void hashmap_count_chain_lengths(hashmap_key_t key, hashmap_value_t *value,
   int count = 0;
   hashmap_find(m, key, /*create_entry=*/0, &count,
                /*created_new_element=*/NULL);
+  if (count >= HASHMAP_MAX_CHAIN_LENGTH) count = HASHMAP_MAX_CHAIN_LENGTH - 1;
   m->chain_length_counts[count] += 1;
 }
 #endif
 
 void hashmap_print_stats(hashmap_t *m) {
   /* Basic stats. */
-  message("size: %zu, table_size: %zu, nr_chunks: %zu.", m->size, m->table_size,
-          m->nr_chunks);
-
-  /* Count the number of populated chunks, graveyard chunks, and allocs. */
-  int chunk_counter = 0;
-  for (size_t k = 0; k < m->nr_chunks; k++) {
-    if (m->chunks[k]) chunk_counter += 1;
-  }
-  int graveyard_counter = 0;
-  for (hashmap_chunk_t *finger = m->graveyard; finger != NULL;
-       finger = (hashmap_chunk_t *)finger->next) {
-    graveyard_counter += 1;
-  }
-  message(
-      "populated chunks: %i (%zu kb), graveyard chunks: %i (%zu kb), allocs: "
-      "%zu",
-      chunk_counter, sizeof(hashmap_chunk_t) * chunk_counter / 1024,
-      graveyard_counter, sizeof(hashmap_chunk_t) * graveyard_counter / 1024,
-      m->allocs_count);
-
-  /* Print fill ratios. */
-  message("element-wise fill ratio: %.2f%%, chunk-wise fill ratio: %.2f%%",
-          (100.0 * m->size) / m->table_size,
-          (100.0 * chunk_counter) / m->nr_chunks);
+  const size_t nr_groups = m->table_size / HASHMAP_GROUP_SIZE;
+  message("size: %zu, table_size: %zu, nr_groups: %zu.", m->size,
+          m->table_size, nr_groups);
+  message("memory: %zu kb, element-wise fill ratio: %.2f%%",
+          m->table_size * (sizeof(hashmap_element_t) + sizeof(hashmap_ctrl_t)) /
+              1024,
+          (100.0 * m->size) / m->table_size);
 
 #if HASHMAP_DEBUG_OUTPUT
   /* Compute the chain lengths. */
@@ -508,38 +437,24 @@ void hashmap_print_stats(hashmap_t *m) {
   }
 #endif
 
-  /* Compute chunk fill ratios. */
-  size_t chunk_fill_ratio_counts[11];
-  for (int k = 0; k < 11; k++) {
-    chunk_fill_ratio_counts[k] = 0;
+  /* Compute group fill ratios. */
+  size_t group_fill_counts[HASHMAP_GROUP_SIZE + 1];
+  for (int k = 0; k <= HASHMAP_GROUP_SIZE; k++) {
+    group_fill_counts[k] = 0;
   }
-  for (size_t k = 0; k < m->nr_chunks; k++) {
-    hashmap_chunk_t *chunk = m->chunks[k];
-    if (!chunk) {
-      chunk_fill_ratio_counts[0] += 1;
-    } else {
-      int count = 0;
-      for (int j = 0; j < HASHMAP_MASKS_PER_CHUNK; j++) {
-        count += __builtin_popcountll(chunk->masks[j]);
-      }
-      chunk_fill_ratio_counts[(int)(10 * count / HASHMAP_MAX_CHUNK_FILL_RATIO /
-                                    HASHMAP_ELEMENTS_PER_CHUNK)] += 1;
-    }
+  for (size_t offset = 0; offset < m->table_size;
+       offset += HASHMAP_GROUP_SIZE) {
+    const unsigned int empty = hashmap_group_match_empty(&m->ctrl[offset]);
+    group_fill_counts[HASHMAP_GROUP_SIZE - __builtin_popcount(empty)] += 1;
   }
-  message("chunk fill ratios:");
-  for (int k = 0; k < 11; k++) {
-    message("  %3i%% - %3i%%: %zu (%.2f%%)",
-            (int)(k * 10 * HASHMAP_MAX_CHUNK_FILL_RATIO),
-            (int)((k + 1) * 10 * HASHMAP_MAX_CHUNK_FILL_RATIO),
-            chunk_fill_ratio_counts[k],
-            (100.0 * chunk_fill_ratio_counts[k]) / m->nr_chunks);
+  message("group fill counts:");
+  for (int k = 0; k <= HASHMAP_GROUP_SIZE; k++) {
+    message("  %2i of %i slots: %zu (%.2f%%)", k, HASHMAP_GROUP_SIZE,
+            group_fill_counts[k], (100.0 * group_fill_counts[k]) / nr_groups);
   }
 
   /* Print struct sizes. */
   message("sizeof(hashmap_element_t): %zu", sizeof(hashmap_element_t));
-  message("sizeof(hashmap_chunk_t): %zu", sizeof(hashmap_chunk_t));
-  message("HASHMAP_TARGET_CHUNK_BYTES: %i", HASHMAP_TARGET_CHUNK_BYTES);
-  message("HASHMAP_BITS_PER_ELEMENT: %i", HASHMAP_BITS_PER_ELEMENT);
-  message("HASHMAP_ELEMENTS_PER_CHUNK: %i", HASHMAP_ELEMENTS_PER_CHUNK);
-  message("HASHMAP_MASKS_PER_CHUNK: %i", HASHMAP_MASKS_PER_CHUNK);
+  message("HASHMAP_GROUP_SIZE: %i", HASHMAP_GROUP_SIZE);
+  message("HASHMAP_MIN_TABLE_SIZE: %i", HASHMAP_MIN_TABLE_SIZE);
 }
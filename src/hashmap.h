@@ -20,11 +20,14 @@
 /*
  * Generic hashmap manipulation functions
  *
- * Originally by Elliot C Back -
- * http://elliottback.com/wp/hashmap-implementation-in-c/
- *
- * Modified by Pete Warden to fix a serious performance problem, support strings
- * as keys and removed thread synchronization - http://petewarden.typepad.com
+ * Open-addressing hash table in the spirit of Google's "Swiss tables": the
+ * slots are split in groups of HASHMAP_GROUP_SIZE, each with one control byte
+ * per slot holding either HASHMAP_CTRL_EMPTY or 7 bits of the hash of the
+ * key in it. A lookup compares the control bytes of a whole group to the
+ * hash of the key at once (with SSE2 when available) and only touches the
+ * elements whose control byte matches, before moving on to the next group
+ * of its (triangular) probe sequence. Elements are never removed, so the
+ * first group with an empty slot ends the search.
  */
 #ifndef SWIFT_HASHMAP_H
 #define SWIFT_HASHMAP_H
@@ -32,16 +35,13 @@
 /* Some standard headers. */
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /* Local headers. */
 #include "align.h"
 
-// Type used for chunk bitmasks.
-typedef size_t hashmap_mask_t;
-
-#define HASHMAP_BITS_PER_MASK ((int)sizeof(hashmap_mask_t) * 8)
-
-// Type used for the hashmap keys (must have a valid '==' operation).
+// Type used for the hashmap keys (must have a valid '==' operation and be
+// convertible to an integer).
 #ifndef hashmap_key_t
 #define hashmap_key_t size_t
 #endif
@@ -65,46 +65,32 @@ typedef struct _hashmap_element {
   hashmap_value_t value;
 } hashmap_element_t;
 
-/* Make sure a chunk fits in a given size. */
-#define HASHMAP_TARGET_CHUNK_BYTES (80 * 1024)
-#define HASHMAP_BITS_PER_ELEMENT ((int)sizeof(hashmap_element_t) * 8 + 1)
-#define HASHMAP_ELEMENTS_PER_CHUNK \
-  ((HASHMAP_TARGET_CHUNK_BYTES * 8) / HASHMAP_BITS_PER_ELEMENT)
-#define HASHMAP_MASKS_PER_CHUNK                               \
-  ((HASHMAP_ELEMENTS_PER_CHUNK + HASHMAP_BITS_PER_MASK - 1) / \
-   HASHMAP_BITS_PER_MASK)
+// Type used for the control bytes of the slots.
+typedef int8_t hashmap_ctrl_t;
+
+/* Number of slots whose control bytes are probed at once. */
+#define HASHMAP_GROUP_SIZE 16
 
-#define HASHMAP_ALLOCS_INITIAL_SIZE (80 * 1024)
-#define HASHMAP_ALLOC_SIZE_FRACTION (0.1)
+/* Control byte of an empty slot (the full ones are in [0, 127]). */
+#define HASHMAP_CTRL_EMPTY ((hashmap_ctrl_t)-128)
 
-#define HASHMAP_MAX_CHAIN_LENGTH (HASHMAP_ELEMENTS_PER_CHUNK / 8)
+/* Smallest number of slots of a table. */
+#define HASHMAP_MIN_TABLE_SIZE (1024)
+
+/* Largest number of groups probed for a key that we keep statistics of. */
+#define HASHMAP_MAX_CHAIN_LENGTH (64)
 #ifndef HASHMAP_DEBUG_OUTPUT
 #define HASHMAP_DEBUG_OUTPUT (0)
 #endif  // HASHMAP_DEBUG_OUTPUT
 
-/* A chunk of hashmap_element, with the corresponding bitmask. */
-typedef struct _hashmap_chunk {
-  union {
-    hashmap_mask_t masks[HASHMAP_MASKS_PER_CHUNK];
-    void *next;
-  };
-  hashmap_element_t data[HASHMAP_ELEMENTS_PER_CHUNK];
-} SWIFT_STRUCT_ALIGN hashmap_chunk_t;
-
 /* A hashmap has some maximum size and current size,
  * as well as the data to hold. */
 typedef struct _hashmap {
-  size_t table_size;
-  size_t size;
-  size_t nr_chunks;
-  hashmap_chunk_t *
-      *chunks;  // Pointer to chunks in use, but not densely populated.
-  hashmap_chunk_t
-      *graveyard;  // Pointer to allocated, but currently unused chunks.
-
-  void **allocs;        // Pointers to allocated blocks of chunks.
-  size_t allocs_size;   // Size of the allocs array.
-  size_t allocs_count;  // Number of elements in the allocs array.
+  size_t table_size;  // Number of slots, a power of two.
+  size_t size;        // Number of slots in use.
+
+  hashmap_ctrl_t *ctrl;     // Control byte of each slot.
+  hashmap_element_t *data;  // Element of each slot.
 
 #if HASHMAP_DEBUG_OUTPUT
   /* Chain lengths, used for debugging only. */
@@ -126,13 +112,12 @@ void hashmap_init(hashmap_t *m);
 /**
  * @brief Re-size the hashmap.
  *
- * Note that the hashmap size does not necessarily correspond to its
- * capacity, since it will grow if too many collisions occur. As a rule
- * of thumb, allocate twice as many elements as you think you will need.
+ * The table grows by itself once it is 7/8 full, so growing it beforehand
+ * only saves the re-hashing when the number of elements is known.
  *
  * @param m The hasmmap to grow.
- * @param new_size New table size. If zero, the current size will be increase
- *                 by a fixed rate.
+ * @param new_size New number of elements to make room for. If zero, the
+ *                 current size will be increase by a fixed rate.
  */
 void hashmap_grow(hashmap_t *m, size_t new_size);
 
@@ -170,6 +155,27 @@ extern hashmap_value_t *hashmap_get_new(hashmap_t *m, hashmap_key_t key,
  */
 extern hashmap_value_t *hashmap_lookup(hashmap_t *m, hashmap_key_t key);
 
+/**
+ * @brief Add many key/value pairs to the hashmap, overwriting whatever was
+ * previously there.
+ *
+ * The table is grown once for all of them and the groups of the next keys
+ * are pre-fetched while the current ones are inserted.
+ */
+extern void hashmap_put_many(hashmap_t *m, const hashmap_key_t *keys,
+                             const hashmap_value_t *values, size_t count);
+
+/**
+ * @brief Look for many keys and store pointers to their values, or NULL for
+ * the ones not in the hashmap, in `values`.
+ *
+ * The groups of the next keys are pre-fetched while the current ones are
+ * looked for. Note that the returned pointers are volatile and will be
+ * invalidated if the hashmap is re-hashed!
+ */
+extern void hashmap_lookup_many(hashmap_t *m, const hashmap_key_t *keys,
+                                size_t count, hashmap_value_t **values);
+
 /**
  * @brief Iterate the function parameter over each element in the hashmap.
  *
@@ -89,6 +89,26 @@ __attribute__((always_inline)) INLINE static void hydro_compute_flux(
   fluxes[4] *= Anorm;
 }
 
+/**
+ * @brief Compute the fluxes for all the Riemann problems of a #riemann_batch,
+ * see hydro_compute_flux().
+ *
+ * @param b The #riemann_batch, in which the fluxes are stored.
+ * @param Anorm Surface areas of the interfaces.
+ */
+__attribute__((always_inline)) INLINE static void hydro_compute_flux_batch(
+    struct riemann_batch* restrict b, const float* restrict Anorm) {
+
+  riemann_batch_solve_for_flux(b);
+
+  for (int k = 0; k < 5; k++) {
+#if !defined(SWIFT_DEBUG_CHECKS) && _OPENMP >= 201307
+#pragma omp simd
+#endif
+    for (int i = 0; i < b->count; i++) b->flux[k][i] *= Anorm[i];
+  }
+}
+
 /**
  * @brief Update the fluxes for the particle with the given contributions,
  * assuming the particle is to the left of the interparticle interface.
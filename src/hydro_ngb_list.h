@@ -0,0 +1,127 @@
+#ifndef SWIFT_HYDRO_NGB_LIST_H
+#define SWIFT_HYDRO_NGB_LIST_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* Local headers. */
+#include "error.h"
+#include "inline.h"
+#include "memuse.h"
+
+/* Forward declarations */
+struct part;
+
+/*! Head-room given to the #hydro_ngb_list arrays when they grow */
+#define hydro_ngb_list_growth 1.25
+
+/**
+ * @brief A neighbour candidate of a #part in the ghost iterations.
+ */
+struct hydro_ngb {
+
+  /*! The neighbour. */
+  struct part *pj;
+
+  /*! Separation from the #part, periodic wrapping included. */
+  float dx[3];
+};
+
+/**
+ * @brief The neighbour candidates of the #part of a cell whose smoothing
+ * length has not converged yet.
+ *
+ * The lists of all these #part are stored one after the other in one array
+ * owned by the #runner. Slot i of the other arrays is the list of the i-th
+ * #part of the ghost's redo list. Nothing is ever shrunk, such that the
+ * allocator is only hit when a cell needs more room than any before it.
+ */
+struct hydro_ngb_list {
+
+  /*! The candidates of all the lists. */
+  struct hydro_ngb *ngbs;
+
+  /*! Start and length of every list in ngbs. */
+  int *offset, *length;
+
+  /*! Smoothing length up to which every list is complete. 0 if it has not
+   * been built. */
+  float *h;
+
+  /*! Number of candidates in use and allocated. */
+  int count, size;
+
+  /*! Number of lists allocated. */
+  int slots;
+};
+
+/**
+ * @brief Prepares a #hydro_ngb_list for the #part of a new cell.
+ *
+ * All the lists are emptied and flagged as not built.
+ *
+ * @param l The #hydro_ngb_list.
+ * @param slots The number of lists needed.
+ */
+static INLINE void hydro_ngb_list_reset(struct hydro_ngb_list *l,
+                                        const int slots) {
+
+  if (slots > l->slots) {
+    const int new_slots = hydro_ngb_list_growth * slots;
+    l->offset = (int *)swift_realloc("hydro_ngb_list", l->offset,
+                                     new_slots * sizeof(int));
+    l->length = (int *)swift_realloc("hydro_ngb_list", l->length,
+                                     new_slots * sizeof(int));
+    l->h = (float *)swift_realloc("hydro_ngb_list", l->h,
+                                  new_slots * sizeof(float));
+    if (l->offset == NULL || l->length == NULL || l->h == NULL)
+      error("Failed to allocate %d neighbour lists.", new_slots);
+    l->slots = new_slots;
+  }
+
+  for (int i = 0; i < slots; i++) l->h[i] = 0.f;
+  l->count = 0;
+}
+
+/**
+ * @brief Makes sure a #hydro_ngb_list can take some more candidates.
+ *
+ * @param l The #hydro_ngb_list.
+ * @param extra The number of candidates about to be added.
+ */
+static INLINE void hydro_ngb_list_reserve(struct hydro_ngb_list *l,
+                                          const int extra) {
+
+  if (l->count + extra <= l->size) return;
+
+  const int new_size = hydro_ngb_list_growth * (l->count + extra);
+  l->ngbs = (struct hydro_ngb *)swift_realloc(
+      "hydro_ngb_list", l->ngbs, new_size * sizeof(struct hydro_ngb));
+  if (l->ngbs == NULL)
+    error("Failed to allocate %d neighbour candidates.", new_size);
+  l->size = new_size;
+}
+
+/**
+ * @brief Frees the memory of a #hydro_ngb_list.
+ *
+ * @param l The #hydro_ngb_list.
+ */
+static INLINE void hydro_ngb_list_clean(struct hydro_ngb_list *l) {
+
+  if (l->size > 0) swift_free("hydro_ngb_list", l->ngbs);
+  if (l->slots > 0) {
+    swift_free("hydro_ngb_list", l->offset);
+    swift_free("hydro_ngb_list", l->length);
+    swift_free("hydro_ngb_list", l->h);
+  }
+  l->ngbs = NULL;
+  l->offset = NULL;
+  l->length = NULL;
+  l->h = NULL;
+  l->count = 0;
+  l->size = 0;
+  l->slots = 0;
+}
+
+#endif /* SWIFT_HYDRO_NGB_LIST_H */
@@ -39,6 +39,7 @@
 #include "units.h"
 
 #define hydro_props_default_max_iterations 30
+#define hydro_props_default_ngb_list_tolerance 1.2f
 #define hydro_props_default_volume_change 1.4f
 #define hydro_props_default_h_max FLT_MAX
 #define hydro_props_default_h_min_ratio 0.f
@@ -101,6 +102,14 @@ void hydro_props_init(struct hydro_props *p,
   if (p->max_smoothing_iterations <= 10)
     error("The number of smoothing length iterations should be > 10");
 
+  /* Search radius of the neighbour lists kept between ghost iterations */
+  p->ghost_ngb_list_tolerance =
+      parser_get_opt_param_float(params, "SPH:ghost_neighbour_list_tolerance",
+                                 hydro_props_default_ngb_list_tolerance);
+
+  if (p->ghost_ngb_list_tolerance != 0.f && p->ghost_ngb_list_tolerance < 1.f)
+    error("The ghost neighbour list tolerance should be 0 or >= 1");
+
   /* ------ Neighbour number definition ------------ */
 
   /* Non-conventional neighbour number definition */
@@ -255,6 +264,11 @@ void hydro_props_print(const struct hydro_props *p) {
     message("Maximal iterations in ghost task set to %d (default is %d)",
             p->max_smoothing_iterations, hydro_props_default_max_iterations);
 
+  if (p->ghost_ngb_list_tolerance != hydro_props_default_ngb_list_tolerance)
+    message("Ghost neighbour list tolerance set to %f (default is %f)",
+            p->ghost_ngb_list_tolerance,
+            hydro_props_default_ngb_list_tolerance);
+
   if (p->initial_temperature != hydro_props_default_init_temp)
     message("Initial gas temperature set to %f", p->initial_temperature);
 
@@ -363,6 +377,7 @@ void hydro_props_init_no_hydro(struct hydro_props *p) {
   p->h_min = 0.f;
   p->h_min_ratio = hydro_props_default_h_min_ratio;
   p->max_smoothing_iterations = hydro_props_default_max_iterations;
+  p->ghost_ngb_list_tolerance = hydro_props_default_ngb_list_tolerance;
   p->CFL_condition = 0.1;
   p->log_max_h_change = logf(powf(1.4, hydro_dimension_inv));
 
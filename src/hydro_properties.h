@@ -73,6 +73,10 @@ struct hydro_props {
   /*! Maximal number of iterations to converge h */
   int max_smoothing_iterations;
 
+  /*! Search radius of the ghost neighbour lists in units of the kernel
+   * support (0 for no lists) */
+  float ghost_ngb_list_tolerance;
+
   /* ------ Neighbour number definition ------------ */
 
   /*! Are we using the mass-weighted definition of neighbour number? */
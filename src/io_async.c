@@ -0,0 +1,193 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+/**
+ *  @file io_async.c
+ *  @brief Writing of the snapshot data on a background thread.
+ *
+ *  The snapshot is written as usual, except that the converted fields are
+ *  kept in memory rather than written to their datasets, which are only
+ *  created. Once the files are closed a thread re-opens them and writes the
+ *  staged buffers, including any compression, while the simulation
+ *  carries on. The next snapshot, or the end of the run, waits for it.
+ */
+
+/* Config parameters. */
+#include <config.h>
+
+#if defined(HAVE_HDF5)
+
+/* Standard headers. */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* This object's header. */
+#include "io_async.h"
+
+/* Local headers. */
+#include "error.h"
+#include "memuse.h"
+
+/*! A field waiting to be written. */
+struct io_async_field {
+
+  /*! File, group and dataset to write to. */
+  char *fileName;
+  char *groupName;
+  char *dataName;
+
+  /*! HDF5 type of the data in memory. */
+  hid_t type;
+
+  /*! The converted data, freed once written. */
+  void *buffer;
+};
+
+/*! The staged fields. */
+static struct io_async_field *io_async_fields = NULL;
+static int io_async_nr_fields = 0;
+static int io_async_size_fields = 0;
+
+/*! The writing thread, if running. */
+static pthread_t io_async_thread;
+static int io_async_running = 0;
+
+/**
+ * @brief Check that we can write on a background thread.
+ *
+ * The simulation may use HDF5 for other outputs while the snapshot is
+ * being written, so that needs a thread-safe library.
+ */
+void io_async_check(void) {
+
+  hbool_t threadsafe = 0;
+  if (H5is_library_threadsafe(&threadsafe) < 0 || !threadsafe)
+    error(
+        "Snapshots:asynchronous requires HDF5 to be built thread-safe "
+        "(--enable-threadsafe).");
+}
+
+/**
+ * @brief Keep a converted field until the background thread writes it.
+ *
+ * The dataset must have been created, with its full extent, by the time
+ * #io_async_launch is called.
+ *
+ * @param fileName The name of the file.
+ * @param groupName The group of the dataset.
+ * @param dataName The name of the dataset.
+ * @param type The HDF5 type of the data in memory.
+ * @param buffer The data, allocated with swift_memalign under the label
+ *        "writebuff". We take ownership.
+ */
+void io_async_stage(const char *fileName, const char *groupName,
+                    const char *dataName, hid_t type, void *buffer) {
+
+  if (io_async_running)
+    error("Staging a field while the last snapshot is being written.");
+
+  if (io_async_nr_fields == io_async_size_fields) {
+    io_async_size_fields =
+        (io_async_size_fields == 0) ? 64 : 2 * io_async_size_fields;
+    struct io_async_field *fields = (struct io_async_field *)realloc(
+        io_async_fields, sizeof(struct io_async_field) * io_async_size_fields);
+    if (fields == NULL) error("Failed to allocate staged fields.");
+    io_async_fields = fields;
+  }
+
+  struct io_async_field *f = &io_async_fields[io_async_nr_fields++];
+  if ((f->fileName = strdup(fileName)) == NULL ||
+      (f->groupName = strdup(groupName)) == NULL ||
+      (f->dataName = strdup(dataName)) == NULL)
+    error("Failed to copy the names of a staged field.");
+  f->type = type;
+  f->buffer = buffer;
+}
+
+/**
+ * @brief Write all the staged fields, opening each file in turn.
+ */
+static void *io_async_main(void *data) {
+
+  hid_t h_file = -1;
+  const char *current = NULL;
+  for (int k = 0; k < io_async_nr_fields; k++) {
+    struct io_async_field *f = &io_async_fields[k];
+
+    if (current == NULL || strcmp(current, f->fileName) != 0) {
+      if (h_file >= 0) H5Fclose(h_file);
+      h_file = H5Fopen(f->fileName, H5F_ACC_RDWR, H5P_DEFAULT);
+      if (h_file < 0) error("Error while re-opening file '%s'.", f->fileName);
+      current = f->fileName;
+    }
+
+    const hid_t h_grp = H5Gopen(h_file, f->groupName, H5P_DEFAULT);
+    if (h_grp < 0) error("Error while opening group '%s'.", f->groupName);
+    const hid_t h_data = H5Dopen(h_grp, f->dataName, H5P_DEFAULT);
+    if (h_data < 0) error("Error while opening dataset '%s'.", f->dataName);
+
+    if (H5Dwrite(h_data, f->type, H5S_ALL, H5S_ALL, H5P_DEFAULT, f->buffer) <
+        0)
+      error("Error while writing data array '%s'.", f->dataName);
+
+    H5Dclose(h_data);
+    H5Gclose(h_grp);
+    swift_free("writebuff", f->buffer);
+    f->buffer = NULL;
+  }
+  if (h_file >= 0) H5Fclose(h_file);
+  return NULL;
+}
+
+/**
+ * @brief Start the background writing of the staged fields.
+ */
+void io_async_launch(void) {
+
+  if (io_async_running) error("The last snapshot is still being written.");
+  if (io_async_nr_fields == 0) return;
+
+  if (pthread_create(&io_async_thread, NULL, &io_async_main, NULL) != 0)
+    error("Failed to create the snapshot writing thread.");
+  io_async_running = 1;
+}
+
+/**
+ * @brief Wait for the background writing to finish, if running.
+ *
+ * @return 1 if a snapshot was being written, 0 otherwise.
+ */
+int io_async_wait(void) {
+
+  if (!io_async_running) return 0;
+
+  if (pthread_join(io_async_thread, NULL) != 0)
+    error("Failed to join the snapshot writing thread.");
+  io_async_running = 0;
+
+  for (int k = 0; k < io_async_nr_fields; k++) {
+    free(io_async_fields[k].fileName);
+    free(io_async_fields[k].groupName);
+    free(io_async_fields[k].dataName);
+  }
+  io_async_nr_fields = 0;
+  return 1;
+}
+
+#endif /* HAVE_HDF5 */
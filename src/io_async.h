@@ -0,0 +1,38 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#ifndef SWIFT_IO_ASYNC_H
+#define SWIFT_IO_ASYNC_H
+
+/* Config parameters. */
+#include <config.h>
+
+#if defined(HAVE_HDF5)
+
+/* HDF5 */
+#include <hdf5.h>
+
+/* Function prototypes. */
+void io_async_check(void);
+void io_async_stage(const char *fileName, const char *groupName,
+                    const char *dataName, hid_t type, void *buffer);
+void io_async_launch(void);
+int io_async_wait(void);
+
+#endif /* HAVE_HDF5 */
+
+#endif /* SWIFT_IO_ASYNC_H */
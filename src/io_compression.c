@@ -25,10 +25,16 @@
 
 /* Local includes. */
 #include "error.h"
+#include "threadpool.h"
 
 /* Some standard headers. */
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 /**
  * @brief Names of the compression levels, used in the select_output.yml
@@ -584,4 +590,116 @@ void set_hdf5_lossy_compression(hid_t* h_prop, hid_t* h_type,
     snprintf(filter_name, 32, "%s", lossy_compression_schemes_names[comp]);
 }
 
+#if defined(HAVE_ZLIB) && H5_VERSION_GE(1, 10, 3)
+
+/*! A chunk of a dataset, compressed by a thread. */
+struct io_chunk {
+  void* buff;
+  size_t size;
+};
+
+/*! Data shared by the threads compressing the chunks. */
+struct io_chunk_mapper_data {
+  const char* data;
+  struct io_chunk* chunks;
+  size_t nr_bytes;
+  size_t chunk_bytes;
+  size_t type_size;
+  int level;
+};
+
+/**
+ * @brief Threadpool mapper shuffling and deflating chunks of a dataset the
+ *        same way the HDF5 shuffle and deflate filters do.
+ */
+static void io_compress_chunks_mapper(void* map_data, int num_elements,
+                                      void* extra_data) {
+
+  struct io_chunk* chunks = (struct io_chunk*)map_data;
+  const struct io_chunk_mapper_data* data =
+      (const struct io_chunk_mapper_data*)extra_data;
+  const size_t chunk_bytes = data->chunk_bytes;
+  const size_t type_size = data->type_size;
+  const size_t nr_elements = chunk_bytes / type_size;
+
+  char* shuffled = (char*)malloc(chunk_bytes);
+  if (shuffled == NULL) error("Failed to allocate chunk shuffling buffer.");
+
+  for (int k = 0; k < num_elements; k++) {
+    const size_t ind = &chunks[k] - data->chunks;
+    const size_t offset = ind * chunk_bytes;
+    const char* in = data->data + offset;
+
+    /* The last chunk is padded to its full size, as HDF5 expects. */
+    const size_t nr_bytes = (offset + chunk_bytes > data->nr_bytes)
+                                ? data->nr_bytes - offset
+                                : chunk_bytes;
+    const size_t nr_full = nr_bytes / type_size;
+
+    /* Gather byte j of each element together. */
+    if (nr_full < nr_elements) bzero(shuffled, chunk_bytes);
+    for (size_t j = 0; j < type_size; j++)
+      for (size_t i = 0; i < nr_full; i++)
+        shuffled[j * nr_elements + i] = in[i * type_size + j];
+
+    uLongf size = compressBound(chunk_bytes);
+    if ((chunks[k].buff = malloc(size)) == NULL)
+      error("Failed to allocate compressed chunk.");
+    if (compress2((Bytef*)chunks[k].buff, &size, (const Bytef*)shuffled,
+                  chunk_bytes, data->level) != Z_OK)
+      error("Failed to compress a chunk.");
+    chunks[k].size = size;
+  }
+
+  free(shuffled);
+}
+
+/**
+ * @brief Compress the chunks of a dataset in parallel and write them
+ *        directly to the file.
+ *
+ * The dataset must have been created with the shuffle and deflate filters
+ * only, in that order, and data of a type needing no conversion.
+ *
+ * @param tp The #threadpool to compress with.
+ * @param h_data The dataset.
+ * @param data The data to write.
+ * @param N The number of rows.
+ * @param dimension The number of elements per row.
+ * @param type_size The size of the elements in bytes.
+ * @param chunk_rows The number of rows of a chunk.
+ * @param level The deflate compression level.
+ */
+void io_write_compressed_chunks(struct threadpool* tp, hid_t h_data,
+                                const void* data, const size_t N,
+                                const int dimension, const size_t type_size,
+                                const hsize_t chunk_rows, const int level) {
+
+  const size_t nr_chunks = (N + chunk_rows - 1) / chunk_rows;
+  struct io_chunk* chunks =
+      (struct io_chunk*)malloc(sizeof(struct io_chunk) * nr_chunks);
+  if (chunks == NULL) error("Failed to allocate the chunks.");
+
+  struct io_chunk_mapper_data mapper_data = {
+      .data = (const char*)data,
+      .chunks = chunks,
+      .nr_bytes = N * dimension * type_size,
+      .chunk_bytes = chunk_rows * dimension * type_size,
+      .type_size = type_size,
+      .level = level};
+  threadpool_map(tp, io_compress_chunks_mapper, chunks, nr_chunks,
+                 sizeof(struct io_chunk), /*chunk=*/1, &mapper_data);
+
+  for (size_t k = 0; k < nr_chunks; k++) {
+    const hsize_t offset[2] = {k * chunk_rows, 0};
+    if (H5Dwrite_chunk(h_data, H5P_DEFAULT, /*filters=*/0, offset,
+                       chunks[k].size, chunks[k].buff) < 0)
+      error("Error while writing a compressed chunk.");
+    free(chunks[k].buff);
+  }
+  free(chunks);
+}
+
+#endif /* HAVE_ZLIB && H5_VERSION_GE(1, 10, 3) */
+
 #endif /* HAVE_HDF5 */
@@ -67,6 +67,17 @@ void set_hdf5_lossy_compression(hid_t* h_prop, hid_t* h_type,
                                 const enum lossy_compression_schemes comp,
                                 const char* field_name, char filter_name[32]);
 
+/*! Can the chunks be compressed in parallel and written directly? */
+#if defined(HAVE_ZLIB) && H5_VERSION_GE(1, 10, 3)
+#define IO_PARALLEL_COMPRESSION 1
+
+struct threadpool;
+void io_write_compressed_chunks(struct threadpool* tp, hid_t h_data,
+                                const void* data, const size_t N,
+                                const int dimension, const size_t type_size,
+                                const hsize_t chunk_rows, const int level);
+#endif
+
 #endif /* HAVE_HDF5 */
 
 #endif /* SWIFT_IO_COMPRESSION_H */
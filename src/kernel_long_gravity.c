@@ -0,0 +1,105 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ * Copyright (c) 2016 Matthieu Schaller (schaller@strw.leidenuniv.nl)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "kernel_long_gravity.h"
+
+/* Standard headers */
+#include <math.h>
+
+/*! The long-range correction table of the P2P interactions */
+struct kernel_long_grav_table kernel_long_grav_table;
+
+/**
+ * @brief The long-range correction terms of the P2P interactions in double
+ * precision and without approximating erfc().
+ *
+ * @param u The ratio of the distance to the FFT cell scale \f$u = r/r_s\f$.
+ * @param corr_f (return) The correction for the force term.
+ * @param corr_pot (return) The correction for the potential term.
+ */
+static void kernel_long_grav_eval_exact(const double u, double *corr_f,
+                                        double *corr_pot) {
+
+#ifdef GADGET2_LONG_RANGE_CORRECTION
+
+  const double one_over_sqrt_pi = M_2_SQRTPI * 0.5;
+
+  *corr_pot = erfc(0.5 * u);
+  *corr_f = *corr_pot + u * one_over_sqrt_pi * exp(-0.25 * u * u);
+#else
+
+  const double x = 2. * u;
+  const double exp_x = exp(x);
+  const double alpha = 1. / (1. + exp_x);
+
+  *corr_pot = 2. * (1. - alpha * exp_x);
+  *corr_f = 2. * (((1. - alpha) * x - exp_x) * alpha + 1.);
+#endif
+}
+
+/**
+ * @brief Fill the #kernel_long_grav_table.
+ *
+ * The function values are exact and the derivatives are obtained by
+ * central differences. Each interval then stores the cubic Hermite
+ * polynomial through its two end points.
+ */
+void kernel_long_grav_table_init(void) {
+
+  const double du =
+      (double)kernel_long_grav_table_u_max / kernel_long_grav_table_size;
+  const double h = 1e-4 * du;
+
+  for (int i = 0; i < kernel_long_grav_table_size; ++i) {
+
+    double f[2], pot[2], df[2], dpot[2];
+
+    /* Values and (scaled) derivatives at both ends of the interval */
+    for (int k = 0; k < 2; ++k) {
+
+      const double u = (i + k) * du;
+      double f_p, pot_p, f_m, pot_m;
+
+      kernel_long_grav_eval_exact(u, &f[k], &pot[k]);
+      kernel_long_grav_eval_exact(u + h, &f_p, &pot_p);
+      kernel_long_grav_eval_exact(u - h, &f_m, &pot_m);
+
+      /* The expressions are smooth through u = 0 so the differences are
+       * also valid at the first point */
+      df[k] = (f_p - f_m) / (2. * h) * du;
+      dpot[k] = (pot_p - pot_m) / (2. * h) * du;
+    }
+
+    float *c = kernel_long_grav_table.coeff[i];
+
+    c[0] = f[0];
+    c[1] = df[0];
+    c[2] = 3. * (f[1] - f[0]) - 2. * df[0] - df[1];
+    c[3] = 2. * (f[0] - f[1]) + df[0] + df[1];
+
+    c[4] = pot[0];
+    c[5] = dpot[0];
+    c[6] = 3. * (pot[1] - pot[0]) - 2. * dpot[0] - dpot[1];
+    c[7] = 2. * (pot[0] - pot[1]) + dpot[0] + dpot[1];
+  }
+}
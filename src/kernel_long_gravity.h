@@ -33,11 +33,46 @@
 
 #define GADGET2_LONG_RANGE_CORRECTION
 
+#ifdef GRAVITY_LONG_RANGE_TABLE
+#ifdef GADGET2_LONG_RANGE_CORRECTION
+#define kernel_long_gravity_truncation_name \
+  "Gadget-like (tabulated erfc(), cubic interpolation)"
+#else
+#define kernel_long_gravity_truncation_name \
+  "Exp-based Sigmoid (tabulated, cubic interpolation)"
+#endif
+#else
 #ifdef GADGET2_LONG_RANGE_CORRECTION
 #define kernel_long_gravity_truncation_name "Gadget-like (using erfc())"
 #else
 #define kernel_long_gravity_truncation_name "Exp-based Sigmoid"
 #endif
+#endif
+
+/*! Number of intervals of the long-range correction table */
+#define kernel_long_grav_table_size 256
+
+/*! Largest r / r_s covered by the table. The corrections are below 1e-8
+ * beyond it and are set to 0. */
+#define kernel_long_grav_table_u_max 10.f
+
+/**
+ * @brief Tabulated long-range correction terms of the P2P interactions.
+ *
+ * Each interval stores the coefficients of the cubic Hermite interpolants
+ * of the force and potential corrections in the local coordinate t in
+ * [0, 1[. The layout is plain floats so that the same table can be copied
+ * as-is to the devices' constant memory.
+ */
+struct kernel_long_grav_table {
+
+  /*! Coefficients of t^0..t^3 for the force (0-3) and potential (4-7) */
+  float coeff[kernel_long_grav_table_size][8];
+};
+
+extern struct kernel_long_grav_table kernel_long_grav_table;
+
+void kernel_long_grav_table_init(void);
 
 /**
  * @brief Derivatives of the long-range truncation function \f$\chi(r,r_s)\f$ up
@@ -204,7 +239,26 @@ __attribute__((always_inline, nonnull)) INLINE static void
 kernel_long_grav_eval(const float r_over_r_s, float *restrict corr_f,
                       float *restrict corr_pot) {
 
-#ifdef GADGET2_LONG_RANGE_CORRECTION
+#if defined(GRAVITY_LONG_RANGE_TABLE)
+
+  /* Position in the table */
+  const float x = r_over_r_s * ((float)kernel_long_grav_table_size /
+                                kernel_long_grav_table_u_max);
+  const int i_x = (int)x;
+  const int i = i_x < kernel_long_grav_table_size
+                    ? i_x
+                    : kernel_long_grav_table_size - 1;
+  const float t = x - (float)i;
+
+  /* Zero beyond the end of the table */
+  const float mask = x < (float)kernel_long_grav_table_size ? 1.f : 0.f;
+
+  const float *c = kernel_long_grav_table.coeff[i];
+
+  *corr_f = mask * (((c[3] * t + c[2]) * t + c[1]) * t + c[0]);
+  *corr_pot = mask * (((c[7] * t + c[6]) * t + c[5]) * t + c[4]);
+
+#elif defined(GADGET2_LONG_RANGE_CORRECTION)
 
   const float two_over_sqrt_pi = ((float)M_2_SQRTPI);
 
@@ -252,6 +252,9 @@ void lightcone_struct_dump(const struct lightcone_props *props, FILE *stream) {
 
   /* Don't write out particle buffers - must flush before dumping restart. */
   memset(tmp.buffer, 0, sizeof(struct particle_buffer) * swift_type_count);
+  memset(tmp.flush_buffer, 0,
+         sizeof(struct particle_buffer) * swift_type_count);
+  tmp.flush_busy = 0;
 
   /* Don't write array pointers */
   tmp.shell = NULL;
@@ -556,11 +559,27 @@ void lightcone_init(struct lightcone_props *props, const int index,
   props->max_map_update_send_size_mb = parser_get_opt_param_double(
       params, YML_NAME("max_map_update_send_size_mb"), 512.0);
 
+  /* Whether to merge map updates to the same pixel before sending them */
+  props->reduce_map_updates =
+      parser_get_opt_param_int(params, YML_NAME("reduce_map_updates"), 0);
+
   /* Compression options */
   props->particles_lossy_compression = parser_get_opt_param_int(
       params, YML_NAME("particles_lossy_compression"), 0);
   props->particles_gzip_level =
       parser_get_opt_param_int(params, YML_NAME("particles_gzip_level"), 0);
+
+  /* Write the particle buffers from a background thread? */
+  props->asynchronous_flush =
+      parser_get_opt_param_int(params, YML_NAME("asynchronous_flush"), 0);
+  props->flush_busy = 0;
+  if (props->asynchronous_flush) {
+    hbool_t threadsafe = 0;
+    if (H5is_library_threadsafe(&threadsafe) < 0 || !threadsafe)
+      error(
+          "Lightcone asynchronous_flush requires HDF5 to be built "
+          "thread-safe (--enable-threadsafe).");
+  }
   props->maps_gzip_level =
       parser_get_opt_param_int(params, YML_NAME("maps_gzip_level"), 0);
 
@@ -819,46 +838,28 @@ static void particle_file_name(char *buf, int len, char *subdir, char *basename,
 }
 
 /**
- * @brief Flush any buffers which exceed the specified size.
+ * @brief Write the particles of the flagged buffers to the current file.
  *
- * Also used to flush buffers before dumping restart files, in
- * which case we should have flush_all=1 and end_file=1 so that
- * buffers are flushed regardless of size and we will start a
- * new set of lightcone files after the restart dump.
+ * Opens or creates the current lightcone particle file of this rank and
+ * finalizes it if requested. The buffers are left untouched.
  *
  * @param props the #lightcone_props structure.
  * @param a the current expansion factor
  * @param internal_units swift internal unit system
  * @param snapshot_units swift snapshot unit system
- * @param flush_all flag to force flush of all buffers
+ * @param buffers the #particle_buffer of each type.
+ * @param flush_type which of the buffers to write.
  * @param end_file if true, subsequent calls write to a new file
- *
  */
-void lightcone_flush_particle_buffers(struct lightcone_props *props, double a,
-                                      const struct unit_system *internal_units,
-                                      const struct unit_system *snapshot_units,
-                                      int flush_all, int end_file) {
+static void lightcone_write_particle_buffers(
+    struct lightcone_props *props, double a,
+    const struct unit_system *internal_units,
+    const struct unit_system *snapshot_units, struct particle_buffer *buffers,
+    const int *flush_type, int end_file) {
 
-  ticks tic = getticks();
-
-  /* Should never be called with end_file=1 and flush_all=0 */
-  if (end_file && (!flush_all))
-    error("Finalizing file without flushing buffers!");
-
-  /* Will flush any buffers with more particles than this */
-  size_t max_to_buffer = (size_t)props->max_particles_buffered;
-  if (flush_all) max_to_buffer = 0;
-
-  /* Count how many types have data to write out */
   int types_to_flush = 0;
-  for (int ptype = 0; ptype < swift_type_count; ptype += 1) {
-    if (props->use_type[ptype]) {
-      const size_t num_to_write =
-          particle_buffer_num_elements(&props->buffer[ptype]);
-      if (num_to_write >= max_to_buffer && num_to_write > 0)
-        types_to_flush += 1;
-    }
-  }
+  for (int ptype = 0; ptype < swift_type_count; ptype += 1)
+    types_to_flush += flush_type[ptype];
 
   /* Check if there's anything to do */
   if ((types_to_flush > 0) || (end_file && props->file_needs_finalizing)) {
@@ -946,16 +947,13 @@ void lightcone_flush_particle_buffers(struct lightcone_props *props, double a,
 
     /* Loop over particle types */
     for (int ptype = 0; ptype < swift_type_count; ptype += 1) {
-      if (props->use_type[ptype]) {
+      if (flush_type[ptype]) {
         const size_t num_to_write =
-            particle_buffer_num_elements(&props->buffer[ptype]);
-        if (num_to_write >= max_to_buffer && num_to_write > 0) {
-          lightcone_write_particles(props, internal_units, snapshot_units,
-                                    ptype, file_id);
-          particle_buffer_empty(&props->buffer[ptype]);
-          props->num_particles_written_to_file[ptype] += num_to_write;
-          props->num_particles_written_this_rank[ptype] += num_to_write;
-        }
+            particle_buffer_num_elements(&buffers[ptype]);
+        lightcone_write_particles(props, internal_units, snapshot_units,
+                                  ptype, &buffers[ptype], file_id);
+        props->num_particles_written_to_file[ptype] += num_to_write;
+        props->num_particles_written_this_rank[ptype] += num_to_write;
       }
     }
 
@@ -986,6 +984,136 @@ void lightcone_flush_particle_buffers(struct lightcone_props *props, double a,
 
   /* If we need to start a new file next time, record this */
   if (end_file) props->start_new_file = 1;
+}
+
+/**
+ * @brief Body of the thread writing the particle buffers in the background.
+ *
+ * @param arg the #lightcone_props structure.
+ */
+static void *lightcone_flush_runner(void *arg) {
+
+  struct lightcone_props *props = (struct lightcone_props *)arg;
+  const ticks tic = getticks();
+
+  lightcone_write_particle_buffers(props, props->flush_a,
+                                   props->flush_internal_units,
+                                   props->flush_snapshot_units,
+                                   props->flush_buffer, props->flush_type,
+                                   /*end_file=*/0);
+
+  for (int ptype = 0; ptype < swift_type_count; ptype += 1)
+    if (props->flush_type[ptype])
+      particle_buffer_free(&props->flush_buffer[ptype]);
+
+  if (props->verbose && engine_rank == 0)
+    message("lightcone %d: Background flush of particle buffers took %.3f %s.",
+            props->index, clocks_from_ticks(getticks() - tic),
+            clocks_getunit());
+
+  return NULL;
+}
+
+/**
+ * @brief Wait for the background thread to finish writing the particle
+ * buffers handed over, if any.
+ *
+ * @param props the #lightcone_props structure.
+ */
+void lightcone_wait_particle_flush(struct lightcone_props *props) {
+
+  if (!props->flush_busy) return;
+
+  if (pthread_join(props->flush_thread, NULL) != 0)
+    error("Failed to join the lightcone flush thread");
+  props->flush_busy = 0;
+}
+
+/**
+ * @brief Flush any buffers which exceed the specified size.
+ *
+ * Also used to flush buffers before dumping restart files, in
+ * which case we should have flush_all=1 and end_file=1 so that
+ * buffers are flushed regardless of size and we will start a
+ * new set of lightcone files after the restart dump.
+ *
+ * With asynchronous flushes, the buffers to flush are swapped for empty
+ * ones and handed to a background thread, unless the file is ending. We
+ * only wait for the previous background flush to be complete.
+ *
+ * @param props the #lightcone_props structure.
+ * @param a the current expansion factor
+ * @param internal_units swift internal unit system
+ * @param snapshot_units swift snapshot unit system
+ * @param flush_all flag to force flush of all buffers
+ * @param end_file if true, subsequent calls write to a new file
+ *
+ */
+void lightcone_flush_particle_buffers(struct lightcone_props *props, double a,
+                                      const struct unit_system *internal_units,
+                                      const struct unit_system *snapshot_units,
+                                      int flush_all, int end_file) {
+
+  ticks tic = getticks();
+
+  /* Should never be called with end_file=1 and flush_all=0 */
+  if (end_file && (!flush_all))
+    error("Finalizing file without flushing buffers!");
+
+  /* The previous background flush must be complete before we touch the
+   * file again */
+  lightcone_wait_particle_flush(props);
+
+  /* Will flush any buffers with more particles than this */
+  size_t max_to_buffer = (size_t)props->max_particles_buffered;
+  if (flush_all) max_to_buffer = 0;
+
+  /* Find the types with data to write out */
+  int flush_type[swift_type_count] = {0};
+  int types_to_flush = 0;
+  for (int ptype = 0; ptype < swift_type_count; ptype += 1) {
+    if (props->use_type[ptype]) {
+      const size_t num_to_write =
+          particle_buffer_num_elements(&props->buffer[ptype]);
+      if (num_to_write >= max_to_buffer && num_to_write > 0) {
+        flush_type[ptype] = 1;
+        types_to_flush += 1;
+      }
+    }
+  }
+
+  if (props->asynchronous_flush && !end_file) {
+
+    /* Nothing to hand over? */
+    if (types_to_flush == 0) return;
+
+    /* Swap the full buffers for empty ones */
+    for (int ptype = 0; ptype < swift_type_count; ptype += 1) {
+      props->flush_type[ptype] = flush_type[ptype];
+      if (flush_type[ptype]) {
+        struct particle_buffer *full = &props->flush_buffer[ptype];
+        *full = props->buffer[ptype];
+        particle_buffer_init(&props->buffer[ptype], full->element_size,
+                             full->elements_per_block, full->name);
+      }
+    }
+    props->flush_a = a;
+    props->flush_internal_units = internal_units;
+    props->flush_snapshot_units = snapshot_units;
+
+    /* And let the background thread write them */
+    if (pthread_create(&props->flush_thread, NULL, lightcone_flush_runner,
+                       props) != 0)
+      error("Failed to create the lightcone flush thread");
+    props->flush_busy = 1;
+
+  } else {
+
+    lightcone_write_particle_buffers(props, a, internal_units, snapshot_units,
+                                     props->buffer, flush_type, end_file);
+    for (int ptype = 0; ptype < swift_type_count; ptype += 1)
+      if (flush_type[ptype]) particle_buffer_empty(&props->buffer[ptype]);
+  }
 
   if (props->verbose && engine_rank == 0 && types_to_flush > 0)
     message("lightcone %d: Flushing particle buffers took %.3f %s.",
@@ -1011,6 +1139,7 @@ void lightcone_flush_map_updates(struct lightcone_props *props,
       lightcone_shell_flush_map_updates(&props->shell[shell_nr], tp,
                                         props->part_type,
                                         props->max_map_update_send_size_mb,
+                                        props->reduce_map_updates,
                                         &props->kernel_table, props->verbose);
     }
   }
@@ -1084,8 +1213,8 @@ void lightcone_dump_completed_shells(struct lightcone_props *props,
         if (need_flush) {
           lightcone_shell_flush_map_updates(
               &props->shell[shell_nr], tp, props->part_type,
-              props->max_map_update_send_size_mb, &props->kernel_table,
-              props->verbose);
+              props->max_map_update_send_size_mb, props->reduce_map_updates,
+              &props->kernel_table, props->verbose);
         }
 
         /* Set the baseline value for the maps */
@@ -1201,6 +1330,9 @@ void lightcone_dump_completed_shells(struct lightcone_props *props,
  */
 void lightcone_clean(struct lightcone_props *props) {
 
+  /* Let the background thread complete its writes */
+  lightcone_wait_particle_flush(props);
+
   /* Deallocate particle buffers */
   for (int i = 0; i < swift_type_count; i += 1) {
     if (props->use_type[i]) particle_buffer_free(&props->buffer[i]);
@@ -1704,6 +1836,10 @@ void lightcone_memory_use(struct lightcone_props *props,
 void lightcone_write_index(struct lightcone_props *props,
                            const struct unit_system *internal_units,
                            const struct unit_system *snapshot_units) {
+
+  /* The particle counts must be final */
+  lightcone_wait_particle_flush(props);
+
   int comm_size = 1;
 #ifdef WITH_MPI
   MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
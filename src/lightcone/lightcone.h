@@ -23,6 +23,9 @@
 /* Config parameters. */
 #include <config.h>
 
+/* Standard headers */
+#include <pthread.h>
+
 /* Local headers */
 #include "lightcone/lightcone_map_types.h"
 #include "lightcone/lightcone_particle_io.h"
@@ -127,6 +130,9 @@ struct lightcone_props {
    * updating healpix maps */
   double max_map_update_send_size_mb;
 
+  /*! Whether to merge map updates to the same pixel before sending them */
+  int reduce_map_updates;
+
   /*! Whether to apply lossy compression */
   int particles_lossy_compression;
 
@@ -175,6 +181,26 @@ struct lightcone_props {
   /*! Whether we have started a particle file and not finalized it yet */
   int file_needs_finalizing;
 
+  /*! Whether the particle buffers are written by a background thread */
+  int asynchronous_flush;
+
+  /*! Whether the background thread is writing the buffers below */
+  int flush_busy;
+
+  /*! The background thread writing the particles */
+  pthread_t flush_thread;
+
+  /*! The buffers handed to the background thread */
+  struct particle_buffer flush_buffer[swift_type_count];
+
+  /*! Which of the buffers handed over have particles to write */
+  int flush_type[swift_type_count];
+
+  /*! Expansion factor and unit systems of the handed over flush */
+  double flush_a;
+  const struct unit_system *flush_internal_units;
+  const struct unit_system *flush_snapshot_units;
+
   /*! Number of pending map updates to trigger communication */
   int max_updates_buffered;
 
@@ -242,6 +268,8 @@ void lightcone_flush_particle_buffers(struct lightcone_props *props, double a,
                                       const struct unit_system *snapshot_units,
                                       int flush_all, int end_file);
 
+void lightcone_wait_particle_flush(struct lightcone_props *props);
+
 void lightcone_buffer_map_update(struct lightcone_props *props,
                                  const struct engine *e, const struct gpart *gp,
                                  const double a_cross, const double x_cross[3]);
@@ -21,6 +21,7 @@
 #include <config.h>
 
 /* Some standard headers. */
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -247,6 +248,79 @@ struct replication_list *lightcone_array_refine_replications(
   return lists;
 }
 
+/**
+ * @brief Can any particle of a leaf cell cross a lightcone during a drift?
+ *
+ * Uses the same effective cell width as the refinement of the replication
+ * lists, and the same limit on how far the particles can move, as
+ * lightcone_check_particle_crosses(). A cell for which this returns 0 hence
+ * has no particle that would be found to cross, and the per-particle checks
+ * can be skipped altogether.
+ *
+ * props the #lightcone_array_props struct
+ * lists the replication lists of the cell, one per lightcone
+ * cosmo the #cosmology struct
+ * cell the leaf #cell
+ * ti_old beginning of the drift on the integer time line
+ * ti_current end of the drift on the integer time line
+ *
+ */
+int lightcone_array_cell_may_cross(const struct lightcone_array_props *props,
+                                   const struct replication_list *lists,
+                                   const struct cosmology *cosmo,
+                                   const struct cell *cell,
+                                   const integertime_t ti_old,
+                                   const integertime_t ti_current) {
+
+  /* Expansion factors and lightcone surfaces at start and end of the drift */
+  const double a_start = cosmo->a_begin * exp(ti_old * cosmo->time_base);
+  const double a_end = cosmo->a_begin * exp(ti_current * cosmo->time_base);
+  const double r_start = cosmology_get_comoving_distance(cosmo, a_start);
+  const double r_end = cosmology_get_comoving_distance(cosmo, a_end);
+  const double r2_start = r_start * r_start;
+  const double r2_end = r_end * r_end;
+  const double boundary = r2_start - r2_end;
+
+  /* Centre of the cell, and its 'effective' half-width */
+  const double cell_centre[3] = {cell->loc[0] + 0.5 * cell->width[0],
+                                 cell->loc[1] + 0.5 * cell->width[1],
+                                 cell->loc[2] + 0.5 * cell->width[2]};
+  const double *half_width = cell->width;
+
+  for (int lightcone_nr = 0; lightcone_nr < props->nr_lightcones;
+       lightcone_nr += 1) {
+
+    const struct lightcone_props *lightcone = props->lightcone + lightcone_nr;
+    const struct replication_list *list = lists + lightcone_nr;
+    if (list->nrep == 0) continue;
+
+    /* Does this drift overlap the lightcone redshift range? */
+    if ((a_start > lightcone->a_max) || (a_end < lightcone->a_min)) continue;
+
+    for (int i = 0; i < list->nrep; i += 1) {
+
+      const struct replication *rep = list->replication + i;
+
+      /* Distance limits of this copy of the cell from the observer */
+      double cell_rmin2 = 0.0, cell_rmax2 = 0.0;
+      for (int j = 0; j < 3; j += 1) {
+        const double dx = fabs(rep->coord[j] + cell_centre[j] -
+                               lightcone->observer_position[j]);
+        const double dx_min = max(dx - half_width[j], 0.0);
+        const double dx_max = dx + half_width[j];
+        cell_rmin2 += dx_min * dx_min;
+        cell_rmax2 += dx_max * dx_max;
+      }
+
+      /* Some particles may start inside the surface at the start of the drift
+       * and end outside the one at the end */
+      if (cell_rmin2 <= r2_start && cell_rmax2 + boundary >= r2_end) return 1;
+    }
+  }
+
+  return 0;
+}
+
 /**
  * @brief Free lists returned by lightcone_array_refine_replications
  *
@@ -33,6 +33,7 @@
 #include "timeline.h"
 
 /* Avoid cyclic inclusions */
+struct cell;
 struct cosmology;
 struct engine;
 struct space;
@@ -90,6 +91,13 @@ void lightcone_array_flush(struct lightcone_array_props *props,
 struct replication_list *lightcone_array_refine_replications(
     struct lightcone_array_props *props, const struct cell *cell);
 
+int lightcone_array_cell_may_cross(const struct lightcone_array_props *props,
+                                   const struct replication_list *lists,
+                                   const struct cosmology *cosmo,
+                                   const struct cell *cell,
+                                   const integertime_t ti_old,
+                                   const integertime_t ti_current);
+
 void lightcone_array_free_replications(struct lightcone_array_props *props,
                                        struct replication_list *lists);
 
@@ -45,7 +45,8 @@
  * function is called.
  *
  * @param e the #engine struct
- * @param replication_list_array one replication list for each lightcone
+ * @param replication_list_array one replication list for each lightcone, or
+ * NULL if the particle's cell cannot cross any of them
  * @param x the position of the particle BEFORE it is drifted
  * @param v_full the velocity of the particle
  * @param gp pointer to the #gpart to check
@@ -62,13 +63,16 @@ lightcone_check_particle_crosses(
     const double dt_drift, const integertime_t ti_old,
     const integertime_t ti_current, const double cell_loc[3]) {
 
+  /* Is the particle in a leaf from which nothing can cross? (see
+   * lightcone_array_cell_may_cross()) */
+  if (replication_list_array == NULL) return;
+
   /* Does this particle type contribute to any lightcone outputs at this
    * redshift? */
   if (e->lightcone_array_properties->check_type_for_crossing[gp->type] == 0)
     return;
 
   /* Check if we have any replications to search */
-  /* TODO: pre-calculate this for each cell to save time */
   int nrep_tot = 0;
   const int nr_lightcones = e->lightcone_array_properties->nr_lightcones;
   for (int lightcone_nr = 0; lightcone_nr < nr_lightcones; lightcone_nr += 1) {
@@ -261,15 +261,18 @@ void lightcone_map_write(struct lightcone_map *map, const hid_t loc_id,
   H5Tclose(dtype_id);
   if (dset_id < 0) error("Unable to create dataset %s", name);
 
-  /* Write attributes */
-  io_write_attribute_i(dset_id, "nside", map->nside);
+  /* Write attributes (the HEALPix ones only for the maps using it, the
+     projections of the box describe their pixels themselves) */
   io_write_attribute_ll(dset_id, "number_of_pixels",
                         (long long)map->total_nr_pix);
-  io_write_attribute_s(dset_id, "pixel_ordering_scheme", "ring");
-  io_write_attribute_d(dset_id, "comoving_inner_radius",
-                       map->r_min * length_conversion_factor);
-  io_write_attribute_d(dset_id, "comoving_outer_radius",
-                       map->r_max * length_conversion_factor);
+  if (map->nside > 0) {
+    io_write_attribute_i(dset_id, "nside", map->nside);
+    io_write_attribute_s(dset_id, "pixel_ordering_scheme", "ring");
+    io_write_attribute_d(dset_id, "comoving_inner_radius",
+                         map->r_min * length_conversion_factor);
+    io_write_attribute_d(dset_id, "comoving_outer_radius",
+                         map->r_max * length_conversion_factor);
+  }
 
   /* Write unit conversion factors for this data set */
   char buffer[FIELD_BUFFER_SIZE] = {0};
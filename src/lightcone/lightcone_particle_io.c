@@ -762,13 +762,14 @@ void append_dataset(const struct unit_system *snapshot_units,
 }
 
 hid_t init_write(struct lightcone_props *props, hid_t file_id, int ptype,
-                 size_t *num_written, size_t *num_to_write) {
+                 struct particle_buffer *buffer, size_t *num_written,
+                 size_t *num_to_write) {
 
   /* Number of particles already written to the file */
   *num_written = props->num_particles_written_to_file[ptype];
 
   /* Number of buffered particles */
-  *num_to_write = particle_buffer_num_elements(&props->buffer[ptype]);
+  *num_to_write = particle_buffer_num_elements(buffer);
 
   /* Create or open the HDF5 group for this particle type */
   const char *name = part_type_names[ptype];
@@ -785,18 +786,26 @@ hid_t init_write(struct lightcone_props *props, hid_t file_id, int ptype,
 
 /**
  * @brief Append buffered particles to the output file.
+ *
+ * @param props the #lightcone_props structure.
+ * @param internal_units swift internal unit system
+ * @param snapshot_units swift snapshot unit system
+ * @param ptype the type of the particles to write.
+ * @param buffer the #particle_buffer holding the particles.
+ * @param file_id the open HDF5 file to write to.
  */
 void lightcone_write_particles(struct lightcone_props *props,
                                const struct unit_system *internal_units,
                                const struct unit_system *snapshot_units,
-                               int ptype, hid_t file_id) {
+                               int ptype, struct particle_buffer *buffer,
+                               hid_t file_id) {
 
   if (props->particle_fields[ptype].num_fields > 0) {
 
     /* Open group and get number and offset of particles to write */
     size_t num_written, num_to_write;
     hid_t group_id =
-        init_write(props, file_id, ptype, &num_written, &num_to_write);
+        init_write(props, file_id, ptype, buffer, &num_written, &num_to_write);
 
     /* Get size of the data struct for this type */
     const size_t data_struct_size = lightcone_io_struct_size(ptype);
@@ -827,7 +836,7 @@ void lightcone_write_particles(struct lightcone_props *props,
       struct particle_buffer_block *block = NULL;
       char *block_data;
       do {
-        particle_buffer_iterate(&props->buffer[ptype], &block, &num_elements,
+        particle_buffer_iterate(buffer, &block, &num_elements,
                                 (void **)&block_data);
         for (size_t i = 0; i < num_elements; i += 1) {
           char *src = block_data + i * data_struct_size + f->offset;
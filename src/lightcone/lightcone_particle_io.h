@@ -43,6 +43,7 @@ struct xpart;
 struct spart;
 struct bpart;
 struct lightcone_props;
+struct particle_buffer;
 struct engine;
 
 /*
@@ -233,7 +234,8 @@ int lightcone_store_neutrino(const struct engine *e,
 void lightcone_write_particles(struct lightcone_props *props,
                                const struct unit_system *internal_units,
                                const struct unit_system *snapshot_units,
-                               int ptype, hid_t file_id);
+                               int ptype, struct particle_buffer *buffer,
+                               hid_t file_id);
 
 inline static size_t lightcone_io_struct_size(int ptype) {
   switch (ptype) {
@@ -31,6 +31,7 @@
 
 /* Local headers */
 #include "cosmology.h"
+#include "cuda_lightcone.h"
 #include "engine.h"
 #include "exchange_structs.h"
 #include "hydro.h"
@@ -377,6 +378,9 @@ struct healpix_smoothing_mapper_data {
 
   /*! Pointer to the projected kernel table */
   struct projected_kernel_table *kernel_table;
+
+  /*! Have the smoothed maps already been updated on the GPU? */
+  int smoothed_on_gpu;
 };
 
 #ifdef HAVE_CHEALPIX
@@ -387,6 +391,27 @@ static pixel_index_t angle_to_pixel(int nside, double theta, double phi) {
 }
 #endif
 
+struct map_update_key {
+
+  /*! Pixel updated by this element, or -1 if it updates several pixels
+   * (the pixel containing the particle when smoothing on the GPU) */
+  pixel_index_t pixel;
+
+  /*! Pointer to the update in the particle buffer */
+  union lightcone_map_buffer_entry *update;
+};
+
+#if defined(WITH_MPI) || defined(HAVE_CHEALPIX)
+/**
+ * @brief Comparison function to sort map updates by pixel index
+ */
+static int map_update_key_compare(const void *a, const void *b) {
+  const pixel_index_t pa = ((const struct map_update_key *)a)->pixel;
+  const pixel_index_t pb = ((const struct map_update_key *)b)->pixel;
+  return (pa > pb) - (pa < pb);
+}
+#endif
+
 #ifdef WITH_MPI
 
 struct buffer_block_info {
@@ -478,6 +503,14 @@ static void count_elements_to_send_mapper(void *map_data, int num_elements,
 
       /* Find the particle angular coordinates and size for this update */
       size_t index = i * (3 + nr_maps);
+
+      /* Skip updates which were merged into another one */
+      if (update_data[index + 0].i < 0) {
+        first_dest[i] = 0;
+        last_dest[i] = -1;
+        continue;
+      }
+
       const double theta = int_to_angle(update_data[index + 0].i);
       const double phi = int_to_angle(update_data[index + 1].i);
       /* Retrieve angular smoothing length for this particle */
@@ -594,6 +627,232 @@ static void store_elements_to_send_mapper(void *map_data, int num_elements,
     /* Next block */
   }
 }
+
+/**
+ * @brief Find the pixel updated by each element of an array of map updates
+ *
+ * Updates with a search radius larger than a pixel may contribute to
+ * several pixels and get a pixel index of -1.
+ *
+ * @param map_data Pointer to an array of map_update_key
+ * @param num_elements Number of elements in the map_update_key array
+ * @param extra_data Pointer to healpix_smoothing_mapper_data struct
+ *
+ */
+static void map_update_pixel_mapper(void *map_data, int num_elements,
+                                    void *extra_data) {
+#ifdef HAVE_CHEALPIX
+
+  struct map_update_key *keys = (struct map_update_key *)map_data;
+  struct healpix_smoothing_mapper_data *mapper_data =
+      (struct healpix_smoothing_mapper_data *)extra_data;
+  struct lightcone_shell *shell = mapper_data->shell;
+
+  /* Maximum radius of a HEALPix pixel */
+  const double max_pixrad = healpix_max_pixrad(shell->nside);
+
+  for (int i = 0; i < num_elements; i += 1) {
+    const union lightcone_map_buffer_entry *update = keys[i].update;
+    const double search_radius = update[2].f * kernel_gamma;
+    if (search_radius < max_pixrad) {
+      const double theta = int_to_angle(update[0].i);
+      const double phi = int_to_angle(update[1].i);
+      keys[i].pixel = angle_to_pixel(shell->nside, theta, phi);
+    } else {
+      keys[i].pixel = -1;
+    }
+  }
+#else
+  error("Need HEALPix C API for lightcone maps");
+#endif
+}
+
+/**
+ * @brief Merge buffered map updates which contribute to the same pixel
+ *
+ * Updates from particles smaller than a pixel only ever contribute to
+ * the pixel containing the particle, whether or not the map is smoothed.
+ * We sort these by pixel and sum all of the updates to each pixel into
+ * the first one so that only one update per pixel needs to be sent.
+ * Merged updates are flagged with a negative theta and skipped when
+ * building the send buffer. This reduces the size of the send and
+ * receive buffers when many particles fall in the same pixels.
+ *
+ * @param buffer the #particle_buffer containing the updates
+ * @param tp the #threadpool used to find the pixel of each update
+ * @param mapper_data information about the shell and particle type
+ *
+ * @return the number of updates which were merged into another one
+ */
+static size_t reduce_map_updates(
+    struct particle_buffer *buffer, struct threadpool *tp,
+    struct healpix_smoothing_mapper_data *mapper_data) {
+
+  const int nr_maps = mapper_data->part_type->nr_maps;
+  const int nr_elements_per_update = 3 + nr_maps;
+
+  /* Count the buffered updates */
+  size_t nr_updates = 0;
+  for (struct particle_buffer_block *block = buffer->first_block; block;
+       block = block->next)
+    nr_updates += block->num_elements;
+  if (nr_updates < 2) return 0;
+
+  /* Make an array with a pointer to each update */
+  struct map_update_key *keys =
+      (struct map_update_key *)malloc(sizeof(struct map_update_key) *
+                                      nr_updates);
+  if (keys == NULL) error("Failed to allocate map update keys");
+  size_t n = 0;
+  for (struct particle_buffer_block *block = buffer->first_block; block;
+       block = block->next) {
+    union lightcone_map_buffer_entry *update_data =
+        (union lightcone_map_buffer_entry *)block->data;
+    for (size_t i = 0; i < block->num_elements; i += 1)
+      keys[n++].update = &update_data[i * nr_elements_per_update];
+  }
+
+  /* Find the pixel each update contributes to and sort by pixel */
+  threadpool_map(tp, map_update_pixel_mapper, keys, nr_updates,
+                 sizeof(struct map_update_key), threadpool_auto_chunk_size,
+                 mapper_data);
+  qsort(keys, nr_updates, sizeof(struct map_update_key),
+        map_update_key_compare);
+
+  /* Merge each run of updates to the same pixel into its first element */
+  double *sum = (double *)malloc(sizeof(double) * nr_maps);
+  if (sum == NULL) error("Failed to allocate map update sums");
+  size_t nr_merged = 0;
+  size_t first = 0;
+  while (first < nr_updates) {
+    size_t last = first + 1;
+    if (keys[first].pixel >= 0) {
+      while (last < nr_updates && keys[last].pixel == keys[first].pixel)
+        last += 1;
+    }
+    if (last - first > 1) {
+      for (int j = 0; j < nr_maps; j += 1) sum[j] = 0.0;
+      for (size_t k = first; k < last; k += 1) {
+        const union lightcone_map_buffer_entry *value = &keys[k].update[3];
+        for (int j = 0; j < nr_maps; j += 1) sum[j] += value[j].f;
+        if (k > first) keys[k].update[0].i = -1;
+      }
+      union lightcone_map_buffer_entry *value = &keys[first].update[3];
+      for (int j = 0; j < nr_maps; j += 1) value[j].f = sum[j];
+      nr_merged += last - first - 1;
+    }
+    first = last;
+  }
+
+  free(sum);
+  free(keys);
+  return nr_merged;
+}
+#endif
+
+#ifdef HAVE_CHEALPIX
+/**
+ * @brief SPH smooth one large particle onto the smoothed healpix maps
+ *
+ * @param mapper_data information about the shell and particle type
+ * @param update the buffered update of the particle
+ *
+ */
+static void healpix_smooth_update(
+    const struct healpix_smoothing_mapper_data *mapper_data,
+    const union lightcone_map_buffer_entry *update) {
+
+  struct lightcone_shell *shell = mapper_data->shell;
+  const struct lightcone_particle_type *part_type = mapper_data->part_type;
+  struct projected_kernel_table *kernel_table = mapper_data->kernel_table;
+  const pixel_index_t local_pix_offset = shell->map[0].local_pix_offset;
+  const pixel_index_t local_nr_pix = shell->map[0].local_nr_pix;
+
+  const double theta = int_to_angle(update[0].i);
+  const double phi = int_to_angle(update[1].i);
+  const double smoothing_radius = update[2].f;
+  const double search_radius = smoothing_radius * kernel_gamma;
+  const union lightcone_map_buffer_entry *value = &update[3];
+
+  /* Get array of ranges of pixels to update */
+  double part_vec[3];
+  ang2vec(theta, phi, part_vec);
+  pixel_index_t pix_min, pix_max;
+  int nr_ranges;
+  struct pixel_range *range;
+  healpix_query_disc_range(shell->nside, part_vec, search_radius, &pix_min,
+                           &pix_max, &nr_ranges, &range);
+
+  /* Compute total weight of pixels to update */
+  double total_weight = 0;
+  for (int range_nr = 0; range_nr < nr_ranges; range_nr += 1) {
+    for (pixel_index_t pix = range[range_nr].first;
+         pix <= range[range_nr].last; pix += 1) {
+
+      /* Get vector at the centre of this pixel */
+      double pixel_vec[3];
+      pix2vec_ring64(shell->nside, pix, pixel_vec);
+
+      /* Find angle between this pixel centre and the particle.
+         Dot product may be a tiny bit greater than one due to rounding
+         error */
+      const double dp =
+          (pixel_vec[0] * part_vec[0] + pixel_vec[1] * part_vec[1] +
+           pixel_vec[2] * part_vec[2]);
+      const double angle = dp < 1.0 ? acos(dp) : 0.0;
+
+      /* Evaluate the kernel at this radius */
+      total_weight +=
+          projected_kernel_eval(kernel_table, angle / smoothing_radius);
+    }
+  }
+
+  /* Update the pixels */
+  for (int range_nr = 0; range_nr < nr_ranges; range_nr += 1) {
+    for (pixel_index_t pix = range[range_nr].first;
+         pix <= range[range_nr].last; pix += 1) {
+
+      /* Check if this pixel is stored locally */
+      pixel_index_t global_pix = pix;
+      if ((global_pix >= local_pix_offset) &&
+          (global_pix < local_pix_offset + local_nr_pix)) {
+
+        /* Get vector at the centre of this pixel */
+        double pixel_vec[3];
+        pix2vec_ring64(shell->nside, pix, pixel_vec);
+
+        /* Find angle between this pixel centre and the particle.
+           Dot product may be a tiny bit greater than one due to rounding
+           error */
+        const double dp =
+            (pixel_vec[0] * part_vec[0] + pixel_vec[1] * part_vec[1] +
+             pixel_vec[2] * part_vec[2]);
+        const double angle = dp < 1.0 ? acos(dp) : 0.0;
+
+        /* Evaluate the kernel at this radius */
+        const double weight =
+            projected_kernel_eval(kernel_table, angle / smoothing_radius) /
+            total_weight;
+
+        /* Find local index of the pixel to update */
+        const pixel_index_t local_pix = global_pix - local_pix_offset;
+
+        /* Update the smoothed healpix maps */
+        for (int j = 0; j < part_type->nr_smoothed_maps; j += 1) {
+          const int map_index = part_type->map_index[j];
+          const double buffered_value = value[j].f;
+          const double fac_inv = shell->map[map_index].buffer_scale_factor_inv;
+          const double value_to_add = buffered_value * fac_inv;
+          atomic_add_d(&shell->map[map_index].data[local_pix],
+                       value_to_add * weight);
+        } /* Next smoothed map */
+      }
+    } /* Next pixel in this range */
+  } /* Next range of pixels */
+
+  /* Free array of pixel ranges */
+  free(range);
+}
 #endif
 
 /**
@@ -622,7 +881,6 @@ void healpix_smoothing_mapper(void *map_data, int num_elements,
       (struct healpix_smoothing_mapper_data *)extra_data;
   struct lightcone_shell *shell = mapper_data->shell;
   struct lightcone_particle_type *part_type = mapper_data->part_type;
-  struct projected_kernel_table *kernel_table = mapper_data->kernel_table;
 
   /* Get maximum radius of any pixel in the map */
   const double max_pixrad = healpix_max_pixrad(shell->nside);
@@ -684,90 +942,8 @@ void healpix_smoothing_mapper(void *map_data, int num_elements,
 
          First do the smoothed maps
       */
-      if (part_type->nr_smoothed_maps > 0) {
-
-        /* Get array of ranges of pixels to update */
-        double part_vec[3];
-        ang2vec(theta, phi, part_vec);
-        pixel_index_t pix_min, pix_max;
-        int nr_ranges;
-        struct pixel_range *range;
-        healpix_query_disc_range(shell->nside, part_vec, search_radius,
-                                 &pix_min, &pix_max, &nr_ranges, &range);
-
-        /* Compute total weight of pixels to update */
-        double total_weight = 0;
-        for (int range_nr = 0; range_nr < nr_ranges; range_nr += 1) {
-          for (pixel_index_t pix = range[range_nr].first;
-               pix <= range[range_nr].last; pix += 1) {
-
-            /* Get vector at the centre of this pixel */
-            double pixel_vec[3];
-            pix2vec_ring64(shell->nside, pix, pixel_vec);
-
-            /* Find angle between this pixel centre and the particle.
-               Dot product may be a tiny bit greater than one due to rounding
-               error */
-            const double dp =
-                (pixel_vec[0] * part_vec[0] + pixel_vec[1] * part_vec[1] +
-                 pixel_vec[2] * part_vec[2]);
-            const double angle = dp < 1.0 ? acos(dp) : 0.0;
-
-            /* Evaluate the kernel at this radius */
-            total_weight +=
-                projected_kernel_eval(kernel_table, angle / smoothing_radius);
-          }
-        }
-
-        /* Update the pixels */
-        for (int range_nr = 0; range_nr < nr_ranges; range_nr += 1) {
-          for (pixel_index_t pix = range[range_nr].first;
-               pix <= range[range_nr].last; pix += 1) {
-
-            /* Check if this pixel is stored locally */
-            pixel_index_t global_pix = pix;
-            if ((global_pix >= local_pix_offset) &&
-                (global_pix < local_pix_offset + local_nr_pix)) {
-
-              /* Get vector at the centre of this pixel */
-              double pixel_vec[3];
-              pix2vec_ring64(shell->nside, pix, pixel_vec);
-
-              /* Find angle between this pixel centre and the particle.
-                 Dot product may be a tiny bit greater than one due to rounding
-                 error */
-              const double dp =
-                  (pixel_vec[0] * part_vec[0] + pixel_vec[1] * part_vec[1] +
-                   pixel_vec[2] * part_vec[2]);
-              const double angle = dp < 1.0 ? acos(dp) : 0.0;
-
-              /* Evaluate the kernel at this radius */
-              const double weight =
-                  projected_kernel_eval(kernel_table,
-                                        angle / smoothing_radius) /
-                  total_weight;
-
-              /* Find local index of the pixel to update */
-              const pixel_index_t local_pix = global_pix - local_pix_offset;
-
-              /* Update the smoothed healpix maps */
-              for (int j = 0; j < part_type->nr_smoothed_maps; j += 1) {
-                const int map_index = part_type->map_index[j];
-                const double buffered_value = value[j].f;
-                const double fac_inv =
-                    shell->map[map_index].buffer_scale_factor_inv;
-                const double value_to_add = buffered_value * fac_inv;
-                atomic_add_d(&shell->map[map_index].data[local_pix],
-                             value_to_add * weight);
-              } /* Next smoothed map */
-            }
-          } /* Next pixel in this range */
-        } /* Next range of pixels */
-
-        /* Free array of pixel ranges */
-        free(range);
-
-      } /* if nr_smoothed_maps > 0*/
+      if (part_type->nr_smoothed_maps > 0 && !mapper_data->smoothed_on_gpu)
+        healpix_smooth_update(mapper_data, &update_data[index]);
 
       /* Then do any un-smoothed maps */
       if (part_type->nr_unsmoothed_maps > 0) {
@@ -801,6 +977,220 @@ void healpix_smoothing_mapper(void *map_data, int num_elements,
 #endif
 }
 
+#ifdef HAVE_CHEALPIX
+/**
+ * @brief Mapper function smoothing large particles onto the smoothed maps
+ *
+ * @param map_data Pointer to an array of map_update_key
+ * @param num_elements Number of elements in the map_update_key array
+ * @param extra_data Pointer to healpix_smoothing_mapper_data struct
+ *
+ */
+static void healpix_smooth_update_mapper(void *map_data, int num_elements,
+                                         void *extra_data) {
+
+  const struct map_update_key *keys = (const struct map_update_key *)map_data;
+  const struct healpix_smoothing_mapper_data *mapper_data =
+      (const struct healpix_smoothing_mapper_data *)extra_data;
+
+  for (int i = 0; i < num_elements; i += 1)
+    healpix_smooth_update(mapper_data, keys[i].update);
+}
+
+/**
+ * @brief Add the window of pixels smoothed on the GPU to the smoothed maps
+ *
+ * @param mapper_data information about the shell and particle type
+ * @param window_first first pixel of the window
+ * @param window_count number of pixels in the window
+ *
+ */
+static void healpix_smooth_window_on_gpu(
+    const struct healpix_smoothing_mapper_data *mapper_data,
+    const pixel_index_t window_first, const size_t window_count) {
+
+  struct lightcone_shell *shell = mapper_data->shell;
+  const struct lightcone_particle_type *part_type = mapper_data->part_type;
+
+  const double *window = cuda_lightcone_smooth(
+      mapper_data->kernel_table, shell->nside, window_first, window_count);
+
+  const pixel_index_t local_first =
+      window_first - shell->map[0].local_pix_offset;
+  for (int j = 0; j < part_type->nr_smoothed_maps; j += 1) {
+    double *data = shell->map[part_type->map_index[j]].data + local_first;
+    const double *values = window + j * window_count;
+    for (size_t k = 0; k < window_count; k += 1) data[k] += values[k];
+  }
+}
+
+/**
+ * @brief SPH smooth the large particles of an array of updates onto the
+ * smoothed healpix maps on the GPU
+ *
+ * The discs of the particles are found here. The particles are taken in
+ * order of the pixel they are in, such that close ones go together, and
+ * sent in batches whose local pixels fit in a window of at most
+ * cuda_lightcone_max_window values. The device spreads the values over the
+ * pixels of the window with atomic additions and the window is then added
+ * to the maps.
+ *
+ * Particles with too many local pixels for a window, and batches with
+ * fewer pixels to update than are in their window, are smoothed on the CPU
+ * instead.
+ *
+ * @param update_data the array of updates
+ * @param num_elements number of updates in the array
+ * @param tp the #threadpool used for the updates smoothed on the CPU
+ * @param mapper_data information about the shell and particle type
+ *
+ */
+static void healpix_smooth_updates_on_gpu(
+    union lightcone_map_buffer_entry *update_data, const size_t num_elements,
+    struct threadpool *tp,
+    const struct healpix_smoothing_mapper_data *mapper_data) {
+
+  if (num_elements == 0) return;
+
+  const struct lightcone_shell *shell = mapper_data->shell;
+  const struct lightcone_particle_type *part_type = mapper_data->part_type;
+  const int nr_maps = part_type->nr_smoothed_maps;
+  const int nr_elements_per_update = 3 + part_type->nr_maps;
+  const double max_pixrad = healpix_max_pixrad(shell->nside);
+  const pixel_index_t local_pix_offset = shell->map[0].local_pix_offset;
+  const pixel_index_t local_pix_last =
+      local_pix_offset + shell->map[0].local_nr_pix - 1;
+  const pixel_index_t max_window = cuda_lightcone_max_window / nr_maps;
+
+  /* Find the large particles and sort them by the pixel they are in */
+  struct map_update_key *keys = (struct map_update_key *)malloc(
+      sizeof(struct map_update_key) * num_elements);
+  struct map_update_key *cpu_keys = (struct map_update_key *)malloc(
+      sizeof(struct map_update_key) * num_elements);
+  if (keys == NULL || cpu_keys == NULL)
+    error("Failed to allocate map update keys");
+  size_t nr_keys = 0;
+  for (size_t i = 0; i < num_elements; i += 1) {
+    union lightcone_map_buffer_entry *update =
+        &update_data[i * nr_elements_per_update];
+    if (update[2].f * kernel_gamma < max_pixrad) continue;
+    const double theta = int_to_angle(update[0].i);
+    const double phi = int_to_angle(update[1].i);
+    keys[nr_keys].pixel = angle_to_pixel(shell->nside, theta, phi);
+    keys[nr_keys].update = update;
+    nr_keys += 1;
+  }
+  qsort(keys, nr_keys, sizeof(struct map_update_key), map_update_key_compare);
+
+  /* The scaled values of one update */
+  double *values = (double *)malloc(sizeof(double) * nr_maps);
+  if (values == NULL) error("Failed to allocate map update values");
+
+  /* The keys from first_batch on that are not NULL are in the current
+   * batch */
+  size_t nr_cpu = 0, first_batch = 0;
+  pixel_index_t window_first = 0, window_last = -1;
+  for (size_t i = 0; i <= nr_keys; i += 1) {
+
+    /* Get the disc of this particle and its local pixels */
+    int nr_ranges = 0;
+    struct pixel_range *range = NULL;
+    pixel_index_t first = 0, last = -1;
+    double part_vec[3];
+    if (i < nr_keys) {
+      const union lightcone_map_buffer_entry *update = keys[i].update;
+      ang2vec(int_to_angle(update[0].i), int_to_angle(update[1].i), part_vec);
+      pixel_index_t pix_min, pix_max;
+      healpix_query_disc_range(shell->nside, part_vec,
+                               update[2].f * kernel_gamma, &pix_min, &pix_max,
+                               &nr_ranges, &range);
+      first = max(pix_min, local_pix_offset);
+      last = min(pix_max, local_pix_last);
+
+      /* Nothing to add here, or too large for any window? */
+      if (first > last || last - first + 1 > max_window) {
+        if (first <= last) cpu_keys[nr_cpu++] = keys[i];
+        keys[i].update = NULL;
+        free(range);
+        continue;
+      }
+    }
+
+    /* Send the batch if this particle does not fit in its window */
+    const int batch_full =
+        i == nr_keys || (window_last >= window_first &&
+                         max(last, window_last) - min(first, window_first) + 1 >
+                             max_window);
+    if (batch_full && gpu_lightcone.nr_updates > 0) {
+      const size_t window_count = window_last - window_first + 1;
+      if (gpu_lightcone.nr_pixels >= window_count) {
+        healpix_smooth_window_on_gpu(mapper_data, window_first, window_count);
+      } else {
+
+        /* Too sparse for the window to pay off */
+        for (size_t k = first_batch; k < i; k += 1)
+          if (keys[k].update != NULL) cpu_keys[nr_cpu++] = keys[k];
+        cuda_lightcone_empty();
+      }
+      window_last = -1;
+    }
+    if (i == nr_keys) break;
+
+    /* Add this particle to the batch */
+    if (window_last < window_first) {
+      window_first = first;
+      window_last = last;
+      first_batch = i;
+    } else {
+      window_first = min(first, window_first);
+      window_last = max(last, window_last);
+    }
+    const union lightcone_map_buffer_entry *value = &keys[i].update[3];
+    for (int j = 0; j < nr_maps; j += 1)
+      values[j] = value[j].f *
+                  shell->map[part_type->map_index[j]].buffer_scale_factor_inv;
+    cuda_lightcone_add(part_vec, keys[i].update[2].f, values, nr_maps, range,
+                       nr_ranges);
+    free(range);
+  }
+
+  /* Smooth what is left on the CPU */
+  threadpool_map(tp, healpix_smooth_update_mapper, cpu_keys, nr_cpu,
+                 sizeof(struct map_update_key), threadpool_auto_chunk_size,
+                 (void *)mapper_data);
+
+  free(values);
+  free(cpu_keys);
+  free(keys);
+}
+#endif
+
+/**
+ * @brief Apply an array of updates to the healpix maps
+ *
+ * @param update_data the array of updates
+ * @param num_elements number of updates in the array
+ * @param tp the #threadpool used to execute the updates
+ * @param mapper_data information about the shell and particle type
+ *
+ */
+static void healpix_apply_updates(
+    union lightcone_map_buffer_entry *update_data, const size_t num_elements,
+    struct threadpool *tp, struct healpix_smoothing_mapper_data *mapper_data) {
+
+  /* Do the smoothed maps on the GPU first, then the rest on the CPU */
+  mapper_data->smoothed_on_gpu =
+      gpu_lightcone.active && mapper_data->part_type->nr_smoothed_maps > 0;
+#ifdef HAVE_CHEALPIX
+  if (mapper_data->smoothed_on_gpu)
+    healpix_smooth_updates_on_gpu(update_data, num_elements, tp, mapper_data);
+#endif
+
+  threadpool_map(tp, healpix_smoothing_mapper, update_data, num_elements,
+                 mapper_data->part_type->buffer_element_size,
+                 threadpool_auto_chunk_size, mapper_data);
+}
+
 /**
  * @brief Apply updates for one particle type to all lightcone maps in a shell
  *
@@ -824,12 +1214,14 @@ void healpix_smoothing_mapper(void *map_data, int num_elements,
  * sphere
  * @param ptype index of the particle type to update
  * @param max_map_update_send_size_mb maximum amount of data each ranks sends
+ * @param reduce_updates whether to merge updates to the same pixel before
+ * sending them
  *
  */
 void lightcone_shell_flush_map_updates_for_type(
     struct lightcone_shell *shell, struct threadpool *tp,
     struct lightcone_particle_type *part_type, int ptype,
-    const double max_map_update_send_size_mb,
+    const double max_map_update_send_size_mb, const int reduce_updates,
     struct projected_kernel_table *kernel_table, int verbose) {
 
   int comm_rank = 0, comm_size = 1;
@@ -846,6 +1238,7 @@ void lightcone_shell_flush_map_updates_for_type(
   mapper_data.comm_size = comm_size;
   mapper_data.sendbuf = NULL;
   mapper_data.kernel_table = kernel_table;
+  mapper_data.smoothed_on_gpu = 0;
 
 #ifdef WITH_MPI
 
@@ -860,6 +1253,13 @@ void lightcone_shell_flush_map_updates_for_type(
     block = block->next;
   }
 
+  /* Merge updates to the same pixel so that we send fewer of them */
+  if (reduce_updates) {
+    const size_t nr_merged = reduce_map_updates(buffer, tp, &mapper_data);
+    if (verbose)
+      message("merged %zu map updates to already updated pixels", nr_merged);
+  }
+
   /* Allocate array with counts and offsets for each block */
   struct buffer_block_info *block_info = (struct buffer_block_info *)malloc(
       sizeof(struct buffer_block_info) * nr_blocks);
@@ -982,9 +1382,7 @@ void lightcone_shell_flush_map_updates_for_type(
                      part_type[ptype].buffer_element_size);
 
     /* Apply received updates to the healpix map */
-    threadpool_map(tp, healpix_smoothing_mapper, recvbuf, total_nr_recv,
-                   part_type[ptype].buffer_element_size,
-                   threadpool_auto_chunk_size, &mapper_data);
+    healpix_apply_updates(recvbuf, total_nr_recv, tp, &mapper_data);
 
     /* Tidy up */
     free(send_count);
@@ -1017,13 +1415,11 @@ void lightcone_shell_flush_map_updates_for_type(
    */
   struct particle_buffer_block *block = NULL;
   size_t num_elements;
-  double *update_data;
+  union lightcone_map_buffer_entry *update_data;
   do {
     particle_buffer_iterate(&shell->buffer[ptype], &block, &num_elements,
                             (void **)&update_data);
-    threadpool_map(tp, healpix_smoothing_mapper, update_data, num_elements,
-                   part_type[ptype].buffer_element_size,
-                   threadpool_auto_chunk_size, &mapper_data);
+    healpix_apply_updates(update_data, num_elements, tp, &mapper_data);
   } while (block);
   particle_buffer_empty(&shell->buffer[ptype]);
 
@@ -1037,12 +1433,15 @@ void lightcone_shell_flush_map_updates_for_type(
  * @param tp the #threadpool used to execute the updates
  * @param part_type contains information about each particle type to be updated
  * sphere
+ * @param max_map_update_send_size_mb maximum amount of data each ranks sends
+ * @param reduce_updates whether to merge updates to the same pixel before
+ * sending them
  *
  */
 void lightcone_shell_flush_map_updates(
     struct lightcone_shell *shell, struct threadpool *tp,
     struct lightcone_particle_type *part_type,
-    const double max_map_update_send_size_mb,
+    const double max_map_update_send_size_mb, const int reduce_updates,
     struct projected_kernel_table *kernel_table, int verbose) {
 
   if (shell->state != shell_current)
@@ -1050,9 +1449,9 @@ void lightcone_shell_flush_map_updates(
 
   for (int ptype = 0; ptype < swift_type_count; ptype += 1) {
     if ((shell->nr_maps > 0) && (part_type[ptype].nr_maps > 0)) {
-      lightcone_shell_flush_map_updates_for_type(shell, tp, part_type, ptype,
-                                                 max_map_update_send_size_mb,
-                                                 kernel_table, verbose);
+      lightcone_shell_flush_map_updates_for_type(
+          shell, tp, part_type, ptype, max_map_update_send_size_mb,
+          reduce_updates, kernel_table, verbose);
     }
   }
 }
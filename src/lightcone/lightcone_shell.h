@@ -176,7 +176,7 @@ struct lightcone_shell *lightcone_shell_array_restore(
 void lightcone_shell_flush_map_updates(
     struct lightcone_shell *shell, struct threadpool *tp,
     struct lightcone_particle_type *part_type,
-    const double max_map_update_send_size_mb,
+    const double max_map_update_send_size_mb, const int reduce_updates,
     struct projected_kernel_table *kernel_table, int verbose);
 
 #endif /* SWIFT_LIGHTCONE_SHELL_H */
@@ -39,11 +39,15 @@
 #include <stdlib.h>
 
 /**
- * @brief Will the line of sight intersect a given cell?
+ * @brief Could the line of sight intersect the kernel of a part in a cell?
+ *
+ * The cell is grown by how far its parts drifted since the last rebuild and
+ * compared with the largest kernel it contains, so this is a conservative
+ * test that can be used at any level of the tree.
  *
  * Also return 0 if the cell is empty.
  *
- * @param c The top level cell.
+ * @param c The cell (top-level or not).
  * @param los The line of sight structure.
  */
 static INLINE int does_los_intersect(const struct cell *c,
@@ -52,45 +56,81 @@ static INLINE int does_los_intersect(const struct cell *c,
   /* Empty cell? */
   if (c->hydro.count == 0) return 0;
 
-#ifdef SWIFT_DEBUG_CHECKS
-  if (c->hydro.h_max <= 0.) error("Invalid h_max for does_los_intersect");
-#endif
+  /* How far the parts may have strayed out of the cell. */
+  const double margin = 1.01 * c->hydro.dx_max_part;
+
+  /* Is the cell outwith the allowed z-range? */
+  const double cz_min = c->loc[los->zaxis] - margin;
+  const double cz_max = c->loc[los->zaxis] + c->width[los->zaxis] + margin;
+  if (cz_max < los->range_when_shooting_down_axis[0] ||
+      cz_min > los->range_when_shooting_down_axis[1])
+    return 0;
+
+  /* Distance from LOS to the cell centre. */
+  double dx = los->Xpos - (c->loc[los->xaxis] + 0.5 * c->width[los->xaxis]);
+  double dy = los->Ypos - (c->loc[los->yaxis] + 0.5 * c->width[los->yaxis]);
 
-  /* Distance from LOS to left and bottom cell edge. */
-  const double cx_min = c->loc[los->xaxis];
-  const double cy_min = c->loc[los->yaxis];
+  /* Periodic wrap. */
+  if (los->periodic) {
+    dx = nearest(dx, los->dim[los->xaxis]);
+    dy = nearest(dy, los->dim[los->yaxis]);
+  }
 
-  /* Distance from LOS to right and top cell edge. */
-  const double cx_max = c->loc[los->xaxis] + c->width[los->xaxis];
-  const double cy_max = c->loc[los->yaxis] + c->width[los->yaxis];
+  /* Distance from LOS to the cell edges (0 if it goes through the cell). */
+  dx = max(fabs(dx) - 0.5 * c->width[los->xaxis] - margin, 0.);
+  dy = max(fabs(dy) - 0.5 * c->width[los->yaxis] - margin, 0.);
 
-  /* Maximum smoothing length of a part in this top level cell. */
+  /* Maximum smoothing length of a part in this cell. */
   const double hsml = c->hydro.h_max * kernel_gamma;
-  const double hsml2 = hsml * hsml;
 
-  double dx, dy;
+  /* Could a part from this cell smooth into the sightline? */
+  return dx * dx + dy * dy <= hsml * hsml;
+}
 
-  if (los->periodic) {
-    dx = min(fabs(nearest(cx_min - los->Xpos, los->dim[los->xaxis])),
-             fabs(nearest(cx_max - los->Xpos, los->dim[los->xaxis])));
-    dy = min(fabs(nearest(cy_min - los->Ypos, los->dim[los->yaxis])),
-             fabs(nearest(cy_max - los->Ypos, los->dim[los->yaxis])));
-  } else {
-    dx = fabs(cx_max - los->Xpos);
-    dy = fabs(cy_max - los->Ypos);
-  }
+/**
+ * @brief Does the smoothing kernel of a part intersect the line of sight?
+ *
+ * @param p The #part.
+ * @param los The line of sight structure.
+ */
+static INLINE int does_los_intersect_part(const struct part *p,
+                                          const struct line_of_sight *los) {
 
-  /* Is sightline directly within this top level cell? */
-  if (dx < (1.01 * c->width[los->xaxis]) / 2. &&
-      dy < (1.01 * c->width[los->yaxis]) / 2.) {
-    return 1;
-    /* Could a part from this top level cell smooth into the sightline? */
-  } else if (dx * dx + dy * dy < hsml2) {
-    return 1;
-    /* Don't need to work with this top level cell. */
-  } else {
+  /* Don't consider inhibited parts. */
+  if (p->time_bin == time_bin_inhibited) return 0;
+  if (p->time_bin == time_bin_not_created) return 0;
+
+  /* Don't consider part if outwith allowed z-range. */
+  if (p->x[los->zaxis] < los->range_when_shooting_down_axis[0] ||
+      p->x[los->zaxis] > los->range_when_shooting_down_axis[1])
     return 0;
-  }
+
+  /* Smoothing length of this part. */
+  const double hsml = p->h * kernel_gamma;
+  const double hsml2 = hsml * hsml;
+
+  /* Distance from this part to LOS along x dim. */
+  double dx = p->x[los->xaxis] - los->Xpos;
+
+  /* Periodic wrap. */
+  if (los->periodic) dx = nearest(dx, los->dim[los->xaxis]);
+
+  /* Does this part fall into our LOS? */
+  const double dx2 = dx * dx;
+  if (dx2 >= hsml2) return 0;
+
+  /* Distance from this part to LOS along y dim. */
+  double dy = p->x[los->yaxis] - los->Ypos;
+
+  /* Periodic wrap. */
+  if (los->periodic) dy = nearest(dy, los->dim[los->yaxis]);
+
+  /* Does this part still fall into our LOS? */
+  const double dy2 = dy * dy;
+  if (dy2 >= hsml2) return 0;
+
+  /* 2D distance to LOS. */
+  return dx2 + dy2 <= hsml2;
 }
 
 /**
@@ -628,117 +668,138 @@ void los_first_loop_mapper(void *restrict map_data, int count,
   size_t los_particle_count = 0;
 
   /* Loop over each part to find those in LOS. */
-  for (int i = 0; i < count; i++) {
-
-    /* Don't consider inhibited parts. */
-    if (parts[i].time_bin == time_bin_inhibited) continue;
+  for (int i = 0; i < count; i++)
+    los_particle_count += does_los_intersect_part(&parts[i], LOS_list);
 
-    /* Don't consider part if outwith allowed z-range. */
-    if (parts[i].x[LOS_list->zaxis] <
-            LOS_list->range_when_shooting_down_axis[0] ||
-        parts[i].x[LOS_list->zaxis] >
-            LOS_list->range_when_shooting_down_axis[1])
-      continue;
-
-    /* Distance from this part to LOS along x dim. */
-    double dx = parts[i].x[LOS_list->xaxis] - LOS_list->Xpos;
-
-    /* Periodic wrap. */
-    if (LOS_list->periodic) dx = nearest(dx, LOS_list->dim[LOS_list->xaxis]);
-
-    /* Square. */
-    const double dx2 = dx * dx;
+  atomic_add(&LOS_list->particles_in_los_local, los_particle_count);
+}
 
-    /* Smoothing length of this part. */
-    const double hsml = parts[i].h * kernel_gamma;
-    const double hsml2 = hsml * hsml;
+/**
+ * @brief Count the parts of a cell that intersect a LOS.
+ *
+ * Only the progeny the sightline can reach are recursed into.
+ *
+ * @param c The cell.
+ * @param los The line_of_sight structure.
+ */
+static int los_count_in_cell(const struct cell *c,
+                             const struct line_of_sight *los) {
 
-    /* Does this particle fall into our LOS? */
-    if (dx2 < hsml2) {
+  if (!does_los_intersect(c, los)) return 0;
 
-      /* Distance from this part to LOS along y dim. */
-      double dy = parts[i].x[LOS_list->yaxis] - LOS_list->Ypos;
+  int count = 0;
+  if (c->split) {
+    for (int k = 0; k < 8; k++)
+      if (c->progeny[k] != NULL) count += los_count_in_cell(c->progeny[k], los);
+  } else {
+    for (int i = 0; i < c->hydro.count; i++)
+      count += does_los_intersect_part(&c->hydro.parts[i], los);
+  }
+  return count;
+}
 
-      /* Periodic wrap. */
-      if (LOS_list->periodic) dy = nearest(dy, LOS_list->dim[LOS_list->yaxis]);
+/**
+ * @brief Copy the parts of a cell that intersect a LOS to the LOS arrays.
+ *
+ * Only the progeny the sightline can reach are recursed into.
+ *
+ * @param c The cell.
+ * @param los The line_of_sight structure.
+ * @param LOS_parts The #part of the LOS.
+ * @param LOS_xparts The #xpart of the LOS.
+ * @param LOS_gparts The #gpart of the LOS.
+ * @param count (return) The number of parts copied so far.
+ */
+static void los_collect_in_cell(const struct cell *c,
+                                const struct line_of_sight *los,
+                                struct part *LOS_parts,
+                                struct xpart *LOS_xparts,
+                                struct gpart *LOS_gparts, int *count) {
+
+  if (!does_los_intersect(c, los)) return;
+
+  if (c->split) {
+    for (int k = 0; k < 8; k++)
+      if (c->progeny[k] != NULL)
+        los_collect_in_cell(c->progeny[k], los, LOS_parts, LOS_xparts,
+                            LOS_gparts, count);
+  } else {
+    const struct part *cell_parts = c->hydro.parts;
+    const struct xpart *cell_xparts = c->hydro.xparts;
+    for (int i = 0; i < c->hydro.count; i++) {
+      if (!does_los_intersect_part(&cell_parts[i], los)) continue;
+
+      /* Store part and xpart properties. */
+      memcpy(&LOS_parts[*count], &cell_parts[i], sizeof(struct part));
+      memcpy(&LOS_xparts[*count], &cell_xparts[i], sizeof(struct xpart));
+      memcpy(&LOS_gparts[*count], cell_parts[i].gpart, sizeof(struct gpart));
+      (*count)++;
+    }
+  }
+}
 
-      /* Square. */
-      const double dy2 = dy * dy;
+/**
+ * @brief The local cells the #los_count_mapper walks.
+ */
+struct los_count_data {
 
-      /* Does this part still fall into our LOS? */
-      if (dy2 < hsml2) {
+  /*! The array of top-level cells. */
+  const struct cell *cells;
 
-        /* 2D distance to LOS. */
-        if (dx2 + dy2 <= hsml2) {
+  /*! The list of local non-empty top-level cells. */
+  const int *local_cells_with_particles;
 
-          /* We've found one. */
-          los_particle_count++;
-        }
-      }
-    }
-  } /* End of loop over all parts */
-
-  atomic_add(&LOS_list->particles_in_los_local, los_particle_count);
-}
+  /*! The number of local non-empty top-level cells. */
+  int nr_local_cells_with_particles;
+};
 
 /**
- * @brief Find all top level cells that a LOS will intersect.
+ * @brief Count the local top level cells and parts each LOS intersects.
  *
- * This includes the top level cells the LOS directly passes through
- * and the neighbouring top level cells whose parts could smooth into the LOS.
+ * Each sightline walks the trees of the top level cells it could intersect,
+ * so the sightlines are done in parallel and independently of each other.
  *
- * @param e The engine.
- * @param los The line_of_sight structure.
- * @param los_cells_top (return) Array indicating whether this cell is
- * intersected.
- * @param cells The array of top-level cells.
- * @param local_cells_with_particles The list of local non-empty top-level
- * cells.
- * @param nr_local_cells_with_particles The number of local non-empty top-level
- * cells.
+ * @param map_data The line_of_sight structures.
+ * @param num_los The number of line_of_sight structures.
+ * @param extra_data The #los_count_data.
  */
-void find_intersecting_top_level_cells(
-    const struct engine *e, struct line_of_sight *los,
-    int *restrict los_cells_top, const struct cell *cells,
-    const int *restrict local_cells_with_particles,
-    const int nr_local_cells_with_particles) {
+static void los_count_mapper(void *restrict map_data, int num_los,
+                             void *restrict extra_data) {
+
+  struct line_of_sight *LOS_list = (struct line_of_sight *)map_data;
+  const struct los_count_data *data = (const struct los_count_data *)extra_data;
 
-  /* Keep track of how many top level cells we intersect. */
-  int num_intersecting_top_level_cells = 0;
+  for (int j = 0; j < num_los; j++) {
+    struct line_of_sight *los = &LOS_list[j];
 
-  /* Loop over each top level cell */
-  for (int n = 0; n < nr_local_cells_with_particles; n++) {
+    int num_intersecting_top_level_cells = 0;
+    int count = 0;
 
-    /* This top level cell. */
-    const struct cell *c = &cells[local_cells_with_particles[n]];
+    /* Loop over each top level cell */
+    for (int n = 0; n < data->nr_local_cells_with_particles; n++) {
+      const struct cell *c = &data->cells[data->local_cells_with_particles[n]];
+      if (!does_los_intersect(c, los)) continue;
 
-    if (does_los_intersect(c, los)) {
       num_intersecting_top_level_cells++;
-      los_cells_top[n] = 1;
+      count += los_count_in_cell(c, los);
     }
-  }
 
-#ifdef WITH_MPI
-  if (MPI_Allreduce(MPI_IN_PLACE, &num_intersecting_top_level_cells, 1, MPI_INT,
-                    MPI_SUM, MPI_COMM_WORLD) != MPI_SUCCESS)
-    error("Failed to allreduce num_intersecting_top_level_cells.");
-#endif
-
-  /* Store how many top level cells this LOS intersects. */
-  los->num_intersecting_top_level_cells = num_intersecting_top_level_cells;
+    los->num_intersecting_top_level_cells = num_intersecting_top_level_cells;
+    los->particles_in_los_local = count;
+  }
 }
 
 /**
  * @brief Main work function for computing line of sights.
  *
  * 1) Construct N random line of sight positions.
- * 2) Loop over each line of sight.
- *  - 2.1) Find which top level cells sightline intersects.
- *  - 2.2) Loop over each part in these top level cells to see which intersect
- * sightline.
- *  - 2.3) Use this count to construct a LOS parts/xparts array.
- *  - 2.4) Loop over each part and extract those in sightline to new array.
- *  - 2.5) Save sightline parts to HDF5 file.
+ * 2) Count the parts in each sightline, walking the cell trees down to the
+ * leaves the sightline can reach (in parallel over the sightlines).
+ * 3) Loop over each line of sight.
+ *  - 3.1) Use the counts to construct a LOS parts/xparts array.
+ *  - 3.2) Walk the trees again and extract the parts in sightline to the new
+ * array.
+ *  - 3.3) Save sightline parts to HDF5 file.
  *
  * @param e The engine.
  */
@@ -795,42 +856,58 @@ void do_line_of_sight(struct engine *e) {
   /* Keep track of the total number of parts in all sightlines. */
   size_t total_num_parts_in_los = 0;
 
+  /* Get list of local non-empty top level cells. */
+  struct los_count_data count_data;
+  count_data.cells = e->s->cells_top;
+  count_data.local_cells_with_particles = e->s->local_cells_with_particles_top;
+  count_data.nr_local_cells_with_particles = s->nr_local_cells_with_particles;
+
+  /* Count the local parts of all the sightlines at once. */
+  threadpool_map(&s->e->threadpool, los_count_mapper, LOS_list,
+                 LOS_params->num_tot, sizeof(struct line_of_sight),
+                 threadpool_uniform_chunk_size, &count_data);
+
+#ifdef WITH_MPI
+  /* Make sure all nodes know how many parts each rank has in each LOS. */
+  int *counts = (int *)malloc(sizeof(int) * e->nr_nodes);
+  int *offsets = (int *)malloc(sizeof(int) * e->nr_nodes);
+  int *local_counts = (int *)malloc(sizeof(int) * LOS_params->num_tot);
+  int *all_counts =
+      (int *)malloc(sizeof(int) * LOS_params->num_tot * e->nr_nodes);
+  int *num_top_level_cells = (int *)malloc(sizeof(int) * LOS_params->num_tot);
+
+  for (int j = 0; j < LOS_params->num_tot; j++) {
+    local_counts[j] = LOS_list[j].particles_in_los_local;
+    num_top_level_cells[j] = LOS_list[j].num_intersecting_top_level_cells;
+  }
+
+  /* How many parts does each rank have for each LOS? */
+  MPI_Allgather(local_counts, LOS_params->num_tot, MPI_INT, all_counts,
+                LOS_params->num_tot, MPI_INT, MPI_COMM_WORLD);
+
+  /* How many top level cells does each LOS intersect? */
+  if (MPI_Allreduce(MPI_IN_PLACE, num_top_level_cells, LOS_params->num_tot,
+                    MPI_INT, MPI_SUM, MPI_COMM_WORLD) != MPI_SUCCESS)
+    error("Failed to allreduce num_intersecting_top_level_cells.");
+
+  for (int j = 0; j < LOS_params->num_tot; j++)
+    LOS_list[j].num_intersecting_top_level_cells = num_top_level_cells[j];
+
+  free(local_counts);
+  free(num_top_level_cells);
+#endif
+
   /* ------------------------------- */
   /* Main loop over each random LOS. */
   /* ------------------------------- */
 
-  /* Get list of local non-empty top level cells. */
-  const struct cell *cells = e->s->cells_top;
-  const int *local_cells_with_particles = e->s->local_cells_with_particles_top;
-  const int nr_local_cells_with_particles = s->nr_local_cells_with_particles;
-
   /* Loop over each random LOS. */
   for (int j = 0; j < LOS_params->num_tot; j++) {
 
-    /* Create empty top level cell list for this LOS */
-    int *los_cells_top = (int *)swift_malloc(
-        "tl_cells_los", nr_local_cells_with_particles * sizeof(int));
-    bzero(los_cells_top, nr_local_cells_with_particles * sizeof(int));
-
-    /* Find all top level cells this LOS will intersect. */
-    find_intersecting_top_level_cells(e, &LOS_list[j], los_cells_top, cells,
-                                      local_cells_with_particles,
-                                      nr_local_cells_with_particles);
-
-    /* Next count all the parts that intersect with this line of sight */
-    for (int n = 0; n < nr_local_cells_with_particles; n++) {
-      if (los_cells_top[n] == 1) {
-        const struct cell *c = &cells[local_cells_with_particles[n]];
-        threadpool_map(&s->e->threadpool, los_first_loop_mapper, c->hydro.parts,
-                       c->hydro.count, sizeof(struct part),
-                       threadpool_auto_chunk_size, &LOS_list[j]);
-      }
-    }
-
 #ifdef SWIFT_DEBUG_CHECKS
     /* Confirm we are capturing all the parts that intersect the LOS by redoing
      * the count looping over all parts in the space (not just those in the
-     * subset of top level cells). */
+     * subset of cells). */
 
     struct part *parts = s->parts;
     const size_t nr_parts = s->nr_parts;
@@ -849,17 +926,12 @@ void do_line_of_sight(struct engine *e) {
 #endif
 
 #ifdef WITH_MPI
-    /* Make sure all nodes know how many parts are in this LOS */
-    int *counts = (int *)malloc(sizeof(int) * e->nr_nodes);
-    int *offsets = (int *)malloc(sizeof(int) * e->nr_nodes);
-
-    /* How many parts does each rank have for this LOS? */
-    MPI_Allgather(&LOS_list[j].particles_in_los_local, 1, MPI_INT, counts, 1,
-                  MPI_INT, MPI_COMM_WORLD);
-
     int offset_count = 0;
     for (int k = 0; k < e->nr_nodes; k++) {
 
+      /* Parts of this LOS on rank k. */
+      counts[k] = all_counts[k * LOS_params->num_tot + j];
+
       /* Total parts in this LOS. */
       LOS_list[j].particles_in_los_total += counts[k];
 
@@ -881,13 +953,6 @@ void do_line_of_sight(struct engine *e) {
         message("*WARNING* LOS %i is empty", j);
         print_los_info(LOS_list, j);
       }
-#ifdef WITH_MPI
-      free(counts);
-      counts = NULL;
-      free(offsets);
-      offsets = NULL;
-#endif
-      swift_free("tl_cells_los", los_cells_top);
       continue;
     }
 
@@ -931,75 +996,13 @@ void do_line_of_sight(struct engine *e) {
         error("Failed to allocate LOS gpart memory.");
     }
 
-    /* Loop over each part again, pulling out those in LOS. */
+    /* Walk the cells again, pulling out the parts in LOS. */
     int count = 0;
-
-    for (int n = 0; n < e->s->nr_local_cells_with_particles; ++n) {
-
-      if (los_cells_top[n] == 0) continue;
-
-      const struct cell *c = &cells[local_cells_with_particles[n]];
-      const struct part *cell_parts = c->hydro.parts;
-      const struct xpart *cell_xparts = c->hydro.xparts;
-      const size_t num_parts_in_cell = c->hydro.count;
-
-      for (size_t i = 0; i < num_parts_in_cell; i++) {
-
-        /* Don't consider inhibited parts. */
-        if (cell_parts[i].time_bin == time_bin_inhibited) continue;
-        if (cell_parts[i].time_bin == time_bin_not_created) continue;
-
-        /* Don't consider part if outwith allowed z-range. */
-        if (cell_parts[i].x[LOS_list[j].zaxis] <
-                LOS_list[j].range_when_shooting_down_axis[0] ||
-            cell_parts[i].x[LOS_list[j].zaxis] >
-                LOS_list[j].range_when_shooting_down_axis[1])
-          continue;
-
-        /* Distance from this part to LOS along x dim. */
-        double dx = cell_parts[i].x[LOS_list[j].xaxis] - LOS_list[j].Xpos;
-
-        /* Periodic wrap. */
-        if (LOS_list[j].periodic)
-          dx = nearest(dx, LOS_list[j].dim[LOS_list[j].xaxis]);
-
-        /* Square */
-        const double dx2 = dx * dx;
-
-        /* Smoothing length of this part. */
-        const double hsml = cell_parts[i].h * kernel_gamma;
-        const double hsml2 = hsml * hsml;
-
-        /* Does this part fall into our LOS? */
-        if (dx2 < hsml2) {
-
-          /* Distance from this part to LOS along y dim. */
-          double dy = cell_parts[i].x[LOS_list[j].yaxis] - LOS_list[j].Ypos;
-
-          /* Periodic wrap. */
-          if (LOS_list[j].periodic)
-            dy = nearest(dy, LOS_list[j].dim[LOS_list[j].yaxis]);
-
-          /* Square */
-          const double dy2 = dy * dy;
-
-          /* Does this part still fall into our LOS? */
-          if (dy2 < hsml2) {
-            /* 2D distance to LOS. */
-
-            if (dx2 + dy2 <= hsml2) {
-
-              /* Store part and xpart properties. */
-              memcpy(&LOS_parts[count], &cell_parts[i], sizeof(struct part));
-              memcpy(&LOS_xparts[count], &cell_xparts[i], sizeof(struct xpart));
-              memcpy(&LOS_gparts[count], cell_parts[i].gpart,
-                     sizeof(struct gpart));
-
-              count++;
-            }
-          }
-        }
-      }
+    for (int n = 0; n < count_data.nr_local_cells_with_particles; ++n) {
+      const struct cell *c =
+          &count_data.cells[count_data.local_cells_with_particles[n]];
+      los_collect_in_cell(c, &LOS_list[j], LOS_parts, LOS_xparts, LOS_gparts,
+                          &count);
     }
 
 #ifdef SWIFT_DEBUG_CHECKS
@@ -1072,17 +1075,18 @@ void do_line_of_sight(struct engine *e) {
     }
 
     /* Free up some memory */
-#ifdef WITH_MPI
-    free(counts);
-    free(offsets);
-#endif
-    swift_free("tl_cells_los", los_cells_top);
     swift_free("los_parts_array", LOS_parts);
     swift_free("los_xparts_array", LOS_xparts);
     swift_free("los_gparts_array", LOS_gparts);
 
   } /* End of loop over each LOS */
 
+#ifdef WITH_MPI
+  free(counts);
+  free(offsets);
+  free(all_counts);
+#endif
+
   if (e->nodeID == 0) {
     /* Write header */
     write_hdf5_header(h_file, e, LOS_params, total_num_parts_in_los);
@@ -0,0 +1,583 @@
+/* Config parameters. */
+#include <config.h>
+
+#ifdef HAVE_FFTW
+#include <fftw3.h>
+#if defined(WITH_MPI) && defined(HAVE_MPI_FFTW)
+#include <fftw3-mpi.h>
+#endif
+#endif
+
+/* This object's header. */
+#include "lpt_ics.h"
+
+/* System includes. */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* MPI headers. */
+#ifdef WITH_MPI
+#include <mpi.h>
+#endif
+
+/* Local headers. */
+#include "cosmology.h"
+#include "engine.h"
+#include "error.h"
+#include "inline.h"
+#include "memuse.h"
+#include "mesh_gravity.h"
+#include "part.h"
+#include "random.h"
+
+/*! Growth of the second-order displacements relative to the square of the
+ *  linear growth (Bouchet et al. 1995) */
+#define lpt_ics_D2_factor (-3. / 7.)
+
+/**
+ * @brief Read the LPT ICs parameters and, on rank 0, their power spectrum.
+ *
+ * The power spectrum file has two columns, the comoving wave number and the
+ * linear power spectrum at the start of the run, both in internal units.
+ * Lines starting with a '#' are skipped.
+ *
+ * @param lpt The #lpt_ics to fill.
+ * @param params The #swift_params.
+ * @param nr_threads The number of threads FFTW can use.
+ */
+void lpt_ics_init(struct lpt_ics *lpt, struct swift_params *params,
+                  const int nr_threads) {
+
+  bzero(lpt, sizeof(struct lpt_ics));
+  lpt->enabled = parser_get_opt_param_int(params, "LPTICs:enable", 0);
+  if (!lpt->enabled) return;
+
+  lpt->side = parser_get_param_int(params, "LPTICs:particles_per_side");
+  lpt->box_size = parser_get_param_double(params, "LPTICs:box_size");
+  lpt->seed = parser_get_opt_param_longlong(params, "LPTICs:random_seed", 1);
+  lpt->second_order =
+      parser_get_opt_param_int(params, "LPTICs:second_order", 1);
+  lpt->nr_threads = nr_threads;
+  parser_get_param_string(params, "LPTICs:power_spectrum_file_name",
+                          lpt->power_spectrum_file_name);
+
+  if (lpt->side < 2 || lpt->side % 2 != 0)
+    error("The LPT ICs need an even number of particles a side (got %d).",
+          lpt->side);
+  if (lpt->box_size <= 0.)
+    error("Invalid size of the box of the LPT ICs (%e).", lpt->box_size);
+
+  int rank = 0;
+#ifdef WITH_MPI
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+#endif
+
+  /* Read the table on rank 0 */
+  if (rank == 0) {
+    FILE *file = fopen(lpt->power_spectrum_file_name, "r");
+    if (file == NULL)
+      error("Could not open the power spectrum file '%s'.",
+            lpt->power_spectrum_file_name);
+
+    int size = 0;
+    char line[PARSER_MAX_LINE_SIZE];
+    while (fgets(line, sizeof(line), file) != NULL) {
+      if (line[0] == '#' || line[0] == '\n') continue;
+
+      double k, P;
+      if (sscanf(line, "%lf %lf", &k, &P) != 2)
+        error("Invalid line in the power spectrum file '%s': %s",
+              lpt->power_spectrum_file_name, line);
+      if (k <= 0. || P <= 0.)
+        error("The power spectrum file '%s' must only contain positive "
+              "entries (got k=%e P=%e).",
+              lpt->power_spectrum_file_name, k, P);
+
+      if (lpt->nr_bins == size) {
+        size = size > 0 ? 2 * size : 256;
+        lpt->log_k = (double *)realloc(lpt->log_k, size * sizeof(double));
+        lpt->log_P = (double *)realloc(lpt->log_P, size * sizeof(double));
+        if (lpt->log_k == NULL || lpt->log_P == NULL)
+          error("Failed to allocate the power spectrum table.");
+      }
+      lpt->log_k[lpt->nr_bins] = log(k);
+      lpt->log_P[lpt->nr_bins] = log(P);
+      if (lpt->nr_bins > 0 &&
+          lpt->log_k[lpt->nr_bins] <= lpt->log_k[lpt->nr_bins - 1])
+        error("The wave numbers of the power spectrum file '%s' must be "
+              "increasing.",
+              lpt->power_spectrum_file_name);
+      lpt->nr_bins++;
+    }
+    fclose(file);
+
+    if (lpt->nr_bins < 2)
+      error("The power spectrum file '%s' needs at least two entries.",
+            lpt->power_spectrum_file_name);
+
+    /* The modes of the mesh, from the fundamental to the corner */
+    const double k_min = 2. * M_PI / lpt->box_size;
+    const double k_max = sqrt(3.) * M_PI * lpt->side / lpt->box_size;
+    if (lpt->log_k[0] > log(k_min) || lpt->log_k[lpt->nr_bins - 1] < log(k_max))
+      warning("The power spectrum table [%e, %e] does not cover the modes of "
+              "the ICs [%e, %e], the missing ones will be empty.",
+              exp(lpt->log_k[0]), exp(lpt->log_k[lpt->nr_bins - 1]), k_min,
+              k_max);
+  }
+
+#ifdef WITH_MPI
+  MPI_Bcast(&lpt->nr_bins, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if (rank != 0) {
+    lpt->log_k = (double *)malloc(lpt->nr_bins * sizeof(double));
+    lpt->log_P = (double *)malloc(lpt->nr_bins * sizeof(double));
+    if (lpt->log_k == NULL || lpt->log_P == NULL)
+      error("Failed to allocate the power spectrum table.");
+  }
+  MPI_Bcast(lpt->log_k, lpt->nr_bins, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  MPI_Bcast(lpt->log_P, lpt->nr_bins, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+#endif
+}
+
+/**
+ * @brief Free the power spectrum table of the LPT ICs.
+ *
+ * @param lpt The #lpt_ics.
+ */
+void lpt_ics_clean(struct lpt_ics *lpt) {
+
+  free(lpt->log_k);
+  free(lpt->log_P);
+  lpt->log_k = NULL;
+  lpt->log_P = NULL;
+  lpt->nr_bins = 0;
+}
+
+#ifdef HAVE_FFTW
+
+/**
+ * @brief The linear power spectrum, interpolated in log-log space.
+ *
+ * @param lpt The #lpt_ics.
+ * @param k The comoving wave number.
+ *
+ * @return P(k), 0 outside of the table.
+ */
+static double lpt_ics_power(const struct lpt_ics *lpt, const double k) {
+
+  const double log_k = log(k);
+  if (log_k < lpt->log_k[0] || log_k > lpt->log_k[lpt->nr_bins - 1]) return 0.;
+
+  int low = 0, high = lpt->nr_bins - 1;
+  while (high - low > 1) {
+    const int mid = (low + high) / 2;
+    if (lpt->log_k[mid] <= log_k)
+      low = mid;
+    else
+      high = mid;
+  }
+
+  const double w =
+      (log_k - lpt->log_k[low]) / (lpt->log_k[high] - lpt->log_k[low]);
+  return exp(lpt->log_P[low] + w * (lpt->log_P[high] - lpt->log_P[low]));
+}
+
+/**
+ * @brief The slab of the FFT mesh of this rank and the plans transforming
+ * it.
+ *
+ * All the transforms are in place on buffers of 2 * nalloc doubles, the last
+ * dimension of the real fields being padded to 2 * (N / 2 + 1). The plans
+ * are made once and executed on whichever buffer is at hand, which FFTW
+ * allows as they all come from fftw_malloc().
+ */
+struct lpt_ics_fft {
+
+  /*! Number of cells on a side. */
+  int N;
+
+  /*! Number of planes of this rank, index of the first one and number of
+   * complex values of the slab. */
+  ptrdiff_t local_n0, local_0_start, nalloc;
+
+  /*! The forward and inverse plans. */
+  fftw_plan forward, inverse;
+};
+
+/**
+ * @brief Allocate a buffer able to hold a field on the slab.
+ */
+static double *lpt_ics_alloc(const struct lpt_ics_fft *fft, const char *name) {
+
+  const size_t size = 2 * fft->nalloc * sizeof(double);
+  double *buff = (double *)fftw_malloc(size);
+  if (buff == NULL) error("Error allocating memory for the LPT %s field", name);
+  memuse_log_allocation(name, buff, 1, size, memuse_policy_none);
+  bzero(buff, size);
+  return buff;
+}
+
+/**
+ * @brief Free a buffer of lpt_ics_alloc().
+ */
+static void lpt_ics_free(double *buff, const char *name) {
+
+  memuse_log_allocation(name, buff, 0, 0, memuse_policy_none);
+  fftw_free(buff);
+}
+
+/**
+ * @brief Find the slab of this rank and make the plans.
+ */
+static void lpt_ics_fft_init(struct lpt_ics_fft *fft, const int N,
+                             const int nr_threads) {
+
+  fft->N = N;
+  initialise_fftw(N, nr_threads);
+
+#if defined(WITH_MPI) && defined(HAVE_MPI_FFTW)
+  fft->nalloc = fftw_mpi_local_size_3d((ptrdiff_t)N, (ptrdiff_t)N,
+                                       (ptrdiff_t)(N / 2 + 1), MPI_COMM_WORLD,
+                                       &fft->local_n0, &fft->local_0_start);
+#elif defined(WITH_MPI)
+  error("No FFTW MPI library available. Cannot generate the LPT ICs.");
+#else
+  fft->nalloc = (ptrdiff_t)N * N * (N / 2 + 1);
+  fft->local_n0 = N;
+  fft->local_0_start = 0;
+#endif
+
+  /* Estimated plans leave the buffer untouched */
+  double *buff = lpt_ics_alloc(fft, "lpt_plan");
+#if defined(WITH_MPI) && defined(HAVE_MPI_FFTW)
+  fft->forward = fftw_mpi_plan_dft_r2c_3d(N, N, N, buff, (fftw_complex *)buff,
+                                          MPI_COMM_WORLD, FFTW_ESTIMATE);
+  fft->inverse = fftw_mpi_plan_dft_c2r_3d(N, N, N, (fftw_complex *)buff, buff,
+                                          MPI_COMM_WORLD, FFTW_ESTIMATE);
+#else
+  fft->forward = fftw_plan_dft_r2c_3d(N, N, N, buff, (fftw_complex *)buff,
+                                      FFTW_ESTIMATE);
+  fft->inverse = fftw_plan_dft_c2r_3d(N, N, N, (fftw_complex *)buff, buff,
+                                      FFTW_ESTIMATE);
+#endif
+  if (fft->forward == NULL || fft->inverse == NULL)
+    error("Failed to make the FFTW plans of the LPT ICs");
+  lpt_ics_free(buff, "lpt_plan");
+}
+
+/**
+ * @brief Transform a real field to Fourier space, in place.
+ */
+static void lpt_ics_fft_forward(const struct lpt_ics_fft *fft, double *buff) {
+#if defined(WITH_MPI) && defined(HAVE_MPI_FFTW)
+  fftw_mpi_execute_dft_r2c(fft->forward, buff, (fftw_complex *)buff);
+#else
+  fftw_execute_dft_r2c(fft->forward, buff, (fftw_complex *)buff);
+#endif
+}
+
+/**
+ * @brief Transform a field back to real space, in place.
+ */
+static void lpt_ics_fft_inverse(const struct lpt_ics_fft *fft, double *buff) {
+#if defined(WITH_MPI) && defined(HAVE_MPI_FFTW)
+  fftw_mpi_execute_dft_c2r(fft->inverse, (fftw_complex *)buff, buff);
+#else
+  fftw_execute_dft_c2r(fft->inverse, (fftw_complex *)buff, buff);
+#endif
+}
+
+/**
+ * @brief The comoving wave vector of a mode of the slab.
+ *
+ * @return The wave number, 0 for the mean and for the Nyquist modes, which
+ * are left empty.
+ */
+static double lpt_ics_wave_vector(const struct lpt_ics_fft *fft,
+                                  const double box_size, const ptrdiff_t i,
+                                  const int j, const int l, double k[3]) {
+
+  const int N = fft->N;
+  const int n[3] = {(int)(fft->local_0_start + i), j, l};
+  if (n[0] == N / 2 || n[1] == N / 2 || n[2] == N / 2) return 0.;
+
+  for (int d = 0; d < 3; d++)
+    k[d] = 2. * M_PI * (n[d] < N / 2 ? n[d] : n[d] - N) / box_size;
+  return sqrt(k[0] * k[0] + k[1] * k[1] + k[2] * k[2]);
+}
+
+/**
+ * @brief Derive a field in Fourier space.
+ *
+ * Fills out with -i k_a / k^2 * in (the gradient of the inverse Laplacian)
+ * if b < 0, with k_a k_b / k^2 * in (a second derivative of the inverse
+ * Laplacian, minus sign included) otherwise. Both are times norm.
+ *
+ * @param fft The #lpt_ics_fft.
+ * @param box_size The size of the box.
+ * @param in The field to derive, in Fourier space.
+ * @param out (return) The derivative, in Fourier space.
+ * @param a The first direction.
+ * @param b The second direction, -1 for a gradient.
+ * @param norm The factor applied to the result.
+ */
+static void lpt_ics_derive(const struct lpt_ics_fft *fft,
+                           const double box_size, const double *in,
+                           double *out, const int a, const int b,
+                           const double norm) {
+
+  const int N = fft->N;
+  const fftw_complex *restrict c_in = (const fftw_complex *)in;
+  fftw_complex *restrict c_out = (fftw_complex *)out;
+
+  for (ptrdiff_t i = 0; i < fft->local_n0; i++) {
+    for (int j = 0; j < N; j++) {
+      for (int l = 0; l <= N / 2; l++) {
+        const size_t index = ((size_t)i * N + j) * (N / 2 + 1) + l;
+        double k[3];
+        const double k_norm = lpt_ics_wave_vector(fft, box_size, i, j, l, k);
+        if (k_norm == 0.) {
+          c_out[index][0] = c_out[index][1] = 0.;
+          continue;
+        }
+
+        const double k2_inv = norm / (k_norm * k_norm);
+        const double re = c_in[index][0], im = c_in[index][1];
+        if (b < 0) {
+          c_out[index][0] = im * k[a] * k2_inv;
+          c_out[index][1] = -re * k[a] * k2_inv;
+        } else {
+          c_out[index][0] = re * k[a] * k[b] * k2_inv;
+          c_out[index][1] = im * k[a] * k[b] * k2_inv;
+        }
+      }
+    }
+  }
+}
+
+/**
+ * @brief Index of a cell of the slab in a padded real field.
+ */
+__attribute__((always_inline)) INLINE static size_t lpt_ics_real_index(
+    const int N, const ptrdiff_t i, const int j, const int l) {
+  return ((size_t)i * N + j) * (2 * (N / 2 + 1)) + l;
+}
+
+#endif /* HAVE_FFTW */
+
+/**
+ * @brief Generate the cosmological ICs of a run.
+ *
+ * A unit white noise is drawn on the cells of the mesh, from a generator
+ * seeded by the index of the cell such that the field does not depend on the
+ * number of ranks, and coloured by the power spectrum in Fourier space. The
+ * particles start at the nodes of the mesh and are moved by the Zel'dovich
+ * displacement psi1 = -grad(phi1), with laplacian(phi1) = delta, and, if
+ * asked for, by the second-order one D2 grad(phi2), with laplacian(phi2) =
+ * sum_{i>j} phi1_ii phi1_jj - phi1_ij^2 and D2 = -3/7. Their velocities
+ * follow from the growth rates of the two orders, f1 = Omega_m(a)^(5/9) and
+ * f2 = 2 Omega_m(a)^(6/11).
+ *
+ * Each rank makes the particles of its slab of the FFT mesh, the engine then
+ * distributes them as it would after reading a file.
+ *
+ * @param lpt The #lpt_ics.
+ * @param cosmo The #cosmology.
+ * @param dim (return) The size of the box.
+ * @param gparts (return) The gravity particles.
+ * @param Ngpart (return) The number of gravity particles on this rank.
+ * @param nodeID The rank of this node.
+ * @param nr_nodes The number of nodes.
+ */
+void lpt_ics_generate(const struct lpt_ics *lpt,
+                      const struct cosmology *cosmo, double dim[3],
+                      struct gpart **gparts, size_t *Ngpart, const int nodeID,
+                      const int nr_nodes) {
+
+#ifdef HAVE_FFTW
+
+  const int N = lpt->side;
+  const double box_size = lpt->box_size;
+  const double delta_x = box_size / N;
+  const double N3 = (double)N * N * N;
+  const double volume = box_size * box_size * box_size;
+  const double mass = (cosmo->Omega_cdm + cosmo->Omega_b) *
+                      cosmo->critical_density_0 * delta_x * delta_x * delta_x;
+
+  /* The growth rates, in the internal velocities a^2 dx/dt */
+  const double E2 = cosmo->H * cosmo->H / (cosmo->H0 * cosmo->H0);
+  const double Omega_m_a =
+      (cosmo->Omega_cdm + cosmo->Omega_b) * cosmo->a3_inv / E2;
+  const double vel_fac = cosmo->a * cosmo->a * cosmo->H;
+  const double vel_fac_1 = vel_fac * pow(Omega_m_a, 5. / 9.);
+  const double vel_fac_2 = vel_fac * 2. * pow(Omega_m_a, 6. / 11.);
+
+  struct lpt_ics_fft fft;
+  lpt_ics_fft_init(&fft, N, lpt->nr_threads);
+
+  if (nodeID == 0)
+    message("Generating %d^3 particles with %s LPT in a box of %e on %d "
+            "rank(s).",
+            N, lpt->second_order ? "second-order" : "first-order", box_size,
+            nr_nodes);
+
+  /* Unit Gaussian white noise on the cells (Box-Muller) */
+  double *delta = lpt_ics_alloc(&fft, "lpt_delta");
+  for (ptrdiff_t i = 0; i < fft.local_n0; i++) {
+    for (int j = 0; j < N; j++) {
+      for (int l = 0; l < N; l++) {
+        const long long cell =
+            ((long long)(fft.local_0_start + i) * N + j) * N + l;
+        const double u1 = random_unit_interval(cell, 2 * lpt->seed,
+                                               random_number_lpt_ics);
+        const double u2 = random_unit_interval(cell, 2 * lpt->seed + 1,
+                                               random_number_lpt_ics);
+        delta[lpt_ics_real_index(N, i, j, l)] =
+            sqrt(-2. * log(1. - u1)) * cos(2. * M_PI * u2);
+      }
+    }
+  }
+
+  /* Colour it: the modes then have a variance of P(k) / V once back in real
+   * space, the noise having one of N^3 */
+  lpt_ics_fft_forward(&fft, delta);
+  fftw_complex *c_delta = (fftw_complex *)delta;
+  for (ptrdiff_t i = 0; i < fft.local_n0; i++) {
+    for (int j = 0; j < N; j++) {
+      for (int l = 0; l <= N / 2; l++) {
+        const size_t index = ((size_t)i * N + j) * (N / 2 + 1) + l;
+        double k[3];
+        const double k_norm = lpt_ics_wave_vector(&fft, box_size, i, j, l, k);
+        const double amp =
+            k_norm > 0. ? sqrt(lpt_ics_power(lpt, k_norm) / (N3 * volume))
+                        : 0.;
+        c_delta[index][0] *= amp;
+        c_delta[index][1] *= amp;
+      }
+    }
+  }
+
+  /* The particles, on the nodes of the slab */
+  const size_t count = (size_t)fft.local_n0 * N * N;
+  if (swift_memalign("gparts", (void **)gparts, gpart_align,
+                     count * sizeof(struct gpart)) != 0)
+    error("Error while allocating memory for gravity particles");
+  bzero(*gparts, count * sizeof(struct gpart));
+
+  for (ptrdiff_t i = 0; i < fft.local_n0; i++) {
+    for (int j = 0; j < N; j++) {
+      for (int l = 0; l < N; l++) {
+        const long long global = (fft.local_0_start + i) * N * N + j * N + l;
+        struct gpart *gp = &(*gparts)[((size_t)i * N + j) * N + l];
+        gp->x[0] = (fft.local_0_start + i) * delta_x;
+        gp->x[1] = j * delta_x;
+        gp->x[2] = l * delta_x;
+        gp->mass = mass;
+        gp->id_or_neg_offset = 1 + global;
+        gp->type = swift_type_dark_matter;
+      }
+    }
+  }
+
+  /* The first-order displacements, one direction at a time */
+  double *work = lpt_ics_alloc(&fft, "lpt_work");
+  for (int d = 0; d < 3; d++) {
+    lpt_ics_derive(&fft, box_size, delta, work, d, -1, -1.);
+    lpt_ics_fft_inverse(&fft, work);
+
+    for (ptrdiff_t i = 0; i < fft.local_n0; i++) {
+      for (int j = 0; j < N; j++) {
+        for (int l = 0; l < N; l++) {
+          struct gpart *gp = &(*gparts)[((size_t)i * N + j) * N + l];
+          const double psi = work[lpt_ics_real_index(N, i, j, l)];
+          gp->x[d] += psi;
+          gp->v_full[d] = vel_fac_1 * psi;
+        }
+      }
+    }
+  }
+
+  if (lpt->second_order) {
+
+    /* Source of the second-order potential. The sum of the products of the
+     * diagonal terms is built from a running sum of these terms, then the
+     * squares of the off-diagonal ones are removed */
+    double *source = lpt_ics_alloc(&fft, "lpt_source");
+    double *diag = lpt_ics_alloc(&fft, "lpt_diag");
+    for (int d = 0; d < 3; d++) {
+      lpt_ics_derive(&fft, box_size, delta, work, d, d, 1.);
+      lpt_ics_fft_inverse(&fft, work);
+
+      for (ptrdiff_t i = 0; i < fft.local_n0; i++) {
+        for (int j = 0; j < N; j++) {
+          for (int l = 0; l < N; l++) {
+            const size_t index = lpt_ics_real_index(N, i, j, l);
+            if (d > 0) source[index] += diag[index] * work[index];
+            diag[index] += work[index];
+          }
+        }
+      }
+    }
+    lpt_ics_free(diag, "lpt_diag");
+
+    const int off_diag[3][2] = {{0, 1}, {0, 2}, {1, 2}};
+    for (int m = 0; m < 3; m++) {
+      lpt_ics_derive(&fft, box_size, delta, work, off_diag[m][0],
+                     off_diag[m][1], 1.);
+      lpt_ics_fft_inverse(&fft, work);
+
+      for (ptrdiff_t i = 0; i < fft.local_n0; i++) {
+        for (int j = 0; j < N; j++) {
+          for (int l = 0; l < N; l++) {
+            const size_t index = lpt_ics_real_index(N, i, j, l);
+            source[index] -= work[index] * work[index];
+          }
+        }
+      }
+    }
+
+    /* The second-order displacements D2 grad(phi2) */
+    lpt_ics_fft_forward(&fft, source);
+    for (int d = 0; d < 3; d++) {
+      lpt_ics_derive(&fft, box_size, source, work, d, -1,
+                     lpt_ics_D2_factor / N3);
+      lpt_ics_fft_inverse(&fft, work);
+
+      for (ptrdiff_t i = 0; i < fft.local_n0; i++) {
+        for (int j = 0; j < N; j++) {
+          for (int l = 0; l < N; l++) {
+            struct gpart *gp = &(*gparts)[((size_t)i * N + j) * N + l];
+            const double psi = work[lpt_ics_real_index(N, i, j, l)];
+            gp->x[d] += psi;
+            gp->v_full[d] += vel_fac_2 * psi;
+          }
+        }
+      }
+    }
+    lpt_ics_free(source, "lpt_source");
+  }
+
+  lpt_ics_free(work, "lpt_work");
+  lpt_ics_free(delta, "lpt_delta");
+  fftw_destroy_plan(fft.forward);
+  fftw_destroy_plan(fft.inverse);
+
+  /* Box-wrap the particles */
+  for (size_t k = 0; k < count; k++) {
+    for (int d = 0; d < 3; d++) {
+      double x = (*gparts)[k].x[d];
+      x = fmod(x, box_size);
+      if (x < 0.) x += box_size;
+      if (x >= box_size) x = 0.;
+      (*gparts)[k].x[d] = x;
+    }
+  }
+
+  dim[0] = dim[1] = dim[2] = box_size;
+  *Ngpart = count;
+
+#else
+  error("No FFTW library found. Cannot generate the LPT ICs.");
+#endif
+}
@@ -0,0 +1,64 @@
+#ifndef SWIFT_LPT_ICS_H
+#define SWIFT_LPT_ICS_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* System includes. */
+#include <stddef.h>
+
+/* Local includes. */
+#include "parser.h"
+
+/* Forward declarations */
+struct cosmology;
+struct gpart;
+
+/**
+ * @brief The properties of the cosmological ICs generated at start-up.
+ *
+ * The ICs are a lattice of dark matter particles displaced by second-order
+ * Lagrangian perturbation theory (2LPT) from a Gaussian random field drawn
+ * from a tabulated linear power spectrum. Each rank only makes the particles
+ * of its slab of the FFT mesh.
+ */
+struct lpt_ics {
+
+  /*! Are the ICs generated rather than read? */
+  int enabled;
+
+  /*! Number of particles (and of mesh cells) on a side. */
+  int side;
+
+  /*! Comoving size of the box (internal units). */
+  double box_size;
+
+  /*! Seed of the white noise. */
+  long long seed;
+
+  /*! Do we add the second-order displacements? */
+  int second_order;
+
+  /*! Number of threads handed to FFTW. */
+  int nr_threads;
+
+  /*! Name of the file giving P(k) at the start of the run. */
+  char power_spectrum_file_name[PARSER_MAX_LINE_SIZE];
+
+  /*! Number of entries of the power spectrum table. */
+  int nr_bins;
+
+  /*! The table: log of the comoving wave numbers (internal units) and of the
+   * power spectrum (internal units of length^3). */
+  double *log_k, *log_P;
+};
+
+void lpt_ics_init(struct lpt_ics *lpt, struct swift_params *params,
+                  const int nr_threads);
+void lpt_ics_generate(const struct lpt_ics *lpt,
+                      const struct cosmology *cosmo, double dim[3],
+                      struct gpart **gparts, size_t *Ngpart, const int nodeID,
+                      const int nr_nodes);
+void lpt_ics_clean(struct lpt_ics *lpt);
+
+#endif /* SWIFT_LPT_ICS_H */
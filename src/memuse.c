@@ -27,12 +27,22 @@
 #include <config.h>
 
 /* Standard includes. */
+#include <fcntl.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <unistd.h>
+#ifdef HAVE_MALLOC_USABLE_SIZE
+#include <malloc.h>
+#endif
+
+#ifdef HAVE_LIBNUMA
+#include <numa.h>
+#include <numaif.h>
+#endif
 
 #ifndef SWIFT_MEMUSE_STATM
 #include <sys/resource.h>
@@ -47,10 +57,67 @@
 #include "clocks.h"
 #include "engine.h"
 #include "error.h"
+#include "lock.h"
 #include "memuse_rnodes.h"
+#include "parser.h"
+
+/*! The #memuse_policy given to the labelled large allocations. */
+static int memuse_policy = memuse_policy_none;
+
+/*! The labels of the allocations the #memuse_policy applies to. */
+static const char *memuse_policy_labels[] = {"parts", "xparts", "gparts",
+                                             "cells_top", "gravity_cache"};
+
+/*! The labels of the allocations put in the cold memory tier. */
+static const char *memuse_cold_tier_labels[] = {"xparts", "sparts"};
+
+/*! Directory of the files backing the cold tier, empty if not used. */
+static char memuse_cold_tier_path[PARSER_MAX_LINE_SIZE] = "";
+
+/*! NUMA node of the cold tier, -1 if not used. */
+static int memuse_cold_tier_node = -1;
+
+/*! Maximal number of live allocations in the cold tier. */
+#define memuse_cold_tier_max_count 32
+
+/*! The live allocations in the cold tier and their mapped sizes. */
+static struct {
+  void *ptr;
+  size_t size;
+} memuse_cold_tier_maps[memuse_cold_tier_max_count];
+int memuse_cold_tier_count = 0;
+static swift_lock_type memuse_cold_tier_lock;
+
+/*! Are the live bytes of the labelled allocations counted? */
+int memuse_labels_active = 0;
 
 #ifdef SWIFT_MEMUSE_REPORTS
 
+/**
+ * @brief Short description of a #memuse_policy for the logs.
+ *
+ * @param policy The #memuse_policy.
+ */
+static const char *memuse_policy_name(int policy) {
+
+  switch (policy) {
+    case memuse_policy_huge_pages:
+      return "huge";
+    case memuse_policy_interleave:
+      return "interleave";
+    case memuse_policy_local:
+      return "local";
+    case memuse_policy_huge_pages | memuse_policy_interleave:
+      return "huge+interleave";
+    case memuse_policy_huge_pages | memuse_policy_local:
+      return "huge+local";
+    case memuse_policy_cold_tier:
+      return "cold";
+    default:
+      return "-";
+  }
+}
+
 /* The initial size and increment of the log entries buffer. */
 #define MEMUSE_INITLOG 1000000
 
@@ -76,6 +143,9 @@ struct memuse_log_entry {
   /* Memory allocated in bytes. */
   size_t size;
 
+  /* The #memuse_policy the memory got. */
+  int policy;
+
   /* Address of memory. Use union as easy way to convert into an array of
    * bytes. */
   union {
@@ -180,9 +250,10 @@ static void memuse_log_reallocate(size_t ind) {
  * @param allocated whether this is an allocation or deallocation.
  * @param size the size in byte of memory allocated, set to 0 when
  *             deallocating.
+ * @param policy the #memuse_policy the memory got.
  */
 void memuse_log_allocation(const char *label, void *ptr, int allocated,
-                           size_t size) {
+                           size_t size, int policy) {
 
   size_t ind = atomic_inc(&memuse_log_count);
 
@@ -202,6 +273,7 @@ void memuse_log_allocation(const char *label, void *ptr, int allocated,
   memuse_log[ind].step = engine_current_step;
   memuse_log[ind].allocated = allocated;
   memuse_log[ind].size = size;
+  memuse_log[ind].policy = policy;
   memuse_log[ind].ptr = ptr;
   strncpy(memuse_log[ind].label, label, MEMUSE_MAXLABLEN);
   memuse_log[ind].label[MEMUSE_MAXLABLEN] = '\0';
@@ -248,7 +320,7 @@ void memuse_log_dump(const char *filename) {
     }
 
     /* Write a header. */
-    fprintf(fd, "# dtic step label size sum\n");
+    fprintf(fd, "# dtic step label size sum policy\n");
 
     size_t memuse_maxmem = memuse_current;
     for (size_t k = old_count; k < log_count; k++) {
@@ -318,9 +390,9 @@ void memuse_log_dump(const char *filename) {
       if (memuse_current > memuse_maxmem) memuse_maxmem = memuse_current;
 
       /* And output. */
-      fprintf(fd, "%lld %d %s %zd %zd\n", memuse_log[k].dtic,
+      fprintf(fd, "%lld %d %s %zd %zd %s\n", memuse_log[k].dtic,
               memuse_log[k].step, memuse_log[k].label, memuse_log[k].size,
-              memuse_current);
+              memuse_current, memuse_policy_name(memuse_log[k].policy));
     }
 
 #ifdef MEMUSE_RNODE_DUMP
@@ -550,3 +622,338 @@ const char *memuse_process(int inmb) {
   }
   return buffer;
 }
+
+/**
+ * @brief Starts measuring the peak memory use of a phase of the run.
+ *
+ * Resets the high-water mark of the resident memory of the process kept by
+ * the kernel. Phases cannot be nested.
+ *
+ * @result 1 if the mark was reset, 0 if memuse_phase_peak() will give the
+ * peak since the start of the run.
+ */
+int memuse_phase_begin(void) {
+
+  FILE *file = fopen("/proc/self/clear_refs", "w");
+  if (file == NULL) return 0;
+  int reset = (fprintf(file, "5") == 1);
+  if (fclose(file) != 0) reset = 0;
+  return reset;
+}
+
+/**
+ * @brief The peak resident memory of the process since memuse_phase_begin().
+ *
+ * @result The peak in KB, 0 if not available.
+ */
+long memuse_phase_peak(void) {
+
+  long peak = 0;
+  FILE *file = fopen("/proc/self/status", "r");
+  if (file == NULL) return 0;
+
+  char line[256];
+  while (fgets(line, sizeof(line), file) != NULL)
+    if (sscanf(line, "VmHWM: %ld", &peak) == 1) break;
+  fclose(file);
+  return peak;
+}
+
+/**
+ * @brief Reads the placement policy of the large particle and cell arrays.
+ *
+ * The arrays are put on transparent huge pages, to cut the TLB misses of
+ * their random accesses, and/or given an interleaved or local NUMA policy,
+ * regardless of the interleaving of the rest of the memory. The xparts and
+ * sparts, which are only touched by the active particles, can instead be put
+ * in a slower but larger cold tier. Must be called before the particles are
+ * allocated.
+ *
+ * @param params The parsed parameters.
+ */
+void memuse_policy_init(struct swift_params *params) {
+
+  memuse_policy = memuse_policy_none;
+
+  if (parser_get_opt_param_int(params, "Scheduler:huge_pages", 0)) {
+#ifdef MADV_HUGEPAGE
+    memuse_policy |= memuse_policy_huge_pages;
+#else
+    error("Transparent huge pages are not supported on this system.");
+#endif
+  }
+
+  char numa_policy[PARSER_MAX_LINE_SIZE];
+  parser_get_opt_param_string(params, "Scheduler:numa_policy", numa_policy,
+                              "none");
+  if (strcmp(numa_policy, "none") != 0) {
+#if defined(HAVE_LIBNUMA) && defined(_GNU_SOURCE)
+    if (numa_available() < 0) {
+      message("WARNING: NUMA not available, Scheduler:numa_policy ignored.");
+    } else if (strcmp(numa_policy, "interleave") == 0) {
+      memuse_policy |= memuse_policy_interleave;
+    } else if (strcmp(numa_policy, "local") == 0) {
+      memuse_policy |= memuse_policy_local;
+    } else {
+      error(
+          "Invalid Scheduler:numa_policy '%s', must be none, interleave or "
+          "local.",
+          numa_policy);
+    }
+#else
+    error(
+        "SWIFT was not compiled with NUMA support, Scheduler:numa_policy must "
+        "be none.");
+#endif
+  }
+
+  if (lock_init(&memuse_cold_tier_lock) != 0)
+    error("Failed to initialise the cold tier lock.");
+  parser_get_opt_param_string(params, "Scheduler:cold_tier_path",
+                              memuse_cold_tier_path, "none");
+  if (strcmp(memuse_cold_tier_path, "none") == 0)
+    memuse_cold_tier_path[0] = '\0';
+  memuse_cold_tier_node =
+      parser_get_opt_param_int(params, "Scheduler:cold_tier_numa_node", -1);
+  if (memuse_cold_tier_path[0] != '\0' && memuse_cold_tier_node >= 0)
+    error(
+        "Scheduler:cold_tier_path and Scheduler:cold_tier_numa_node cannot be "
+        "used together.");
+#if !defined(HAVE_LIBNUMA) || !defined(_GNU_SOURCE)
+  if (memuse_cold_tier_node >= 0)
+    error(
+        "SWIFT was not compiled with NUMA support, "
+        "Scheduler:cold_tier_numa_node cannot be used.");
+#else
+  if (memuse_cold_tier_node > numa_max_node())
+    error("Scheduler:cold_tier_numa_node %d is not a NUMA node.",
+          memuse_cold_tier_node);
+#endif
+}
+
+/**
+ * @brief Gets the #memuse_policy an allocation is to be given.
+ *
+ * @param label The label of the allocation.
+ * @param size The size of the allocation in bytes.
+ * @return The #memuse_policy, #memuse_policy_none for small or unlisted
+ * allocations.
+ */
+int memuse_policy_get(const char *label, size_t size) {
+
+  if (size < memuse_huge_page_size) return memuse_policy_none;
+
+  if (memuse_cold_tier_path[0] != '\0' || memuse_cold_tier_node >= 0) {
+    const int nr_cold_labels =
+        sizeof(memuse_cold_tier_labels) / sizeof(memuse_cold_tier_labels[0]);
+    for (int k = 0; k < nr_cold_labels; k++)
+      if (strcmp(label, memuse_cold_tier_labels[k]) == 0)
+        return memuse_policy_cold_tier;
+  }
+
+  if (memuse_policy == memuse_policy_none) return memuse_policy_none;
+
+  const int nr_labels =
+      sizeof(memuse_policy_labels) / sizeof(memuse_policy_labels[0]);
+  for (int k = 0; k < nr_labels; k++)
+    if (strcmp(label, memuse_policy_labels[k]) == 0) return memuse_policy;
+
+  return memuse_policy_none;
+}
+
+/**
+ * @brief Applies a #memuse_policy to some freshly allocated memory.
+ *
+ * Only the whole pages within the allocation are touched. Failures are not
+ * fatal, the memory then simply does not get that part of the policy.
+ *
+ * @param ptr The start of the allocation.
+ * @param size The size of the allocation in bytes.
+ * @param policy The #memuse_policy.
+ * @return The #memuse_policy that was applied.
+ */
+int memuse_policy_apply(void *ptr, size_t size, int policy) {
+
+  int applied = memuse_policy_none;
+
+#ifdef MADV_HUGEPAGE
+  if (policy & memuse_policy_huge_pages) {
+    const size_t first = ((size_t)ptr + memuse_huge_page_size - 1) &
+                         ~((size_t)memuse_huge_page_size - 1);
+    const size_t last =
+        ((size_t)ptr + size) & ~((size_t)memuse_huge_page_size - 1);
+    if (last > first &&
+        madvise((void *)first, last - first, MADV_HUGEPAGE) == 0)
+      applied |= memuse_policy_huge_pages;
+  }
+#endif
+
+#if defined(HAVE_LIBNUMA) && defined(_GNU_SOURCE)
+  if (policy & (memuse_policy_interleave | memuse_policy_local)) {
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    const size_t first = ((size_t)ptr + page_size - 1) & ~(page_size - 1);
+    const size_t last = ((size_t)ptr + size) & ~(page_size - 1);
+    if (last > first) {
+      if (policy & memuse_policy_interleave) {
+        struct bitmask *nodes = numa_get_mems_allowed();
+        if (mbind((void *)first, last - first, MPOL_INTERLEAVE, nodes->maskp,
+                  nodes->size + 1, 0) == 0)
+          applied |= memuse_policy_interleave;
+        numa_free_nodemask(nodes);
+      } else {
+
+        /* A preferred policy with no node is a local one. */
+        if (mbind((void *)first, last - first, MPOL_PREFERRED, NULL, 0, 0) ==
+            0)
+          applied |= memuse_policy_local;
+      }
+    }
+  }
+#endif
+
+  return applied;
+}
+
+/**
+ * @brief Allocates some memory in the cold tier.
+ *
+ * The memory is either mapped from an unlinked file in the directory given by
+ * Scheduler:cold_tier_path, such that the kernel can page it out to that
+ * device rather than to swap, or bound to the (CPU-less, CXL for instance)
+ * NUMA node given by Scheduler:cold_tier_numa_node. The memory is page
+ * aligned and zeroed.
+ *
+ * @param memptr pointer to the allocated memory.
+ * @param alignment alignment boundary, at most the page size.
+ * @param size the quantity of bytes to allocate.
+ * @result zero on success, otherwise an error code.
+ */
+int memuse_cold_tier_alloc(void **memptr, size_t alignment, size_t size) {
+
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  if (alignment > page_size)
+    error("Cold tier allocations cannot be aligned beyond a page.");
+  const size_t mapped = (size + page_size - 1) & ~(page_size - 1);
+
+  void *ptr = MAP_FAILED;
+  if (memuse_cold_tier_path[0] != '\0') {
+
+    char filename[PARSER_MAX_LINE_SIZE + 32];
+    snprintf(filename, sizeof(filename), "%s/swift_cold_tier_XXXXXX",
+             memuse_cold_tier_path);
+    const int fd = mkstemp(filename);
+    if (fd < 0) return -1;
+
+    /* The file disappears with its last mapping. */
+    unlink(filename);
+    if (ftruncate(fd, mapped) == 0)
+      ptr = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+  } else {
+    ptr = mmap(NULL, mapped, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#if defined(HAVE_LIBNUMA) && defined(_GNU_SOURCE)
+    if (ptr != MAP_FAILED) {
+      struct bitmask *nodes = numa_allocate_nodemask();
+      numa_bitmask_setbit(nodes, memuse_cold_tier_node);
+      if (mbind(ptr, mapped, MPOL_BIND, nodes->maskp, nodes->size + 1, 0) !=
+          0) {
+        munmap(ptr, mapped);
+        ptr = MAP_FAILED;
+      }
+      numa_free_nodemask(nodes);
+    }
+#endif
+  }
+  if (ptr == MAP_FAILED) return -1;
+
+  lock_lock(&memuse_cold_tier_lock);
+  if (memuse_cold_tier_count == memuse_cold_tier_max_count)
+    error("Too many allocations in the cold tier.");
+  memuse_cold_tier_maps[memuse_cold_tier_count].ptr = ptr;
+  memuse_cold_tier_maps[memuse_cold_tier_count].size = mapped;
+  memuse_cold_tier_count++;
+  if (lock_unlock(&memuse_cold_tier_lock) != 0)
+    error("Failed to unlock the cold tier.");
+
+  *memptr = ptr;
+  return 0;
+}
+
+/**
+ * @brief Frees some memory if it was allocated in the cold tier.
+ *
+ * @param ptr The memory.
+ * @result 1 if the memory was in the cold tier and is now freed, 0 otherwise.
+ */
+int memuse_cold_tier_free(void *ptr) {
+
+  if (ptr == NULL) return 0;
+
+  int found = 0;
+  lock_lock(&memuse_cold_tier_lock);
+  for (int k = 0; k < memuse_cold_tier_count; k++) {
+    if (memuse_cold_tier_maps[k].ptr == ptr) {
+      if (munmap(ptr, memuse_cold_tier_maps[k].size) != 0)
+        error("Failed to unmap cold tier memory.");
+      memuse_cold_tier_count--;
+      memuse_cold_tier_maps[k] = memuse_cold_tier_maps[memuse_cold_tier_count];
+      found = 1;
+      break;
+    }
+  }
+  if (lock_unlock(&memuse_cold_tier_lock) != 0)
+    error("Failed to unlock the cold tier.");
+  return found;
+}
+
+/**
+ * @brief The mapped size of some memory if it was allocated in the cold tier.
+ *
+ * @param ptr The memory.
+ * @result The size in bytes, 0 if the memory is not in the cold tier.
+ */
+size_t memuse_cold_tier_size(void *ptr) {
+
+  if (ptr == NULL || memuse_cold_tier_count == 0) return 0;
+
+  size_t size = 0;
+  lock_lock(&memuse_cold_tier_lock);
+  for (int k = 0; k < memuse_cold_tier_count; k++) {
+    if (memuse_cold_tier_maps[k].ptr == ptr) {
+      size = memuse_cold_tier_maps[k].size;
+      break;
+    }
+  }
+  if (lock_unlock(&memuse_cold_tier_lock) != 0)
+    error("Failed to unlock the cold tier.");
+  return size;
+}
+
+/**
+ * @brief The size of a live allocation, as counted by memuse_labels_add().
+ *
+ * That is the size the allocator reserved, which may be a bit more than was
+ * asked for, such that the same is added and removed whatever the size
+ * given to the reallocations.
+ *
+ * The pointer is not const as it is given fresh allocations, which GCC
+ * would otherwise think get read while uninitialised.
+ *
+ * @param ptr The memory, can be NULL.
+ * @result The size in bytes.
+ */
+size_t memuse_labels_size(void *ptr) {
+
+  if (ptr == NULL) return 0;
+  const size_t cold = memuse_cold_tier_size(ptr);
+  if (cold > 0) return cold;
+#ifdef HAVE_MALLOC_USABLE_SIZE
+  return malloc_usable_size(ptr);
+#else
+  error("Counting the memory of the labels needs malloc_usable_size().");
+  return 0;
+#endif
+}
+
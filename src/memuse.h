@@ -25,20 +25,53 @@
 /* Includes. */
 #include <stdlib.h>
 
+/* Forward declarations. */
+struct swift_params;
+
+/*! Size of the transparent huge pages */
+#define memuse_huge_page_size 2097152
+
+/**
+ * @brief The placement policies given to the large particle and cell arrays.
+ */
+enum memuse_policy {
+  memuse_policy_none = 0,
+  memuse_policy_huge_pages = (1 << 0),
+  memuse_policy_interleave = (1 << 1),
+  memuse_policy_local = (1 << 2),
+  memuse_policy_cold_tier = (1 << 3),
+};
+
+/*! Number of live allocations in the cold memory tier */
+extern int memuse_cold_tier_count;
+
+/*! Are the live bytes of the labelled allocations counted? */
+extern int memuse_labels_active;
+
 /* API. */
 void memuse_use(long *size, long *resident, long *shared, long *text,
                 long *data, long *library, long *dirty);
 const char *memuse_process(int inmb);
+int memuse_phase_begin(void);
+long memuse_phase_peak(void);
+void memuse_policy_init(struct swift_params *params);
+int memuse_policy_get(const char *label, size_t size);
+int memuse_policy_apply(void *ptr, size_t size, int policy);
+int memuse_cold_tier_alloc(void **memptr, size_t alignment, size_t size);
+int memuse_cold_tier_free(void *ptr);
+size_t memuse_cold_tier_size(void *ptr);
+size_t memuse_labels_size(void *ptr);
+void memuse_labels_add(const char *label, const long long bytes);
 
 #ifdef SWIFT_MEMUSE_REPORTS
 void memuse_log_dump(const char *filename);
 void memuse_log_dump_error(int rank);
 void memuse_log_allocation(const char *label, void *ptr, int allocated,
-                           size_t size);
+                           size_t size, int policy);
 #else
 
 /* No-op when not reporting. */
-#define memuse_log_allocation(label, ptr, allocated, size)
+#define memuse_log_allocation(label, ptr, allocated, size, policy)
 #endif
 
 #ifdef HAVE_LSAN_IGNORE_OBJECT
@@ -75,13 +108,31 @@ __attribute__((always_inline)) inline int swift_memalign(const char *label,
                                                          void **memptr,
                                                          size_t alignment,
                                                          size_t size) {
-  int result = posix_memalign(memptr, alignment, size);
+  int policy = memuse_policy_get(label, size);
+  if ((policy & memuse_policy_huge_pages) && alignment < memuse_huge_page_size)
+    alignment = memuse_huge_page_size;
+
+  /* Only read when the allocation succeeded, but the compiler cannot always
+   * tell through memuse_cold_tier_alloc() */
+  *memptr = NULL;
+  int result;
+  if (policy & memuse_policy_cold_tier) {
+    result = memuse_cold_tier_alloc(memptr, alignment, size);
+    if (result == 0) policy = memuse_policy_cold_tier;
+  } else {
+    result = posix_memalign(memptr, alignment, size);
+  }
+  if (result == 0 && policy != memuse_policy_none &&
+      policy != memuse_policy_cold_tier)
+    policy = memuse_policy_apply(*memptr, size, policy);
+  if (result == 0 && memuse_labels_active)
+    memuse_labels_add(label, memuse_labels_size(*memptr));
 #ifdef SWIFT_MEMUSE_REPORTS
   if (result == 0) {
-    memuse_log_allocation(label, *memptr, 1, size);
+    memuse_log_allocation(label, *memptr, 1, size, policy);
   } else {
     /* Failed allocations are interesting as well. */
-    memuse_log_allocation(label, NULL, -1, size);
+    memuse_log_allocation(label, NULL, -1, size, memuse_policy_none);
   }
 #endif
   return result;
@@ -101,12 +152,17 @@ __attribute__((always_inline)) inline int swift_memalign(const char *label,
 __attribute__((always_inline)) inline void *swift_malloc(const char *label,
                                                          size_t size) {
   void *memptr = malloc(size);
+  int policy = memuse_policy_get(label, size);
+  if (memptr != NULL && policy != memuse_policy_none)
+    policy = memuse_policy_apply(memptr, size, policy);
+  if (memptr != NULL && memuse_labels_active)
+    memuse_labels_add(label, memuse_labels_size(memptr));
 #ifdef SWIFT_MEMUSE_REPORTS
   if (memptr != NULL) {
-    memuse_log_allocation(label, memptr, 1, size);
+    memuse_log_allocation(label, memptr, 1, size, policy);
   } else {
     /* Failed allocations are interesting as well. */
-    memuse_log_allocation(label, NULL, -1, size);
+    memuse_log_allocation(label, NULL, -1, size, memuse_policy_none);
   }
 #endif
   return memptr;
@@ -128,12 +184,17 @@ __attribute__((always_inline)) inline void *swift_calloc(const char *label,
                                                          size_t nmemb,
                                                          size_t size) {
   void *memptr = calloc(nmemb, size);
+  int policy = memuse_policy_get(label, size * nmemb);
+  if (memptr != NULL && policy != memuse_policy_none)
+    policy = memuse_policy_apply(memptr, size * nmemb, policy);
+  if (memptr != NULL && memuse_labels_active)
+    memuse_labels_add(label, memuse_labels_size(memptr));
 #ifdef SWIFT_MEMUSE_REPORTS
   if (memptr != NULL) {
-    memuse_log_allocation(label, memptr, 1, size * nmemb);
+    memuse_log_allocation(label, memptr, 1, size * nmemb, policy);
   } else {
     /* Failed allocations are interesting as well. */
-    memuse_log_allocation(label, NULL, -1, size * nmemb);
+    memuse_log_allocation(label, NULL, -1, size * nmemb, memuse_policy_none);
   }
 #endif
   return memptr;
@@ -154,23 +215,31 @@ __attribute__((always_inline)) inline void *swift_calloc(const char *label,
 __attribute__((always_inline)) inline void *swift_realloc(const char *label,
                                                           void *ptr,
                                                           size_t size) {
+  const size_t old_size = memuse_labels_active ? memuse_labels_size(ptr) : 0;
   void *memptr = realloc(ptr, size);
+  int policy = memuse_policy_get(label, size);
+  if (memptr != NULL && policy != memuse_policy_none)
+    policy = memuse_policy_apply(memptr, size, policy);
+  if ((memptr != NULL || size == 0) && memuse_labels_active)
+    memuse_labels_add(label, (long long)memuse_labels_size(memptr) -
+                                 (long long)old_size);
 #ifdef SWIFT_MEMUSE_REPORTS
   if (memptr != NULL) {
 
     /* On reallocation we free the previous memory. */
-    if (ptr != NULL && ptr != memptr) memuse_log_allocation(label, ptr, 0, 0);
-    memuse_log_allocation(label, memptr, 1, size);
+    if (ptr != NULL && ptr != memptr)
+      memuse_log_allocation(label, ptr, 0, 0, memuse_policy_none);
+    memuse_log_allocation(label, memptr, 1, size, policy);
 
   } else {
 
     /* Can be NULL if size is zero, we have just freed the memory. */
     if (size == 0) {
-      memuse_log_allocation(label, ptr, 0, 0);
+      memuse_log_allocation(label, ptr, 0, 0, memuse_policy_none);
     } else {
 
       /* Failed allocations are interesting as well. */
-      memuse_log_allocation(label, NULL, -1, size);
+      memuse_log_allocation(label, NULL, -1, size, memuse_policy_none);
     }
   }
 #endif
@@ -188,8 +257,11 @@ __attribute__((always_inline)) inline void *swift_realloc(const char *label,
 __attribute__((always_inline)) inline void swift_free(const char *label,
                                                       void *ptr) {
 #ifdef SWIFT_MEMUSE_REPORTS
-  memuse_log_allocation(label, ptr, 0, 0);
+  memuse_log_allocation(label, ptr, 0, 0, memuse_policy_none);
 #endif
+  if (memuse_labels_active)
+    memuse_labels_add(label, -(long long)memuse_labels_size(ptr));
+  if (memuse_cold_tier_count > 0 && memuse_cold_tier_free(ptr)) return;
   free(ptr);
   return;
 }
@@ -0,0 +1,168 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "memuse_arena.h"
+
+/* Local headers. */
+#include "error.h"
+#include "memuse.h"
+
+/**
+ * @brief An allocation of a #memuse_arena that did not fit in its block.
+ */
+struct memuse_arena_overflow {
+
+  /*! The next one. */
+  struct memuse_arena_overflow *next;
+
+  /*! Its size in bytes. */
+  size_t size;
+};
+
+/*! The arena of the temporary arrays of the rebuilds */
+struct memuse_arena memuse_transient_arena = {.label = "transient_arena"};
+
+/**
+ * @brief Initialise an (empty) #memuse_arena.
+ *
+ * @param a The #memuse_arena.
+ * @param label The label of its memory in the reports.
+ * @param keep Keep the block between the scopes?
+ */
+void memuse_arena_init(struct memuse_arena *a, const char *label, int keep) {
+
+  a->label = label;
+  a->block = NULL;
+  a->size = 0;
+  a->used = 0;
+  a->overflow = NULL;
+  a->total = 0;
+  a->peak = 0;
+  a->keep = keep;
+  a->in_scope = 0;
+}
+
+/**
+ * @brief Opens a scope of a #memuse_arena.
+ *
+ * @param a The #memuse_arena.
+ * @param size The number of bytes the scope is expected to need, as a sum of
+ * memuse_arena_size().
+ */
+void memuse_arena_begin(struct memuse_arena *a, size_t size) {
+
+  if (a->in_scope) error("Arena '%s' is already in use.", a->label);
+
+  if (a->size < size) {
+    if (a->block != NULL) swift_free(a->label, a->block);
+    if (swift_memalign(a->label, (void **)&a->block, SWIFT_CACHE_ALIGNMENT,
+                       size) != 0)
+      error("Failed to allocate %zd bytes for arena '%s'.", size, a->label);
+    a->size = size;
+  }
+
+  a->used = 0;
+  a->total = 0;
+  a->peak = 0;
+  a->in_scope = 1;
+}
+
+/**
+ * @brief Allocates some memory from the open scope of a #memuse_arena.
+ *
+ * @param a The #memuse_arena.
+ * @param size The size of the allocation in bytes.
+ * @return The memory, aligned on #SWIFT_CACHE_ALIGNMENT.
+ */
+void *memuse_arena_alloc(struct memuse_arena *a, size_t size) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (!a->in_scope) error("Arena '%s' has no open scope.", a->label);
+#endif
+
+  const size_t bytes = memuse_arena_size(size);
+  void *ptr;
+
+  if (a->used + bytes <= a->size) {
+    ptr = a->block + a->used;
+    a->used += bytes;
+  } else {
+
+    /* Does not fit, so allocate it with its header, one alignment ahead. */
+    char *buff = NULL;
+    if (swift_memalign(a->label, (void **)&buff, SWIFT_CACHE_ALIGNMENT,
+                       SWIFT_CACHE_ALIGNMENT + bytes) != 0)
+      error("Failed to allocate %zd bytes for arena '%s'.", size, a->label);
+    struct memuse_arena_overflow *o = (struct memuse_arena_overflow *)buff;
+    o->next = a->overflow;
+    o->size = bytes;
+    a->overflow = o;
+    ptr = buff + SWIFT_CACHE_ALIGNMENT;
+  }
+
+  a->total += bytes;
+  if (a->total > a->peak) a->peak = a->total;
+  return ptr;
+}
+
+/**
+ * @brief Releases the allocations made from the block of a #memuse_arena
+ * since memuse_arena_mark() was called.
+ *
+ * The allocations that did not fit in the block are only freed with the
+ * scope.
+ *
+ * @param a The #memuse_arena.
+ * @param mark The value returned by memuse_arena_mark().
+ */
+void memuse_arena_release(struct memuse_arena *a, size_t mark) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (mark > a->used) error("Arena '%s' released above its top.", a->label);
+#endif
+
+  a->total -= a->used - mark;
+  a->used = mark;
+}
+
+/**
+ * @brief Closes the scope of a #memuse_arena, releasing all its allocations.
+ *
+ * @param a The #memuse_arena.
+ * @return The largest number of bytes the scope had at any one time.
+ */
+size_t memuse_arena_end(struct memuse_arena *a) {
+
+  if (!a->in_scope) error("Arena '%s' has no open scope.", a->label);
+
+  while (a->overflow != NULL) {
+    struct memuse_arena_overflow *next = a->overflow->next;
+    swift_free(a->label, a->overflow);
+    a->overflow = next;
+  }
+
+  if (!a->keep && a->block != NULL) {
+    swift_free(a->label, a->block);
+    a->block = NULL;
+    a->size = 0;
+  }
+
+  a->used = 0;
+  a->total = 0;
+  a->in_scope = 0;
+  return a->peak;
+}
+
+/**
+ * @brief Frees all the memory of a #memuse_arena.
+ *
+ * @param a The #memuse_arena.
+ */
+void memuse_arena_clean(struct memuse_arena *a) {
+
+  if (a->in_scope) memuse_arena_end(a);
+  if (a->block != NULL) swift_free(a->label, a->block);
+  a->block = NULL;
+  a->size = 0;
+}
@@ -0,0 +1,82 @@
+#ifndef SWIFT_MEMUSE_ARENA_H
+#define SWIFT_MEMUSE_ARENA_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* System includes. */
+#include <stddef.h>
+
+/* Local headers. */
+#include "align.h"
+#include "inline.h"
+
+/* Forward declarations */
+struct memuse_arena_overflow;
+
+/**
+ * @brief A stack of transient allocations carved out of one block.
+ *
+ * A scope is opened with the number of bytes it is expected to need. Its
+ * allocations are then handed out one after the other from the block and
+ * released in reverse order, or all at once when the scope is closed, such
+ * that the peak memory of the scope is known in advance and reported.
+ * Requests that do not fit are served by swift_memalign() and only freed
+ * with the scope. The block can be kept for the next scope rather than
+ * being allocated and faulted in again.
+ */
+struct memuse_arena {
+
+  /*! Label of the block in the memory reports. */
+  const char *label;
+
+  /*! The block, its size and the number of bytes in use. */
+  char *block;
+  size_t size, used;
+
+  /*! The allocations that did not fit in the block. */
+  struct memuse_arena_overflow *overflow;
+
+  /*! Number of bytes handed out in the scope, overflows included, and the
+   * largest it got. */
+  size_t total, peak;
+
+  /*! Keep the block between the scopes? */
+  int keep;
+
+  /*! Is a scope open? */
+  int in_scope;
+};
+
+/*! The arena of the temporary arrays of the rebuilds */
+extern struct memuse_arena memuse_transient_arena;
+
+void memuse_arena_init(struct memuse_arena *a, const char *label, int keep);
+void memuse_arena_begin(struct memuse_arena *a, size_t size);
+void *memuse_arena_alloc(struct memuse_arena *a, size_t size);
+void memuse_arena_release(struct memuse_arena *a, size_t mark);
+size_t memuse_arena_end(struct memuse_arena *a);
+void memuse_arena_clean(struct memuse_arena *a);
+
+/**
+ * @brief Number of bytes of a #memuse_arena used by an allocation.
+ *
+ * @param size The size of the allocation in bytes.
+ */
+__attribute__((always_inline)) INLINE static size_t memuse_arena_size(
+    const size_t size) {
+  return (size + SWIFT_CACHE_ALIGNMENT - 1) &
+         ~((size_t)SWIFT_CACHE_ALIGNMENT - 1);
+}
+
+/**
+ * @brief Marks the top of a #memuse_arena for memuse_arena_release().
+ *
+ * @param a The #memuse_arena.
+ */
+__attribute__((always_inline)) INLINE static size_t memuse_arena_mark(
+    const struct memuse_arena *a) {
+  return a->used;
+}
+
+#endif /* SWIFT_MEMUSE_ARENA_H */
@@ -0,0 +1,308 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "memuse_phases.h"
+
+/* System includes. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Local headers. */
+#include "atomic.h"
+#include "clocks.h"
+#include "error.h"
+#include "lock.h"
+#include "memuse.h"
+#include "minmax.h"
+#include "parser.h"
+
+/*! Maximal number of labels counted, the others are summed together */
+#define memuse_phases_max_labels 512
+
+/*! Length of the labels kept, the longer ones are cut */
+#define memuse_phases_label_length 48
+
+/*! Names of the phases */
+const char *memuse_phase_names[memuse_phase_count] = {
+    "other", "rebuild", "repartition", "drift_all", "tasks",
+    "mesh",  "fof",     "snapshot",    "restart"};
+
+/**
+ * @brief The live bytes of a label.
+ */
+struct memuse_phases_label {
+
+  /*! Is the entry taken? */
+  volatile int used;
+
+  /*! The label. */
+  char name[memuse_phases_label_length];
+
+  /*! Bytes allocated now and most allocated since the last output. */
+  volatile long long live;
+  volatile long long peak;
+};
+
+/**
+ * @brief The memory use of a phase since the last output.
+ */
+struct memuse_phases_sums {
+
+  /*! Time spent in the phase. */
+  ticks time;
+
+  /*! Most bytes of all the labels in the phase. */
+  long long peak;
+
+  /*! Largest resident memory at the end of the phase (KB). */
+  long rss;
+
+  /*! Growth of the high-water mark of the resident memory (KB). */
+  long hwm_growth;
+};
+
+/*! Number of steps between two outputs, 0 for none. */
+static int memuse_phases_frequency = 0;
+
+/*! The file the reports are appended to. */
+static char memuse_phases_filename[64];
+
+/*! The labels, their lock and the labels that did not fit. */
+static struct memuse_phases_label
+    memuse_phases_labels[memuse_phases_max_labels];
+static swift_lock_type memuse_phases_labels_lock;
+static struct memuse_phases_label memuse_phases_other = {1, "(others)", 0, 0};
+
+/*! Bytes of all the labels now and most since the last phase change. */
+static volatile long long memuse_phases_live = 0;
+static volatile long long memuse_phases_peak = 0;
+
+/*! The phases, the current one and the state at its start. */
+static struct memuse_phases_sums memuse_phases_sums[memuse_phase_count];
+static enum memuse_phase memuse_phases_current = memuse_phase_other;
+static ticks memuse_phases_tic = 0;
+static long memuse_phases_hwm = 0;
+
+/**
+ * @brief Find the entry of a label, creating it if needed.
+ *
+ * @param label The label.
+ */
+static struct memuse_phases_label *memuse_phases_find(const char *label) {
+
+  unsigned long hash = 5381;
+  for (int k = 0; label[k] != '\0' && k < memuse_phases_label_length - 1; k++)
+    hash = hash * 33 + (unsigned char)label[k];
+
+  for (int k = 0; k < memuse_phases_max_labels; k++) {
+    struct memuse_phases_label *l =
+        &memuse_phases_labels[(hash + k) % memuse_phases_max_labels];
+
+    /* Take the entry if it is free. */
+    if (!l->used) {
+      lock_lock(&memuse_phases_labels_lock);
+      if (!l->used) {
+        strncpy(l->name, label, memuse_phases_label_length - 1);
+        l->name[memuse_phases_label_length - 1] = '\0';
+        __sync_synchronize();
+        l->used = 1;
+      }
+      if (lock_unlock(&memuse_phases_labels_lock) != 0)
+        error("Failed to unlock the memory labels.");
+    }
+
+    if (strncmp(l->name, label, memuse_phases_label_length - 1) == 0)
+      return l;
+  }
+  return &memuse_phases_other;
+}
+
+/**
+ * @brief Count some bytes allocated (or freed, if negative) for a label.
+ *
+ * @param label The label of the allocation.
+ * @param bytes The number of bytes.
+ */
+void memuse_labels_add(const char *label, const long long bytes) {
+
+  if (bytes == 0) return;
+  struct memuse_phases_label *l = memuse_phases_find(label);
+  atomic_max_ll(&l->peak, atomic_add(&l->live, bytes) + bytes);
+  atomic_max_ll(&memuse_phases_peak,
+                atomic_add(&memuse_phases_live, bytes) + bytes);
+}
+
+/**
+ * @brief Add the time and memory use since the last phase change to the
+ * current phase and start a new period.
+ */
+static void memuse_phases_fold(void) {
+
+  struct memuse_phases_sums *s = &memuse_phases_sums[memuse_phases_current];
+  const ticks tic = getticks();
+
+  long size, resident, shared, text, data, library, dirty;
+  memuse_use(&size, &resident, &shared, &text, &data, &library, &dirty);
+  const long hwm = memuse_phase_peak();
+
+  s->time += tic - memuse_phases_tic;
+  s->peak = max(s->peak, memuse_phases_peak);
+  s->rss = max(s->rss, resident);
+
+  /* The mark can have been reset by memuse_phase_begin(). */
+  if (hwm > memuse_phases_hwm) s->hwm_growth += hwm - memuse_phases_hwm;
+
+  memuse_phases_tic = tic;
+  memuse_phases_hwm = hwm;
+  memuse_phases_peak = memuse_phases_live;
+}
+
+/**
+ * @brief Start counting the memory of the labels, if asked for, and create
+ * the file of the reports.
+ *
+ * Must be called before the particles are allocated, as their memory can
+ * only be counted if its allocation was.
+ *
+ * @param params The parsed parameters.
+ * @param nodeID The rank of this node.
+ * @param restart Are we restarting? The file is then appended to.
+ */
+void memuse_phases_init(struct swift_params *params, const int nodeID,
+                        const int restart) {
+
+  memuse_phases_frequency =
+      parser_get_opt_param_int(params, "Scheduler:memuse_phases_frequency", 0);
+  if (memuse_phases_frequency < 0)
+    error("Scheduler:memuse_phases_frequency should be >= 0");
+  if (memuse_phases_frequency == 0) return;
+
+#ifndef HAVE_MALLOC_USABLE_SIZE
+  error(
+      "Scheduler:memuse_phases_frequency needs malloc_usable_size(), which is "
+      "not available on this system.");
+#endif
+
+  if (lock_init(&memuse_phases_labels_lock) != 0)
+    error("Failed to initialise the memory labels lock.");
+  memuse_phases_tic = getticks();
+  memuse_phases_hwm = memuse_phase_peak();
+  memuse_labels_active = 1;
+
+#ifdef WITH_MPI
+  snprintf(memuse_phases_filename, sizeof(memuse_phases_filename),
+           "memuse_phases_%04d.txt", nodeID);
+#else
+  snprintf(memuse_phases_filename, sizeof(memuse_phases_filename),
+           "memuse_phases.txt");
+#endif
+
+  if (restart) return;
+
+  FILE *file = fopen(memuse_phases_filename, "w");
+  if (file == NULL)
+    error("Could not create file '%s'.", memuse_phases_filename);
+  fprintf(file,
+          "# Memory use of the phases of the steps and of the labels of the "
+          "allocations since the last output. Times in %s, memory in MB.\n"
+          "# peak: most bytes allocated by swift_malloc() and friends, for a "
+          "phase all the labels together.\n"
+          "# rss: largest resident memory at the end of the phase.\n"
+          "# hwm_growth: growth of the high-water mark of the resident "
+          "memory during the phase, the phases where it grows set the "
+          "peak.\n"
+          "# live: bytes of the label allocated at the time of the output.\n",
+          clocks_getunit());
+  fprintf(file, "# %6s %5s %24s %12s %12s %12s %12s\n", "step", "kind", "name",
+          "time", "peak", "rss/live", "hwm_growth");
+  fclose(file);
+}
+
+/**
+ * @brief Start a phase.
+ *
+ * The phases can be nested, the memory of the inner one is then not counted
+ * in the outer one.
+ *
+ * @param phase The #memuse_phase starting.
+ *
+ * @result The phase it interrupts, to give to memuse_phases_end().
+ */
+enum memuse_phase memuse_phases_begin(const enum memuse_phase phase) {
+
+  if (memuse_phases_frequency == 0) return memuse_phase_other;
+
+  const enum memuse_phase previous = memuse_phases_current;
+  memuse_phases_fold();
+  memuse_phases_current = phase;
+  return previous;
+}
+
+/**
+ * @brief End the current phase.
+ *
+ * @param previous The phase to go back to, as given by memuse_phases_begin().
+ */
+void memuse_phases_end(const enum memuse_phase previous) {
+
+  if (memuse_phases_frequency == 0) return;
+
+  memuse_phases_fold();
+  memuse_phases_current = previous;
+}
+
+/**
+ * @brief Sort the labels by decreasing peak.
+ */
+static int memuse_phases_cmp_peaks(const void *a, const void *b) {
+  const long long peak_a = (*(struct memuse_phases_label *const *)a)->peak;
+  const long long peak_b = (*(struct memuse_phases_label *const *)b)->peak;
+  return (peak_a < peak_b) - (peak_a > peak_b);
+}
+
+/**
+ * @brief Write the memory use of the phases and of the labels to the file,
+ * if it is time, and start again.
+ *
+ * @param step The current step.
+ */
+void memuse_phases_end_step(const int step) {
+
+  if (memuse_phases_frequency == 0) return;
+  if (step % memuse_phases_frequency != 0) return;
+
+  memuse_phases_fold();
+
+  FILE *file = fopen(memuse_phases_filename, "a");
+  if (file == NULL) error("Could not open file '%s'.", memuse_phases_filename);
+
+  const double mb = 1. / (1024. * 1024.);
+  for (int k = 0; k < memuse_phase_count; k++) {
+    const struct memuse_phases_sums *s = &memuse_phases_sums[k];
+    if (s->time == 0) continue;
+    fprintf(file, "  %6d %5s %24s %12.3f %12.3f %12.3f %12.3f\n", step,
+            "phase", memuse_phase_names[k], clocks_from_ticks(s->time),
+            s->peak * mb, s->rss / 1024., s->hwm_growth / 1024.);
+  }
+
+  struct memuse_phases_label *labels[memuse_phases_max_labels + 1];
+  int nr_labels = 0;
+  for (int k = 0; k < memuse_phases_max_labels; k++)
+    if (memuse_phases_labels[k].used && memuse_phases_labels[k].peak > 0)
+      labels[nr_labels++] = &memuse_phases_labels[k];
+  if (memuse_phases_other.peak > 0) labels[nr_labels++] = &memuse_phases_other;
+  qsort(labels, nr_labels, sizeof(struct memuse_phases_label *),
+        memuse_phases_cmp_peaks);
+
+  for (int k = 0; k < nr_labels; k++) {
+    fprintf(file, "  %6d %5s %24s %12.3f %12.3f %12.3f %12.3f\n", step,
+            "label", labels[k]->name, 0., labels[k]->peak * mb,
+            labels[k]->live * mb, 0.);
+    labels[k]->peak = labels[k]->live;
+  }
+  fclose(file);
+
+  bzero(memuse_phases_sums, sizeof(memuse_phases_sums));
+}
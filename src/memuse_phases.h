@@ -0,0 +1,38 @@
+#ifndef SWIFT_MEMUSE_PHASES_H
+#define SWIFT_MEMUSE_PHASES_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* Forward declarations. */
+struct swift_params;
+
+/**
+ * @brief The phases of a step the memory use is reported for.
+ *
+ * The drifts, forces and kicks done by the tasks all share the tasks phase,
+ * as they run at the same time.
+ */
+enum memuse_phase {
+  memuse_phase_other = 0,
+  memuse_phase_rebuild,
+  memuse_phase_repartition,
+  memuse_phase_drift_all,
+  memuse_phase_tasks,
+  memuse_phase_mesh,
+  memuse_phase_fof,
+  memuse_phase_snapshot,
+  memuse_phase_restart,
+  memuse_phase_count
+};
+
+extern const char *memuse_phase_names[memuse_phase_count];
+
+/* Function prototypes. */
+void memuse_phases_init(struct swift_params *params, const int nodeID,
+                        const int restart);
+enum memuse_phase memuse_phases_begin(const enum memuse_phase phase);
+void memuse_phases_end(const enum memuse_phase previous);
+void memuse_phases_end_step(const int step);
+
+#endif /* SWIFT_MEMUSE_PHASES_H */
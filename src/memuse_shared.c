@@ -0,0 +1,251 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "memuse_shared.h"
+
+/* System includes. */
+#include <stdint.h>
+#include <stdlib.h>
+
+/* MPI headers. */
+#ifdef WITH_MPI
+#include <mpi.h>
+#endif
+
+/* Local headers. */
+#include "error.h"
+#include "memuse.h"
+#include "parser.h"
+
+/*! Maximal number of shared allocations alive at once */
+#define memuse_shared_max_windows 64
+
+/*! Are the allocations shared between the ranks of a node? */
+static int memuse_shared_active = 0;
+
+#ifdef WITH_MPI
+
+/**
+ * @brief A shared allocation and the window it lives in.
+ */
+struct memuse_shared_window {
+
+  /*! The memory handed out. */
+  void *ptr;
+
+  /*! Its size in bytes. */
+  size_t size;
+
+  /*! The window of the node. */
+  MPI_Win win;
+};
+
+/*! The live shared allocations. */
+static struct memuse_shared_window
+    memuse_shared_windows[memuse_shared_max_windows];
+static int memuse_shared_nr_windows = 0;
+
+/*! The ranks of this node and our rank amongst them. */
+static MPI_Comm memuse_shared_comm = MPI_COMM_NULL;
+static int memuse_shared_rank = 0;
+
+#endif /* WITH_MPI */
+
+/**
+ * @brief Decide whether the large read-only tables are shared between the
+ * ranks of each node.
+ *
+ * When they are, the tables allocated with memuse_shared_memalign() live in
+ * an MPI-3 shared window of the node and are filled by its first rank only,
+ * such that a node holds and reads one copy rather than one per rank.
+ * Without MPI, or when not asked for, they are plain swift_memalign()
+ * allocations.
+ *
+ * Must be called by all the ranks, before any table is allocated.
+ *
+ * @param params The parsed parameters.
+ */
+void memuse_shared_init(struct swift_params *params) {
+
+#ifdef WITH_MPI
+  memuse_shared_active =
+      parser_get_opt_param_int(params, "Scheduler:node_shared_tables", 0);
+  if (!memuse_shared_active) return;
+
+  if (MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0,
+                          MPI_INFO_NULL, &memuse_shared_comm) != MPI_SUCCESS)
+    error("Failed to split the ranks by node.");
+  int nr_ranks = 0, rank = 0;
+  MPI_Comm_rank(memuse_shared_comm, &memuse_shared_rank);
+  MPI_Comm_size(memuse_shared_comm, &nr_ranks);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  if (rank == 0)
+    message("Sharing the tables between the %d ranks of node 0.", nr_ranks);
+#else
+  memuse_shared_active = 0;
+#endif
+}
+
+/**
+ * @brief Free the node communicator. The tables must have been freed.
+ */
+void memuse_shared_clean(void) {
+
+#ifdef WITH_MPI
+  if (memuse_shared_nr_windows > 0)
+    error("%d shared allocations were not freed.", memuse_shared_nr_windows);
+  if (memuse_shared_comm != MPI_COMM_NULL) MPI_Comm_free(&memuse_shared_comm);
+  memuse_shared_active = 0;
+#endif
+}
+
+/**
+ * @brief Allocate aligned memory shared by the ranks of the node.
+ *
+ * Collective over all the ranks: each must allocate the same tables in the
+ * same order. The contents can only be written between
+ * memuse_shared_fill_begin() and memuse_shared_fill_end(), by the rank that
+ * the former returned 1 to.
+ *
+ * @param label a symbolic label for the memory, i.e. "cooling-tables".
+ * @param memptr pointer to the allocated memory.
+ * @param alignment alignment boundary.
+ * @param size the quantity of bytes to allocate.
+ * @result zero on success, otherwise an error code.
+ */
+int memuse_shared_memalign(const char *label, void **memptr, size_t alignment,
+                           size_t size) {
+
+  if (!memuse_shared_active)
+    return swift_memalign(label, memptr, alignment, size);
+
+#ifdef WITH_MPI
+  if (memuse_shared_nr_windows == memuse_shared_max_windows)
+    error("Too many shared allocations, increase memuse_shared_max_windows.");
+
+  /* The first rank of the node holds the whole segment */
+  const MPI_Aint local_size = memuse_shared_rank == 0 ? size + alignment : 0;
+  MPI_Info info;
+  MPI_Info_create(&info);
+  MPI_Info_set(info, "alloc_shared_noncontig", "true");
+  char *base = NULL;
+  MPI_Win win;
+  const int res = MPI_Win_allocate_shared(local_size, 1, info,
+                                          memuse_shared_comm, &base, &win);
+  MPI_Info_free(&info);
+  if (res != MPI_SUCCESS) return res;
+
+  /* Where it is mapped here, and the offset that aligns it on the first
+   * rank, which must then align it on all of them */
+  MPI_Aint segment_size = 0;
+  int disp_unit = 0;
+  char *segment = NULL;
+  MPI_Win_shared_query(win, 0, &segment_size, &disp_unit, &segment);
+  unsigned long long offset =
+      (alignment - (uintptr_t)segment % alignment) % alignment;
+  MPI_Bcast(&offset, 1, MPI_UNSIGNED_LONG_LONG, 0, memuse_shared_comm);
+  char *ptr = segment + offset;
+  if ((uintptr_t)ptr % alignment != 0)
+    error("The shared allocation '%s' is not aligned on all the ranks.",
+          label);
+
+  /* Stay in a passive epoch for the syncs of the fills */
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+
+  struct memuse_shared_window *w =
+      &memuse_shared_windows[memuse_shared_nr_windows++];
+  w->ptr = ptr;
+  w->size = size;
+  w->win = win;
+  *memptr = ptr;
+
+  /* The memory is counted once per node, by the rank holding it */
+  if (memuse_shared_rank == 0) {
+    if (memuse_labels_active) memuse_labels_add(label, (long long)size);
+#ifdef SWIFT_MEMUSE_REPORTS
+    memuse_log_allocation(label, ptr, 1, size, memuse_policy_none);
+#endif
+  }
+  return 0;
+#else
+  return 1;
+#endif
+}
+
+/**
+ * @brief Free memory allocated with memuse_shared_memalign().
+ *
+ * Collective over all the ranks when the memory is shared.
+ *
+ * @param label the label used when allocating.
+ * @param ptr the memory.
+ */
+void memuse_shared_free(const char *label, void *ptr) {
+
+  if (!memuse_shared_active) {
+    swift_free(label, ptr);
+    return;
+  }
+
+#ifdef WITH_MPI
+  if (ptr == NULL) return;
+
+  int k = 0;
+  while (k < memuse_shared_nr_windows && memuse_shared_windows[k].ptr != ptr)
+    k++;
+  if (k == memuse_shared_nr_windows)
+    error("'%s' is not a shared allocation.", label);
+
+  struct memuse_shared_window *w = &memuse_shared_windows[k];
+  if (memuse_shared_rank == 0) {
+#ifdef SWIFT_MEMUSE_REPORTS
+    memuse_log_allocation(label, ptr, 0, 0, memuse_policy_none);
+#endif
+    if (memuse_labels_active) memuse_labels_add(label, -(long long)w->size);
+  }
+  MPI_Win_unlock_all(w->win);
+  MPI_Win_free(&w->win);
+  *w = memuse_shared_windows[--memuse_shared_nr_windows];
+#endif
+}
+
+/**
+ * @brief Start writing the shared tables.
+ *
+ * Collective over all the ranks. Waits for the ranks of the node to be done
+ * with the old contents.
+ *
+ * @result 1 if this rank writes the tables, 0 if it only waits for
+ * memuse_shared_fill_end().
+ */
+int memuse_shared_fill_begin(void) {
+
+  if (!memuse_shared_active) return 1;
+
+#ifdef WITH_MPI
+  MPI_Barrier(memuse_shared_comm);
+  return memuse_shared_rank == 0;
+#else
+  return 1;
+#endif
+}
+
+/**
+ * @brief Done writing the shared tables, make them visible to all the ranks
+ * of the node.
+ *
+ * Collective over all the ranks.
+ */
+void memuse_shared_fill_end(void) {
+
+  if (!memuse_shared_active) return;
+
+#ifdef WITH_MPI
+  for (int k = 0; k < memuse_shared_nr_windows; k++)
+    MPI_Win_sync(memuse_shared_windows[k].win);
+  MPI_Barrier(memuse_shared_comm);
+  for (int k = 0; k < memuse_shared_nr_windows; k++)
+    MPI_Win_sync(memuse_shared_windows[k].win);
+#endif
+}
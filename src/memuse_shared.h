@@ -0,0 +1,22 @@
+#ifndef SWIFT_MEMUSE_SHARED_H
+#define SWIFT_MEMUSE_SHARED_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* System includes. */
+#include <stddef.h>
+
+/* Forward declarations. */
+struct swift_params;
+
+/* Function prototypes. */
+void memuse_shared_init(struct swift_params *params);
+void memuse_shared_clean(void);
+int memuse_shared_memalign(const char *label, void **memptr, size_t alignment,
+                           size_t size);
+void memuse_shared_free(const char *label, void *ptr);
+int memuse_shared_fill_begin(void);
+void memuse_shared_fill_end(void);
+
+#endif /* SWIFT_MEMUSE_SHARED_H */
@@ -0,0 +1,127 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ * Copyright (c) 2016 Matthieu Schaller (schaller@strw.leidenuniv.nl)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#ifndef SWIFT_MESH_ASSIGNMENT_H
+#define SWIFT_MESH_ASSIGNMENT_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* Standard includes */
+#include <math.h>
+
+/* Local includes. */
+#include "atomic.h"
+#include "inline.h"
+#include "row_major_id.h"
+
+/*! Highest order of mass assignment scheme we know about (PCS) */
+#define mesh_assignment_max_order 4
+
+/**
+ * @brief Computes the 1D weights of the mass assignment scheme of a given
+ * order for a position on a mesh.
+ *
+ * The mesh points sit at integer coordinates. The schemes are NGP (order 1),
+ * CIC (order 2), TSC (order 3) and PCS (order 4). A position gives a
+ * non-zero weight to order consecutive mesh points, the first of which is
+ * returned. The index is not wrapped.
+ *
+ * @param order The order of the scheme (1 to #mesh_assignment_max_order).
+ * @param pos The position in units of the mesh spacing.
+ * @param w (return) The order weights.
+ */
+__attribute__((always_inline)) INLINE static int mesh_assignment_weights(
+    const int order, const double pos, double w[mesh_assignment_max_order]) {
+
+  switch (order) {
+    case 1: {
+      const int i = (int)floor(pos + 0.5);
+      w[0] = 1.;
+      return i;
+    }
+    case 2: {
+      const int i = (int)floor(pos);
+      const double d = pos - i;
+      w[0] = 1. - d;
+      w[1] = d;
+      return i;
+    }
+    case 3: {
+      const int i = (int)floor(pos + 0.5);
+      const double d = pos - i;
+      w[0] = 0.5 * (0.5 - d) * (0.5 - d); /* left side, dist 1 + d  */
+      w[1] = 0.75 - d * d;                /* center, dist |d| */
+      w[2] = 0.5 * (0.5 + d) * (0.5 + d); /* right side, dist 1 - d */
+      return i - 1;
+    }
+    case 4: {
+      const int i = (int)floor(pos);
+      const double d = pos - i;
+      const double t = 1. - d;
+      w[0] = t * t * t / 6.;                          /* dist 1 + d */
+      w[1] = (4. - 6. * d * d + 3. * d * d * d) / 6.; /* dist d */
+      w[2] = (4. - 6. * t * t + 3. * t * t * t) / 6.; /* dist 1 - d */
+      w[3] = d * d * d / 6.;                          /* dist 2 - d */
+      return i - 1;
+    }
+    default:
+      return 0;
+  }
+}
+
+/**
+ * @brief Assigns a value to a periodic mesh using the mass assignment
+ * scheme of a given order.
+ *
+ * The writes are atomic. The mesh is N x N x (N + pad), the padding being
+ * along the last axis (e.g. 2 for the in-place FFTW layout, 0 for none).
+ *
+ * @param mesh The mesh to write to.
+ * @param N The side-length of the mesh.
+ * @param pad The padding of the last axis of the mesh.
+ * @param order The order of the scheme (1 to #mesh_assignment_max_order).
+ * @param pos_x The position along x in units of the mesh spacing.
+ * @param pos_y The position along y in units of the mesh spacing.
+ * @param pos_z The position along z in units of the mesh spacing.
+ * @param value The value to assign.
+ */
+__attribute__((always_inline)) INLINE static void mesh_assignment_set(
+    double* mesh, const int N, const int pad, const int order,
+    const double pos_x, const double pos_y, const double pos_z,
+    const double value) {
+
+  double wx[mesh_assignment_max_order];
+  double wy[mesh_assignment_max_order];
+  double wz[mesh_assignment_max_order];
+  const int i = mesh_assignment_weights(order, pos_x, wx);
+  const int j = mesh_assignment_weights(order, pos_y, wy);
+  const int k = mesh_assignment_weights(order, pos_z, wz);
+
+  for (int ii = 0; ii < order; ++ii) {
+    for (int jj = 0; jj < order; ++jj) {
+      for (int kk = 0; kk < order; ++kk) {
+        atomic_add_d(&mesh[row_major_id_periodic_with_padding(
+                         i + ii, j + jj, k + kk, N, pad)],
+                     value * wx[ii] * wy[jj] * wz[kk]);
+      }
+    }
+  }
+}
+
+#endif /* SWIFT_MESH_ASSIGNMENT_H */
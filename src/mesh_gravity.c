@@ -32,13 +32,19 @@
 
 /* Local includes. */
 #include "active.h"
+#include "atomic.h"
+#include "cosmology.h"
+#include "cuda_pm_mesh.h"
 #include "debug.h"
 #include "engine.h"
 #include "error.h"
 #include "gravity_properties.h"
+#include "integer_power.h"
 #include "kernel_long_gravity.h"
+#include "mesh_assignment.h"
 #include "mesh_gravity_mpi.h"
 #include "mesh_gravity_patch.h"
+#include "mesh_gravity_pencil.h"
 #include "neutrino.h"
 #include "part.h"
 #include "restart.h"
@@ -212,9 +218,15 @@ void cell_gpart_to_mesh_CIC(const struct cell* c, double* rho, const int N,
  */
 struct cic_mapper_data {
   const struct cell* cells;
+  const int* local_cells;
+  struct pm_mesh_patch* patches;
+  struct pm_mesh_patch* patches_interlaced;
   double* rho;
+  double* rho_interlaced;
   double* potential;
+  double* potential_interlaced;
   int N;
+  int order;
   int use_local_patches;
   double fac;
   double dim[3];
@@ -261,8 +273,8 @@ void cell_gpart_to_mesh_CIC_mapper(void* map_data, int num, void* extra) {
   /* Pointer to the chunk to be processed */
   int* local_cells = (int*)map_data;
 
-  /* A temporary patch of the global mesh */
-  struct pm_mesh_patch patch;
+  /* Start at the same position in the list of patches */
+  const size_t offset = local_cells - data->local_cells;
 
   /* Loop over the elements assigned to this thread */
   for (int i = 0; i < num; ++i) {
@@ -276,14 +288,10 @@ void cell_gpart_to_mesh_CIC_mapper(void* map_data, int num, void* extra) {
     if (data->use_local_patches) {
 
       /* Do a CIC interpolation of all the particles in this cell onto
-         the local patch (allocates memory in the patch) */
-      accumulate_cell_to_local_patch(N, fac, dim, c, &patch, nu_model);
-
-      /* Copy the local patch values back onto the global mesh */
-      pm_add_patch_to_global_mesh(rho, &patch);
-
-      /* Free the allocated memory */
-      pm_mesh_patch_clean(&patch);
+         its patch (allocates memory in the patch). The patches are added
+         to the global mesh once they are all done. */
+      accumulate_cell_to_local_patch(N, fac, dim, c,
+                                     &data->patches[offset + i], nu_model);
 
     } else {
 
@@ -486,12 +494,545 @@ void cell_mesh_to_gpart_CIC_mapper(void* map_data, int num, void* extra) {
   /* Loop over the elements assigned to this thread */
   for (int i = 0; i < num; ++i) {
 
-    /* Pointer to local cell */
-    const struct cell* c = &cells[local_cells[i]];
+    /* Pointer to local cell */
+    const struct cell* c = &cells[local_cells[i]];
+
+    /* Assign this cell's content to the mesh */
+    cell_mesh_to_gpart_CIC(c, potential, N, fac, const_G, dim);
+  }
+}
+
+/**
+ * @brief Assigns a given #gpart to a density mesh using the mass assignment
+ * scheme of a given order.
+ *
+ * @param gp The #gpart.
+ * @param rho The density mesh.
+ * @param N the size of the mesh along one axis.
+ * @param fac The width of a mesh cell.
+ * @param dim The dimensions of the simulation box.
+ * @param order The order of the mass assignment scheme.
+ * @param shift The shift of the particle in units of the mesh spacing (0.5
+ * for the interlaced mesh).
+ * @param nu_model Struct with neutrino constants
+ */
+INLINE static void gpart_to_mesh_order(const struct gpart* gp, double* rho,
+                                       const int N, const double fac,
+                                       const double dim[3], const int order,
+                                       const double shift,
+                                       const struct neutrino_model* nu_model) {
+
+  /* Box wrap the multipole's position */
+  const double pos_x = box_wrap(gp->x[0], 0., dim[0]);
+  const double pos_y = box_wrap(gp->x[1], 0., dim[1]);
+  const double pos_z = box_wrap(gp->x[2], 0., dim[2]);
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (gp->time_bin == time_bin_not_created)
+    error("Found an extra particle in mesh assignment.");
+#endif
+
+  /* Compute weight (for neutrino delta-f weighting) */
+  double weight = 1.0;
+  if (gp->type == swift_type_neutrino)
+    gpart_neutrino_weight_mesh_only(gp, nu_model, &weight);
+
+  const double mass = gp->mass;
+  const double value = mass * weight;
+
+  mesh_assignment_set(rho, N, /*pad=*/0, order, fac * pos_x + shift,
+                      fac * pos_y + shift, fac * pos_z + shift, value);
+}
+
+/**
+ * @brief Assigns all the #gpart of a #cell to a mesh patch using the mass
+ * assignment scheme of a given order.
+ *
+ * The patch must have been made with a boundary of 2 cells to hold the
+ * widest scheme with the half-cell shift of the interlaced mesh.
+ *
+ * @param c The #cell.
+ * @param patch The #pm_mesh_patch covering the cell.
+ * @param order The order of the mass assignment scheme.
+ * @param shift The shift of the particles in units of the mesh spacing.
+ * @param nu_model Struct with neutrino constants
+ */
+void cell_gpart_to_patch_order(const struct cell* c,
+                               struct pm_mesh_patch* patch, const int order,
+                               const double shift,
+                               const struct neutrino_model* nu_model) {
+
+  const int gcount = c->grav.count;
+  const struct gpart* gparts = c->grav.parts;
+  const double fac = patch->fac;
+
+  pm_mesh_patch_zero(patch);
+
+  for (int ipart = 0; ipart < gcount; ipart++) {
+
+    const struct gpart* gp = &gparts[ipart];
+    if (gp->time_bin == time_bin_inhibited) continue;
+
+    /* Box wrap the particle's position to the copy nearest the cell centre */
+    const double pos_x =
+        box_wrap(gp->x[0], patch->wrap_min[0], patch->wrap_max[0]);
+    const double pos_y =
+        box_wrap(gp->x[1], patch->wrap_min[1], patch->wrap_max[1]);
+    const double pos_z =
+        box_wrap(gp->x[2], patch->wrap_min[2], patch->wrap_max[2]);
+
+    /* Workout the weights and the first cell in the patch receiving them */
+    double wx[mesh_assignment_max_order];
+    double wy[mesh_assignment_max_order];
+    double wz[mesh_assignment_max_order];
+    const int i = mesh_assignment_weights(order, fac * pos_x + shift, wx) -
+                  patch->mesh_min[0];
+    const int j = mesh_assignment_weights(order, fac * pos_y + shift, wy) -
+                  patch->mesh_min[1];
+    const int k = mesh_assignment_weights(order, fac * pos_z + shift, wz) -
+                  patch->mesh_min[2];
+
+    /* Compute weight (for neutrino delta-f weighting) */
+    double weight = 1.0;
+    if (gp->type == swift_type_neutrino)
+      gpart_neutrino_weight_mesh_only(gp, nu_model, &weight);
+
+    const double mass = gp->mass;
+    const double value = mass * weight;
+
+    for (int ii = 0; ii < order; ++ii)
+      for (int jj = 0; jj < order; ++jj)
+        for (int kk = 0; kk < order; ++kk)
+          patch->mesh[pm_mesh_patch_index(patch, i + ii, j + jj, k + kk)] +=
+              value * wx[ii] * wy[jj] * wz[kk];
+  }
+}
+
+void gpart_to_mesh_order_mapper(void* map_data, int num, void* extra) {
+
+  const struct cic_mapper_data* data = (struct cic_mapper_data*)extra;
+  double* rho = data->rho;
+  double* rho_interlaced = data->rho_interlaced;
+  const int N = data->N;
+  const int order = data->order;
+  const double fac = data->fac;
+  const double dim[3] = {data->dim[0], data->dim[1], data->dim[2]};
+  const struct neutrino_model* nu_model = data->nu_model;
+
+  /* Pointer to the chunk to be processed */
+  const struct gpart* gparts = (const struct gpart*)map_data;
+
+  for (int i = 0; i < num; ++i) {
+    if (gparts[i].time_bin == time_bin_inhibited) continue;
+    gpart_to_mesh_order(&gparts[i], rho, N, fac, dim, order, /*shift=*/0.,
+                        nu_model);
+    if (rho_interlaced != NULL)
+      gpart_to_mesh_order(&gparts[i], rho_interlaced, N, fac, dim, order,
+                          /*shift=*/0.5, nu_model);
+  }
+}
+
+/**
+ * @brief Threadpool mapper function for the mesh assignment of a cell with
+ * a scheme of a given order, and to the interlaced mesh if any.
+ *
+ * @param map_data A chunk of the list of local cells.
+ * @param num The number of cells in the chunk.
+ * @param extra The information about the mesh and cells.
+ */
+void cell_gpart_to_mesh_order_mapper(void* map_data, int num, void* extra) {
+
+  /* Unpack the shared information */
+  const struct cic_mapper_data* data = (struct cic_mapper_data*)extra;
+  const struct cell* cells = data->cells;
+  double* rho = data->rho;
+  double* rho_interlaced = data->rho_interlaced;
+  const int N = data->N;
+  const int order = data->order;
+  const double fac = data->fac;
+  const double dim[3] = {data->dim[0], data->dim[1], data->dim[2]};
+  const struct neutrino_model* nu_model = data->nu_model;
+
+  /* Pointer to the chunk to be processed */
+  int* local_cells = (int*)map_data;
+
+  /* Start at the same position in the list of patches */
+  const size_t offset = local_cells - data->local_cells;
+
+  /* Loop over the elements assigned to this thread */
+  for (int i = 0; i < num; ++i) {
+
+    /* Pointer to local cell */
+    const struct cell* c = &cells[local_cells[i]];
+
+    /* Skip empty cells */
+    if (c->grav.count == 0) continue;
+
+    if (data->use_local_patches) {
+
+      /* Patches wide enough for the shifted mesh too. They are added to
+       * the global mesh once they are all done. */
+      struct pm_mesh_patch* patch = &data->patches[offset + i];
+      pm_mesh_patch_init(patch, c, N, fac, dim, /*boundary_size=*/2);
+      cell_gpart_to_patch_order(c, patch, order, /*shift=*/0., nu_model);
+
+      if (rho_interlaced != NULL) {
+        patch = &data->patches_interlaced[offset + i];
+        pm_mesh_patch_init(patch, c, N, fac, dim, /*boundary_size=*/2);
+        cell_gpart_to_patch_order(c, patch, order, /*shift=*/0.5, nu_model);
+      }
+
+    } else {
+
+      /* Assign this cell's content directly atomically to the mesh */
+      const struct gpart* gparts = c->grav.parts;
+      for (int k = 0; k < c->grav.count; ++k) {
+        if (gparts[k].time_bin == time_bin_inhibited) continue;
+        gpart_to_mesh_order(&gparts[k], rho, N, fac, dim, order,
+                            /*shift=*/0., nu_model);
+        if (rho_interlaced != NULL)
+          gpart_to_mesh_order(&gparts[k], rho_interlaced, N, fac, dim, order,
+                              /*shift=*/0.5, nu_model);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Interpolates the potential and its gradient at a position using
+ * the scheme of a given order.
+ *
+ * The gradient is obtained with a 5-point stencil along each axis which is
+ * then interpolated in the same way as the potential itself.
+ *
+ * @param pot The potential mesh.
+ * @param N the size of the mesh along one axis.
+ * @param order The order of the mass assignment scheme.
+ * @param pos_x The position along x in units of the mesh spacing.
+ * @param pos_y The position along y in units of the mesh spacing.
+ * @param pos_z The position along z in units of the mesh spacing.
+ * @param p (return) The potential.
+ * @param a (return) Minus the gradient of the potential in mesh units.
+ */
+INLINE static void mesh_order_get(const double* pot, const int N,
+                                  const int order, const double pos_x,
+                                  const double pos_y, const double pos_z,
+                                  double* p, double a[3]) {
+
+  double wx[mesh_assignment_max_order];
+  double wy[mesh_assignment_max_order];
+  double wz[mesh_assignment_max_order];
+  const int i = mesh_assignment_weights(order, pos_x, wx);
+  const int j = mesh_assignment_weights(order, pos_y, wy);
+  const int k = mesh_assignment_weights(order, pos_z, wz);
+
+  /* First, copy the necessary part of the mesh for stencil operations */
+  /* This includes box-wrapping in all 3 dimensions. */
+  const int size = order + 4;
+  double phi[mesh_assignment_max_order + 4][mesh_assignment_max_order + 4]
+            [mesh_assignment_max_order + 4];
+  for (int iii = 0; iii < size; ++iii) {
+    for (int jjj = 0; jjj < size; ++jjj) {
+      for (int kkk = 0; kkk < size; ++kkk) {
+        phi[iii][jjj][kkk] =
+            pot[row_major_id_periodic(i + iii - 2, j + jjj - 2, k + kkk - 2,
+                                      N)];
+      }
+    }
+  }
+
+  *p = 0.;
+  a[0] = 0.;
+  a[1] = 0.;
+  a[2] = 0.;
+
+  for (int ii = 2; ii < order + 2; ++ii) {
+    for (int jj = 2; jj < order + 2; ++jj) {
+      for (int kk = 2; kk < order + 2; ++kk) {
+
+        const double w = wx[ii - 2] * wy[jj - 2] * wz[kk - 2];
+
+        *p += w * phi[ii][jj][kk];
+
+        /* 5-point stencil along each axis for the accelerations */
+        a[0] += w * ((1. / 12.) * phi[ii + 2][jj][kk] -
+                     (2. / 3.) * phi[ii + 1][jj][kk] +
+                     (2. / 3.) * phi[ii - 1][jj][kk] -
+                     (1. / 12.) * phi[ii - 2][jj][kk]);
+        a[1] += w * ((1. / 12.) * phi[ii][jj + 2][kk] -
+                     (2. / 3.) * phi[ii][jj + 1][kk] +
+                     (2. / 3.) * phi[ii][jj - 1][kk] -
+                     (1. / 12.) * phi[ii][jj - 2][kk]);
+        a[2] += w * ((1. / 12.) * phi[ii][jj][kk + 2] -
+                     (2. / 3.) * phi[ii][jj][kk + 1] +
+                     (2. / 3.) * phi[ii][jj][kk - 1] -
+                     (1. / 12.) * phi[ii][jj][kk - 2]);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Computes the potential on a gpart from a given mesh using the
+ * scheme of a given order, averaging with the interlaced mesh if any.
+ *
+ * @param gp The #gpart.
+ * @param pot The potential mesh.
+ * @param pot_interlaced The potential on the interlaced mesh (or NULL).
+ * @param N the size of the mesh along one axis.
+ * @param fac width of a mesh cell.
+ * @param dim The dimensions of the simulation box.
+ * @param order The order of the mass assignment scheme.
+ */
+void mesh_to_gpart_order(struct gpart* gp, const double* pot,
+                         const double* pot_interlaced, const int N,
+                         const double fac, const double dim[3],
+                         const int order) {
+
+  /* Box wrap the gpart's position */
+  const double pos_x = fac * box_wrap(gp->x[0], 0., dim[0]);
+  const double pos_y = fac * box_wrap(gp->x[1], 0., dim[1]);
+  const double pos_z = fac * box_wrap(gp->x[2], 0., dim[2]);
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (gp->time_bin == time_bin_not_created)
+    error("Found an extra particle when computing gravity from mesh.");
+#endif
+
+#ifdef SWIFT_GRAVITY_FORCE_CHECKS
+  if (gp->a_grav_mesh[0] != 0.) error("Particle with non-initalised stuff");
+#ifndef SWIFT_GRAVITY_NO_POTENTIAL
+  if (gp->potential_mesh != 0.) error("Particle with non-initalised stuff");
+#endif
+#endif
+
+  double p, a[3];
+  mesh_order_get(pot, N, order, pos_x, pos_y, pos_z, &p, a);
+
+  /* The interlaced mesh sees the particle half a cell further */
+  if (pot_interlaced != NULL) {
+    double p_i, a_i[3];
+    mesh_order_get(pot_interlaced, N, order, pos_x + 0.5, pos_y + 0.5,
+                   pos_z + 0.5, &p_i, a_i);
+    p = 0.5 * (p + p_i);
+    a[0] = 0.5 * (a[0] + a_i[0]);
+    a[1] = 0.5 * (a[1] + a_i[1]);
+    a[2] = 0.5 * (a[2] + a_i[2]);
+  }
+
+  /* Store things back */
+  gp->a_grav_mesh[0] = fac * a[0];
+  gp->a_grav_mesh[1] = fac * a[1];
+  gp->a_grav_mesh[2] = fac * a[2];
+  gravity_add_comoving_mesh_potential(gp, p);
+}
+
+void cell_mesh_to_gpart_order(const struct cell* c, const double* potential,
+                              const double* potential_interlaced, const int N,
+                              const double fac, const float const_G,
+                              const double dim[3], const int order) {
+
+  const int gcount = c->grav.count;
+  struct gpart* gparts = c->grav.parts;
+
+  /* Assign all the gpart of that cell to the mesh */
+  for (int i = 0; i < gcount; ++i) {
+
+    struct gpart* gp = &gparts[i];
+
+    if (gp->time_bin == time_bin_inhibited) continue;
+
+    gp->a_grav_mesh[0] = 0.f;
+    gp->a_grav_mesh[1] = 0.f;
+    gp->a_grav_mesh[2] = 0.f;
+#ifndef SWIFT_GRAVITY_NO_POTENTIAL
+    gp->potential_mesh = 0.f;
+#endif
+
+    mesh_to_gpart_order(gp, potential, potential_interlaced, N, fac, dim,
+                        order);
+
+    gp->a_grav_mesh[0] *= const_G;
+    gp->a_grav_mesh[1] *= const_G;
+    gp->a_grav_mesh[2] *= const_G;
+#ifndef SWIFT_GRAVITY_NO_POTENTIAL
+    gp->potential_mesh *= const_G;
+#endif
+  }
+}
+
+void mesh_to_gpart_order_mapper(void* map_data, int num, void* extra) {
+
+  /* Unpack the shared information */
+  const struct cic_mapper_data* data = (struct cic_mapper_data*)extra;
+  const double* const potential = data->potential;
+  const double* const potential_interlaced = data->potential_interlaced;
+  const int N = data->N;
+  const int order = data->order;
+  const double fac = data->fac;
+  const double dim[3] = {data->dim[0], data->dim[1], data->dim[2]};
+  const float const_G = data->const_G;
+
+  /* Pointer to the chunk to be processed */
+  struct gpart* gparts = (struct gpart*)map_data;
+
+  /* Loop over the elements assigned to this thread */
+  for (int i = 0; i < num; ++i) {
+
+    struct gpart* gp = &gparts[i];
+    if (gp->time_bin == time_bin_inhibited) continue;
+
+    gp->a_grav_mesh[0] = 0.f;
+    gp->a_grav_mesh[1] = 0.f;
+    gp->a_grav_mesh[2] = 0.f;
+#ifndef SWIFT_GRAVITY_NO_POTENTIAL
+    gp->potential_mesh = 0.f;
+#endif
+
+    mesh_to_gpart_order(gp, potential, potential_interlaced, N, fac, dim,
+                        order);
+
+    gp->a_grav_mesh[0] *= const_G;
+    gp->a_grav_mesh[1] *= const_G;
+    gp->a_grav_mesh[2] *= const_G;
+#ifndef SWIFT_GRAVITY_NO_POTENTIAL
+    gp->potential_mesh *= const_G;
+#endif
+  }
+}
+
+/**
+ * @brief Threadpool mapper function for the mesh interpolation onto the
+ * #gpart of a cell with a scheme of a given order.
+ *
+ * @param map_data A chunk of the list of local cells.
+ * @param num The number of cells in the chunk.
+ * @param extra The information about the mesh and cells.
+ */
+void cell_mesh_to_gpart_order_mapper(void* map_data, int num, void* extra) {
+
+  /* Unpack the shared information */
+  const struct cic_mapper_data* data = (struct cic_mapper_data*)extra;
+  const struct cell* cells = data->cells;
+  const double* const potential = data->potential;
+  const double* const potential_interlaced = data->potential_interlaced;
+  const int N = data->N;
+  const int order = data->order;
+  const double fac = data->fac;
+  const double dim[3] = {data->dim[0], data->dim[1], data->dim[2]};
+  const float const_G = data->const_G;
+
+  /* Pointer to the chunk to be processed */
+  int* local_cells = (int*)map_data;
+
+  /* Loop over the elements assigned to this thread */
+  for (int i = 0; i < num; ++i) {
+
+    /* Pointer to local cell */
+    const struct cell* c = &cells[local_cells[i]];
+
+    /* Interpolate the mesh onto this cell's content */
+    cell_mesh_to_gpart_order(c, potential, potential_interlaced, N, fac,
+                             const_G, dim, order);
+  }
+}
+
+/**
+ * @brief Shared information about the interlacing of the meshes to be used
+ * by all the threads in the pool.
+ */
+struct interlacing_data {
+
+  int N;
+  fftw_complex* frho;
+  fftw_complex* frho_interlaced;
+  int combine;
+};
+
+/**
+ * @brief Mapper function combining or splitting the Fourier transforms of
+ * the mesh and of the interlaced mesh.
+ *
+ * The interlaced mesh sees the particles half a cell further along each
+ * axis so its transform is the one of the mesh times
+ * exp(-i pi (kx + ky + kz) / N), except for the aliased images of odd
+ * order whose sign is flipped. Combining brings it back in phase and
+ * averages the two, which cancel these images. Splitting makes the
+ * transform of the potential on the interlaced mesh from the combined one.
+ *
+ * @param map_data The array of the density field Fourier transform.
+ * @param num The number of elements to iterate on (along the x-axis).
+ * @param extra The #interlacing_data.
+ */
+void mesh_interlacing_mapper(void* map_data, const int num, void* extra) {
+
+  struct interlacing_data* data = (struct interlacing_data*)extra;
+
+  /* Unpack the arrays */
+  fftw_complex* const frho = data->frho;
+  fftw_complex* const frho_interlaced = data->frho_interlaced;
+  const int N = data->N;
+  const int N_half = N / 2;
+  const int combine = data->combine;
+
+  /* Range of x coordinates handled by this call */
+  const int i_start = (fftw_complex*)map_data - frho;
+  const int i_end = i_start + num;
+
+  for (int i = i_start; i < i_end; ++i) {
+    const int kx = (i > N_half ? i - N : i);
+
+    for (int j = 0; j < N; ++j) {
+      const int ky = (j > N_half ? j - N : j);
+
+      for (int k = 0; k < N_half + 1; ++k) {
+        const int kz = k;
+
+        /* Phase of the half-cell shift */
+        const double theta = M_PI * (double)(kx + ky + kz) / (double)N;
+        const double c = cos(theta);
+        const double s = sin(theta);
+
+        const int index = N * (N_half + 1) * i + (N_half + 1) * j + k;
+        if (combine) {
+          const double re = frho_interlaced[index][0] * c -
+                            frho_interlaced[index][1] * s;
+          const double im = frho_interlaced[index][0] * s +
+                            frho_interlaced[index][1] * c;
+          frho[index][0] = 0.5 * (frho[index][0] + re);
+          frho[index][1] = 0.5 * (frho[index][1] + im);
+        } else {
+          frho_interlaced[index][0] = frho[index][0] * c + frho[index][1] * s;
+          frho_interlaced[index][1] = frho[index][1] * c - frho[index][0] * s;
+        }
+      }
+    }
+  }
+}
+
+/**
+ * @brief Combines the transforms of the density on the mesh and on the
+ * interlaced mesh, or splits the potential in Fourier space back onto both.
+ *
+ * @param tp The threadpool.
+ * @param frho The NxNx(N/2+1) Fourier transform of the mesh.
+ * @param frho_interlaced The NxNx(N/2+1) Fourier transform of the
+ * interlaced mesh.
+ * @param N The dimension of the arrays.
+ * @param combine Combine (1) or split (0)?
+ */
+void mesh_apply_interlacing(struct threadpool* tp, fftw_complex* frho,
+                            fftw_complex* frho_interlaced, const int N,
+                            const int combine) {
+
+  struct interlacing_data data;
+  data.N = N;
+  data.frho = frho;
+  data.frho_interlaced = frho_interlaced;
+  data.combine = combine;
 
-    /* Assign this cell's content to the mesh */
-    cell_mesh_to_gpart_CIC(c, potential, N, fac, const_G, dim);
-  }
+  threadpool_map(tp, mesh_interlacing_mapper, frho, N, sizeof(fftw_complex),
+                 threadpool_auto_chunk_size, &data);
 }
 
 /**
@@ -505,6 +1046,7 @@ struct Green_function_data {
   double green_fac;
   double a_smooth2;
   double k_fac;
+  int order;
   int slice_offset;
   int slice_width;
 };
@@ -530,6 +1072,7 @@ void mesh_apply_Green_function_mapper(void* map_data, const int num,
   const double green_fac = data->green_fac;
   const double a_smooth2 = data->a_smooth2;
   const double k_fac = data->k_fac;
+  const int order = data->order;
 
   /* Find what slice of the full mesh is stored on this MPI rank */
   const int slice_offset = data->slice_offset;
@@ -574,13 +1117,12 @@ void mesh_apply_Green_function_mapper(void* map_data, const int num,
         fourier_kernel_long_grav_eval(k2 * a_smooth2, &W);
         const double green_cor = green_fac * W / (k2 + FLT_MIN);
 
-        /* Deconvolution of CIC */
-        const double CIC_cor = sinc_kx_inv * sinc_ky_inv * sinc_kz_inv;
-        const double CIC_cor2 = CIC_cor * CIC_cor;
-        const double CIC_cor4 = CIC_cor2 * CIC_cor2;
+        /* Deconvolution of the assignment and of the interpolation */
+        const double W_cor = sinc_kx_inv * sinc_ky_inv * sinc_kz_inv;
+        const double W_cor_2p = integer_pow(W_cor, 2 * order);
 
         /* Combined correction */
-        const double total_cor = green_cor * CIC_cor4;
+        const double total_cor = green_cor * W_cor_2p;
 
         /* Apply to the mesh */
         const int index =
@@ -596,7 +1138,7 @@ void mesh_apply_Green_function_mapper(void* map_data, const int num,
  * @brief Apply the Green function in Fourier space to the density
  * array to get the potential.
  *
- * Also deconvolves the CIC kernel.
+ * Also deconvolves the mass assignment kernel.
  *
  * @param tp The threadpool.
  * @param frho The NxNx(N/2) complex array of the Fourier transform of the
@@ -605,12 +1147,13 @@ void mesh_apply_Green_function_mapper(void* map_data, const int num,
  * rank
  * @param slice_width The width of the local slice on this MPI rank
  * @param N The dimension of the array.
+ * @param order The order of the mass assignment scheme.
  * @param r_s The Green function smoothing scale.
  * @param box_size The physical size of the simulation box.
  */
 void mesh_apply_Green_function(struct threadpool* tp, fftw_complex* frho,
                                const int slice_offset, const int slice_width,
-                               const int N, const double r_s,
+                               const int N, const int order, const double r_s,
                                const double box_size) {
 
   /* Some common factors */
@@ -620,6 +1163,7 @@ void mesh_apply_Green_function(struct threadpool* tp, fftw_complex* frho,
   data.green_fac = -1. / (M_PI * box_size);
   data.a_smooth2 = 4. * M_PI * M_PI * r_s * r_s / (box_size * box_size);
   data.k_fac = M_PI / (double)N;
+  data.order = order;
   data.slice_offset = slice_offset;
   data.slice_width = slice_width;
 
@@ -637,6 +1181,328 @@ void mesh_apply_Green_function(struct threadpool* tp, fftw_complex* frho,
   }
 }
 
+#if defined(WITH_MPI)
+
+/**
+ * @brief Shared information about the Green function of a pencil
+ * decomposition to be used by all the threads in the pool.
+ */
+struct Green_function_pencil_data {
+
+  int N;
+  fftw_complex* frho;
+  double green_fac;
+  double a_smooth2;
+  double k_fac;
+  int ky_offset;
+  int kz_offset;
+  int kz_width;
+};
+
+/**
+ * @brief Mapper function for the application of the Green function to the
+ * modes of a pencil decomposition (stored as ky x kz x kx).
+ *
+ * @param map_data The array of the density field Fourier transform.
+ * @param num The number of elements to iterate on (along the ky-axis).
+ * @param extra The properties of the Green function.
+ */
+void mesh_apply_Green_function_pencil_mapper(void* map_data, const int num,
+                                             void* extra) {
+
+  struct Green_function_pencil_data* data =
+      (struct Green_function_pencil_data*)extra;
+
+  /* Unpack the array */
+  fftw_complex* const frho = data->frho;
+  const int N = data->N;
+  const int N_half = N / 2;
+
+  /* Unpack the Green function properties */
+  const double green_fac = data->green_fac;
+  const double a_smooth2 = data->a_smooth2;
+  const double k_fac = data->k_fac;
+
+  /* What modes are stored on this MPI rank */
+  const int ky_offset = data->ky_offset;
+  const int kz_offset = data->kz_offset;
+  const int kz_width = data->kz_width;
+
+  /* Range of local ky rows handled by this call */
+  const int j_start = (fftw_complex*)map_data - frho;
+  const int j_end = j_start + num;
+
+  for (int jj = j_start; jj < j_end; ++jj) {
+
+    /* ky component of vector in Fourier space and 1/sinc(ky) */
+    const int j = jj + ky_offset;
+    const int ky = (j > N_half ? j - N : j);
+    const double ky_d = (double)ky;
+    const double fy = k_fac * ky_d;
+    const double sinc_ky_inv = (ky != 0) ? fy / sin(fy) : 1.;
+
+    for (int kk = 0; kk < kz_width; ++kk) {
+
+      /* kz component of vector in Fourier space and 1/sinc(kz) */
+      const int kz = kk + kz_offset;
+      const double kz_d = (double)kz;
+      const double fz = k_fac * kz_d;
+      const double sinc_kz_inv = (kz != 0) ? fz / (sin(fz) + FLT_MIN) : 1.;
+
+      for (int i = 0; i < N; ++i) {
+
+        /* kx component of vector in Fourier space and 1/sinc(kx) */
+        const int kx = (i > N_half ? i - N : i);
+        const double kx_d = (double)kx;
+        const double fx = k_fac * kx_d;
+        const double sinc_kx_inv = (kx != 0) ? fx / sin(fx) : 1.;
+
+        /* Norm of vector in Fourier space */
+        const double k2 = (kx_d * kx_d + ky_d * ky_d + kz_d * kz_d);
+
+        /* Avoid FPEs... */
+        if (k2 == 0.) continue;
+
+        /* Green function */
+        double W = 1.;
+        fourier_kernel_long_grav_eval(k2 * a_smooth2, &W);
+        const double green_cor = green_fac * W / (k2 + FLT_MIN);
+
+        /* Deconvolution of CIC */
+        const double CIC_cor = sinc_kx_inv * sinc_ky_inv * sinc_kz_inv;
+        const double CIC_cor2 = CIC_cor * CIC_cor;
+        const double CIC_cor4 = CIC_cor2 * CIC_cor2;
+
+        /* Combined correction */
+        const double total_cor = green_cor * CIC_cor4;
+
+        /* Apply to the mesh */
+        const size_t index = ((size_t)jj * kz_width + kk) * N + i;
+        frho[index][0] *= total_cor;
+        frho[index][1] *= total_cor;
+      }
+    }
+  }
+}
+
+/**
+ * @brief Apply the Green function in Fourier space to the modes of a
+ * pencil decomposition to get the potential.
+ *
+ * Also deconvolves the CIC kernel.
+ *
+ * @param tp The threadpool.
+ * @param pencil The #pm_mesh_pencil holding the modes.
+ * @param r_s The Green function smoothing scale.
+ * @param box_size The physical size of the simulation box.
+ */
+void mesh_apply_Green_function_pencil(struct threadpool* tp,
+                                      struct pm_mesh_pencil* pencil,
+                                      const double r_s,
+                                      const double box_size) {
+
+  const int N = pencil->N;
+  const int c0 = pencil->coord[0];
+  const int c1 = pencil->coord[1];
+
+  /* Some common factors */
+  struct Green_function_pencil_data data;
+  data.frho = pencil->frho;
+  data.N = N;
+  data.green_fac = -1. / (M_PI * box_size);
+  data.a_smooth2 = 4. * M_PI * M_PI * r_s * r_s / (box_size * box_size);
+  data.k_fac = M_PI / (double)N;
+  data.ky_offset = pencil->x_offset[c0];
+  data.kz_offset = pencil->kz_offset[c1];
+  data.kz_width = pencil->kz_width[c1];
+
+  /* Split the ky rows over the threads */
+  threadpool_map(tp, mesh_apply_Green_function_pencil_mapper, pencil->frho,
+                 pencil->x_width[c0], sizeof(fftw_complex),
+                 threadpool_auto_chunk_size, &data);
+
+  /* Correct singularity at (0,0,0) */
+  if (data.ky_offset == 0 && data.kz_offset == 0) {
+    pencil->frho[0][0] = 0.;
+    pencil->frho[0][1] = 0.;
+  }
+}
+
+#endif
+
+/**
+ * @brief Loads the FFTW wisdom of the mesh from its file, if we have one.
+ *
+ * Over MPI, rank 0 reads it and broadcasts it to everybody.
+ *
+ * @param mesh The #pm_mesh.
+ */
+void pm_mesh_import_wisdom(const struct pm_mesh* mesh) {
+
+  if (mesh->fftw_wisdom_file[0] == '\0') return;
+
+  int imported = 0;
+  if (engine_rank == 0)
+    imported = fftw_import_wisdom_from_filename(mesh->fftw_wisdom_file);
+#if defined(WITH_MPI) && defined(HAVE_MPI_FFTW)
+  fftw_mpi_broadcast_wisdom(MPI_COMM_WORLD);
+#elif defined(WITH_MPI)
+  if (engine_rank != 0)
+    imported = fftw_import_wisdom_from_filename(mesh->fftw_wisdom_file);
+#endif
+
+  if (engine_rank == 0 && imported)
+    message("Imported the FFTW wisdom from '%s'.", mesh->fftw_wisdom_file);
+}
+
+/**
+ * @brief Saves the FFTW wisdom of the mesh to its file, if we have one.
+ *
+ * Over MPI, the wisdom of all the ranks is gathered and written by rank 0.
+ *
+ * @param mesh The #pm_mesh.
+ */
+void pm_mesh_export_wisdom(const struct pm_mesh* mesh) {
+
+  if (mesh->fftw_wisdom_file[0] == '\0') return;
+
+#if defined(WITH_MPI) && defined(HAVE_MPI_FFTW)
+  fftw_mpi_gather_wisdom(MPI_COMM_WORLD);
+#endif
+
+  if (engine_rank == 0 &&
+      !fftw_export_wisdom_to_filename(mesh->fftw_wisdom_file))
+    message("WARNING: Could not save the FFTW wisdom to '%s'.",
+            mesh->fftw_wisdom_file);
+}
+
+/**
+ * @brief Makes sure the buffers and the plans of the FFTs of the mesh exist.
+ *
+ * The buffers are allocated here (and released by pm_mesh_free() when the
+ * memory is needed elsewhere), the plans are made on the first call only
+ * and kept until pm_mesh_clean(). They are then executed on whichever
+ * buffers are current, which FFTW allows as they all come from
+ * fftw_malloc() and hence share the same alignment.
+ *
+ * Planning may overwrite the content of the buffers so this must be called
+ * before the density is assigned to the mesh.
+ *
+ * @param mesh The #pm_mesh.
+ */
+void pm_mesh_prepare_fft(struct pm_mesh* mesh) {
+
+  const int N = mesh->N;
+  const unsigned int flags =
+      (mesh->fftw_measure ? FFTW_MEASURE : FFTW_ESTIMATE) | FFTW_DESTROY_INPUT;
+
+  if (mesh->distributed_mesh && mesh->distributed_mesh_pencils) {
+
+#if defined(WITH_MPI)
+    /* Set up the decomposition and its 1D plans (only done once) */
+    if (mesh->pencil == NULL) {
+      pm_mesh_import_wisdom(mesh);
+      mesh->pencil =
+          (struct pm_mesh_pencil*)malloc(sizeof(struct pm_mesh_pencil));
+      if (mesh->pencil == NULL)
+        error("Failed to allocate the pencil decomposition of the mesh");
+      pm_mesh_pencil_init(mesh->pencil, N, flags & ~FFTW_DESTROY_INPUT);
+      pm_mesh_export_wisdom(mesh);
+
+      if (engine_rank == 0)
+        message("Distributed mesh split in %d x %d pencils.",
+                mesh->pencil->P[0], mesh->pencil->P[1]);
+    }
+#else
+    error("Need MPI to compute a distributed mesh.");
+#endif
+
+  } else if (mesh->distributed_mesh) {
+
+#if defined(WITH_MPI) && defined(HAVE_MPI_FFTW)
+
+    /* Ask FFTW what slice of the density field we need to store on this
+       task. Note that fftw_mpi_local_size_3d works in terms of the size of the
+       complex output. The last dimension of the real input is padded to
+       2*(N/2+1). */
+    if (mesh->rho_slice == NULL) {
+      mesh->nalloc = fftw_mpi_local_size_3d(
+          (ptrdiff_t)N, (ptrdiff_t)N, (ptrdiff_t)(N / 2 + 1), MPI_COMM_WORLD,
+          &mesh->local_n0, &mesh->local_0_start);
+
+      /* Note: nalloc is the number of *complex* values. */
+      mesh->rho_slice = (double*)fftw_malloc(2 * mesh->nalloc * sizeof(double));
+      if (mesh->rho_slice == NULL)
+        error("Error allocating memory for the density mesh slice");
+      memuse_log_allocation("fftw_rho_slice", mesh->rho_slice, 1,
+                            2 * mesh->nalloc * sizeof(double),
+                            memuse_policy_none);
+
+      mesh->frho_slice =
+          (fftw_complex*)fftw_malloc(mesh->nalloc * sizeof(fftw_complex));
+      if (mesh->frho_slice == NULL)
+        error("Error allocating memory for the transform of the mesh slice");
+      memuse_log_allocation("fftw_frho_slice", mesh->frho_slice, 1,
+                            mesh->nalloc * sizeof(fftw_complex),
+                            memuse_policy_none);
+    }
+
+    /* We can save a bit of time if we allow FFTW to transpose the first two
+     * dimensions of the output. */
+    if (mesh->forward_plan == NULL) {
+      pm_mesh_import_wisdom(mesh);
+      mesh->forward_plan = fftw_mpi_plan_dft_r2c_3d(
+          N, N, N, mesh->rho_slice, (fftw_complex*)mesh->frho_slice,
+          MPI_COMM_WORLD, flags | FFTW_MPI_TRANSPOSED_OUT);
+      mesh->inverse_plan = fftw_mpi_plan_dft_c2r_3d(
+          N, N, N, (fftw_complex*)mesh->frho_slice, mesh->rho_slice,
+          MPI_COMM_WORLD, flags | FFTW_MPI_TRANSPOSED_IN);
+      if (mesh->forward_plan == NULL || mesh->inverse_plan == NULL)
+        error("Failed to make the FFTW plans of the distributed mesh");
+      pm_mesh_export_wisdom(mesh);
+    }
+#else
+    error("No FFTW MPI library available. Cannot compute distributed mesh.");
+#endif
+
+  } else {
+
+    if (mesh->potential_global == NULL)
+      error("Error allocating memory for density mesh");
+
+    /* Allocates some memory for the mesh in Fourier space */
+    if (mesh->frho_global == NULL) {
+      const size_t size = sizeof(fftw_complex) * N * N * (N / 2 + 1);
+      mesh->frho_global = (fftw_complex*)fftw_malloc(size);
+      if (mesh->frho_global == NULL)
+        error("Error allocating memory for transform of density mesh");
+      memuse_log_allocation("fftw_frho", mesh->frho_global, 1, size,
+                            memuse_policy_none);
+    }
+    if (mesh->interlacing && mesh->frho_interlaced == NULL) {
+      const size_t size = sizeof(fftw_complex) * N * N * (N / 2 + 1);
+      mesh->frho_interlaced = (fftw_complex*)fftw_malloc(size);
+      if (mesh->frho_interlaced == NULL)
+        error("Error allocating memory for transform of interlaced mesh");
+      memuse_log_allocation("fftw_frho_interlaced", mesh->frho_interlaced, 1,
+                            size, memuse_policy_none);
+    }
+
+    if (mesh->forward_plan == NULL) {
+      pm_mesh_import_wisdom(mesh);
+      mesh->forward_plan =
+          fftw_plan_dft_r2c_3d(N, N, N, mesh->potential_global,
+                               (fftw_complex*)mesh->frho_global, flags);
+      mesh->inverse_plan =
+          fftw_plan_dft_c2r_3d(N, N, N, (fftw_complex*)mesh->frho_global,
+                               mesh->potential_global, flags);
+      if (mesh->forward_plan == NULL || mesh->inverse_plan == NULL)
+        error("Failed to make the FFTW plans of the mesh");
+      pm_mesh_export_wisdom(mesh);
+    }
+  }
+}
+
 #endif
 
 /**
@@ -692,15 +1558,97 @@ void compute_potential_distributed(struct pm_mesh* mesh, const struct space* s,
     message("Accumulating mass to local patches took %.3f %s.",
             clocks_from_ticks(getticks() - tic), clocks_getunit());
 
+  /* Pencil decomposition: same steps with our own transposes */
+  if (mesh->distributed_mesh_pencils) {
+
+    tic = getticks();
+
+    /* Get the decomposition and its plans (only made on the first call) */
+    pm_mesh_prepare_fft(mesh);
+    struct pm_mesh_pencil* pencil = mesh->pencil;
+    const size_t nr_cells_local =
+        (size_t)pencil->x_width[pencil->coord[0]] *
+        pencil->y_width[pencil->coord[1]] * (2 * (N / 2 + 1));
+    memset(pencil->rho, 0, nr_cells_local * sizeof(double));
+
+    /* Construct the density field columns from the local patches.
+     * Note: This cleans up the local_patches entries. */
+    mpi_mesh_local_patches_to_slices(N, /*local_n0=*/0, local_patches,
+                                     nr_local_cells, pencil->rho, pencil, tp,
+                                     verbose);
+    if (verbose)
+      message("Assembling mesh pencils took %.3f %s.",
+              clocks_from_ticks(getticks() - tic), clocks_getunit());
+
+    tic = getticks();
+
+    pm_mesh_pencil_forward(pencil);
+    if (verbose)
+      message("Pencil Forward Fourier transform took %.3f %s.",
+              clocks_from_ticks(getticks() - tic), clocks_getunit());
+
+    tic = getticks();
+
+    mesh_apply_Green_function_pencil(tp, pencil, r_s, box_size);
+    if (verbose)
+      message("Applying Green function took %.3f %s.",
+              clocks_from_ticks(getticks() - tic), clocks_getunit());
+
+    /* If using linear response neutrinos, apply to our modes */
+    if (s->e->neutrino_properties->use_linear_response) {
+      tic = getticks();
+
+      const int c0 = pencil->coord[0];
+      const int c1 = pencil->coord[1];
+      neutrino_response_compute_pencil(
+          s, mesh, tp, pencil->frho, pencil->x_offset[c0], pencil->x_width[c0],
+          pencil->kz_offset[c1], pencil->kz_width[c1], verbose);
+
+      if (verbose)
+        message("Applying neutrino response took %.3f %s.",
+                clocks_from_ticks(getticks() - tic), clocks_getunit());
+    }
+
+    tic = getticks();
+
+    pm_mesh_pencil_inverse(pencil);
+    if (verbose)
+      message("Pencil Reverse Fourier transform took %.3f %s.",
+              clocks_from_ticks(getticks() - tic), clocks_getunit());
+
+    tic = getticks();
+
+    /* Fetch the mesh entries we need on this rank from the other ones */
+    mpi_mesh_fetch_potential(N, cell_fac, s, /*local_0_start=*/0,
+                             /*local_n0=*/0, pencil->rho, local_patches,
+                             pencil, tp, verbose);
+    if (verbose)
+      message("Fetching local potential took %.3f %s.",
+              clocks_from_ticks(getticks() - tic), clocks_getunit());
+
+    tic = getticks();
+
+    /* Compute accelerations and potentials for the gparts */
+    mpi_mesh_update_gparts(local_patches, s, tp, N, cell_fac);
+
+    /* Clean the local patches array */
+    for (int i = 0; i < nr_local_cells; ++i)
+      pm_mesh_patch_clean(&local_patches[i]);
+    free(local_patches);
+
+    if (verbose)
+      message("Computing mesh accelerations took %.3f %s.",
+              clocks_from_ticks(getticks() - tic), clocks_getunit());
+    return;
+  }
+
   tic = getticks();
 
-  /* Ask FFTW what slice of the density field we need to store on this task.
-     Note that fftw_mpi_local_size_3d works in terms of the size of the complex
-     output. The last dimension of the real input is padded to 2*(N/2+1). */
-  ptrdiff_t local_n0, local_0_start;
-  ptrdiff_t nalloc =
-      fftw_mpi_local_size_3d((ptrdiff_t)N, (ptrdiff_t)N, (ptrdiff_t)(N / 2 + 1),
-                             MPI_COMM_WORLD, &local_n0, &local_0_start);
+  /* Get the slices and plans of the FFT (only made on the first call) */
+  pm_mesh_prepare_fft(mesh);
+  const ptrdiff_t local_n0 = mesh->local_n0;
+  const ptrdiff_t local_0_start = mesh->local_0_start;
+  const ptrdiff_t nalloc = mesh->nalloc;
   if (verbose)
     message("Local density field slice has thickness %d.", (int)local_n0);
   if (verbose)
@@ -710,11 +1658,11 @@ void compute_potential_distributed(struct pm_mesh* mesh, const struct space* s,
     message("Planning the FFT took %.3f %s.",
             clocks_from_ticks(getticks() - tic), clocks_getunit());
 
-  /* Allocate storage for mesh slices.
+  /* Zero the mesh slice.
    *
    * Note: nalloc is the number of *complex* values.
    */
-  double* rho_slice = (double*)fftw_malloc(2 * nalloc * sizeof(double));
+  double* rho_slice = mesh->rho_slice;
   memset(rho_slice, 0, 2 * nalloc * sizeof(double));
 
   tic = getticks();
@@ -723,16 +1671,16 @@ void compute_potential_distributed(struct pm_mesh* mesh, const struct space* s,
    * patches.
    * Note: This cleans up the local_patches entries. */
   mpi_mesh_local_patches_to_slices(N, (int)local_n0, local_patches,
-                                   nr_local_cells, rho_slice, tp, verbose);
+                                   nr_local_cells, rho_slice, /*pencil=*/NULL,
+                                   tp, verbose);
   if (verbose)
     message("Assembling mesh slices took %.3f %s.",
             clocks_from_ticks(getticks() - tic), clocks_getunit());
 
   tic = getticks();
 
-  /* Allocate storage for the slices of the FFT of the density mesh */
-  fftw_complex* frho_slice =
-      (fftw_complex*)fftw_malloc(nalloc * sizeof(fftw_complex));
+  /* The slice of the FFT of the density mesh */
+  fftw_complex* frho_slice = (fftw_complex*)mesh->frho_slice;
 
   /* Carry out the MPI Fourier transform. We can save a bit of time
    * if we allow FFTW to transpose the first two dimensions of the output.
@@ -746,11 +1694,8 @@ void compute_potential_distributed(struct pm_mesh* mesh, const struct space* s,
    * the output. Each MPI rank has slice of thickness local_n0
    * starting at local_0_start in the first dimension.
    */
-  fftw_plan mpi_plan = fftw_mpi_plan_dft_r2c_3d(
-      N, N, N, rho_slice, frho_slice, MPI_COMM_WORLD,
-      FFTW_ESTIMATE | FFTW_MPI_TRANSPOSED_OUT | FFTW_DESTROY_INPUT);
-  fftw_execute(mpi_plan);
-  fftw_destroy_plan(mpi_plan);
+  fftw_mpi_execute_dft_r2c((fftw_plan)mesh->forward_plan, rho_slice,
+                           frho_slice);
   if (verbose)
     message("MPI Forward Fourier transform took %.3f %s.",
             clocks_from_ticks(getticks() - tic), clocks_getunit());
@@ -758,8 +1703,8 @@ void compute_potential_distributed(struct pm_mesh* mesh, const struct space* s,
   tic = getticks();
 
   /* Apply Green function to local slice of the MPI mesh */
-  mesh_apply_Green_function(tp, frho_slice, local_0_start, local_n0, N, r_s,
-                            box_size);
+  mesh_apply_Green_function(tp, frho_slice, local_0_start, local_n0, N,
+                            mesh->assignment_order, r_s, box_size);
   if (verbose)
     message("Applying Green function took %.3f %s.",
             clocks_from_ticks(getticks() - tic), clocks_getunit());
@@ -779,32 +1724,23 @@ void compute_potential_distributed(struct pm_mesh* mesh, const struct space* s,
   }
 
   /* Carry out the reverse MPI Fourier transform */
-  fftw_plan mpi_inverse_plan = fftw_mpi_plan_dft_c2r_3d(
-      N, N, N, frho_slice, rho_slice, MPI_COMM_WORLD,
-      FFTW_ESTIMATE | FFTW_MPI_TRANSPOSED_IN | FFTW_DESTROY_INPUT);
-  fftw_execute(mpi_inverse_plan);
-  fftw_destroy_plan(mpi_inverse_plan);
+  fftw_mpi_execute_dft_c2r((fftw_plan)mesh->inverse_plan, frho_slice,
+                           rho_slice);
 
   if (verbose)
     message("MPI Reverse Fourier transform took %.3f %s.",
             clocks_from_ticks(getticks() - tic), clocks_getunit());
 
-  /* We can now free the Fourier-space data */
-  fftw_free(frho_slice);
-
   tic = getticks();
 
   /* Fetch MPI mesh entries we need on this rank from other ranks */
   mpi_mesh_fetch_potential(N, cell_fac, s, local_0_start, local_n0, rho_slice,
-                           local_patches, tp, verbose);
+                           local_patches, /*pencil=*/NULL, tp, verbose);
 
   if (verbose)
     message("Fetching local potential took %.3f %s.",
             clocks_from_ticks(getticks() - tic), clocks_getunit());
 
-  /* Free the local slice of the potential */
-  fftw_free(rho_slice);
-
   tic = getticks();
 
   /* Compute accelerations and potentials for the gparts */
@@ -829,7 +1765,11 @@ void compute_potential_distributed(struct pm_mesh* mesh, const struct space* s,
  *
  * Interpolates the top-level multipoles on-to a mesh, move to Fourier space,
  * compute the potential including short-range correction and move back
- * to real space. We use CIC for the interpolation.
+ * to real space. We use CIC for the interpolation unless a higher-order
+ * scheme (TSC or PCS) is asked for. With interlacing, a second mesh sees the
+ * particles shifted by half a cell. The two transforms are averaged, which
+ * cancels the leading aliased images, and the forces interpolated from both
+ * potentials are averaged.
  *
  * This version stores the full N*N*N mesh on each MPI rank and uses the
  * non-MPI version of FFTW.
@@ -857,33 +1797,38 @@ void compute_potential_global(struct pm_mesh* mesh, const struct space* s,
       mesh->dim[2] != dim[2])
     error("Domain size does not match the value stored in the space.");
 
+  /* Do the whole thing on the GPU unless the neutrino response has to be
+   * applied to the transform on the host */
+  if (gpu_pm_mesh.active && !s->e->neutrino_properties->use_linear_response) {
+    cuda_pm_mesh_compute(mesh, s, tp, verbose);
+    return;
+  }
+
   /* Some useful constants */
   const int N = mesh->N;
-  const int N_half = N / 2;
   const double cell_fac = N / box_size;
 
+  /* Get the buffers and plans of the FFT (only planned on the first call) */
+  pm_mesh_prepare_fft(mesh);
+
   /* Use the memory allocated for the potential to temporarily store rho */
   double* restrict rho = mesh->potential_global;
-  if (rho == NULL) error("Error allocating memory for density mesh");
-
-  /* Allocates some memory for the mesh in Fourier space */
-  fftw_complex* restrict frho =
-      (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * N * N * (N_half + 1));
-  if (frho == NULL)
-    error("Error allocating memory for transform of density mesh");
-  memuse_log_allocation("fftw_frho", frho, 1,
-                        sizeof(fftw_complex) * N * N * (N_half + 1));
-
-  /* Prepare the FFT library */
-  fftw_plan forward_plan = fftw_plan_dft_r2c_3d(
-      N, N, N, rho, frho, FFTW_ESTIMATE | FFTW_DESTROY_INPUT);
-  fftw_plan inverse_plan = fftw_plan_dft_c2r_3d(
-      N, N, N, frho, rho, FFTW_ESTIMATE | FFTW_DESTROY_INPUT);
+
+  /* The mesh in Fourier space */
+  fftw_complex* restrict frho = (fftw_complex*)mesh->frho_global;
+
+  /* The interlaced mesh, if any, in real and Fourier space */
+  const int order = mesh->assignment_order;
+  const int interlacing = mesh->interlacing;
+  double* restrict rho_interlaced = mesh->potential_interlaced;
+  fftw_complex* restrict frho_interlaced =
+      (fftw_complex*)mesh->frho_interlaced;
 
   ticks tic = getticks();
 
   /* Zero everything */
   bzero(rho, N * N * N * sizeof(double));
+  if (interlacing) bzero(rho_interlaced, N * N * N * sizeof(double));
 
   /* Gather some neutrino constants if using delta-f weighting on the mesh */
   struct neutrino_model nu_model;
@@ -894,9 +1839,15 @@ void compute_potential_global(struct pm_mesh* mesh, const struct space* s,
   /* Gather the mesh shared information to be used by the threads */
   struct cic_mapper_data data;
   data.cells = s->cells_top;
+  data.local_cells = local_cells;
+  data.patches = NULL;
+  data.patches_interlaced = NULL;
   data.rho = rho;
+  data.rho_interlaced = interlacing ? rho_interlaced : NULL;
   data.potential = NULL;
+  data.potential_interlaced = NULL;
   data.N = N;
+  data.order = order;
   data.use_local_patches = mesh->use_local_patches;
   data.fac = cell_fac;
   data.dim[0] = dim[0];
@@ -909,17 +1860,49 @@ void compute_potential_global(struct pm_mesh* mesh, const struct space* s,
 
     /* We don't have a cell infrastructure in place so we need to
      * directly loop over the particles */
-    threadpool_map(tp, gpart_to_mesh_CIC_mapper, s->gparts, s->nr_gparts,
-                   sizeof(struct gpart), threadpool_auto_chunk_size,
-                   (void*)&data);
+    threadpool_map(tp,
+                   (order == 2 && !interlacing) ? gpart_to_mesh_CIC_mapper
+                                                : gpart_to_mesh_order_mapper,
+                   s->gparts, s->nr_gparts, sizeof(struct gpart),
+                   threadpool_auto_chunk_size, (void*)&data);
 
   } else { /* Normal case */
 
-    /* Do a parallel CIC mesh assignment of the gparts but only using
+    /* One patch per local top-level cell, kept until they are all done */
+    const int nr_meshes = interlacing ? 2 : 1;
+    struct pm_mesh_patch* patches = NULL;
+    if (mesh->use_local_patches) {
+      patches = (struct pm_mesh_patch*)calloc(
+          nr_meshes * nr_local_cells, sizeof(struct pm_mesh_patch));
+      if (patches == NULL)
+        error("Could not allocate array of local mesh patches!");
+      data.patches = patches;
+      data.patches_interlaced = interlacing ? patches + nr_local_cells : NULL;
+    }
+
+    /* Do a parallel mesh assignment of the gparts but only using
      * the local top-level cells */
-    threadpool_map(tp, cell_gpart_to_mesh_CIC_mapper, (void*)local_cells,
-                   nr_local_cells, sizeof(int), threadpool_auto_chunk_size,
-                   (void*)&data);
+    threadpool_map(tp,
+                   (order == 2 && !interlacing)
+                       ? cell_gpart_to_mesh_CIC_mapper
+                       : cell_gpart_to_mesh_order_mapper,
+                   (void*)local_cells, nr_local_cells, sizeof(int),
+                   threadpool_auto_chunk_size, (void*)&data);
+
+    if (mesh->use_local_patches) {
+
+      /* Add the patches to the global mesh, each thread owning a range of
+       * planes so that no atomics are needed */
+      pm_add_patches_to_global_mesh(tp, rho, patches, nr_local_cells, N);
+      if (interlacing)
+        pm_add_patches_to_global_mesh(tp, rho_interlaced,
+                                      patches + nr_local_cells, nr_local_cells,
+                                      N);
+
+      for (int i = 0; i < nr_meshes * nr_local_cells; ++i)
+        pm_mesh_patch_clean(&patches[i]);
+      free(patches);
+    }
   }
 
   if (verbose)
@@ -934,6 +1917,9 @@ void compute_potential_global(struct pm_mesh* mesh, const struct space* s,
   /* Merge everybody's share of the density mesh */
   MPI_Allreduce(MPI_IN_PLACE, rho, N * N * N, MPI_DOUBLE, MPI_SUM,
                 MPI_COMM_WORLD);
+  if (interlacing)
+    MPI_Allreduce(MPI_IN_PLACE, rho_interlaced, N * N * N, MPI_DOUBLE,
+                  MPI_SUM, MPI_COMM_WORLD);
 
   if (verbose)
     message("Mesh MPI-reduction took %.3f %s.",
@@ -946,7 +1932,10 @@ void compute_potential_global(struct pm_mesh* mesh, const struct space* s,
   tic = getticks();
 
   /* Fourier transform to go to magic-land */
-  fftw_execute(forward_plan);
+  fftw_execute_dft_r2c((fftw_plan)mesh->forward_plan, rho, frho);
+  if (interlacing)
+    fftw_execute_dft_r2c((fftw_plan)mesh->forward_plan, rho_interlaced,
+                         frho_interlaced);
 
   if (verbose)
     message("Forward Fourier transform took %.3f %s.",
@@ -955,11 +1944,15 @@ void compute_potential_global(struct pm_mesh* mesh, const struct space* s,
   /* frho now contains the Fourier transform of the density field */
   /* frho contains NxNx(N/2+1) complex numbers */
 
+  /* Average in the interlaced mesh */
+  if (interlacing)
+    mesh_apply_interlacing(tp, frho, frho_interlaced, N, /*combine=*/1);
+
   tic = getticks();
 
-  /* Now de-convolve the CIC kernel and apply the Green function */
+  /* Now de-convolve the assignment kernel and apply the Green function */
   mesh_apply_Green_function(tp, frho, /*slice_offset=*/0, /*slice_width=*/N,
-                            /* mesh_size=*/N, r_s, box_size);
+                            /* mesh_size=*/N, order, r_s, box_size);
 
   if (verbose)
     message("Applying Green function took %.3f %s.",
@@ -979,8 +1972,15 @@ void compute_potential_global(struct pm_mesh* mesh, const struct space* s,
     tic = getticks();
   }
 
+  /* The potential on the interlaced mesh (before frho gets overwritten) */
+  if (interlacing)
+    mesh_apply_interlacing(tp, frho, frho_interlaced, N, /*combine=*/0);
+
   /* Fourier transform to come back from magic-land */
-  fftw_execute(inverse_plan);
+  fftw_execute_dft_c2r((fftw_plan)mesh->inverse_plan, frho, rho);
+  if (interlacing)
+    fftw_execute_dft_c2r((fftw_plan)mesh->inverse_plan, frho_interlaced,
+                         rho_interlaced);
 
   if (verbose)
     message("Reverse Fourier transform took %.3f %s.",
@@ -1000,7 +2000,9 @@ void compute_potential_global(struct pm_mesh* mesh, const struct space* s,
   /* Gather the mesh shared information to be used by the threads */
   data.cells = s->cells_top;
   data.rho = NULL;
+  data.rho_interlaced = NULL;
   data.potential = mesh->potential_global;
+  data.potential_interlaced = interlacing ? rho_interlaced : NULL;
   data.N = N;
   data.fac = cell_fac;
   data.dim[0] = dim[0];
@@ -1012,34 +2014,80 @@ void compute_potential_global(struct pm_mesh* mesh, const struct space* s,
 
     /* We don't have a cell infrastructure in place so we need to
      * directly loop over the particles */
-    threadpool_map(tp, mesh_to_gpart_CIC_mapper, s->gparts, s->nr_gparts,
-                   sizeof(struct gpart), threadpool_auto_chunk_size,
-                   (void*)&data);
+    threadpool_map(tp,
+                   (order == 2 && !interlacing) ? mesh_to_gpart_CIC_mapper
+                                                : mesh_to_gpart_order_mapper,
+                   s->gparts, s->nr_gparts, sizeof(struct gpart),
+                   threadpool_auto_chunk_size, (void*)&data);
 
   } else { /* Normal case */
 
-    /* Do a parallel CIC mesh interpolation onto the gparts but only using
+    /* Do a parallel mesh interpolation onto the gparts but only using
        the local top-level cells */
-    threadpool_map(tp, cell_mesh_to_gpart_CIC_mapper, (void*)local_cells,
-                   nr_local_cells, sizeof(int), threadpool_auto_chunk_size,
-                   (void*)&data);
+    threadpool_map(tp,
+                   (order == 2 && !interlacing)
+                       ? cell_mesh_to_gpart_CIC_mapper
+                       : cell_mesh_to_gpart_order_mapper,
+                   (void*)local_cells, nr_local_cells, sizeof(int),
+                   threadpool_auto_chunk_size, (void*)&data);
   }
 
   if (verbose)
     message("Computing mesh accelerations took %.3f %s.",
             clocks_from_ticks(getticks() - tic), clocks_getunit());
 
-  /* Clean-up the mess */
-  fftw_destroy_plan(forward_plan);
-  fftw_destroy_plan(inverse_plan);
-  memuse_log_allocation("fftw_frho", frho, 0, 0);
-  fftw_free(frho);
-
 #else
   error("No FFTW library found. Cannot compute periodic long-range forces.");
 #endif
 }
 
+/**
+ * @brief Threadpool mapper function for the largest mesh acceleration.
+ *
+ * @param map_data A chunk of the #gpart.
+ * @param num The number of #gpart in the chunk.
+ * @param extra The largest norm of the mesh acceleration so far.
+ */
+void mesh_max_acceleration_mapper(void* map_data, int num, void* extra) {
+
+  const struct gpart* gparts = (const struct gpart*)map_data;
+  float* a_max = (float*)extra;
+
+  float a2_max = 0.f;
+  for (int i = 0; i < num; ++i) {
+    const struct gpart* gp = &gparts[i];
+    if (gp->time_bin == time_bin_inhibited) continue;
+    const float a2 = gp->a_grav_mesh[0] * gp->a_grav_mesh[0] +
+                     gp->a_grav_mesh[1] * gp->a_grav_mesh[1] +
+                     gp->a_grav_mesh[2] * gp->a_grav_mesh[2];
+    a2_max = max(a2_max, a2);
+  }
+
+  atomic_max_f(a_max, sqrtf(a2_max));
+}
+
+/**
+ * @brief Collect the largest mesh acceleration of all the #gpart.
+ *
+ * @param mesh The #pm_mesh.
+ * @param s The #space containing the particles.
+ * @param tp The #threadpool object used for parallelisation.
+ */
+static void pm_mesh_measure_acceleration(struct pm_mesh* mesh,
+                                         const struct space* s,
+                                         struct threadpool* tp) {
+
+  float a_max = 0.f;
+  threadpool_map(tp, mesh_max_acceleration_mapper, s->gparts, s->nr_gparts,
+                 sizeof(struct gpart), threadpool_auto_chunk_size, &a_max);
+
+#ifdef WITH_MPI
+  MPI_Allreduce(MPI_IN_PLACE, &a_max, 1, MPI_FLOAT, MPI_MAX, MPI_COMM_WORLD);
+#endif
+
+  mesh->a_mesh_max = a_max;
+}
+
 /**
  * @brief Compute the mesh forces and potential, including periodic correction.
  *
@@ -1062,6 +2110,31 @@ void pm_mesh_compute_potential(struct pm_mesh* mesh, const struct space* s,
   } else {
     compute_potential_global(mesh, s, tp, verbose);
   }
+
+  /* Record how strong the mesh forces now are for the mesh time-step */
+  if (mesh->eta > 0.f) pm_mesh_measure_acceleration(mesh, s, tp);
+}
+
+/**
+ * @brief The time-step allowed by the mesh-scale dynamical time.
+ *
+ * This is the usual acceleration criterion of the #gpart with the softening
+ * replaced by the mesh smoothing scale and the acceleration by the largest
+ * one of the last mesh computation. The long-range forces hence only
+ * get recomputed once the particles can have moved by a fraction of the
+ * scale over which they vary.
+ *
+ * @param mesh The #pm_mesh.
+ * @param cosmo The current cosmological model.
+ * @return The time-step (FLT_MAX if not constrained).
+ */
+double pm_mesh_dynamical_timestep(const struct pm_mesh* mesh,
+                                  const struct cosmology* cosmo) {
+
+  if (mesh->eta <= 0.f || mesh->a_mesh_max <= 0.f) return FLT_MAX;
+
+  const double a_phys = mesh->a_mesh_max * cosmo->a_factor_grav_accel;
+  return sqrt(2. * mesh->eta * cosmo->a * mesh->r_s / a_phys);
 }
 
 /**
@@ -1083,7 +2156,17 @@ void pm_mesh_allocate(struct pm_mesh* mesh) {
     if (mesh->potential_global == NULL)
       error("Error allocating memory for the long-range gravity mesh.");
     memuse_log_allocation("fftw_mesh.potential", mesh->potential_global, 1,
-                          sizeof(double) * N * N * N);
+                          sizeof(double) * N * N * N, memuse_policy_none);
+
+    /* And for the interlaced one */
+    if (mesh->interlacing) {
+      mesh->potential_interlaced =
+          (double*)fftw_malloc(sizeof(double) * N * N * N);
+      if (mesh->potential_interlaced == NULL)
+        error("Error allocating memory for the interlaced gravity mesh.");
+      memuse_log_allocation("fftw_mesh.interlaced", mesh->potential_interlaced,
+                            1, sizeof(double) * N * N * N, memuse_policy_none);
+    }
   }
 #else
   error("No FFTW library found. Cannot compute periodic long-range forces.");
@@ -1091,7 +2174,9 @@ void pm_mesh_allocate(struct pm_mesh* mesh) {
 }
 
 /**
- * @brief Frees the potential grid.
+ * @brief Frees the potential grid and the buffers of the FFTs.
+ *
+ * The FFTW plans are kept (see pm_mesh_clean()).
  *
  * @param mesh The #pm_mesh structure.
  */
@@ -1100,10 +2185,41 @@ void pm_mesh_free(struct pm_mesh* mesh) {
 #ifdef HAVE_FFTW
 
   if (!mesh->distributed_mesh && mesh->potential_global) {
-    memuse_log_allocation("fftw_mesh.potential", mesh->potential_global, 0, 0);
-    free(mesh->potential_global);
+    memuse_log_allocation("fftw_mesh.potential", mesh->potential_global, 0, 0,
+                          memuse_policy_none);
+    fftw_free(mesh->potential_global);
     mesh->potential_global = NULL;
   }
+  if (mesh->frho_global) {
+    memuse_log_allocation("fftw_frho", mesh->frho_global, 0, 0,
+                          memuse_policy_none);
+    fftw_free(mesh->frho_global);
+    mesh->frho_global = NULL;
+  }
+  if (mesh->potential_interlaced) {
+    memuse_log_allocation("fftw_mesh.interlaced", mesh->potential_interlaced,
+                          0, 0, memuse_policy_none);
+    fftw_free(mesh->potential_interlaced);
+    mesh->potential_interlaced = NULL;
+  }
+  if (mesh->frho_interlaced) {
+    memuse_log_allocation("fftw_frho_interlaced", mesh->frho_interlaced, 0, 0,
+                          memuse_policy_none);
+    fftw_free(mesh->frho_interlaced);
+    mesh->frho_interlaced = NULL;
+  }
+  if (mesh->rho_slice) {
+    memuse_log_allocation("fftw_rho_slice", mesh->rho_slice, 0, 0,
+                          memuse_policy_none);
+    fftw_free(mesh->rho_slice);
+    mesh->rho_slice = NULL;
+  }
+  if (mesh->frho_slice) {
+    memuse_log_allocation("fftw_frho_slice", mesh->frho_slice, 0, 0,
+                          memuse_policy_none);
+    fftw_free(mesh->frho_slice);
+    mesh->frho_slice = NULL;
+  }
 
 #else
   error("No FFTW library found. Cannot compute periodic long-range forces.");
@@ -1155,6 +2271,12 @@ void pm_mesh_init(struct pm_mesh* mesh, const struct gravity_props* props,
   mesh->N = N;
   mesh->distributed_mesh = props->distributed_mesh;
   mesh->use_local_patches = props->mesh_uses_local_patches;
+  mesh->assignment_order = props->mesh_assignment_order;
+  mesh->interlacing = props->mesh_interlacing;
+  mesh->overlap_tasks = props->mesh_overlap_tasks;
+  mesh->overlap_pending = 0;
+  mesh->eta = props->mesh_eta;
+  mesh->a_mesh_max = 0.f;
   mesh->dim[0] = dim[0];
   mesh->dim[1] = dim[1];
   mesh->dim[2] = dim[2];
@@ -1164,6 +2286,17 @@ void pm_mesh_init(struct pm_mesh* mesh, const struct gravity_props* props,
   mesh->r_cut_max = mesh->r_s * props->r_cut_max_ratio;
   mesh->r_cut_min = mesh->r_s * props->r_cut_min_ratio;
   mesh->potential_global = NULL;
+  mesh->fftw_measure = props->mesh_fftw_measure;
+  strcpy(mesh->fftw_wisdom_file, props->mesh_fftw_wisdom_file);
+  mesh->frho_global = NULL;
+  mesh->potential_interlaced = NULL;
+  mesh->frho_interlaced = NULL;
+  mesh->rho_slice = NULL;
+  mesh->frho_slice = NULL;
+  mesh->forward_plan = NULL;
+  mesh->inverse_plan = NULL;
+  mesh->pencil = NULL;
+  mesh->distributed_mesh_pencils = props->distributed_mesh_pencils;
   mesh->ti_beg_mesh_last = -1;
   mesh->ti_end_mesh_last = -1;
   mesh->ti_beg_mesh_next = -1;
@@ -1215,10 +2348,24 @@ void pm_mesh_init_no_mesh(struct pm_mesh* mesh, double dim[3]) {
 }
 
 /**
- * @brief Frees the memory allocated for the long-range mesh.
+ * @brief Frees the memory and the FFTW plans of the long-range mesh.
  */
 void pm_mesh_clean(struct pm_mesh* mesh) {
 
+#ifdef HAVE_FFTW
+#ifdef WITH_MPI
+  if (mesh->pencil) {
+    pm_mesh_pencil_clean(mesh->pencil);
+    free(mesh->pencil);
+    mesh->pencil = NULL;
+  }
+#endif
+  if (mesh->forward_plan) fftw_destroy_plan((fftw_plan)mesh->forward_plan);
+  if (mesh->inverse_plan) fftw_destroy_plan((fftw_plan)mesh->inverse_plan);
+  mesh->forward_plan = NULL;
+  mesh->inverse_plan = NULL;
+#endif
+
 #ifdef HAVE_THREADED_FFTW
   fftw_cleanup_threads();
 #endif
@@ -1252,11 +2399,25 @@ void pm_mesh_struct_restore(struct pm_mesh* mesh, FILE* stream) {
   restart_read_blocks((void*)mesh, sizeof(struct pm_mesh), 1, stream, NULL,
                       "gravity props");
 
+  /* Nothing can be left in flight across a restart */
+  mesh->overlap_pending = 0;
+
   if (mesh->periodic) {
 
 #ifdef HAVE_FFTW
     const int N = mesh->N;
 
+    /* The buffers and plans of the dumped run are gone */
+    mesh->potential_global = NULL;
+    mesh->frho_global = NULL;
+    mesh->potential_interlaced = NULL;
+    mesh->frho_interlaced = NULL;
+    mesh->rho_slice = NULL;
+    mesh->frho_slice = NULL;
+    mesh->forward_plan = NULL;
+    mesh->inverse_plan = NULL;
+    mesh->pencil = NULL;
+
     initialise_fftw(N, mesh->nr_threads);
     pm_mesh_allocate(mesh);
 
@@ -22,11 +22,16 @@
 /* Config parameters. */
 #include <config.h>
 
+/* System includes. */
+#include <stddef.h>
+
 /* Local headers */
 #include "gravity_properties.h"
 #include "timeline.h"
 
 /* Forward declarations */
+struct cosmology;
+struct pm_mesh_pencil;
 struct engine;
 struct space;
 struct gpart;
@@ -50,10 +55,34 @@ struct pm_mesh {
   /*! Whether mesh is distributed between MPI ranks */
   int distributed_mesh;
 
+  /*! Whether the distributed mesh uses pencils rather than FFTW-MPI slabs */
+  int distributed_mesh_pencils;
+
   /*! Whether or not to use local patches rather than
    * direct atomic writes to the mesh when running without MPI */
   int use_local_patches;
 
+  /*! Order of the mass assignment and interpolation (2: CIC, 3: TSC, 4: PCS)
+   */
+  int assignment_order;
+
+  /*! Whether a second mesh shifted by half a cell is interlaced */
+  int interlacing;
+
+  /*! Whether the mesh can be computed while the tree tasks run */
+  int overlap_tasks;
+
+  /*! Is a mesh computation waiting for the next launch of the tasks? */
+  int overlap_pending;
+
+  /*! Constant multiplier of the mesh-scale dynamical time limiting the mesh
+   * time-step (0 for none) */
+  float eta;
+
+  /*! Largest norm of the (comoving) mesh acceleration of the #gpart at the
+   * last mesh computation (eta > 0 only) */
+  float a_mesh_max;
+
   /*! Integer time-step end of the mesh force for the last step */
   integertime_t ti_end_mesh_last;
 
@@ -86,6 +115,39 @@ struct pm_mesh {
 
   /*! Full N*N*N potential field */
   double *potential_global;
+
+  /*! Are we measuring (rather than estimating) the FFTW plans? */
+  int fftw_measure;
+
+  /*! File to load and save the FFTW wisdom from (empty for none) */
+  char fftw_wisdom_file[PARSER_MAX_LINE_SIZE];
+
+  /*! Fourier transform of the full mesh (fftw_complex, global mesh only) */
+  void *frho_global;
+
+  /*! The mesh shifted by half a cell and its Fourier transform (fftw_complex)
+   * (interlaced global mesh only) */
+  double *potential_interlaced;
+  void *frho_interlaced;
+
+  /*! Local slice of the padded density and potential field (distributed
+   * mesh only) */
+  double *rho_slice;
+
+  /*! Local slice of the Fourier transform (fftw_complex, distributed mesh
+   * only) */
+  void *frho_slice;
+
+  /*! Thickness, start and size (in complex numbers) of the local slices */
+  ptrdiff_t local_n0, local_0_start, nalloc;
+
+  /*! The forward and inverse FFTW plans (fftw_plan), made once for the run
+   * and executed on whichever buffers are current */
+  void *forward_plan, *inverse_plan;
+
+  /*! The pencil decomposition and its FFTs (distributed mesh in pencils
+   * only), kept for the whole run */
+  struct pm_mesh_pencil *pencil;
 };
 
 void pm_mesh_init(struct pm_mesh *mesh, const struct gravity_props *props,
@@ -93,10 +155,13 @@ void pm_mesh_init(struct pm_mesh *mesh, const struct gravity_props *props,
 void pm_mesh_init_no_mesh(struct pm_mesh *mesh, double dim[3]);
 void pm_mesh_compute_potential(struct pm_mesh *mesh, const struct space *s,
                                struct threadpool *tp, int verbose);
+double pm_mesh_dynamical_timestep(const struct pm_mesh *mesh,
+                                  const struct cosmology *cosmo);
 void pm_mesh_clean(struct pm_mesh *mesh);
 
 void pm_mesh_allocate(struct pm_mesh *mesh);
 void pm_mesh_free(struct pm_mesh *mesh);
+void initialise_fftw(int N, int nr_threads);
 
 /* Dump/restore. */
 void pm_mesh_struct_dump(const struct pm_mesh *p, FILE *stream);
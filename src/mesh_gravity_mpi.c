@@ -36,6 +36,7 @@
 #include "exchange_structs.h"
 #include "lock.h"
 #include "mesh_gravity_patch.h"
+#include "mesh_gravity_pencil.h"
 #include "mesh_gravity_sort.h"
 #include "neutrino.h"
 #include "part.h"
@@ -218,14 +219,36 @@ void mpi_mesh_accumulate_gparts_to_local_patches(
 #endif
 }
 
-void mesh_patches_to_sorted_array(const struct pm_mesh_patch *local_patches,
-                                  const int nr_patches,
-                                  struct mesh_key_value_rho *array,
-                                  const size_t size) {
+/**
+ * @brief Shared information about the flattening of the mesh patches.
+ */
+struct patches_to_array_mapper_data {
 
-  size_t count = 0;
-  for (int p = 0; p < nr_patches; ++p) {
-    const struct pm_mesh_patch *patch = &local_patches[p];
+  /* The patches to flatten */
+  const struct pm_mesh_patch *local_patches;
+
+  /* Position of the first cell of each patch in the array */
+  const size_t *patch_offsets;
+
+  /* The flattened array */
+  struct mesh_key_value_rho *array;
+};
+
+/**
+ * @brief Threadpool mapper flattening a range of mesh patches into their
+ * part of the array of (key, value) pairs.
+ */
+void mesh_patches_to_sorted_array_mapper(void *map_data, int num,
+                                         void *extra) {
+
+  const struct patches_to_array_mapper_data *data =
+      (const struct patches_to_array_mapper_data *)extra;
+  const struct pm_mesh_patch *patches = (const struct pm_mesh_patch *)map_data;
+  struct mesh_key_value_rho *array = data->array;
+
+  for (int p = 0; p < num; ++p) {
+    const struct pm_mesh_patch *patch = &patches[p];
+    size_t count = data->patch_offsets[patch - data->local_patches];
 
     /* Loop over all cells in the patch */
     for (int i = 0; i < patch->mesh_size[0]; i++) {
@@ -253,9 +276,49 @@ void mesh_patches_to_sorted_array(const struct pm_mesh_patch *local_patches,
       }
     }
   }
+}
+
+/**
+ * @brief Flatten the local mesh patches into an array of (key, value) pairs,
+ * patch after patch.
+ *
+ * @param local_patches The array of local patches.
+ * @param nr_patches The number of local patches.
+ * @param array (return) The array of (key, value) pairs.
+ * @param size The number of cells in all the patches.
+ * @param tp The #threadpool object.
+ */
+void mesh_patches_to_sorted_array(const struct pm_mesh_patch *local_patches,
+                                  const int nr_patches,
+                                  struct mesh_key_value_rho *array,
+                                  const size_t size, struct threadpool *tp) {
+
+  /* Where does each patch start in the array? */
+  size_t *patch_offsets = (size_t *)malloc(nr_patches * sizeof(size_t));
+  if (patch_offsets == NULL && nr_patches > 0)
+    error("Failed to allocate the mesh patch offsets");
+
+  size_t count = 0;
+  for (int p = 0; p < nr_patches; ++p) {
+    const struct pm_mesh_patch *patch = &local_patches[p];
+    patch_offsets[p] = count;
+    count += (size_t)patch->mesh_size[0] * patch->mesh_size[1] *
+             patch->mesh_size[2];
+  }
 
   /* quick check... */
   if (count != size) error("Error flattening the mesh patches!");
+
+  struct patches_to_array_mapper_data data;
+  data.local_patches = local_patches;
+  data.patch_offsets = patch_offsets;
+  data.array = array;
+  threadpool_map(tp, mesh_patches_to_sorted_array_mapper,
+                 (void *)local_patches, nr_patches,
+                 sizeof(struct pm_mesh_patch), threadpool_auto_chunk_size,
+                 &data);
+
+  free(patch_offsets);
 }
 
 /**
@@ -265,6 +328,10 @@ void mesh_patches_to_sorted_array(const struct pm_mesh_patch *local_patches,
  * This routine does the necessary communication to convert
  * the per-rank local patches into a slab-distributed mesh.
  *
+ * With a pencil decomposition, each rank holds its columns of the full
+ * mesh instead and the mesh cells are sent to the rank owning their (x, y)
+ * coordinates.
+ *
  * This function will clean the memory allocated by each of the entry
  * in the local_patches array.
  *
@@ -273,12 +340,14 @@ void mesh_patches_to_sorted_array(const struct pm_mesh_patch *local_patches,
  * @param local_patches The array of local patches.
  * @param nr_patches The number of local patches.
  * @param mesh Pointer to the output data buffer.
+ * @param pencil The #pm_mesh_pencil decomposition (NULL for slabs).
  * @param tp The #threadpool object.
  * @param verbose Are we talkative?
  */
 void mpi_mesh_local_patches_to_slices(const int N, const int local_n0,
                                       struct pm_mesh_patch *local_patches,
                                       const int nr_patches, double *mesh,
+                                      const struct pm_mesh_pencil *pencil,
                                       struct threadpool *tp,
                                       const int verbose) {
 
@@ -300,6 +369,7 @@ void mpi_mesh_local_patches_to_slices(const int N, const int local_n0,
     count += p->mesh_size[0] * p->mesh_size[1] * p->mesh_size[2];
   }
 
+
   /* Create an array to contain all the individual mesh cells we have
    * on this node. For now, this is in random order */
   struct mesh_key_value_rho *mesh_sendbuf_unsorted;
@@ -313,7 +383,7 @@ void mpi_mesh_local_patches_to_slices(const int N, const int local_n0,
    * We're going to distribute them between ranks according to their
    * x coordinate, so we later need to put them in order of destination rank. */
   mesh_patches_to_sorted_array(local_patches, nr_patches, mesh_sendbuf_unsorted,
-                               count);
+                               count, tp);
 
   if (verbose)
     message(" - Converting mesh patches to array took %.3f %s.",
@@ -331,23 +401,8 @@ void mpi_mesh_local_patches_to_slices(const int N, const int local_n0,
                      count * sizeof(struct mesh_key_value_rho)) != 0)
     error("Failed to allocate array for unsorted mesh send buffer!");
 
-  size_t *sorted_offsets = (size_t *)malloc(N * sizeof(size_t));
-
-  /* Do a bucket sort of the mesh elements to have them sorted
-   * by global x-coordinate (note we don't care about y,z at this stage)
-   * Also reover the offsets where we switch from one bin to the next */
-  bucket_sort_mesh_key_value_rho(mesh_sendbuf_unsorted, count, N, tp,
-                                 mesh_sendbuf, sorted_offsets);
-
-  /* Let's free the unsorted array to keep things lean */
-  swift_free("mesh_sendbuf_unsorted", mesh_sendbuf_unsorted);
-  mesh_sendbuf_unsorted = NULL;
-
-  if (verbose)
-    message(" - Sorting of mesh cells took %.3f %s.",
-            clocks_from_ticks(getticks() - tic), clocks_getunit());
-
-  tic = getticks();
+  /* Compute how many elements are to be sent to each rank */
+  size_t *nr_send = (size_t *)calloc(nr_nodes, sizeof(size_t));
 
   /* Get width of the slice on each rank */
   int *slice_width = (int *)malloc(sizeof(int) * nr_nodes);
@@ -360,60 +415,93 @@ void mpi_mesh_local_patches_to_slices(const int N, const int local_n0,
     slice_offset[i] = slice_offset[i - 1] + slice_width[i - 1];
   }
 
-  /* Compute how many elements are to be sent to each rank */
-  size_t *nr_send = (size_t *)calloc(nr_nodes, sizeof(size_t));
+  if (pencil != NULL) {
 
-  /* Loop over the offsets */
-  int dest_node = 0;
-  for (int i = 0; i < N; ++i) {
+    /* Sort the mesh elements by the rank owning their column */
+    pm_mesh_pencil_sort_rho(pencil, mesh_sendbuf_unsorted, count,
+                            mesh_sendbuf, nr_send);
 
-    /* Find the first mesh cell in that bucket */
-    const size_t j = sorted_offsets[i];
+    swift_free("mesh_sendbuf_unsorted", mesh_sendbuf_unsorted);
+    mesh_sendbuf_unsorted = NULL;
 
-    /* Get the x coordinate of this mesh cell in the global mesh */
-    const int mesh_x =
-        get_xcoord_from_padded_row_major_id((size_t)mesh_sendbuf[j].key, N);
+    if (verbose)
+      message(" - Sorting of mesh cells took %.3f %s.",
+              clocks_from_ticks(getticks() - tic), clocks_getunit());
 
-    /* Advance to the destination node that is to contain this x coordinate */
-    while ((mesh_x >= slice_offset[dest_node] + slice_width[dest_node]) ||
-           (slice_width[dest_node] == 0)) {
-      dest_node++;
-    }
+    tic = getticks();
 
-    /* Add all the mesh cells in this bucket */
-    if (i < N - 1)
-      nr_send[dest_node] += sorted_offsets[i + 1] - sorted_offsets[i];
-    else
-      nr_send[dest_node] += count - sorted_offsets[i];
-  }
+  } else {
+
+    size_t *sorted_offsets = (size_t *)malloc(N * sizeof(size_t));
+
+    /* Do a bucket sort of the mesh elements to have them sorted
+     * by global x-coordinate (note we don't care about y,z at this stage)
+     * Also reover the offsets where we switch from one bin to the next */
+    bucket_sort_mesh_key_value_rho(mesh_sendbuf_unsorted, count, N, tp,
+                                   mesh_sendbuf, sorted_offsets);
+
+    /* Let's free the unsorted array to keep things lean */
+    swift_free("mesh_sendbuf_unsorted", mesh_sendbuf_unsorted);
+    mesh_sendbuf_unsorted = NULL;
+
+    if (verbose)
+      message(" - Sorting of mesh cells took %.3f %s.",
+              clocks_from_ticks(getticks() - tic), clocks_getunit());
+
+    tic = getticks();
+
+    /* Loop over the offsets */
+    int dest_node = 0;
+    for (int i = 0; i < N; ++i) {
+
+      /* Find the first mesh cell in that bucket */
+      const size_t j = sorted_offsets[i];
+
+      /* Get the x coordinate of this mesh cell in the global mesh */
+      const int mesh_x =
+          get_xcoord_from_padded_row_major_id((size_t)mesh_sendbuf[j].key, N);
+
+      /* Advance to the destination node that is to contain this x coordinate */
+      while ((mesh_x >= slice_offset[dest_node] + slice_width[dest_node]) ||
+             (slice_width[dest_node] == 0)) {
+        dest_node++;
+      }
+
+      /* Add all the mesh cells in this bucket */
+      if (i < N - 1)
+        nr_send[dest_node] += sorted_offsets[i + 1] - sorted_offsets[i];
+      else
+        nr_send[dest_node] += count - sorted_offsets[i];
+    }
 
 #ifdef SWIFT_DEBUG_CHECKS
-  size_t *nr_send_check = (size_t *)calloc(nr_nodes, sizeof(size_t));
-
-  /* Brute-force list without using the offsets */
-  int dest_node_check = 0;
-  for (size_t i = 0; i < count; i++) {
-    /* Get the x coordinate of this mesh cell in the global mesh */
-    const int mesh_x =
-        get_xcoord_from_padded_row_major_id((size_t)mesh_sendbuf[i].key, N);
-    /* Advance to the destination node that is to contain this x coordinate */
-    while ((mesh_x >=
-            slice_offset[dest_node_check] + slice_width[dest_node_check]) ||
-           (slice_width[dest_node_check] == 0)) {
-      dest_node_check++;
+    size_t *nr_send_check = (size_t *)calloc(nr_nodes, sizeof(size_t));
+
+    /* Brute-force list without using the offsets */
+    int dest_node_check = 0;
+    for (size_t i = 0; i < count; i++) {
+      /* Get the x coordinate of this mesh cell in the global mesh */
+      const int mesh_x =
+          get_xcoord_from_padded_row_major_id((size_t)mesh_sendbuf[i].key, N);
+      /* Advance to the destination node that is to contain this x coordinate */
+      while ((mesh_x >=
+              slice_offset[dest_node_check] + slice_width[dest_node_check]) ||
+             (slice_width[dest_node_check] == 0)) {
+        dest_node_check++;
+      }
+      nr_send_check[dest_node_check]++;
     }
-    nr_send_check[dest_node_check]++;
-  }
 
-  /* Verify the "smart" list is as good as the brute-force one */
-  for (int i = 0; i < nr_nodes; ++i) {
-    if (nr_send[i] != nr_send_check[i]) error("Invalid send list!");
-  }
-  free(nr_send_check);
+    /* Verify the "smart" list is as good as the brute-force one */
+    for (int i = 0; i < nr_nodes; ++i) {
+      if (nr_send[i] != nr_send_check[i]) error("Invalid send list!");
+    }
+    free(nr_send_check);
 #endif
 
-  /* We don't need the sorted offsets any more from here onwards */
-  free(sorted_offsets);
+    /* We don't need the sorted offsets any more from here onwards */
+    free(sorted_offsets);
+  }
 
   /* Determine how many requests we'll receive from each MPI rank */
   size_t *nr_recv = (size_t *)malloc(sizeof(size_t) * nr_nodes);
@@ -437,41 +525,64 @@ void mpi_mesh_local_patches_to_slices(const int N, const int local_n0,
 
   tic = getticks();
 
-  /* Carry out the communication */
-  exchange_structs(nr_send, (char *)mesh_sendbuf, nr_recv, (char *)mesh_recvbuf,
-                   sizeof(struct mesh_key_value_rho));
+  /* Carry out the communication. Post everything, then add the cells of
+   * each rank to the slice as soon as they have arrived while the others
+   * are still in flight. The ranks are taken in order such that the sums
+   * do not depend on the timing of the messages. */
+  struct exchange_structs_handle exchange;
+  exchange_structs_init(&exchange, nr_send, mesh_sendbuf, nr_recv,
+                        mesh_recvbuf, sizeof(struct mesh_key_value_rho));
+  for (int i = 0; i < nr_nodes; i++) exchange_structs_post_recv(&exchange, i);
+  for (int i = 0; i < nr_nodes; i++) exchange_structs_post_send(&exchange, i);
 
-  if (verbose)
-    message(" - MPI exchange took %.3f %s.",
-            clocks_from_ticks(getticks() - tic), clocks_getunit());
+  for (int node = 0; node < nr_nodes; node++) {
 
-  tic = getticks();
+    size_t first = 0, nr_cells = 0;
+    exchange_structs_wait_recv(&exchange, node, &first, &nr_cells);
 
-  /* Copy received data to the output buffer.
-   * This is now a local slice of the global mesh. */
-  for (size_t i = 0; i < nr_recv_tot; i++) {
+    /* Copy received data to the output buffer.
+     * This is now a local slice of the global mesh. */
+    for (size_t i = first; i < first + nr_cells; i++) {
+
+      if (pencil != NULL) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+        if (pm_mesh_pencil_owner(pencil, mesh_recvbuf[i].key) != nodeID)
+          error("Received mesh cell is not in the local columns");
+#endif
+
+        mesh[pm_mesh_pencil_local_index(pencil, mesh_recvbuf[i].key)] +=
+            mesh_recvbuf[i].value;
+        continue;
+      }
 
 #ifdef SWIFT_DEBUG_CHECKS
-    /* Verify that we indeed got a cell that should be in the local mesh slice
-     */
-    const int xcoord =
-        get_xcoord_from_padded_row_major_id(mesh_recvbuf[i].key, N);
-    if (xcoord < slice_offset[nodeID])
-      error("Received mesh cell is not in the local slice (xcoord too small)");
-    if (xcoord >= slice_offset[nodeID] + slice_width[nodeID])
-      error("Received mesh cell is not in the local slice (xcoord too large)");
+      /* Verify that we indeed got a cell that should be in the local mesh
+       * slice */
+      const int xcoord =
+          get_xcoord_from_padded_row_major_id(mesh_recvbuf[i].key, N);
+      if (xcoord < slice_offset[nodeID])
+        error(
+            "Received mesh cell is not in the local slice (xcoord too small)");
+      if (xcoord >= slice_offset[nodeID] + slice_width[nodeID])
+        error(
+            "Received mesh cell is not in the local slice (xcoord too large)");
 #endif
 
-    /* What cell are we looking at? */
-    const size_t local_index = get_index_in_local_slice(
-        (size_t)mesh_recvbuf[i].key, N, slice_offset[nodeID]);
+      /* What cell are we looking at? */
+      const size_t local_index = get_index_in_local_slice(
+          (size_t)mesh_recvbuf[i].key, N, slice_offset[nodeID]);
 
-    /* Add to the cell*/
-    mesh[local_index] += mesh_recvbuf[i].value;
+      /* Add to the cell*/
+      mesh[local_index] += mesh_recvbuf[i].value;
+    }
   }
 
+  /* Wait for our own sends */
+  exchange_structs_end(&exchange);
+
   if (verbose)
-    message(" - Filling of the density values took %.3f %s.",
+    message(" - MPI exchange and filling of the density values took %.3f %s.",
             clocks_from_ticks(getticks() - tic), clocks_getunit());
 
   /* Tidy up */
@@ -743,8 +854,10 @@ void fill_local_patches_from_mesh_cells(
  * @param s The #space containing the particles.
  * @param local_0_start Offset to the first mesh x coordinate on this rank
  * @param local_n0 Width of the mesh slab on this rank
- * @param potential_slice Array with the potential on the local slice of the
- * mesh
+ * @param potential_slice Array with the potential on the local slice (or
+ * the local columns with a pencil decomposition) of the mesh
+ * @param local_patches The array of local patches to fill.
+ * @param pencil The #pm_mesh_pencil decomposition (NULL for slabs).
  * @param tp The #threadpool object.
  * @param verbose Are we talkative?
  */
@@ -752,6 +865,7 @@ void mpi_mesh_fetch_potential(const int N, const double fac,
                               const struct space *s, const int local_0_start,
                               const int local_n0, double *potential_slice,
                               struct pm_mesh_patch *local_patches,
+                              const struct pm_mesh_pencil *pencil,
                               struct threadpool *tp, const int verbose) {
 
 #if defined(WITH_MPI) && defined(HAVE_MPI_FFTW)
@@ -796,21 +910,8 @@ void mpi_mesh_fetch_potential(const int N, const double fac,
                      nr_send_tot * sizeof(struct mesh_key_value_pot)) != 0)
     error("Failed to allocate array for cells to request!");
 
-  size_t *sorted_offsets = (size_t *)malloc(N * sizeof(size_t));
-
-  /* Do a bucket sort of the mesh elements to have them sorted
-   * by global x-coordinate (note we don't care about y,z at this stage) */
-  bucket_sort_mesh_key_value_pot(send_cells_unsorted, nr_send_tot, N, tp,
-                                 send_cells, sorted_offsets);
-
-  swift_free("send_cells_unsorted", send_cells_unsorted);
-  send_cells_unsorted = NULL;
-
-  if (verbose)
-    message(" - 1st mesh patches sort took %.3f %s.",
-            clocks_from_ticks(getticks() - tic), clocks_getunit());
-
-  tic = getticks();
+  /* Count how many mesh cells we need to request from each MPI rank */
+  size_t *nr_send = (size_t *)calloc(nr_nodes, sizeof(size_t));
 
   /* Get width of the mesh slice on each rank */
   int *slice_width = (int *)malloc(sizeof(int) * nr_nodes);
@@ -823,58 +924,90 @@ void mpi_mesh_fetch_potential(const int N, const double fac,
     slice_offset[i] = slice_offset[i - 1] + slice_width[i - 1];
   }
 
-  /* Count how many mesh cells we need to request from each MPI rank */
-  size_t *nr_send = (size_t *)calloc(nr_nodes, sizeof(size_t));
+  if (pencil != NULL) {
 
-  /* Loop over the offsets */
-  int dest_node = 0;
-  for (int i = 0; i < N; ++i) {
+    /* Sort the requests by the rank owning their column */
+    pm_mesh_pencil_sort_pot(pencil, send_cells_unsorted, nr_send_tot,
+                            send_cells, nr_send);
 
-    /* Find the first mesh cell in that bucket */
-    const size_t j = sorted_offsets[i];
+    swift_free("send_cells_unsorted", send_cells_unsorted);
+    send_cells_unsorted = NULL;
 
-    /* Get the x coordinate of this mesh cell in the global mesh */
-    const int mesh_x =
-        get_xcoord_from_padded_row_major_id((size_t)send_cells[j].key, N);
+    if (verbose)
+      message(" - 1st mesh patches sort took %.3f %s.",
+              clocks_from_ticks(getticks() - tic), clocks_getunit());
 
-    /* Advance to the destination node that is to contain this x coordinate */
-    while ((mesh_x >= slice_offset[dest_node] + slice_width[dest_node]) ||
-           (slice_width[dest_node] == 0)) {
-      dest_node++;
-    }
+    tic = getticks();
 
-    /* Add all the mesh cells in this bucket */
-    if (i < N - 1)
-      nr_send[dest_node] += sorted_offsets[i + 1] - sorted_offsets[i];
-    else
-      nr_send[dest_node] += nr_send_tot - sorted_offsets[i];
-  }
+  } else {
+
+    size_t *sorted_offsets = (size_t *)malloc(N * sizeof(size_t));
+
+    /* Do a bucket sort of the mesh elements to have them sorted
+     * by global x-coordinate (note we don't care about y,z at this stage) */
+    bucket_sort_mesh_key_value_pot(send_cells_unsorted, nr_send_tot, N, tp,
+                                   send_cells, sorted_offsets);
+
+    swift_free("send_cells_unsorted", send_cells_unsorted);
+    send_cells_unsorted = NULL;
+
+    if (verbose)
+      message(" - 1st mesh patches sort took %.3f %s.",
+              clocks_from_ticks(getticks() - tic), clocks_getunit());
+
+    tic = getticks();
+
+    /* Loop over the offsets */
+    int dest_node = 0;
+    for (int i = 0; i < N; ++i) {
+
+      /* Find the first mesh cell in that bucket */
+      const size_t j = sorted_offsets[i];
+
+      /* Get the x coordinate of this mesh cell in the global mesh */
+      const int mesh_x =
+          get_xcoord_from_padded_row_major_id((size_t)send_cells[j].key, N);
+
+      /* Advance to the destination node that is to contain this x coordinate */
+      while ((mesh_x >= slice_offset[dest_node] + slice_width[dest_node]) ||
+             (slice_width[dest_node] == 0)) {
+        dest_node++;
+      }
+
+      /* Add all the mesh cells in this bucket */
+      if (i < N - 1)
+        nr_send[dest_node] += sorted_offsets[i + 1] - sorted_offsets[i];
+      else
+        nr_send[dest_node] += nr_send_tot - sorted_offsets[i];
+    }
 
 #ifdef SWIFT_DEBUG_CHECKS
-  size_t *nr_send_check = (size_t *)calloc(nr_nodes, sizeof(size_t));
-
-  /* Brute-force list without using the offsets */
-  int dest_node_check = 0;
-  for (size_t i = 0; i < nr_send_tot; i++) {
-    while (get_xcoord_from_padded_row_major_id(send_cells[i].key, N) >=
-               (slice_offset[dest_node_check] + slice_width[dest_node_check]) ||
-           slice_width[dest_node_check] == 0) {
-      dest_node_check++;
+    size_t *nr_send_check = (size_t *)calloc(nr_nodes, sizeof(size_t));
+
+    /* Brute-force list without using the offsets */
+    int dest_node_check = 0;
+    for (size_t i = 0; i < nr_send_tot; i++) {
+      while (get_xcoord_from_padded_row_major_id(send_cells[i].key, N) >=
+                 (slice_offset[dest_node_check] +
+                  slice_width[dest_node_check]) ||
+             slice_width[dest_node_check] == 0) {
+        dest_node_check++;
+      }
+      if (dest_node_check >= nr_nodes || dest_node_check < 0)
+        error("Destination node out of range");
+      nr_send_check[dest_node_check]++;
     }
-    if (dest_node_check >= nr_nodes || dest_node_check < 0)
-      error("Destination node out of range");
-    nr_send_check[dest_node_check]++;
-  }
 
-  /* Verify the "smart" list is as good as the brute-force one */
-  for (int i = 0; i < nr_nodes; ++i) {
-    if (nr_send[i] != nr_send_check[i]) error("Invalid send list!");
-  }
-  free(nr_send_check);
+    /* Verify the "smart" list is as good as the brute-force one */
+    for (int i = 0; i < nr_nodes; ++i) {
+      if (nr_send[i] != nr_send_check[i]) error("Invalid send list!");
+    }
+    free(nr_send_check);
 #endif
 
-  /* We don't need the sorted offsets any more from here onwards */
-  free(sorted_offsets);
+    /* We don't need the sorted offsets any more from here onwards */
+    free(sorted_offsets);
+  }
 
   /* Determine how many requests we'll receive from each MPI rank */
   size_t *nr_recv = (size_t *)malloc(sizeof(size_t) * nr_nodes);
@@ -897,46 +1030,73 @@ void mpi_mesh_fetch_potential(const int N, const double fac,
                      nr_recv_tot * sizeof(struct mesh_key_value_pot)) != 0)
     error("Failed to allocate array for mesh receive buffer!");
 
-  /* Send requests for cells to other ranks */
-  exchange_structs(nr_send, (char *)send_cells, nr_recv, (char *)recv_cells,
-                   sizeof(struct mesh_key_value_pot));
+  /* Send requests for cells to other ranks. As soon as the requests of a
+   * rank have arrived, look up the potential in its cells and send them
+   * back while the requests of the other ranks are still in flight. */
+  struct exchange_structs_handle requests, replies;
+  exchange_structs_init(&requests, nr_send, send_cells, nr_recv, recv_cells,
+                        sizeof(struct mesh_key_value_pot));
+  exchange_structs_init(&replies, nr_recv, recv_cells, nr_send, send_cells,
+                        sizeof(struct mesh_key_value_pot));
+  for (int i = 0; i < nr_nodes; i++) exchange_structs_post_recv(&requests, i);
+  for (int i = 0; i < nr_nodes; i++) exchange_structs_post_send(&requests, i);
 
-  if (verbose)
-    message(" - 1st exchange took %.3f %s.",
-            clocks_from_ticks(getticks() - tic), clocks_getunit());
+  size_t first = 0, nr_cells = 0;
+  int node;
+  while ((node = exchange_structs_wait_recv(&requests, -1, &first,
+                                            &nr_cells)) >= 0) {
 
-  tic = getticks();
+    /* Look up potential in the requested cells */
+    for (size_t i = first; i < first + nr_cells; i++) {
+
+      if (pencil != NULL) {
 
-  /* Look up potential in the requested cells */
-  for (size_t i = 0; i < nr_recv_tot; i++) {
 #ifdef SWIFT_DEBUG_CHECKS
-    const size_t cells_in_slab = ((size_t)N) * (2 * (N / 2 + 1));
-    const size_t first_local_id = local_0_start * cells_in_slab;
-    const size_t num_local_ids = local_n0 * cells_in_slab;
-    if (recv_cells[i].key < first_local_id ||
-        recv_cells[i].key >= first_local_id + num_local_ids) {
-      error("Requested potential mesh cell ID is out of range");
-    }
+        if (pm_mesh_pencil_owner(pencil, recv_cells[i].key) != nodeID)
+          error("Requested potential mesh cell is not in the local columns");
 #endif
-    const size_t local_id =
-        get_index_in_local_slice(recv_cells[i].key, N, local_0_start);
+
+        const size_t local_id =
+            pm_mesh_pencil_local_index(pencil, recv_cells[i].key);
+        recv_cells[i].value = potential_slice[local_id];
+        continue;
+      }
+
+#ifdef SWIFT_DEBUG_CHECKS
+      const size_t cells_in_slab = ((size_t)N) * (2 * (N / 2 + 1));
+      const size_t first_local_id = local_0_start * cells_in_slab;
+      const size_t num_local_ids = local_n0 * cells_in_slab;
+      if (recv_cells[i].key < first_local_id ||
+          recv_cells[i].key >= first_local_id + num_local_ids) {
+        error("Requested potential mesh cell ID is out of range");
+      }
+#endif
+      const size_t local_id =
+          get_index_in_local_slice(recv_cells[i].key, N, local_0_start);
 #ifdef SWIFT_DEBUG_CHECKS
-    const size_t Ns = N;
-    if (local_id >= Ns * (2 * (Ns / 2 + 1)) * local_n0)
-      error("Local potential mesh cell ID is out of range");
+      const size_t Ns = N;
+      if (local_id >= Ns * (2 * (Ns / 2 + 1)) * local_n0)
+        error("Local potential mesh cell ID is out of range");
 #endif
-    recv_cells[i].value = potential_slice[local_id];
+      recv_cells[i].value = potential_slice[local_id];
+    }
+
+    /* Return the results to that rank */
+    exchange_structs_post_send(&replies, node);
   }
 
+  /* Our requests must be out of send_cells before the replies land there */
+  exchange_structs_end(&requests);
+  for (int i = 0; i < nr_nodes; i++) exchange_structs_post_recv(&replies, i);
+
   if (verbose)
-    message(" - Filling of the potential values took %.3f %s.",
+    message(" - 1st exchange and filling of the potential values took %.3f %s.",
             clocks_from_ticks(getticks() - tic), clocks_getunit());
 
   tic = getticks();
 
-  /* Return the results */
-  exchange_structs(nr_recv, (char *)recv_cells, nr_send, (char *)send_cells,
-                   sizeof(struct mesh_key_value_pot));
+  /* Wait for the results */
+  exchange_structs_end(&replies);
 
   if (verbose)
     message(" - 2nd exchange took %.3f %s.",
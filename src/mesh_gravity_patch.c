@@ -31,6 +31,7 @@
 #include "cell.h"
 #include "error.h"
 #include "row_major_id.h"
+#include "threadpool.h"
 
 /**
  * @brief Initialize a mesh patch to cover a cell
@@ -140,6 +141,110 @@ void pm_add_patch_to_global_mesh(double *const global_mesh,
   }
 }
 
+/**
+ * @brief Shared information about the reduction of patches onto the global
+ * mesh.
+ */
+struct patch_reduction_data {
+  double *global_mesh;
+  const struct pm_mesh_patch *patches;
+  int nr_patches;
+  int N;
+};
+
+/**
+ * @brief Threadpool mapper adding the patches to a range of x planes of the
+ * global mesh.
+ *
+ * Each call only writes to its own planes, so no atomics are needed.
+ *
+ * @param map_data The first plane of the global mesh to update.
+ * @param num The number of planes to update.
+ * @param extra The #patch_reduction_data.
+ */
+static void pm_add_patches_to_global_mesh_mapper(void *map_data, int num,
+                                                 void *extra) {
+
+  const struct patch_reduction_data *data =
+      (struct patch_reduction_data *)extra;
+  double *const global_mesh = data->global_mesh;
+  const int N = data->N;
+
+  /* Range of x planes handled by this call */
+  const int i_start = ((double *)map_data - global_mesh) / ((size_t)N * N);
+  const int i_end = i_start + num;
+
+  for (int p = 0; p < data->nr_patches; ++p) {
+
+    const struct pm_mesh_patch *patch = &data->patches[p];
+
+    /* Skip the patches of empty cells */
+    if (patch->mesh == NULL) continue;
+
+    const int size_i = patch->mesh_size[0];
+    const int size_j = patch->mesh_size[1];
+    const int size_k = patch->mesh_size[2];
+    const int mesh_min_j = patch->mesh_min[1];
+    const int mesh_min_k = patch->mesh_min[2];
+
+    /* Remind the compiler that the arrays are nicely aligned */
+    swift_declare_aligned_ptr(const double, mesh, patch->mesh,
+                              SWIFT_CACHE_ALIGNMENT);
+
+    for (int i = 0; i < size_i; ++i) {
+
+      /* Is this plane of the patch in our range? */
+      int ii = (i + patch->mesh_min[0]) % N;
+      if (ii < 0) ii += N;
+      if (ii < i_start || ii >= i_end) continue;
+
+      for (int j = 0; j < size_j; ++j) {
+        for (int k = 0; k < size_k; ++k) {
+
+          const int jj = j + mesh_min_j;
+          const int kk = k + mesh_min_k;
+
+          const int patch_index = pm_mesh_patch_index(patch, i, j, k);
+          const int mesh_index = row_major_id_periodic(ii, jj, kk, N);
+
+          global_mesh[mesh_index] += mesh[patch_index];
+        }
+      }
+    }
+  }
+}
+
+/**
+ * @brief Write the content of an array of mesh patches back to the global
+ * mesh without atomic operations.
+ *
+ * The threads each own a range of x planes of the global mesh and add to
+ * them the overlapping parts of all the patches. Patches whose mesh has not
+ * been allocated (e.g. empty cells) are ignored.
+ *
+ * @param tp The #threadpool to use.
+ * @param global_mesh The global mesh to write to.
+ * @param patches The #pm_mesh_patch objects to write from.
+ * @param nr_patches The number of patches.
+ * @param N The side-length of the global mesh.
+ */
+void pm_add_patches_to_global_mesh(struct threadpool *tp,
+                                   double *const global_mesh,
+                                   const struct pm_mesh_patch *patches,
+                                   const int nr_patches, const int N) {
+
+  struct patch_reduction_data data;
+  data.global_mesh = global_mesh;
+  data.patches = patches;
+  data.nr_patches = nr_patches;
+  data.N = N;
+
+  /* Map over the x planes of the global mesh */
+  threadpool_map(tp, pm_add_patches_to_global_mesh_mapper, global_mesh, N,
+                 (int)((size_t)N * N * sizeof(double)),
+                 threadpool_auto_chunk_size, &data);
+}
+
 /**
  * @brief Set all values in a mesh patch to zero
  *
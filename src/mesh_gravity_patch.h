@@ -30,6 +30,7 @@
 
 /* Forward declarations */
 struct cell;
+struct threadpool;
 
 /**
  * @brief Data structure for a patch of mesh covering a cell
@@ -170,4 +171,9 @@ __attribute__((always_inline)) INLINE static void pm_mesh_patch_CIC_set(
 void pm_add_patch_to_global_mesh(double *const global_mesh,
                                  const struct pm_mesh_patch *patch);
 
+void pm_add_patches_to_global_mesh(struct threadpool *tp,
+                                   double *const global_mesh,
+                                   const struct pm_mesh_patch *patches,
+                                   const int nr_patches, const int N);
+
 #endif
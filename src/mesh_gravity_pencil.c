@@ -0,0 +1,507 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ * Copyright (c) 2016 Matthieu Schaller (schaller@strw.leidenuniv.nl)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "mesh_gravity_pencil.h"
+
+/* Standard includes */
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Local includes. */
+#include "error.h"
+#include "memuse.h"
+#include "mesh_gravity_sort.h"
+
+#if defined(WITH_MPI) && defined(HAVE_FFTW)
+
+/**
+ * @brief Splits [0, n[ into p nearly-equal contiguous ranges.
+ *
+ * @param n The number of elements to split.
+ * @param p The number of ranges.
+ * @param offset (return) The start of each range.
+ * @param width (return) The width of each range.
+ */
+static void pm_mesh_pencil_split(const int n, const int p, int *offset,
+                                 int *width) {
+  for (int i = 0; i < p; ++i) {
+    offset[i] = (int)(((long long)n * i) / p);
+    width[i] = (int)(((long long)n * (i + 1)) / p) - offset[i];
+  }
+}
+
+/**
+ * @brief Converts a number of complex values of a transpose to a number of
+ * doubles that MPI can take.
+ */
+static int pm_mesh_pencil_count(const size_t count) {
+  if (2 * count > INT_MAX)
+    error("Too many mesh cells in a pencil transpose. Use more ranks.");
+  return (int)(2 * count);
+}
+
+/**
+ * @brief Sets up the pencil decomposition of an N^3 mesh over all the ranks
+ * and makes the buffers and the 1D plans of its transforms.
+ *
+ * @param pencil The #pm_mesh_pencil to initialise.
+ * @param N The side-length of the mesh.
+ * @param flags The FFTW planning flags.
+ */
+void pm_mesh_pencil_init(struct pm_mesh_pencil *pencil, const int N,
+                         const unsigned int flags) {
+
+  int nr_nodes, nodeID;
+  MPI_Comm_size(MPI_COMM_WORLD, &nr_nodes);
+  MPI_Comm_rank(MPI_COMM_WORLD, &nodeID);
+
+  bzero(pencil, sizeof(struct pm_mesh_pencil));
+  pencil->N = N;
+
+  /* Get a process grid as square as possible */
+  int dims[2] = {0, 0};
+  MPI_Dims_create(nr_nodes, 2, dims);
+  pencil->P[0] = dims[0];
+  pencil->P[1] = dims[1];
+  pencil->coord[0] = nodeID / dims[1];
+  pencil->coord[1] = nodeID % dims[1];
+
+  const int N_half = N / 2;
+  if (dims[0] > N || dims[1] > N_half + 1)
+    error(
+        "Too many ranks (%d x %d) for a pencil decomposition of a mesh of "
+        "side-length %d.",
+        dims[0], dims[1], N);
+
+  /* Ranks sharing our x range and ranks sharing our kz range */
+  if (MPI_Comm_split(MPI_COMM_WORLD, pencil->coord[0], pencil->coord[1],
+                     &pencil->row_comm) != MPI_SUCCESS ||
+      MPI_Comm_split(MPI_COMM_WORLD, pencil->coord[1], pencil->coord[0],
+                     &pencil->col_comm) != MPI_SUCCESS)
+    error("Failed to create the communicators of the pencil decomposition.");
+
+  /* Split the axes */
+  pencil->x_offset = (int *)malloc(dims[0] * sizeof(int));
+  pencil->x_width = (int *)malloc(dims[0] * sizeof(int));
+  pencil->y_offset = (int *)malloc(dims[1] * sizeof(int));
+  pencil->y_width = (int *)malloc(dims[1] * sizeof(int));
+  pencil->kz_offset = (int *)malloc(dims[1] * sizeof(int));
+  pencil->kz_width = (int *)malloc(dims[1] * sizeof(int));
+  pencil->x_owner = (int *)malloc(N * sizeof(int));
+  pencil->y_owner = (int *)malloc(N * sizeof(int));
+  if (pencil->x_offset == NULL || pencil->x_width == NULL ||
+      pencil->y_offset == NULL || pencil->y_width == NULL ||
+      pencil->kz_offset == NULL || pencil->kz_width == NULL ||
+      pencil->x_owner == NULL || pencil->y_owner == NULL)
+    error("Failed to allocate the pencil decomposition.");
+
+  pm_mesh_pencil_split(N, dims[0], pencil->x_offset, pencil->x_width);
+  pm_mesh_pencil_split(N, dims[1], pencil->y_offset, pencil->y_width);
+  pm_mesh_pencil_split(N_half + 1, dims[1], pencil->kz_offset,
+                       pencil->kz_width);
+  for (int p = 0; p < dims[0]; ++p)
+    for (int i = 0; i < pencil->x_width[p]; ++i)
+      pencil->x_owner[pencil->x_offset[p] + i] = p;
+  for (int p = 0; p < dims[1]; ++p)
+    for (int i = 0; i < pencil->y_width[p]; ++i)
+      pencil->y_owner[pencil->y_offset[p] + i] = p;
+
+  const size_t nx = pencil->x_width[pencil->coord[0]];
+  const size_t ny = pencil->y_width[pencil->coord[1]];
+  const size_t nkz = pencil->kz_width[pencil->coord[1]];
+  const size_t pad = 2 * (N_half + 1);
+
+  /* Size of the three stages (the x and ky splits are the same) */
+  const size_t size_z = nx * ny * (N_half + 1);
+  const size_t size_y = nx * nkz * N;
+  const size_t size_x = nx * nkz * N;
+  size_t size_buf = size_z;
+  if (size_y > size_buf) size_buf = size_y;
+
+  pencil->rho = (double *)fftw_malloc(nx * ny * pad * sizeof(double));
+  pencil->frho_y = (fftw_complex *)fftw_malloc(size_y * sizeof(fftw_complex));
+  pencil->frho = (fftw_complex *)fftw_malloc(size_x * sizeof(fftw_complex));
+  pencil->sendbuf =
+      (fftw_complex *)fftw_malloc(size_buf * sizeof(fftw_complex));
+  pencil->recvbuf =
+      (fftw_complex *)fftw_malloc(size_buf * sizeof(fftw_complex));
+  if (pencil->rho == NULL || pencil->frho_y == NULL || pencil->frho == NULL ||
+      pencil->sendbuf == NULL || pencil->recvbuf == NULL)
+    error("Failed to allocate the buffers of the pencil FFT.");
+  memuse_log_allocation("fftw_pencil_rho", pencil->rho, 1,
+                        nx * ny * pad * sizeof(double), memuse_policy_none);
+
+  const int P_max = dims[0] > dims[1] ? dims[0] : dims[1];
+  pencil->sendcounts = (int *)malloc(P_max * sizeof(int));
+  pencil->sdispls = (int *)malloc(P_max * sizeof(int));
+  pencil->recvcounts = (int *)malloc(P_max * sizeof(int));
+  pencil->rdispls = (int *)malloc(P_max * sizeof(int));
+  if (pencil->sendcounts == NULL || pencil->sdispls == NULL ||
+      pencil->recvcounts == NULL || pencil->rdispls == NULL)
+    error("Failed to allocate the counts of the pencil transposes.");
+
+  /* The 1D plans: z is contiguous in the real mesh, y after the first
+   * transpose and x after the second one. */
+  int n[1] = {N};
+  pencil->plan_z_r2c = fftw_plan_many_dft_r2c(
+      1, n, (int)(nx * ny), pencil->rho, NULL, 1, (int)pad,
+      (fftw_complex *)pencil->rho, NULL, 1, N_half + 1, flags);
+  pencil->plan_z_c2r = fftw_plan_many_dft_c2r(
+      1, n, (int)(nx * ny), (fftw_complex *)pencil->rho, NULL, 1, N_half + 1,
+      pencil->rho, NULL, 1, (int)pad, flags);
+  pencil->plan_y_forward = fftw_plan_many_dft(
+      1, n, (int)(nx * nkz), pencil->frho_y, NULL, 1, N, pencil->frho_y, NULL,
+      1, N, FFTW_FORWARD, flags);
+  pencil->plan_y_backward = fftw_plan_many_dft(
+      1, n, (int)(nx * nkz), pencil->frho_y, NULL, 1, N, pencil->frho_y, NULL,
+      1, N, FFTW_BACKWARD, flags);
+  pencil->plan_x_forward =
+      fftw_plan_many_dft(1, n, (int)(nx * nkz), pencil->frho, NULL, 1, N,
+                         pencil->frho, NULL, 1, N, FFTW_FORWARD, flags);
+  pencil->plan_x_backward =
+      fftw_plan_many_dft(1, n, (int)(nx * nkz), pencil->frho, NULL, 1, N,
+                         pencil->frho, NULL, 1, N, FFTW_BACKWARD, flags);
+  if (pencil->plan_z_r2c == NULL || pencil->plan_z_c2r == NULL ||
+      pencil->plan_y_forward == NULL || pencil->plan_y_backward == NULL ||
+      pencil->plan_x_forward == NULL || pencil->plan_x_backward == NULL)
+    error("Failed to make the FFTW plans of the pencil decomposition.");
+}
+
+/**
+ * @brief Frees the buffers, plans and communicators of a #pm_mesh_pencil.
+ *
+ * @param pencil The #pm_mesh_pencil.
+ */
+void pm_mesh_pencil_clean(struct pm_mesh_pencil *pencil) {
+
+  fftw_destroy_plan(pencil->plan_z_r2c);
+  fftw_destroy_plan(pencil->plan_z_c2r);
+  fftw_destroy_plan(pencil->plan_y_forward);
+  fftw_destroy_plan(pencil->plan_y_backward);
+  fftw_destroy_plan(pencil->plan_x_forward);
+  fftw_destroy_plan(pencil->plan_x_backward);
+
+  memuse_log_allocation("fftw_pencil_rho", pencil->rho, 0, 0,
+                        memuse_policy_none);
+  fftw_free(pencil->rho);
+  fftw_free(pencil->frho_y);
+  fftw_free(pencil->frho);
+  fftw_free(pencil->sendbuf);
+  fftw_free(pencil->recvbuf);
+
+  free(pencil->sendcounts);
+  free(pencil->sdispls);
+  free(pencil->recvcounts);
+  free(pencil->rdispls);
+  free(pencil->x_offset);
+  free(pencil->x_width);
+  free(pencil->y_offset);
+  free(pencil->y_width);
+  free(pencil->kz_offset);
+  free(pencil->kz_width);
+  free(pencil->x_owner);
+  free(pencil->y_owner);
+
+  MPI_Comm_free(&pencil->row_comm);
+  MPI_Comm_free(&pencil->col_comm);
+}
+
+/**
+ * @brief Exchanges the transpose buffers of a #pm_mesh_pencil.
+ *
+ * @param pencil The #pm_mesh_pencil.
+ * @param comm The communicator of the transpose.
+ * @param P The number of ranks in comm.
+ */
+static void pm_mesh_pencil_exchange(struct pm_mesh_pencil *pencil,
+                                    MPI_Comm comm, const int P) {
+
+  pencil->sdispls[0] = 0;
+  pencil->rdispls[0] = 0;
+  for (int q = 1; q < P; ++q) {
+    pencil->sdispls[q] = pencil->sdispls[q - 1] + pencil->sendcounts[q - 1];
+    pencil->rdispls[q] = pencil->rdispls[q - 1] + pencil->recvcounts[q - 1];
+  }
+
+  if (MPI_Alltoallv(pencil->sendbuf, pencil->sendcounts, pencil->sdispls,
+                    MPI_DOUBLE, pencil->recvbuf, pencil->recvcounts,
+                    pencil->rdispls, MPI_DOUBLE, comm) != MPI_SUCCESS)
+    error("Failed to transpose the pencils of the mesh.");
+}
+
+/**
+ * @brief Forward transform of the density in the real-space columns
+ * (pencil->rho) to the modes in pencil->frho.
+ *
+ * @param pencil The #pm_mesh_pencil.
+ */
+void pm_mesh_pencil_forward(struct pm_mesh_pencil *pencil) {
+
+  const int N = pencil->N;
+  const int Nc = N / 2 + 1;
+  const int c0 = pencil->coord[0];
+  const int c1 = pencil->coord[1];
+  const size_t nx = pencil->x_width[c0];
+  const size_t ny = pencil->y_width[c1];
+  const size_t nkz = pencil->kz_width[c1];
+  const fftw_complex *rho = (const fftw_complex *)pencil->rho;
+  fftw_complex *frho_y = pencil->frho_y;
+  fftw_complex *frho = pencil->frho;
+  fftw_complex *sendbuf = pencil->sendbuf;
+  const fftw_complex *recvbuf = pencil->recvbuf;
+
+  /* Along z, in place */
+  fftw_execute(pencil->plan_z_r2c);
+
+  /* Transpose y <-> kz over the ranks sharing our x range */
+  size_t count = 0;
+  for (int q = 0; q < pencil->P[1]; ++q) {
+    const int kz0 = pencil->kz_offset[q];
+    const int nkz_q = pencil->kz_width[q];
+    for (size_t i = 0; i < nx; ++i)
+      for (size_t j = 0; j < ny; ++j)
+        for (int k = 0; k < nkz_q; ++k, ++count) {
+          const size_t index = (i * ny + j) * Nc + kz0 + k;
+          sendbuf[count][0] = rho[index][0];
+          sendbuf[count][1] = rho[index][1];
+        }
+    pencil->sendcounts[q] = pm_mesh_pencil_count(nx * ny * nkz_q);
+    pencil->recvcounts[q] = pm_mesh_pencil_count(nx * pencil->y_width[q] * nkz);
+  }
+  pm_mesh_pencil_exchange(pencil, pencil->row_comm, pencil->P[1]);
+
+  count = 0;
+  for (int q = 0; q < pencil->P[1]; ++q) {
+    const int y0 = pencil->y_offset[q];
+    const int ny_q = pencil->y_width[q];
+    for (size_t i = 0; i < nx; ++i)
+      for (int j = 0; j < ny_q; ++j)
+        for (size_t k = 0; k < nkz; ++k, ++count) {
+          const size_t index = (i * nkz + k) * N + y0 + j;
+          frho_y[index][0] = recvbuf[count][0];
+          frho_y[index][1] = recvbuf[count][1];
+        }
+  }
+
+  /* Along y, in place */
+  fftw_execute(pencil->plan_y_forward);
+
+  /* Transpose x <-> ky over the ranks sharing our kz range */
+  count = 0;
+  for (int q = 0; q < pencil->P[0]; ++q) {
+    const int ky0 = pencil->x_offset[q];
+    const int nky_q = pencil->x_width[q];
+    for (size_t i = 0; i < nx; ++i)
+      for (size_t k = 0; k < nkz; ++k)
+        for (int j = 0; j < nky_q; ++j, ++count) {
+          const size_t index = (i * nkz + k) * N + ky0 + j;
+          sendbuf[count][0] = frho_y[index][0];
+          sendbuf[count][1] = frho_y[index][1];
+        }
+    pencil->sendcounts[q] = pm_mesh_pencil_count(nx * nkz * nky_q);
+    pencil->recvcounts[q] = pm_mesh_pencil_count(pencil->x_width[q] * nkz * nx);
+  }
+  pm_mesh_pencil_exchange(pencil, pencil->col_comm, pencil->P[0]);
+
+  /* Note: our ky range has the same width as our x range */
+  count = 0;
+  for (int q = 0; q < pencil->P[0]; ++q) {
+    const int x0 = pencil->x_offset[q];
+    const int nx_q = pencil->x_width[q];
+    for (int i = 0; i < nx_q; ++i)
+      for (size_t k = 0; k < nkz; ++k)
+        for (size_t j = 0; j < nx; ++j, ++count) {
+          const size_t index = (j * nkz + k) * N + x0 + i;
+          frho[index][0] = recvbuf[count][0];
+          frho[index][1] = recvbuf[count][1];
+        }
+  }
+
+  /* Along x, in place */
+  fftw_execute(pencil->plan_x_forward);
+}
+
+/**
+ * @brief Inverse transform of the modes in pencil->frho to the real-space
+ * columns (pencil->rho).
+ *
+ * As for FFTW, the result is not normalised.
+ *
+ * @param pencil The #pm_mesh_pencil.
+ */
+void pm_mesh_pencil_inverse(struct pm_mesh_pencil *pencil) {
+
+  const int N = pencil->N;
+  const int Nc = N / 2 + 1;
+  const int c0 = pencil->coord[0];
+  const int c1 = pencil->coord[1];
+  const size_t nx = pencil->x_width[c0];
+  const size_t ny = pencil->y_width[c1];
+  const size_t nkz = pencil->kz_width[c1];
+  fftw_complex *rho = (fftw_complex *)pencil->rho;
+  fftw_complex *frho_y = pencil->frho_y;
+  const fftw_complex *frho = pencil->frho;
+  fftw_complex *sendbuf = pencil->sendbuf;
+  const fftw_complex *recvbuf = pencil->recvbuf;
+
+  /* Along x, in place */
+  fftw_execute(pencil->plan_x_backward);
+
+  /* Transpose ky <-> x over the ranks sharing our kz range */
+  size_t count = 0;
+  for (int q = 0; q < pencil->P[0]; ++q) {
+    const int x0 = pencil->x_offset[q];
+    const int nx_q = pencil->x_width[q];
+    for (int i = 0; i < nx_q; ++i)
+      for (size_t k = 0; k < nkz; ++k)
+        for (size_t j = 0; j < nx; ++j, ++count) {
+          const size_t index = (j * nkz + k) * N + x0 + i;
+          sendbuf[count][0] = frho[index][0];
+          sendbuf[count][1] = frho[index][1];
+        }
+    pencil->sendcounts[q] = pm_mesh_pencil_count(nx_q * nkz * nx);
+    pencil->recvcounts[q] = pm_mesh_pencil_count(nx * nkz * pencil->x_width[q]);
+  }
+  pm_mesh_pencil_exchange(pencil, pencil->col_comm, pencil->P[0]);
+
+  count = 0;
+  for (int q = 0; q < pencil->P[0]; ++q) {
+    const int ky0 = pencil->x_offset[q];
+    const int nky_q = pencil->x_width[q];
+    for (size_t i = 0; i < nx; ++i)
+      for (size_t k = 0; k < nkz; ++k)
+        for (int j = 0; j < nky_q; ++j, ++count) {
+          const size_t index = (i * nkz + k) * N + ky0 + j;
+          frho_y[index][0] = recvbuf[count][0];
+          frho_y[index][1] = recvbuf[count][1];
+        }
+  }
+
+  /* Along y, in place */
+  fftw_execute(pencil->plan_y_backward);
+
+  /* Transpose kz <-> y over the ranks sharing our x range */
+  count = 0;
+  for (int q = 0; q < pencil->P[1]; ++q) {
+    const int y0 = pencil->y_offset[q];
+    const int ny_q = pencil->y_width[q];
+    for (size_t i = 0; i < nx; ++i)
+      for (int j = 0; j < ny_q; ++j)
+        for (size_t k = 0; k < nkz; ++k, ++count) {
+          const size_t index = (i * nkz + k) * N + y0 + j;
+          sendbuf[count][0] = frho_y[index][0];
+          sendbuf[count][1] = frho_y[index][1];
+        }
+    pencil->sendcounts[q] = pm_mesh_pencil_count(nx * ny_q * nkz);
+    pencil->recvcounts[q] =
+        pm_mesh_pencil_count(nx * ny * pencil->kz_width[q]);
+  }
+  pm_mesh_pencil_exchange(pencil, pencil->row_comm, pencil->P[1]);
+
+  count = 0;
+  for (int q = 0; q < pencil->P[1]; ++q) {
+    const int kz0 = pencil->kz_offset[q];
+    const int nkz_q = pencil->kz_width[q];
+    for (size_t i = 0; i < nx; ++i)
+      for (size_t j = 0; j < ny; ++j)
+        for (int k = 0; k < nkz_q; ++k, ++count) {
+          const size_t index = (i * ny + j) * Nc + kz0 + k;
+          rho[index][0] = recvbuf[count][0];
+          rho[index][1] = recvbuf[count][1];
+        }
+  }
+
+  /* Along z, in place */
+  fftw_execute(pencil->plan_z_c2r);
+}
+
+/**
+ * @brief Sorts an array of density mesh cells by the rank owning them.
+ *
+ * @param pencil The #pm_mesh_pencil.
+ * @param array_in The cells to sort.
+ * @param count The number of cells.
+ * @param array_out (return) The sorted cells.
+ * @param nr_send (return) The number of cells going to each rank.
+ */
+void pm_mesh_pencil_sort_rho(const struct pm_mesh_pencil *pencil,
+                             const struct mesh_key_value_rho *array_in,
+                             const size_t count,
+                             struct mesh_key_value_rho *array_out,
+                             size_t *nr_send) {
+
+  const int nr_nodes = pencil->P[0] * pencil->P[1];
+  size_t *offsets = (size_t *)malloc(nr_nodes * sizeof(size_t));
+  if (offsets == NULL) error("Failed to allocate the sort offsets.");
+
+  bzero(nr_send, nr_nodes * sizeof(size_t));
+  for (size_t i = 0; i < count; ++i)
+    nr_send[pm_mesh_pencil_owner(pencil, array_in[i].key)]++;
+
+  offsets[0] = 0;
+  for (int r = 1; r < nr_nodes; ++r)
+    offsets[r] = offsets[r - 1] + nr_send[r - 1];
+
+  for (size_t i = 0; i < count; ++i)
+    array_out[offsets[pm_mesh_pencil_owner(pencil, array_in[i].key)]++] =
+        array_in[i];
+
+  free(offsets);
+}
+
+/**
+ * @brief Sorts an array of potential mesh cells by the rank owning them.
+ *
+ * @param pencil The #pm_mesh_pencil.
+ * @param array_in The cells to sort.
+ * @param count The number of cells.
+ * @param array_out (return) The sorted cells.
+ * @param nr_send (return) The number of cells going to each rank.
+ */
+void pm_mesh_pencil_sort_pot(const struct pm_mesh_pencil *pencil,
+                             const struct mesh_key_value_pot *array_in,
+                             const size_t count,
+                             struct mesh_key_value_pot *array_out,
+                             size_t *nr_send) {
+
+  const int nr_nodes = pencil->P[0] * pencil->P[1];
+  size_t *offsets = (size_t *)malloc(nr_nodes * sizeof(size_t));
+  if (offsets == NULL) error("Failed to allocate the sort offsets.");
+
+  bzero(nr_send, nr_nodes * sizeof(size_t));
+  for (size_t i = 0; i < count; ++i)
+    nr_send[pm_mesh_pencil_owner(pencil, array_in[i].key)]++;
+
+  offsets[0] = 0;
+  for (int r = 1; r < nr_nodes; ++r)
+    offsets[r] = offsets[r - 1] + nr_send[r - 1];
+
+  for (size_t i = 0; i < count; ++i)
+    array_out[offsets[pm_mesh_pencil_owner(pencil, array_in[i].key)]++] =
+        array_in[i];
+
+  free(offsets);
+}
+
+#endif /* WITH_MPI && HAVE_FFTW */
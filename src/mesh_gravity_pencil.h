@@ -0,0 +1,167 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ * Copyright (c) 2016 Matthieu Schaller (schaller@strw.leidenuniv.nl)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#ifndef SWIFT_MESH_GRAVITY_PENCIL_H
+#define SWIFT_MESH_GRAVITY_PENCIL_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* Standard includes */
+#include <stddef.h>
+
+/* MPI and FFTW headers. */
+#ifdef WITH_MPI
+#include <mpi.h>
+#endif
+#ifdef HAVE_FFTW
+#include <fftw3.h>
+#endif
+
+/* Local includes. */
+#include "inline.h"
+
+/* Forward declarations */
+struct mesh_key_value_rho;
+struct mesh_key_value_pot;
+
+#if defined(WITH_MPI) && defined(HAVE_FFTW)
+
+/**
+ * @brief A pencil (2D) decomposition of the distributed mesh and its FFTs.
+ *
+ * The ranks are arranged in a P[0] x P[1] grid, rank r sitting at
+ * (r / P[1], r % P[1]).
+ *
+ * In real space, each rank holds the columns of the padded mesh with x in
+ * its share of [0, N[ along P[0] and y in its share along P[1], i.e. an
+ * array of x_width x y_width x 2(N/2+1) doubles. After the forward
+ * transform, each rank holds the (ky, kz, kx) modes with ky in its share
+ * of [0, N[ along P[0] (same split as x) and kz in its share of [0, N/2]
+ * along P[1], stored as ky x kz x kx with the kx contiguous.
+ *
+ * The 3D transform is done as 1D transforms along z, y and x with two
+ * transposes in between, one within the ranks sharing the same x range and
+ * one within the ranks sharing the same kz range. As opposed to the slabs
+ * of FFTW-MPI, this keeps all the ranks busy as long as P[0] <= N and
+ * P[1] <= N/2+1.
+ */
+struct pm_mesh_pencil {
+
+  /*! Side-length of the mesh */
+  int N;
+
+  /*! Dimensions of the process grid and position of this rank in it */
+  int P[2], coord[2];
+
+  /*! Ranks sharing our x range (along P[1]) and our kz range (along P[0]) */
+  MPI_Comm row_comm, col_comm;
+
+  /*! Split of [0, N[ along P[0] (x in real space, ky in Fourier space) */
+  int *x_offset, *x_width;
+
+  /*! Split of [0, N[ along P[1] (y in real space) */
+  int *y_offset, *y_width;
+
+  /*! Split of [0, N/2] along P[1] (kz in Fourier space) */
+  int *kz_offset, *kz_width;
+
+  /*! Rank owning each x and each y of the real-space mesh */
+  int *x_owner, *y_owner;
+
+  /*! The local columns of the padded real mesh (density, then potential) */
+  double *rho;
+
+  /*! The modes after the y transform (x x kz x y) and after the x transform
+   * (ky x kz x kx). The latter is what the Green function is applied to. */
+  fftw_complex *frho_y, *frho;
+
+  /*! Buffers of the transposes */
+  fftw_complex *sendbuf, *recvbuf;
+
+  /*! Counts and displacements of the transposes (in doubles) */
+  int *sendcounts, *sdispls, *recvcounts, *rdispls;
+
+  /*! The 1D plans along z (r2c and c2r), y and x (forward and backward) */
+  fftw_plan plan_z_r2c, plan_z_c2r, plan_y_forward, plan_y_backward,
+      plan_x_forward, plan_x_backward;
+};
+
+void pm_mesh_pencil_init(struct pm_mesh_pencil *pencil, const int N,
+                         const unsigned int flags);
+void pm_mesh_pencil_clean(struct pm_mesh_pencil *pencil);
+void pm_mesh_pencil_forward(struct pm_mesh_pencil *pencil);
+void pm_mesh_pencil_inverse(struct pm_mesh_pencil *pencil);
+
+/**
+ * @brief Returns the rank owning a cell of the real-space mesh.
+ *
+ * @param pencil The #pm_mesh_pencil.
+ * @param key The padded row-major index of the cell in the full mesh.
+ */
+__attribute__((always_inline)) INLINE static int pm_mesh_pencil_owner(
+    const struct pm_mesh_pencil *pencil, const size_t key) {
+
+  const size_t Nj = pencil->N;
+  const size_t Nk = 2 * (pencil->N / 2 + 1);
+  const int x = (int)(key / (Nj * Nk));
+  const int y = (int)((key / Nk) % Nj);
+  return pencil->x_owner[x] * pencil->P[1] + pencil->y_owner[y];
+}
+
+/**
+ * @brief Returns the index of a cell of the real-space mesh in the local
+ * columns of this rank.
+ *
+ * @param pencil The #pm_mesh_pencil.
+ * @param key The padded row-major index of the cell in the full mesh.
+ */
+__attribute__((always_inline)) INLINE static size_t pm_mesh_pencil_local_index(
+    const struct pm_mesh_pencil *pencil, const size_t key) {
+
+  const size_t Nj = pencil->N;
+  const size_t Nk = 2 * (pencil->N / 2 + 1);
+  const size_t x = key / (Nj * Nk);
+  const size_t y = (key / Nk) % Nj;
+  const size_t z = key % Nk;
+  const size_t ny = pencil->y_width[pencil->coord[1]];
+  return ((x - pencil->x_offset[pencil->coord[0]]) * ny +
+          (y - pencil->y_offset[pencil->coord[1]])) *
+             Nk +
+         z;
+}
+
+void pm_mesh_pencil_sort_rho(const struct pm_mesh_pencil *pencil,
+                             const struct mesh_key_value_rho *array_in,
+                             const size_t count,
+                             struct mesh_key_value_rho *array_out,
+                             size_t *nr_send);
+void pm_mesh_pencil_sort_pot(const struct pm_mesh_pencil *pencil,
+                             const struct mesh_key_value_pot *array_in,
+                             const size_t count,
+                             struct mesh_key_value_pot *array_out,
+                             size_t *nr_send);
+
+#else
+
+/* The distributed mesh is not available in this configuration */
+struct pm_mesh_pencil;
+
+#endif
+
+#endif /* SWIFT_MESH_GRAVITY_PENCIL_H */
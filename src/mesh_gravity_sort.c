@@ -27,147 +27,232 @@
 #include "align.h"
 #include "atomic.h"
 #include "error.h"
+#include "inline.h"
 #include "row_major_id.h"
 #include "threadpool.h"
 
+/*! The keys the mesh cells can be bucketed by */
+enum bucket_sort_key {
+  bucket_sort_key_rho_xcoord,
+  bucket_sort_key_pot_xcoord,
+  bucket_sort_key_pot_cell_index
+};
+
 struct mapper_extra_data {
 
-  /* Mesh size */
+  /* Mesh size (i.e. number of buckets) */
   int N;
 
-  /* Buckets */
-  size_t *bucket_counts;
+  /* What we bucket the elements by */
+  enum bucket_sort_key sort_key;
+
+  /* The arrays to sort from and to */
+  const void *array_in;
+  void *array_out;
+  size_t count;
+
+  /* Number of elements of each block of the input array */
+  size_t block_size;
+
+  /* Bucket counts, then write positions, of each block (nr_blocks x N) */
+  size_t *block_buckets;
 };
 
 /**
- * @param Count how may mesh cells will end up in each x-coord bucket.
+ * @brief Returns the bucket of an element of the array to sort.
+ *
+ * @param data The #mapper_extra_data of the sort.
+ * @param i The index of the element in the input array.
  */
-void bucket_sort_mesh_key_value_rho_count_mapper(void *map_data, int nr_parts,
-                                                 void *extra_data) {
+__attribute__((always_inline)) INLINE static int bucket_sort_get_bucket(
+    const struct mapper_extra_data *data, const size_t i) {
+
+  int bucket;
+  switch (data->sort_key) {
+    case bucket_sort_key_rho_xcoord: {
+      const struct mesh_key_value_rho *array_in =
+          (const struct mesh_key_value_rho *)data->array_in;
+
+      /* Get the x coordinate of this mesh cell in the global mesh
+       * Note: we don't need to sort more precisely than just
+       * the x coordinate */
+      bucket = get_xcoord_from_padded_row_major_id(array_in[i].key, data->N);
+      break;
+    }
+    case bucket_sort_key_pot_xcoord: {
+      const struct mesh_key_value_pot *array_in =
+          (const struct mesh_key_value_pot *)data->array_in;
+      bucket = get_xcoord_from_padded_row_major_id(array_in[i].key, data->N);
+      break;
+    }
+    default: {
+      const struct mesh_key_value_pot *array_in =
+          (const struct mesh_key_value_pot *)data->array_in;
+      bucket = cell_index_extract_patch_index(array_in[i].cell_index);
+      break;
+    }
+  }
 
-  /* Unpack the data */
-  const struct mesh_key_value_rho *array_in =
-      (const struct mesh_key_value_rho *)map_data;
-  struct mapper_extra_data *data = (struct mapper_extra_data *)extra_data;
-  const int N = data->N;
-  size_t *global_bucket_counts = data->bucket_counts;
+#ifdef SWIFT_DEBUG_CHECKS
+  if (bucket < 0) error("Invalid mesh cell bucket (too small)");
+  if (bucket >= data->N) error("Invalid mesh cell bucket (too large)");
+#endif
 
-  /* Local buckets */
-  size_t *local_bucket_counts = (size_t *)calloc(N, sizeof(size_t));
+  return bucket;
+}
 
-  /* Count how many items will land in each bucket. */
-  for (int i = 0; i < nr_parts; ++i) {
+/**
+ * @brief Count how many mesh cells of each block of the input will end up
+ * in each bucket.
+ *
+ * The map data are the rows of block_buckets, one per block.
+ */
+void bucket_sort_mesh_key_value_count_mapper(void *map_data, int nr_blocks,
+                                             void *extra_data) {
 
-    const size_t key = array_in[i].key;
+  /* Unpack the data */
+  struct mapper_extra_data *data = (struct mapper_extra_data *)extra_data;
+  const int N = data->N;
+  size_t *const first_row = (size_t *)map_data;
+  const size_t first_block = (first_row - data->block_buckets) / N;
 
-    /* Get the x coordinate of this mesh cell in the global mesh
-     * Note: we don't need to sort more precisely than just
-     * the x coordinate */
-    const int mesh_x = get_xcoord_from_padded_row_major_id(key, N);
+  for (int b = 0; b < nr_blocks; ++b) {
 
-#ifdef SWIFT_DEBUG_CHECKS
-    if (mesh_x < 0) error("Invalid mesh cell x-coordinate (too small)");
-    if (mesh_x >= N) error("Invalid mesh cell x-coordinate (too large)");
-#endif
+    /* Local buckets */
+    size_t *local_bucket_counts = first_row + (size_t)b * N;
+    memset(local_bucket_counts, 0, N * sizeof(size_t));
 
-    /* Add a contribution to the bucket count */
-    local_bucket_counts[mesh_x]++;
-  }
+    /* Range of elements in this block */
+    const size_t i_start = (first_block + b) * data->block_size;
+    size_t i_end = i_start + data->block_size;
+    if (i_end > data->count) i_end = data->count;
 
-  /* Now write back to memory */
-  for (int i = 0; i < N; ++i) {
-    atomic_add(&global_bucket_counts[i], local_bucket_counts[i]);
+    /* Count how many items will land in each bucket. */
+    for (size_t i = i_start; i < i_end; ++i)
+      local_bucket_counts[bucket_sort_get_bucket(data, i)]++;
   }
-
-  /* Clean up */
-  free(local_bucket_counts);
 }
 
 /**
- * @param Count how may mesh cells will end up in each x-coord bucket.
+ * @brief Copy the mesh cells of each block of the input to their position
+ * in the sorted array.
+ *
+ * The map data are the rows of block_buckets, one per block, which by now
+ * contain the position of the next element of each bucket in that block.
  */
-void bucket_sort_mesh_key_value_pot_count_mapper(void *map_data, int nr_parts,
-                                                 void *extra_data) {
+void bucket_sort_mesh_key_value_scatter_mapper(void *map_data, int nr_blocks,
+                                               void *extra_data) {
 
   /* Unpack the data */
-  const struct mesh_key_value_pot *array_in =
-      (const struct mesh_key_value_pot *)map_data;
   struct mapper_extra_data *data = (struct mapper_extra_data *)extra_data;
   const int N = data->N;
-  size_t *global_bucket_counts = data->bucket_counts;
+  size_t *const first_row = (size_t *)map_data;
+  const size_t first_block = (first_row - data->block_buckets) / N;
 
-  /* Local buckets */
-  size_t *local_bucket_counts = (size_t *)calloc(N, sizeof(size_t));
+  for (int b = 0; b < nr_blocks; ++b) {
 
-  /* Count how many items will land in each bucket. */
-  for (int i = 0; i < nr_parts; ++i) {
+    size_t *local_bucket_offsets = first_row + (size_t)b * N;
 
-    const size_t key = array_in[i].key;
+    /* Range of elements in this block */
+    const size_t i_start = (first_block + b) * data->block_size;
+    size_t i_end = i_start + data->block_size;
+    if (i_end > data->count) i_end = data->count;
 
-    /* Get the x coordinate of this mesh cell in the global mesh
-     * Note: we don't need to sort more precisely than just
-     * the x coordinate */
-    const int mesh_x = get_xcoord_from_padded_row_major_id(key, N);
+    if (data->sort_key == bucket_sort_key_rho_xcoord) {
 
-#ifdef SWIFT_DEBUG_CHECKS
-    if (mesh_x < 0) error("Invalid mesh cell x-coordinate (too small)");
-    if (mesh_x >= N) error("Invalid mesh cell x-coordinate (too large)");
-#endif
+      /* Remind the compiler that the arrays are nicely aligned */
+      swift_declare_aligned_ptr(const struct mesh_key_value_rho, array_in,
+                                data->array_in, SWIFT_CACHE_ALIGNMENT);
+      swift_declare_aligned_ptr(struct mesh_key_value_rho, array_out,
+                                data->array_out, SWIFT_CACHE_ALIGNMENT);
 
-    /* Add a contribution to the bucket count */
-    local_bucket_counts[mesh_x]++;
-  }
+      for (size_t i = i_start; i < i_end; ++i) {
+        const int bucket = bucket_sort_get_bucket(data, i);
+        array_out[local_bucket_offsets[bucket]++] = array_in[i];
+      }
 
-  /* Now write back to memory */
-  for (int i = 0; i < N; ++i) {
-    atomic_add(&global_bucket_counts[i], local_bucket_counts[i]);
-  }
+    } else {
+
+      /* Remind the compiler that the arrays are nicely aligned */
+      swift_declare_aligned_ptr(const struct mesh_key_value_pot, array_in,
+                                data->array_in, SWIFT_CACHE_ALIGNMENT);
+      swift_declare_aligned_ptr(struct mesh_key_value_pot, array_out,
+                                data->array_out, SWIFT_CACHE_ALIGNMENT);
 
-  /* Clean up */
-  free(local_bucket_counts);
+      for (size_t i = i_start; i < i_end; ++i) {
+        const int bucket = bucket_sort_get_bucket(data, i);
+        array_out[local_bucket_offsets[bucket]++] = array_in[i];
+      }
+    }
+  }
 }
 
 /**
- * @param Count how may mesh cells will end up in each cell index
+ * @brief Stable bucket sort of an array of mesh cells, in parallel.
+ *
+ * The input is split in one contiguous block per thread. Each thread counts
+ * the elements of its block in each bucket, the counts are turned into
+ * write positions (bucket by bucket, block by block), and each thread then
+ * copies its block to the output. The result is the same as a serial
+ * counting sort.
+ *
+ * @param data The #mapper_extra_data describing the sort.
+ * @param tp The #threadpool object.
+ * @param bucket_offsets The offsets in the sorted array where we change
+ * bucket (to be filled).
  */
-void bucket_sort_mesh_key_value_pot_index_count_mapper(void *map_data,
-                                                       int nr_parts,
-                                                       void *extra_data) {
+static void bucket_sort_mesh_key_value(struct mapper_extra_data *data,
+                                       struct threadpool *tp,
+                                       size_t *bucket_offsets) {
 
-  /* Unpack the data */
-  const struct mesh_key_value_pot *array_in =
-      (const struct mesh_key_value_pot *)map_data;
-  struct mapper_extra_data *data = (struct mapper_extra_data *)extra_data;
   const int N = data->N;
-  size_t *global_bucket_counts = data->bucket_counts;
-
-  /* Local buckets */
-  size_t *local_bucket_counts = (size_t *)calloc(N, sizeof(size_t));
+  const size_t count = data->count;
+
+  /* One block per thread, but don't let the counts outgrow the data */
+  size_t nr_blocks = tp->num_threads;
+  if (nr_blocks > 1 + count / N) nr_blocks = 1 + count / N;
+  data->block_size = (count + nr_blocks - 1) / nr_blocks;
+  if (data->block_size == 0) data->block_size = 1;
+  nr_blocks = (count + data->block_size - 1) / data->block_size;
+
+  if (nr_blocks == 0) {
+    memset(bucket_offsets, 0, N * sizeof(size_t));
+    return;
+  }
 
-  /* Count how many items will land in each bucket. */
-  for (int i = 0; i < nr_parts; ++i) {
+  data->block_buckets = (size_t *)malloc(nr_blocks * N * sizeof(size_t));
+  if (data->block_buckets == NULL)
+    error("Failed to allocate the bucket counts of the mesh sort");
 
-    const size_t key = array_in[i].cell_index;
+  /* Collect the number of items of each block that go in each bucket */
+  threadpool_map(tp, bucket_sort_mesh_key_value_count_mapper,
+                 data->block_buckets, nr_blocks, N * sizeof(size_t),
+                 /*chunk=*/1, data);
 
-    /* Get the cell_index */
-    const int cell_id = cell_index_extract_patch_index(key);
+  /* Now we can build the array of offsets (cumsum of the counts) and the
+   * position in the output each block starts writing each bucket at */
+  size_t offset = 0;
+  for (int i = 0; i < N; ++i) {
+    bucket_offsets[i] = offset;
+    for (size_t b = 0; b < nr_blocks; ++b) {
+      const size_t block_count = data->block_buckets[b * N + i];
+      data->block_buckets[b * N + i] = offset;
+      offset += block_count;
+    }
+  }
 
 #ifdef SWIFT_DEBUG_CHECKS
-    if (cell_id < 0) error("Invalid mesh cell x-coordinate (too small)");
-    if (cell_id >= N) error("Invalid mesh cell x-coordinate (too large)");
+  if (offset != count) error("Bucket count is not matching");
 #endif
 
-    /* Add a contribution to the bucket count */
-    local_bucket_counts[cell_id]++;
-  }
-
-  /* Now write back to memory */
-  for (int i = 0; i < N; ++i) {
-    atomic_add(&global_bucket_counts[i], local_bucket_counts[i]);
-  }
+  /* Now, we can do the actual sorting */
+  threadpool_map(tp, bucket_sort_mesh_key_value_scatter_mapper,
+                 data->block_buckets, nr_blocks, N * sizeof(size_t),
+                 /*chunk=*/1, data);
 
-  /* Clean up */
-  free(local_bucket_counts);
+  /* Clean up! */
+  free(data->block_buckets);
+  data->block_buckets = NULL;
 }
 
 /**
@@ -190,74 +275,27 @@ void bucket_sort_mesh_key_value_rho(const struct mesh_key_value_rho *array_in,
                                     struct mesh_key_value_rho *array_out,
                                     size_t *bucket_offsets) {
 
-  /* Create an array of bucket counts and one of offsets */
-  size_t *bucket_counts = (size_t *)malloc(N * sizeof(size_t));
-  memset(bucket_counts, 0, N * sizeof(size_t));
-
   struct mapper_extra_data extra_data;
   extra_data.N = N;
-  extra_data.bucket_counts = bucket_counts;
-
-  /* Collect the number of items that will end up in each bucket */
-  threadpool_map(tp, bucket_sort_mesh_key_value_rho_count_mapper,
-                 (void *)array_in, count, sizeof(struct mesh_key_value_rho),
-                 threadpool_auto_chunk_size, &extra_data);
+  extra_data.sort_key = bucket_sort_key_rho_xcoord;
+  extra_data.array_in = array_in;
+  extra_data.array_out = array_out;
+  extra_data.count = count;
 
-#ifdef SWIFT_DEBUG_CHECKS
-  size_t count_check = 0;
-  for (int i = 0; i < N; ++i) count_check += bucket_counts[i];
-  if (count_check != count) error("Bucket count is not matching");
-#endif
-
-  /* Now we can build the array of offsets (cumsum of the counts) */
-  bucket_offsets[0] = 0;
-  for (int i = 1; i < N; ++i) {
-    bucket_offsets[i] = bucket_offsets[i - 1] + bucket_counts[i - 1];
-  }
-
-  /* Remind the compiler that the array is nicely aligned */
-  swift_declare_aligned_ptr(struct mesh_key_value_rho, array_out_aligned,
-                            array_out, SWIFT_CACHE_ALIGNMENT);
-  swift_declare_aligned_ptr(const struct mesh_key_value_rho, array_in_aligned,
-                            array_in, SWIFT_CACHE_ALIGNMENT);
-
-  /* Now, we can do the actual sorting */
-  for (size_t i = 0; i < count; ++i) {
-
-    const size_t key = array_in_aligned[i].key;
-    const int mesh_x = get_xcoord_from_padded_row_major_id(key, N);
-
-    /* Where does this element land? */
-    const size_t index = bucket_offsets[mesh_x];
-
-    /* Copy the element to its correct position */
-    memcpy(&array_out_aligned[index], &array_in_aligned[i],
-           sizeof(struct mesh_key_value_rho));
-
-    /* Move the start of this bucket by one */
-    bucket_offsets[mesh_x]++;
-  }
+  bucket_sort_mesh_key_value(&extra_data, tp, bucket_offsets);
 
 #ifdef SWIFT_DEBUG_CHECKS
   /* Verify that things have indeed been sorted */
-  int last_mesh_x =
-      get_xcoord_from_padded_row_major_id(array_out_aligned[0].key, N);
-  ;
-  for (size_t i = 1; i < count; ++i) {
-    const size_t key = array_out_aligned[i].key;
-    const int mesh_x = get_xcoord_from_padded_row_major_id(key, N);
-    if (mesh_x < last_mesh_x) error("Unsorted array!");
-    last_mesh_x = mesh_x;
+  if (count > 0) {
+    int last_mesh_x = get_xcoord_from_padded_row_major_id(array_out[0].key, N);
+    for (size_t i = 1; i < count; ++i) {
+      const size_t key = array_out[i].key;
+      const int mesh_x = get_xcoord_from_padded_row_major_id(key, N);
+      if (mesh_x < last_mesh_x) error("Unsorted array!");
+      last_mesh_x = mesh_x;
+    }
   }
 #endif
-
-  /* Restore the bucket offsets to their former glory */
-  for (int i = 0; i < N; ++i) {
-    bucket_offsets[i] -= bucket_counts[i];
-  }
-
-  /* Clean up! */
-  free(bucket_counts);
 }
 
 /**
@@ -280,74 +318,27 @@ void bucket_sort_mesh_key_value_pot(const struct mesh_key_value_pot *array_in,
                                     struct mesh_key_value_pot *array_out,
                                     size_t *bucket_offsets) {
 
-  /* Create an array of bucket counts and one of offsets */
-  size_t *bucket_counts = (size_t *)malloc(N * sizeof(size_t));
-  memset(bucket_counts, 0, N * sizeof(size_t));
-
   struct mapper_extra_data extra_data;
   extra_data.N = N;
-  extra_data.bucket_counts = bucket_counts;
+  extra_data.sort_key = bucket_sort_key_pot_xcoord;
+  extra_data.array_in = array_in;
+  extra_data.array_out = array_out;
+  extra_data.count = count;
 
-  /* Collect the number of items that will end up in each bucket */
-  threadpool_map(tp, bucket_sort_mesh_key_value_pot_count_mapper,
-                 (void *)array_in, count, sizeof(struct mesh_key_value_pot),
-                 threadpool_auto_chunk_size, &extra_data);
-
-#ifdef SWIFT_DEBUG_CHECKS
-  size_t count_check = 0;
-  for (int i = 0; i < N; ++i) count_check += bucket_counts[i];
-  if (count_check != count) error("Bucket count is not matching");
-#endif
-
-  /* Now we can build the array of offsets (cumsum of the counts) */
-  bucket_offsets[0] = 0;
-  for (int i = 1; i < N; ++i) {
-    bucket_offsets[i] = bucket_offsets[i - 1] + bucket_counts[i - 1];
-  }
-
-  /* Remind the compiler that the array is nicely aligned */
-  swift_declare_aligned_ptr(struct mesh_key_value_pot, array_out_aligned,
-                            array_out, SWIFT_CACHE_ALIGNMENT);
-  swift_declare_aligned_ptr(const struct mesh_key_value_pot, array_in_aligned,
-                            array_in, SWIFT_CACHE_ALIGNMENT);
-
-  /* Now, we can do the actual sorting */
-  for (size_t i = 0; i < count; ++i) {
-
-    const size_t key = array_in_aligned[i].key;
-    const int mesh_x = get_xcoord_from_padded_row_major_id(key, N);
-
-    /* Where does this element land? */
-    const size_t index = bucket_offsets[mesh_x];
-
-    /* Copy the element to its correct position */
-    memcpy(&array_out_aligned[index], &array_in_aligned[i],
-           sizeof(struct mesh_key_value_pot));
-
-    /* Move the start of this bucket by one */
-    bucket_offsets[mesh_x]++;
-  }
+  bucket_sort_mesh_key_value(&extra_data, tp, bucket_offsets);
 
 #ifdef SWIFT_DEBUG_CHECKS
   /* Verify that things have indeed been sorted */
-  int last_mesh_x =
-      get_xcoord_from_padded_row_major_id(array_out_aligned[0].key, N);
-
-  for (size_t i = 1; i < count; ++i) {
-    const size_t key = array_out_aligned[i].key;
-    const int mesh_x = get_xcoord_from_padded_row_major_id(key, N);
-    if (mesh_x < last_mesh_x) error("Unsorted array!");
-    last_mesh_x = mesh_x;
+  if (count > 0) {
+    int last_mesh_x = get_xcoord_from_padded_row_major_id(array_out[0].key, N);
+    for (size_t i = 1; i < count; ++i) {
+      const size_t key = array_out[i].key;
+      const int mesh_x = get_xcoord_from_padded_row_major_id(key, N);
+      if (mesh_x < last_mesh_x) error("Unsorted array!");
+      last_mesh_x = mesh_x;
+    }
   }
 #endif
-
-  /* Restore the bucket offsets to their former glory */
-  for (int i = 0; i < N; ++i) {
-    bucket_offsets[i] -= bucket_counts[i];
-  }
-
-  /* Clean up! */
-  free(bucket_counts);
 }
 
 /**
@@ -366,56 +357,19 @@ void bucket_sort_mesh_key_value_pot_index(
     const struct mesh_key_value_pot *array_in, const size_t count, const int N,
     struct threadpool *tp, struct mesh_key_value_pot *array_out) {
 
-  /* Create an array of bucket counts and one of offsets */
-  size_t *bucket_counts = (size_t *)malloc(N * sizeof(size_t));
   size_t *bucket_offsets = (size_t *)malloc(N * sizeof(size_t));
-  memset(bucket_counts, 0, N * sizeof(size_t));
+  if (bucket_offsets == NULL)
+    error("Failed to allocate the bucket offsets of the mesh sort");
 
   struct mapper_extra_data extra_data;
   extra_data.N = N;
-  extra_data.bucket_counts = bucket_counts;
-
-  /* Collect the number of items that will end up in each bucket */
-  threadpool_map(tp, bucket_sort_mesh_key_value_pot_index_count_mapper,
-                 (void *)array_in, count, sizeof(struct mesh_key_value_pot),
-                 threadpool_auto_chunk_size, &extra_data);
+  extra_data.sort_key = bucket_sort_key_pot_cell_index;
+  extra_data.array_in = array_in;
+  extra_data.array_out = array_out;
+  extra_data.count = count;
 
-#ifdef SWIFT_DEBUG_CHECKS
-  size_t count_check = 0;
-  for (int i = 0; i < N; ++i) count_check += bucket_counts[i];
-  if (count_check != count) error("Bucket count is not matching");
-#endif
-
-  /* Now we can build the array of offsets (cumsum of the counts) */
-  bucket_offsets[0] = 0;
-  for (int i = 1; i < N; ++i) {
-    bucket_offsets[i] = bucket_offsets[i - 1] + bucket_counts[i - 1];
-  }
-
-  /* Remind the compiler that the array is nicely aligned */
-  swift_declare_aligned_ptr(const struct mesh_key_value_pot, array_in_aligned,
-                            array_in, SWIFT_CACHE_ALIGNMENT);
-  swift_declare_aligned_ptr(struct mesh_key_value_pot, array_out_aligned,
-                            array_out, SWIFT_CACHE_ALIGNMENT);
-
-  /* Now, we can do the actual sorting */
-  for (size_t i = 0; i < count; ++i) {
-
-    const size_t key = array_in_aligned[i].cell_index;
-    const int cell_id = cell_index_extract_patch_index(key);
-
-    /* Where does this element land? */
-    const size_t index = bucket_offsets[cell_id];
-
-    /* Copy the element to its correct position */
-    memcpy(&array_out_aligned[index], &array_in_aligned[i],
-           sizeof(struct mesh_key_value_pot));
-
-    /* Move the start of this bucket by one */
-    bucket_offsets[cell_id]++;
-  }
+  bucket_sort_mesh_key_value(&extra_data, tp, bucket_offsets);
 
   /* Clean up! */
   free(bucket_offsets);
-  free(bucket_counts);
 }
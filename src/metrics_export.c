@@ -0,0 +1,219 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+/**
+ *  @file metrics_export.c
+ *  @brief Export of the state of the run as Prometheus metrics.
+ *
+ *  Every few steps rank 0 rewrites a file in the Prometheus text exposition
+ *  format, for the textfile collector of a node exporter (or any scraper) to
+ *  pick up, such that a slow-down of a long run can be alerted on without
+ *  reading the timesteps file. The file is written next to its final name
+ *  and renamed over it, so it is never seen half written.
+ *
+ *  The global counts are those the engine already reduced for the step. The
+ *  memory, GPU, receive and task numbers of the ranks are gathered at the
+ *  steps of the export only.
+ */
+
+/* Config parameters. */
+#include <config.h>
+
+/* Standard headers. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* MPI headers. */
+#ifdef WITH_MPI
+#include <mpi.h>
+#endif
+
+/* This object's header. */
+#include "metrics_export.h"
+
+/* Local headers. */
+#include "clocks.h"
+#include "engine.h"
+#include "error.h"
+#include "memuse.h"
+#include "mpi_comm_stats.h"
+#include "parser.h"
+
+/*! Number of steps between two exports, 0 for none. */
+static int metrics_export_frequency = 0;
+
+/*! The file the metrics are written to. */
+static char metrics_export_filename[PARSER_MAX_LINE_SIZE];
+
+/**
+ * @brief The numbers of a rank that are summed or maxed over the ranks.
+ */
+enum metrics_export_local {
+  metrics_export_rss = 0,
+  metrics_export_gpu_time,
+  metrics_export_recv_latency,
+  metrics_export_active_tasks,
+  metrics_export_tasks,
+  metrics_export_count
+};
+
+/**
+ * @brief Write one metric to the file.
+ *
+ * @param file The file.
+ * @param name The name of the metric.
+ * @param type Its Prometheus type.
+ * @param help What it is.
+ * @param value Its value.
+ */
+static void metrics_export_write(FILE *file, const char *name,
+                                 const char *type, const char *help,
+                                 const double value) {
+
+  fprintf(file, "# HELP %s %s\n# TYPE %s %s\n%s %.10g\n", name, help, name,
+          type, name, value);
+}
+
+/**
+ * @brief Read the parameters of the export.
+ *
+ * @param params The parsed parameters.
+ */
+void metrics_export_init(struct swift_params *params) {
+
+  metrics_export_frequency =
+      parser_get_opt_param_int(params, "Scheduler:metrics_frequency", 0);
+  if (metrics_export_frequency < 0)
+    error("Scheduler:metrics_frequency should be >= 0");
+  parser_get_opt_param_string(params, "Scheduler:metrics_file",
+                              metrics_export_filename, "swift_metrics.prom");
+}
+
+/**
+ * @brief Export the metrics of the step just done, if it is time.
+ *
+ * Must be called by all the ranks at the end of the step.
+ *
+ * @param e The #engine.
+ */
+void metrics_export_end_step(const struct engine *e) {
+
+  if (metrics_export_frequency == 0) return;
+  if (e->step % metrics_export_frequency != 0) return;
+
+  /* What this rank has to add */
+  long size, resident, shared, text, data, library, dirty;
+  memuse_use(&size, &resident, &shared, &text, &data, &library, &dirty);
+  double local[metrics_export_count];
+  local[metrics_export_rss] = 1024. * resident;
+  local[metrics_export_gpu_time] =
+      (double)e->step_gpu_ticks / clocks_get_cpufreq();
+  local[metrics_export_recv_latency] =
+      mpi_comm_stats_get_recv_latency(/*reset=*/1);
+  local[metrics_export_active_tasks] = e->sched.active_count;
+  local[metrics_export_tasks] = e->sched.nr_tasks;
+
+  double sums[metrics_export_count], maxs[metrics_export_count];
+#ifdef WITH_MPI
+  MPI_Reduce(local, sums, metrics_export_count, MPI_DOUBLE, MPI_SUM, 0,
+             MPI_COMM_WORLD);
+  MPI_Reduce(local, maxs, metrics_export_count, MPI_DOUBLE, MPI_MAX, 0,
+             MPI_COMM_WORLD);
+#else
+  memcpy(sums, local, sizeof(local));
+  memcpy(maxs, local, sizeof(local));
+#endif
+  if (e->nodeID != 0) return;
+
+  const double seconds = e->wallclock_time / 1000.;
+  const double nr_runners = (double)e->nr_nodes * e->nr_threads;
+  const double dead_time =
+      seconds > 0. ? e->global_deadtime / (nr_runners * e->wallclock_time) : 0.;
+
+  char tmp_filename[PARSER_MAX_LINE_SIZE + 8];
+  snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp",
+           metrics_export_filename);
+  FILE *file = fopen(tmp_filename, "w");
+  if (file == NULL) error("Could not create file '%s'.", tmp_filename);
+
+  metrics_export_write(file, "swift_step", "gauge", "Last step done.",
+                       e->step);
+  metrics_export_write(file, "swift_time", "gauge",
+                       "Simulation time (internal units).", e->time);
+  metrics_export_write(file, "swift_scale_factor", "gauge",
+                       "Scale factor.", e->cosmology->a);
+  metrics_export_write(file, "swift_step_seconds", "gauge",
+                       "Wall-clock time of the last step.", seconds);
+  metrics_export_write(file, "swift_parts_updated", "gauge",
+                       "Gas particles updated in the last step.", e->updates);
+  metrics_export_write(file, "swift_gparts_updated", "gauge",
+                       "Gravity particles updated in the last step.",
+                       e->g_updates);
+  metrics_export_write(file, "swift_sparts_updated", "gauge",
+                       "Star particles updated in the last step.",
+                       e->s_updates);
+  metrics_export_write(file, "swift_parts_updated_per_second", "gauge",
+                       "Gas particles updated per second in the last step.",
+                       seconds > 0. ? e->updates / seconds : 0.);
+  metrics_export_write(
+      file, "swift_gparts_updated_per_second", "gauge",
+      "Gravity particles updated per second in the last step.",
+      seconds > 0. ? e->g_updates / seconds : 0.);
+  metrics_export_write(file, "swift_dead_time_fraction", "gauge",
+                       "Fraction of the runner time spent idle in the last "
+                       "step.",
+                       dead_time);
+  metrics_export_write(file, "swift_gpu_offload_seconds", "gauge",
+                       "Runner time spent in offloaded GPU calls in the last "
+                       "step, all the ranks.",
+                       sums[metrics_export_gpu_time]);
+  metrics_export_write(file, "swift_gpu_offload_fraction", "gauge",
+                       "Fraction of the runner time spent in offloaded GPU "
+                       "calls in the last step.",
+                       seconds > 0. ? sums[metrics_export_gpu_time] /
+                                          (nr_runners * seconds)
+                                    : 0.);
+  metrics_export_write(file, "swift_mpi_recv_latency_seconds", "gauge",
+                       "Mean time from post to completion of the receives "
+                       "since the last export, worst rank.",
+                       maxs[metrics_export_recv_latency]);
+  metrics_export_write(file, "swift_resident_memory_max_bytes", "gauge",
+                       "Resident memory of the largest rank.",
+                       maxs[metrics_export_rss]);
+  metrics_export_write(file, "swift_resident_memory_bytes", "gauge",
+                       "Resident memory of all the ranks.",
+                       sums[metrics_export_rss]);
+  metrics_export_write(file, "swift_tasks_active", "gauge",
+                       "Tasks queued in the last step, all the ranks.",
+                       sums[metrics_export_active_tasks]);
+  metrics_export_write(file, "swift_tasks_active_max", "gauge",
+                       "Tasks queued in the last step, busiest rank.",
+                       maxs[metrics_export_active_tasks]);
+  metrics_export_write(file, "swift_tasks", "gauge",
+                       "Tasks in the graph, all the ranks.",
+                       sums[metrics_export_tasks]);
+  metrics_export_write(file, "swift_last_export_timestamp_seconds", "gauge",
+                       "Unix time of this export.", (double)time(NULL));
+
+  if (fclose(file) != 0) error("Could not write file '%s'.", tmp_filename);
+  if (rename(tmp_filename, metrics_export_filename) != 0)
+    error("Could not rename '%s' to '%s'.", tmp_filename,
+          metrics_export_filename);
+}
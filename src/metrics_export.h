@@ -0,0 +1,32 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#ifndef SWIFT_METRICS_EXPORT_H
+#define SWIFT_METRICS_EXPORT_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* Forward declarations. */
+struct engine;
+struct swift_params;
+
+/* Function prototypes. */
+void metrics_export_init(struct swift_params *params);
+void metrics_export_end_step(const struct engine *e);
+
+#endif /* SWIFT_METRICS_EXPORT_H */
@@ -0,0 +1,475 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+/**
+ *  @file mpi_aggregate.c
+ *  @brief Aggregation of the #gpart messages sent to and received from each
+ *  node into a single message per node and engine_launch.
+ *
+ *  The per-cell send and receive tasks are kept, as are their dependencies.
+ *  The send tasks copy their #gpart into the buffer of their node and the
+ *  last one of them posts the message. The first receive task of a node
+ *  posts the receive of the whole buffer and each of them then copies its
+ *  own cell's #gpart out of it, such that the gravity tasks of a cell can
+ *  start as soon as the message has landed.
+ *
+ *  Both sides lay the cells out in the buffer in the order of their tags,
+ *  which works as the same cells are active on both sides (as is already
+ *  required for the per-cell messages to match).
+ */
+
+/* Config parameters. */
+#include <config.h>
+
+/* Standard headers. */
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* MPI headers. */
+#ifdef WITH_MPI
+#include <mpi.h>
+#endif
+
+/* This object's header. */
+#include "mpi_aggregate.h"
+
+/* Local headers. */
+#include "atomic.h"
+#include "cell.h"
+#include "error.h"
+#include "lock.h"
+#include "mpi_comm_stats.h"
+#include "mpiuse.h"
+#include "part.h"
+#include "scheduler.h"
+#include "task.h"
+
+/*! Tag of the aggregated messages, above all the cell tags. */
+#define mpi_aggregate_tag (cell_max_tag + 1)
+
+/*! Are the #gpart messages aggregated per node? */
+int mpi_aggregate_gparts = 0;
+
+#ifdef WITH_MPI
+
+/**
+ * @brief The #gpart of all the cells sent to or received from one node.
+ */
+struct mpi_aggregate {
+
+  /*! The buffer. */
+  char *buff;
+
+  /*! Size of the buffer in bytes. */
+  size_t size;
+
+  /*! Number of #gpart in the message of this launch. */
+  size_t count;
+
+  /*! Number of tasks in the message of this launch. */
+  int nr_tasks;
+
+  /*! Number of send tasks yet to copy their #gpart in. */
+  volatile int pending;
+
+  /*! Has the message been posted? */
+  volatile int posted;
+
+  /*! Has the message been received? */
+  volatile int done;
+
+  /*! When was the message posted? */
+  ticks tic_posted;
+
+  /*! The request of the message. */
+  MPI_Request req;
+
+  /*! Lock protecting the tests of the request. */
+  swift_lock_type lock;
+};
+
+/*! Outgoing and incoming messages, per node. */
+static struct mpi_aggregate *mpi_aggregate_send = NULL;
+static struct mpi_aggregate *mpi_aggregate_recv = NULL;
+static int mpi_aggregate_nr_nodes = 0;
+
+/*! Are the #gpart sent as #gpart_foreign? */
+static int mpi_aggregate_compact = 0;
+
+/*! And kept in that form by the foreign cells? */
+static int mpi_aggregate_compact_in_memory = 0;
+
+/*! Room to sort the active tasks by node. */
+static struct task **mpi_aggregate_tasks = NULL;
+static int mpi_aggregate_tasks_size = 0;
+
+/**
+ * @brief Size in bytes of one particle in the messages.
+ */
+static size_t mpi_aggregate_part_size(void) {
+  return mpi_aggregate_compact ? sizeof(struct gpart_foreign)
+                               : sizeof(struct gpart);
+}
+
+/**
+ * @brief MPI type of one particle in the messages.
+ */
+static MPI_Datatype mpi_aggregate_part_type(void) {
+  return mpi_aggregate_compact ? gpart_foreign_mpi_type : gpart_mpi_type;
+}
+
+/**
+ * @brief Sort the tasks by #cell tag.
+ */
+static int mpi_aggregate_cmp_tags(const void *a, const void *b) {
+  const long long tag_a = (*(struct task *const *)a)->flags;
+  const long long tag_b = (*(struct task *const *)b)->flags;
+  return (tag_a > tag_b) - (tag_a < tag_b);
+}
+
+/**
+ * @brief Lay out the #gpart of a set of tasks in the buffer of a node.
+ *
+ * @param agg The #mpi_aggregate of the node.
+ * @param tasks The tasks of the node.
+ * @param nr_tasks The number of tasks.
+ */
+static void mpi_aggregate_layout(struct mpi_aggregate *agg,
+                                 struct task **tasks, const int nr_tasks) {
+
+  qsort(tasks, nr_tasks, sizeof(struct task *), mpi_aggregate_cmp_tags);
+
+  size_t count = 0;
+  for (int k = 0; k < nr_tasks; k++) count += tasks[k]->ci->grav.count;
+
+  const size_t part_size = mpi_aggregate_part_size();
+  if (count * part_size > agg->size) {
+    free(agg->buff);
+    agg->size = 1.2 * count * part_size;
+    if (posix_memalign((void **)&agg->buff, SWIFT_CACHE_ALIGNMENT,
+                       agg->size) != 0)
+      error("Failed to allocate the aggregated gpart buffer.");
+  }
+
+  size_t offset = 0;
+  for (int k = 0; k < nr_tasks; k++) {
+    tasks[k]->buff = agg->buff + offset * part_size;
+    offset += tasks[k]->ci->grav.count;
+  }
+
+  agg->count = count;
+  agg->nr_tasks = nr_tasks;
+  agg->pending = nr_tasks;
+  agg->posted = 0;
+  agg->done = 0;
+  agg->req = MPI_REQUEST_NULL;
+
+  if (count > INT_MAX) error("Too many gparts in an aggregated message.");
+}
+
+#endif /* WITH_MPI */
+
+/**
+ * @brief Turn the aggregation of the #gpart messages on or off.
+ *
+ * @param active Do we aggregate the messages?
+ * @param nr_nodes The number of nodes.
+ */
+void mpi_aggregate_init(const int active, const int nr_nodes) {
+
+#ifdef WITH_MPI
+  mpi_aggregate_gparts = active && nr_nodes > 1;
+  if (!mpi_aggregate_gparts) return;
+
+  mpi_aggregate_nr_nodes = nr_nodes;
+  if ((mpi_aggregate_send = (struct mpi_aggregate *)calloc(
+           nr_nodes, sizeof(struct mpi_aggregate))) == NULL ||
+      (mpi_aggregate_recv = (struct mpi_aggregate *)calloc(
+           nr_nodes, sizeof(struct mpi_aggregate))) == NULL)
+    error("Failed to allocate the aggregated messages.");
+
+  for (int k = 0; k < nr_nodes; k++) {
+    lock_init(&mpi_aggregate_send[k].lock);
+    lock_init(&mpi_aggregate_recv[k].lock);
+    mpi_aggregate_send[k].req = MPI_REQUEST_NULL;
+    mpi_aggregate_recv[k].req = MPI_REQUEST_NULL;
+  }
+#else
+  mpi_aggregate_gparts = 0;
+#endif
+}
+
+/**
+ * @brief Free the buffers of the aggregated messages.
+ */
+void mpi_aggregate_clean(void) {
+
+#ifdef WITH_MPI
+  if (!mpi_aggregate_gparts) return;
+
+  for (int k = 0; k < mpi_aggregate_nr_nodes; k++) {
+    free(mpi_aggregate_send[k].buff);
+    free(mpi_aggregate_recv[k].buff);
+  }
+  free(mpi_aggregate_send);
+  free(mpi_aggregate_recv);
+  free(mpi_aggregate_tasks);
+  mpi_aggregate_send = NULL;
+  mpi_aggregate_recv = NULL;
+  mpi_aggregate_tasks = NULL;
+  mpi_aggregate_tasks_size = 0;
+  mpi_aggregate_gparts = 0;
+#endif
+}
+
+/**
+ * @brief Lay out the #gpart of the active send and receive tasks in the
+ * buffers of their nodes.
+ *
+ * Must be called on the list of active tasks before scheduler_start().
+ *
+ * @param s The #scheduler.
+ */
+void mpi_aggregate_prepare(struct scheduler *s) {
+
+#ifdef WITH_MPI
+  if (!mpi_aggregate_gparts) return;
+
+  const int nr_nodes = mpi_aggregate_nr_nodes;
+  mpi_aggregate_compact = s->compact_foreign_gparts;
+  mpi_aggregate_compact_in_memory = s->compact_foreign_gparts_in_memory;
+
+  /* Count the tasks of each node and direction. */
+  int *counts = (int *)calloc(2 * nr_nodes + 1, sizeof(int));
+  if (counts == NULL) error("Failed to allocate task counts.");
+  for (int k = 0; k < s->active_count; k++) {
+    const struct task *t = &s->tasks[s->tid_active[k]];
+    if (t->subtype != task_subtype_gpart) continue;
+    if (t->type == task_type_send)
+      counts[2 * t->cj->nodeID + 1]++;
+    else if (t->type == task_type_recv)
+      counts[2 * t->ci->nodeID + 2]++;
+  }
+
+  /* Turn them into offsets. */
+  for (int k = 1; k <= 2 * nr_nodes; k++) counts[k] += counts[k - 1];
+  const int nr_tasks = counts[2 * nr_nodes];
+
+  if (nr_tasks > mpi_aggregate_tasks_size) {
+    free(mpi_aggregate_tasks);
+    mpi_aggregate_tasks_size = 1.2 * nr_tasks;
+    if ((mpi_aggregate_tasks = (struct task **)malloc(
+             mpi_aggregate_tasks_size * sizeof(struct task *))) == NULL)
+      error("Failed to allocate the aggregated tasks.");
+  }
+
+  /* Sort the tasks by node and direction. */
+  int *fill = (int *)malloc(2 * nr_nodes * sizeof(int));
+  if (fill == NULL) error("Failed to allocate task offsets.");
+  memcpy(fill, counts, 2 * nr_nodes * sizeof(int));
+  for (int k = 0; k < s->active_count; k++) {
+    struct task *t = &s->tasks[s->tid_active[k]];
+    if (t->subtype != task_subtype_gpart) continue;
+    if (t->type == task_type_send)
+      mpi_aggregate_tasks[fill[2 * t->cj->nodeID]++] = t;
+    else if (t->type == task_type_recv)
+      mpi_aggregate_tasks[fill[2 * t->ci->nodeID + 1]++] = t;
+  }
+  free(fill);
+
+  /* And lay them out. */
+  for (int k = 0; k < nr_nodes; k++) {
+    mpi_aggregate_layout(&mpi_aggregate_send[k],
+                         &mpi_aggregate_tasks[counts[2 * k]],
+                         counts[2 * k + 1] - counts[2 * k]);
+    mpi_aggregate_layout(&mpi_aggregate_recv[k],
+                         &mpi_aggregate_tasks[counts[2 * k + 1]],
+                         counts[2 * k + 2] - counts[2 * k + 1]);
+  }
+  free(counts);
+#endif
+}
+
+/**
+ * @brief Copy the #gpart of a send task into the buffer of its node, and
+ * send the buffer if it was the last one.
+ *
+ * @param t The send #task.
+ */
+void mpi_aggregate_send_gpart(struct task *t) {
+
+#ifdef WITH_MPI
+  const int node = t->cj->nodeID;
+  struct mpi_aggregate *agg = &mpi_aggregate_send[node];
+
+  if (mpi_aggregate_compact)
+    cell_pack_gpart_foreign(t->ci, (struct gpart_foreign *)t->buff);
+  else
+    memcpy(t->buff, t->ci->grav.parts,
+           t->ci->grav.count * sizeof(struct gpart));
+
+  /* Last one in? Send everything. */
+  if (atomic_dec(&agg->pending) == 1) {
+    const int err =
+        MPI_Isend(agg->buff, (int)agg->count, mpi_aggregate_part_type(), node,
+                  mpi_aggregate_tag, subtaskMPI_comms[task_subtype_gpart],
+                  &agg->req);
+    if (err != MPI_SUCCESS)
+      mpi_error(err, "Failed to emit isend for aggregated gpart data.");
+    agg->posted = 1;
+    agg->tic_posted = getticks();
+
+    mpiuse_log_allocation(task_type_send, task_subtype_gpart, &agg->req, 1,
+                          agg->count * mpi_aggregate_part_size(), node,
+                          mpi_aggregate_tag);
+    mpi_comm_stats_post(/*send=*/1, task_subtype_gpart,
+                        agg->count * mpi_aggregate_part_size(), node);
+  }
+#else
+  error("SWIFT was not compiled with MPI support.");
+#endif
+}
+
+/**
+ * @brief Post the receive of the buffer of the node of a receive task, if
+ * not done already.
+ *
+ * @param t The receive #task.
+ */
+void mpi_aggregate_recv_gpart(struct task *t) {
+
+#ifdef WITH_MPI
+  const int node = t->ci->nodeID;
+  struct mpi_aggregate *agg = &mpi_aggregate_recv[node];
+
+  if (atomic_cas(&agg->posted, 0, 1) != 0) return;
+
+  lock_lock(&agg->lock);
+  const int err =
+      MPI_Irecv(agg->buff, (int)agg->count, mpi_aggregate_part_type(), node,
+                mpi_aggregate_tag, subtaskMPI_comms[task_subtype_gpart],
+                &agg->req);
+  if (err != MPI_SUCCESS)
+    mpi_error(err, "Failed to emit irecv for aggregated gpart data.");
+  agg->tic_posted = getticks();
+
+  mpiuse_log_allocation(task_type_recv, task_subtype_gpart, &agg->req, 1,
+                        agg->count * mpi_aggregate_part_size(), node,
+                        mpi_aggregate_tag);
+  mpi_comm_stats_post(/*send=*/0, task_subtype_gpart,
+                      agg->count * mpi_aggregate_part_size(), node);
+  if (lock_unlock(&agg->lock) != 0) error("Failed to unlock the message.");
+#else
+  error("SWIFT was not compiled with MPI support.");
+#endif
+}
+
+/**
+ * @brief Has the buffer of the node of a receive task arrived?
+ *
+ * @param t The receive #task.
+ *
+ * @return 1 if the task's #gpart can be unpacked, 0 otherwise.
+ */
+int mpi_aggregate_recv_gpart_test(const struct task *t) {
+
+#ifdef WITH_MPI
+  struct mpi_aggregate *agg = &mpi_aggregate_recv[t->ci->nodeID];
+
+  if (agg->done) return 1;
+
+  /* Someone else is testing (or posting) it. */
+  if (lock_trylock(&agg->lock) != 0) return 0;
+
+  if (!agg->done) {
+    int res;
+    MPI_Status stat;
+    const int err = MPI_Test(&agg->req, &res, &stat);
+    if (err != MPI_SUCCESS)
+      mpi_error(err, "Failed to test request on aggregated gpart data.");
+    if (res) {
+      mpiuse_log_allocation(task_type_recv, task_subtype_gpart, &agg->req, 0,
+                            0, 0, 0);
+      mpi_comm_stats_done(/*send=*/0, task_subtype_gpart, t->ci->nodeID,
+                          agg->tic_posted);
+      agg->done = 1;
+    }
+  }
+
+  const int done = agg->done;
+  if (lock_unlock(&agg->lock) != 0) error("Failed to unlock the message.");
+  return done;
+#else
+  error("SWIFT was not compiled with MPI support.");
+  return 0;
+#endif
+}
+
+/**
+ * @brief Copy the #gpart of a receive task out of the buffer of its node.
+ *
+ * @param t The receive #task.
+ */
+void mpi_aggregate_recv_gpart_unpack(struct task *t) {
+
+#ifdef WITH_MPI
+  if (mpi_aggregate_compact_in_memory)
+    memcpy(t->ci->grav.parts_foreign, t->buff,
+           t->ci->grav.count * sizeof(struct gpart_foreign));
+  else if (mpi_aggregate_compact)
+    cell_unpack_gpart_foreign(t->ci, (const struct gpart_foreign *)t->buff);
+  else
+    memcpy(t->ci->grav.parts, t->buff,
+           t->ci->grav.count * sizeof(struct gpart));
+#else
+  error("SWIFT was not compiled with MPI support.");
+#endif
+}
+
+/**
+ * @brief Wait for the aggregated messages sent during the last launch to
+ * be gone.
+ */
+void mpi_aggregate_wait(void) {
+
+#ifdef WITH_MPI
+  if (!mpi_aggregate_gparts) return;
+
+  for (int k = 0; k < mpi_aggregate_nr_nodes; k++) {
+    struct mpi_aggregate *agg = &mpi_aggregate_send[k];
+    if (agg->nr_tasks == 0) continue;
+    if (!agg->posted) error("Aggregated gpart message to %d never sent.", k);
+
+    MPI_Status stat;
+    const int err = MPI_Wait(&agg->req, &stat);
+    if (err != MPI_SUCCESS)
+      mpi_error(err, "Failed to wait for aggregated gpart data.");
+    mpiuse_log_allocation(task_type_send, task_subtype_gpart, &agg->req, 0, 0,
+                          0, 0);
+    mpi_comm_stats_done(/*send=*/1, task_subtype_gpart, k, agg->tic_posted);
+    agg->nr_tasks = 0;
+  }
+
+#ifdef SWIFT_DEBUG_CHECKS
+  for (int k = 0; k < mpi_aggregate_nr_nodes; k++)
+    if (mpi_aggregate_recv[k].nr_tasks > 0 && !mpi_aggregate_recv[k].done)
+      error("Aggregated gpart message from %d never received.", k);
+#endif
+#endif
+}
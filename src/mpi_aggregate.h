@@ -0,0 +1,41 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#ifndef SWIFT_MPI_AGGREGATE_H
+#define SWIFT_MPI_AGGREGATE_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* Forward declarations. */
+struct scheduler;
+struct task;
+
+/*! Are the #gpart messages aggregated per node? */
+extern int mpi_aggregate_gparts;
+
+/* Function prototypes. */
+void mpi_aggregate_init(const int active, const int nr_nodes);
+void mpi_aggregate_clean(void);
+void mpi_aggregate_prepare(struct scheduler *s);
+void mpi_aggregate_send_gpart(struct task *t);
+void mpi_aggregate_recv_gpart(struct task *t);
+int mpi_aggregate_recv_gpart_test(const struct task *t);
+void mpi_aggregate_recv_gpart_unpack(struct task *t);
+void mpi_aggregate_wait(void);
+
+#endif /* SWIFT_MPI_AGGREGATE_H */
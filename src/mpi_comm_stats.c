@@ -0,0 +1,327 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+/**
+ *  @file mpi_comm_stats.c
+ *  @brief Running summary of the messages of the send and receive tasks.
+ *
+ *  Each message adds its size to the sums of its subtype and of the node at
+ *  the other end when it is posted, and the time from its post to the test
+ *  that found it complete when it is done. That is a few atomic additions
+ *  per message, so the sums are always kept and cost nothing worth
+ *  switching off; writing them out is what the frequency controls. Unlike
+ *  the mpiuse reports nothing is kept per message.
+ *
+ *  The bytes exchanged with each node are also summed since they were last
+ *  asked for, for the repartitioning to weigh the communications with, and
+ *  so are the times of the receives, for the metrics export.
+ *
+ *  The completion times are those of the tests, so they include the time
+ *  the runners took to come back to the task. The aggregated #gpart sends are
+ *  only waited for at the end of the launch.
+ */
+
+/* Config parameters. */
+#include <config.h>
+
+/* Standard headers. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* This object's header. */
+#include "mpi_comm_stats.h"
+
+/* Local headers. */
+#include "atomic.h"
+#include "clocks.h"
+#include "error.h"
+#include "task.h"
+
+#ifdef WITH_MPI
+
+/**
+ * @brief The sums of a set of messages.
+ */
+struct mpi_comm_stats_sums {
+
+  /*! Number of messages posted. */
+  volatile long long count;
+
+  /*! Their size in bytes. */
+  volatile long long bytes;
+
+  /*! Number of messages completed. */
+  volatile long long done;
+
+  /*! Sum and maximum of their times from post to completion. */
+  volatile long long time;
+  volatile long long max_time;
+};
+
+/*! Number of steps between two outputs, 0 for none. */
+static int mpi_comm_stats_frequency = 0;
+
+/*! Sums per direction (0 receives, 1 sends) and subtype. */
+static struct mpi_comm_stats_sums mpi_comm_stats_subtypes[2]
+                                                        [task_subtype_count];
+
+/*! Sums per direction and node. */
+static struct mpi_comm_stats_sums *mpi_comm_stats_nodes = NULL;
+static int mpi_comm_stats_nr_nodes = 0;
+
+/*! Bytes per direction and node since they were last asked for. */
+static volatile long long *mpi_comm_stats_node_bytes = NULL;
+
+/*! Receives completed and their times since they were last asked for. */
+static volatile long long mpi_comm_stats_recv_done = 0;
+static volatile long long mpi_comm_stats_recv_time = 0;
+
+/*! The file the sums are appended to. */
+static char mpi_comm_stats_filename[64];
+
+/**
+ * @brief Add a completed message to a set of sums.
+ */
+static void mpi_comm_stats_add_done(struct mpi_comm_stats_sums *s,
+                                    const long long dt) {
+  atomic_inc(&s->done);
+  atomic_add(&s->time, dt);
+  atomic_max_ll(&s->max_time, dt);
+}
+
+/**
+ * @brief Write one set of sums to the file.
+ */
+static void mpi_comm_stats_write_sums(FILE *file, const int step,
+                                      const int send, const char *kind,
+                                      const char *name,
+                                      const struct mpi_comm_stats_sums *s) {
+
+  const double time = clocks_from_ticks(s->time);
+  const double seconds = (double)s->time / (double)clocks_get_cpufreq();
+  fprintf(file, "  %6d %4s %7s %16s %10lld %14lld %12.4f %12.4f %12.3f\n",
+          step, send ? "send" : "recv", kind, name, s->count, s->bytes,
+          s->done > 0 ? time / s->done : 0.,
+          clocks_from_ticks(s->max_time),
+          seconds > 0. ? 1e-6 * s->bytes / seconds : 0.);
+}
+
+#endif /* WITH_MPI */
+
+/**
+ * @brief Set up the sums of the messages and create their file.
+ *
+ * @param frequency Number of steps between two outputs, 0 for none.
+ * @param nr_nodes The number of nodes.
+ * @param nodeID The rank of this node.
+ * @param restart Are we restarting? The file is then appended to.
+ */
+void mpi_comm_stats_init(const int frequency, const int nr_nodes,
+                         const int nodeID, const int restart) {
+
+#ifdef WITH_MPI
+  mpi_comm_stats_frequency = frequency;
+  mpi_comm_stats_nr_nodes = nr_nodes;
+  bzero(mpi_comm_stats_subtypes, sizeof(mpi_comm_stats_subtypes));
+
+  free(mpi_comm_stats_nodes);
+  free((void *)mpi_comm_stats_node_bytes);
+  mpi_comm_stats_nodes = (struct mpi_comm_stats_sums *)calloc(
+      2 * nr_nodes, sizeof(struct mpi_comm_stats_sums));
+  mpi_comm_stats_node_bytes =
+      (volatile long long *)calloc(2 * nr_nodes, sizeof(long long));
+  if (mpi_comm_stats_nodes == NULL || mpi_comm_stats_node_bytes == NULL)
+    error("Failed to allocate the MPI communication sums.");
+
+  if (frequency == 0) return;
+
+  snprintf(mpi_comm_stats_filename, sizeof(mpi_comm_stats_filename),
+           "mpi_comm_stats_%04d.txt", nodeID);
+  if (restart) return;
+
+  FILE *file = fopen(mpi_comm_stats_filename, "w");
+  if (file == NULL)
+    error("Could not create file '%s'.", mpi_comm_stats_filename);
+  fprintf(file,
+          "# Messages of the send and receive tasks since the last output, "
+          "per subtype and per node at the other end. Times in %s.\n"
+          "# latency: from the post of a message to the test that found it "
+          "complete (mean and max).\n"
+          "# MB/s: bytes over the sum of the latencies, the rate one message "
+          "in flight got.\n",
+          clocks_getunit());
+  fprintf(file, "# %6s %4s %7s %16s %10s %14s %12s %12s %12s\n", "step",
+          "dir", "kind", "name", "count", "bytes", "mean_latency",
+          "max_latency", "MB/s");
+  fclose(file);
+#endif
+}
+
+/**
+ * @brief Free the sums of the messages.
+ */
+void mpi_comm_stats_clean(void) {
+
+#ifdef WITH_MPI
+  free(mpi_comm_stats_nodes);
+  free((void *)mpi_comm_stats_node_bytes);
+  mpi_comm_stats_nodes = NULL;
+  mpi_comm_stats_node_bytes = NULL;
+  mpi_comm_stats_nr_nodes = 0;
+#endif
+}
+
+/**
+ * @brief Count a message that was just posted.
+ *
+ * @param send Is it a send (or a receive)?
+ * @param subtype The #task_subtypes of the message.
+ * @param size Its size in bytes.
+ * @param node The node at the other end.
+ */
+void mpi_comm_stats_post(const int send, const int subtype, const size_t size,
+                         const int node) {
+
+#ifdef WITH_MPI
+  if (mpi_comm_stats_nodes == NULL) return;
+  const int dir = send ? 1 : 0;
+
+  struct mpi_comm_stats_sums *s = &mpi_comm_stats_subtypes[dir][subtype];
+  atomic_inc(&s->count);
+  atomic_add(&s->bytes, (long long)size);
+
+  struct mpi_comm_stats_sums *n =
+      &mpi_comm_stats_nodes[dir * mpi_comm_stats_nr_nodes + node];
+  atomic_inc(&n->count);
+  atomic_add(&n->bytes, (long long)size);
+
+  atomic_add(&mpi_comm_stats_node_bytes[dir * mpi_comm_stats_nr_nodes + node],
+             (long long)size);
+#endif
+}
+
+/**
+ * @brief Count a message that was just found complete.
+ *
+ * @param send Is it a send (or a receive)?
+ * @param subtype The #task_subtypes of the message.
+ * @param node The node at the other end.
+ * @param tic_post When the message was posted.
+ */
+void mpi_comm_stats_done(const int send, const int subtype, const int node,
+                         const ticks tic_post) {
+
+#ifdef WITH_MPI
+  if (mpi_comm_stats_nodes == NULL) return;
+  const int dir = send ? 1 : 0;
+  const ticks tic = getticks();
+  const long long dt = tic > tic_post ? (long long)(tic - tic_post) : 0;
+
+  mpi_comm_stats_add_done(&mpi_comm_stats_subtypes[dir][subtype], dt);
+  mpi_comm_stats_add_done(
+      &mpi_comm_stats_nodes[dir * mpi_comm_stats_nr_nodes + node], dt);
+  if (!send) {
+    atomic_inc(&mpi_comm_stats_recv_done);
+    atomic_add(&mpi_comm_stats_recv_time, dt);
+  }
+#endif
+}
+
+/**
+ * @brief Write the sums to the file, if it is time, and start new ones.
+ *
+ * Must be called when no messages are in flight.
+ *
+ * @param step The current step.
+ */
+void mpi_comm_stats_end_step(const int step) {
+
+#ifdef WITH_MPI
+  if (mpi_comm_stats_frequency == 0 || mpi_comm_stats_nodes == NULL) return;
+  if (step % mpi_comm_stats_frequency != 0) return;
+
+  FILE *file = fopen(mpi_comm_stats_filename, "a");
+  if (file == NULL)
+    error("Could not open file '%s'.", mpi_comm_stats_filename);
+
+  for (int dir = 0; dir < 2; dir++) {
+    for (int k = 0; k < task_subtype_count; k++) {
+      const struct mpi_comm_stats_sums *s = &mpi_comm_stats_subtypes[dir][k];
+      if (s->count > 0)
+        mpi_comm_stats_write_sums(file, step, dir, "subtype",
+                                  subtaskID_names[k], s);
+    }
+    for (int k = 0; k < mpi_comm_stats_nr_nodes; k++) {
+      const struct mpi_comm_stats_sums *s =
+          &mpi_comm_stats_nodes[dir * mpi_comm_stats_nr_nodes + k];
+      if (s->count == 0) continue;
+      char name[16];
+      snprintf(name, sizeof(name), "%d", k);
+      mpi_comm_stats_write_sums(file, step, dir, "rank", name, s);
+    }
+  }
+  fclose(file);
+
+  bzero(mpi_comm_stats_subtypes, sizeof(mpi_comm_stats_subtypes));
+  bzero(mpi_comm_stats_nodes,
+        2 * mpi_comm_stats_nr_nodes * sizeof(struct mpi_comm_stats_sums));
+#endif
+}
+
+/**
+ * @brief Get the bytes exchanged with each node since the last reset.
+ *
+ * @param bytes The bytes received from (first nr_nodes entries) and sent to
+ *        (next nr_nodes entries) each node.
+ * @param reset Start the sums again?
+ */
+void mpi_comm_stats_get_node_bytes(double *bytes, const int reset) {
+
+#ifdef WITH_MPI
+  for (int k = 0; k < 2 * mpi_comm_stats_nr_nodes; k++) {
+    bytes[k] = (double)mpi_comm_stats_node_bytes[k];
+    if (reset) mpi_comm_stats_node_bytes[k] = 0;
+  }
+#endif
+}
+
+/**
+ * @brief Get the mean time from the post of a receive to its completion
+ * since the last reset.
+ *
+ * @param reset Start the sums again?
+ *
+ * @return The mean latency in seconds, 0 if nothing was received.
+ */
+double mpi_comm_stats_get_recv_latency(const int reset) {
+
+#ifdef WITH_MPI
+  const long long done = mpi_comm_stats_recv_done;
+  const double latency =
+      done > 0 ? (double)mpi_comm_stats_recv_time / done / clocks_get_cpufreq()
+               : 0.;
+  if (reset) {
+    mpi_comm_stats_recv_done = 0;
+    mpi_comm_stats_recv_time = 0;
+  }
+  return latency;
+#else
+  return 0.;
+#endif
+}
@@ -0,0 +1,39 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#ifndef SWIFT_MPI_COMM_STATS_H
+#define SWIFT_MPI_COMM_STATS_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* Local headers. */
+#include "cycle.h"
+
+/* Function prototypes. */
+void mpi_comm_stats_init(const int frequency, const int nr_nodes,
+                         const int nodeID, const int restart);
+void mpi_comm_stats_clean(void);
+void mpi_comm_stats_post(const int send, const int subtype, const size_t size,
+                         const int node);
+void mpi_comm_stats_done(const int send, const int subtype, const int node,
+                         const ticks tic_post);
+void mpi_comm_stats_end_step(const int step);
+void mpi_comm_stats_get_node_bytes(double *bytes, const int reset);
+double mpi_comm_stats_get_recv_latency(const int reset);
+
+#endif /* SWIFT_MPI_COMM_STATS_H */
@@ -0,0 +1,208 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+/**
+ *  @file mpi_progress.c
+ *  @brief A thread that drives the progress of the MPI messages while the
+ *  tasks run.
+ *
+ *  Most MPI libraries only move the data of large (rendezvous) messages on
+ *  when some thread calls into the library. The runners do that when they
+ *  test the requests of the send and receive tasks, but when they are all
+ *  busy in long tasks the messages stall. This thread calls @c MPI_Iprobe
+ *  on the communicators of the tasks in turn, which progresses all the
+ *  outstanding requests without touching them, so the runners keep sole
+ *  ownership of their requests. Probes that find a message not yet matched
+ *  by a receive are counted and reported by the mpiuse logs.
+ */
+
+/* Config parameters. */
+#include <config.h>
+
+/* Standard headers. */
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* MPI headers. */
+#ifdef WITH_MPI
+#include <mpi.h>
+#endif
+
+/* This object's header. */
+#include "mpi_progress.h"
+
+/* Local headers. */
+#include "error.h"
+#include "task.h"
+
+/*! Is there a thread driving the MPI progress? */
+int mpi_progress_thread = 0;
+
+#ifdef WITH_MPI
+
+/*! The progress thread. */
+static pthread_t mpi_progress_pthread;
+
+/*! Lock and condition to sleep on between the launches. */
+static pthread_mutex_t mpi_progress_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mpi_progress_cond = PTHREAD_COND_INITIALIZER;
+
+/*! Are we in an engine_launch, or shutting down? */
+static volatile int mpi_progress_active = 0;
+static volatile int mpi_progress_done = 0;
+
+/*! Pause between the probes. */
+static struct timespec mpi_progress_pause;
+
+/*! Number of probes and of those that found an unmatched message. */
+static volatile size_t mpi_progress_polls = 0;
+static volatile size_t mpi_progress_pending = 0;
+
+/**
+ * @brief The progress thread, probes while the tasks run and sleeps
+ *        otherwise.
+ */
+static void *mpi_progress_main(void *data) {
+
+  int comm = 0;
+  while (1) {
+
+    /* Wait for a launch. */
+    pthread_mutex_lock(&mpi_progress_mutex);
+    while (!mpi_progress_active && !mpi_progress_done)
+      pthread_cond_wait(&mpi_progress_cond, &mpi_progress_mutex);
+    pthread_mutex_unlock(&mpi_progress_mutex);
+    if (mpi_progress_done) break;
+
+    while (mpi_progress_active) {
+
+      int flag = 0;
+      if (MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, subtaskMPI_comms[comm], &flag,
+                     MPI_STATUS_IGNORE) != MPI_SUCCESS)
+        error("Failed to probe for MPI messages.");
+      mpi_progress_polls++;
+      if (flag) mpi_progress_pending++;
+      comm = (comm + 1) % task_subtype_count;
+
+      if (mpi_progress_pause.tv_nsec > 0) nanosleep(&mpi_progress_pause, NULL);
+    }
+  }
+  return NULL;
+}
+
+#endif /* WITH_MPI */
+
+/**
+ * @brief Start the thread driving the MPI progress, if wanted.
+ *
+ * @param active Do we want a progress thread?
+ * @param interval_us Pause between the probes in micro-seconds.
+ * @param nr_nodes The number of nodes.
+ */
+void mpi_progress_init(const int active, const float interval_us,
+                       const int nr_nodes) {
+
+#ifdef WITH_MPI
+  mpi_progress_thread = active && nr_nodes > 1;
+  if (!mpi_progress_thread) return;
+
+  if (interval_us < 0.f)
+    error("Scheduler:mpi_progress_interval_us should be >= 0");
+  const long long interval_ns = (long long)(interval_us * 1000.f);
+  mpi_progress_pause.tv_sec = interval_ns / 1000000000LL;
+  mpi_progress_pause.tv_nsec = interval_ns % 1000000000LL;
+
+  mpi_progress_active = 0;
+  mpi_progress_done = 0;
+  if (pthread_create(&mpi_progress_pthread, NULL, &mpi_progress_main, NULL) !=
+      0)
+    error("Failed to create the MPI progress thread.");
+#else
+  mpi_progress_thread = 0;
+#endif
+}
+
+/**
+ * @brief Stop the progress thread.
+ */
+void mpi_progress_clean(void) {
+
+#ifdef WITH_MPI
+  if (!mpi_progress_thread) return;
+
+  pthread_mutex_lock(&mpi_progress_mutex);
+  mpi_progress_active = 0;
+  mpi_progress_done = 1;
+  pthread_cond_broadcast(&mpi_progress_cond);
+  pthread_mutex_unlock(&mpi_progress_mutex);
+  if (pthread_join(mpi_progress_pthread, NULL) != 0)
+    error("Failed to join the MPI progress thread.");
+  mpi_progress_thread = 0;
+#endif
+}
+
+/**
+ * @brief Let the progress thread probe, called as the tasks start.
+ */
+void mpi_progress_start(void) {
+
+#ifdef WITH_MPI
+  if (!mpi_progress_thread) return;
+
+  pthread_mutex_lock(&mpi_progress_mutex);
+  mpi_progress_active = 1;
+  pthread_cond_broadcast(&mpi_progress_cond);
+  pthread_mutex_unlock(&mpi_progress_mutex);
+#endif
+}
+
+/**
+ * @brief Send the progress thread back to sleep, called once the tasks are
+ *        done.
+ */
+void mpi_progress_stop(void) {
+
+#ifdef WITH_MPI
+  if (!mpi_progress_thread) return;
+  mpi_progress_active = 0;
+#endif
+}
+
+/**
+ * @brief The number of probes made and of those that found a message not
+ *        yet matched by a receive.
+ *
+ * @param polls The number of probes.
+ * @param pending The number of probes that found an unmatched message.
+ * @param reset Start counting again.
+ */
+void mpi_progress_get_stats(size_t *polls, size_t *pending, const int reset) {
+
+#ifdef WITH_MPI
+  *polls = mpi_progress_polls;
+  *pending = mpi_progress_pending;
+  if (reset) {
+    mpi_progress_polls = 0;
+    mpi_progress_pending = 0;
+  }
+#else
+  *polls = 0;
+  *pending = 0;
+#endif
+}
@@ -0,0 +1,38 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#ifndef SWIFT_MPI_PROGRESS_H
+#define SWIFT_MPI_PROGRESS_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* Standard headers. */
+#include <stddef.h>
+
+/*! Is there a thread driving the MPI progress? */
+extern int mpi_progress_thread;
+
+/* Function prototypes. */
+void mpi_progress_init(const int active, const float interval_us,
+                       const int nr_nodes);
+void mpi_progress_clean(void);
+void mpi_progress_start(void);
+void mpi_progress_stop(void);
+void mpi_progress_get_stats(size_t *polls, size_t *pending, const int reset);
+
+#endif /* SWIFT_MPI_PROGRESS_H */
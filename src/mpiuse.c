@@ -42,6 +42,7 @@
 #include "engine.h"
 #include "error.h"
 #include "memuse_rnodes.h"
+#include "mpi_progress.h"
 
 /* The initial size and increment of the log entries buffer. */
 #define MPIUSE_INITLOG 1000000
@@ -218,6 +219,11 @@ void mpiuse_log_dump(const char *filename, ticks stepticks) {
   size_t mpiuse_max = 0;
   double mpiuse_sum = 0;
   size_t mpiuse_actcount = 0;
+
+  /* Time the sends and recvs waited for their handoff. */
+  size_t stall_count[2] = {0, 0};
+  ticks stall_sum[2] = {0, 0};
+  ticks stall_max[2] = {0, 0};
   for (size_t k = 0; k < log_count; k++) {
 
     /* Check if this address has already been recorded. */
@@ -249,6 +255,11 @@ void mpiuse_log_dump(const char *filename, ticks stepticks) {
 
       /* Time taken to handoff. */
       mpiuse_log[k].acttic = mpiuse_log[k].tic - oldlog->tic;
+      const int isrecv = (mpiuse_log[k].type == task_type_recv);
+      stall_count[isrecv]++;
+      stall_sum[isrecv] += mpiuse_log[k].acttic;
+      if (mpiuse_log[k].acttic > stall_max[isrecv])
+        stall_max[isrecv] = mpiuse_log[k].acttic;
 
       /* And deactivate this key. */
       child->value = -1;
@@ -325,6 +336,21 @@ void mpiuse_log_dump(const char *filename, ticks stepticks) {
   fprintf(fd, "## Sum of all requests: %.4f (MB)\n", mpiuse_sum / MEGABYTE);
   fprintf(fd, "## Mean of all requests: %.4f (MB)\n",
           mpiuse_sum / (double)mpiuse_actcount / MEGABYTE);
+  const char *stall_names[2] = {"send", "recv"};
+  for (int k = 0; k < 2; k++) {
+    if (stall_count[k] == 0) continue;
+    fprintf(fd, "## Mean %s handoff time: %.4f (%s)\n", stall_names[k],
+            clocks_from_ticks(stall_sum[k] / stall_count[k]),
+            clocks_getunit());
+    fprintf(fd, "## Maximum %s handoff time: %.4f (%s)\n", stall_names[k],
+            clocks_from_ticks(stall_max[k]), clocks_getunit());
+  }
+  if (mpi_progress_thread) {
+    size_t polls, pending;
+    mpi_progress_get_stats(&polls, &pending, /*reset=*/1);
+    fprintf(fd, "## Progress thread probes: %zd (%zd found unmatched)\n",
+            polls, pending);
+  }
   fprintf(fd, "##\n");
 
   /* Now check any still active logs, these are errors all should match. */
@@ -53,6 +53,7 @@ __attribute__((nonnull)) INLINE static void gravity_reset(
 
   bzero(m, sizeof(struct gravity_tensors));
   m->m_pole.min_old_a_grav_norm = FLT_MAX;
+  m->m_pole.min_mass = FLT_MAX;
 }
 
 /**
@@ -287,6 +288,7 @@ __attribute__((nonnull)) INLINE static void gravity_multipole_init(
 
   bzero(m, sizeof(struct multipole));
   m->min_old_a_grav_norm = FLT_MAX;
+  m->min_mass = FLT_MAX;
 }
 
 /**
@@ -359,6 +361,9 @@ __attribute__((nonnull)) INLINE static void gravity_multipole_add(
   ma->min_old_a_grav_norm =
       min(ma->min_old_a_grav_norm, mb->min_old_a_grav_norm);
 
+  /* Minimum of both particle masses */
+  ma->min_mass = min(ma->min_mass, mb->min_mass);
+
   /* Add 0th order term */
   ma->M_000 += mb->M_000;
 
@@ -998,6 +1003,7 @@ __attribute__((nonnull)) INLINE static void gravity_P2M(
   /* Temporary variables */
   float epsilon_max = 0.f;
   float min_old_a_grav_norm = FLT_MAX;
+  float min_mass = FLT_MAX;
   double mass = 0.0;
   double com[3] = {0.0, 0.0, 0.0};
   double vel[3] = {0.f, 0.f, 0.f};
@@ -1018,6 +1024,7 @@ __attribute__((nonnull)) INLINE static void gravity_P2M(
 
     epsilon_max = max(epsilon_max, epsilon);
     min_old_a_grav_norm = min(min_old_a_grav_norm, gparts[k].old_a_grav_norm);
+    min_mass = min(min_mass, gparts[k].mass);
     mass += m;
     com[0] += gparts[k].x[0] * m;
     com[1] += gparts[k].x[1] * m;
@@ -1181,6 +1188,7 @@ __attribute__((nonnull)) INLINE static void gravity_P2M(
   multi->CoM[2] = com[2];
   multi->m_pole.max_softening = epsilon_max;
   multi->m_pole.min_old_a_grav_norm = min_old_a_grav_norm;
+  multi->m_pole.min_mass = min_mass;
   multi->m_pole.vel[0] = vel[0];
   multi->m_pole.vel[1] = vel[1];
   multi->m_pole.vel[2] = vel[2];
@@ -1296,6 +1304,9 @@ __attribute__((nonnull)) INLINE static void gravity_M2M(
   /* "shift" the minimal acceleration */
   m_a->min_old_a_grav_norm = m_b->min_old_a_grav_norm;
 
+  /* "shift" the minimal mass */
+  m_a->min_mass = m_b->min_mass;
+
   /* Shift 0th order term */
   m_a->M_000 = m_b->M_000;
 
@@ -1602,15 +1613,17 @@ __attribute__((nonnull)) INLINE static void gravity_M2M(
 /**
  * @brief Compute the field tensors due to a multipole.
  *
- * Corresponds to equation (28b).
+ * Corresponds to equation (28b), truncated at a given order.
  *
  * @param l_b The field tensor to compute.
  * @param m_a The multipole creating the field.
  * @param pot The derivatives of the potential.
+ * @param order The order up to which to expand (at least 1 and at most
+ * SELF_GRAVITY_MULTIPOLE_ORDER).
  */
-__attribute__((nonnull)) INLINE static void gravity_M2L_apply(
+__attribute__((nonnull)) INLINE static void gravity_M2L_apply_order(
     struct grav_tensor *restrict l_b, const struct multipole *restrict m_a,
-    const struct potential_derivatives_M2L *pot) {
+    const struct potential_derivatives_M2L *pot, const int order) {
 
 #ifdef SWIFT_DEBUG_CHECKS
   /* Count all interactions
@@ -1658,6 +1671,9 @@ __attribute__((nonnull)) INLINE static void gravity_M2L_apply(
   l_b->F_010 += M_000 * D_010;
   l_b->F_001 += M_000 * D_001;
 #endif
+
+  if (order < 2) return;
+
 #if SELF_GRAVITY_MULTIPOLE_ORDER > 1
 
   const float M_200 = m_a->M_200;
@@ -1691,6 +1707,9 @@ __attribute__((nonnull)) INLINE static void gravity_M2L_apply(
   l_b->F_101 += M_000 * D_101;
   l_b->F_011 += M_000 * D_011;
 #endif
+
+  if (order < 3) return;
+
 #if SELF_GRAVITY_MULTIPOLE_ORDER > 2
 
   const float M_300 = m_a->M_300;
@@ -1749,6 +1768,9 @@ __attribute__((nonnull)) INLINE static void gravity_M2L_apply(
   l_b->F_012 += M_000 * D_012;
   l_b->F_111 += M_000 * D_111;
 #endif
+
+  if (order < 4) return;
+
 #if SELF_GRAVITY_MULTIPOLE_ORDER > 3
 
   const float M_400 = m_a->M_400;
@@ -1844,6 +1866,9 @@ __attribute__((nonnull)) INLINE static void gravity_M2L_apply(
   l_b->F_400 += M_000 * D_400;
 
 #endif
+
+  if (order < 5) return;
+
 #if SELF_GRAVITY_MULTIPOLE_ORDER > 4
 
   const float M_500 = m_a->M_500;
@@ -2001,7 +2026,24 @@ __attribute__((nonnull)) INLINE static void gravity_M2L_apply(
 }
 
 /**
- * @brief Compute the field tensor due to a multipole.
+ * @brief Compute the field tensors due to a multipole.
+ *
+ * Corresponds to equation (28b).
+ *
+ * @param l_b The field tensor to compute.
+ * @param m_a The multipole creating the field.
+ * @param pot The derivatives of the potential.
+ */
+__attribute__((nonnull)) INLINE static void gravity_M2L_apply(
+    struct grav_tensor *restrict l_b, const struct multipole *restrict m_a,
+    const struct potential_derivatives_M2L *pot) {
+
+  gravity_M2L_apply_order(l_b, m_a, pot, SELF_GRAVITY_MULTIPOLE_ORDER);
+}
+
+/**
+ * @brief Compute the field tensor due to a multipole, truncating the
+ * expansion at a given order.
  *
  * @param l_b The field tensor to compute.
  * @param m_a The multipole.
@@ -2011,11 +2053,13 @@ __attribute__((nonnull)) INLINE static void gravity_M2L_apply(
  * @param periodic Is the calculation periodic ?
  * @param dim The size of the simulation box.
  * @param rs_inv The inverse of the gravity mesh-smoothing scale.
+ * @param order The order up to which to expand.
  */
-__attribute__((nonnull)) INLINE static void gravity_M2L_nonsym(
+__attribute__((nonnull)) INLINE static void gravity_M2L_nonsym_order(
     struct grav_tensor *l_b, const struct multipole *m_a, const double pos_b[3],
     const double pos_a[3], const struct gravity_props *props,
-    const int periodic, const double dim[3], const float rs_inv) {
+    const int periodic, const double dim[3], const float rs_inv,
+    const int order) {
 
   /* Recover some constants */
   const float eps = m_a->max_softening;
@@ -2038,16 +2082,37 @@ __attribute__((nonnull)) INLINE static void gravity_M2L_nonsym(
 
   /* Compute all derivatives */
   struct potential_derivatives_M2L pot;
-  potential_derivatives_compute_M2L(dx, dy, dz, r2, r_inv, eps, periodic,
-                                    rs_inv, &pot);
+  potential_derivatives_compute_M2L_order(dx, dy, dz, r2, r_inv, eps,
+                                          periodic, rs_inv, order, &pot);
 
   /* Do the M2L tensor multiplication */
-  gravity_M2L_apply(l_b, m_a, &pot);
+  gravity_M2L_apply_order(l_b, m_a, &pot, order);
+}
+
+/**
+ * @brief Compute the field tensor due to a multipole.
+ *
+ * @param l_b The field tensor to compute.
+ * @param m_a The multipole.
+ * @param pos_b The position of the field tensor.
+ * @param pos_a The position of the multipole.
+ * @param props The #gravity_props of this calculation.
+ * @param periodic Is the calculation periodic ?
+ * @param dim The size of the simulation box.
+ * @param rs_inv The inverse of the gravity mesh-smoothing scale.
+ */
+__attribute__((nonnull)) INLINE static void gravity_M2L_nonsym(
+    struct grav_tensor *l_b, const struct multipole *m_a, const double pos_b[3],
+    const double pos_a[3], const struct gravity_props *props,
+    const int periodic, const double dim[3], const float rs_inv) {
+
+  gravity_M2L_nonsym_order(l_b, m_a, pos_b, pos_a, props, periodic, dim, rs_inv,
+                           SELF_GRAVITY_MULTIPOLE_ORDER);
 }
 
 /**
  * @brief Compute the field tensor due to a multipole and the symmetric
- * equivalent.
+ * equivalent, truncating the expansion at a given order.
  *
  * @param l_a The first field tensor to compute.
  * @param l_b The second field tensor to compute.
@@ -2059,13 +2124,14 @@ __attribute__((nonnull)) INLINE static void gravity_M2L_nonsym(
  * @param periodic Is the calculation periodic ?
  * @param dim The size of the simulation box.
  * @param rs_inv The inverse of the gravity mesh-smoothing scale.
+ * @param order The order up to which to expand.
  */
-__attribute__((nonnull)) INLINE static void gravity_M2L_symmetric(
+__attribute__((nonnull)) INLINE static void gravity_M2L_symmetric_order(
     struct grav_tensor *restrict l_a, struct grav_tensor *restrict l_b,
     const struct multipole *restrict m_a, const struct multipole *restrict m_b,
     const double pos_a[3], const double pos_b[3],
     const struct gravity_props *props, const int periodic, const double dim[3],
-    const float rs_inv) {
+    const float rs_inv, const int order) {
 
   /* Recover some constants */
   const float eps = max(m_a->max_softening, m_b->max_softening);
@@ -2088,17 +2154,43 @@ __attribute__((nonnull)) INLINE static void gravity_M2L_symmetric(
 
   /* Compute all derivatives */
   struct potential_derivatives_M2L pot;
-  potential_derivatives_compute_M2L(dx, dy, dz, r2, r_inv, eps, periodic,
-                                    rs_inv, &pot);
+  potential_derivatives_compute_M2L_order(dx, dy, dz, r2, r_inv, eps,
+                                          periodic, rs_inv, order, &pot);
 
   /* Do the first M2L tensor multiplication */
-  gravity_M2L_apply(l_b, m_a, &pot);
+  gravity_M2L_apply_order(l_b, m_a, &pot, order);
 
   /* Flip the signs of odd derivatives */
   potential_derivatives_flip_signs(&pot);
 
   /* Do the second M2L tensor multiplication */
-  gravity_M2L_apply(l_a, m_b, &pot);
+  gravity_M2L_apply_order(l_a, m_b, &pot, order);
+}
+
+/**
+ * @brief Compute the field tensor due to a multipole and the symmetric
+ * equivalent.
+ *
+ * @param l_a The first field tensor to compute.
+ * @param l_b The second field tensor to compute.
+ * @param m_a The first multipole.
+ * @param m_b The second multipole.
+ * @param pos_a The position of the first m-pole and field tensor.
+ * @param pos_b The position of the second m-pole and field tensor.
+ * @param props The #gravity_props of this calculation.
+ * @param periodic Is the calculation periodic ?
+ * @param dim The size of the simulation box.
+ * @param rs_inv The inverse of the gravity mesh-smoothing scale.
+ */
+__attribute__((nonnull)) INLINE static void gravity_M2L_symmetric(
+    struct grav_tensor *restrict l_a, struct grav_tensor *restrict l_b,
+    const struct multipole *restrict m_a, const struct multipole *restrict m_b,
+    const double pos_a[3], const double pos_b[3],
+    const struct gravity_props *props, const int periodic, const double dim[3],
+    const float rs_inv) {
+
+  gravity_M2L_symmetric_order(l_a, l_b, m_a, m_b, pos_a, pos_b, props, periodic,
+                              dim, rs_inv, SELF_GRAVITY_MULTIPOLE_ORDER);
 }
 
 /**
@@ -2875,40 +2967,24 @@ __attribute__((nonnull)) INLINE static void gravity_L2L(
 }
 
 /**
- * @brief Applies the  #grav_tensor to a  #gpart.
+ * @brief Evaluates a #grav_tensor at a given distance from its centre.
  *
- * Corresponds to equation (28a).
+ * Corresponds to equation (28a). This is the arithmetic core shared by
+ * the scalar ( gravity_L2P() ) and batched ( gravity_L2P_soa() ) L2P.
  *
  * @param lb The gravity field tensor to apply.
- * @param loc The position of the gravity field tensor.
- * @param gp The #gpart to update.
+ * @param dx The distance between the particle and the tensor's centre.
+ * @param a_out (return) The acceleration at dx.
+ * @param pot_out (return) The potential at dx.
  */
-__attribute__((nonnull)) INLINE static void gravity_L2P(
-    const struct grav_tensor *lb, const double loc[3], struct gpart *gp) {
-
-#ifdef SWIFT_DEBUG_CHECKS
-  if (gp->time_bin == time_bin_not_created) {
-    error("Extra particle in L2P.");
-  }
-
-  if (lb->num_interacted == 0) error("Interacting with empty field tensor");
-
-  accumulate_add_ll(&gp->num_interacted, lb->num_interacted);
-#endif
-
-#ifdef SWIFT_GRAVITY_FORCE_CHECKS
-  accumulate_add_ll(&gp->num_interacted_m2l, lb->num_interacted_tree);
-  accumulate_add_ll(&gp->num_interacted_pm, lb->num_interacted_pm);
-#endif
+__attribute__((always_inline, nonnull)) INLINE static void gravity_L2P_eval(
+    const struct grav_tensor *lb, const double dx[3], double a_out[3],
+    double *pot_out) {
 
   /* Local accumulator */
   double a_grav[3] = {0., 0., 0.};
   double pot = 0.;
 
-  /* Distance to the multipole */
-  const double dx[3] = {gp->x[0] - loc[0], gp->x[1] - loc[1],
-                        gp->x[2] - loc[2]};
-
   /* 0th order contributions */
   pot -= X_000(dx) * lb->F_000;
 
@@ -3015,6 +3091,39 @@ __attribute__((nonnull)) INLINE static void gravity_L2P(
 #error "Missing implementation for order >5"
 #endif
 
+  a_out[0] = a_grav[0];
+  a_out[1] = a_grav[1];
+  a_out[2] = a_grav[2];
+  *pot_out = pot;
+}
+
+/**
+ * @brief Adds the result of an L2P evaluation to a #gpart.
+ *
+ * @param lb The gravity field tensor that was evaluated.
+ * @param gp The #gpart to update.
+ * @param a_grav The acceleration returned by gravity_L2P_eval().
+ * @param pot The potential returned by gravity_L2P_eval().
+ */
+__attribute__((always_inline, nonnull)) INLINE static void gravity_L2P_update(
+    const struct grav_tensor *lb, struct gpart *gp, const double a_grav[3],
+    const double pot) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (gp->time_bin == time_bin_not_created) {
+    error("Extra particle in L2P.");
+  }
+
+  if (lb->num_interacted == 0) error("Interacting with empty field tensor");
+
+  accumulate_add_ll(&gp->num_interacted, lb->num_interacted);
+#endif
+
+#ifdef SWIFT_GRAVITY_FORCE_CHECKS
+  accumulate_add_ll(&gp->num_interacted_m2l, lb->num_interacted_tree);
+  accumulate_add_ll(&gp->num_interacted_pm, lb->num_interacted_pm);
+#endif
+
   /* Update the particle */
   gp->a_grav[0] += a_grav[0];
   gp->a_grav[1] += a_grav[1];
@@ -3028,4 +3137,68 @@ __attribute__((nonnull)) INLINE static void gravity_L2P(
 #endif
 }
 
+/**
+ * @brief Applies the  #grav_tensor to a  #gpart.
+ *
+ * Corresponds to equation (28a).
+ *
+ * @param lb The gravity field tensor to apply.
+ * @param loc The position of the gravity field tensor.
+ * @param gp The #gpart to update.
+ */
+__attribute__((nonnull)) INLINE static void gravity_L2P(
+    const struct grav_tensor *lb, const double loc[3], struct gpart *gp) {
+
+  /* Distance to the multipole */
+  const double dx[3] = {gp->x[0] - loc[0], gp->x[1] - loc[1],
+                        gp->x[2] - loc[2]};
+
+  double a_grav[3], pot;
+  gravity_L2P_eval(lb, dx, a_grav, &pot);
+
+  gravity_L2P_update(lb, gp, a_grav, pot);
+}
+
+/**
+ * @brief Evaluates a #grav_tensor at a batch of positions stored as SoA.
+ *
+ * The tensor is the same for every lane so its coefficients are loaded
+ * once and the loop over the positions vectorizes. The results are
+ * returned rather than applied; the caller scatters them to the #gpart
+ * with gravity_L2P_update().
+ *
+ * @param lb The gravity field tensor to apply.
+ * @param loc The position of the gravity field tensor.
+ * @param count The number of positions.
+ * @param x The x coordinates of the positions.
+ * @param y The y coordinates of the positions.
+ * @param z The z coordinates of the positions.
+ * @param a_x (return) The x component of the accelerations.
+ * @param a_y (return) The y component of the accelerations.
+ * @param a_z (return) The z component of the accelerations.
+ * @param pot (return) The potentials.
+ */
+__attribute__((nonnull)) INLINE static void gravity_L2P_soa(
+    const struct grav_tensor *lb, const double loc[3], const int count,
+    const double *restrict x, const double *restrict y,
+    const double *restrict z, double *restrict a_x, double *restrict a_y,
+    double *restrict a_z, double *restrict pot) {
+
+#if !defined(SWIFT_DEBUG_CHECKS) && _OPENMP >= 201307
+#pragma omp simd
+#endif
+  for (int i = 0; i < count; ++i) {
+
+    const double dx[3] = {x[i] - loc[0], y[i] - loc[1], z[i] - loc[2]};
+
+    double a_grav[3], p;
+    gravity_L2P_eval(lb, dx, a_grav, &p);
+
+    a_x[i] = a_grav[0];
+    a_y[i] = a_grav[1];
+    a_z[i] = a_grav[2];
+    pot[i] = p;
+  }
+}
+
 #endif /* SWIFT_MULTIPOLE_H */
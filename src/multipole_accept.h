@@ -182,12 +182,59 @@ __attribute__((nonnull, pure)) INLINE static int gravity_M2L_accept(
   }
 }
 
+/**
+ * @brief Checks whether the multipoles of A and B are far enough apart to be
+ * used for each other whatever their accuracy, as one of them only contains
+ * background particles.
+ *
+ * The two multipoles must not overlap once grown by the buffer distance and,
+ * as for the regular criterion, not be below softening.
+ *
+ * @param props The properties of the gravity scheme.
+ * @param A The first set of multipole and gravity tensors.
+ * @param B The second set of multipole and gravity tensors.
+ * @param r2 The square of the distance between the centres of mass of A and B.
+ * @param use_rebuild_sizes Are we considering the sizes at the last tree-build
+ * (1) or current sizes (0)?
+ */
+__attribute__((nonnull, pure)) INLINE static int gravity_M2L_accept_background(
+    const struct gravity_props *props, const struct gravity_tensors *restrict A,
+    const struct gravity_tensors *restrict B, const float r2,
+    const int use_rebuild_sizes) {
+
+  /* Is any of the two made of background particles only? */
+  const float threshold = props->background_mass_threshold;
+  if (threshold <= 0.f) return 0;
+  if (A->m_pole.min_mass < threshold && B->m_pole.min_mass < threshold)
+    return 0;
+
+  /* Sizes of the multipoles */
+  const float rho_A = use_rebuild_sizes ? A->r_max_rebuild : A->r_max;
+  const float rho_B = use_rebuild_sizes ? B->r_max_rebuild : B->r_max;
+
+  /* Get the softening */
+  const float max_softening =
+      max(A->m_pole.max_softening, B->m_pole.max_softening);
+
+  /* Condition 1: We are beyond the buffer */
+  const float r_min = rho_A + rho_B + props->background_buffer_distance;
+  const int cond_1 = r_min * r_min < r2;
+
+  /* Condition 2: We are not below softening */
+  const int cond_2 =
+      props->use_tree_below_softening || max_softening * max_softening < r2;
+
+  return cond_1 && cond_2;
+}
+
 /**
  * @brief Checks whether The multipole in B can be used to update the field
  * tensor in A and whether the multipole in A can be used to update the field
  * tensor in B.
  *
- * We use the MAC of Dehnen 2014 eq. 16.
+ * We use the MAC of Dehnen 2014 eq. 16, unless one of the two is made of
+ * background particles only and far enough (see
+ * gravity_M2L_accept_background()).
  *
  * @param props The properties of the gravity scheme.
  * @param A The first set of multipole and gravity tensors.
@@ -202,10 +249,97 @@ __attribute__((nonnull, pure)) INLINE static int gravity_M2L_accept_symmetric(
     const struct gravity_tensors *restrict B, const float r2,
     const int use_rebuild_sizes, const int periodic) {
 
+  if (gravity_M2L_accept_background(props, A, B, r2, use_rebuild_sizes))
+    return 1;
+
   return gravity_M2L_accept(props, A, B, r2, use_rebuild_sizes, periodic) &&
          gravity_M2L_accept(props, B, A, r2, use_rebuild_sizes, periodic);
 }
 
+/**
+ * @brief Lowest order at which the M2L interaction of the multipole in B with
+ * the field tensor in A is accurate enough.
+ *
+ * We use the error estimator of Dehnen 2014 eq. 16, as the adaptive MAC does,
+ * but for a truncation of the expansion at each order p in turn. The powers
+ * of the multipole of B give the size of the discarded terms. This is only
+ * done with the adaptive MACs and a non-zero tolerance, otherwise the full
+ * order is used.
+ *
+ * @param props The properties of the gravity scheme.
+ * @param A The gravity tensors that we want to update (sink).
+ * @param B The gravity tensors that act as a source.
+ * @param r2 The square of the distance between the centres of mass of A and B.
+ * @param periodic Are we using periodic BCs?
+ * @return The order, between 1 and SELF_GRAVITY_MULTIPOLE_ORDER.
+ */
+__attribute__((nonnull, pure)) INLINE static int gravity_M2L_order(
+    const struct gravity_props *props, const struct gravity_tensors *restrict A,
+    const struct gravity_tensors *restrict B, const float r2,
+    const int periodic) {
+
+  const float eps = props->adaptive_order_tolerance;
+  const float min_a_grav = A->m_pole.min_old_a_grav_norm;
+  if (!props->use_advanced_MAC || eps == 0.f || min_a_grav == 0.f)
+    return SELF_GRAVITY_MULTIPOLE_ORDER;
+
+  /* Sizes of the multipoles */
+  const float rho_A = A->r_max;
+  const float rho_B = B->r_max;
+  const float rho_max = max(rho_A, rho_B);
+  const float rho_ratio =
+      (rho_A + rho_B > 0.f) ? rho_max / (rho_A + rho_B) : 1.f;
+
+  float f_MAC_inv;
+  if (periodic && props->consider_truncation_in_MAC) {
+    const float max_softening =
+        max(A->m_pole.max_softening, B->m_pole.max_softening);
+    f_MAC_inv = gravity_f_MAC_inverse(max_softening, props->r_s_inv, r2);
+  } else {
+    f_MAC_inv = r2;
+  }
+
+  /* Accuracy we are after */
+  const float a_tol = eps * min_a_grav * f_MAC_inv;
+  const float r = sqrtf(r2);
+
+  for (int p = 1; p < SELF_GRAVITY_MULTIPOLE_ORDER; ++p) {
+
+    /* Error estimator of the expansion truncated at order p
+     * (without the 1/M_B term that cancels out) */
+    float E_BA_term = 0.f;
+    for (int n = 0; n <= p; ++n) {
+      E_BA_term +=
+          binomial(p, n) * B->m_pole.power[n] * integer_powf(rho_A, p - n);
+    }
+    E_BA_term *= 8.f * rho_ratio;
+
+    /* E_BA * (1 / r^(p)) * ((1 / r^2) * W) < eps * a_min */
+    if (E_BA_term < a_tol * integer_powf(r, p)) return p;
+  }
+
+  return SELF_GRAVITY_MULTIPOLE_ORDER;
+}
+
+/**
+ * @brief Lowest order at which the M2L interactions between the multipoles
+ * in A and B are accurate enough in both directions.
+ *
+ * @param props The properties of the gravity scheme.
+ * @param A The first set of multipole and gravity tensors.
+ * @param B The second set of multipole and gravity tensors.
+ * @param r2 The square of the distance between the centres of mass of A and B.
+ * @param periodic Are we using periodic BCs?
+ */
+__attribute__((nonnull, pure)) INLINE static int gravity_M2L_order_symmetric(
+    const struct gravity_props *props, const struct gravity_tensors *restrict A,
+    const struct gravity_tensors *restrict B, const float r2,
+    const int periodic) {
+
+  return max(gravity_M2L_order(props, A, B, r2, periodic),
+             gravity_M2L_order(props, B, A, r2, periodic));
+}
+
 /**
  * Compute the distance above which an M2L kernel is allowed to be used.
  *
@@ -276,20 +410,24 @@ gravity_M2L_min_accept_distance(
 }
 
 /**
- * @brief Checks whether The multipole in B can be used to update the particle
- * pa
+ * @brief Checks whether The multipole in B can be used to update a particle
+ * of given softening and acceleration of the last step.
  *
  * We use the MAC of Dehnen 2014 eq. 16.
  *
  * @param props The properties of the gravity scheme.
- * @param pa The particle we want to compute forces for (sink)
+ * @param epsilon_a The softening of the particle (sink).
+ * @param old_a_grav The norm of the acceleration of the particle at the last
+ * step.
  * @param B The gravity tensors that act as a source.
- * @param r2 The square of the distance between pa and the centres of mass of B.
+ * @param r2 The square of the distance between the particle and the centres
+ * of mass of B.
  * @param periodic Are we using periodic BCs?
  */
-__attribute__((nonnull, pure)) INLINE static int gravity_M2P_accept(
-    const struct gravity_props *props, const struct gpart *pa,
-    const struct gravity_tensors *B, const float r2, const int periodic) {
+__attribute__((nonnull, pure)) INLINE static int gravity_M2P_accept_values(
+    const struct gravity_props *props, const float epsilon_a,
+    const float old_a_grav, const struct gravity_tensors *B, const float r2,
+    const int periodic) {
 
   /* Order of the expansion */
   const int p = 2;
@@ -298,8 +436,7 @@ __attribute__((nonnull, pure)) INLINE static int gravity_M2P_accept(
   const float rho_B = B->r_max;
 
   /* Get the maximal softening */
-  const float max_softening =
-      max(B->m_pole.max_softening, gravity_get_softening(pa, props));
+  const float max_softening = max(B->m_pole.max_softening, epsilon_a);
 
 #ifdef SWIFT_DEBUG_CHECKS
   if (rho_B == 0.) error("Size of multipole B is 0!");
@@ -318,9 +455,6 @@ __attribute__((nonnull, pure)) INLINE static int gravity_M2P_accept(
     f_MAC_inv = r2;
   }
 
-  /* Get the estimate of the acceleration */
-  const float old_a_grav = pa->old_a_grav_norm;
-
   /* Get the relative tolerance */
   const float eps = props->adaptive_tolerance;
 
@@ -374,4 +508,24 @@ __attribute__((nonnull, pure)) INLINE static int gravity_M2P_accept(
   }
 }
 
+/**
+ * @brief Checks whether The multipole in B can be used to update the particle
+ * pa
+ *
+ * We use the MAC of Dehnen 2014 eq. 16.
+ *
+ * @param props The properties of the gravity scheme.
+ * @param pa The particle we want to compute forces for (sink)
+ * @param B The gravity tensors that act as a source.
+ * @param r2 The square of the distance between pa and the centres of mass of B.
+ * @param periodic Are we using periodic BCs?
+ */
+__attribute__((nonnull, pure)) INLINE static int gravity_M2P_accept(
+    const struct gravity_props *props, const struct gpart *pa,
+    const struct gravity_tensors *B, const float r2, const int periodic) {
+
+  return gravity_M2P_accept_values(props, gravity_get_softening(pa, props),
+                                   pa->old_a_grav_norm, B, r2, periodic);
+}
+
 #endif /* SWIFT_MULTIPOLE_ACCEPT_H */
@@ -0,0 +1,1031 @@
+#ifndef SWIFT_MULTIPOLE_BATCH_H
+#define SWIFT_MULTIPOLE_BATCH_H
+
+/**
+ * @file multipole_batch.h
+ * @brief Batched (SoA) version of the M2L kernel.
+ *
+ * The multipoles, derivatives and field tensors of #MULTIPOLE_BATCH_SIZE
+ * interactions are stored term by term such that the tensor multiplications
+ * of all the interactions of a batch are done with the same vector
+ * instructions. gravity_M2L_apply() remains the reference: the operations
+ * done on every lane are the same.
+ */
+
+/* Config parameters. */
+#include <config.h>
+
+/* Some standard headers. */
+#include <string.h>
+
+/* Includes. */
+#include "align.h"
+#include "gravity_derivatives.h"
+#include "inline.h"
+#include "multipole_struct.h"
+
+/*! Number of M2L interactions done in one go (one AVX-512 vector) */
+#define MULTIPOLE_BATCH_SIZE 16
+
+/**
+ * @brief The multipoles of a batch of interactions.
+ */
+struct multipole_batch {
+
+  /* 0th order terms */
+  float M_000[MULTIPOLE_BATCH_SIZE];
+
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+
+  /* 2nd order terms */
+  float M_200[MULTIPOLE_BATCH_SIZE];
+  float M_020[MULTIPOLE_BATCH_SIZE];
+  float M_002[MULTIPOLE_BATCH_SIZE];
+  float M_110[MULTIPOLE_BATCH_SIZE];
+  float M_101[MULTIPOLE_BATCH_SIZE];
+  float M_011[MULTIPOLE_BATCH_SIZE];
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 2
+
+  /* 3rd order terms */
+  float M_300[MULTIPOLE_BATCH_SIZE];
+  float M_030[MULTIPOLE_BATCH_SIZE];
+  float M_003[MULTIPOLE_BATCH_SIZE];
+  float M_210[MULTIPOLE_BATCH_SIZE];
+  float M_201[MULTIPOLE_BATCH_SIZE];
+  float M_120[MULTIPOLE_BATCH_SIZE];
+  float M_021[MULTIPOLE_BATCH_SIZE];
+  float M_102[MULTIPOLE_BATCH_SIZE];
+  float M_012[MULTIPOLE_BATCH_SIZE];
+  float M_111[MULTIPOLE_BATCH_SIZE];
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 3
+
+  /* 4th order terms */
+  float M_400[MULTIPOLE_BATCH_SIZE];
+  float M_040[MULTIPOLE_BATCH_SIZE];
+  float M_004[MULTIPOLE_BATCH_SIZE];
+  float M_310[MULTIPOLE_BATCH_SIZE];
+  float M_301[MULTIPOLE_BATCH_SIZE];
+  float M_130[MULTIPOLE_BATCH_SIZE];
+  float M_031[MULTIPOLE_BATCH_SIZE];
+  float M_103[MULTIPOLE_BATCH_SIZE];
+  float M_013[MULTIPOLE_BATCH_SIZE];
+  float M_220[MULTIPOLE_BATCH_SIZE];
+  float M_202[MULTIPOLE_BATCH_SIZE];
+  float M_022[MULTIPOLE_BATCH_SIZE];
+  float M_211[MULTIPOLE_BATCH_SIZE];
+  float M_121[MULTIPOLE_BATCH_SIZE];
+  float M_112[MULTIPOLE_BATCH_SIZE];
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 4
+
+  /* 5th order terms */
+  float M_005[MULTIPOLE_BATCH_SIZE];
+  float M_014[MULTIPOLE_BATCH_SIZE];
+  float M_023[MULTIPOLE_BATCH_SIZE];
+  float M_032[MULTIPOLE_BATCH_SIZE];
+  float M_041[MULTIPOLE_BATCH_SIZE];
+  float M_050[MULTIPOLE_BATCH_SIZE];
+  float M_104[MULTIPOLE_BATCH_SIZE];
+  float M_113[MULTIPOLE_BATCH_SIZE];
+  float M_122[MULTIPOLE_BATCH_SIZE];
+  float M_131[MULTIPOLE_BATCH_SIZE];
+  float M_140[MULTIPOLE_BATCH_SIZE];
+  float M_203[MULTIPOLE_BATCH_SIZE];
+  float M_212[MULTIPOLE_BATCH_SIZE];
+  float M_221[MULTIPOLE_BATCH_SIZE];
+  float M_230[MULTIPOLE_BATCH_SIZE];
+  float M_302[MULTIPOLE_BATCH_SIZE];
+  float M_311[MULTIPOLE_BATCH_SIZE];
+  float M_320[MULTIPOLE_BATCH_SIZE];
+  float M_401[MULTIPOLE_BATCH_SIZE];
+  float M_410[MULTIPOLE_BATCH_SIZE];
+  float M_500[MULTIPOLE_BATCH_SIZE];
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 5
+#error "Missing implementation for order >5"
+#endif
+} SWIFT_CACHE_ALIGN;
+
+/**
+ * @brief The derivatives of the potential of a batch of interactions.
+ */
+struct potential_derivatives_M2L_batch {
+
+  /* 0th order terms */
+  float D_000[MULTIPOLE_BATCH_SIZE];
+
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 0
+
+  /* 1st order terms */
+  float D_100[MULTIPOLE_BATCH_SIZE];
+  float D_010[MULTIPOLE_BATCH_SIZE];
+  float D_001[MULTIPOLE_BATCH_SIZE];
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+
+  /* 2nd order terms */
+  float D_200[MULTIPOLE_BATCH_SIZE];
+  float D_020[MULTIPOLE_BATCH_SIZE];
+  float D_002[MULTIPOLE_BATCH_SIZE];
+  float D_110[MULTIPOLE_BATCH_SIZE];
+  float D_101[MULTIPOLE_BATCH_SIZE];
+  float D_011[MULTIPOLE_BATCH_SIZE];
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 2
+
+  /* 3rd order terms */
+  float D_300[MULTIPOLE_BATCH_SIZE];
+  float D_030[MULTIPOLE_BATCH_SIZE];
+  float D_003[MULTIPOLE_BATCH_SIZE];
+  float D_210[MULTIPOLE_BATCH_SIZE];
+  float D_201[MULTIPOLE_BATCH_SIZE];
+  float D_120[MULTIPOLE_BATCH_SIZE];
+  float D_021[MULTIPOLE_BATCH_SIZE];
+  float D_102[MULTIPOLE_BATCH_SIZE];
+  float D_012[MULTIPOLE_BATCH_SIZE];
+  float D_111[MULTIPOLE_BATCH_SIZE];
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 3
+
+  /* 4th order terms */
+  float D_400[MULTIPOLE_BATCH_SIZE];
+  float D_040[MULTIPOLE_BATCH_SIZE];
+  float D_004[MULTIPOLE_BATCH_SIZE];
+  float D_310[MULTIPOLE_BATCH_SIZE];
+  float D_301[MULTIPOLE_BATCH_SIZE];
+  float D_130[MULTIPOLE_BATCH_SIZE];
+  float D_031[MULTIPOLE_BATCH_SIZE];
+  float D_103[MULTIPOLE_BATCH_SIZE];
+  float D_013[MULTIPOLE_BATCH_SIZE];
+  float D_220[MULTIPOLE_BATCH_SIZE];
+  float D_202[MULTIPOLE_BATCH_SIZE];
+  float D_022[MULTIPOLE_BATCH_SIZE];
+  float D_211[MULTIPOLE_BATCH_SIZE];
+  float D_121[MULTIPOLE_BATCH_SIZE];
+  float D_112[MULTIPOLE_BATCH_SIZE];
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 4
+
+  /* 5th order terms */
+  float D_005[MULTIPOLE_BATCH_SIZE];
+  float D_014[MULTIPOLE_BATCH_SIZE];
+  float D_023[MULTIPOLE_BATCH_SIZE];
+  float D_032[MULTIPOLE_BATCH_SIZE];
+  float D_041[MULTIPOLE_BATCH_SIZE];
+  float D_050[MULTIPOLE_BATCH_SIZE];
+  float D_104[MULTIPOLE_BATCH_SIZE];
+  float D_113[MULTIPOLE_BATCH_SIZE];
+  float D_122[MULTIPOLE_BATCH_SIZE];
+  float D_131[MULTIPOLE_BATCH_SIZE];
+  float D_140[MULTIPOLE_BATCH_SIZE];
+  float D_203[MULTIPOLE_BATCH_SIZE];
+  float D_212[MULTIPOLE_BATCH_SIZE];
+  float D_221[MULTIPOLE_BATCH_SIZE];
+  float D_230[MULTIPOLE_BATCH_SIZE];
+  float D_302[MULTIPOLE_BATCH_SIZE];
+  float D_311[MULTIPOLE_BATCH_SIZE];
+  float D_320[MULTIPOLE_BATCH_SIZE];
+  float D_401[MULTIPOLE_BATCH_SIZE];
+  float D_410[MULTIPOLE_BATCH_SIZE];
+  float D_500[MULTIPOLE_BATCH_SIZE];
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 5
+#error "Missing implementation for order >5"
+#endif
+} SWIFT_CACHE_ALIGN;
+
+/**
+ * @brief The field tensors of a batch of interactions.
+ */
+struct grav_tensor_batch {
+
+  /* 0th order terms */
+  float F_000[MULTIPOLE_BATCH_SIZE];
+
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 0
+
+  /* 1st order terms */
+  float F_100[MULTIPOLE_BATCH_SIZE];
+  float F_010[MULTIPOLE_BATCH_SIZE];
+  float F_001[MULTIPOLE_BATCH_SIZE];
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+
+  /* 2nd order terms */
+  float F_200[MULTIPOLE_BATCH_SIZE];
+  float F_020[MULTIPOLE_BATCH_SIZE];
+  float F_002[MULTIPOLE_BATCH_SIZE];
+  float F_110[MULTIPOLE_BATCH_SIZE];
+  float F_101[MULTIPOLE_BATCH_SIZE];
+  float F_011[MULTIPOLE_BATCH_SIZE];
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 2
+
+  /* 3rd order terms */
+  float F_300[MULTIPOLE_BATCH_SIZE];
+  float F_030[MULTIPOLE_BATCH_SIZE];
+  float F_003[MULTIPOLE_BATCH_SIZE];
+  float F_210[MULTIPOLE_BATCH_SIZE];
+  float F_201[MULTIPOLE_BATCH_SIZE];
+  float F_120[MULTIPOLE_BATCH_SIZE];
+  float F_021[MULTIPOLE_BATCH_SIZE];
+  float F_102[MULTIPOLE_BATCH_SIZE];
+  float F_012[MULTIPOLE_BATCH_SIZE];
+  float F_111[MULTIPOLE_BATCH_SIZE];
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 3
+
+  /* 4th order terms */
+  float F_400[MULTIPOLE_BATCH_SIZE];
+  float F_040[MULTIPOLE_BATCH_SIZE];
+  float F_004[MULTIPOLE_BATCH_SIZE];
+  float F_310[MULTIPOLE_BATCH_SIZE];
+  float F_301[MULTIPOLE_BATCH_SIZE];
+  float F_130[MULTIPOLE_BATCH_SIZE];
+  float F_031[MULTIPOLE_BATCH_SIZE];
+  float F_103[MULTIPOLE_BATCH_SIZE];
+  float F_013[MULTIPOLE_BATCH_SIZE];
+  float F_220[MULTIPOLE_BATCH_SIZE];
+  float F_202[MULTIPOLE_BATCH_SIZE];
+  float F_022[MULTIPOLE_BATCH_SIZE];
+  float F_211[MULTIPOLE_BATCH_SIZE];
+  float F_121[MULTIPOLE_BATCH_SIZE];
+  float F_112[MULTIPOLE_BATCH_SIZE];
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 4
+
+  /* 5th order terms */
+  float F_005[MULTIPOLE_BATCH_SIZE];
+  float F_014[MULTIPOLE_BATCH_SIZE];
+  float F_023[MULTIPOLE_BATCH_SIZE];
+  float F_032[MULTIPOLE_BATCH_SIZE];
+  float F_041[MULTIPOLE_BATCH_SIZE];
+  float F_050[MULTIPOLE_BATCH_SIZE];
+  float F_104[MULTIPOLE_BATCH_SIZE];
+  float F_113[MULTIPOLE_BATCH_SIZE];
+  float F_122[MULTIPOLE_BATCH_SIZE];
+  float F_131[MULTIPOLE_BATCH_SIZE];
+  float F_140[MULTIPOLE_BATCH_SIZE];
+  float F_203[MULTIPOLE_BATCH_SIZE];
+  float F_212[MULTIPOLE_BATCH_SIZE];
+  float F_221[MULTIPOLE_BATCH_SIZE];
+  float F_230[MULTIPOLE_BATCH_SIZE];
+  float F_302[MULTIPOLE_BATCH_SIZE];
+  float F_311[MULTIPOLE_BATCH_SIZE];
+  float F_320[MULTIPOLE_BATCH_SIZE];
+  float F_401[MULTIPOLE_BATCH_SIZE];
+  float F_410[MULTIPOLE_BATCH_SIZE];
+  float F_500[MULTIPOLE_BATCH_SIZE];
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 5
+#error "Missing implementation for order >5"
+#endif
+} SWIFT_CACHE_ALIGN;
+
+/**
+ * @brief Copy a #multipole into one lane of a #multipole_batch.
+ *
+ * @param mb The #multipole_batch.
+ * @param k The lane.
+ * @param m The #multipole.
+ */
+__attribute__((nonnull)) INLINE static void multipole_batch_set(
+    struct multipole_batch *restrict mb, const int k,
+    const struct multipole *restrict m) {
+
+  /* 0th order terms */
+  mb->M_000[k] = m->M_000;
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+  /* 2nd order terms */
+  mb->M_200[k] = m->M_200;
+  mb->M_020[k] = m->M_020;
+  mb->M_002[k] = m->M_002;
+  mb->M_110[k] = m->M_110;
+  mb->M_101[k] = m->M_101;
+  mb->M_011[k] = m->M_011;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 2
+  /* 3rd order terms */
+  mb->M_300[k] = m->M_300;
+  mb->M_030[k] = m->M_030;
+  mb->M_003[k] = m->M_003;
+  mb->M_210[k] = m->M_210;
+  mb->M_201[k] = m->M_201;
+  mb->M_120[k] = m->M_120;
+  mb->M_021[k] = m->M_021;
+  mb->M_102[k] = m->M_102;
+  mb->M_012[k] = m->M_012;
+  mb->M_111[k] = m->M_111;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 3
+  /* 4th order terms */
+  mb->M_400[k] = m->M_400;
+  mb->M_040[k] = m->M_040;
+  mb->M_004[k] = m->M_004;
+  mb->M_310[k] = m->M_310;
+  mb->M_301[k] = m->M_301;
+  mb->M_130[k] = m->M_130;
+  mb->M_031[k] = m->M_031;
+  mb->M_103[k] = m->M_103;
+  mb->M_013[k] = m->M_013;
+  mb->M_220[k] = m->M_220;
+  mb->M_202[k] = m->M_202;
+  mb->M_022[k] = m->M_022;
+  mb->M_211[k] = m->M_211;
+  mb->M_121[k] = m->M_121;
+  mb->M_112[k] = m->M_112;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 4
+  /* 5th order terms */
+  mb->M_005[k] = m->M_005;
+  mb->M_014[k] = m->M_014;
+  mb->M_023[k] = m->M_023;
+  mb->M_032[k] = m->M_032;
+  mb->M_041[k] = m->M_041;
+  mb->M_050[k] = m->M_050;
+  mb->M_104[k] = m->M_104;
+  mb->M_113[k] = m->M_113;
+  mb->M_122[k] = m->M_122;
+  mb->M_131[k] = m->M_131;
+  mb->M_140[k] = m->M_140;
+  mb->M_203[k] = m->M_203;
+  mb->M_212[k] = m->M_212;
+  mb->M_221[k] = m->M_221;
+  mb->M_230[k] = m->M_230;
+  mb->M_302[k] = m->M_302;
+  mb->M_311[k] = m->M_311;
+  mb->M_320[k] = m->M_320;
+  mb->M_401[k] = m->M_401;
+  mb->M_410[k] = m->M_410;
+  mb->M_500[k] = m->M_500;
+#endif
+}
+
+/**
+ * @brief Copy some #potential_derivatives_M2L into one lane of a
+ * #potential_derivatives_M2L_batch.
+ *
+ * @param pb The #potential_derivatives_M2L_batch.
+ * @param k The lane.
+ * @param pot The #potential_derivatives_M2L.
+ */
+__attribute__((nonnull)) INLINE static void potential_derivatives_batch_set(
+    struct potential_derivatives_M2L_batch *restrict pb, const int k,
+    const struct potential_derivatives_M2L *restrict pot) {
+
+  /* 0th order terms */
+  pb->D_000[k] = pot->D_000;
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 0
+  /* 1st order terms */
+  pb->D_100[k] = pot->D_100;
+  pb->D_010[k] = pot->D_010;
+  pb->D_001[k] = pot->D_001;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+  /* 2nd order terms */
+  pb->D_200[k] = pot->D_200;
+  pb->D_020[k] = pot->D_020;
+  pb->D_002[k] = pot->D_002;
+  pb->D_110[k] = pot->D_110;
+  pb->D_101[k] = pot->D_101;
+  pb->D_011[k] = pot->D_011;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 2
+  /* 3rd order terms */
+  pb->D_300[k] = pot->D_300;
+  pb->D_030[k] = pot->D_030;
+  pb->D_003[k] = pot->D_003;
+  pb->D_210[k] = pot->D_210;
+  pb->D_201[k] = pot->D_201;
+  pb->D_120[k] = pot->D_120;
+  pb->D_021[k] = pot->D_021;
+  pb->D_102[k] = pot->D_102;
+  pb->D_012[k] = pot->D_012;
+  pb->D_111[k] = pot->D_111;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 3
+  /* 4th order terms */
+  pb->D_400[k] = pot->D_400;
+  pb->D_040[k] = pot->D_040;
+  pb->D_004[k] = pot->D_004;
+  pb->D_310[k] = pot->D_310;
+  pb->D_301[k] = pot->D_301;
+  pb->D_130[k] = pot->D_130;
+  pb->D_031[k] = pot->D_031;
+  pb->D_103[k] = pot->D_103;
+  pb->D_013[k] = pot->D_013;
+  pb->D_220[k] = pot->D_220;
+  pb->D_202[k] = pot->D_202;
+  pb->D_022[k] = pot->D_022;
+  pb->D_211[k] = pot->D_211;
+  pb->D_121[k] = pot->D_121;
+  pb->D_112[k] = pot->D_112;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 4
+  /* 5th order terms */
+  pb->D_005[k] = pot->D_005;
+  pb->D_014[k] = pot->D_014;
+  pb->D_023[k] = pot->D_023;
+  pb->D_032[k] = pot->D_032;
+  pb->D_041[k] = pot->D_041;
+  pb->D_050[k] = pot->D_050;
+  pb->D_104[k] = pot->D_104;
+  pb->D_113[k] = pot->D_113;
+  pb->D_122[k] = pot->D_122;
+  pb->D_131[k] = pot->D_131;
+  pb->D_140[k] = pot->D_140;
+  pb->D_203[k] = pot->D_203;
+  pb->D_212[k] = pot->D_212;
+  pb->D_221[k] = pot->D_221;
+  pb->D_230[k] = pot->D_230;
+  pb->D_302[k] = pot->D_302;
+  pb->D_311[k] = pot->D_311;
+  pb->D_320[k] = pot->D_320;
+  pb->D_401[k] = pot->D_401;
+  pb->D_410[k] = pot->D_410;
+  pb->D_500[k] = pot->D_500;
+#endif
+}
+
+/**
+ * @brief Zero all the lanes of a #grav_tensor_batch.
+ *
+ * @param lb The #grav_tensor_batch.
+ */
+__attribute__((nonnull)) INLINE static void grav_tensor_batch_init(
+    struct grav_tensor_batch *lb) {
+
+  bzero(lb, sizeof(struct grav_tensor_batch));
+}
+
+/**
+ * @brief Copy one lane of a #grav_tensor_batch into a #grav_tensor.
+ *
+ * Only the terms are copied, the counters of the #grav_tensor are left
+ * untouched.
+ *
+ * @param l The #grav_tensor.
+ * @param lb The #grav_tensor_batch.
+ * @param k The lane.
+ */
+__attribute__((nonnull)) INLINE static void grav_tensor_batch_get(
+    struct grav_tensor *restrict l, const struct grav_tensor_batch *restrict lb,
+    const int k) {
+
+  /* 0th order terms */
+  l->F_000 = lb->F_000[k];
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 0
+  /* 1st order terms */
+  l->F_100 = lb->F_100[k];
+  l->F_010 = lb->F_010[k];
+  l->F_001 = lb->F_001[k];
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+  /* 2nd order terms */
+  l->F_200 = lb->F_200[k];
+  l->F_020 = lb->F_020[k];
+  l->F_002 = lb->F_002[k];
+  l->F_110 = lb->F_110[k];
+  l->F_101 = lb->F_101[k];
+  l->F_011 = lb->F_011[k];
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 2
+  /* 3rd order terms */
+  l->F_300 = lb->F_300[k];
+  l->F_030 = lb->F_030[k];
+  l->F_003 = lb->F_003[k];
+  l->F_210 = lb->F_210[k];
+  l->F_201 = lb->F_201[k];
+  l->F_120 = lb->F_120[k];
+  l->F_021 = lb->F_021[k];
+  l->F_102 = lb->F_102[k];
+  l->F_012 = lb->F_012[k];
+  l->F_111 = lb->F_111[k];
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 3
+  /* 4th order terms */
+  l->F_400 = lb->F_400[k];
+  l->F_040 = lb->F_040[k];
+  l->F_004 = lb->F_004[k];
+  l->F_310 = lb->F_310[k];
+  l->F_301 = lb->F_301[k];
+  l->F_130 = lb->F_130[k];
+  l->F_031 = lb->F_031[k];
+  l->F_103 = lb->F_103[k];
+  l->F_013 = lb->F_013[k];
+  l->F_220 = lb->F_220[k];
+  l->F_202 = lb->F_202[k];
+  l->F_022 = lb->F_022[k];
+  l->F_211 = lb->F_211[k];
+  l->F_121 = lb->F_121[k];
+  l->F_112 = lb->F_112[k];
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 4
+  /* 5th order terms */
+  l->F_005 = lb->F_005[k];
+  l->F_014 = lb->F_014[k];
+  l->F_023 = lb->F_023[k];
+  l->F_032 = lb->F_032[k];
+  l->F_041 = lb->F_041[k];
+  l->F_050 = lb->F_050[k];
+  l->F_104 = lb->F_104[k];
+  l->F_113 = lb->F_113[k];
+  l->F_122 = lb->F_122[k];
+  l->F_131 = lb->F_131[k];
+  l->F_140 = lb->F_140[k];
+  l->F_203 = lb->F_203[k];
+  l->F_212 = lb->F_212[k];
+  l->F_221 = lb->F_221[k];
+  l->F_230 = lb->F_230[k];
+  l->F_302 = lb->F_302[k];
+  l->F_311 = lb->F_311[k];
+  l->F_320 = lb->F_320[k];
+  l->F_401 = lb->F_401[k];
+  l->F_410 = lb->F_410[k];
+  l->F_500 = lb->F_500[k];
+#endif
+}
+
+/**
+ * @brief Flip the signs of the odd derivatives of all the lanes of a
+ * #potential_derivatives_M2L_batch.
+ *
+ * @param pot The #potential_derivatives_M2L_batch.
+ */
+__attribute__((nonnull)) INLINE static void
+potential_derivatives_batch_flip_signs(
+    struct potential_derivatives_M2L_batch *pot) {
+
+  for (int k = 0; k < MULTIPOLE_BATCH_SIZE; ++k) {
+
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 0
+    /* 1st order terms */
+    pot->D_100[k] = -pot->D_100[k];
+    pot->D_010[k] = -pot->D_010[k];
+    pot->D_001[k] = -pot->D_001[k];
+#endif
+
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 2
+    /* 3rd order terms */
+    pot->D_300[k] = -pot->D_300[k];
+    pot->D_030[k] = -pot->D_030[k];
+    pot->D_003[k] = -pot->D_003[k];
+    pot->D_210[k] = -pot->D_210[k];
+    pot->D_201[k] = -pot->D_201[k];
+    pot->D_021[k] = -pot->D_021[k];
+    pot->D_120[k] = -pot->D_120[k];
+    pot->D_012[k] = -pot->D_012[k];
+    pot->D_102[k] = -pot->D_102[k];
+    pot->D_111[k] = -pot->D_111[k];
+#endif
+
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 4
+    /* 5th order terms */
+    pot->D_500[k] = -pot->D_500[k];
+    pot->D_050[k] = -pot->D_050[k];
+    pot->D_005[k] = -pot->D_005[k];
+    pot->D_410[k] = -pot->D_410[k];
+    pot->D_401[k] = -pot->D_401[k];
+    pot->D_041[k] = -pot->D_041[k];
+    pot->D_140[k] = -pot->D_140[k];
+    pot->D_014[k] = -pot->D_014[k];
+    pot->D_104[k] = -pot->D_104[k];
+    pot->D_320[k] = -pot->D_320[k];
+    pot->D_302[k] = -pot->D_302[k];
+    pot->D_032[k] = -pot->D_032[k];
+    pot->D_230[k] = -pot->D_230[k];
+    pot->D_023[k] = -pot->D_023[k];
+    pot->D_203[k] = -pot->D_203[k];
+    pot->D_311[k] = -pot->D_311[k];
+    pot->D_131[k] = -pot->D_131[k];
+    pot->D_113[k] = -pot->D_113[k];
+    pot->D_122[k] = -pot->D_122[k];
+    pot->D_212[k] = -pot->D_212[k];
+    pot->D_221[k] = -pot->D_221[k];
+#endif
+  }
+}
+
+/**
+ * @brief Compute the field tensor of one lane of a batch due to its
+ * multipole.
+ *
+ * Same operations as gravity_M2L_apply().
+ *
+ * @param l_b The field tensors to compute.
+ * @param m_a The multipoles creating the fields.
+ * @param pot The derivatives of the potential.
+ * @param k The lane.
+ */
+__attribute__((always_inline, nonnull)) INLINE static void
+gravity_M2L_batch_apply_lane(
+    struct grav_tensor_batch *restrict l_b,
+    const struct multipole_batch *restrict m_a,
+    const struct potential_derivatives_M2L_batch *restrict pot, const int k) {
+
+  const float M_000 = m_a->M_000[k];
+  const float D_000 = pot->D_000[k];
+
+  /*  0th order term */
+  l_b->F_000[k] += M_000 * D_000;
+
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 0
+
+  /* The dipole term is zero when using the CoM */
+  /* The compiler will optimize out the terms in the equations */
+  /* below. We keep them written to maintain the logical structure. */
+  const float M_100 = 0.f;
+  const float M_010 = 0.f;
+  const float M_001 = 0.f;
+
+  const float D_100 = pot->D_100[k];
+  const float D_010 = pot->D_010[k];
+  const float D_001 = pot->D_001[k];
+
+  /*  1st order multipole term (addition to rank 0)*/
+  l_b->F_000[k] += M_100 * D_100 + M_010 * D_010 + M_001 * D_001;
+
+  /*  1st order multipole term (addition to rank 1)*/
+  l_b->F_100[k] += M_000 * D_100;
+  l_b->F_010[k] += M_000 * D_010;
+  l_b->F_001[k] += M_000 * D_001;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+
+  const float M_200 = m_a->M_200[k];
+  const float M_020 = m_a->M_020[k];
+  const float M_002 = m_a->M_002[k];
+  const float M_110 = m_a->M_110[k];
+  const float M_101 = m_a->M_101[k];
+  const float M_011 = m_a->M_011[k];
+
+  const float D_200 = pot->D_200[k];
+  const float D_020 = pot->D_020[k];
+  const float D_002 = pot->D_002[k];
+  const float D_110 = pot->D_110[k];
+  const float D_101 = pot->D_101[k];
+  const float D_011 = pot->D_011[k];
+
+  /*  2nd order multipole term (addition to rank 0)*/
+  l_b->F_000[k] += M_200 * D_200 + M_020 * D_020 + M_002 * D_002;
+  l_b->F_000[k] += M_110 * D_110 + M_101 * D_101 + M_011 * D_011;
+
+  /*  2nd order multipole term (addition to rank 1)*/
+  l_b->F_100[k] += M_100 * D_200 + M_010 * D_110 + M_001 * D_101;
+  l_b->F_010[k] += M_100 * D_110 + M_010 * D_020 + M_001 * D_011;
+  l_b->F_001[k] += M_100 * D_101 + M_010 * D_011 + M_001 * D_002;
+
+  /*  2nd order multipole term (addition to rank 2)*/
+  l_b->F_200[k] += M_000 * D_200;
+  l_b->F_020[k] += M_000 * D_020;
+  l_b->F_002[k] += M_000 * D_002;
+  l_b->F_110[k] += M_000 * D_110;
+  l_b->F_101[k] += M_000 * D_101;
+  l_b->F_011[k] += M_000 * D_011;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 2
+
+  const float M_300 = m_a->M_300[k];
+  const float M_030 = m_a->M_030[k];
+  const float M_003 = m_a->M_003[k];
+  const float M_210 = m_a->M_210[k];
+  const float M_201 = m_a->M_201[k];
+  const float M_021 = m_a->M_021[k];
+  const float M_120 = m_a->M_120[k];
+  const float M_012 = m_a->M_012[k];
+  const float M_102 = m_a->M_102[k];
+  const float M_111 = m_a->M_111[k];
+
+  const float D_300 = pot->D_300[k];
+  const float D_030 = pot->D_030[k];
+  const float D_003 = pot->D_003[k];
+  const float D_210 = pot->D_210[k];
+  const float D_201 = pot->D_201[k];
+  const float D_021 = pot->D_021[k];
+  const float D_120 = pot->D_120[k];
+  const float D_012 = pot->D_012[k];
+  const float D_102 = pot->D_102[k];
+  const float D_111 = pot->D_111[k];
+
+  /*  3rd order multipole term (addition to rank 0)*/
+  l_b->F_000[k] += M_300 * D_300 + M_030 * D_030 + M_003 * D_003;
+  l_b->F_000[k] += M_210 * D_210 + M_201 * D_201 + M_120 * D_120;
+  l_b->F_000[k] += M_021 * D_021 + M_102 * D_102 + M_012 * D_012;
+  l_b->F_000[k] += M_111 * D_111;
+
+  /*  3rd order multipole term (addition to rank 1)*/
+  l_b->F_100[k] += M_200 * D_300 + M_020 * D_120 + M_002 * D_102;
+  l_b->F_100[k] += M_110 * D_210 + M_101 * D_201 + M_011 * D_111;
+  l_b->F_010[k] += M_200 * D_210 + M_020 * D_030 + M_002 * D_012;
+  l_b->F_010[k] += M_110 * D_120 + M_101 * D_111 + M_011 * D_021;
+  l_b->F_001[k] += M_200 * D_201 + M_020 * D_021 + M_002 * D_003;
+  l_b->F_001[k] += M_110 * D_111 + M_101 * D_102 + M_011 * D_012;
+
+  /*  3rd order multipole term (addition to rank 2)*/
+  l_b->F_200[k] += M_100 * D_300 + M_010 * D_210 + M_001 * D_201;
+  l_b->F_020[k] += M_100 * D_120 + M_010 * D_030 + M_001 * D_021;
+  l_b->F_002[k] += M_100 * D_102 + M_010 * D_012 + M_001 * D_003;
+  l_b->F_110[k] += M_100 * D_210 + M_010 * D_120 + M_001 * D_111;
+  l_b->F_101[k] += M_100 * D_201 + M_010 * D_111 + M_001 * D_102;
+  l_b->F_011[k] += M_100 * D_111 + M_010 * D_021 + M_001 * D_012;
+
+  /*  3rd order multipole term (addition to rank 3)*/
+  l_b->F_300[k] += M_000 * D_300;
+  l_b->F_030[k] += M_000 * D_030;
+  l_b->F_003[k] += M_000 * D_003;
+  l_b->F_210[k] += M_000 * D_210;
+  l_b->F_201[k] += M_000 * D_201;
+  l_b->F_120[k] += M_000 * D_120;
+  l_b->F_021[k] += M_000 * D_021;
+  l_b->F_102[k] += M_000 * D_102;
+  l_b->F_012[k] += M_000 * D_012;
+  l_b->F_111[k] += M_000 * D_111;
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 3
+
+  const float M_400 = m_a->M_400[k];
+  const float M_040 = m_a->M_040[k];
+  const float M_004 = m_a->M_004[k];
+  const float M_310 = m_a->M_310[k];
+  const float M_301 = m_a->M_301[k];
+  const float M_031 = m_a->M_031[k];
+  const float M_130 = m_a->M_130[k];
+  const float M_013 = m_a->M_013[k];
+  const float M_103 = m_a->M_103[k];
+  const float M_220 = m_a->M_220[k];
+  const float M_202 = m_a->M_202[k];
+  const float M_022 = m_a->M_022[k];
+  const float M_211 = m_a->M_211[k];
+  const float M_121 = m_a->M_121[k];
+  const float M_112 = m_a->M_112[k];
+
+  const float D_400 = pot->D_400[k];
+  const float D_040 = pot->D_040[k];
+  const float D_004 = pot->D_004[k];
+  const float D_310 = pot->D_310[k];
+  const float D_301 = pot->D_301[k];
+  const float D_031 = pot->D_031[k];
+  const float D_130 = pot->D_130[k];
+  const float D_013 = pot->D_013[k];
+  const float D_103 = pot->D_103[k];
+  const float D_220 = pot->D_220[k];
+  const float D_202 = pot->D_202[k];
+  const float D_022 = pot->D_022[k];
+  const float D_211 = pot->D_211[k];
+  const float D_121 = pot->D_121[k];
+  const float D_112 = pot->D_112[k];
+
+  /* Compute 4th order field tensor terms (addition to rank 0) */
+  l_b->F_000[k] += M_004 * D_004 + M_013 * D_013 + M_022 * D_022 +
+                   M_031 * D_031 + M_040 * D_040 + M_103 * D_103 +
+                   M_112 * D_112 + M_121 * D_121 + M_130 * D_130 +
+                   M_202 * D_202 + M_211 * D_211 + M_220 * D_220 +
+                   M_301 * D_301 + M_310 * D_310 + M_400 * D_400;
+
+  /* Compute 4th order field tensor terms (addition to rank 1) */
+  l_b->F_001[k] += M_003 * D_004 + M_012 * D_013 + M_021 * D_022 +
+                   M_030 * D_031 + M_102 * D_103 + M_111 * D_112 +
+                   M_120 * D_121 + M_201 * D_202 + M_210 * D_211 +
+                   M_300 * D_301;
+  l_b->F_010[k] += M_003 * D_013 + M_012 * D_022 + M_021 * D_031 +
+                   M_030 * D_040 + M_102 * D_112 + M_111 * D_121 +
+                   M_120 * D_130 + M_201 * D_211 + M_210 * D_220 +
+                   M_300 * D_310;
+  l_b->F_100[k] += M_003 * D_103 + M_012 * D_112 + M_021 * D_121 +
+                   M_030 * D_130 + M_102 * D_202 + M_111 * D_211 +
+                   M_120 * D_220 + M_201 * D_301 + M_210 * D_310 +
+                   M_300 * D_400;
+
+  /* Compute 4th order field tensor terms (addition to rank 2) */
+  l_b->F_002[k] += M_002 * D_004 + M_011 * D_013 + M_020 * D_022 +
+                   M_101 * D_103 + M_110 * D_112 + M_200 * D_202;
+  l_b->F_011[k] += M_002 * D_013 + M_011 * D_022 + M_020 * D_031 +
+                   M_101 * D_112 + M_110 * D_121 + M_200 * D_211;
+  l_b->F_020[k] += M_002 * D_022 + M_011 * D_031 + M_020 * D_040 +
+                   M_101 * D_121 + M_110 * D_130 + M_200 * D_220;
+  l_b->F_101[k] += M_002 * D_103 + M_011 * D_112 + M_020 * D_121 +
+                   M_101 * D_202 + M_110 * D_211 + M_200 * D_301;
+  l_b->F_110[k] += M_002 * D_112 + M_011 * D_121 + M_020 * D_130 +
+                   M_101 * D_211 + M_110 * D_220 + M_200 * D_310;
+  l_b->F_200[k] += M_002 * D_202 + M_011 * D_211 + M_020 * D_220 +
+                   M_101 * D_301 + M_110 * D_310 + M_200 * D_400;
+
+  /* Compute 4th order field tensor terms (addition to rank 3) */
+  l_b->F_003[k] += M_001 * D_004 + M_010 * D_013 + M_100 * D_103;
+  l_b->F_012[k] += M_001 * D_013 + M_010 * D_022 + M_100 * D_112;
+  l_b->F_021[k] += M_001 * D_022 + M_010 * D_031 + M_100 * D_121;
+  l_b->F_030[k] += M_001 * D_031 + M_010 * D_040 + M_100 * D_130;
+  l_b->F_102[k] += M_001 * D_103 + M_010 * D_112 + M_100 * D_202;
+  l_b->F_111[k] += M_001 * D_112 + M_010 * D_121 + M_100 * D_211;
+  l_b->F_120[k] += M_001 * D_121 + M_010 * D_130 + M_100 * D_220;
+  l_b->F_201[k] += M_001 * D_202 + M_010 * D_211 + M_100 * D_301;
+  l_b->F_210[k] += M_001 * D_211 + M_010 * D_220 + M_100 * D_310;
+  l_b->F_300[k] += M_001 * D_301 + M_010 * D_310 + M_100 * D_400;
+
+  /* Compute 4th order field tensor terms (addition to rank 4) */
+  l_b->F_004[k] += M_000 * D_004;
+  l_b->F_013[k] += M_000 * D_013;
+  l_b->F_022[k] += M_000 * D_022;
+  l_b->F_031[k] += M_000 * D_031;
+  l_b->F_040[k] += M_000 * D_040;
+  l_b->F_103[k] += M_000 * D_103;
+  l_b->F_112[k] += M_000 * D_112;
+  l_b->F_121[k] += M_000 * D_121;
+  l_b->F_130[k] += M_000 * D_130;
+  l_b->F_202[k] += M_000 * D_202;
+  l_b->F_211[k] += M_000 * D_211;
+  l_b->F_220[k] += M_000 * D_220;
+  l_b->F_301[k] += M_000 * D_301;
+  l_b->F_310[k] += M_000 * D_310;
+  l_b->F_400[k] += M_000 * D_400;
+
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 4
+
+  const float M_500 = m_a->M_500[k];
+  const float M_050 = m_a->M_050[k];
+  const float M_005 = m_a->M_005[k];
+  const float M_410 = m_a->M_410[k];
+  const float M_401 = m_a->M_401[k];
+  const float M_041 = m_a->M_041[k];
+  const float M_140 = m_a->M_140[k];
+  const float M_014 = m_a->M_014[k];
+  const float M_104 = m_a->M_104[k];
+  const float M_320 = m_a->M_320[k];
+  const float M_302 = m_a->M_302[k];
+  const float M_230 = m_a->M_230[k];
+  const float M_032 = m_a->M_032[k];
+  const float M_203 = m_a->M_203[k];
+  const float M_023 = m_a->M_023[k];
+  const float M_122 = m_a->M_122[k];
+  const float M_212 = m_a->M_212[k];
+  const float M_221 = m_a->M_221[k];
+  const float M_311 = m_a->M_311[k];
+  const float M_131 = m_a->M_131[k];
+  const float M_113 = m_a->M_113[k];
+
+  const float D_500 = pot->D_500[k];
+  const float D_050 = pot->D_050[k];
+  const float D_005 = pot->D_005[k];
+  const float D_410 = pot->D_410[k];
+  const float D_401 = pot->D_401[k];
+  const float D_041 = pot->D_041[k];
+  const float D_140 = pot->D_140[k];
+  const float D_014 = pot->D_014[k];
+  const float D_104 = pot->D_104[k];
+  const float D_320 = pot->D_320[k];
+  const float D_302 = pot->D_302[k];
+  const float D_230 = pot->D_230[k];
+  const float D_032 = pot->D_032[k];
+  const float D_203 = pot->D_203[k];
+  const float D_023 = pot->D_023[k];
+  const float D_122 = pot->D_122[k];
+  const float D_212 = pot->D_212[k];
+  const float D_221 = pot->D_221[k];
+  const float D_311 = pot->D_311[k];
+  const float D_131 = pot->D_131[k];
+  const float D_113 = pot->D_113[k];
+
+  /* Compute 5th order field tensor terms (addition to rank 0) */
+  l_b->F_000[k] += M_005 * D_005 + M_014 * D_014 + M_023 * D_023 +
+                   M_032 * D_032 + M_041 * D_041 + M_050 * D_050 +
+                   M_104 * D_104 + M_113 * D_113 + M_122 * D_122 +
+                   M_131 * D_131 + M_140 * D_140 + M_203 * D_203 +
+                   M_212 * D_212 + M_221 * D_221 + M_230 * D_230 +
+                   M_302 * D_302 + M_311 * D_311 + M_320 * D_320 +
+                   M_401 * D_401 + M_410 * D_410 + M_500 * D_500;
+
+  /* Compute 5th order field tensor terms (addition to rank 1) */
+  l_b->F_001[k] += M_004 * D_005 + M_013 * D_014 + M_022 * D_023 +
+                   M_031 * D_032 + M_040 * D_041 + M_103 * D_104 +
+                   M_112 * D_113 + M_121 * D_122 + M_130 * D_131 +
+                   M_202 * D_203 + M_211 * D_212 + M_220 * D_221 +
+                   M_301 * D_302 + M_310 * D_311 + M_400 * D_401;
+  l_b->F_010[k] += M_004 * D_014 + M_013 * D_023 + M_022 * D_032 +
+                   M_031 * D_041 + M_040 * D_050 + M_103 * D_113 +
+                   M_112 * D_122 + M_121 * D_131 + M_130 * D_140 +
+                   M_202 * D_212 + M_211 * D_221 + M_220 * D_230 +
+                   M_301 * D_311 + M_310 * D_320 + M_400 * D_410;
+  l_b->F_100[k] += M_004 * D_104 + M_013 * D_113 + M_022 * D_122 +
+                   M_031 * D_131 + M_040 * D_140 + M_103 * D_203 +
+                   M_112 * D_212 + M_121 * D_221 + M_130 * D_230 +
+                   M_202 * D_302 + M_211 * D_311 + M_220 * D_320 +
+                   M_301 * D_401 + M_310 * D_410 + M_400 * D_500;
+
+  /* Compute 5th order field tensor terms (addition to rank 2) */
+  l_b->F_002[k] += M_003 * D_005 + M_012 * D_014 + M_021 * D_023 +
+                   M_030 * D_032 + M_102 * D_104 + M_111 * D_113 +
+                   M_120 * D_122 + M_201 * D_203 + M_210 * D_212 +
+                   M_300 * D_302;
+  l_b->F_011[k] += M_003 * D_014 + M_012 * D_023 + M_021 * D_032 +
+                   M_030 * D_041 + M_102 * D_113 + M_111 * D_122 +
+                   M_120 * D_131 + M_201 * D_212 + M_210 * D_221 +
+                   M_300 * D_311;
+  l_b->F_020[k] += M_003 * D_023 + M_012 * D_032 + M_021 * D_041 +
+                   M_030 * D_050 + M_102 * D_122 + M_111 * D_131 +
+                   M_120 * D_140 + M_201 * D_221 + M_210 * D_230 +
+                   M_300 * D_320;
+  l_b->F_101[k] += M_003 * D_104 + M_012 * D_113 + M_021 * D_122 +
+                   M_030 * D_131 + M_102 * D_203 + M_111 * D_212 +
+                   M_120 * D_221 + M_201 * D_302 + M_210 * D_311 +
+                   M_300 * D_401;
+  l_b->F_110[k] += M_003 * D_113 + M_012 * D_122 + M_021 * D_131 +
+                   M_030 * D_140 + M_102 * D_212 + M_111 * D_221 +
+                   M_120 * D_230 + M_201 * D_311 + M_210 * D_320 +
+                   M_300 * D_410;
+  l_b->F_200[k] += M_003 * D_203 + M_012 * D_212 + M_021 * D_221 +
+                   M_030 * D_230 + M_102 * D_302 + M_111 * D_311 +
+                   M_120 * D_320 + M_201 * D_401 + M_210 * D_410 +
+                   M_300 * D_500;
+
+  /* Compute 5th order field tensor terms (addition to rank 3) */
+  l_b->F_003[k] += M_002 * D_005 + M_011 * D_014 + M_020 * D_023 +
+                   M_101 * D_104 + M_110 * D_113 + M_200 * D_203;
+  l_b->F_012[k] += M_002 * D_014 + M_011 * D_023 + M_020 * D_032 +
+                   M_101 * D_113 + M_110 * D_122 + M_200 * D_212;
+  l_b->F_021[k] += M_002 * D_023 + M_011 * D_032 + M_020 * D_041 +
+                   M_101 * D_122 + M_110 * D_131 + M_200 * D_221;
+  l_b->F_030[k] += M_002 * D_032 + M_011 * D_041 + M_020 * D_050 +
+                   M_101 * D_131 + M_110 * D_140 + M_200 * D_230;
+  l_b->F_102[k] += M_002 * D_104 + M_011 * D_113 + M_020 * D_122 +
+                   M_101 * D_203 + M_110 * D_212 + M_200 * D_302;
+  l_b->F_111[k] += M_002 * D_113 + M_011 * D_122 + M_020 * D_131 +
+                   M_101 * D_212 + M_110 * D_221 + M_200 * D_311;
+  l_b->F_120[k] += M_002 * D_122 + M_011 * D_131 + M_020 * D_140 +
+                   M_101 * D_221 + M_110 * D_230 + M_200 * D_320;
+  l_b->F_201[k] += M_002 * D_203 + M_011 * D_212 + M_020 * D_221 +
+                   M_101 * D_302 + M_110 * D_311 + M_200 * D_401;
+  l_b->F_210[k] += M_002 * D_212 + M_011 * D_221 + M_020 * D_230 +
+                   M_101 * D_311 + M_110 * D_320 + M_200 * D_410;
+  l_b->F_300[k] += M_002 * D_302 + M_011 * D_311 + M_020 * D_320 +
+                   M_101 * D_401 + M_110 * D_410 + M_200 * D_500;
+
+  /* Compute 5th order field tensor terms (addition to rank 4) */
+  l_b->F_004[k] += M_001 * D_005 + M_010 * D_014 + M_100 * D_104;
+  l_b->F_013[k] += M_001 * D_014 + M_010 * D_023 + M_100 * D_113;
+  l_b->F_022[k] += M_001 * D_023 + M_010 * D_032 + M_100 * D_122;
+  l_b->F_031[k] += M_001 * D_032 + M_010 * D_041 + M_100 * D_131;
+  l_b->F_040[k] += M_001 * D_041 + M_010 * D_050 + M_100 * D_140;
+  l_b->F_103[k] += M_001 * D_104 + M_010 * D_113 + M_100 * D_203;
+  l_b->F_112[k] += M_001 * D_113 + M_010 * D_122 + M_100 * D_212;
+  l_b->F_121[k] += M_001 * D_122 + M_010 * D_131 + M_100 * D_221;
+  l_b->F_130[k] += M_001 * D_131 + M_010 * D_140 + M_100 * D_230;
+  l_b->F_202[k] += M_001 * D_203 + M_010 * D_212 + M_100 * D_302;
+  l_b->F_211[k] += M_001 * D_212 + M_010 * D_221 + M_100 * D_311;
+  l_b->F_220[k] += M_001 * D_221 + M_010 * D_230 + M_100 * D_320;
+  l_b->F_301[k] += M_001 * D_302 + M_010 * D_311 + M_100 * D_401;
+  l_b->F_310[k] += M_001 * D_311 + M_010 * D_320 + M_100 * D_410;
+  l_b->F_400[k] += M_001 * D_401 + M_010 * D_410 + M_100 * D_500;
+
+  /* Compute 5th order field tensor terms (addition to rank 5) */
+  l_b->F_005[k] += M_000 * D_005;
+  l_b->F_014[k] += M_000 * D_014;
+  l_b->F_023[k] += M_000 * D_023;
+  l_b->F_032[k] += M_000 * D_032;
+  l_b->F_041[k] += M_000 * D_041;
+  l_b->F_050[k] += M_000 * D_050;
+  l_b->F_104[k] += M_000 * D_104;
+  l_b->F_113[k] += M_000 * D_113;
+  l_b->F_122[k] += M_000 * D_122;
+  l_b->F_131[k] += M_000 * D_131;
+  l_b->F_140[k] += M_000 * D_140;
+  l_b->F_203[k] += M_000 * D_203;
+  l_b->F_212[k] += M_000 * D_212;
+  l_b->F_221[k] += M_000 * D_221;
+  l_b->F_230[k] += M_000 * D_230;
+  l_b->F_302[k] += M_000 * D_302;
+  l_b->F_311[k] += M_000 * D_311;
+  l_b->F_320[k] += M_000 * D_320;
+  l_b->F_401[k] += M_000 * D_401;
+  l_b->F_410[k] += M_000 * D_410;
+  l_b->F_500[k] += M_000 * D_500;
+
+#endif
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 5
+#error "Missing implementation for order >5"
+#endif
+}
+
+/**
+ * @brief Compute the field tensors of all the lanes of a batch due to their
+ * multipoles.
+ *
+ * Corresponds to equation (28b). The loop over the lanes is the one the
+ * compiler vectorises.
+ *
+ * @param l_b The field tensors to compute.
+ * @param m_a The multipoles creating the fields.
+ * @param pot The derivatives of the potential.
+ */
+__attribute__((nonnull)) INLINE static void gravity_M2L_batch_apply(
+    struct grav_tensor_batch *restrict l_b,
+    const struct multipole_batch *restrict m_a,
+    const struct potential_derivatives_M2L_batch *restrict pot) {
+
+  for (int k = 0; k < MULTIPOLE_BATCH_SIZE; ++k)
+    gravity_M2L_batch_apply_lane(l_b, m_a, pot, k);
+}
+
+#endif /* SWIFT_MULTIPOLE_BATCH_H */
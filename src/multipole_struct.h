@@ -23,6 +23,7 @@
 #include <config.h>
 
 /* Local includes */
+#include "align.h"
 #include "timeline.h"
 
 /**
@@ -124,6 +125,9 @@ struct multipole {
   /*! Minimal acceleration norm of all the #gpart in the mulipole */
   float min_old_a_grav_norm;
 
+  /*! Minimal mass of all the #gpart in the mulipole */
+  float min_mass;
+
   /*! Mulipole power for the different orders */
   float power[SELF_GRAVITY_MULTIPOLE_ORDER + 1];
 
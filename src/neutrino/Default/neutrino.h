@@ -53,6 +53,29 @@ void gpart_neutrino_mass_weight(const struct gpart *gp,
                                 const struct neutrino_model *nm, double *mass,
                                 double *weight);
 
+/**
+ * @brief Set the statistically weighted mass of a neutrino #gpart from its
+ * current velocity, using the delta-f method.
+ *
+ * @param gp The #gpart.
+ * @param nm Properties of the neutrino model
+ */
+INLINE static void gpart_neutrino_set_weighted_mass(
+    struct gpart *gp, const struct neutrino_model *nm) {
+
+  /* Compute the mass and delta-f weight */
+  double mass, weight;
+  gpart_neutrino_mass_weight(gp, nm, &mass, &weight);
+
+  /* Set the statistically weighted mass */
+  gp->mass = mass * weight;
+
+  /* Prevent degeneracies */
+  if (gp->mass == 0.) {
+    gp->mass = FLT_MIN;
+  }
+}
+
 /* Compute the ratio of macro particle mass in internal mass units to
  * the mass of one microscopic neutrino in eV.
  *
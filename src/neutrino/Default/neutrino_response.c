@@ -413,6 +413,11 @@ struct neutrino_response_tp_data {
   int slice_offset;
   int slice_width;
 
+  /* Modes stored by this rank in a pencil decomposition */
+  int ky_offset;
+  int kz_offset;
+  int kz_width;
+
   /* Interpolation properties */
   double inv_delta_log_k;
   double log_k_min;
@@ -424,6 +429,49 @@ struct neutrino_response_tp_data {
   const double *pt_density_ratio;
 };
 
+/**
+ * @brief The factor by which the neutrino response multiplies a mode.
+ *
+ * @param data The properties of the neutrino mesh.
+ * @param k2 The square of the (non-zero) wavenumber of the mode (U_L^-2).
+ */
+__attribute__((always_inline)) INLINE static double
+neutrino_response_correction(const struct neutrino_response_tp_data *data,
+                             const double k2) {
+
+  /* Unpack the interpolation properties */
+  const hsize_t a_index = data->a_index;
+  const double u_a = data->u_a;
+  const int N_k = wavenumber_length;
+  const double *pt_density_ratio = data->pt_density_ratio;
+
+  /* Interpolate along the k-axis */
+  const double log_k = 0.5 * log(k2);
+  const double log_k_steps = (log_k - data->log_k_min) * data->inv_delta_log_k;
+  const hsize_t k_index = (hsize_t)log_k_steps;
+  const double u_k = log_k_steps - k_index;
+
+  /* Retrieve the bounding values */
+  const double T11 = pt_density_ratio[N_k * a_index + k_index];
+  const double T21 = pt_density_ratio[N_k * a_index + k_index + 1];
+  const double T12 = pt_density_ratio[N_k * (a_index + 1) + k_index];
+  const double T22 = pt_density_ratio[N_k * (a_index + 1) + k_index + 1];
+
+  /* Bilinear interpolation of the tranfer function ratio */
+  double pt_ratio_interp = (1.0 - u_a) * ((1.0 - u_k) * T11 + u_k * T21) +
+                           u_a * ((1.0 - u_k) * T12 + u_k * T22);
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (u_k < 0 || u_a < 0 || u_k > 1 || u_a > 1 ||
+      k_index > wavenumber_length || a_index > timestep_length)
+    error("Interpolation out of bounds error: %g %g %g %g %llu %llu\n", u_k,
+          u_a, sqrt(k2), pt_ratio_interp, (unsigned long long)k_index,
+          (unsigned long long)a_index);
+#endif
+
+  return 1.0 + pt_ratio_interp * data->bg_density_ratio;
+}
+
 /**
  * @brief Mapper function for the application of the linear neutrino response.
  *
@@ -444,17 +492,6 @@ void neutrino_response_apply_neutrino_response_mapper(void *map_data,
   const int N_half = N / 2;
   const double delta_k = 2.0 * M_PI / data->boxlen;
 
-  /* Unpack the interpolation properties */
-  const hsize_t a_index = data->a_index;
-  const double u_a = data->u_a;
-  const double inv_delta_log_k = data->inv_delta_log_k;
-  const double log_k_min = data->log_k_min;
-  const int N_k = wavenumber_length;
-
-  /* Unpack the density ratios (background & perturbation) */
-  const double bg_density_ratio = data->bg_density_ratio;
-  const double *pt_density_ratio = data->pt_density_ratio;
-
   /* Find what slice of the full mesh is stored on this MPI rank */
   const int slice_offset = data->slice_offset;
 
@@ -476,34 +513,62 @@ void neutrino_response_apply_neutrino_response_mapper(void *map_data,
         /* Skip the DC mode */
         if (k2 == 0.) continue;
 
-        /* Interpolate along the k-axis */
-        const double log_k = 0.5 * log(k2);
-        const double log_k_steps = (log_k - log_k_min) * inv_delta_log_k;
-        const hsize_t k_index = (hsize_t)log_k_steps;
-        const double u_k = log_k_steps - k_index;
+        const double correction = neutrino_response_correction(data, k2);
+
+        /* Apply to the mesh */
+        const int index =
+            N * (N_half + 1) * (x - slice_offset) + (N_half + 1) * y + z;
+        frho[index][0] *= correction;
+        frho[index][1] *= correction;
+      }
+    }
+  }
+}
+
+/**
+ * @brief Mapper function for the application of the linear neutrino response
+ * to the modes of a pencil decomposition (ky x kz x kx).
+ *
+ * @param map_data The array of the density field Fourier transform.
+ * @param num The number of elements to iterate on (along the ky-axis).
+ * @param extra The properties of the neutrino mesh.
+ */
+void neutrino_response_apply_neutrino_response_pencil_mapper(void *map_data,
+                                                             const int num,
+                                                             void *extra) {
 
-        /* Retrieve the bounding values */
-        const double T11 = pt_density_ratio[N_k * a_index + k_index];
-        const double T21 = pt_density_ratio[N_k * a_index + k_index + 1];
-        const double T12 = pt_density_ratio[N_k * (a_index + 1) + k_index];
-        const double T22 = pt_density_ratio[N_k * (a_index + 1) + k_index + 1];
+  struct neutrino_response_tp_data *data =
+      (struct neutrino_response_tp_data *)extra;
 
-        /* Bilinear interpolation of the tranfer function ratio */
-        double pt_ratio_interp = (1.0 - u_a) * ((1.0 - u_k) * T11 + u_k * T21) +
-                                 u_a * ((1.0 - u_k) * T12 + u_k * T22);
-        double correction = 1.0 + pt_ratio_interp * bg_density_ratio;
+  /* Unpack the mesh properties */
+  fftw_complex *const frho = data->frho;
+  const int N = data->N;
+  const int N_half = N / 2;
+  const double delta_k = 2.0 * M_PI / data->boxlen;
+  const int kz_width = data->kz_width;
 
-#ifdef SWIFT_DEBUG_CHECKS
-        if (u_k < 0 || u_a < 0 || u_k > 1 || u_a > 1 ||
-            k_index > wavenumber_length || a_index > timestep_length)
-          error("Interpolation out of bounds error: %g %g %g %g %llu %llu\n",
-                u_k, u_a, sqrt(k2), pt_ratio_interp,
-                (unsigned long long)k_index, (unsigned long long)a_index);
-#endif
+  /* Range of local ky rows handled by this call */
+  const int j_start = (fftw_complex *)map_data - frho;
+  const int j_end = j_start + num;
+
+  for (int jj = j_start; jj < j_end; ++jj) {
+    const int y = jj + data->ky_offset;
+    const double k_y = (y > N_half) ? (y - N) * delta_k : y * delta_k;
+
+    for (int kk = 0; kk < kz_width; ++kk) {
+      const double k_z = (kk + data->kz_offset) * delta_k;
+
+      for (int x = 0; x < N; ++x) {
+        const double k_x = (x > N_half) ? (x - N) * delta_k : x * delta_k;
+        const double k2 = k_x * k_x + k_y * k_y + k_z * k_z;
+
+        /* Skip the DC mode */
+        if (k2 == 0.) continue;
+
+        const double correction = neutrino_response_correction(data, k2);
 
         /* Apply to the mesh */
-        const int index =
-            N * (N_half + 1) * (x - slice_offset) + (N_half + 1) * y + z;
+        const size_t index = ((size_t)jj * kz_width + kk) * N + x;
         frho[index][0] *= correction;
         frho[index][1] *= correction;
       }
@@ -512,32 +577,21 @@ void neutrino_response_apply_neutrino_response_mapper(void *map_data,
 }
 
 /**
- * @brief Apply the linear neutrino response to the Fourier transform of the
- * gravitational potential.
+ * @brief Gather the factors of the neutrino response at the current time.
  *
  * @param s The current #space
  * @param mesh The #pm_mesh used to store the potential
- * @param tp The #threadpool object used for parallelisation
- * @param frho The NxNx(N/2) complex array of the Fourier transform of the
- * density field
- * @param slice_offset The x coordinate of the start of the slice on this MPI
- * rank
- * @param slice_width The width of the local slice on this MPI rank
- * @param verbose Are we talkative?
+ * @param frho The local part of the Fourier transform of the density field
+ * @param data The #neutrino_response_tp_data to fill
  */
-void neutrino_response_compute(const struct space *s, struct pm_mesh *mesh,
-                               struct threadpool *tp, fftw_complex *frho,
-                               const int slice_offset, const int slice_width,
-                               int verbose) {
-#ifdef HAVE_FFTW
+static void neutrino_response_prepare(const struct space *s,
+                                      const struct pm_mesh *mesh,
+                                      fftw_complex *frho,
+                                      struct neutrino_response_tp_data *data) {
 
   const struct cosmology *c = s->e->cosmology;
   struct neutrino_response *numesh = s->e->neutrino_response;
 
-  /* Grid size */
-  const int N = mesh->N;
-  const double boxlen = mesh->dim[0];
-
   /* Calculate the background neutrino density */
   const double a = numesh->fixed_bg_density ? 1.0 : c->a;
   const double Omega_nu = cosmology_get_neutrino_density(c, a);
@@ -567,18 +621,42 @@ void neutrino_response_compute(const struct space *s, struct pm_mesh *mesh,
   }
 
   /* Some common factors */
+  bzero(data, sizeof(struct neutrino_response_tp_data));
+  data->frho = frho;
+  data->N = mesh->N;
+  data->boxlen = mesh->dim[0];
+  data->inv_delta_log_k = inv_delta_log_k;
+  data->log_k_min = log_k_min;
+  data->a_index = a_index;
+  data->u_a = u_a;
+  data->bg_density_ratio = bg_density_ratio;
+  data->pt_density_ratio = numesh->pt_density_ratio;
+}
+
+/**
+ * @brief Apply the linear neutrino response to the Fourier transform of the
+ * gravitational potential.
+ *
+ * @param s The current #space
+ * @param mesh The #pm_mesh used to store the potential
+ * @param tp The #threadpool object used for parallelisation
+ * @param frho The NxNx(N/2) complex array of the Fourier transform of the
+ * density field
+ * @param slice_offset The x coordinate of the start of the slice on this MPI
+ * rank
+ * @param slice_width The width of the local slice on this MPI rank
+ * @param verbose Are we talkative?
+ */
+void neutrino_response_compute(const struct space *s, struct pm_mesh *mesh,
+                               struct threadpool *tp, fftw_complex *frho,
+                               const int slice_offset, const int slice_width,
+                               int verbose) {
+#ifdef HAVE_FFTW
+
   struct neutrino_response_tp_data data;
-  data.frho = frho;
-  data.N = N;
-  data.boxlen = boxlen;
+  neutrino_response_prepare(s, mesh, frho, &data);
   data.slice_offset = slice_offset;
   data.slice_width = slice_width;
-  data.inv_delta_log_k = inv_delta_log_k;
-  data.log_k_min = log_k_min;
-  data.a_index = a_index;
-  data.u_a = u_a;
-  data.bg_density_ratio = bg_density_ratio;
-  data.pt_density_ratio = numesh->pt_density_ratio;
 
   /* Parallelize the neutrino linear response application using the threadpool
      to split the x-axis loop over the threads. The array is N x N x (N/2).
@@ -598,6 +676,45 @@ void neutrino_response_compute(const struct space *s, struct pm_mesh *mesh,
 #endif
 }
 
+/**
+ * @brief Apply the linear neutrino response to the modes of a pencil
+ * decomposition of the Fourier transform of the gravitational potential.
+ *
+ * @param s The current #space
+ * @param mesh The #pm_mesh used to store the potential
+ * @param tp The #threadpool object used for parallelisation
+ * @param frho The local ky x kz x kx complex modes
+ * @param ky_offset The first ky stored on this MPI rank
+ * @param ky_width The number of ky stored on this MPI rank
+ * @param kz_offset The first kz stored on this MPI rank
+ * @param kz_width The number of kz stored on this MPI rank
+ * @param verbose Are we talkative?
+ */
+void neutrino_response_compute_pencil(const struct space *s,
+                                      struct pm_mesh *mesh,
+                                      struct threadpool *tp,
+                                      fftw_complex *frho, const int ky_offset,
+                                      const int ky_width, const int kz_offset,
+                                      const int kz_width, int verbose) {
+
+  struct neutrino_response_tp_data data;
+  neutrino_response_prepare(s, mesh, frho, &data);
+  data.ky_offset = ky_offset;
+  data.kz_offset = kz_offset;
+  data.kz_width = kz_width;
+
+  /* Split the ky rows over the threads */
+  threadpool_map(tp, neutrino_response_apply_neutrino_response_pencil_mapper,
+                 frho, ky_width, sizeof(fftw_complex),
+                 threadpool_auto_chunk_size, &data);
+
+  /* Correct singularity at (0,0,0) */
+  if (ky_offset == 0 && kz_offset == 0 && ky_width > 0 && kz_width > 0) {
+    frho[0][0] = 0.;
+    frho[0][1] = 0.;
+  }
+}
+
 #endif /* HAVE FFTW */
 
 /**
@@ -76,6 +76,12 @@ void neutrino_response_compute(const struct space *s, struct pm_mesh *mesh,
                                struct threadpool *tp, fftw_complex *frho,
                                const int slice_offset, const int slice_width,
                                int verbose);
+void neutrino_response_compute_pencil(const struct space *s,
+                                      struct pm_mesh *mesh,
+                                      struct threadpool *tp,
+                                      fftw_complex *frho, const int ky_offset,
+                                      const int ky_width, const int kz_offset,
+                                      const int kz_width, int verbose);
 #endif /* HAVE_FFTW */
 
 void neutrino_response_struct_dump(const struct neutrino_response *numesh,
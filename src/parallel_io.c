@@ -31,6 +31,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 
 /* This object's header. */
@@ -74,6 +75,11 @@
 /* Max number of entries that can be written for a given particle type */
 static const int io_max_size_output_list = 100;
 
+/*! Collective buffering hints picked by io_tune_mpi_hints() */
+static int io_mpi_hints_tuned = 0;
+static char io_cb_nodes[16];
+static char io_cb_buffer_size[16];
+
 /**
  * @brief Reads a chunk of data from an open HDF5 dataset
  *
@@ -342,9 +348,9 @@ void read_array_parallel(hid_t grp, struct io_props props, size_t N,
   char redo = 1;
   while (redo) {
 
-    /* Maximal number of elements */
+    /* Maximal number of elements, also limited by the read buffer size */
     const size_t max_chunk_size =
-        HDF5_PARALLEL_IO_MAX_BYTES / (props.dimension * typeSize);
+        io_read_chunk_length(HDF5_PARALLEL_IO_MAX_BYTES / copySize, copySize);
 
     /* Write the first chunk */
     const size_t this_chunk = (N > max_chunk_size) ? max_chunk_size : N;
@@ -1296,6 +1302,8 @@ void prepare_file(struct engine* e, const char* fileName,
     io_write_attribute_s(h_grp, "OutputType", "SubSampled");
     io_write_attribute(h_grp, "SubSampleFractions", FLOAT, subsample_fraction,
                        swift_type_count);
+    io_write_attribute_i(h_grp, "SubSampleSameParticles",
+                         e->snapshot_subsample_same_particles);
   } else {
     io_write_attribute_s(h_grp, "OutputType", "FullVolume");
   }
@@ -1439,6 +1447,101 @@ void prepare_file(struct engine* e, const char* fileName,
   H5Pclose(h_props);
 }
 
+/**
+ * @brief Pick the collective buffering hints by timing some test writes.
+ *
+ * Each rank writes a fixed amount of data to a test file next to the
+ * snapshot, for a few combinations of the number of aggregators
+ * ("cb_nodes") and the size of their buffers ("cb_buffer_size"). The
+ * fastest combination is then used for all the snapshots of this run.
+ *
+ * @param fileName The name of the snapshot about to be written.
+ * @param mpi_rank The rank of this node.
+ * @param mpi_size The number of MPI ranks.
+ * @param comm The MPI communicator.
+ * @param verbose Are we talkative?
+ */
+static void io_tune_mpi_hints(const char* fileName, const int mpi_rank,
+                              const int mpi_size, MPI_Comm comm,
+                              const int verbose) {
+
+  const ticks tic = getticks();
+
+  /* Amount of data written by each rank in each test */
+  const int test_size = 16 * 1024 * 1024;
+  char* buffer = (char*)malloc(test_size);
+  if (buffer == NULL) error("Error allocating the MPI-IO test buffer");
+  memset(buffer, 0, test_size);
+
+  char test_name[FILENAME_BUFFER_SIZE + 8];
+  snprintf(test_name, sizeof(test_name), "%s.tune", fileName);
+
+  /* Candidate numbers of aggregators: all, half, a quarter... of the ranks */
+  int cb_nodes[4];
+  int nr_cb_nodes = 0;
+  for (int n = mpi_size; n >= 1 && nr_cb_nodes < 4; n /= 2)
+    cb_nodes[nr_cb_nodes++] = n;
+
+  /* Candidate buffer sizes in MB */
+  const int cb_buffer_size_MB[3] = {4, 16, 64};
+
+  double best_rate = 0.;
+  for (int i = 0; i < nr_cb_nodes; ++i) {
+    for (int j = 0; j < 3; ++j) {
+
+      char nodes[16], size[16];
+      snprintf(nodes, sizeof(nodes), "%d", cb_nodes[i]);
+      snprintf(size, sizeof(size), "%d", cb_buffer_size_MB[j] * 1024 * 1024);
+
+      MPI_Info info;
+      MPI_Info_create(&info);
+      MPI_Info_set(info, "romio_cb_write", "enable");
+      MPI_Info_set(info, "romio_ds_write", "disable");
+      MPI_Info_set(info, "cb_nodes", nodes);
+      MPI_Info_set(info, "cb_buffer_size", size);
+
+      MPI_File fh;
+      if (MPI_File_open(comm, test_name, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                        info, &fh) != MPI_SUCCESS)
+        error("Error opening the MPI-IO test file '%s'.", test_name);
+
+      MPI_Barrier(comm);
+      const double t0 = MPI_Wtime();
+      MPI_File_write_at_all(fh, (MPI_Offset)mpi_rank * test_size, buffer,
+                            test_size, MPI_BYTE, MPI_STATUS_IGNORE);
+      MPI_File_sync(fh);
+      MPI_File_close(&fh);
+      double t = MPI_Wtime() - t0;
+      MPI_Info_free(&info);
+
+      /* All the ranks need to agree on the outcome */
+      MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE, MPI_MAX, comm);
+      const double rate = (double)test_size * mpi_size / t / 1e9;
+
+      if (verbose && mpi_rank == 0)
+        message("cb_nodes=%s cb_buffer_size=%dMB: %.3f GB/s", nodes,
+                cb_buffer_size_MB[j], rate);
+
+      if (rate > best_rate) {
+        best_rate = rate;
+        strcpy(io_cb_nodes, nodes);
+        strcpy(io_cb_buffer_size, size);
+      }
+    }
+  }
+
+  if (mpi_rank == 0) MPI_File_delete(test_name, MPI_INFO_NULL);
+  free(buffer);
+  io_mpi_hints_tuned = 1;
+
+  if (mpi_rank == 0)
+    message(
+        "Using cb_nodes=%s and cb_buffer_size=%s for the snapshots (%.3f "
+        "GB/s). Tuning took %.3f %s.",
+        io_cb_nodes, io_cb_buffer_size, best_rate,
+        clocks_from_ticks(getticks() - tic), clocks_getunit());
+}
+
 /**
  * @brief Writes an HDF5 output file (GADGET-3 type) with
  * its XMF descriptor
@@ -1500,6 +1603,9 @@ void write_output_parallel(struct engine* e,
   const size_t Nsinks = e->s->nr_sinks;
   const size_t Nblackholes = e->s->nr_bparts;
 
+  /* Used to report the achieved bandwidth */
+  const ticks tic_write = getticks();
+
 #ifdef IO_SPEED_MEASUREMENT
   ticks tic = getticks();
 #endif
@@ -1551,6 +1657,9 @@ void write_output_parallel(struct engine* e,
     if (!subsample[i]) subsample_fraction[i] = 1.f;
   }
 
+  /* Seed of the selection of the sub-sampled particles */
+  const int subsample_seed = io_get_subsample_seed(e);
+
   /* Total number of fields to write per ptype */
   int numFields[swift_type_count] = {0};
   for (int ptype = 0; ptype < swift_type_count; ++ptype) {
@@ -1565,7 +1674,7 @@ void write_output_parallel(struct engine* e,
   if (subsample[swift_type_gas]) {
     Ngas_written = io_count_gas_to_write(e->s, /*subsample=*/1,
                                          subsample_fraction[swift_type_gas],
-                                         e->snapshot_output_count);
+                                         subsample_seed);
   } else {
     Ngas_written =
         e->s->nr_parts - e->s->nr_inhibited_parts - e->s->nr_extra_parts;
@@ -1574,7 +1683,7 @@ void write_output_parallel(struct engine* e,
   if (subsample[swift_type_stars]) {
     Nstars_written = io_count_stars_to_write(
         e->s, /*subsample=*/1, subsample_fraction[swift_type_stars],
-        e->snapshot_output_count);
+        subsample_seed);
   } else {
     Nstars_written =
         e->s->nr_sparts - e->s->nr_inhibited_sparts - e->s->nr_extra_sparts;
@@ -1583,7 +1692,7 @@ void write_output_parallel(struct engine* e,
   if (subsample[swift_type_black_hole]) {
     Nblackholes_written = io_count_black_holes_to_write(
         e->s, /*subsample=*/1, subsample_fraction[swift_type_black_hole],
-        e->snapshot_output_count);
+        subsample_seed);
   } else {
     Nblackholes_written =
         e->s->nr_bparts - e->s->nr_inhibited_bparts - e->s->nr_extra_bparts;
@@ -1592,7 +1701,7 @@ void write_output_parallel(struct engine* e,
   if (subsample[swift_type_sink]) {
     Nsinks_written = io_count_sinks_to_write(
         e->s, /*subsample=*/1, subsample_fraction[swift_type_sink],
-        e->snapshot_output_count);
+        subsample_seed);
   } else {
     Nsinks_written =
         e->s->nr_sinks - e->s->nr_inhibited_sinks - e->s->nr_extra_sinks;
@@ -1600,13 +1709,12 @@ void write_output_parallel(struct engine* e,
 
   Ndm_written = io_count_dark_matter_to_write(
       e->s, subsample[swift_type_dark_matter],
-      subsample_fraction[swift_type_dark_matter], e->snapshot_output_count);
+      subsample_fraction[swift_type_dark_matter], subsample_seed);
 
   if (with_DM_background) {
     Ndm_background = io_count_background_dark_matter_to_write(
         e->s, subsample[swift_type_dark_matter_background],
-        subsample_fraction[swift_type_dark_matter_background],
-        e->snapshot_output_count);
+        subsample_fraction[swift_type_dark_matter_background], subsample_seed);
   } else {
     Ndm_background = 0;
   }
@@ -1614,7 +1722,7 @@ void write_output_parallel(struct engine* e,
   if (with_neutrinos) {
     Ndm_neutrino = io_count_neutrinos_to_write(
         e->s, subsample[swift_type_neutrino],
-        subsample_fraction[swift_type_neutrino], e->snapshot_output_count);
+        subsample_fraction[swift_type_neutrino], subsample_seed);
   } else {
     Ndm_neutrino = 0;
   }
@@ -1680,8 +1788,8 @@ void write_output_parallel(struct engine* e,
   io_write_cell_offsets(h_grp_cells, e->s->cdim, e->s->dim, e->s->cells_top,
                         e->s->nr_cells, e->s->width, mpi_rank,
                         /*distributed=*/0, subsample, subsample_fraction,
-                        e->snapshot_output_count, N_total, offset, to_write,
-                        numFields, internal_units, snapshot_units);
+                        subsample_seed, N_total, offset, to_write, numFields,
+                        internal_units, snapshot_units);
 
   /* Close everything */
   if (mpi_rank == 0) {
@@ -1702,6 +1810,14 @@ void write_output_parallel(struct engine* e,
   MPI_Info_set(info, "romio_cb_write", "enable");
   MPI_Info_set(info, "romio_ds_write", "disable");
 
+  /* Use the collective buffering hints that worked best on this system */
+  if (e->snapshot_tune_mpi_hints) {
+    if (!io_mpi_hints_tuned)
+      io_tune_mpi_hints(fileName, mpi_rank, mpi_size, comm, e->verbose);
+    MPI_Info_set(info, "cb_nodes", io_cb_nodes);
+    MPI_Info_set(info, "cb_buffer_size", io_cb_buffer_size);
+  }
+
   /* Activate parallel i/o */
   hid_t h_err = H5Pset_fapl_mpio(plist_id, comm, info);
   if (h_err < 0) error("Error setting parallel i/o");
@@ -1818,7 +1934,7 @@ void write_output_parallel(struct engine* e,
           io_collect_parts_to_write(
               parts, xparts, parts_written, xparts_written,
               subsample[swift_type_gas], subsample_fraction[swift_type_gas],
-              e->snapshot_output_count, Ngas, Ngas_written);
+              subsample_seed, Ngas, Ngas_written);
 
           /* Select the fields to write */
           io_select_hydro_fields(parts_written, xparts_written, with_cosmology,
@@ -1863,7 +1979,7 @@ void write_output_parallel(struct engine* e,
               gparts, e->s->gpart_group_data, gparts_written,
               gpart_group_data_written, subsample[swift_type_dark_matter],
               subsample_fraction[swift_type_dark_matter],
-              e->snapshot_output_count, Ntot, Ndm_written, with_stf);
+              subsample_seed, Ntot, Ndm_written, with_stf);
 
           /* Select the fields to write */
           io_select_dm_fields(gparts_written, gpart_group_data_written,
@@ -1898,7 +2014,7 @@ void write_output_parallel(struct engine* e,
             gpart_group_data_written,
             subsample[swift_type_dark_matter_background],
             subsample_fraction[swift_type_dark_matter_background],
-            e->snapshot_output_count, Ntot, Ndm_background, with_stf);
+            subsample_seed, Ntot, Ndm_background, with_stf);
 
         /* Select the fields to write */
         io_select_dm_fields(gparts_written, gpart_group_data_written, with_fof,
@@ -1930,8 +2046,8 @@ void write_output_parallel(struct engine* e,
         io_collect_gparts_neutrino_to_write(
             gparts, e->s->gpart_group_data, gparts_written,
             gpart_group_data_written, subsample[swift_type_neutrino],
-            subsample_fraction[swift_type_neutrino], e->snapshot_output_count,
-            Ntot, Ndm_neutrino, with_stf);
+            subsample_fraction[swift_type_neutrino], subsample_seed, Ntot,
+            Ndm_neutrino, with_stf);
 
         /* Select the fields to write */
         io_select_neutrino_fields(gparts_written, gpart_group_data_written,
@@ -1963,8 +2079,8 @@ void write_output_parallel(struct engine* e,
           /* Collect the particles we want to write */
           io_collect_sinks_to_write(
               sinks, sinks_written, subsample[swift_type_sink],
-              subsample_fraction[swift_type_sink], e->snapshot_output_count,
-              Nsinks, Nsinks_written);
+              subsample_fraction[swift_type_sink], subsample_seed, Nsinks,
+              Nsinks_written);
 
           /* Select the fields to write */
           io_select_sink_fields(sinks_written, with_cosmology, with_fof,
@@ -1996,8 +2112,8 @@ void write_output_parallel(struct engine* e,
           /* Collect the particles we want to write */
           io_collect_sparts_to_write(
               sparts, sparts_written, subsample[swift_type_stars],
-              subsample_fraction[swift_type_stars], e->snapshot_output_count,
-              Nstars, Nstars_written);
+              subsample_fraction[swift_type_stars], subsample_seed, Nstars,
+              Nstars_written);
 
           /* Select the fields to write */
           io_select_star_fields(sparts_written, with_cosmology, with_fof,
@@ -2030,7 +2146,7 @@ void write_output_parallel(struct engine* e,
           io_collect_bparts_to_write(
               bparts, bparts_written, subsample[swift_type_black_hole],
               subsample_fraction[swift_type_black_hole],
-              e->snapshot_output_count, Nblackholes, Nblackholes_written);
+              subsample_seed, Nblackholes, Nblackholes_written);
 
           /* Select the fields to write */
           io_select_bh_fields(bparts_written, with_cosmology, with_fof,
@@ -2123,6 +2239,17 @@ void write_output_parallel(struct engine* e,
             clocks_getunit());
 #endif
 
+  /* Report the bandwidth achieved for the whole snapshot */
+  if (e->verbose || e->snapshot_tune_mpi_hints) {
+    MPI_Barrier(comm);
+    const double time_ms = clocks_from_ticks(getticks() - tic_write);
+    struct stat file_stat;
+    if (mpi_rank == 0 && stat(fileName, &file_stat) == 0 && time_ms > 0.)
+      message("Wrote %.3f GB in %.3f %s (%.3f GB/s).",
+              file_stat.st_size / 1e9, time_ms, clocks_getunit(),
+              file_stat.st_size / 1e9 / (time_ms / 1000.));
+  }
+
   e->snapshot_output_count++;
   if (e->snapshot_invoke_stf) e->stf_output_count++;
 }
@@ -0,0 +1,171 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "part_soa.h"
+
+/* System includes. */
+#include <stdlib.h>
+#include <strings.h>
+
+/* Local headers. */
+#include "cell.h"
+#include "engine.h"
+#include "error.h"
+#include "memuse.h"
+#include "space.h"
+
+/*! The one instance, shared by all the runners */
+struct part_soa part_soa;
+
+/**
+ * @brief Initialise the (empty) #part_soa.
+ *
+ * @param active Are we going to fill the density caches from it?
+ */
+void part_soa_init(const int active) {
+
+  bzero(&part_soa, sizeof(struct part_soa));
+  part_soa.active = active;
+}
+
+/**
+ * @brief Frees the memory of the #part_soa.
+ */
+void part_soa_clean(void) {
+
+  struct part_soa *p = &part_soa;
+  if (p->size > 0) {
+    swift_free("part_soa", p->x);
+    swift_free("part_soa", p->y);
+    swift_free("part_soa", p->z);
+    swift_free("part_soa", p->h);
+    swift_free("part_soa", p->m);
+    swift_free("part_soa", p->vx);
+    swift_free("part_soa", p->vy);
+    swift_free("part_soa", p->vz);
+    swift_free("part_soa", p->time_bin);
+  }
+  p->x = p->y = p->z = NULL;
+  p->h = p->m = NULL;
+  p->vx = p->vy = p->vz = NULL;
+  p->time_bin = NULL;
+  p->size = 0;
+}
+
+/**
+ * @brief Allocate one array of the #part_soa.
+ *
+ * @param ptr (return) The pointer.
+ * @param size The number of bytes to allocate.
+ */
+static void part_soa_alloc(void **ptr, const size_t size) {
+
+  if (swift_memalign("part_soa", ptr, SWIFT_CACHE_ALIGNMENT, size) != 0)
+    error("Couldn't allocate the part SoA copy (%zd bytes).", size);
+}
+
+/**
+ * @brief Make sure the #part_soa has room for all the local #part.
+ *
+ * Must be called when no task is running. Growing the arrays loses their
+ * content, which is fine as this only happens after a rebuild.
+ *
+ * @param nr_parts The size of the #part array of the #space.
+ */
+void part_soa_ensure(const size_t nr_parts) {
+
+  struct part_soa *p = &part_soa;
+  if (!p->active || nr_parts <= p->size) return;
+
+  part_soa_clean();
+
+  part_soa_alloc((void **)&p->x, nr_parts * sizeof(double));
+  part_soa_alloc((void **)&p->y, nr_parts * sizeof(double));
+  part_soa_alloc((void **)&p->z, nr_parts * sizeof(double));
+  part_soa_alloc((void **)&p->h, nr_parts * sizeof(float));
+  part_soa_alloc((void **)&p->m, nr_parts * sizeof(float));
+  part_soa_alloc((void **)&p->vx, nr_parts * sizeof(float));
+  part_soa_alloc((void **)&p->vy, nr_parts * sizeof(float));
+  part_soa_alloc((void **)&p->vz, nr_parts * sizeof(float));
+  part_soa_alloc((void **)&p->time_bin, nr_parts * sizeof(timebin_t));
+  p->size = nr_parts;
+}
+
+#if defined(GADGET2_SPH) || defined(SPHENIX_SPH)
+
+/**
+ * @brief Mark the copy of a cell hierarchy as up to date.
+ *
+ * @param c The #cell.
+ * @param ti_current The current time.
+ */
+static void part_soa_stamp_rec(struct cell *c,
+                               const integertime_t ti_current) {
+
+  c->hydro.ti_soa = ti_current;
+  if (c->split)
+    for (int k = 0; k < 8; ++k)
+      if (c->progeny[k] != NULL)
+        part_soa_stamp_rec(c->progeny[k], ti_current);
+}
+
+#endif
+
+/**
+ * @brief Refresh the #part_soa copy of the #part of a freshly drifted local
+ * cell.
+ *
+ * Nothing touches the positions, velocities, smoothing lengths, masses and
+ * time bins of the #part between the drift and the end of the density tasks
+ * of a step (feedback and star formation come after the kick2, the ghost
+ * after all the density tasks of the cell), so the copy is exact for the
+ * density loop. The ghost changing h afterwards is why nothing else reads it.
+ *
+ * Only the schemes whose density caches read #part directly (Gadget-2 and
+ * SPHENIX) have anything to copy.
+ *
+ * @param e The #engine.
+ * @param c The #cell.
+ */
+void part_soa_fill(const struct engine *e, struct cell *c) {
+
+#if defined(GADGET2_SPH) || defined(SPHENIX_SPH)
+
+  struct part_soa *p = &part_soa;
+  if (!p->active || c->nodeID != e->nodeID || c->hydro.count == 0) return;
+
+  const struct part *parts = c->hydro.parts;
+  const int count = c->hydro.count;
+  const size_t offset = parts - e->s->parts;
+
+  /* Not room for it (yet), the caches will read the parts directly */
+  if (offset + count > p->size) return;
+
+  double *restrict x = p->x + offset;
+  double *restrict y = p->y + offset;
+  double *restrict z = p->z + offset;
+  float *restrict h = p->h + offset;
+  float *restrict m = p->m + offset;
+  float *restrict vx = p->vx + offset;
+  float *restrict vy = p->vy + offset;
+  float *restrict vz = p->vz + offset;
+  timebin_t *restrict time_bin = p->time_bin + offset;
+
+  for (int i = 0; i < count; ++i) {
+    const struct part *pi = &parts[i];
+    x[i] = pi->x[0];
+    y[i] = pi->x[1];
+    z[i] = pi->x[2];
+    h[i] = pi->h;
+    m[i] = pi->mass;
+    vx[i] = pi->v[0];
+    vy[i] = pi->v[1];
+    vz[i] = pi->v[2];
+    time_bin[i] = pi->time_bin;
+  }
+
+  part_soa_stamp_rec(c, e->ti_current);
+
+#endif
+}
@@ -0,0 +1,58 @@
+#ifndef SWIFT_PART_SOA_H
+#define SWIFT_PART_SOA_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* System includes. */
+#include <stddef.h>
+
+/* Local headers */
+#include "timeline.h"
+
+/* Forward declarations */
+struct cell;
+struct engine;
+
+/**
+ * @brief A host-side copy of the fields of the local #part the vectorised
+ * density caches read, in SoA form and indexed like space->parts.
+ *
+ * The drift task of a cell refreshes its particles once per step, after
+ * which all the density caches of the step are filled from these few
+ * compact arrays rather than by gathering from the whole #part.
+ */
+struct part_soa {
+
+  /*! #part positions. */
+  double *x, *y, *z;
+
+  /*! #part smoothing lengths. */
+  float *h;
+
+  /*! #part masses. */
+  float *m;
+
+  /*! #part velocities. */
+  float *vx, *vy, *vz;
+
+  /*! #part time bins. */
+  timebin_t *time_bin;
+
+  /*! Number of #part we have room for. */
+  size_t size;
+
+  /*! Are we using the copy at all? */
+  int active;
+};
+
+/* The one instance */
+extern struct part_soa part_soa;
+
+/* Function prototypes. */
+void part_soa_init(const int active);
+void part_soa_clean(void);
+void part_soa_ensure(const size_t nr_parts);
+void part_soa_fill(const struct engine *e, struct cell *c);
+
+#endif /* SWIFT_PART_SOA_H */
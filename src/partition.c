@@ -68,13 +68,15 @@ const char *initial_partition_name[] = {
     "axis aligned grids of cells", "vectorized point associated cells",
     "memory balanced, using particle weighted cells",
     "similar sized regions, using unweighted cells",
-    "memory and edge balanced cells using particle weights"};
+    "memory and edge balanced cells using particle weights",
+    "memory balanced cells along a Peano-Hilbert curve"};
 
 /* Simple descriptions of repartition types for reports. */
 const char *repartition_name[] = {
     "none", "edge and vertex task cost weights", "task cost edge weights",
     "memory balanced, using particle vertex weights",
-    "vertex task costs and edge delta timebin weights"};
+    "vertex task costs and edge delta timebin weights",
+    "vertex task costs along a Peano-Hilbert curve"};
 
 /* Local functions, if needed. */
 static int check_complete(struct space *s, int verbose, int nregions);
@@ -90,6 +92,11 @@ static double repartition_costs[task_type_count][task_subtype_count];
 static int repart_init_fixed_costs(void);
 #endif
 
+#if defined(WITH_MPI)
+/*! Relative capacities of the ranks, NULL if they are all the same. */
+static float *partition_rank_capacities = NULL;
+#endif
+
 /*  Vectorisation support */
 /*  ===================== */
 
@@ -675,6 +682,30 @@ void permute_regions(int *newlist, int *oldlist, int nregions, int ncells,
 }
 #endif
 
+#if defined(WITH_MPI) && (defined(HAVE_METIS) || defined(HAVE_PARMETIS))
+/**
+ * @brief Fill the target fractions of the total weight for each region.
+ *
+ * These are the capacities of the ranks given by the user, when any, so
+ * that faster ranks get more work, and an equal share otherwise.
+ *
+ * @param nregions the number of regions.
+ * @param tpwgts on exit the target fractions, sizeof nregions.
+ */
+static void partition_target_weights(int nregions, real_t *tpwgts) {
+
+  if (partition_rank_capacities == NULL) {
+    for (int i = 0; i < nregions; i++) tpwgts[i] = 1.0 / (real_t)nregions;
+    return;
+  }
+
+  double sum = 0.0;
+  for (int i = 0; i < nregions; i++) sum += partition_rank_capacities[i];
+  for (int i = 0; i < nregions; i++)
+    tpwgts[i] = partition_rank_capacities[i] / sum;
+}
+#endif
+
 #if defined(WITH_MPI) && defined(HAVE_PARMETIS)
 /**
  * @brief Partition the given space into a number of connected regions using
@@ -699,6 +730,9 @@ void permute_regions(int *newlist, int *oldlist, int nregions, int ncells,
  *        of cells * 26 if used, NULL for unit weights. Need to be packed
  *        in CSR format, so same as adjncy array. Need to be in the range of
  *        idx_t.
+ * @param vertexs the cost of moving each cell to another rank, sizeof number
+ *        of cells if used, NULL for unit costs. Only used by the adaptive
+ *        repartition. Need to be in the range of idx_t.
  * @param refine whether to refine an existing partition, or create a new one.
  * @param adaptive whether to use an adaptive reparitition of an existing
  *        partition or simple refinement. Adaptive repartition is controlled
@@ -711,8 +745,8 @@ void permute_regions(int *newlist, int *oldlist, int nregions, int ncells,
  *        the old partition on entry.
  */
 static void pick_parmetis(int nodeID, struct space *s, int nregions,
-                          double *vertexw, double *edgew, int refine,
-                          int adaptive, float itr, int *celllist) {
+                          double *vertexw, double *edgew, double *vertexs,
+                          int refine, int adaptive, float itr, int *celllist) {
 
   int res;
   MPI_Comm comm;
@@ -777,19 +811,24 @@ static void pick_parmetis(int nodeID, struct space *s, int nregions,
     if ((weights_e = (idx_t *)malloc(26 * sizeof(idx_t) * nverts)) == NULL)
       error("Failed to allocate edge weights array");
 
+  idx_t *sizes_v = NULL;
+  if (vertexs != NULL)
+    if ((sizes_v = (idx_t *)malloc(sizeof(idx_t) * nverts)) == NULL)
+      error("Failed to allocate vertex sizes array");
+
   idx_t *regionid = NULL;
   if ((regionid = (idx_t *)malloc(sizeof(idx_t) * (nverts + 1))) == NULL)
     error("Failed to allocate regionid array");
 
   /* Prepare MPI requests for the asynchronous communications */
   MPI_Request *reqs;
-  if ((reqs = (MPI_Request *)malloc(sizeof(MPI_Request) * 5 * nregions)) ==
+  if ((reqs = (MPI_Request *)malloc(sizeof(MPI_Request) * 6 * nregions)) ==
       NULL)
     error("Failed to allocate MPI request list.");
-  for (int k = 0; k < 5 * nregions; k++) reqs[k] = MPI_REQUEST_NULL;
+  for (int k = 0; k < 6 * nregions; k++) reqs[k] = MPI_REQUEST_NULL;
 
   MPI_Status *stats;
-  if ((stats = (MPI_Status *)malloc(sizeof(MPI_Status) * 5 * nregions)) == NULL)
+  if ((stats = (MPI_Status *)malloc(sizeof(MPI_Status) * 6 * nregions)) == NULL)
     error("Failed to allocate MPI status list.");
 
   /* Only use one rank to organize everything. */
@@ -816,6 +855,23 @@ static void pick_parmetis(int nodeID, struct space *s, int nregions,
           NULL)
         error("Failed to allocate full edge weights array");
 
+    idx_t *full_sizes_v = NULL;
+    if (sizes_v != NULL) {
+      if ((full_sizes_v = (idx_t *)malloc(sizeof(idx_t) * ncells)) == NULL)
+        error("Failed to allocate full vertex sizes array");
+
+      /* Keep the sum in the range of idx_t, every cell costs something
+       * to move. */
+      double sum = 0.0;
+      for (int k = 0; k < ncells; k++) sum += vertexs[k];
+      const double scale =
+          (sum > (double)IDX_MAX) ? (double)(IDX_MAX - 1000) / sum : 1.0;
+      for (int k = 0; k < ncells; k++) {
+        const double size = vertexs[k] * scale;
+        full_sizes_v[k] = size > 1 ? size : 1;
+      }
+    }
+
     idx_t *full_regionid = NULL;
     if (refine) {
       if ((full_regionid = (idx_t *)malloc(sizeof(idx_t) * ncells)) == NULL)
@@ -921,23 +977,28 @@ static void pick_parmetis(int nodeID, struct space *s, int nregions,
           memcpy(weights_e, &full_weights_e[j2], sizeof(idx_t) * nedge);
         if (weights_v != NULL)
           memcpy(weights_v, &full_weights_v[j3], sizeof(idx_t) * nvt);
+        if (sizes_v != NULL)
+          memcpy(sizes_v, &full_sizes_v[j3], sizeof(idx_t) * nvt);
         if (refine) memcpy(regionid, full_regionid, sizeof(idx_t) * nvt);
 
       } else {
         res = MPI_Isend(&full_xadj[j1], nvt + 1, IDX_T, rank, 0, comm,
-                        &reqs[5 * rank + 0]);
+                        &reqs[6 * rank + 0]);
         if (res == MPI_SUCCESS)
           res = MPI_Isend(&full_adjncy[j2], nvt * 26, IDX_T, rank, 1, comm,
-                          &reqs[5 * rank + 1]);
+                          &reqs[6 * rank + 1]);
         if (res == MPI_SUCCESS && weights_e != NULL)
           res = MPI_Isend(&full_weights_e[j2], nvt * 26, IDX_T, rank, 2, comm,
-                          &reqs[5 * rank + 2]);
+                          &reqs[6 * rank + 2]);
         if (res == MPI_SUCCESS && weights_v != NULL)
           res = MPI_Isend(&full_weights_v[j3], nvt, IDX_T, rank, 3, comm,
-                          &reqs[5 * rank + 3]);
+                          &reqs[6 * rank + 3]);
         if (refine && res == MPI_SUCCESS)
           res = MPI_Isend(&full_regionid[j3], nvt, IDX_T, rank, 4, comm,
-                          &reqs[5 * rank + 4]);
+                          &reqs[6 * rank + 4]);
+        if (res == MPI_SUCCESS && sizes_v != NULL)
+          res = MPI_Isend(&full_sizes_v[j3], nvt, IDX_T, rank, 5, comm,
+                          &reqs[6 * rank + 5]);
         if (res != MPI_SUCCESS) mpi_error(res, "Failed to send graph data");
       }
       j1 += nvt + 1;
@@ -949,8 +1010,8 @@ static void pick_parmetis(int nodeID, struct space *s, int nregions,
 
     /* Wait for all sends to complete. */
     int result;
-    if ((result = MPI_Waitall(5 * nregions, reqs, stats)) != MPI_SUCCESS) {
-      for (int k = 0; k < 5 * nregions; k++) {
+    if ((result = MPI_Waitall(6 * nregions, reqs, stats)) != MPI_SUCCESS) {
+      for (int k = 0; k < 6 * nregions; k++) {
         char buff[MPI_MAX_ERROR_STRING];
         MPI_Error_string(stats[k].MPI_ERROR, buff, &result);
         message("send request from source %i, tag %i has error '%s'.",
@@ -962,6 +1023,7 @@ static void pick_parmetis(int nodeID, struct space *s, int nregions,
     /* Clean up. */
     if (weights_v != NULL) free(full_weights_v);
     if (weights_e != NULL) free(full_weights_e);
+    if (sizes_v != NULL) free(full_sizes_v);
     free(full_xadj);
     free(std_xadj);
     free(full_adjncy);
@@ -979,12 +1041,14 @@ static void pick_parmetis(int nodeID, struct space *s, int nregions,
       res = MPI_Irecv(weights_v, nverts, IDX_T, 0, 3, comm, &reqs[3]);
     if (refine && res == MPI_SUCCESS)
       res += MPI_Irecv((void *)regionid, nverts, IDX_T, 0, 4, comm, &reqs[4]);
+    if (res == MPI_SUCCESS && sizes_v != NULL)
+      res = MPI_Irecv(sizes_v, nverts, IDX_T, 0, 5, comm, &reqs[5]);
     if (res != MPI_SUCCESS) mpi_error(res, "Failed to receive graph data");
 
     /* Wait for all recvs to complete. */
     int result;
-    if ((result = MPI_Waitall(5, reqs, stats)) != MPI_SUCCESS) {
-      for (int k = 0; k < 5; k++) {
+    if ((result = MPI_Waitall(6, reqs, stats)) != MPI_SUCCESS) {
+      for (int k = 0; k < 6; k++) {
         char buff[MPI_MAX_ERROR_STRING];
         MPI_Error_string(stats[k].MPI_ERROR, buff, &result);
         message("recv request from source %i, tag %i has error '%s'.",
@@ -994,11 +1058,11 @@ static void pick_parmetis(int nodeID, struct space *s, int nregions,
     }
   }
 
-  /* Set up the tpwgts array. This is just 1/nregions. */
+  /* Set up the tpwgts array from the capacities of the ranks. */
   real_t *tpwgts;
   if ((tpwgts = (real_t *)malloc(sizeof(real_t) * nregions)) == NULL)
     error("Failed to allocate tpwgts array");
-  for (int i = 0; i < nregions; i++) tpwgts[i] = 1.0 / (real_t)nregions;
+  partition_target_weights(nregions, tpwgts);
 
   /* Common parameters. */
   idx_t options[4];
@@ -1031,7 +1095,7 @@ static void pick_parmetis(int nodeID, struct space *s, int nregions,
       /* Balance between cuts and movement. */
       real_t itr_real_t = itr;
       if (ParMETIS_V3_AdaptiveRepart(
-              vtxdist, xadj, adjncy, weights_v, NULL, weights_e, &wgtflag,
+              vtxdist, xadj, adjncy, weights_v, sizes_v, weights_e, &wgtflag,
               &numflag, &ncon, &nparts, tpwgts, ubvec, &itr_real_t, options,
               &edgecut, regionid, &comm) != METIS_OK)
         error("Call to ParMETIS_V3_AdaptiveRepart failed.");
@@ -1178,6 +1242,7 @@ static void pick_parmetis(int nodeID, struct space *s, int nregions,
   free(stats);
   if (weights_v != NULL) free(weights_v);
   if (weights_e != NULL) free(weights_e);
+  if (sizes_v != NULL) free(sizes_v);
   free(vtxdist);
   free(tpwgts);
   free(xadj);
@@ -1321,10 +1386,17 @@ static void pick_metis(int nodeID, struct space *s, int nregions,
     /*dumpMETISGraph("metis_graph", idx_ncells, one, xadj, adjncy, weights_v,
                    NULL, weights_e);*/
 
+    /* Share of the total weight each rank should get. */
+    real_t *tpwgts;
+    if ((tpwgts = (real_t *)malloc(sizeof(real_t) * nregions)) == NULL)
+      error("Failed to allocate tpwgts array");
+    partition_target_weights(nregions, tpwgts);
+
     if (METIS_PartGraphKway(&idx_ncells, &one, xadj, adjncy, weights_v, NULL,
-                            weights_e, &idx_nregions, NULL, NULL, options,
+                            weights_e, &idx_nregions, tpwgts, NULL, options,
                             &objval, regionid) != METIS_OK)
       error("Call to METIS_PartGraphKway failed.");
+    free(tpwgts);
 
     /* Check that the regionids are ok. */
     for (int k = 0; k < ncells; k++) {
@@ -1351,6 +1423,181 @@ static void pick_metis(int nodeID, struct space *s, int nregions,
 
 #if defined(WITH_MPI) && (defined(HAVE_METIS) || defined(HAVE_PARMETIS))
 
+/* Helper struct for ordering the cells along the space-filling curve. */
+struct sfc_key {
+  uint64_t key;
+  int cid;
+};
+
+/**
+ * @brief Sort callback for the cell keys, the cell index breaks ties so the
+ *        order is the same on all the ranks.
+ */
+static int sfc_keycmp(const void *p1, const void *p2) {
+  const struct sfc_key *k1 = (const struct sfc_key *)p1;
+  const struct sfc_key *k2 = (const struct sfc_key *)p2;
+  if (k1->key != k2->key) return (k1->key < k2->key) ? -1 : 1;
+  return k1->cid - k2->cid;
+}
+
+/**
+ * @brief Position of a cell along a 3D Peano-Hilbert curve.
+ *
+ * Uses the transposition algorithm of Skilling (2004, AIP Conf. Proc. 707,
+ * 381).
+ *
+ * @param x the integer coordinates of the cell, overwritten.
+ * @param bits the number of bits per coordinate, at most 21.
+ */
+static uint64_t sfc_hilbert_key(unsigned int x[3], int bits) {
+
+  const unsigned int m = 1u << (bits - 1);
+
+  /* Inverse undo. */
+  for (unsigned int q = m; q > 1; q >>= 1) {
+    const unsigned int p = q - 1;
+    for (int i = 0; i < 3; i++) {
+      if (x[i] & q) {
+        x[0] ^= p;
+      } else {
+        const unsigned int t = (x[0] ^ x[i]) & p;
+        x[0] ^= t;
+        x[i] ^= t;
+      }
+    }
+  }
+
+  /* Gray encode. */
+  for (int i = 1; i < 3; i++) x[i] ^= x[i - 1];
+  unsigned int t = 0;
+  for (unsigned int q = m; q > 1; q >>= 1)
+    if (x[2] & q) t ^= q - 1;
+  for (int i = 0; i < 3; i++) x[i] ^= t;
+
+  /* Interleave the transposed bits. */
+  uint64_t key = 0;
+  for (int b = bits - 1; b >= 0; b--)
+    for (int i = 0; i < 3; i++) key = (key << 1) | ((x[i] >> b) & 1);
+  return key;
+}
+
+/**
+ * @brief Partition the given space by cutting a Peano-Hilbert curve through
+ *        the top-level cells into pieces of equal weight.
+ *
+ * All ranks order the cells along the curve, each then sums the weights of
+ * its own share of the curve and after a prefix sum over the ranks finds the
+ * cuts that fall in it. No graph is needed and the regions are compact, so
+ * this is a lot cheaper than METIS for large numbers of cells, at the cost
+ * of some balance. Any rank capacities are respected.
+ *
+ * @param nodeID the rank of our node.
+ * @param s the space of cells to partition.
+ * @param nregions the number of regions required in the partition.
+ * @param vertexw weights for the cells, sizeof number of cells if used,
+ *        NULL for unit weights. Must be the same on all ranks.
+ * @param celllist on exit this contains the ids of the selected regions,
+ *        sizeof number of cells.
+ */
+static void pick_sfc(int nodeID, struct space *s, int nregions,
+                     const double *vertexw, int *celllist) {
+
+  const int ncells = s->cdim[0] * s->cdim[1] * s->cdim[2];
+  if (ncells < nregions)
+    error("Fewer top-level cells (%d) than ranks (%d)", ncells, nregions);
+
+  /* Bits needed per coordinate. */
+  const int maxdim = max3(s->cdim[0], s->cdim[1], s->cdim[2]);
+  int bits = 1;
+  while ((1 << bits) < maxdim) bits++;
+  if (bits > 21) error("Too many top-level cells for a 64 bit curve key");
+
+  /* Order the cells along the curve. */
+  struct sfc_key *keys =
+      (struct sfc_key *)malloc(sizeof(struct sfc_key) * ncells);
+  if (keys == NULL) error("Failed to allocate curve keys");
+  for (int i = 0; i < s->cdim[0]; i++) {
+    for (int j = 0; j < s->cdim[1]; j++) {
+      for (int k = 0; k < s->cdim[2]; k++) {
+        const int cid = cell_getid(s->cdim, i, j, k);
+        unsigned int x[3] = {(unsigned int)i, (unsigned int)j,
+                             (unsigned int)k};
+        keys[cid].key = sfc_hilbert_key(x, bits);
+        keys[cid].cid = cid;
+      }
+    }
+  }
+  qsort(keys, ncells, sizeof(struct sfc_key), sfc_keycmp);
+
+  /* Our share of the curve. */
+  const int first = (int)((long long)ncells * nodeID / nregions);
+  const int last = (int)((long long)ncells * (nodeID + 1) / nregions);
+
+  double local = 0.0;
+  for (int n = first; n < last; n++)
+    local += (vertexw != NULL) ? vertexw[keys[n].cid] : 1.0;
+
+  /* Prefix sum of the weights along the curve. */
+  double offset = 0.0;
+  int res = MPI_Exscan(&local, &offset, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  if (res != MPI_SUCCESS) mpi_error(res, "Failed to scan curve weights");
+  if (nodeID == 0) offset = 0.0;
+  double total = 0.0;
+  res = MPI_Allreduce(&local, &total, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  if (res != MPI_SUCCESS) mpi_error(res, "Failed to reduce curve weights");
+  const int unit = (vertexw == NULL || total <= 0.0);
+  if (unit) {
+    offset = first;
+    total = ncells;
+  }
+
+  /* Target fraction of the weight for each region. */
+  double *bounds = (double *)malloc(sizeof(double) * (nregions + 1));
+  if (bounds == NULL) error("Failed to allocate region bounds");
+  bounds[0] = 0.0;
+  for (int r = 0; r < nregions; r++)
+    bounds[r + 1] = bounds[r] + ((partition_rank_capacities != NULL)
+                                     ? partition_rank_capacities[r]
+                                     : 1.0);
+  for (int r = 1; r <= nregions; r++) bounds[r] *= total / bounds[nregions];
+
+  /* Each region starts at the first cell whose weight midpoint reaches its
+   * bound, find those in our share. Cuts made by the earlier ranks also
+   * match our first cell, but the reduction keeps the smallest. */
+  int *cuts = (int *)malloc(sizeof(int) * (nregions + 1));
+  if (cuts == NULL) error("Failed to allocate curve cuts");
+  for (int r = 0; r <= nregions; r++) cuts[r] = ncells;
+  double sum = offset;
+  int reg = 1;
+  for (int n = first; n < last; n++) {
+    const double w = unit ? 1.0 : vertexw[keys[n].cid];
+    while (reg < nregions && bounds[reg] <= sum + 0.5 * w) cuts[reg++] = n;
+    sum += w;
+  }
+  free(bounds);
+
+  res = MPI_Allreduce(MPI_IN_PLACE, cuts, nregions + 1, MPI_INT, MPI_MIN,
+                      MPI_COMM_WORLD);
+  if (res != MPI_SUCCESS) mpi_error(res, "Failed to reduce curve cuts");
+
+  /* Make sure every region gets at least one cell. */
+  cuts[0] = 0;
+  cuts[nregions] = ncells;
+  for (int r = 1; r < nregions; r++)
+    if (cuts[r] <= cuts[r - 1]) cuts[r] = cuts[r - 1] + 1;
+  for (int r = nregions - 1; r > 0; r--)
+    if (cuts[r] >= cuts[r + 1]) cuts[r] = cuts[r + 1] - 1;
+
+  for (int r = 0; r < nregions; r++)
+    for (int n = cuts[r]; n < cuts[r + 1]; n++) celllist[keys[n].cid] = r;
+
+  free(cuts);
+  free(keys);
+}
+#endif
+
+#if defined(WITH_MPI) && (defined(HAVE_METIS) || defined(HAVE_PARMETIS))
+
 /* Helper struct for partition_gather weights. */
 struct weights_mapper_data {
   double *weights_e;
@@ -1447,7 +1694,6 @@ void partition_gather_weights(void *map_data, int num_elements,
         t->type == task_type_stars_ghost ||
         t->type == task_type_bh_density_ghost ||
         t->type == task_type_bh_swallow_ghost2 ||
-        t->type == task_type_neutrino_weight ||
         t->type == task_type_sink_formation || t->type == task_type_rt_ghost1 ||
         t->type == task_type_rt_ghost2 || t->type == task_type_rt_tchem) {
 
@@ -1536,6 +1782,122 @@ void partition_gather_weights(void *map_data, int num_elements,
   }
 }
 
+/**
+ * @brief Data for sorting the cells to be moved by a repartition.
+ */
+struct partition_move {
+  double load;
+  int cid;
+};
+
+/**
+ * @brief Sort the moves by decreasing load of the rank the cell leaves, then
+ *        by cell index so that all ranks agree.
+ */
+static int partition_movecmp(const void *p1, const void *p2) {
+  const struct partition_move *m1 = (const struct partition_move *)p1;
+  const struct partition_move *m2 = (const struct partition_move *)p2;
+  if (m1->load != m2->load) return (m1->load < m2->load) ? 1 : -1;
+  return m1->cid - m2->cid;
+}
+
+/**
+ * @brief Limit the fraction of the particle memory a new partition moves
+ *        between the ranks.
+ *
+ * Only the moves of cells leaving the most loaded ranks are kept, up to the
+ * maximal fraction given by the user, the other cells stay where they are.
+ * Successive repartitions then move towards the new partition in steps of
+ * bounded cost. If a rank would end up without cells the current partition
+ * is kept.
+ *
+ * @param repartition the partition struct of the local engine, its celllist
+ *        holds the new partition on entry and the bounded one on exit.
+ * @param nodeID our nodeID.
+ * @param nr_nodes the number of nodes.
+ * @param s the space of cells holding our local particles.
+ * @param sizes the memory of the particles in each cell.
+ * @param loads the weight of each cell, NULL to use the sizes.
+ */
+static void partition_bound_migration(struct repartition *repartition,
+                                      int nodeID, int nr_nodes,
+                                      struct space *s, const double *sizes,
+                                      const double *loads) {
+
+  const int nr_cells = s->nr_cells;
+  const struct cell *cells = s->cells_top;
+  int *celllist = repartition->celllist;
+  if (loads == NULL) loads = sizes;
+
+  /* Current load of each rank and what the new partition moves. */
+  double *rank_loads = (double *)calloc(nr_nodes, sizeof(double));
+  if (rank_loads == NULL) error("Failed to allocate rank loads.");
+  double total = 0.0;
+  double moved = 0.0;
+  int nr_moves = 0;
+  for (int k = 0; k < nr_cells; k++) {
+    rank_loads[cells[k].nodeID] += loads[k];
+    total += sizes[k];
+    if (celllist[k] != cells[k].nodeID) {
+      moved += sizes[k];
+      nr_moves++;
+    }
+  }
+
+  const double budget = repartition->max_migration * total;
+  if (moved <= budget) {
+    free(rank_loads);
+    return;
+  }
+
+  /* Too much, keep the moves off the most loaded ranks first. */
+  struct partition_move *moves = (struct partition_move *)malloc(
+      nr_moves * sizeof(struct partition_move));
+  if (moves == NULL) error("Failed to allocate cell moves.");
+  for (int k = 0, m = 0; k < nr_cells; k++) {
+    if (celllist[k] != cells[k].nodeID) {
+      moves[m].load = rank_loads[cells[k].nodeID];
+      moves[m].cid = k;
+      m++;
+    }
+  }
+  qsort(moves, nr_moves, sizeof(struct partition_move), partition_movecmp);
+
+  double kept = 0.0;
+  int nr_kept = 0;
+  for (int m = 0; m < nr_moves; m++) {
+    const int cid = moves[m].cid;
+    if (kept + sizes[cid] <= budget) {
+      kept += sizes[cid];
+      nr_kept++;
+    } else {
+      celllist[cid] = cells[cid].nodeID;
+    }
+  }
+  free(moves);
+  free(rank_loads);
+
+  /* All the ranks need some cells. */
+  int *present = (int *)calloc(nr_nodes, sizeof(int));
+  if (present == NULL) error("Failed to allocate rank cell counts.");
+  for (int k = 0; k < nr_cells; k++) present[celllist[k]]++;
+  int failed = 0;
+  for (int i = 0; i < nr_nodes; i++)
+    if (!present[i]) failed = 1;
+  free(present);
+
+  if (failed) {
+    if (nodeID == 0)
+      message(
+          "WARNING: bounding the migration emptied a rank, keeping the "
+          "current partition");
+    for (int k = 0; k < nr_cells; k++) celllist[k] = cells[k].nodeID;
+  } else if (nodeID == 0) {
+    message("bounded migration: moving %d of %d cells (%.1f%% of %.1f%%).",
+            nr_kept, nr_moves, 100.0 * kept / total, 100.0 * moved / total);
+  }
+}
+
 /**
  * @brief Repartition the cells amongst the nodes using weights of
  *        various kinds.
@@ -1626,6 +1988,19 @@ static void repart_edge_metis(int vweights, int eweights, int timebins,
     if (res != MPI_SUCCESS) mpi_error(res, "Failed to allreduce edge weights.");
   }
 
+  /* The particle memory of the cells is the cost of moving them, both for
+   * the adaptive repartition and for bounding the migration. */
+  double *sizes = NULL;
+  int with_sizes = repartition->max_migration < 1.f;
+#ifdef HAVE_PARMETIS
+  if (!repartition->usemetis && repartition->adaptive) with_sizes = 1;
+#endif
+  if (with_sizes) {
+    if ((sizes = (double *)malloc(sizeof(double) * nr_cells)) == NULL)
+      error("Failed to allocate cell sizes.");
+    accumulate_sizes(s, s->e->verbose, sizes);
+  }
+
   /* Allocate cell list for the partition. If not already done. */
 #ifdef HAVE_PARMETIS
   int refine = 1;
@@ -1707,18 +2082,23 @@ static void repart_edge_metis(int vweights, int eweights, int timebins,
   }
 
   /* And repartition/ partition, using both weights or not as requested. */
+  if (repartition->type == REPART_SFC_VERTEX_COSTS) {
+    pick_sfc(nodeID, s, nr_nodes, weights_v, repartition->celllist);
+  } else {
 #ifdef HAVE_PARMETIS
-  if (repartition->usemetis) {
+    if (repartition->usemetis) {
+      pick_metis(nodeID, s, nr_nodes, weights_v, weights_e,
+                 repartition->celllist);
+    } else {
+      pick_parmetis(nodeID, s, nr_nodes, weights_v, weights_e, sizes, refine,
+                    repartition->adaptive, repartition->itr,
+                    repartition->celllist);
+    }
+#else
     pick_metis(nodeID, s, nr_nodes, weights_v, weights_e,
                repartition->celllist);
-  } else {
-    pick_parmetis(nodeID, s, nr_nodes, weights_v, weights_e, refine,
-                  repartition->adaptive, repartition->itr,
-                  repartition->celllist);
-  }
-#else
-  pick_metis(nodeID, s, nr_nodes, weights_v, weights_e, repartition->celllist);
 #endif
+  }
 
   /* Check that all cells have good values. All nodes have same copy, so just
    * check on one. */
@@ -1750,11 +2130,17 @@ static void repart_edge_metis(int vweights, int eweights, int timebins,
       repartition->celllist[k] = cells[k].nodeID;
   }
 
+  /* Don't move more particles than allowed in one go. */
+  if (!failed && repartition->max_migration < 1.f)
+    partition_bound_migration(repartition, nodeID, nr_nodes, s, sizes,
+                              weights_v);
+
   /* And apply to our cells */
   split_metis(s, nr_nodes, repartition->celllist);
 
   /* Clean up. */
   free(inds);
+  free(sizes);
   if (vweights) free(weights_v);
   if (eweights) free(weights_e);
 }
@@ -1809,7 +2195,7 @@ static void repart_memory_metis(struct repartition *repartition, int nodeID,
   if (repartition->usemetis) {
     pick_metis(nodeID, s, nr_nodes, weights, NULL, repartition->celllist);
   } else {
-    pick_parmetis(nodeID, s, nr_nodes, weights, NULL, refine,
+    pick_parmetis(nodeID, s, nr_nodes, weights, NULL, weights, refine,
                   repartition->adaptive, repartition->itr,
                   repartition->celllist);
   }
@@ -1847,8 +2233,15 @@ static void repart_memory_metis(struct repartition *repartition, int nodeID,
       repartition->celllist[k] = s->cells_top[k].nodeID;
   }
 
+  /* Don't move more particles than allowed in one go. */
+  if (!failed && repartition->max_migration < 1.f)
+    partition_bound_migration(repartition, nodeID, nr_nodes, s, weights,
+                              NULL);
+
   /* And apply to our cells */
   split_metis(s, nr_nodes, repartition->celllist);
+
+  free(weights);
 }
 #endif /* WITH_MPI && (HAVE_METIS || HAVE_PARMETIS) */
 
@@ -1888,6 +2281,10 @@ void partition_repartition(struct repartition *reparttype, int nodeID,
   } else if (reparttype->type == REPART_METIS_VERTEX_COUNTS) {
     repart_memory_metis(reparttype, nodeID, nr_nodes, s);
 
+  } else if (reparttype->type == REPART_SFC_VERTEX_COSTS) {
+    repart_edge_metis(1, 0, 0, reparttype, nodeID, nr_nodes, s, tasks,
+                      nr_tasks);
+
   } else if (reparttype->type == REPART_NONE) {
     /* Doing nothing. */
 
@@ -1995,8 +2392,8 @@ void partition_initial_partition(struct partition *initial_partition,
     if (initial_partition->usemetis) {
       pick_metis(nodeID, s, nr_nodes, weights_v, weights_e, celllist);
     } else {
-      pick_parmetis(nodeID, s, nr_nodes, weights_v, weights_e, 0, 0, 0.0f,
-                    celllist);
+      pick_parmetis(nodeID, s, nr_nodes, weights_v, weights_e, NULL, 0, 0,
+                    0.0f, celllist);
     }
 #else
     pick_metis(nodeID, s, nr_nodes, weights_v, weights_e, celllist);
@@ -2021,6 +2418,33 @@ void partition_initial_partition(struct partition *initial_partition,
     error("SWIFT was not compiled with METIS or ParMETIS support");
 #endif
 
+  } else if (initial_partition->type == INITPART_SFC) {
+#if defined(WITH_MPI) && (defined(HAVE_METIS) || defined(HAVE_PARMETIS))
+    /* Cut a space-filling curve into pieces of equal particle memory. */
+    double *weights_v = NULL;
+    if ((weights_v = (double *)malloc(sizeof(double) * s->nr_cells)) == NULL)
+      error("Failed to allocate weights_v buffer.");
+    accumulate_sizes(s, s->e->verbose, weights_v);
+
+    int *celllist = NULL;
+    if ((celllist = (int *)malloc(sizeof(int) * s->nr_cells)) == NULL)
+      error("Failed to allocate celllist");
+    pick_sfc(nodeID, s, nr_nodes, weights_v, celllist);
+    split_metis(s, nr_nodes, celllist);
+
+    if (!check_complete(s, (nodeID == 0), nr_nodes)) {
+      if (nodeID == 0)
+        message("SFC initial partition failed, using a vectorised partition");
+      initial_partition->type = INITPART_VECTORIZE;
+      partition_initial_partition(initial_partition, nodeID, nr_nodes, s);
+    }
+
+    free(weights_v);
+    free(celllist);
+#else
+    error("SWIFT was not compiled with METIS or ParMETIS support");
+#endif
+
   } else if (initial_partition->type == INITPART_VECTORIZE) {
 
 #if defined(WITH_MPI)
@@ -2108,11 +2532,14 @@ void partition_init(struct partition *partition,
     case 'e':
       partition->type = INITPART_METIS_WEIGHT_EDGE;
       break;
+    case 's':
+      partition->type = INITPART_SFC;
+      break;
     default:
       message("Invalid choice of initial partition type '%s'.", part_type);
       error(
-          "Permitted values are: 'grid', 'region', 'memory', 'edgememory' or "
-          "'vectorized'");
+          "Permitted values are: 'grid', 'region', 'memory', 'edgememory', "
+          "'sfc' or 'vectorized'");
 #else
     default:
       message("Invalid choice of initial partition type '%s'.", part_type);
@@ -2148,11 +2575,14 @@ void partition_init(struct partition *partition,
   } else if (strcmp("timecosts", part_type) == 0) {
     repartition->type = REPART_METIS_VERTEX_COSTS_TIMEBINS;
 
+  } else if (strcmp("sfccosts", part_type) == 0) {
+    repartition->type = REPART_SFC_VERTEX_COSTS;
+
   } else {
     message("Invalid choice of re-partition type '%s'.", part_type);
     error(
-        "Permitted values are: 'none', 'fullcosts', 'edgecosts' "
-        "'memory' or 'timecosts'");
+        "Permitted values are: 'none', 'fullcosts', 'edgecosts', "
+        "'memory', 'timecosts' or 'sfccosts'");
 #else
   } else {
     message("Invalid choice of re-partition type '%s'.", part_type);
@@ -2195,6 +2625,29 @@ void partition_init(struct partition *partition,
   repartition->itr =
       parser_get_opt_param_float(params, "DomainDecomposition:itr", 100.0f);
 
+  /* Largest fraction of the particle memory moved by a repartition. */
+  repartition->max_migration = parser_get_opt_param_float(
+      params, "DomainDecomposition:max_migration", 1.0f);
+  if (repartition->max_migration <= 0.f || repartition->max_migration > 1.f)
+    error("Invalid DomainDecomposition:max_migration, must be in (0,1]");
+
+  /* Relative capacities of the ranks, for instance larger for the ranks
+   * with GPUs, if they are not all the same. */
+  float *capacities = (float *)malloc(sizeof(float) * nr_nodes);
+  if (capacities == NULL) error("Failed to allocate rank capacities.");
+  for (int i = 0; i < nr_nodes; i++) capacities[i] = 1.f;
+  if (parser_get_opt_param_float_array(params,
+                                       "DomainDecomposition:rank_capacities",
+                                       nr_nodes, capacities)) {
+    for (int i = 0; i < nr_nodes; i++)
+      if (capacities[i] <= 0.f)
+        error("Invalid DomainDecomposition:rank_capacities, must be positive");
+    free(partition_rank_capacities);
+    partition_rank_capacities = capacities;
+  } else {
+    free(capacities);
+  }
+
   /* Do we have fixed costs available? These can be used to force
    * repartitioning at any time. Not required if not repartitioning.*/
   repartition->use_fixed_costs = parser_get_opt_param_int(
@@ -2232,8 +2685,10 @@ void partition_init(struct partition *partition,
 void partition_clean(struct partition *partition,
                      struct repartition *repartition) {
 #ifdef WITH_MPI
-  /* Only the celllist is dynamic. */
+  /* Only the celllist and the capacities are dynamic. */
   if (repartition->celllist != NULL) free(repartition->celllist);
+  free(partition_rank_capacities);
+  partition_rank_capacities = NULL;
 
   /* Zero structs for reuse. */
   bzero(partition, sizeof(struct partition));
@@ -2397,7 +2852,6 @@ static void check_weights(struct task *tasks, int nr_tasks,
         t->type == task_type_stars_ghost ||
         t->type == task_type_bh_density_ghost ||
         t->type == task_type_bh_swallow_ghost2 ||
-        t->type == task_type_neutrino_weight ||
         t->type == task_type_sink_formation || t->type == task_type_rt_ghost1 ||
         t->type == task_type_rt_ghost2 || t->type == task_type_rt_tchem) {
 
@@ -29,7 +29,8 @@ enum partition_type {
   INITPART_VECTORIZE,
   INITPART_METIS_WEIGHT,
   INITPART_METIS_NOWEIGHT,
-  INITPART_METIS_WEIGHT_EDGE
+  INITPART_METIS_WEIGHT_EDGE,
+  INITPART_SFC
 };
 
 /* Simple descriptions of types for reports. */
@@ -48,7 +49,8 @@ enum repartition_type {
   REPART_METIS_VERTEX_EDGE_COSTS,
   REPART_METIS_EDGE_COSTS,
   REPART_METIS_VERTEX_COUNTS,
-  REPART_METIS_VERTEX_COSTS_TIMEBINS
+  REPART_METIS_VERTEX_COSTS_TIMEBINS,
+  REPART_SFC_VERTEX_COSTS
 };
 
 /* Repartition preferences. */
@@ -57,6 +59,7 @@ struct repartition {
   float trigger;
   float minfrac;
   float itr;
+  float max_migration;
   int usemetis;
   int adaptive;
 
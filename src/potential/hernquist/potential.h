@@ -26,6 +26,7 @@
 #include <math.h>
 
 /* Local includes. */
+#include "align.h"
 #include "error.h"
 #include "gravity.h"
 #include "parser.h"
@@ -34,6 +35,10 @@
 #include "space.h"
 #include "units.h"
 
+/*! Number of particles handled together by
+ * external_gravity_acceleration_batch() */
+#define hernquist_potential_batch_size 128
+
 /**
  * @brief External Potential Properties - Hernquist potential
  */
@@ -153,6 +158,70 @@ __attribute__((always_inline)) INLINE static void external_gravity_acceleration(
   gravity_add_comoving_potential(g, pot);
 }
 
+/**
+ * @brief Computes the gravitational acceleration from an Hernquist potential
+ * for a batch of particles.
+ *
+ * Same as external_gravity_acceleration() but reading the positions from
+ * and writing the accelerations and potentials to aligned arrays, such that
+ * the compiler can vectorise the loop.
+ *
+ * @param time The current time.
+ * @param potential The #external_potential used in the run.
+ * @param phys_const The physical constants in internal units.
+ * @param count The number of particles.
+ * @param x The x positions of the particles.
+ * @param y The y positions of the particles.
+ * @param z The z positions of the particles.
+ * @param a_x (return) The x components of the accelerations.
+ * @param a_y (return) The y components of the accelerations.
+ * @param a_z (return) The z components of the accelerations.
+ * @param pot (return) The potentials.
+ */
+__attribute__((always_inline)) INLINE static void
+external_gravity_acceleration_batch(
+    double time, const struct external_potential* potential,
+    const struct phys_const* const phys_const, const int count,
+    const double* x, const double* y, const double* z, float* a_x, float* a_y,
+    float* a_z, float* pot) {
+
+  swift_declare_aligned_ptr(const double, x_i, x, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(const double, y_i, y, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(const double, z_i, z, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, a_x_i, a_x, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, a_y_i, a_y, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, a_z_i, a_z, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, pot_i, pot, SWIFT_CACHE_ALIGNMENT);
+
+  const double x_c = potential->x[0];
+  const double y_c = potential->x[1];
+  const double z_c = potential->x[2];
+  const double epsilon2 = potential->epsilon2;
+  const double al = potential->al;
+  const double mass = potential->mass;
+
+  for (int i = 0; i < count; i++) {
+
+    /* Determine the position relative to the centre of the potential */
+    const float dx = x_i[i] - x_c;
+    const float dy = y_i[i] - y_c;
+    const float dz = z_i[i] - z_c;
+
+    /* Calculate the acceleration */
+    const float r2 = dx * dx + dy * dy + dz * dz + epsilon2;
+    const float r = sqrtf(r2);
+    const float r_plus_a_inv = 1.f / (r + al);
+    const float r_plus_a_inv2 = r_plus_a_inv * r_plus_a_inv;
+
+    const float acc = -mass * r_plus_a_inv2 / r;
+
+    a_x_i[i] = acc * dx;
+    a_y_i[i] = acc * dy;
+    a_z_i[i] = acc * dz;
+    pot_i[i] = -mass * r_plus_a_inv;
+  }
+}
+
 /**
  * @brief Computes the gravitational potential energy of a particle in an
  * Hernquist potential.
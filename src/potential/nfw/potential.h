@@ -28,6 +28,7 @@
 #include <math.h>
 
 /* Local includes. */
+#include "align.h"
 #include "error.h"
 #include "gravity.h"
 #include "parser.h"
@@ -36,6 +37,10 @@
 #include "space.h"
 #include "units.h"
 
+/*! Number of particles handled together by
+ * external_gravity_acceleration_batch() */
+#define nfw_potential_batch_size 128
+
 /**
  * @brief External Potential Properties - NFW Potential
                 rho(r) = rho_0 / ( (r/R_s)*(1+r/R_s)^2 )
@@ -179,6 +184,70 @@ __attribute__((always_inline)) INLINE static void external_gravity_acceleration(
   gravity_add_comoving_potential(g, pot);
 }
 
+/**
+ * @brief Computes the gravitational acceleration due to an NFW halo for a
+ * batch of particles.
+ *
+ * Same as external_gravity_acceleration() but reading the positions from
+ * and writing the accelerations and potentials to aligned arrays, such that
+ * the compiler can vectorise the loop.
+ *
+ * @param time The current time.
+ * @param potential The #external_potential used in the run.
+ * @param phys_const The physical constants in internal units.
+ * @param count The number of particles.
+ * @param x The x positions of the particles.
+ * @param y The y positions of the particles.
+ * @param z The z positions of the particles.
+ * @param a_x (return) The x components of the accelerations.
+ * @param a_y (return) The y components of the accelerations.
+ * @param a_z (return) The z components of the accelerations.
+ * @param pot (return) The potentials.
+ */
+__attribute__((always_inline)) INLINE static void
+external_gravity_acceleration_batch(
+    double time, const struct external_potential* restrict potential,
+    const struct phys_const* restrict phys_const, const int count,
+    const double* x, const double* y, const double* z, float* a_x, float* a_y,
+    float* a_z, float* pot) {
+
+  swift_declare_aligned_ptr(const double, x_i, x, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(const double, y_i, y, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(const double, z_i, z, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, a_x_i, a_x, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, a_y_i, a_y, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, a_z_i, a_z, SWIFT_CACHE_ALIGNMENT);
+  swift_declare_aligned_ptr(float, pot_i, pot, SWIFT_CACHE_ALIGNMENT);
+
+  const double x_c = potential->x[0];
+  const double y_c = potential->x[1];
+  const double z_c = potential->x[2];
+  const double eps2 = potential->eps * potential->eps;
+  const double pot_fac = potential->M_200_times_log_c200_term_inv;
+  const double r_s = potential->r_s;
+
+  for (int i = 0; i < count; i++) {
+
+    /* Determine the position relative to the centre of the potential */
+    const float dx = x_i[i] - x_c;
+    const float dy = y_i[i] - y_c;
+    const float dz = z_i[i] - z_c;
+
+    /* Calculate the acceleration */
+    const float r2 = dx * dx + dy * dy + dz * dz + eps2;
+    const float r = sqrtf(r2);
+    const float r_inv = 1.f / r;
+    const float M_encl = enclosed_mass_NFW(potential, r);
+
+    const float acc = -M_encl * r_inv * r_inv * r_inv;
+
+    a_x_i[i] = acc * dx;
+    a_y_i[i] = acc * dy;
+    a_z_i[i] = acc * dz;
+    pot_i[i] = -pot_fac * r_inv * logf(1.f + r / r_s);
+  }
+}
+
 /**
  * @brief Computes the gravitational potential energy of a particle in an
  * NFW potential.
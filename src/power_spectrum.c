@@ -37,7 +37,9 @@
 
 /* Local includes. */
 #include "cooling.h"
+#include "cuda_power_spectrum.h"
 #include "engine.h"
+#include "mesh_assignment.h"
 #include "minmax.h"
 #include "neutrino.h"
 #include "random.h"
@@ -370,210 +372,37 @@ void shotnoise_mapper(void* map_data, int num, void* extra) {
   }
 }
 
-__attribute__((always_inline)) INLINE static void TSC_set(
-    double* mesh, const int N, const int i, const int j, const int k,
-    const double dx, const double dy, const double dz, const double value) {
-
-  const double lx = 0.5 * (0.5 - dx) * (0.5 - dx); /* left side, dist 1 + dx  */
-  const double mx = 0.75 - dx * dx;                /* center, dist |dx|  */
-  const double rx = 0.5 * (0.5 + dx) * (0.5 + dx); /* right side, dist 1 - dx */
-
-  const double ly = 0.5 * (0.5 - dy) * (0.5 - dy); /* left side, dist 1 + dy  */
-  const double my = 0.75 - dy * dy;                /* center, dist |dy|  */
-  const double ry = 0.5 * (0.5 + dy) * (0.5 + dy); /* right side, dist 1 - dy */
-
-  const double lz = 0.5 * (0.5 - dz) * (0.5 - dz); /* left side, dist 1 + dz  */
-  const double mz = 0.75 - dz * dz;                /* center, dist |dz|  */
-  const double rz = 0.5 * (0.5 + dz) * (0.5 + dz); /* right side, dist 1 - dz */
-
-  /* TSC interpolation */
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i - 1, j - 1, k - 1, N, 2)],
-      value * lx * ly * lz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i - 1, j - 1, k + 0, N, 2)],
-      value * lx * ly * mz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i - 1, j - 1, k + 1, N, 2)],
-      value * lx * ly * rz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i - 1, j + 0, k - 1, N, 2)],
-      value * lx * my * lz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i - 1, j + 0, k + 0, N, 2)],
-      value * lx * my * mz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i - 1, j + 0, k + 1, N, 2)],
-      value * lx * my * rz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i - 1, j + 1, k - 1, N, 2)],
-      value * lx * ry * lz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i - 1, j + 1, k + 0, N, 2)],
-      value * lx * ry * mz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i - 1, j + 1, k + 1, N, 2)],
-      value * lx * ry * rz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 0, j - 1, k - 1, N, 2)],
-      value * mx * ly * lz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 0, j - 1, k + 0, N, 2)],
-      value * mx * ly * mz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 0, j - 1, k + 1, N, 2)],
-      value * mx * ly * rz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 0, j + 0, k - 1, N, 2)],
-      value * mx * my * lz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 0, j + 0, k + 0, N, 2)],
-      value * mx * my * mz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 0, j + 0, k + 1, N, 2)],
-      value * mx * my * rz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 0, j + 1, k - 1, N, 2)],
-      value * mx * ry * lz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 0, j + 1, k + 0, N, 2)],
-      value * mx * ry * mz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 0, j + 1, k + 1, N, 2)],
-      value * mx * ry * rz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 1, j - 1, k - 1, N, 2)],
-      value * rx * ly * lz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 1, j - 1, k + 0, N, 2)],
-      value * rx * ly * mz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 1, j - 1, k + 1, N, 2)],
-      value * rx * ly * rz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 1, j + 0, k - 1, N, 2)],
-      value * rx * my * lz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 1, j + 0, k + 0, N, 2)],
-      value * rx * my * mz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 1, j + 0, k + 1, N, 2)],
-      value * rx * my * rz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 1, j + 1, k - 1, N, 2)],
-      value * rx * ry * lz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 1, j + 1, k + 0, N, 2)],
-      value * rx * ry * mz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 1, j + 1, k + 1, N, 2)],
-      value * rx * ry * rz);
-}
-
-INLINE static void gpart_to_grid_TSC(const struct gpart* gp, double* rho,
-                                     const int N, const double fac,
-                                     const double dim[3], const double value) {
-
-  /* Fold the particle position position */
-  const double pos_x = box_wrap_multiple(gp->x[0], 0., dim[0]) * fac;
-  const double pos_y = box_wrap_multiple(gp->x[1], 0., dim[1]) * fac;
-  const double pos_z = box_wrap_multiple(gp->x[2], 0., dim[2]) * fac;
-
-  /* Workout the TSC coefficients */
-  const int i = (int)(pos_x + 0.5);
-  const double dx = pos_x - i;
-
-  const int j = (int)(pos_y + 0.5);
-  const double dy = pos_y - j;
-
-  const int k = (int)(pos_z + 0.5);
-  const double dz = pos_z - k;
-
-#ifdef SWIFT_DEBUG_CHECKS
-  if (i < 0 || i > N) error("Invalid gpart position in x");
-  if (j < 0 || j > N) error("Invalid gpart position in y");
-  if (k < 0 || k > N) error("Invalid gpart position in z");
-#endif
-
-  TSC_set(rho, N, i, j, k, dx, dy, dz, value);
-}
-
-__attribute__((always_inline)) INLINE static void CIC_set(
-    double* mesh, const int N, const int i, const int j, const int k,
-    const double tx, const double ty, const double tz, const double dx,
-    const double dy, const double dz, const double value) {
-
-  /* Classic CIC interpolation */
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 0, j + 0, k + 0, N, 2)],
-      value * tx * ty * tz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 0, j + 0, k + 1, N, 2)],
-      value * tx * ty * dz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 0, j + 1, k + 0, N, 2)],
-      value * tx * dy * tz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 0, j + 1, k + 1, N, 2)],
-      value * tx * dy * dz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 1, j + 0, k + 0, N, 2)],
-      value * dx * ty * tz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 1, j + 0, k + 1, N, 2)],
-      value * dx * ty * dz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 1, j + 1, k + 0, N, 2)],
-      value * dx * dy * tz);
-  atomic_add_d(
-      &mesh[row_major_id_periodic_with_padding(i + 1, j + 1, k + 1, N, 2)],
-      value * dx * dy * dz);
-}
-
-INLINE static void gpart_to_grid_CIC(const struct gpart* gp, double* rho,
-                                     const int N, const double fac,
-                                     const double dim[3], const double value) {
+/**
+ * @brief Assigns a quantity carried by a #gpart to the power grid using the
+ * mass assignment scheme of a given order.
+ *
+ * @param gp The #gpart.
+ * @param rho The density grid.
+ * @param N the size of the grid along one axis.
+ * @param fac Conversion factor of wrapped position to grid.
+ * @param dim The dimensions of the simulation box.
+ * @param windoworder The order of the mass assignment scheme.
+ * @param value The quantity to assign.
+ */
+INLINE static void gpart_to_grid(const struct gpart* gp, double* rho,
+                                 const int N, const double fac,
+                                 const double dim[3], const int windoworder,
+                                 const double value) {
 
   /* Fold the particle position position */
   const double pos_x = box_wrap_multiple(gp->x[0], 0., dim[0]) * fac;
   const double pos_y = box_wrap_multiple(gp->x[1], 0., dim[1]) * fac;
   const double pos_z = box_wrap_multiple(gp->x[2], 0., dim[2]) * fac;
 
-  /* Workout the CIC coefficients */
-  const int i = (int)pos_x;
-  const double dx = pos_x - i;
-  const double tx = 1. - dx;
-
-  const int j = (int)pos_y;
-  const double dy = pos_y - j;
-  const double ty = 1. - dy;
-
-  const int k = (int)pos_z;
-  const double dz = pos_z - k;
-  const double tz = 1. - dz;
-
 #ifdef SWIFT_DEBUG_CHECKS
-  if (i < 0 || i > N) error("Invalid gpart position in x");
-  if (j < 0 || j > N) error("Invalid gpart position in y");
-  if (k < 0 || k > N) error("Invalid gpart position in z");
+  if (pos_x < 0. || pos_x > N) error("Invalid gpart position in x");
+  if (pos_y < 0. || pos_y > N) error("Invalid gpart position in y");
+  if (pos_z < 0. || pos_z > N) error("Invalid gpart position in z");
 #endif
 
-  CIC_set(rho, N, i, j, k, tx, ty, tz, dx, dy, dz, value);
-}
-
-INLINE static void gpart_to_grid_NGP(const struct gpart* gp, double* rho,
-                                     const int N, const double fac,
-                                     const double dim[3], const double value) {
-
-  /* Fold the particle position position */
-  const double pos_x = box_wrap_multiple(gp->x[0], 0., dim[0]) * fac;
-  const double pos_y = box_wrap_multiple(gp->x[1], 0., dim[1]) * fac;
-  const double pos_z = box_wrap_multiple(gp->x[2], 0., dim[2]) * fac;
-
-  const int xi = (int)(pos_x + 0.5) % N;
-  const int yi = (int)(pos_y + 0.5) % N;
-  const int zi = (int)(pos_z + 0.5) % N;
-  atomic_add_d(&rho[(xi * N + yi) * (N + 2) + zi], value);
+  /* The grid is padded for the in-place FFT */
+  mesh_assignment_set(rho, N, /*pad=*/2, windoworder, pos_x, pos_y, pos_z,
+                      value);
 }
 
 /**
@@ -642,22 +471,7 @@ void cell_to_powgrid(const struct cell* c, double* rho, const int N,
     }
 
     /* Assign the quantity to the grid */
-    switch (windoworder) {
-      case 1:
-        gpart_to_grid_NGP(&gparts[i], rho, N, fac, dim, quantity);
-        break;
-      case 2:
-        gpart_to_grid_CIC(&gparts[i], rho, N, fac, dim, quantity);
-        break;
-      case 3:
-        gpart_to_grid_TSC(&gparts[i], rho, N, fac, dim, quantity);
-        break;
-      default:
-#ifdef SWIFT_DEBUG_CHECKS
-        error("Not implemented!");
-#endif
-        break;
-    }
+    gpart_to_grid(&gparts[i], rho, N, fac, dim, windoworder, quantity);
 
   } /* Loop over particles */
 }
@@ -924,12 +738,14 @@ void power_spectrum(const enum power_type type1, const enum power_type type2,
   /* Allocate the grids based on whether this is an auto- or cross-spectrum*/
   pow_data->powgrid = fftw_alloc_real(Ngrid2 * (Ngrid + 2));
   memuse_log_allocation("fftw_grid.grid", pow_data->powgrid, 1,
-                        sizeof(double) * Ngrid2 * (Ngrid + 2));
+                        sizeof(double) * Ngrid2 * (Ngrid + 2),
+                        memuse_policy_none);
   pow_data->powgridft = (fftw_complex*)pow_data->powgrid;
   if (type1 != type2) {
     pow_data->powgrid2 = fftw_alloc_real(Ngrid2 * (Ngrid + 2));
     memuse_log_allocation("fftw_grid.grid2", pow_data->powgrid2, 1,
-                          sizeof(double) * Ngrid2 * (Ngrid + 2));
+                          sizeof(double) * Ngrid2 * (Ngrid + 2),
+                          memuse_policy_none);
     pow_data->powgridft2 = (fftw_complex*)pow_data->powgrid2;
   } else {
     pow_data->powgrid2 = pow_data->powgrid;
@@ -1147,10 +963,12 @@ void power_spectrum(const enum power_type type1, const enum power_type type2,
         }
       }
 
-      /* Perform FFT(s) */
-      fftw_execute_dft_r2c(pow_data->fftplanpow, pow_data->powgrid,
-                           pow_data->powgridft);
-      if (type1 != type2)
+      /* Perform FFT(s), on the GPU if we can */
+      if (!cuda_power_spectrum_fft(pow_data->powgrid, Ngrid))
+        fftw_execute_dft_r2c(pow_data->fftplanpow, pow_data->powgrid,
+                             pow_data->powgridft);
+      if (type1 != type2 &&
+          !cuda_power_spectrum_fft(pow_data->powgrid2, Ngrid))
         fftw_execute_dft_r2c(pow_data->fftplanpow2, pow_data->powgrid2,
                              pow_data->powgridft2);
 
@@ -1265,12 +1083,14 @@ void power_spectrum(const enum power_type type1, const enum power_type type2,
   free(modecounts);
   free(kbin);
   if (type1 != type2) {
-    memuse_log_allocation("fftw_grid.grid2", pow_data->powgrid2, 0, 0);
+    memuse_log_allocation("fftw_grid.grid2", pow_data->powgrid2, 0, 0,
+                          memuse_policy_none);
     fftw_free(pow_data->powgrid2);
   }
   pow_data->powgrid2 = NULL;
   pow_data->powgridft2 = NULL;
-  memuse_log_allocation("fftw_grid.grid", pow_data->powgrid, 0, 0);
+  memuse_log_allocation("fftw_grid.grid", pow_data->powgrid, 0, 0,
+                        memuse_policy_none);
   fftw_free(pow_data->powgrid);
   pow_data->powgrid = NULL;
   pow_data->powgridft = NULL;
@@ -1301,7 +1121,7 @@ void power_init(struct power_spectrum_data* p, struct swift_params* params,
   p->windoworder = parser_get_opt_param_int(
       params, "PowerSpectrum:window_order", power_data_default_window_order);
 
-  if (p->windoworder > 3 || p->windoworder < 1)
+  if (p->windoworder > mesh_assignment_max_order || p->windoworder < 1)
     error("Power spectrum calculation is not implemented for %dth order!",
           p->windoworder);
   if (p->windoworder == 1)
@@ -0,0 +1,553 @@
+/* Config parameters. */
+#include <config.h>
+
+/* Standard headers */
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+/* MPI headers. */
+#ifdef WITH_MPI
+#include <mpi.h>
+#endif
+
+/* HDF5 */
+#ifdef HAVE_HDF5
+#include <hdf5.h>
+#endif
+
+/* This object's header. */
+#include "projection_maps.h"
+
+/* Local headers. */
+#include "active.h"
+#include "align.h"
+#include "atomic.h"
+#include "common_io.h"
+#include "cooling.h"
+#include "engine.h"
+#include "error.h"
+#include "hydro.h"
+#include "kernel_hydro.h"
+#include "lightcone/lightcone_map.h"
+#include "lightcone/projected_kernel.h"
+#include "memuse.h"
+#include "periodic.h"
+#include "threadpool.h"
+#include "tools.h"
+
+/*! Names of the maps in the output files. */
+const char *projection_map_names[projection_map_count] = {
+    "GasMass", "GasMassWeightedTemperature", "DarkMatterMass", "StellarMass"};
+
+/*! Names of the groups holding the projections along each axis. */
+static const char *projection_group_names[3] = {
+    "ProjectionAlongX", "ProjectionAlongY", "ProjectionAlongZ"};
+
+/**
+ * @brief Read the parameters of the projection maps.
+ *
+ * The output times are read by the engine with those of the other outputs.
+ *
+ * @param props The #projection_maps_props to fill.
+ * @param params The parsed parameter file.
+ */
+void projection_maps_init(struct projection_maps_props *props,
+                          struct swift_params *params) {
+
+  props->enabled = parser_get_opt_param_int(params, "ProjectionMaps:enable", 0);
+  props->output_count = 0;
+  if (!props->enabled) return;
+
+  props->nr_pixels = parser_get_param_int(params, "ProjectionMaps:nr_pixels");
+  if (props->nr_pixels <= 0)
+    error("ProjectionMaps:nr_pixels must be positive (got %d)",
+          props->nr_pixels);
+  if ((long long)props->nr_pixels * props->nr_pixels > INT_MAX)
+    error("ProjectionMaps:nr_pixels=%d gives too many pixels per image",
+          props->nr_pixels);
+
+  /* All the axes by default */
+  props->axes[0] = props->axes[1] = props->axes[2] = 1;
+  parser_get_opt_param_int_array(params, "ProjectionMaps:axes", 3,
+                                 props->axes);
+  if (!props->axes[0] && !props->axes[1] && !props->axes[2])
+    error("ProjectionMaps:axes does not select any axis");
+
+  parser_get_param_string(params, "ProjectionMaps:basename", props->basename);
+  parser_get_opt_param_string(params, "ProjectionMaps:subdir", props->subdir,
+                              ".");
+  props->distributed =
+      parser_get_opt_param_int(params, "ProjectionMaps:distributed", 0);
+  props->gzip_level =
+      parser_get_opt_param_int(params, "ProjectionMaps:gzip_level", 0);
+  props->chunk_size =
+      parser_get_opt_param_int(params, "ProjectionMaps:chunk_size", 65536);
+
+#ifndef HAVE_LIBGSL
+  if (engine_rank == 0)
+    warning(
+        "SWIFT was compiled without GSL, the gas will be assigned to the "
+        "nearest pixel rather than smoothed in the projection maps.");
+#endif
+}
+
+/**
+ * @brief Data shared by the threads depositing the particles on an image.
+ */
+struct projection_maps_mapper_data {
+
+  /*! The #engine. */
+  const struct engine *e;
+
+  /*! The image being made (all of its pixels) */
+  double *image;
+
+  /*! The projected kernel, NULL to assign the gas to the nearest pixel. */
+  struct projected_kernel_table *kernel_table;
+
+  /*! Which quantity is projected. */
+  enum projection_map_type type;
+
+  /*! The two axes of the image. */
+  int i0, i1;
+
+  /*! Number of pixels on a side. */
+  int nr_pixels;
+
+  /*! Size of the pixels along the two axes of the image. */
+  double dx0, dx1;
+
+  /*! Total of the quantity deposited on this rank. */
+  double total;
+};
+
+/**
+ * @brief Position of a particle along one axis of the image.
+ *
+ * @return 0 if the particle is outside of a non-periodic box.
+ */
+static INLINE int projection_maps_get_position(const struct engine *e,
+                                               const double x_in,
+                                               const int axis, double *x) {
+  const double dim = e->s->dim[axis];
+  if (e->s->periodic) {
+    *x = box_wrap(x_in, 0., dim);
+    return 1;
+  }
+  *x = x_in;
+  return x_in >= 0. && x_in < dim;
+}
+
+/**
+ * @brief Add a quantity to the pixel containing a point.
+ */
+static INLINE void projection_maps_deposit_ngp(
+    struct projection_maps_mapper_data *data, const double x0, const double x1,
+    const double value) {
+
+  const int N = data->nr_pixels;
+  int i = (int)(x0 / data->dx0);
+  int j = (int)(x1 / data->dx1);
+  if (i >= N) i = N - 1;
+  if (j >= N) j = N - 1;
+  atomic_add_d(&data->image[(size_t)i * N + j], value);
+}
+
+/**
+ * @brief Add a quantity smoothed over the projected kernel of a particle.
+ *
+ * The weights are normalised by their sum over the pixels, such that the
+ * quantity is conserved even for kernels smaller than a pixel, which fall
+ * back to the nearest pixel.
+ */
+static INLINE void projection_maps_deposit_smoothed(
+    struct projection_maps_mapper_data *data, const double x0, const double x1,
+    const double h, const double value) {
+
+  const int N = data->nr_pixels;
+  const int periodic = data->e->s->periodic;
+  const double radius = kernel_gamma * h;
+  const double inv_h = 1. / h;
+
+  /* Range of pixels covered by the kernel, at most the whole image. */
+  int i_min = (int)floor((x0 - radius) / data->dx0);
+  int i_max = (int)floor((x0 + radius) / data->dx0);
+  int j_min = (int)floor((x1 - radius) / data->dx1);
+  int j_max = (int)floor((x1 + radius) / data->dx1);
+  if (i_max - i_min >= N) i_max = i_min + N - 1;
+  if (j_max - j_min >= N) j_max = j_min + N - 1;
+  if (!periodic) {
+    if (i_min < 0) i_min = 0;
+    if (j_min < 0) j_min = 0;
+    if (i_max >= N) i_max = N - 1;
+    if (j_max >= N) j_max = N - 1;
+  }
+
+  /* Sum of the weights */
+  double sum = 0.;
+  for (int i = i_min; i <= i_max; ++i) {
+    const double d0 = (i + 0.5) * data->dx0 - x0;
+    for (int j = j_min; j <= j_max; ++j) {
+      const double d1 = (j + 0.5) * data->dx1 - x1;
+      const double u = sqrt(d0 * d0 + d1 * d1) * inv_h;
+      sum += projected_kernel_eval(data->kernel_table, u);
+    }
+  }
+
+  /* Kernel smaller than a pixel? */
+  if (sum == 0.) {
+    projection_maps_deposit_ngp(data, x0, x1, value);
+    return;
+  }
+
+  /* Deposit */
+  const double norm = value / sum;
+  for (int i = i_min; i <= i_max; ++i) {
+    const double d0 = (i + 0.5) * data->dx0 - x0;
+    const int ii = ((i % N) + N) % N;
+    for (int j = j_min; j <= j_max; ++j) {
+      const double d1 = (j + 0.5) * data->dx1 - x1;
+      const double u = sqrt(d0 * d0 + d1 * d1) * inv_h;
+      const double w = projected_kernel_eval(data->kernel_table, u);
+      if (w > 0.) {
+        const int jj = ((j % N) + N) % N;
+        atomic_add_d(&data->image[(size_t)ii * N + jj], w * norm);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Deposit the gas particles on an image.
+ */
+static void projection_maps_part_mapper(void *map_data, int count,
+                                        void *extra_data) {
+
+  struct part *parts = (struct part *)map_data;
+  struct projection_maps_mapper_data *data =
+      (struct projection_maps_mapper_data *)extra_data;
+  const struct engine *e = data->e;
+  const ptrdiff_t offset = parts - e->s->parts;
+  const struct xpart *xparts = e->s->xparts + offset;
+
+  double total = 0.;
+  for (int k = 0; k < count; ++k) {
+
+    const struct part *p = &parts[k];
+    if (part_is_inhibited(p, e)) continue;
+
+    double x0, x1;
+    if (!projection_maps_get_position(e, p->x[data->i0], data->i0, &x0) ||
+        !projection_maps_get_position(e, p->x[data->i1], data->i1, &x1))
+      continue;
+
+    double value = hydro_get_mass(p);
+    if (data->type == projection_map_gas_temperature)
+      value *= cooling_get_temperature(e->physical_constants,
+                                       e->hydro_properties, e->internal_units,
+                                       e->cosmology, e->cooling_func, p,
+                                       &xparts[k]);
+
+    if (data->kernel_table)
+      projection_maps_deposit_smoothed(data, x0, x1, p->h, value);
+    else
+      projection_maps_deposit_ngp(data, x0, x1, value);
+    total += value;
+  }
+
+  atomic_add_d(&data->total, total);
+}
+
+/**
+ * @brief Deposit the dark matter or star particles on an image.
+ */
+static void projection_maps_gpart_mapper(void *map_data, int count,
+                                         void *extra_data) {
+
+  struct gpart *gparts = (struct gpart *)map_data;
+  struct projection_maps_mapper_data *data =
+      (struct projection_maps_mapper_data *)extra_data;
+  const struct engine *e = data->e;
+
+  double total = 0.;
+  for (int k = 0; k < count; ++k) {
+
+    const struct gpart *gp = &gparts[k];
+    if (gpart_is_inhibited(gp, e)) continue;
+
+    if (data->type == projection_map_stellar_mass) {
+      if (gp->type != swift_type_stars) continue;
+    } else {
+      if (gp->type != swift_type_dark_matter &&
+          gp->type != swift_type_dark_matter_background)
+        continue;
+    }
+
+    double x0, x1;
+    if (!projection_maps_get_position(e, gp->x[data->i0], data->i0, &x0) ||
+        !projection_maps_get_position(e, gp->x[data->i1], data->i1, &x1))
+      continue;
+
+    projection_maps_deposit_ngp(data, x0, x1, gp->mass);
+    total += gp->mass;
+  }
+
+  atomic_add_d(&data->total, total);
+}
+
+/**
+ * @brief Make one projection and hand its pixels to the ranks storing them.
+ *
+ * The ranks each deposit their particles on a full image, which is then
+ * summed and scattered over the strips of pixels of the #lightcone_map.
+ *
+ * @param e The #engine.
+ * @param map The #lightcone_map receiving this rank's pixels (allocated).
+ * @param image Buffer of all the pixels of the image.
+ * @param kernel_table The projected kernel, NULL for nearest pixel assignment.
+ * @param type The quantity to project.
+ * @param axis The axis along which to project.
+ */
+static void projection_maps_make(const struct engine *e,
+                                 struct lightcone_map *map, double *image,
+                                 struct projected_kernel_table *kernel_table,
+                                 const enum projection_map_type type,
+                                 const int axis) {
+
+  const struct space *s = e->s;
+  const int N = e->projection_maps.nr_pixels;
+  const size_t nr_pix = (size_t)N * N;
+  const int with_gas = type == projection_map_gas_mass ||
+                       type == projection_map_gas_temperature;
+
+  struct projection_maps_mapper_data data;
+  data.e = e;
+  data.image = image;
+  data.kernel_table = kernel_table;
+  data.type = type;
+  data.i0 = (axis + 1) % 3;
+  data.i1 = (axis + 2) % 3;
+  data.nr_pixels = N;
+  data.dx0 = s->dim[data.i0] / N;
+  data.dx1 = s->dim[data.i1] / N;
+  data.total = 0.;
+
+  memset(image, 0, nr_pix * sizeof(double));
+
+  if (with_gas)
+    threadpool_map((struct threadpool *)&e->threadpool,
+                   projection_maps_part_mapper, s->parts, s->nr_parts,
+                   sizeof(struct part), threadpool_auto_chunk_size, &data);
+  else
+    threadpool_map((struct threadpool *)&e->threadpool,
+                   projection_maps_gpart_mapper, s->gparts, s->nr_gparts,
+                   sizeof(struct gpart), threadpool_auto_chunk_size, &data);
+
+#ifdef LIGHTCONE_MAP_CHECK_TOTAL
+  map->total = data.total;
+#endif
+
+#ifdef WITH_MPI
+  int *counts = (int *)malloc(e->nr_nodes * sizeof(int));
+  if (counts == NULL) error("Failed to allocate the projection counts");
+  for (int i = 0; i < e->nr_nodes; ++i) counts[i] = (int)map->pix_per_rank;
+  counts[e->nr_nodes - 1] =
+      (int)(nr_pix - (size_t)(e->nr_nodes - 1) * map->pix_per_rank);
+  MPI_Reduce_scatter(image, map->data, counts, MPI_DOUBLE, MPI_SUM,
+                     MPI_COMM_WORLD);
+  free(counts);
+#else
+  memcpy(map->data, image, nr_pix * sizeof(double));
+#endif
+}
+
+/**
+ * @brief Make the projections of the box and write them to a file.
+ *
+ * @param e The #engine.
+ */
+void projection_maps_write(struct engine *e) {
+
+#ifdef HAVE_HDF5
+  const ticks tic = getticks();
+  struct projection_maps_props *props = &e->projection_maps;
+  const struct unit_system *internal_units = e->internal_units;
+  const struct unit_system *snapshot_units = e->snapshot_units;
+  const int with_gas = e->total_nr_parts > 0;
+  const double mass_factor =
+      units_conversion_factor(internal_units, snapshot_units, UNIT_CONV_MASS);
+  const int N = props->nr_pixels;
+  const pixel_index_t nr_pix = (pixel_index_t)N * N;
+
+  /* Distribution of the pixels over the ranks: the last one gets the extra */
+  const pixel_index_t pix_per_rank = nr_pix / e->nr_nodes;
+  const pixel_index_t local_offset = pix_per_rank * e->nodeID;
+  const pixel_index_t local_nr_pix = (e->nodeID == e->nr_nodes - 1)
+                                         ? nr_pix - local_offset
+                                         : pix_per_rank;
+
+  /* Kernel used to smooth the gas */
+  struct projected_kernel_table *kernel = NULL;
+#ifdef HAVE_LIBGSL
+  struct projected_kernel_table kernel_table;
+  if (with_gas) {
+    projected_kernel_init(&kernel_table);
+    kernel = &kernel_table;
+  }
+#endif
+
+  /* Buffer of the full images */
+  double *image = NULL;
+  if (swift_memalign("projection_image", (void **)&image,
+                     SWIFT_STRUCT_ALIGNMENT, nr_pix * sizeof(double)) != 0)
+    error("Failed to allocate the projection image");
+
+  /* Ensure the output directory exists */
+  if (e->nodeID == 0) safe_checkdir(props->subdir, 1);
+#ifdef WITH_MPI
+  MPI_Barrier(MPI_COMM_WORLD);
+#endif
+
+  /* Name of the file: the rank is in there in distributed mode */
+  const int file_num = props->distributed ? e->nodeID : 0;
+  char fname[FILENAME_BUFFER_SIZE];
+  check_snprintf(fname, FILENAME_BUFFER_SIZE, "%s/%s_%04d.%d.hdf5",
+                 props->subdir, props->basename, props->output_count,
+                 file_num);
+
+  hid_t fapl_id = H5Pcreate(H5P_FILE_ACCESS);
+  if (H5Pset_libver_bounds(fapl_id, HDF5_LOWEST_FILE_FORMAT_VERSION,
+                           HDF5_HIGHEST_FILE_FORMAT_VERSION) < 0)
+    error("Error setting the hdf5 API version");
+
+  int collective = 0;
+#ifdef WITH_MPI
+#ifdef HAVE_PARALLEL_HDF5
+  if (!props->distributed) {
+    if (H5Pset_fapl_mpio(fapl_id, MPI_COMM_WORLD, MPI_INFO_NULL) < 0)
+      error("Unable to set HDF5 MPI-IO file access mode");
+    collective = 1;
+  }
+#else
+  if (!props->distributed)
+    error("Writing projection maps in MPI collective mode requires parallel "
+          "HDF5");
+#endif
+#endif
+  const int nr_files = collective ? 1 : e->nr_nodes;
+
+  hid_t file_id = H5Fcreate(fname, H5F_ACC_TRUNC, H5P_DEFAULT, fapl_id);
+  if (file_id < 0) error("Unable to create file %s", fname);
+
+  /* Header */
+  const double factor_time =
+      units_conversion_factor(internal_units, snapshot_units, UNIT_CONV_TIME);
+  const double factor_length =
+      units_conversion_factor(internal_units, snapshot_units, UNIT_CONV_LENGTH);
+  const double dim[3] = {e->s->dim[0] * factor_length,
+                         e->s->dim[1] * factor_length,
+                         e->s->dim[2] * factor_length};
+  hid_t h_grp =
+      H5Gcreate(file_id, "/Header", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+  if (h_grp < 0) error("Error while creating the file header");
+  io_write_attribute(h_grp, "BoxSize", DOUBLE, dim, 3);
+  io_write_attribute_d(h_grp, "Time", e->time * factor_time);
+  io_write_attribute_d(h_grp, "Redshift", e->cosmology->z);
+  io_write_attribute_d(h_grp, "Scale-factor", e->cosmology->a);
+  io_write_attribute_i(h_grp, "NumberOfPixelsPerSide", N);
+  io_write_attribute_i(h_grp, "NumberOfFiles", nr_files);
+  io_write_attribute_i(h_grp, "SmoothedGas", kernel != NULL);
+  io_write_attribute_s(h_grp, "Code", "SWIFT");
+  io_write_attribute_s(h_grp, "RunName", e->run_name);
+  H5Gclose(h_grp);
+
+  io_write_unit_system(file_id, snapshot_units, "Units");
+  io_write_unit_system(file_id, internal_units, "InternalCodeUnits");
+
+  for (int axis = 0; axis < 3; ++axis) {
+    if (!props->axes[axis]) continue;
+
+    hid_t grp = H5Gcreate(file_id, projection_group_names[axis], H5P_DEFAULT,
+                          H5P_DEFAULT, H5P_DEFAULT);
+    if (grp < 0) error("Error while creating the projection group");
+    const int image_axes[2] = {(axis + 1) % 3, (axis + 2) % 3};
+    io_write_attribute_i(grp, "ProjectionAxis", axis);
+    io_write_attribute(grp, "ImageAxes", INT, image_axes, 2);
+    io_write_attribute_s(grp, "PixelOrdering", "row-major");
+
+    /* Gas mass, kept for the temperature */
+    struct lightcone_map gas_mass;
+    gas_mass.data = NULL;
+
+    for (int type = 0; type < projection_map_count; ++type) {
+
+      const int is_gas = type == projection_map_gas_mass ||
+                         type == projection_map_gas_temperature;
+      if (is_gas && !with_gas) continue;
+
+      struct lightcone_map_type map_type;
+      memset(&map_type, 0, sizeof(struct lightcone_map_type));
+      strcpy(map_type.name, projection_map_names[type]);
+      map_type.units = type == projection_map_gas_temperature
+                           ? UNIT_CONV_TEMPERATURE
+                           : UNIT_CONV_MASS;
+      map_type.smoothing =
+          is_gas && kernel != NULL ? map_smoothed : map_unsmoothed;
+      map_type.compression = compression_write_lossless;
+      map_type.buffer_scale_factor = 1.;
+
+      struct lightcone_map map;
+      lightcone_map_init(&map, /*nside=*/0, nr_pix, pix_per_rank, local_nr_pix,
+                         local_offset, /*r_min=*/0., /*r_max=*/0., map_type);
+      lightcone_map_allocate_pixels(&map, /*zero_pixels=*/0);
+
+      projection_maps_make(e, &map, image, kernel,
+                           (enum projection_map_type)type, axis);
+
+      /* The temperature is the mass-weighted mean in each pixel (the mass
+         map is already in the output units) */
+      if (type == projection_map_gas_temperature) {
+        if (gas_mass.data == NULL) error("The gas mass map must be made first");
+        double total = 0.;
+        for (pixel_index_t i = 0; i < map.local_nr_pix; ++i) {
+          const double m = gas_mass.data[i] / mass_factor;
+          map.data[i] = m > 0. ? map.data[i] / m : 0.;
+          total += map.data[i];
+        }
+#ifdef LIGHTCONE_MAP_CHECK_TOTAL
+        /* Each rank checks its own pixels */
+        map.total = total;
+#endif
+      }
+
+      lightcone_map_write(&map, grp, map_type.name, internal_units,
+                          snapshot_units, collective, props->gzip_level,
+                          props->chunk_size, map_type.compression);
+
+      if (type == projection_map_gas_mass) {
+        gas_mass = map;
+      } else {
+        lightcone_map_clean(&map);
+      }
+    }
+
+    lightcone_map_clean(&gas_mass);
+    H5Gclose(grp);
+  }
+
+  H5Pclose(fapl_id);
+  H5Fclose(file_id);
+
+  swift_free("projection_image", image);
+  if (kernel != NULL) projected_kernel_clean(kernel);
+
+  if (e->verbose)
+    message("Writing projection maps %04d took %.3f %s.", props->output_count,
+            clocks_from_ticks(getticks() - tic), clocks_getunit());
+
+  props->output_count++;
+#else
+  error("Need HDF5 to write out projection maps");
+#endif
+}
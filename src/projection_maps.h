@@ -0,0 +1,69 @@
+#ifndef SWIFT_PROJECTION_MAPS_H
+#define SWIFT_PROJECTION_MAPS_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* Local includes. */
+#include "parser.h"
+
+/* Pre-declarations */
+struct engine;
+
+/**
+ * @brief The quantities the projections of the box are made of.
+ */
+enum projection_map_type {
+  projection_map_gas_mass = 0,
+  projection_map_gas_temperature,
+  projection_map_dark_matter_mass,
+  projection_map_stellar_mass,
+  projection_map_count
+};
+
+/**
+ * @brief Properties of the in-situ projections of the whole box.
+ *
+ * The box is projected along some of its axes onto square images of
+ * nr_pixels a side. The gas is smoothed with the projected SPH kernel, the
+ * other particles are assigned to the pixel they are in. The pixels are
+ * distributed over the ranks and written with the lightcone map machinery.
+ *
+ * There are no pointers in here, such that the engine can carry this
+ * structure across restarts as it is.
+ */
+struct projection_maps_props {
+
+  /*! Are the maps made? */
+  int enabled;
+
+  /*! Number of pixels on a side of the images. */
+  int nr_pixels;
+
+  /*! Along which axes do we project? */
+  int axes[3];
+
+  /*! Write one file per rank rather than a single one? */
+  int distributed;
+
+  /*! Level of the lossless compression of the distributed files. */
+  int gzip_level;
+
+  /*! Size of the HDF5 chunks of the distributed files. */
+  int chunk_size;
+
+  /*! Number of outputs written so far. */
+  int output_count;
+
+  /*! Base name and directory of the output files. */
+  char basename[PARSER_MAX_LINE_SIZE];
+  char subdir[PARSER_MAX_LINE_SIZE];
+};
+
+extern const char *projection_map_names[projection_map_count];
+
+void projection_maps_init(struct projection_maps_props *props,
+                          struct swift_params *params);
+void projection_maps_write(struct engine *e);
+
+#endif /* SWIFT_PROJECTION_MAPS_H */
@@ -23,7 +23,9 @@
 /* Some standard headers. */
 #include <float.h>
 #include <limits.h>
+#include <math.h>
 #include <sched.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -48,8 +50,165 @@
 #ifdef WITH_MPI
 /* MPI data type for the communications */
 MPI_Datatype pcell_mpi_type;
+
+/* MPI data type for the #pcell without their high-order multipole terms */
+MPI_Datatype pcell_low_order_mpi_type;
 #endif
 
+/*! Only send the #pcell that changed since the last cell exchange? */
+int proxy_cells_delta = 0;
+
+/*! Send the high-order multipole terms of the #pcell in half precision? */
+int proxy_cells_half_multipoles = 0;
+
+#if defined(WITH_MPI) && SELF_GRAVITY_MULTIPOLE_ORDER > 1
+
+/*! Number of multipole orders above the monopole that are stored. */
+#define proxy_multipole_nr_orders (SELF_GRAVITY_MULTIPOLE_ORDER - 1)
+
+/*! Number of terms of these orders, from M_200 onwards in #multipole. */
+#define proxy_multipole_nr_terms                                             \
+  ((SELF_GRAVITY_MULTIPOLE_ORDER + 1) * (SELF_GRAVITY_MULTIPOLE_ORDER + 2) * \
+       (SELF_GRAVITY_MULTIPOLE_ORDER + 3) / 6 -                              \
+   4)
+
+/**
+ * @brief The high-order multipole terms of a #pcell in half precision.
+ *
+ * The terms of each order are scaled by the same power of two, such that
+ * the largest of them is in [0.5, 1[, which keeps 11 bits of precision
+ * relative to it.
+ */
+struct pcell_multipole_half {
+
+  /*! The power of two of each order. */
+  int16_t exponent[proxy_multipole_nr_orders];
+
+  /*! The scaled terms as IEEE half-precision numbers. */
+  uint16_t term[proxy_multipole_nr_terms];
+};
+
+/**
+ * @brief Convert a float to an IEEE half-precision number, rounding to the
+ * nearest even.
+ *
+ * @param f The float.
+ */
+static uint16_t proxy_float_to_half(const float f) {
+
+  union {
+    float f;
+    uint32_t i;
+  } u = {f};
+  const uint32_t sign = (u.i >> 16) & 0x8000u;
+  const uint32_t abs = u.i & 0x7fffffffu;
+
+  /* Too large, infinite or NaN */
+  if (abs >= 0x47800000u) return sign | (abs > 0x7f800000u ? 0x7e00u : 0x7c00u);
+
+  /* Sub-normal or zero */
+  if (abs < 0x38800000u) {
+    if (abs < 0x33000000u) return sign;
+    const int shift = 126 - (int)(abs >> 23);
+    const uint32_t mantissa = (abs & 0x7fffffu) | 0x800000u;
+    const uint32_t rem = mantissa & ((1u << shift) - 1u);
+    const uint32_t half = 1u << (shift - 1);
+    uint32_t h = mantissa >> shift;
+    h += (rem > half || (rem == half && (h & 1u)));
+    return sign | h;
+  }
+
+  /* Normal, a carry out of the mantissa correctly bumps the exponent */
+  const uint32_t rem = abs & 0x1fffu;
+  uint32_t h = (abs - 0x38000000u) >> 13;
+  h += (rem > 0x1000u || (rem == 0x1000u && (h & 1u)));
+  return sign | h;
+}
+
+/**
+ * @brief Convert an IEEE half-precision number to a float.
+ *
+ * @param h The half-precision number.
+ */
+static float proxy_half_to_float(const uint16_t h) {
+
+  const uint32_t exponent = (h >> 10) & 0x1fu;
+  const uint32_t mantissa = h & 0x3ffu;
+  const float sign = (h & 0x8000u) ? -1.f : 1.f;
+
+  /* Sub-normal or zero */
+  if (exponent == 0) return sign * ldexpf((float)mantissa, -24);
+
+  union {
+    uint32_t i;
+    float f;
+  } u;
+  if (exponent == 31)
+    u.i = 0x7f800000u | (mantissa << 13);
+  else
+    u.i = ((exponent + 112) << 23) | (mantissa << 13);
+  return sign * u.f;
+}
+
+/**
+ * @brief Store the high-order multipole terms of an array of #pcell in half
+ * precision.
+ *
+ * @param pcells The #pcell.
+ * @param count The number of #pcell.
+ * @param mpoles (return) The terms in half precision, one per #pcell.
+ */
+static void proxy_multipoles_compress(const struct pcell *pcells,
+                                      const int count,
+                                      struct pcell_multipole_half *mpoles) {
+
+  for (int k = 0; k < count; k++) {
+    const float *M = &pcells[k].grav.m_pole.M_200;
+
+    for (int first = 0, n = 2; n <= SELF_GRAVITY_MULTIPOLE_ORDER; n++) {
+      const int nr_terms = (n + 1) * (n + 2) / 2;
+
+      float M_max = 0.f;
+      for (int i = first; i < first + nr_terms; i++)
+        M_max = fmaxf(M_max, fabsf(M[i]));
+      int exponent = 0;
+      if (M_max > 0.f) frexpf(M_max, &exponent);
+
+      mpoles[k].exponent[n - 2] = exponent;
+      for (int i = first; i < first + nr_terms; i++)
+        mpoles[k].term[i] = proxy_float_to_half(ldexpf(M[i], -exponent));
+      first += nr_terms;
+    }
+  }
+}
+
+/**
+ * @brief Restore the high-order multipole terms of an array of #pcell from
+ * their half-precision version.
+ *
+ * @param pcells (return) The #pcell.
+ * @param count The number of #pcell.
+ * @param mpoles The terms in half precision, one per #pcell.
+ */
+static void proxy_multipoles_uncompress(
+    struct pcell *pcells, const int count,
+    const struct pcell_multipole_half *mpoles) {
+
+  for (int k = 0; k < count; k++) {
+    float *M = &pcells[k].grav.m_pole.M_200;
+
+    for (int first = 0, n = 2; n <= SELF_GRAVITY_MULTIPOLE_ORDER; n++) {
+      const int nr_terms = (n + 1) * (n + 2) / 2;
+      for (int i = first; i < first + nr_terms; i++)
+        M[i] = ldexpf(proxy_half_to_float(mpoles[k].term[i]),
+                      mpoles[k].exponent[n - 2]);
+      first += nr_terms;
+    }
+  }
+}
+
+#endif /* WITH_MPI && SELF_GRAVITY_MULTIPOLE_ORDER > 1 */
+
 /**
  * @brief Exchange tags between nodes.
  *
@@ -335,49 +494,137 @@ void proxy_grid_extra_exchange(struct proxy *proxies, int num_proxies,
  * #pcell array to the destination node, and enqueues an @c MPI_Irecv for
  * the foreign cell counts.
  *
+ * When #proxy_cells_delta is set and the trees have the same shape as in the
+ * last exchange, only the #pcell that changed are sent, together with their
+ * indices, unless that is more than half of them.
+ *
+ * When #proxy_cells_half_multipoles is set, the high-order multipole terms
+ * of the #pcell sent are left out of them and sent in half precision in a
+ * separate message.
+ *
  * @param p The #proxy.
  */
 void proxy_cells_exchange_first(struct proxy *p) {
 
 #ifdef WITH_MPI
 
+  /* Leave out the high-order multipole terms? */
+  const MPI_Datatype type = proxy_cells_half_multipoles
+                                ? pcell_low_order_mpi_type
+                                : pcell_mpi_type;
+
   /* Get the number of pcells we will need to send. */
-  p->size_pcells_out = 0;
+  int size_pcells = 0;
   for (int k = 0; k < p->nr_cells_out; k++)
-    p->size_pcells_out += p->cells_out[k]->mpi.pcell_size;
+    size_pcells += p->cells_out[k]->mpi.pcell_size;
+
+  /* Can we just send what changed since the last time? */
+  int nr_changed = -1;
+  if (proxy_cells_delta && p->pcells_out != NULL &&
+      p->size_pcells_out == size_pcells && size_pcells > 1) {
+
+    const int max_changed = size_pcells / 2;
+    if (swift_memalign("pcells_delta_out", (void **)&p->pcells_delta_out,
+                       SWIFT_STRUCT_ALIGNMENT,
+                       sizeof(struct pcell) * max_changed) != 0 ||
+        (p->index_delta_out = (int *)swift_malloc(
+             "index_delta_out", sizeof(int) * max_changed)) == NULL)
+      error("Failed to allocate pcell differences buffers.");
+
+    nr_changed = 0;
+    for (int ind = 0, k = 0; k < p->nr_cells_out && nr_changed >= 0; k++) {
+      const struct pcell *pc = p->cells_out[k]->mpi.pcell;
+      for (int j = 0; j < p->cells_out[k]->mpi.pcell_size; j++, ind++) {
+        if (memcmp(&pc[j], &p->pcells_out[ind], sizeof(struct pcell)) == 0)
+          continue;
+        if (nr_changed == max_changed) {
+          nr_changed = -1;
+          break;
+        }
+        memcpy(&p->pcells_delta_out[nr_changed], &pc[j],
+               sizeof(struct pcell));
+        p->index_delta_out[nr_changed] = ind;
+        nr_changed++;
+      }
+    }
+
+    /* Keep the new version for next time. */
+    for (int k = 0; k < nr_changed; k++)
+      memcpy(&p->pcells_out[p->index_delta_out[k]], &p->pcells_delta_out[k],
+             sizeof(struct pcell));
+  }
+  p->count_pcells_out[0] = size_pcells;
+  p->count_pcells_out[1] = nr_changed;
 
   /* Send the number of pcells. */
-  int err = MPI_Isend(&p->size_pcells_out, 1, MPI_INT, p->nodeID,
+  int err = MPI_Isend(p->count_pcells_out, 2, MPI_INT, p->nodeID,
                       p->mynodeID * proxy_tag_shift + proxy_tag_count,
                       MPI_COMM_WORLD, &p->req_cells_count_out);
   if (err != MPI_SUCCESS) mpi_error(err, "Failed to isend nr of pcells.");
   // message( "isent pcell count (%i) from node %i to node %i." ,
   // p->size_pcells_out , p->mynodeID , p->nodeID ); fflush(stdout);
 
-  /* Allocate and fill the pcell buffer. */
-  if (p->pcells_out != NULL) swift_free("pcells_out", p->pcells_out);
-  if (swift_memalign("pcells_out", (void **)&p->pcells_out,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     sizeof(struct pcell) * p->size_pcells_out) != 0)
-    error("Failed to allocate pcell_out buffer.");
+  if (nr_changed < 0) {
 
-  for (int ind = 0, k = 0; k < p->nr_cells_out; k++) {
-    memcpy(&p->pcells_out[ind], p->cells_out[k]->mpi.pcell,
-           sizeof(struct pcell) * p->cells_out[k]->mpi.pcell_size);
-    ind += p->cells_out[k]->mpi.pcell_size;
-  }
+    /* Allocate and fill the pcell buffer. */
+    if (p->pcells_out != NULL) swift_free("pcells_out", p->pcells_out);
+    p->size_pcells_out = size_pcells;
+    if (swift_memalign("pcells_out", (void **)&p->pcells_out,
+                       SWIFT_STRUCT_ALIGNMENT,
+                       sizeof(struct pcell) * p->size_pcells_out) != 0)
+      error("Failed to allocate pcell_out buffer.");
 
-  /* Send the pcell buffer. */
-  err = MPI_Isend(p->pcells_out, p->size_pcells_out, pcell_mpi_type, p->nodeID,
-                  p->mynodeID * proxy_tag_shift + proxy_tag_cells,
-                  MPI_COMM_WORLD, &p->req_cells_out);
+    for (int ind = 0, k = 0; k < p->nr_cells_out; k++) {
+      memcpy(&p->pcells_out[ind], p->cells_out[k]->mpi.pcell,
+             sizeof(struct pcell) * p->cells_out[k]->mpi.pcell_size);
+      ind += p->cells_out[k]->mpi.pcell_size;
+    }
 
-  if (err != MPI_SUCCESS) mpi_error(err, "Failed to pcell_out buffer.");
+    /* Send the pcell buffer. */
+    err = MPI_Isend(p->pcells_out, p->size_pcells_out, type, p->nodeID,
+                    p->mynodeID * proxy_tag_shift + proxy_tag_cells,
+                    MPI_COMM_WORLD, &p->req_cells_out);
+    if (err != MPI_SUCCESS) mpi_error(err, "Failed to pcell_out buffer.");
+    p->req_cells_index_out = MPI_REQUEST_NULL;
+
+  } else {
+
+    /* Send the changed pcells and where they go. */
+    err = MPI_Isend(p->pcells_delta_out, nr_changed, type, p->nodeID,
+                    p->mynodeID * proxy_tag_shift + proxy_tag_cells,
+                    MPI_COMM_WORLD, &p->req_cells_out);
+    if (err == MPI_SUCCESS)
+      err = MPI_Isend(p->index_delta_out, nr_changed, MPI_INT, p->nodeID,
+                      p->mynodeID * proxy_tag_shift + proxy_tag_cells_index,
+                      MPI_COMM_WORLD, &p->req_cells_index_out);
+    if (err != MPI_SUCCESS)
+      mpi_error(err, "Failed to send pcell differences.");
+  }
+
+  /* Send the high-order multipole terms that were left out. */
+  p->req_cells_mpoles_out = MPI_REQUEST_NULL;
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+  if (proxy_cells_half_multipoles) {
+    const int count = nr_changed < 0 ? size_pcells : nr_changed;
+    const size_t size = sizeof(struct pcell_multipole_half) * count;
+    if ((p->mpoles_out = (struct pcell_multipole_half *)swift_malloc(
+             "mpoles_out", size > 0 ? size : 1)) == NULL)
+      error("Failed to allocate half-precision multipole buffer.");
+    proxy_multipoles_compress(nr_changed < 0 ? p->pcells_out
+                                             : p->pcells_delta_out,
+                              count, p->mpoles_out);
+    err = MPI_Isend(p->mpoles_out, size, MPI_BYTE, p->nodeID,
+                    p->mynodeID * proxy_tag_shift + proxy_tag_cells_multipoles,
+                    MPI_COMM_WORLD, &p->req_cells_mpoles_out);
+    if (err != MPI_SUCCESS)
+      mpi_error(err, "Failed to send half-precision multipoles.");
+  }
+#endif
   // message( "isent pcells (%i) from node %i to node %i." , p->size_pcells_out
   // , p->mynodeID , p->nodeID ); fflush(stdout);
 
   /* Receive the number of pcells. */
-  err = MPI_Irecv(&p->size_pcells_in, 1, MPI_INT, p->nodeID,
+  err = MPI_Irecv(p->count_pcells_in, 2, MPI_INT, p->nodeID,
                   p->nodeID * proxy_tag_shift + proxy_tag_count, MPI_COMM_WORLD,
                   &p->req_cells_count_in);
   if (err != MPI_SUCCESS) mpi_error(err, "Failed to irecv nr of pcells.");
@@ -394,7 +641,8 @@ void proxy_cells_exchange_first(struct proxy *p) {
  *
  * Once the incomming cell count has been received, allocate a buffer
  * for the foreign packed #pcell array and emit the @c MPI_Irecv for
- * it.
+ * it. If only the differences are coming, receive them and their indices,
+ * they are applied by #proxy_cells_exchange_third.
  *
  * @param p The #proxy.
  */
@@ -402,19 +650,71 @@ void proxy_cells_exchange_second(struct proxy *p) {
 
 #ifdef WITH_MPI
 
-  /* Re-allocate the pcell_in buffer. */
-  if (p->pcells_in != NULL) swift_free("pcells_in", p->pcells_in);
-  if (swift_memalign("pcells_in", (void **)&p->pcells_in,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     sizeof(struct pcell) * p->size_pcells_in) != 0)
-    error("Failed to allocate pcell_in buffer.");
-
-  /* Receive the particle buffers. */
-  int err = MPI_Irecv(p->pcells_in, p->size_pcells_in, pcell_mpi_type,
-                      p->nodeID, p->nodeID * proxy_tag_shift + proxy_tag_cells,
-                      MPI_COMM_WORLD, &p->req_cells_in);
+  const int size_pcells = p->count_pcells_in[0];
+  const int nr_changed = p->count_pcells_in[1];
+  const MPI_Datatype type = proxy_cells_half_multipoles
+                                ? pcell_low_order_mpi_type
+                                : pcell_mpi_type;
+
+  int err;
+  if (nr_changed < 0) {
+
+    /* Re-allocate the pcell_in buffer. */
+    if (p->pcells_in != NULL) swift_free("pcells_in", p->pcells_in);
+    p->size_pcells_in = size_pcells;
+    if (swift_memalign("pcells_in", (void **)&p->pcells_in,
+                       SWIFT_STRUCT_ALIGNMENT,
+                       sizeof(struct pcell) * p->size_pcells_in) != 0)
+      error("Failed to allocate pcell_in buffer.");
+
+    /* Receive the particle buffers. */
+    err = MPI_Irecv(p->pcells_in, p->size_pcells_in, type, p->nodeID,
+                    p->nodeID * proxy_tag_shift + proxy_tag_cells,
+                    MPI_COMM_WORLD, &p->req_cells_in);
+    if (err != MPI_SUCCESS) mpi_error(err, "Failed to irecv part data.");
+    p->req_cells_index_in = MPI_REQUEST_NULL;
+
+  } else {
+
+    if (p->pcells_in == NULL || p->size_pcells_in != size_pcells)
+      error("Received pcell differences for trees we do not have.");
+
+    /* Nothing may have changed, but allocate something. */
+    const int size_delta = nr_changed > 0 ? nr_changed : 1;
+    if (swift_memalign("pcells_delta_in", (void **)&p->pcells_delta_in,
+                       SWIFT_STRUCT_ALIGNMENT,
+                       sizeof(struct pcell) * size_delta) != 0 ||
+        (p->index_delta_in = (int *)swift_malloc(
+             "index_delta_in", sizeof(int) * size_delta)) == NULL)
+      error("Failed to allocate pcell differences buffers.");
+
+    err = MPI_Irecv(p->pcells_delta_in, nr_changed, type, p->nodeID,
+                    p->nodeID * proxy_tag_shift + proxy_tag_cells,
+                    MPI_COMM_WORLD, &p->req_cells_in);
+    if (err == MPI_SUCCESS)
+      err = MPI_Irecv(p->index_delta_in, nr_changed, MPI_INT, p->nodeID,
+                      p->nodeID * proxy_tag_shift + proxy_tag_cells_index,
+                      MPI_COMM_WORLD, &p->req_cells_index_in);
+    if (err != MPI_SUCCESS)
+      mpi_error(err, "Failed to irecv pcell differences.");
+  }
 
-  if (err != MPI_SUCCESS) mpi_error(err, "Failed to irecv part data.");
+  /* And the high-order multipole terms that were left out. */
+  p->req_cells_mpoles_in = MPI_REQUEST_NULL;
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+  if (proxy_cells_half_multipoles) {
+    const int count = nr_changed < 0 ? size_pcells : nr_changed;
+    const size_t size = sizeof(struct pcell_multipole_half) * count;
+    if ((p->mpoles_in = (struct pcell_multipole_half *)swift_malloc(
+             "mpoles_in", size > 0 ? size : 1)) == NULL)
+      error("Failed to allocate half-precision multipole buffer.");
+    err = MPI_Irecv(p->mpoles_in, size, MPI_BYTE, p->nodeID,
+                    p->nodeID * proxy_tag_shift + proxy_tag_cells_multipoles,
+                    MPI_COMM_WORLD, &p->req_cells_mpoles_in);
+    if (err != MPI_SUCCESS)
+      mpi_error(err, "Failed to irecv half-precision multipoles.");
+  }
+#endif
     // message( "irecv pcells (%i) on node %i from node %i." , p->size_pcells_in
     // , p->mynodeID , p->nodeID ); fflush(stdout);
 
@@ -423,6 +723,57 @@ void proxy_cells_exchange_second(struct proxy *p) {
 #endif
 }
 
+/**
+ * @brief Exchange cells with a remote node, third part.
+ *
+ * Once the #pcell have arrived, restore their high-order multipole terms if
+ * they came in half precision and apply any differences to the trees
+ * received in the last exchange.
+ *
+ * @param p The #proxy.
+ */
+void proxy_cells_exchange_third(struct proxy *p) {
+
+#ifdef WITH_MPI
+
+  const int nr_changed = p->count_pcells_in[1];
+
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+  if (proxy_cells_half_multipoles) {
+    if (MPI_Wait(&p->req_cells_mpoles_in, MPI_STATUS_IGNORE) != MPI_SUCCESS)
+      error("MPI_Wait on half-precision multipoles failed.");
+    proxy_multipoles_uncompress(
+        nr_changed < 0 ? p->pcells_in : p->pcells_delta_in,
+        nr_changed < 0 ? p->size_pcells_in : nr_changed, p->mpoles_in);
+    swift_free("mpoles_in", p->mpoles_in);
+    p->mpoles_in = NULL;
+  }
+#endif
+
+  if (nr_changed < 0) return;
+
+  if (MPI_Wait(&p->req_cells_index_in, MPI_STATUS_IGNORE) != MPI_SUCCESS)
+    error("MPI_Wait on pcell indices failed.");
+
+  for (int k = 0; k < nr_changed; k++) {
+    const int ind = p->index_delta_in[k];
+#ifdef SWIFT_DEBUG_CHECKS
+    if (ind < 0 || ind >= p->size_pcells_in)
+      error("Invalid pcell index %d received.", ind);
+#endif
+    memcpy(&p->pcells_in[ind], &p->pcells_delta_in[k], sizeof(struct pcell));
+  }
+
+  swift_free("pcells_delta_in", p->pcells_delta_in);
+  swift_free("index_delta_in", p->index_delta_in);
+  p->pcells_delta_in = NULL;
+  p->index_delta_in = NULL;
+
+#else
+  error("SWIFT was not compiled with MPI support.");
+#endif
+}
+
 #ifdef WITH_MPI
 
 void proxy_cells_count_mapper(void *map_data, int num_elements,
@@ -515,6 +866,9 @@ void proxy_cells_exchange(struct proxy *proxies, int num_proxies,
                      sizeof(struct pcell) * count_out) != 0)
     error("Failed to allocate pcell buffer.");
 
+  /* Compare the trees bytewise with the last ones, so clear any padding. */
+  if (proxy_cells_delta) bzero(pcells, sizeof(struct pcell) * count_out);
+
   tic2 = getticks();
 
   /* Pack the cells. */
@@ -567,6 +921,7 @@ void proxy_cells_exchange(struct proxy *proxies, int num_proxies,
         pid == MPI_UNDEFINED)
       error("MPI_Waitany failed.");
     // message( "cell data from proxy %i has arrived." , pid );
+    proxy_cells_exchange_third(&proxies[pid]);
     for (int count = 0, j = 0; j < proxies[pid].nr_cells_in; j++)
       count += cell_unpack(&proxies[pid].pcells_in[count],
                            proxies[pid].cells_in[j], s, with_gravity);
@@ -579,16 +934,36 @@ void proxy_cells_exchange(struct proxy *proxies, int num_proxies,
   /* Wait for all the sends to have finished too. */
   if (MPI_Waitall(num_proxies, reqs_out, MPI_STATUSES_IGNORE) != MPI_SUCCESS)
     error("MPI_Waitall on sends failed.");
+  for (int k = 0; k < num_proxies; k++)
+    reqs_out[k] = proxies[k].req_cells_index_out;
+  if (MPI_Waitall(num_proxies, reqs_out, MPI_STATUSES_IGNORE) != MPI_SUCCESS)
+    error("MPI_Waitall on sends failed.");
+  for (int k = 0; k < num_proxies; k++)
+    reqs_out[k] = proxies[k].req_cells_mpoles_out;
+  if (MPI_Waitall(num_proxies, reqs_out, MPI_STATUSES_IGNORE) != MPI_SUCCESS)
+    error("MPI_Waitall on sends failed.");
 
-  /* Clean up. */
+  /* Clean up, keeping the trees when we can send differences next time. */
   free(reqs);
   swift_free("pcells", pcells);
   swift_free("proxy_cell_offset", offset);
   for (int k = 0; k < num_proxies; k++) {
-    swift_free("pcells_in", proxies[k].pcells_in);
-    swift_free("pcells_out", proxies[k].pcells_out);
-    proxies[k].pcells_in = NULL;
-    proxies[k].pcells_out = NULL;
+    if (proxies[k].pcells_delta_out != NULL) {
+      swift_free("pcells_delta_out", proxies[k].pcells_delta_out);
+      swift_free("index_delta_out", proxies[k].index_delta_out);
+      proxies[k].pcells_delta_out = NULL;
+      proxies[k].index_delta_out = NULL;
+    }
+    if (proxies[k].mpoles_out != NULL) {
+      swift_free("mpoles_out", proxies[k].mpoles_out);
+      proxies[k].mpoles_out = NULL;
+    }
+    if (!proxy_cells_delta) {
+      swift_free("pcells_in", proxies[k].pcells_in);
+      swift_free("pcells_out", proxies[k].pcells_out);
+      proxies[k].pcells_in = NULL;
+      proxies[k].pcells_out = NULL;
+    }
   }
 
 #else
@@ -1077,6 +1452,14 @@ void proxy_init(struct proxy *p, int mynodeID, int nodeID) {
   p->mynodeID = mynodeID;
   p->nodeID = nodeID;
 
+  /* Forget the cells of any previous exchange, the trees will differ. */
+  if (p->pcells_in != NULL) swift_free("pcells_in", p->pcells_in);
+  if (p->pcells_out != NULL) swift_free("pcells_out", p->pcells_out);
+  p->pcells_in = NULL;
+  p->pcells_out = NULL;
+  p->size_pcells_in = 0;
+  p->size_pcells_out = 0;
+
   /* Allocate the cell send and receive buffers, if needed. */
   if (p->cells_in == NULL) {
     p->size_cells_in = proxy_buffinit;
@@ -1202,6 +1585,26 @@ void proxy_create_mpi_type(void) {
       MPI_Type_commit(&pcell_mpi_type) != MPI_SUCCESS) {
     error("Failed to create MPI type for parts.");
   }
+
+  /* The same without the high-order multipole terms, if any. */
+#if SELF_GRAVITY_MULTIPOLE_ORDER > 1
+  const int first = offsetof(struct pcell, grav.m_pole.M_200);
+  const int last = first + proxy_multipole_nr_terms * sizeof(float);
+  int blocklengths[2] = {first, (int)sizeof(struct pcell) - last};
+  int displacements[2] = {0, last};
+  MPI_Datatype type;
+  if (MPI_Type_indexed(2, blocklengths, displacements, MPI_BYTE, &type) !=
+          MPI_SUCCESS ||
+      MPI_Type_create_resized(type, 0, sizeof(struct pcell),
+                              &pcell_low_order_mpi_type) != MPI_SUCCESS ||
+      MPI_Type_commit(&pcell_low_order_mpi_type) != MPI_SUCCESS ||
+      MPI_Type_free(&type) != MPI_SUCCESS) {
+    error("Failed to create MPI type for low-order pcells.");
+  }
+#else
+  if (MPI_Type_dup(pcell_mpi_type, &pcell_low_order_mpi_type) != MPI_SUCCESS)
+    error("Failed to create MPI type for low-order pcells.");
+#endif
 #else
   error("SWIFT was not compiled with MPI support.");
 #endif
@@ -1210,6 +1613,7 @@ void proxy_create_mpi_type(void) {
 void proxy_free_mpi_type(void) {
 #ifdef WITH_MPI
   MPI_Type_free(&pcell_mpi_type);
+  MPI_Type_free(&pcell_low_order_mpi_type);
 #else
   error("SWIFT was not compiled with MPI support.");
 #endif
@@ -29,7 +29,7 @@
 #define proxy_buffinit 100
 
 /* Proxy tag arithmetic. */
-#define proxy_tag_shift 8
+#define proxy_tag_shift 9
 #define proxy_tag_count 0
 #define proxy_tag_parts 1
 #define proxy_tag_xparts 2
@@ -37,6 +37,11 @@
 #define proxy_tag_sparts 4
 #define proxy_tag_bparts 5
 #define proxy_tag_cells 6
+#define proxy_tag_cells_index 7
+#define proxy_tag_cells_multipoles 8
+
+/* The high-order multipole terms of a #pcell in half precision. */
+struct pcell_multipole_half;
 
 /**
  * @brief The different reasons a cell can be in a proxy
@@ -83,6 +88,18 @@ struct proxy {
   /* Buffer to hold the incomming/outgoing particle counts. */
   int buff_out[4], buff_in[4];
 
+  /* Number of #pcell in the trees and of those changed since the last
+   * exchange, -1 if all are sent. */
+  int count_pcells_out[2], count_pcells_in[2];
+
+  /* The changed #pcell and their indices in the trees. */
+  struct pcell *pcells_delta_out, *pcells_delta_in;
+  int *index_delta_out, *index_delta_in;
+
+  /* The high-order multipole terms of the #pcell being sent, when they are
+   * sent in half precision. */
+  struct pcell_multipole_half *mpoles_out, *mpoles_in;
+
 /* MPI request handles. */
 #ifdef WITH_MPI
   MPI_Request req_parts_count_out, req_parts_count_in;
@@ -93,9 +110,17 @@ struct proxy {
   MPI_Request req_bparts_out, req_bparts_in;
   MPI_Request req_cells_count_out, req_cells_count_in;
   MPI_Request req_cells_out, req_cells_in;
+  MPI_Request req_cells_index_out, req_cells_index_in;
+  MPI_Request req_cells_mpoles_out, req_cells_mpoles_in;
 #endif
 };
 
+/*! Only send the #pcell that changed since the last cell exchange? */
+extern int proxy_cells_delta;
+
+/*! Send the high-order multipole terms of the #pcell in half precision? */
+extern int proxy_cells_half_multipoles;
+
 /* Function prototypes. */
 void proxy_init(struct proxy *p, int mynodeID, int nodeID);
 void proxy_clean(struct proxy *p);
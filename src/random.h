@@ -72,6 +72,8 @@ enum random_number_type {
   random_number_mosaic_schechter = 562448657LL,
   random_number_mosaic_poisson = 384160001LL,
   random_number_powerspectrum_split = 126247697LL,
+  random_number_benchmark_ics = 3549527789LL,
+  random_number_lpt_ics = 7046029261LL,
 };
 
 #ifndef __APPLE__
@@ -29,16 +29,24 @@
 #include "engine.h"
 #include "error.h"
 #include "restart.h"
+#include "threadpool.h"
 #include "version.h"
 
 #include <errno.h>
 #include <glob.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 /* The signature for restart files. */
 #define SWIFT_RESTART_SIGNATURE "SWIFT-restart-file"
 #define SWIFT_RESTART_END_SIGNATURE "SWIFT-restart-file:end"
@@ -46,12 +54,79 @@
 #define FNAMELEN 200
 #define LABLEN 20
 
+/* Blocks smaller than this are never compressed nor aligned. */
+#define RESTART_COMPRESS_MIN_BYTES (1024 * 1024)
+
+/* Size of the slices of a block compressed independently. */
+#define RESTART_COMPRESS_SLICE_BYTES (4 * 1024 * 1024)
+
+/* Number of slices compressed together before being written. */
+#define RESTART_COMPRESS_BATCH 64
+
 /* Structure for a dumped header. */
 struct header {
   size_t len;             /* Total length of data in bytes. */
   char label[LABLEN + 1]; /* A label for data */
 };
 
+/* Description of how the large blocks of a restart file are stored. */
+struct restart_layout {
+  size_t level;       /* The zlib level, 0 for none. */
+  size_t min_bytes;   /* Blocks smaller than this are stored as they are. */
+  size_t slice_bytes; /* Size of the slices compressed independently. */
+  size_t alignment;   /* Alignment in the file of the uncompressed blocks. */
+};
+
+/* The layout of the header blocks, before the one of the file is known. */
+static const struct restart_layout restart_default_layout = {
+    .level = 0,
+    .min_bytes = RESTART_COMPRESS_MIN_BYTES,
+    .slice_bytes = RESTART_COMPRESS_SLICE_BYTES,
+    .alignment = 0};
+
+/* The layout of the file currently being written or read. */
+static struct restart_layout restart_file_layout = {
+    .level = 0,
+    .min_bytes = RESTART_COMPRESS_MIN_BYTES,
+    .slice_bytes = RESTART_COMPRESS_SLICE_BYTES,
+    .alignment = 0};
+
+/*! Are the large blocks of the restart files mapped rather than read? */
+int restart_mmap = 0;
+
+/* Have we mapped blocks of the restart file of this rank? */
+static int restart_mapped = 0;
+
+/* The threads used to compress the blocks, NULL to do it serially. */
+static struct threadpool *restart_threadpool = NULL;
+
+/* Size of the buffer used to copy staged restart files. */
+#define RESTART_DRAIN_BUFFER_BYTES (8 * 1024 * 1024)
+
+/* A restart file written to a node-local directory, to be copied to the
+ * restart directory by a background thread. */
+struct restart_drain {
+  char local[FNAMELEN];  /* The staged file. */
+  char global[FNAMELEN]; /* Its final name in the restart directory. */
+  int save;              /* Keep the previous restart file as .prev? */
+  int ost;               /* Lustre OST of the copy, -1 to leave as is. */
+  int verbose;           /* Report the time taken. */
+  int failed;            /* Was the copy unsuccessful? */
+};
+
+/* The file being copied and the thread doing so, if running. */
+static struct restart_drain restart_drain_file;
+static pthread_t restart_drain_thread;
+static int restart_drain_running = 0;
+
+/* A slice of a block and its compressed version. */
+struct restart_slice {
+  const char *data;
+  size_t size;
+  void *buff;
+  size_t buff_size;
+};
+
 /**
  * @brief generate a name for a restart file.
  *
@@ -120,6 +195,138 @@ void restart_locate_free(int nfiles, char **files) {
   free(files);
 }
 
+/**
+ * @brief Place a new file on a single Lustre stripe.
+ *
+ * @param filename the file, which should not exist yet.
+ * @param ost the index of the OST.
+ */
+static void restart_setstripe(const char *filename, const int ost) {
+  char string[1200];
+  sprintf(string, "lfs setstripe -c 1 -i %d %s", ost, filename);
+  const int result = system(string);
+  if (result != 0) {
+    message("lfs setstripe command returned error code %d", result);
+  }
+}
+
+/**
+ * @brief Copy a file, or just read it, and checksum its content (FNV-1a).
+ *
+ * @param from the file to read.
+ * @param to the file to write, NULL to only read.
+ * @param buffer work space of #RESTART_DRAIN_BUFFER_BYTES bytes.
+ * @param sum the checksum.
+ *
+ * @result 0 on success.
+ */
+static int restart_copy_checksum(const char *from, const char *to,
+                                 char *buffer, uint64_t *sum) {
+
+  FILE *in = fopen(from, "r");
+  if (in == NULL) return 1;
+  FILE *out = NULL;
+  if (to != NULL && (out = fopen(to, "w")) == NULL) {
+    fclose(in);
+    return 1;
+  }
+
+  uint64_t hash = 14695981039346656037ULL;
+  int failed = 0;
+  size_t n;
+  while ((n = fread(buffer, 1, RESTART_DRAIN_BUFFER_BYTES, in)) > 0) {
+    for (size_t k = 0; k < n; k++) {
+      hash ^= (unsigned char)buffer[k];
+      hash *= 1099511628211ULL;
+    }
+    if (out != NULL && fwrite(buffer, 1, n, out) != n) {
+      failed = 1;
+      break;
+    }
+  }
+  if (ferror(in)) failed = 1;
+  fclose(in);
+
+  /* Make sure the copy is on disk before it replaces the last one. */
+  if (out != NULL) {
+    if (fflush(out) != 0 || fsync(fileno(out)) != 0) failed = 1;
+    if (fclose(out) != 0) failed = 1;
+  }
+
+  *sum = hash;
+  return failed;
+}
+
+/**
+ * @brief Copy a staged restart file to the restart directory.
+ *
+ * The file is copied under a temporary name and read back. Only once the
+ * checksums agree does it replace the previous restart file, which is kept
+ * as .prev if requested, and is the staged file removed.
+ *
+ * @param data the #restart_drain.
+ */
+static void *restart_drain_main(void *data) {
+
+  struct restart_drain *d = (struct restart_drain *)data;
+  const ticks tic = getticks();
+
+  char partname[FNAMELEN + 5];
+  sprintf(partname, "%s.part", d->global);
+  unlink(partname);
+  if (d->ost >= 0) restart_setstripe(partname, d->ost);
+
+  char *buffer = (char *)malloc(RESTART_DRAIN_BUFFER_BYTES);
+  if (buffer == NULL) error("Failed to allocate the restart copy buffer");
+
+  uint64_t sum_local = 0, sum_copy = 0;
+  d->failed =
+      restart_copy_checksum(d->local, partname, buffer, &sum_local) ||
+      restart_copy_checksum(partname, NULL, buffer, &sum_copy) ||
+      sum_local != sum_copy;
+  free(buffer);
+
+  if (d->failed) {
+    message(
+        "Failed to copy restart file '%s' to '%s' (%s), the files in the "
+        "restart directory are from the previous dump",
+        d->local, d->global, strerror(errno));
+    unlink(partname);
+    return NULL;
+  }
+
+  if (d->save) restart_save_previous(d->global);
+  if (rename(partname, d->global) != 0) {
+    message("Failed to rename file '%s' to '%s' (%s)", partname, d->global,
+            strerror(errno));
+    d->failed = 1;
+    return NULL;
+  }
+  if (unlink(d->local) != 0)
+    message("Failed to unlink staged restart file '%s' (%s)", d->local,
+            strerror(errno));
+
+  if (d->verbose)
+    message("Copying the restart file to '%s' took %.3f %s.", d->global,
+            clocks_from_ticks(getticks() - tic), clocks_getunit());
+  return NULL;
+}
+
+/**
+ * @brief Wait for the last staged restart file to be copied, if running.
+ *
+ * @result 1 if the copy failed, 0 otherwise.
+ */
+int restart_drain_wait(void) {
+
+  if (!restart_drain_running) return 0;
+
+  if (pthread_join(restart_drain_thread, NULL) != 0)
+    error("Failed to join the restart copying thread.");
+  restart_drain_running = 0;
+  return restart_drain_file.failed;
+}
+
 /**
  * @brief Write a restart file for the state of the given engine struct.
  *
@@ -130,10 +337,13 @@ void restart_write(struct engine *e, const char *filename) {
 
   ticks tic = getticks();
 
-  /* Save a backup the existing restart file, if requested. */
-  if (e->restart_save) restart_save_previous(filename);
+  /* Write to a node-local directory first? The previous copy must be out of
+   * the way. */
+  const int staged = strcmp(e->restart_local_dir, "none") != 0;
+  if (staged) restart_drain_wait();
 
   /* Use a single Lustre stripe with a rank-based OST offset? */
+  int ost = -1;
   if (e->restart_lustre_OST_count != 0) {
 
     /* Use a random offset to avoid placing things in the same OSTs. We do
@@ -143,18 +353,41 @@ void restart_write(struct engine *e, const char *filename) {
 #ifdef WITH_MPI
     MPI_Bcast(&offset, 1, MPI_INT, 0, MPI_COMM_WORLD);
 #endif
-    char string[1200];
-    sprintf(string, "lfs setstripe -c 1 -i %d %s",
-            ((e->nodeID + offset) % e->restart_lustre_OST_count), filename);
-    const int result = system(string);
-    if (result != 0) {
-      message("lfs setstripe command returned error code %d", result);
-    }
+    ost = (e->nodeID + offset) % e->restart_lustre_OST_count;
+  }
+
+  /* The file we write to now. */
+  char target[FNAMELEN];
+  if (staged) {
+    const char *base = strrchr(filename, '/');
+    base = (base == NULL) ? filename : base + 1;
+    if (snprintf(target, FNAMELEN, "%s/%s", e->restart_local_dir, base) >=
+        FNAMELEN)
+      error("Name of the staged restart file is too long");
+  } else {
+    strcpy(target, filename);
+
+    /* Save a backup the existing restart file, if requested. */
+    if (e->restart_save) restart_save_previous(filename);
+
+    /* Never overwrite a file we have mapped, our untouched pages still come
+     * from it. Removing it leaves the mapping valid. */
+    if (restart_mapped && unlink(filename) != 0 && errno != ENOENT)
+      message("Failed to unlink mapped restart file '%s' (%s)", filename,
+              strerror(errno));
+
+    if (ost >= 0) restart_setstripe(filename, ost);
   }
 
-  FILE *stream = fopen(filename, "w");
+  FILE *stream = fopen(target, "w");
   if (stream == NULL)
-    error("Failed to open restart file: %s (%s)", filename, strerror(errno));
+    error("Failed to open restart file: %s (%s)", target, strerror(errno));
+
+  /* Write through a large buffer, if requested. */
+  if (e->restart_buffer_size > 0 &&
+      setvbuf(stream, NULL, _IOFBF, e->restart_buffer_size) != 0)
+    message("Failed to set the buffer of the restart file (%s)",
+            strerror(errno));
 
   /* Dump our signature and version. */
   restart_write_blocks((void *)SWIFT_RESTART_SIGNATURE,
@@ -163,14 +396,42 @@ void restart_write(struct engine *e, const char *filename) {
   restart_write_blocks((void *)package_version(), strlen(package_version()), 1,
                        stream, "version", "SWIFT version");
 
+  /* How are the large blocks of this file stored? Written before we switch
+   * to that layout. */
+  struct restart_layout info = restart_default_layout;
+  info.level = e->restart_compression;
+  info.alignment = sysconf(_SC_PAGESIZE);
+  restart_write_blocks(&info, sizeof(struct restart_layout), 1, stream,
+                       "layout", "layout information");
+  restart_file_layout = info;
+  restart_threadpool = &e->threadpool;
+
   engine_struct_dump(e, stream);
 
+  restart_file_layout = restart_default_layout;
+  restart_threadpool = NULL;
+
   /* Just an END statement to spot truncated files. */
   restart_write_blocks((void *)SWIFT_RESTART_END_SIGNATURE,
                        strlen(SWIFT_RESTART_END_SIGNATURE), 1, stream,
                        "endsignature", "SWIFT end signature");
 
-  fclose(stream);
+  if (fclose(stream) != 0)
+    error("Failed to write restart file: %s (%s)", target, strerror(errno));
+
+  /* Leave the copy to the restart directory to a background thread. */
+  if (staged) {
+    strcpy(restart_drain_file.local, target);
+    strcpy(restart_drain_file.global, filename);
+    restart_drain_file.save = e->restart_save;
+    restart_drain_file.ost = ost;
+    restart_drain_file.verbose = e->verbose;
+    restart_drain_file.failed = 0;
+    if (pthread_create(&restart_drain_thread, NULL, &restart_drain_main,
+                       &restart_drain_file) != 0)
+      error("Failed to create the restart copying thread.");
+    restart_drain_running = 1;
+  }
 
   if (e->verbose)
     message("took %.3f %s.", clocks_from_ticks(getticks() - tic),
@@ -215,14 +476,230 @@ void restart_read(struct engine *e, const char *filename) {
         " badly.",
         package_version(), version);
 
+  /* How are the large blocks stored? */
+  struct restart_layout info;
+  restart_read_blocks(&info, sizeof(struct restart_layout), 1, stream, NULL,
+                      "layout information");
+#ifndef HAVE_ZLIB
+  if (info.level > 0)
+    error("This restart file is compressed but SWIFT was built without zlib.");
+#endif
+  restart_file_layout = info;
+
   engine_struct_restore(e, stream);
   fclose(stream);
 
+  restart_file_layout = restart_default_layout;
+
   if (e->verbose)
     message("took %.3f %s.", clocks_from_ticks(getticks() - tic),
             clocks_getunit());
 }
 
+#ifdef HAVE_ZLIB
+/**
+ * @brief Mapper function compressing slices of a block of restart data.
+ *
+ * @param map_data The #restart_slice to compress.
+ * @param num_elements The number of slices.
+ * @param extra_data Pointer to the compression level.
+ */
+static void restart_compress_mapper(void *map_data, int num_elements,
+                                    void *extra_data) {
+
+  struct restart_slice *slices = (struct restart_slice *)map_data;
+  const int level = *(int *)extra_data;
+
+  for (int k = 0; k < num_elements; k++) {
+    struct restart_slice *slice = &slices[k];
+
+    uLongf size = compressBound(slice->size);
+    slice->buff = malloc(size);
+    if (slice->buff == NULL)
+      error("Failed to allocate the restart compression buffer");
+
+    if (compress2((Bytef *)slice->buff, &size, (const Bytef *)slice->data,
+                  slice->size, level) != Z_OK)
+      error("Failed to compress a slice of the restart data");
+    slice->buff_size = size;
+  }
+}
+
+/**
+ * @brief Write a block of memory compressed slice by slice.
+ *
+ * Each slice is written as its compressed size followed by the compressed
+ * data. The slices are compressed in batches by the threads of the
+ * #threadpool, if we have one.
+ *
+ * @param data pointer to the memory.
+ * @param len the size of the block in bytes.
+ * @param stream the file stream.
+ * @param errstr a context string to qualify any errors.
+ */
+static void restart_write_compressed(const char *data, const size_t len,
+                                     FILE *stream, const char *errstr) {
+
+  const size_t slice_bytes = restart_file_layout.slice_bytes;
+  const size_t nr_slices = (len + slice_bytes - 1) / slice_bytes;
+  int level = restart_file_layout.level;
+
+  struct restart_slice slices[RESTART_COMPRESS_BATCH];
+  for (size_t first = 0; first < nr_slices; first += RESTART_COMPRESS_BATCH) {
+
+    /* Prepare the next batch of slices. */
+    const int count = (nr_slices - first < RESTART_COMPRESS_BATCH)
+                          ? (int)(nr_slices - first)
+                          : RESTART_COMPRESS_BATCH;
+    for (int k = 0; k < count; k++) {
+      const size_t offset = (first + k) * slice_bytes;
+      slices[k].data = data + offset;
+      slices[k].size =
+          (len - offset < slice_bytes) ? (len - offset) : slice_bytes;
+    }
+
+    /* Compress them all. */
+    if (restart_threadpool != NULL)
+      threadpool_map(restart_threadpool, restart_compress_mapper, slices,
+                     count, sizeof(struct restart_slice), 1, &level);
+    else
+      restart_compress_mapper(slices, count, &level);
+
+    /* And dump them in order. */
+    for (int k = 0; k < count; k++) {
+      if (fwrite(&slices[k].buff_size, sizeof(size_t), 1, stream) != 1 ||
+          fwrite(slices[k].buff, 1, slices[k].buff_size, stream) !=
+              slices[k].buff_size)
+        error("Failed to save %s to restart file (%s)", errstr,
+              strerror(errno));
+      free(slices[k].buff);
+    }
+  }
+}
+
+/**
+ * @brief Read a block of memory written by #restart_write_compressed.
+ *
+ * @param data pointer to the memory.
+ * @param len the size of the block in bytes.
+ * @param stream the file stream.
+ * @param errstr a context string to qualify any errors.
+ */
+static void restart_read_compressed(char *data, const size_t len,
+                                    FILE *stream, const char *errstr) {
+
+  const size_t slice_bytes = restart_file_layout.slice_bytes;
+  const size_t max_size = compressBound(slice_bytes);
+  void *buff = malloc(max_size);
+  if (buff == NULL) error("Failed to allocate the restart compression buffer");
+
+  for (size_t offset = 0; offset < len; offset += slice_bytes) {
+
+    size_t size = 0;
+    if (fread(&size, sizeof(size_t), 1, stream) != 1 || size > max_size ||
+        fread(buff, 1, size, stream) != size)
+      error("Failed to restore %s from restart file (%s)", errstr,
+            ferror(stream) ? strerror(errno) : "unexpected end of file");
+
+    const size_t expected =
+        (len - offset < slice_bytes) ? (len - offset) : slice_bytes;
+    uLongf out = expected;
+    if (uncompress((Bytef *)data + offset, &out, (const Bytef *)buff, size) !=
+            Z_OK ||
+        out != expected)
+      error("Failed to decompress %s from restart file", errstr);
+  }
+
+  free(buff);
+}
+#endif
+
+/**
+ * @brief Move a restart file stream to the next multiple of the alignment
+ * of the large blocks, writing zeros if we are writing.
+ *
+ * @param stream the file stream.
+ * @param writing are we writing the file?
+ * @param errstr a context string to qualify any errors.
+ */
+static void restart_align_stream(FILE *stream, const int writing,
+                                 const char *errstr) {
+
+  const size_t alignment = restart_file_layout.alignment;
+  const off_t pos = ftello(stream);
+  if (pos < 0) error("Failed to locate %s in restart file", errstr);
+  size_t pad = (alignment - (size_t)pos % alignment) % alignment;
+
+  if (writing) {
+    static const char zeros[512] = {0};
+    while (pad > 0) {
+      const size_t count = (pad < sizeof(zeros)) ? pad : sizeof(zeros);
+      if (fwrite(zeros, 1, count, stream) != count)
+        error("Failed to pad %s in restart file (%s)", errstr,
+              strerror(errno));
+      pad -= count;
+    }
+  } else if (pad > 0 && fseeko(stream, pos + pad, SEEK_SET) != 0) {
+    error("Failed to skip the padding of %s in restart file (%s)", errstr,
+          strerror(errno));
+  }
+}
+
+/**
+ * @brief Map a block of a restart file onto its memory.
+ *
+ * The whole pages of the block replace the pages of the memory by a private
+ * mapping of the file, so they are only read when first accessed and only
+ * copied when first modified. The remainder of the last page is read.
+ *
+ * @param ptr pointer to the memory, must be page aligned.
+ * @param len the size of the block in bytes.
+ * @param stream the file stream, positioned on the (page aligned) block.
+ * @param errstr a context string to qualify any errors.
+ *
+ * @return 1 if the block was restored, 0 if it needs to be read instead.
+ */
+static int restart_map_block(char *ptr, const size_t len, FILE *stream,
+                             const char *errstr) {
+
+  const size_t page = sysconf(_SC_PAGESIZE);
+  if (restart_file_layout.alignment % page != 0 || (uintptr_t)ptr % page != 0)
+    return 0;
+
+  const size_t mapped = len - len % page;
+  const off_t offset = ftello(stream);
+  if (mapped == 0 || offset < 0) return 0;
+
+  if (mmap(ptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+           fileno(stream), offset) == MAP_FAILED) {
+    message("Failed to map %s from restart file (%s), reading it instead",
+            errstr, strerror(errno));
+    return 0;
+  }
+  restart_mapped = 1;
+
+  /* Read what is left past the last whole page. */
+  if (fseeko(stream, offset + mapped, SEEK_SET) != 0 ||
+      fread(ptr + mapped, 1, len - mapped, stream) != len - mapped)
+    error("Failed to restore %s from restart file (%s)", errstr,
+          ferror(stream) ? strerror(errno) : "unexpected end of file");
+
+  return 1;
+}
+
+/**
+ * @brief The alignment to use for the memory of a large block to restore,
+ * such that it can be mapped from the restart file.
+ *
+ * @param alignment the alignment the memory needs anyway.
+ */
+size_t restart_block_alignment(const size_t alignment) {
+
+  if (!restart_mmap) return alignment;
+  const size_t page = sysconf(_SC_PAGESIZE);
+  return (alignment > page) ? alignment : page;
+}
+
 /**
  * @brief Read blocks of memory from a file stream into a memory location.
  *        Exits the application if the read fails and does nothing if the
@@ -256,6 +733,25 @@ void restart_read_blocks(void *ptr, size_t size, size_t nblocks, FILE *stream,
       strncpy(label, head.label, LABLEN + 1);
     }
 
+#ifdef HAVE_ZLIB
+    /* Large blocks may have been compressed. */
+    if (restart_file_layout.level > 0 &&
+        head.len >= restart_file_layout.min_bytes) {
+      restart_read_compressed((char *)ptr, head.len, stream, errstr);
+      return;
+    }
+#endif
+
+    /* Large uncompressed blocks start on an aligned offset and may be
+     * mapped. */
+    if (restart_file_layout.alignment > 0 &&
+        head.len >= restart_file_layout.min_bytes) {
+      restart_align_stream(stream, /*writing=*/0, errstr);
+      if (restart_mmap &&
+          restart_map_block((char *)ptr, head.len, stream, errstr))
+        return;
+    }
+
     nread = fread(ptr, size, nblocks, stream);
     if (nread != nblocks)
       error("Failed to restore %s from restart file (%s)", errstr,
@@ -291,6 +787,21 @@ void restart_write_blocks(void *ptr, size_t size, size_t nblocks, FILE *stream,
       error("Failed to save %s header to restart file (%s)", errstr,
             strerror(errno));
 
+#ifdef HAVE_ZLIB
+    /* Large blocks are compressed, if requested. */
+    if (restart_file_layout.level > 0 &&
+        head.len >= restart_file_layout.min_bytes) {
+      restart_write_compressed((const char *)ptr, head.len, stream, errstr);
+      return;
+    }
+#endif
+
+    /* Large uncompressed blocks start on an aligned offset so that they
+     * can be mapped on reading. */
+    if (restart_file_layout.alignment > 0 &&
+        head.len >= restart_file_layout.min_bytes)
+      restart_align_stream(stream, /*writing=*/1, errstr);
+
     nwrite = fwrite(ptr, size, nblocks, stream);
     if (nwrite != nblocks)
       error("Failed to save %s to restart file (%s)", errstr, strerror(errno));
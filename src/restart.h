@@ -23,7 +23,11 @@
 
 struct engine;
 
+/*! Are the large blocks of the restart files mapped rather than read? */
+extern int restart_mmap;
+
 void restart_write(struct engine *e, const char *filename);
+int restart_drain_wait(void);
 void restart_read(struct engine *e, const char *filename);
 
 char **restart_locate(const char *dir, const char *basename, int *nfiles);
@@ -35,6 +39,7 @@ void restart_read_blocks(void *ptr, size_t size, size_t nblocks, FILE *stream,
                          char *label, const char *errstr);
 void restart_write_blocks(void *ptr, size_t size, size_t nblocks, FILE *stream,
                           const char *label, const char *errstr);
+size_t restart_block_alignment(const size_t alignment);
 
 int restart_stop_now(const char *dir, int cleanup);
 
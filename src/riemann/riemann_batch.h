@@ -0,0 +1,112 @@
+#ifndef SWIFT_RIEMANN_BATCH_H
+#define SWIFT_RIEMANN_BATCH_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* Local headers. */
+#include "inline.h"
+
+/*! Number of interfaces solved at once by the riemann_batch_* functions */
+#define riemann_batch_size 16
+
+/**
+ * @brief A set of Riemann problems, stored as one array per variable.
+ *
+ * The riemann_batch_solve_for_flux() and
+ * riemann_batch_solve_for_middle_state_flux() functions of every solver
+ * loop over the interfaces of a batch instead of branching on each of them,
+ * which lets the compiler vectorise the bulk of the work.
+ */
+struct riemann_batch {
+
+  /*! Left and right states. */
+  float WL[5][riemann_batch_size], WR[5][riemann_batch_size];
+
+  /*! Normal and velocity of the interfaces. */
+  float n[3][riemann_batch_size], vij[3][riemann_batch_size];
+
+  /*! Fluxes through the interfaces, set by the solver. */
+  float flux[5][riemann_batch_size];
+
+  /*! Number of interfaces in the batch. */
+  int count;
+};
+
+/**
+ * @brief Adds a Riemann problem to a #riemann_batch.
+ *
+ * @param b The #riemann_batch, which must not be full.
+ * @param WL Left state variables.
+ * @param WR Right state variables.
+ * @param n Unit vector of the interface.
+ * @param vij Velocity of the interface.
+ * @return The index of the interface in the batch.
+ */
+__attribute__((always_inline)) INLINE static int riemann_batch_add(
+    struct riemann_batch *restrict b, const float *WL, const float *WR,
+    const float *n, const float *vij) {
+
+  const int i = b->count++;
+  for (int k = 0; k < 5; k++) {
+    b->WL[k][i] = WL[k];
+    b->WR[k][i] = WR[k];
+  }
+  for (int k = 0; k < 3; k++) {
+    b->n[k][i] = n[k];
+    b->vij[k][i] = vij[k];
+  }
+  return i;
+}
+
+/**
+ * @brief Copies one Riemann problem out of a #riemann_batch.
+ *
+ * @param b The #riemann_batch.
+ * @param i The index of the interface.
+ * @param WL (return) Left state variables.
+ * @param WR (return) Right state variables.
+ * @param n (return) Unit vector of the interface.
+ * @param vij (return) Velocity of the interface.
+ */
+__attribute__((always_inline)) INLINE static void riemann_batch_get_problem(
+    const struct riemann_batch *restrict b, const int i, float *WL, float *WR,
+    float *n, float *vij) {
+
+  for (int k = 0; k < 5; k++) {
+    WL[k] = b->WL[k][i];
+    WR[k] = b->WR[k][i];
+  }
+  for (int k = 0; k < 3; k++) {
+    n[k] = b->n[k][i];
+    vij[k] = b->vij[k][i];
+  }
+}
+
+/**
+ * @brief Copies the fluxes through one interface out of a #riemann_batch.
+ *
+ * @param b The #riemann_batch.
+ * @param i The index of the interface.
+ * @param flux (return) The fluxes (array of size 5 or more).
+ */
+__attribute__((always_inline)) INLINE static void riemann_batch_get_flux(
+    const struct riemann_batch *restrict b, const int i, float *flux) {
+
+  for (int k = 0; k < 5; k++) flux[k] = b->flux[k][i];
+}
+
+/**
+ * @brief Stores the fluxes through one interface in a #riemann_batch.
+ *
+ * @param b The #riemann_batch.
+ * @param i The index of the interface.
+ * @param flux The fluxes (array of size 5 or more).
+ */
+__attribute__((always_inline)) INLINE static void riemann_batch_set_flux(
+    struct riemann_batch *restrict b, const int i, const float *flux) {
+
+  for (int k = 0; k < 5; k++) b->flux[k][i] = flux[k];
+}
+
+#endif /* SWIFT_RIEMANN_BATCH_H */
@@ -39,6 +39,7 @@
 #include "adiabatic_index.h"
 #include "error.h"
 #include "minmax.h"
+#include "riemann_batch.h"
 #include "riemann_checks.h"
 #include "riemann_vacuum.h"
 
@@ -298,93 +299,31 @@ __attribute__((always_inline)) INLINE static float riemann_solve_brent(
   return b;
 }
 
-/* Solve the Riemann problem between the states WL and WR and store the result
- * in Whalf
- * The Riemann problem is solved in the x-direction; the velocities in the y-
- * and z-direction
- * are simply advected.
- */
 /**
- * @brief Solve the Riemann problem between the given left and right state and
- * along the given interface normal
- *
- * Based on chapter 4 in Toro
+ * @brief Sample the solution of a Riemann problem at the interface, given the
+ * pressure in the middle state
  *
  * @param WL The left state vector
  * @param WR The right state vector
+ * @param vL The left velocity along the interface normal
+ * @param vR The right velocity along the interface normal
+ * @param aL The left sound speed
+ * @param aR The right sound speed
+ * @param p The pressure in the middle state
  * @param Whalf Empty state vector in which the result will be stored
  * @param n_unit Normal vector of the interface
  */
-__attribute__((always_inline)) INLINE static void riemann_solver_solve(
-    const float* WL, const float* WR, float* Whalf, const float* n_unit) {
+__attribute__((always_inline)) INLINE static void riemann_sample(
+    const float* WL, const float* WR, float vL, float vR, float aL, float aR,
+    float p, float* Whalf, const float* n_unit) {
 
-  /* velocity of the left and right state in a frame aligned with n_unit */
-  float vL, vR, vhalf;
-  /* sound speeds */
-  float aL, aR;
-  /* variables used for finding pstar */
-  float p, pguess, fp, fpguess;
   /* variables used for sampling the solution */
-  float u;
+  float u, vhalf;
   float pdpR, SR;
   float SHR, STR;
   float pdpL, SL;
   float SHL, STL;
 
-  /* calculate velocities in interface frame */
-  vL = WL[1] * n_unit[0] + WL[2] * n_unit[1] + WL[3] * n_unit[2];
-  vR = WR[1] * n_unit[0] + WR[2] * n_unit[1] + WR[3] * n_unit[2];
-
-  /* calculate sound speeds */
-  aL = sqrtf(hydro_gamma * WL[4] / WL[0]);
-  aR = sqrtf(hydro_gamma * WR[4] / WR[0]);
-
-  /* check vacuum (generation) condition */
-  if (riemann_is_vacuum(WL, WR, vL, vR, aL, aR)) {
-    riemann_solve_vacuum(WL, WR, vL, vR, aL, aR, Whalf, n_unit);
-    return;
-  }
-
-  /* values are ok: let's find pstar (riemann_f(pstar) = 0)! */
-  /* We normally use a Newton-Raphson iteration to find the zeropoint
-     of riemann_f(p), but if pstar is close to 0, we risk negative p values.
-     Since riemann_f(p) is undefined for negative pressures, we don't
-     want this to happen.
-     We therefore use Brent's method if riemann_f(0) is larger than some
-     value. -5 makes the iteration fail safe while almost never invoking
-     the expensive Brent solver. */
-  p = 0.;
-  /* obtain a first guess for p */
-  pguess = riemann_guess_p(WL, WR, vL, vR, aL, aR);
-  fp = riemann_f(p, WL, WR, vL, vR, aL, aR);
-  fpguess = riemann_f(pguess, WL, WR, vL, vR, aL, aR);
-  /* ok, pstar is close to 0, better use Brent's method... */
-  /* we use Newton-Raphson until we find a suitable interval */
-  if (fp * fpguess >= 0.0f) {
-    /* Newton-Raphson until convergence or until suitable interval is found
-       to use Brent's method */
-    unsigned int counter = 0;
-    while (fabs(p - pguess) > 1.e-6f * 0.5f * (p + pguess) && fpguess < 0.0f) {
-      p = pguess;
-      pguess = pguess - fpguess / riemann_fprime(pguess, WL, WR, aL, aR);
-      fpguess = riemann_f(pguess, WL, WR, vL, vR, aL, aR);
-      counter++;
-      if (counter > 1000) {
-        error("Stuck in Newton-Raphson!\n");
-      }
-    }
-  }
-  /* As soon as there is a suitable interval: use Brent's method */
-  if (1.e6 * fabs(p - pguess) > 0.5f * (p + pguess) && fpguess > 0.0f) {
-    p = 0.0f;
-    fp = riemann_f(p, WL, WR, vL, vR, aL, aR);
-    /* use Brent's method to find the zeropoint */
-    p = riemann_solve_brent(p, pguess, fp, fpguess, 1.e-6, WL, WR, vL, vR, aL,
-                            aR);
-  } else {
-    p = pguess;
-  }
-
   /* calculate the velocity in the intermediate state */
   u = 0.5f * (vL + vR) + 0.5f * (riemann_fb(p, WR, aR) - riemann_fb(p, WL, aL));
 
@@ -493,6 +432,90 @@ __attribute__((always_inline)) INLINE static void riemann_solver_solve(
   Whalf[3] += vhalf * n_unit[2];
 }
 
+/* Solve the Riemann problem between the states WL and WR and store the result
+ * in Whalf
+ * The Riemann problem is solved in the x-direction; the velocities in the y-
+ * and z-direction
+ * are simply advected.
+ */
+/**
+ * @brief Solve the Riemann problem between the given left and right state and
+ * along the given interface normal
+ *
+ * Based on chapter 4 in Toro
+ *
+ * @param WL The left state vector
+ * @param WR The right state vector
+ * @param Whalf Empty state vector in which the result will be stored
+ * @param n_unit Normal vector of the interface
+ */
+__attribute__((always_inline)) INLINE static void riemann_solver_solve(
+    const float* WL, const float* WR, float* Whalf, const float* n_unit) {
+
+  /* velocity of the left and right state in a frame aligned with n_unit */
+  float vL, vR;
+  /* sound speeds */
+  float aL, aR;
+  /* variables used for finding pstar */
+  float p, pguess, fp, fpguess;
+
+  /* calculate velocities in interface frame */
+  vL = WL[1] * n_unit[0] + WL[2] * n_unit[1] + WL[3] * n_unit[2];
+  vR = WR[1] * n_unit[0] + WR[2] * n_unit[1] + WR[3] * n_unit[2];
+
+  /* calculate sound speeds */
+  aL = sqrtf(hydro_gamma * WL[4] / WL[0]);
+  aR = sqrtf(hydro_gamma * WR[4] / WR[0]);
+
+  /* check vacuum (generation) condition */
+  if (riemann_is_vacuum(WL, WR, vL, vR, aL, aR)) {
+    riemann_solve_vacuum(WL, WR, vL, vR, aL, aR, Whalf, n_unit);
+    return;
+  }
+
+  /* values are ok: let's find pstar (riemann_f(pstar) = 0)! */
+  /* We normally use a Newton-Raphson iteration to find the zeropoint
+     of riemann_f(p), but if pstar is close to 0, we risk negative p values.
+     Since riemann_f(p) is undefined for negative pressures, we don't
+     want this to happen.
+     We therefore use Brent's method if riemann_f(0) is larger than some
+     value. -5 makes the iteration fail safe while almost never invoking
+     the expensive Brent solver. */
+  p = 0.;
+  /* obtain a first guess for p */
+  pguess = riemann_guess_p(WL, WR, vL, vR, aL, aR);
+  fp = riemann_f(p, WL, WR, vL, vR, aL, aR);
+  fpguess = riemann_f(pguess, WL, WR, vL, vR, aL, aR);
+  /* ok, pstar is close to 0, better use Brent's method... */
+  /* we use Newton-Raphson until we find a suitable interval */
+  if (fp * fpguess >= 0.0f) {
+    /* Newton-Raphson until convergence or until suitable interval is found
+       to use Brent's method */
+    unsigned int counter = 0;
+    while (fabs(p - pguess) > 1.e-6f * 0.5f * (p + pguess) && fpguess < 0.0f) {
+      p = pguess;
+      pguess = pguess - fpguess / riemann_fprime(pguess, WL, WR, aL, aR);
+      fpguess = riemann_f(pguess, WL, WR, vL, vR, aL, aR);
+      counter++;
+      if (counter > 1000) {
+        error("Stuck in Newton-Raphson!\n");
+      }
+    }
+  }
+  /* As soon as there is a suitable interval: use Brent's method */
+  if (1.e6 * fabs(p - pguess) > 0.5f * (p + pguess) && fpguess > 0.0f) {
+    p = 0.0f;
+    fp = riemann_f(p, WL, WR, vL, vR, aL, aR);
+    /* use Brent's method to find the zeropoint */
+    p = riemann_solve_brent(p, pguess, fp, fpguess, 1.e-6, WL, WR, vL, vR, aL,
+                            aR);
+  } else {
+    p = pguess;
+  }
+
+  riemann_sample(WL, WR, vL, vR, aL, aR, p, Whalf, n_unit);
+}
+
 /**
  * @brief Solve the Riemann problem between the given left and right state and
  * return the velocity and pressure in the middle state
@@ -574,21 +597,23 @@ riemann_solver_solve_middle_state(const float* WL, const float vL,
       0.5f * (vL + vR) + 0.5f * (riemann_fb(p, WR, aR) - riemann_fb(p, WL, aL));
 }
 
-__attribute__((always_inline)) INLINE static void riemann_solve_for_flux(
-    const float* Wi, const float* Wj, const float* n_unit, const float* vij,
+/**
+ * @brief Compute the fluxes through an interface from the state at the
+ * interface
+ *
+ * @param Whalf The state at the interface
+ * @param n_unit Normal vector of the interface
+ * @param vij Velocity of the interface
+ * @param totflux Array to store the result in (of size 5 or more)
+ */
+__attribute__((always_inline)) INLINE static void riemann_flux_from_half_state(
+    const float* Whalf, const float* n_unit, const float* vij,
     float* totflux) {
 
-#ifdef SWIFT_DEBUG_CHECKS
-  riemann_check_input(Wi, Wj, n_unit, vij);
-#endif
-
-  float Whalf[5];
   float flux[5][3];
   float vtot[3];
   float rhoe;
 
-  riemann_solver_solve(Wi, Wj, Whalf, n_unit);
-
   flux[0][0] = Whalf[0] * Whalf[1];
   flux[0][1] = Whalf[0] * Whalf[2];
   flux[0][2] = Whalf[0] * Whalf[3];
@@ -626,6 +651,20 @@ __attribute__((always_inline)) INLINE static void riemann_solve_for_flux(
       flux[3][0] * n_unit[0] + flux[3][1] * n_unit[1] + flux[3][2] * n_unit[2];
   totflux[4] =
       flux[4][0] * n_unit[0] + flux[4][1] * n_unit[1] + flux[4][2] * n_unit[2];
+}
+
+__attribute__((always_inline)) INLINE static void riemann_solve_for_flux(
+    const float* Wi, const float* Wj, const float* n_unit, const float* vij,
+    float* totflux) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+  riemann_check_input(Wi, Wj, n_unit, vij);
+#endif
+
+  float Whalf[5];
+
+  riemann_solver_solve(Wi, Wj, Whalf, n_unit);
+  riemann_flux_from_half_state(Whalf, n_unit, vij, totflux);
 
 #ifdef SWIFT_DEBUG_CHECKS
   riemann_check_output(Wi, Wj, n_unit, vij, totflux);
@@ -671,4 +710,249 @@ riemann_solve_for_middle_state_flux(const float* Wi, const float* Wj,
 #endif
 }
 
+/**
+ * @brief Find the pressure in the middle state of the Riemann problems of a
+ * #riemann_batch
+ *
+ * This is the iteration of riemann_solver_solve() run on all the interfaces
+ * at once. Every pass of the Newton-Raphson loop moves the interfaces that
+ * have not converged yet and leaves the others where they are, such that the
+ * loop body has no branches and vectorises. The few interfaces that need
+ * Brent's method get it one at a time afterwards. Interfaces in (or
+ * generating) vacuum are flagged and go through the iteration as a uniform
+ * gas at rest, which cannot raise FPEs.
+ *
+ * @param b The #riemann_batch
+ * @param vL Array to store the left velocities along the interface normals in
+ * @param vR Array to store the right velocities along the interface normals in
+ * @param aL Array to store the left sound speeds in
+ * @param aR Array to store the right sound speeds in
+ * @param pstar Array to store the middle state pressures in
+ * @param vacuum Array to store the vacuum flags in. The other results are
+ * meaningless for the interfaces flagged
+ */
+__attribute__((always_inline)) INLINE static void riemann_batch_solve_pstar(
+    const struct riemann_batch* restrict b, float* restrict vL,
+    float* restrict vR, float* restrict aL, float* restrict aR,
+    float* restrict pstar, int* restrict vacuum) {
+
+  const int count = b->count;
+  float rhoL[riemann_batch_size], rhoR[riemann_batch_size];
+  float PL[riemann_batch_size], PR[riemann_batch_size];
+  float p[riemann_batch_size], fpguess[riemann_batch_size];
+  int active[riemann_batch_size];
+  int nr_active = 0;
+
+#if !defined(SWIFT_DEBUG_CHECKS) && _OPENMP >= 201307
+#pragma omp simd reduction(+ : nr_active)
+#endif
+  for (int i = 0; i < count; i++) {
+
+    const float n0 = b->n[0][i], n1 = b->n[1][i], n2 = b->n[2][i];
+    const float vL0 = b->WL[1][i] * n0 + b->WL[2][i] * n1 + b->WL[3][i] * n2;
+    const float vR0 = b->WR[1][i] * n0 + b->WR[2][i] * n1 + b->WR[3][i] * n2;
+    const int empty = !b->WL[0][i] || !b->WR[0][i];
+    const float aL0 =
+        sqrtf(hydro_gamma * b->WL[4][i] / (empty ? 1.0f : b->WL[0][i]));
+    const float aR0 =
+        sqrtf(hydro_gamma * b->WR[4][i] / (empty ? 1.0f : b->WR[0][i]));
+
+    /* Same test as riemann_is_vacuum() */
+    const int vac = empty || hydro_two_over_gamma_minus_one * aL0 +
+                                     hydro_two_over_gamma_minus_one * aR0 <=
+                                 vR0 - vL0;
+    vacuum[i] = vac;
+    rhoL[i] = vac ? 1.0f : b->WL[0][i];
+    rhoR[i] = vac ? 1.0f : b->WR[0][i];
+    PL[i] = vac ? 1.0f : b->WL[4][i];
+    PR[i] = vac ? 1.0f : b->WR[4][i];
+    vL[i] = vac ? 0.0f : vL0;
+    vR[i] = vac ? 0.0f : vR0;
+    aL[i] = vac ? sqrtf(hydro_gamma) : aL0;
+    aR[i] = vac ? sqrtf(hydro_gamma) : aR0;
+
+    /* The iteration only needs the density and pressure of the states */
+    const float WLi[5] = {rhoL[i], 0.0f, 0.0f, 0.0f, PL[i]};
+    const float WRi[5] = {rhoR[i], 0.0f, 0.0f, 0.0f, PR[i]};
+
+    /* obtain a first guess for p */
+    const float pguess = riemann_guess_p(WLi, WRi, vL[i], vR[i], aL[i], aR[i]);
+    const float fp = riemann_f(0.0f, WLi, WRi, vL[i], vR[i], aL[i], aR[i]);
+    const float fpg = riemann_f(pguess, WLi, WRi, vL[i], vR[i], aL[i], aR[i]);
+    p[i] = 0.0f;
+    pstar[i] = pguess;
+    fpguess[i] = fpg;
+
+    /* Newton-Raphson until convergence or until suitable interval is found
+       to use Brent's method */
+    active[i] = (fp * fpg >= 0.0f) &&
+                (fabsf(pguess) > 1.e-6f * 0.5f * pguess) && (fpg < 0.0f);
+    nr_active += active[i];
+  }
+
+  int counter = 0;
+  while (nr_active > 0) {
+
+    nr_active = 0;
+#if !defined(SWIFT_DEBUG_CHECKS) && _OPENMP >= 201307
+#pragma omp simd reduction(+ : nr_active)
+#endif
+    for (int i = 0; i < count; i++) {
+
+      const float WLi[5] = {rhoL[i], 0.0f, 0.0f, 0.0f, PL[i]};
+      const float WRi[5] = {rhoR[i], 0.0f, 0.0f, 0.0f, PR[i]};
+
+      /* The converged interfaces take a step of 0 */
+      const float pguess = pstar[i];
+      const float fprime = riemann_fprime(pguess, WLi, WRi, aL[i], aR[i]);
+      const float pnew = pguess - (active[i] ? fpguess[i] / fprime : 0.0f);
+      const float fpnew = riemann_f(pnew, WLi, WRi, vL[i], vR[i], aL[i], aR[i]);
+
+      p[i] = active[i] ? pguess : p[i];
+      pstar[i] = pnew;
+      fpguess[i] = active[i] ? fpnew : fpguess[i];
+      active[i] = active[i] &&
+                  (fabsf(pguess - pnew) > 1.e-6f * 0.5f * (pguess + pnew)) &&
+                  (fpnew < 0.0f);
+      nr_active += active[i];
+    }
+
+    counter++;
+    if (counter > 1000) {
+      error("Stuck in Newton-Raphson!\n");
+    }
+  }
+
+  /* As soon as there is a suitable interval: use Brent's method */
+  for (int i = 0; i < count; i++) {
+    if (vacuum[i]) continue;
+    if (1.e6 * fabs(p[i] - pstar[i]) > 0.5f * (p[i] + pstar[i]) &&
+        fpguess[i] > 0.0f) {
+      const float WLi[5] = {rhoL[i], 0.0f, 0.0f, 0.0f, PL[i]};
+      const float WRi[5] = {rhoR[i], 0.0f, 0.0f, 0.0f, PR[i]};
+      const float fp = riemann_f(0.0f, WLi, WRi, vL[i], vR[i], aL[i], aR[i]);
+      pstar[i] = riemann_solve_brent(0.0f, pstar[i], fp, fpguess[i], 1.e-6,
+                                     WLi, WRi, vL[i], vR[i], aL[i], aR[i]);
+    }
+  }
+}
+
+/**
+ * @brief Solve the Riemann problems of a #riemann_batch and store the fluxes
+ * through the interfaces in it
+ *
+ * The middle state pressure is found for all the interfaces at once; the
+ * solution is then sampled one interface at a time. The interfaces in vacuum
+ * go through riemann_solve_for_flux().
+ *
+ * @param b The #riemann_batch
+ */
+__attribute__((always_inline)) INLINE static void riemann_batch_solve_for_flux(
+    struct riemann_batch* restrict b) {
+
+  float vL[riemann_batch_size], vR[riemann_batch_size];
+  float aL[riemann_batch_size], aR[riemann_batch_size];
+  float pstar[riemann_batch_size];
+  int vacuum[riemann_batch_size];
+
+#ifdef SWIFT_DEBUG_CHECKS
+  for (int i = 0; i < b->count; i++) {
+    float WL[5], WR[5], n_unit[3], vij[3];
+    riemann_batch_get_problem(b, i, WL, WR, n_unit, vij);
+    riemann_check_input(WL, WR, n_unit, vij);
+  }
+#endif
+
+  riemann_batch_solve_pstar(b, vL, vR, aL, aR, pstar, vacuum);
+
+  for (int i = 0; i < b->count; i++) {
+    float WL[5], WR[5], n_unit[3], vij[3], totflux[5];
+    riemann_batch_get_problem(b, i, WL, WR, n_unit, vij);
+    if (vacuum[i]) {
+      riemann_solve_for_flux(WL, WR, n_unit, vij, totflux);
+    } else {
+      float Whalf[5];
+      riemann_sample(WL, WR, vL[i], vR[i], aL[i], aR[i], pstar[i], Whalf,
+                     n_unit);
+      riemann_flux_from_half_state(Whalf, n_unit, vij, totflux);
+    }
+    riemann_batch_set_flux(b, i, totflux);
+
+#ifdef SWIFT_DEBUG_CHECKS
+    riemann_check_output(WL, WR, n_unit, vij, totflux);
+#endif
+  }
+}
+
+/**
+ * @brief Solve the Riemann problems of a #riemann_batch for the middle state
+ * and store the fluxes through the interfaces in it
+ *
+ * The batched equivalent of riemann_solve_for_middle_state_flux(), which
+ * vectorises entirely but for the interfaces that need Brent's method.
+ *
+ * @param b The #riemann_batch
+ */
+__attribute__((always_inline)) INLINE static void
+riemann_batch_solve_for_middle_state_flux(struct riemann_batch* restrict b) {
+
+  const int count = b->count;
+  float vL[riemann_batch_size], vR[riemann_batch_size];
+  float aL[riemann_batch_size], aR[riemann_batch_size];
+  float pstar[riemann_batch_size];
+  int vacuum[riemann_batch_size];
+
+#ifdef SWIFT_DEBUG_CHECKS
+  for (int i = 0; i < count; i++) {
+    float WL[5], WR[5], n_unit[3], vij[3];
+    riemann_batch_get_problem(b, i, WL, WR, n_unit, vij);
+    riemann_check_input(WL, WR, n_unit, vij);
+  }
+#endif
+
+  riemann_batch_solve_pstar(b, vL, vR, aL, aR, pstar, vacuum);
+
+#if !defined(SWIFT_DEBUG_CHECKS) && _OPENMP >= 201307
+#pragma omp simd
+#endif
+  for (int i = 0; i < count; i++) {
+
+    /* The same harmless states as in riemann_batch_solve_pstar() */
+    const int vac = vacuum[i];
+    const float WLi[5] = {vac ? 1.0f : b->WL[0][i], 0.0f, 0.0f, 0.0f,
+                          vac ? 1.0f : b->WL[4][i]};
+    const float WRi[5] = {vac ? 1.0f : b->WR[0][i], 0.0f, 0.0f, 0.0f,
+                          vac ? 1.0f : b->WR[4][i]};
+
+    /* calculate the velocity in the intermediate state */
+    const float p = pstar[i];
+    const float u =
+        0.5f * (vL[i] + vR[i]) +
+        0.5f * (riemann_fb(p, WRi, aR[i]) - riemann_fb(p, WLi, aL[i]));
+
+    /* Vacuum has no flux */
+    const float PM = vac ? 0.0f : p;
+    const float vM = vac ? 0.0f : u;
+
+    const float n0 = b->n[0][i], n1 = b->n[1][i], n2 = b->n[2][i];
+    const float vface =
+        b->vij[0][i] * n0 + b->vij[1][i] * n1 + b->vij[2][i] * n2;
+
+    b->flux[0][i] = 0.0f;
+    b->flux[1][i] = PM * n0;
+    b->flux[2][i] = PM * n1;
+    b->flux[3][i] = PM * n2;
+    b->flux[4][i] = (vM + vface) * PM;
+  }
+
+#ifdef SWIFT_DEBUG_CHECKS
+  for (int i = 0; i < count; i++) {
+    float WL[5], WR[5], n_unit[3], vij[3], totflux[5];
+    riemann_batch_get_problem(b, i, WL, WR, n_unit, vij);
+    riemann_batch_get_flux(b, i, totflux);
+    riemann_check_output(WL, WR, n_unit, vij, totflux);
+  }
+#endif
+}
+
 #endif /* SWIFT_RIEMANN_EXACT_H */
@@ -30,6 +30,7 @@
 #include "adiabatic_index.h"
 #include "error.h"
 #include "minmax.h"
+#include "riemann_batch.h"
 #include "riemann_checks.h"
 #include "riemann_vacuum.h"
 
@@ -244,4 +245,274 @@ riemann_solve_for_middle_state_flux(const float *WL, const float *WR,
 #endif
 }
 
+/**
+ * @brief The left and right states of the Riemann problems of a
+ * #riemann_batch, as needed by the HLLC solver.
+ */
+struct riemann_hllc_batch_states {
+
+  /*! Densities and pressures. */
+  float rhoL[riemann_batch_size], rhoR[riemann_batch_size];
+  float PL[riemann_batch_size], PR[riemann_batch_size];
+
+  /*! Velocities along the interface normal and sound speeds. */
+  float uL[riemann_batch_size], uR[riemann_batch_size];
+  float aL[riemann_batch_size], aR[riemann_batch_size];
+
+  /*! Is the interface in (or generating) vacuum? */
+  int vacuum[riemann_batch_size];
+};
+
+/**
+ * @brief Gets the states of the Riemann problems of a #riemann_batch for the
+ * HLLC solver.
+ *
+ * The interfaces in (or generating) vacuum are flagged and get a uniform gas
+ * at rest, which cannot raise FPEs in the loops of the solver. This is done
+ * in a loop of its own, such that these loops do not mix the vacuum test
+ * with their own selections, which would keep the compiler from vectorising
+ * them.
+ *
+ * @param b The #riemann_batch.
+ * @param s (return) The states.
+ */
+__attribute__((always_inline)) INLINE static void riemann_hllc_batch_get_states(
+    const struct riemann_batch *restrict b,
+    struct riemann_hllc_batch_states *restrict s) {
+
+#if !defined(SWIFT_DEBUG_CHECKS) && _OPENMP >= 201307
+#pragma omp simd
+#endif
+  for (int i = 0; i < b->count; i++) {
+
+    /* STEP 0: obtain velocity in interface frame */
+    const float uL = b->WL[1][i] * b->n[0][i] + b->WL[2][i] * b->n[1][i] +
+                     b->WL[3][i] * b->n[2][i];
+    const float uR = b->WR[1][i] * b->n[0][i] + b->WR[2][i] * b->n[1][i] +
+                     b->WR[3][i] * b->n[2][i];
+    const float rhoLinv =
+        (b->WL[0][i] > 0.0f) ? 1.0f / max(b->WL[0][i], FLT_MIN) : 0.0f;
+    const float rhoRinv =
+        (b->WR[0][i] > 0.0f) ? 1.0f / max(b->WR[0][i], FLT_MIN) : 0.0f;
+    const float aL = sqrtf(hydro_gamma * b->WL[4][i] * rhoLinv);
+    const float aR = sqrtf(hydro_gamma * b->WR[4][i] * rhoRinv);
+
+    /* Same test as riemann_is_vacuum() */
+    const int vac = !b->WL[0][i] || !b->WR[0][i] ||
+                    hydro_two_over_gamma_minus_one * aL +
+                            hydro_two_over_gamma_minus_one * aR <=
+                        uR - uL;
+    s->vacuum[i] = vac;
+    s->rhoL[i] = vac ? 1.0f : b->WL[0][i];
+    s->rhoR[i] = vac ? 1.0f : b->WR[0][i];
+    s->PL[i] = vac ? 1.0f : b->WL[4][i];
+    s->PR[i] = vac ? 1.0f : b->WR[4][i];
+    s->uL[i] = vac ? 0.0f : uL;
+    s->uR[i] = vac ? 0.0f : uR;
+    s->aL[i] = vac ? sqrtf(hydro_gamma) : aL;
+    s->aR[i] = vac ? sqrtf(hydro_gamma) : aR;
+  }
+}
+
+/**
+ * @brief Gets the pressure estimate and contact wave speed of the Riemann
+ * problem of one interface for the HLLC solver (steps 1 and 2 of
+ * riemann_solve_for_flux()).
+ *
+ * @param s The states.
+ * @param i The index of the interface.
+ * @param pstar (return) The pressure estimate.
+ * @param SLmuL (return) The left wave speed relative to the left velocity.
+ * @param SRmuR (return) The right wave speed relative to the right velocity.
+ * @param Sstar (return) The contact wave speed.
+ */
+__attribute__((always_inline)) INLINE static void riemann_hllc_batch_get_waves(
+    const struct riemann_hllc_batch_states *restrict s, const int i,
+    float *pstar, float *SLmuL, float *SRmuR, float *Sstar) {
+
+  const float rhoL = s->rhoL[i], rhoR = s->rhoR[i];
+  const float PL = s->PL[i], PR = s->PR[i];
+  const float uL = s->uL[i], uR = s->uR[i];
+
+  /* STEP 1: pressure estimate */
+  const float rhobar = rhoL + rhoR;
+  const float abar = s->aL[i] + s->aR[i];
+  const float pPVRS = 0.5f * ((PL + PR) - 0.25f * (uR - uL) * rhobar * abar);
+  *pstar = max(0.0f, pPVRS);
+
+  /* STEP 2: wave speed estimates */
+  const float qL =
+      (*pstar > PL && PL > 0.0f)
+          ? sqrtf(1.0f + 0.5f * hydro_gamma_plus_one * hydro_one_over_gamma *
+                             (*pstar / max(PL, FLT_MIN) - 1.0f))
+          : 1.0f;
+  const float qR =
+      (*pstar > PR && PR > 0.0f)
+          ? sqrtf(1.0f + 0.5f * hydro_gamma_plus_one * hydro_one_over_gamma *
+                             (*pstar / max(PR, FLT_MIN) - 1.0f))
+          : 1.0f;
+  *SLmuL = -s->aL[i] * qL;
+  *SRmuR = s->aR[i] * qR;
+  *Sstar = (PR - PL + rhoL * uL * *SLmuL - rhoR * uR * *SRmuR) /
+           (rhoL * *SLmuL - rhoR * *SRmuR);
+}
+
+/**
+ * @brief Solve the Riemann problems of a #riemann_batch and store the fluxes
+ * through the interfaces in it.
+ *
+ * This is riemann_solve_for_flux() written as one loop over the interfaces
+ * without branches: the left or right state is picked depending on the side
+ * of the contact and the star region correction is multiplied away where it
+ * does not apply, such that the compiler can vectorise the loop. Interfaces
+ * in (or generating) vacuum are redone one at a time afterwards.
+ *
+ * @param b The #riemann_batch.
+ */
+__attribute__((always_inline)) INLINE static void riemann_batch_solve_for_flux(
+    struct riemann_batch *restrict b) {
+
+  const int count = b->count;
+  struct riemann_hllc_batch_states s;
+
+#ifdef SWIFT_DEBUG_CHECKS
+  for (int i = 0; i < count; i++) {
+    float WL[5], WR[5], n[3], vij[3];
+    riemann_batch_get_problem(b, i, WL, WR, n, vij);
+    riemann_check_input(WL, WR, n, vij);
+  }
+#endif
+
+  riemann_hllc_batch_get_states(b, &s);
+
+#if !defined(SWIFT_DEBUG_CHECKS) && _OPENMP >= 201307
+#pragma omp simd
+#endif
+  for (int i = 0; i < count; i++) {
+
+    float pstar, SLmuL, SRmuR, Sstar;
+    riemann_hllc_batch_get_waves(&s, i, &pstar, &SLmuL, &SRmuR, &Sstar);
+
+    /* STEP 3: HLLC flux in a frame moving with the interface velocity, using
+     * the state on the upwind side of the contact */
+    const int left = (Sstar >= 0.0f);
+    const float rho = left ? s.rhoL[i] : s.rhoR[i];
+    const float u = left ? s.uL[i] : s.uR[i];
+    const float P = left ? s.PL[i] : s.PR[i];
+    const float vx = left ? b->WL[1][i] : b->WR[1][i];
+    const float vy = left ? b->WL[2][i] : b->WR[2][i];
+    const float vz = left ? b->WL[3][i] : b->WR[3][i];
+    const float SmuW = left ? SLmuL : SRmuR;
+    const float S = SmuW + u;
+    const float n0 = b->n[0][i], n1 = b->n[1][i], n2 = b->n[2][i];
+
+    const float rhou = rho * u;
+    const float e = P * (1.0f / rho) * hydro_one_over_gamma_minus_one +
+                    0.5f * (vx * vx + vy * vy + vz * vz);
+    float f0 = rhou;
+    float f1 = rhou * vx + P * n0;
+    float f2 = rhou * vy + P * n1;
+    float f3 = rhou * vz + P * n2;
+    float f4 = rhou * e + P * u;
+
+    /* Star region correction, if the interface is between that wave and the
+     * contact */
+    const int star = (left && S < 0.0f) || (!left && S > 0.0f);
+    const float starfac = SmuW / (star ? S - Sstar : 1.0f);
+    const float rhoS = star ? rho * S : 0.0f;
+    const float rhoSstarfac = rhoS * (starfac - 1.0f);
+    const float rhoSSstarmu = rhoS * (Sstar - u) * starfac;
+
+    f0 += rhoSstarfac;
+    f1 += rhoSstarfac * vx + rhoSSstarmu * n0;
+    f2 += rhoSstarfac * vy + rhoSSstarmu * n1;
+    f3 += rhoSstarfac * vz + rhoSSstarmu * n2;
+    f4 += rhoSstarfac * e +
+          rhoSSstarmu * (Sstar + P / (star ? rho * SmuW : 1.0f));
+
+    /* deboost to lab frame, energy first as in riemann_solve_for_flux() */
+    const float vij0 = b->vij[0][i], vij1 = b->vij[1][i], vij2 = b->vij[2][i];
+    const float vij2_tot = vij0 * vij0 + vij1 * vij1 + vij2 * vij2;
+    b->flux[4][i] =
+        f4 + (vij0 * f1 + vij1 * f2 + vij2 * f3 + 0.5f * vij2_tot * f0);
+    b->flux[0][i] = f0;
+    b->flux[1][i] = f1 + vij0 * f0;
+    b->flux[2][i] = f2 + vij1 * f0;
+    b->flux[3][i] = f3 + vij2 * f0;
+  }
+
+  /* Redo the vacuum interfaces with the scalar solver */
+  for (int i = 0; i < count; i++) {
+    if (!s.vacuum[i]) continue;
+    float WL[5], WR[5], n[3], vij[3], flux[5];
+    riemann_batch_get_problem(b, i, WL, WR, n, vij);
+    riemann_solve_for_flux(WL, WR, n, vij, flux);
+    riemann_batch_set_flux(b, i, flux);
+  }
+
+#ifdef SWIFT_DEBUG_CHECKS
+  for (int i = 0; i < count; i++) {
+    float WL[5], WR[5], n[3], vij[3], flux[5];
+    riemann_batch_get_problem(b, i, WL, WR, n, vij);
+    riemann_batch_get_flux(b, i, flux);
+    riemann_check_output(WL, WR, n, vij, flux);
+  }
+#endif
+}
+
+/**
+ * @brief Solve the Riemann problems of a #riemann_batch for the middle state
+ * and store the fluxes through the interfaces in it.
+ *
+ * The batched equivalent of riemann_solve_for_middle_state_flux(), see
+ * riemann_batch_solve_for_flux(). Vacuum has no flux.
+ *
+ * @param b The #riemann_batch.
+ */
+__attribute__((always_inline)) INLINE static void
+riemann_batch_solve_for_middle_state_flux(struct riemann_batch *restrict b) {
+
+  const int count = b->count;
+  struct riemann_hllc_batch_states s;
+
+#ifdef SWIFT_DEBUG_CHECKS
+  for (int i = 0; i < count; i++) {
+    float WL[5], WR[5], n[3], vij[3];
+    riemann_batch_get_problem(b, i, WL, WR, n, vij);
+    riemann_check_input(WL, WR, n, vij);
+  }
+#endif
+
+  riemann_hllc_batch_get_states(b, &s);
+
+#if !defined(SWIFT_DEBUG_CHECKS) && _OPENMP >= 201307
+#pragma omp simd
+#endif
+  for (int i = 0; i < count; i++) {
+
+    float pstar, SLmuL, SRmuR, Sstar;
+    riemann_hllc_batch_get_waves(&s, i, &pstar, &SLmuL, &SRmuR, &Sstar);
+
+    const float n0 = b->n[0][i], n1 = b->n[1][i], n2 = b->n[2][i];
+    const float pflux = s.vacuum[i] ? 0.0f : pstar;
+    const float vface =
+        b->vij[0][i] * n0 + b->vij[1][i] * n1 + b->vij[2][i] * n2;
+
+    b->flux[0][i] = 0.0f;
+    b->flux[1][i] = pflux * n0;
+    b->flux[2][i] = pflux * n1;
+    b->flux[3][i] = pflux * n2;
+    b->flux[4][i] = pflux * (Sstar + vface);
+  }
+
+#ifdef SWIFT_DEBUG_CHECKS
+  for (int i = 0; i < count; i++) {
+    float WL[5], WR[5], n[3], vij[3], flux[5];
+    riemann_batch_get_problem(b, i, WL, WR, n, vij);
+    riemann_batch_get_flux(b, i, flux);
+    riemann_check_output(WL, WR, n, vij, flux);
+  }
+#endif
+}
+
 #endif /* SWIFT_RIEMANN_HLLC_H */
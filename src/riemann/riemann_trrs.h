@@ -30,6 +30,7 @@
 #include "adiabatic_index.h"
 #include "error.h"
 #include "minmax.h"
+#include "riemann_batch.h"
 #include "riemann_checks.h"
 #include "riemann_vacuum.h"
 
@@ -279,4 +280,41 @@ riemann_solve_for_middle_state_flux(const float* Wi, const float* Wj,
 #endif
 }
 
+/**
+ * @brief Solve the Riemann problems of a #riemann_batch and store the fluxes
+ * through the interfaces in it
+ *
+ * The TRRS has no iteration to vectorise, the interfaces are simply solved
+ * one after the other.
+ *
+ * @param b The #riemann_batch
+ */
+__attribute__((always_inline)) INLINE static void riemann_batch_solve_for_flux(
+    struct riemann_batch* restrict b) {
+
+  for (int i = 0; i < b->count; i++) {
+    float WL[5], WR[5], n_unit[3], vij[3], totflux[5];
+    riemann_batch_get_problem(b, i, WL, WR, n_unit, vij);
+    riemann_solve_for_flux(WL, WR, n_unit, vij, totflux);
+    riemann_batch_set_flux(b, i, totflux);
+  }
+}
+
+/**
+ * @brief Solve the Riemann problems of a #riemann_batch for the middle state
+ * and store the fluxes through the interfaces in it
+ *
+ * @param b The #riemann_batch
+ */
+__attribute__((always_inline)) INLINE static void
+riemann_batch_solve_for_middle_state_flux(struct riemann_batch* restrict b) {
+
+  for (int i = 0; i < b->count; i++) {
+    float WL[5], WR[5], n_unit[3], vij[3], totflux[5];
+    riemann_batch_get_problem(b, i, WL, WR, n_unit, vij);
+    riemann_solve_for_middle_state_flux(WL, WR, n_unit, vij, totflux);
+    riemann_batch_set_flux(b, i, totflux);
+  }
+}
+
 #endif /* SWIFT_RIEMANN_TRRS_H */
@@ -30,11 +30,27 @@
 #include <sunmatrix/sunmatrix_dense.h>
 
 /* Local includes. */
+#include "cuda_rt.h"
 #include "rt_cooling.h"
 #include "rt_cooling_rates.h"
 #include "rt_getters.h"
 #include "rt_setters.h"
 
+/**
+ * @brief What rt_do_thermochemistry_mode() does of the explicit solution.
+ */
+enum rt_tchem_explicit_mode {
+
+  /*! Compute it (and use it or not) */
+  rt_tchem_explicit_compute,
+
+  /*! Only write down the problem it solves */
+  rt_tchem_explicit_pack,
+
+  /*! Use the one already computed (on the GPU) */
+  rt_tchem_explicit_given
+};
+
 /**
  * @brief Main function for the thermochemistry step.
  *
@@ -46,18 +62,22 @@
  * @param phys_const The physical constants in internal units.
  * @param us The internal system of units.
  * @param dt The time-step of this particle.
+ * @param tchem The explicit problem (not used when computing it here).
+ * @param mode What to do of the explicit solution.
+ *
+ * @return 0 if there is nothing to do for this particle, 1 otherwise.
  */
-void rt_do_thermochemistry(struct part* restrict p, struct xpart* restrict xp,
-                           struct rt_props* rt_props,
-                           const struct cosmology* restrict cosmo,
-                           const struct hydro_props* hydro_props,
-                           const struct phys_const* restrict phys_const,
-                           const struct unit_system* restrict us,
-                           const double dt) {
+static int rt_do_thermochemistry_mode(
+    struct part* restrict p, struct xpart* restrict xp,
+    struct rt_props* rt_props, const struct cosmology* restrict cosmo,
+    const struct hydro_props* hydro_props,
+    const struct phys_const* restrict phys_const,
+    const struct unit_system* restrict us, const double dt,
+    struct cuda_rt_tchem* tchem, const enum rt_tchem_explicit_mode mode) {
 
   /* Nothing to do here? */
-  if (rt_props->skip_thermochemistry == 1) return;
-  if (dt == 0.0) return;
+  if (rt_props->skip_thermochemistry == 1) return 0;
+  if (dt == 0.0) return 0;
 
   rt_check_unphysical_elem_spec(p, rt_props);
 
@@ -176,6 +196,21 @@ void rt_do_thermochemistry(struct part* restrict p, struct xpart* restrict xp,
 
   data.u_min_cgs = u_min_cgs;
 
+  /* Only write down the explicit problem, to be solved on the GPU */
+  if (mode == rt_tchem_explicit_pack) {
+    tchem->T_cgs = T_cgs;
+    tchem->n_H_cgs = n_H_cgs;
+    tchem->cred_cgs = cred_cgs;
+    tchem->dt_cgs = dt_cgs;
+    tchem->rho_cgs = rho_cgs;
+    tchem->u_cgs = u_cgs;
+    tchem->u_min_cgs = u_min_cgs;
+    for (int spec = 0; spec < rt_species_count; spec++)
+      tchem->abundances[spec] = abundances[spec];
+    for (int i = 0; i < 3; i++) tchem->ngamma_cgs[i] = ngamma_cgs[i];
+    return 1;
+  }
+
   /**************************/
   /* GET RATE COEFFICIENTS  */
   /**************************/
@@ -231,9 +266,13 @@ void rt_do_thermochemistry(struct part* restrict p, struct xpart* restrict xp,
         epsilonlist[i][j] = 0.0;
       }
     }
-  } else {
+  } else if (mode == rt_tchem_explicit_compute) {
     rt_compute_rate_coefficients(T_cgs, onthespot, alphalist, betalist,
                                  Gammalist, sigmalist, epsilonlist);
+  } else {
+    /* The rates were used on the GPU, the opacities need the cross
+     * sections */
+    rt_compute_photoionization_rate_cgs(sigmalist, epsilonlist);
   }
 
   data.useparams = rt_props->useparams;
@@ -248,11 +287,21 @@ void rt_do_thermochemistry(struct part* restrict p, struct xpart* restrict xp,
       max_relative_change, new_ngamma_cgs[3], u_new_cgs;
 
   max_relative_change = 0.0;
-  /* compute net changes and cooling and heating for explicit solution */
-  rt_compute_explicit_thermochemistry_solution(
-      n_H_cgs, cred_cgs, dt_cgs, rho_cgs, u_cgs, u_min_cgs, abundances,
-      ngamma_cgs, alphalist, betalist, Gammalist, sigmalist, epsilonlist,
-      aindex, &u_new_cgs, new_abundances, new_ngamma_cgs, &max_relative_change);
+  if (mode == rt_tchem_explicit_compute) {
+    /* compute net changes and cooling and heating for explicit solution */
+    rt_compute_explicit_thermochemistry_solution(
+        n_H_cgs, cred_cgs, dt_cgs, rho_cgs, u_cgs, u_min_cgs, abundances,
+        ngamma_cgs, alphalist, betalist, Gammalist, sigmalist, epsilonlist,
+        aindex, &u_new_cgs, new_abundances, new_ngamma_cgs,
+        &max_relative_change);
+  } else {
+    /* The explicit solution from the GPU */
+    u_new_cgs = tchem->u_new_cgs;
+    for (int spec = 0; spec < rt_species_count; spec++)
+      new_abundances[spec] = tchem->new_abundances[spec];
+    for (int i = 0; i < 3; i++) new_ngamma_cgs[i] = tchem->new_ngamma_cgs[i];
+    max_relative_change = tchem->max_relative_change;
+  }
 
   /* check whether xHI bigger than one */
   int errorHI = 0;
@@ -335,7 +384,7 @@ void rt_do_thermochemistry(struct part* restrict p, struct xpart* restrict xp,
 
     rt_check_unphysical_elem_spec(p, rt_props);
 
-    return;
+    return 1;
 
   } else {
 
@@ -527,6 +576,97 @@ void rt_do_thermochemistry(struct part* restrict p, struct xpart* restrict xp,
 
     rt_check_unphysical_elem_spec(p, rt_props);
   }
+  return 1;
+}
+
+/**
+ * @brief Main function for the thermochemistry step.
+ *
+ * @param p Particle to work on.
+ * @param xp Pointer to the particle' extended data.
+ * @param rt_props RT properties struct
+ * @param cosmo The current cosmological model.
+ * @param hydro_props The #hydro_props.
+ * @param phys_const The physical constants in internal units.
+ * @param us The internal system of units.
+ * @param dt The time-step of this particle.
+ */
+void rt_do_thermochemistry(struct part* restrict p, struct xpart* restrict xp,
+                           struct rt_props* rt_props,
+                           const struct cosmology* restrict cosmo,
+                           const struct hydro_props* hydro_props,
+                           const struct phys_const* restrict phys_const,
+                           const struct unit_system* restrict us,
+                           const double dt) {
+
+  rt_do_thermochemistry_mode(p, xp, rt_props, cosmo, hydro_props, phys_const,
+                             us, dt, NULL, rt_tchem_explicit_compute);
+}
+
+/**
+ * @brief Write down the explicit thermochemistry problem of a particle, for
+ * it to be solved on the GPU.
+ *
+ * @param p Particle to work on.
+ * @param xp Pointer to the particle' extended data.
+ * @param rt_props RT properties struct
+ * @param cosmo The current cosmological model.
+ * @param hydro_props The #hydro_props.
+ * @param phys_const The physical constants in internal units.
+ * @param us The internal system of units.
+ * @param dt The time-step of this particle.
+ * @param tchem (return) The explicit problem.
+ *
+ * @return 0 if there is nothing to do for this particle, 1 otherwise.
+ */
+int rt_tchem_pack_explicit(struct part* restrict p, struct xpart* restrict xp,
+                           struct rt_props* rt_props,
+                           const struct cosmology* restrict cosmo,
+                           const struct hydro_props* hydro_props,
+                           const struct phys_const* restrict phys_const,
+                           const struct unit_system* restrict us,
+                           const double dt, struct cuda_rt_tchem* tchem) {
+
+  return rt_do_thermochemistry_mode(p, xp, rt_props, cosmo, hydro_props,
+                                    phys_const, us, dt, tchem,
+                                    rt_tchem_explicit_pack);
+}
+
+/**
+ * @brief Thermochemistry step of a particle whose explicit solution was
+ * computed on the GPU.
+ *
+ * The particle must not have changed since rt_tchem_pack_explicit(). The
+ * implicit solver is used when the explicit solution is not accurate
+ * enough, as in rt_do_thermochemistry().
+ *
+ * @param p Particle to work on.
+ * @param xp Pointer to the particle' extended data.
+ * @param rt_props RT properties struct
+ * @param cosmo The current cosmological model.
+ * @param hydro_props The #hydro_props.
+ * @param phys_const The physical constants in internal units.
+ * @param us The internal system of units.
+ * @param dt The time-step of this particle.
+ * @param tchem The explicit problem and its solution.
+ */
+void rt_tchem_with_explicit(struct part* restrict p, struct xpart* restrict xp,
+                            struct rt_props* rt_props,
+                            const struct cosmology* restrict cosmo,
+                            const struct hydro_props* hydro_props,
+                            const struct phys_const* restrict phys_const,
+                            const struct unit_system* restrict us,
+                            const double dt, struct cuda_rt_tchem* tchem) {
+
+  /* The problems the GPU could not solve are redone here, and reported */
+  if (isinf(tchem->max_relative_change)) {
+    rt_do_thermochemistry(p, xp, rt_props, cosmo, hydro_props, phys_const, us,
+                          dt);
+    return;
+  }
+
+  rt_do_thermochemistry_mode(p, xp, rt_props, cosmo, hydro_props, phys_const,
+                             us, dt, tchem, rt_tchem_explicit_given);
 }
 
 /**
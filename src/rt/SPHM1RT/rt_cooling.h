@@ -27,6 +27,8 @@
 #include "rt_properties.h"
 #include "rt_unphysical.h"
 
+struct cuda_rt_tchem;
+
 /**
  * @brief initialize particle quantities relevant for the thermochemistry.
  *
@@ -85,4 +87,20 @@ void rt_do_thermochemistry(struct part* restrict p, struct xpart* restrict xp,
                            const struct unit_system* restrict us,
                            const double dt);
 
+int rt_tchem_pack_explicit(struct part* restrict p, struct xpart* restrict xp,
+                           struct rt_props* rt_props,
+                           const struct cosmology* restrict cosmo,
+                           const struct hydro_props* hydro_props,
+                           const struct phys_const* restrict phys_const,
+                           const struct unit_system* restrict us,
+                           const double dt, struct cuda_rt_tchem* tchem);
+
+void rt_tchem_with_explicit(struct part* restrict p, struct xpart* restrict xp,
+                            struct rt_props* rt_props,
+                            const struct cosmology* restrict cosmo,
+                            const struct hydro_props* hydro_props,
+                            const struct phys_const* restrict phys_const,
+                            const struct unit_system* restrict us,
+                            const double dt, struct cuda_rt_tchem* tchem);
+
 #endif /* SWIFT_RT_SPHM1RT_COOLING_H */
@@ -28,10 +28,22 @@
 
 /* Local headers. */
 #include "cache.h"
+#include "cuda_devices.h"
+#include "cuda_gravity_cache.h"
+#include "cuda_hydro.h"
+#include "cuda_mm_batch.h"
+#include "cuda_pair_batch.h"
+#include "cuda_rt.h"
+#include "cuda_timeline.h"
+#include "cuda_work_split.h"
 #include "gravity_cache.h"
+#include "hydro_ngb_list.h"
+#include "runner_scratch.h"
+#include "task_counters.h"
 
 struct cell;
 struct engine;
+struct sort_entry;
 struct task;
 
 /* Unique identifier of loop types */
@@ -49,6 +61,16 @@ struct task;
 #define TASK_LOOP_RT_GRADIENT 11
 #define TASK_LOOP_RT_TRANSPORT 12
 
+/*! Number of entries from which the leaves are radix-sorted */
+#define sort_radix_threshold 384
+
+/*! Number of entries the radix sort can sort with its buffers on the stack */
+#define sort_radix_stack_size 2048
+
+/*! Average number of shifts per entry after which the repair of an old sort
+ * gives up and the entries are sorted from scratch */
+#define sort_resort_max_shifts 8
+
 /**
  * @brief A struct representing a runner's thread and its data.
  */
@@ -72,9 +94,52 @@ struct runner {
   /*! The particle gravity_cache of cell cj. */
   struct gravity_cache cj_gravity_cache;
 
+  /*! The device copy of the particle gravity_cache of cell ci. */
+  struct cuda_gravity_cache ci_cuda_gravity_cache;
+
+  /*! The device copy of the particle gravity_cache of cell cj. */
+  struct cuda_gravity_cache cj_cuda_gravity_cache;
+
+  /*! The device copy of the #part of cell ci for the density loop. */
+  struct cuda_hydro_cache ci_cuda_hydro_cache;
+
+  /*! The device copy of the #part of cell cj for the density loop. */
+  struct cuda_hydro_cache cj_cuda_hydro_cache;
+
+  /*! The #part waiting for their thermochemistry on the GPU. */
+  struct cuda_rt_cache cuda_rt_cache;
+
+  /*! The neighbour candidates of the #part iterated over in the ghost. */
+  struct hydro_ngb_list ghost_ngb_list;
+
+  /*! Temporary memory of the tasks of this runner. */
+  struct runner_scratch scratch;
+
+  /*! The pairs waiting to be sent to the GPU. */
+  struct cuda_pair_batch gpu_pair_batch;
+
+  /*! The M2L interactions waiting to be sent to the GPU. */
+  struct cuda_mm_batch gpu_mm_batch;
+
+  /*! Timings of the P2P pairs for the CPU/GPU split. */
+  struct cuda_split_timings gpu_split_timings;
+
+  /*! The GPU phases of the tasks of this runner, for the task dumps. */
+  struct cuda_timeline gpu_timeline;
+
+  /*! The hardware events of the tasks of this runner. */
+  struct task_counters counters;
+
+  /*! What this runner sent to its GPU since the last report. */
+  struct cuda_device_load gpu_load;
+
   /*! Time this runner was active during the last engine_launch. */
   ticks active_time;
 
+  /*! Time this runner spent looking for tasks, of which spinning and asleep,
+   * since the start of the step. */
+  ticks idle_time, spin_time, park_time;
+
 #ifdef WITH_VECTORIZATION
 
   /*! The particle cache of cell ci. */
@@ -104,6 +169,10 @@ void runner_do_hydro_sort(struct runner *r, struct cell *c, int flag,
 void runner_do_stars_sort(struct runner *r, struct cell *c, int flag,
                           int cleanup, int clock);
 void runner_do_all_hydro_sort(struct runner *r, struct cell *c);
+void runner_do_sort_ascending(struct sort_entry *sort, int N);
+void runner_do_sort_ascending_quicksort(struct sort_entry *sort, int N);
+void runner_do_sort_ascending_radix(struct sort_entry *sort, const int N);
+void runner_do_resort_ascending(struct sort_entry *sort, int N);
 void runner_do_all_stars_sort(struct runner *r, struct cell *c);
 void runner_do_drift_part(struct runner *r, struct cell *c, int timer);
 void runner_do_drift_gpart(struct runner *r, struct cell *c, int timer);
@@ -166,7 +235,6 @@ void runner_do_pack_limiter(struct runner *r, struct cell *c, void **buffer,
                             const int timer);
 void runner_do_unpack_limiter(struct runner *r, struct cell *c, void *buffer,
                               const int timer);
-void runner_do_neutrino_weighting(struct runner *r, struct cell *c, int timer);
 void runner_do_rt_advance_cell_time(struct runner *r, struct cell *c,
                                     int timer);
 void runner_do_collect_rt_times(struct runner *r, struct cell *c,
@@ -175,5 +243,6 @@ void *runner_main(void *data);
 
 ticks runner_get_active_time(const struct runner *restrict r);
 void runner_reset_active_time(struct runner *restrict r);
+void runner_reset_idle_times(struct runner *restrict r);
 
 #endif /* SWIFT_RUNNER_H */
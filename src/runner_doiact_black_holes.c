@@ -31,6 +31,36 @@
 #include "space_getsid.h"
 #include "timers.h"
 
+/**
+ * @brief Can a black hole reach any of the gas particles of a cell?
+ *
+ * The kernel of the black hole is compared with the box of the cell, grown by
+ * the largest displacement of its #part since the last rebuild, such that the
+ * gas of a cell out of reach is not looked at. The displacements of the
+ * foreign cells are those of the previous step, so these are always swept.
+ *
+ * @param x The position of the black hole, in the frame of the cell.
+ * @param hig2 The square of the kernel radius of the black hole.
+ * @param c The #cell.
+ */
+INLINE static int runner_bh_reaches_cell(const double x[3], const float hig2,
+                                         const struct cell *c) {
+
+  if (c->nodeID != engine_rank) return 1;
+
+  /* A little slack for the single-precision distances of the loops */
+  const double pad = c->hydro.dx_max_part + 1e-4 * c->width[0];
+
+  double r2 = 0.;
+  for (int k = 0; k < 3; k++) {
+    const double lo = c->loc[k] - pad;
+    const double hi = c->loc[k] + c->width[k] + pad;
+    const double d = x[k] < lo ? lo - x[k] : (x[k] > hi ? x[k] - hi : 0.);
+    r2 += d * d;
+  }
+  return r2 < hig2;
+}
+
 /* Import the black hole density loop functions. */
 #define FUNCTION density
 #define FUNCTION_TASK_LOOP TASK_LOOP_DENSITY
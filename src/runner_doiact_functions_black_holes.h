@@ -241,6 +241,12 @@ void DO_NONSYM_PAIR1_BH_NAIVE(struct runner *r, struct cell *restrict ci,
 
       const float hi = bi->h;
       const float hig2 = hi * hi * kernel_gamma2;
+
+      /* Gather the gas of cj only if the kernel reaches it */
+      const double bi_x[3] = {bi->x[0] - shift[0], bi->x[1] - shift[1],
+                              bi->x[2] - shift[2]};
+      if (!runner_bh_reaches_cell(bi_x, hig2, cj)) continue;
+
       const float bix[3] = {(float)(bi->x[0] - (cj->loc[0] + shift[0])),
                             (float)(bi->x[1] - (cj->loc[1] + shift[1])),
                             (float)(bi->x[2] - (cj->loc[2] + shift[2]))};
@@ -429,6 +435,10 @@ void DOPAIR1_SUBSET_BH_NAIVE(struct runner *r, struct cell *restrict ci,
       error("Trying to correct smoothing length of inactive particle !");
 #endif
 
+    /* Gather the gas of cj only if the kernel reaches it */
+    const double bi_x[3] = {bix, biy, biz};
+    if (!runner_bh_reaches_cell(bi_x, hig2, cj)) continue;
+
     /* Loop over the parts in cj. */
     for (int pjd = 0; pjd < count_j; pjd++) {
 
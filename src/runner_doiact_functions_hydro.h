@@ -47,6 +47,7 @@ void DOPAIR1_NAIVE(struct runner *r, struct cell *restrict ci,
 #endif
 
   TIMER_TIC;
+  FLUX_BATCH_DECLARE;
 
   /* Anything to do here? */
   if (!CELL_IS_ACTIVE(ci, e) && !CELL_IS_ACTIVE(cj, e)) return;
@@ -158,6 +159,7 @@ void DOPAIR1_NAIVE(struct runner *r, struct cell *restrict ci,
     } /* loop over the parts in cj. */
   } /* loop over the parts in ci. */
 
+  FLUX_BATCH_FLUSH;
   TIMER_TOC(TIMER_DOPAIR);
 }
 
@@ -182,6 +184,7 @@ void DOPAIR2_NAIVE(struct runner *r, struct cell *restrict ci,
 #endif
 
   TIMER_TIC;
+  FLUX_BATCH_DECLARE;
 
   /* Anything to do here? */
   if (!CELL_IS_ACTIVE(ci, e) && !CELL_IS_ACTIVE(cj, e)) return;
@@ -312,6 +315,7 @@ void DOPAIR2_NAIVE(struct runner *r, struct cell *restrict ci,
     } /* loop over the parts in cj. */
   } /* loop over the parts in ci. */
 
+  FLUX_BATCH_FLUSH;
   TIMER_TOC(TIMER_DOPAIR);
 }
 
@@ -334,6 +338,7 @@ void DOSELF1_NAIVE(struct runner *r, struct cell *restrict c) {
 #endif
 
   TIMER_TIC;
+  FLUX_BATCH_DECLARE;
 
   /* Anything to do here? */
   if (!CELL_IS_ACTIVE(c, e)) return;
@@ -453,6 +458,7 @@ void DOSELF1_NAIVE(struct runner *r, struct cell *restrict c) {
     } /* loop over the parts in cj. */
   } /* loop over the parts in ci. */
 
+  FLUX_BATCH_FLUSH;
   TIMER_TOC(TIMER_DOSELF);
 }
 
@@ -475,6 +481,7 @@ void DOSELF2_NAIVE(struct runner *r, struct cell *restrict c) {
 #endif
 
   TIMER_TIC;
+  FLUX_BATCH_DECLARE;
 
   /* Anything to do here? */
   if (!CELL_IS_ACTIVE(c, e)) return;
@@ -594,6 +601,7 @@ void DOSELF2_NAIVE(struct runner *r, struct cell *restrict c) {
     } /* loop over the parts in cj. */
   } /* loop over the parts in ci. */
 
+  FLUX_BATCH_FLUSH;
   TIMER_TOC(TIMER_DOSELF);
 }
 
@@ -625,6 +633,7 @@ void DOPAIR_SUBSET_NAIVE(struct runner *r, struct cell *restrict ci,
 #endif
 
   TIMER_TIC;
+  FLUX_BATCH_DECLARE;
 
   const int count_j = cj->hydro.count;
   struct part *restrict parts_j = cj->hydro.parts;
@@ -696,6 +705,7 @@ void DOPAIR_SUBSET_NAIVE(struct runner *r, struct cell *restrict ci,
     } /* loop over the parts in cj. */
   } /* loop over the parts in ci. */
 
+  FLUX_BATCH_FLUSH;
   TIMER_TOC(timer_dopair_subset_naive);
 }
 
@@ -727,6 +737,7 @@ void DOPAIR_SUBSET(struct runner *r, struct cell *restrict ci,
 #endif
 
   TIMER_TIC;
+  FLUX_BATCH_DECLARE;
 
   const int count_j = cj->hydro.count;
   struct part *restrict parts_j = cj->hydro.parts;
@@ -872,6 +883,7 @@ void DOPAIR_SUBSET(struct runner *r, struct cell *restrict ci,
     } /* loop over the parts in ci. */
   }
 
+  FLUX_BATCH_FLUSH;
   TIMER_TOC(timer_dopair_subset);
 }
 
@@ -930,7 +942,7 @@ void DOPAIR_SUBSET_BRANCH(struct runner *r, struct cell *restrict ci,
   if (force_naive || !is_sorted) {
     DOPAIR_SUBSET_NAIVE(r, ci, parts_i, ind, count, cj, shift);
   } else {
-#if defined(WITH_VECTORIZATION) && defined(GADGET2_SPH)
+#if defined(HYDRO_DENSITY_VEC)
     if (sort_is_face(sid))
       runner_dopair_subset_density_vec(r, ci, parts_i, ind, count, cj, sid,
                                        flipped, shift);
@@ -964,6 +976,7 @@ void DOSELF_SUBSET(struct runner *r, struct cell *restrict ci,
 #endif
 
   TIMER_TIC;
+  FLUX_BATCH_DECLARE;
 
   /* Cosmological terms and physical constants */
   const float a = cosmo->a;
@@ -1038,6 +1051,7 @@ void DOSELF_SUBSET(struct runner *r, struct cell *restrict ci,
     } /* loop over the parts in cj. */
   } /* loop over the parts in ci. */
 
+  FLUX_BATCH_FLUSH;
   TIMER_TOC(timer_doself_subset);
 }
 
@@ -1055,13 +1069,90 @@ void DOSELF_SUBSET_BRANCH(struct runner *r, struct cell *restrict ci,
                           struct part *restrict parts, int *restrict ind,
                           int count) {
 
-#if defined(WITH_VECTORIZATION) && defined(GADGET2_SPH)
+#if defined(HYDRO_DENSITY_VEC)
   runner_doself_subset_density_vec(r, ci, parts, ind, count);
 #else
   DOSELF_SUBSET(r, ci, parts, ind, count);
 #endif
 }
 
+#if (FUNCTION_TASK_LOOP == TASK_LOOP_DENSITY)
+/**
+ * @brief Compute the interactions of a subset of #part with the neighbour
+ * candidates the ghost collected for them.
+ *
+ * @param r The #runner.
+ * @param parts The #part to interact.
+ * @param ind The list of indices of the particles to interact.
+ * @param count The number of particles in @c ind.
+ * @param ngbs The neighbour lists, one per entry of @c ind.
+ */
+void DOSUBSET_NGB_LIST(struct runner *r, struct part *restrict parts,
+                       const int *restrict ind, const int count,
+                       const struct hydro_ngb_list *restrict ngbs) {
+
+  const struct engine *e = r->e;
+  const struct cosmology *cosmo = e->cosmology;
+
+  TIMER_TIC;
+
+  /* Cosmological terms and physical constants */
+  const float a = cosmo->a;
+  const float H = cosmo->H;
+  GET_MU0();
+
+  /* Loop over the parts to update. */
+  for (int pid = 0; pid < count; pid++) {
+
+    /* Get a hold of the ith part and of its candidates. */
+    struct part *pi = &parts[ind[pid]];
+    const struct hydro_ngb *restrict list = &ngbs->ngbs[ngbs->offset[pid]];
+    const int count_j = ngbs->length[pid];
+    const float hi = pi->h;
+    const float hig2 = hi * hi * kernel_gamma2;
+
+#ifdef SWIFT_DEBUG_CHECKS
+    if (!part_is_active(pi, e)) error("Inactive particle in subset function!");
+    if (hi > ngbs->h[pid]) error("Neighbour list too short for particle!");
+#endif
+
+    /* Loop over the candidates. */
+    for (int pjd = 0; pjd < count_j; pjd++) {
+
+      /* Get a pointer to the jth particle. */
+      struct part *restrict pj = list[pjd].pj;
+      const float hj = pj->h;
+
+      /* The pairwise distance. */
+      float dx[3] = {list[pjd].dx[0], list[pjd].dx[1], list[pjd].dx[2]};
+      const float r2 = dx[0] * dx[0] + dx[1] * dx[1] + dx[2] * dx[2];
+
+#if defined(SWIFT_DEBUG_CHECKS) && defined(DO_DRIFT_DEBUG_CHECKS)
+      /* Check that particles have been drifted to the current time */
+      if (pi->ti_drift != e->ti_current)
+        error("Particle pi not drifted to current time");
+      if (pj->ti_drift != e->ti_current)
+        error("Particle pj not drifted to current time");
+#endif
+
+      /* Hit or miss? */
+      if (r2 < hig2) {
+
+        IACT_NONSYM(r2, dx, hi, hj, pi, pj, a, H);
+        IACT_NONSYM_MHD(r2, dx, hi, hj, pi, pj, mu_0, a, H);
+        runner_iact_nonsym_chemistry(r2, dx, hi, hj, pi, pj, a, H);
+        runner_iact_nonsym_pressure_floor(r2, dx, hi, hj, pi, pj, a, H);
+        runner_iact_nonsym_star_formation(r2, dx, hi, hj, pi, pj, a, H);
+        runner_iact_nonsym_sink(r2, dx, hi, hj, pi, pj, a, H,
+                                e->sink_properties->cut_off_radius);
+      }
+    } /* loop over the candidates. */
+  } /* loop over the parts to update. */
+
+  TIMER_TOC(timer_dosubset_ngb_list);
+}
+#endif
+
 /**
  * @brief Compute the interactions between a cell pair (non-symmetric).
  *
@@ -1083,6 +1174,7 @@ void DOPAIR1(struct runner *r, struct cell *ci, struct cell *cj, const int sid,
 #endif
 
   TIMER_TIC;
+  FLUX_BATCH_DECLARE;
 
   /* Get the cutoff shift. */
   double rshift = 0.0;
@@ -1322,6 +1414,7 @@ void DOPAIR1(struct runner *r, struct cell *ci, struct cell *cj, const int sid,
     } /* loop over the parts in cj. */
   } /* Cell cj is active */
 
+  FLUX_BATCH_FLUSH;
   TIMER_TOC(TIMER_DOPAIR);
 }
 
@@ -1407,12 +1500,17 @@ void DOPAIR1_BRANCH(struct runner *r, struct cell *ci, struct cell *cj) {
 
 #if defined(SWIFT_USE_NAIVE_INTERACTIONS)
   DOPAIR1_NAIVE(r, ci, cj);
-#elif defined(WITH_VECTORIZATION) && defined(GADGET2_SPH) && \
-    (FUNCTION_TASK_LOOP == TASK_LOOP_DENSITY)
+#elif defined(HYDRO_DENSITY_VEC) && (FUNCTION_TASK_LOOP == TASK_LOOP_DENSITY)
+#if defined(CUDA_HYDRO_DENSITY)
+  if (cuda_hydro_dopair_density(r, ci, cj, shift)) return;
+#endif
   if (!sort_is_corner(sid))
     runner_dopair1_density_vec(r, ci, cj, sid, shift);
   else
     DOPAIR1(r, ci, cj, sid, shift);
+#elif defined(CUDA_HYDRO_DENSITY) && (FUNCTION_TASK_LOOP == TASK_LOOP_DENSITY)
+  if (!cuda_hydro_dopair_density(r, ci, cj, shift))
+    DOPAIR1(r, ci, cj, sid, shift);
 #else
   DOPAIR1(r, ci, cj, sid, shift);
 #endif
@@ -1439,6 +1537,7 @@ void DOPAIR2(struct runner *r, struct cell *ci, struct cell *cj, const int sid,
 #endif
 
   TIMER_TIC;
+  FLUX_BATCH_DECLARE;
 
   /* Get the cutoff shift. */
   double rshift = 0.0;
@@ -1967,6 +2066,7 @@ void DOPAIR2(struct runner *r, struct cell *ci, struct cell *cj, const int sid,
   if (CELL_IS_ACTIVE(cj, e))  // && !cell_is_all_active_hydro(cj, e))
     free(sort_active_j);
 
+  FLUX_BATCH_FLUSH;
   TIMER_TOC(TIMER_DOPAIR);
 }
 
@@ -2080,6 +2180,7 @@ void DOSELF1(struct runner *r, struct cell *restrict c) {
 #endif
 
   TIMER_TIC;
+  FLUX_BATCH_DECLARE;
 
   struct part *restrict parts = c->hydro.parts;
   const int count = c->hydro.count;
@@ -2269,6 +2370,7 @@ void DOSELF1(struct runner *r, struct cell *restrict c) {
 
   free(indt);
 
+  FLUX_BATCH_FLUSH;
   TIMER_TOC(TIMER_DOSELF);
 }
 
@@ -2299,9 +2401,13 @@ void DOSELF1_BRANCH(struct runner *r, struct cell *c) {
 
 #if defined(SWIFT_USE_NAIVE_INTERACTIONS)
   DOSELF1_NAIVE(r, c);
-#elif defined(WITH_VECTORIZATION) && defined(GADGET2_SPH) && \
-    (FUNCTION_TASK_LOOP == TASK_LOOP_DENSITY)
+#elif defined(HYDRO_DENSITY_VEC) && (FUNCTION_TASK_LOOP == TASK_LOOP_DENSITY)
+#if defined(CUDA_HYDRO_DENSITY)
+  if (cuda_hydro_doself_density(r, c)) return;
+#endif
   runner_doself1_density_vec(r, c);
+#elif defined(CUDA_HYDRO_DENSITY) && (FUNCTION_TASK_LOOP == TASK_LOOP_DENSITY)
+  if (!cuda_hydro_doself_density(r, c)) DOSELF1(r, c);
 #else
   DOSELF1(r, c);
 #endif
@@ -2324,6 +2430,7 @@ void DOSELF2(struct runner *r, struct cell *restrict c) {
 #endif
 
   TIMER_TIC;
+  FLUX_BATCH_DECLARE;
 
   struct part *restrict parts = c->hydro.parts;
   const int count = c->hydro.count;
@@ -2486,6 +2593,7 @@ void DOSELF2(struct runner *r, struct cell *restrict c) {
 
   free(indt);
 
+  FLUX_BATCH_FLUSH;
   TIMER_TOC(TIMER_DOSELF);
 }
 
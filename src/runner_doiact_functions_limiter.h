@@ -50,6 +50,8 @@ void DOPAIR1_NAIVE(struct runner *r, struct cell *restrict ci,
   const int count_j = cj->hydro.count;
   struct part *restrict parts_i = ci->hydro.parts;
   struct part *restrict parts_j = cj->hydro.parts;
+  const int ci_local = ci->nodeID == e->nodeID;
+  const int cj_local = cj->nodeID == e->nodeID;
 
   /* Cosmological terms */
   const float a = cosmo->a;
@@ -73,7 +75,8 @@ void DOPAIR1_NAIVE(struct runner *r, struct cell *restrict ci,
     /* Skip inhibited particles. */
     if (part_is_inhibited(pi, e)) continue;
 
-    const int pi_active = part_is_starting(pi, e);
+    const int pi_active =
+        part_is_starting(pi, e) && timestep_limiter_can_wake(pi, ci_local);
     const float hi = pi->h;
     const float hig2 = hi * hi * kernel_gamma2;
     const float pix[3] = {(float)(pi->x[0] - (cj->loc[0] + shift[0])),
@@ -91,7 +94,8 @@ void DOPAIR1_NAIVE(struct runner *r, struct cell *restrict ci,
 
       const float hj = pj->h;
       const float hjg2 = hj * hj * kernel_gamma2;
-      const int pj_active = part_is_starting(pj, e);
+      const int pj_active =
+          part_is_starting(pj, e) && timestep_limiter_can_wake(pj, cj_local);
 
       /* Compute the pairwise distance. */
       const float pjx[3] = {(float)(pj->x[0] - cj->loc[0]),
@@ -152,6 +156,7 @@ void DOSELF1_NAIVE(struct runner *r, struct cell *restrict c) {
 
   const int count = c->hydro.count;
   struct part *restrict parts = c->hydro.parts;
+  const int local = c->nodeID == e->nodeID;
 
   /* Loop over the parts in ci. */
   for (int pid = 0; pid < count; pid++) {
@@ -163,6 +168,7 @@ void DOSELF1_NAIVE(struct runner *r, struct cell *restrict c) {
     if (part_is_inhibited(pi, e)) continue;
 
     const int pi_active = part_is_starting(pi, e);
+    const int pi_wakes = pi_active && timestep_limiter_can_wake(pi, local);
     const float hi = pi->h;
     const float hig2 = hi * hi * kernel_gamma2;
     const float pix[3] = {(float)(pi->x[0] - c->loc[0]),
@@ -181,6 +187,7 @@ void DOSELF1_NAIVE(struct runner *r, struct cell *restrict c) {
       const float hj = pj->h;
       const float hjg2 = hj * hj * kernel_gamma2;
       const int pj_active = part_is_starting(pj, e);
+      const int pj_wakes = pj_active && timestep_limiter_can_wake(pj, local);
 
       /* Compute the pairwise distance. */
       const float pjx[3] = {(float)(pj->x[0] - c->loc[0]),
@@ -204,10 +211,10 @@ void DOSELF1_NAIVE(struct runner *r, struct cell *restrict c) {
       if (doi && doj) {
 
         IACT(r2, dx, hi, hj, pi, pj, a, H);
-      } else if (doi) {
+      } else if (doi && pi_wakes) {
 
         IACT_NONSYM(r2, dx, hi, hj, pi, pj, a, H);
-      } else if (doj) {
+      } else if (doj && pj_wakes) {
 
         dx[0] = -dx[0];
         dx[1] = -dx[1];
@@ -269,6 +276,8 @@ void DOPAIR1(struct runner *r, struct cell *ci, struct cell *cj, const int sid,
   const double di_max = sort_i[count_i - 1].d - rshift;
   const double dj_min = sort_j[0].d;
   const float dx_max = (ci->hydro.dx_max_sort + cj->hydro.dx_max_sort);
+  const int ci_local = ci->nodeID == e->nodeID;
+  const int cj_local = cj->nodeID == e->nodeID;
 
   /* Cosmological terms */
   const float a = cosmo->a;
@@ -284,8 +293,9 @@ void DOPAIR1(struct runner *r, struct cell *ci, struct cell *cj, const int sid,
       struct part *restrict pi = &parts_i[sort_i[pid].i];
       const float hi = pi->h;
 
-      /* Skip inactive particles */
+      /* Skip inactive particles and those that cannot wake anything up */
       if (!part_is_starting(pi, e)) continue;
+      if (!timestep_limiter_can_wake(pi, ci_local)) continue;
 
       /* Is there anything we need to interact with ? */
       const double di = sort_i[pid].d + hi * kernel_gamma + dx_max - rshift;
@@ -368,8 +378,9 @@ void DOPAIR1(struct runner *r, struct cell *ci, struct cell *cj, const int sid,
       struct part *pj = &parts_j[sort_j[pjd].i];
       const float hj = pj->h;
 
-      /* Skip inactive particles */
+      /* Skip inactive particles and those that cannot wake anything up */
       if (!part_is_starting(pj, e)) continue;
+      if (!timestep_limiter_can_wake(pj, cj_local)) continue;
 
       /* Is there anything we need to interact with ? */
       const double dj = sort_j[pjd].d - hj * kernel_gamma - dx_max + rshift;
@@ -547,15 +558,17 @@ void DOSELF1(struct runner *r, struct cell *restrict c) {
 
   struct part *restrict parts = c->hydro.parts;
   const int count = c->hydro.count;
+  const int local = c->nodeID == e->nodeID;
 
-  /* Set up indt. */
+  /* Set up indt, the list of the particles that can wake others up. */
   int *indt = NULL;
   int countdt = 0, firstdt = 0;
   if (posix_memalign((void **)&indt, VEC_SIZE * sizeof(int),
                      count * sizeof(int)) != 0)
     error("Failed to allocate indt.");
   for (int k = 0; k < count; k++)
-    if (part_is_starting(&parts[k], e)) {
+    if (part_is_starting(&parts[k], e) &&
+        timestep_limiter_can_wake(&parts[k], local)) {
       indt[countdt] = k;
       countdt += 1;
     }
@@ -578,9 +591,10 @@ void DOSELF1(struct runner *r, struct cell *restrict c) {
     for (int k = 0; k < 3; k++) pix[k] = pi->x[k];
     const float hi = pi->h;
     const float hig2 = hi * hi * kernel_gamma2;
+    const int pi_active = part_is_starting(pi, e);
 
-    /* Is the ith particle inactive? */
-    if (!part_is_starting(pi, e)) {
+    /* Is the ith particle inactive or unable to wake anything up? */
+    if (!pi_active || !timestep_limiter_can_wake(pi, local)) {
 
       /* Loop over the other particles .*/
       for (int pjd = firstdt; pjd < countdt; pjd++) {
@@ -605,8 +619,8 @@ void DOSELF1(struct runner *r, struct cell *restrict c) {
           r2 += dx[k] * dx[k];
         }
 
-        /* Hit or miss? */
-        if (r2 < hj * hj * kernel_gamma2) {
+        /* Hit or miss? Active pairs in range of both do not interact. */
+        if (r2 < hj * hj * kernel_gamma2 && !(pi_active && r2 < hig2)) {
 
           IACT_NONSYM(r2, dx, hj, hi, pj, pi, a, H);
         }
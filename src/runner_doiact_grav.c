@@ -22,14 +22,32 @@
 /* This object's header. */
 #include "runner_doiact_grav.h"
 
+/* System includes. */
+#include <float.h>
+
 /* Local includes. */
 #include "active.h"
 #include "cell.h"
+#include "cosmology.h"
+#include "cuda_devices.h"
+#include "cuda_gpart_mirror.h"
+#include "cuda_gravity_cache.h"
+#include "cuda_mm_batch.h"
+#include "cuda_multipole_mirror.h"
+#include "cuda_pair_batch.h"
+#include "cuda_precision.h"
+#include "cuda_streams.h"
+#include "cuda_timeline.h"
+#include "cuda_top_multipoles.h"
+#include "cuda_work_split.h"
+#include "gpart_soa.h"
 #include "gravity.h"
 #include "gravity_cache.h"
 #include "gravity_iact.h"
 #include "inline.h"
+#include "multipole_batch.h"
 #include "part.h"
+#include "space.h"
 #include "space_getsid.h"
 #include "timers.h"
 
@@ -55,9 +73,106 @@ static INLINE void runner_clear_grav_flags(struct cell *c,
 }
 
 /**
- * @brief Recursively propagate the multipoles down the tree by applying the
+ * @brief Number of #gpart evaluated together by a leaf's batched L2P.
+ */
+#define runner_grav_down_batch_size 64
+
+/**
+ * @brief Apply the field tensor of a leaf #cell to its active #gpart.
+ *
+ * The active particles are gathered in batches into SoA position arrays,
+ * the tensor is evaluated over the whole batch with gravity_L2P_soa() and
+ * the results are then scattered back to the particles.
+ *
+ * @param e The #engine.
+ * @param c The leaf #cell we are working on.
+ */
+static void runner_do_grav_down_leaf(const struct engine *e, struct cell *c) {
+
+  /* We can abort early if no interactions via multipole happened */
+  if (!c->grav.multipole->pot.interacted) return;
+
+  if (!cell_are_gpart_drifted(c, e)) error("Un-drifted gparts");
+
+#ifndef SWIFT_TASKS_WITHOUT_ATOMICS
+  /* Lock the cell for the particle updates */
+  lock_lock(&c->grav.plock);
+#endif
+
+  /* Cell properties */
+  struct gpart *gparts = c->grav.parts;
+  const int gcount = c->grav.count;
+  const struct grav_tensor *pot = &c->grav.multipole->pot;
+  const double CoM[3] = {c->grav.multipole->CoM[0], c->grav.multipole->CoM[1],
+                         c->grav.multipole->CoM[2]};
+
+  /* The batch buffers */
+  int index[runner_grav_down_batch_size];
+  double x[runner_grav_down_batch_size], y[runner_grav_down_batch_size],
+      z[runner_grav_down_batch_size];
+  double a_x[runner_grav_down_batch_size], a_y[runner_grav_down_batch_size],
+      a_z[runner_grav_down_batch_size], phi[runner_grav_down_batch_size];
+
+  int i = 0;
+  while (i < gcount) {
+
+    /* Gather the next batch of active particles */
+    int count = 0;
+    for (; i < gcount && count < runner_grav_down_batch_size; ++i) {
+
+      /* Get a handle on the gpart */
+      const struct gpart *gp = &gparts[i];
+
+      /* Update if active */
+      if (!gpart_is_active(gp, e)) continue;
+
+#ifdef SWIFT_DEBUG_CHECKS
+      /* Check that particles have been drifted to the current time */
+      if (gp->ti_drift != e->ti_current)
+        error("gpart not drifted to current time");
+      if (c->grav.multipole->pot.ti_init != e->ti_current)
+        error("c->field tensor not initialised");
+
+      /* Check that we are not updated an inhibited particle */
+      if (gpart_is_inhibited(gp, e)) error("Updating an inhibited particle!");
+
+      /* Check that the particle was initialised */
+      if (gp->initialised == 0)
+        error("Adding forces to an un-initialised gpart.");
+#endif
+
+      index[count] = i;
+      x[count] = gp->x[0];
+      y[count] = gp->x[1];
+      z[count] = gp->x[2];
+      ++count;
+    }
+
+    /* Apply the kernel to the whole batch */
+    gravity_L2P_soa(pot, CoM, count, x, y, z, a_x, a_y, a_z, phi);
+
+    /* Scatter the results back */
+    for (int k = 0; k < count; ++k) {
+      const double a_grav[3] = {a_x[k], a_y[k], a_z[k]};
+      gravity_L2P_update(pot, &gparts[index[k]], a_grav, phi[k]);
+    }
+  }
+
+#ifndef SWIFT_TASKS_WITHOUT_ATOMICS
+  /* All done -> unlock the cell */
+  if (lock_unlock(&c->grav.plock) != 0) error("Error unlocking cell");
+#endif
+}
+
+/**
+ * @brief Propagate the multipoles down the tree by applying the
  * L2L and L2P kernels.
  *
+ * The tree below c is walked with an explicit work-list rather than by
+ * recursion: a cell's tensor is pushed into its active progeny before
+ * they are themselves taken off the list, so every L2L reads a complete
+ * tensor.
+ *
  * @param r The #runner.
  * @param c The #cell we are working on.
  * @param timer Are we timing this ?
@@ -76,13 +191,28 @@ void runner_do_grav_down(struct runner *r, struct cell *c, int timer) {
     error("c->field tensor not initialised");
 #endif
 
-  if (c->split) {
+  /* Each level adds at most 7 cells to the list on top of the one taken
+   * off it */
+  struct cell *stack[7 * space_cell_maxdepth + 8];
+  int stack_size = 0;
+  stack[stack_size++] = c;
+
+  while (stack_size > 0) {
+
+    struct cell *cc = stack[--stack_size];
+
+    if (!cc->split) {
+
+      /* Leaf case */
+      runner_do_grav_down_leaf(e, cc);
+      continue;
+    }
 
     /* Node case */
 
     /* Add the field-tensor to all the 8 progenitors */
     for (int k = 0; k < 8; ++k) {
-      struct cell *cp = c->progeny[k];
+      struct cell *cp = cc->progeny[k];
 
       /* Do we have a progenitor with any active g-particles ? */
       if (cp != NULL && cell_is_active_gravity(cp, e)) {
@@ -94,76 +224,22 @@ void runner_do_grav_down(struct runner *r, struct cell *c, int timer) {
           error("cp->field tensor not initialised");
 #endif
         /* If the tensor received any contribution, push it down */
-        if (c->grav.multipole->pot.interacted) {
+        if (cc->grav.multipole->pot.interacted) {
 
           struct grav_tensor shifted_tensor;
 
           /* Shift the field tensor */
-          gravity_L2L(&shifted_tensor, &c->grav.multipole->pot,
-                      cp->grav.multipole->CoM, c->grav.multipole->CoM);
+          gravity_L2L(&shifted_tensor, &cc->grav.multipole->pot,
+                      cp->grav.multipole->CoM, cc->grav.multipole->CoM);
 
           /* Add it to this level's tensor */
           gravity_field_tensors_add(&cp->grav.multipole->pot, &shifted_tensor);
         }
 
-        /* Recurse */
-        runner_do_grav_down(r, cp, 0);
-      }
-    }
-
-  } else {
-
-    /* Leaf case */
-
-    /* We can abort early if no interactions via multipole happened */
-    if (!c->grav.multipole->pot.interacted) return;
-
-    if (!cell_are_gpart_drifted(c, e)) error("Un-drifted gparts");
-
-#ifndef SWIFT_TASKS_WITHOUT_ATOMICS
-    /* Lock the cell for the particle updates */
-    lock_lock(&c->grav.plock);
-#endif
-
-    /* Cell properties */
-    struct gpart *gparts = c->grav.parts;
-    const int gcount = c->grav.count;
-    const struct grav_tensor *pot = &c->grav.multipole->pot;
-    const double CoM[3] = {c->grav.multipole->CoM[0], c->grav.multipole->CoM[1],
-                           c->grav.multipole->CoM[2]};
-
-    /* Apply accelerations to the particles */
-    for (int i = 0; i < gcount; ++i) {
-
-      /* Get a handle on the gpart */
-      struct gpart *gp = &gparts[i];
-
-      /* Update if active */
-      if (gpart_is_active(gp, e)) {
-
-#ifdef SWIFT_DEBUG_CHECKS
-        /* Check that particles have been drifted to the current time */
-        if (gp->ti_drift != e->ti_current)
-          error("gpart not drifted to current time");
-        if (c->grav.multipole->pot.ti_init != e->ti_current)
-          error("c->field tensor not initialised");
-
-        /* Check that we are not updated an inhibited particle */
-        if (gpart_is_inhibited(gp, e)) error("Updating an inhibited particle!");
-
-        /* Check that the particle was initialised */
-        if (gp->initialised == 0)
-          error("Adding forces to an un-initialised gpart.");
-#endif
-        /* Apply the kernel */
-        gravity_L2P(pot, CoM, gp);
+        /* Process it later */
+        stack[stack_size++] = cp;
       }
     }
-
-#ifndef SWIFT_TASKS_WITHOUT_ATOMICS
-    /* All done -> unlock the cell */
-    if (lock_unlock(&c->grav.plock) != 0) error("Error unlocking cell");
-#endif
   }
 
   if (timer) TIMER_TOC(timer_dograv_down);
@@ -194,8 +270,7 @@ static INLINE void runner_dopair_grav_pp_full_no_cache(
 
   /* Prepare the i cache */
   const int gcount_padded_i = gcount_i - (gcount_i % VEC_SIZE) + VEC_SIZE;
-  if (cache_i->count < gcount_padded_i)
-    gravity_cache_init(cache_i, gcount_padded_i);
+  gravity_cache_ensure(cache_i, gcount_padded_i);
   gravity_cache_zero_output(cache_i, gcount_padded_i);
 
 #ifdef SWIFT_DEBUG_CHECKS
@@ -393,8 +468,7 @@ static INLINE void runner_dopair_grav_pp_truncated_no_cache(
 
   /* Prepare the i cache */
   const int gcount_padded_i = gcount_i - (gcount_i % VEC_SIZE) + VEC_SIZE;
-  if (cache_i->count < gcount_padded_i)
-    gravity_cache_init(cache_i, gcount_padded_i);
+  gravity_cache_ensure(cache_i, gcount_padded_i);
   gravity_cache_zero_output(cache_i, gcount_padded_i);
 
   /* Loop over sink particles */
@@ -585,7 +659,7 @@ static INLINE void runner_dopair_grav_pp_truncated_no_cache(
  * @param gcount_j The number of particles in the cell j (for debugging checks
  * only).
  */
-static INLINE void runner_dopair_grav_pp_full(
+__attribute__((always_inline)) INLINE static void runner_dopair_grav_pp_full(
     struct gravity_cache *restrict ci_cache,
     struct gravity_cache *restrict cj_cache, const int gcount_i,
     const int gcount_j, const int gcount_padded_j, const int periodic,
@@ -731,13 +805,15 @@ static INLINE void runner_dopair_grav_pp_full(
  * The calculation is performed non-symmetrically using the pre-filled
  * #gravity_cache structures. The loop over the j cache should auto-vectorize.
  *
- * This function only makes sense in periodic BCs.
+ * This function only makes sense in periodic BCs but the particles need not
+ * be wrapped if the caches were filled with the right periodic image.
  *
  * @param ci_cache #gravity_cache contaning the particles to be updated.
  * @param cj_cache #gravity_cache contaning the source particles.
  * @param gcount_i The number of particles in the cell i.
  * @param gcount_padded_j The number of particles in the cell j padded to the
  * vector length.
+ * @param periodic Do we need to wrap the distances ?
  * @param dim The size of the simulation volume.
  * @param r_s_inv The inverse of the gravity-mesh smoothing-scale.
  *
@@ -747,11 +823,12 @@ static INLINE void runner_dopair_grav_pp_full(
  * @param gcount_j The number of particles in the cell j (for debugging checks
  * only).
  */
-static INLINE void runner_dopair_grav_pp_truncated(
+__attribute__((always_inline)) INLINE static void
+runner_dopair_grav_pp_truncated(
     struct gravity_cache *restrict ci_cache,
     struct gravity_cache *restrict cj_cache, const int gcount_i,
-    const int gcount_j, const int gcount_padded_j, const float dim[3],
-    const float r_s_inv, const struct engine *restrict e,
+    const int gcount_j, const int gcount_padded_j, const int periodic,
+    const float dim[3], const float r_s_inv, const struct engine *restrict e,
     struct gpart *restrict gparts_i, const struct gpart *restrict gparts_j) {
 
 #ifdef SWIFT_DEBUG_CHECKS
@@ -805,9 +882,11 @@ static INLINE void runner_dopair_grav_pp_truncated(
       float dz = z_j - z_i;
 
       /* Correct for periodic BCs */
-      dx = nearestf(dx, dim[0]);
-      dy = nearestf(dy, dim[1]);
-      dz = nearestf(dz, dim[2]);
+      if (periodic) {
+        dx = nearestf(dx, dim[0]);
+        dy = nearestf(dy, dim[1]);
+        dz = nearestf(dz, dim[2]);
+      }
 
       const float r2 = dx * dx + dy * dy + dz * dz;
 
@@ -912,7 +991,7 @@ static INLINE void runner_dopair_grav_pp_truncated(
  * only).
  * @param cj The #cell j (for debugging checks only).
  */
-static INLINE void runner_dopair_grav_pm_full(
+__attribute__((always_inline)) INLINE static void runner_dopair_grav_pm_full(
     struct gravity_cache *ci_cache, const int gcount_padded_i,
     const float CoM_j[3], const struct multipole *restrict multi_j,
     const int periodic, const float dim[3], const struct engine *restrict e,
@@ -1000,7 +1079,8 @@ static INLINE void runner_dopair_grav_pm_full(
 
 #ifdef SWIFT_DEBUG_CHECKS
     if (!gravity_M2P_accept(e->gravity_properties, &gparts_i[pid],
-                            cj->grav.multipole, r2 * 1.01, periodic))
+                            cj->grav.multipole, r2 * 1.01,
+                            e->mesh->periodic))
       error("use_mpole[i] set when M2P accept fails");
 #endif
 
@@ -1042,13 +1122,15 @@ static INLINE void runner_dopair_grav_pm_full(
  * The calculation is performedusing the pre-filled
  * #gravity_cache structure. The loop over the i cache should auto-vectorize.
  *
- * This function only makes sense in periodic BCs.
+ * This function only makes sense in periodic BCs but the distances need not
+ * be wrapped if the cache and CoM_j are in the right periodic image.
  *
  * @param ci_cache #gravity_cache contaning the particles to be updated.
  * @param gcount_padded_i The number of particles in the cell i padded to the
  * vector length.
  * @param CoM_j Position of the #multipole in #cell j.
  * @param multi_j The #multipole in #cell j.
+ * @param periodic Do we need to wrap the distances ?
  * @param dim The size of the simulation volume.
  * @param r_s_inv The inverse of the gravity-mesh smoothing-scale.
  *
@@ -1058,10 +1140,12 @@ static INLINE void runner_dopair_grav_pm_full(
  * only).
  * @param cj The #cell j (for debugging checks only).
  */
-static INLINE void runner_dopair_grav_pm_truncated(
+__attribute__((always_inline)) INLINE static void
+runner_dopair_grav_pm_truncated(
     struct gravity_cache *ci_cache, const int gcount_padded_i,
     const float CoM_j[3], const struct multipole *restrict multi_j,
-    const float dim[3], const float r_s_inv, const struct engine *restrict e,
+    const int periodic, const float dim[3], const float r_s_inv,
+    const struct engine *restrict e,
     struct gpart *restrict gparts_i, const int gcount_i,
     const struct cell *restrict cj) {
 
@@ -1140,10 +1224,12 @@ static INLINE void runner_dopair_grav_pm_truncated(
     float dy = CoM_j[1] - y_i;
     float dz = CoM_j[2] - z_i;
 
-    /* Apply periodic BCs */
-    dx = nearestf(dx, dim[0]);
-    dy = nearestf(dy, dim[1]);
-    dz = nearestf(dz, dim[2]);
+    /* Apply periodic BCs? */
+    if (periodic) {
+      dx = nearestf(dx, dim[0]);
+      dy = nearestf(dy, dim[1]);
+      dz = nearestf(dz, dim[2]);
+    }
 
     const float r2 = dx * dx + dy * dy + dz * dz;
 
@@ -1184,28 +1270,269 @@ static INLINE void runner_dopair_grav_pm_truncated(
   }
 }
 
-extern void pp_offload(int periodic, const float *CoM_i, const float *CoM_j, float rmax_i, float rmax_j, double min_trunc, int* active_i, int* mpole_i, int* active_j, int* mpole_j, const float *dim, const float *x_i, const float *x_j_arr, const float *y_i, const float *y_j_arr, const float *z_i, const float *z_j_arr, float *pot_i, float *pot_j, float *a_x_i, float *a_y_i, float *a_z_i, float *a_x_j, float *a_y_j, float *a_z_j, float *mass_i_arr, float *mass_j_arr, const float *r_s_inv, float *h_i, float *h_j_arr, const int *gcount_i, const int *gcount_padded_i, const int *gcount_j, const int *gcount_padded_j, int ci_active, int cj_active, const int symmetric, const int allow_mpole, const struct multipole *restrict multi_i, const struct multipole *restrict multi_j, float *epsilon, const int *allow_multipole_j, const int *allow_multipole_i);
 /**
- * @brief Computes the interaction of all the particles in a cell with all the
- * particles of another cell.
+ * @brief Instance of the Newtonian P-P and M2P interactions of a pair of
+ * cells with the periodicity a compile-time constant.
  *
- * This function switches between the full potential and the truncated one
- * depending on needs. It will also use the M2P (multipole) interaction
- * for the subset of particles in either cell for which the distance criterion
- * is valid.
+ * The generic functions get inlined into the instances, such that the box
+ * wrapping disappears from the inner loops of the non-periodic runs, which
+ * the compiler can then vectorise without it.
  *
- * This function starts by constructing the require #gravity_cache for both
- * cells and then call the specialised functions doing the actual work on
- * the caches. It then write the data back to the particles.
+ * NAME The suffix of the instance.
+ * PERIODIC Is the calculation using periodic BCs ?
+ */
+#define RUNNER_DOPAIR_GRAV_FULL_INSTANCE(NAME, PERIODIC)                      \
+  static void runner_dopair_grav_full_##NAME(                                 \
+      struct gravity_cache *restrict ci_cache,                                \
+      struct gravity_cache *restrict cj_cache, const int update_i,            \
+      const int update_j, const int allow_multipole_i,                        \
+      const int allow_multipole_j, const float CoM_i[3],                      \
+      const float CoM_j[3], const struct multipole *restrict multi_i,         \
+      const struct multipole *restrict multi_j, const float dim[3],           \
+      const struct engine *restrict e, struct cell *ci, struct cell *cj) {    \
+                                                                              \
+    const int gcount_i = ci->grav.count;                                      \
+    const int gcount_j = cj->grav.count;                                      \
+    const int gcount_padded_i = gcount_i - (gcount_i % VEC_SIZE) + VEC_SIZE;  \
+    const int gcount_padded_j = gcount_j - (gcount_j % VEC_SIZE) + VEC_SIZE;  \
+                                                                              \
+    if (update_i) {                                                           \
+      runner_dopair_grav_pp_full(ci_cache, cj_cache, gcount_i, gcount_j,      \
+                                 gcount_padded_j, PERIODIC, dim, e,           \
+                                 ci->grav.parts, cj->grav.parts);             \
+      if (allow_multipole_j)                                                  \
+        runner_dopair_grav_pm_full(ci_cache, gcount_padded_i, CoM_j, multi_j, \
+                                   PERIODIC, dim, e, ci->grav.parts,          \
+                                   gcount_i, cj);                             \
+    }                                                                         \
+    if (update_j) {                                                           \
+      runner_dopair_grav_pp_full(cj_cache, ci_cache, gcount_j, gcount_i,      \
+                                 gcount_padded_i, PERIODIC, dim, e,           \
+                                 cj->grav.parts, ci->grav.parts);             \
+      if (allow_multipole_i)                                                  \
+        runner_dopair_grav_pm_full(cj_cache, gcount_padded_j, CoM_i, multi_i, \
+                                   PERIODIC, dim, e, cj->grav.parts,          \
+                                   gcount_j, ci);                             \
+    }                                                                         \
+  }
+
+RUNNER_DOPAIR_GRAV_FULL_INSTANCE(periodic, /*PERIODIC=*/1)
+RUNNER_DOPAIR_GRAV_FULL_INSTANCE(non_periodic, /*PERIODIC=*/0)
+
+/**
+ * @brief Instance of the truncated P-P and M2P interactions of a pair of
+ * cells with the box wrapping a compile-time constant.
  *
- * @param r The #runner.
+ * The pairs whose caches were filled with the right periodic image use the
+ * instance without wrapping.
+ *
+ * NAME The suffix of the instance.
+ * PERIODIC Do we need to wrap the distances ?
+ */
+#define RUNNER_DOPAIR_GRAV_TRUNCATED_INSTANCE(NAME, PERIODIC)                 \
+  static void runner_dopair_grav_truncated_##NAME(                            \
+      struct gravity_cache *restrict ci_cache,                                \
+      struct gravity_cache *restrict cj_cache, const int update_i,            \
+      const int update_j, const int allow_multipole_i,                        \
+      const int allow_multipole_j, const float CoM_i[3],                      \
+      const float CoM_j[3], const struct multipole *restrict multi_i,         \
+      const struct multipole *restrict multi_j, const float dim[3],           \
+      const float r_s_inv, const struct engine *restrict e, struct cell *ci,  \
+      struct cell *cj) {                                                      \
+                                                                              \
+    const int gcount_i = ci->grav.count;                                      \
+    const int gcount_j = cj->grav.count;                                      \
+    const int gcount_padded_i = gcount_i - (gcount_i % VEC_SIZE) + VEC_SIZE;  \
+    const int gcount_padded_j = gcount_j - (gcount_j % VEC_SIZE) + VEC_SIZE;  \
+                                                                              \
+    if (update_i) {                                                           \
+      runner_dopair_grav_pp_truncated(ci_cache, cj_cache, gcount_i, gcount_j, \
+                                      gcount_padded_j, PERIODIC, dim,         \
+                                      r_s_inv, e, ci->grav.parts,             \
+                                      cj->grav.parts);                        \
+      if (allow_multipole_j)                                                  \
+        runner_dopair_grav_pm_truncated(ci_cache, gcount_padded_i, CoM_j,     \
+                                        multi_j, PERIODIC, dim, r_s_inv, e,   \
+                                        ci->grav.parts, gcount_i, cj);        \
+    }                                                                         \
+    if (update_j) {                                                           \
+      runner_dopair_grav_pp_truncated(cj_cache, ci_cache, gcount_j, gcount_i, \
+                                      gcount_padded_i, PERIODIC, dim,         \
+                                      r_s_inv, e, cj->grav.parts,             \
+                                      ci->grav.parts);                        \
+      if (allow_multipole_i)                                                  \
+        runner_dopair_grav_pm_truncated(cj_cache, gcount_padded_j, CoM_i,     \
+                                        multi_i, PERIODIC, dim, r_s_inv, e,   \
+                                        cj->grav.parts, gcount_j, ci);        \
+    }                                                                         \
+  }
+
+RUNNER_DOPAIR_GRAV_TRUNCATED_INSTANCE(periodic, /*PERIODIC=*/1)
+RUNNER_DOPAIR_GRAV_TRUNCATED_INSTANCE(shifted, /*PERIODIC=*/0)
+
+extern enum cuda_fault pp_offload(const int precision, const int periodic, const int truncated, const int update_i, const int update_j, const float *dim, const float r_s_inv, const struct cuda_cell_multipole *multi_i, const struct cuda_cell_multipole *multi_j, const float *x_i, const float *y_i, const float *z_i, const float *h_i, const float *mass_i, const int *active_i, const int *mpole_i, float *a_x_i, float *a_y_i, float *a_z_i, float *pot_i, const int gcount_i, const int gcount_padded_i, const float *x_j, const float *y_j, const float *z_j, const float *h_j, const float *mass_j, const int *active_j, const int *mpole_j, float *a_x_j, float *a_y_j, float *a_z_j, float *pot_j, const int gcount_j, const int gcount_padded_j, struct cuda_gravity_cache *d_ci, struct cuda_gravity_cache *d_cj, const struct cuda_gpart_mirror *resident, const size_t goffset_i, const size_t goffset_j, cudaStream_t stream);
+extern enum cuda_fault pp_batch_offload(struct cuda_pair_batch *b, const struct cuda_gpart_mirror *resident, const int precision, const int periodic, const float *dim, const float r_s_inv, const int wait, cudaStream_t stream);
+extern enum cuda_fault cuda_event_sync_check(cudaEvent_t event, const char *what);
+
+/**
+ * @brief Do we need the truncated potential for a leaf-leaf pair?
+ *
+ * Periodic but far-away cells must use the truncated potential. This is
+ * decided once per pair on the host such that the GPU only runs the variant
+ * of the kernel the pair needs.
+ *
+ * @param e The #engine.
+ * @param CoM_i The centre of mass of the first #cell.
+ * @param CoM_j The centre of mass of the other #cell.
+ * @param rmax_i The maximal distance to the CoM of the first #cell.
+ * @param rmax_j The maximal distance to the CoM of the other #cell.
+ */
+static INLINE int runner_dopair_grav_pp_need_truncation(
+    const struct engine *e, const float CoM_i[3], const float CoM_j[3],
+    const float rmax_i, const float rmax_j) {
+
+  /* Not periodic -> Can always use Newtonian potential */
+  if (!e->mesh->periodic) return 0;
+
+  const float dim[3] = {(float)e->mesh->dim[0], (float)e->mesh->dim[1],
+                        (float)e->mesh->dim[2]};
+
+  /* Get the relative distance between the CoMs */
+  const float dx = nearestf(CoM_i[0] - CoM_j[0], dim[0]);
+  const float dy = nearestf(CoM_i[1] - CoM_j[1], dim[1]);
+  const float dz = nearestf(CoM_i[2] - CoM_j[2], dim[2]);
+  const double r2 = dx * dx + dy * dy + dz * dz;
+
+  /* Get the maximal distance between any two particles */
+  const double max_r = sqrt(r2) + rmax_i + rmax_j;
+
+  return max_r > e->mesh->r_cut_min;
+}
+
+/**
+ * @brief Find the periodic image of a cell j for which all its #gpart are
+ * the nearest images of all the #gpart of a cell i.
+ *
+ * This is the case when the two cells, extended by the r_max of their
+ * multipoles, are less than half a box apart along each axis. The box
+ * wrapping can then be done once on the whole cell rather than on every
+ * interaction.
+ *
+ * @param e The #engine.
  * @param ci The first #cell.
- * @param cj The other #cell.
- * @param symmetric Are we updating both cells (1) or just ci (0) ?
+ * @param cj The second #cell.
+ * @param shift (return) The shift to subtract from the positions of cj.
+ *
+ * @return 1 if there is such an image, 0 if the interactions must be wrapped
+ * one by one.
+ */
+static INLINE int runner_dopair_grav_pp_image_shift(const struct engine *e,
+                                                    const struct cell *ci,
+                                                    const struct cell *cj,
+                                                    double shift[3]) {
+
+  const double *dim = e->mesh->dim;
+  const double r_max = ci->grav.multipole->r_max + cj->grav.multipole->r_max;
+
+  for (int k = 0; k < 3; k++) {
+    const double d = cj->grav.multipole->CoM[k] - ci->grav.multipole->CoM[k];
+    if (d > 0.5 * dim[k])
+      shift[k] = dim[k];
+    else if (d < -0.5 * dim[k])
+      shift[k] = -dim[k];
+    else
+      shift[k] = 0.;
+
+    if (fabs(d - shift[k]) + r_max >= 0.5 * dim[k]) return 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief Fills a #gravity_cache with the #gpart of a cell, reading them from
+ * the #gpart_soa if its copy of the cell is up to date or from the
+ * #gpart_foreign of a foreign cell that only keeps these.
+ *
+ * @param e The #engine.
  * @param allow_mpole Are we allowing the use of M2P interactions ?
+ * @param periodic Are we using periodic BCs ?
+ * @param dim The size of the simulation volume along each dimension.
+ * @param cache The #gravity_cache to fill.
+ * @param c The #cell whose #gpart we read.
+ * @param gcount_padded The number of particles padded to the next multiple
+ * of the vector length.
+ * @param shift A shift to apply to all the particles.
+ * @param CoM The position of the multipole of the other cell.
+ * @param multipole The multipole of the other cell.
  */
-void runner_dopair_grav_pp(struct runner *r, struct cell *ci, struct cell *cj,
-                           const int symmetric, const int allow_mpole) {
+static INLINE void runner_gravity_cache_populate(
+    const struct engine *e, const int allow_mpole, const int periodic,
+    const float dim[3], struct gravity_cache *cache, const struct cell *c,
+    const int gcount_padded, const double shift[3], const float CoM[3],
+    const struct gravity_tensors *multipole) {
+
+  if (gpart_soa.active && c->nodeID == e->nodeID &&
+      c->grav.ti_soa == e->ti_current) {
+    gravity_cache_populate_soa(e->max_active_bin, allow_mpole, periodic, dim,
+                               cache, &gpart_soa, c->grav.parts - e->s->gparts,
+                               c->grav.count, gcount_padded, shift, CoM,
+                               multipole, c, e->gravity_properties);
+  } else if (c->grav.parts_foreign != NULL) {
+    gravity_cache_populate_foreign(
+        e->max_active_bin, cache, c->grav.parts_foreign, c->grav.count,
+        gcount_padded, c->grav.parts_foreign_base->loc, shift, c,
+        e->gravity_properties);
+  } else {
+    gravity_cache_populate(e->max_active_bin, allow_mpole, periodic, dim,
+                           cache, c->grav.parts, c->grav.count, gcount_padded,
+                           shift, CoM, multipole, c, e->gravity_properties);
+  }
+}
+
+/**
+ * @brief Points a #gravity_cache at a section of the packed arrays of a
+ * #cuda_pair_batch.
+ *
+ * The cache does not own the memory and must not be cleaned.
+ *
+ * @param c The #gravity_cache to set up.
+ * @param b The #cuda_pair_batch.
+ * @param offset The index of the first particle of the section.
+ * @param size The number of particles in the section.
+ */
+static INLINE void runner_gravity_cache_from_batch(
+    struct gravity_cache *c, const struct cuda_pair_batch *b, const int offset,
+    const int size) {
+
+  c->x = b->x + offset;
+  c->y = b->y + offset;
+  c->z = b->z + offset;
+  c->epsilon = b->epsilon + offset;
+  c->m = b->m + offset;
+  c->a_x = b->a_x + offset;
+  c->a_y = b->a_y + offset;
+  c->a_z = b->a_z + offset;
+  c->pot = b->pot + offset;
+  c->active = b->active + offset;
+  c->use_mpole = b->use_mpole + offset;
+  c->count = size;
+}
+
+/**
+ * @brief Sends all the pairs accumulated in the runner's #cuda_pair_batch to
+ * the GPU.
+ *
+ * @param r The #runner.
+ * @param wait Do we wait for the results to land?
+ *
+ * @return What went wrong on the device, only known here if we waited or if
+ * the launch failed.
+ */
+static enum cuda_fault runner_dopair_grav_pp_issue(struct runner *r,
+                                                   const int wait) {
+
+#ifdef WITH_CUDA
+  struct cuda_pair_batch *const b = &r->gpu_pair_batch;
 
   /* Recover some useful constants */
   const struct engine *e = r->e;
@@ -1213,106 +1540,846 @@ void runner_dopair_grav_pp(struct runner *r, struct cell *ci, struct cell *cj,
   const float dim[3] = {(float)e->mesh->dim[0], (float)e->mesh->dim[1],
                         (float)e->mesh->dim[2]};
   const float r_s_inv = e->mesh->r_s_inv;
-  const double min_trunc = e->mesh->r_cut_min;
-
-  TIMER_TIC;
-
-  /* Record activity status */
-  const int ci_active =
-      cell_is_active_gravity(ci, e) && (ci->nodeID == e->nodeID);
-  const int cj_active =
-      cell_is_active_gravity(cj, e) && (cj->nodeID == e->nodeID);
-
-  /* Anything to do here? */
-  if (!ci_active && !cj_active) return;
-  if (!ci_active && !symmetric) return;
-
-#ifdef SWIFT_DEBUG_CHECKS
-  /* Check that we are not doing something stupid */
-  if (ci->split || cj->split) error("Running P-P on splitable cells");
 
-  /* Let's start by checking things are drifted */
-  if (!cell_are_gpart_drifted(ci, e)) error("Un-drifted gparts");
-  if (!cell_are_gpart_drifted(cj, e)) error("Un-drifted gparts");
-  if (cj_active && ci->grav.ti_old_multipole != e->ti_current)
-    error("Un-drifted multipole");
-  if (ci_active && cj->grav.ti_old_multipole != e->ti_current)
-    error("Un-drifted multipole");
+  /* Do all the pairs in one go. Only pairs of cells of this runner's device
+   * get batched when the gparts are resident. */
+  const int device = cuda_devices_of_runner(r->id);
+  const struct cuda_gpart_mirror *resident =
+      gpu_gparts[device].active ? &gpu_gparts[device] : NULL;
+  return pp_batch_offload(b, resident, gpu_precision, periodic, dim, r_s_inv,
+                          wait, get_runner_cuda_stream(r->id));
+#else
+  error("SWIFT was not compiled with CUDA support.");
+  return cuda_fault_none;
 #endif
+}
 
-  /* Caches to play with */
-  struct gravity_cache *const ci_cache = &r->ci_gravity_cache;
-  struct gravity_cache *const cj_cache = &r->cj_gravity_cache;
+/**
+ * @brief Re-runs all the pairs of the batch on the CPU after a fault of the
+ * device.
+ *
+ * The caches of the pairs are still in the packed arrays of the batch, only
+ * their outputs need clearing. The results of the resident #gpart are
+ * accumulated on the device and what the failed kernel added there cannot
+ * be known, so these batches cannot be recovered.
+ *
+ * @param r The #runner.
+ * @param fault What went wrong on the device.
+ */
+static void runner_dopair_grav_pp_redo(struct runner *r,
+                                       const enum cuda_fault fault) {
 
-  /* Shift to apply to the particles in each cell */
-  const double shift_i[3] = {0., 0., 0.};
-  const double shift_j[3] = {0., 0., 0.};
+  struct cuda_pair_batch *const b = &r->gpu_pair_batch;
+  const struct engine *e = r->e;
+  const int periodic = e->mesh->periodic;
+  const float dim[3] = {(float)e->mesh->dim[0], (float)e->mesh->dim[1],
+                        (float)e->mesh->dim[2]};
+  const float r_s_inv = e->mesh->r_s_inv;
 
-  /* Recover the multipole info and shift the CoM locations */
-  const float rmax_i = ci->grav.multipole->r_max;
-  const float rmax_j = cj->grav.multipole->r_max;
-  const struct multipole *multi_i = &ci->grav.multipole->m_pole;
-  const struct multipole *multi_j = &cj->grav.multipole->m_pole;
-  const float CoM_i[3] = {(float)(ci->grav.multipole->CoM[0] - shift_i[0]),
-                          (float)(ci->grav.multipole->CoM[1] - shift_i[1]),
-                          (float)(ci->grav.multipole->CoM[2] - shift_i[2])};
-  const float CoM_j[3] = {(float)(cj->grav.multipole->CoM[0] - shift_j[0]),
-                          (float)(cj->grav.multipole->CoM[1] - shift_j[1]),
-                          (float)(cj->grav.multipole->CoM[2] - shift_j[2])};
+  if (fault == cuda_fault_sticky)
+    error("The CUDA context was lost, restart from the last checkpoint.");
+  if (gpu_gparts[cuda_devices_of_runner(r->id)].active)
+    error("Device fault on a batch of resident pairs, cannot recover.");
+
+  warning("Device fault on a batch of %d pairs, re-running it on the CPU.",
+          b->npairs);
+
+  for (int k = 0; k < b->npairs; ++k) {
+
+    const struct cuda_pair_desc *p = &b->pairs[k];
+    struct cell *ci = b->cells[2 * k + 0];
+    struct cell *cj = b->cells[2 * k + 1];
+
+    struct gravity_cache ci_cache, cj_cache;
+    runner_gravity_cache_from_batch(&ci_cache, b, p->offset_i,
+                                    p->gcount_padded_i);
+    runner_gravity_cache_from_batch(&cj_cache, b, p->offset_j,
+                                    p->gcount_padded_j);
+    gravity_cache_zero_output(&ci_cache, p->gcount_padded_i);
+    gravity_cache_zero_output(&cj_cache, p->gcount_padded_j);
+
+    /* The batched caches are not shifted, the multipoles were only sent
+     * when used by an M2P */
+    const int allow_multipole_i = p->multi_i != NULL;
+    const int allow_multipole_j = p->multi_j != NULL;
+    const struct multipole *multi_i = &ci->grav.multipole->m_pole;
+    const struct multipole *multi_j = &cj->grav.multipole->m_pole;
+    const float CoM_i[3] = {(float)ci->grav.multipole->CoM[0],
+                            (float)ci->grav.multipole->CoM[1],
+                            (float)ci->grav.multipole->CoM[2]};
+    const float CoM_j[3] = {(float)cj->grav.multipole->CoM[0],
+                            (float)cj->grav.multipole->CoM[1],
+                            (float)cj->grav.multipole->CoM[2]};
+
+    if (p->truncated && periodic)
+      runner_dopair_grav_truncated_periodic(
+          &ci_cache, &cj_cache, p->update_i, p->update_j, allow_multipole_i,
+          allow_multipole_j, CoM_i, CoM_j, multi_i, multi_j, dim, r_s_inv, e,
+          ci, cj);
+    else if (p->truncated)
+      runner_dopair_grav_truncated_shifted(
+          &ci_cache, &cj_cache, p->update_i, p->update_j, allow_multipole_i,
+          allow_multipole_j, CoM_i, CoM_j, multi_i, multi_j, dim, r_s_inv, e,
+          ci, cj);
+    else if (periodic)
+      runner_dopair_grav_full_periodic(
+          &ci_cache, &cj_cache, p->update_i, p->update_j, allow_multipole_i,
+          allow_multipole_j, CoM_i, CoM_j, multi_i, multi_j, dim, e, ci, cj);
+    else
+      runner_dopair_grav_full_non_periodic(
+          &ci_cache, &cj_cache, p->update_i, p->update_j, allow_multipole_i,
+          allow_multipole_j, CoM_i, CoM_j, multi_i, multi_j, dim, e, ci, cj);
+  }
+}
 
-  /* Start by constructing particle caches */
+/**
+ * @brief Writes the results of the batch that just came back from the GPU
+ * to the particles and empties the #cuda_pair_batch.
+ *
+ * When the #gpart are resident on the device, the results are accumulated
+ * there and only collected at the end of the step.
+ *
+ * @param r The #runner.
+ * @param time The time the runner spent on the batch.
+ * @param redone Was the batch re-run on the CPU?
+ */
+static void runner_dopair_grav_pp_finish(struct runner *r, ticks time,
+                                         const int redone) {
 
-  /* Computed the padded counts */
-  const int gcount_i = ci->grav.count;
-  const int gcount_j = cj->grav.count;
-  const int gcount_padded_i = gcount_i - (gcount_i % VEC_SIZE) + VEC_SIZE;
-  const int gcount_padded_j = gcount_j - (gcount_j % VEC_SIZE) + VEC_SIZE;
-  const int allow_multipole_i = allow_mpole && ci->grav.count > 1;
-  const int allow_multipole_j = allow_mpole && cj->grav.count > 1;
+  struct cuda_pair_batch *const b = &r->gpu_pair_batch;
+  const int device = cuda_devices_of_runner(r->id);
+  const int resident = gpu_gparts[device].active;
 
-  /* Fill the caches */
-  gravity_cache_populate(e->max_active_bin, allow_multipole_j, periodic, dim,
-                         ci_cache, ci->grav.parts, gcount_i, gcount_padded_i,
-                         shift_i, CoM_j, cj->grav.multipole, ci,
-                         e->gravity_properties);
-  gravity_cache_populate(e->max_active_bin, allow_multipole_i, periodic, dim,
-                         cj_cache, cj->grav.parts, gcount_j, gcount_padded_j,
-                         shift_j, CoM_i, ci->grav.multipole, cj,
-                         e->gravity_properties);
-  
-  pp_offload(periodic, CoM_i, CoM_j, rmax_i, rmax_j, min_trunc, ci_cache->active, ci_cache->use_mpole, cj_cache->active, cj_cache->use_mpole, dim, ci_cache->x, cj_cache->x, ci_cache->y, cj_cache->y, ci_cache->z, cj_cache->z, ci_cache->pot, cj_cache->pot, ci_cache->a_x, ci_cache->a_y, ci_cache->a_z, cj_cache->a_x, cj_cache->a_y, cj_cache->a_z, ci_cache->m, cj_cache->m, &r_s_inv, ci_cache->epsilon, cj_cache->epsilon, &gcount_i, &gcount_padded_i, &gcount_j, &gcount_padded_j, ci_active, cj_active, symmetric, allow_mpole, multi_i, multi_j, ci_cache->epsilon, &allow_multipole_j, &allow_multipole_i);
+  const ticks tic = getticks();
 
+  /* Write back to the particles */
+  if (!resident) cuda_timeline_cpu_begin(cuda_timeline_write_back);
+  for (int k = 0; k < b->npairs && !resident; ++k) {
 
-  /* Write back to the particles in ci */
-  if (ci_active) {
+    const struct cuda_pair_desc *p = &b->pairs[k];
+    struct cell *ci = b->cells[2 * k + 0];
+    struct cell *cj = b->cells[2 * k + 1];
+    struct gravity_cache cache;
+
+    if (p->update_i) {
+      runner_gravity_cache_from_batch(&cache, b, p->offset_i,
+                                      p->gcount_padded_i);
 #ifndef SWIFT_TASKS_WITHOUT_ATOMICS
-    lock_lock(&ci->grav.plock);
+      lock_lock(&ci->grav.plock);
 #endif
-    gravity_cache_write_back(ci_cache, ci->grav.parts, gcount_i);
+      gravity_cache_write_back(&cache, ci->grav.parts, p->gcount_i);
 #ifndef SWIFT_TASKS_WITHOUT_ATOMICS
-    if (lock_unlock(&ci->grav.plock) != 0) error("Error unlocking cell");
+      if (lock_unlock(&ci->grav.plock) != 0) error("Error unlocking cell");
 #endif
-  }
+    }
 
-  /* Write back to the particles in cj */
-  if (cj_active && symmetric) {
+    if (p->update_j) {
+      runner_gravity_cache_from_batch(&cache, b, p->offset_j,
+                                      p->gcount_padded_j);
 #ifndef SWIFT_TASKS_WITHOUT_ATOMICS
-    lock_lock(&cj->grav.plock);
+      lock_lock(&cj->grav.plock);
 #endif
-    gravity_cache_write_back(cj_cache, cj->grav.parts, gcount_j);
+      gravity_cache_write_back(&cache, cj->grav.parts, p->gcount_j);
 #ifndef SWIFT_TASKS_WITHOUT_ATOMICS
-    if (lock_unlock(&cj->grav.plock) != 0) error("Error unlocking cell");
+      if (lock_unlock(&cj->grav.plock) != 0) error("Error unlocking cell");
 #endif
+    }
   }
+  if (!resident) cuda_timeline_cpu_end(cuda_timeline_write_back);
+
+  /* Tell the CPU/GPU split what the whole batch cost */
+  double work = 0.;
+  for (int k = 0; k < b->npairs; ++k)
+    work += (double)b->pairs[k].gcount_i * (double)b->pairs[k].gcount_j;
+  const ticks toc = time + getticks() - tic;
+  if (gpu_work_split.active && !redone)
+    cuda_split_samples_add(&r->gpu_split_timings.gpu, work, b->npairs, toc);
+  if (!redone) cuda_device_load_add(&r->gpu_load, work, toc);
+
+  /* The batch is ready for more */
+  b->count = 0;
+  b->npairs = 0;
+}
 
-  TIMER_TOC(timer_dopair_grav_pp);
+/**
+ * @brief Sends all the pairs accumulated in the runner's #cuda_pair_batch to
+ * the GPU and writes the results back to the particles.
+ *
+ * @param r The #runner.
+ */
+void runner_dopair_grav_pp_flush(struct runner *r) {
+
+  struct cuda_pair_batch *const b = &r->gpu_pair_batch;
+  if (b->npairs == 0) return;
+
+  const ticks tic = getticks();
+  const enum cuda_fault fault = runner_dopair_grav_pp_issue(r, /*wait=*/1);
+  if (fault != cuda_fault_none) runner_dopair_grav_pp_redo(r, fault);
+  runner_dopair_grav_pp_finish(r, getticks() - tic, fault != cuda_fault_none);
 }
 
 /**
- * @brief Compute the gravitational forces from particles in #cell cj onto
- * particles in #cell ci without using a cache for cj.
+ * @brief Sends the pairs accumulated by a task to the GPU but leaves them
+ * in flight.
  *
- * This function does not update the particles in cj. It also does not
+ * The runner can then pick another task while the GPU works. The task only
+ * gets completed, and its dependencies unlocked, by
+ * #runner_dopair_grav_pp_complete() once the results have been written back.
+ *
+ * Must be called at the end of every task that may have added pairs to the
+ * batch.
+ *
+ * @param r The #runner.
+ * @param t The #task that filled the batch.
+ * @return 1 if the batch is in flight and the task must not be marked as
+ * done yet, 0 if the task is over.
+ */
+int runner_dopair_grav_pp_flush_async(struct runner *r, struct task *t) {
+
+  struct cuda_pair_batch *const b = &r->gpu_pair_batch;
+  if (b->npairs == 0) return 0;
+
+  /* No overlap wanted? */
+  if (!b->async) {
+    runner_dopair_grav_pp_flush(r);
+    return 0;
+  }
+
+  const ticks tic = getticks();
+  const enum cuda_fault fault = runner_dopair_grav_pp_issue(r, /*wait=*/0);
+
+  /* Failed straight away, nothing left in flight */
+  if (fault != cuda_fault_none) {
+    runner_dopair_grav_pp_redo(r, fault);
+    runner_dopair_grav_pp_finish(r, getticks() - tic, /*redone=*/1);
+    return 0;
+  }
+
+  b->in_flight = t;
+  b->in_flight_ticks = getticks() - tic;
+  return 1;
+}
+
+/**
+ * @brief Completes the task whose batch is in flight on the GPU if the
+ * results have landed.
+ *
+ * @param r The #runner.
+ * @param wait Do we wait for the results rather than just checking?
+ */
+void runner_dopair_grav_pp_complete(struct runner *r, const int wait) {
+
+  struct cuda_pair_batch *const b = &r->gpu_pair_batch;
+  if (b->in_flight == NULL) return;
+
+#ifdef WITH_CUDA
+  const ticks tic = getticks();
+  if (!wait && cudaEventQuery(b->done) == cudaErrorNotReady) return;
+
+  /* The whole batch is checked once, when it is waited for */
+  const enum cuda_fault fault = cuda_event_sync_check(b->done, "pair batch");
+  if (fault != cuda_fault_none) runner_dopair_grav_pp_redo(r, fault);
+
+  /* Only count the time we actually spent waiting */
+  runner_dopair_grav_pp_finish(r, b->in_flight_ticks + getticks() - tic,
+                               fault != cuda_fault_none);
+
+  /* Let the dependencies of the task run */
+  struct task *t = b->in_flight;
+  b->in_flight = NULL;
+  scheduler_done(&r->e->sched, t);
+#else
+  error("SWIFT was not compiled with CUDA support.");
+#endif
+}
+
+/**
+ * @brief Adds a leaf-leaf pair to the runner's #cuda_pair_batch, sending the
+ * batch to the GPU if it is full.
+ *
+ * The caches are filled directly in the packed arrays of the batch and the
+ * truncation decision is taken here once for the whole pair.
+ *
+ * @param r The #runner.
+ * @param ci The first #cell.
+ * @param cj The other #cell.
+ * @param ci_active Is ci active?
+ * @param cj_active Is cj active?
+ * @param symmetric Are we updating both cells (1) or just ci (0) ?
+ * @param allow_mpole Are we allowing the use of M2P interactions ?
+ */
+static void runner_dopair_grav_pp_batch(struct runner *r, struct cell *ci,
+                                        struct cell *cj, const int ci_active,
+                                        const int cj_active,
+                                        const int symmetric,
+                                        const int allow_mpole) {
+
+  /* Recover some useful constants */
+  const struct engine *e = r->e;
+  const int periodic = e->mesh->periodic;
+  const float dim[3] = {(float)e->mesh->dim[0], (float)e->mesh->dim[1],
+                        (float)e->mesh->dim[2]};
+  const double shift[3] = {0., 0., 0.};
+  struct cuda_pair_batch *const b = &r->gpu_pair_batch;
+
+  /* Computed the padded counts */
+  const int gcount_i = ci->grav.count;
+  const int gcount_j = cj->grav.count;
+  const int gcount_padded_i = gcount_i - (gcount_i % VEC_SIZE) + VEC_SIZE;
+  const int gcount_padded_j = gcount_j - (gcount_j % VEC_SIZE) + VEC_SIZE;
+  const int stride_i = cuda_pair_batch_stride(gcount_padded_i);
+  const int stride_j = cuda_pair_batch_stride(gcount_padded_j);
+
+  /* The previous task's batch must have come back before we re-use it */
+  runner_dopair_grav_pp_complete(r, /*wait=*/1);
+
+  /* Make some room if need be */
+  if (b->count + stride_i + stride_j > b->size || b->npairs == b->max_pairs)
+    runner_dopair_grav_pp_flush(r);
+  cuda_pair_batch_ensure(b, stride_i + stride_j);
+
+  /* Recover the multipole info */
+  const struct gravity_tensors *mpole_i = ci->grav.multipole;
+  const struct gravity_tensors *mpole_j = cj->grav.multipole;
+  const float CoM_i[3] = {(float)mpole_i->CoM[0], (float)mpole_i->CoM[1],
+                          (float)mpole_i->CoM[2]};
+  const float CoM_j[3] = {(float)mpole_j->CoM[0], (float)mpole_j->CoM[1],
+                          (float)mpole_j->CoM[2]};
+
+  /* Describe the pair */
+  struct cuda_pair_desc *p = &b->pairs[b->npairs];
+  p->offset_i = b->count;
+  p->offset_j = b->count + stride_i;
+  p->goffset_i = ci->grav.parts - e->s->gparts;
+  p->goffset_j = cj->grav.parts - e->s->gparts;
+  p->gcount_i = gcount_i;
+  p->gcount_j = gcount_j;
+  p->gcount_padded_i = gcount_padded_i;
+  p->gcount_padded_j = gcount_padded_j;
+  p->update_i = ci_active;
+  p->update_j = cj_active && symmetric;
+
+  /* Only the multipoles used by an M2P travel, once per step */
+  const int allow_multipole_i = allow_mpole && gcount_i > 1;
+  const int allow_multipole_j = allow_mpole && gcount_j > 1;
+  p->multi_i = (p->update_j && allow_multipole_i)
+                   ? cuda_multipole_mirror_get(r, ci)
+                   : NULL;
+  p->multi_j = (p->update_i && allow_multipole_j)
+                   ? cuda_multipole_mirror_get(r, cj)
+                   : NULL;
+
+  /* Can we use the Newtonian version or do we need the truncated one ? */
+  p->truncated = runner_dopair_grav_pp_need_truncation(
+      e, CoM_i, CoM_j, mpole_i->r_max, mpole_j->r_max);
+
+  /* Fill the caches in-place */
+  struct gravity_cache ci_cache, cj_cache;
+  runner_gravity_cache_from_batch(&ci_cache, b, p->offset_i, stride_i);
+  runner_gravity_cache_from_batch(&cj_cache, b, p->offset_j, stride_j);
+  cuda_timeline_cpu_begin(cuda_timeline_populate);
+  runner_gravity_cache_populate(e, allow_multipole_j, periodic, dim, &ci_cache,
+                                ci, gcount_padded_i, shift, CoM_j, mpole_j);
+  runner_gravity_cache_populate(e, allow_multipole_i, periodic, dim, &cj_cache,
+                                cj, gcount_padded_j, shift, CoM_i, mpole_i);
+  cuda_timeline_cpu_end(cuda_timeline_populate);
+
+  /* Record the pair */
+  b->cells[2 * b->npairs + 0] = ci;
+  b->cells[2 * b->npairs + 1] = cj;
+  b->count += stride_i + stride_j;
+  b->npairs++;
+
+  /* Enough work to make a trip to the GPU worthwhile? */
+  if (b->count >= b->threshold) runner_dopair_grav_pp_flush(r);
+}
+
+/**
+ * @brief Computes the interaction of all the particles in a cell with all the
+ * particles of another cell.
+ *
+ * This function switches between the full potential and the truncated one
+ * depending on needs. It will also use the M2P (multipole) interaction
+ * for the subset of particles in either cell for which the distance criterion
+ * is valid.
+ *
+ * This function starts by constructing the require #gravity_cache for both
+ * cells and then call the specialised functions doing the actual work on
+ * the caches. It then write the data back to the particles.
+ *
+ * @param r The #runner.
+ * @param ci The first #cell.
+ * @param cj The other #cell.
+ * @param symmetric Are we updating both cells (1) or just ci (0) ?
+ * @param allow_mpole Are we allowing the use of M2P interactions ?
+ */
+void runner_dopair_grav_pp(struct runner *r, struct cell *ci, struct cell *cj,
+                           const int symmetric, const int allow_mpole) {
+
+  /* Recover some useful constants */
+  const struct engine *e = r->e;
+  const int periodic = e->mesh->periodic;
+  const float dim[3] = {(float)e->mesh->dim[0], (float)e->mesh->dim[1],
+                        (float)e->mesh->dim[2]};
+  const float r_s_inv = e->mesh->r_s_inv;
+
+  TIMER_TIC;
+
+  /* Record activity status */
+  const int ci_active =
+      cell_is_active_gravity(ci, e) && (ci->nodeID == e->nodeID);
+  const int cj_active =
+      cell_is_active_gravity(cj, e) && (cj->nodeID == e->nodeID);
+
+  /* Anything to do here? */
+  if (!ci_active && !cj_active) return;
+  if (!ci_active && !symmetric) return;
+
+#ifdef SWIFT_DEBUG_CHECKS
+  /* Check that we are not doing something stupid */
+  if (ci->split || cj->split) error("Running P-P on splitable cells");
+
+  /* Let's start by checking things are drifted */
+  if (!cell_are_gpart_drifted(ci, e)) error("Un-drifted gparts");
+  if (!cell_are_gpart_drifted(cj, e)) error("Un-drifted gparts");
+  if (cj_active && ci->grav.ti_old_multipole != e->ti_current)
+    error("Un-drifted multipole");
+  if (ci_active && cj->grav.ti_old_multipole != e->ti_current)
+    error("Un-drifted multipole");
+#endif
+
+  /* Small pairs are cheaper on the CPU than a trip to the GPU */
+  const int use_gpu =
+      cuda_work_split_use_gpu(&gpu_work_split, ci->grav.count, cj->grav.count);
+  const ticks tic_split = getticks();
+
+  /* Where the GPU can read the particles from, if resident. Pairs with a
+   * cell of another device have to be sent. */
+  const struct cuda_gpart_mirror *mirror =
+      cuda_gpart_mirror_of_pair(r, ci, cj);
+  const int can_batch = mirror != NULL || !gpu_gparts[0].active;
+
+  /* Accumulate the pair on its way to the GPU? */
+  if (use_gpu && can_batch && r->gpu_pair_batch.threshold > 0) {
+    runner_dopair_grav_pp_batch(r, ci, cj, ci_active, cj_active, symmetric,
+                                allow_mpole);
+    TIMER_TOC(timer_dopair_grav_pp);
+    return;
+  }
+
+  /* Caches to play with */
+  struct gravity_cache *const ci_cache = &r->ci_gravity_cache;
+  struct gravity_cache *const cj_cache = &r->cj_gravity_cache;
+
+  /* Read the particles from the device copy if we have one */
+  const struct cuda_gpart_mirror *resident = use_gpu ? mirror : NULL;
+
+  /* Shift to apply to the particles in each cell. When all the pairs of
+   * particles agree on the periodic image, cj is moved there once and the
+   * interactions need no wrapping. The resident particles stay where they
+   * are. */
+  const double shift_i[3] = {0., 0., 0.};
+  double shift_j[3] = {0., 0., 0.};
+  const int wrap =
+      periodic && (resident != NULL ||
+                   !runner_dopair_grav_pp_image_shift(e, ci, cj, shift_j));
+
+  /* Recover the multipole info and shift the CoM locations */
+  const float rmax_i = ci->grav.multipole->r_max;
+  const float rmax_j = cj->grav.multipole->r_max;
+  const struct multipole *multi_i = &ci->grav.multipole->m_pole;
+  const struct multipole *multi_j = &cj->grav.multipole->m_pole;
+  const float CoM_i[3] = {(float)(ci->grav.multipole->CoM[0] - shift_i[0]),
+                          (float)(ci->grav.multipole->CoM[1] - shift_i[1]),
+                          (float)(ci->grav.multipole->CoM[2] - shift_i[2])};
+  const float CoM_j[3] = {(float)(cj->grav.multipole->CoM[0] - shift_j[0]),
+                          (float)(cj->grav.multipole->CoM[1] - shift_j[1]),
+                          (float)(cj->grav.multipole->CoM[2] - shift_j[2])};
+
+  /* Start by constructing particle caches */
+
+  /* Computed the padded counts */
+  const int gcount_i = ci->grav.count;
+  const int gcount_j = cj->grav.count;
+  const int gcount_padded_i = gcount_i - (gcount_i % VEC_SIZE) + VEC_SIZE;
+  const int gcount_padded_j = gcount_j - (gcount_j % VEC_SIZE) + VEC_SIZE;
+  const int allow_multipole_i = allow_mpole && ci->grav.count > 1;
+  const int allow_multipole_j = allow_mpole && cj->grav.count > 1;
+
+  /* Fill the caches */
+  if (use_gpu) cuda_timeline_cpu_begin(cuda_timeline_populate);
+  runner_gravity_cache_populate(e, allow_multipole_j, periodic, dim, ci_cache,
+                                ci, gcount_padded_i, shift_i, CoM_j,
+                                cj->grav.multipole);
+  runner_gravity_cache_populate(e, allow_multipole_i, periodic, dim, cj_cache,
+                                cj, gcount_padded_j, shift_j, CoM_i,
+                                ci->grav.multipole);
+  if (use_gpu) cuda_timeline_cpu_end(cuda_timeline_populate);
+
+  /* Take the decisions here such that the GPU only does the needed work */
+  const int truncated =
+      runner_dopair_grav_pp_need_truncation(e, CoM_i, CoM_j, rmax_i, rmax_j);
+  const int update_i = ci_active;
+  const int update_j = cj_active && symmetric;
+
+  /* Did the device fail us? */
+  enum cuda_fault fault = cuda_fault_none;
+
+  if (use_gpu) {
+
+#ifdef WITH_CUDA
+    /* Make sure the device caches can hold the padded caches */
+    cuda_gravity_cache_ensure(&r->ci_cuda_gravity_cache, gcount_padded_i);
+    cuda_gravity_cache_ensure(&r->cj_cuda_gravity_cache, gcount_padded_j);
+
+    /* Only the multipoles used by an M2P travel, once per step */
+    const struct cuda_cell_multipole *d_multi_i =
+        (update_j && allow_multipole_i) ? cuda_multipole_mirror_get(r, ci)
+                                        : NULL;
+    const struct cuda_cell_multipole *d_multi_j =
+        (update_i && allow_multipole_j) ? cuda_multipole_mirror_get(r, cj)
+                                        : NULL;
+
+    /* The device copy of the multipole of cj is not shifted */
+    const int gpu_wrap = wrap || d_multi_j != NULL;
+
+    /* The whole pair is checked once, when its stream is synchronised */
+    fault = pp_offload(
+        gpu_precision, gpu_wrap, truncated, update_i, update_j, dim, r_s_inv,
+        d_multi_i, d_multi_j, ci_cache->x, ci_cache->y, ci_cache->z,
+        ci_cache->epsilon, ci_cache->m, ci_cache->active, ci_cache->use_mpole,
+        ci_cache->a_x, ci_cache->a_y, ci_cache->a_z, ci_cache->pot, gcount_i,
+        gcount_padded_i, cj_cache->x, cj_cache->y, cj_cache->z,
+        cj_cache->epsilon, cj_cache->m, cj_cache->active, cj_cache->use_mpole,
+        cj_cache->a_x, cj_cache->a_y, cj_cache->a_z, cj_cache->pot, gcount_j,
+        gcount_padded_j, &r->ci_cuda_gravity_cache, &r->cj_cuda_gravity_cache,
+        resident, ci->grav.parts - e->s->gparts,
+        cj->grav.parts - e->s->gparts, get_runner_cuda_stream(r->id));
+#else
+    error("SWIFT was not compiled with CUDA support.");
+#endif
+
+    /* The resident results are only brought back at the end of the step, we
+     * cannot tell what the failed kernel added to them. Same when the
+     * context is gone. */
+    if (fault == cuda_fault_sticky)
+      error("The CUDA context was lost, restart from the last checkpoint.");
+    if (fault != cuda_fault_none && resident != NULL)
+      error("Device fault on a pair of resident cells, cannot recover.");
+
+    if (fault == cuda_fault_none) {
+      cuda_device_load_add(&r->gpu_load, (double)gcount_i * (double)gcount_j,
+                           getticks() - tic_split);
+    } else {
+
+      /* The results in the host caches are garbage, redo the pair on the
+       * CPU from scratch */
+      warning("Device fault on a pair of %d and %d gparts, re-running it on "
+              "the CPU.",
+              gcount_i, gcount_j);
+      gravity_cache_zero_output(ci_cache, gcount_padded_i);
+      gravity_cache_zero_output(cj_cache, gcount_padded_j);
+    }
+  }
+
+  /* On the CPU, possibly again after a device fault */
+  const int on_cpu = !use_gpu || fault != cuda_fault_none;
+
+  if (on_cpu && truncated) {
+
+    /* Periodic and close enough to need the truncated potential */
+    if (wrap)
+      runner_dopair_grav_truncated_periodic(
+          ci_cache, cj_cache, update_i, update_j, allow_multipole_i,
+          allow_multipole_j, CoM_i, CoM_j, multi_i, multi_j, dim, r_s_inv, e,
+          ci, cj);
+    else
+      runner_dopair_grav_truncated_shifted(
+          ci_cache, cj_cache, update_i, update_j, allow_multipole_i,
+          allow_multipole_j, CoM_i, CoM_j, multi_i, multi_j, dim, r_s_inv, e,
+          ci, cj);
+
+  } else if (on_cpu) {
+
+    /* Newtonian potential (with periodic wrapping if needed) */
+    if (wrap)
+      runner_dopair_grav_full_periodic(
+          ci_cache, cj_cache, update_i, update_j, allow_multipole_i,
+          allow_multipole_j, CoM_i, CoM_j, multi_i, multi_j, dim, e, ci, cj);
+    else
+      runner_dopair_grav_full_non_periodic(
+          ci_cache, cj_cache, update_i, update_j, allow_multipole_i,
+          allow_multipole_j, CoM_i, CoM_j, multi_i, multi_j, dim, e, ci, cj);
+  }
+
+  /* Write back to the particles in ci */
+  if (use_gpu && resident == NULL)
+    cuda_timeline_cpu_begin(cuda_timeline_write_back);
+  if (update_i && resident == NULL) {
+#ifndef SWIFT_TASKS_WITHOUT_ATOMICS
+    lock_lock(&ci->grav.plock);
+#endif
+    gravity_cache_write_back(ci_cache, ci->grav.parts, gcount_i);
+#ifndef SWIFT_TASKS_WITHOUT_ATOMICS
+    if (lock_unlock(&ci->grav.plock) != 0) error("Error unlocking cell");
+#endif
+  }
+
+  /* Write back to the particles in cj */
+  if (update_j && resident == NULL) {
+#ifndef SWIFT_TASKS_WITHOUT_ATOMICS
+    lock_lock(&cj->grav.plock);
+#endif
+    gravity_cache_write_back(cj_cache, cj->grav.parts, gcount_j);
+#ifndef SWIFT_TASKS_WITHOUT_ATOMICS
+    if (lock_unlock(&cj->grav.plock) != 0) error("Error unlocking cell");
+#endif
+  }
+  if (use_gpu && resident == NULL)
+    cuda_timeline_cpu_end(cuda_timeline_write_back);
+
+  /* Let the CPU/GPU split learn from this pair */
+  if (gpu_work_split.active) {
+    struct cuda_split_timings *t = &r->gpu_split_timings;
+    cuda_split_samples_add(use_gpu ? &t->gpu : &t->cpu,
+                           (double)gcount_i * (double)gcount_j, 1,
+                           getticks() - tic_split);
+  }
+
+  TIMER_TOC(timer_dopair_grav_pp);
+}
+
+/* The calibrations do not run in the modes checking the #gpart */
+#if !defined(SWIFT_DEBUG_CHECKS) && !defined(SWIFT_GRAVITY_FORCE_CHECKS)
+
+/**
+ * @brief Fill a #gravity_cache with a synthetic cloud of particles for the
+ * calibration of the CPU/GPU split.
+ *
+ * @param c The #gravity_cache to fill.
+ * @param gcount The number of particles.
+ * @param gcount_padded The number of particles padded to the vector length.
+ * @param shift The offset to apply along x.
+ */
+static void runner_gravity_cache_fill_calibration(struct gravity_cache *c,
+                                                  const int gcount,
+                                                  const int gcount_padded,
+                                                  const float shift) {
+
+  for (int k = 0; k < gcount_padded; ++k) {
+    const int real = k < gcount;
+    c->x[k] = shift + fmodf(0.6180340f * k, 1.f);
+    c->y[k] = fmodf(0.4142136f * k, 1.f);
+    c->z[k] = fmodf(0.7320508f * k, 1.f);
+    c->epsilon[k] = 0.01f;
+    c->m[k] = real ? 1.f : 0.f;
+    c->active[k] = real;
+    c->use_mpole[k] = 0;
+    c->a_x[k] = 0.f;
+    c->a_y[k] = 0.f;
+    c->a_z[k] = 0.f;
+    c->pot[k] = 0.f;
+  }
+}
+
+#endif
+
+/**
+ * @brief Times the CPU and GPU P2P kernels on synthetic pairs of growing
+ * size and sets the cost models of the #cuda_work_split from them.
+ *
+ * This uses the caches of the runner and must hence be called before it
+ * starts running tasks.
+ *
+ * @param r The #runner.
+ */
+void runner_dopair_grav_pp_calibrate(struct runner *r) {
+
+#if defined(SWIFT_DEBUG_CHECKS) || defined(SWIFT_GRAVITY_FORCE_CHECKS)
+  /* The kernels look at the #gpart behind the caches in these modes and
+   * there are none here. The run-time measurements will set the models. */
+  return;
+#elif !defined(WITH_CUDA)
+  error("SWIFT was not compiled with CUDA support.");
+#else
+
+  /* Recover some useful constants */
+  const struct engine *e = r->e;
+  const float dim[3] = {(float)e->mesh->dim[0], (float)e->mesh->dim[1],
+                        (float)e->mesh->dim[2]};
+  const float r_s_inv = e->mesh->r_s_inv;
+  struct gravity_cache *const ci_cache = &r->ci_gravity_cache;
+  struct gravity_cache *const cj_cache = &r->cj_gravity_cache;
+
+  /* The caches are only allocated on first use, make room for the largest
+   * synthetic cells. */
+  gravity_cache_ensure(ci_cache, space_splitsize_grav_max);
+  gravity_cache_ensure(cj_cache, space_splitsize_grav_max);
+
+  /* Two unit cubes next to each other. No particle uses the multipoles. */
+
+  struct cuda_split_samples cpu, gpu;
+  bzero(&cpu, sizeof(struct cuda_split_samples));
+  bzero(&gpu, sizeof(struct cuda_split_samples));
+
+  const int max_count = min(ci_cache->count, cj_cache->count) - VEC_SIZE;
+  for (int n = CUDA_WORK_SPLIT_CALIBRATION_MIN; n <= max_count; n *= 2) {
+
+    const int gcount_padded = n - (n % VEC_SIZE) + VEC_SIZE;
+    cuda_gravity_cache_ensure(&r->ci_cuda_gravity_cache, gcount_padded);
+    cuda_gravity_cache_ensure(&r->cj_cuda_gravity_cache, gcount_padded);
+
+    /* Keep the fastest of a few repeats */
+    ticks cpu_time = 0, gpu_time = 0;
+    for (int rep = 0; rep < CUDA_WORK_SPLIT_CALIBRATION_REPEATS; ++rep) {
+
+      runner_gravity_cache_fill_calibration(ci_cache, n, gcount_padded, 0.f);
+      runner_gravity_cache_fill_calibration(cj_cache, n, gcount_padded, 2.f);
+
+      ticks tic = getticks();
+      runner_dopair_grav_pp_full(ci_cache, cj_cache, n, n, gcount_padded,
+                                 /*periodic=*/0, dim, e, NULL, NULL);
+      runner_dopair_grav_pp_full(cj_cache, ci_cache, n, n, gcount_padded,
+                                 /*periodic=*/0, dim, e, NULL, NULL);
+      const ticks cpu_toc = getticks() - tic;
+
+      tic = getticks();
+      pp_offload(gpu_precision, /*periodic=*/0, /*truncated=*/0,
+                 /*update_i=*/1, /*update_j=*/1, dim, r_s_inv,
+                 /*multi_i=*/NULL, /*multi_j=*/NULL, ci_cache->x, ci_cache->y,
+                 ci_cache->z, ci_cache->epsilon, ci_cache->m, ci_cache->active,
+                 ci_cache->use_mpole, ci_cache->a_x, ci_cache->a_y,
+                 ci_cache->a_z, ci_cache->pot, n, gcount_padded, cj_cache->x,
+                 cj_cache->y, cj_cache->z, cj_cache->epsilon, cj_cache->m,
+                 cj_cache->active, cj_cache->use_mpole, cj_cache->a_x,
+                 cj_cache->a_y, cj_cache->a_z, cj_cache->pot, n,
+                 gcount_padded, &r->ci_cuda_gravity_cache,
+                 &r->cj_cuda_gravity_cache, /*resident=*/NULL, 0, 0,
+                 get_runner_cuda_stream(r->id));
+      const ticks gpu_toc = getticks() - tic;
+
+      if (rep == 0 || cpu_toc < cpu_time) cpu_time = cpu_toc;
+      if (rep == 0 || gpu_toc < gpu_time) gpu_time = gpu_toc;
+    }
+
+    cuda_split_samples_add(&cpu, (double)n * (double)n, 1, cpu_time);
+    cuda_split_samples_add(&gpu, (double)n * (double)n, 1, gpu_time);
+  }
+
+  cuda_work_split_calibrate(&gpu_work_split, &cpu, &gpu);
+#endif
+}
+
+/**
+ * @brief Times the P2P interactions of a synthetic pair of cells on the CPU
+ * or on the GPU, for the benchmarks.
+ *
+ * Both cells are updated (as in a symmetric pair task) and none of the
+ * particles use the multipoles. The runner's caches are used and the ones on
+ * the device are grown if need be.
+ *
+ * @param r The #runner.
+ * @param gcount The number of #gpart in each cell.
+ * @param periodic Use the nearest periodic images within the mesh box?
+ * @param truncated Use the truncated (short-range) potential? Requires
+ * periodic.
+ * @param on_gpu Send the pair through pp_offload() rather than running the
+ * CPU kernels?
+ * @param repeats The number of runs, of which the fastest is reported.
+ * @param h2d_bytes (return) The number of bytes a run sends to the device.
+ * @param d2h_bytes (return) The number of bytes a run gets back from it.
+ * @return The time taken by the fastest run.
+ */
+ticks runner_dopair_grav_pp_benchmark(struct runner *r, const int gcount,
+                                      const int periodic, const int truncated,
+                                      const int on_gpu, const int repeats,
+                                      size_t *h2d_bytes, size_t *d2h_bytes) {
+
+#if defined(SWIFT_DEBUG_CHECKS) || defined(SWIFT_GRAVITY_FORCE_CHECKS)
+  /* The kernels look at the #gpart behind the caches in these modes and
+   * there are none here. */
+  error("The P2P benchmarks cannot run with the debugging checks.");
+  return 0;
+#else
+
+  /* Recover some useful constants */
+  const struct engine *e = r->e;
+  const float dim[3] = {(float)e->mesh->dim[0], (float)e->mesh->dim[1],
+                        (float)e->mesh->dim[2]};
+  const float r_s_inv = e->mesh->r_s_inv;
+  struct gravity_cache *const ci_cache = &r->ci_gravity_cache;
+  struct gravity_cache *const cj_cache = &r->cj_gravity_cache;
+  const int gcount_padded = gcount - (gcount % VEC_SIZE) + VEC_SIZE;
+
+  if (truncated && !periodic)
+    error("The truncated potential only exists in periodic boxes.");
+
+  gravity_cache_ensure(ci_cache, gcount_padded);
+  gravity_cache_ensure(cj_cache, gcount_padded);
+  if (on_gpu) {
+    cuda_gravity_cache_ensure(&r->ci_cuda_gravity_cache, gcount_padded);
+    cuda_gravity_cache_ensure(&r->cj_cuda_gravity_cache, gcount_padded);
+  }
+
+  /* What pp_offload() moves for a pair of non-resident cells: the padded
+   * positions, softenings and masses and the activity and M2P flags on the
+   * way in, the accelerations and potentials on the way out. */
+  *h2d_bytes = on_gpu ? 2 * (5 * sizeof(float) * (size_t)gcount_padded +
+                             2 * sizeof(int) * (size_t)gcount)
+                      : 0;
+  *d2h_bytes = on_gpu ? 2 * 4 * sizeof(float) * (size_t)gcount : 0;
+
+  ticks best = 0;
+  for (int rep = 0; rep < repeats; ++rep) {
+
+    runner_gravity_cache_fill_calibration(ci_cache, gcount, gcount_padded, 0.f);
+    runner_gravity_cache_fill_calibration(cj_cache, gcount, gcount_padded, 2.f);
+
+    const ticks tic = getticks();
+    if (on_gpu) {
+#ifdef WITH_CUDA
+      pp_offload(gpu_precision, periodic, truncated, /*update_i=*/1,
+                 /*update_j=*/1, dim, r_s_inv, /*multi_i=*/NULL,
+                 /*multi_j=*/NULL, ci_cache->x, ci_cache->y, ci_cache->z,
+                 ci_cache->epsilon, ci_cache->m, ci_cache->active,
+                 ci_cache->use_mpole, ci_cache->a_x, ci_cache->a_y,
+                 ci_cache->a_z, ci_cache->pot, gcount, gcount_padded,
+                 cj_cache->x, cj_cache->y, cj_cache->z, cj_cache->epsilon,
+                 cj_cache->m, cj_cache->active, cj_cache->use_mpole,
+                 cj_cache->a_x, cj_cache->a_y, cj_cache->a_z, cj_cache->pot,
+                 gcount, gcount_padded, &r->ci_cuda_gravity_cache,
+                 &r->cj_cuda_gravity_cache, /*resident=*/NULL, 0, 0,
+                 get_runner_cuda_stream(r->id));
+#else
+      error("SWIFT was not compiled with CUDA support.");
+#endif
+    } else if (truncated) {
+      runner_dopair_grav_pp_truncated(ci_cache, cj_cache, gcount, gcount,
+                                      gcount_padded, /*periodic=*/1, dim,
+                                      r_s_inv, e, NULL, NULL);
+      runner_dopair_grav_pp_truncated(cj_cache, ci_cache, gcount, gcount,
+                                      gcount_padded, /*periodic=*/1, dim,
+                                      r_s_inv, e, NULL, NULL);
+    } else {
+      runner_dopair_grav_pp_full(ci_cache, cj_cache, gcount, gcount,
+                                 gcount_padded, periodic, dim, e, NULL, NULL);
+      runner_dopair_grav_pp_full(cj_cache, ci_cache, gcount, gcount,
+                                 gcount_padded, periodic, dim, e, NULL, NULL);
+    }
+    const ticks toc = getticks() - tic;
+
+    if (rep == 0 || toc < best) best = toc;
+  }
+
+  return best;
+#endif
+}
+
+/**
+ * @brief Compute the gravitational forces from particles in #cell cj onto
+ * particles in #cell ci without using a cache for cj.
+ *
+ * This function does not update the particles in cj. It also does not
  * make use of the field tensors in ci.
  * The function recurses to the leaf level in ci (not cj!) and then either uses
  * M2P or P2P when too close.
@@ -1322,7 +2389,7 @@ void runner_dopair_grav_pp(struct runner *r, struct cell *ci, struct cell *cj,
  * @param cj The cell containing the particles sourcing the gravity.
  */
 void runner_dopair_grav_pp_no_cache(struct runner *r, struct cell *restrict ci,
-                                    const struct cell *restrict cj) {
+                                    struct cell *restrict cj) {
 
   /* Recover some useful constants */
   const struct engine *e = r->e;
@@ -1347,6 +2414,15 @@ void runner_dopair_grav_pp_no_cache(struct runner *r, struct cell *restrict ci,
       }
     }
 
+  } else if (cj->grav.parts_foreign != NULL ||
+             (cj->nodeID == e->nodeID &&
+              cj->grav.ti_old_part != e->ti_current)) {
+
+    /* The compact foreign particles, and the local ones only drifted into the
+     * gpart SoA copy (see gpart_soa_drift_lazy()), can only be read through a
+     * cache */
+    runner_dopair_grav_pp(r, ci, cj, /*symmetric=*/0, /*allow_mpole=*/0);
+
   } else {
 
     /* Can we use the Newtonian version or do we need the truncated one ? */
@@ -1655,6 +2731,8 @@ static INLINE void runner_doself_grav_pp_truncated(
   }
 }
 
+extern enum cuda_fault self_pp_offload(const int precision, const int truncated, const float r_s_inv, const float *x, const float *y, const float *z, const float *h, const float *mass, const int *active, float *a_x, float *a_y, float *a_z, float *pot, const int gcount, const int gcount_padded, struct cuda_gravity_cache *d_c, const struct cuda_gpart_mirror *resident, const size_t goffset, cudaStream_t stream);
+
 /**
  * @brief Computes the interaction of all the particles in a cell with all the
  * other ones.
@@ -1663,8 +2741,12 @@ static INLINE void runner_doself_grav_pp_truncated(
  * depending on needs.
  *
  * This function starts by constructing the require #gravity_cache for the
- * cell and then call the specialised functions doing the actual work on
- * the cache. It then write the data back to the particles.
+ * cell and then offloads the actual work on the cache to the GPU, or does it
+ * on the CPU when no GPU is in use. It then write the data back to the
+ * particles.
+ *
+ * When the #gpart are resident on the device, the results are accumulated
+ * there instead and only written back by the end of the gravity calculation.
  *
  * @param r The #runner.
  * @param c The #cell.
@@ -1705,49 +2787,241 @@ void runner_doself_grav_pp(struct runner *r, struct cell *c) {
   const int gcount_padded = gcount - (gcount % VEC_SIZE) + VEC_SIZE;
 
   /* Fill the cache */
-  gravity_cache_populate_no_mpole(e->max_active_bin, ci_cache, c->grav.parts,
-                                  gcount, gcount_padded, loc, c,
-                                  e->gravity_properties);
-
-  /* Can we use the Newtonian version or do we need the truncated one ? */
-  if (!periodic) {
-
-    /* Not periodic -> Can always use Newtonian potential */
-    runner_doself_grav_pp_full(ci_cache, gcount, gcount_padded, e,
-                               c->grav.parts);
-
-  } else {
-
-    /* Get the maximal distance between any two particles */
-    const double max_r = 2. * c->grav.multipole->r_max;
-
-    /* Do we need to use the truncated interactions ? */
-    if (max_r > min_trunc) {
+  cuda_timeline_cpu_begin(cuda_timeline_populate);
+  if (gpart_soa.active && c->grav.ti_soa == e->ti_current)
+    gravity_cache_populate_no_mpole_soa(e->max_active_bin, ci_cache, &gpart_soa,
+                                        c->grav.parts - e->s->gparts, gcount,
+                                        gcount_padded, loc, c);
+  else
+    gravity_cache_populate_no_mpole(e->max_active_bin, ci_cache,
+                                    c->grav.parts, gcount, gcount_padded, loc,
+                                    c, e->gravity_properties);
+  cuda_timeline_cpu_end(cuda_timeline_populate);
+
+  /* Can we use the Newtonian version or do we need the truncated one ?
+   * Periodic but far-away cells must use the truncated potential. */
+  const int truncated =
+      periodic && (2. * c->grav.multipole->r_max > min_trunc);
+
+  /* Read the particles from the device copy if we have one */
+  const struct cuda_gpart_mirror *resident =
+      cuda_devices_active() ? cuda_gpart_mirror_of_pair(r, c, c) : NULL;
+
+  /* Did the device fail us? */
+  enum cuda_fault fault = cuda_fault_none;
+
+  if (cuda_devices_active()) {
+
+    const ticks tic_gpu = getticks();
+
+#ifdef WITH_CUDA
+    /* Make sure the device cache can hold the padded cache */
+    cuda_gravity_cache_ensure(&r->ci_cuda_gravity_cache, gcount_padded);
+
+    /* Do the work on the GPU, checked once when its stream is synchronised */
+    fault = self_pp_offload(
+        gpu_precision, truncated, r_s_inv, ci_cache->x, ci_cache->y,
+        ci_cache->z, ci_cache->epsilon, ci_cache->m, ci_cache->active,
+        ci_cache->a_x, ci_cache->a_y, ci_cache->a_z, ci_cache->pot, gcount,
+        gcount_padded, &r->ci_cuda_gravity_cache, resident,
+        c->grav.parts - e->s->gparts, get_runner_cuda_stream(r->id));
+#endif
 
-      /* Periodic but far-away cells must use the truncated potential */
-      runner_doself_grav_pp_truncated(ci_cache, gcount, gcount_padded, r_s_inv,
-                                      e, c->grav.parts);
+    /* As for the pairs, only the non-resident cells can be redone */
+    if (fault == cuda_fault_sticky)
+      error("The CUDA context was lost, restart from the last checkpoint.");
+    if (fault != cuda_fault_none && resident != NULL)
+      error("Device fault on a resident cell, cannot recover.");
 
+    if (fault == cuda_fault_none) {
+      cuda_device_load_add(&r->gpu_load, (double)gcount * (double)gcount,
+                           getticks() - tic_gpu);
     } else {
-
-      /* Periodic but close-by cells can use the full Newtonian potential */
-      runner_doself_grav_pp_full(ci_cache, gcount, gcount_padded, e,
-                                 c->grav.parts);
+      warning("Device fault on a cell of %d gparts, re-running it on the CPU.",
+              gcount);
+      gravity_cache_zero_output(ci_cache, gcount_padded);
     }
   }
 
+  /* On the CPU, possibly again after a device fault */
+  const int on_cpu = !cuda_devices_active() || fault != cuda_fault_none;
+
+  if (on_cpu && truncated) {
+    runner_doself_grav_pp_truncated(ci_cache, gcount, gcount_padded, r_s_inv,
+                                    e, c->grav.parts);
+  } else if (on_cpu) {
+    runner_doself_grav_pp_full(ci_cache, gcount, gcount_padded, e,
+                               c->grav.parts);
+  }
+
   /* Write back to the particles */
+  if (resident == NULL) {
+    cuda_timeline_cpu_begin(cuda_timeline_write_back);
 #ifndef SWIFT_TASKS_WITHOUT_ATOMICS
-  lock_lock(&c->grav.plock);
+    lock_lock(&c->grav.plock);
 #endif
-  gravity_cache_write_back(ci_cache, c->grav.parts, gcount);
+    gravity_cache_write_back(ci_cache, c->grav.parts, gcount);
 #ifndef SWIFT_TASKS_WITHOUT_ATOMICS
-  if (lock_unlock(&c->grav.plock) != 0) error("Error unlocking cell");
+    if (lock_unlock(&c->grav.plock) != 0) error("Error unlocking cell");
 #endif
+    cuda_timeline_cpu_end(cuda_timeline_write_back);
+  }
 
   TIMER_TOC(timer_doself_grav_pp);
 }
 
+extern void mm_batch_offload(struct cuda_mm_batch *b, const int periodic, const float r_s_inv, cudaStream_t stream);
+
+/**
+ * @brief Sends all the M2L interactions accumulated in the runner's
+ * #cuda_mm_batch to the GPU and adds the results to the field tensors.
+ *
+ * Must be called before the end of every task that may have added
+ * interactions to the batch.
+ *
+ * @param r The #runner.
+ */
+void runner_dopair_grav_mm_flush(struct runner *r) {
+
+  struct cuda_mm_batch *const b = &r->gpu_mm_batch;
+  if (b->npairs == 0) return;
+
+  /* Do all the interactions in one go */
+  const ticks tic = getticks();
+#ifdef WITH_CUDA
+  mm_batch_offload(b, r->e->mesh->periodic, r->e->mesh->r_s_inv,
+                   get_runner_cuda_stream(r->id));
+#else
+  error("SWIFT was not compiled with CUDA support.");
+#endif
+  cuda_device_load_add(&r->gpu_load, b->npairs, getticks() - tic);
+
+  /* Add the results to the cells' field tensors */
+  for (int k = 0; k < b->npairs; ++k) {
+
+    const struct cuda_mm_desc *p = &b->pairs[k];
+    struct cell *ca = b->cells[2 * k + 0];
+    struct cell *cb = b->cells[2 * k + 1];
+
+#ifdef SWIFT_DEBUG_CHECKS
+    /* The interaction counters are not computed on the device */
+    b->l_b[k].num_interacted = p->m_a.num_gpart;
+    if (p->symmetric) b->l_a[k].num_interacted = p->m_b.num_gpart;
+#endif
+#ifdef SWIFT_GRAVITY_FORCE_CHECKS
+    b->l_b[k].num_interacted_tree = p->m_a.num_gpart;
+    if (p->symmetric) b->l_a[k].num_interacted_tree = p->m_b.num_gpart;
+#endif
+
+#ifndef SWIFT_TASKS_WITHOUT_ATOMICS
+    lock_lock(&cb->grav.mlock);
+#endif
+    gravity_field_tensors_add(&cb->grav.multipole->pot, &b->l_b[k]);
+#ifndef SWIFT_TASKS_WITHOUT_ATOMICS
+    if (lock_unlock(&cb->grav.mlock) != 0) error("Failed to unlock multipole");
+#endif
+
+    if (p->symmetric) {
+#ifndef SWIFT_TASKS_WITHOUT_ATOMICS
+      lock_lock(&ca->grav.mlock);
+#endif
+      gravity_field_tensors_add(&ca->grav.multipole->pot, &b->l_a[k]);
+#ifndef SWIFT_TASKS_WITHOUT_ATOMICS
+      if (lock_unlock(&ca->grav.mlock) != 0)
+        error("Failed to unlock multipole");
+#endif
+    }
+  }
+
+  /* The batch is ready for more */
+  b->npairs = 0;
+}
+
+/**
+ * @brief Adds an M2L interaction to the runner's #cuda_mm_batch, sending the
+ * batch to the GPU if it is full.
+ *
+ * The distance vector and softening are computed here exactly as
+ * gravity_M2L_nonsym() and gravity_M2L_symmetric() do.
+ *
+ * @param r The #runner.
+ * @param ca The #cell whose multipole sources the field.
+ * @param cb The #cell whose field tensor gets updated.
+ * @param symmetric Do we also update the field tensor of ca?
+ */
+static void runner_dopair_grav_mm_batch(struct runner *r, struct cell *ca,
+                                        struct cell *cb, const int symmetric) {
+
+  const struct engine *e = r->e;
+  const int periodic = e->mesh->periodic;
+  const double dim[3] = {e->mesh->dim[0], e->mesh->dim[1], e->mesh->dim[2]};
+  struct cuda_mm_batch *const b = &r->gpu_mm_batch;
+
+  const struct multipole *m_a = &ca->grav.multipole->m_pole;
+  const struct multipole *m_b = &cb->grav.multipole->m_pole;
+  const double *pos_a = ca->grav.multipole->CoM;
+  const double *pos_b = cb->grav.multipole->CoM;
+
+  /* Compute distance vector */
+  float dx = (float)(pos_b[0] - pos_a[0]);
+  float dy = (float)(pos_b[1] - pos_a[1]);
+  float dz = (float)(pos_b[2] - pos_a[2]);
+
+  /* Apply BC */
+  if (periodic) {
+    dx = nearest(dx, dim[0]);
+    dy = nearest(dy, dim[1]);
+    dz = nearest(dz, dim[2]);
+  }
+
+  /* Describe the interaction */
+  struct cuda_mm_desc *p = &b->pairs[b->npairs];
+  p->dx = dx;
+  p->dy = dy;
+  p->dz = dz;
+  p->eps = symmetric ? max(m_a->max_softening, m_b->max_softening)
+                     : m_a->max_softening;
+  p->symmetric = symmetric;
+  p->m_a = *m_a;
+  if (symmetric) p->m_b = *m_b;
+
+  /* Record the interaction */
+  b->cells[2 * b->npairs + 0] = ca;
+  b->cells[2 * b->npairs + 1] = cb;
+  b->npairs++;
+
+  if (b->npairs == b->max_pairs) runner_dopair_grav_mm_flush(r);
+}
+
+/**
+ * @brief Square of the distance between the centres of mass of two cells, as
+ * used by the M2L kernels.
+ *
+ * @param e The #engine.
+ * @param ci The first #cell.
+ * @param cj The other #cell.
+ */
+static INLINE float runner_grav_mm_r2(const struct engine *e,
+                                      const struct cell *ci,
+                                      const struct cell *cj) {
+
+  const double *CoM_i = ci->grav.multipole->CoM;
+  const double *CoM_j = cj->grav.multipole->CoM;
+
+  float dx = (float)(CoM_j[0] - CoM_i[0]);
+  float dy = (float)(CoM_j[1] - CoM_i[1]);
+  float dz = (float)(CoM_j[2] - CoM_i[2]);
+
+  /* Apply BC */
+  if (e->mesh->periodic) {
+    dx = nearest(dx, e->mesh->dim[0]);
+    dy = nearest(dy, e->mesh->dim[1]);
+    dz = nearest(dz, e->mesh->dim[2]);
+  }
+
+  return dx * dx + dy * dy + dz * dz;
+}
+
 /**
  * @brief Computes the interaction of the field tensor and multipole
  * of two cells symmetrically.
@@ -1806,6 +3080,13 @@ static INLINE void runner_dopair_grav_mm_symmetric(struct runner *r,
         cj->grav.ti_old_multipole, cj->nodeID, ci->nodeID, e->ti_current);
 #endif
 
+  /* Leave it to the GPU? */
+  if (r->gpu_mm_batch.max_pairs > 0) {
+    runner_dopair_grav_mm_batch(r, ci, cj, /*symmetric=*/1);
+    TIMER_TOC(timer_dopair_grav_mm);
+    return;
+  }
+
 #ifndef SWIFT_TASKS_WITHOUT_ATOMICS
   /* Lock the multipoles
    * Note we impose a hierarchy to solve the dining philosopher problem */
@@ -1818,10 +3099,14 @@ static INLINE void runner_dopair_grav_mm_symmetric(struct runner *r,
   }
 #endif
 
-  /* Let's interact at this level */
-  gravity_M2L_symmetric(&ci->grav.multipole->pot, &cj->grav.multipole->pot,
-                        multi_i, multi_j, ci->grav.multipole->CoM,
-                        cj->grav.multipole->CoM, props, periodic, dim, r_s_inv);
+  /* Let's interact at this level, at the order the accuracy requires */
+  const int order =
+      gravity_M2L_order_symmetric(props, ci->grav.multipole, cj->grav.multipole,
+                                  runner_grav_mm_r2(e, ci, cj), periodic);
+  gravity_M2L_symmetric_order(&ci->grav.multipole->pot,
+                              &cj->grav.multipole->pot, multi_i, multi_j,
+                              ci->grav.multipole->CoM, cj->grav.multipole->CoM,
+                              props, periodic, dim, r_s_inv, order);
 
 #ifndef SWIFT_TASKS_WITHOUT_ATOMICS
   /* Unlock the multipoles */
@@ -1875,6 +3160,13 @@ static INLINE void runner_dopair_grav_mm_nonsym(struct runner *r,
         cj->grav.ti_old_multipole, cj->nodeID, ci->nodeID, e->ti_current);
 #endif
 
+  /* Leave it to the GPU? */
+  if (r->gpu_mm_batch.max_pairs > 0) {
+    runner_dopair_grav_mm_batch(r, cj, ci, /*symmetric=*/0);
+    TIMER_TOC(timer_dopair_grav_mm);
+    return;
+  }
+
 #ifndef SWIFT_TASKS_WITHOUT_ATOMICS
   /* Lock the multipoles
    * Note we impose a hierarchy to solve the dining philosopher problem */
@@ -1887,9 +3179,13 @@ static INLINE void runner_dopair_grav_mm_nonsym(struct runner *r,
   }
 #endif
 
-  /* Let's interact at this level */
-  gravity_M2L_nonsym(&ci->grav.multipole->pot, multi_j, ci->grav.multipole->CoM,
-                     cj->grav.multipole->CoM, props, periodic, dim, r_s_inv);
+  /* Let's interact at this level, at the order the accuracy requires */
+  const int order =
+      gravity_M2L_order(props, ci->grav.multipole, cj->grav.multipole,
+                        runner_grav_mm_r2(e, ci, cj), periodic);
+  gravity_M2L_nonsym_order(&ci->grav.multipole->pot, multi_j,
+                           ci->grav.multipole->CoM, cj->grav.multipole->CoM,
+                           props, periodic, dim, r_s_inv, order);
 
 #ifndef SWIFT_TASKS_WITHOUT_ATOMICS
   /* Unlock the multipoles */
@@ -1932,6 +3228,234 @@ static INLINE void runner_dopair_grav_mm(struct runner *r,
     runner_dopair_grav_mm_nonsym(r, cj, ci);
 }
 
+/**
+ * @brief A batch of M2L interactions done together on the CPU.
+ *
+ * Each lane interacts the multipole of ca with the field tensor of cb and,
+ * when symmetric, the multipole of cb with the field tensor of ca.
+ */
+struct runner_grav_mm_batch {
+
+  /*! The multipoles of the ca and cb cells. */
+  struct multipole_batch m_a, m_b;
+
+  /*! The derivatives of the potential. */
+  struct potential_derivatives_M2L_batch pot;
+
+  /*! The contributions to the field tensors of the ca and cb cells. */
+  struct grav_tensor_batch l_a, l_b;
+
+  /*! The cells of each lane. */
+  struct cell *ca[MULTIPOLE_BATCH_SIZE], *cb[MULTIPOLE_BATCH_SIZE];
+
+  /*! Is the interaction of each lane symmetric? */
+  int symmetric[MULTIPOLE_BATCH_SIZE];
+
+  /*! Number of lanes in use. */
+  int count;
+};
+
+/**
+ * @brief Does all the M2L interactions of a #runner_grav_mm_batch and adds
+ * the results to the field tensors.
+ *
+ * @param b The #runner_grav_mm_batch.
+ */
+static void runner_dopair_grav_mm_batch_flush(struct runner_grav_mm_batch *b) {
+
+  if (b->count == 0) return;
+
+  TIMER_TIC;
+
+  /* Neutral values in the unused lanes */
+  if (b->count < MULTIPOLE_BATCH_SIZE) {
+    struct multipole m_zero;
+    struct potential_derivatives_M2L pot_zero;
+    bzero(&m_zero, sizeof(struct multipole));
+    bzero(&pot_zero, sizeof(struct potential_derivatives_M2L));
+    for (int k = b->count; k < MULTIPOLE_BATCH_SIZE; ++k) {
+      multipole_batch_set(&b->m_a, k, &m_zero);
+      multipole_batch_set(&b->m_b, k, &m_zero);
+      potential_derivatives_batch_set(&b->pot, k, &pot_zero);
+    }
+  }
+
+  int any_symmetric = 0;
+  for (int k = 0; k < b->count; ++k) any_symmetric |= b->symmetric[k];
+
+  /* Do the first M2L tensor multiplication of all the lanes */
+  grav_tensor_batch_init(&b->l_b);
+  gravity_M2L_batch_apply(&b->l_b, &b->m_a, &b->pot);
+
+  /* And the second one, with the odd derivatives flipped */
+  if (any_symmetric) {
+    potential_derivatives_batch_flip_signs(&b->pot);
+    grav_tensor_batch_init(&b->l_a);
+    gravity_M2L_batch_apply(&b->l_a, &b->m_b, &b->pot);
+  }
+
+  /* Add the results to the cells' field tensors */
+  for (int k = 0; k < b->count; ++k) {
+
+    struct cell *ca = b->ca[k];
+    struct cell *cb = b->cb[k];
+
+    struct grav_tensor l;
+    bzero(&l, sizeof(struct grav_tensor));
+    grav_tensor_batch_get(&l, &b->l_b, k);
+#ifdef SWIFT_DEBUG_CHECKS
+    l.num_interacted = ca->grav.multipole->m_pole.num_gpart;
+#endif
+#ifdef SWIFT_GRAVITY_FORCE_CHECKS
+    l.num_interacted_tree = ca->grav.multipole->m_pole.num_gpart;
+#endif
+
+#ifndef SWIFT_TASKS_WITHOUT_ATOMICS
+    lock_lock(&cb->grav.mlock);
+#endif
+    gravity_field_tensors_add(&cb->grav.multipole->pot, &l);
+#ifndef SWIFT_TASKS_WITHOUT_ATOMICS
+    if (lock_unlock(&cb->grav.mlock) != 0) error("Failed to unlock multipole");
+#endif
+
+    if (b->symmetric[k]) {
+
+      bzero(&l, sizeof(struct grav_tensor));
+      grav_tensor_batch_get(&l, &b->l_a, k);
+#ifdef SWIFT_DEBUG_CHECKS
+      l.num_interacted = cb->grav.multipole->m_pole.num_gpart;
+#endif
+#ifdef SWIFT_GRAVITY_FORCE_CHECKS
+      l.num_interacted_tree = cb->grav.multipole->m_pole.num_gpart;
+#endif
+
+#ifndef SWIFT_TASKS_WITHOUT_ATOMICS
+      lock_lock(&ca->grav.mlock);
+#endif
+      gravity_field_tensors_add(&ca->grav.multipole->pot, &l);
+#ifndef SWIFT_TASKS_WITHOUT_ATOMICS
+      if (lock_unlock(&ca->grav.mlock) != 0)
+        error("Failed to unlock multipole");
+#endif
+    }
+  }
+
+  /* The batch is ready for more */
+  b->count = 0;
+
+  TIMER_TOC(timer_dopair_grav_mm);
+}
+
+/**
+ * @brief Adds an M2L interaction to a #runner_grav_mm_batch, doing the
+ * whole batch if it is full.
+ *
+ * The distance vector, softening and derivatives are computed here exactly
+ * as gravity_M2L_nonsym() and gravity_M2L_symmetric() do.
+ *
+ * @param r The #runner.
+ * @param b The #runner_grav_mm_batch.
+ * @param ca The #cell whose multipole sources the field.
+ * @param cb The #cell whose field tensor gets updated.
+ * @param symmetric Do we also update the field tensor of ca?
+ */
+static void runner_dopair_grav_mm_batch_add(struct runner *r,
+                                            struct runner_grav_mm_batch *b,
+                                            struct cell *ca, struct cell *cb,
+                                            const int symmetric) {
+
+  const struct engine *e = r->e;
+  const int periodic = e->mesh->periodic;
+  const double dim[3] = {e->mesh->dim[0], e->mesh->dim[1], e->mesh->dim[2]};
+  const float r_s_inv = e->mesh->r_s_inv;
+
+  const struct multipole *m_a = &ca->grav.multipole->m_pole;
+  const struct multipole *m_b = &cb->grav.multipole->m_pole;
+  const double *pos_a = ca->grav.multipole->CoM;
+  const double *pos_b = cb->grav.multipole->CoM;
+
+  /* Recover some constants */
+  const float eps = symmetric ? max(m_a->max_softening, m_b->max_softening)
+                              : m_a->max_softening;
+
+  /* Compute distance vector */
+  float dx = (float)(pos_b[0] - pos_a[0]);
+  float dy = (float)(pos_b[1] - pos_a[1]);
+  float dz = (float)(pos_b[2] - pos_a[2]);
+
+  /* Apply BC */
+  if (periodic) {
+    dx = nearest(dx, dim[0]);
+    dy = nearest(dy, dim[1]);
+    dz = nearest(dz, dim[2]);
+  }
+
+  /* Compute distance */
+  const float r2 = dx * dx + dy * dy + dz * dz;
+  const float r_inv = 1. / sqrtf(r2);
+
+  /* Compute all derivatives */
+  struct potential_derivatives_M2L pot;
+  potential_derivatives_compute_M2L(dx, dy, dz, r2, r_inv, eps, periodic,
+                                    r_s_inv, &pot);
+
+  /* Fill the lane */
+  const int k = b->count;
+  potential_derivatives_batch_set(&b->pot, k, &pot);
+  multipole_batch_set(&b->m_a, k, m_a);
+  if (symmetric) multipole_batch_set(&b->m_b, k, m_b);
+  b->ca[k] = ca;
+  b->cb[k] = cb;
+  b->symmetric[k] = symmetric;
+  b->count++;
+
+  if (b->count == MULTIPOLE_BATCH_SIZE) runner_dopair_grav_mm_batch_flush(b);
+}
+
+/**
+ * @brief Call the M-M calculation on two cells if active, adding the
+ * interaction to a #runner_grav_mm_batch.
+ *
+ * Same as runner_dopair_grav_mm().
+ *
+ * @param r The #runner object.
+ * @param b The #runner_grav_mm_batch.
+ * @param ci The first #cell.
+ * @param cj The second #cell.
+ */
+static void runner_dopair_grav_mm_batched(struct runner *r,
+                                          struct runner_grav_mm_batch *b,
+                                          struct cell *ci, struct cell *cj) {
+
+  const struct engine *e = r->e;
+
+  /* What do we need to do? */
+  const int do_i =
+      cell_is_active_gravity_mm(ci, e) && (ci->nodeID == e->nodeID);
+  const int do_j =
+      cell_is_active_gravity_mm(cj, e) && (cj->nodeID == e->nodeID);
+
+  /* Do we need drifting first? */
+  if (ci->grav.ti_old_multipole < e->ti_current) cell_drift_multipole(ci, e);
+  if (cj->grav.ti_old_multipole < e->ti_current) cell_drift_multipole(cj, e);
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (ci == cj) error("Interacting a cell with itself using M2L");
+
+  if ((do_i || do_j) && (ci->grav.multipole->m_pole.num_gpart == 0 ||
+                         cj->grav.multipole->m_pole.num_gpart == 0))
+    error("Multipole does not seem to have been set.");
+#endif
+
+  /* Interact! */
+  if (do_i && do_j)
+    runner_dopair_grav_mm_batch_add(r, b, ci, cj, /*symmetric=*/1);
+  else if (do_i)
+    runner_dopair_grav_mm_batch_add(r, b, cj, ci, /*symmetric=*/0);
+  else if (do_j)
+    runner_dopair_grav_mm_batch_add(r, b, ci, cj, /*symmetric=*/0);
+}
+
 /**
  * @brief Computes all the M-M interactions between all the well-separated (at
  * rebuild) pairs of progenies of the two cells.
@@ -1952,6 +3476,28 @@ void runner_dopair_grav_mm_progenies(struct runner *r, const long long flags,
   runner_clear_grav_flags(ci, e);
   runner_clear_grav_flags(cj, e);
 
+  /* Without the GPU, do the interactions #MULTIPOLE_BATCH_SIZE at a time */
+  if (r->gpu_mm_batch.max_pairs == 0) {
+
+    struct runner_grav_mm_batch batch;
+    batch.count = 0;
+
+    for (int i = 0; i < 8; i++) {
+      if (ci->progeny[i] == NULL) continue;
+      for (int j = 0; j < 8; j++) {
+        if (cj->progeny[j] == NULL) continue;
+
+        /* Did we agree to use an M-M interaction here at the last rebuild? */
+        if (flags & (1ULL << (i * 8 + j)))
+          runner_dopair_grav_mm_batched(r, &batch, ci->progeny[i],
+                                        cj->progeny[j]);
+      }
+    }
+
+    runner_dopair_grav_mm_batch_flush(&batch);
+    return;
+  }
+
   /* Loop over all pairs of progenies */
   for (int i = 0; i < 8; i++) {
     if (ci->progeny[i] != NULL) {
@@ -2003,6 +3549,10 @@ void runner_dopair_recursive_grav_pm(struct runner *r, struct cell *ci,
   /* Can we recurse further? */
   if (ci->split) {
 
+    /* Only the cells are read on the way down, not their multipoles */
+    for (int k = 0; k < 8; k++)
+      if (ci->progeny[k] != NULL) __builtin_prefetch(&ci->progeny[k]->grav);
+
     /* Loop over ci's children */
     for (int k = 0; k < 8; k++) {
       if (ci->progeny[k] != NULL)
@@ -2047,8 +3597,8 @@ void runner_dopair_recursive_grav_pm(struct runner *r, struct cell *ci,
     } else {
 
       runner_dopair_grav_pm_truncated(ci_cache, gcount_padded_i, CoM_j, multi_j,
-                                      dim, r_s_inv, e, ci->grav.parts, gcount_i,
-                                      cj);
+                                      /*periodic=*/1, dim, r_s_inv, e,
+                                      ci->grav.parts, gcount_i, cj);
     }
 
     /* Write back to the particles */
@@ -2063,22 +3613,53 @@ void runner_dopair_recursive_grav_pm(struct runner *r, struct cell *ci,
 }
 
 /**
- * @brief Computes the interaction of all the particles in a cell with all the
- * particles of another cell.
+ * @brief What to do next with a pair of cells of a gravity tree walk.
+ */
+enum runner_grav_node_action {
+  runner_grav_node_done,    /* Interacted, cut or nothing to do */
+  runner_grav_node_split_i, /* Recurse into the progenies of ci */
+  runner_grav_node_split_j  /* Recurse into the progenies of cj */
+};
+
+/**
+ * @brief Prefetch the parts of the progenies of a cell, and of their
+ * multipoles, that the MAC reads.
  *
- * This function will try to recurse as far down the tree as possible and only
- * default to direct summation if there is no better option.
+ * The cells are requested first, such that their loads overlap when we
+ * then follow the pointers to the multipoles.
  *
- * If using periodic BCs, we will abort the recursion if th distance between the
+ * @param c The split #cell.
+ */
+static INLINE void runner_grav_prefetch_progeny(const struct cell *c) {
+
+  for (int k = 0; k < 8; k++)
+    if (c->progeny[k] != NULL) __builtin_prefetch(&c->progeny[k]->grav);
+
+  for (int k = 0; k < 8; k++) {
+    const struct cell *cp = c->progeny[k];
+    if (cp == NULL) continue;
+    const struct gravity_tensors *m = cp->grav.multipole;
+    __builtin_prefetch(&m->m_pole.max_softening);
+    __builtin_prefetch(&m->CoM);
+    __builtin_prefetch(&m->r_max);
+  }
+}
+
+/**
+ * @brief Interact a pair of cells of a gravity tree walk if we can, or tell
+ * which one to split.
+ *
+ * If using periodic BCs, the pair is dropped if the distance between the
  * cells is larger than the set threshold.
  *
  * @param r The #runner.
  * @param ci The first #cell.
  * @param cj The other #cell.
- * @param gettimer Are we timing this ?
+ * @return The #runner_grav_node_action to take next.
  */
-void runner_dopair_recursive_grav(struct runner *r, struct cell *ci,
-                                  struct cell *cj, const int gettimer) {
+static enum runner_grav_node_action runner_dopair_grav_node(struct runner *r,
+                                                            struct cell *ci,
+                                                            struct cell *cj) {
 
   const struct engine *e = r->e;
 
@@ -2095,7 +3676,7 @@ void runner_dopair_recursive_grav(struct runner *r, struct cell *ci,
   /* Anything to do here? */
   if (!((cell_is_active_gravity(ci, e) && ci->nodeID == nodeID) ||
         (cell_is_active_gravity(cj, e) && cj->nodeID == nodeID)))
-    return;
+    return runner_grav_node_done;
 
 #ifdef SWIFT_DEBUG_CHECKS
 
@@ -2117,8 +3698,6 @@ void runner_dopair_recursive_grav(struct runner *r, struct cell *ci,
     error("cj->grav.multipole not drifted.");
 #endif
 
-  TIMER_TIC;
-
   /* Recover the multipole information */
   struct gravity_tensors *const multi_i = ci->grav.multipole;
   struct gravity_tensors *const multi_j = cj->grav.multipole;
@@ -2160,7 +3739,7 @@ void runner_dopair_recursive_grav(struct runner *r, struct cell *ci,
       accumulate_add_ll(&multi_j->pot.num_interacted_pm,
                         multi_i->m_pole.num_gpart);
 #endif
-    return;
+    return runner_grav_node_done;
   }
 
   /* OK, we actually need to compute this pair. Let's find the cheapest
@@ -2171,6 +3750,7 @@ void runner_dopair_recursive_grav(struct runner *r, struct cell *ci,
     /* We have two cheap cells. Go P-P. */
     runner_dopair_grav_pp_no_cache(r, ci, cj);
     runner_dopair_grav_pp_no_cache(r, cj, ci);
+    return runner_grav_node_done;
 
     /* Can we use M-M interactions ? */
   } else if (gravity_M2L_accept_symmetric(e->gravity_properties, multi_i,
@@ -2179,80 +3759,190 @@ void runner_dopair_recursive_grav(struct runner *r, struct cell *ci,
 
     /* Go M-M */
     runner_dopair_grav_mm(r, ci, cj);
+    return runner_grav_node_done;
 
     /* Did we reach the bottom? */
   } else if (!ci->split && !cj->split) {
 
     /* We have two leaves. Go P-P. */
     runner_dopair_grav_pp(r, ci, cj, /*symmetric*/ 1, /*allow_mpoles=*/1);
+    return runner_grav_node_done;
+  }
 
-  } else {
-
-    /* Alright, we'll have to split and recurse. */
-    /* We know at least one of ci and cj is splittable */
-
-    const double ri_max = multi_i->r_max;
-    const double rj_max = multi_j->r_max;
-
-    /* Split the larger of the two cells and start over again */
-    if (ri_max > rj_max) {
-
-      /* Can we actually split that interaction ? */
-      if (ci->split) {
-
-        /* Loop over ci's children */
-        for (int k = 0; k < 8; k++) {
-          if (ci->progeny[k] != NULL)
-            runner_dopair_recursive_grav(r, ci->progeny[k], cj, 0);
-        }
-
-      } else {
-        /* cj is split */
+  /* Alright, we'll have to split and recurse. */
+  /* We know at least one of ci and cj is splittable */
 
-        /* MATTHIEU: This could maybe be replaced by P-M interactions ?  */
+  /* Split the larger of the two cells and start over again. If that one
+   * cannot be split, split the other one. */
 
-        /* Loop over cj's children */
-        for (int k = 0; k < 8; k++) {
-          if (cj->progeny[k] != NULL)
-            runner_dopair_recursive_grav(r, ci, cj->progeny[k], 0);
-        }
-      }
-    } else {
+  /* MATTHIEU: This could maybe be replaced by P-M interactions ?  */
+  if (multi_i->r_max > multi_j->r_max)
+    return ci->split ? runner_grav_node_split_i : runner_grav_node_split_j;
+  else
+    return cj->split ? runner_grav_node_split_j : runner_grav_node_split_i;
+}
 
-      /* Can we actually split that interaction ? */
-      if (cj->split) {
+/**
+ * @brief A pair of cells waiting in a breadth-first gravity tree walk.
+ */
+struct runner_grav_node_pair {
+  struct cell *ci, *cj;
+};
 
-        /* Loop over cj's children */
-        for (int k = 0; k < 8; k++) {
-          if (cj->progeny[k] != NULL)
-            runner_dopair_recursive_grav(r, ci, cj->progeny[k], 0);
-        }
+/**
+ * @brief Add a pair of cells to a level of a breadth-first gravity tree
+ * walk, asking for their multipoles on the way.
+ *
+ * @param level (return) The pairs of the level.
+ * @param count (return) The number of pairs of the level.
+ * @param size (return) The number of pairs the level has room for.
+ * @param ci The first #cell.
+ * @param cj The other #cell.
+ */
+static INLINE void runner_grav_node_push(struct runner_grav_node_pair **level,
+                                         int *count, int *size,
+                                         struct cell *ci, struct cell *cj) {
+
+  /* Grow the level if need be */
+  if (*count == *size) {
+    *size = *size > 0 ? 2 * *size : 64;
+    struct runner_grav_node_pair *pairs =
+        (struct runner_grav_node_pair *)realloc(
+            *level, *size * sizeof(struct runner_grav_node_pair));
+    if (pairs == NULL) error("Failed to allocate a gravity walk level.");
+    *level = pairs;
+  }
 
-      } else {
-        /* ci is split */
+  __builtin_prefetch(&ci->grav.multipole->CoM);
+  __builtin_prefetch(&cj->grav.multipole->CoM);
 
-        /* MATTHIEU: This could maybe be replaced by P-M interactions ?  */
+  (*level)[*count].ci = ci;
+  (*level)[*count].cj = cj;
+  (*count)++;
+}
 
-        /* Loop over ci's children */
-        for (int k = 0; k < 8; k++) {
-          if (ci->progeny[k] != NULL)
-            runner_dopair_recursive_grav(r, ci->progeny[k], cj, 0);
-        }
+/**
+ * @brief Computes the interaction of all the particles in a cell with all the
+ * particles of another cell one level of the trees at a time.
+ *
+ * This makes the same decisions as runner_dopair_recursive_grav() but all
+ * the pairs of a level are collected, and their multipoles prefetched,
+ * before any of them is looked at.
+ *
+ * @param r The #runner.
+ * @param ci The first #cell.
+ * @param cj The other #cell.
+ */
+static void runner_dopair_breadth_first_grav(struct runner *r, struct cell *ci,
+                                             struct cell *cj) {
+
+  struct runner_grav_node_pair *level = NULL, *next = NULL;
+  int count = 0, size = 0, next_count = 0, next_size = 0;
+
+  runner_grav_node_push(&level, &count, &size, ci, cj);
+
+  while (count > 0) {
+
+    next_count = 0;
+    for (int n = 0; n < count; n++) {
+      struct cell *pi = level[n].ci;
+      struct cell *pj = level[n].cj;
+
+      switch (runner_dopair_grav_node(r, pi, pj)) {
+        case runner_grav_node_split_i:
+          for (int k = 0; k < 8; k++)
+            if (pi->progeny[k] != NULL)
+              runner_grav_node_push(&next, &next_count, &next_size,
+                                    pi->progeny[k], pj);
+          break;
+        case runner_grav_node_split_j:
+          for (int k = 0; k < 8; k++)
+            if (pj->progeny[k] != NULL)
+              runner_grav_node_push(&next, &next_count, &next_size, pi,
+                                    pj->progeny[k]);
+          break;
+        default:
+          break;
       }
     }
+
+    /* Move on to the next level */
+    struct runner_grav_node_pair *tmp = level;
+    level = next;
+    next = tmp;
+    const int tmp_size = size;
+    size = next_size;
+    next_size = tmp_size;
+    count = next_count;
   }
 
-  if (gettimer) TIMER_TOC(timer_dosub_pair_grav);
+  free(level);
+  free(next);
 }
 
 /**
- * @brief Computes the interaction of all the particles in a cell.
+ * @brief Computes the interaction of all the particles in a cell with all the
+ * particles of another cell.
  *
  * This function will try to recurse as far down the tree as possible and only
  * default to direct summation if there is no better option.
  *
+ * If using periodic BCs, we will abort the recursion if th distance between the
+ * cells is larger than the set threshold.
+ *
  * @param r The #runner.
- * @param c The first #cell.
+ * @param ci The first #cell.
+ * @param cj The other #cell.
+ * @param gettimer Are we timing this ?
+ */
+void runner_dopair_recursive_grav(struct runner *r, struct cell *ci,
+                                  struct cell *cj, const int gettimer) {
+
+  TIMER_TIC;
+
+  /* Walk the rest of the trees level by level? */
+  if (r->e->gravity_properties->use_breadth_first_walk) {
+    runner_dopair_breadth_first_grav(r, ci, cj);
+    if (gettimer) TIMER_TOC(timer_dosub_pair_grav);
+    return;
+  }
+
+  switch (runner_dopair_grav_node(r, ci, cj)) {
+    case runner_grav_node_split_i:
+
+      /* Loop over ci's children */
+      runner_grav_prefetch_progeny(ci);
+      for (int k = 0; k < 8; k++) {
+        if (ci->progeny[k] != NULL)
+          runner_dopair_recursive_grav(r, ci->progeny[k], cj, 0);
+      }
+      break;
+
+    case runner_grav_node_split_j:
+
+      /* Loop over cj's children */
+      runner_grav_prefetch_progeny(cj);
+      for (int k = 0; k < 8; k++) {
+        if (cj->progeny[k] != NULL)
+          runner_dopair_recursive_grav(r, ci, cj->progeny[k], 0);
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  if (gettimer) TIMER_TOC(timer_dosub_pair_grav);
+}
+
+/**
+ * @brief Computes the interaction of all the particles in a cell.
+ *
+ * This function will try to recurse as far down the tree as possible and only
+ * default to direct summation if there is no better option.
+ *
+ * @param r The #runner.
+ * @param c The first #cell.
  * @param gettimer Are we timing this ?
  */
 void runner_doself_recursive_grav(struct runner *r, struct cell *c,
@@ -2278,6 +3968,8 @@ void runner_doself_recursive_grav(struct runner *r, struct cell *c,
      each of its siblings. */
   if (c->split) {
 
+    runner_grav_prefetch_progeny(c);
+
     for (int j = 0; j < 8; j++) {
       if (c->progeny[j] != NULL) {
 
@@ -2302,6 +3994,966 @@ void runner_doself_recursive_grav(struct runner *r, struct cell *c,
   if (gettimer) TIMER_TOC(timer_dosub_self_grav);
 }
 
+/**
+ * @brief The interaction list of a leaf built by the group tree walk.
+ */
+struct runner_grav_group_list {
+
+  /*! The cells whose multipole acts on all the #gpart of the leaf (M2P) */
+  struct cell **m2p;
+
+  /*! The leaves interacting directly with the #gpart of the leaf (P2P) */
+  struct cell **p2p;
+
+  /*! Number of cells in the lists */
+  int m2p_count, p2p_count;
+
+  /*! Number of cells the lists have room for */
+  int m2p_size, p2p_size;
+
+  /*! Does the leaf interact with itself? */
+  int self;
+
+  /*! Smallest acceleration of the last step of the active #gpart of the
+   * leaf */
+  float min_a_grav;
+
+  /*! Largest softening of the active #gpart of the leaf */
+  float max_softening;
+};
+
+/**
+ * @brief Add a #cell to one of the lists of a #runner_grav_group_list.
+ *
+ * @param cells (return) The list.
+ * @param count (return) The number of cells in the list.
+ * @param size (return) The number of cells the list has room for.
+ * @param c The #cell to add.
+ */
+static void runner_grav_group_add(struct cell ***cells, int *count, int *size,
+                                  struct cell *c) {
+
+  /* Grow the list if need be */
+  if (*count == *size) {
+    *size = *size > 0 ? 2 * *size : 64;
+    struct cell **new_cells =
+        (struct cell **)realloc(*cells, *size * sizeof(struct cell *));
+    if (new_cells == NULL) error("Failed to allocate a gravity group list.");
+    *cells = new_cells;
+  }
+
+  (*cells)[(*count)++] = c;
+}
+
+/**
+ * @brief Is a #cell one of the ancestors of another one (or the cell itself)?
+ *
+ * @param c The potential ancestor.
+ * @param leaf The other #cell.
+ */
+static INLINE int runner_grav_group_contains(const struct cell *c,
+                                             const struct cell *leaf) {
+
+  for (const struct cell *p = leaf; p != NULL; p = p->parent)
+    if (p == c) return 1;
+  return 0;
+}
+
+/**
+ * @brief Can the multipole of a #cell be used for all the active #gpart of
+ * a leaf?
+ *
+ * The M2P criterion is evaluated for the worst particle the leaf could
+ * hold: as close to the multipole as its size allows, with the largest
+ * softening and the smallest acceleration of its active particles. All the
+ * criteria are monotonic in these, so this implies gravity_M2P_accept() for
+ * every active particle of the leaf.
+ *
+ * @param props The properties of the gravity scheme.
+ * @param list The #runner_grav_group_list of the leaf.
+ * @param multi_l The multipole of the leaf.
+ * @param multi_c The multipole of the source #cell.
+ * @param r The distance between the centres of mass.
+ * @param periodic Are we using periodic BCs?
+ */
+static INLINE int runner_grav_group_accept(
+    const struct gravity_props *props,
+    const struct runner_grav_group_list *list,
+    const struct gravity_tensors *multi_l,
+    const struct gravity_tensors *multi_c, const double r,
+    const int periodic) {
+
+  const double r_min = r - multi_l->r_max;
+  if (r_min <= 0.) return 0;
+
+  return gravity_M2P_accept_values(props, list->max_softening,
+                                   list->min_a_grav, multi_c,
+                                   (float)(r_min * r_min), periodic);
+}
+
+/**
+ * @brief Build the interaction list of a leaf with a tree in a single
+ * top-down walk.
+ *
+ * The cells whose multipole is accepted for the whole leaf go to the M2P
+ * list, the leaves that are too close to the P2P list. Pairs involving a
+ * single #gpart are done straight away without a cache.
+ *
+ * @param r The #runner.
+ * @param leaf The active leaf.
+ * @param c The #cell of the tree we are walking.
+ * @param list (return) The #runner_grav_group_list of the leaf.
+ */
+static void runner_grav_group_walk(struct runner *r, struct cell *leaf,
+                                   struct cell *c,
+                                   struct runner_grav_group_list *list) {
+
+  const struct engine *e = r->e;
+  const int periodic = e->mesh->periodic;
+
+  if (c->grav.count == 0) return;
+
+  /* The cells holding the leaf can only be opened */
+  if (runner_grav_group_contains(c, leaf)) {
+    if (c == leaf) {
+      list->self = 1;
+    } else {
+      for (int k = 0; k < 8; k++)
+        if (c->progeny[k] != NULL)
+          runner_grav_group_walk(r, leaf, c->progeny[k], list);
+    }
+    return;
+  }
+
+  const struct gravity_tensors *multi_l = leaf->grav.multipole;
+  struct gravity_tensors *multi_c = c->grav.multipole;
+
+  /* Do we need drifting first? */
+  if (c->grav.ti_old_multipole < e->ti_current) cell_drift_multipole(c, e);
+
+  /* Get the distance between the CoMs */
+  double dx = multi_l->CoM[0] - multi_c->CoM[0];
+  double dy = multi_l->CoM[1] - multi_c->CoM[1];
+  double dz = multi_l->CoM[2] - multi_c->CoM[2];
+
+  /* Apply BC */
+  if (periodic) {
+    dx = nearest(dx, e->mesh->dim[0]);
+    dy = nearest(dy, e->mesh->dim[1]);
+    dz = nearest(dz, e->mesh->dim[2]);
+  }
+  const double dist = sqrt(dx * dx + dy * dy + dz * dz);
+
+  /* Are we beyond the distance where the truncated forces are 0? */
+  if (periodic &&
+      dist - (multi_l->r_max + multi_c->r_max) > e->mesh->r_cut_max) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+    accumulate_add_ll(&leaf->grav.multipole->pot.num_interacted,
+                      multi_c->m_pole.num_gpart);
+#endif
+#ifdef SWIFT_GRAVITY_FORCE_CHECKS
+    /* Need to account for the interactions we missed */
+    accumulate_add_ll(&leaf->grav.multipole->pot.num_interacted_pm,
+                      multi_c->m_pole.num_gpart);
+#endif
+    return;
+  }
+
+  if (leaf->grav.count <= 1 || c->grav.count <= 1) {
+
+    /* Cheap enough to go P-P without caches */
+    runner_dopair_grav_pp_no_cache(r, leaf, c);
+
+  } else if (runner_grav_group_accept(e->gravity_properties, list, multi_l,
+                                      multi_c, dist, periodic)) {
+
+    runner_grav_group_add(&list->m2p, &list->m2p_count, &list->m2p_size, c);
+
+  } else if (!c->split) {
+
+    runner_grav_group_add(&list->p2p, &list->p2p_count, &list->p2p_size, c);
+
+  } else {
+
+    for (int k = 0; k < 8; k++)
+      if (c->progeny[k] != NULL)
+        runner_grav_group_walk(r, leaf, c->progeny[k], list);
+  }
+}
+
+/**
+ * @brief Compute the gravity of a tree on an active leaf from its
+ * interaction list.
+ *
+ * The list is built by one walk of the tree with the leaf as a whole. The
+ * M2P interactions are then all evaluated from a single cache of the leaf
+ * and the P2P ones go through runner_dopair_grav_pp(), which batches them
+ * for the GPU when it is in use.
+ *
+ * @param r The #runner.
+ * @param leaf The active local leaf.
+ * @param c The root of the tree acting on it.
+ * @param list The (empty) #runner_grav_group_list to use.
+ */
+static void runner_grav_group_leaf(struct runner *r, struct cell *leaf,
+                                   struct cell *c,
+                                   struct runner_grav_group_list *list) {
+
+  const struct engine *e = r->e;
+  const int periodic = e->mesh->periodic;
+  const float dim[3] = {(float)e->mesh->dim[0], (float)e->mesh->dim[1],
+                        (float)e->mesh->dim[2]};
+  const float r_s_inv = e->mesh->r_s_inv;
+
+  /* Properties of the active particles entering the MAC */
+  list->min_a_grav = FLT_MAX;
+  list->max_softening = 0.f;
+  for (int k = 0; k < leaf->grav.count; k++) {
+    const struct gpart *gp = &leaf->grav.parts[k];
+    if (!gpart_is_active(gp, e)) continue;
+    list->min_a_grav = min(list->min_a_grav, gp->old_a_grav_norm);
+    list->max_softening =
+        max(list->max_softening,
+            gravity_get_softening(gp, e->gravity_properties));
+  }
+
+  list->m2p_count = 0;
+  list->p2p_count = 0;
+  list->self = 0;
+  runner_grav_group_walk(r, leaf, c, list);
+
+  /* All the multipoles in one go */
+  if (list->m2p_count > 0) {
+
+    struct gravity_cache *const ci_cache = &r->ci_gravity_cache;
+    const int gcount = leaf->grav.count;
+    const int gcount_padded = gcount - (gcount % VEC_SIZE) + VEC_SIZE;
+
+    const struct cell *first = list->m2p[0];
+    const float CoM_first[3] = {(float)(first->grav.multipole->CoM[0]),
+                                (float)(first->grav.multipole->CoM[1]),
+                                (float)(first->grav.multipole->CoM[2])};
+    gravity_cache_populate_all_mpole(
+        e->max_active_bin, periodic, dim, ci_cache, leaf->grav.parts, gcount,
+        gcount_padded, leaf, CoM_first, first->grav.multipole,
+        e->gravity_properties);
+
+    for (int k = 0; k < list->m2p_count; k++) {
+      const struct cell *cj = list->m2p[k];
+      const struct multipole *multi_j = &cj->grav.multipole->m_pole;
+      const float CoM_j[3] = {(float)(cj->grav.multipole->CoM[0]),
+                              (float)(cj->grav.multipole->CoM[1]),
+                              (float)(cj->grav.multipole->CoM[2])};
+
+      if (!periodic) {
+        runner_dopair_grav_pm_full(ci_cache, gcount_padded, CoM_j, multi_j,
+                                   periodic, dim, e, leaf->grav.parts, gcount,
+                                   cj);
+      } else {
+        runner_dopair_grav_pm_truncated(ci_cache, gcount_padded, CoM_j,
+                                        multi_j, /*periodic=*/1, dim, r_s_inv,
+                                        e, leaf->grav.parts, gcount, cj);
+      }
+    }
+
+    /* Write back to the particles */
+#ifndef SWIFT_TASKS_WITHOUT_ATOMICS
+    lock_lock(&leaf->grav.plock);
+#endif
+    gravity_cache_write_back(ci_cache, leaf->grav.parts, gcount);
+#ifndef SWIFT_TASKS_WITHOUT_ATOMICS
+    if (lock_unlock(&leaf->grav.plock) != 0) error("Error unlocking cell");
+#endif
+  }
+
+  /* And the leaves one after the other */
+  for (int k = 0; k < list->p2p_count; k++)
+    runner_dopair_grav_pp(r, leaf, list->p2p[k], /*symmetric=*/0,
+                          /*allow_mpole=*/1);
+
+  if (list->self) runner_doself_grav_pp(r, leaf);
+}
+
+/**
+ * @brief Walk a tree once for each of the active local leaves of another
+ * one (or of itself).
+ *
+ * @param r The #runner.
+ * @param ci The #cell whose leaves we are looking for.
+ * @param cj The root of the tree acting on them.
+ * @param list The #runner_grav_group_list to use.
+ */
+static void runner_grav_group_recurse(struct runner *r, struct cell *ci,
+                                      struct cell *cj,
+                                      struct runner_grav_group_list *list) {
+
+  const struct engine *e = r->e;
+
+  if (ci->grav.count == 0) return;
+  if (!cell_is_active_gravity(ci, e) || ci->nodeID != e->nodeID) return;
+
+  if (ci->split) {
+    for (int k = 0; k < 8; k++)
+      if (ci->progeny[k] != NULL)
+        runner_grav_group_recurse(r, ci->progeny[k], cj, list);
+  } else {
+    runner_grav_group_leaf(r, ci, cj, list);
+  }
+}
+
+/**
+ * @brief Computes the interaction of all the particles in a cell with a
+ * group walk: each active leaf gets its own interaction list from a single
+ * walk of the tree.
+ *
+ * Unlike runner_doself_recursive_grav(), no M-M interaction is done, the
+ * cells accepted for a leaf act on its particles directly.
+ *
+ * @param r The #runner.
+ * @param c The #cell.
+ */
+static void runner_doself_grav_group(struct runner *r, struct cell *c) {
+
+  const struct engine *e = r->e;
+
+  /* Clear the flags */
+  runner_clear_grav_flags(c, e);
+
+#ifdef SWIFT_DEBUG_CHECKS
+  /* Early abort? */
+  if (c->grav.count == 0) error("Doing self gravity on an empty cell !");
+#endif
+
+  TIMER_TIC;
+
+  struct runner_grav_group_list list;
+  bzero(&list, sizeof(struct runner_grav_group_list));
+
+  runner_grav_group_recurse(r, c, c, &list);
+
+  free(list.m2p);
+  free(list.p2p);
+
+  TIMER_TOC(timer_dosub_self_grav);
+}
+
+/**
+ * @brief Computes the interaction of all the particles in a cell with all
+ * the particles of another cell with a group walk (see
+ * runner_doself_grav_group()).
+ *
+ * @param r The #runner.
+ * @param ci The first #cell.
+ * @param cj The other #cell.
+ */
+static void runner_dopair_grav_group(struct runner *r, struct cell *ci,
+                                     struct cell *cj) {
+
+  const struct engine *e = r->e;
+
+  /* Clear the flags */
+  runner_clear_grav_flags(ci, e);
+  runner_clear_grav_flags(cj, e);
+
+#ifdef SWIFT_DEBUG_CHECKS
+  /* Early abort? */
+  if (ci->grav.count == 0 || cj->grav.count == 0)
+    error("Doing pair gravity on an empty cell !");
+
+  /* Sanity check */
+  if (ci == cj) error("Pair interaction between a cell and itself.");
+#endif
+
+  TIMER_TIC;
+
+  struct runner_grav_group_list list;
+  bzero(&list, sizeof(struct runner_grav_group_list));
+
+  runner_grav_group_recurse(r, ci, cj, &list);
+  runner_grav_group_recurse(r, cj, ci, &list);
+
+  free(list.m2p);
+  free(list.p2p);
+
+  TIMER_TOC(timer_dosub_pair_grav);
+}
+
+/**
+ * @brief Add a node to a recorded gravity tree walk.
+ *
+ * @param w The #task_grav_walk.
+ * @param ci The first #cell of the node.
+ * @param cj The second #cell of the node (NULL for self nodes).
+ * @param type The #task_grav_walk_types of the node.
+ * @param ti_record The oldest drift time of the multipoles of the cells.
+ * @return The index of the new node.
+ */
+static int runner_grav_walk_add(struct task_grav_walk *w, struct cell *ci,
+                                struct cell *cj, const int type,
+                                const integertime_t ti_record) {
+
+  /* Grow the list if need be */
+  if (w->count == w->size) {
+    w->size = w->size > 0 ? 2 * w->size : 64;
+    struct task_grav_walk_node *nodes = (struct task_grav_walk_node *)realloc(
+        w->nodes, w->size * sizeof(struct task_grav_walk_node));
+    if (nodes == NULL) error("Failed to allocate a recorded gravity walk.");
+    w->nodes = nodes;
+  }
+
+  const int id = w->count++;
+  w->nodes[id].ci = ci;
+  w->nodes[id].cj = cj;
+  w->nodes[id].ti_record = ti_record;
+  w->nodes[id].type = type;
+  w->nodes[id].next = w->count;
+  return id;
+}
+
+/**
+ * @brief Account for the interactions of a pair of cells beyond the
+ * truncation distance in the debugging counters.
+ *
+ * @param e The #engine.
+ * @param ci The first #cell.
+ * @param cj The other #cell.
+ */
+static INLINE void runner_dopair_grav_walk_cut(const struct engine *e,
+                                               struct cell *ci,
+                                               struct cell *cj) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (cell_is_active_gravity(ci, e))
+    accumulate_add_ll(&ci->grav.multipole->pot.num_interacted,
+                      cj->grav.multipole->m_pole.num_gpart);
+  if (cell_is_active_gravity(cj, e))
+    accumulate_add_ll(&cj->grav.multipole->pot.num_interacted,
+                      ci->grav.multipole->m_pole.num_gpart);
+#endif
+
+#ifdef SWIFT_GRAVITY_FORCE_CHECKS
+  /* Need to account for the interactions we missed */
+  if (cell_is_active_gravity(ci, e))
+    accumulate_add_ll(&ci->grav.multipole->pot.num_interacted_pm,
+                      cj->grav.multipole->m_pole.num_gpart);
+  if (cell_is_active_gravity(cj, e))
+    accumulate_add_ll(&cj->grav.multipole->pot.num_interacted_pm,
+                      ci->grav.multipole->m_pole.num_gpart);
+#endif
+}
+
+/**
+ * @brief Would the MAC still give the same answer for a pair of multipoles
+ * after each of them drifted by up to a given distance?
+ *
+ * The centres of mass can get 2 * delta closer or further apart and the
+ * sizes can grow by delta. Both the geometric and the Gadget MACs are
+ * monotonic in these, so testing the worst case is enough.
+ *
+ * @param props The properties of the gravity scheme.
+ * @param multi_i The first set of multipole and gravity tensors.
+ * @param multi_j The second set of multipole and gravity tensors.
+ * @param r The distance between the centres of mass.
+ * @param delta The maximal displacement of the multipoles.
+ * @param accepted What the MAC says now.
+ * @param periodic Are we using periodic BCs?
+ */
+static int runner_grav_walk_MAC_is_robust(
+    const struct gravity_props *props,
+    const struct gravity_tensors *multi_i,
+    const struct gravity_tensors *multi_j, const double r, const float delta,
+    const int accepted, const int periodic) {
+
+  if (!accepted) {
+
+    /* Rejected with the current sizes, rejected with any larger one */
+    const double r_far = r + 2. * delta;
+    return !gravity_M2L_accept_symmetric(props, multi_i, multi_j,
+                                         r_far * r_far,
+                                         /* use_rebuild_sizes=*/0, periodic);
+  }
+
+  /* Accepted even with the multipoles grown and closer? */
+  if (r <= 2. * delta) return 0;
+  struct gravity_tensors grown_i = *multi_i;
+  struct gravity_tensors grown_j = *multi_j;
+  grown_i.r_max += delta;
+  grown_j.r_max += delta;
+  const double r_near = r - 2. * delta;
+  return gravity_M2L_accept_symmetric(props, &grown_i, &grown_j,
+                                      r_near * r_near,
+                                      /* use_rebuild_sizes=*/0, periodic);
+}
+
+/**
+ * @brief Walks the tree for a pair of cells as runner_dopair_recursive_grav()
+ * would, recording the decisions taken on the way.
+ *
+ * The whole tree below the pair is recorded, whether active or not, such
+ * that the walk can be replayed at any later step. The interactions are
+ * only computed where runner_dopair_recursive_grav() would compute them.
+ *
+ * @param r The #runner.
+ * @param w The #task_grav_walk to record into.
+ * @param ci The first #cell.
+ * @param cj The other #cell.
+ * @param do_work Are we computing the interactions below this pair?
+ */
+static void runner_dopair_grav_walk_record(struct runner *r,
+                                           struct task_grav_walk *w,
+                                           struct cell *ci, struct cell *cj,
+                                           const int do_work) {
+
+  const struct engine *e = r->e;
+  const struct gravity_props *props = e->gravity_properties;
+
+  /* Some constants */
+  const int nodeID = e->nodeID;
+  const int periodic = e->mesh->periodic;
+  const double dim[3] = {e->mesh->dim[0], e->mesh->dim[1], e->mesh->dim[2]};
+  const double max_distance = e->mesh->r_cut_max;
+  const float delta = w->margin;
+
+  /* Clear the flags */
+  if (do_work) {
+    runner_clear_grav_flags(ci, e);
+    runner_clear_grav_flags(cj, e);
+  }
+
+  /* Anything to do here? */
+  const int active =
+      do_work && ((cell_is_active_gravity(ci, e) && ci->nodeID == nodeID) ||
+                  (cell_is_active_gravity(cj, e) && cj->nodeID == nodeID));
+
+  /* Recover the multipole information */
+  struct gravity_tensors *const multi_i = ci->grav.multipole;
+  struct gravity_tensors *const multi_j = cj->grav.multipole;
+
+  /* Get the distance between the CoMs */
+  double dx = multi_i->CoM[0] - multi_j->CoM[0];
+  double dy = multi_i->CoM[1] - multi_j->CoM[1];
+  double dz = multi_i->CoM[2] - multi_j->CoM[2];
+
+  /* Apply BC */
+  if (periodic) {
+    dx = nearest(dx, dim[0]);
+    dy = nearest(dy, dim[1]);
+    dz = nearest(dz, dim[2]);
+  }
+  const double r2 = dx * dx + dy * dy + dz * dz;
+  const double dist = sqrt(r2);
+  const double ri_max = multi_i->r_max;
+  const double rj_max = multi_j->r_max;
+
+  /* Minimal distance between any 2 particles in the two cells */
+  const double r_lr_check = dist - (ri_max + rj_max);
+
+  const integertime_t ti_record =
+      min(ci->grav.ti_old_multipole, cj->grav.ti_old_multipole);
+  const int id = runner_grav_walk_add(w, ci, cj, task_grav_walk_pair_recheck,
+                                      ti_record);
+
+  /* Are we beyond the distance where the truncated forces are 0? */
+  if (periodic && r_lr_check > max_distance) {
+
+    /* Still beyond it with the cells grown and closer? */
+    if (r_lr_check - 4. * delta > max_distance) {
+      w->nodes[id].type = task_grav_walk_pair_cut;
+      if (active) runner_dopair_grav_walk_cut(e, ci, cj);
+    } else {
+      if (active) runner_dopair_recursive_grav(r, ci, cj, 0);
+    }
+    return;
+  }
+
+  /* Will it stay within the truncation distance? */
+  const int robust_cut = !periodic || r_lr_check + 2. * delta <= max_distance;
+
+  /* Same decisions as runner_dopair_recursive_grav() */
+  int type;
+  int robust = robust_cut;
+  if (ci->grav.count <= 1 || cj->grav.count <= 1) {
+    type = task_grav_walk_pair_cheap;
+  } else if (gravity_M2L_accept_symmetric(props, multi_i, multi_j, r2,
+                                          /* use_rebuild_sizes=*/0,
+                                          periodic)) {
+    type = task_grav_walk_pair_mm;
+    robust = robust && runner_grav_walk_MAC_is_robust(
+                           props, multi_i, multi_j, dist, delta,
+                           /*accepted=*/1, periodic);
+  } else {
+    robust = robust && runner_grav_walk_MAC_is_robust(
+                           props, multi_i, multi_j, dist, delta,
+                           /*accepted=*/0, periodic);
+    if (!ci->split && !cj->split) {
+      type = task_grav_walk_pair_pp;
+    } else {
+      type = task_grav_walk_pair_split;
+
+      /* Will we still split the same cell? */
+      robust = robust && fabs(ri_max - rj_max) > delta;
+    }
+  }
+
+  /* Leave the fragile ones for the regular walk */
+  if (!robust) {
+    if (active) runner_dopair_recursive_grav(r, ci, cj, 0);
+    return;
+  }
+
+  w->nodes[id].type = type;
+
+  switch (type) {
+    case task_grav_walk_pair_cheap:
+      if (active) {
+        runner_dopair_grav_pp_no_cache(r, ci, cj);
+        runner_dopair_grav_pp_no_cache(r, cj, ci);
+      }
+      break;
+    case task_grav_walk_pair_mm:
+      if (active) runner_dopair_grav_mm(r, ci, cj);
+      break;
+    case task_grav_walk_pair_pp:
+      if (active)
+        runner_dopair_grav_pp(r, ci, cj, /*symmetric*/ 1, /*allow_mpoles=*/1);
+      break;
+    default: {
+
+      /* Split the larger of the two cells */
+      const int split_i = (ri_max > rj_max) ? ci->split : !cj->split;
+      for (int k = 0; k < 8; k++) {
+        if (split_i && ci->progeny[k] != NULL)
+          runner_dopair_grav_walk_record(r, w, ci->progeny[k], cj, active);
+        else if (!split_i && cj->progeny[k] != NULL)
+          runner_dopair_grav_walk_record(r, w, ci, cj->progeny[k], active);
+      }
+      w->nodes[id].next = w->count;
+    }
+  }
+}
+
+/**
+ * @brief Walks the tree of a cell as runner_doself_recursive_grav() would,
+ * recording the decisions taken on the way.
+ *
+ * @param r The #runner.
+ * @param w The #task_grav_walk to record into.
+ * @param c The #cell.
+ * @param do_work Are we computing the interactions below this cell?
+ */
+static void runner_doself_grav_walk_record(struct runner *r,
+                                           struct task_grav_walk *w,
+                                           struct cell *c, const int do_work) {
+
+  const struct engine *e = r->e;
+
+  /* Clear the flags */
+  if (do_work) runner_clear_grav_flags(c, e);
+
+  /* Anything to do here? */
+  const int active = do_work && cell_is_active_gravity(c, e);
+
+  const int id = runner_grav_walk_add(
+      w, c, NULL, c->split ? task_grav_walk_self_split : task_grav_walk_self_pp,
+      e->ti_current);
+
+  if (c->split) {
+
+    for (int j = 0; j < 8; j++) {
+      if (c->progeny[j] != NULL) {
+
+        runner_doself_grav_walk_record(r, w, c->progeny[j], active);
+
+        for (int k = j + 1; k < 8; k++) {
+          if (c->progeny[k] != NULL)
+            runner_dopair_grav_walk_record(r, w, c->progeny[j], c->progeny[k],
+                                           active);
+        }
+      }
+    }
+    w->nodes[id].next = w->count;
+
+  } else if (active) {
+
+    runner_doself_grav_pp(r, c);
+  }
+}
+
+/**
+ * @brief Upper limit of the speed at which the multipoles of a cell and of
+ * all its progenies get displaced or grow.
+ *
+ * @param c The #cell.
+ */
+static INLINE float runner_grav_walk_drift_rate(const struct cell *c) {
+
+  const struct multipole *m = &c->grav.multipole->m_pole;
+
+  /* Bulk motion and spread of the velocities, bounding the progenies' */
+  float bulk2 = 0.f, spread2 = 0.f;
+  for (int k = 0; k < 3; ++k) {
+    const float bulk =
+        max(fabsf(m->max_delta_vel[k]), fabsf(m->min_delta_vel[k]));
+    const float spread = m->max_delta_vel[k] - m->min_delta_vel[k];
+    bulk2 += bulk * bulk;
+    spread2 += spread * spread;
+  }
+  return sqrtf(bulk2) + sqrtf(spread2);
+}
+
+/**
+ * @brief Can a gravity task use a recorded tree walk in this run?
+ *
+ * The replay is only exact when the MAC is monotonic in the distance and
+ * sizes of the multipoles and when the multipoles only change by drifting
+ * between rebuilds.
+ *
+ * @param e The #engine.
+ * @param t The #task.
+ */
+static int runner_grav_walk_is_allowed(const struct engine *e,
+                                       const struct task *t) {
+
+  const struct gravity_props *props = e->gravity_properties;
+
+  if (!props->reuse_tree_walk) return 0;
+  if (e->policy & engine_policy_reconstruct_mpoles) return 0;
+
+  /* Dehnen's MAC is not monotonic in the sizes of the multipoles */
+  if (props->use_advanced_MAC && !props->use_gadget_tolerance) return 0;
+  if (props->use_advanced_MAC && e->mesh->periodic &&
+      props->consider_truncation_in_MAC)
+    return 0;
+
+  /* Foreign multipoles are not drifted here */
+  if (t->ci->nodeID != e->nodeID) return 0;
+  if (t->cj != NULL && t->cj->nodeID != e->nodeID) return 0;
+
+  return 1;
+}
+
+/**
+ * @brief Record the tree walk of a gravity task, computing its interactions
+ * on the way.
+ *
+ * @param r The #runner.
+ * @param t The #task.
+ */
+static void runner_grav_walk_record(struct runner *r, struct task *t) {
+
+  const struct engine *e = r->e;
+
+  if (t->grav_walk == NULL) {
+    t->grav_walk =
+        (struct task_grav_walk *)calloc(1, sizeof(struct task_grav_walk));
+    if (t->grav_walk == NULL)
+      error("Failed to allocate a recorded gravity walk.");
+  }
+  struct task_grav_walk *w = t->grav_walk;
+
+  /* A tenth of the smallest leaf of the task */
+  float min_width = ldexpf(t->ci->width[0], t->ci->depth - t->ci->maxdepth);
+  if (t->cj != NULL)
+    min_width = min(min_width, ldexpf(t->cj->width[0],
+                                      t->cj->depth - t->cj->maxdepth));
+
+  w->count = 0;
+  w->margin = 0.1f * min_width;
+  w->use_advanced_MAC = e->gravity_properties->use_advanced_MAC;
+  w->needs_record = 0;
+
+  if (t->cj == NULL)
+    runner_doself_grav_walk_record(r, w, t->ci, /*do_work=*/1);
+  else
+    runner_dopair_grav_walk_record(r, w, t->ci, t->cj, /*do_work=*/1);
+}
+
+/**
+ * @brief Replay the recorded tree walk of a gravity task.
+ *
+ * Every node is subject to the same activity checks as in the regular walk.
+ * The pair nodes whose multipoles may have drifted by more than the margin
+ * since they were recorded are walked again the regular way. If too many of
+ * them are, the walk will be recorded again at the next run.
+ *
+ * @param r The #runner.
+ * @param t The #task.
+ */
+static void runner_grav_walk_replay(struct runner *r, struct task *t) {
+
+  const struct engine *e = r->e;
+  const int nodeID = e->nodeID;
+  const integertime_t ti_current = e->ti_current;
+  struct task_grav_walk *w = t->grav_walk;
+
+  /* Longest drift time the margin covers */
+  float rate = runner_grav_walk_drift_rate(t->ci);
+  if (t->cj != NULL) rate = max(rate, runner_grav_walk_drift_rate(t->cj));
+  const double dt_max = rate > 0.f ? w->margin / (1.01 * rate) : DBL_MAX;
+
+  /* Is the time of the last node we looked at still covered? */
+  integertime_t ti_last = -1;
+  int last_is_valid = 0;
+
+  int num_pairs = 0, num_stale = 0;
+  int i = 0;
+  while (i < w->count) {
+
+    const struct task_grav_walk_node *n = &w->nodes[i];
+    struct cell *ci = n->ci;
+    struct cell *cj = n->cj;
+
+    /* Self nodes do not depend on the multipoles */
+    if (n->type == task_grav_walk_self_split ||
+        n->type == task_grav_walk_self_pp) {
+
+      runner_clear_grav_flags(ci, e);
+      if (!cell_is_active_gravity(ci, e)) {
+        i = n->next;
+        continue;
+      }
+      if (n->type == task_grav_walk_self_pp) runner_doself_grav_pp(r, ci);
+      i++;
+      continue;
+    }
+
+    /* Clear the flags */
+    runner_clear_grav_flags(ci, e);
+    runner_clear_grav_flags(cj, e);
+
+    /* Anything to do here? */
+    if (!((cell_is_active_gravity(ci, e) && ci->nodeID == nodeID) ||
+          (cell_is_active_gravity(cj, e) && cj->nodeID == nodeID))) {
+      i = n->next;
+      continue;
+    }
+
+    num_pairs++;
+
+    /* Is the recorded decision still valid? */
+    if (n->ti_record != ti_last) {
+      double dt;
+      if (e->policy & engine_policy_cosmology)
+        dt = cosmology_get_drift_factor(e->cosmology, n->ti_record, ti_current);
+      else
+        dt = (ti_current - n->ti_record) * e->time_base;
+      ti_last = n->ti_record;
+      last_is_valid = dt <= dt_max;
+    }
+
+    if (!last_is_valid || n->type == task_grav_walk_pair_recheck) {
+      if (!last_is_valid) num_stale++;
+      runner_dopair_recursive_grav(r, ci, cj, 0);
+      i = n->next;
+      continue;
+    }
+
+    switch (n->type) {
+      case task_grav_walk_pair_cut:
+        runner_dopair_grav_walk_cut(e, ci, cj);
+        break;
+      case task_grav_walk_pair_cheap:
+        runner_dopair_grav_pp_no_cache(r, ci, cj);
+        runner_dopair_grav_pp_no_cache(r, cj, ci);
+        break;
+      case task_grav_walk_pair_mm:
+        runner_dopair_grav_mm(r, ci, cj);
+        break;
+      case task_grav_walk_pair_pp:
+        runner_dopair_grav_pp(r, ci, cj, /*symmetric*/ 1, /*allow_mpoles=*/1);
+        break;
+      default:
+        break;
+    }
+    i++;
+  }
+
+  /* Time to start again? */
+  if (4 * num_stale > num_pairs) w->needs_record = 1;
+}
+
+/**
+ * @brief Runs the tree walk of a gravity task, replaying the one recorded at
+ * an earlier step if possible.
+ *
+ * @param r The #runner.
+ * @param t The self or pair #task.
+ */
+static void runner_grav_walk(struct runner *r, struct task *t) {
+
+  const struct engine *e = r->e;
+  const struct task_grav_walk *w = t->grav_walk;
+
+  if (w == NULL || w->needs_record ||
+      w->use_advanced_MAC != e->gravity_properties->use_advanced_MAC)
+    runner_grav_walk_record(r, t);
+  else
+    runner_grav_walk_replay(r, t);
+}
+
+/**
+ * @brief Computes the interaction of all the particles in the cell of a self
+ * gravity task, re-using the tree walk of an earlier step where possible.
+ *
+ * @param r The #runner.
+ * @param t The #task.
+ */
+void runner_doself_grav_walk(struct runner *r, struct task *t) {
+
+  const struct engine *e = r->e;
+
+  if (e->gravity_properties->use_group_walk) {
+    runner_doself_grav_group(r, t->ci);
+    return;
+  }
+
+  if (!runner_grav_walk_is_allowed(e, t)) {
+    runner_doself_recursive_grav(r, t->ci, 1);
+    return;
+  }
+
+#ifdef SWIFT_DEBUG_CHECKS
+  /* Early abort? */
+  if (t->ci->grav.count == 0) error("Doing self gravity on an empty cell !");
+#endif
+
+  TIMER_TIC;
+
+  runner_grav_walk(r, t);
+
+  TIMER_TOC(timer_dosub_self_grav);
+}
+
+/**
+ * @brief Computes the interaction of all the particles in the cells of a
+ * pair gravity task, re-using the tree walk of an earlier step where
+ * possible.
+ *
+ * @param r The #runner.
+ * @param t The #task.
+ */
+void runner_dopair_grav_walk(struct runner *r, struct task *t) {
+
+  const struct engine *e = r->e;
+
+  if (e->gravity_properties->use_group_walk) {
+    runner_dopair_grav_group(r, t->ci, t->cj);
+    return;
+  }
+
+  if (!runner_grav_walk_is_allowed(e, t)) {
+    runner_dopair_recursive_grav(r, t->ci, t->cj, 1);
+    return;
+  }
+
+  TIMER_TIC;
+
+  runner_grav_walk(r, t);
+
+  TIMER_TOC(timer_dosub_pair_grav);
+}
+
 /**
  * @brief Performs all M-M interactions between a given top-level cell and all
  * the other top-levels that are far enough.
@@ -2310,6 +4962,86 @@ void runner_doself_recursive_grav(struct runner *r, struct cell *c,
  * @param ci The #cell of interest.
  * @param timer Are we timing this ?
  */
+extern int long_range_offload(struct cuda_top_multipoles *t, const int device, const int runner_id, const int top, const double *CoM_i, const struct cuda_mac_props *props, const int periodic, const double *dim, const double *width, const double max_distance2, const float r_s_inv, cudaStream_t stream);
+
+/**
+ * @brief Performs all M-M interactions between a given top-level cell and
+ * all the other top-levels that are far enough, on the GPU.
+ *
+ * All the top-level cells are checked against the MAC and interacted in one
+ * kernel launch. Each block of the kernel returns the sum of its
+ * contributions which are then added to the field tensor.
+ *
+ * @param r The thread #runner.
+ * @param ci The #cell of interest.
+ * @param top The top-level parent of ci.
+ */
+static void runner_do_grav_long_range_gpu(struct runner *r, struct cell *ci,
+                                          const struct cell *top) {
+
+#ifdef WITH_CUDA
+  /* Some constants */
+  const struct engine *e = r->e;
+  const struct space *s = e->s;
+  const struct gravity_props *props = e->gravity_properties;
+  const double dim[3] = {e->mesh->dim[0], e->mesh->dim[1], e->mesh->dim[2]};
+  const double width[3] = {s->width[0], s->width[1], s->width[2]};
+  const double max_distance2 = e->mesh->r_cut_max * e->mesh->r_cut_max;
+  struct cuda_top_multipoles *const t = &gpu_top_multipoles;
+  struct gravity_tensors *const multi_i = ci->grav.multipole;
+
+  /* The first task of the launch on this device sends the multipoles */
+  const int device = cuda_devices_of_runner(r->id);
+  cuda_top_multipoles_refresh(e, device);
+
+  const int top_index = t->index[top - s->cells_top];
+#ifdef SWIFT_DEBUG_CHECKS
+  if (top_index < 0) error("Active cell in an empty top-level cell!");
+#endif
+
+  /* What the MAC needs to know */
+  struct cuda_mac_props mac;
+  mac.theta_crit = props->theta_crit;
+  mac.adaptive_tolerance = props->adaptive_tolerance;
+  mac.r_s_inv = props->r_s_inv;
+  mac.use_advanced_MAC = props->use_advanced_MAC;
+  mac.use_gadget_tolerance = props->use_gadget_tolerance;
+  mac.use_tree_below_softening = props->use_tree_below_softening;
+  mac.consider_truncation_in_MAC = props->consider_truncation_in_MAC;
+
+  const ticks tic = getticks();
+  const int nr_blocks = long_range_offload(
+      t, device, r->id, top_index, multi_i->CoM, &mac, e->mesh->periodic, dim,
+      width, max_distance2, e->mesh->r_s_inv, get_runner_cuda_stream(r->id));
+  cuda_device_load_add(&r->gpu_load, t->count, getticks() - tic);
+
+  /* Add the contributions in a fixed order */
+  struct cuda_long_range_result *res = t->results + r->id * t->max_blocks;
+  for (int k = 0; k < nr_blocks; ++k) {
+
+    if (!res[k].interacted) continue;
+
+#ifdef SWIFT_DEBUG_CHECKS
+    res[k].l.num_interacted = res[k].num_tree + res[k].num_pm;
+#endif
+#ifdef SWIFT_GRAVITY_FORCE_CHECKS
+    res[k].l.num_interacted_tree = res[k].num_tree;
+    res[k].l.num_interacted_pm = res[k].num_pm;
+#endif
+
+#ifndef SWIFT_TASKS_WITHOUT_ATOMICS
+    lock_lock(&ci->grav.mlock);
+#endif
+    gravity_field_tensors_add(&multi_i->pot, &res[k].l);
+#ifndef SWIFT_TASKS_WITHOUT_ATOMICS
+    if (lock_unlock(&ci->grav.mlock) != 0) error("Failed to unlock multipole");
+#endif
+  }
+#else
+  error("SWIFT was not compiled with CUDA support.");
+#endif
+}
+
 void runner_do_grav_long_range(struct runner *r, struct cell *ci,
                                const int timer) {
 
@@ -2342,6 +5074,13 @@ void runner_do_grav_long_range(struct runner *r, struct cell *ci,
   struct cell *top = ci;
   while (top->parent != NULL) top = top->parent;
 
+  /* Walk the whole top-level grid in one go on the GPU? */
+  if (gpu_top_multipoles.active && cell_is_active_gravity_mm(ci, e)) {
+    runner_do_grav_long_range_gpu(r, ci, top);
+    if (timer) TIMER_TOC(timer_dograv_long_range);
+    return;
+  }
+
   /* Loop over all the top-level cells and go for a M-M interaction if
    * well-separated */
   for (int n = 0; n < nr_cells_with_particles; ++n) {
@@ -22,8 +22,15 @@
 
 #include <config.h>
 
+/* System includes. */
+#include <stddef.h>
+
+/* Local includes. */
+#include "cycle.h"
+
 struct runner;
 struct cell;
+struct task;
 
 void runner_do_grav_down(struct runner *r, struct cell *c, int timer);
 
@@ -36,12 +43,31 @@ void runner_doself_recursive_grav(struct runner *r, struct cell *c,
 void runner_dopair_recursive_grav(struct runner *r, struct cell *ci,
                                   struct cell *cj, int gettimer);
 
+void runner_doself_grav_walk(struct runner *r, struct task *t);
+
+void runner_dopair_grav_walk(struct runner *r, struct task *t);
+
+void runner_dopair_grav_mm_flush(struct runner *r);
+
 void runner_dopair_grav_mm_progenies(struct runner *r, const long long flags,
                                      struct cell *restrict ci,
                                      struct cell *restrict cj);
 
 void runner_do_grav_long_range(struct runner *r, struct cell *ci, int timer);
 
+void runner_dopair_grav_pp_flush(struct runner *r);
+
+int runner_dopair_grav_pp_flush_async(struct runner *r, struct task *t);
+
+void runner_dopair_grav_pp_complete(struct runner *r, const int wait);
+
+void runner_dopair_grav_pp_calibrate(struct runner *r);
+
+ticks runner_dopair_grav_pp_benchmark(struct runner *r, const int gcount,
+                                      const int periodic, const int truncated,
+                                      const int on_gpu, const int repeats,
+                                      size_t *h2d_bytes, size_t *d2h_bytes);
+
 /* Internal functions (for unit tests and debugging) */
 
 void runner_doself_grav_pp(struct runner *r, struct cell *c);
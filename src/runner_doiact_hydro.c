@@ -26,6 +26,7 @@
 #include "active.h"
 #include "cell.h"
 #include "chemistry.h"
+#include "cuda_hydro.h"
 #include "engine.h"
 #include "mhd.h"
 #include "pressure_floor_iact.h"
@@ -95,12 +95,33 @@
 #define _DOSUB_SUBSET(f) PASTE(runner_dosub_subset, f)
 #define DOSUB_SUBSET _DOSUB_SUBSET(FUNCTION)
 
+#define _DOSUBSET_NGB_LIST(f) PASTE(runner_dosubset_ngb_list, f)
+#define DOSUBSET_NGB_LIST _DOSUBSET_NGB_LIST(FUNCTION)
+
 #define _IACT_NONSYM(f) PASTE(runner_iact_nonsym, f)
 #define IACT_NONSYM _IACT_NONSYM(FUNCTION)
 
 #define _IACT(f) PASTE(runner_iact, f)
 #define IACT _IACT(FUNCTION)
 
+/* The schemes whose force loop solves Riemann problems queue the interfaces
+ * in a batch, which every interaction function flushes before returning. */
+#if (FUNCTION_TASK_LOOP == TASK_LOOP_FORCE) && defined(HYDRO_FLUX_BATCH)
+#undef IACT_NONSYM
+#undef IACT
+#define IACT_NONSYM(r2, dx, hi, hj, pi, pj, a, H) \
+  runner_iact_nonsym_force_batch(&flux_batch, r2, dx, hi, hj, pi, pj, a, H)
+#define IACT(r2, dx, hi, hj, pi, pj, a, H) \
+  runner_iact_force_batch(&flux_batch, r2, dx, hi, hj, pi, pj, a, H)
+#define FLUX_BATCH_DECLARE            \
+  struct hydro_flux_batch flux_batch; \
+  hydro_flux_batch_init(&flux_batch)
+#define FLUX_BATCH_FLUSH hydro_flux_batch_flush(&flux_batch)
+#else
+#define FLUX_BATCH_DECLARE
+#define FLUX_BATCH_FLUSH (void)0
+#endif
+
 #if ((FUNCTION_TASK_LOOP == TASK_LOOP_DENSITY) ||  \
      (FUNCTION_TASK_LOOP == TASK_LOOP_GRADIENT) || \
      (FUNCTION_TASK_LOOP == TASK_LOOP_FORCE))
@@ -189,3 +210,9 @@ void DOPAIR_SUBSET_BRANCH(struct runner *r, struct cell *restrict ci,
 
 void DOSUB_SUBSET(struct runner *r, struct cell *ci, struct part *parts,
                   int *ind, int count, struct cell *cj, int gettimer);
+
+#if (FUNCTION_TASK_LOOP == TASK_LOOP_DENSITY)
+void DOSUBSET_NGB_LIST(struct runner *r, struct part *restrict parts,
+                       const int *restrict ind, const int count,
+                       const struct hydro_ngb_list *restrict ngbs);
+#endif
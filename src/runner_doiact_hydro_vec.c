@@ -23,9 +23,35 @@
 /* This object's header. */
 #include "runner_doiact_hydro_vec.h"
 
-#if defined(WITH_VECTORIZATION) && defined(GADGET2_SPH)
+/* Local headers. */
+#include "part_soa.h"
+
+#ifdef HYDRO_DENSITY_VEC
 
+#if defined(GADGET2_SPH)
+/* Only the force loop needs it. */
 static const vector kernel_gamma2_vec = FILL_VEC(kernel_gamma2);
+#endif
+
+/* Where the density loop accumulates the velocity divergence. */
+#if defined(SPHENIX_SPH)
+#define hydro_vec_div_v(p) ((p)->viscosity.div_v)
+#else
+#define hydro_vec_div_v(p) ((p)->density.div_v)
+#endif
+
+/**
+ * @brief Is the #part_soa copy of a cell's #part up to date?
+ *
+ * @param e The #engine.
+ * @param c The #cell.
+ */
+static INLINE int runner_part_soa_is_valid(const struct engine *e,
+                                           const struct cell *c) {
+
+  return part_soa.active && c->nodeID == e->nodeID &&
+         c->hydro.ti_soa == e->ti_current;
+}
 
 /**
  * @brief Compute the vector remainder interactions from the secondary cache.
@@ -637,7 +663,7 @@ __attribute__((always_inline)) INLINE static int populate_max_index_subset(
   }
 }
 
-#endif /* WITH_VECTORIZATION && GADGET2_SPH */
+#endif /* HYDRO_DENSITY_VEC */
 
 /**
  * @brief Compute the cell self-interaction (non-symmetric) using vector
@@ -648,7 +674,7 @@ __attribute__((always_inline)) INLINE static int populate_max_index_subset(
  */
 void runner_doself1_density_vec(struct runner *r, struct cell *restrict c) {
 
-#if defined(WITH_VECTORIZATION) && defined(GADGET2_SPH)
+#ifdef HYDRO_DENSITY_VEC
 
   /* Get some local variables */
   const struct engine *e = r->e;
@@ -674,10 +700,15 @@ void runner_doself1_density_vec(struct runner *r, struct cell *restrict c) {
   /* Get the particle cache from the runner and re-allocate
    * the cache if it is not big enough for the cell. */
   struct cache *restrict cell_cache = &r->ci_cache;
-  if (cell_cache->count < count) cache_init(cell_cache, count);
+  cache_ensure(cell_cache, count);
 
-  /* Read the particles from the cell and store them locally in the cache. */
-  const int count_align = cache_read_particles(c, cell_cache);
+  /* Read the particles from the cell and store them locally in the cache,
+   * streaming through the SoA copy if it is up to date. */
+  const int count_align =
+      runner_part_soa_is_valid(e, c)
+          ? cache_read_particles_soa(c, cell_cache, &part_soa,
+                                     parts - e->s->parts)
+          : cache_read_particles(c, cell_cache);
 
   /* Create secondary cache to store particle interactions. */
   struct c2_cache int_cache;
@@ -853,7 +884,7 @@ void runner_doself1_density_vec(struct runner *r, struct cell *restrict c) {
     VEC_HADD(v_rho_dhSum, pi->density.rho_dh);
     VEC_HADD(v_wcountSum, pi->density.wcount);
     VEC_HADD(v_wcount_dhSum, pi->density.wcount_dh);
-    VEC_HADD(v_div_vSum, pi->density.div_v);
+    VEC_HADD(v_div_vSum, hydro_vec_div_v(pi));
     VEC_HADD(v_curlvxSum, pi->density.rot_v[0]);
     VEC_HADD(v_curlvySum, pi->density.rot_v[1]);
     VEC_HADD(v_curlvzSum, pi->density.rot_v[2]);
@@ -868,7 +899,7 @@ void runner_doself1_density_vec(struct runner *r, struct cell *restrict c) {
 
   error("Incorrectly calling vectorized Gadget-2 functions!");
 
-#endif /* WITH_VECTORIZATION */
+#endif /* HYDRO_DENSITY_VEC */
 }
 
 /**
@@ -885,7 +916,7 @@ void runner_doself_subset_density_vec(struct runner *r, struct cell *restrict c,
                                       struct part *restrict parts,
                                       int *restrict ind, int pi_count) {
 
-#if defined(WITH_VECTORIZATION) && defined(GADGET2_SPH)
+#ifdef HYDRO_DENSITY_VEC
 
   const int count = c->hydro.count;
 
@@ -895,7 +926,7 @@ void runner_doself_subset_density_vec(struct runner *r, struct cell *restrict c,
    * the cache if it is not big enough for the cell. */
   struct cache *restrict cell_cache = &r->ci_cache;
 
-  if (cell_cache->count < count) cache_init(cell_cache, count);
+  cache_ensure(cell_cache, count);
 
   /* Read the particles from the cell and store them locally in the cache. */
   const int count_align = cache_read_particles_subset_self(c, cell_cache);
@@ -1087,7 +1118,7 @@ void runner_doself_subset_density_vec(struct runner *r, struct cell *restrict c,
     VEC_HADD(v_rho_dhSum, pi->density.rho_dh);
     VEC_HADD(v_wcountSum, pi->density.wcount);
     VEC_HADD(v_wcount_dhSum, pi->density.wcount_dh);
-    VEC_HADD(v_div_vSum, pi->density.div_v);
+    VEC_HADD(v_div_vSum, hydro_vec_div_v(pi));
     VEC_HADD(v_curlvxSum, pi->density.rot_v[0]);
     VEC_HADD(v_curlvySum, pi->density.rot_v[1]);
     VEC_HADD(v_curlvzSum, pi->density.rot_v[2]);
@@ -1102,7 +1133,7 @@ void runner_doself_subset_density_vec(struct runner *r, struct cell *restrict c,
 
   error("Incorrectly calling vectorized Gadget-2 functions!");
 
-#endif /* WITH_VECTORIZATION */
+#endif /* HYDRO_DENSITY_VEC */
 }
 
 /**
@@ -1140,7 +1171,7 @@ void runner_doself2_force_vec(struct runner *r, struct cell *restrict c) {
    * the cache if it is not big enough for the cell. */
   struct cache *restrict cell_cache = &r->ci_cache;
 
-  if (cell_cache->count < count) cache_init(cell_cache, count);
+  cache_ensure(cell_cache, count);
 
   /* Read the particles from the cell and store them locally in the cache. */
   const int count_align = cache_read_force_particles(c, cell_cache);
@@ -1306,7 +1337,7 @@ void runner_dopair1_density_vec(struct runner *r, struct cell *ci,
                                 struct cell *cj, const int sid,
                                 const double *shift) {
 
-#if defined(WITH_VECTORIZATION) && defined(GADGET2_SPH)
+#ifdef HYDRO_DENSITY_VEC
 
   const struct engine *restrict e = r->e;
   const timebin_t max_active_bin = e->max_active_bin;
@@ -1382,8 +1413,8 @@ void runner_dopair1_density_vec(struct runner *r, struct cell *ci,
    * them if they are not big enough for the cells. */
   struct cache *restrict ci_cache = &r->ci_cache;
   struct cache *restrict cj_cache = &r->cj_cache;
-  if (ci_cache->count < count_i) cache_init(ci_cache, count_i);
-  if (cj_cache->count < count_j) cache_init(cj_cache, count_j);
+  cache_ensure(ci_cache, count_i);
+  cache_ensure(cj_cache, count_j);
 
   /* Get a direct pointer to the index arrays */
   int first_pi, last_pj;
@@ -1409,9 +1440,15 @@ void runner_dopair1_density_vec(struct runner *r, struct cell *ci,
   last_pj = max(last_pj, max_index_i[count_i - 1]);
   first_pi = min(first_pi, max_index_j[0]);
 
-  /* Read the required particles into the two caches. */
-  cache_read_two_partial_cells_sorted(ci, cj, ci_cache, cj_cache, sort_i,
-                                      sort_j, shift, &first_pi, &last_pj);
+  /* Read the required particles into the two caches, from the SoA copy if
+   * it is up to date for both cells. */
+  if (runner_part_soa_is_valid(e, ci) && runner_part_soa_is_valid(e, cj))
+    cache_read_two_partial_cells_sorted_soa(
+        ci, cj, ci_cache, cj_cache, sort_i, sort_j, shift, &first_pi, &last_pj,
+        &part_soa, parts_i - e->s->parts, parts_j - e->s->parts);
+  else
+    cache_read_two_partial_cells_sorted(ci, cj, ci_cache, cj_cache, sort_i,
+                                        sort_j, shift, &first_pi, &last_pj);
 
   /* Get the number of particles read into the ci cache. */
   const int ci_cache_count = count_i - first_pi;
@@ -1542,7 +1579,7 @@ void runner_dopair1_density_vec(struct runner *r, struct cell *ci,
       VEC_HADD(v_rho_dhSum, pi->density.rho_dh);
       VEC_HADD(v_wcountSum, pi->density.wcount);
       VEC_HADD(v_wcount_dhSum, pi->density.wcount_dh);
-      VEC_HADD(v_div_vSum, pi->density.div_v);
+      VEC_HADD(v_div_vSum, hydro_vec_div_v(pi));
       VEC_HADD(v_curlvxSum, pi->density.rot_v[0]);
       VEC_HADD(v_curlvySum, pi->density.rot_v[1]);
       VEC_HADD(v_curlvzSum, pi->density.rot_v[2]);
@@ -1683,7 +1720,7 @@ void runner_dopair1_density_vec(struct runner *r, struct cell *ci,
       VEC_HADD(v_rho_dhSum, pj->density.rho_dh);
       VEC_HADD(v_wcountSum, pj->density.wcount);
       VEC_HADD(v_wcount_dhSum, pj->density.wcount_dh);
-      VEC_HADD(v_div_vSum, pj->density.div_v);
+      VEC_HADD(v_div_vSum, hydro_vec_div_v(pj));
       VEC_HADD(v_curlvxSum, pj->density.rot_v[0]);
       VEC_HADD(v_curlvySum, pj->density.rot_v[1]);
       VEC_HADD(v_curlvzSum, pj->density.rot_v[2]);
@@ -1697,7 +1734,7 @@ void runner_dopair1_density_vec(struct runner *r, struct cell *ci,
 
   error("Incorrectly calling vectorized Gadget-2 functions!");
 
-#endif /* WITH_VECTORIZATION */
+#endif /* HYDRO_DENSITY_VEC */
 }
 
 /**
@@ -1721,7 +1758,7 @@ void runner_dopair_subset_density_vec(struct runner *r,
                                       struct cell *restrict cj, const int sid,
                                       const int flipped, const double *shift) {
 
-#if defined(WITH_VECTORIZATION) && defined(GADGET2_SPH)
+#ifdef HYDRO_DENSITY_VEC
 
   TIMER_TIC;
 
@@ -1735,7 +1772,7 @@ void runner_dopair_subset_density_vec(struct runner *r,
    * them if they are not big enough for the cells. */
   struct cache *restrict cj_cache = &r->cj_cache;
 
-  if (cj_cache->count < count_j) cache_init(cj_cache, count_j);
+  cache_ensure(cj_cache, count_j);
 
   /* Pull each runner_shift from memory. */
   const double runner_shift_x = runner_shift[sid][0];
@@ -1886,7 +1923,7 @@ void runner_dopair_subset_density_vec(struct runner *r,
       VEC_HADD(v_rho_dhSum, pi->density.rho_dh);
       VEC_HADD(v_wcountSum, pi->density.wcount);
       VEC_HADD(v_wcount_dhSum, pi->density.wcount_dh);
-      VEC_HADD(v_div_vSum, pi->density.div_v);
+      VEC_HADD(v_div_vSum, hydro_vec_div_v(pi));
       VEC_HADD(v_curlvxSum, pi->density.rot_v[0]);
       VEC_HADD(v_curlvySum, pi->density.rot_v[1]);
       VEC_HADD(v_curlvzSum, pi->density.rot_v[2]);
@@ -2034,7 +2071,7 @@ void runner_dopair_subset_density_vec(struct runner *r,
       VEC_HADD(v_rho_dhSum, pi->density.rho_dh);
       VEC_HADD(v_wcountSum, pi->density.wcount);
       VEC_HADD(v_wcount_dhSum, pi->density.wcount_dh);
-      VEC_HADD(v_div_vSum, pi->density.div_v);
+      VEC_HADD(v_div_vSum, hydro_vec_div_v(pi));
       VEC_HADD(v_curlvxSum, pi->density.rot_v[0]);
       VEC_HADD(v_curlvySum, pi->density.rot_v[1]);
       VEC_HADD(v_curlvzSum, pi->density.rot_v[2]);
@@ -2043,7 +2080,7 @@ void runner_dopair_subset_density_vec(struct runner *r,
   }
 
   TIMER_TOC(timer_dopair_subset);
-#endif /* WITH_VECTORIZATION */
+#endif /* HYDRO_DENSITY_VEC */
 }
 
 /**
@@ -2147,8 +2184,8 @@ void runner_dopair2_force_vec(struct runner *r, struct cell *ci,
    * them if they are not big enough for the cells. */
   struct cache *restrict ci_cache = &r->ci_cache;
   struct cache *restrict cj_cache = &r->cj_cache;
-  if (ci_cache->count < count_i) cache_init(ci_cache, count_i);
-  if (cj_cache->count < count_j) cache_init(cj_cache, count_j);
+  cache_ensure(ci_cache, count_i);
+  cache_ensure(cj_cache, count_j);
 
   /* Get a direct pointer to the index arrays */
   int first_pi, last_pj;
@@ -33,6 +33,20 @@
 #include "timers.h"
 #include "vector.h"
 
+/* The hand-vectorised density loop reproduces the hydro part of the density
+ * interactions of Gadget-2 and SPHENIX. With SPHENIX, the other models must
+ * act as no-ops in that loop. */
+#if defined(WITH_VECTORIZATION) && \
+    (defined(GADGET2_SPH) || \
+     (defined(SPHENIX_SPH) && defined(NONE_MHD) && \
+      !defined(ADAPTIVE_SOFTENING) && !defined(RT_GEAR) && \
+      defined(CHEMISTRY_NONE) && \
+      (defined(STAR_FORMATION_NONE) || defined(STAR_FORMATION_EAGLE)) && \
+      defined(PRESSURE_FLOOR_NONE) && defined(SINK_NONE) && \
+      !defined(SWIFT_HYDRO_DENSITY_CHECKS) && !defined(DEBUG_INTERACTIONS_SPH)))
+#define HYDRO_DENSITY_VEC
+#endif
+
 /* Function prototypes. */
 void runner_doself_subset_density_vec(struct runner *r,
                                       struct cell *restrict ci,
@@ -33,6 +33,8 @@
 #undef IACT_SINKS_GAS
 #undef IACT_SINKS_SINK
 #undef GET_MU0
+#undef FLUX_BATCH_DECLARE
+#undef FLUX_BATCH_FLUSH
 #undef FUNCTION
 #undef FUNCTION_TASK_LOOP
 
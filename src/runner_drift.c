@@ -28,7 +28,10 @@
 /* Local headers. */
 #include "active.h"
 #include "cell.h"
+#include "cuda_gpart_mirror.h"
 #include "engine.h"
+#include "gpart_soa.h"
+#include "part_soa.h"
 #include "timers.h"
 
 /**
@@ -44,6 +47,9 @@ void runner_do_drift_part(struct runner *r, struct cell *c, int timer) {
 
   cell_drift_part(c, r->e, 0, NULL);
 
+  /* Refresh the host SoA copy the density caches read */
+  part_soa_fill(r->e, c);
+
   if (timer) TIMER_TOC(timer_drift_part);
 }
 
@@ -58,8 +64,22 @@ void runner_do_drift_gpart(struct runner *r, struct cell *c, int timer) {
 
   TIMER_TIC;
 
+  /* Cells nothing kicks may only need their drifted positions in the host
+   * SoA copy the gravity caches read */
+  if (gpart_soa_drift_lazy(r->e, c)) {
+    cuda_gpart_mirror_upload(r, c, /*lazy=*/1);
+    if (timer) TIMER_TOC(timer_drift_gpart);
+    return;
+  }
+
   cell_drift_gpart(c, r->e, 0, NULL);
 
+  /* Refresh the device copy of the positions for this step */
+  cuda_gpart_mirror_upload(r, c, /*lazy=*/0);
+
+  /* And the host SoA copy the gravity caches read */
+  gpart_soa_fill(r->e, c);
+
   if (timer) TIMER_TOC(timer_drift_gpart);
 }
 
@@ -117,19 +117,17 @@ void runner_do_stars_ghost(struct runner *r, struct cell *c, int timer) {
     }
   } else {
 
-    /* Init the list of active particles that have to be updated. */
-    int *sid = NULL;
-    float *h_0 = NULL;
-    float *left = NULL;
-    float *right = NULL;
-    if ((sid = (int *)malloc(sizeof(int) * c->stars.count)) == NULL)
-      error("Can't allocate memory for sid.");
-    if ((h_0 = (float *)malloc(sizeof(float) * c->stars.count)) == NULL)
-      error("Can't allocate memory for h_0.");
-    if ((left = (float *)malloc(sizeof(float) * c->stars.count)) == NULL)
-      error("Can't allocate memory for left.");
-    if ((right = (float *)malloc(sizeof(float) * c->stars.count)) == NULL)
-      error("Can't allocate memory for right.");
+    /* Init the list of active particles that have to be updated, in the
+     * scratch memory of the runner. */
+    struct runner_scratch *scratch = &r->scratch;
+    const struct runner_scratch_mark scratch_mark =
+        runner_scratch_mark(scratch);
+    const size_t int_size = sizeof(int) * c->stars.count;
+    const size_t float_size = sizeof(float) * c->stars.count;
+    int *sid = (int *)runner_scratch_alloc(scratch, int_size);
+    float *h_0 = (float *)runner_scratch_alloc(scratch, float_size);
+    float *left = (float *)runner_scratch_alloc(scratch, float_size);
+    float *right = (float *)runner_scratch_alloc(scratch, float_size);
     for (int k = 0; k < c->stars.count; k++)
       if (spart_is_active(&sparts[k], e) &&
           (feedback_is_active(&sparts[k], e) || with_rt)) {
@@ -532,10 +530,7 @@ void runner_do_stars_ghost(struct runner *r, struct cell *c, int timer) {
     }
 
     /* Be clean */
-    free(left);
-    free(right);
-    free(sid);
-    free(h_0);
+    runner_scratch_release(scratch, scratch_mark);
   }
 
   /* Update h_max */
@@ -613,19 +608,17 @@ void runner_do_black_holes_density_ghost(struct runner *r, struct cell *c,
     }
   } else {
 
-    /* Init the list of active particles that have to be updated. */
-    int *sid = NULL;
-    float *h_0 = NULL;
-    float *left = NULL;
-    float *right = NULL;
-    if ((sid = (int *)malloc(sizeof(int) * c->black_holes.count)) == NULL)
-      error("Can't allocate memory for sid.");
-    if ((h_0 = (float *)malloc(sizeof(float) * c->black_holes.count)) == NULL)
-      error("Can't allocate memory for h_0.");
-    if ((left = (float *)malloc(sizeof(float) * c->black_holes.count)) == NULL)
-      error("Can't allocate memory for left.");
-    if ((right = (float *)malloc(sizeof(float) * c->black_holes.count)) == NULL)
-      error("Can't allocate memory for right.");
+    /* Init the list of active particles that have to be updated, in the
+     * scratch memory of the runner. */
+    struct runner_scratch *scratch = &r->scratch;
+    const struct runner_scratch_mark scratch_mark =
+        runner_scratch_mark(scratch);
+    const size_t int_size = sizeof(int) * c->black_holes.count;
+    const size_t float_size = sizeof(float) * c->black_holes.count;
+    int *sid = (int *)runner_scratch_alloc(scratch, int_size);
+    float *h_0 = (float *)runner_scratch_alloc(scratch, float_size);
+    float *left = (float *)runner_scratch_alloc(scratch, float_size);
+    float *right = (float *)runner_scratch_alloc(scratch, float_size);
     for (int k = 0; k < c->black_holes.count; k++)
       if (bpart_is_active(&bparts[k], e)) {
         sid[bcount] = k;
@@ -880,10 +873,7 @@ void runner_do_black_holes_density_ghost(struct runner *r, struct cell *c,
     }
 
     /* Be clean */
-    free(left);
-    free(right);
-    free(sid);
-    free(h_0);
+    runner_scratch_release(scratch, scratch_mark);
   }
 
   /* Update h_max */
@@ -1075,6 +1065,219 @@ void runner_do_extra_ghost(struct runner *r, struct cell *c, int timer) {
 #endif
 }
 
+/**
+ * @brief Appends to the neighbour list of a #part the #part of a leaf cell
+ * that are within the search radius.
+ *
+ * The separations are computed as in the subset density loops.
+ *
+ * @param e The #engine.
+ * @param ngbs The #hydro_ngb_list to grow.
+ * @param pi The #part whose list this is.
+ * @param r2_max Square of the search radius.
+ * @param ci The #cell containing @c pi.
+ * @param cj The #cell to search, NULL for @c ci itself.
+ */
+static void runner_ghost_collect_ngbs_leaf(const struct engine *e,
+                                           struct hydro_ngb_list *ngbs,
+                                           const struct part *pi,
+                                           const float r2_max,
+                                           const struct cell *ci,
+                                           const struct cell *cj) {
+
+  /* Get the relative distance between the pairs, wrapping. */
+  double shift[3] = {0.0, 0.0, 0.0};
+  if (cj != NULL) {
+    for (int k = 0; k < 3; k++) {
+      if (cj->loc[k] - ci->loc[k] < -e->s->dim[k] / 2)
+        shift[k] = e->s->dim[k];
+      else if (cj->loc[k] - ci->loc[k] > e->s->dim[k] / 2)
+        shift[k] = -e->s->dim[k];
+    }
+  } else {
+    cj = ci;
+  }
+
+  const int count_j = cj->hydro.count;
+  struct part *restrict parts_j = cj->hydro.parts;
+  hydro_ngb_list_reserve(ngbs, count_j);
+
+  /* Loop over the parts in cj. */
+  for (int pjd = 0; pjd < count_j; pjd++) {
+
+    struct part *restrict pj = &parts_j[pjd];
+
+    /* Skip oneself and inhibited particles. */
+    if (pj == pi) continue;
+    if (part_is_inhibited(pj, e)) continue;
+
+    /* Compute the pairwise distance. */
+    float dx[3];
+    if (cj == ci) {
+      for (int k = 0; k < 3; k++)
+        dx[k] = (float)(pi->x[k] - ci->loc[k]) - (float)(pj->x[k] - ci->loc[k]);
+    } else {
+      for (int k = 0; k < 3; k++) dx[k] = (pi->x[k] - shift[k]) - pj->x[k];
+    }
+    const float r2 = dx[0] * dx[0] + dx[1] * dx[1] + dx[2] * dx[2];
+
+    /* Keep it? */
+    if (r2 < r2_max) {
+      struct hydro_ngb *ngb = &ngbs->ngbs[ngbs->count++];
+      ngb->pj = pj;
+      ngb->dx[0] = dx[0];
+      ngb->dx[1] = dx[1];
+      ngb->dx[2] = dx[2];
+    }
+  }
+}
+
+/**
+ * @brief Appends to the neighbour list of a #part its candidates from a
+ * (sub-)self or (sub-)pair density interaction.
+ *
+ * This follows the recursion of runner_dosub_subset_density(), such that the
+ * list covers exactly the #part the subset loops would visit.
+ *
+ * @param e The #engine.
+ * @param ngbs The #hydro_ngb_list to grow.
+ * @param pi The #part whose list this is.
+ * @param r2_max Square of the search radius.
+ * @param ci The #cell containing @c pi.
+ * @param cj The other #cell of the interaction, NULL for a self.
+ * @param recurse Can we recurse into sub-cells, as for a sub-task?
+ */
+static void runner_ghost_collect_ngbs(const struct engine *e,
+                                      struct hydro_ngb_list *ngbs,
+                                      const struct part *pi,
+                                      const float r2_max, struct cell *ci,
+                                      struct cell *cj, const int recurse) {
+
+  /* Should we even bother? */
+  if (!cell_is_active_hydro(ci, e) &&
+      (cj == NULL || !cell_is_active_hydro(cj, e)))
+    return;
+  if (ci->hydro.count == 0 || (cj != NULL && cj->hydro.count == 0)) return;
+
+  /* Find out in which sub-cell of ci the part is. */
+  struct cell *sub = NULL;
+  if (ci->split) {
+    for (int k = 0; k < 8; k++) {
+      if (ci->progeny[k] != NULL) {
+        if (pi >= &ci->progeny[k]->hydro.parts[0] &&
+            pi < &ci->progeny[k]->hydro.parts[ci->progeny[k]->hydro.count]) {
+          sub = ci->progeny[k];
+          break;
+        }
+      }
+    }
+  }
+
+  /* Is this a single cell? */
+  if (cj == NULL) {
+
+    if (recurse && cell_can_recurse_in_self_hydro_task(ci)) {
+      runner_ghost_collect_ngbs(e, ngbs, pi, r2_max, sub, NULL, 1);
+      for (int j = 0; j < 8; j++)
+        if (ci->progeny[j] != sub && ci->progeny[j] != NULL)
+          runner_ghost_collect_ngbs(e, ngbs, pi, r2_max, sub, ci->progeny[j],
+                                    1);
+    } else {
+      runner_ghost_collect_ngbs_leaf(e, ngbs, pi, r2_max, ci, NULL);
+    }
+  }
+
+  /* Otherwise, it's a pair interaction. */
+  else {
+
+    if (recurse && cell_can_recurse_in_pair_hydro_task(ci) &&
+        cell_can_recurse_in_pair_hydro_task(cj)) {
+
+      /* Get the type of pair and flip ci/cj if needed. */
+      double shift[3] = {0.0, 0.0, 0.0};
+      const int sid = space_getsid_and_swap_cells(e->s, &ci, &cj, shift);
+
+      struct cell_split_pair *csp = &cell_split_pairs[sid];
+      for (int k = 0; k < csp->count; k++) {
+        const int pid = csp->pairs[k].pid;
+        const int pjd = csp->pairs[k].pjd;
+        if (ci->progeny[pid] == sub && cj->progeny[pjd] != NULL)
+          runner_ghost_collect_ngbs(e, ngbs, pi, r2_max, ci->progeny[pid],
+                                    cj->progeny[pjd], 1);
+        if (ci->progeny[pid] != NULL && cj->progeny[pjd] == sub)
+          runner_ghost_collect_ngbs(e, ngbs, pi, r2_max, cj->progeny[pjd],
+                                    ci->progeny[pid], 1);
+      }
+    } else if (cell_is_active_hydro(ci, e) || cell_is_active_hydro(cj, e)) {
+      runner_ghost_collect_ngbs_leaf(e, ngbs, pi, r2_max, ci, cj);
+    }
+  }
+}
+
+/**
+ * @brief Builds the neighbour lists of the #part whose smoothing length
+ * outgrew their list (or that do not have one yet).
+ *
+ * The candidates of a #part are all the #part its density loop would visit
+ * within tolerance times its kernel support. The lists are in the same order
+ * as the indices and are complete for any smoothing length up to tolerance
+ * times the current one.
+ *
+ * @param r The #runner.
+ * @param c The (leaf) #cell containing the #part.
+ * @param parts The #part of the cell.
+ * @param pid The indices of the #part to interact.
+ * @param count The number of #part in @c pid.
+ * @param tolerance Search radius in units of the kernel support.
+ */
+static void runner_ghost_build_ngb_lists(struct runner *r, struct cell *c,
+                                         const struct part *parts,
+                                         const int *pid, const int count,
+                                         const float tolerance) {
+
+  const struct engine *e = r->e;
+  struct hydro_ngb_list *ngbs = &r->ghost_ngb_list;
+
+  for (int i = 0; i < count; i++) {
+
+    const struct part *p = &parts[pid[i]];
+
+    /* Is the current list still good enough? */
+    if (p->h <= ngbs->h[i]) continue;
+
+    const float h_list = tolerance * p->h;
+    const float r2_max = h_list * h_list * kernel_gamma2;
+    ngbs->offset[i] = ngbs->count;
+
+    /* Climb up the cell hierarchy. */
+    for (struct cell *finger = c; finger != NULL; finger = finger->parent) {
+
+      /* Run through this cell's density interactions. */
+      for (struct link *l = finger->hydro.density; l != NULL; l = l->next) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+        if (l->t->ti_run < e->ti_current)
+          error("Density task should have been run.");
+#endif
+
+        /* The other cell, if any. */
+        struct cell *other = NULL;
+        if (l->t->type == task_type_pair || l->t->type == task_type_sub_pair)
+          other = (l->t->ci == finger) ? l->t->cj : l->t->ci;
+
+        /* Can we recurse, as for a sub-task? */
+        const int recurse = (l->t->type == task_type_sub_self ||
+                             l->t->type == task_type_sub_pair);
+
+        runner_ghost_collect_ngbs(e, ngbs, p, r2_max, finger, other, recurse);
+      }
+    }
+
+    ngbs->length[i] = ngbs->count - ngbs->offset[i];
+    ngbs->h[i] = h_list;
+  }
+}
+
 /**
  * @brief Intermediate task after the density to check that the smoothing
  * lengths are correct.
@@ -1107,6 +1310,8 @@ void runner_do_ghost(struct runner *r, struct cell *c, int timer) {
   const int use_mass_weighted_num_ngb =
       e->hydro_properties->use_mass_weighted_num_ngb;
   const int max_smoothing_iter = e->hydro_properties->max_smoothing_iterations;
+  const float ngb_list_tolerance = hydro_props->ghost_ngb_list_tolerance;
+  struct hydro_ngb_list *ngbs = &r->ghost_ngb_list;
   int redo = 0, count = 0;
 
   /* Running value of the maximal smoothing length */
@@ -1133,19 +1338,16 @@ void runner_do_ghost(struct runner *r, struct cell *c, int timer) {
   } else {
 
     /* Init the list of active particles that have to be updated and their
-     * current smoothing lengths. */
-    int *pid = NULL;
-    float *h_0 = NULL;
-    float *left = NULL;
-    float *right = NULL;
-    if ((pid = (int *)malloc(sizeof(int) * c->hydro.count)) == NULL)
-      error("Can't allocate memory for pid.");
-    if ((h_0 = (float *)malloc(sizeof(float) * c->hydro.count)) == NULL)
-      error("Can't allocate memory for h_0.");
-    if ((left = (float *)malloc(sizeof(float) * c->hydro.count)) == NULL)
-      error("Can't allocate memory for left.");
-    if ((right = (float *)malloc(sizeof(float) * c->hydro.count)) == NULL)
-      error("Can't allocate memory for right.");
+     * current smoothing lengths, in the scratch memory of the runner. */
+    struct runner_scratch *scratch = &r->scratch;
+    const struct runner_scratch_mark scratch_mark =
+        runner_scratch_mark(scratch);
+    const size_t int_size = sizeof(int) * c->hydro.count;
+    const size_t float_size = sizeof(float) * c->hydro.count;
+    int *pid = (int *)runner_scratch_alloc(scratch, int_size);
+    float *h_0 = (float *)runner_scratch_alloc(scratch, float_size);
+    float *left = (float *)runner_scratch_alloc(scratch, float_size);
+    float *right = (float *)runner_scratch_alloc(scratch, float_size);
     for (int k = 0; k < c->hydro.count; k++)
       if (part_is_active(&parts[k], e)) {
         pid[count] = k;
@@ -1155,6 +1357,9 @@ void runner_do_ghost(struct runner *r, struct cell *c, int timer) {
         ++count;
       }
 
+    /* None of the neighbour lists have been built yet */
+    if (ngb_list_tolerance > 0.f) hydro_ngb_list_reset(ngbs, count);
+
     /* While there are particles that need to be updated... */
     for (int num_reruns = 0; count > 0 && num_reruns < max_smoothing_iter;
          num_reruns++) {
@@ -1377,6 +1582,11 @@ void runner_do_ghost(struct runner *r, struct cell *c, int timer) {
             h_0[redo] = h_0[i];
             left[redo] = left[i];
             right[redo] = right[i];
+            if (ngb_list_tolerance > 0.f) {
+              ngbs->offset[redo] = ngbs->offset[i];
+              ngbs->length[redo] = ngbs->length[i];
+              ngbs->h[redo] = ngbs->h[i];
+            }
             redo += 1;
 
             /* Re-initialise everything */
@@ -1504,7 +1714,15 @@ void runner_do_ghost(struct runner *r, struct cell *c, int timer) {
 
       /* Re-set the counter for the next loop (potentially). */
       count = redo;
-      if (count > 0) {
+      if (count > 0 && ngb_list_tolerance > 0.f) {
+
+        /* Collect the neighbours of the particles that have no (long enough)
+         * list and only run over the lists from now on. */
+        runner_ghost_build_ngb_lists(r, c, parts, pid, count,
+                                     ngb_list_tolerance);
+        runner_dosubset_ngb_list_density(r, parts, pid, count, ngbs);
+
+      } else if (count > 0) {
 
         /* Climb up the cell hierarchy. */
         for (struct cell *finger = c; finger != NULL; finger = finger->parent) {
@@ -1567,10 +1785,7 @@ void runner_do_ghost(struct runner *r, struct cell *c, int timer) {
     }
 
     /* Be clean */
-    free(left);
-    free(right);
-    free(pid);
-    free(h_0);
+    runner_scratch_release(scratch, scratch_mark);
   }
 
   /* Update h_max */
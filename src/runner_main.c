@@ -31,8 +31,10 @@
 #include "runner.h"
 
 /* Local headers. */
+#include "cuda_gpart_mirror.h"
 #include "engine.h"
 #include "feedback.h"
+#include "mpi_aggregate.h"
 #include "scheduler.h"
 #include "space_getsid.h"
 #include "timers.h"
@@ -141,6 +143,9 @@ void *runner_main(void *data) {
   struct engine *e = r->e;
   struct scheduler *sched = &e->sched;
 
+  /* The hardware counters count the events of this thread */
+  task_counters_init(&r->counters);
+
   /* Main loop. */
   while (1) {
 
@@ -150,6 +155,9 @@ void *runner_main(void *data) {
     /* Can we go home yet? */
     if (e->step_props & engine_step_prop_done) break;
 
+    /* All our device buffers live on our GPU */
+    cuda_devices_use(cuda_devices_of_runner(r->id));
+
     /* Re-set the pointer to the previous task, as there is none. */
     struct task *t = NULL;
     struct task *prev = NULL;
@@ -160,11 +168,27 @@ void *runner_main(void *data) {
       /* If there's no old task, try to get a new one. */
       if (t == NULL) {
 
-        /* Get the task. */
+        /* Complete the GPU work that has landed in the meantime */
+        runner_dopair_grav_pp_complete(r, /*wait=*/0);
+        const int in_flight = r->gpu_pair_batch.in_flight != NULL;
+
+        /* Get the task, don't fall asleep with work on the GPU. */
         TIMER_TIC
-        t = scheduler_gettask(sched, r->qid, prev);
+        const ticks idle_beg = getticks();
+        if (in_flight)
+          t = scheduler_gettask_nowait(sched, r->qid, prev);
+        else
+          t = scheduler_gettask(sched, r->qid, prev, &r->spin_time,
+                                &r->park_time);
+        r->idle_time += getticks() - idle_beg;
         TIMER_TOC(timer_gettask);
 
+        /* Nothing else to do than wait for the GPU? */
+        if (t == NULL && in_flight) {
+          runner_dopair_grav_pp_complete(r, /*wait=*/1);
+          continue;
+        }
+
         /* Did I get anything? */
         if (t == NULL) break;
       }
@@ -195,7 +219,12 @@ void *runner_main(void *data) {
       r->t = t;
 #endif
 
+      /* Left in flight on the GPU? */
+      int deferred = 0;
+
       const ticks task_beg = getticks();
+      cuda_timeline_task_begin(&r->gpu_timeline, t);
+      task_counters_start(&r->counters);
       /* Different types of tasks... */
       switch (t->type) {
         case task_type_self:
@@ -209,9 +238,11 @@ void *runner_main(void *data) {
             runner_doself2_branch_force(r, ci);
           else if (t->subtype == task_subtype_limiter)
             runner_doself1_branch_limiter(r, ci);
-          else if (t->subtype == task_subtype_grav)
-            runner_doself_recursive_grav(r, ci, 1);
-          else if (t->subtype == task_subtype_external_grav)
+          else if (t->subtype == task_subtype_grav) {
+            runner_doself_grav_walk(r, t);
+            runner_dopair_grav_mm_flush(r);
+            deferred = runner_dopair_grav_pp_flush_async(r, t);
+          } else if (t->subtype == task_subtype_external_grav)
             runner_do_grav_external(r, ci, 1);
           else if (t->subtype == task_subtype_stars_density)
             runner_doself_branch_stars_density(r, ci);
@@ -259,9 +290,11 @@ void *runner_main(void *data) {
             runner_dopair2_branch_force(r, ci, cj);
           else if (t->subtype == task_subtype_limiter)
             runner_dopair1_branch_limiter(r, ci, cj);
-          else if (t->subtype == task_subtype_grav)
-            runner_dopair_recursive_grav(r, ci, cj, 1);
-          else if (t->subtype == task_subtype_stars_density)
+          else if (t->subtype == task_subtype_grav) {
+            runner_dopair_grav_walk(r, t);
+            runner_dopair_grav_mm_flush(r);
+            deferred = runner_dopair_grav_pp_flush_async(r, t);
+          } else if (t->subtype == task_subtype_stars_density)
             runner_dopair_branch_stars_density(r, ci, cj);
 #ifdef EXTRA_STAR_LOOPS
           else if (t->subtype == task_subtype_stars_prep1)
@@ -453,6 +486,7 @@ void *runner_main(void *data) {
           break;
         case task_type_kick1:
           runner_do_kick1(r, ci, 1);
+          cuda_gpart_mirror_upload_velocities(r, ci);
           break;
         case task_type_kick2:
           runner_do_kick2(r, ci, 1);
@@ -495,18 +529,25 @@ void *runner_main(void *data) {
             free(t->buff);
           } else if (t->subtype == task_subtype_limiter) {
             free(t->buff);
+          } else if (t->subtype == task_subtype_gpart &&
+                     e->sched.compact_foreign_gparts && !mpi_aggregate_gparts) {
+            free(t->buff);
           }
           break;
         case task_type_recv:
           if (t->subtype == task_subtype_tend) {
-            cell_unpack_end_step(ci, (struct pcell_step *)t->buff);
+            cell_unpack_changed(t->buff, &t->buff_last, ci->mpi.pcell_size,
+                                sizeof(struct pcell_step));
+            cell_unpack_end_step(ci, (struct pcell_step *)t->buff_last);
             free(t->buff);
           } else if (t->subtype == task_subtype_sf_counts) {
             cell_unpack_sf_counts(ci, (struct pcell_sf_stars *)t->buff);
             cell_clear_stars_sort_flags(ci, /*clear_unused_flags=*/0);
             free(t->buff);
           } else if (t->subtype == task_subtype_grav_counts) {
-            cell_unpack_grav_counts(ci, (struct pcell_sf_grav *)t->buff);
+            cell_unpack_changed(t->buff, &t->buff_last, ci->mpi.pcell_size,
+                                sizeof(struct pcell_sf_grav));
+            cell_unpack_grav_counts(ci, (struct pcell_sf_grav *)t->buff_last);
             free(t->buff);
           } else if (t->subtype == task_subtype_xv) {
             runner_do_recv_part(r, ci, 1, 1);
@@ -529,6 +570,13 @@ void *runner_main(void *data) {
           } else if (t->subtype == task_subtype_limiter) {
             /* Nothing to do here. Unpacking done in a separate task */
           } else if (t->subtype == task_subtype_gpart) {
+            if (mpi_aggregate_gparts) {
+              mpi_aggregate_recv_gpart_unpack(t);
+            } else if (e->sched.compact_foreign_gparts &&
+                       !e->sched.compact_foreign_gparts_in_memory) {
+              cell_unpack_gpart_foreign(ci, (struct gpart_foreign *)t->buff);
+              free(t->buff);
+            }
             runner_do_recv_gpart(r, ci, 1);
           } else if (t->subtype == task_subtype_spart_density) {
             runner_do_recv_spart(r, ci, 1, 1);
@@ -558,11 +606,14 @@ void *runner_main(void *data) {
           break;
         case task_type_grav_long_range:
           runner_do_grav_long_range(r, t->ci, 1);
+          runner_dopair_grav_mm_flush(r);
           break;
         case task_type_grav_mm:
           runner_dopair_grav_mm_progenies(r, t->flags, t->ci, t->cj);
+          runner_dopair_grav_mm_flush(r);
           break;
         case task_type_cooling:
+          if (e->fuse_end_force_cooling) runner_do_end_hydro_force(r, ci, 0);
           runner_do_cooling(r, t->ci, 1);
           break;
         case task_type_star_formation:
@@ -589,9 +640,6 @@ void *runner_main(void *data) {
         case task_type_fof_attach_pair:
           runner_do_fof_attach_pair(r, t->ci, t->cj, 1);
           break;
-        case task_type_neutrino_weight:
-          runner_do_neutrino_weighting(r, ci, 1);
-          break;
         case task_type_rt_ghost1:
           runner_do_rt_ghost1(r, t->ci, 1);
           break;
@@ -607,6 +655,8 @@ void *runner_main(void *data) {
         default:
           error("Unknown/invalid task type (%d).", t->type);
       }
+      task_counters_stop(&r->counters, t);
+      cuda_timeline_task_end(&r->gpu_timeline);
       r->active_time += (getticks() - task_beg);
 
 /* Mark that we have run this task on these cells */
@@ -624,9 +674,16 @@ void *runner_main(void *data) {
       r->t = NULL;
 #endif
 
-      /* We're done with this task, see if we get a next one. */
+      /* Whatever temporary memory the task used is free again */
+      runner_scratch_reset(&r->scratch);
+
+      /* We're done with this task, see if we get a next one. A task still on
+       * the GPU gets completed once its results have landed. */
       prev = t;
-      t = scheduler_done(sched, t);
+      if (deferred)
+        t = NULL;
+      else
+        t = scheduler_done(sched, t);
 
     } /* main loop. */
   }
@@ -640,3 +697,9 @@ ticks runner_get_active_time(const struct runner *restrict r) {
 }
 
 void runner_reset_active_time(struct runner *restrict r) { r->active_time = 0; }
+
+void runner_reset_idle_times(struct runner *restrict r) {
+  r->idle_time = 0;
+  r->spin_time = 0;
+  r->park_time = 0;
+}
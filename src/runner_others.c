@@ -44,11 +44,14 @@
 #include "cooling.h"
 #include "csds.h"
 #include "csds_io.h"
+#include "cuda_gpart_mirror.h"
+#include "cuda_rt.h"
 #include "engine.h"
 #include "error.h"
 #include "feedback.h"
 #include "fof.h"
 #include "forcing.h"
+#include "gpart_soa.h"
 #include "gravity.h"
 #include "hydro.h"
 #include "potential.h"
@@ -63,6 +66,20 @@
 #include "timestep_limiter.h"
 #include "tracers.h"
 
+/* The cooling schemes that cool the particles of a cell in batches */
+#if defined(COOLING_PS2020)
+#define runner_cooling_batch_size colibre_cooling_batch_size
+#elif defined(COOLING_GRACKLE)
+#define runner_cooling_batch_size grackle_cooling_batch_size
+#endif
+
+/* The external potentials evaluated on batches of particles */
+#if defined(EXTERNAL_POTENTIAL_HERNQUIST)
+#define runner_grav_external_batch_size hernquist_potential_batch_size
+#elif defined(EXTERNAL_POTENTIAL_NFW)
+#define runner_grav_external_batch_size nfw_potential_batch_size
+#endif
+
 extern const int sort_stack_size;
 
 /**
@@ -92,11 +109,70 @@ void runner_do_grav_external(struct runner *r, struct cell *c, int timer) {
       if (c->progeny[k] != NULL) runner_do_grav_external(r, c->progeny[k], 0);
   } else {
 
+    /* Only visit the active ones if we know which they are */
+    int nr_active = 0;
+    const int *active = gpart_soa_active_list(e, c, &nr_active);
+    const int nr_loop = active != NULL ? nr_active : gcount;
+
+#ifdef runner_grav_external_batch_size
+
+    /* Gather the active particles in batches and evaluate the potential
+     * on each batch in one (vectorisable) go */
+    int index[runner_grav_external_batch_size];
+    double x[runner_grav_external_batch_size] SWIFT_CACHE_ALIGN;
+    double y[runner_grav_external_batch_size] SWIFT_CACHE_ALIGN;
+    double z[runner_grav_external_batch_size] SWIFT_CACHE_ALIGN;
+    float a_x[runner_grav_external_batch_size] SWIFT_CACHE_ALIGN;
+    float a_y[runner_grav_external_batch_size] SWIFT_CACHE_ALIGN;
+    float a_z[runner_grav_external_batch_size] SWIFT_CACHE_ALIGN;
+    float pot[runner_grav_external_batch_size] SWIFT_CACHE_ALIGN;
+
+    int n = 0;
+    while (n < nr_loop) {
+
+      /* Collect the next batch of active particles */
+      int count = 0;
+      for (; n < nr_loop && count < runner_grav_external_batch_size; n++) {
+
+        const int k = active != NULL ? active[n] : n;
+        const struct gpart *restrict gp = &gparts[k];
+
+#ifdef SWIFT_DEBUG_CHECKS
+        if (gp->time_bin == time_bin_not_created)
+          error("Found an extra particle in external gravity.");
+#endif
+
+        /* Is this part within the time step? */
+        if (!gpart_is_active(gp, e)) continue;
+
+        index[count] = k;
+        x[count] = gp->x[0];
+        y[count] = gp->x[1];
+        z[count] = gp->x[2];
+        count++;
+      }
+
+      external_gravity_acceleration_batch(time, potential, constants, count, x,
+                                          y, z, a_x, a_y, a_z, pot);
+
+      /* Add the contributions back to the particles */
+      for (int i = 0; i < count; i++) {
+        struct gpart *restrict gp = &gparts[index[i]];
+        gp->a_grav[0] += a_x[i];
+        gp->a_grav[1] += a_y[i];
+        gp->a_grav[2] += a_z[i];
+        gravity_add_comoving_potential(gp, pot[i]);
+      }
+    }
+
+#else
+
     /* Loop over the gparts in this cell. */
-    for (int i = 0; i < gcount; i++) {
+    for (int n = 0; n < nr_loop; n++) {
 
       /* Get a direct pointer on the part. */
-      struct gpart *restrict gp = &gparts[i];
+      const int k = active != NULL ? active[n] : n;
+      struct gpart *restrict gp = &gparts[k];
 
 #ifdef SWIFT_DEBUG_CHECKS
       if (gp->time_bin == time_bin_not_created)
@@ -108,6 +184,7 @@ void runner_do_grav_external(struct runner *r, struct cell *c, int timer) {
         external_gravity_acceleration(time, potential, constants, gp);
       }
     }
+#endif /* runner_grav_external_batch_size */
   }
 
   if (timer) TIMER_TOC(timer_dograv_external);
@@ -152,6 +229,15 @@ void runner_do_cooling(struct runner *r, struct cell *c, int timer) {
       if (c->progeny[k] != NULL) runner_do_cooling(r, c->progeny[k], 0);
   } else {
 
+#ifdef runner_cooling_batch_size
+    /* The active particles are cooled in batches */
+    struct part *batch_p[runner_cooling_batch_size];
+    struct xpart *batch_xp[runner_cooling_batch_size];
+    float batch_dt_cool[runner_cooling_batch_size];
+    float batch_dt_therm[runner_cooling_batch_size];
+    int batch_count = 0;
+#endif
+
     /* Loop over the parts in this cell. */
     for (int i = 0; i < count; i++) {
 
@@ -178,12 +264,37 @@ void runner_do_cooling(struct runner *r, struct cell *c, int timer) {
           dt_therm = get_timestep(p->time_bin, time_base);
         }
 
+#ifdef runner_cooling_batch_size
+        batch_p[batch_count] = p;
+        batch_xp[batch_count] = xp;
+        batch_dt_cool[batch_count] = dt_cool;
+        batch_dt_therm[batch_count] = dt_therm;
+        if (++batch_count == runner_cooling_batch_size) {
+
+          /* Let's cool ! */
+          cooling_cool_parts(constants, us, cosmo, hydro_props,
+                             entropy_floor_props, pressure_floor, cooling_func,
+                             batch_p, batch_xp, batch_dt_cool, batch_dt_therm,
+                             batch_count, time);
+          batch_count = 0;
+        }
+#else
         /* Let's cool ! */
         cooling_cool_part(constants, us, cosmo, hydro_props,
                           entropy_floor_props, pressure_floor, cooling_func, p,
                           xp, dt_cool, dt_therm, time);
+#endif
       }
     }
+
+#ifdef runner_cooling_batch_size
+    /* The last, partial, batch */
+    if (batch_count > 0)
+      cooling_cool_parts(constants, us, cosmo, hydro_props,
+                         entropy_floor_props, pressure_floor, cooling_func,
+                         batch_p, batch_xp, batch_dt_cool, batch_dt_therm,
+                         batch_count, time);
+#endif
   }
 
   if (timer) TIMER_TOC(timer_do_cooling);
@@ -309,6 +420,18 @@ void runner_do_star_formation_sink(struct runner *r, struct cell *c,
   if (timer) TIMER_TOC(timer_do_star_formation);
 }
 
+/**
+ * @brief A gas particle of a leaf cell forming stars in this step.
+ */
+struct star_formation_event {
+
+  /*! Index of the #part in the cell. */
+  int k;
+
+  /*! Number of #spart it spawns, and turns into (0 or 1). */
+  int n_spart_spawn, n_spart_convert;
+};
+
 /**
  * @brief Convert some hydro particles into stars depending on the star
  * formation model.
@@ -379,6 +502,14 @@ void runner_do_star_formation(struct runner *r, struct cell *c, int timer) {
       }
   } else {
 
+    /* The gas particles forming stars in this step. The stars are only
+     * created once all of them are known, such that the leaf reserves its
+     * sparts in one go. */
+    struct star_formation_event *events = NULL;
+    int nr_events = 0, nr_sparts = 0;
+    const struct runner_scratch_mark scratch_mark =
+        runner_scratch_mark(&r->scratch);
+
     /* Loop over the gas particles in this cell. */
     for (int k = 0; k < count; k++) {
 
@@ -430,105 +561,21 @@ void runner_do_star_formation(struct runner *r, struct cell *c, int timer) {
               error("Invalid number of sparts to convert");
 #endif
 
-            int n_spart_to_create = n_spart_spawn + n_spart_convert;
-
-            while (n_spart_to_create > 0) {
-
-              struct spart *sp = NULL;
-              int part_converted;
-
-              /* Are we using a model that actually generates star particles? */
-              if (swift_star_formation_model_creates_stars) {
+            if (n_spart_spawn + n_spart_convert > 0) {
 
-                /* Check if we should create a new particle or transform one */
-                if (n_spart_to_create == 1 && n_spart_convert == 1) {
-                  /* Convert the gas particle to a star particle */
-                  sp = cell_convert_part_to_spart(e, c, p, xp);
-                  part_converted = 1;
-#ifdef WITH_CSDS
-                  /* Write the particle */
-                  /* Logs all the fields request by the user */
-                  // TODO select only the requested fields
-                  csds_log_part(e->csds, p, xp, e, /* log_all */ 1,
-                                csds_flag_change_type, swift_type_stars);
-#endif
-                } else {
-                  /* Spawn a new spart (+ gpart) */
-                  sp = cell_spawn_new_spart_from_part(e, c, p, xp);
-                  part_converted = 0;
-                }
-
-              } else {
-
-                /* We are in a model where spart don't exist
-                 * --> convert the part to a DM gpart */
-                cell_convert_part_to_gpart(e, c, p, xp);
-                part_converted = 1;
-              }
-
-              /* Did we get a star? (Or did we run out of spare ones?) */
-              if (sp != NULL) {
-
-                /* Copy the properties of the gas particle to the star particle
-                 */
-                star_formation_copy_properties(
-                    p, xp, sp, e, sf_props, cosmo, with_cosmology, phys_const,
-                    hydro_props, us, cooling, part_converted);
-
-                /* Update the Star formation history */
-                star_formation_logger_log_new_spart(sp, &c->stars.sfh);
-
-                /* Update the h_max */
-                c->stars.h_max = max(c->stars.h_max, sp->h);
-                c->stars.h_max_active = max(c->stars.h_max_active, sp->h);
-
-                /* Update the displacement information */
-                if (star_formation_need_update_dx_max) {
-                  const float dx2_part = xp->x_diff[0] * xp->x_diff[0] +
-                                         xp->x_diff[1] * xp->x_diff[1] +
-                                         xp->x_diff[2] * xp->x_diff[2];
-                  const float dx2_sort =
-                      xp->x_diff_sort[0] * xp->x_diff_sort[0] +
-                      xp->x_diff_sort[1] * xp->x_diff_sort[1] +
-                      xp->x_diff_sort[2] * xp->x_diff_sort[2];
-
-                  const float dx_part = sqrtf(dx2_part);
-                  const float dx_sort = sqrtf(dx2_sort);
-
-                  /* Note: no need to update quantities further up the tree as
-                     this task is always called at the top-level */
-                  c->hydro.dx_max_part = max(c->hydro.dx_max_part, dx_part);
-                  c->hydro.dx_max_sort = max(c->hydro.dx_max_sort, dx_sort);
-                }
-
-#ifdef WITH_CSDS
-                if (spawn_spart) {
-                  /* Set to zero the csds data. */
-                  csds_part_data_init(&sp->csds_data);
-                } else {
-                  /* Copy the properties back to the stellar particle */
-                  sp->csds_data = xp->csds_data;
-                }
-
-                /* Write the s-particle */
-                csds_log_spart(e->csds, sp, e, /* log_all */ 1,
-                               csds_flag_create,
-                               /* data */ 0);
-#endif
-              } else if (swift_star_formation_model_creates_stars) {
-
-                /* Do something about the fact no star could be formed.
-                   Note that in such cases a tree rebuild to create more free
-                   slots has already been triggered by the function
-                   cell_convert_part_to_spart() */
-                star_formation_no_spart_available(e, p, xp);
+              /* First one of the leaf? */
+              if (events == NULL) {
+                events = (struct star_formation_event *)runner_scratch_alloc(
+                    &r->scratch,
+                    (count - k) * sizeof(struct star_formation_event));
               }
 
-              /* We have spawned a particle, decrease the counter of particles
-               * to create */
-              n_spart_to_create--;
-
-            } /* while n_spart_to_create > 0 */
+              events[nr_events].k = k;
+              events[nr_events].n_spart_spawn = n_spart_spawn;
+              events[nr_events].n_spart_convert = n_spart_convert;
+              nr_events++;
+              nr_sparts += n_spart_spawn + n_spart_convert;
+            }
           }
 
         } else { /* Are we not star-forming? */
@@ -547,6 +594,129 @@ void runner_do_star_formation(struct runner *r, struct cell *c, int timer) {
         }
       }
     } /* Loop over particles */
+
+    /* Reserve all the new stars of the leaf at once. They are the first
+     * sparts of the cell. */
+    const int nr_reserved = swift_star_formation_model_creates_stars
+                                ? cell_add_sparts(e, c, nr_sparts)
+                                : 0;
+    int next_reserved = 0;
+
+    /* Now create the stars */
+    for (int i = 0; i < nr_events; i++) {
+
+      struct part *restrict p = &parts[events[i].k];
+      struct xpart *restrict xp = &xparts[events[i].k];
+      const int n_spart_convert = events[i].n_spart_convert;
+
+      int n_spart_to_create = events[i].n_spart_spawn + n_spart_convert;
+
+      while (n_spart_to_create > 0) {
+
+        struct spart *sp = NULL;
+        int part_converted;
+
+        /* Are we using a model that actually generates star particles? */
+        if (swift_star_formation_model_creates_stars) {
+
+          /* Any reserved spart left? */
+          struct spart *sp_free = next_reserved < nr_reserved
+                                      ? &c->stars.parts[next_reserved++]
+                                      : NULL;
+
+          /* Check if we should create a new particle or transform one */
+          if (n_spart_to_create == 1 && n_spart_convert == 1) {
+            /* Convert the gas particle to a star particle */
+            if (sp_free != NULL)
+              sp = cell_convert_part_to_spart(e, c, p, xp, sp_free);
+            part_converted = 1;
+#ifdef WITH_CSDS
+            /* Write the particle */
+            /* Logs all the fields request by the user */
+            // TODO select only the requested fields
+            csds_log_part(e->csds, p, xp, e, /* log_all */ 1,
+                          csds_flag_change_type, swift_type_stars);
+#endif
+          } else {
+            /* Spawn a new spart (+ gpart) */
+            if (sp_free != NULL)
+              sp = cell_spawn_new_spart_from_part(e, c, p, xp, sp_free);
+            part_converted = 0;
+          }
+
+        } else {
+
+          /* We are in a model where spart don't exist
+           * --> convert the part to a DM gpart */
+          cell_convert_part_to_gpart(e, c, p, xp);
+          part_converted = 1;
+        }
+
+        /* Did we get a star? (Or did we run out of spare ones?) */
+        if (sp != NULL) {
+
+          /* Copy the properties of the gas particle to the star particle
+           */
+          star_formation_copy_properties(p, xp, sp, e, sf_props, cosmo,
+                                         with_cosmology, phys_const,
+                                         hydro_props, us, cooling,
+                                         part_converted);
+
+          /* Update the Star formation history */
+          star_formation_logger_log_new_spart(sp, &c->stars.sfh);
+
+          /* Update the h_max */
+          c->stars.h_max = max(c->stars.h_max, sp->h);
+          c->stars.h_max_active = max(c->stars.h_max_active, sp->h);
+
+          /* Update the displacement information */
+          if (star_formation_need_update_dx_max) {
+            const float dx2_part = xp->x_diff[0] * xp->x_diff[0] +
+                                   xp->x_diff[1] * xp->x_diff[1] +
+                                   xp->x_diff[2] * xp->x_diff[2];
+            const float dx2_sort = xp->x_diff_sort[0] * xp->x_diff_sort[0] +
+                                   xp->x_diff_sort[1] * xp->x_diff_sort[1] +
+                                   xp->x_diff_sort[2] * xp->x_diff_sort[2];
+
+            const float dx_part = sqrtf(dx2_part);
+            const float dx_sort = sqrtf(dx2_sort);
+
+            /* Note: no need to update quantities further up the tree as
+               this task is always called at the top-level */
+            c->hydro.dx_max_part = max(c->hydro.dx_max_part, dx_part);
+            c->hydro.dx_max_sort = max(c->hydro.dx_max_sort, dx_sort);
+          }
+
+#ifdef WITH_CSDS
+          if (spawn_spart) {
+            /* Set to zero the csds data. */
+            csds_part_data_init(&sp->csds_data);
+          } else {
+            /* Copy the properties back to the stellar particle */
+            sp->csds_data = xp->csds_data;
+          }
+
+          /* Write the s-particle */
+          csds_log_spart(e->csds, sp, e, /* log_all */ 1, csds_flag_create,
+                         /* data */ 0);
+#endif
+        } else if (swift_star_formation_model_creates_stars) {
+
+          /* Do something about the fact no star could be formed.
+             Note that in such cases a tree rebuild to create more free
+             slots has already been triggered by the function
+             cell_add_sparts() */
+          star_formation_no_spart_available(e, p, xp);
+        }
+
+        /* We have spawned a particle, decrease the counter of particles
+         * to create */
+        n_spart_to_create--;
+
+      } /* while n_spart_to_create > 0 */
+    } /* Loop over the star forming particles */
+
+    runner_scratch_release(&r->scratch, scratch_mark);
   }
 
   /* If we formed any stars, the star sorts are now invalid. We need to
@@ -793,10 +963,19 @@ void runner_do_end_grav_force(struct runner *r, struct cell *c, int timer) {
     const int gcount = c->grav.count;
     struct gpart *restrict gparts = c->grav.parts;
 
+    /* Collect what the GPU accumulated for these particles */
+    cuda_gpart_mirror_download(r, c);
+
+    /* Only visit the active ones if we know which they are */
+    int nr_active = 0;
+    const int *active = gpart_soa_active_list(e, c, &nr_active);
+    const int nr_loop = active != NULL ? nr_active : gcount;
+
     /* Loop over the g-particles in this cell. */
-    for (int k = 0; k < gcount; k++) {
+    for (int n = 0; n < nr_loop; n++) {
 
       /* Get a handle on the gpart. */
+      const int k = active != NULL ? active[n] : n;
       struct gpart *restrict gp = &gparts[k];
 
       if (gpart_is_active(gp, e)) {
@@ -937,6 +1116,16 @@ void runner_do_csds(struct runner *r, struct cell *c, int timer) {
       if (c->progeny[k] != NULL) runner_do_csds(r, c->progeny[k], 0);
   } else {
 
+    /* The particles to write. They are only written once all of them are
+     * known, such that the leaf reserves its records in the logfile in one
+     * go rather than once per particle. */
+    const struct runner_scratch_mark scratch_mark =
+        runner_scratch_mark(&r->scratch);
+    const int max_count = max3(count, gcount, scount);
+    int *ind =
+        (int *)runner_scratch_alloc(&r->scratch, max_count * sizeof(int));
+    int nr_write = 0;
+
     /* Loop over the parts in this cell. */
     for (int k = 0; k < count; k++) {
 
@@ -947,17 +1136,22 @@ void runner_do_csds(struct runner *r, struct cell *c, int timer) {
       /* If particle needs to be log */
       if (part_is_active(p, e)) {
 
-        if (csds_should_write(&xp->csds_data, e->csds)) {
-          /* Write particle */
-          /* Currently writing everything, should adapt it through time */
-          csds_log_part(e->csds, p, xp, e, /* log_all_fields= */ 0,
-                        csds_flag_none, /* flag_data= */ 0);
-        } else
+        if (csds_should_write(&xp->csds_data, e->csds))
+          ind[nr_write++] = k;
+        else
           /* Update counter */
           xp->csds_data.steps_since_last_output += 1;
       }
     }
 
+    /* Write the particles */
+    /* Currently writing everything, should adapt it through time */
+    if (nr_write > 0)
+      csds_log_parts_selection(e->csds, parts, xparts, ind, nr_write, e,
+                               /* log_all_fields= */ 0, csds_flag_none,
+                               /* flag_data= */ 0);
+    nr_write = 0;
+
     /* Loop over the gparts in this cell. */
     for (int k = 0; k < gcount; k++) {
 
@@ -972,18 +1166,21 @@ void runner_do_csds(struct runner *r, struct cell *c, int timer) {
       /* If particle needs to be log */
       if (gpart_is_active(gp, e)) {
 
-        if (csds_should_write(&gp->csds_data, e->csds)) {
-          /* Write particle */
-          /* Currently writing everything, should adapt it through time */
-          csds_log_gpart(e->csds, gp, e, /* log_all_fields= */ 0,
-                         csds_flag_none, /* flag_data= */ 0);
-
-        } else
+        if (csds_should_write(&gp->csds_data, e->csds))
+          ind[nr_write++] = k;
+        else
           /* Update counter */
           gp->csds_data.steps_since_last_output += 1;
       }
     }
 
+    /* Write the particles */
+    if (nr_write > 0)
+      csds_log_gparts_selection(e->csds, gparts, ind, nr_write, e,
+                                /* log_all_fields= */ 0, csds_flag_none,
+                                /* flag_data= */ 0);
+    nr_write = 0;
+
     /* Loop over the sparts in this cell. */
     for (int k = 0; k < scount; k++) {
 
@@ -993,16 +1190,21 @@ void runner_do_csds(struct runner *r, struct cell *c, int timer) {
       /* If particle needs to be log */
       if (spart_is_active(sp, e)) {
 
-        if (csds_should_write(&sp->csds_data, e->csds)) {
-          /* Write particle */
-          /* Currently writing everything, should adapt it through time */
-          csds_log_spart(e->csds, sp, e, /* Log_all_fields= */ 0,
-                         csds_flag_none, /* flag_data= */ 0);
-        } else
+        if (csds_should_write(&sp->csds_data, e->csds))
+          ind[nr_write++] = k;
+        else
           /* Update counter */
           sp->csds_data.steps_since_last_output += 1;
       }
     }
+
+    /* Write the particles */
+    if (nr_write > 0)
+      csds_log_sparts_selection(e->csds, sparts, ind, nr_write, e,
+                                /* log_all_fields= */ 0, csds_flag_none,
+                                /* flag_data= */ 0);
+
+    runner_scratch_release(&r->scratch, scratch_mark);
   }
 
   if (timer) TIMER_TOC(timer_csds);
@@ -1030,7 +1232,7 @@ void runner_do_fof_search_self(struct runner *r, struct cell *c, int timer) {
   const double dim[3] = {s->dim[0], s->dim[1], s->dim[2]};
   const int periodic = s->periodic;
   const struct gpart *const gparts = s->gparts;
-  const double search_r2 = e->fof_properties->l_x2;
+  const double search_r2 = e->fof_properties->search_l_x2;
 
   rec_fof_search_self(e->fof_properties, dim, search_r2, periodic, gparts, c);
 
@@ -1065,7 +1267,7 @@ void runner_do_fof_search_pair(struct runner *r, struct cell *ci,
   const double dim[3] = {s->dim[0], s->dim[1], s->dim[2]};
   const int periodic = s->periodic;
   const struct gpart *const gparts = s->gparts;
-  const double search_r2 = e->fof_properties->l_x2;
+  const double search_r2 = e->fof_properties->search_l_x2;
 
   rec_fof_search_pair(e->fof_properties, dim, search_r2, periodic, gparts, ci,
                       cj);
@@ -1172,6 +1374,9 @@ void runner_do_rt_tchem(struct runner *r, struct cell *c, int timer) {
     struct part *restrict parts = c->hydro.parts;
     struct xpart *restrict xparts = c->hydro.xparts;
 
+    /* Large enough to solve the particles together on the GPU? */
+    const int on_gpu = cuda_rt_tchem_on_gpu(count);
+
     /* Loop over the gas particles in this cell. */
     for (int k = 0; k < count; k++) {
 
@@ -1209,8 +1414,14 @@ void runner_do_rt_tchem(struct runner *r, struct cell *c, int timer) {
       rt_finalise_transport(p, rt_props, dt, cosmo);
 
       /* And finally do thermochemistry */
-      rt_tchem(p, xp, rt_props, cosmo, hydro_props, phys_const, us, dt);
+      if (on_gpu)
+        cuda_rt_tchem_add(r, p, xp, dt);
+      else
+        rt_tchem(p, xp, rt_props, cosmo, hydro_props, phys_const, us, dt);
     }
+
+    /* Solve the particles queued for the GPU */
+    if (on_gpu) cuda_rt_tchem_flush(r);
   }
 
   if (timer) TIMER_TOC(timer_do_rt_tchem);
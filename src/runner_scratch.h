@@ -0,0 +1,179 @@
+#ifndef SWIFT_RUNNER_SCRATCH_H
+#define SWIFT_RUNNER_SCRATCH_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* System includes. */
+#include <stddef.h>
+
+/* Local headers. */
+#include "align.h"
+#include "error.h"
+#include "inline.h"
+#include "memuse.h"
+
+/*! Alignment of the blocks handed out by a #runner_scratch */
+#define runner_scratch_align SWIFT_STRUCT_ALIGNMENT
+
+/*! Head-room given to the #runner_scratch arena when it grows */
+#define runner_scratch_growth 1.25
+
+/*! Maximal number of blocks that did not fit in the arena within a task */
+#define runner_scratch_max_overflow 16
+
+/**
+ * @brief Temporary memory of the tasks of a #runner.
+ *
+ * Blocks are handed out one after the other from a single arena and given
+ * back in the reverse order, or all at once when the task is done. A block
+ * that does not fit comes from the allocator instead, and the arena is grown
+ * to the largest need seen so far once it is empty again. After the first
+ * few steps, the tasks hence no longer hit the allocator at all.
+ */
+struct runner_scratch {
+
+  /*! The arena. */
+  char *data;
+
+  /*! Number of bytes of the arena allocated and in use. */
+  size_t size, used;
+
+  /*! Largest number of bytes in use at once since the arena last grew. */
+  size_t peak;
+
+  /*! The blocks that did not fit in the arena, and their sizes. */
+  void *overflow[runner_scratch_max_overflow];
+  size_t overflow_size[runner_scratch_max_overflow];
+
+  /*! Number of bytes of these blocks. */
+  size_t overflow_bytes;
+
+  /*! Number of these blocks. */
+  int nr_overflow;
+};
+
+/**
+ * @brief What a #runner_scratch had handed out at some point.
+ */
+struct runner_scratch_mark {
+
+  /*! Number of bytes of the arena in use. */
+  size_t used;
+
+  /*! Number of blocks that did not fit in the arena. */
+  int nr_overflow;
+};
+
+/**
+ * @brief Hand out a block of a #runner_scratch.
+ *
+ * The block is valid until runner_scratch_release() is called with a mark
+ * taken before it, or the end of the task.
+ *
+ * @param s The #runner_scratch.
+ * @param bytes The size of the block.
+ */
+static INLINE void *runner_scratch_alloc(struct runner_scratch *s,
+                                         size_t bytes) {
+
+  bytes = (bytes + runner_scratch_align - 1) & ~(runner_scratch_align - 1);
+
+  void *ptr = NULL;
+  if (s->used + bytes <= s->size) {
+
+    /* Room left in the arena */
+    ptr = s->data + s->used;
+    s->used += bytes;
+
+  } else {
+
+    /* Get it from the allocator until the arena has grown */
+    if (s->nr_overflow == runner_scratch_max_overflow)
+      error("Too many scratch blocks for a single task.");
+    if (swift_memalign("runner_scratch", &ptr, runner_scratch_align,
+                       bytes) != 0)
+      error("Failed to allocate %zd bytes of scratch memory.", bytes);
+    s->overflow[s->nr_overflow] = ptr;
+    s->overflow_size[s->nr_overflow] = bytes;
+    s->nr_overflow++;
+    s->overflow_bytes += bytes;
+  }
+
+  if (s->used + s->overflow_bytes > s->peak)
+    s->peak = s->used + s->overflow_bytes;
+  return ptr;
+}
+
+/**
+ * @brief What a #runner_scratch has handed out so far.
+ *
+ * @param s The #runner_scratch.
+ */
+static INLINE struct runner_scratch_mark runner_scratch_mark(
+    const struct runner_scratch *s) {
+
+  struct runner_scratch_mark mark = {s->used, s->nr_overflow};
+  return mark;
+}
+
+/**
+ * @brief Give back the blocks of a #runner_scratch handed out since a mark.
+ *
+ * Once nothing is in use anymore, the arena grows to the largest need seen
+ * so far if it was too small.
+ *
+ * @param s The #runner_scratch.
+ * @param mark The mark from runner_scratch_mark().
+ */
+static INLINE void runner_scratch_release(
+    struct runner_scratch *s, const struct runner_scratch_mark mark) {
+#ifdef SWIFT_DEBUG_CHECKS
+  if (mark.used > s->used || mark.nr_overflow > s->nr_overflow)
+    error("Releasing scratch memory not handed out.");
+#endif
+
+  while (s->nr_overflow > mark.nr_overflow) {
+    s->nr_overflow--;
+    swift_free("runner_scratch", s->overflow[s->nr_overflow]);
+    s->overflow_bytes -= s->overflow_size[s->nr_overflow];
+  }
+  s->used = mark.used;
+
+  /* Grow the arena while it is empty? */
+  if (s->used == 0 && s->nr_overflow == 0 && s->peak > s->size) {
+    const size_t new_size = runner_scratch_growth * s->peak;
+    if (s->size > 0) swift_free("runner_scratch", s->data);
+    if (swift_memalign("runner_scratch", (void **)&s->data,
+                       runner_scratch_align, new_size) != 0)
+      error("Failed to allocate %zd bytes of scratch memory.", new_size);
+    s->size = new_size;
+  }
+}
+
+/**
+ * @brief Give back all the blocks of a #runner_scratch at the end of a task.
+ *
+ * @param s The #runner_scratch.
+ */
+static INLINE void runner_scratch_reset(struct runner_scratch *s) {
+
+  const struct runner_scratch_mark empty = {0, 0};
+  runner_scratch_release(s, empty);
+}
+
+/**
+ * @brief Free the memory of a #runner_scratch.
+ *
+ * @param s The #runner_scratch.
+ */
+static INLINE void runner_scratch_clean(struct runner_scratch *s) {
+
+  runner_scratch_reset(s);
+  if (s->size > 0) swift_free("runner_scratch", s->data);
+  s->data = NULL;
+  s->size = 0;
+  s->peak = 0;
+}
+
+#endif /* SWIFT_RUNNER_SCRATCH_H */
@@ -22,6 +22,11 @@
 /* Config parameters. */
 #include <config.h>
 
+/* System includes. */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
 /* This object's header. */
 #include "runner.h"
 
@@ -67,7 +72,7 @@ void runner_do_stars_resort(struct runner *r, struct cell *c, const int timer) {
  * @param sort The entries
  * @param N The number of entries.
  */
-void runner_do_sort_ascending(struct sort_entry *sort, int N) {
+void runner_do_sort_ascending_quicksort(struct sort_entry *sort, int N) {
 
   struct {
     short int lo, hi;
@@ -162,6 +167,153 @@ void runner_do_sort_ascending(struct sort_entry *sort, int N) {
   }
 }
 
+/**
+ * @brief Maps a float to an unsigned int with the same ordering.
+ *
+ * The sign bit is flipped for the positive values and all the bits are
+ * flipped for the negative ones.
+ *
+ * @param d The float.
+ */
+__attribute__((always_inline)) INLINE static uint32_t runner_sort_key(
+    const float d) {
+
+  uint32_t u;
+  memcpy(&u, &d, sizeof(uint32_t));
+  const uint32_t mask = (u & 0x80000000u) ? 0xffffffffu : 0x80000000u;
+  return u ^ mask;
+}
+
+/**
+ * @brief Sort the entries in ascending order using a LSD radix sort on the
+ * bytes of the keys.
+ *
+ * The four histograms are built in a single pass and the passes of the bytes
+ * all the entries share (the leading bytes, for the close-by particles of a
+ * cell) are skipped.
+ *
+ * @param sort The entries
+ * @param N The number of entries.
+ */
+void runner_do_sort_ascending_radix(struct sort_entry *sort, const int N) {
+
+  /* Keys and entries, and their copies for the out-of-place passes. The
+   * usual leaves fit on the stack. */
+  uint32_t keys_stack[2 * sort_radix_stack_size];
+  struct sort_entry buff_stack[sort_radix_stack_size];
+  uint32_t *keys = keys_stack;
+  struct sort_entry *buff = buff_stack;
+  if (N > sort_radix_stack_size) {
+    keys = (uint32_t *)malloc(2 * N * sizeof(uint32_t));
+    buff = (struct sort_entry *)malloc(N * sizeof(struct sort_entry));
+    if (keys == NULL || buff == NULL)
+      error("Failed to allocate the radix sort buffers.");
+  }
+  uint32_t *keys_buff = keys + N;
+
+  /* Histograms of the four bytes */
+  int count[4][256];
+  bzero(count, sizeof(count));
+  for (int k = 0; k < N; k++) {
+    const uint32_t key = runner_sort_key(sort[k].d);
+    keys[k] = key;
+    count[0][key & 0xff]++;
+    count[1][(key >> 8) & 0xff]++;
+    count[2][(key >> 16) & 0xff]++;
+    count[3][key >> 24]++;
+  }
+
+  struct sort_entry *from = sort, *to = buff;
+  uint32_t *keys_from = keys, *keys_to = keys_buff;
+  for (int pass = 0; pass < 4; pass++) {
+
+    /* Nothing to do if all the entries have the same byte here */
+    const int shift = 8 * pass;
+    if (count[pass][(keys[0] >> shift) & 0xff] == N) continue;
+
+    /* Offsets of the buckets */
+    int offset[256];
+    int total = 0;
+    for (int b = 0; b < 256; b++) {
+      offset[b] = total;
+      total += count[pass][b];
+    }
+
+    /* Stable scatter */
+    for (int k = 0; k < N; k++) {
+      const int b = (keys_from[k] >> shift) & 0xff;
+      const int ind = offset[b]++;
+      to[ind] = from[k];
+      keys_to[ind] = keys_from[k];
+    }
+
+    struct sort_entry *temp = from;
+    from = to;
+    to = temp;
+    uint32_t *keys_temp = keys_from;
+    keys_from = keys_to;
+    keys_to = keys_temp;
+  }
+
+  /* Did we end in the buffer? */
+  if (from != sort) memcpy(sort, from, N * sizeof(struct sort_entry));
+
+  if (N > sort_radix_stack_size) {
+    free(keys);
+    free(buff);
+  }
+}
+
+/**
+ * @brief Sort the entries in ascending order.
+ *
+ * The small arrays are sorted with QuickSort, the large ones with a radix
+ * sort.
+ *
+ * @param sort The entries
+ * @param N The number of entries.
+ */
+void runner_do_sort_ascending(struct sort_entry *sort, int N) {
+
+  if (N < sort_radix_threshold)
+    runner_do_sort_ascending_quicksort(sort, N);
+  else
+    runner_do_sort_ascending_radix(sort, N);
+}
+
+/**
+ * @brief Sort entries that are already nearly in ascending order.
+ *
+ * An insertion sort, linear in the number of entries when they only moved
+ * by a few places. If too many shifts are needed, we finish with a full
+ * sort instead.
+ *
+ * @param sort The entries
+ * @param N The number of entries.
+ */
+void runner_do_resort_ascending(struct sort_entry *sort, int N) {
+
+  const long long max_shifts = (long long)sort_resort_max_shifts * N;
+  long long shifts = 0;
+
+  for (int i = 1; i < N; i++) {
+    const struct sort_entry temp = sort[i];
+    int j = i - 1;
+    while (j >= 0 && sort[j].d > temp.d) {
+      sort[j + 1] = sort[j];
+      j--;
+    }
+    sort[j + 1] = temp;
+
+    /* Not that nearly sorted after all? */
+    shifts += i - 1 - j;
+    if (shifts > max_shifts) {
+      runner_do_sort_ascending(sort, N);
+      return;
+    }
+  }
+}
+
 #ifdef SWIFT_DEBUG_CHECKS
 /**
  * @brief Recursively checks that the flags are consistent in a cell hierarchy.
@@ -249,6 +401,10 @@ void runner_do_hydro_sort(struct runner *r, struct cell *c, int flags,
   if (c->hydro.sorted == 0) c->hydro.ti_sort = r->e->ti_current;
 #endif
 
+  /* The directions sorted at an earlier step still hold a permutation of
+   * the particles (until the next rebuild frees them). */
+  const int sort_allocated_old = c->hydro.sort_allocated;
+
   /* Allocate memory for sorting. */
   cell_malloc_hydro_sorts(c, flags);
 
@@ -375,11 +531,21 @@ void runner_do_hydro_sort(struct runner *r, struct cell *c, int flags,
       c->hydro.dx_max_sort = 0.f;
     }
 
+    /* Which of the old sorts can be repaired? Their sentinel must still be
+     * where the particles end. */
+    int resort = 0;
+    for (int j = 0; j < 13; j++)
+      if (flags & sort_allocated_old & (1 << j)) {
+        const struct sort_entry *entries = cell_get_hydro_sorts(c, j);
+        if (entries[count].d == FLT_MAX && entries[count].i == 0)
+          resort |= (1 << j);
+      }
+
     /* Fill the sort array. */
     for (int k = 0; k < count; k++) {
       const double px[3] = {parts[k].x[0], parts[k].x[1], parts[k].x[2]};
       for (int j = 0; j < 13; j++)
-        if (flags & (1 << j)) {
+        if ((flags & ~resort) & (1 << j)) {
           struct sort_entry *entries = cell_get_hydro_sorts(c, j);
           entries[k].i = k;
           entries[k].d = px[0] * runner_shift[j][0] +
@@ -388,13 +554,28 @@ void runner_do_hydro_sort(struct runner *r, struct cell *c, int flags,
         }
     }
 
+    /* Update the distances of the old sorts, in their old order. */
+    for (int j = 0; j < 13; j++)
+      if (resort & (1 << j)) {
+        struct sort_entry *entries = cell_get_hydro_sorts(c, j);
+        for (int k = 0; k < count; k++) {
+          const double *px = parts[entries[k].i].x;
+          entries[k].d = px[0] * runner_shift[j][0] +
+                         px[1] * runner_shift[j][1] +
+                         px[2] * runner_shift[j][2];
+        }
+      }
+
     /* Add the sentinel and sort. */
     for (int j = 0; j < 13; j++)
       if (flags & (1 << j)) {
         struct sort_entry *entries = cell_get_hydro_sorts(c, j);
         entries[count].d = FLT_MAX;
         entries[count].i = 0;
-        runner_do_sort_ascending(entries, count);
+        if (resort & (1 << j))
+          runner_do_resort_ascending(entries, count);
+        else
+          runner_do_sort_ascending(entries, count);
         atomic_or(&c->hydro.sorted, 1 << j);
       }
   }
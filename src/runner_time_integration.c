@@ -31,8 +31,10 @@
 #include "cell.h"
 #include "engine.h"
 #include "feedback.h"
+#include "gpart_soa.h"
 #include "kick.h"
 #include "multipole.h"
+#include "neutrino.h"
 #include "timers.h"
 #include "timestep.h"
 #include "timestep_limiter.h"
@@ -92,6 +94,7 @@ void runner_do_kick1(struct runner *r, struct cell *c, const int timer) {
   const struct entropy_floor_properties *entropy_floor = e->entropy_floor;
   const int periodic = e->s->periodic;
   const int with_cosmology = (e->policy & engine_policy_cosmology);
+  const int with_delta_f = e->neutrino_properties->use_delta_f;
   struct part *restrict parts = c->hydro.parts;
   struct xpart *restrict xparts = c->hydro.xparts;
   struct gpart *restrict gparts = c->grav.parts;
@@ -109,9 +112,12 @@ void runner_do_kick1(struct runner *r, struct cell *c, const int timer) {
   TIMER_TIC;
 
   /* Anything to do here? */
-  if (!cell_is_starting_hydro(c, e) && !cell_is_starting_gravity(c, e) &&
-      !cell_is_starting_stars(c, e) && !cell_is_starting_sinks(c, e) &&
-      !cell_is_starting_black_holes(c, e))
+  if (e->policy & engine_policy_gravity_only) {
+    if (!cell_is_starting_gravity(c, e)) return;
+  } else if (!cell_is_starting_hydro(c, e) &&
+             !cell_is_starting_gravity(c, e) &&
+             !cell_is_starting_stars(c, e) && !cell_is_starting_sinks(c, e) &&
+             !cell_is_starting_black_holes(c, e))
     return;
 
   /* Recurse? */
@@ -124,6 +130,14 @@ void runner_do_kick1(struct runner *r, struct cell *c, const int timer) {
     integertime_t ti_end_mesh = 0;
     double dt_kick_mesh_grav = 0.;
 
+    /* Retrieve the constants of the delta-f weighting of the neutrinos */
+    struct neutrino_model nu_model;
+    if (with_delta_f) {
+      if (!with_cosmology)
+        error("Phase space weighting without cosmology not implemented.");
+      gather_neutrino_consts(e->s, &nu_model);
+    }
+
     /* Are we at a step where we do mesh-gravity time-integration? */
     if (periodic && e->mesh->ti_beg_mesh_next == e->ti_current) {
 
@@ -191,10 +205,16 @@ void runner_do_kick1(struct runner *r, struct cell *c, const int timer) {
       }
     }
 
+    /* Only visit the active g-particles if we know which they are */
+    int nr_active = 0;
+    const int *active = gpart_soa_active_list(e, c, &nr_active);
+    const int nr_loop = active != NULL ? nr_active : gcount;
+
     /* Loop over the gparts in this cell. */
-    for (int k = 0; k < gcount; k++) {
+    for (int n = 0; n < nr_loop; n++) {
 
       /* Get a handle on the part. */
+      const int k = active != NULL ? active[n] : n;
       struct gpart *restrict gp = &gparts[k];
 
 #ifdef SWIFT_DEBUG_CHECKS
@@ -235,6 +255,10 @@ void runner_do_kick1(struct runner *r, struct cell *c, const int timer) {
         /* Do the kick */
         kick_gpart(gp, dt_kick_grav, ti_begin, ti_end, dt_kick_mesh_grav,
                    ti_begin_mesh, ti_end_mesh);
+
+        /* Weight the neutrinos with their new velocity */
+        if (with_delta_f && gp->type == swift_type_neutrino)
+          gpart_neutrino_set_weighted_mass(gp, &nu_model);
       }
     }
 
@@ -382,9 +406,11 @@ void runner_do_kick2(struct runner *r, struct cell *c, const int timer) {
   TIMER_TIC;
 
   /* Anything to do here? */
-  if (!cell_is_active_hydro(c, e) && !cell_is_active_gravity(c, e) &&
-      !cell_is_active_stars(c, e) && !cell_is_active_sinks(c, e) &&
-      !cell_is_active_black_holes(c, e))
+  if (e->policy & engine_policy_gravity_only) {
+    if (!cell_is_active_gravity(c, e)) return;
+  } else if (!cell_is_active_hydro(c, e) && !cell_is_active_gravity(c, e) &&
+             !cell_is_active_stars(c, e) && !cell_is_active_sinks(c, e) &&
+             !cell_is_active_black_holes(c, e))
     return;
 
   /* Recurse? */
@@ -464,10 +490,16 @@ void runner_do_kick2(struct runner *r, struct cell *c, const int timer) {
       }
     }
 
+    /* Only visit the active g-particles if we know which they are */
+    int nr_active = 0;
+    const int *active = gpart_soa_active_list(e, c, &nr_active);
+    const int nr_loop = active != NULL ? nr_active : gcount;
+
     /* Loop over the g-particles in this cell. */
-    for (int k = 0; k < gcount; k++) {
+    for (int n = 0; n < nr_loop; n++) {
 
       /* Get a handle on the part. */
+      const int k = active != NULL ? active[n] : n;
       struct gpart *restrict gp = &gparts[k];
 
 #ifdef SWIFT_DEBUG_CHECKS
@@ -626,6 +658,132 @@ void runner_do_kick2(struct runner *r, struct cell *c, const int timer) {
   if (timer) TIMER_TOC(timer_kick2);
 }
 
+/**
+ * @brief Computes the next time-step of all active #gpart in this cell
+ * and update the cell's gravity statistics.
+ *
+ * Version of runner_do_timestep() for engine_policy_gravity_only runs: the
+ * cells hold nothing but dark matter and neutrino #gpart so only the
+ * gravity fields of the cells are read and written.
+ *
+ * @param r The runner thread.
+ * @param c The cell.
+ */
+static void runner_do_timestep_gravity_only(struct runner *r, struct cell *c) {
+
+  const struct engine *e = r->e;
+  const integertime_t ti_current = e->ti_current;
+
+  /* Anything to do here? */
+  if (!cell_is_active_gravity(c, e)) {
+    c->grav.updated = 0;
+    return;
+  }
+
+  int g_updated = 0;
+  integertime_t ti_gravity_end_min = max_nr_timesteps, ti_gravity_beg_max = 0;
+
+  /* No children? */
+  if (!c->split) {
+
+    struct gpart *restrict gparts = c->grav.parts;
+    const int gcount = c->grav.count;
+    int bin_changed = 0;
+
+    /* Loop over the g-particles in this cell. */
+    for (int k = 0; k < gcount; k++) {
+
+      /* Get a handle on the part. */
+      struct gpart *restrict gp = &gparts[k];
+
+#ifdef SWIFT_DEBUG_CHECKS
+      if (gp->type != swift_type_dark_matter &&
+          gp->type != swift_type_dark_matter_background &&
+          gp->type != swift_type_neutrino)
+        error("Baryonic g-particle in a gravity-only run.");
+#endif
+
+      /* need to be updated ? */
+      if (gpart_is_active(gp, e)) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+        /* Current end of time-step */
+        const integertime_t ti_end =
+            get_integer_time_end(ti_current, gp->time_bin);
+
+        if (ti_end != ti_current)
+          error("Computing time-step of rogue particle.");
+#endif
+
+        /* Get new time-step */
+        const integertime_t ti_new_step = get_gpart_timestep(gp, e);
+
+        /* Update particle */
+        const timebin_t new_time_bin = get_time_bin(ti_new_step);
+        bin_changed |= (new_time_bin != gp->time_bin);
+        gp->time_bin = new_time_bin;
+
+        /* Number of updated g-particles */
+        g_updated++;
+
+        /* What is the next sync-point ? */
+        ti_gravity_end_min = min(ti_current + ti_new_step, ti_gravity_end_min);
+
+        /* What is the next starting point for this cell ? */
+        ti_gravity_beg_max = max(ti_current, ti_gravity_beg_max);
+
+      } else { /* gpart is inactive */
+
+        if (!gpart_is_inhibited(gp, e)) {
+
+          const integertime_t ti_end =
+              get_integer_time_end(ti_current, gp->time_bin);
+
+          /* What is the next sync-point ? */
+          ti_gravity_end_min = min(ti_end, ti_gravity_end_min);
+
+          const integertime_t ti_beg =
+              get_integer_time_begin(ti_current + 1, gp->time_bin);
+
+          /* What is the next starting point for this cell ? */
+          ti_gravity_beg_max = max(ti_beg, ti_gravity_beg_max);
+        }
+      }
+    }
+
+    /* The cached active cells of engine_unskip() are now stale */
+    if (bin_changed) atomic_inc(&r->e->time_bin_changes);
+
+  } else {
+
+    /* Loop over the progeny. */
+    for (int k = 0; k < 8; k++) {
+      if (c->progeny[k] != NULL) {
+        struct cell *restrict cp = c->progeny[k];
+
+        /* Recurse */
+        runner_do_timestep_gravity_only(r, cp);
+
+        /* And aggregate */
+        g_updated += cp->grav.updated;
+        ti_gravity_end_min = min(cp->grav.ti_end_min, ti_gravity_end_min);
+        ti_gravity_beg_max = max(cp->grav.ti_beg_max, ti_gravity_beg_max);
+      }
+    }
+  }
+
+  /* Store the values. */
+  c->grav.updated = g_updated;
+  c->grav.ti_end_min = ti_gravity_end_min;
+  c->grav.ti_beg_max = ti_gravity_beg_max;
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (c->grav.ti_end_min == e->ti_current &&
+      c->grav.ti_end_min < max_nr_timesteps)
+    error("End of next gravity step is current time!");
+#endif
+}
+
 /**
  * @brief Computes the next time-step of all active particles in this cell
  * and update the cell's statistics.
@@ -659,6 +817,13 @@ void runner_do_timestep(struct runner *r, struct cell *c, const int timer) {
 
   TIMER_TIC;
 
+  /* Only the gravity side of the cells can change in gravity-only runs */
+  if (e->policy & engine_policy_gravity_only) {
+    runner_do_timestep_gravity_only(r, c);
+    if (timer) TIMER_TOC(timer_timestep);
+    return;
+  }
+
   /* Anything to do here? */
   if (!cell_is_active_hydro(c, e) && !cell_is_active_gravity(c, e) &&
       !cell_is_active_stars(c, e) && !cell_is_active_sinks(c, e) &&
@@ -1212,6 +1377,30 @@ void runner_do_timestep_collect(struct runner *r, struct cell *c,
    * The time-step task would have set things at this level already */
   if (c->super == c) return;
 
+  /* Only the gravity side of the cells can change in gravity-only runs */
+  if (r->e->policy & engine_policy_gravity_only) {
+
+    size_t g_updated = 0;
+    integertime_t ti_grav_end_min = max_nr_timesteps, ti_grav_beg_max = 0;
+
+    for (int k = 0; k < 8; k++) {
+      struct cell *cp = c->progeny[k];
+      if (cp != NULL) {
+        runner_do_timestep_collect(r, cp, 0);
+
+        ti_grav_end_min = min(ti_grav_end_min, cp->grav.ti_end_min);
+        ti_grav_beg_max = max(ti_grav_beg_max, cp->grav.ti_beg_max);
+        g_updated += cp->grav.updated;
+        cp->grav.updated = 0;
+      }
+    }
+
+    c->grav.ti_end_min = ti_grav_end_min;
+    c->grav.ti_beg_max = ti_grav_beg_max;
+    c->grav.updated = g_updated;
+    return;
+  }
+
   /* Counters for the different quantities. */
   size_t h_updated = 0;
   size_t g_updated = 0;
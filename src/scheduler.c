@@ -41,12 +41,15 @@
 
 /* Local headers. */
 #include "atomic.h"
+#include "cuda_devices.h"
 #include "cycle.h"
 #include "engine.h"
 #include "error.h"
 #include "intrinsics.h"
 #include "kernel_hydro.h"
 #include "memuse.h"
+#include "mpi_aggregate.h"
+#include "mpi_comm_stats.h"
 #include "mpiuse.h"
 #include "queue.h"
 #include "sort_part.h"
@@ -1380,6 +1383,40 @@ static void scheduler_splittask_hydro(struct task *t, struct scheduler *s) {
   } /* iterate over the current task. */
 }
 
+/**
+ * @brief Would splitting a self-gravity task make tasks too small?
+ *
+ * The task on the cell runs the self and pair interactions of its progeny one
+ * after the other, under a single lock. Keeping it whole hence fuses the tasks
+ * the split would create, which is worth it when they would on average do
+ * fewer than #scheduler.grav_task_min_interactions interactions each.
+ *
+ * @param s The #scheduler.
+ * @param c The #cell of the task.
+ */
+static int scheduler_self_grav_split_too_fine(const struct scheduler *s,
+                                              const struct cell *c) {
+
+  if (s->grav_task_min_interactions <= 0) return 0;
+
+  long long interactions = 0;
+  int nr_tasks = 0;
+  for (int j = 0; j < 8; j++) {
+    if (c->progeny[j] == NULL) continue;
+    const long long count_j = c->progeny[j]->grav.count;
+    interactions += count_j * count_j;
+    nr_tasks++;
+    for (int k = j + 1; k < 8; k++) {
+      if (c->progeny[k] == NULL) continue;
+      interactions += count_j * c->progeny[k]->grav.count;
+      nr_tasks++;
+    }
+  }
+
+  return nr_tasks > 0 &&
+         interactions < s->grav_task_min_interactions * nr_tasks;
+}
+
 /**
  * @brief Split a gravity task if too large.
  *
@@ -1421,6 +1458,9 @@ static void scheduler_splittask_gravity(struct task *t, struct scheduler *s) {
       if (cell_can_split_self_gravity_task(ci)) {
         if (scheduler_dosub && ci->grav.count < space_subsize_self_grav) {
           /* Otherwise, split it. */
+        } else if (t->subtype == task_subtype_grav &&
+                   scheduler_self_grav_split_too_fine(s, ci)) {
+          /* Keep the tiny progeny tasks fused in this one. */
         } else {
           /* Take a step back (we're going to recycle the current task)... */
           redo = 1;
@@ -1479,42 +1519,60 @@ static void scheduler_splittask_gravity(struct task *t, struct scheduler *s) {
             gcount_i * gcount_j < ((long long)space_subsize_pair_grav)) {
           /* Otherwise, split it. */
         } else {
-          /* Turn the task into a M-M task that will take care of all the
-           * progeny pairs */
-          t->type = task_type_grav_mm;
-          t->subtype = task_subtype_none;
-          t->flags = 0;
-
-          /* Make a task for every other pair of progeny */
+          /* Which pairs of progeny can use a M-M interaction? We use the 64
+           * bits of the M-M task's flags field to store this information.
+           * The corresponding task will unpack the information and operate
+           * according to the choices made here. */
+          unsigned long long mm_flags = 0ULL;
+          long long interactions = 0;
+          int nr_tasks = 0;
           for (int i = 0; i < 8; i++) {
             if (ci->progeny[i] != NULL) {
               for (int j = 0; j < 8; j++) {
                 if (cj->progeny[j] != NULL) {
-                  /* Can we use a M-M interaction here? */
                   if (cell_can_use_pair_mm(ci->progeny[i], cj->progeny[j], e,
                                            sp, /*use_rebuild_data=*/1,
                                            /*is_tree_walk=*/1)) {
-
-                    /* Flag this pair as being treated by the M-M task.
-                     * We use the 64 bits in the task->flags field to store
-                     * this information. The corresponding taks will unpack
-                     * the information and operate according to the choices
-                     * made here. */
-                    const int flag = i * 8 + j;
-                    t->flags |= (1ULL << flag);
-
+                    mm_flags |= (1ULL << (i * 8 + j));
                   } else {
-                    /* Ok, we actually have to create a task */
-                    scheduler_splittask_gravity(
-                        scheduler_addtask(s, task_type_pair, task_subtype_grav,
-                                          0, 0, ci->progeny[i], cj->progeny[j]),
-                        s);
+                    interactions += (long long)ci->progeny[i]->grav.count *
+                                    cj->progeny[j]->grav.count;
+                    nr_tasks++;
                   }
                 }
               }
             }
           }
 
+          /* Would the direct pairs be too small to get a task each? Keep
+           * them fused in this one, which walks the progeny one pair after
+           * the other under a single lock. */
+          if (nr_tasks > 0 && s->grav_task_min_interactions > 0 &&
+              interactions < s->grav_task_min_interactions * nr_tasks)
+            break;
+
+          /* Turn the task into a M-M task that will take care of all the
+           * progeny pairs */
+          t->type = task_type_grav_mm;
+          t->subtype = task_subtype_none;
+          t->flags = mm_flags;
+
+          /* Make a task for every other pair of progeny */
+          for (int i = 0; i < 8; i++) {
+            if (ci->progeny[i] != NULL) {
+              for (int j = 0; j < 8; j++) {
+                if (cj->progeny[j] != NULL &&
+                    !(mm_flags & (1ULL << (i * 8 + j)))) {
+                  /* Ok, we actually have to create a task */
+                  scheduler_splittask_gravity(
+                      scheduler_addtask(s, task_type_pair, task_subtype_grav,
+                                        0, 0, ci->progeny[i], cj->progeny[j]),
+                      s);
+                }
+              }
+            }
+          }
+
           /* Can none of the progenies use M-M calculations? */
           if (t->flags == 0) {
             t->type = task_type_none;
@@ -1735,7 +1793,13 @@ struct task *scheduler_addtask(struct scheduler *s, enum task_types type,
 #endif
   t->tic = 0;
   t->toc = 0;
+  t->enqueued = 0;
   t->total_ticks = 0;
+  t->nr_runs = 0;
+  t->grav_walk = NULL;
+#ifdef WITH_MPI
+  t->buff_last = NULL;
+#endif
 
   if (ci != NULL) cell_set_flag(ci, cell_flag_has_tasks);
   if (cj != NULL) cell_set_flag(cj, cell_flag_has_tasks);
@@ -1910,6 +1974,13 @@ void scheduler_ranktasks(struct scheduler *s) {
  */
 void scheduler_reset(struct scheduler *s, int size) {
 
+  /* The recorded walks and exchanged records refer to the old tree */
+  if (s->tasks != NULL)
+    for (int k = 0; k < s->tasks_next; k++) {
+      task_grav_walk_clean(&s->tasks[k]);
+      task_buff_last_clean(&s->tasks[k]);
+    }
+
   /* Do we need to re-allocate? */
   if (size > s->size) {
     /* Free existing task lists if necessary. */
@@ -1937,403 +2008,474 @@ void scheduler_reset(struct scheduler *s, int size) {
   s->nr_unlocks = 0;
   s->completed_unlock_writes = 0;
   s->active_count = 0;
+  s->hold_end_grav_force = 0;
   s->total_ticks = 0;
 
+  /* The recorded waits are those of the old tasks */
+  if (s->rearm.active) error("Re-building the tasks while re-arming them.");
+  s->rearm.count = 0;
+  s->rearm.nr_active = 0;
+
   /* Set the task pointers in the queues. */
   for (int k = 0; k < s->nr_queues; k++) s->queues[k].tasks = s->tasks;
 }
 
 /**
- * @brief Compute the task weights
+ * @brief Computes the modelled cost of a task from the number of particles
+ * in its cells.
  *
- * @param s The #scheduler.
- * @param verbose Are we talkative?
+ * @param t The #task.
+ * @param nodeID The MPI rank we are on.
  */
-void scheduler_reweight(struct scheduler *s, int verbose) {
-  const int nr_tasks = s->nr_tasks;
-  int *tid = s->tasks_ind;
-  struct task *tasks = s->tasks;
-  const int nodeID = s->nodeID;
-  const float wscale = 0.001f;
-  const ticks tic = getticks();
+static float scheduler_task_cost(const struct task *t, const int nodeID) {
 
-  /* Run through the tasks backwards and set their weights. */
-  for (int k = nr_tasks - 1; k >= 0; k--) {
-    struct task *t = &tasks[tid[k]];
-    float cost = 0.f;
-    t->weight = 0.f;
+  const float wscale = 0.001f;
+  float cost = 0.f;
+
+  const float count_i = (t->ci != NULL) ? t->ci->hydro.count : 0.f;
+  const float count_j = (t->cj != NULL) ? t->cj->hydro.count : 0.f;
+  const float gcount_i = (t->ci != NULL) ? t->ci->grav.count : 0.f;
+  const float gcount_j = (t->cj != NULL) ? t->cj->grav.count : 0.f;
+  const float scount_i = (t->ci != NULL) ? t->ci->stars.count : 0.f;
+  const float scount_j = (t->cj != NULL) ? t->cj->stars.count : 0.f;
+  const float sink_count_i = (t->ci != NULL) ? t->ci->sinks.count : 0.f;
+  const float sink_count_j = (t->cj != NULL) ? t->cj->sinks.count : 0.f;
+  const float bcount_i = (t->ci != NULL) ? t->ci->black_holes.count : 0.f;
+  const float bcount_j = (t->cj != NULL) ? t->cj->black_holes.count : 0.f;
+
+  switch (t->type) {
+    case task_type_sort:
+    case task_type_rt_sort:
+      cost = wscale * intrinsics_popcount(t->flags) * count_i *
+             (sizeof(int) * 8 - (count_i ? intrinsics_clz(count_i) : 0));
+      break;
 
-    for (int j = 0; j < t->nr_unlock_tasks; j++)
-      t->weight += t->unlock_tasks[j]->weight;
-
-    const float count_i = (t->ci != NULL) ? t->ci->hydro.count : 0.f;
-    const float count_j = (t->cj != NULL) ? t->cj->hydro.count : 0.f;
-    const float gcount_i = (t->ci != NULL) ? t->ci->grav.count : 0.f;
-    const float gcount_j = (t->cj != NULL) ? t->cj->grav.count : 0.f;
-    const float scount_i = (t->ci != NULL) ? t->ci->stars.count : 0.f;
-    const float scount_j = (t->cj != NULL) ? t->cj->stars.count : 0.f;
-    const float sink_count_i = (t->ci != NULL) ? t->ci->sinks.count : 0.f;
-    const float sink_count_j = (t->cj != NULL) ? t->cj->sinks.count : 0.f;
-    const float bcount_i = (t->ci != NULL) ? t->ci->black_holes.count : 0.f;
-    const float bcount_j = (t->cj != NULL) ? t->cj->black_holes.count : 0.f;
+    case task_type_stars_sort:
+      cost = wscale * intrinsics_popcount(t->flags) * scount_i *
+             (sizeof(int) * 8 - (scount_i ? intrinsics_clz(scount_i) : 0));
+      break;
 
-    switch (t->type) {
-      case task_type_sort:
-      case task_type_rt_sort:
-        cost = wscale * intrinsics_popcount(t->flags) * count_i *
-               (sizeof(int) * 8 - (count_i ? intrinsics_clz(count_i) : 0));
-        break;
+    case task_type_stars_resort:
+      cost = wscale * intrinsics_popcount(t->flags) * scount_i *
+             (sizeof(int) * 8 - (scount_i ? intrinsics_clz(scount_i) : 0));
+      break;
 
-      case task_type_stars_sort:
-        cost = wscale * intrinsics_popcount(t->flags) * scount_i *
-               (sizeof(int) * 8 - (scount_i ? intrinsics_clz(scount_i) : 0));
-        break;
+    case task_type_self:
+      if (t->subtype == task_subtype_grav) {
+        cost = 1.f * (wscale * gcount_i) * gcount_i;
+      } else if (t->subtype == task_subtype_external_grav)
+        cost = 1.f * wscale * gcount_i;
+      else if (t->subtype == task_subtype_stars_density ||
+               t->subtype == task_subtype_stars_prep1 ||
+               t->subtype == task_subtype_stars_prep2 ||
+               t->subtype == task_subtype_stars_feedback)
+        cost = 1.f * wscale * scount_i * count_i;
+      else if (t->subtype == task_subtype_sink_swallow ||
+               t->subtype == task_subtype_sink_do_gas_swallow)
+        cost = 1.f * wscale * count_i * sink_count_i;
+      else if (t->subtype == task_subtype_sink_do_sink_swallow)
+        cost = 1.f * wscale * sink_count_i * sink_count_i;
+      else if (t->subtype == task_subtype_bh_density ||
+               t->subtype == task_subtype_bh_swallow ||
+               t->subtype == task_subtype_bh_feedback)
+        cost = 1.f * wscale * bcount_i * count_i;
+      else if (t->subtype == task_subtype_do_gas_swallow)
+        cost = 1.f * wscale * count_i;
+      else if (t->subtype == task_subtype_do_bh_swallow)
+        cost = 1.f * wscale * bcount_i;
+      else if (t->subtype == task_subtype_density ||
+               t->subtype == task_subtype_gradient ||
+               t->subtype == task_subtype_force ||
+               t->subtype == task_subtype_limiter)
+        cost = 1.f * (wscale * count_i) * count_i;
+      else if (t->subtype == task_subtype_rt_gradient)
+        cost = 1.f * wscale * count_i * count_i;
+      else if (t->subtype == task_subtype_rt_transport)
+        cost = 1.f * wscale * count_i * count_i;
+      else
+        error("Untreated sub-type for selfs: %s",
+              subtaskID_names[t->subtype]);
+      break;
 
-      case task_type_stars_resort:
-        cost = wscale * intrinsics_popcount(t->flags) * scount_i *
-               (sizeof(int) * 8 - (scount_i ? intrinsics_clz(scount_i) : 0));
-        break;
+    case task_type_pair:
+      if (t->subtype == task_subtype_grav) {
+        if (t->ci->nodeID != nodeID || t->cj->nodeID != nodeID)
+          cost = 3.f * (wscale * gcount_i) * gcount_j;
+        else
+          cost = 2.f * (wscale * gcount_i) * gcount_j;
 
-      case task_type_self:
-        if (t->subtype == task_subtype_grav) {
-          cost = 1.f * (wscale * gcount_i) * gcount_i;
-        } else if (t->subtype == task_subtype_external_grav)
-          cost = 1.f * wscale * gcount_i;
-        else if (t->subtype == task_subtype_stars_density ||
+      } else if (t->subtype == task_subtype_stars_density ||
                  t->subtype == task_subtype_stars_prep1 ||
                  t->subtype == task_subtype_stars_prep2 ||
-                 t->subtype == task_subtype_stars_feedback)
-          cost = 1.f * wscale * scount_i * count_i;
-        else if (t->subtype == task_subtype_sink_swallow ||
-                 t->subtype == task_subtype_sink_do_gas_swallow)
-          cost = 1.f * wscale * count_i * sink_count_i;
-        else if (t->subtype == task_subtype_sink_do_sink_swallow)
-          cost = 1.f * wscale * sink_count_i * sink_count_i;
-        else if (t->subtype == task_subtype_bh_density ||
+                 t->subtype == task_subtype_stars_feedback) {
+        if (t->ci->nodeID != nodeID)
+          cost = 3.f * wscale * count_i * scount_j * sid_scale[t->flags];
+        else if (t->cj->nodeID != nodeID)
+          cost = 3.f * wscale * scount_i * count_j * sid_scale[t->flags];
+        else
+          cost = 2.f * wscale * (scount_i * count_j + scount_j * count_i) *
+                 sid_scale[t->flags];
+
+      } else if (t->subtype == task_subtype_sink_swallow ||
+                 t->subtype == task_subtype_sink_do_gas_swallow) {
+        if (t->ci->nodeID != nodeID)
+          cost = 3.f * wscale * count_i * sink_count_j * sid_scale[t->flags];
+        else if (t->cj->nodeID != nodeID)
+          cost = 3.f * wscale * sink_count_i * count_j * sid_scale[t->flags];
+        else
+          cost = 2.f * wscale *
+                 (sink_count_i * count_j + sink_count_j * count_i) *
+                 sid_scale[t->flags];
+
+      } else if (t->subtype == task_subtype_sink_do_sink_swallow) {
+        if (t->ci->nodeID != nodeID)
+          cost = 3.f * wscale * sink_count_i * sink_count_j *
+                 sid_scale[t->flags];
+        else if (t->cj->nodeID != nodeID)
+          cost = 3.f * wscale * sink_count_i * sink_count_j *
+                 sid_scale[t->flags];
+        else
+          cost = 2.f * wscale *
+                 (sink_count_i * sink_count_j + sink_count_j * sink_count_i) *
+                 sid_scale[t->flags];
+
+      } else if (t->subtype == task_subtype_bh_density ||
                  t->subtype == task_subtype_bh_swallow ||
-                 t->subtype == task_subtype_bh_feedback)
-          cost = 1.f * wscale * bcount_i * count_i;
-        else if (t->subtype == task_subtype_do_gas_swallow)
-          cost = 1.f * wscale * count_i;
-        else if (t->subtype == task_subtype_do_bh_swallow)
-          cost = 1.f * wscale * bcount_i;
-        else if (t->subtype == task_subtype_density ||
+                 t->subtype == task_subtype_bh_feedback) {
+        if (t->ci->nodeID != nodeID)
+          cost = 3.f * wscale * count_i * bcount_j * sid_scale[t->flags];
+        else if (t->cj->nodeID != nodeID)
+          cost = 3.f * wscale * bcount_i * count_j * sid_scale[t->flags];
+        else
+          cost = 2.f * wscale * (bcount_i * count_j + bcount_j * count_i) *
+                 sid_scale[t->flags];
+
+      } else if (t->subtype == task_subtype_do_gas_swallow) {
+        cost = 1.f * wscale * (count_i + count_j);
+
+      } else if (t->subtype == task_subtype_do_bh_swallow) {
+        cost = 1.f * wscale * (bcount_i + bcount_j);
+
+      } else if (t->subtype == task_subtype_density ||
                  t->subtype == task_subtype_gradient ||
                  t->subtype == task_subtype_force ||
-                 t->subtype == task_subtype_limiter)
-          cost = 1.f * (wscale * count_i) * count_i;
-        else if (t->subtype == task_subtype_rt_gradient)
-          cost = 1.f * wscale * count_i * count_i;
-        else if (t->subtype == task_subtype_rt_transport)
-          cost = 1.f * wscale * count_i * count_i;
+                 t->subtype == task_subtype_limiter) {
+        if (t->ci->nodeID != nodeID || t->cj->nodeID != nodeID)
+          cost = 3.f * (wscale * count_i) * count_j * sid_scale[t->flags];
         else
-          error("Untreated sub-type for selfs: %s",
-                subtaskID_names[t->subtype]);
-        break;
+          cost = 2.f * (wscale * count_i) * count_j * sid_scale[t->flags];
+
+      } else if (t->subtype == task_subtype_rt_gradient) {
+        cost = 1.f * wscale * count_i * count_j;
+      } else if (t->subtype == task_subtype_rt_transport) {
+        cost = 1.f * wscale * count_i * count_j;
+      } else {
+        error("Untreated sub-type for pairs: %s",
+              subtaskID_names[t->subtype]);
+      }
+      break;
 
-      case task_type_pair:
-        if (t->subtype == task_subtype_grav) {
-          if (t->ci->nodeID != nodeID || t->cj->nodeID != nodeID)
-            cost = 3.f * (wscale * gcount_i) * gcount_j;
-          else
-            cost = 2.f * (wscale * gcount_i) * gcount_j;
-
-        } else if (t->subtype == task_subtype_stars_density ||
-                   t->subtype == task_subtype_stars_prep1 ||
-                   t->subtype == task_subtype_stars_prep2 ||
-                   t->subtype == task_subtype_stars_feedback) {
-          if (t->ci->nodeID != nodeID)
-            cost = 3.f * wscale * count_i * scount_j * sid_scale[t->flags];
-          else if (t->cj->nodeID != nodeID)
-            cost = 3.f * wscale * scount_i * count_j * sid_scale[t->flags];
-          else
-            cost = 2.f * wscale * (scount_i * count_j + scount_j * count_i) *
-                   sid_scale[t->flags];
-
-        } else if (t->subtype == task_subtype_sink_swallow ||
-                   t->subtype == task_subtype_sink_do_gas_swallow) {
-          if (t->ci->nodeID != nodeID)
-            cost = 3.f * wscale * count_i * sink_count_j * sid_scale[t->flags];
-          else if (t->cj->nodeID != nodeID)
-            cost = 3.f * wscale * sink_count_i * count_j * sid_scale[t->flags];
-          else
-            cost = 2.f * wscale *
-                   (sink_count_i * count_j + sink_count_j * count_i) *
-                   sid_scale[t->flags];
-
-        } else if (t->subtype == task_subtype_sink_do_sink_swallow) {
-          if (t->ci->nodeID != nodeID)
-            cost = 3.f * wscale * sink_count_i * sink_count_j *
-                   sid_scale[t->flags];
-          else if (t->cj->nodeID != nodeID)
-            cost = 3.f * wscale * sink_count_i * sink_count_j *
-                   sid_scale[t->flags];
-          else
-            cost = 2.f * wscale *
-                   (sink_count_i * sink_count_j + sink_count_j * sink_count_i) *
-                   sid_scale[t->flags];
-
-        } else if (t->subtype == task_subtype_bh_density ||
-                   t->subtype == task_subtype_bh_swallow ||
-                   t->subtype == task_subtype_bh_feedback) {
-          if (t->ci->nodeID != nodeID)
-            cost = 3.f * wscale * count_i * bcount_j * sid_scale[t->flags];
-          else if (t->cj->nodeID != nodeID)
-            cost = 3.f * wscale * bcount_i * count_j * sid_scale[t->flags];
-          else
-            cost = 2.f * wscale * (bcount_i * count_j + bcount_j * count_i) *
-                   sid_scale[t->flags];
+    case task_type_sub_pair:
+#ifdef SWIFT_DEBUG_CHECKS
+      if (t->flags < 0) error("Negative flag value!");
+#endif
+      if (t->subtype == task_subtype_stars_density ||
+          t->subtype == task_subtype_stars_prep1 ||
+          t->subtype == task_subtype_stars_prep2 ||
+          t->subtype == task_subtype_stars_feedback) {
+        if (t->ci->nodeID != nodeID) {
+          cost = 3.f * (wscale * count_i) * scount_j * sid_scale[t->flags];
+        } else if (t->cj->nodeID != nodeID) {
+          cost = 3.f * (wscale * scount_i) * count_j * sid_scale[t->flags];
+        } else {
+          cost = 2.f * wscale * (scount_i * count_j + scount_j * count_i) *
+                 sid_scale[t->flags];
+        }
 
-        } else if (t->subtype == task_subtype_do_gas_swallow) {
-          cost = 1.f * wscale * (count_i + count_j);
+      } else if (t->subtype == task_subtype_sink_swallow ||
+                 t->subtype == task_subtype_sink_do_gas_swallow) {
+        if (t->ci->nodeID != nodeID) {
+          cost = 3.f * (wscale * count_i) * sink_count_j * sid_scale[t->flags];
+        } else if (t->cj->nodeID != nodeID) {
+          cost = 3.f * (wscale * sink_count_i) * count_j * sid_scale[t->flags];
+        } else {
+          cost = 2.f * wscale *
+                 (sink_count_i * count_j + sink_count_j * count_i) *
+                 sid_scale[t->flags];
+        }
 
-        } else if (t->subtype == task_subtype_do_bh_swallow) {
-          cost = 1.f * wscale * (bcount_i + bcount_j);
+      } else if (t->subtype == task_subtype_sink_do_sink_swallow) {
+        if (t->ci->nodeID != nodeID) {
+          cost = 3.f * (wscale * sink_count_i) * sink_count_j *
+                 sid_scale[t->flags];
+        } else if (t->cj->nodeID != nodeID) {
+          cost = 3.f * (wscale * sink_count_i) * sink_count_j *
+                 sid_scale[t->flags];
+        } else {
+          cost = 2.f * wscale *
+                 (sink_count_i * sink_count_j + sink_count_j * sink_count_i) *
+                 sid_scale[t->flags];
+        }
+      } else if (t->subtype == task_subtype_bh_density ||
+                 t->subtype == task_subtype_bh_swallow ||
+                 t->subtype == task_subtype_bh_feedback) {
+        if (t->ci->nodeID != nodeID) {
+          cost = 3.f * (wscale * count_i) * bcount_j * sid_scale[t->flags];
+        } else if (t->cj->nodeID != nodeID) {
+          cost = 3.f * (wscale * bcount_i) * count_j * sid_scale[t->flags];
+        } else {
+          cost = 2.f * wscale * (bcount_i * count_j + bcount_j * count_i) *
+                 sid_scale[t->flags];
+        }
 
-        } else if (t->subtype == task_subtype_density ||
-                   t->subtype == task_subtype_gradient ||
-                   t->subtype == task_subtype_force ||
-                   t->subtype == task_subtype_limiter) {
-          if (t->ci->nodeID != nodeID || t->cj->nodeID != nodeID)
-            cost = 3.f * (wscale * count_i) * count_j * sid_scale[t->flags];
-          else
-            cost = 2.f * (wscale * count_i) * count_j * sid_scale[t->flags];
+      } else if (t->subtype == task_subtype_do_gas_swallow) {
+        cost = 1.f * wscale * (count_i + count_j);
+
+      } else if (t->subtype == task_subtype_do_bh_swallow) {
+        cost = 1.f * wscale * (bcount_i + bcount_j);
 
-        } else if (t->subtype == task_subtype_rt_gradient) {
-          cost = 1.f * wscale * count_i * count_j;
-        } else if (t->subtype == task_subtype_rt_transport) {
-          cost = 1.f * wscale * count_i * count_j;
+      } else if (t->subtype == task_subtype_density ||
+                 t->subtype == task_subtype_gradient ||
+                 t->subtype == task_subtype_force ||
+                 t->subtype == task_subtype_limiter) {
+        if (t->ci->nodeID != nodeID || t->cj->nodeID != nodeID) {
+          cost = 3.f * (wscale * count_i) * count_j * sid_scale[t->flags];
         } else {
-          error("Untreated sub-type for pairs: %s",
-                subtaskID_names[t->subtype]);
+          cost = 2.f * (wscale * count_i) * count_j * sid_scale[t->flags];
         }
-        break;
+      } else if (t->subtype == task_subtype_rt_gradient) {
+        cost = 1.f * wscale * count_i * count_j;
+      } else if (t->subtype == task_subtype_rt_transport) {
+        cost = 1.f * wscale * count_i * count_j;
+      } else {
+        error("Untreated sub-type for sub-pairs: %s",
+              subtaskID_names[t->subtype]);
+      }
+      break;
 
-      case task_type_sub_pair:
-#ifdef SWIFT_DEBUG_CHECKS
-        if (t->flags < 0) error("Negative flag value!");
-#endif
-        if (t->subtype == task_subtype_stars_density ||
-            t->subtype == task_subtype_stars_prep1 ||
-            t->subtype == task_subtype_stars_prep2 ||
-            t->subtype == task_subtype_stars_feedback) {
-          if (t->ci->nodeID != nodeID) {
-            cost = 3.f * (wscale * count_i) * scount_j * sid_scale[t->flags];
-          } else if (t->cj->nodeID != nodeID) {
-            cost = 3.f * (wscale * scount_i) * count_j * sid_scale[t->flags];
-          } else {
-            cost = 2.f * wscale * (scount_i * count_j + scount_j * count_i) *
-                   sid_scale[t->flags];
-          }
+    case task_type_sub_self:
+      if (t->subtype == task_subtype_stars_density ||
+          t->subtype == task_subtype_stars_prep1 ||
+          t->subtype == task_subtype_stars_prep2 ||
+          t->subtype == task_subtype_stars_feedback) {
+        cost = 1.f * (wscale * scount_i) * count_i;
+      } else if (t->subtype == task_subtype_sink_swallow ||
+                 t->subtype == task_subtype_sink_do_gas_swallow) {
+        cost = 1.f * (wscale * sink_count_i) * count_i;
+      } else if (t->subtype == task_subtype_sink_do_sink_swallow) {
+        cost = 1.f * (wscale * sink_count_i) * sink_count_i;
+      } else if (t->subtype == task_subtype_bh_density ||
+                 t->subtype == task_subtype_bh_swallow ||
+                 t->subtype == task_subtype_bh_feedback) {
+        cost = 1.f * (wscale * bcount_i) * count_i;
+      } else if (t->subtype == task_subtype_do_gas_swallow) {
+        cost = 1.f * wscale * count_i;
+      } else if (t->subtype == task_subtype_do_bh_swallow) {
+        cost = 1.f * wscale * bcount_i;
+      } else if (t->subtype == task_subtype_density ||
+                 t->subtype == task_subtype_gradient ||
+                 t->subtype == task_subtype_force ||
+                 t->subtype == task_subtype_limiter) {
+        cost = 1.f * (wscale * count_i) * count_i;
+      } else if (t->subtype == task_subtype_rt_gradient) {
+        cost = 1.f * wscale * scount_i * count_i;
+      } else if (t->subtype == task_subtype_rt_transport) {
+        cost = 1.f * wscale * scount_i * count_i;
+      } else {
+        error("Untreated sub-type for sub-selfs: %s",
+              subtaskID_names[t->subtype]);
+      }
+      break;
+    case task_type_ghost:
+      if (t->ci == t->ci->hydro.super) cost = wscale * count_i;
+      break;
+    case task_type_extra_ghost:
+      if (t->ci == t->ci->hydro.super) cost = wscale * count_i;
+      break;
+    case task_type_stars_ghost:
+      if (t->ci == t->ci->hydro.super) cost = wscale * scount_i;
+      break;
+    case task_type_bh_density_ghost:
+      if (t->ci == t->ci->hydro.super) cost = wscale * bcount_i;
+      break;
+    case task_type_bh_swallow_ghost2:
+      if (t->ci == t->ci->hydro.super) cost = wscale * bcount_i;
+      break;
+    case task_type_drift_part:
+      cost = wscale * count_i;
+      break;
+    case task_type_drift_gpart:
+      cost = wscale * gcount_i;
+      break;
+    case task_type_drift_spart:
+      cost = wscale * scount_i;
+      break;
+    case task_type_drift_sink:
+      cost = wscale * sink_count_i;
+      break;
+    case task_type_drift_bpart:
+      cost = wscale * bcount_i;
+      break;
+    case task_type_init_grav:
+      cost = wscale * gcount_i;
+      break;
+    case task_type_grav_down:
+      cost = wscale * gcount_i;
+      break;
+    case task_type_grav_long_range:
+      cost = wscale * gcount_i;
+      break;
+    case task_type_grav_mm:
+      cost = wscale * (gcount_i + gcount_j);
+      break;
+    case task_type_end_hydro_force:
+      cost = wscale * count_i;
+      break;
+    case task_type_end_grav_force:
+      cost = wscale * gcount_i;
+      break;
+    case task_type_cooling:
+      cost = wscale * count_i;
+      break;
+    case task_type_star_formation:
+      cost = wscale * (count_i + scount_i);
+      break;
+    case task_type_star_formation_sink:
+      cost = wscale * (sink_count_i + scount_i);
+      break;
+    case task_type_sink_formation:
+      cost = wscale * (count_i + sink_count_i);
+      break;
+    case task_type_rt_ghost1:
+      cost = wscale * count_i;
+      break;
+    case task_type_rt_ghost2:
+      cost = wscale * count_i;
+      break;
+    case task_type_rt_tchem:
+      cost = wscale * count_i;
+      break;
+    case task_type_rt_advance_cell_time:
+    case task_type_rt_collect_times:
+      cost = wscale;
+      break;
+    case task_type_csds:
+      cost = wscale * (count_i + gcount_i + scount_i + sink_count_i + bcount_i);
+      break;
+    case task_type_kick1:
+      cost = wscale * (count_i + gcount_i + scount_i + sink_count_i + bcount_i);
+      break;
+    case task_type_kick2:
+      cost = wscale * (count_i + gcount_i + scount_i + sink_count_i + bcount_i);
+      break;
+    case task_type_timestep:
+      cost = wscale * (count_i + gcount_i + scount_i + sink_count_i + bcount_i);
+      break;
+    case task_type_timestep_limiter:
+      cost = wscale * count_i;
+      break;
+    case task_type_timestep_sync:
+      cost = wscale * count_i;
+      break;
+    case task_type_send:
+      if (count_i < 1e5)
+        cost = 10.f * (wscale * count_i) * count_i;
+      else
+        cost = 2e9;
+      break;
+    case task_type_recv:
+      if (count_i < 1e5)
+        cost = 5.f * (wscale * count_i) * count_i;
+      else
+        cost = 1e9;
+      break;
+    default:
+      cost = 0;
+      break;
+  }
+  return cost;
+}
 
-        } else if (t->subtype == task_subtype_sink_swallow ||
-                   t->subtype == task_subtype_sink_do_gas_swallow) {
-          if (t->ci->nodeID != nodeID) {
-            cost =
-                3.f * (wscale * count_i) * sink_count_j * sid_scale[t->flags];
-          } else if (t->cj->nodeID != nodeID) {
-            cost =
-                3.f * (wscale * sink_count_i) * count_j * sid_scale[t->flags];
-          } else {
-            cost = 2.f * wscale *
-                   (sink_count_i * count_j + sink_count_j * count_i) *
-                   sid_scale[t->flags];
-          }
+/**
+ * @brief Compute the task weights
+ *
+ * The weight of a task is its cost plus the weights of all the tasks it
+ * unlocks, so that the tasks at the start of long chains run first.
+ *
+ * If s->measured_weights is set, the costs are the times the tasks took the
+ * last time they ran. The tasks that never ran (e.g. just after a rebuild)
+ * use their modelled cost converted to ticks with the ratio of measured to
+ * modelled costs of their type and subtype, which is kept from one call to
+ * the next.
+ *
+ * @param s The #scheduler.
+ * @param verbose Are we talkative?
+ */
+void scheduler_reweight(struct scheduler *s, int verbose) {
+  const int nr_tasks = s->nr_tasks;
+  int *tid = s->tasks_ind;
+  struct task *tasks = s->tasks;
+  const int nodeID = s->nodeID;
+  const ticks tic = getticks();
 
-        } else if (t->subtype == task_subtype_sink_do_sink_swallow) {
-          if (t->ci->nodeID != nodeID) {
-            cost = 3.f * (wscale * sink_count_i) * sink_count_j *
-                   sid_scale[t->flags];
-          } else if (t->cj->nodeID != nodeID) {
-            cost = 3.f * (wscale * sink_count_i) * sink_count_j *
-                   sid_scale[t->flags];
-          } else {
-            cost = 2.f * wscale *
-                   (sink_count_i * sink_count_j + sink_count_j * sink_count_i) *
-                   sid_scale[t->flags];
-          }
-        } else if (t->subtype == task_subtype_bh_density ||
-                   t->subtype == task_subtype_bh_swallow ||
-                   t->subtype == task_subtype_bh_feedback) {
-          if (t->ci->nodeID != nodeID) {
-            cost = 3.f * (wscale * count_i) * bcount_j * sid_scale[t->flags];
-          } else if (t->cj->nodeID != nodeID) {
-            cost = 3.f * (wscale * bcount_i) * count_j * sid_scale[t->flags];
-          } else {
-            cost = 2.f * wscale * (bcount_i * count_j + bcount_j * count_i) *
-                   sid_scale[t->flags];
-          }
+  if (!s->measured_weights) {
 
-        } else if (t->subtype == task_subtype_do_gas_swallow) {
-          cost = 1.f * wscale * (count_i + count_j);
+    /* Run through the tasks backwards and set their weights. */
+    for (int k = nr_tasks - 1; k >= 0; k--) {
+      struct task *t = &tasks[tid[k]];
+      t->weight = scheduler_task_cost(t, nodeID);
+      for (int j = 0; j < t->nr_unlock_tasks; j++)
+        t->weight += t->unlock_tasks[j]->weight;
+    }
 
-        } else if (t->subtype == task_subtype_do_bh_swallow) {
-          cost = 1.f * wscale * (bcount_i + bcount_j);
+  } else {
 
-        } else if (t->subtype == task_subtype_density ||
-                   t->subtype == task_subtype_gradient ||
-                   t->subtype == task_subtype_force ||
-                   t->subtype == task_subtype_limiter) {
-          if (t->ci->nodeID != nodeID || t->cj->nodeID != nodeID) {
-            cost = 3.f * (wscale * count_i) * count_j * sid_scale[t->flags];
-          } else {
-            cost = 2.f * (wscale * count_i) * count_j * sid_scale[t->flags];
-          }
-        } else if (t->subtype == task_subtype_rt_gradient) {
-          cost = 1.f * wscale * count_i * count_j;
-        } else if (t->subtype == task_subtype_rt_transport) {
-          cost = 1.f * wscale * count_i * count_j;
-        } else {
-          error("Untreated sub-type for sub-pairs: %s",
-                subtaskID_names[t->subtype]);
-        }
-        break;
+    /* Compare the measured and modelled costs of the tasks that ran */
+    double *measured = (double *)calloc(
+        2 * task_type_count * task_subtype_count, sizeof(double));
+    if (measured == NULL) error("Failed to allocate the task costs.");
+    double *modelled = measured + task_type_count * task_subtype_count;
+    double measured_all = 0., modelled_all = 0.;
+
+    for (int k = 0; k < nr_tasks; k++) {
+      struct task *t = &tasks[k];
+
+      /* Keep the modelled cost until the backward pass */
+      t->weight = scheduler_task_cost(t, nodeID);
+
+      if (t->toc > t->tic) {
+        const int ind = t->type * task_subtype_count + t->subtype;
+        measured[ind] += t->toc - t->tic;
+        modelled[ind] += t->weight;
+        measured_all += t->toc - t->tic;
+        modelled_all += t->weight;
+      }
+    }
 
-      case task_type_sub_self:
-        if (t->subtype == task_subtype_stars_density ||
-            t->subtype == task_subtype_stars_prep1 ||
-            t->subtype == task_subtype_stars_prep2 ||
-            t->subtype == task_subtype_stars_feedback) {
-          cost = 1.f * (wscale * scount_i) * count_i;
-        } else if (t->subtype == task_subtype_sink_swallow ||
-                   t->subtype == task_subtype_sink_do_gas_swallow) {
-          cost = 1.f * (wscale * sink_count_i) * count_i;
-        } else if (t->subtype == task_subtype_sink_do_sink_swallow) {
-          cost = 1.f * (wscale * sink_count_i) * sink_count_i;
-        } else if (t->subtype == task_subtype_bh_density ||
-                   t->subtype == task_subtype_bh_swallow ||
-                   t->subtype == task_subtype_bh_feedback) {
-          cost = 1.f * (wscale * bcount_i) * count_i;
-        } else if (t->subtype == task_subtype_do_gas_swallow) {
-          cost = 1.f * wscale * count_i;
-        } else if (t->subtype == task_subtype_do_bh_swallow) {
-          cost = 1.f * wscale * bcount_i;
-        } else if (t->subtype == task_subtype_density ||
-                   t->subtype == task_subtype_gradient ||
-                   t->subtype == task_subtype_force ||
-                   t->subtype == task_subtype_limiter) {
-          cost = 1.f * (wscale * count_i) * count_i;
-        } else if (t->subtype == task_subtype_rt_gradient) {
-          cost = 1.f * wscale * scount_i * count_i;
-        } else if (t->subtype == task_subtype_rt_transport) {
-          cost = 1.f * wscale * scount_i * count_i;
-        } else {
-          error("Untreated sub-type for sub-selfs: %s",
-                subtaskID_names[t->subtype]);
-        }
-        break;
-      case task_type_ghost:
-        if (t->ci == t->ci->hydro.super) cost = wscale * count_i;
-        break;
-      case task_type_extra_ghost:
-        if (t->ci == t->ci->hydro.super) cost = wscale * count_i;
-        break;
-      case task_type_stars_ghost:
-        if (t->ci == t->ci->hydro.super) cost = wscale * scount_i;
-        break;
-      case task_type_bh_density_ghost:
-        if (t->ci == t->ci->hydro.super) cost = wscale * bcount_i;
-        break;
-      case task_type_bh_swallow_ghost2:
-        if (t->ci == t->ci->hydro.super) cost = wscale * bcount_i;
-        break;
-      case task_type_drift_part:
-        cost = wscale * count_i;
-        break;
-      case task_type_drift_gpart:
-        cost = wscale * gcount_i;
-        break;
-      case task_type_drift_spart:
-        cost = wscale * scount_i;
-        break;
-      case task_type_drift_sink:
-        cost = wscale * sink_count_i;
-        break;
-      case task_type_drift_bpart:
-        cost = wscale * bcount_i;
-        break;
-      case task_type_init_grav:
-        cost = wscale * gcount_i;
-        break;
-      case task_type_grav_down:
-        cost = wscale * gcount_i;
-        break;
-      case task_type_grav_long_range:
-        cost = wscale * gcount_i;
-        break;
-      case task_type_grav_mm:
-        cost = wscale * (gcount_i + gcount_j);
-        break;
-      case task_type_end_hydro_force:
-        cost = wscale * count_i;
-        break;
-      case task_type_end_grav_force:
-        cost = wscale * gcount_i;
-        break;
-      case task_type_cooling:
-        cost = wscale * count_i;
-        break;
-      case task_type_star_formation:
-        cost = wscale * (count_i + scount_i);
-        break;
-      case task_type_star_formation_sink:
-        cost = wscale * (sink_count_i + scount_i);
-        break;
-      case task_type_sink_formation:
-        cost = wscale * (count_i + sink_count_i);
-        break;
-      case task_type_rt_ghost1:
-        cost = wscale * count_i;
-        break;
-      case task_type_rt_ghost2:
-        cost = wscale * count_i;
-        break;
-      case task_type_rt_tchem:
-        cost = wscale * count_i;
-        break;
-      case task_type_rt_advance_cell_time:
-      case task_type_rt_collect_times:
-        cost = wscale;
-        break;
-      case task_type_csds:
-        cost =
-            wscale * (count_i + gcount_i + scount_i + sink_count_i + bcount_i);
-        break;
-      case task_type_kick1:
-        cost =
-            wscale * (count_i + gcount_i + scount_i + sink_count_i + bcount_i);
-        break;
-      case task_type_kick2:
-        cost =
-            wscale * (count_i + gcount_i + scount_i + sink_count_i + bcount_i);
-        break;
-      case task_type_timestep:
-        cost =
-            wscale * (count_i + gcount_i + scount_i + sink_count_i + bcount_i);
-        break;
-      case task_type_timestep_limiter:
-        cost = wscale * count_i;
-        break;
-      case task_type_timestep_sync:
-        cost = wscale * count_i;
-        break;
-      case task_type_send:
-        if (count_i < 1e5)
-          cost = 10.f * (wscale * count_i) * count_i;
-        else
-          cost = 2e9;
-        break;
-      case task_type_recv:
-        if (count_i < 1e5)
-          cost = 5.f * (wscale * count_i) * count_i;
-        else
-          cost = 1e9;
-        break;
-      default:
-        cost = 0;
-        break;
+    for (int ind = 0; ind < task_type_count * task_subtype_count; ind++)
+      if (measured[ind] > 0. && modelled[ind] > 0.)
+        s->task_cost_ratio[ind] = measured[ind] / modelled[ind];
+    if (measured_all > 0. && modelled_all > 0.)
+      s->task_cost_ratio_all = measured_all / modelled_all;
+    free(measured);
+
+    /* Run through the tasks backwards and set their weights. */
+    for (int k = nr_tasks - 1; k >= 0; k--) {
+      struct task *t = &tasks[tid[k]];
+
+      if (t->toc > t->tic) {
+        t->weight = t->toc - t->tic;
+      } else {
+        const int ind = t->type * task_subtype_count + t->subtype;
+        if (s->task_cost_ratio[ind] > 0.f)
+          t->weight *= s->task_cost_ratio[ind];
+        else if (s->task_cost_ratio_all > 0.f)
+          t->weight *= s->task_cost_ratio_all;
+      }
+
+      for (int j = 0; j < t->nr_unlock_tasks; j++)
+        t->weight += t->unlock_tasks[j]->weight;
     }
-    t->weight += cost;
   }
 
   if (verbose)
@@ -2367,6 +2509,10 @@ void scheduler_rewait_mapper(void *map_data, int num_elements,
     /* Increment the task's own wait counter for the enqueueing. */
     atomic_inc(&t->wait);
 
+    /* Keep the end of the gravity waiting for the mesh? */
+    if (s->hold_end_grav_force && t->type == task_type_end_grav_force)
+      atomic_inc(&t->wait);
+
 #ifdef SWIFT_DEBUG_CHECKS
     /* Check that we don't have more waits that what can be stored. */
     if (t->wait < 0)
@@ -2397,6 +2543,129 @@ void scheduler_enqueue_mapper(void *map_data, int num_elements,
   pthread_cond_broadcast(&s->sleep_cond);
 }
 
+/**
+ * @brief Start re-arming the tasks from the waits recorded by
+ * scheduler_start().
+ *
+ * Until scheduler_rearm_end(), each start records the waits it computed for
+ * its active tasks and their dependents. A later start with exactly the same
+ * active tasks then sets these waits back by plain stores rather than
+ * re-counting them with atomics over the unlocks. This is for a series of
+ * launches of the same sub-graph, e.g. the RT sub-cycles, with no rebuild in
+ * between.
+ *
+ * @param s The #scheduler.
+ */
+void scheduler_rearm_begin(struct scheduler *s) {
+
+  if (s->rearm.active) error("Already re-arming the tasks.");
+
+  if ((s->rearm.mark = (char *)swift_malloc("rearm_mark", s->nr_tasks)) ==
+      NULL)
+    error("Failed to allocate the re-arming marks.");
+  bzero(s->rearm.mark, s->nr_tasks);
+  s->rearm.count = 0;
+  s->rearm.nr_active = 0;
+  s->rearm.active = 1;
+}
+
+/**
+ * @brief Stop re-arming the tasks and forget the recorded waits.
+ *
+ * @param s The #scheduler.
+ */
+void scheduler_rearm_end(struct scheduler *s) {
+
+  if (!s->rearm.active) return;
+
+  swift_free("rearm_mark", s->rearm.mark);
+  s->rearm.mark = NULL;
+  s->rearm.count = 0;
+  s->rearm.nr_active = 0;
+  s->rearm.active = 0;
+}
+
+/**
+ * @brief Add a task to the recorded waits, if not already in.
+ *
+ * @param s The #scheduler.
+ * @param tid The index of the #task.
+ * @param mark 2 for an active task, 1 for a dependent.
+ */
+static void scheduler_rearm_add(struct scheduler *s, const int tid,
+                                const char mark) {
+
+  if (s->rearm.mark[tid] != 0) return;
+  s->rearm.mark[tid] = mark;
+
+  if (s->rearm.count == s->rearm.size) {
+    s->rearm.size = 2 * s->rearm.size + 1024;
+    s->rearm.tid = (int *)realloc(s->rearm.tid, s->rearm.size * sizeof(int));
+    s->rearm.wait = (int *)realloc(s->rearm.wait, s->rearm.size * sizeof(int));
+    if (s->rearm.tid == NULL || s->rearm.wait == NULL)
+      error("Failed to allocate the recorded waits.");
+  }
+  s->rearm.tid[s->rearm.count++] = tid;
+}
+
+/**
+ * @brief Record the waits the re-wait gave to the active tasks and their
+ * dependents.
+ *
+ * @param s The #scheduler.
+ */
+static void scheduler_rearm_record(struct scheduler *s) {
+
+  /* Forget the previous set */
+  for (int k = 0; k < s->rearm.count; k++) s->rearm.mark[s->rearm.tid[k]] = 0;
+  s->rearm.count = 0;
+
+  /* The active tasks first, such that a dependent amongst them is marked as
+   * active */
+  for (int k = 0; k < s->active_count; k++)
+    scheduler_rearm_add(s, s->tid_active[k], 2);
+  for (int k = 0; k < s->active_count; k++) {
+    const struct task *t = &s->tasks[s->tid_active[k]];
+    if (t->skip) continue;
+    for (int j = 0; j < t->nr_unlock_tasks; j++)
+      scheduler_rearm_add(s, t->unlock_tasks[j] - s->tasks, 1);
+  }
+  s->rearm.nr_active = s->active_count;
+
+  for (int k = 0; k < s->rearm.count; k++)
+    s->rearm.wait[k] = s->tasks[s->rearm.tid[k]].wait;
+}
+
+/**
+ * @brief Set the waits of the active tasks back from the recorded ones, if
+ * they are the same tasks.
+ *
+ * @param s The #scheduler.
+ * @return 1 if the waits were set, 0 if they must be re-computed.
+ */
+static int scheduler_rearm_restore(struct scheduler *s) {
+
+  if (s->rearm.nr_active != s->active_count || s->rearm.count == 0 ||
+      s->hold_end_grav_force)
+    return 0;
+
+  /* A task can't be in the active list twice, so the same number of tasks
+   * all marked active is the same set */
+  for (int k = 0; k < s->active_count; k++)
+    if (s->rearm.mark[s->tid_active[k]] != 2) return 0;
+
+  for (int k = 0; k < s->rearm.count; k++) {
+    struct task *t = &s->tasks[s->rearm.tid[k]];
+#ifdef SWIFT_DEBUG_CHECKS
+    if (t->wait != 0)
+      error("Re-arming a task (type=%s/%s) that is still waiting!",
+            taskID_names[t->type], subtaskID_names[t->subtype]);
+#endif
+    t->wait = s->rearm.wait[k];
+  }
+  return 1;
+}
+
 /**
  * @brief Start the scheduler, i.e. fill the queues with ready tasks.
  *
@@ -2404,12 +2673,16 @@ void scheduler_enqueue_mapper(void *map_data, int num_elements,
  */
 void scheduler_start(struct scheduler *s) {
 
-  /* Re-wait the tasks. */
-  if (s->active_count > 1000) {
-    threadpool_map(s->threadpool, scheduler_rewait_mapper, s->tid_active,
-                   s->active_count, sizeof(int), threadpool_auto_chunk_size, s);
-  } else {
-    scheduler_rewait_mapper(s->tid_active, s->active_count, s);
+  /* Re-wait the tasks, unless we already know their waits. */
+  if (!(s->rearm.active && scheduler_rearm_restore(s))) {
+    if (s->active_count > 1000) {
+      threadpool_map(s->threadpool, scheduler_rewait_mapper, s->tid_active,
+                     s->active_count, sizeof(int), threadpool_auto_chunk_size,
+                     s);
+    } else {
+      scheduler_rewait_mapper(s->tid_active, s->active_count, s);
+    }
+    if (s->rearm.active) scheduler_rearm_record(s);
   }
 
   /* Loop over the tasks and enqueue whoever is ready. */
@@ -2429,6 +2702,42 @@ void scheduler_start(struct scheduler *s) {
   pthread_mutex_unlock(&s->sleep_mutex);
 }
 
+/**
+ * @brief Let the end_grav_force tasks held back by scheduler_start() run.
+ *
+ * Called once the long-range mesh forces computed alongside the tasks are
+ * in the #gpart. This also removes the hold the caller put on the
+ * scheduler's waiting counter so that the runners can't go home before
+ * these tasks ran.
+ *
+ * @param s The #scheduler.
+ */
+void scheduler_release_end_grav_force(struct scheduler *s) {
+
+  if (!s->hold_end_grav_force) error("The end_grav_force tasks were not held");
+
+  /* Only the tasks that were active can be waiting for us (and they can't
+   * have run, so they are still not marked as skipped) */
+  for (int k = 0; k < s->nr_tasks; k++) {
+    struct task *t = &s->tasks[k];
+    if (t->type != task_type_end_grav_force || t->skip) continue;
+
+    const int res = atomic_dec(&t->wait);
+    if (res < 1) {
+      error("Negative wait!");
+    } else if (res == 1) {
+      scheduler_enqueue(s, t);
+    }
+  }
+  s->hold_end_grav_force = 0;
+
+  /* Remove the safeguard. */
+  pthread_mutex_lock(&s->sleep_mutex);
+  atomic_dec(&s->waiting);
+  pthread_cond_broadcast(&s->sleep_cond);
+  pthread_mutex_unlock(&s->sleep_mutex);
+}
+
 /**
  * @brief Put a task on one of the queues.
  *
@@ -2517,6 +2826,13 @@ void scheduler_enqueue(struct scheduler *s, struct task *t) {
       case task_type_recv:
 #ifdef WITH_MPI
       {
+        /* Aggregated messages are posted once for all the cells. */
+        if (mpi_aggregate_gparts && t->subtype == task_subtype_gpart) {
+          mpi_aggregate_recv_gpart(t);
+          qid = 1 % s->nr_queues;
+          break;
+        }
+
         size_t size = 0;              /* Size in bytes. */
         size_t count = 0;             /* Number of elements to receive */
         MPI_Datatype type = MPI_BYTE; /* Type of the elements */
@@ -2524,7 +2840,9 @@ void scheduler_enqueue(struct scheduler *s, struct task *t) {
 
         if (t->subtype == task_subtype_tend) {
 
-          count = size = t->ci->mpi.pcell_size * sizeof(struct pcell_step);
+          /* Only the changed records are sent, but we may get all of them */
+          count = size = cell_pack_changed_max_size(t->ci->mpi.pcell_size,
+                                                    sizeof(struct pcell_step));
           buff = t->buff = malloc(count);
 
         } else if (t->subtype == task_subtype_part_swallow) {
@@ -2559,6 +2877,17 @@ void scheduler_enqueue(struct scheduler *s, struct task *t) {
           t->buff = buff;
           task_get_unique_dependent(t)->buff = buff;
 
+        } else if (t->subtype == task_subtype_gpart &&
+                   s->compact_foreign_gparts) {
+
+          count = t->ci->grav.count;
+          size = count * sizeof(struct gpart_foreign);
+          type = gpart_foreign_mpi_type;
+          if (s->compact_foreign_gparts_in_memory)
+            buff = t->ci->grav.parts_foreign;
+          else
+            buff = t->buff = malloc(size);
+
         } else if (t->subtype == task_subtype_gpart) {
 
           count = t->ci->grav.count;
@@ -2589,7 +2918,8 @@ void scheduler_enqueue(struct scheduler *s, struct task *t) {
 
         } else if (t->subtype == task_subtype_grav_counts) {
 
-          count = size = t->ci->mpi.pcell_size * sizeof(struct pcell_sf_grav);
+          count = size = cell_pack_changed_max_size(
+              t->ci->mpi.pcell_size, sizeof(struct pcell_sf_grav));
           buff = t->buff = malloc(count);
 
         } else {
@@ -2606,6 +2936,7 @@ void scheduler_enqueue(struct scheduler *s, struct task *t) {
         /* And log, if logging enabled. */
         mpiuse_log_allocation(t->type, t->subtype, &t->req, 1, size,
                               t->ci->nodeID, t->flags);
+        mpi_comm_stats_post(/*send=*/0, t->subtype, size, t->ci->nodeID);
 
         qid = 1 % s->nr_queues;
       }
@@ -2616,6 +2947,13 @@ void scheduler_enqueue(struct scheduler *s, struct task *t) {
       case task_type_send:
 #ifdef WITH_MPI
       {
+        /* Aggregated messages are sent by the last of the cells. */
+        if (mpi_aggregate_gparts && t->subtype == task_subtype_gpart) {
+          mpi_aggregate_send_gpart(t);
+          qid = 0;
+          break;
+        }
+
         size_t size = 0;              /* Size in bytes. */
         size_t count = 0;             /* Number of elements to send */
         MPI_Datatype type = MPI_BYTE; /* Type of the elements */
@@ -2623,9 +2961,18 @@ void scheduler_enqueue(struct scheduler *s, struct task *t) {
 
         if (t->subtype == task_subtype_tend) {
 
-          size = count = t->ci->mpi.pcell_size * sizeof(struct pcell_step);
-          buff = t->buff = malloc(size);
-          cell_pack_end_step(t->ci, (struct pcell_step *)buff);
+          /* Pack everything, but only send what changed since last time */
+          const int pcell_size = t->ci->mpi.pcell_size;
+          struct pcell_step *pcells = (struct pcell_step *)calloc(
+              pcell_size, sizeof(struct pcell_step));
+          if (pcells == NULL) error("Failed to allocate the pcell_steps.");
+          cell_pack_end_step(t->ci, pcells);
+
+          buff = t->buff = malloc(cell_pack_changed_max_size(
+              pcell_size, sizeof(struct pcell_step)));
+          size = count = cell_pack_changed(pcells, &t->buff_last, pcell_size,
+                                           sizeof(struct pcell_step), buff);
+          free(pcells);
 
         } else if (t->subtype == task_subtype_part_swallow) {
 
@@ -2660,8 +3007,19 @@ void scheduler_enqueue(struct scheduler *s, struct task *t) {
           type = MPI_BYTE;
           buff = t->buff;
 
+        } else if (t->subtype == task_subtype_gpart &&
+                   s->compact_foreign_gparts) {
+
+          count = t->ci->grav.count;
+          size = count * sizeof(struct gpart_foreign);
+          type = gpart_foreign_mpi_type;
+          buff = t->buff = malloc(size);
+          cell_pack_gpart_foreign(t->ci, (struct gpart_foreign *)buff);
+
         } else if (t->subtype == task_subtype_gpart) {
 
+          /* Over MPI the host #gpart are the only up-to-date copy (the
+           * device mirror is off), so they are sent from host memory. */
           count = t->ci->grav.count;
           size = count * sizeof(struct gpart);
           type = gpart_mpi_type;
@@ -2691,9 +3049,18 @@ void scheduler_enqueue(struct scheduler *s, struct task *t) {
 
         } else if (t->subtype == task_subtype_grav_counts) {
 
-          size = count = t->ci->mpi.pcell_size * sizeof(struct pcell_sf_grav);
-          buff = t->buff = malloc(size);
-          cell_pack_grav_counts(t->ci, (struct pcell_sf_grav *)t->buff);
+          /* As for the tend, only send the records that changed */
+          const int pcell_size = t->ci->mpi.pcell_size;
+          struct pcell_sf_grav *pcells = (struct pcell_sf_grav *)calloc(
+              pcell_size, sizeof(struct pcell_sf_grav));
+          if (pcells == NULL) error("Failed to allocate the pcell_sf_gravs.");
+          cell_pack_grav_counts(t->ci, pcells);
+
+          buff = t->buff = malloc(cell_pack_changed_max_size(
+              pcell_size, sizeof(struct pcell_sf_grav)));
+          size = count = cell_pack_changed(pcells, &t->buff_last, pcell_size,
+                                           sizeof(struct pcell_sf_grav), buff);
+          free(pcells);
 
         } else {
           error("Unknown communication sub-type");
@@ -2714,6 +3081,7 @@ void scheduler_enqueue(struct scheduler *s, struct task *t) {
         /* And log, if logging enabled. */
         mpiuse_log_allocation(t->type, t->subtype, &t->req, 1, size,
                               t->cj->nodeID, t->flags);
+        mpi_comm_stats_post(/*send=*/1, t->subtype, size, t->cj->nodeID);
 
         qid = 0;
       }
@@ -2727,6 +3095,13 @@ void scheduler_enqueue(struct scheduler *s, struct task *t) {
 
     if (qid >= s->nr_queues) error("Bad computed qid.");
 
+    /* The gravity tasks go to the runners of the GPU holding the cell */
+    if (gpu_devices.count > 1 &&
+        (t->subtype == task_subtype_grav || t->type == task_type_drift_gpart ||
+         t->type == task_type_grav_long_range ||
+         t->type == task_type_grav_mm || t->type == task_type_end_grav_force))
+      qid = cuda_devices_pick_queue(s->space, t->ci, qid, s->nr_queues);
+
     /* If no qid, pick a random queue. */
     if (qid < 0) qid = rand() % s->nr_queues;
 
@@ -2737,6 +3112,7 @@ void scheduler_enqueue(struct scheduler *s, struct task *t) {
     atomic_inc(&s->waiting);
 
     /* Insert the task into that queue. */
+    t->enqueued = getticks();
     queue_insert(&s->queues[qid], t);
   }
 }
@@ -2772,6 +3148,7 @@ struct task *scheduler_done(struct scheduler *s, struct task *t) {
   if (!t->implicit) {
     t->toc = getticks();
     t->total_ticks += t->toc - t->tic;
+    t->nr_runs++;
     pthread_mutex_lock(&s->sleep_mutex);
     atomic_dec(&s->waiting);
     pthread_cond_broadcast(&s->sleep_cond);
@@ -2813,6 +3190,7 @@ struct task *scheduler_unlock(struct scheduler *s, struct task *t) {
   if (!t->implicit) {
     t->toc = getticks();
     t->total_ticks += t->toc - t->tic;
+    t->nr_runs++;
     pthread_mutex_lock(&s->sleep_mutex);
     atomic_dec(&s->waiting);
     pthread_cond_broadcast(&s->sleep_cond);
@@ -2902,15 +3280,23 @@ void scheduler_check_deadlock(struct scheduler *s) {
  * @param s The #scheduler.
  * @param qid The ID of the preferred #queue.
  * @param prev the previous task that was run.
+ * @param nap Are we allowed to sleep until a task becomes available?
+ * @param spin_time (return) Incremented by the time spent spinning.
+ * @param park_time (return) Incremented by the time spent asleep.
  *
  * @return A pointer to a #task or @c NULL if there are no available tasks.
  */
-struct task *scheduler_gettask(struct scheduler *s, int qid,
-                               const struct task *prev) {
+static struct task *scheduler_gettask_search(struct scheduler *s, int qid,
+                                             const struct task *prev,
+                                             const int nap, ticks *spin_time,
+                                             ticks *park_time) {
   struct task *res = NULL;
   const int nr_queues = s->nr_queues;
   unsigned int seed = qid;
 
+  /* When did we start spinning? (0 if we aren't) */
+  ticks spin_start = 0;
+
   /* Check qid. */
   if (qid >= nr_queues || qid < 0) error("Bad queue ID.");
 
@@ -2927,28 +3313,47 @@ struct task *scheduler_gettask(struct scheduler *s, int qid,
         if (res != NULL) break;
       }
 
-      /* If unsuccessful, try stealing from the other queues. */
+      /* If unsuccessful, try stealing from the other queues, starting with
+       * the ones in our own locality domain. */
       if (s->flags & scheduler_flag_steal) {
-        int count = 0, qids[nr_queues];
-        for (int k = 0; k < nr_queues; k++)
-          if (s->queues[k].count > 0 || s->queues[k].count_incoming > 0) {
-            qids[count++] = k;
-          }
-        for (int k = 0; k < scheduler_maxsteal && count > 0; k++) {
-          const int ind = rand_r(&seed) % count;
-          TIMER_TIC
-          res = queue_gettask(&s->queues[qids[ind]], prev, 0);
-          TIMER_TOC(timer_qsteal);
-          if (res != NULL) {
-            break;
-          } else {
-            qids[ind] = qids[--count];
+        const int domain = s->queue_domain[qid];
+        for (int local = 1; local >= 0 && res == NULL; local--) {
+          int count = 0, qids[nr_queues];
+          for (int k = 0; k < nr_queues; k++)
+            if ((s->queue_domain[k] == domain) == local &&
+                (s->queues[k].count > 0 || s->queues[k].count_incoming > 0)) {
+              qids[count++] = k;
+            }
+          for (int k = 0; k < scheduler_maxsteal && count > 0; k++) {
+            const int ind = rand_r(&seed) % count;
+            TIMER_TIC
+            res = queue_gettask(&s->queues[qids[ind]], prev, 0);
+            TIMER_TOC(timer_qsteal);
+            if (res != NULL) {
+              break;
+            } else {
+              qids[ind] = qids[--count];
+            }
           }
         }
         if (res != NULL) break;
       }
     }
 
+    /* Not allowed to wait? Let the caller do something else. */
+    if (!nap) break;
+
+    /* Keep looking for a while before going to sleep? */
+    if (res == NULL && s->idle_spin_ticks > 0) {
+      const ticks now = getticks();
+      if (spin_start == 0) spin_start = now;
+      if (now - spin_start < s->idle_spin_ticks) continue;
+    }
+    if (spin_start != 0) {
+      *spin_time += getticks() - spin_start;
+      spin_start = 0;
+    }
+
 /* If we failed, take a short nap. */
 #ifdef WITH_MPI
     if (res == NULL && qid > 1)
@@ -2956,17 +3361,22 @@ struct task *scheduler_gettask(struct scheduler *s, int qid,
     if (res == NULL)
 #endif
     {
+      const ticks park_start = getticks();
       pthread_mutex_lock(&s->sleep_mutex);
       res = queue_gettask(&s->queues[qid], prev, 1);
       if (res == NULL && s->waiting > 0) {
         pthread_cond_wait(&s->sleep_cond, &s->sleep_mutex);
       }
       pthread_mutex_unlock(&s->sleep_mutex);
+      *park_time += getticks() - park_start;
     }
 
     scheduler_check_deadlock(s);
   }
 
+  /* Found something, or the step is over, while spinning? */
+  if (spin_start != 0) *spin_time += getticks() - spin_start;
+
   if (res != NULL) {
     scheduler_mark_last_fetch(s);
     /* Start the timer on this task, if we got one. */
@@ -2980,6 +3390,45 @@ struct task *scheduler_gettask(struct scheduler *s, int qid,
   return res;
 }
 
+/**
+ * @brief Get a task, preferably from the given queue.
+ *
+ * Keeps looking for #scheduler.idle_spin_ticks, then sleeps until a task
+ * becomes available or the step is over.
+ *
+ * @param s The #scheduler.
+ * @param qid The ID of the preferred #queue.
+ * @param prev the previous task that was run.
+ * @param spin_time (return) Incremented by the time spent spinning.
+ * @param park_time (return) Incremented by the time spent asleep.
+ *
+ * @return A pointer to a #task or @c NULL if there are no available tasks.
+ */
+struct task *scheduler_gettask(struct scheduler *s, int qid,
+                               const struct task *prev, ticks *spin_time,
+                               ticks *park_time) {
+  return scheduler_gettask_search(s, qid, prev, /*nap=*/1, spin_time,
+                                  park_time);
+}
+
+/**
+ * @brief Get a task, preferably from the given queue, without ever sleeping.
+ *
+ * Used by the runners that have some work of their own to finish (e.g. a
+ * GPU batch in flight) if no task is ready.
+ *
+ * @param s The #scheduler.
+ * @param qid The ID of the preferred #queue.
+ * @param prev the previous task that was run.
+ *
+ * @return A pointer to a #task or @c NULL if none could be found right now.
+ */
+struct task *scheduler_gettask_nowait(struct scheduler *s, int qid,
+                                      const struct task *prev) {
+  /* Never spins nor sleeps, so nothing to time. */
+  return scheduler_gettask_search(s, qid, prev, /*nap=*/0, NULL, NULL);
+}
+
 /**
  * @brief Initialize the #scheduler.
  *
@@ -3005,6 +3454,27 @@ void scheduler_init(struct scheduler *s, struct space *space, int nr_tasks,
   /* Initialize each queue. */
   for (int k = 0; k < nr_queues; k++) queue_init(&s->queues[k], NULL);
 
+  /* Idle runners go to sleep straight away unless told otherwise. */
+  s->idle_spin_ticks = 0;
+
+  /* Split the gravity tasks as finely as the cell sizes allow. */
+  s->grav_task_min_interactions = 0;
+
+  /* Send the foreign gparts whole. */
+  s->compact_foreign_gparts = 0;
+  s->compact_foreign_gparts_in_memory = 0;
+
+  /* No measured task costs yet. */
+  s->measured_weights = 0;
+  bzero(s->task_cost_ratio, sizeof(s->task_cost_ratio));
+  s->task_cost_ratio_all = 0.f;
+
+  /* All the queues are in the same domain until told otherwise. */
+  if ((s->queue_domain = (int *)swift_malloc(
+           "queue_domain", sizeof(int) * nr_queues)) == NULL)
+    error("Failed to allocate the queue domains.");
+  bzero(s->queue_domain, sizeof(int) * nr_queues);
+
   /* Init the sleep mutex and cond. */
   if (pthread_cond_init(&s->sleep_cond, NULL) != 0 ||
       pthread_mutex_init(&s->sleep_mutex, NULL) != 0)
@@ -3031,6 +3501,7 @@ void scheduler_init(struct scheduler *s, struct space *space, int nr_tasks,
   s->size = 0;
   s->tasks = NULL;
   s->tasks_ind = NULL;
+  bzero(&s->rearm, sizeof(s->rearm));
   scheduler_reset(s, nr_tasks);
 
 #if defined(SWIFT_DEBUG_CHECKS)
@@ -3073,6 +3544,11 @@ void scheduler_clean(struct scheduler *s) {
   swift_free("unlock_ind", s->unlock_ind);
   for (int i = 0; i < s->nr_queues; ++i) queue_clean(&s->queues[i]);
   swift_free("queues", s->queues);
+  swift_free("queue_domain", s->queue_domain);
+  task_histograms_clean(&s->histograms);
+  scheduler_rearm_end(s);
+  free(s->rearm.tid);
+  free(s->rearm.wait);
 }
 
 /**
@@ -3080,6 +3556,10 @@ void scheduler_clean(struct scheduler *s) {
  */
 void scheduler_free_tasks(struct scheduler *s) {
   if (s->tasks != NULL) {
+    for (int k = 0; k < s->tasks_next; k++) {
+      task_grav_walk_clean(&s->tasks[k]);
+      task_buff_last_clean(&s->tasks[k]);
+    }
     swift_free("tasks", s->tasks);
     s->tasks = NULL;
   }
@@ -3093,6 +3573,7 @@ void scheduler_free_tasks(struct scheduler *s) {
   }
   s->size = 0;
   s->nr_tasks = 0;
+  s->tasks_next = 0;
 }
 
 /**
@@ -37,6 +37,8 @@
 #include "lock.h"
 #include "queue.h"
 #include "task.h"
+#include "task_critical_path.h"
+#include "task_histograms.h"
 #include "threadpool.h"
 
 /* Some constants. */
@@ -65,6 +67,10 @@ struct scheduler {
   /* Array of queues. */
   struct queue *queues;
 
+  /* Locality domain (e.g. NUMA node) of the runners of each queue. Steals
+   * go to the queues of the same domain first. */
+  int *queue_domain;
+
   /* Total number of tasks. */
   int nr_tasks, size, tasks_next;
 
@@ -81,6 +87,28 @@ struct scheduler {
   int *tid_active;
   int active_count;
 
+  /* Are the end_grav_force tasks held back until the mesh is done? */
+  int hold_end_grav_force;
+
+  /* The waits scheduler_start() gave to the last set of active tasks it
+   * recorded. They are given again by plain stores when the same set comes
+   * back, rather than re-computed (see scheduler_rearm_begin()). */
+  struct {
+    /* Are we recording and re-arming? */
+    int active;
+
+    /* The tasks whose waits the recorded start set, and these waits. */
+    int *tid, *wait;
+    int count, size;
+
+    /* Number of active tasks of the recorded start. */
+    int nr_active;
+
+    /* Per task, 2 if it was active in the recorded start, 1 if it was only
+     * unlocked by one of these, 0 otherwise. */
+    char *mark;
+  } rearm;
+
   /* The task unlocks. */
   struct task **volatile unlocks;
   int *volatile unlock_ind;
@@ -109,6 +137,29 @@ struct scheduler {
   /* Total ticks spent running the tasks */
   ticks total_ticks;
 
+  /* How long an idle runner keeps looking for tasks before going to sleep
+   * (in ticks, 0 to sleep as soon as the queues are found empty). */
+  ticks idle_spin_ticks;
+
+  /* Minimal mean number of interactions of the gravity tasks made by a split,
+   * finer splits are not done (0 to always split). */
+  long long grav_task_min_interactions;
+
+  /* Are the foreign #gpart updates sent as #gpart_foreign rather than as
+   * full #gpart? */
+  int compact_foreign_gparts;
+
+  /* Are the foreign #gpart only kept as the #gpart_foreign received? */
+  int compact_foreign_gparts_in_memory;
+
+  /* Are the task weights based on their measured costs? */
+  int measured_weights;
+
+  /* Ratios of the measured to the modelled task costs, per type and subtype
+   * (indexed as type * task_subtype_count + subtype) and over all tasks */
+  float task_cost_ratio[task_type_count * task_subtype_count];
+  float task_cost_ratio_all;
+
   struct {
     /* Total ticks spent waiting for runners to come home. */
     ticks waiting_ticks;
@@ -126,6 +177,12 @@ struct scheduler {
   /* Frequency of the task levels dumping. */
   int frequency_task_levels;
 
+  /* Histograms of the run and queue wait times of the tasks. */
+  struct task_histograms histograms;
+
+  /* Analysis of the critical path of the tasks. */
+  struct task_critical_path critical_path;
+
 #if defined(SWIFT_DEBUG_CHECKS)
   /* Stuff for the deadlock detector */
 
@@ -287,9 +344,15 @@ void scheduler_init(struct scheduler *s, struct space *space, int nr_tasks,
                     int nr_queues, unsigned int flags, int nodeID,
                     struct threadpool *tp);
 struct task *scheduler_gettask(struct scheduler *s, int qid,
-                               const struct task *prev);
+                               const struct task *prev, ticks *spin_time,
+                               ticks *park_time);
+struct task *scheduler_gettask_nowait(struct scheduler *s, int qid,
+                                      const struct task *prev);
 void scheduler_enqueue(struct scheduler *s, struct task *t);
 void scheduler_start(struct scheduler *s);
+void scheduler_release_end_grav_force(struct scheduler *s);
+void scheduler_rearm_begin(struct scheduler *s);
+void scheduler_rearm_end(struct scheduler *s);
 void scheduler_reset(struct scheduler *s, int nr_tasks);
 void scheduler_ranktasks(struct scheduler *s);
 void scheduler_reweight(struct scheduler *s, int verbose);
@@ -67,64 +67,31 @@
 static const int io_max_size_output_list = 100;
 
 /**
- * @brief Reads a data array from a given HDF5 group.
+ * @brief Reads a chunk of data from an open HDF5 dataset
  *
- * @param grp The group from which to read.
- * @param props The #io_props of the field to read
- * @param N The number of particles to read on this rank.
- * @param N_total The total number of particles on all ranks.
- * @param offset The offset position where this rank starts reading.
- * @param internal_units The #unit_system used internally
- * @param ic_units The #unit_system used in the ICs
+ * @param h_data The HDF5 dataset to read from.
+ * @param props The #io_props of the field to read.
+ * @param N The number of particles to read.
+ * @param offset Offset in the array on disk where the chunk starts.
+ * @param internal_units The #unit_system used internally.
+ * @param ic_units The #unit_system used in the ICs.
  * @param cleanup_h Are we removing h-factors from the ICs?
  * @param cleanup_sqrt_a Are we cleaning-up the sqrt(a) factors in the Gadget
  * IC velocities?
  * @param h The value of the reduced Hubble constant to use for cleaning.
  * @param a The current value of the scale-factor.
- *
- * @todo A better version using HDF5 hyper-slabs to read the file directly into
- * the part array will be written once the structures have been stabilized.
  */
-void read_array_serial(hid_t grp, const struct io_props props, size_t N,
-                       long long N_total, long long offset,
-                       const struct unit_system* internal_units,
-                       const struct unit_system* ic_units, int cleanup_h,
-                       int cleanup_sqrt_a, double h, double a) {
+void read_array_serial_chunk(hid_t h_data, const struct io_props props,
+                             size_t N, long long offset,
+                             const struct unit_system* internal_units,
+                             const struct unit_system* ic_units,
+                             int cleanup_h, int cleanup_sqrt_a, double h,
+                             double a) {
 
   const size_t typeSize = io_sizeof_type(props.type);
   const size_t copySize = typeSize * props.dimension;
   const size_t num_elements = N * props.dimension;
 
-  /* Check whether the dataspace exists or not */
-  const htri_t exist = H5Lexists(grp, props.name, 0);
-  if (exist < 0) {
-    error("Error while checking the existence of data set '%s'.", props.name);
-  } else if (exist == 0) {
-    if (props.importance == COMPULSORY) {
-      error("Compulsory data set '%s' not present in the file.", props.name);
-    } else {
-
-      /* Create a single instance of the default value */
-      float* temp = (float*)malloc(copySize);
-      for (int i = 0; i < props.dimension; ++i) temp[i] = props.default_value;
-
-      /* Copy it everywhere in the particle array */
-      for (size_t i = 0; i < N; ++i)
-        memcpy(props.field + i * props.partSize, temp, copySize);
-
-      free(temp);
-      return;
-    }
-  }
-
-  /* message( "Reading %s '%s' array...", importance == COMPULSORY ? */
-  /* 	   "compulsory": "optional  ", name); */
-  /* fflush(stdout); */
-
-  /* Open data space */
-  const hid_t h_data = H5Dopen(grp, props.name, H5P_DEFAULT);
-  if (h_data < 0) error("Error while opening data space '%s'.", props.name);
-
   /* Allocate temporary buffer */
   void* temp = malloc(num_elements * typeSize);
   if (temp == NULL) error("Unable to allocate memory for temporary buffer");
@@ -163,7 +130,7 @@ void read_array_serial(hid_t grp, const struct io_props props, size_t N,
   /* Unit conversion if necessary */
   const double factor =
       units_conversion_factor(ic_units, internal_units, props.units);
-  if (factor != 1. && exist != 0) {
+  if (factor != 1.) {
 
     /* message("Converting ! factor=%e", factor); */
 
@@ -208,7 +175,7 @@ void read_array_serial(hid_t grp, const struct io_props props, size_t N,
 
   /* Clean-up h if necessary */
   const float h_factor_exp = units_h_factor(internal_units, props.units);
-  if (cleanup_h && h_factor_exp != 0.f && exist != 0) {
+  if (cleanup_h && h_factor_exp != 0.f) {
 
     /* message("Multipltying '%s' by h^%f=%f", props.name, h_factor_exp,
      * h_factor); */
@@ -247,6 +214,85 @@ void read_array_serial(hid_t grp, const struct io_props props, size_t N,
   free(temp);
   H5Sclose(h_filespace);
   H5Sclose(h_memspace);
+}
+
+/**
+ * @brief Reads a data array from a given HDF5 group.
+ *
+ * @param grp The group from which to read.
+ * @param props The #io_props of the field to read
+ * @param N The number of particles to read on this rank.
+ * @param N_total The total number of particles on all ranks.
+ * @param offset The offset position where this rank starts reading.
+ * @param internal_units The #unit_system used internally
+ * @param ic_units The #unit_system used in the ICs
+ * @param cleanup_h Are we removing h-factors from the ICs?
+ * @param cleanup_sqrt_a Are we cleaning-up the sqrt(a) factors in the Gadget
+ * IC velocities?
+ * @param h The value of the reduced Hubble constant to use for cleaning.
+ * @param a The current value of the scale-factor.
+ *
+ * @todo A better version using HDF5 hyper-slabs to read the file directly into
+ * the part array will be written once the structures have been stabilized.
+ */
+void read_array_serial(hid_t grp, const struct io_props props, size_t N,
+                       long long N_total, long long offset,
+                       const struct unit_system* internal_units,
+                       const struct unit_system* ic_units, int cleanup_h,
+                       int cleanup_sqrt_a, double h, double a) {
+
+  const size_t typeSize = io_sizeof_type(props.type);
+  const size_t copySize = typeSize * props.dimension;
+
+  /* Check whether the dataspace exists or not */
+  const htri_t exist = H5Lexists(grp, props.name, 0);
+  if (exist < 0) {
+    error("Error while checking the existence of data set '%s'.", props.name);
+  } else if (exist == 0) {
+    if (props.importance == COMPULSORY) {
+      error("Compulsory data set '%s' not present in the file.", props.name);
+    } else {
+
+      /* Create a single instance of the default value */
+      float* temp = (float*)malloc(copySize);
+      for (int i = 0; i < props.dimension; ++i) temp[i] = props.default_value;
+
+      /* Copy it everywhere in the particle array */
+      for (size_t i = 0; i < N; ++i)
+        memcpy(props.field + i * props.partSize, temp, copySize);
+
+      free(temp);
+      return;
+    }
+  }
+
+  /* message( "Reading %s '%s' array...", importance == COMPULSORY ? */
+  /* 	   "compulsory": "optional  ", name); */
+  /* fflush(stdout); */
+
+  /* Open data space */
+  const hid_t h_data = H5Dopen(grp, props.name, H5P_DEFAULT);
+  if (h_data < 0) error("Error while opening data space '%s'.", props.name);
+
+  /* Read the field in pieces of bounded size */
+  struct io_props chunk_props = props;
+  size_t done = 0;
+  while (done < N) {
+    const size_t this_chunk = io_read_chunk_length(N - done, copySize);
+    read_array_serial_chunk(h_data, chunk_props, this_chunk, offset + done,
+                            internal_units, ic_units, cleanup_h,
+                            cleanup_sqrt_a, h, a);
+
+    chunk_props.field += this_chunk * props.partSize; /* char* on the field */
+    chunk_props.parts += this_chunk;                  /* part* on the part */
+    chunk_props.xparts += this_chunk;                 /* xpart* on the xpart */
+    chunk_props.gparts += this_chunk;                 /* gpart* on the gpart */
+    chunk_props.sparts += this_chunk;                 /* spart* on the spart */
+    chunk_props.bparts += this_chunk;                 /* bpart* on the bpart */
+    done += this_chunk;
+  }
+
+  /* Free and close everything */
   H5Dclose(h_data);
 }
 
@@ -263,8 +309,8 @@ void prepare_array_serial(
   if (h_space < 0)
     error("Error while creating data space for field '%s'.", props.name);
 
-  /* Decide what chunk size to use based on compression */
-  int log2_chunk_size = 20;
+  /* Decide what chunk size to use */
+  const int log2_chunk_size = io_log2_chunk_size(e, N_total, e->s->nr_cells);
 
   int rank = 0;
   hsize_t shape[2];
@@ -1068,6 +1114,9 @@ void write_output_serial(struct engine* e,
     if (!subsample[i]) subsample_fraction[i] = 1.f;
   }
 
+  /* Seed of the selection of the sub-sampled particles */
+  const int subsample_seed = io_get_subsample_seed(e);
+
   /* Number of particles that we will write */
   size_t Ngas_written, Ndm_written, Ndm_background, Ndm_neutrino,
       Nsinks_written, Nstars_written, Nblackholes_written;
@@ -1075,7 +1124,7 @@ void write_output_serial(struct engine* e,
   if (subsample[swift_type_gas]) {
     Ngas_written = io_count_gas_to_write(e->s, /*subsample=*/1,
                                          subsample_fraction[swift_type_gas],
-                                         e->snapshot_output_count);
+                                         subsample_seed);
   } else {
     Ngas_written =
         e->s->nr_parts - e->s->nr_inhibited_parts - e->s->nr_extra_parts;
@@ -1084,7 +1133,7 @@ void write_output_serial(struct engine* e,
   if (subsample[swift_type_stars]) {
     Nstars_written = io_count_stars_to_write(
         e->s, /*subsample=*/1, subsample_fraction[swift_type_stars],
-        e->snapshot_output_count);
+        subsample_seed);
   } else {
     Nstars_written =
         e->s->nr_sparts - e->s->nr_inhibited_sparts - e->s->nr_extra_sparts;
@@ -1093,7 +1142,7 @@ void write_output_serial(struct engine* e,
   if (subsample[swift_type_black_hole]) {
     Nblackholes_written = io_count_black_holes_to_write(
         e->s, /*subsample=*/1, subsample_fraction[swift_type_black_hole],
-        e->snapshot_output_count);
+        subsample_seed);
   } else {
     Nblackholes_written =
         e->s->nr_bparts - e->s->nr_inhibited_bparts - e->s->nr_extra_bparts;
@@ -1102,7 +1151,7 @@ void write_output_serial(struct engine* e,
   if (subsample[swift_type_sink]) {
     Nsinks_written = io_count_sinks_to_write(
         e->s, /*subsample=*/1, subsample_fraction[swift_type_sink],
-        e->snapshot_output_count);
+        subsample_seed);
   } else {
     Nsinks_written =
         e->s->nr_sinks - e->s->nr_inhibited_sinks - e->s->nr_extra_sinks;
@@ -1110,13 +1159,12 @@ void write_output_serial(struct engine* e,
 
   Ndm_written = io_count_dark_matter_to_write(
       e->s, subsample[swift_type_dark_matter],
-      subsample_fraction[swift_type_dark_matter], e->snapshot_output_count);
+      subsample_fraction[swift_type_dark_matter], subsample_seed);
 
   if (with_DM_background) {
     Ndm_background = io_count_background_dark_matter_to_write(
         e->s, subsample[swift_type_dark_matter_background],
-        subsample_fraction[swift_type_dark_matter_background],
-        e->snapshot_output_count);
+        subsample_fraction[swift_type_dark_matter_background], subsample_seed);
   } else {
     Ndm_background = 0;
   }
@@ -1124,7 +1172,7 @@ void write_output_serial(struct engine* e,
   if (with_neutrinos) {
     Ndm_neutrino = io_count_neutrinos_to_write(
         e->s, subsample[swift_type_neutrino],
-        subsample_fraction[swift_type_neutrino], e->snapshot_output_count);
+        subsample_fraction[swift_type_neutrino], subsample_seed);
   } else {
     Ndm_neutrino = 0;
   }
@@ -1274,6 +1322,8 @@ void write_output_serial(struct engine* e,
       io_write_attribute_s(h_grp, "OutputType", "SubSampled");
       io_write_attribute(h_grp, "SubSampleFractions", FLOAT, subsample_fraction,
                          swift_type_count);
+      io_write_attribute_i(h_grp, "SubSampleSameParticles",
+                           e->snapshot_subsample_same_particles);
     } else {
       io_write_attribute_s(h_grp, "OutputType", "FullVolume");
     }
@@ -1350,8 +1400,8 @@ void write_output_serial(struct engine* e,
   io_write_cell_offsets(h_grp_cells, e->s->cdim, e->s->dim, e->s->cells_top,
                         e->s->nr_cells, e->s->width, mpi_rank,
                         /*distributed=*/0, subsample, subsample_fraction,
-                        e->snapshot_output_count, N_total, offset, to_write,
-                        numFields, internal_units, snapshot_units);
+                        subsample_seed, N_total, offset, to_write, numFields,
+                        internal_units, snapshot_units);
 
   /* Close everything */
   if (mpi_rank == 0) {
@@ -1445,7 +1495,7 @@ void write_output_serial(struct engine* e,
               io_collect_parts_to_write(
                   parts, xparts, parts_written, xparts_written,
                   subsample[swift_type_gas], subsample_fraction[swift_type_gas],
-                  e->snapshot_output_count, Ngas, Ngas_written);
+                  subsample_seed, Ngas, Ngas_written);
 
               /* Select the fields to write */
               io_select_hydro_fields(parts_written, xparts_written,
@@ -1493,7 +1543,7 @@ void write_output_serial(struct engine* e,
                   gparts, e->s->gpart_group_data, gparts_written,
                   gpart_group_data_written, subsample[swift_type_dark_matter],
                   subsample_fraction[swift_type_dark_matter],
-                  e->snapshot_output_count, Ntot, Ndm_written, with_stf);
+                  subsample_seed, Ntot, Ndm_written, with_stf);
 
               /* Select the fields to write */
               io_select_dm_fields(gparts_written, gpart_group_data_written,
@@ -1529,7 +1579,7 @@ void write_output_serial(struct engine* e,
                 gpart_group_data_written,
                 subsample[swift_type_dark_matter_background],
                 subsample_fraction[swift_type_dark_matter_background],
-                e->snapshot_output_count, Ntot, Ndm_background, with_stf);
+                subsample_seed, Ntot, Ndm_background, with_stf);
 
             /* Select the fields to write */
             io_select_dm_fields(gparts_written, gpart_group_data_written,
@@ -1564,7 +1614,7 @@ void write_output_serial(struct engine* e,
                 gparts, e->s->gpart_group_data, gparts_written,
                 gpart_group_data_written, subsample[swift_type_neutrino],
                 subsample_fraction[swift_type_neutrino],
-                e->snapshot_output_count, Ntot, Ndm_neutrino, with_stf);
+                subsample_seed, Ntot, Ndm_neutrino, with_stf);
 
             /* Select the fields to write */
             io_select_neutrino_fields(gparts_written, gpart_group_data_written,
@@ -1595,8 +1645,8 @@ void write_output_serial(struct engine* e,
               /* Collect the particles we want to write */
               io_collect_sinks_to_write(
                   sinks, sinks_written, subsample[swift_type_sink],
-                  subsample_fraction[swift_type_sink], e->snapshot_output_count,
-                  Nsinks, Nsinks_written);
+                  subsample_fraction[swift_type_sink], subsample_seed, Nsinks,
+                  Nsinks_written);
 
               /* Select the fields to write */
               io_select_sink_fields(sinks_written, with_cosmology, with_fof,
@@ -1629,7 +1679,7 @@ void write_output_serial(struct engine* e,
               io_collect_sparts_to_write(
                   sparts, sparts_written, subsample[swift_type_stars],
                   subsample_fraction[swift_type_stars],
-                  e->snapshot_output_count, Nstars, Nstars_written);
+                  subsample_seed, Nstars, Nstars_written);
 
               /* Select the fields to write */
               io_select_star_fields(sparts_written, with_cosmology, with_fof,
@@ -1662,7 +1712,7 @@ void write_output_serial(struct engine* e,
               io_collect_bparts_to_write(
                   bparts, bparts_written, subsample[swift_type_black_hole],
                   subsample_fraction[swift_type_black_hole],
-                  e->snapshot_output_count, Nblackholes, Nblackholes_written);
+                  subsample_seed, Nblackholes, Nblackholes_written);
 
               /* Select the fields to write */
               io_select_bh_fields(bparts_written, with_cosmology, with_fof,
@@ -24,6 +24,11 @@
 /* Local includes */
 #include "inline.h"
 
+/* Note: this is only the placeholder needed by the cell_grid code. The
+ * Delaunay/Voronoi construction of the moving-mesh scheme is not part of this
+ * version of the code, such that there is no tessellation to build, update
+ * or reuse between steps yet. */
+
 struct voronoi {
   int pair_count[27];
 };
@@ -67,76 +67,70 @@
 static const int io_max_size_output_list = 100;
 
 /**
- * @brief Reads a data array from a given HDF5 group.
+ * @brief Reads a chunk of data from an open HDF5 dataset
  *
- * @param h_grp The group from which to read.
- * @param prop The #io_props of the field to read
- * @param N The number of particles.
- * @param internal_units The #unit_system used internally
- * @param ic_units The #unit_system used in the ICs
+ * @param h_data The HDF5 dataset to read from.
+ * @param props The #io_props of the field to read.
+ * @param N The number of particles to read.
+ * @param offset Offset in the array on disk where the chunk starts.
+ * @param internal_units The #unit_system used internally.
+ * @param ic_units The #unit_system used in the ICs.
  * @param cleanup_h Are we removing h-factors from the ICs?
  * @param cleanup_sqrt_a Are we cleaning-up the sqrt(a) factors in the Gadget
  * IC velocities?
- * @param h The value of the reduced Hubble constant.
+ * @param h The value of the reduced Hubble constant to use for cleaning.
  * @param a The current value of the scale-factor.
- *
- * @todo A better version using HDF5 hyper-slabs to read the file directly into
- * the part array will be written once the structures have been stabilized.
  */
-void read_array_single(hid_t h_grp, const struct io_props props, size_t N,
-                       const struct unit_system* internal_units,
-                       const struct unit_system* ic_units, int cleanup_h,
-                       int cleanup_sqrt_a, double h, double a) {
+void read_array_single_chunk(hid_t h_data, const struct io_props props,
+                             size_t N, long long offset,
+                             const struct unit_system* internal_units,
+                             const struct unit_system* ic_units,
+                             int cleanup_h, int cleanup_sqrt_a, double h,
+                             double a) {
 
   const size_t typeSize = io_sizeof_type(props.type);
   const size_t copySize = typeSize * props.dimension;
   const size_t num_elements = N * props.dimension;
 
-  /* Check whether the dataspace exists or not */
-  const htri_t exist = H5Lexists(h_grp, props.name, 0);
-  if (exist < 0) {
-    error("Error while checking the existence of data set '%s'.", props.name);
-  } else if (exist == 0) {
-    if (props.importance == COMPULSORY) {
-      error("Compulsory data set '%s' not present in the file.", props.name);
-    } else {
-
-      /* Create a single instance of the default value */
-      float* temp = (float*)malloc(copySize);
-      for (int i = 0; i < props.dimension; ++i) temp[i] = props.default_value;
-
-      /* Copy it everywhere in the particle array */
-      for (size_t i = 0; i < N; ++i)
-        memcpy(props.field + i * props.partSize, temp, copySize);
+  /* Allocate temporary buffer */
+  void* temp = malloc(num_elements * typeSize);
+  if (temp == NULL) error("Unable to allocate memory for temporary buffer");
 
-      free(temp);
-      return;
-    }
+  /* Prepare information for hyper-slab */
+  hsize_t shape[2], offsets[2];
+  int rank;
+  if (props.dimension > 1) {
+    rank = 2;
+    shape[0] = N;
+    shape[1] = props.dimension;
+    offsets[0] = offset;
+    offsets[1] = 0;
+  } else {
+    rank = 2;
+    shape[0] = N;
+    shape[1] = 1;
+    offsets[0] = offset;
+    offsets[1] = 0;
   }
 
-  /* message("Reading %s '%s' array...", */
-  /*         props.importance == COMPULSORY ? "compulsory" : "optional  ", */
-  /*         props.name); */
+  /* Create data space in memory */
+  const hid_t h_memspace = H5Screate_simple(rank, shape, NULL);
 
-  /* Open data space */
-  const hid_t h_data = H5Dopen(h_grp, props.name, H5P_DEFAULT);
-  if (h_data < 0) error("Error while opening data space '%s'.", props.name);
-
-  /* Allocate temporary buffer */
-  void* temp = malloc(num_elements * typeSize);
-  if (temp == NULL) error("Unable to allocate memory for temporary buffer");
+  /* Select hyper-slab in file */
+  const hid_t h_filespace = H5Dget_space(h_data);
+  H5Sselect_hyperslab(h_filespace, H5S_SELECT_SET, offsets, NULL, shape, NULL);
 
   /* Read HDF5 dataspace in temporary buffer */
   /* Dirty version that happens to work for vectors but should be improved */
   /* Using HDF5 dataspaces would be better */
-  const hid_t h_err = H5Dread(h_data, io_hdf5_type(props.type), H5S_ALL,
-                              H5S_ALL, H5P_DEFAULT, temp);
+  const hid_t h_err = H5Dread(h_data, io_hdf5_type(props.type), h_memspace,
+                              h_filespace, H5P_DEFAULT, temp);
   if (h_err < 0) error("Error while reading data array '%s'.", props.name);
 
   /* Unit conversion if necessary */
   const double unit_factor =
       units_conversion_factor(ic_units, internal_units, props.units);
-  if (unit_factor != 1. && exist != 0) {
+  if (unit_factor != 1.) {
 
     /* message("Converting ! factor=%e", factor); */
 
@@ -182,7 +176,7 @@ void read_array_single(hid_t h_grp, const struct io_props props, size_t N,
 
   /* Clean-up h if necessary */
   const float h_factor_exp = units_h_factor(internal_units, props.units);
-  if (cleanup_h && h_factor_exp != 0.f && exist != 0) {
+  if (cleanup_h && h_factor_exp != 0.f) {
 
     /* message("Multipltying '%s' by h^%f=%f", props.name, h_factor_exp,
      * h_factor); */
@@ -219,6 +213,84 @@ void read_array_single(hid_t h_grp, const struct io_props props, size_t N,
 
   /* Free and close everything */
   free(temp);
+  H5Sclose(h_filespace);
+  H5Sclose(h_memspace);
+}
+
+/**
+ * @brief Reads a data array from a given HDF5 group.
+ *
+ * @param h_grp The group from which to read.
+ * @param prop The #io_props of the field to read
+ * @param N The number of particles.
+ * @param internal_units The #unit_system used internally
+ * @param ic_units The #unit_system used in the ICs
+ * @param cleanup_h Are we removing h-factors from the ICs?
+ * @param cleanup_sqrt_a Are we cleaning-up the sqrt(a) factors in the Gadget
+ * IC velocities?
+ * @param h The value of the reduced Hubble constant.
+ * @param a The current value of the scale-factor.
+ *
+ * @todo A better version using HDF5 hyper-slabs to read the file directly into
+ * the part array will be written once the structures have been stabilized.
+ */
+void read_array_single(hid_t h_grp, const struct io_props props, size_t N,
+                       const struct unit_system* internal_units,
+                       const struct unit_system* ic_units, int cleanup_h,
+                       int cleanup_sqrt_a, double h, double a) {
+
+  const size_t typeSize = io_sizeof_type(props.type);
+  const size_t copySize = typeSize * props.dimension;
+
+  /* Check whether the dataspace exists or not */
+  const htri_t exist = H5Lexists(h_grp, props.name, 0);
+  if (exist < 0) {
+    error("Error while checking the existence of data set '%s'.", props.name);
+  } else if (exist == 0) {
+    if (props.importance == COMPULSORY) {
+      error("Compulsory data set '%s' not present in the file.", props.name);
+    } else {
+
+      /* Create a single instance of the default value */
+      float* temp = (float*)malloc(copySize);
+      for (int i = 0; i < props.dimension; ++i) temp[i] = props.default_value;
+
+      /* Copy it everywhere in the particle array */
+      for (size_t i = 0; i < N; ++i)
+        memcpy(props.field + i * props.partSize, temp, copySize);
+
+      free(temp);
+      return;
+    }
+  }
+
+  /* message("Reading %s '%s' array...", */
+  /*         props.importance == COMPULSORY ? "compulsory" : "optional  ", */
+  /*         props.name); */
+
+  /* Open data space */
+  const hid_t h_data = H5Dopen(h_grp, props.name, H5P_DEFAULT);
+  if (h_data < 0) error("Error while opening data space '%s'.", props.name);
+
+  /* Read the field in pieces of bounded size */
+  struct io_props chunk_props = props;
+  size_t done = 0;
+  while (done < N) {
+    const size_t this_chunk = io_read_chunk_length(N - done, copySize);
+    read_array_single_chunk(h_data, chunk_props, this_chunk, done,
+                            internal_units, ic_units, cleanup_h,
+                            cleanup_sqrt_a, h, a);
+
+    chunk_props.field += this_chunk * props.partSize; /* char* on the field */
+    chunk_props.parts += this_chunk;                  /* part* on the part */
+    chunk_props.xparts += this_chunk;                 /* xpart* on the xpart */
+    chunk_props.gparts += this_chunk;                 /* gpart* on the gpart */
+    chunk_props.sparts += this_chunk;                 /* spart* on the spart */
+    chunk_props.bparts += this_chunk;                 /* bpart* on the bpart */
+    done += this_chunk;
+  }
+
+  /* Free and close everything */
   H5Dclose(h_data);
 }
 
@@ -265,8 +337,8 @@ void write_array_single(const struct engine* e, hid_t grp, const char* fileName,
   if (h_space < 0)
     error("Error while creating data space for field '%s'.", props.name);
 
-  /* Decide what chunk size to use based on compression */
-  int log2_chunk_size = 20;
+  /* Decide what chunk size to use */
+  const int log2_chunk_size = io_log2_chunk_size(e, N, e->s->nr_cells);
 
   int rank;
   hsize_t shape[2];
@@ -300,6 +372,15 @@ void write_array_single(const struct engine* e, hid_t grp, const char* fileName,
   /* Dataset properties */
   hid_t h_prop = H5Pcreate(H5P_DATASET_CREATE);
 
+  /* Are the chunks compressed by our threads and written directly? */
+#ifdef IO_PARALLEL_COMPRESSION
+  const int direct_chunks = e->snapshot_parallel_compression && N > 0 &&
+                            e->snapshot_compression > 0 &&
+                            lossy_compression == compression_write_lossless;
+#else
+  const int direct_chunks = 0;
+#endif
+
   /* Create filters and set compression level if we have something to write */
   char comp_buffer[32] = "None";
   if (N > 0) {
@@ -329,10 +410,14 @@ void write_array_single(const struct engine* e, hid_t grp, const char* fileName,
               props.name);
     }
 
-    /* Impose check-sum to verify data corruption */
-    h_err = H5Pset_fletcher32(h_prop);
-    if (h_err < 0)
-      error("Error while setting checksum options for field '%s'.", props.name);
+    /* Impose check-sum to verify data corruption, unless we filter the
+     * chunks ourselves. */
+    if (!direct_chunks) {
+      h_err = H5Pset_fletcher32(h_prop);
+      if (h_err < 0)
+        error("Error while setting checksum options for field '%s'.",
+              props.name);
+    }
   }
 
   /* Create dataset */
@@ -341,9 +426,17 @@ void write_array_single(const struct engine* e, hid_t grp, const char* fileName,
   if (h_data < 0) error("Error while creating dataspace '%s'.", props.name);
 
   /* Write temporary buffer to HDF5 dataspace */
-  h_err = H5Dwrite(h_data, io_hdf5_type(props.type), h_space, H5S_ALL,
-                   H5P_DEFAULT, temp);
-  if (h_err < 0) error("Error while writing data array '%s'.", props.name);
+  if (direct_chunks) {
+#ifdef IO_PARALLEL_COMPRESSION
+    io_write_compressed_chunks((struct threadpool*)&e->threadpool, h_data,
+                               temp, N, props.dimension, typeSize,
+                               chunk_shape[0], e->snapshot_compression);
+#endif
+  } else {
+    h_err = H5Dwrite(h_data, io_hdf5_type(props.type), h_space, H5S_ALL,
+                     H5P_DEFAULT, temp);
+    if (h_err < 0) error("Error while writing data array '%s'.", props.name);
+  }
 
   /* Write XMF description for this data set */
   if (xmfFile != NULL)
@@ -903,6 +996,9 @@ void write_output_single(struct engine* e,
     if (!subsample[i]) subsample_fraction[i] = 1.f;
   }
 
+  /* Seed of the selection of the sub-sampled particles */
+  const int subsample_seed = io_get_subsample_seed(e);
+
   /* First time, we need to create the XMF file */
   if (e->snapshot_output_count == 0) xmf_create_file(xmfFileName);
 
@@ -920,7 +1016,7 @@ void write_output_single(struct engine* e,
   if (subsample[swift_type_gas]) {
     Ngas_written = io_count_gas_to_write(e->s, /*subsample=*/1,
                                          subsample_fraction[swift_type_gas],
-                                         e->snapshot_output_count);
+                                         subsample_seed);
   } else {
     Ngas_written =
         e->s->nr_parts - e->s->nr_inhibited_parts - e->s->nr_extra_parts;
@@ -929,7 +1025,7 @@ void write_output_single(struct engine* e,
   if (subsample[swift_type_stars]) {
     Nstars_written = io_count_stars_to_write(
         e->s, /*subsample=*/1, subsample_fraction[swift_type_stars],
-        e->snapshot_output_count);
+        subsample_seed);
   } else {
     Nstars_written =
         e->s->nr_sparts - e->s->nr_inhibited_sparts - e->s->nr_extra_sparts;
@@ -938,7 +1034,7 @@ void write_output_single(struct engine* e,
   if (subsample[swift_type_black_hole]) {
     Nblackholes_written = io_count_black_holes_to_write(
         e->s, /*subsample=*/1, subsample_fraction[swift_type_black_hole],
-        e->snapshot_output_count);
+        subsample_seed);
   } else {
     Nblackholes_written =
         e->s->nr_bparts - e->s->nr_inhibited_bparts - e->s->nr_extra_bparts;
@@ -947,7 +1043,7 @@ void write_output_single(struct engine* e,
   if (subsample[swift_type_sink]) {
     Nsinks_written = io_count_sinks_to_write(
         e->s, /*subsample=*/1, subsample_fraction[swift_type_sink],
-        e->snapshot_output_count);
+        subsample_seed);
   } else {
     Nsinks_written =
         e->s->nr_sinks - e->s->nr_inhibited_sinks - e->s->nr_extra_sinks;
@@ -955,13 +1051,12 @@ void write_output_single(struct engine* e,
 
   Ndm_written = io_count_dark_matter_to_write(
       e->s, subsample[swift_type_dark_matter],
-      subsample_fraction[swift_type_dark_matter], e->snapshot_output_count);
+      subsample_fraction[swift_type_dark_matter], subsample_seed);
 
   if (with_DM_background) {
     Ndm_background = io_count_background_dark_matter_to_write(
         e->s, subsample[swift_type_dark_matter_background],
-        subsample_fraction[swift_type_dark_matter_background],
-        e->snapshot_output_count);
+        subsample_fraction[swift_type_dark_matter_background], subsample_seed);
   } else {
     Ndm_background = 0;
   }
@@ -969,7 +1064,7 @@ void write_output_single(struct engine* e,
   if (with_neutrinos) {
     Ndm_neutrino = io_count_neutrinos_to_write(
         e->s, subsample[swift_type_neutrino],
-        subsample_fraction[swift_type_neutrino], e->snapshot_output_count);
+        subsample_fraction[swift_type_neutrino], subsample_seed);
   } else {
     Ndm_neutrino = 0;
   }
@@ -1096,6 +1191,8 @@ void write_output_single(struct engine* e,
     io_write_attribute_s(h_grp, "OutputType", "SubSampled");
     io_write_attribute(h_grp, "SubSampleFractions", FLOAT, subsample_fraction,
                        swift_type_count);
+    io_write_attribute_i(h_grp, "SubSampleSameParticles",
+                         e->snapshot_subsample_same_particles);
   } else {
     io_write_attribute_s(h_grp, "OutputType", "FullVolume");
   }
@@ -1118,8 +1215,8 @@ void write_output_single(struct engine* e,
   io_write_cell_offsets(h_grp, e->s->cdim, e->s->dim, e->s->cells_top,
                         e->s->nr_cells, e->s->width, e->nodeID,
                         /*distributed=*/0, subsample, subsample_fraction,
-                        e->snapshot_output_count, N_total, global_offsets,
-                        to_write, numFields, internal_units, snapshot_units);
+                        subsample_seed, N_total, global_offsets, to_write,
+                        numFields, internal_units, snapshot_units);
   H5Gclose(h_grp);
 
   /* Loop over all particle types */
@@ -1200,7 +1297,7 @@ void write_output_single(struct engine* e,
           io_collect_parts_to_write(
               parts, xparts, parts_written, xparts_written,
               subsample[swift_type_gas], subsample_fraction[swift_type_gas],
-              e->snapshot_output_count, Ngas, Ngas_written);
+              subsample_seed, Ngas, Ngas_written);
 
           /* Select the fields to write */
           io_select_hydro_fields(parts_written, xparts_written, with_cosmology,
@@ -1246,7 +1343,7 @@ void write_output_single(struct engine* e,
               gparts, e->s->gpart_group_data, gparts_written,
               gpart_group_data_written, subsample[swift_type_dark_matter],
               subsample_fraction[swift_type_dark_matter],
-              e->snapshot_output_count, Ntot, Ndm_written, with_stf);
+              subsample_seed, Ntot, Ndm_written, with_stf);
 
           /* Select the fields to write */
           io_select_dm_fields(gparts_written, gpart_group_data_written,
@@ -1281,7 +1378,7 @@ void write_output_single(struct engine* e,
             gpart_group_data_written,
             subsample[swift_type_dark_matter_background],
             subsample_fraction[swift_type_dark_matter_background],
-            e->snapshot_output_count, Ntot, Ndm_background, with_stf);
+            subsample_seed, Ntot, Ndm_background, with_stf);
 
         /* Select the fields to write */
         io_select_dm_fields(gparts_written, gpart_group_data_written, with_fof,
@@ -1314,8 +1411,8 @@ void write_output_single(struct engine* e,
         io_collect_gparts_neutrino_to_write(
             gparts, e->s->gpart_group_data, gparts_written,
             gpart_group_data_written, subsample[swift_type_neutrino],
-            subsample_fraction[swift_type_neutrino], e->snapshot_output_count,
-            Ntot, Ndm_neutrino, with_stf);
+            subsample_fraction[swift_type_neutrino], subsample_seed, Ntot,
+            Ndm_neutrino, with_stf);
 
         /* Select the fields to write */
         io_select_neutrino_fields(gparts_written, gpart_group_data_written,
@@ -1346,8 +1443,8 @@ void write_output_single(struct engine* e,
           /* Collect the particles we want to write */
           io_collect_sinks_to_write(
               sinks, sinks_written, subsample[swift_type_sink],
-              subsample_fraction[swift_type_sink], e->snapshot_output_count,
-              Nsinks, Nsinks_written);
+              subsample_fraction[swift_type_sink], subsample_seed, Nsinks,
+              Nsinks_written);
 
           /* Select the fields to write */
           io_select_sink_fields(sinks_written, with_cosmology, with_fof,
@@ -1379,8 +1476,8 @@ void write_output_single(struct engine* e,
           /* Collect the particles we want to write */
           io_collect_sparts_to_write(
               sparts, sparts_written, subsample[swift_type_stars],
-              subsample_fraction[swift_type_stars], e->snapshot_output_count,
-              Nstars, Nstars_written);
+              subsample_fraction[swift_type_stars], subsample_seed, Nstars,
+              Nstars_written);
 
           /* Select the fields to write */
           io_select_star_fields(sparts_written, with_cosmology, with_fof,
@@ -1413,7 +1510,7 @@ void write_output_single(struct engine* e,
           io_collect_bparts_to_write(
               bparts, bparts_written, subsample[swift_type_black_hole],
               subsample_fraction[swift_type_black_hole],
-              e->snapshot_output_count, Nblackholes, Nblackholes_written);
+              subsample_seed, Nblackholes, Nblackholes_written);
 
           /* Select the fields to write */
           io_select_bh_fields(bparts_written, with_cosmology, with_fof,
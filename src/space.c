@@ -28,6 +28,7 @@
 #include <float.h>
 #include <limits.h>
 #include <math.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -64,6 +65,16 @@
 
 /* Split size. */
 int space_splitsize = space_splitsize_default;
+
+/*! Split size of the #gpart leaves under self-gravity (the default of the
+ * top-level cells) and the range it is tuned in */
+int space_splitsize_grav = space_splitsize_default;
+int space_splitsize_grav_min = space_splitsize_default;
+int space_splitsize_grav_max = space_splitsize_default;
+
+/*! Target time (in ms) per run of the gravity tasks of a leaf when tuning
+ * the leaf sizes (0 for no tuning) */
+float space_split_tune_time = 0.f;
 int space_subsize_pair_hydro = space_subsize_pair_hydro_default;
 int space_subsize_self_hydro = space_subsize_self_hydro_default;
 int space_subsize_pair_stars = space_subsize_pair_stars_default;
@@ -140,6 +151,11 @@ void space_free_foreign_parts(struct space *s, const int clear_cell_pointers) {
     s->size_gparts_foreign = 0;
     s->gparts_foreign = NULL;
   }
+  if (s->gparts_foreign_compact != NULL) {
+    swift_free("gparts_foreign", s->gparts_foreign_compact);
+    s->size_gparts_foreign = 0;
+    s->gparts_foreign_compact = NULL;
+  }
   if (s->sparts_foreign != NULL) {
     swift_free("sparts_foreign", s->sparts_foreign);
     s->size_sparts_foreign = 0;
@@ -432,6 +448,35 @@ void space_map_cells_pre(struct space *s, int full,
     rec_map_cells_pre(&s->cells_top[cid], full, fun, data);
 }
 
+/**
+ * @brief Records a chunk of sub-cells or multipoles allocated for a buffer.
+ *
+ * @param s The #space.
+ * @param cells The chunk of cells, or NULL.
+ * @param multipoles The chunk of multipoles, or NULL.
+ * @param tpid ID of the thread whose buffer the chunk was allocated for.
+ */
+static void space_add_slab(struct space *s, struct cell *cells,
+                           struct gravity_tensors *multipoles,
+                           const short int tpid) {
+
+  lock_lock(&s->lock);
+
+  if (s->nr_slabs == s->size_slabs) {
+    s->size_slabs += space_slaballocchunk;
+    s->slabs = (struct space_slab *)realloc(
+        s->slabs, s->size_slabs * sizeof(struct space_slab));
+    if (s->slabs == NULL) error("Failed to allocate the list of cell slabs.");
+  }
+
+  s->slabs[s->nr_slabs].cells = cells;
+  s->slabs[s->nr_slabs].multipoles = multipoles;
+  s->slabs[s->nr_slabs].tpid = tpid;
+  s->nr_slabs++;
+
+  lock_unlock_blind(&s->lock);
+}
+
 /**
  * @brief Get a new empty (sub-)#cell.
  *
@@ -466,6 +511,8 @@ void space_getcells(struct space *s, int nr_cells, struct cell **cells,
       for (int k = 0; k < space_cellallocchunk - 1; k++)
         s->cells_sub[tpid][k].next = &s->cells_sub[tpid][k + 1];
       s->cells_sub[tpid][space_cellallocchunk - 1].next = NULL;
+
+      space_add_slab(s, s->cells_sub[tpid], NULL, tpid);
     }
 
     /* Is the multipole buffer empty? */
@@ -480,6 +527,8 @@ void space_getcells(struct space *s, int nr_cells, struct cell **cells,
       for (int k = 0; k < space_cellallocchunk - 1; k++)
         s->multipoles_sub[tpid][k].next = &s->multipoles_sub[tpid][k + 1];
       s->multipoles_sub[tpid][space_cellallocchunk - 1].next = NULL;
+
+      space_add_slab(s, NULL, s->multipoles_sub[tpid], tpid);
     }
 
     /* Pick off the next cell. */
@@ -736,25 +785,34 @@ void space_synchronize_particle_positions(struct space *s) {
 
   const ticks tic = getticks();
 
-  if (s->nr_gparts > 0 && s->nr_parts > 0)
-    threadpool_map(&s->e->threadpool, space_synchronize_part_positions_mapper,
-                   s->parts, s->nr_parts, sizeof(struct part),
-                   threadpool_auto_chunk_size, (void *)s);
-
-  if (s->nr_gparts > 0 && s->nr_sparts > 0)
-    threadpool_map(&s->e->threadpool, space_synchronize_spart_positions_mapper,
-                   s->sparts, s->nr_sparts, sizeof(struct spart),
-                   threadpool_auto_chunk_size, /*extra_data=*/NULL);
-
-  if (s->nr_gparts > 0 && s->nr_bparts > 0)
-    threadpool_map(&s->e->threadpool, space_synchronize_bpart_positions_mapper,
-                   s->bparts, s->nr_bparts, sizeof(struct bpart),
-                   threadpool_auto_chunk_size, /*extra_data=*/NULL);
-
-  if (s->nr_gparts > 0 && s->nr_sinks > 0)
-    threadpool_map(&s->e->threadpool, space_synchronize_sink_positions_mapper,
-                   s->sinks, s->nr_sinks, sizeof(struct sink),
-                   threadpool_auto_chunk_size, /*extra_data=*/NULL);
+  /* The four types write to distinct #gpart, so do them in one go. */
+  const int with_gparts = s->nr_gparts > 0;
+  struct threadpool_map_job jobs[4] = {
+      {.map_function = space_synchronize_part_positions_mapper,
+       .map_data = s->parts,
+       .N = with_gparts ? s->nr_parts : 0,
+       .stride = sizeof(struct part),
+       .chunk = threadpool_auto_chunk_size,
+       .extra_data = (void *)s},
+      {.map_function = space_synchronize_spart_positions_mapper,
+       .map_data = s->sparts,
+       .N = with_gparts ? s->nr_sparts : 0,
+       .stride = sizeof(struct spart),
+       .chunk = threadpool_auto_chunk_size,
+       .extra_data = NULL},
+      {.map_function = space_synchronize_bpart_positions_mapper,
+       .map_data = s->bparts,
+       .N = with_gparts ? s->nr_bparts : 0,
+       .stride = sizeof(struct bpart),
+       .chunk = threadpool_auto_chunk_size,
+       .extra_data = NULL},
+      {.map_function = space_synchronize_sink_positions_mapper,
+       .map_data = s->sinks,
+       .N = with_gparts ? s->nr_sinks : 0,
+       .stride = sizeof(struct sink),
+       .chunk = threadpool_auto_chunk_size,
+       .extra_data = NULL}};
+  threadpool_map_batch(&s->e->threadpool, jobs, 4);
 
   if (s->e->verbose)
     message("took %.3f %s.", clocks_from_ticks(getticks() - tic),
@@ -1008,22 +1066,39 @@ void space_collect_mean_masses(struct space *s, int verbose) {
     s->initial_mean_mass_particles[i] = 0.;
   for (int i = 0; i < swift_type_count; ++i) s->initial_count_particles[i] = 0;
 
-  /* Collect each particle type */
-  threadpool_map(&s->e->threadpool, space_collect_sum_part_mass, s->parts,
-                 s->nr_parts, sizeof(struct part), threadpool_auto_chunk_size,
-                 s);
-  threadpool_map(&s->e->threadpool, space_collect_sum_gpart_mass, s->gparts,
-                 s->nr_gparts, sizeof(struct gpart), threadpool_auto_chunk_size,
-                 s);
-  threadpool_map(&s->e->threadpool, space_collect_sum_spart_mass, s->sparts,
-                 s->nr_sparts, sizeof(struct spart), threadpool_auto_chunk_size,
-                 s);
-  threadpool_map(&s->e->threadpool, space_collect_sum_sink_mass, s->sinks,
-                 s->nr_sinks, sizeof(struct sink), threadpool_auto_chunk_size,
-                 s);
-  threadpool_map(&s->e->threadpool, space_collect_sum_bpart_mass, s->bparts,
-                 s->nr_bparts, sizeof(struct bpart), threadpool_auto_chunk_size,
-                 s);
+  /* Collect each particle type, all in one go */
+  struct threadpool_map_job jobs[5] = {
+      {.map_function = space_collect_sum_part_mass,
+       .map_data = s->parts,
+       .N = s->nr_parts,
+       .stride = sizeof(struct part),
+       .chunk = threadpool_auto_chunk_size,
+       .extra_data = s},
+      {.map_function = space_collect_sum_gpart_mass,
+       .map_data = s->gparts,
+       .N = s->nr_gparts,
+       .stride = sizeof(struct gpart),
+       .chunk = threadpool_auto_chunk_size,
+       .extra_data = s},
+      {.map_function = space_collect_sum_spart_mass,
+       .map_data = s->sparts,
+       .N = s->nr_sparts,
+       .stride = sizeof(struct spart),
+       .chunk = threadpool_auto_chunk_size,
+       .extra_data = s},
+      {.map_function = space_collect_sum_sink_mass,
+       .map_data = s->sinks,
+       .N = s->nr_sinks,
+       .stride = sizeof(struct sink),
+       .chunk = threadpool_auto_chunk_size,
+       .extra_data = s},
+      {.map_function = space_collect_sum_bpart_mass,
+       .map_data = s->bparts,
+       .N = s->nr_bparts,
+       .stride = sizeof(struct bpart),
+       .chunk = threadpool_auto_chunk_size,
+       .extra_data = s}};
+  threadpool_map_batch(&s->e->threadpool, jobs, 5);
 
 #ifdef WITH_MPI
   MPI_Allreduce(MPI_IN_PLACE, s->initial_mean_mass_particles, swift_type_count,
@@ -1047,6 +1122,102 @@ void space_collect_mean_masses(struct space *s, int verbose) {
           (double)s->initial_count_particles[i];
 }
 
+/**
+ * @brief What space_init_positions_mapper() needs to know about the
+ * particles.
+ */
+struct space_init_positions_data {
+
+  /*! Size of one particle and offset of its position in it. */
+  size_t size, offset;
+
+  /*! Shift to apply to the positions. */
+  double shift[3];
+
+  /*! Size of the box. */
+  double dim[3];
+
+  /*! Are we shifting the positions? */
+  int do_shift;
+
+  /*! Are we wrapping them (or checking they are in the box)? */
+  int periodic;
+
+  /*! Name of the particles, for the error messages. */
+  const char *name;
+};
+
+/**
+ * @brief Shift the positions of some particles of the ICs and wrap them in
+ * the box, or check that they are in it. #threadpool mapper function.
+ *
+ * @param map_data The first particle.
+ * @param count The number of particles.
+ * @param extra_data The #space_init_positions_data.
+ */
+static void space_init_positions_mapper(void *map_data, int count,
+                                        void *extra_data) {
+
+  const struct space_init_positions_data *data =
+      (const struct space_init_positions_data *)extra_data;
+  char *const base = (char *)map_data;
+
+  for (int k = 0; k < count; k++) {
+    double *x = (double *)(base + k * data->size + data->offset);
+
+    if (data->do_shift)
+      for (int j = 0; j < 3; j++) x[j] += data->shift[j];
+
+    if (data->periodic) {
+      for (int j = 0; j < 3; j++) {
+        while (x[j] < 0) x[j] += data->dim[j];
+        while (x[j] >= data->dim[j]) x[j] -= data->dim[j];
+      }
+    } else {
+      for (int j = 0; j < 3; j++)
+        if (x[j] < 0 || x[j] >= data->dim[j])
+          error("Not all %s are within the specified domain.", data->name);
+    }
+  }
+}
+
+/**
+ * @brief Largest extent along any axis of the high-resolution region of a
+ * zoom run.
+ *
+ * The region is the bounding box of all the #gpart that are neither
+ * background dark matter nor neutrinos, over all the nodes.
+ *
+ * @param s The #space.
+ *
+ * @return The extent of the region, or 0 if it has no particles.
+ */
+double space_zoom_region_extent(const struct space *s) {
+
+  double bmin[3] = {DBL_MAX, DBL_MAX, DBL_MAX};
+  double bmax[3] = {-DBL_MAX, -DBL_MAX, -DBL_MAX};
+  for (size_t k = 0; k < s->nr_gparts; k++) {
+    const struct gpart *gp = &s->gparts[k];
+    if (gp->type == swift_type_dark_matter_background ||
+        gp->type == swift_type_neutrino)
+      continue;
+    for (int i = 0; i < 3; i++) {
+      bmin[i] = min(bmin[i], gp->x[i]);
+      bmax[i] = max(bmax[i], gp->x[i]);
+    }
+  }
+
+#ifdef WITH_MPI
+  MPI_Allreduce(MPI_IN_PLACE, bmin, 3, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+  MPI_Allreduce(MPI_IN_PLACE, bmax, 3, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+#endif
+
+  double extent = 0.;
+  for (int i = 0; i < 3; i++)
+    if (bmax[i] >= bmin[i]) extent = max(extent, bmax[i] - bmin[i]);
+  return extent;
+}
+
 /**
  * @brief Split the space into cells given the array of particles.
  *
@@ -1077,6 +1248,7 @@ void space_collect_mean_masses(struct space *s, int verbose) {
  * @param verbose Print messages to stdout or not.
  * @param dry_run If 1, just initialise stuff, don't do anything with the parts.
  * @param nr_nodes The number of MPI rank.
+ * @param nr_threads The number of threads to use for the particle loops.
  *
  * Makes a grid of edge length > r_max and fills the particles
  * into the respective cells. Cells containing more than #space_splitsize
@@ -1092,7 +1264,7 @@ void space_init(struct space *s, struct swift_params *params,
                 int replicate, int remap_ids, int generate_gas_in_ics,
                 int hydro, int self_gravity, int star_formation, int with_sink,
                 int with_DM, int with_DM_background, int neutrinos, int verbose,
-                int dry_run, int nr_nodes) {
+                int dry_run, int nr_nodes, int nr_threads) {
 
   /* Clean-up everything */
   bzero(s, sizeof(struct space));
@@ -1213,8 +1385,42 @@ void space_init(struct space *s, struct swift_params *params,
   int maxtcells =
       parser_get_opt_param_int(params, "Scheduler:max_top_level_cells",
                                space_max_top_level_cells_default);
+
+  /* In a zoom run, refine the grid such that the high-resolution region
+   * spans enough top-level cells for the tasks and the domain decomposition
+   * to have some granularity there. */
+  const int zoom_cells = parser_get_opt_param_int(
+      params, "Scheduler:zoom_region_top_level_cells", 0);
+  if (zoom_cells > 0 && with_DM_background && !dry_run) {
+    const int zoom_maxtcells = parser_get_opt_param_int(
+        params, "Scheduler:zoom_max_top_level_cells",
+        space_zoom_max_top_level_cells_default);
+    const double extent = space_zoom_region_extent(s);
+    if (extent > 0.) {
+      const int needtcells = (int)ceil(zoom_cells * dmax / extent);
+      const int zoomtcells = min(needtcells, zoom_maxtcells);
+      if (zoomtcells > maxtcells) maxtcells = zoomtcells;
+      if (verbose)
+        message(
+            "Zoom region of extent %e spans %.1f top-level cells, asked for "
+            "%d (max_top_level_cells=%d).",
+            extent, extent * maxtcells / dmax, zoom_cells, maxtcells);
+    }
+  }
   s->cell_min = 0.99 * dmax / maxtcells;
 
+  /* Sort the particles into the top-level cells in parallel? */
+  s->parallel_sort =
+      parser_get_opt_param_int(params, "Scheduler:parallel_sort", 1);
+
+  /* Order the gparts within the leaves? */
+  s->gpart_morton_order =
+      parser_get_opt_param_int(params, "Scheduler:gpart_morton_order", 1);
+
+  /* Group the particles of the leaves by time-bin? */
+  s->time_bin_order =
+      parser_get_opt_param_int(params, "Scheduler:time_bin_order", 0);
+
   /* Check that it is big enough. */
   const double dmin = min3(s->dim[0], s->dim[1], s->dim[2]);
   int needtcells = 3 * dmax / dmin;
@@ -1247,6 +1453,27 @@ void space_init(struct space *s, struct swift_params *params,
                                space_subsize_self_grav_default);
   space_splitsize = parser_get_opt_param_int(
       params, "Scheduler:cell_split_size", space_splitsize_default);
+  space_splitsize_grav = parser_get_opt_param_int(
+      params, "Scheduler:cell_split_size_grav", space_splitsize);
+  space_split_tune_time = parser_get_opt_param_float(
+      params, "Scheduler:cell_split_tune_time", 0.f);
+  if (space_split_tune_time > 0.f) {
+    space_splitsize_grav_min =
+        parser_get_opt_param_int(params, "Scheduler:cell_split_size_grav_min",
+                                 max(space_splitsize_grav / 4, 1));
+    space_splitsize_grav_max =
+        parser_get_opt_param_int(params, "Scheduler:cell_split_size_grav_max",
+                                 4 * space_splitsize_grav);
+  } else {
+    space_splitsize_grav_min = space_splitsize_grav;
+    space_splitsize_grav_max = space_splitsize_grav;
+  }
+  if (space_splitsize_grav_min < 1 ||
+      space_splitsize_grav_min > space_splitsize_grav ||
+      space_splitsize_grav_max < space_splitsize_grav)
+    error(
+        "Scheduler:cell_split_size_grav_min <= Scheduler:cell_split_size_grav "
+        "<= Scheduler:cell_split_size_grav_max does not hold.");
   space_grid_split_threshold = parser_get_opt_param_int(
       params, "Scheduler:grid_split_threshold", space_grid_split_threshold);
   space_subdepth_diff_grav =
@@ -1285,6 +1512,9 @@ void space_init(struct space *s, struct swift_params *params,
   if (verbose) {
     message("max_size set to %d split_size set to %d", space_maxsize,
             space_splitsize);
+    message("split_size_grav set to %d (tuned in [%d, %d])",
+            space_splitsize_grav, space_splitsize_grav_min,
+            space_splitsize_grav_max);
     message("subdepth_grav set to %d", space_subdepth_diff_grav);
     message("sub_size_pair_hydro set to %d, sub_size_self_hydro set to %d",
             space_subsize_pair_hydro, space_subsize_self_hydro);
@@ -1318,106 +1548,60 @@ void space_init(struct space *s, struct swift_params *params,
   parser_get_opt_param_double_array(params, "InitialConditions:shift", 3,
                                     shift);
   memcpy(s->initial_shift, shift, 3 * sizeof(double));
-  if ((shift[0] != 0. || shift[1] != 0. || shift[2] != 0.) && !dry_run) {
+  const int do_shift = shift[0] != 0. || shift[1] != 0. || shift[2] != 0.;
+  if (do_shift && !dry_run)
     message("Shifting particles by [%e %e %e]", shift[0], shift[1], shift[2]);
-    for (size_t k = 0; k < Npart; k++) {
-      parts[k].x[0] += shift[0];
-      parts[k].x[1] += shift[1];
-      parts[k].x[2] += shift[2];
-    }
-    for (size_t k = 0; k < Ngpart; k++) {
-      gparts[k].x[0] += shift[0];
-      gparts[k].x[1] += shift[1];
-      gparts[k].x[2] += shift[2];
-    }
-    for (size_t k = 0; k < Nspart; k++) {
-      sparts[k].x[0] += shift[0];
-      sparts[k].x[1] += shift[1];
-      sparts[k].x[2] += shift[2];
-    }
-    for (size_t k = 0; k < Nbpart; k++) {
-      bparts[k].x[0] += shift[0];
-      bparts[k].x[1] += shift[1];
-      bparts[k].x[2] += shift[2];
-    }
-    for (size_t k = 0; k < Nsink; k++) {
-      sinks[k].x[0] += shift[0];
-      sinks[k].x[1] += shift[1];
-      sinks[k].x[2] += shift[2];
-    }
-  }
 
   if (!dry_run) {
 
-    /* Check that all the part positions are reasonable, wrap if periodic. */
-    if (periodic) {
-      for (size_t k = 0; k < Npart; k++)
-        for (int j = 0; j < 3; j++) {
-          while (parts[k].x[j] < 0) parts[k].x[j] += s->dim[j];
-          while (parts[k].x[j] >= s->dim[j]) parts[k].x[j] -= s->dim[j];
-        }
-    } else {
-      for (size_t k = 0; k < Npart; k++)
-        for (int j = 0; j < 3; j++)
-          if (parts[k].x[j] < 0 || parts[k].x[j] >= s->dim[j])
-            error("Not all particles are within the specified domain.");
+    /* Shift the positions, then check that they are all reasonable and wrap
+     * them if periodic. */
+    struct threadpool tp;
+    threadpool_init(&tp, nr_threads);
+
+    struct space_init_positions_data data;
+    data.do_shift = do_shift;
+    data.periodic = periodic;
+    for (int j = 0; j < 3; j++) {
+      data.shift[j] = shift[j];
+      data.dim[j] = s->dim[j];
     }
 
+    data.size = sizeof(struct part);
+    data.offset = offsetof(struct part, x);
+    data.name = "particles";
+    threadpool_map(&tp, space_init_positions_mapper, parts, Npart,
+                   sizeof(struct part), threadpool_auto_chunk_size, &data);
+
     /* Same for the gparts */
-    if (periodic) {
-      for (size_t k = 0; k < Ngpart; k++)
-        for (int j = 0; j < 3; j++) {
-          while (gparts[k].x[j] < 0) gparts[k].x[j] += s->dim[j];
-          while (gparts[k].x[j] >= s->dim[j]) gparts[k].x[j] -= s->dim[j];
-        }
-    } else {
-      for (size_t k = 0; k < Ngpart; k++)
-        for (int j = 0; j < 3; j++)
-          if (gparts[k].x[j] < 0 || gparts[k].x[j] >= s->dim[j])
-            error("Not all g-particles are within the specified domain.");
-    }
+    data.size = sizeof(struct gpart);
+    data.offset = offsetof(struct gpart, x);
+    data.name = "g-particles";
+    threadpool_map(&tp, space_init_positions_mapper, gparts, Ngpart,
+                   sizeof(struct gpart), threadpool_auto_chunk_size, &data);
 
     /* Same for the sparts */
-    if (periodic) {
-      for (size_t k = 0; k < Nspart; k++)
-        for (int j = 0; j < 3; j++) {
-          while (sparts[k].x[j] < 0) sparts[k].x[j] += s->dim[j];
-          while (sparts[k].x[j] >= s->dim[j]) sparts[k].x[j] -= s->dim[j];
-        }
-    } else {
-      for (size_t k = 0; k < Nspart; k++)
-        for (int j = 0; j < 3; j++)
-          if (sparts[k].x[j] < 0 || sparts[k].x[j] >= s->dim[j])
-            error("Not all s-particles are within the specified domain.");
-    }
+    data.size = sizeof(struct spart);
+    data.offset = offsetof(struct spart, x);
+    data.name = "s-particles";
+    threadpool_map(&tp, space_init_positions_mapper, sparts, Nspart,
+                   sizeof(struct spart), threadpool_auto_chunk_size, &data);
 
     /* Same for the bparts */
-    if (periodic) {
-      for (size_t k = 0; k < Nbpart; k++)
-        for (int j = 0; j < 3; j++) {
-          while (bparts[k].x[j] < 0) bparts[k].x[j] += s->dim[j];
-          while (bparts[k].x[j] >= s->dim[j]) bparts[k].x[j] -= s->dim[j];
-        }
-    } else {
-      for (size_t k = 0; k < Nbpart; k++)
-        for (int j = 0; j < 3; j++)
-          if (bparts[k].x[j] < 0 || bparts[k].x[j] >= s->dim[j])
-            error("Not all b-particles are within the specified domain.");
-    }
+    data.size = sizeof(struct bpart);
+    data.offset = offsetof(struct bpart, x);
+    data.name = "b-particles";
+    threadpool_map(&tp, space_init_positions_mapper, bparts, Nbpart,
+                   sizeof(struct bpart), threadpool_auto_chunk_size, &data);
 
     /* Same for the sinks */
-    if (periodic) {
-      for (size_t k = 0; k < Nsink; k++)
-        for (int j = 0; j < 3; j++) {
-          while (sinks[k].x[j] < 0) sinks[k].x[j] += s->dim[j];
-          while (sinks[k].x[j] >= s->dim[j]) sinks[k].x[j] -= s->dim[j];
-        }
-    } else {
-      for (size_t k = 0; k < Nsink; k++)
-        for (int j = 0; j < 3; j++)
-          if (sinks[k].x[j] < 0 || sinks[k].x[j] >= s->dim[j])
-            error("Not all sink-particles are within the specified domain.");
-    }
+    data.size = sizeof(struct sink);
+    data.offset = offsetof(struct sink, x);
+    data.name = "sink-particles";
+    threadpool_map(&tp, space_init_positions_mapper, sinks, Nsink,
+                   sizeof(struct sink), threadpool_auto_chunk_size, &data);
+
+    threadpool_clean(&tp);
   }
 
   /* Allocate the extra parts array for the gas particles. */
@@ -2436,10 +2620,12 @@ void space_clean(struct space *s) {
   swift_free("parts_foreign", s->parts_foreign);
   swift_free("sparts_foreign", s->sparts_foreign);
   swift_free("gparts_foreign", s->gparts_foreign);
+  swift_free("gparts_foreign", s->gparts_foreign_compact);
   swift_free("bparts_foreign", s->bparts_foreign);
 #endif
   free(s->cells_sub);
   free(s->multipoles_sub);
+  free(s->slabs);
 
   if (lock_destroy(&s->unique_id.lock) != 0)
     error("Failed to destroy spinlocks.");
@@ -2460,6 +2646,14 @@ void space_struct_dump(struct space *s, FILE *stream) {
   /* Now all our globals. */
   restart_write_blocks(&space_splitsize, sizeof(int), 1, stream,
                        "space_splitsize", "space_splitsize");
+  restart_write_blocks(&space_splitsize_grav, sizeof(int), 1, stream,
+                       "space_splitsize_grav", "space_splitsize_grav");
+  restart_write_blocks(&space_splitsize_grav_min, sizeof(int), 1, stream,
+                       "space_splitsize_grav_min", "space_splitsize_grav_min");
+  restart_write_blocks(&space_splitsize_grav_max, sizeof(int), 1, stream,
+                       "space_splitsize_grav_max", "space_splitsize_grav_max");
+  restart_write_blocks(&space_split_tune_time, sizeof(float), 1, stream,
+                       "space_split_tune_time", "space_split_tune_time");
   restart_write_blocks(&space_maxsize, sizeof(int), 1, stream, "space_maxsize",
                        "space_maxsize");
   restart_write_blocks(&space_grid_split_threshold, sizeof(int), 1, stream,
@@ -2548,6 +2742,14 @@ void space_struct_restore(struct space *s, FILE *stream) {
   /* Now all our globals. */
   restart_read_blocks(&space_splitsize, sizeof(int), 1, stream, NULL,
                       "space_splitsize");
+  restart_read_blocks(&space_splitsize_grav, sizeof(int), 1, stream, NULL,
+                      "space_splitsize_grav");
+  restart_read_blocks(&space_splitsize_grav_min, sizeof(int), 1, stream, NULL,
+                      "space_splitsize_grav_min");
+  restart_read_blocks(&space_splitsize_grav_max, sizeof(int), 1, stream, NULL,
+                      "space_splitsize_grav_max");
+  restart_read_blocks(&space_split_tune_time, sizeof(float), 1, stream, NULL,
+                      "space_split_tune_time");
   restart_read_blocks(&space_maxsize, sizeof(int), 1, stream, NULL,
                       "space_maxsize");
   restart_read_blocks(&space_grid_split_threshold, sizeof(int), 1, stream, NULL,
@@ -2596,6 +2798,9 @@ void space_struct_restore(struct space *s, FILE *stream) {
   s->cells_sub = NULL;
   s->multipoles_top = NULL;
   s->multipoles_sub = NULL;
+  s->slabs = NULL;
+  s->nr_slabs = 0;
+  s->size_slabs = 0;
   s->local_cells_top = NULL;
   s->local_cells_with_tasks_top = NULL;
   s->cells_with_particles_top = NULL;
@@ -2606,6 +2811,7 @@ void space_struct_restore(struct space *s, FILE *stream) {
   s->parts_foreign = NULL;
   s->size_parts_foreign = 0;
   s->gparts_foreign = NULL;
+  s->gparts_foreign_compact = NULL;
   s->size_gparts_foreign = 0;
   s->sparts_foreign = NULL;
   s->size_sparts_foreign = 0;
@@ -2619,11 +2825,13 @@ void space_struct_restore(struct space *s, FILE *stream) {
   if (s->nr_parts > 0) {
 
     /* Need the memory for these. */
-    if (swift_memalign("parts", (void **)&s->parts, part_align,
+    if (swift_memalign("parts", (void **)&s->parts,
+                       restart_block_alignment(part_align),
                        s->size_parts * sizeof(struct part)) != 0)
       error("Failed to allocate restore part array.");
 
-    if (swift_memalign("xparts", (void **)&s->xparts, xpart_align,
+    if (swift_memalign("xparts", (void **)&s->xparts,
+                       restart_block_alignment(xpart_align),
                        s->size_parts * sizeof(struct xpart)) != 0)
       error("Failed to allocate restore xpart array.");
 
@@ -2634,7 +2842,8 @@ void space_struct_restore(struct space *s, FILE *stream) {
   }
   s->gparts = NULL;
   if (s->nr_gparts > 0) {
-    if (swift_memalign("gparts", (void **)&s->gparts, gpart_align,
+    if (swift_memalign("gparts", (void **)&s->gparts,
+                       restart_block_alignment(gpart_align),
                        s->size_gparts * sizeof(struct gpart)) != 0)
       error("Failed to allocate restore gpart array.");
 
@@ -2644,7 +2853,8 @@ void space_struct_restore(struct space *s, FILE *stream) {
 
   s->sinks = NULL;
   if (s->nr_sinks > 0) {
-    if (swift_memalign("sinks", (void **)&s->sinks, sink_align,
+    if (swift_memalign("sinks", (void **)&s->sinks,
+                       restart_block_alignment(sink_align),
                        s->size_sinks * sizeof(struct sink)) != 0)
       error("Failed to allocate restore sink array.");
 
@@ -2654,7 +2864,8 @@ void space_struct_restore(struct space *s, FILE *stream) {
 
   s->sparts = NULL;
   if (s->nr_sparts > 0) {
-    if (swift_memalign("sparts", (void **)&s->sparts, spart_align,
+    if (swift_memalign("sparts", (void **)&s->sparts,
+                       restart_block_alignment(spart_align),
                        s->size_sparts * sizeof(struct spart)) != 0)
       error("Failed to allocate restore spart array.");
 
@@ -2663,7 +2874,8 @@ void space_struct_restore(struct space *s, FILE *stream) {
   }
   s->bparts = NULL;
   if (s->nr_bparts > 0) {
-    if (swift_memalign("bparts", (void **)&s->bparts, bpart_align,
+    if (swift_memalign("bparts", (void **)&s->bparts,
+                       restart_block_alignment(bpart_align),
                        s->size_bparts * sizeof(struct bpart)) != 0)
       error("Failed to allocate restore bpart array.");
 
@@ -43,9 +43,12 @@ struct cosmology;
 struct gravity_props;
 struct star_formation;
 struct hydro_props;
+struct scheduler;
+struct threadpool;
 
 /* Some constants. */
 #define space_cellallocchunk 1000
+#define space_slaballocchunk 64
 #define space_splitsize_default 400
 #define space_maxsize_default 8000000
 #define space_grid_split_threshold_default 400
@@ -63,6 +66,7 @@ struct hydro_props;
 #define space_subsize_self_grav_default 32000
 #define space_subdepth_diff_grav_default 4
 #define space_max_top_level_cells_default 12
+#define space_zoom_max_top_level_cells_default 64
 #define space_stretch 1.10f
 #define space_maxreldx 0.1f
 
@@ -72,6 +76,10 @@ struct hydro_props;
 /* Globals needed in contexts without a space struct. Remember to dump and
  * restore these. */
 extern int space_splitsize;
+extern int space_splitsize_grav;
+extern int space_splitsize_grav_min;
+extern int space_splitsize_grav_max;
+extern float space_split_tune_time;
 extern int space_maxsize;
 extern int space_grid_split_threshold;
 extern int space_subsize_pair_hydro;
@@ -89,6 +97,22 @@ extern int space_extra_sinks;
 extern double engine_redistribute_alloc_margin;
 extern double engine_foreign_alloc_margin;
 
+/**
+ * @brief A chunk of #space_cellallocchunk sub-cells or multipoles allocated
+ * by space_getcells().
+ */
+struct space_slab {
+
+  /*! The cells, or NULL. */
+  struct cell *cells;
+
+  /*! The multipoles, or NULL. */
+  struct gravity_tensors *multipoles;
+
+  /*! The thread whose buffer the slab was allocated for. */
+  short int tpid;
+};
+
 /**
  * @brief The space in which the cells and particles reside.
  */
@@ -133,6 +157,15 @@ struct space {
   /*! The minimum top-level cell width allowed. */
   double cell_min;
 
+  /*! Are the particles sorted into the top-level cells in parallel? */
+  int parallel_sort;
+
+  /*! Are the gparts of the leaves put in Morton order? */
+  int gpart_morton_order;
+
+  /*! Are the particles of the leaves grouped by time-bin? */
+  int time_bin_order;
+
   /*! Space dimensions in number of top-cells. */
   int cdim[3];
 
@@ -169,6 +202,12 @@ struct space {
   /*! Buffer of unused multipoles for the sub-cells. One chunk per thread. */
   struct gravity_tensors **multipoles_sub;
 
+  /*! All the chunks the sub-cells and multipoles were allocated in. */
+  struct space_slab *slabs;
+
+  /*! Number of slabs in use and allocated. */
+  int nr_slabs, size_slabs;
+
   /*! The indices of the *local* top-level cells */
   int *local_cells_top;
 
@@ -337,8 +376,10 @@ struct space {
   struct part *parts_foreign;
   size_t nr_parts_foreign, size_parts_foreign;
 
-  /*! Buffers for g-parts that we will receive from foreign cells. */
+  /*! Buffers for g-parts that we will receive from foreign cells, either
+   * whole or in compact form (the counts are of whichever is in use). */
   struct gpart *gparts_foreign;
+  struct gpart_foreign *gparts_foreign_compact;
   size_t nr_gparts_foreign, size_gparts_foreign;
 
   /*! Buffers for s-parts that we will receive from foreign cells. */
@@ -355,11 +396,12 @@ struct space {
 /* Function prototypes. */
 void space_free_buff_sort_indices(struct space *s);
 void space_parts_sort(struct part *parts, struct xpart *xparts, int *ind,
-                      int *counts, int num_bins, ptrdiff_t parts_offset);
+                      int *counts, int num_bins, ptrdiff_t parts_offset,
+                      struct threadpool *tp);
 void space_gparts_sort(struct gpart *gparts, struct part *parts,
                        struct sink *sinks, struct spart *sparts,
                        struct bpart *bparts, int *ind, int *counts,
-                       int num_bins);
+                       int num_bins, struct threadpool *tp);
 void space_sparts_sort(struct spart *sparts, int *ind, int *counts,
                        int num_bins, ptrdiff_t sparts_offset);
 void space_bparts_sort(struct bpart *bparts, int *ind, int *counts,
@@ -377,7 +419,8 @@ void space_init(struct space *s, struct swift_params *params,
                 int replicate, int remap_ids, int generate_gas_in_ics,
                 int hydro, int gravity, int star_formation, int with_sink,
                 int with_DM, int with_DM_background, int neutrinos, int verbose,
-                int dry_run, int nr_nodes);
+                int dry_run, int nr_nodes, int nr_threads);
+double space_zoom_region_extent(const struct space *s);
 void space_sanitize(struct space *s);
 void space_map_cells_pre(struct space *s, int full,
                          void (*fun)(struct cell *c, void *data), void *data);
@@ -398,6 +441,8 @@ void space_recycle_list(struct space *s, struct cell *cell_list_begin,
 void space_regrid(struct space *s, int verbose);
 void space_allocate_extras(struct space *s, int verbose);
 void space_split(struct space *s, int verbose);
+void space_split_tune(struct space *s, const struct scheduler *sched,
+                      int verbose);
 void space_reorder_extras(struct space *s, int verbose);
 void space_list_useful_top_level_cells(struct space *s);
 void space_parts_get_cell_index(struct space *s, int *ind, int *cell_counts,
@@ -454,6 +499,7 @@ void space_check_cosmology(struct space *s, const struct cosmology *cosmo,
 void space_reset_task_counters(struct space *s);
 void space_clean(struct space *s);
 void space_free_cells(struct space *s);
+void space_relink_cells_sub(struct space *s);
 
 void space_free_foreign_parts(struct space *s, const int clear_cell_pointers);
 
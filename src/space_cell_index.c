@@ -35,6 +35,9 @@
 /* Some standard headers. */
 #include <float.h>
 
+/*! Number of g-particles whose cell index is computed in one go */
+#define space_cell_index_block_size 64
+
 /**
  * @brief Information required to compute the particle cell indices.
  */
@@ -42,6 +45,7 @@ struct space_index_data {
   struct space *s;
   int *ind;
   int *cell_counts;
+  int *thread_cell_counts;
   size_t count_inhibited_part;
   size_t count_inhibited_gpart;
   size_t count_inhibited_spart;
@@ -184,6 +188,12 @@ void space_parts_get_cell_index_mapper(void *map_data, int nr_parts,
 /**
  * @brief #threadpool mapper function to compute the g-particle cell indices.
  *
+ * The particles are treated in blocks. The wrapping and the cell indices of
+ * a block are computed first in a branch-free loop that the compiler can
+ * vectorize, the particles are then sorted by type and counted. The counts
+ * go to the private histogram of the thread, merged once all the particles
+ * have been treated.
+ *
  * @param map_data Pointer towards the g-particles.
  * @param nr_gparts The number of g-particles to treat.
  * @param extra_data Pointers to the space and index list
@@ -206,10 +216,9 @@ void space_gparts_get_cell_index_mapper(void *map_data, int nr_gparts,
   const double ih_y = s->iwidth[1];
   const double ih_z = s->iwidth[2];
 
-  /* Init the local count buffer. */
-  int *cell_counts = (int *)calloc(s->nr_cells, sizeof(int));
-  if (cell_counts == NULL)
-    error("Failed to allocate temporary cell count buffer.");
+  /* The count buffer of this thread. */
+  int *restrict cell_counts =
+      data->thread_cell_counts + (size_t)threadpool_gettid() * s->nr_cells;
 
   /* Init the local collectors */
   float min_mass = FLT_MAX;
@@ -217,91 +226,106 @@ void space_gparts_get_cell_index_mapper(void *map_data, int nr_gparts,
   size_t count_inhibited_gpart = 0;
   size_t count_extra_gpart = 0;
 
-  for (int k = 0; k < nr_gparts; k++) {
+  /* The wrapped positions and indices of a block */
+  double pos_x[space_cell_index_block_size];
+  double pos_y[space_cell_index_block_size];
+  double pos_z[space_cell_index_block_size];
+  int index[space_cell_index_block_size];
 
-    /* Get the particle */
-    struct gpart *restrict gp = &gparts[k];
+  for (int first = 0; first < nr_gparts;
+       first += space_cell_index_block_size) {
 
-    double old_pos_x = gp->x[0];
-    double old_pos_y = gp->x[1];
-    double old_pos_z = gp->x[2];
+    const int n = min(space_cell_index_block_size, nr_gparts - first);
+    const struct gpart *restrict block = &gparts[first];
 
-#ifdef SWIFT_DEBUG_CHECKS
-    if (!s->periodic && gp->time_bin != time_bin_inhibited) {
-      if (old_pos_x < 0. || old_pos_x > dim_x)
-        error("Particle outside of volume along X.");
-      if (old_pos_y < 0. || old_pos_y > dim_y)
-        error("Particle outside of volume along Y.");
-      if (old_pos_z < 0. || old_pos_z > dim_z)
-        error("Particle outside of volume along Z.");
+    /* Gather the positions */
+    for (int i = 0; i < n; i++) {
+      pos_x[i] = block[i].x[0];
+      pos_y[i] = block[i].x[1];
+      pos_z[i] = block[i].x[2];
     }
-#endif
 
-    /* Put it back into the simulation volume */
-    double pos_x = box_wrap(old_pos_x, 0.0, dim_x);
-    double pos_y = box_wrap(old_pos_y, 0.0, dim_y);
-    double pos_z = box_wrap(old_pos_z, 0.0, dim_z);
+    for (int i = 0; i < n; i++) {
+
+      /* Put it back into the simulation volume */
+      double x = box_wrap(pos_x[i], 0.0, dim_x);
+      double y = box_wrap(pos_y[i], 0.0, dim_y);
+      double z = box_wrap(pos_z[i], 0.0, dim_z);
+
+      /* Treat the case where a particle was wrapped back exactly onto
+       * the edge because of rounding issues (more accuracy around 0
+       * than around dim) */
+      x = (x == dim_x) ? 0.0 : x;
+      y = (y == dim_y) ? 0.0 : y;
+      z = (z == dim_z) ? 0.0 : z;
+
+      /* Get its cell index */
+      pos_x[i] = x;
+      pos_y[i] = y;
+      pos_z[i] = z;
+      index[i] = cell_getid(cdim, x * ih_x, y * ih_y, z * ih_z);
+    }
 
-    /* Treat the case where a particle was wrapped back exactly onto
-     * the edge because of rounding issues (more accuracy around 0
-     * than around dim) */
-    if (pos_x == dim_x) pos_x = 0.0;
-    if (pos_y == dim_y) pos_y = 0.0;
-    if (pos_z == dim_z) pos_z = 0.0;
+    for (int i = 0; i < n; i++) {
 
-    /* Get its cell index */
-    const int index =
-        cell_getid(cdim, pos_x * ih_x, pos_y * ih_y, pos_z * ih_z);
+      /* Get the particle */
+      const int k = first + i;
+      struct gpart *restrict gp = &gparts[k];
 
 #ifdef SWIFT_DEBUG_CHECKS
-    if (index < 0 || index >= cdim[0] * cdim[1] * cdim[2])
-      error("Invalid index=%d cdim=[%d %d %d] p->x=[%e %e %e]", index, cdim[0],
-            cdim[1], cdim[2], pos_x, pos_y, pos_z);
-
-    if (pos_x >= dim_x || pos_y >= dim_y || pos_z >= dim_z || pos_x < 0. ||
-        pos_y < 0. || pos_z < 0.)
-      error("Particle outside of simulation box. p->x=[%e %e %e]", pos_x, pos_y,
-            pos_z);
-#endif
-
-    if (gp->time_bin == time_bin_inhibited) {
-      /* Is this particle to be removed? */
-      ind[k] = -1;
-      ++count_inhibited_gpart;
-    } else if (gp->time_bin == time_bin_not_created) {
-      /* Is this a place-holder for on-the-fly creation? */
-      ind[k] = index;
-      cell_counts[index]++;
-      ++count_extra_gpart;
-
-    } else {
-      /* List its top-level cell index */
-      ind[k] = index;
-      cell_counts[index]++;
+      if (!s->periodic && gp->time_bin != time_bin_inhibited) {
+        if (gp->x[0] < 0. || gp->x[0] > dim_x)
+          error("Particle outside of volume along X.");
+        if (gp->x[1] < 0. || gp->x[1] > dim_y)
+          error("Particle outside of volume along Y.");
+        if (gp->x[2] < 0. || gp->x[2] > dim_z)
+          error("Particle outside of volume along Z.");
+      }
 
-      if (gp->type == swift_type_dark_matter) {
+      if (index[i] < 0 || index[i] >= cdim[0] * cdim[1] * cdim[2])
+        error("Invalid index=%d cdim=[%d %d %d] p->x=[%e %e %e]", index[i],
+              cdim[0], cdim[1], cdim[2], pos_x[i], pos_y[i], pos_z[i]);
 
-        /* Compute minimal mass */
-        min_mass = min(min_mass, gp->mass);
+      if (pos_x[i] >= dim_x || pos_y[i] >= dim_y || pos_z[i] >= dim_z ||
+          pos_x[i] < 0. || pos_y[i] < 0. || pos_z[i] < 0.)
+        error("Particle outside of simulation box. p->x=[%e %e %e]", pos_x[i],
+              pos_y[i], pos_z[i]);
+#endif
 
-        /* Compute sum of velocity norm */
-        sum_vel_norm += gp->v_full[0] * gp->v_full[0] +
-                        gp->v_full[1] * gp->v_full[1] +
-                        gp->v_full[2] * gp->v_full[2];
+      if (gp->time_bin == time_bin_inhibited) {
+        /* Is this particle to be removed? */
+        ind[k] = -1;
+        ++count_inhibited_gpart;
+      } else if (gp->time_bin == time_bin_not_created) {
+        /* Is this a place-holder for on-the-fly creation? */
+        ind[k] = index[i];
+        cell_counts[index[i]]++;
+        ++count_extra_gpart;
+
+      } else {
+        /* List its top-level cell index */
+        ind[k] = index[i];
+        cell_counts[index[i]]++;
+
+        if (gp->type == swift_type_dark_matter) {
+
+          /* Compute minimal mass */
+          min_mass = min(min_mass, gp->mass);
+
+          /* Compute sum of velocity norm */
+          sum_vel_norm += gp->v_full[0] * gp->v_full[0] +
+                          gp->v_full[1] * gp->v_full[1] +
+                          gp->v_full[2] * gp->v_full[2];
+        }
+
+        /* Update the position */
+        gp->x[0] = pos_x[i];
+        gp->x[1] = pos_y[i];
+        gp->x[2] = pos_z[i];
       }
-
-      /* Update the position */
-      gp->x[0] = pos_x;
-      gp->x[1] = pos_y;
-      gp->x[2] = pos_z;
     }
   }
 
-  /* Write the counts back to the global array. */
-  for (int k = 0; k < s->nr_cells; k++)
-    if (cell_counts[k]) atomic_add(&data->cell_counts[k], cell_counts[k]);
-  free(cell_counts);
-
   /* Write the count of inhibited and extra gparts */
   if (count_inhibited_gpart)
     atomic_add(&data->count_inhibited_gpart, count_inhibited_gpart);
@@ -313,6 +337,31 @@ void space_gparts_get_cell_index_mapper(void *map_data, int nr_gparts,
   atomic_add_f(&s->sum_gpart_vel_norm, sum_vel_norm);
 }
 
+/**
+ * @brief #threadpool mapper function to add the per-thread cell counts of
+ * the g-particles to the global ones.
+ *
+ * @param map_data Pointer towards the global cell counts.
+ * @param nr_cells The number of cells to treat.
+ * @param extra_data Pointers to the space and the per-thread counts.
+ */
+void space_gparts_merge_cell_counts_mapper(void *map_data, int nr_cells,
+                                           void *extra_data) {
+
+  /* Unpack the data */
+  int *const cell_counts = (int *)map_data;
+  struct space_index_data *data = (struct space_index_data *)extra_data;
+  const struct space *s = data->s;
+  const size_t offset = cell_counts - data->cell_counts;
+  const int nr_threads = s->e->threadpool.num_threads;
+
+  for (int t = 0; t < nr_threads; t++) {
+    const int *const thread_counts =
+        data->thread_cell_counts + (size_t)t * s->nr_cells + offset;
+    for (int k = 0; k < nr_cells; k++) cell_counts[k] += thread_counts[k];
+  }
+}
+
 /**
  * @brief #threadpool mapper function to compute the s-particle cell indices.
  *
@@ -786,10 +835,23 @@ void space_gparts_get_cell_index(struct space *s, int *gind, int *cell_counts,
   data.count_extra_bpart = 0;
   data.count_extra_sink = 0;
 
+  /* Every thread counts its particles on its own, no need for atomics */
+  const int nr_threads = s->e->threadpool.num_threads;
+  data.thread_cell_counts = (int *)swift_calloc(
+      "cell_counts", (size_t)nr_threads * s->nr_cells, sizeof(int));
+  if (data.thread_cell_counts == NULL)
+    error("Failed to allocate the per-thread cell count buffers.");
+
   threadpool_map(&s->e->threadpool, space_gparts_get_cell_index_mapper,
                  s->gparts, s->nr_gparts, sizeof(struct gpart),
                  threadpool_auto_chunk_size, &data);
 
+  /* Add them up */
+  threadpool_map(&s->e->threadpool, space_gparts_merge_cell_counts_mapper,
+                 cell_counts, s->nr_cells, sizeof(int),
+                 threadpool_auto_chunk_size, &data);
+  swift_free("cell_counts", data.thread_cell_counts);
+
   *count_inhibited_gparts = data.count_inhibited_gpart;
   *count_extra_gparts = data.count_extra_gpart;
 
@@ -29,6 +29,7 @@
 #include "cell.h"
 #include "engine.h"
 #include "memswap.h"
+#include "memuse_arena.h"
 
 /*! Expected maximal number of strays received at a rebuild */
 extern int space_expected_max_nr_strays;
@@ -106,35 +107,40 @@ void space_rebuild(struct space *s, int repartitioned, int verbose) {
   const size_t b_index_size = size_bparts + space_expected_max_nr_strays;
   const size_t sink_index_size = size_sinks + space_expected_max_nr_strays;
 
+  /* All the temporary arrays come from the transient arena. */
+  struct memuse_arena *arena = &memuse_transient_arena;
+  const size_t arena_size =
+      memuse_arena_size(sizeof(int) * h_index_size) +
+      memuse_arena_size(sizeof(int) * g_index_size) +
+      memuse_arena_size(sizeof(int) * s_index_size) +
+      memuse_arena_size(sizeof(int) * b_index_size) +
+      memuse_arena_size(sizeof(int) * sink_index_size) +
+      5 * memuse_arena_size(sizeof(int) * s->nr_cells);
+  memuse_arena_begin(arena, arena_size);
+
   /* Allocate arrays to store the indices of the cells where particles
      belong. We allocate extra space to allow for particles we may
-     receive from other nodes */
-  int *h_index = (int *)swift_malloc("h_index", sizeof(int) * h_index_size);
-  int *g_index = (int *)swift_malloc("g_index", sizeof(int) * g_index_size);
-  int *s_index = (int *)swift_malloc("s_index", sizeof(int) * s_index_size);
-  int *b_index = (int *)swift_malloc("b_index", sizeof(int) * b_index_size);
+     receive from other nodes. Those of the gparts are needed the longest,
+     so come first such that the others can be released before them. */
+  int *g_index = (int *)memuse_arena_alloc(arena, sizeof(int) * g_index_size);
+  int *cell_gpart_counts =
+      (int *)memuse_arena_alloc(arena, sizeof(int) * s->nr_cells);
+  const size_t arena_mark = memuse_arena_mark(arena);
+  int *h_index = (int *)memuse_arena_alloc(arena, sizeof(int) * h_index_size);
+  int *s_index = (int *)memuse_arena_alloc(arena, sizeof(int) * s_index_size);
+  int *b_index = (int *)memuse_arena_alloc(arena, sizeof(int) * b_index_size);
   int *sink_index =
-      (int *)swift_malloc("sink_index", sizeof(int) * sink_index_size);
-  if (h_index == NULL || g_index == NULL || s_index == NULL ||
-      b_index == NULL || sink_index == NULL)
-    error("Failed to allocate temporary particle indices.");
+      (int *)memuse_arena_alloc(arena, sizeof(int) * sink_index_size);
 
   /* Allocate counters of particles that will land in each cell */
   int *cell_part_counts =
-      (int *)swift_malloc("cell_part_counts", sizeof(int) * s->nr_cells);
-  int *cell_gpart_counts =
-      (int *)swift_malloc("cell_gpart_counts", sizeof(int) * s->nr_cells);
+      (int *)memuse_arena_alloc(arena, sizeof(int) * s->nr_cells);
   int *cell_spart_counts =
-      (int *)swift_malloc("cell_spart_counts", sizeof(int) * s->nr_cells);
+      (int *)memuse_arena_alloc(arena, sizeof(int) * s->nr_cells);
   int *cell_bpart_counts =
-      (int *)swift_malloc("cell_bpart_counts", sizeof(int) * s->nr_cells);
+      (int *)memuse_arena_alloc(arena, sizeof(int) * s->nr_cells);
   int *cell_sink_counts =
-      (int *)swift_malloc("cell_sink_counts", sizeof(int) * s->nr_cells);
-
-  if (cell_part_counts == NULL || cell_gpart_counts == NULL ||
-      cell_spart_counts == NULL || cell_bpart_counts == NULL ||
-      cell_sink_counts == NULL)
-    error("Failed to allocate cell particle count buffer.");
+      (int *)memuse_arena_alloc(arena, sizeof(int) * s->nr_cells);
 
   /* Initialise the counters, including buffer space for future particles */
   for (int i = 0; i < s->nr_cells; ++i) {
@@ -526,34 +532,25 @@ void space_rebuild(struct space *s, int repartitioned, int verbose) {
 
   /* Re-allocate the index array for the parts if needed.. */
   if (s->nr_parts + 1 > h_index_size) {
-    int *ind_new;
-    if ((ind_new = (int *)swift_malloc(
-             "h_index", sizeof(int) * (s->nr_parts + 1))) == NULL)
-      error("Failed to allocate temporary particle indices.");
+    int *ind_new =
+        (int *)memuse_arena_alloc(arena, sizeof(int) * (s->nr_parts + 1));
     memcpy(ind_new, h_index, sizeof(int) * nr_parts);
-    swift_free("h_index", h_index);
     h_index = ind_new;
   }
 
   /* Re-allocate the index array for the sparts if needed.. */
   if (s->nr_sparts + 1 > s_index_size) {
-    int *sind_new;
-    if ((sind_new = (int *)swift_malloc(
-             "s_index", sizeof(int) * (s->nr_sparts + 1))) == NULL)
-      error("Failed to allocate temporary s-particle indices.");
+    int *sind_new =
+        (int *)memuse_arena_alloc(arena, sizeof(int) * (s->nr_sparts + 1));
     memcpy(sind_new, s_index, sizeof(int) * nr_sparts);
-    swift_free("s_index", s_index);
     s_index = sind_new;
   }
 
   /* Re-allocate the index array for the bparts if needed.. */
   if (s->nr_bparts + 1 > s_index_size) {
-    int *bind_new;
-    if ((bind_new = (int *)swift_malloc(
-             "b_index", sizeof(int) * (s->nr_bparts + 1))) == NULL)
-      error("Failed to allocate temporary s-particle indices.");
+    int *bind_new =
+        (int *)memuse_arena_alloc(arena, sizeof(int) * (s->nr_bparts + 1));
     memcpy(bind_new, b_index, sizeof(int) * nr_bparts);
-    swift_free("b_index", b_index);
     b_index = bind_new;
   }
 
@@ -615,7 +612,8 @@ void space_rebuild(struct space *s, int repartitioned, int verbose) {
   /* Sort the parts according to their cells. */
   if (nr_parts > 0)
     space_parts_sort(s->parts, s->xparts, h_index, cell_part_counts,
-                     s->nr_cells, 0);
+                     s->nr_cells, 0,
+                     s->parallel_sort ? &s->e->threadpool : NULL);
 
 #ifdef SWIFT_DEBUG_CHECKS
   /* Verify that the part have been sorted correctly. */
@@ -782,14 +780,7 @@ void space_rebuild(struct space *s, int repartitioned, int verbose) {
   }
 
   /* We no longer need the indices as of here. */
-  swift_free("h_index", h_index);
-  swift_free("cell_part_counts", cell_part_counts);
-  swift_free("s_index", s_index);
-  swift_free("cell_spart_counts", cell_spart_counts);
-  swift_free("b_index", b_index);
-  swift_free("cell_bpart_counts", cell_bpart_counts);
-  swift_free("sink_index", sink_index);
-  swift_free("cell_sink_counts", cell_sink_counts);
+  memuse_arena_release(arena, arena_mark);
 
   /* Update the slice of unique IDs. */
   space_update_unique_id(s);
@@ -798,12 +789,9 @@ void space_rebuild(struct space *s, int repartitioned, int verbose) {
 
   /* Re-allocate the index array for the gparts if needed.. */
   if (s->nr_gparts + 1 > g_index_size) {
-    int *gind_new;
-    if ((gind_new = (int *)swift_malloc(
-             "g_index", sizeof(int) * (s->nr_gparts + 1))) == NULL)
-      error("Failed to allocate temporary g-particle indices.");
+    int *gind_new =
+        (int *)memuse_arena_alloc(arena, sizeof(int) * (s->nr_gparts + 1));
     memcpy(gind_new, g_index, sizeof(int) * nr_gparts);
-    swift_free("g_index", g_index);
     g_index = gind_new;
   }
 
@@ -838,7 +826,8 @@ void space_rebuild(struct space *s, int repartitioned, int verbose) {
   /* Sort the gparts according to their cells. */
   if (nr_gparts > 0)
     space_gparts_sort(s->gparts, s->parts, s->sinks, s->sparts, s->bparts,
-                      g_index, cell_gpart_counts, s->nr_cells);
+                      g_index, cell_gpart_counts, s->nr_cells,
+                      s->parallel_sort ? &s->e->threadpool : NULL);
 
 #ifdef SWIFT_DEBUG_CHECKS
   /* Verify that the gpart have been sorted correctly. */
@@ -879,8 +868,10 @@ void space_rebuild(struct space *s, int repartitioned, int verbose) {
   }
 
   /* We no longer need the indices as of here. */
-  swift_free("g_index", g_index);
-  swift_free("cell_gpart_counts", cell_gpart_counts);
+  const size_t arena_peak = memuse_arena_end(arena);
+  if (verbose)
+    message("Temporary arrays peaked at %.3f MB.",
+            arena_peak / (1024. * 1024.));
 
 #ifdef SWIFT_DEBUG_CHECKS
   /* Verify that the links are correct */
@@ -908,6 +899,8 @@ void space_rebuild(struct space *s, int repartitioned, int verbose) {
     c->hydro.ti_old_part = ti_current;
     c->grav.ti_old_part = ti_current;
     c->grav.ti_old_multipole = ti_current;
+    c->grav.ti_soa = -1;
+    c->hydro.ti_soa = -1;
     c->stars.ti_old_part = ti_current;
     c->sinks.ti_old_part = ti_current;
     c->black_holes.ti_old_part = ti_current;
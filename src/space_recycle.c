@@ -181,7 +181,6 @@ void space_rebuild_recycle_mapper(void *map_data, int num_elements,
     c->grav.down_in = NULL;
     c->grav.down = NULL;
     c->grav.end_force = NULL;
-    c->grav.neutrino_weight = NULL;
     c->top = c;
     c->super = c;
     c->hydro.super = c;
@@ -190,6 +189,7 @@ void space_rebuild_recycle_mapper(void *map_data, int num_elements,
     c->hydro.xparts = NULL;
     c->grav.parts = NULL;
     c->grav.parts_rebuild = NULL;
+    c->grav.parts_foreign = NULL;
     c->sinks.parts = NULL;
     c->stars.parts = NULL;
     c->stars.parts_rebuild = NULL;
@@ -341,7 +341,52 @@ void space_free_cells(struct space *s) {
                  s);
   s->maxdepth = 0;
 
+  /* All the sub-cells are now unused. */
+  space_relink_cells_sub(s);
+
   if (s->e->verbose)
     message("took %.3f %s.", clocks_from_ticks(getticks() - tic),
             clocks_getunit());
 }
+
+/**
+ * @brief Re-orders the buffers of unused sub-cells and multipoles by address.
+ *
+ * The recycled cells and multipoles end up in their buffers in whatever
+ * order the trees were taken apart, and are then handed out in that order
+ * by space_getcells(). When none of them is in use, the buffers are instead
+ * re-built from the slabs they were allocated in, such that the next split
+ * hands out consecutive cells and multipoles. The trees, and the progeny of
+ * every cell, are then laid out contiguously and in depth-first order, and
+ * the multipoles of the cells in the same order.
+ *
+ * @param s The #space.
+ */
+void space_relink_cells_sub(struct space *s) {
+
+  /* Are any sub-cells still in use? */
+  if (s->tot_cells != s->nr_cells) return;
+
+  const int nr_buffers = s->e->threadpool.num_threads + 1;
+  for (int k = 0; k < nr_buffers; k++) {
+    s->cells_sub[k] = NULL;
+    s->multipoles_sub[k] = NULL;
+  }
+
+  /* Push the slabs backwards such that the lists start with the first. */
+  for (int i = s->nr_slabs - 1; i >= 0; i--) {
+    const struct space_slab *slab = &s->slabs[i];
+    if (slab->cells != NULL) {
+      for (int k = space_cellallocchunk - 1; k >= 0; k--) {
+        slab->cells[k].next = s->cells_sub[slab->tpid];
+        s->cells_sub[slab->tpid] = &slab->cells[k];
+      }
+    }
+    if (slab->multipoles != NULL) {
+      for (int k = space_cellallocchunk - 1; k >= 0; k--) {
+        slab->multipoles[k].next = s->multipoles_sub[slab->tpid];
+        s->multipoles_sub[slab->tpid] = &slab->multipoles[k];
+      }
+    }
+  }
+}
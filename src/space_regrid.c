@@ -319,6 +319,8 @@ void space_regrid(struct space *s, int verbose) {
           c->sinks.ti_old_part = ti_current;
           c->black_holes.ti_old_part = ti_current;
           c->grav.ti_old_multipole = ti_current;
+          c->grav.ti_soa = -1;
+          c->hydro.ti_soa = -1;
 #ifdef WITH_MPI
           c->mpi.tag = -1;
           c->mpi.recv = NULL;
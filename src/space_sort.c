@@ -22,11 +22,301 @@
 /* Config parameters. */
 #include <config.h>
 
+/* Some standard headers. */
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
 /* This object's header. */
+#include "atomic.h"
 #include "error.h"
 #include "memswap.h"
 #include "memuse.h"
 #include "space.h"
+#include "threadpool.h"
+
+/*! Minimal number of particles per chunk of the parallel sorts */
+#define space_sort_parallel_min_chunk 10000
+
+/*! Fraction of the particles out of their bin below which the in-place sort,
+ * which only moves these, is used rather than the parallel one */
+#define space_sort_in_place_fraction 0.01
+
+/**
+ * @brief Data shared by the #threadpool mappers of the parallel sorts.
+ */
+struct space_sort_data {
+
+  /*! The cell indices of the particles and their sorted copy. */
+  int *ind, *ind_sorted;
+
+  /*! Number of particles and of bins. */
+  size_t count;
+  int num_bins;
+
+  /*! Number of particles per chunk, the last one excepted. */
+  size_t chunk_size;
+
+  /*! Histogram and then first free slot of every bin of every chunk. */
+  size_t *offsets;
+
+  /*! Range of every bin in the sorted array. */
+  size_t *bin_offsets;
+
+  /*! Number of particles that are not in the range of their bin. */
+  size_t count_movers;
+
+  /*! The #part and #xpart, and their sorted copies. */
+  struct part *parts, *parts_sorted;
+  struct xpart *xparts, *xparts_sorted;
+  ptrdiff_t parts_offset;
+
+  /*! The #gpart and their sorted copy. */
+  struct gpart *gparts, *gparts_sorted;
+
+  /*! The other particles to re-link to the #gpart. */
+  struct sink *sinks;
+  struct spart *sparts;
+  struct bpart *bparts;
+};
+
+/**
+ * @brief #threadpool mapper function counting the particles of each bin in
+ * some chunks of the particles, and those not already in their bin.
+ *
+ * @param map_data The indices of the chunks.
+ * @param num_elements The number of chunks.
+ * @param extra_data The #space_sort_data.
+ */
+static void space_sort_histogram_mapper(void *map_data, int num_elements,
+                                        void *extra_data) {
+
+  struct space_sort_data *data = (struct space_sort_data *)extra_data;
+  const int *chunks = (const int *)map_data;
+  const int *restrict ind = data->ind;
+  const size_t *restrict bin_offsets = data->bin_offsets;
+  size_t count_movers = 0;
+
+  for (int i = 0; i < num_elements; i++) {
+    size_t *restrict hist = &data->offsets[chunks[i] * (size_t)data->num_bins];
+    const size_t first = chunks[i] * data->chunk_size;
+    const size_t last = min(first + data->chunk_size, data->count);
+    for (size_t k = first; k < last; k++) {
+      hist[ind[k]]++;
+      count_movers += (k < bin_offsets[ind[k]] || k >= bin_offsets[ind[k] + 1]);
+    }
+  }
+
+  if (count_movers) atomic_add(&data->count_movers, count_movers);
+}
+
+/**
+ * @brief Prepares a parallel counting sort of some particles.
+ *
+ * The particles are cut into chunks which are counted in parallel. The
+ * histograms are then turned into the position of the first particle of
+ * each bin of each chunk in the sorted array, such that the chunks can be
+ * scattered in parallel and in a reproducible order.
+ *
+ * When the particles were sorted at the previous rebuild and only a few of
+ * them changed bin since, most of them are still within the range of their
+ * bin. The serial in-place sort, which only moves the others, is then
+ * cheaper and is used instead.
+ *
+ * @param tp The #threadpool, or NULL for a serial sort.
+ * @param data The #space_sort_data with its ind, count and num_bins set.
+ * @param counts Number of particles per index.
+ * @param chunks (return) The indices of the chunks.
+ * @return The number of chunks, 0 if the sort is better done in place.
+ */
+static int space_sort_prepare(struct threadpool *tp,
+                              struct space_sort_data *data,
+                              const int *counts, int **chunks) {
+
+  if (tp == NULL) return 0;
+
+  /* Not more chunks than threads, and not more bins in the histograms than
+   * particles. */
+  const size_t max_chunks = data->count / space_sort_parallel_min_chunk;
+  int nr_chunks = tp->num_threads;
+  if ((size_t)nr_chunks > max_chunks) nr_chunks = max_chunks;
+  if ((size_t)nr_chunks > data->count / data->num_bins)
+    nr_chunks = data->count / data->num_bins;
+  if (nr_chunks < 2) return 0;
+
+  data->chunk_size = (data->count + nr_chunks - 1) / nr_chunks;
+  data->offsets = (size_t *)swift_calloc(
+      "sort_offsets", (size_t)nr_chunks * data->num_bins, sizeof(size_t));
+  if (data->offsets == NULL)
+    error("Failed to allocate temporary sort offsets array.");
+
+  data->bin_offsets = (size_t *)swift_malloc(
+      "sort_offsets", sizeof(size_t) * (data->num_bins + 1));
+  if (data->bin_offsets == NULL)
+    error("Failed to allocate temporary sort offsets array.");
+  data->bin_offsets[0] = 0;
+  for (int k = 0; k < data->num_bins; k++)
+    data->bin_offsets[k + 1] = data->bin_offsets[k] + counts[k];
+
+  if ((*chunks = (int *)malloc(sizeof(int) * nr_chunks)) == NULL)
+    error("Failed to allocate temporary sort chunks array.");
+  for (int k = 0; k < nr_chunks; k++) (*chunks)[k] = k;
+
+  data->count_movers = 0;
+  threadpool_map(tp, space_sort_histogram_mapper, *chunks, nr_chunks,
+                 sizeof(int), 1, data);
+  swift_free("sort_offsets", data->bin_offsets);
+
+  /* Few particles changed bin? */
+  if (data->count_movers < space_sort_in_place_fraction * data->count) {
+    swift_free("sort_offsets", data->offsets);
+    free(*chunks);
+    *chunks = NULL;
+    return 0;
+  }
+
+  /* Bin by bin and, within a bin, chunk by chunk. */
+  size_t offset = 0;
+  for (int b = 0; b < data->num_bins; b++) {
+#ifdef SWIFT_DEBUG_CHECKS
+    const size_t bin_start = offset;
+#endif
+    for (int c = 0; c < nr_chunks; c++) {
+      size_t *o = &data->offsets[c * (size_t)data->num_bins + b];
+      const size_t n = *o;
+      *o = offset;
+      offset += n;
+    }
+#ifdef SWIFT_DEBUG_CHECKS
+    if (offset - bin_start != (size_t)counts[b])
+      error("Histogram of bin %d does not match its count.", b);
+#endif
+  }
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (offset != data->count) error("Histograms do not match the count.");
+#endif
+
+  return nr_chunks;
+}
+
+/**
+ * @brief #threadpool mapper function scattering some chunks of #part and
+ * #xpart to their sorted position.
+ *
+ * @param map_data The indices of the chunks.
+ * @param num_elements The number of chunks.
+ * @param extra_data The #space_sort_data.
+ */
+static void space_parts_sort_scatter_mapper(void *map_data, int num_elements,
+                                            void *extra_data) {
+
+  const struct space_sort_data *data =
+      (const struct space_sort_data *)extra_data;
+  const int *chunks = (const int *)map_data;
+
+  for (int i = 0; i < num_elements; i++) {
+    size_t *restrict offsets =
+        &data->offsets[chunks[i] * (size_t)data->num_bins];
+    const size_t first = chunks[i] * data->chunk_size;
+    const size_t last = min(first + data->chunk_size, data->count);
+    for (size_t k = first; k < last; k++) {
+      const size_t j = offsets[data->ind[k]]++;
+      data->parts_sorted[j] = data->parts[k];
+      data->xparts_sorted[j] = data->xparts[k];
+      data->ind_sorted[j] = data->ind[k];
+    }
+  }
+}
+
+/**
+ * @brief #threadpool mapper function copying the sorted #part and #xpart
+ * back and re-linking their #gpart.
+ *
+ * @param map_data The sorted #part.
+ * @param num_elements The number of #part.
+ * @param extra_data The #space_sort_data.
+ */
+static void space_parts_sort_copy_mapper(void *map_data, int num_elements,
+                                         void *extra_data) {
+
+  const struct space_sort_data *data =
+      (const struct space_sort_data *)extra_data;
+  const size_t first = (struct part *)map_data - data->parts_sorted;
+
+  memcpy(&data->parts[first], &data->parts_sorted[first],
+         num_elements * sizeof(struct part));
+  memcpy(&data->xparts[first], &data->xparts_sorted[first],
+         num_elements * sizeof(struct xpart));
+  memcpy(&data->ind[first], &data->ind_sorted[first],
+         num_elements * sizeof(int));
+
+  for (size_t k = first; k < first + num_elements; k++)
+    if (data->parts[k].gpart)
+      data->parts[k].gpart->id_or_neg_offset = -(k + data->parts_offset);
+}
+
+/**
+ * @brief #threadpool mapper function scattering some chunks of #gpart to
+ * their sorted position.
+ *
+ * @param map_data The indices of the chunks.
+ * @param num_elements The number of chunks.
+ * @param extra_data The #space_sort_data.
+ */
+static void space_gparts_sort_scatter_mapper(void *map_data, int num_elements,
+                                             void *extra_data) {
+
+  const struct space_sort_data *data =
+      (const struct space_sort_data *)extra_data;
+  const int *chunks = (const int *)map_data;
+
+  for (int i = 0; i < num_elements; i++) {
+    size_t *restrict offsets =
+        &data->offsets[chunks[i] * (size_t)data->num_bins];
+    const size_t first = chunks[i] * data->chunk_size;
+    const size_t last = min(first + data->chunk_size, data->count);
+    for (size_t k = first; k < last; k++) {
+      const size_t j = offsets[data->ind[k]]++;
+      data->gparts_sorted[j] = data->gparts[k];
+      data->ind_sorted[j] = data->ind[k];
+    }
+  }
+}
+
+/**
+ * @brief #threadpool mapper function copying the sorted #gpart back and
+ * re-linking their partners.
+ *
+ * @param map_data The sorted #gpart.
+ * @param num_elements The number of #gpart.
+ * @param extra_data The #space_sort_data.
+ */
+static void space_gparts_sort_copy_mapper(void *map_data, int num_elements,
+                                          void *extra_data) {
+
+  const struct space_sort_data *data =
+      (const struct space_sort_data *)extra_data;
+  const size_t first = (struct gpart *)map_data - data->gparts_sorted;
+  struct gpart *gparts = data->gparts;
+
+  memcpy(&gparts[first], &data->gparts_sorted[first],
+         num_elements * sizeof(struct gpart));
+  memcpy(&data->ind[first], &data->ind_sorted[first],
+         num_elements * sizeof(int));
+
+  for (size_t k = first; k < first + num_elements; k++) {
+    if (gparts[k].type == swift_type_gas) {
+      data->parts[-gparts[k].id_or_neg_offset].gpart = &gparts[k];
+    } else if (gparts[k].type == swift_type_stars) {
+      data->sparts[-gparts[k].id_or_neg_offset].gpart = &gparts[k];
+    } else if (gparts[k].type == swift_type_black_hole) {
+      data->bparts[-gparts[k].id_or_neg_offset].gpart = &gparts[k];
+    } else if (gparts[k].type == swift_type_sink) {
+      data->sinks[-gparts[k].id_or_neg_offset].gpart = &gparts[k];
+    }
+  }
+}
 
 /**
  * @brief Sort the particles and condensed particles according to the given
@@ -38,10 +328,51 @@
  * @param counts Number of particles per index.
  * @param num_bins Total number of bins (length of count).
  * @param parts_offset Offset of the #part array from the global #part array.
+ * @param tp The #threadpool to sort with, or NULL for a serial sort.
  */
 void space_parts_sort(struct part *parts, struct xpart *xparts,
                       int *restrict ind, int *restrict counts, int num_bins,
-                      ptrdiff_t parts_offset) {
+                      ptrdiff_t parts_offset, struct threadpool *tp) {
+
+  /* Large enough to be sorted in parallel? */
+  size_t count = 0;
+  for (int k = 0; k < num_bins; k++) count += counts[k];
+
+  struct space_sort_data data;
+  bzero(&data, sizeof(struct space_sort_data));
+  data.ind = ind;
+  data.count = count;
+  data.num_bins = num_bins;
+  int *chunks = NULL;
+  const int nr_chunks = space_sort_prepare(tp, &data, counts, &chunks);
+
+  if (nr_chunks > 0) {
+
+    data.parts = parts;
+    data.xparts = xparts;
+    data.parts_offset = parts_offset;
+    if (swift_memalign("parts_sorted", (void **)&data.parts_sorted,
+                       part_align, sizeof(struct part) * count) != 0 ||
+        swift_memalign("xparts_sorted", (void **)&data.xparts_sorted,
+                       xpart_align, sizeof(struct xpart) * count) != 0 ||
+        (data.ind_sorted =
+             (int *)swift_malloc("ind_sorted", sizeof(int) * count)) == NULL)
+      error("Failed to allocate temporary sorted parts arrays.");
+
+    threadpool_map(tp, space_parts_sort_scatter_mapper, chunks, nr_chunks,
+                   sizeof(int), 1, &data);
+    threadpool_map(tp, space_parts_sort_copy_mapper, data.parts_sorted,
+                   count, sizeof(struct part), threadpool_auto_chunk_size,
+                   &data);
+
+    swift_free("parts_sorted", data.parts_sorted);
+    swift_free("xparts_sorted", data.xparts_sorted);
+    swift_free("ind_sorted", data.ind_sorted);
+    swift_free("sort_offsets", data.offsets);
+    free(chunks);
+    return;
+  }
+
   /* Create the offsets array. */
   size_t *offsets = NULL;
   if (swift_memalign("parts_offsets", (void **)&offsets, SWIFT_STRUCT_ALIGNMENT,
@@ -285,11 +616,52 @@ void space_sinks_sort(struct sink *sinks, int *restrict ind,
  * @param ind The indices with respect to which the gparts are sorted.
  * @param counts Number of particles per index.
  * @param num_bins Total number of bins (length of counts).
+ * @param tp The #threadpool to sort with, or NULL for a serial sort.
  */
 void space_gparts_sort(struct gpart *gparts, struct part *parts,
                        struct sink *sinks, struct spart *sparts,
                        struct bpart *bparts, int *restrict ind,
-                       int *restrict counts, int num_bins) {
+                       int *restrict counts, int num_bins,
+                       struct threadpool *tp) {
+
+  /* Large enough to be sorted in parallel? */
+  size_t count = 0;
+  for (int k = 0; k < num_bins; k++) count += counts[k];
+
+  struct space_sort_data data;
+  bzero(&data, sizeof(struct space_sort_data));
+  data.ind = ind;
+  data.count = count;
+  data.num_bins = num_bins;
+  int *chunks = NULL;
+  const int nr_chunks = space_sort_prepare(tp, &data, counts, &chunks);
+
+  if (nr_chunks > 0) {
+
+    data.gparts = gparts;
+    data.parts = parts;
+    data.sinks = sinks;
+    data.sparts = sparts;
+    data.bparts = bparts;
+    if (swift_memalign("gparts_sorted", (void **)&data.gparts_sorted,
+                       gpart_align, sizeof(struct gpart) * count) != 0 ||
+        (data.ind_sorted =
+             (int *)swift_malloc("ind_sorted", sizeof(int) * count)) == NULL)
+      error("Failed to allocate temporary sorted gparts arrays.");
+
+    threadpool_map(tp, space_gparts_sort_scatter_mapper, chunks, nr_chunks,
+                   sizeof(int), 1, &data);
+    threadpool_map(tp, space_gparts_sort_copy_mapper, data.gparts_sorted,
+                   count, sizeof(struct gpart), threadpool_auto_chunk_size,
+                   &data);
+
+    swift_free("gparts_sorted", data.gparts_sorted);
+    swift_free("ind_sorted", data.ind_sorted);
+    swift_free("sort_offsets", data.offsets);
+    free(chunks);
+    return;
+  }
+
   /* Create the offsets array. */
   size_t *offsets = NULL;
   if (swift_memalign("gparts_offsets", (void **)&offsets,
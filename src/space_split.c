@@ -22,12 +22,17 @@
 /* Config parameters. */
 #include <config.h>
 
+/* System includes. */
+#include <math.h>
+#include <stdlib.h>
+
 /* This object's header. */
 #include "space.h"
 
 /* Local headers. */
 #include "active.h"
 #include "cell.h"
+#include "cuda_multipole_build.h"
 #include "debug.h"
 #include "engine.h"
 #include "multipole.h"
@@ -64,6 +69,7 @@ void space_split_recursive(struct space *s, struct cell *c,
   const int bcount = c->black_holes.count;
   const int sink_count = c->sinks.count;
   const int with_self_gravity = s->with_self_gravity;
+  const int with_multipoles = with_self_gravity && !gpu_multipole_build.active;
   const int depth = c->depth;
   int maxdepth = 0;
   float h_max = 0.0f;
@@ -192,10 +198,14 @@ void space_split_recursive(struct space *s, struct cell *c,
         space_cell_maxdepth);
   }
 
+  /* The #gpart leaves may be larger or smaller than the others */
+  const int split_size_grav = c->top->grav.split_size > 0
+                                  ? c->top->grav.split_size
+                                  : space_splitsize_grav;
+
   /* Split or let it be? */
-  if ((with_self_gravity && gcount > space_splitsize) ||
-      (!with_self_gravity &&
-       (count > space_splitsize || scount > space_splitsize))) {
+  if ((with_self_gravity && gcount > split_size_grav) ||
+      count > space_splitsize || scount > space_splitsize) {
 
     /* No longer just a leaf. */
     c->split = 1;
@@ -217,6 +227,8 @@ void space_split_recursive(struct space *s, struct cell *c,
       cp->hydro.ti_old_part = c->hydro.ti_old_part;
       cp->grav.ti_old_part = c->grav.ti_old_part;
       cp->grav.ti_old_multipole = c->grav.ti_old_multipole;
+      cp->grav.ti_soa = -1;
+      cp->hydro.ti_soa = -1;
       cp->stars.ti_old_part = c->stars.ti_old_part;
       cp->sinks.ti_old_part = c->sinks.ti_old_part;
       cp->black_holes.ti_old_part = c->black_holes.ti_old_part;
@@ -333,8 +345,8 @@ void space_split_recursive(struct space *s, struct cell *c,
       }
     }
 
-    /* Deal with the multipole */
-    if (s->with_self_gravity) {
+    /* Deal with the multipole (unless the GPU builds them all later) */
+    if (with_multipoles) {
 
       /* Reset everything */
       gravity_reset(c->grav.multipole);
@@ -516,6 +528,16 @@ void space_split_recursive(struct space *s, struct cell *c,
       xparts[k].x_diff[2] = 0.f;
     }
 
+    /* gparts: Put them in Morton order */
+    if (s->gpart_morton_order && gbuff != NULL)
+      cell_morton_order_gparts(c, gbuff, s->parts, s->sparts, s->bparts,
+                               s->sinks);
+
+    /* All: Group the particles by time-bin, keeping the Morton order of the
+     * gparts within each bin */
+    if (s->time_bin_order)
+      cell_time_bin_order(c, s->parts, s->sparts, s->bparts, s->sinks);
+
     /* gparts: Get dt_min/dt_max. */
     for (int k = 0; k < gcount; k++) {
 #ifdef SWIFT_DEBUG_CHECKS
@@ -619,7 +641,7 @@ void space_split_recursive(struct space *s, struct cell *c,
     }
 
     /* Construct the multipole and the centre of mass*/
-    if (s->with_self_gravity) {
+    if (with_multipoles) {
       if (gcount > 0) {
 
         gravity_P2M(c->grav.multipole, c->grav.parts, c->grav.count,
@@ -718,7 +740,7 @@ void space_split_mapper(void *map_data, int num_cells, void *extra_data) {
     struct cell *c = &cells_top[local_cells_with_particles[ind]];
     space_split_recursive(s, c, NULL, NULL, NULL, NULL, NULL, tpid);
 
-    if (s->with_self_gravity) {
+    if (s->with_self_gravity && !gpu_multipole_build.active) {
       min_a_grav =
           min(min_a_grav, c->grav.multipole->m_pole.min_old_a_grav_norm);
       max_softening =
@@ -767,7 +789,120 @@ void space_split(struct space *s, int verbose) {
                  s->nr_local_cells_with_particles, sizeof(int),
                  threadpool_auto_chunk_size, s);
 
+  /* Build all the multipoles of the new trees in one go on the GPU */
+  if (s->with_self_gravity && gpu_multipole_build.active) {
+
+    cuda_multipole_build(s, s->local_cells_with_particles_top,
+                         s->nr_local_cells_with_particles,
+                         /*ti_current=*/-1);
+
+    /* Collect the global information about the top-level m-poles */
+    for (int ind = 0; ind < s->nr_local_cells_with_particles; ind++) {
+      const struct cell *c =
+          &s->cells_top[s->local_cells_with_particles_top[ind]];
+      const struct multipole *m_pole = &c->grav.multipole->m_pole;
+
+      s->min_a_grav = min(s->min_a_grav, m_pole->min_old_a_grav_norm);
+      s->max_softening = max(s->max_softening, m_pole->max_softening);
+      for (int n = 0; n < SELF_GRAVITY_MULTIPOLE_ORDER + 1; ++n)
+        s->max_mpole_power[n] = max(s->max_mpole_power[n], m_pole->power[n]);
+    }
+  }
+
   if (verbose)
     message("took %.3f %s.", clocks_from_ticks(getticks() - tic),
             clocks_getunit());
 }
+
+/**
+ * @brief Count the leaves of a tree that hold #gpart.
+ *
+ * @param c The #cell at the root of the tree.
+ */
+static int space_split_count_grav_leaves(const struct cell *c) {
+
+  if (!c->split) return c->grav.count > 0;
+
+  int count = 0;
+  for (int k = 0; k < 8; k++)
+    if (c->progeny[k] != NULL)
+      count += space_split_count_grav_leaves(c->progeny[k]);
+  return count;
+}
+
+/**
+ * @brief Tune the size of the #gpart leaves of the local top-level cells
+ * from the cost of their gravity tasks since the last rebuild.
+ *
+ * The time per run of the self and pair gravity tasks is given to the
+ * top-level cells they act on (half to each for pairs) and spread over the
+ * leaves of the cell. A leaf interacts with a roughly fixed number of
+ * neighbours, so that cost grows as the square of the leaf size, which we
+ * scale to reach #space_split_tune_time per leaf. The change is limited to a
+ * factor 2 per rebuild and the size to the range [#space_splitsize_grav_min,
+ * #space_splitsize_grav_max]. The next space_split() then splits or merges
+ * the leaves accordingly.
+ *
+ * The times are the ones of whichever device ran the tasks, so the cells of
+ * the different GPUs and of the CPU each find their own leaf size.
+ *
+ * This must be called before the tasks and the trees are freed.
+ *
+ * @param s The #space.
+ * @param sched The #scheduler holding the tasks of the last rebuild.
+ * @param verbose Are we talkative ?
+ */
+void space_split_tune(struct space *s, const struct scheduler *sched,
+                      int verbose) {
+
+  const ticks tic = getticks();
+
+  double *cost = (double *)calloc(s->nr_cells, sizeof(double));
+  if (cost == NULL) error("Failed to allocate the top-level cell costs.");
+
+  /* Collect the time per run of the gravity tasks of each top-level cell */
+  for (int k = 0; k < sched->nr_tasks; k++) {
+    const struct task *t = &sched->tasks[k];
+    if (t->subtype != task_subtype_grav || t->nr_runs == 0) continue;
+
+    const double time = clocks_from_ticks(t->total_ticks) / t->nr_runs;
+    if (t->type == task_type_self || t->type == task_type_sub_self) {
+      cost[t->ci->top - s->cells_top] += time;
+    } else if (t->type == task_type_pair || t->type == task_type_sub_pair) {
+      cost[t->ci->top - s->cells_top] += 0.5 * time;
+      cost[t->cj->top - s->cells_top] += 0.5 * time;
+    }
+  }
+
+  /* Scale the leaves towards the target cost */
+  int nr_tuned = 0;
+  double sum_split_size = 0.;
+  for (int k = 0; k < s->nr_local_cells; k++) {
+    struct cell *c = &s->cells_top[s->local_cells_top[k]];
+    const int nr_leaves = space_split_count_grav_leaves(c);
+    const double time = cost[s->local_cells_top[k]];
+    if (nr_leaves == 0 || time <= 0.) continue;
+
+    const int split_size =
+        c->grav.split_size > 0 ? c->grav.split_size : space_splitsize_grav;
+    double factor = sqrt(space_split_tune_time * nr_leaves / time);
+    factor = max(factor, 0.5);
+    factor = min(factor, 2.);
+    int new_split_size = split_size * factor;
+    new_split_size = max(new_split_size, space_splitsize_grav_min);
+    c->grav.split_size = min(new_split_size, space_splitsize_grav_max);
+
+    nr_tuned++;
+    sum_split_size += c->grav.split_size;
+  }
+
+  free(cost);
+
+  if (verbose) {
+    if (nr_tuned > 0)
+      message("Mean gravity leaf size of %d top-level cells set to %.1f.",
+              nr_tuned, sum_split_size / nr_tuned);
+    message("took %.3f %s.", clocks_from_ticks(getticks() - tic),
+            clocks_getunit());
+  }
+}
@@ -41,6 +41,7 @@
 #include "error.h"
 #include "gravity_io.h"
 #include "hydro_io.h"
+#include "memuse.h"
 #include "mhd_io.h"
 #include "potential.h"
 #include "sink_io.h"
@@ -54,7 +55,7 @@ struct space_index_data {
   /*! The space we play with */
   const struct space *s;
 
-  /*! The #statistics aggregator to fill */
+  /*! The per-thread #statistics aggregators to fill */
   struct statistics *stats;
 };
 
@@ -116,9 +117,50 @@ void stats_init(struct statistics *s) {
 
   /* Zero everything */
   bzero(s, sizeof(struct statistics));
+}
+
+/**
+ * @brief Allocate and initialise one #statistics aggregator per thread.
+ *
+ * Each one sits on its own cache lines such that the mappers can accumulate
+ * into them without locking or false sharing.
+ *
+ * @param nr_threads The number of threads in the #threadpool.
+ */
+struct statistics *stats_threads_init(const int nr_threads) {
+
+  struct statistics *thread_stats = NULL;
+  if (swift_memalign("thread_stats", (void **)&thread_stats,
+                     SWIFT_CACHE_ALIGNMENT,
+                     nr_threads * sizeof(struct statistics)) != 0)
+    error("Failed to allocate the per-thread statistics.");
 
-  /* Set the lock */
-  lock_init(&s->lock);
+  for (int k = 0; k < nr_threads; k++) stats_init(&thread_stats[k]);
+
+  return thread_stats;
+}
+
+/**
+ * @brief Add the per-thread #statistics aggregators to another one and free
+ * them.
+ *
+ * The aggregators are summed pairwise in a tree rather than one after the
+ * other.
+ *
+ * @param thread_stats The per-thread #statistics (freed on exit).
+ * @param nr_threads The number of threads in the #threadpool.
+ * @param stats The #statistics aggregator to add the result to.
+ */
+void stats_threads_reduce(struct statistics *thread_stats,
+                          const int nr_threads, struct statistics *stats) {
+
+  for (int stride = 1; stride < nr_threads; stride *= 2)
+    for (int k = 0; k + stride < nr_threads; k += 2 * stride)
+      stats_add(&thread_stats[k], &thread_stats[k + stride]);
+
+  if (nr_threads > 0) stats_add(stats, &thread_stats[0]);
+
+  swift_free("thread_stats", thread_stats);
 }
 
 /**
@@ -139,7 +181,7 @@ void stats_collect_part_mapper(void *map_data, int nr_parts, void *extra_data) {
   const double time = e->time;
   const struct part *const parts = (struct part *)map_data;
   const struct xpart *const xparts = s->xparts + (ptrdiff_t)(parts - s->parts);
-  struct statistics *const global_stats = data->stats;
+  struct statistics *const thread_stats = &data->stats[threadpool_gettid()];
 
   /* Some information about the physical model */
   const struct external_potential *potential = e->external_potential;
@@ -254,9 +296,8 @@ void stats_collect_part_mapper(void *map_data, int nr_parts, void *extra_data) {
     stats.divB_error += mhd_get_divB_error(p, xp);
   }
 
-  /* Now write back to memory */
-  if (lock_lock(&global_stats->lock) == 0) stats_add(global_stats, &stats);
-  if (lock_unlock(&global_stats->lock) != 0) error("Failed to unlock stats.");
+  /* Now write back to this thread's partial sums */
+  stats_add(thread_stats, &stats);
 }
 
 /**
@@ -277,7 +318,7 @@ void stats_collect_spart_mapper(void *map_data, int nr_sparts,
   const int with_self_grav = (e->policy & engine_policy_self_gravity);
   const double time = e->time;
   const struct spart *const sparts = (struct spart *)map_data;
-  struct statistics *const global_stats = data->stats;
+  struct statistics *const thread_stats = &data->stats[threadpool_gettid()];
 
   /* Some information about the physical model */
   const struct external_potential *potential = e->external_potential;
@@ -343,9 +384,8 @@ void stats_collect_spart_mapper(void *map_data, int nr_sparts,
                                  time, potential, phys_const, gp);
   }
 
-  /* Now write back to memory */
-  if (lock_lock(&global_stats->lock) == 0) stats_add(global_stats, &stats);
-  if (lock_unlock(&global_stats->lock) != 0) error("Failed to unlock stats.");
+  /* Now write back to this thread's partial sums */
+  stats_add(thread_stats, &stats);
 }
 
 /**
@@ -365,7 +405,7 @@ void stats_collect_sink_mapper(void *map_data, int nr_sinks, void *extra_data) {
   const int with_self_grav = (e->policy & engine_policy_self_gravity);
   const double time = e->time;
   const struct sink *const sinks = (struct sink *)map_data;
-  struct statistics *const global_stats = data->stats;
+  struct statistics *const thread_stats = &data->stats[threadpool_gettid()];
 
   /* Some information about the physical model */
   const struct external_potential *potential = e->external_potential;
@@ -428,9 +468,8 @@ void stats_collect_sink_mapper(void *map_data, int nr_sinks, void *extra_data) {
                                  time, potential, phys_const, gp);
   }
 
-  /* Now write back to memory */
-  if (lock_lock(&global_stats->lock) == 0) stats_add(global_stats, &stats);
-  if (lock_unlock(&global_stats->lock) != 0) error("Failed to unlock stats.");
+  /* Now write back to this thread's partial sums */
+  stats_add(thread_stats, &stats);
 }
 
 /**
@@ -451,7 +490,7 @@ void stats_collect_bpart_mapper(void *map_data, int nr_bparts,
   const int with_self_grav = (e->policy & engine_policy_self_gravity);
   const double time = e->time;
   const struct bpart *const bparts = (struct bpart *)map_data;
-  struct statistics *const global_stats = data->stats;
+  struct statistics *const thread_stats = &data->stats[threadpool_gettid()];
 
   /* Some information about the physical model */
   const struct external_potential *potential = e->external_potential;
@@ -529,9 +568,8 @@ void stats_collect_bpart_mapper(void *map_data, int nr_bparts,
     stats.bh_jet_power += black_holes_get_jet_power(bp, phys_const);
   }
 
-  /* Now write back to memory */
-  if (lock_lock(&global_stats->lock) == 0) stats_add(global_stats, &stats);
-  if (lock_unlock(&global_stats->lock) != 0) error("Failed to unlock stats.");
+  /* Now write back to this thread's partial sums */
+  stats_add(thread_stats, &stats);
 }
 
 /**
@@ -552,7 +590,7 @@ void stats_collect_gpart_mapper(void *map_data, int nr_gparts,
   const int with_self_grav = (e->policy & engine_policy_self_gravity);
   const double time = e->time;
   const struct gpart *restrict gparts = (struct gpart *)map_data;
-  struct statistics *const global_stats = data->stats;
+  struct statistics *const thread_stats = &data->stats[threadpool_gettid()];
 
   /* Some information about the physical model */
   const struct external_potential *potential = e->external_potential;
@@ -620,9 +658,8 @@ void stats_collect_gpart_mapper(void *map_data, int nr_gparts,
                                  time, potential, phys_const, gp);
   }
 
-  /* Now write back to memory */
-  if (lock_lock(&global_stats->lock) == 0) stats_add(global_stats, &stats);
-  if (lock_unlock(&global_stats->lock) != 0) error("Failed to unlock stats.");
+  /* Now write back to this thread's partial sums */
+  stats_add(thread_stats, &stats);
 }
 
 /**
@@ -633,10 +670,12 @@ void stats_collect_gpart_mapper(void *map_data, int nr_gparts,
  */
 void stats_collect(const struct space *s, struct statistics *stats) {
 
+  const int nr_threads = s->e->threadpool.num_threads;
+
   /* Prepare the data */
   struct space_index_data extra_data;
   extra_data.s = s;
-  extra_data.stats = stats;
+  extra_data.stats = stats_threads_init(nr_threads);
 
   /* Run parallel collection of statistics for parts */
   if (s->nr_parts > 0)
@@ -667,6 +706,88 @@ void stats_collect(const struct space *s, struct statistics *stats) {
     threadpool_map(&s->e->threadpool, stats_collect_gpart_mapper, s->gparts,
                    s->nr_gparts, sizeof(struct gpart),
                    threadpool_auto_chunk_size, &extra_data);
+
+  /* And sum what the threads found */
+  stats_threads_reduce(extra_data.stats, nr_threads, stats);
+}
+
+/**
+ * @brief Collect the statistics of the #part of a #cell.
+ *
+ * To be called from a #threadpool mapper, e.g. right after the particles
+ * were drifted, instead of a separate stats_collect() sweep.
+ *
+ * @param s The #space the #cell belongs to.
+ * @param c The #cell.
+ * @param thread_stats The per-thread #statistics from stats_threads_init().
+ */
+void stats_collect_cell_part(const struct space *s, const struct cell *c,
+                             struct statistics *thread_stats) {
+
+  struct space_index_data data = {s, thread_stats};
+  if (c->hydro.count > 0)
+    stats_collect_part_mapper(c->hydro.parts, c->hydro.count, &data);
+}
+
+/**
+ * @brief Collect the statistics of the #gpart of a #cell.
+ *
+ * @param s The #space the #cell belongs to.
+ * @param c The #cell.
+ * @param thread_stats The per-thread #statistics from stats_threads_init().
+ */
+void stats_collect_cell_gpart(const struct space *s, const struct cell *c,
+                              struct statistics *thread_stats) {
+
+  struct space_index_data data = {s, thread_stats};
+  if (c->grav.count > 0)
+    stats_collect_gpart_mapper(c->grav.parts, c->grav.count, &data);
+}
+
+/**
+ * @brief Collect the statistics of the #spart of a #cell.
+ *
+ * @param s The #space the #cell belongs to.
+ * @param c The #cell.
+ * @param thread_stats The per-thread #statistics from stats_threads_init().
+ */
+void stats_collect_cell_spart(const struct space *s, const struct cell *c,
+                              struct statistics *thread_stats) {
+
+  struct space_index_data data = {s, thread_stats};
+  if (c->stars.count > 0)
+    stats_collect_spart_mapper(c->stars.parts, c->stars.count, &data);
+}
+
+/**
+ * @brief Collect the statistics of the #sink of a #cell.
+ *
+ * @param s The #space the #cell belongs to.
+ * @param c The #cell.
+ * @param thread_stats The per-thread #statistics from stats_threads_init().
+ */
+void stats_collect_cell_sink(const struct space *s, const struct cell *c,
+                             struct statistics *thread_stats) {
+
+  struct space_index_data data = {s, thread_stats};
+  if (c->sinks.count > 0)
+    stats_collect_sink_mapper(c->sinks.parts, c->sinks.count, &data);
+}
+
+/**
+ * @brief Collect the statistics of the #bpart of a #cell.
+ *
+ * @param s The #space the #cell belongs to.
+ * @param c The #cell.
+ * @param thread_stats The per-thread #statistics from stats_threads_init().
+ */
+void stats_collect_cell_bpart(const struct space *s, const struct cell *c,
+                              struct statistics *thread_stats) {
+
+  struct space_index_data data = {s, thread_stats};
+  if (c->black_holes.count > 0)
+    stats_collect_bpart_mapper(c->black_holes.parts, c->black_holes.count,
+                               &data);
 }
 
 /**
@@ -23,18 +23,21 @@
 #include <config.h>
 
 /* Local headers. */
-#include "lock.h"
+#include "align.h"
 
 /* Some standard headers. */
 #include <stdio.h>
 
 /* Pre-declarations */
+struct cell;
 struct phys_const;
 struct space;
 struct unit_system;
 
 /**
  * @brief Quantities collected for physics statistics
+ *
+ * Cache-aligned such that the per-thread copies do not share cache lines.
  */
 struct statistics {
 
@@ -131,11 +134,22 @@ struct statistics {
   /*! Total Magnetic helicity */
   double H_mag;
 
-  /*! Lock for threaded access */
-  swift_lock_type lock;
-};
+} SWIFT_CACHE_ALIGN;
 
 void stats_collect(const struct space* s, struct statistics* stats);
+void stats_collect_cell_part(const struct space* s, const struct cell* c,
+                             struct statistics* thread_stats);
+void stats_collect_cell_gpart(const struct space* s, const struct cell* c,
+                              struct statistics* thread_stats);
+void stats_collect_cell_spart(const struct space* s, const struct cell* c,
+                              struct statistics* thread_stats);
+void stats_collect_cell_sink(const struct space* s, const struct cell* c,
+                             struct statistics* thread_stats);
+void stats_collect_cell_bpart(const struct space* s, const struct cell* c,
+                              struct statistics* thread_stats);
+struct statistics* stats_threads_init(const int nr_threads);
+void stats_threads_reduce(struct statistics* thread_stats,
+                          const int nr_threads, struct statistics* stats);
 void stats_add(struct statistics* a, const struct statistics* b);
 void stats_write_file_header(FILE* file, const struct unit_system* us,
                              const struct phys_const* phys_const);
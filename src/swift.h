@@ -26,6 +26,7 @@
 #include "active.h"
 #include "adaptive_softening.h"
 #include "atomic.h"
+#include "benchmark.h"
 #include "black_holes_properties.h"
 #include "cache.h"
 #include "cell.h"
@@ -58,8 +59,11 @@
 #include "lightcone/lightcone_array.h"
 #include "line_of_sight.h"
 #include "lock.h"
+#include "lpt_ics.h"
 #include "map.h"
 #include "memuse.h"
+#include "memuse_phases.h"
+#include "memuse_shared.h"
 #include "mesh_gravity.h"
 #include "minmax.h"
 #include "mpiuse.h"
@@ -42,10 +42,13 @@
 
 /* Local headers. */
 #include "atomic.h"
+#include "cuda_timeline.h"
 #include "engine.h"
 #include "error.h"
 #include "inline.h"
 #include "lock.h"
+#include "mpi_aggregate.h"
+#include "mpi_comm_stats.h"
 #include "mpiuse.h"
 
 /* Task type names. */
@@ -112,7 +115,6 @@ const char *taskID_names[task_type_count] = {
     "fof_pair",
     "fof_attach_self",
     "fof_attach_pair",
-    "neutrino_weight",
     "sink_in",
     "sink_ghost1",
     "sink_ghost2",
@@ -608,10 +610,15 @@ void task_unlock(struct task *t) {
     case task_type_sub_pair:
       if (subtype == task_subtype_grav) {
 #ifdef SWIFT_TASKS_WITHOUT_ATOMICS
-        cell_gunlocktree(ci);
-        cell_gunlocktree(cj);
-        cell_munlocktree(ci);
-        cell_munlocktree(cj);
+        if (!(t->flags & task_grav_nolock_ci)) {
+          cell_gunlocktree(ci);
+          cell_munlocktree(ci);
+        }
+        if (!(t->flags & task_grav_nolock_cj)) {
+          cell_gunlocktree(cj);
+          cell_munlocktree(cj);
+        }
+        t->flags = 0;
 #endif
       } else if ((subtype == task_subtype_sink_swallow) ||
                  (subtype == task_subtype_sink_do_gas_swallow)) {
@@ -667,8 +674,8 @@ void task_unlock(struct task *t) {
 
     case task_type_grav_mm:
 #ifdef SWIFT_TASKS_WITHOUT_ATOMICS
-      cell_munlocktree(ci);
-      cell_munlocktree(cj);
+      if (ci->nodeID == engine_rank) cell_munlocktree(ci);
+      if (cj->nodeID == engine_rank) cell_munlocktree(cj);
 #endif
       break;
 
@@ -727,6 +734,11 @@ int task_lock(struct task *t) {
     case task_type_recv:
     case task_type_send:
 #ifdef WITH_MPI
+      /* Aggregated messages are tested on behalf of all their cells. */
+      if (mpi_aggregate_gparts && t->subtype == task_subtype_gpart)
+        return t->type == task_type_send ? 1
+                                         : mpi_aggregate_recv_gpart_test(t);
+
       /* Check the status of the MPI request. */
       if ((err = MPI_Test(&t->req, &res, &stat)) != MPI_SUCCESS) {
         char buff[MPI_MAX_ERROR_STRING];
@@ -741,6 +753,10 @@ int task_lock(struct task *t) {
       /* And log deactivation, if logging enabled. */
       if (res) {
         mpiuse_log_allocation(t->type, t->subtype, &t->req, 0, 0, 0, 0);
+        mpi_comm_stats_done(
+            t->type == task_type_send, t->subtype,
+            t->type == task_type_send ? t->cj->nodeID : t->ci->nodeID,
+            t->enqueued);
       }
 
       return res;
@@ -859,20 +875,25 @@ int task_lock(struct task *t) {
     case task_type_sub_pair:
       if (subtype == task_subtype_grav) {
 #ifdef SWIFT_TASKS_WITHOUT_ATOMICS
-        /* Lock the gparts and the m-pole in both cells */
-        if (ci->grav.phold || cj->grav.phold) return 0;
-        if (cell_glocktree(ci) != 0) return 0;
-        if (cell_glocktree(cj) != 0) {
-          cell_gunlocktree(ci);
+        /* Lock the gparts and the m-pole of the cells we write to */
+        const int lock_ci = !(t->flags & task_grav_nolock_ci);
+        const int lock_cj = !(t->flags & task_grav_nolock_cj);
+        if ((lock_ci && ci->grav.phold) || (lock_cj && cj->grav.phold))
           return 0;
-        } else if (cell_mlocktree(ci) != 0) {
-          cell_gunlocktree(ci);
-          cell_gunlocktree(cj);
+        if (lock_ci && cell_glocktree(ci) != 0) return 0;
+        if (lock_cj && cell_glocktree(cj) != 0) {
+          if (lock_ci) cell_gunlocktree(ci);
           return 0;
-        } else if (cell_mlocktree(cj) != 0) {
+        } else if (lock_ci && cell_mlocktree(ci) != 0) {
           cell_gunlocktree(ci);
+          if (lock_cj) cell_gunlocktree(cj);
+          return 0;
+        } else if (lock_cj && cell_mlocktree(cj) != 0) {
+          if (lock_ci) {
+            cell_gunlocktree(ci);
+            cell_munlocktree(ci);
+          }
           cell_gunlocktree(cj);
-          cell_munlocktree(ci);
           return 0;
         }
 #endif
@@ -999,13 +1020,18 @@ int task_lock(struct task *t) {
 
     case task_type_grav_mm:
 #ifdef SWIFT_TASKS_WITHOUT_ATOMICS
-      /* Lock both m-poles */
-      if (ci->grav.mhold || cj->grav.mhold) return 0;
-      if (cell_mlocktree(ci) != 0) return 0;
-      if (cell_mlocktree(cj) != 0) {
-        cell_munlocktree(ci);
+    {
+      /* Lock both m-poles, unless foreign as we never write to those */
+      const int lock_ci = (ci->nodeID == engine_rank);
+      const int lock_cj = (cj->nodeID == engine_rank);
+      if ((lock_ci && ci->grav.mhold) || (lock_cj && cj->grav.mhold))
+        return 0;
+      if (lock_ci && cell_mlocktree(ci) != 0) return 0;
+      if (lock_cj && cell_mlocktree(cj) != 0) {
+        if (lock_ci) cell_munlocktree(ci);
         return 0;
       }
+    }
 #endif
       break;
 
@@ -1109,6 +1135,32 @@ void task_print(const struct task *t) {
           t->nr_unlock_tasks, t->skip);
 }
 
+/**
+ * @brief Free the recorded gravity tree walk of a task, if any.
+ *
+ * @param t The #task.
+ */
+void task_grav_walk_clean(struct task *t) {
+
+  if (t->grav_walk == NULL) return;
+  free(t->grav_walk->nodes);
+  free(t->grav_walk);
+  t->grav_walk = NULL;
+}
+
+/**
+ * @brief Free the records last exchanged by a communication task, if any.
+ *
+ * @param t The #task.
+ */
+void task_buff_last_clean(struct task *t) {
+
+#ifdef WITH_MPI
+  free(t->buff_last);
+  t->buff_last = NULL;
+#endif
+}
+
 /**
  * @brief Get the group name of a task.
  *
@@ -1344,6 +1396,30 @@ void task_dump_all(struct engine *e, int step) {
               e->sched.tasks[l].flags, e->sched.tasks[l].sid);
         }
       }
+
+      /* And the time each runner spent looking for tasks, spinning and
+       * asleep, as lines of type -3 with no tic or toc. */
+      for (int k = 0; k < e->nr_threads; k++) {
+        const struct runner *r = &e->runners[k];
+        fprintf(file_thread, " %03d %i -3 0 0 0 0 %lld %lld %lld 0 0 -1\n",
+                engine_rank, r->cpuid, (long long int)r->idle_time,
+                (long long int)r->spin_time, (long long int)r->park_time);
+      }
+
+      /* And the GPU phases of the offloaded tasks, as lines of type -4 with
+       * the task type and subtype and the phase. */
+      for (int k = 0; k < e->nr_threads; k++) {
+        struct runner *r = &e->runners[k];
+        cuda_timeline_flush(&r->gpu_timeline);
+        for (int l = 0; l < r->gpu_timeline.count; l++) {
+          const struct cuda_timeline_record *rec = &r->gpu_timeline.records[l];
+          if (rec->tic <= e->tic_step) continue;
+          fprintf(file_thread, " %03d %i -4 %i %i %lld %lld %i 0 0 0 0 -1\n",
+                  engine_rank, r->cpuid, rec->subtype, rec->type,
+                  (long long int)rec->tic, (long long int)rec->toc,
+                  rec->phase);
+        }
+      }
       fclose(file_thread);
     }
 
@@ -1382,6 +1458,29 @@ void task_dump_all(struct engine *e, int step) {
           e->sched.tasks[l].sid);
     }
   }
+
+  /* And the time each runner spent looking for tasks, spinning and asleep,
+   * as lines of type -3 with no tic or toc. */
+  for (int k = 0; k < e->nr_threads; k++) {
+    const struct runner *r = &e->runners[k];
+    fprintf(file_thread, " %i -3 0 0 0 0 %lld %lld %lld 0 -1\n", r->cpuid,
+            (long long int)r->idle_time, (long long int)r->spin_time,
+            (long long int)r->park_time);
+  }
+
+  /* And the GPU phases of the offloaded tasks, as lines of type -4 with the
+   * task type and subtype and the phase. */
+  for (int k = 0; k < e->nr_threads; k++) {
+    struct runner *r = &e->runners[k];
+    cuda_timeline_flush(&r->gpu_timeline);
+    for (int l = 0; l < r->gpu_timeline.count; l++) {
+      const struct cuda_timeline_record *rec = &r->gpu_timeline.records[l];
+      if (rec->tic <= e->tic_step) continue;
+      fprintf(file_thread, " %i -4 %i %i %lld %lld %i 0 0 0 -1\n", r->cpuid,
+              rec->subtype, rec->type, (long long int)rec->tic,
+              (long long int)rec->toc, rec->phase);
+    }
+  }
   fclose(file_thread);
 #endif  // WITH_MPI
 
@@ -1744,9 +1843,6 @@ enum task_categories task_get_category(const struct task *t) {
     case task_type_rt_advance_cell_time:
       return task_category_rt;
 
-    case task_type_neutrino_weight:
-      return task_category_neutrino;
-
     case task_type_self:
     case task_type_pair:
     case task_type_sub_self:
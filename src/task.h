@@ -36,6 +36,12 @@ struct engine;
 
 #define task_align 128
 
+/* Flags of the gravity pair tasks marking the cells they do not write to
+ * this step (inactive or foreign), which therefore need no locking when
+ * running without atomics. */
+#define task_grav_nolock_ci (1LL << 0)
+#define task_grav_nolock_cj (1LL << 1)
+
 /**
  * @brief The different task types.
  *
@@ -105,7 +111,6 @@ enum task_types {
   task_type_fof_pair,
   task_type_fof_attach_self,
   task_type_fof_attach_pair,
-  task_type_neutrino_weight,
   task_type_sink_in,     /* Implicit */
   task_type_sink_ghost1, /* Implicit */
   task_type_sink_ghost2, /* Implicit */
@@ -228,6 +233,66 @@ extern const char *task_category_names[];
 extern MPI_Comm subtaskMPI_comms[task_subtype_count];
 #endif
 
+/**
+ * @brief The different kinds of node of a recorded gravity tree walk.
+ */
+enum task_grav_walk_types {
+  task_grav_walk_self_split,   /* Self, recursing into the progenies */
+  task_grav_walk_self_pp,      /* Self, leaf P-P */
+  task_grav_walk_pair_split,   /* Pair, recursing into the progenies */
+  task_grav_walk_pair_cut,     /* Pair, beyond the truncation distance */
+  task_grav_walk_pair_cheap,   /* Pair, P-P with at most one gpart */
+  task_grav_walk_pair_mm,      /* Pair, M-M */
+  task_grav_walk_pair_pp,      /* Pair, leaf P-P */
+  task_grav_walk_pair_recheck, /* Pair, walked again at every run */
+};
+
+/**
+ * @brief One node of a recorded gravity tree walk.
+ */
+struct task_grav_walk_node {
+
+  /*! The cells of the node (cj is NULL for self nodes) */
+  struct cell *ci, *cj;
+
+  /*! Oldest time at which the multipoles of the cells were drifted when the
+   * node was recorded */
+  integertime_t ti_record;
+
+  /*! The #task_grav_walk_types of the node */
+  int type;
+
+  /*! Index of the first node after the sub-tree of this one */
+  int next;
+};
+
+/**
+ * @brief The decisions of the tree walk of a gravity self or pair task,
+ * recorded such that the following runs of the task can replay them without
+ * re-evaluating the MAC as long as the multipoles did not drift by more than
+ * #margin since then.
+ *
+ * Only the decisions that cannot change under such a drift are recorded,
+ * the others are marked as #task_grav_walk_pair_recheck and walked again.
+ */
+struct task_grav_walk {
+
+  /*! The nodes, in walk order */
+  struct task_grav_walk_node *nodes;
+
+  /*! Number of nodes in use and that we have room for */
+  int count, size;
+
+  /*! Which MAC was in use when the walk was recorded? */
+  int use_advanced_MAC;
+
+  /*! Displacement of the multipoles up to which the walk is valid */
+  float margin;
+
+  /*! Must the walk be recorded again at the next run? */
+  int needs_record;
+};
+
 /**
  * @brief A task to be run by the #scheduler.
  */
@@ -250,6 +315,10 @@ struct task {
   /*! MPI request corresponding to this task */
   MPI_Request req;
 
+  /*! Records last exchanged by this task, for the messages that only
+   * carry the changed ones (NULL if none yet) */
+  void *buff_last;
+
 #endif
 
   /*! Rank of a task in the order */
@@ -287,9 +356,18 @@ struct task {
   /*! Start and end time of this task */
   ticks tic, toc;
 
+  /*! When this task was put on a queue */
+  ticks enqueued;
+
   /* Total time spent running this task */
   ticks total_ticks;
 
+  /*! Number of times this task was run since it was created */
+  int nr_runs;
+
+  /*! The recorded tree walk of gravity self and pair tasks (NULL if none) */
+  struct task_grav_walk *grav_walk;
+
 #ifdef SWIFT_DEBUG_CHECKS
   /* When was this task last run? */
   integertime_t ti_run;
@@ -303,6 +381,8 @@ float task_overlap(const struct task *ta, const struct task *tb);
 int task_lock(struct task *t);
 struct task *task_get_unique_dependent(const struct task *t);
 void task_print(const struct task *t);
+void task_grav_walk_clean(struct task *t);
+void task_buff_last_clean(struct task *t);
 void task_dump_all(struct engine *e, int step);
 void task_dump_stats(const char *dumpfile, struct engine *e,
                      float dump_tasks_threshold, int header, int allranks);
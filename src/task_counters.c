@@ -0,0 +1,281 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "task_counters.h"
+
+/* System includes. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef SWIFT_TASK_COUNTERS
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+/* Local headers. */
+#include "atomic.h"
+#include "clocks.h"
+#include "error.h"
+#include "runner.h"
+#include "task.h"
+
+/*! Number of (type, subtype) combinations */
+#define task_counters_nr_keys (task_type_count * task_subtype_count)
+
+/*! Size of a cache line, to turn the LLC misses into a bandwidth */
+#define task_counters_line_size 64
+
+#ifdef SWIFT_TASK_COUNTERS
+
+/*! The file the counters are written to */
+static FILE *task_counters_file = NULL;
+
+/*! Has the lack of counters been reported? */
+static int task_counters_warned = 0;
+
+/**
+ * @brief Open one event on the calling thread.
+ *
+ * @param type The perf_event type.
+ * @param config The perf_event config.
+ * @param group_fd The group leader, -1 to create a group.
+ *
+ * @return The file descriptor, -1 if the event could not be opened.
+ */
+static int task_counters_open(const unsigned int type,
+                              const unsigned long long config,
+                              const int group_fd) {
+
+  struct perf_event_attr attr;
+  bzero(&attr, sizeof(struct perf_event_attr));
+  attr.type = type;
+  attr.size = sizeof(struct perf_event_attr);
+  attr.config = config;
+  attr.read_format = PERF_FORMAT_GROUP;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+
+  return (int)syscall(__NR_perf_event_open, &attr, /*pid=*/0, /*cpu=*/-1,
+                      group_fd, /*flags=*/0);
+}
+
+/**
+ * @brief Read the current values of the events of a #task_counters.
+ *
+ * @param c The #task_counters.
+ * @param values The values, in the order of #task_counters_event.
+ */
+static void task_counters_read(const struct task_counters *c,
+                               unsigned long long *values) {
+
+  unsigned long long buff[task_counters_event_count + 1];
+  const ssize_t size = (c->nr_events + 1) * sizeof(unsigned long long);
+  if (read(c->leader, buff, size) != size)
+    error("Failed to read the hardware counters.");
+
+  for (int k = 0; k < task_counters_event_count; k++)
+    values[k] = c->index[k] >= 0 ? buff[1 + c->index[k]] : 0;
+}
+
+/**
+ * @brief Start counting the hardware events of the calling thread.
+ *
+ * Must be called by the #runner's own thread. The events the hardware or the
+ * kernel (see /proc/sys/kernel/perf_event_paranoid) refuse are left out.
+ *
+ * @param c The #task_counters of the runner.
+ */
+void task_counters_init(struct task_counters *c) {
+
+  static const unsigned int types[task_counters_event_count] = {
+      PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+      PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE};
+  static const unsigned long long configs[task_counters_event_count] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+      PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES};
+
+  bzero(c, sizeof(struct task_counters));
+  c->leader = -1;
+  for (int k = 0; k < task_counters_event_count; k++) {
+    c->fd[k] = task_counters_open(types[k], configs[k], c->leader);
+    c->index[k] = -1;
+    if (c->fd[k] < 0) continue;
+    if (c->leader < 0) c->leader = c->fd[k];
+    c->index[k] = c->nr_events++;
+  }
+
+  if (c->leader < 0) {
+    if (atomic_inc(&task_counters_warned) == 0)
+      message("WARNING: no hardware counters available, the task counters "
+              "will stay empty.");
+    return;
+  }
+
+  c->sums = (struct task_counters_sums *)calloc(
+      task_counters_nr_keys, sizeof(struct task_counters_sums));
+  if (c->sums == NULL) error("Failed to allocate the task counters.");
+}
+
+/**
+ * @brief Take the values of the events just before a task runs.
+ *
+ * @param c The #task_counters of the runner.
+ */
+void task_counters_start(struct task_counters *c) {
+
+  if (c->leader < 0) return;
+  task_counters_read(c, c->start);
+  c->tic = getticks();
+}
+
+/**
+ * @brief Add the events since task_counters_start() to the task's type and
+ * subtype.
+ *
+ * @param c The #task_counters of the runner.
+ * @param t The #task that just ran.
+ */
+void task_counters_stop(struct task_counters *c, const struct task *t) {
+
+  if (c->leader < 0) return;
+
+  const ticks toc = getticks();
+  unsigned long long values[task_counters_event_count];
+  task_counters_read(c, values);
+
+  struct task_counters_sums *s =
+      &c->sums[t->type * task_subtype_count + t->subtype];
+  s->count++;
+  s->time += toc - c->tic;
+  for (int k = 0; k < task_counters_event_count; k++)
+    s->events[k] += values[k] - c->start[k];
+}
+
+#endif /* SWIFT_TASK_COUNTERS */
+
+/**
+ * @brief Opens the file of the task counters and prints a header.
+ *
+ * @param rank The MPI rank of the file.
+ */
+void task_counters_open_file(int rank) {
+#ifdef SWIFT_TASK_COUNTERS
+  char buff[100];
+  sprintf(buff, "task_counters_%d.txt", rank);
+  task_counters_file = fopen(buff, "w");
+  if (task_counters_file == NULL) error("Could not create file '%s'.", buff);
+
+  fprintf(task_counters_file,
+          "# Hardware events of the tasks, per type and subtype. Time in %s, "
+          "Miss_GB/s is the LLC line fills per second of task time.\n",
+          clocks_getunit());
+  fprintf(task_counters_file,
+          "# %6s %32s %10s %12s %16s %16s %6s %14s %14s %14s %8s %10s\n",
+          "step", "type/subtype", "count", "time", "cycles", "instructions",
+          "IPC", "L1D_misses", "LLC_refs", "LLC_misses", "LLC_rate",
+          "Miss_GB/s");
+#endif
+}
+
+/**
+ * @brief Re-set the counters of all the runners.
+ *
+ * @param runners The #runner array.
+ * @param nr_runners The number of runners.
+ */
+void task_counters_reset_all(struct runner *runners, const int nr_runners) {
+#ifdef SWIFT_TASK_COUNTERS
+  for (int r = 0; r < nr_runners; r++)
+    if (runners[r].counters.sums != NULL)
+      bzero(runners[r].counters.sums,
+            task_counters_nr_keys * sizeof(struct task_counters_sums));
+#endif
+}
+
+/**
+ * @brief Writes the counters of all the runners, summed, to the task
+ * counters file.
+ *
+ * @param runners The #runner array.
+ * @param nr_runners The number of runners.
+ * @param step The current step.
+ */
+void task_counters_print(const struct runner *runners, const int nr_runners,
+                         const int step) {
+#ifdef SWIFT_TASK_COUNTERS
+  if (task_counters_file == NULL) return;
+
+  for (int key = 0; key < task_counters_nr_keys; key++) {
+
+    struct task_counters_sums s;
+    bzero(&s, sizeof(struct task_counters_sums));
+    for (int r = 0; r < nr_runners; r++) {
+      const struct task_counters_sums *rs = runners[r].counters.sums;
+      if (rs == NULL) continue;
+      s.count += rs[key].count;
+      s.time += rs[key].time;
+      for (int k = 0; k < task_counters_event_count; k++)
+        s.events[k] += rs[key].events[k];
+    }
+    if (s.count == 0) continue;
+
+    char name[64];
+    snprintf(name, sizeof(name), "%s/%s",
+             taskID_names[key / task_subtype_count],
+             subtaskID_names[key % task_subtype_count]);
+    const double time = clocks_from_ticks(s.time);
+    const double seconds = (double)s.time / (double)clocks_get_cpufreq();
+    const unsigned long long *ev = s.events;
+
+    fprintf(task_counters_file,
+            "  %6d %32s %10lld %12.3f %16llu %16llu %6.3f %14llu %14llu "
+            "%14llu %8.4f %10.3f\n",
+            step, name, s.count, time, ev[task_counters_cycles],
+            ev[task_counters_instructions],
+            ev[task_counters_cycles] > 0
+                ? (double)ev[task_counters_instructions] /
+                      (double)ev[task_counters_cycles]
+                : 0.,
+            ev[task_counters_l1d_misses], ev[task_counters_llc_references],
+            ev[task_counters_llc_misses],
+            ev[task_counters_llc_references] > 0
+                ? (double)ev[task_counters_llc_misses] /
+                      (double)ev[task_counters_llc_references]
+                : 0.,
+            seconds > 0. ? 1e-9 * task_counters_line_size *
+                               (double)ev[task_counters_llc_misses] / seconds
+                         : 0.);
+  }
+  fflush(task_counters_file);
+#endif
+}
+
+/**
+ * @brief Close the file of the task counters.
+ */
+void task_counters_close_file(void) {
+#ifdef SWIFT_TASK_COUNTERS
+  if (task_counters_file != NULL) fclose(task_counters_file);
+  task_counters_file = NULL;
+#endif
+}
+
+/**
+ * @brief Stop counting and free the memory of a #task_counters.
+ *
+ * @param c The #task_counters of the runner.
+ */
+void task_counters_clean(struct task_counters *c) {
+#ifdef SWIFT_TASK_COUNTERS
+  for (int k = 0; k < task_counters_event_count; k++)
+    if (c->fd[k] >= 0) close(c->fd[k]);
+  free(c->sums);
+  bzero(c, sizeof(struct task_counters));
+  c->leader = -1;
+#endif
+}
@@ -0,0 +1,89 @@
+#ifndef SWIFT_TASK_COUNTERS_H
+#define SWIFT_TASK_COUNTERS_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* Local headers */
+#include "cycle.h"
+
+/* Forward declarations */
+struct runner;
+struct task;
+
+/**
+ * @brief The hardware events counted around the tasks.
+ */
+enum task_counters_event {
+  task_counters_cycles = 0,
+  task_counters_instructions,
+  task_counters_l1d_misses,
+  task_counters_llc_references,
+  task_counters_llc_misses,
+  task_counters_event_count
+};
+
+/**
+ * @brief The counts of the tasks of one type and subtype.
+ */
+struct task_counters_sums {
+
+  /*! Number of tasks. */
+  long long count;
+
+  /*! Time spent in the tasks. */
+  ticks time;
+
+  /*! Hardware events during the tasks. */
+  unsigned long long events[task_counters_event_count];
+};
+
+/**
+ * @brief The hardware counters of one #runner.
+ *
+ * The events are counted for the runner's thread, in one group such that
+ * they are read together.
+ */
+struct task_counters {
+
+  /*! File descriptor of the group leader, -1 when nothing is counted. */
+  int leader;
+
+  /*! File descriptors of the events, -1 for the ones not available. */
+  int fd[task_counters_event_count];
+
+  /*! Position of each event in the group read, -1 if not counted. */
+  int index[task_counters_event_count];
+
+  /*! Number of events in the group. */
+  int nr_events;
+
+  /*! Values of the events and ticks at the start of the current task. */
+  unsigned long long start[task_counters_event_count];
+  ticks tic;
+
+  /*! Sums per type and subtype (indexed as type * task_subtype_count +
+   * subtype). */
+  struct task_counters_sums *sums;
+};
+
+#ifdef SWIFT_TASK_COUNTERS
+void task_counters_init(struct task_counters *c);
+void task_counters_start(struct task_counters *c);
+void task_counters_stop(struct task_counters *c, const struct task *t);
+#else
+
+/* Nothing to count. */
+#define task_counters_init(c) (void)0
+#define task_counters_start(c) (void)0
+#define task_counters_stop(c, t) (void)0
+#endif
+
+void task_counters_open_file(int rank);
+void task_counters_reset_all(struct runner *runners, const int nr_runners);
+void task_counters_print(const struct runner *runners, const int nr_runners,
+                         const int step);
+void task_counters_close_file(void);
+void task_counters_clean(struct task_counters *c);
+
+#endif /* SWIFT_TASK_COUNTERS_H */
@@ -0,0 +1,213 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "task_critical_path.h"
+
+/* System includes. */
+#include <stdio.h>
+#include <string.h>
+
+/* MPI headers. */
+#ifdef WITH_MPI
+#include <mpi.h>
+#endif
+
+/* Local headers. */
+#include "clocks.h"
+#include "error.h"
+#include "memuse.h"
+#include "minmax.h"
+#include "runner.h"
+#include "scheduler.h"
+
+/**
+ * @brief Prepare the analyses (if needed) and create their file.
+ *
+ * @param cp The #task_critical_path.
+ * @param frequency Number of steps between two analyses, 0 to not analyse.
+ * @param nr_top Number of the longest tasks of the path to report.
+ * @param nodeID The rank of this node.
+ * @param restart Are we restarting? The file is then appended to.
+ */
+void task_critical_path_init(struct task_critical_path *cp,
+                             const int frequency, const int nr_top,
+                             const int nodeID, const int restart) {
+
+  bzero(cp, sizeof(struct task_critical_path));
+  cp->frequency = frequency;
+  cp->nr_top = nr_top;
+  if (frequency == 0) return;
+
+#ifdef WITH_MPI
+  snprintf(cp->filename, sizeof(cp->filename), "critical_path_%04d.txt",
+           nodeID);
+#else
+  snprintf(cp->filename, sizeof(cp->filename), "critical_path.txt");
+#endif
+
+  if (restart) return;
+
+  FILE *file = fopen(cp->filename, "w");
+  if (file == NULL) error("Could not create file '%s'.", cp->filename);
+  fprintf(file,
+          "# Critical path of the tasks of each step, times in %s.\n"
+          "# span: from the start of the first task to the end of the last.\n"
+          "# path: the longest chain of dependencies, weighted with the "
+          "measured times of the tasks.\n"
+          "# busy: the time of all the tasks, efficiency = busy / (threads x "
+          "span).\n"
+          "# idle: fraction of the span each runner spent without a task "
+          "(min, mean and max over the runners).\n"
+          "# rank_idle: fraction of the span of the slowest rank this rank "
+          "was done early.\n"
+          "# top: the longest tasks of the path (type/subtype:time).\n",
+          clocks_getunit());
+  fprintf(file,
+          "# %6s %12s %12s %9s %14s %10s %8s %8s %8s %9s %10s   %s\n", "step",
+          "span", "path", "path/span", "busy", "efficiency", "idle_min",
+          "idle_avg", "idle_max", "rank_idle", "path_tasks", "top");
+  fclose(file);
+}
+
+/**
+ * @brief Did a task run during the step?
+ *
+ * The implicit tasks are done as soon as they are unlocked, they pass the
+ * dependencies on without taking any time.
+ */
+static int task_critical_path_ran(const struct task *t, const ticks tic_step) {
+  return t->implicit || (t->tic > tic_step && t->toc >= t->tic);
+}
+
+/**
+ * @brief Find the critical path of the tasks that ran during this step and
+ * append its analysis to the file.
+ *
+ * The tasks are visited in topological order, carrying the length of the
+ * longest chain of dependencies leading to each of them. Needs all the ranks
+ * to call it at the same step.
+ *
+ * @param cp The #task_critical_path.
+ * @param s The #scheduler.
+ * @param runners The #runner%s, for their active times.
+ * @param nr_runners The number of runners.
+ * @param tic_step The start of the step.
+ * @param step The current step.
+ */
+void task_critical_path_analyse(const struct task_critical_path *cp,
+                                const struct scheduler *s,
+                                const struct runner *runners,
+                                const int nr_runners, const ticks tic_step,
+                                const int step) {
+
+  if (cp->frequency == 0) return;
+
+  const int nr_tasks = s->nr_tasks;
+  const int *tid = s->tasks_ind;
+  const struct task *tasks = s->tasks;
+
+  /* Longest chain ending at the start of each task and the task it ends with
+   * (-1 if none) */
+  const size_t size = nr_tasks > 0 ? nr_tasks : 1;
+  ticks *start = (ticks *)swift_malloc("critical_path", size * sizeof(ticks));
+  int *pred = (int *)swift_malloc("critical_path", size * sizeof(int));
+  if (start == NULL || pred == NULL)
+    error("Failed to allocate the critical path.");
+  bzero(start, nr_tasks * sizeof(ticks));
+  memset(pred, -1, nr_tasks * sizeof(int));
+
+  ticks first = 0, last = 0, busy = 0, path = 0;
+  int path_end = -1;
+  for (int k = 0; k < nr_tasks; k++) {
+    const int ind = tid[k];
+    const struct task *t = &tasks[ind];
+    if (!task_critical_path_ran(t, tic_step)) continue;
+
+    const ticks dt = t->implicit ? 0 : t->toc - t->tic;
+    if (!t->implicit) {
+      if (first == 0 || t->tic < first) first = t->tic;
+      if (t->toc > last) last = t->toc;
+      busy += dt;
+    }
+
+    const ticks end = start[ind] + dt;
+    if (path_end < 0 || end > path) {
+      path = end;
+      path_end = ind;
+    }
+
+    for (int j = 0; j < t->nr_unlock_tasks; j++) {
+      const int ind_u = t->unlock_tasks[j] - tasks;
+      if (pred[ind_u] < 0 || end > start[ind_u]) {
+        start[ind_u] = end;
+        pred[ind_u] = ind;
+      }
+    }
+  }
+  const ticks span = last - first;
+
+  /* Walk back along the path and keep its longest tasks */
+  int top[cp->nr_top > 0 ? cp->nr_top : 1];
+  int nr_top = 0, path_tasks = 0;
+  for (int ind = path_end; ind >= 0; ind = pred[ind]) {
+    const struct task *t = &tasks[ind];
+    if (t->implicit) continue;
+    path_tasks++;
+
+    /* Insert it in the sorted list of the longest ones */
+    const ticks dt = t->toc - t->tic;
+    int k;
+    if (nr_top < cp->nr_top)
+      k = nr_top++;
+    else if (nr_top > 0 &&
+             dt > tasks[top[nr_top - 1]].toc - tasks[top[nr_top - 1]].tic)
+      k = nr_top - 1;
+    else
+      continue;
+    for (; k > 0 && tasks[top[k - 1]].toc - tasks[top[k - 1]].tic < dt; k--)
+      top[k] = top[k - 1];
+    top[k] = ind;
+  }
+
+  swift_free("critical_path", start);
+  swift_free("critical_path", pred);
+
+  /* Idle fractions of the runners */
+  double idle_min = nr_runners > 0 ? 1. : 0., idle_max = 0., idle_sum = 0.;
+  for (int k = 0; k < nr_runners; k++) {
+    const ticks active = runner_get_active_time(&runners[k]);
+    const double idle = span > 0 ? 1. - (double)active / (double)span : 0.;
+    idle_min = min(idle_min, idle);
+    idle_max = max(idle_max, idle);
+    idle_sum += idle;
+  }
+
+  /* How early were we done compared to the slowest rank? */
+  double rank_idle = 0.;
+#ifdef WITH_MPI
+  long long max_span = span;
+  MPI_Allreduce(MPI_IN_PLACE, &max_span, 1, MPI_LONG_LONG_INT, MPI_MAX,
+                MPI_COMM_WORLD);
+  if (max_span > 0) rank_idle = 1. - (double)span / (double)max_span;
+#endif
+
+  FILE *file = fopen(cp->filename, "a");
+  if (file == NULL) error("Could not open file '%s'.", cp->filename);
+  fprintf(file,
+          "  %6d %12.3f %12.3f %9.4f %14.3f %10.4f %8.4f %8.4f %8.4f %9.4f "
+          "%10d  ",
+          step, clocks_from_ticks(span), clocks_from_ticks(path),
+          span > 0 ? (double)path / (double)span : 0.,
+          clocks_from_ticks(busy),
+          span > 0 ? (double)busy / ((double)nr_runners * span) : 0.,
+          idle_min, nr_runners > 0 ? idle_sum / nr_runners : 0., idle_max,
+          rank_idle, path_tasks);
+  for (int k = 0; k < nr_top; k++) {
+    const struct task *t = &tasks[top[k]];
+    fprintf(file, " %s/%s:%.3f", taskID_names[t->type],
+            subtaskID_names[t->subtype], clocks_from_ticks(t->toc - t->tic));
+  }
+  fprintf(file, "\n");
+  fclose(file);
+}
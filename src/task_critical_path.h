@@ -0,0 +1,49 @@
+#ifndef SWIFT_TASK_CRITICAL_PATH_H
+#define SWIFT_TASK_CRITICAL_PATH_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* Local headers */
+#include "cycle.h"
+
+/* Forward declarations */
+struct runner;
+struct scheduler;
+
+/**
+ * @brief Analysis of the critical path of the task graph of a step.
+ *
+ * The longest chain of dependencies, weighted with the measured run times of
+ * the tasks, is a lower bound of the step time on any number of threads.
+ * Comparing it with the actual span of the step and the idle times of the
+ * threads tells whether a slow step is limited by its dependencies (a long
+ * path: split the tasks or change their priorities) or by the load balance
+ * (idle threads or ranks: change the partition).
+ *
+ * The analysis is local to the rank: the communications appear only through
+ * the times of their tasks.
+ */
+struct task_critical_path {
+
+  /*! Number of steps between two analyses, 0 when not analysing. */
+  int frequency;
+
+  /*! Number of the longest tasks of the path to report. */
+  int nr_top;
+
+  /*! The file the analyses are appended to. */
+  char filename[64];
+};
+
+/* Function prototypes. */
+void task_critical_path_init(struct task_critical_path *cp,
+                             const int frequency, const int nr_top,
+                             const int nodeID, const int restart);
+void task_critical_path_analyse(const struct task_critical_path *cp,
+                                const struct scheduler *s,
+                                const struct runner *runners,
+                                const int nr_runners, const ticks tic_step,
+                                const int step);
+
+#endif /* SWIFT_TASK_CRITICAL_PATH_H */
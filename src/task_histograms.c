@@ -0,0 +1,215 @@
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "task_histograms.h"
+
+/* System includes. */
+#include <stdio.h>
+#include <string.h>
+
+/* Local headers. */
+#include "atomic.h"
+#include "clocks.h"
+#include "error.h"
+#include "memuse.h"
+#include "scheduler.h"
+#include "threadpool.h"
+
+/*! Number of (type, subtype) combinations */
+#define task_histograms_nr_keys (task_type_count * task_subtype_count)
+
+/**
+ * @brief The bucket of a time in ticks.
+ *
+ * @param dt The time.
+ */
+static int task_histograms_bucket(const ticks dt) {
+
+  if (dt == 0) return 0;
+  const int b = 64 - __builtin_clzll((unsigned long long)dt);
+  return b < task_histograms_nr_buckets ? b : task_histograms_nr_buckets - 1;
+}
+
+/**
+ * @brief Start collecting the histograms (if needed) and create their file.
+ *
+ * @param h The #task_histograms.
+ * @param frequency Number of steps between two writes, 0 to not collect.
+ * @param nodeID The rank of this node.
+ * @param restart Are we restarting? The file is then appended to.
+ */
+void task_histograms_init(struct task_histograms *h, const int frequency,
+                          const int nodeID, const int restart) {
+
+  bzero(h, sizeof(struct task_histograms));
+  h->frequency = frequency;
+  if (frequency == 0) return;
+
+  h->run = (unsigned int *)swift_calloc(
+      "task_histograms",
+      2 * task_histograms_nr_keys * task_histograms_nr_buckets,
+      sizeof(unsigned int));
+  h->run_ticks = (long long *)swift_calloc(
+      "task_histograms", 2 * task_histograms_nr_keys, sizeof(long long));
+  if (h->run == NULL || h->run_ticks == NULL)
+    error("Failed to allocate the task histograms.");
+  h->wait = h->run + task_histograms_nr_keys * task_histograms_nr_buckets;
+  h->wait_ticks = h->run_ticks + task_histograms_nr_keys;
+
+#ifdef WITH_MPI
+  snprintf(h->filename, sizeof(h->filename), "task_histograms_%04d.csv",
+           nodeID);
+#else
+  snprintf(h->filename, sizeof(h->filename), "task_histograms.csv");
+#endif
+
+  if (restart) return;
+
+  FILE *file = fopen(h->filename, "w");
+  if (file == NULL) error("Could not create file '%s'.", h->filename);
+  fprintf(file,
+          "# Run and queue wait times of the tasks, cpufreq=%llu. Bucket 0 "
+          "counts the times of 0 ticks, bucket k the ones in [2^(k-1), 2^k) "
+          "ticks and the last one all the longer ones.\n",
+          clocks_get_cpufreq());
+  fprintf(file, "step,nr_steps,type,subtype,kind,count,total_%s",
+          clocks_getunit());
+  for (int k = 0; k < task_histograms_nr_buckets; k++)
+    fprintf(file, ",b%d", k);
+  fprintf(file, "\n");
+  fclose(file);
+}
+
+/*! Data of the collection mapper */
+struct task_histograms_collect_data {
+  struct task_histograms *h;
+  ticks tic_step;
+};
+
+/**
+ * @brief Adds the times of a chunk of tasks to the histograms.
+ */
+static void task_histograms_collect_mapper(void *map_data, int num_elements,
+                                           void *extra_data) {
+
+  const struct task *tasks = (const struct task *)map_data;
+  const struct task_histograms_collect_data *data =
+      (const struct task_histograms_collect_data *)extra_data;
+  struct task_histograms *h = data->h;
+
+  for (int i = 0; i < num_elements; i++) {
+    const struct task *t = &tasks[i];
+
+    /* Only the tasks that ran during this step */
+    if (t->implicit || t->tic <= data->tic_step || t->toc < t->tic) continue;
+
+    const int key = t->type * task_subtype_count + t->subtype;
+
+    const ticks run = t->toc - t->tic;
+    atomic_inc(&h->run[key * task_histograms_nr_buckets +
+                       task_histograms_bucket(run)]);
+    atomic_add(&h->run_ticks[key], (long long)run);
+
+    if (t->enqueued > data->tic_step && t->tic >= t->enqueued) {
+      const ticks wait = t->tic - t->enqueued;
+      atomic_inc(&h->wait[key * task_histograms_nr_buckets +
+                          task_histograms_bucket(wait)]);
+      atomic_add(&h->wait_ticks[key], (long long)wait);
+    }
+  }
+}
+
+/**
+ * @brief Adds the times of the tasks that ran during this step to the
+ * histograms.
+ *
+ * @param h The #task_histograms.
+ * @param s The #scheduler.
+ * @param tic_step The start of the step.
+ */
+void task_histograms_collect(struct task_histograms *h,
+                             const struct scheduler *s, const ticks tic_step) {
+
+  if (h->frequency == 0) return;
+
+  struct task_histograms_collect_data data = {h, tic_step};
+  threadpool_map(s->threadpool, task_histograms_collect_mapper, s->tasks,
+                 s->nr_tasks, sizeof(struct task), threadpool_auto_chunk_size,
+                 &data);
+  h->nr_steps++;
+}
+
+/**
+ * @brief Writes one row of the histograms.
+ *
+ * @param file The file to write to.
+ * @param step The current step.
+ * @param nr_steps The number of steps in the histograms.
+ * @param key The index of the type and subtype.
+ * @param kind What times these are.
+ * @param counts The counts of the buckets.
+ * @param total The total time (ticks).
+ */
+static void task_histograms_write_row(FILE *file, const int step,
+                                      const int nr_steps, const int key,
+                                      const char *kind,
+                                      const unsigned int *counts,
+                                      const long long total) {
+
+  unsigned long long count = 0;
+  for (int k = 0; k < task_histograms_nr_buckets; k++) count += counts[k];
+  if (count == 0) return;
+
+  fprintf(file, "%d,%d,%s,%s,%s,%llu,%.6f", step, nr_steps,
+          taskID_names[key / task_subtype_count],
+          subtaskID_names[key % task_subtype_count], kind, count,
+          clocks_from_ticks(total));
+  for (int k = 0; k < task_histograms_nr_buckets; k++)
+    fprintf(file, ",%u", counts[k]);
+  fprintf(file, "\n");
+}
+
+/**
+ * @brief Appends the histograms collected since the last call to their file
+ * and starts afresh.
+ *
+ * @param h The #task_histograms.
+ * @param step The current step.
+ */
+void task_histograms_write(struct task_histograms *h, const int step) {
+
+  if (h->frequency == 0 || h->nr_steps == 0) return;
+
+  FILE *file = fopen(h->filename, "a");
+  if (file == NULL) error("Could not open file '%s'.", h->filename);
+
+  for (int key = 0; key < task_histograms_nr_keys; key++) {
+    task_histograms_write_row(file, step, h->nr_steps, key, "run",
+                              &h->run[key * task_histograms_nr_buckets],
+                              h->run_ticks[key]);
+    task_histograms_write_row(file, step, h->nr_steps, key, "wait",
+                              &h->wait[key * task_histograms_nr_buckets],
+                              h->wait_ticks[key]);
+  }
+  fclose(file);
+
+  bzero(h->run, 2 * task_histograms_nr_keys * task_histograms_nr_buckets *
+                    sizeof(unsigned int));
+  bzero(h->run_ticks, 2 * task_histograms_nr_keys * sizeof(long long));
+  h->nr_steps = 0;
+}
+
+/**
+ * @brief Frees the memory of the #task_histograms.
+ *
+ * @param h The #task_histograms.
+ */
+void task_histograms_clean(struct task_histograms *h) {
+
+  if (h->frequency != 0) {
+    swift_free("task_histograms", h->run);
+    swift_free("task_histograms", h->run_ticks);
+  }
+  bzero(h, sizeof(struct task_histograms));
+}
@@ -0,0 +1,54 @@
+#ifndef SWIFT_TASK_HISTOGRAMS_H
+#define SWIFT_TASK_HISTOGRAMS_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* Local headers */
+#include "cycle.h"
+
+/* Forward declarations */
+struct scheduler;
+
+/*! Number of buckets of the histograms. Bucket 0 holds the times of 0 ticks,
+ *  bucket k > 0 the ones in [2^(k-1), 2^k) ticks and the last one everything
+ *  longer. */
+#define task_histograms_nr_buckets 40
+
+/**
+ * @brief Log-bucket histograms of the run and queue wait times of the tasks,
+ * per type and subtype (indexed as type * task_subtype_count + subtype).
+ *
+ * They are cheap enough to be collected in production runs: the times are
+ * the ticks the scheduler records anyway, binned once per step.
+ */
+struct task_histograms {
+
+  /*! Number of steps between two writes, 0 when not collecting. */
+  int frequency;
+
+  /*! Number of steps collected since the last write. */
+  int nr_steps;
+
+  /*! Counts of the times between the start and the end of the tasks. */
+  unsigned int *run;
+
+  /*! Counts of the times the tasks waited in the queues. */
+  unsigned int *wait;
+
+  /*! Total run and wait ticks per type and subtype. */
+  long long *run_ticks, *wait_ticks;
+
+  /*! The CSV file the histograms are appended to. */
+  char filename[64];
+};
+
+/* Function prototypes. */
+void task_histograms_init(struct task_histograms *h, const int frequency,
+                          const int nodeID, const int restart);
+void task_histograms_collect(struct task_histograms *h,
+                             const struct scheduler *s, const ticks tic_step);
+void task_histograms_write(struct task_histograms *h, const int step);
+void task_histograms_clean(struct task_histograms *h);
+
+#endif /* SWIFT_TASK_HISTOGRAMS_H */
@@ -57,7 +57,8 @@ static void threadpool_apply_affinity_mask(void);
  * @brief Store a log entry of the given chunk.
  */
 static void threadpool_log(struct threadpool *tp, int tid, size_t chunk_size,
-                           ticks tic, ticks toc) {
+                           threadpool_map_function map_function, ticks tic,
+                           ticks toc) {
   struct mapper_log *log = &tp->logs[tid > 0 ? tid : 0];
 
   /* Check if we need to re-allocate the log buffer. */
@@ -78,7 +79,7 @@ static void threadpool_log(struct threadpool *tp, int tid, size_t chunk_size,
   entry->chunk_size = chunk_size;
   entry->tic = tic;
   entry->toc = toc;
-  entry->map_function = tp->map_function;
+  entry->map_function = map_function;
   log->count++;
 }
 
@@ -143,25 +144,22 @@ void threadpool_dump_log(struct threadpool *tp, const char *filename,
 #endif  // SWIFT_DEBUG_THREADPOOL
 
 /**
- * @brief Runner main loop, get a chunk and call the mapper function.
+ * @brief Get chunks of a job and call its mapper function on them until
+ * the job is exhausted.
  */
-static void threadpool_chomp(struct threadpool *tp, int tid) {
-
-  /* Store the thread ID as thread specific data. */
-  int localtid = tid;
-  pthread_setspecific(threadpool_tid, &localtid);
+static void threadpool_chomp_job(struct threadpool *tp,
+                                 struct threadpool_map_job *job, int tid) {
 
   /* Loop until we can't get a chunk. */
   while (1) {
     /* Compute the desired chunk size. */
     ptrdiff_t chunk_size;
-    if (tp->map_data_chunk == threadpool_uniform_chunk_size) {
-      chunk_size = ((tid + 1) * tp->map_data_size / tp->num_threads) -
-                   (tid * tp->map_data_size / tp->num_threads);
+    if (job->map_data_chunk == threadpool_uniform_chunk_size) {
+      chunk_size = ((tid + 1) * job->N / tp->num_threads) -
+                   (tid * job->N / tp->num_threads);
     } else {
-      chunk_size =
-          (tp->map_data_size - tp->map_data_count) / (2 * tp->num_threads);
-      if (chunk_size > tp->map_data_chunk) chunk_size = tp->map_data_chunk;
+      chunk_size = (job->N - job->map_data_count) / (2 * tp->num_threads);
+      if (chunk_size > job->map_data_chunk) chunk_size = job->map_data_chunk;
     }
     if (chunk_size < 1) chunk_size = 1;
 
@@ -169,25 +167,85 @@ static void threadpool_chomp(struct threadpool *tp, int tid) {
     if (chunk_size > INT_MAX) chunk_size = INT_MAX;
 
     /* Get a chunk and check its size. */
-    size_t task_ind = atomic_add(&tp->map_data_count, chunk_size);
-    if (task_ind >= tp->map_data_size) break;
-    if (task_ind + chunk_size > tp->map_data_size)
-      chunk_size = tp->map_data_size - task_ind;
+    size_t task_ind = atomic_add(&job->map_data_count, chunk_size);
+    if (task_ind >= job->N) break;
+    if (task_ind + chunk_size > job->N) chunk_size = job->N - task_ind;
 
 /* Call the mapper function. */
 #ifdef SWIFT_DEBUG_THREADPOOL
     ticks tic = getticks();
 #endif
 
-    tp->map_function((char *)tp->map_data + (tp->map_data_stride * task_ind),
-                     chunk_size, tp->map_extra_data);
+    job->map_function((char *)job->map_data + (job->stride * task_ind),
+                      chunk_size, job->extra_data);
 
 #ifdef SWIFT_DEBUG_THREADPOOL
-    threadpool_log(tp, tid, chunk_size, tic, getticks());
+    threadpool_log(tp, tid, chunk_size, job->map_function, tic, getticks());
 #endif
   }
 }
 
+/**
+ * @brief Runner main loop, get a chunk and call the mapper function, for
+ * all the jobs in turn.
+ */
+static void threadpool_chomp(struct threadpool *tp, int tid) {
+
+  /* Store the thread ID as thread specific data. */
+  int localtid = tid;
+  pthread_setspecific(threadpool_tid, &localtid);
+
+  /* The jobs are independent, move on as soon as one has no chunks left */
+  for (int k = 0; k < tp->nr_jobs; k++)
+    threadpool_chomp_job(tp, &tp->jobs[k], tid);
+}
+
+/**
+ * @brief Run a job in the calling thread.
+ */
+static void threadpool_run_inline(struct threadpool *tp,
+                                  const struct threadpool_map_job *job) {
+
+  /* The caller is the last thread, as in threadpool_map_batch. */
+  int localtid = tp->num_threads - 1;
+  pthread_setspecific(threadpool_tid, &localtid);
+
+  if (job->N <= INT_MAX) {
+#ifdef SWIFT_DEBUG_THREADPOOL
+    ticks tic = getticks();
+#endif
+    job->map_function(job->map_data, job->N, job->extra_data);
+
+#ifdef SWIFT_DEBUG_THREADPOOL
+    threadpool_log(tp, 0, job->N, job->map_function, tic, getticks());
+#endif
+  } else {
+
+    /* N > INT_MAX, we need to do this in chunks as map_function only takes
+     * an int. */
+    size_t chunk_size = INT_MAX;
+    size_t data_size = job->N;
+    size_t data_count = 0;
+    while (1) {
+
+/* Call the mapper function. */
+#ifdef SWIFT_DEBUG_THREADPOOL
+      ticks tic = getticks();
+#endif
+      job->map_function((char *)job->map_data + (job->stride * data_count),
+                        chunk_size, job->extra_data);
+#ifdef SWIFT_DEBUG_THREADPOOL
+      threadpool_log(tp, 0, chunk_size, job->map_function, tic, getticks());
+#endif
+      /* Get the next chunk and check its size. */
+      data_count += chunk_size;
+      if (data_count >= data_size) break;
+      if (data_count + chunk_size > data_size)
+        chunk_size = data_size - data_count;
+    }
+  }
+}
+
 /**
  * @brief The thread start routine. Loops until told to exit.
  *
@@ -210,9 +268,9 @@ static void *threadpool_runner(void *data) {
     /* Wait for the controller. */
     swift_barrier_wait(&tp->run_barrier);
 
-    /* If no map function is specified, just die. We use this as a mechanism
-       to shut down threads without leaving the barriers in an invalid state. */
-    if (tp->map_function == NULL) pthread_exit(NULL);
+    /* If no jobs are specified, just die. We use this as a mechanism to shut
+       down threads without leaving the barriers in an invalid state. */
+    if (tp->jobs == NULL) pthread_exit(NULL);
 
     /* Do actual work. */
     threadpool_chomp(tp, atomic_inc(&tp->num_threads_running));
@@ -259,12 +317,9 @@ void threadpool_init(struct threadpool *tp, int num_threads) {
       swift_barrier_init(&tp->run_barrier, NULL, num_threads) != 0)
     error("Failed to initialize barriers.");
 
-  /* Set the task counter to zero. */
-  tp->map_data_size = 0;
-  tp->map_data_count = 0;
-  tp->map_data_stride = 0;
-  tp->map_data_chunk = 0;
-  tp->map_function = NULL;
+  /* No jobs yet. */
+  tp->jobs = NULL;
+  tp->nr_jobs = 0;
 
   /* Allocate the threads, one less than requested since the calling thread
      works as well. */
@@ -306,64 +361,84 @@ void threadpool_map(struct threadpool *tp, threadpool_map_function map_function,
                     void *map_data, size_t N, int stride, int chunk,
                     void *extra_data) {
 
-#ifdef SWIFT_DEBUG_THREADPOOL
-  ticks tic_total = getticks();
-#endif
+  struct threadpool_map_job job;
+  job.map_function = map_function;
+  job.map_data = map_data;
+  job.N = N;
+  job.stride = stride;
+  job.chunk = chunk;
+  job.extra_data = extra_data;
 
-  /* If we just have a single thread, call the map function directly. */
-  if (tp->num_threads == 1) {
+  threadpool_map_batch(tp, &job, 1);
+}
 
-    if (N <= INT_MAX) {
-      map_function(map_data, N, extra_data);
+/**
+ * @brief Map several functions to their arrays of data in parallel using a
+ * #threadpool, in a single wake-up of the threads.
+ *
+ * The jobs must be independent of each other: the threads move on to the
+ * next job as soon as there are no chunks left in the current one, so
+ * several jobs may be running at the same time. The function returns once
+ * all of them are done.
+ *
+ * A single job that fits in one chunk is run by the calling thread without
+ * waking the others.
+ *
+ * @param tp The #threadpool on which to run.
+ * @param jobs The #threadpool_map_job to run (see #threadpool_map for the
+ *        meaning of their fields).
+ * @param nr_jobs The number of jobs.
+ */
+void threadpool_map_batch(struct threadpool *tp,
+                          struct threadpool_map_job *jobs, int nr_jobs) {
 
 #ifdef SWIFT_DEBUG_THREADPOOL
-      tp->map_function = map_function;
-      threadpool_log(tp, 0, N, tic_total, getticks());
+  ticks tic_total = getticks();
 #endif
-    } else {
 
-      /* N > INT_MAX, we need to do this in chunks as map_function only takes
-       * an int. */
-      size_t chunk_size = INT_MAX;
-      size_t data_size = N;
-      size_t data_count = 0;
-      while (1) {
-
-/* Call the mapper function. */
-#ifdef SWIFT_DEBUG_THREADPOOL
-        ticks tic = getticks();
-#endif
-        map_function((char *)map_data + (stride * data_count), chunk_size,
-                     extra_data);
-#ifdef SWIFT_DEBUG_THREADPOOL
-        threadpool_log(tp, 0, chunk_size, tic, getticks());
-#endif
-        /* Get the next chunk and check its size. */
-        data_count += chunk_size;
-        if (data_count >= data_size) break;
-        if (data_count + chunk_size > data_size)
-          chunk_size = data_size - data_count;
-      }
+  /* Count the jobs with something to do. */
+  int nr_active = 0;
+  size_t N_total = 0;
+  const struct threadpool_map_job *last = NULL;
+  for (int k = 0; k < nr_jobs; k++) {
+    if (jobs[k].N > 0) {
+      nr_active++;
+      N_total += jobs[k].N;
+      last = &jobs[k];
     }
+  }
+  if (nr_active == 0) return;
 
+  /* If we just have a single thread, or a single chunk of work, call the
+   * map functions directly. */
+  const int single_chunk =
+      nr_active == 1 &&
+      (last->N == 1 || (last->chunk > 0 && last->N <= (size_t)last->chunk));
+  if (tp->num_threads == 1 || single_chunk) {
+
+    for (int k = 0; k < nr_jobs; k++)
+      if (jobs[k].N > 0) threadpool_run_inline(tp, &jobs[k]);
     return;
   }
 
-  /* Set the map data and signal the threads. */
-  tp->map_data_stride = stride;
-  tp->map_data_size = N;
-  tp->map_data_count = 0;
-  if (chunk == threadpool_auto_chunk_size) {
-    tp->map_data_chunk =
-        max((N / (tp->num_threads * threadpool_default_chunk_ratio)), 1U);
-  } else if (chunk == threadpool_uniform_chunk_size) {
-    tp->map_data_chunk = threadpool_uniform_chunk_size;
-  } else {
-    tp->map_data_chunk = chunk;
+  /* Set the chunking of each job. */
+  for (int k = 0; k < nr_jobs; k++) {
+    struct threadpool_map_job *job = &jobs[k];
+    job->map_data_count = 0;
+    if (job->chunk == threadpool_auto_chunk_size) {
+      job->map_data_chunk =
+          max((job->N / (tp->num_threads * threadpool_default_chunk_ratio)),
+              1U);
+    } else if (job->chunk == threadpool_uniform_chunk_size) {
+      job->map_data_chunk = threadpool_uniform_chunk_size;
+    } else {
+      job->map_data_chunk = job->chunk;
+    }
   }
-  tp->map_function = map_function;
-  tp->map_data = map_data;
-  tp->map_extra_data = extra_data;
+
+  /* Set the jobs and signal the threads. */
+  tp->jobs = jobs;
+  tp->nr_jobs = nr_jobs;
   tp->num_threads_running = 0;
 
   /* Wait for all the threads to be up and running. */
@@ -377,7 +452,9 @@ void threadpool_map(struct threadpool *tp, threadpool_map_function map_function,
 
 #ifdef SWIFT_DEBUG_THREADPOOL
   /* Log the total call time to thread id -1. */
-  threadpool_log(tp, -1, N, tic_total, getticks());
+  threadpool_log(tp, -1, N_total, last->map_function, tic_total, getticks());
+#else
+  (void)N_total;
 #endif
 }
 
@@ -396,10 +473,10 @@ void threadpool_reset_log(struct threadpool *tp) {
 void threadpool_clean(struct threadpool *tp) {
 
   if (tp->num_threads > 1) {
-    /* Destroy the runner threads by calling them with a NULL mapper function
+    /* Destroy the runner threads by calling them with a NULL list of jobs
      * and waiting for all the threads to terminate. This ensures that no
      * thread is still waiting at a barrier. */
-    tp->map_function = NULL;
+    tp->jobs = NULL;
     swift_barrier_wait(&tp->run_barrier);
     for (int k = 0; k < tp->num_threads - 1; k++) {
       void *retval;
@@ -40,6 +40,33 @@
 typedef void (*threadpool_map_function)(void *map_data, int num_elements,
                                         void *extra_data);
 
+/**
+ * @brief A job of a #threadpool_map_batch call, i.e. the arguments of one
+ * #threadpool_map call.
+ */
+struct threadpool_map_job {
+
+  /*! The function to apply to the data. */
+  threadpool_map_function map_function;
+
+  /*! The data, its number of elements and their size in bytes. */
+  void *map_data;
+  size_t N;
+  int stride;
+
+  /*! Chunk size, or #threadpool_auto_chunk_size, or
+   * #threadpool_uniform_chunk_size. */
+  int chunk;
+
+  /*! Additional data passed to the function. */
+  void *extra_data;
+
+  /*! Number of elements already handed out and actual chunk size (set by
+   * the threadpool). */
+  volatile size_t map_data_count;
+  ptrdiff_t map_data_chunk;
+};
+
 /* Data for threadpool logging. */
 struct mapper_log_entry {
 
@@ -77,11 +104,9 @@ struct threadpool {
   swift_barrier_t wait_barrier;
   swift_barrier_t run_barrier;
 
-  /* Current map data and count. */
-  void *map_data, *map_extra_data;
-  volatile size_t map_data_count, map_data_size, map_data_stride;
-  volatile ptrdiff_t map_data_chunk;
-  volatile threadpool_map_function map_function;
+  /* Current jobs (NULL tells the threads to exit). */
+  struct threadpool_map_job *volatile jobs;
+  volatile int nr_jobs;
 
   /* Number of threads in this pool. */
   int num_threads;
@@ -99,6 +124,8 @@ void threadpool_init(struct threadpool *tp, int num_threads);
 void threadpool_map(struct threadpool *tp, threadpool_map_function map_function,
                     void *map_data, size_t N, int stride, int chunk,
                     void *extra_data);
+void threadpool_map_batch(struct threadpool *tp,
+                          struct threadpool_map_job *jobs, int nr_jobs);
 int threadpool_gettid(void);
 void threadpool_clean(struct threadpool *tp);
 #ifdef HAVE_SETAFFINITY
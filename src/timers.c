@@ -105,6 +105,7 @@ const char* timers_names[timer_count] = {
     "dopair_subset",
     "dopair_subset_naive",
     "dosub_subset",
+    "dosubset_ngb_list",
     "do_ghost",
     "do_extra_ghost",
     "do_stars_ghost",
@@ -143,7 +144,6 @@ const char* timers_names[timer_count] = {
     "rt_advance_cell_time",
     "rt_collect_times",
     "do_sync",
-    "neutrino_weighting",
 };
 
 /* File to store the timers */
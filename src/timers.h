@@ -105,6 +105,7 @@ enum {
   timer_dopair_subset,
   timer_dopair_subset_naive,
   timer_dosub_subset,
+  timer_dosubset_ngb_list,
   timer_do_ghost,
   timer_do_extra_ghost,
   timer_do_stars_ghost,
@@ -143,7 +144,6 @@ enum {
   timer_do_rt_advance_cell_time,
   timer_do_rt_collect_times,
   timer_do_sync,
-  timer_neutrino_weighting,
   timer_count,
 };
 
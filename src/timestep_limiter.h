@@ -36,6 +36,7 @@ timestep_limiter_prepare_force(struct part *restrict p,
                                struct xpart *restrict xp) {
 
   p->limiter_data.min_ngb_time_bin = num_time_bins + 1;
+  p->limiter_data.max_ngb_time_bin = 0;
 }
 
 /**
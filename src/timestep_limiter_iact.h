@@ -44,6 +44,12 @@ __attribute__((always_inline)) INLINE static void runner_iact_timebin(
   if (pi->time_bin > 0)
     pj->limiter_data.min_ngb_time_bin =
         min(pj->limiter_data.min_ngb_time_bin, pi->time_bin);
+
+  /* Update the maximal time-bin */
+  pi->limiter_data.max_ngb_time_bin =
+      max(pi->limiter_data.max_ngb_time_bin, pj->time_bin);
+  pj->limiter_data.max_ngb_time_bin =
+      max(pj->limiter_data.max_ngb_time_bin, pi->time_bin);
 }
 
 /**
@@ -67,6 +73,39 @@ __attribute__((always_inline)) INLINE static void runner_iact_nonsym_timebin(
   if (pj->time_bin > 0)
     pi->limiter_data.min_ngb_time_bin =
         min(pi->limiter_data.min_ngb_time_bin, pj->time_bin);
+
+  /* Update the maximal time-bin */
+  pi->limiter_data.max_ngb_time_bin =
+      max(pi->limiter_data.max_ngb_time_bin, pj->time_bin);
+}
+
+/**
+ * @brief Can a #part starting a new time-step wake up any of its neighbours
+ * in the limiter loop?
+ *
+ * The force loop recorded the largest time-bin of the neighbours. The
+ * inactive ones still have it and the active ones moved up by at most one
+ * bin in the time-step task. If that is within
+ * time_bin_neighbour_max_delta_bin of the new bin of the #part, none of the
+ * runner_iact_nonsym_limiter() calls it would make can wake anything up.
+ *
+ * Only particles from this node went through our force loop.
+ *
+ * @param p The #part.
+ * @param local Is the #part on this node?
+ */
+__attribute__((always_inline)) INLINE static int timestep_limiter_can_wake(
+    const struct part *restrict p, const int local) {
+
+#ifdef SWIFT_HYDRO_DENSITY_CHECKS
+  /* We need to count all the neighbours */
+  return 1;
+#else
+  if (!local) return 1;
+
+  return p->limiter_data.max_ngb_time_bin + 1 >
+         p->time_bin + time_bin_neighbour_max_delta_bin;
+#endif
 }
 
 /**
@@ -41,6 +41,9 @@ struct timestep_limiter_data {
   /*! Minimal time-bin across all neighbours */
   timebin_t min_ngb_time_bin;
 
+  /*! Maximal time-bin across all neighbours */
+  timebin_t max_ngb_time_bin;
+
   /* Do we want this particle to be synched back on the time-line? */
   char to_be_synchronized;
 
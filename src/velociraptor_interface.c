@@ -35,6 +35,8 @@
 #include "black_holes_io.h"
 #include "common_io.h"
 #include "cooling.h"
+#include "cuda_fof.h"
+#include "cuda_pm_mesh.h"
 #include "engine.h"
 #include "gravity_io.h"
 #include "hydro.h"
@@ -975,6 +977,12 @@ void velociraptor_invoke(struct engine *e, const int linked_with_snap) {
 
   tic = getticks();
 
+  /* The page-locked copies of the gparts used by the GPU mesh and FOF are
+   * re-made at their next use, so give their memory back before making the
+   * array for VELOCIraptor. */
+  cuda_pm_mesh_clean();
+  cuda_fof_clean();
+
   /* Allocate and populate an array of swift_vel_parts to be passed to
    * VELOCIraptor. */
   struct swift_vel_part *swift_parts = NULL;
@@ -1021,9 +1029,11 @@ void velociraptor_invoke(struct engine *e, const int linked_with_snap) {
   int *most_bound_index = return_data.most_bound_index;
 
   /* Report that the memory was freed */
-  memuse_log_allocation("VR.cell_loc", sim_info.cell_loc, 0, 0);
-  memuse_log_allocation("VR.cell_nodeID", cell_node_ids, 0, 0);
-  memuse_log_allocation("VR.parts", swift_parts, 0, 0);
+  memuse_log_allocation("VR.cell_loc", sim_info.cell_loc, 0, 0,
+                        memuse_policy_none);
+  memuse_log_allocation("VR.cell_nodeID", cell_node_ids, 0, 0,
+                        memuse_policy_none);
+  memuse_log_allocation("VR.parts", swift_parts, 0, 0, memuse_policy_none);
 
   /* Check that the ouput is valid */
   if (linked_with_snap && group_info == NULL && num_gparts_in_groups < 0) {
@@ -33,6 +33,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 /* MPI headers. */
@@ -75,6 +76,139 @@ static int handle_cmdparam(struct argparse *self,
   return 1;
 }
 
+/*! Maximal number of phases in the startup timeline. */
+#define startup_max_phases 16
+
+/**
+ * @brief How long each phase of the startup took, from the parameters being
+ * read to the first step.
+ */
+struct startup_timeline {
+
+  /*! The names of the phases. */
+  const char *names[startup_max_phases];
+
+  /*! Their durations. */
+  double times[startup_max_phases];
+
+  /*! Number of phases so far. */
+  int count;
+
+  /*! The end of the last phase. */
+  struct clocks_time tic;
+};
+
+/**
+ * @brief Record the end of a phase of the startup.
+ *
+ * @param t The #startup_timeline.
+ * @param name The name of the phase.
+ */
+static void startup_timeline_mark(struct startup_timeline *t,
+                                  const char *name) {
+
+  struct clocks_time toc;
+  clocks_gettime(&toc);
+  if (t->count < startup_max_phases) {
+    t->names[t->count] = name;
+    t->times[t->count] = clocks_diff(&t->tic, &toc);
+    t->count++;
+  }
+  t->tic = toc;
+}
+
+/**
+ * @brief Print the startup timeline, with the time of the slowest rank for
+ * each phase. Collective over all the ranks.
+ *
+ * @param t The #startup_timeline.
+ * @param myrank The rank of this node.
+ */
+static void startup_timeline_report(const struct startup_timeline *t,
+                                    const int myrank) {
+
+  double slowest[startup_max_phases];
+#ifdef WITH_MPI
+  MPI_Reduce(t->times, slowest, t->count, MPI_DOUBLE, MPI_MAX, 0,
+             MPI_COMM_WORLD);
+#else
+  memcpy(slowest, t->times, t->count * sizeof(double));
+#endif
+  if (myrank != 0) return;
+
+  double total = 0.;
+  message("Startup timeline (slowest rank):");
+  for (int k = 0; k < t->count; k++) {
+    total += slowest[k];
+    message("  %-24s %12.3f %s", t->names[k], slowest[k], clocks_getunit());
+  }
+  message("  %-24s %12.3f %s", "total", total, clocks_getunit());
+  fflush(stdout);
+}
+
+/**
+ * @brief Fork the members of an ensemble of independent simulations.
+ *
+ * Each member is a child process running in its own directory,
+ * ensemble_XXX, with its output going to swift.log there. This process
+ * waits for all of them and exits, with an error if any of them failed.
+ *
+ * @param nr_members The number of members.
+ * @return The index of the member, in the child processes only.
+ */
+static int ensemble_fork(const int nr_members) {
+
+  /* Check all the directories first, rather than fail half way through. */
+  char dir[32];
+  for (int k = 0; k < nr_members; k++) {
+    sprintf(dir, "ensemble_%03d", k);
+    if (access(dir, R_OK | W_OK | X_OK) != 0)
+      error("Cannot use the directory of ensemble member %d: %s (%s)", k, dir,
+            strerror(errno));
+  }
+
+  pid_t *pids = (pid_t *)malloc(nr_members * sizeof(pid_t));
+  if (pids == NULL) error("Failed to allocate the ensemble process ids.");
+
+  fflush(stdout);
+  fflush(stderr);
+  for (int k = 0; k < nr_members; k++) {
+    const pid_t pid = fork();
+    if (pid < 0)
+      error("Failed to fork ensemble member %d (%s)", k, strerror(errno));
+
+    /* The member carries on with the rest of main(). */
+    if (pid == 0) {
+      free(pids);
+      sprintf(dir, "ensemble_%03d", k);
+      if (chdir(dir) != 0)
+        error("Failed to move to %s (%s)", dir, strerror(errno));
+      if (freopen("swift.log", "w", stdout) == NULL ||
+          dup2(fileno(stdout), fileno(stderr)) < 0)
+        error("Failed to redirect the output of ensemble member %d", k);
+      return k;
+    }
+    pids[k] = pid;
+  }
+  pretime_message("Started %d ensemble members.", nr_members);
+
+  int nr_failed = 0;
+  for (int k = 0; k < nr_members; k++) {
+    int status = 0;
+    if (waitpid(pids[k], &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+      pretime_message("Ensemble member %d failed, see ensemble_%03d/swift.log",
+                      k, k);
+      nr_failed++;
+    }
+  }
+  free(pids);
+
+  pretime_message("%d of %d ensemble members completed.",
+                  nr_members - nr_failed, nr_members);
+  exit(nr_failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
 /**
  * @brief Main routine that loads a few particles and generates some output.
  *
@@ -82,6 +216,7 @@ static int handle_cmdparam(struct argparse *self,
 int main(int argc, char *argv[]) {
 
   struct clocks_time tic, toc;
+  struct startup_timeline startup;
   struct engine e;
 
   /* Structs used by the engine. Declare now to make sure these are always in
@@ -202,13 +337,16 @@ int main(int argc, char *argv[]) {
   int with_line_of_sight = 0;
   int with_rt = 0;
   int with_power = 0;
+  int benchmark_scale = 1;
   int verbose = 0;
   int nr_threads = 1;
   int nr_pool_threads = -1;
+  int nr_ensemble = 1;
   int with_verbose_timers = 0;
   char *output_parameters_filename = NULL;
   char *cpufreqarg = NULL;
   char *param_filename = NULL;
+  char *benchmark_name = NULL;
   char restart_file[200] = "";
   unsigned long long cpufreq = 0;
   float dump_tasks_threshold = 0.f;
@@ -300,6 +438,16 @@ int main(int argc, char *argv[]) {
           "equivalent to --hydro --limiter --sync --self-gravity --stars "
           "--star-formation --cooling --feedback.",
           NULL, 0, 0),
+      OPT_STRING(0, "benchmark", &benchmark_name,
+                 "Run one of the built-in benchmarks (cosmo-dmo, hydro-box) on "
+                 "ICs generated in memory, with built-in parameters that -P "
+                 "can change. No parameter file is needed. Runs 32 steps "
+                 "unless --steps is given.",
+                 NULL, 0, 0),
+      OPT_INTEGER(0, "scale", &benchmark_scale,
+                  "Size of the benchmark ICs: 64 x scale particles a side in "
+                  "a box scale times larger (default 1).",
+                  NULL, 0, 0),
 
       OPT_GROUP("  Control options:\n"),
       OPT_BOOLEAN('a', "pin", &with_aff,
@@ -346,6 +494,11 @@ int main(int argc, char *argv[]) {
                   "threadpool operations. "
                   "Defaults to the numbers of task threads if not specified.",
                   NULL, 0, 0),
+      OPT_INTEGER(0, "ensemble", &nr_ensemble,
+                  "Run this many independent simulations side by side, each "
+                  "in its directory ensemble_XXX with its own copy of the "
+                  "parameter file. The threads are shared between them.",
+                  NULL, 0, 0),
       OPT_INTEGER('T', "timers", &with_verbose_timers,
                   "Print timers every time-step.", NULL, 0, 0),
       OPT_INTEGER('v', "verbose", &verbose,
@@ -374,6 +527,18 @@ int main(int argc, char *argv[]) {
   int nargs = argparse_parse(&argparse, argc, (const char **)argv);
 
   /* Deal with meta options */
+  struct benchmark bench;
+  bzero(&bench, sizeof(struct benchmark));
+  if (benchmark_name != NULL) {
+    benchmark_init(&bench, benchmark_get_type(benchmark_name),
+                   benchmark_scale);
+    if (bench.type == benchmark_cosmo_dmo) {
+      with_cosmology = 1;
+      with_self_gravity = 1;
+    }
+    if (bench.type == benchmark_hydro_box) with_hydro = 1;
+    if (nsteps == -2) nsteps = benchmark_default_steps;
+  }
   if (with_qla) {
     with_hydro = 1;
     with_self_gravity = 1;
@@ -432,13 +597,37 @@ int main(int argc, char *argv[]) {
     return 0;
   }
 
-  /* Need a parameter file. */
-  if (nargs != 1) {
+  /* Need a parameter file, unless the benchmark brings its own. */
+  if (bench.type != benchmark_none) {
+    if (nargs != 0 || restart) {
+      if (myrank == 0) argparse_usage(&argparse);
+      pretime_message(
+          "\nError: a benchmark takes neither a parameter file nor restarts, "
+          "use -P to change its parameters.");
+      return 1;
+    }
+  } else if (nargs != 1) {
     if (myrank == 0) argparse_usage(&argparse);
     pretime_message("\nError: no parameter file was supplied.");
     return 1;
+  } else {
+    param_filename = argv[0];
+  }
+
+  /* Run several independent simulations? Each carries on from here in its
+   * own process and directory. */
+  if (nr_ensemble > 1) {
+#ifdef WITH_MPI
+    error("Ensembles can only be run by the non-MPI version of SWIFT.");
+#endif
+    if (bench.type != benchmark_none)
+      error("A benchmark cannot be run as an ensemble.");
+    if (with_aff)
+      error("The threads of the ensemble members cannot be pinned.");
+    nr_threads = max(nr_threads / nr_ensemble, 1);
+    nr_pool_threads = max(nr_pool_threads / nr_ensemble, 1);
+    ensemble_fork(nr_ensemble);
   }
-  param_filename = argv[0];
 
   /* Checks of options. */
 #if !defined(HAVE_SETAFFINITY) || !defined(HAVE_LIBNUMA)
@@ -802,8 +991,15 @@ int main(int argc, char *argv[]) {
   struct swift_params *refparams = NULL;
   if (params == NULL) error("Error allocating memory for the parameter file.");
   if (myrank == 0) {
-    message("Reading runtime parameters from file '%s'", param_filename);
-    parser_read_file(param_filename, params);
+    if (bench.type != benchmark_none) {
+      message("Using the parameters of the '%s' benchmark",
+              benchmark_names[bench.type]);
+      parser_init(benchmark_names[bench.type], params);
+      benchmark_set_params(&bench, params);
+    } else {
+      message("Reading runtime parameters from file '%s'", param_filename);
+      parser_read_file(param_filename, params);
+    }
 
     /* Handle any command-line overrides. */
     if (cmdps.nparam > 0) {
@@ -820,6 +1016,19 @@ int main(int argc, char *argv[]) {
   MPI_Bcast(params, sizeof(struct swift_params), MPI_BYTE, 0, MPI_COMM_WORLD);
 #endif
 
+  /* Placement policy of the large particle and cell arrays. */
+  memuse_policy_init(params);
+
+  /* Count the memory of the phases and labels, if asked for. */
+  memuse_phases_init(params, myrank, restart);
+
+  /* Share the large read-only tables between the ranks of a node? */
+  memuse_shared_init(params);
+
+  /* The startup is timed from here */
+  bzero(&startup, sizeof(struct startup_timeline));
+  clocks_gettime(&startup.tic);
+
   /* Read the provided output selection file, if available. Best to
    * do this after broadcasting the parameters as there may be code in this
    * function that is repeated on each node based on the parameter file. */
@@ -985,8 +1194,10 @@ int main(int argc, char *argv[]) {
     restart_locate_free(1, restart_files);
 #endif
 
-    /* Now read it. */
+    /* Now read it, mapping the particle arrays if requested. */
+    restart_mmap = parser_get_opt_param_int(params, "Restarts:mmap_read", 0);
     restart_read(&e, restart_file);
+    startup_timeline_mark(&startup, "restart files");
 
 #ifdef WITH_MPI
     integertime_t min_ti_current = e.ti_current;
@@ -1021,6 +1232,7 @@ int main(int argc, char *argv[]) {
     engine_config(/*restart=*/1, /*fof=*/0, &e, params, nr_nodes, myrank,
                   nr_threads, nr_pool_threads, with_aff, talking, restart_dir,
                   restart_file, &reparttype);
+    startup_timeline_mark(&startup, "engine_config");
 
     /* Check if we are already done when given steps on the command-line. */
     if (e.step >= nsteps && nsteps > 0)
@@ -1055,9 +1267,17 @@ int main(int argc, char *argv[]) {
       phys_const_print(&prog_const);
     }
 
-    /* Read particles and space information from ICs */
+    /* Read particles and space information from ICs, unless they are
+     * generated */
+    struct lpt_ics lpt;
+    lpt_ics_init(&lpt, params, nr_threads);
     char ICfileName[200] = "";
-    parser_get_param_string(params, "InitialConditions:file_name", ICfileName);
+    if (lpt.enabled)
+      parser_get_opt_param_string(params, "InitialConditions:file_name",
+                                  ICfileName, "none");
+    else
+      parser_get_param_string(params, "InitialConditions:file_name",
+                              ICfileName);
     const int periodic =
         parser_get_param_int(params, "InitialConditions:periodic");
     const int replicate =
@@ -1072,6 +1292,13 @@ int main(int argc, char *argv[]) {
         params, "InitialConditions:generate_gas_in_ics", 0);
     const int remap_ids =
         parser_get_opt_param_int(params, "InitialConditions:remap_ids", 0);
+#if defined(HAVE_HDF5)
+    io_read_buffer_size =
+        parser_get_opt_param_float(params,
+                                   "InitialConditions:read_buffer_size_MB",
+                                   0.f) *
+        1024 * 1024;
+#endif
 
     /* Initialise the cosmology */
     if (with_cosmology)
@@ -1233,7 +1460,14 @@ int main(int argc, char *argv[]) {
     }
 
     /* Be verbose about what happens next */
-    if (myrank == 0) message("Reading ICs from file '%s'", ICfileName);
+    if (myrank == 0 && bench.type != benchmark_none)
+      message("Generating the ICs of the '%s' benchmark",
+              benchmark_names[bench.type]);
+    else if (myrank == 0 && lpt.enabled)
+      message("Generating the ICs from the power spectrum '%s'",
+              lpt.power_spectrum_file_name);
+    else if (myrank == 0)
+      message("Reading ICs from file '%s'", ICfileName);
     if (myrank == 0 && cleanup_h)
       message("Cleaning up h-factors (h=%f)", cosmo.h);
     if (myrank == 0 && cleanup_sqrt_a)
@@ -1248,35 +1482,50 @@ int main(int argc, char *argv[]) {
     /* Prepare struct to store metadata from ICs */
     ic_info_init(&ics_metadata, params);
 
+    startup_timeline_mark(&startup, "properties and tables");
     if (myrank == 0) clocks_gettime(&tic);
+    if (bench.type != benchmark_none) {
+      benchmark_generate_ics(&bench, &cosmo, &hydro_properties, dim, &parts,
+                             &gparts, &Ngas, &Ngpart, myrank, nr_nodes);
+    } else if (lpt.enabled) {
+      if (!with_cosmology || !periodic)
+        error("The LPT ICs need a periodic cosmological run.");
+      if (with_hydro && !generate_gas_in_ics)
+        error("The LPT ICs only contain dark matter, need to generate the gas "
+              "to run with hydro.");
+      lpt_ics_generate(&lpt, &cosmo, dim, &gparts, &Ngpart, myrank, nr_nodes);
+      lpt_ics_clean(&lpt);
+    } else {
 #if defined(HAVE_HDF5)
 #if defined(WITH_MPI)
 #if defined(HAVE_PARALLEL_HDF5)
-    read_ic_parallel(ICfileName, &us, dim, &parts, &gparts, &sinks, &sparts,
+      read_ic_parallel(ICfileName, &us, dim, &parts, &gparts, &sinks,
+                       &sparts, &bparts, &Ngas, &Ngpart, &Ngpart_background,
+                       &Nnupart, &Nsink, &Nspart, &Nbpart, &flag_entropy_ICs,
+                       with_hydro, with_gravity, with_sinks, with_stars,
+                       with_black_holes, with_cosmology, cleanup_h,
+                       cleanup_sqrt_a, cosmo.h, cosmo.a, myrank, nr_nodes,
+                       MPI_COMM_WORLD, MPI_INFO_NULL, nr_threads, dry_run,
+                       remap_ids, &ics_metadata);
+#else
+      read_ic_serial(ICfileName, &us, dim, &parts, &gparts, &sinks, &sparts,
                      &bparts, &Ngas, &Ngpart, &Ngpart_background, &Nnupart,
                      &Nsink, &Nspart, &Nbpart, &flag_entropy_ICs, with_hydro,
                      with_gravity, with_sinks, with_stars, with_black_holes,
                      with_cosmology, cleanup_h, cleanup_sqrt_a, cosmo.h,
                      cosmo.a, myrank, nr_nodes, MPI_COMM_WORLD, MPI_INFO_NULL,
                      nr_threads, dry_run, remap_ids, &ics_metadata);
-#else
-    read_ic_serial(ICfileName, &us, dim, &parts, &gparts, &sinks, &sparts,
-                   &bparts, &Ngas, &Ngpart, &Ngpart_background, &Nnupart,
-                   &Nsink, &Nspart, &Nbpart, &flag_entropy_ICs, with_hydro,
-                   with_gravity, with_sinks, with_stars, with_black_holes,
-                   with_cosmology, cleanup_h, cleanup_sqrt_a, cosmo.h, cosmo.a,
-                   myrank, nr_nodes, MPI_COMM_WORLD, MPI_INFO_NULL, nr_threads,
-                   dry_run, remap_ids, &ics_metadata);
 #endif
 #else
-    read_ic_single(ICfileName, &us, dim, &parts, &gparts, &sinks, &sparts,
-                   &bparts, &Ngas, &Ngpart, &Ngpart_background, &Nnupart,
-                   &Nsink, &Nspart, &Nbpart, &flag_entropy_ICs, with_hydro,
-                   with_gravity, with_sinks, with_stars, with_black_holes,
-                   with_cosmology, cleanup_h, cleanup_sqrt_a, cosmo.h, cosmo.a,
-                   nr_threads, dry_run, remap_ids, &ics_metadata);
+      read_ic_single(ICfileName, &us, dim, &parts, &gparts, &sinks, &sparts,
+                     &bparts, &Ngas, &Ngpart, &Ngpart_background, &Nnupart,
+                     &Nsink, &Nspart, &Nbpart, &flag_entropy_ICs, with_hydro,
+                     with_gravity, with_sinks, with_stars, with_black_holes,
+                     with_cosmology, cleanup_h, cleanup_sqrt_a, cosmo.h,
+                     cosmo.a, nr_threads, dry_run, remap_ids, &ics_metadata);
 #endif
 #endif
+    }
 
     if (myrank == 0) {
       clocks_gettime(&toc);
@@ -1284,6 +1533,7 @@ int main(int argc, char *argv[]) {
               clocks_diff(&tic, &toc), clocks_getunit());
       fflush(stdout);
     }
+    startup_timeline_mark(&startup, "initial conditions");
 
     /* Some checks that we are not doing something stupid */
     if (generate_gas_in_ics && flag_entropy_ICs)
@@ -1387,7 +1637,7 @@ int main(int argc, char *argv[]) {
                periodic, replicate, remap_ids, generate_gas_in_ics, with_hydro,
                with_self_gravity, with_star_formation, with_sinks,
                with_DM_particles, with_DM_background_particles, with_neutrinos,
-               talking, dry_run, nr_nodes);
+               talking, dry_run, nr_nodes, nr_threads);
 
     /* Initialise the line of sight properties. */
     if (with_line_of_sight) los_init(s.dim, &los_properties, params);
@@ -1408,6 +1658,7 @@ int main(int argc, char *argv[]) {
               clocks_getunit());
       fflush(stdout);
     }
+    startup_timeline_mark(&startup, "space_init");
 
     /* Initialise the gravity properties */
     bzero(&gravity_properties, sizeof(struct gravity_props));
@@ -1562,9 +1813,11 @@ int main(int argc, char *argv[]) {
                 &mesh, &pow_data, &potential, &forcing_terms, &cooling_func,
                 &starform, &chemistry, &extra_io_props, &fof_properties,
                 &los_properties, &lightcone_array_properties, &ics_metadata);
+    startup_timeline_mark(&startup, "engine_init");
     engine_config(/*restart=*/0, /*fof=*/0, &e, params, nr_nodes, myrank,
                   nr_threads, nr_pool_threads, with_aff, talking, restart_dir,
                   restart_file, &reparttype);
+    startup_timeline_mark(&startup, "engine_config");
 
     /* Compute some stats for the star formation */
     if (with_star_formation) {
@@ -1614,10 +1867,12 @@ int main(int argc, char *argv[]) {
 #ifdef WITH_MPI
     /* Split the space. */
     engine_split(&e, &initial_partition);
+    startup_timeline_mark(&startup, "engine_split");
 #endif
 
     /* Initialise the particles */
     engine_init_particles(&e, flag_entropy_ICs, clean_smoothing_length_values);
+    startup_timeline_mark(&startup, "engine_init_particles");
 
     /* Check that the matter content matches the cosmology given in the
      * parameter file. */
@@ -1658,8 +1913,12 @@ int main(int argc, char *argv[]) {
 
     /* Is there a dump before the end of the first time-step? */
     engine_io(&e);
+    startup_timeline_mark(&startup, "initial outputs");
   }
 
+  /* How long it took to get here */
+  startup_timeline_report(&startup, myrank);
+
   /* Legend */
   if (myrank == 0) {
     printf(
@@ -1674,6 +1933,7 @@ int main(int argc, char *argv[]) {
 
   /* File for the timers */
   if (with_verbose_timers) timers_open_file(myrank);
+  if (with_verbose_timers) task_counters_open_file(myrank);
 
   /* Create a name for restart file of this rank. */
   if (restart_genname(restart_dir, restart_name, e.nodeID, restart_file, 200) !=
@@ -1727,6 +1987,8 @@ int main(int argc, char *argv[]) {
   }
 #endif
 
+  if (bench.type != benchmark_none) benchmark_print_header(&bench, &e);
+
   /* Main simulation loop */
   /* ==================== */
   int force_stop = 0;
@@ -1735,12 +1997,18 @@ int main(int argc, char *argv[]) {
 
     /* Reset timers */
     timers_reset_all();
+    task_counters_reset_all(e.runners, e.nr_threads);
 
     /* Take a step. */
     force_stop = engine_step(&e);
 
     /* Print the timers. */
     if (with_verbose_timers) timers_print(e.step);
+    if (with_verbose_timers)
+      task_counters_print(e.runners, e.nr_threads, e.step);
+
+    /* Report the times of the step to the benchmark. */
+    if (bench.type != benchmark_none) benchmark_step(&bench, &e);
 
     /* Shall we write some check-point files?
      * Note that this was already done by engine_step() if force_stop is set */
@@ -1810,6 +2078,8 @@ int main(int argc, char *argv[]) {
 #endif
   }
 
+  if (bench.type != benchmark_none) benchmark_print_summary(&bench, &e);
+
   /* Write final time information */
   if (myrank == 0) {
 
@@ -1920,6 +2190,10 @@ int main(int argc, char *argv[]) {
 #endif
   }
 
+  /* Make sure the last snapshot and restart files are on disk. */
+  engine_dump_snapshot_wait(&e);
+  restart_drain_wait();
+
   /* Remove the stop file if used. Do this anyway, we could have missed the
    * stop file if normal exit happened first. */
   if (myrank == 0) force_stop = restart_stop_now(restart_dir, 1);
@@ -1935,6 +2209,7 @@ int main(int argc, char *argv[]) {
 
   /* Clean everything */
   if (with_verbose_timers) timers_close_file();
+  if (with_verbose_timers) task_counters_close_file();
   if (with_cosmology) cosmology_clean(e.cosmology);
   if (e.neutrino_properties->use_linear_response)
     neutrino_response_clean(e.neutrino_response);
@@ -1947,6 +2222,7 @@ int main(int argc, char *argv[]) {
   if (with_power) power_clean(e.power_data);
   extra_io_clean(e.io_extra_props);
   engine_clean(&e, /*fof=*/0, restart);
+  memuse_shared_clean();
   free(params);
   if (restart) free(refparams);
   free(output_options);
@@ -573,7 +573,7 @@ int main(int argc, char *argv[]) {
              /*generate_gas_in_ics=*/0, /*hydro=*/N_total[0] > 0, /*gravity=*/1,
              /*with_star_formation=*/0, /*sink=*/N_total[swift_type_sink],
              with_DM_particles, with_DM_background_particles, with_neutrinos,
-             talking, /*dry_run=*/0, nr_nodes);
+             talking, /*dry_run=*/0, nr_nodes, nr_threads);
 
   if (myrank == 0) {
     clocks_gettime(&toc);
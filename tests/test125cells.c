@@ -594,6 +594,7 @@ int main(int argc, char *argv[]) {
   engine.sink_properties = &sink_props;
 
   struct runner runner;
+  bzero(&runner, sizeof(struct runner));
   runner.e = &engine;
 
   struct lightcone_array_props lightcone_array_properties;
@@ -0,0 +1,238 @@
+#include <config.h>
+
+/* Some standard headers. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Local headers. */
+#include "cuda_devices.h"
+#include "cuda_gravity_cache.h"
+#include "cuda_precision.h"
+#include "cuda_streams.h"
+#include "runner_doiact_grav.h"
+#include "swift.h"
+
+/* Range of the leaf sizes to sweep (doubling every time) */
+#define min_leaf_size 32
+#define max_leaf_size 4096
+#define num_leaf_sizes 8
+
+/* Nominal cost of one interaction in flops, for the GFLOP/s figures: the
+ * usual 20 of a softened Newtonian interaction and another 10 for the
+ * truncation of the potential. */
+#define flops_full 20.
+#define flops_truncated 30.
+
+/**
+ * @brief The P2P cases we time.
+ */
+struct pp_case {
+  const char *name;
+  int periodic;
+  int truncated;
+};
+
+static const struct pp_case pp_cases[3] = {{"non-periodic", 0, 0},
+                                           {"periodic-full", 1, 0},
+                                           {"periodic-truncated", 1, 1}};
+
+/**
+ * @brief The timings of one side (CPU or GPU) for one pair size.
+ */
+struct pp_timing {
+  double seconds;
+  size_t h2d_bytes;
+  size_t d2h_bytes;
+};
+
+/**
+ * @brief Write the timing of one side of a pair as a JSON object.
+ */
+static void write_timing(FILE *file, const char *name,
+                         const struct pp_timing *t, const double interactions,
+                         const double flops) {
+
+  fprintf(file,
+          "\"%s\": {\"seconds\": %e, \"interactions_per_second\": %e, "
+          "\"gflops\": %e, \"h2d_bytes\": %zu, \"d2h_bytes\": %zu}",
+          name, t->seconds, interactions / t->seconds,
+          1e-9 * flops * interactions / t->seconds, t->h2d_bytes,
+          t->d2h_bytes);
+}
+
+int main(int argc, char *argv[]) {
+
+  /* Initialize CPU frequency, this also starts time. */
+  unsigned long long cpufreq = 0;
+  clocks_set_cpufreq(cpufreq);
+
+  /* Default options */
+  int repeats = 5;
+  int with_gpu = 1;
+  char precision[32] = "strict";
+  char output[200] = "gravity_pp_speed.json";
+
+  /* Get the command line options */
+  int c;
+  while ((c = getopt(argc, argv, "cn:o:p:h")) != -1) switch (c) {
+      case 'c':
+        with_gpu = 0;
+        break;
+      case 'n':
+        if (sscanf(optarg, "%d", &repeats) != 1 || repeats < 1)
+          error("Invalid number of repeats.");
+        break;
+      case 'o':
+        if (sscanf(optarg, "%199s", output) != 1)
+          error("Invalid output file name.");
+        break;
+      case 'p':
+        if (sscanf(optarg, "%31s", precision) != 1)
+          error("Invalid GPU precision.");
+        break;
+      case 'h':
+      case '?':
+        printf(
+            "Usage: %s [OPTIONS...]\n"
+            "\nTimes the P2P kernels of the CPU and GPU on pairs of leaves of"
+            "\n%d to %d particles and writes the results as JSON.\n"
+            "\nOptions:"
+            "\n-c        Only time the CPU kernels."
+            "\n-n NUM    Number of runs of each pair, the fastest is kept "
+            "(default: %d)."
+            "\n-o FILE   Output file, - for the standard output (default: %s)."
+            "\n-p MODE   Precision of the GPU kernels: strict, fma or mixed "
+            "(default: %s).\n",
+            argv[0], min_leaf_size, max_leaf_size, repeats, output, precision);
+        return c == 'h' ? 0 : 1;
+    }
+
+#if defined(SWIFT_DEBUG_CHECKS) || defined(SWIFT_GRAVITY_FORCE_CHECKS)
+  message("The P2P kernels cannot be timed with the debugging checks.");
+  return 0;
+#endif
+
+  /* Gravity properties */
+  struct gravity_props grav_props;
+  bzero(&grav_props, sizeof(struct gravity_props));
+  grav_props.G_Newton = 1.;
+  grav_props.mesh_size = 64;
+  grav_props.a_smooth = 1.25;
+
+  /* Mesh structure, the pairs are within a few r_s of each other */
+  struct pm_mesh mesh;
+  bzero(&mesh, sizeof(struct pm_mesh));
+  mesh.dim[0] = 100.;
+  mesh.dim[1] = 100.;
+  mesh.dim[2] = 100.;
+  mesh.r_s = grav_props.a_smooth * mesh.dim[0] / grav_props.mesh_size;
+  mesh.r_s_inv = 1. / mesh.r_s;
+
+  /* Construct an engine */
+  struct engine e;
+  bzero(&e, sizeof(struct engine));
+  e.mesh = &mesh;
+  e.gravity_properties = &grav_props;
+
+  /* Construct a runner */
+  struct runner r;
+  bzero(&r, sizeof(struct runner));
+  r.e = &e;
+
+  /* The GPU, through the stream of our only runner */
+  if (with_gpu) {
+    cuda_devices_init(/*requested=*/1, /*nr_runners=*/1);
+    if (engine_cuda_init_streams(1) != 1) error("Failed to create a stream.");
+    cuda_precision_init(precision);
+  }
+
+  const int to_stdout = strcmp(output, "-") == 0;
+  FILE *file = to_stdout ? stdout : fopen(output, "w");
+  if (file == NULL) error("Could not open '%s'.", output);
+
+  fprintf(file, "{\n  \"vec_size\": %d,\n  \"repeats\": %d,\n", VEC_SIZE,
+          repeats);
+  fprintf(file, "  \"gpu_precision\": ");
+  if (with_gpu)
+    fprintf(file, "\"%s\",\n", precision);
+  else
+    fprintf(file, "null,\n");
+  fprintf(file, "  \"cases\": [\n");
+
+  for (int k = 0; k < 3; ++k) {
+
+    const struct pp_case *pp = &pp_cases[k];
+    const double flops = pp->truncated ? flops_truncated : flops_full;
+
+    /* Smallest leaf size from which the GPU was faster */
+    int crossover = -1;
+
+    fprintf(file,
+            "    {\"name\": \"%s\", \"periodic\": %d, \"truncated\": %d, "
+            "\"flops_per_interaction\": %.0f,\n     \"sizes\": [\n",
+            pp->name, pp->periodic, pp->truncated, flops);
+
+    for (int n = 0, gcount = min_leaf_size; n < num_leaf_sizes;
+         ++n, gcount *= 2) {
+
+      /* Both cells act on each other */
+      const double interactions = 2. * (double)gcount * (double)gcount;
+
+      struct pp_timing cpu, gpu;
+      cpu.seconds = clocks_from_ticks(runner_dopair_grav_pp_benchmark(
+                        &r, gcount, pp->periodic, pp->truncated,
+                        /*on_gpu=*/0, repeats, &cpu.h2d_bytes,
+                        &cpu.d2h_bytes)) /
+                    1000.;
+      if (with_gpu) {
+        gpu.seconds = clocks_from_ticks(runner_dopair_grav_pp_benchmark(
+                          &r, gcount, pp->periodic, pp->truncated,
+                          /*on_gpu=*/1, repeats, &gpu.h2d_bytes,
+                          &gpu.d2h_bytes)) /
+                      1000.;
+        if (crossover < 0 && gpu.seconds < cpu.seconds) crossover = gcount;
+      }
+
+      fprintf(file, "       {\"gcount\": %d, ", gcount);
+      write_timing(file, "cpu", &cpu, interactions, flops);
+      if (with_gpu) {
+        fprintf(file, ", ");
+        write_timing(file, "gpu", &gpu, interactions, flops);
+      }
+      fprintf(file, "}%s\n", n < num_leaf_sizes - 1 ? "," : "");
+
+      /* Keep the standard output for the JSON if that's where it goes */
+      if (to_stdout) continue;
+      if (with_gpu)
+        message("%20s %5d gparts: CPU %.3e GPU %.3e interactions/s.",
+                pp->name, gcount, interactions / cpu.seconds,
+                interactions / gpu.seconds);
+      else
+        message("%20s %5d gparts: CPU %.3e interactions/s.", pp->name,
+                gcount, interactions / cpu.seconds);
+    }
+
+    fprintf(file, "     ],\n     \"crossover_gcount\": ");
+    if (crossover > 0)
+      fprintf(file, "%d", crossover);
+    else
+      fprintf(file, "null");
+    fprintf(file, "}%s\n", k < 2 ? "," : "");
+  }
+
+  fprintf(file, "  ]\n}\n");
+  if (!to_stdout) fclose(file);
+
+  /* Be clean... */
+  gravity_cache_clean(&r.ci_gravity_cache);
+  gravity_cache_clean(&r.cj_gravity_cache);
+  if (with_gpu) {
+    cuda_gravity_cache_clean(&r.ci_cuda_gravity_cache);
+    cuda_gravity_cache_clean(&r.cj_cuda_gravity_cache);
+    destroy_persistent_cuda_streams();
+  }
+
+  return 0;
+}
@@ -27,6 +27,8 @@
 #include "swift.h"
 
 #define NUM_KEYS (26 * 1000 * 1000)
+#define NUM_BULK_KEYS (1000 * 1000)
+#define BULK_CHUNK 4096
 
 int main(int argc, char *argv[]) {
 
@@ -77,4 +79,77 @@ int main(int argc, char *argv[]) {
 
   message("Freeing hash table...");
   hashmap_free(&m);
+
+  /* Now the bulk interface, with only the even keys present. */
+  hashmap_key_t *keys =
+      (hashmap_key_t *)malloc(BULK_CHUNK * sizeof(hashmap_key_t));
+  hashmap_value_t *values =
+      (hashmap_value_t *)malloc(BULK_CHUNK * sizeof(hashmap_value_t));
+  hashmap_value_t **found =
+      (hashmap_value_t **)malloc(BULK_CHUNK * sizeof(hashmap_value_t *));
+  if (keys == NULL || values == NULL || found == NULL)
+    error("Failed to allocate the bulk arrays.");
+
+  message("Initialising hash table for the bulk insertions...");
+  hashmap_init(&m);
+  const size_t initial_table_size = m.table_size;
+
+  message("Populating hash table in bulk...");
+  for (size_t first = 0; first < NUM_BULK_KEYS; first += BULK_CHUNK) {
+    const size_t count = min((size_t)BULK_CHUNK, (size_t)NUM_BULK_KEYS - first);
+    for (size_t k = 0; k < count; k++) {
+      keys[k] = 2 * (first + k);
+      values[k].value_st = (long long)keys[k];
+    }
+    hashmap_put_many(&m, keys, values, count);
+  }
+
+  if (m.table_size <= initial_table_size)
+    error("The hash table did not grow during the bulk insertions.");
+  if (m.size != NUM_BULK_KEYS)
+    error("Wrong no. of elements after the bulk insertions: %zu instead of %d",
+          m.size, NUM_BULK_KEYS);
+
+  message("Overwriting elements in bulk...");
+  for (size_t k = 0; k < BULK_CHUNK; k++) {
+    keys[k] = 2 * k;
+    values[k].value_st = -(long long)keys[k];
+  }
+  hashmap_put_many(&m, keys, values, BULK_CHUNK);
+  if (m.size != NUM_BULK_KEYS)
+    error("Overwriting the elements changed the size of the table to %zu",
+          m.size);
+
+  message("Retrieving present and missing elements in bulk...");
+  for (size_t first = 0; first < 2 * NUM_BULK_KEYS; first += BULK_CHUNK) {
+    const size_t count =
+        min((size_t)BULK_CHUNK, (size_t)2 * NUM_BULK_KEYS - first);
+    for (size_t k = 0; k < count; k++) keys[k] = first + k;
+    hashmap_lookup_many(&m, keys, count, found);
+
+    for (size_t k = 0; k < count; k++) {
+      const hashmap_key_t key = keys[k];
+      if (key % 2) {
+        if (found[k] != NULL)
+          error("Key: %lld shouldn't exist or be created.", (long long)key);
+        continue;
+      }
+      if (found[k] == NULL)
+        error("Key: %lld was not found.", (long long)key);
+      const long long expected =
+          key < 2 * BULK_CHUNK ? -(long long)key : (long long)key;
+      if (found[k]->value_st != expected)
+        error("Incorrect value (%lld) found for key: %lld", found[k]->value_st,
+              (long long)key);
+    }
+  }
+
+  if (m.size != NUM_BULK_KEYS)
+    error("The bulk lookups changed the size of the table to %zu", m.size);
+
+  message("Freeing hash table...");
+  hashmap_free(&m);
+  free(keys);
+  free(values);
+  free(found);
 }
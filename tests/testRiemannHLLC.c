@@ -147,6 +147,71 @@ void check_riemann_symmetry(void) {
   }
 }
 
+/**
+ * @brief Check that the batched HLLC Riemann solver agrees with the one
+ * solving a single interface
+ */
+void check_riemann_batch(void) {
+  struct riemann_batch b;
+  float totflux[riemann_batch_size][5];
+  b.count = 0;
+
+  for (int i = 0; i < riemann_batch_size; i++) {
+    float WL[5], WR[5], n_unit[3], n_norm, vij[3];
+
+    WL[0] = random_uniform(0.1f, 1.0f);
+    WL[1] = random_uniform(-10.0f, 10.0f);
+    WL[2] = random_uniform(-10.0f, 10.0f);
+    WL[3] = random_uniform(-10.0f, 10.0f);
+    WL[4] = random_uniform(0.1f, 1.0f);
+    WR[0] = random_uniform(0.1f, 1.0f);
+    WR[1] = random_uniform(-10.0f, 10.0f);
+    WR[2] = random_uniform(-10.0f, 10.0f);
+    WR[3] = random_uniform(-10.0f, 10.0f);
+    WR[4] = random_uniform(0.1f, 1.0f);
+
+    /* Put a vacuum on one side of some of the interfaces */
+    if (i % 8 == 0) {
+      WL[0] = 0.0f;
+      WL[1] = 0.0f;
+      WL[2] = 0.0f;
+      WL[3] = 0.0f;
+      WL[4] = 0.0f;
+    }
+
+    n_unit[0] = random_uniform(-1.0f, 1.0f);
+    n_unit[1] = random_uniform(-1.0f, 1.0f);
+    n_unit[2] = random_uniform(-1.0f, 1.0f);
+
+    n_norm = sqrtf(n_unit[0] * n_unit[0] + n_unit[1] * n_unit[1] +
+                   n_unit[2] * n_unit[2]);
+    n_unit[0] /= n_norm;
+    n_unit[1] /= n_norm;
+    n_unit[2] /= n_norm;
+
+    vij[0] = random_uniform(-10.0f, 10.0f);
+    vij[1] = random_uniform(-10.0f, 10.0f);
+    vij[2] = random_uniform(-10.0f, 10.0f);
+
+    riemann_batch_add(&b, WL, WR, n_unit, vij);
+    riemann_solve_for_flux(WL, WR, n_unit, vij, totflux[i]);
+  }
+
+  riemann_batch_solve_for_flux(&b);
+
+  for (int i = 0; i < riemann_batch_size; i++) {
+    for (int k = 0; k < 5; k++) {
+      const float abs_error = fabsf(b.flux[k][i] - totflux[i][k]);
+      const float norm = fabsf(b.flux[k][i]) + fabsf(totflux[i][k]);
+      if (abs_error > max_abs_error && abs_error > max_rel_error * norm) {
+        message("Interface %d, flux %d: batch=%.8e single=%.8e", i, k,
+                b.flux[k][i], totflux[i][k]);
+        error("Batched flux solution differs!");
+      }
+    }
+  }
+}
+
 /**
  * @brief Check the HLLC Riemann solver
  */
@@ -171,5 +236,10 @@ int main(int argc, char *argv[]) {
     check_riemann_symmetry();
   }
 
+  /* batched solver test */
+  for (int i = 0; i < 10000; i++) {
+    check_riemann_batch();
+  }
+
   return 0;
 }
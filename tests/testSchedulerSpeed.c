@@ -0,0 +1,432 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#include <config.h>
+
+/* Some standard headers. */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Local headers. */
+#include "swift.h"
+
+/**
+ * @file testSchedulerSpeed.c
+ * @brief Times the scheduler and the queues on synthetic task graphs.
+ *
+ * The tasks go through the real scheduler_addtask(), scheduler_addunlock(),
+ * scheduler_start(), scheduler_gettask() and scheduler_done(), but do nothing
+ * or spin for a fixed time, such that the overheads of the scheduling are
+ * measured without any physics. Two graph shapes are available:
+ *
+ *  - tree: the leaves are reduced into their parents, fan_in at a time, up
+ *    to a single root, as the upward passes through the cell trees. The
+ *    tasks lock nothing.
+ *  - lattice: a periodic cubic lattice of cells, each with a drift, a self
+ *    density, its 13 pair densities, a ghost, a self force and its 13 pair
+ *    forces, as the hydro loops. The self and pair tasks lock their cells,
+ *    so the conflicts of the pairs are part of the cost.
+ *
+ * Every run checks that each task ran once and after all the tasks that
+ * unlock it.
+ */
+
+/*! The graph shapes */
+enum graph_shape { graph_tree = 0, graph_lattice };
+
+/*! What the runner threads share */
+struct bench {
+  struct scheduler *s;
+  swift_barrier_t run_barrier, wait_barrier;
+  ticks cost;
+
+  /* When each task was finished, before it unlocked the others */
+  ticks *ends;
+  volatile int done;
+  volatile int count;
+};
+
+/*! A runner thread */
+struct bench_runner {
+  struct bench *b;
+  pthread_t thread;
+  int qid;
+
+  /* Times of the last run */
+  ticks body, gettask, sched_done, last_toc;
+  int nr_tasks;
+};
+
+/**
+ * @brief The body of a runner thread, a stripped down runner_main().
+ */
+static void *bench_runner_main(void *data) {
+
+  struct bench_runner *r = (struct bench_runner *)data;
+  struct bench *b = r->b;
+  struct scheduler *s = b->s;
+
+  while (1) {
+
+    /* Wait for the launch */
+    swift_barrier_wait(&b->wait_barrier);
+    swift_barrier_wait(&b->run_barrier);
+    if (b->done) break;
+
+    r->body = r->gettask = r->sched_done = r->last_toc = 0;
+    r->nr_tasks = 0;
+    struct task *prev = NULL;
+    ticks spin_time = 0, park_time = 0;
+    while (1) {
+
+      const ticks tic = getticks();
+      struct task *t = scheduler_gettask(s, r->qid, prev, &spin_time,
+                                         &park_time);
+      r->gettask += getticks() - tic;
+      if (t == NULL) break;
+
+      /* Do the "work" */
+      if (b->cost > 0)
+        while (getticks() - t->tic < b->cost) {
+        }
+      atomic_inc(&b->count);
+      const ticks toc = getticks();
+      b->ends[t - s->tasks] = toc;
+      r->body += toc - t->tic;
+      r->nr_tasks++;
+
+      scheduler_done(s, t);
+      r->sched_done += getticks() - toc;
+      r->last_toc = toc;
+      prev = t;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Builds a fan-in tree of non-locking tasks.
+ *
+ * @param s The #scheduler.
+ * @param nr_leaves The number of leaves.
+ * @param fan_in The number of tasks reduced into each parent.
+ */
+static void make_tree(struct scheduler *s, const int nr_leaves,
+                      const int fan_in) {
+
+  int first = 0, count = nr_leaves;
+  for (int k = 0; k < nr_leaves; k++)
+    scheduler_addtask(s, task_type_none, task_subtype_none, 0, 0, NULL, NULL);
+
+  while (count > 1) {
+    const int nr_parents = (count + fan_in - 1) / fan_in;
+    const int first_parent = s->nr_tasks;
+    for (int k = 0; k < nr_parents; k++) {
+      struct task *p = scheduler_addtask(s, task_type_none, task_subtype_none,
+                                         0, 0, NULL, NULL);
+      for (int j = k * fan_in; j < min((k + 1) * fan_in, count); j++)
+        scheduler_addunlock(s, &s->tasks[first + j], p);
+    }
+    first = first_parent;
+    count = nr_parents;
+  }
+}
+
+/**
+ * @brief Builds the hydro loops of a periodic lattice of cells.
+ *
+ * @param s The #scheduler.
+ * @param cells The cells, side^3 of them.
+ * @param side The number of cells a side.
+ */
+static void make_lattice(struct scheduler *s, struct cell *cells,
+                         const int side) {
+
+  const int nr_cells = side * side * side;
+  struct task **drift = malloc(nr_cells * sizeof(struct task *));
+  struct task **ghost = malloc(nr_cells * sizeof(struct task *));
+  if (drift == NULL || ghost == NULL) error("Failed to allocate the tasks.");
+
+  for (int k = 0; k < nr_cells; k++) {
+    struct cell *c = &cells[k];
+    c->super = c;
+    c->hydro.super = c;
+    c->grav.super = c;
+    c->owner = -1;
+    lock_init(&c->hydro.lock);
+    drift[k] = scheduler_addtask(s, task_type_drift_part, task_subtype_none, 0,
+                                 0, c, NULL);
+    ghost[k] =
+        scheduler_addtask(s, task_type_ghost, task_subtype_none, 0, 0, c, NULL);
+  }
+
+  for (int i = 0; i < side; i++) {
+    for (int j = 0; j < side; j++) {
+      for (int k = 0; k < side; k++) {
+        const int cid = (i * side + j) * side + k;
+        struct cell *ci = &cells[cid];
+
+        struct task *density = scheduler_addtask(
+            s, task_type_self, task_subtype_density, 0, 0, ci, NULL);
+        struct task *force = scheduler_addtask(
+            s, task_type_self, task_subtype_force, 0, 0, ci, NULL);
+        scheduler_addunlock(s, drift[cid], density);
+        scheduler_addunlock(s, density, ghost[cid]);
+        scheduler_addunlock(s, ghost[cid], force);
+
+        /* Half of the 26 neighbours, the other half has the pair */
+        for (int ii = -1; ii <= 1; ii++) {
+          for (int jj = -1; jj <= 1; jj++) {
+            for (int kk = -1; kk <= 1; kk++) {
+              const int sid = (ii + 1) * 9 + (jj + 1) * 3 + (kk + 1);
+              if (sid <= 13) continue;
+              const int cjd = (((i + ii + side) % side) * side +
+                               (j + jj + side) % side) *
+                                  side +
+                              (k + kk + side) % side;
+              struct cell *cj = &cells[cjd];
+
+              struct task *pd = scheduler_addtask(
+                  s, task_type_pair, task_subtype_density, sid, 0, ci, cj);
+              struct task *pf = scheduler_addtask(
+                  s, task_type_pair, task_subtype_force, sid, 0, ci, cj);
+              scheduler_addunlock(s, drift[cid], pd);
+              scheduler_addunlock(s, drift[cjd], pd);
+              scheduler_addunlock(s, pd, ghost[cid]);
+              scheduler_addunlock(s, pd, ghost[cjd]);
+              scheduler_addunlock(s, ghost[cid], pf);
+              scheduler_addunlock(s, ghost[cjd], pf);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  free(drift);
+  free(ghost);
+}
+
+int main(int argc, char *argv[]) {
+
+  /* Initialize CPU frequency, this also starts time. */
+  unsigned long long cpufreq = 0;
+  clocks_set_cpufreq(cpufreq);
+
+  int shape = graph_lattice, size = 8, fan_in = 8, nr_threads = 4, runs = 5;
+  int steal = 1;
+  double cost_us = 0.;
+  int c;
+  while ((c = getopt(argc, argv, "g:n:f:c:t:r:s:")) != -1) {
+    switch (c) {
+      case 'g':
+        if (strcmp(optarg, "tree") == 0)
+          shape = graph_tree;
+        else if (strcmp(optarg, "lattice") == 0)
+          shape = graph_lattice;
+        else
+          error("Unknown graph shape '%s'.", optarg);
+        break;
+      case 'n':
+        sscanf(optarg, "%d", &size);
+        break;
+      case 'f':
+        sscanf(optarg, "%d", &fan_in);
+        break;
+      case 'c':
+        sscanf(optarg, "%lf", &cost_us);
+        break;
+      case 't':
+        sscanf(optarg, "%d", &nr_threads);
+        break;
+      case 'r':
+        sscanf(optarg, "%d", &runs);
+        break;
+      case 's':
+        sscanf(optarg, "%d", &steal);
+        break;
+      case '?':
+        error("Unknown option.");
+        break;
+    }
+  }
+
+  if (size < 1 || fan_in < 2 || nr_threads < 1 || runs < 1 || cost_us < 0.) {
+    printf(
+        "\nUsage: %s [OPTIONS...]\n"
+        "\nTimes the scheduler on a synthetic task graph."
+        "\n\nOptions:"
+        "\n-g SHAPE=lattice - tree (fan-in reduction) or lattice (hydro loops)"
+        "\n-n SIZE=8        - number of leaves of the tree or cells a side of "
+        "the lattice"
+        "\n-f FAN_IN=8      - number of tasks reduced into each tree node"
+        "\n-c COST=0        - time spent in each task in micro-seconds"
+        "\n-t THREADS=4     - number of runner threads (and queues)"
+        "\n-r RUNS=5        - number of times the graph is run"
+        "\n-s STEAL=1       - let the runners steal from the other queues\n",
+        argv[0]);
+    exit(1);
+  }
+
+  /* A space and engine for the scheduler to point at */
+  struct engine *e = calloc(1, sizeof(struct engine));
+  struct space *sp = calloc(1, sizeof(struct space));
+  if (e == NULL || sp == NULL) error("Failed to allocate the engine.");
+  sp->e = e;
+
+  struct threadpool tp;
+  threadpool_init(&tp, nr_threads);
+
+  /* Build the graph */
+  const int nr_cells = shape == graph_lattice ? size * size * size : 0;
+  int max_tasks = 30 * nr_cells;
+  if (shape == graph_tree)
+    for (int count = size; count > 1; count = (count + fan_in - 1) / fan_in)
+      max_tasks += count;
+  max_tasks += 1;
+  struct cell *cells = NULL;
+  if (nr_cells > 0) {
+    cells = (struct cell *)calloc(nr_cells, sizeof(struct cell));
+    if (cells == NULL) error("Failed to allocate the cells.");
+  }
+
+  struct scheduler s;
+  bzero(&s, sizeof(struct scheduler));
+  scheduler_init(&s, sp, max_tasks, nr_threads,
+                 steal ? scheduler_flag_steal : scheduler_flag_none,
+                 /*nodeID=*/0, &tp);
+  if (shape == graph_lattice)
+    make_lattice(&s, cells, size);
+  else
+    make_tree(&s, size, fan_in);
+  scheduler_set_unlocks(&s);
+  scheduler_ranktasks(&s);
+
+  /* Give the tasks their critical path length as weight, as
+   * scheduler_reweight() but without the costs of the physics */
+  for (int k = s.nr_tasks - 1; k >= 0; k--) {
+    struct task *t = &s.tasks[s.tasks_ind[k]];
+    t->weight = 1.f;
+    for (int j = 0; j < t->nr_unlock_tasks; j++)
+      t->weight = max(t->weight, 1.f + t->unlock_tasks[j]->weight);
+  }
+
+  message("%s of %d tasks and %d unlocks on %d threads, %.3f us per task, "
+          "stealing %s.",
+          shape == graph_lattice ? "Lattice" : "Tree", s.nr_tasks,
+          s.nr_unlocks, nr_threads, cost_us, steal ? "on" : "off");
+
+  /* Start the runners */
+  struct bench b;
+  b.s = &s;
+  b.cost = cost_us * clocks_get_cpufreq() / 1e6;
+  b.ends = (ticks *)malloc(s.nr_tasks * sizeof(ticks));
+  if (b.ends == NULL) error("Failed to allocate the task times.");
+  b.done = 0;
+  swift_barrier_init(&b.run_barrier, NULL, nr_threads + 1);
+  swift_barrier_init(&b.wait_barrier, NULL, nr_threads + 1);
+  struct bench_runner *runners =
+      (struct bench_runner *)calloc(nr_threads, sizeof(struct bench_runner));
+  if (runners == NULL) error("Failed to allocate the runners.");
+  for (int k = 0; k < nr_threads; k++) {
+    runners[k].b = &b;
+    runners[k].qid = k;
+    if (pthread_create(&runners[k].thread, NULL, bench_runner_main,
+                       &runners[k]) != 0)
+      error("Failed to create a runner thread.");
+  }
+  swift_barrier_wait(&b.wait_barrier);
+
+  printf("# %4s %12s %12s %12s %12s %12s %10s %10s\n", "run", "start_ms",
+         "run_ms", "Mtasks/s", "gettask_ns", "done_ns", "idle", "tail_idle");
+  double best_rate = 0., sum_rate = 0.;
+  for (int run = 0; run < runs; run++) {
+
+    /* Activate everything, as engine_marktasks() would */
+    const ticks tic_start = getticks();
+    for (int k = 0; k < s.nr_tasks; k++) scheduler_activate(&s, &s.tasks[k]);
+    b.count = 0;
+
+    /* As engine_launch() */
+    atomic_inc(&s.waiting);
+    swift_barrier_wait(&b.run_barrier);
+    const ticks tic_run = getticks();
+    scheduler_start(&s);
+    pthread_mutex_lock(&s.sleep_mutex);
+    atomic_dec(&s.waiting);
+    pthread_cond_broadcast(&s.sleep_cond);
+    pthread_mutex_unlock(&s.sleep_mutex);
+    swift_barrier_wait(&b.wait_barrier);
+    const ticks toc_run = getticks();
+
+    /* Did everything run in order? */
+    if (b.count != s.nr_tasks)
+      error("Ran %d tasks out of %d.", b.count, s.nr_tasks);
+    for (int k = 0; k < s.nr_tasks; k++) {
+      const struct task *t = &s.tasks[k];
+      if (!t->skip) error("Task %d did not run.", k);
+      for (int j = 0; j < t->nr_unlock_tasks; j++)
+        if (t->unlock_tasks[j]->tic < b.ends[k])
+          error("Task %d started before a task unlocking it was done.",
+                (int)(t->unlock_tasks[j] - s.tasks));
+    }
+
+    /* Sum up the runners */
+    ticks body = 0, gettask = 0, sched_done = 0, tail = 0, last = 0;
+    for (int k = 0; k < nr_threads; k++) last = max(last, runners[k].last_toc);
+    for (int k = 0; k < nr_threads; k++) {
+      body += runners[k].body;
+      gettask += runners[k].gettask;
+      sched_done += runners[k].sched_done;
+      const ticks last_toc =
+          runners[k].nr_tasks > 0 ? runners[k].last_toc : tic_run;
+      tail += last - last_toc;
+    }
+
+    const double span = (double)(last - tic_run);
+    const double seconds = span / clocks_get_cpufreq();
+    const double rate = seconds > 0. ? 1e-6 * s.nr_tasks / seconds : 0.;
+    const double to_ns = 1e9 / clocks_get_cpufreq();
+    printf("  %4d %12.3f %12.3f %12.3f %12.1f %12.1f %10.4f %10.4f\n", run,
+           clocks_from_ticks(tic_run - tic_start),
+           clocks_from_ticks(toc_run - tic_run), rate,
+           to_ns * gettask / s.nr_tasks, to_ns * sched_done / s.nr_tasks,
+           span > 0. ? 1. - body / (nr_threads * span) : 0.,
+           span > 0. ? tail / (nr_threads * span) : 0.);
+    best_rate = max(best_rate, rate);
+    sum_rate += rate;
+  }
+  message("Best %.3f Mtasks/s, mean %.3f Mtasks/s.", best_rate,
+          sum_rate / runs);
+
+  /* Stop the runners */
+  b.done = 1;
+  swift_barrier_wait(&b.run_barrier);
+  for (int k = 0; k < nr_threads; k++) pthread_join(runners[k].thread, NULL);
+
+  free(runners);
+  free(b.ends);
+  scheduler_clean(&s);
+  threadpool_clean(&tp);
+  free(cells);
+  free(sp);
+  free(e);
+  return 0;
+}
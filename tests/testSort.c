@@ -0,0 +1,287 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#include <config.h>
+
+/* Some standard headers. */
+#include <fenv.h>
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Local headers. */
+#include "swift.h"
+
+/*! Largest number of entries the quicksort's stack can handle */
+#define max_quicksort_count 1023
+
+/*! Index of the sentinel, something no sort would write there */
+#define sentinel_index 123456789
+
+/**
+ * @brief Compare two #sort_entry by distance, for qsort().
+ */
+int sort_entry_compare(const void *a, const void *b) {
+
+  const float da = ((const struct sort_entry *)a)->d;
+  const float db = ((const struct sort_entry *)b)->d;
+  return (da > db) - (da < db);
+}
+
+/**
+ * @brief A random float in [lo, hi).
+ */
+float random_in(const float lo, const float hi) {
+
+  return lo + (hi - lo) * ((float)rand() / ((float)RAND_MAX + 1.f));
+}
+
+/**
+ * @brief Check an array against a reference sort of the same entries.
+ *
+ * The sorts need not be stable, so only the distances are compared in order.
+ * Every entry must however still be there with its distance.
+ *
+ * @param sort The sorted entries, with their sentinel.
+ * @param ref The reference sort of the same entries.
+ * @param orig The entries before the sort, with orig[k].i = k.
+ * @param N The number of entries.
+ * @param name The name of the test.
+ */
+void check_sort(const struct sort_entry *sort, const struct sort_entry *ref,
+                const struct sort_entry *orig, const int N, const char *name) {
+
+  if (sort[N].d != FLT_MAX || sort[N].i != sentinel_index)
+    error("%s (N=%d): the sentinel was overwritten.", name, N);
+
+  char *seen = (char *)calloc(N, sizeof(char));
+  if (seen == NULL) error("Failed to allocate the check array.");
+
+  for (int k = 0; k < N; k++) {
+
+    if (sort[k].d != ref[k].d)
+      error("%s (N=%d): entry %d has d=%e instead of %e.", name, N, k,
+            sort[k].d, ref[k].d);
+
+    const int i = sort[k].i;
+    if (i < 0 || i >= N || seen[i])
+      error("%s (N=%d): entry %d has an invalid or repeated index %d.", name,
+            N, k, i);
+    seen[i] = 1;
+
+    if (sort[k].d != orig[i].d)
+      error("%s (N=%d): entry %d lost its distance.", name, N, k);
+  }
+
+  free(seen);
+}
+
+/**
+ * @brief Radix-sort an array and compare it with the quicksort, or with
+ * qsort() beyond what the quicksort can handle.
+ *
+ * @param orig The entries to sort, with orig[k].i = k.
+ * @param N The number of entries.
+ * @param name The name of the test.
+ */
+void test_radix(const struct sort_entry *orig, const int N, const char *name) {
+
+  struct sort_entry *sort =
+      (struct sort_entry *)malloc((N + 1) * sizeof(struct sort_entry));
+  struct sort_entry *ref =
+      (struct sort_entry *)malloc((N + 1) * sizeof(struct sort_entry));
+  if (sort == NULL || ref == NULL) error("Failed to allocate the sorts.");
+
+  memcpy(ref, orig, N * sizeof(struct sort_entry));
+  if (N <= max_quicksort_count)
+    runner_do_sort_ascending_quicksort(ref, N);
+  else
+    qsort(ref, N, sizeof(struct sort_entry), sort_entry_compare);
+
+  /* The radix sort itself */
+  memcpy(sort, orig, N * sizeof(struct sort_entry));
+  sort[N].d = FLT_MAX;
+  sort[N].i = sentinel_index;
+  runner_do_sort_ascending_radix(sort, N);
+  check_sort(sort, ref, orig, N, name);
+
+  /* And whichever sort the leaves would use */
+  memcpy(sort, orig, N * sizeof(struct sort_entry));
+  sort[N].d = FLT_MAX;
+  sort[N].i = sentinel_index;
+  runner_do_sort_ascending(sort, N);
+  check_sort(sort, ref, orig, N, name);
+
+  free(sort);
+  free(ref);
+}
+
+/**
+ * @brief Repair the sort of an array and compare it with a fresh sort.
+ *
+ * @param orig The entries in their old order, with orig[k].i = k.
+ * @param N The number of entries.
+ * @param name The name of the test.
+ */
+void test_resort(const struct sort_entry *orig, const int N,
+                 const char *name) {
+
+  struct sort_entry *sort =
+      (struct sort_entry *)malloc((N + 1) * sizeof(struct sort_entry));
+  struct sort_entry *ref =
+      (struct sort_entry *)malloc((N + 1) * sizeof(struct sort_entry));
+  if (sort == NULL || ref == NULL) error("Failed to allocate the sorts.");
+
+  memcpy(ref, orig, N * sizeof(struct sort_entry));
+  runner_do_sort_ascending(ref, N);
+
+  memcpy(sort, orig, N * sizeof(struct sort_entry));
+  sort[N].d = FLT_MAX;
+  sort[N].i = sentinel_index;
+  runner_do_resort_ascending(sort, N);
+  check_sort(sort, ref, orig, N, name);
+
+  free(sort);
+  free(ref);
+}
+
+int main(int argc, char *argv[]) {
+
+  /* Initialize CPU frequency, this also starts time. */
+  unsigned long long cpufreq = 0;
+  clocks_set_cpufreq(cpufreq);
+
+/* Choke on FPEs */
+#ifdef HAVE_FE_ENABLE_EXCEPT
+  feenableexcept(FE_DIVBYZERO | FE_INVALID | FE_OVERFLOW);
+#endif
+
+  srand(42);
+
+  /* Around the switch to the radix sort and to its buffers on the heap */
+  const int counts[] = {1,
+                        2,
+                        17,
+                        sort_radix_threshold - 1,
+                        sort_radix_threshold,
+                        sort_radix_threshold + 1,
+                        max_quicksort_count,
+                        sort_radix_stack_size,
+                        sort_radix_stack_size + 1,
+                        3 * sort_radix_stack_size + 17};
+  const int nr_counts = sizeof(counts) / sizeof(int);
+
+  struct sort_entry *orig = (struct sort_entry *)malloc(
+      4 * sort_radix_stack_size * sizeof(struct sort_entry));
+  if (orig == NULL) error("Failed to allocate the entries.");
+
+  for (int n = 0; n < nr_counts; n++) {
+    const int N = counts[n];
+    message("Testing the radix sort with N=%d...", N);
+
+    /* Negative and positive distances over many orders of magnitude */
+    for (int k = 0; k < N; k++) {
+      orig[k].i = k;
+      orig[k].d = random_in(-1.f, 1.f) * powf(10.f, random_in(-6.f, 6.f));
+    }
+    test_radix(orig, N, "random");
+
+    /* With a lot of duplicates, and both zeros */
+    for (int k = 0; k < N; k++) {
+      orig[k].i = k;
+      orig[k].d = (float)(rand() % 7 - 3);
+      if (orig[k].d == 0.f && rand() % 2) orig[k].d = -0.f;
+    }
+    test_radix(orig, N, "duplicates");
+
+    /* Close-by positive distances, sharing their leading bytes */
+    for (int k = 0; k < N; k++) {
+      orig[k].i = k;
+      orig[k].d = random_in(1.f, 1.0001f);
+    }
+    test_radix(orig, N, "shared leading bytes");
+
+    /* Close-by negative distances, sharing their leading bytes */
+    for (int k = 0; k < N; k++) {
+      orig[k].i = k;
+      orig[k].d = -random_in(1.f, 1.0001f);
+    }
+    test_radix(orig, N, "shared negative leading bytes");
+
+    /* Only the leading byte differs, the other passes are skipped */
+    for (int k = 0; k < N; k++) {
+      uint32_t u = 0x3e000000u | ((uint32_t)(rand() % 2) << 24);
+      orig[k].i = k;
+      memcpy(&orig[k].d, &u, sizeof(float));
+    }
+    test_radix(orig, N, "shared trailing bytes");
+
+    /* All the same, every pass is skipped */
+    for (int k = 0; k < N; k++) {
+      orig[k].i = k;
+      orig[k].d = 0.25f;
+    }
+    test_radix(orig, N, "all equal");
+
+    /* Already sorted and reversed */
+    for (int k = 0; k < N; k++) {
+      orig[k].i = k;
+      orig[k].d = (float)k - 0.5f * N;
+    }
+    test_radix(orig, N, "sorted");
+    for (int k = 0; k < N; k++) {
+      orig[k].i = k;
+      orig[k].d = 0.5f * N - (float)k;
+    }
+    test_radix(orig, N, "reversed");
+
+    message("Testing the repair of the sorts with N=%d...", N);
+
+    /* An old sort whose entries moved by a few places since */
+    for (int k = 0; k < N; k++) {
+      orig[k].i = k;
+      orig[k].d = (float)k + random_in(-3.f, 3.f);
+    }
+    test_resort(orig, N, "nearly sorted");
+
+    /* One entry moved across the whole array */
+    for (int k = 0; k < N; k++) {
+      orig[k].i = k;
+      orig[k].d = (float)k;
+    }
+    orig[0].d = (float)N;
+    test_resort(orig, N, "one far move");
+
+    /* Reversed and random, far more than sort_resort_max_shifts shifts per
+     * entry for all but the smallest arrays, handed over to the full sort */
+    for (int k = 0; k < N; k++) {
+      orig[k].i = k;
+      orig[k].d = 0.5f * N - (float)k;
+    }
+    test_resort(orig, N, "reversed");
+    for (int k = 0; k < N; k++) {
+      orig[k].i = k;
+      orig[k].d = random_in(-1.f, 1.f);
+    }
+    test_resort(orig, N, "random");
+  }
+
+  free(orig);
+
+  message("All good.");
+  return 0;
+}
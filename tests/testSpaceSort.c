@@ -0,0 +1,352 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#include <config.h>
+
+/* Some standard headers. */
+#include <fenv.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Local headers. */
+#include "swift.h"
+
+/*! Number of #part, all of them with a #gpart, and of dark matter #gpart */
+#define NUM_PARTS 60000
+#define NUM_DM 40000
+#define NUM_GPARTS (NUM_PARTS + NUM_DM)
+
+/*! Number of cells to sort the particles into */
+#define NUM_BINS 1000
+
+/**
+ * @brief The particles and their cell indices.
+ */
+struct particles {
+  struct part *parts;
+  struct xpart *xparts;
+  struct gpart *gparts;
+  int *ind_parts, *counts_parts;
+  int *ind_gparts, *counts_gparts;
+};
+
+/**
+ * @brief Allocate a set of particles.
+ */
+void particles_alloc(struct particles *p) {
+
+  if (swift_memalign("parts", (void **)&p->parts, part_align,
+                     NUM_PARTS * sizeof(struct part)) != 0 ||
+      swift_memalign("xparts", (void **)&p->xparts, xpart_align,
+                     NUM_PARTS * sizeof(struct xpart)) != 0 ||
+      swift_memalign("gparts", (void **)&p->gparts, gpart_align,
+                     NUM_GPARTS * sizeof(struct gpart)) != 0)
+    error("Failed to allocate the particles.");
+
+  p->ind_parts = (int *)malloc(NUM_PARTS * sizeof(int));
+  p->ind_gparts = (int *)malloc(NUM_GPARTS * sizeof(int));
+  p->counts_parts = (int *)malloc(NUM_BINS * sizeof(int));
+  p->counts_gparts = (int *)malloc(NUM_BINS * sizeof(int));
+  if (p->ind_parts == NULL || p->ind_gparts == NULL ||
+      p->counts_parts == NULL || p->counts_gparts == NULL)
+    error("Failed to allocate the cell indices.");
+}
+
+/**
+ * @brief Free a set of particles.
+ */
+void particles_free(struct particles *p) {
+
+  swift_free("parts", p->parts);
+  swift_free("xparts", p->xparts);
+  swift_free("gparts", p->gparts);
+  free(p->ind_parts);
+  free(p->ind_gparts);
+  free(p->counts_parts);
+  free(p->counts_gparts);
+}
+
+/**
+ * @brief Copy a set of particles and link the copies to each other.
+ */
+void particles_copy(struct particles *to, const struct particles *from) {
+
+  memcpy(to->parts, from->parts, NUM_PARTS * sizeof(struct part));
+  memcpy(to->xparts, from->xparts, NUM_PARTS * sizeof(struct xpart));
+  memcpy(to->gparts, from->gparts, NUM_GPARTS * sizeof(struct gpart));
+  memcpy(to->ind_parts, from->ind_parts, NUM_PARTS * sizeof(int));
+  memcpy(to->ind_gparts, from->ind_gparts, NUM_GPARTS * sizeof(int));
+  memcpy(to->counts_parts, from->counts_parts, NUM_BINS * sizeof(int));
+  memcpy(to->counts_gparts, from->counts_gparts, NUM_BINS * sizeof(int));
+
+  for (int k = 0; k < NUM_PARTS; k++)
+    to->parts[k].gpart = &to->gparts[from->parts[k].gpart - from->gparts];
+}
+
+/**
+ * @brief Set the cells of some particles, either at random or sorted
+ * already with only a few pairs of particles swapped.
+ *
+ * @param ind The cell indices.
+ * @param counts (return) The number of particles per cell.
+ * @param count The number of particles.
+ * @param random Are the cells random?
+ */
+void cells_init(int *ind, int *counts, const int count, const int random) {
+
+  for (int k = 0; k < count; k++)
+    ind[k] = random ? rand() % NUM_BINS : ((long long)k * NUM_BINS) / count;
+
+  /* 0.1% of the particles swapped, which leaves the ranges of the cells in
+   * place */
+  if (!random) {
+    for (int k = 0; k < count / 2000; k++) {
+      const int a = rand() % count;
+      const int b = rand() % count;
+      const int temp = ind[a];
+      ind[a] = ind[b];
+      ind[b] = temp;
+    }
+  }
+
+  bzero(counts, NUM_BINS * sizeof(int));
+  for (int k = 0; k < count; k++) counts[ind[k]]++;
+}
+
+/**
+ * @brief Set up particles, with the gas #gpart shuffled amongst the dark
+ * matter ones.
+ *
+ * @param p The particles.
+ * @param random Are the cells random? Otherwise, only a few particles are out
+ * of their cell.
+ */
+void particles_init(struct particles *p, const int random) {
+
+  bzero(p->parts, NUM_PARTS * sizeof(struct part));
+  bzero(p->xparts, NUM_PARTS * sizeof(struct xpart));
+  bzero(p->gparts, NUM_GPARTS * sizeof(struct gpart));
+
+  /* The x[0] of the #gpart tags them with their original position */
+  for (int k = 0; k < NUM_GPARTS; k++) {
+    p->gparts[k].x[0] = k;
+    p->gparts[k].type = swift_type_dark_matter;
+    p->gparts[k].id_or_neg_offset = k;
+  }
+
+  /* Every #part picks a distinct #gpart */
+  for (int k = 0; k < NUM_PARTS; k++) {
+    int g = rand() % NUM_GPARTS;
+    while (p->gparts[g].type == swift_type_gas) g = (g + 1) % NUM_GPARTS;
+    p->parts[k].id = k;
+    p->parts[k].gpart = &p->gparts[g];
+    p->gparts[g].type = swift_type_gas;
+    p->gparts[g].id_or_neg_offset = -k;
+  }
+
+  cells_init(p->ind_parts, p->counts_parts, NUM_PARTS, random);
+  cells_init(p->ind_gparts, p->counts_gparts, NUM_GPARTS, random);
+}
+
+/**
+ * @brief Sort the #part and then the #gpart into their cells, as the
+ * rebuild does, and check the result.
+ *
+ * @param p The particles.
+ * @param orig The particles before the sort.
+ * @param tp The #threadpool, NULL for the serial sort.
+ */
+void particles_sort(struct particles *p, const struct particles *orig,
+                    struct threadpool *tp) {
+
+  space_parts_sort(p->parts, p->xparts, p->ind_parts, p->counts_parts,
+                   NUM_BINS, /*parts_offset=*/0, tp);
+  space_gparts_sort(p->gparts, p->parts, /*sinks=*/NULL, /*sparts=*/NULL,
+                    /*bparts=*/NULL, p->ind_gparts, p->counts_gparts, NUM_BINS,
+                    tp);
+
+  /* The counts are unchanged */
+  if (memcmp(p->counts_parts, orig->counts_parts, NUM_BINS * sizeof(int)) ||
+      memcmp(p->counts_gparts, orig->counts_gparts, NUM_BINS * sizeof(int)))
+    error("The sort changed the counts.");
+
+  /* Every particle is in its cell, with the index that goes with it */
+  for (int k = 0; k < NUM_PARTS; k++) {
+    if (k > 0 && p->ind_parts[k] < p->ind_parts[k - 1])
+      error("The #part are not sorted at %d.", k);
+    if (p->ind_parts[k] != orig->ind_parts[p->parts[k].id])
+      error("The #part %d lost its index.", k);
+  }
+  for (int k = 0; k < NUM_GPARTS; k++) {
+    if (k > 0 && p->ind_gparts[k] < p->ind_gparts[k - 1])
+      error("The #gpart are not sorted at %d.", k);
+    if (p->ind_gparts[k] != orig->ind_gparts[(int)p->gparts[k].x[0]])
+      error("The #gpart %d lost its index.", k);
+  }
+
+  /* The links go both ways */
+  for (int k = 0; k < NUM_PARTS; k++) {
+    const struct gpart *gp = p->parts[k].gpart;
+    if (gp < p->gparts || gp >= p->gparts + NUM_GPARTS)
+      error("The #part %d points outside of the #gpart.", k);
+    if (gp->type != swift_type_gas || gp->id_or_neg_offset != -k)
+      error("The #gpart of the #part %d does not point back to it.", k);
+  }
+  for (int k = 0; k < NUM_GPARTS; k++) {
+    const struct gpart *gp = &p->gparts[k];
+    if (gp->type == swift_type_gas) {
+      if (gp->id_or_neg_offset > 0 || -gp->id_or_neg_offset >= NUM_PARTS)
+        error("The #gpart %d has an invalid id_or_neg_offset.", k);
+      if (p->parts[-gp->id_or_neg_offset].gpart != gp)
+        error("The #part of the #gpart %d does not point back to it.", k);
+    } else if (gp->id_or_neg_offset != (long long)gp->x[0]) {
+      error("The dark matter #gpart %d lost its ID.", k);
+    }
+  }
+}
+
+/**
+ * @brief Compare two ints, for qsort().
+ */
+int int_compare(const void *a, const void *b) {
+
+  return *(const int *)a - *(const int *)b;
+}
+
+/**
+ * @brief Check that two sorts put the same particles in each cell.
+ *
+ * The serial sort is not stable, so the order within the cells may differ.
+ *
+ * @param a The first sorted particles.
+ * @param b The second sorted particles.
+ * @param exact Must the order within the cells be the same as well?
+ */
+void particles_compare(const struct particles *a, const struct particles *b,
+                       const int exact) {
+
+  int *tags_a = (int *)malloc(NUM_GPARTS * sizeof(int));
+  int *tags_b = (int *)malloc(NUM_GPARTS * sizeof(int));
+  if (tags_a == NULL || tags_b == NULL) error("Failed to allocate the tags.");
+
+  for (int type = 0; type < 2; type++) {
+
+    const int count = type == 0 ? NUM_PARTS : NUM_GPARTS;
+    const int *counts = type == 0 ? a->counts_parts : a->counts_gparts;
+    for (int k = 0; k < count; k++) {
+      tags_a[k] = type == 0 ? a->parts[k].id : (int)a->gparts[k].x[0];
+      tags_b[k] = type == 0 ? b->parts[k].id : (int)b->gparts[k].x[0];
+    }
+
+    if (!exact) {
+      for (int c = 0, first = 0; c < NUM_BINS; first += counts[c++]) {
+        qsort(&tags_a[first], counts[c], sizeof(int), int_compare);
+        qsort(&tags_b[first], counts[c], sizeof(int), int_compare);
+      }
+    }
+
+    if (memcmp(tags_a, tags_b, count * sizeof(int)) != 0)
+      error("The sorts of the %s differ.", type == 0 ? "#part" : "#gpart");
+  }
+
+  free(tags_a);
+  free(tags_b);
+}
+
+/**
+ * @brief Check that a parallel sort is stable.
+ *
+ * @param p The sorted particles.
+ */
+void particles_check_stable(const struct particles *p) {
+
+  for (int k = 1; k < NUM_PARTS; k++)
+    if (p->ind_parts[k] == p->ind_parts[k - 1] &&
+        p->parts[k].id < p->parts[k - 1].id)
+      error("The parallel sort of the #part is not stable at %d.", k);
+  for (int k = 1; k < NUM_GPARTS; k++)
+    if (p->ind_gparts[k] == p->ind_gparts[k - 1] &&
+        p->gparts[k].x[0] < p->gparts[k - 1].x[0])
+      error("The parallel sort of the #gpart is not stable at %d.", k);
+}
+
+int main(int argc, char *argv[]) {
+
+  /* Initialize CPU frequency, this also starts time. */
+  unsigned long long cpufreq = 0;
+  clocks_set_cpufreq(cpufreq);
+
+/* Choke on FPEs */
+#ifdef HAVE_FE_ENABLE_EXCEPT
+  feenableexcept(FE_DIVBYZERO | FE_INVALID | FE_OVERFLOW);
+#endif
+
+  srand(42);
+
+  struct particles orig, serial, parallel, first_parallel;
+  particles_alloc(&orig);
+  particles_alloc(&serial);
+  particles_alloc(&parallel);
+  particles_alloc(&first_parallel);
+
+  /* All of them in random cells, for the parallel counting sort, and only a
+   * few of them out of their cell, for the in-place sort */
+  const int num_threads[3] = {2, 4, 7};
+
+  for (int random = 1; random >= 0; random--) {
+
+    particles_init(&orig, random);
+
+    message("Sorting the particles from %s cells...",
+            random ? "random" : "nearly sorted");
+
+    particles_copy(&serial, &orig);
+    particles_sort(&serial, &orig, /*tp=*/NULL);
+
+    for (int t = 0; t < 3; t++) {
+
+      struct threadpool tp;
+      threadpool_init(&tp, num_threads[t]);
+
+      particles_copy(&parallel, &orig);
+      particles_sort(&parallel, &orig, &tp);
+
+      /* The same cells as the serial sort. The counting sort is stable, and
+       * so independent of the number of threads, and the in-place one is the
+       * serial sort itself. */
+      particles_compare(&serial, &parallel, /*exact=*/!random);
+      if (random) {
+        particles_check_stable(&parallel);
+        if (t == 0)
+          particles_copy(&first_parallel, &parallel);
+        else
+          particles_compare(&first_parallel, &parallel, /*exact=*/1);
+      }
+
+      threadpool_clean(&tp);
+      message("%d threads: ok.", num_threads[t]);
+    }
+  }
+
+  particles_free(&orig);
+  particles_free(&serial);
+  particles_free(&parallel);
+  particles_free(&first_parallel);
+
+  message("All good.");
+  return 0;
+}
@@ -70,6 +70,13 @@ void map_function_check_uniform(void *map_data, int num_elements,
   printf("    map_function_check_uniform handled %d elements\n", num_elements);
 }
 
+void map_function_sum(void *map_data, int num_elements, void *extra_data) {
+  const int *inputs = (int *)map_data;
+  int sum = 0;
+  for (int ind = 0; ind < num_elements; ind++) sum += inputs[ind];
+  atomic_add((int *)extra_data, sum);
+}
+
 int main(int argc, char *argv[]) {
 
   // Some constants for this test.
@@ -165,9 +172,50 @@ int main(int argc, char *argv[]) {
     exit(1);
   }
 
+  printf("# passed uniform checks\n");
+
+  /* Run several maps, with all chunking kinds, in one go. */
+  printf("# threadpool_map_batch checks\n");
+  int bsums[4] = {0, 0, 0, 0};
+  struct threadpool_map_job jobs[4] = {
+      {.map_function = map_function_sum,
+       .map_data = counts,
+       .N = 23,
+       .stride = sizeof(int),
+       .chunk = threadpool_auto_chunk_size,
+       .extra_data = &bsums[0]},
+      {.map_function = map_function_sum,
+       .map_data = counts,
+       .N = 0,
+       .stride = sizeof(int),
+       .chunk = 1,
+       .extra_data = &bsums[1]},
+      {.map_function = map_function_sum,
+       .map_data = counts,
+       .N = 17,
+       .stride = sizeof(int),
+       .chunk = 3,
+       .extra_data = &bsums[2]},
+      {.map_function = map_function_sum,
+       .map_data = counts,
+       .N = 11,
+       .stride = sizeof(int),
+       .chunk = threadpool_uniform_chunk_size,
+       .extra_data = &bsums[3]}};
+  threadpool_map_batch(&utp, jobs, 4);
+  for (int k = 0; k < 4; k++) {
+    sum = 0;
+    for (size_t i = 0; i < jobs[k].N; i++) sum += counts[i];
+    if (bsums[k] != sum) {
+      printf("  batched map %d not correct (%d != %d).\n", k, bsums[k], sum);
+      fflush(stdout);
+      exit(1);
+    }
+  }
+
   threadpool_clean(&utp);
 
-  printf("# passed uniform checks\n");
+  printf("# passed batch checks\n");
 
   return 0;
 }
@@ -9,7 +9,8 @@ where input.dat is a thread info file for a step (MPI or non-MPI). Use the
 
 The output is an analysis of the task timings, including deadtime per thread
 and step, total amount of time spent for each task type, for the whole step
-and per thread and the minimum and maximum times spent per task type.
+and per thread and the minimum and maximum times spent per task type, and
+the time each thread spent looking for tasks, spinning or asleep.
 
 This file is part of SWIFT.
 Copyright (c) 2017 Peter W. Draper (p.w.draper@durham.ac.uk)
@@ -38,7 +39,7 @@ import sys
 import argparse
 
 # import hardcoded data
-from swift_hardcoded_data import TASKTYPES, SUBTYPES, SIDS
+from swift_hardcoded_data import TASKTYPES, SUBTYPES, SIDS, PHASES
 
 #  Handle the command line.
 parser = argparse.ArgumentParser(description="Analyse task dumps")
@@ -128,9 +129,16 @@ else:
 maxthread = int(max(data[:, threadscol])) + 1
 print("# Maximum thread id:", maxthread)
 
+#  Time the runners spent looking for tasks, lines of type -3 (if any).
+idledata = data[data[:, taskcol] == -3]
+
+#  The GPU phases of the offloaded tasks, lines of type -4 (if any).
+gpudata = data[data[:, taskcol] == -4]
+
 #  Avoid start and end times of zero.
 sdata = data[data[:, ticcol] != 0]
 sdata = data[data[:, toccol] != 0]
+sdata = sdata[sdata[:, taskcol] != -4]
 
 #  Now we process the required ranks.
 for rank in ranks:
@@ -480,4 +488,71 @@ for rank in ranks:
     )
     print()
 
+    #  Time looking for tasks, as measured by the runners.
+    if mpimode:
+        idle = idledata[idledata[:, rankcol] == rank]
+    else:
+        idle = idledata
+    if pl.shape(idle)[0] > 0:
+        if with_html:
+            print('<div id="idle"></div>')
+        print("# Time looking for tasks (of which spinning and asleep):")
+        print(
+            "# no.    : {0:>9s} {1:>9s} {2:>9s} {3:>9s}".format(
+                "idle", "spinning", "asleep", "percent"
+            )
+        )
+        for line in range(pl.shape(idle)[0]):
+            times = idle[line, ticcol + 2 : ticcol + 5] / CPU_CLOCK
+            print(
+                "thread {0:2d}: {1:9.4f} {2:9.4f} {3:9.4f} {4:9.2f}".format(
+                    int(idle[line, threadscol]),
+                    times[0],
+                    times[1],
+                    times[2],
+                    times[0] / total_t * 100.0,
+                )
+            )
+        print()
+
+    #  GPU phases, the task type is in the column of the pair flag and the
+    #  phase in the one after the toc.
+    if mpimode:
+        gpu = gpudata[gpudata[:, rankcol] == rank]
+    else:
+        gpu = gpudata
+    if pl.shape(gpu)[0] > 0:
+        if with_html:
+            print('<div id="gpu"></div>')
+        print("# GPU phases of the offloaded tasks:")
+        print(
+            "# {0:<30s} {1:>10s}: {2:>9s} {3:>9s} {4:>9s} {5:>9s}".format(
+                "type/subtype", "phase", "count", "sum", "mean", "percent"
+            )
+        )
+        phases = {}
+        for line in range(pl.shape(gpu)[0]):
+            key = (
+                int(gpu[line, subtaskcol + 1]),
+                int(gpu[line, subtaskcol]),
+                int(gpu[line, toccol + 1]),
+            )
+            dt = (gpu[line, toccol] - gpu[line, ticcol]) / CPU_CLOCK
+            if key not in phases:
+                phases[key] = []
+            phases[key].append(dt)
+        for key in sorted(phases.keys()):
+            times = pl.array(phases[key])
+            print(
+                "{0:<32s} {1:>10s}: {2:9d} {3:9.4f} {4:9.4f} {5:9.2f}".format(
+                    TASKTYPES[key[0]] + "/" + SUBTYPES[key[1]],
+                    PHASES[key[2]],
+                    len(times),
+                    times.sum(),
+                    times.mean(),
+                    times.sum() / (total_t * maxthread) * 100.0,
+                )
+            )
+        print()
+
 sys.exit(0)
@@ -312,6 +312,9 @@ print("# Number of threads:", nthread)
 sdata = data[data[:, ticcol] != 0]
 sdata = sdata[sdata[:, toccol] != 0]
 
+# The GPU phases (lines of type -4) are not tasks.
+sdata = sdata[sdata[:, taskcol] != -4]
+
 # Calculate the data range, if not given.
 delta_t = delta_t * CPU_CLOCK
 if delta_t == 0:
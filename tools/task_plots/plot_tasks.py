@@ -15,6 +15,9 @@ span and the --expand option to expand each thread line into '*expand' lines,
 so that adjacent tasks of the same type can be distinguished. Other options
 can be seen using the --help flag.
 
+The GPU phases of the offloaded tasks, when the file has some, are shown on
+extra lines above the threads, one line for each thread that used the GPU.
+
 See the command 'process_plot_tasks' to efficiently wrap this command to
 process a number of thread info files and create an HTML file to view them.
 
@@ -50,7 +53,7 @@ import sys
 import argparse
 
 # import hardcoded data
-from swift_hardcoded_data import TASKTYPES, SUBTYPES
+from swift_hardcoded_data import TASKTYPES, SUBTYPES, PHASES
 
 #  Handle the command line.
 parser = argparse.ArgumentParser(description="Plot task graphs")
@@ -289,6 +292,15 @@ for task in SUBTYPES:
     SUBCOLOURS[task] = colours[ncolours]
     ncolours = (ncolours + 1) % maxcolours
 
+#  Colours of the GPU phases.
+PHASECOLOURS = {
+    "populate": "lightsteelblue",
+    "h2d": "gold",
+    "kernel": "crimson",
+    "d2h": "darkorange",
+    "write_back": "slategray",
+}
+
 #  For fiddling with colours...
 if args.verbose:
     print("#Selected colours:")
@@ -337,6 +349,12 @@ print("# Number of threads:", nthread)
 sdata = data[data[:, ticcol] != 0]
 sdata = sdata[sdata[:, toccol] != 0]
 
+# The GPU phases of the offloaded tasks, lines of type -4 with the phase in
+# the column after the toc, get their own lanes.
+gdata = sdata[sdata[:, taskcol] == -4]
+sdata = sdata[sdata[:, taskcol] != -4]
+phasecol = toccol + 1
+
 if delta_t < 0.0:
     print("The time-range must be >=0!")
     sys.exit(1)
@@ -476,6 +494,33 @@ for rank in ranks:
             #  Now plot.
             ax.broken_barh(tictocs, [i + 0.55, 0.9], facecolors=colours, linewidth=0)
 
+        #  One lane per thread that sent work to the GPU, above the threads.
+        if mpimode:
+            gpudata = gdata[gdata[:, rankcol] == rank]
+        else:
+            gpudata = gdata
+        gputhreads = sorted(set(gpudata[:, threadscol].astype(int)))
+        for j, thread in enumerate(gputhreads):
+            tictocs = []
+            colours = []
+            for line in gpudata[gpudata[:, threadscol] == thread]:
+                phase = PHASES[int(line[phasecol])]
+                tic = (line[ticcol] - start_t) / CPU_CLOCK
+                toc = (line[toccol] - start_t) / CPU_CLOCK
+                tictocs.append((tic, toc - tic))
+                colours.append(PHASECOLOURS[phase])
+
+                qtask = "gpu/" + phase
+                if qtask not in typesseen:
+                    pl.plot([], [], color=PHASECOLOURS[phase], label=qtask)
+                    typesseen.append(qtask)
+
+            ax.broken_barh(
+                tictocs, [nethread + j + 0.55, 0.9], facecolors=colours, linewidth=0
+            )
+        nethread += len(gputhreads)
+        ax.set_ylim(0.5, nethread + 1.0)
+
     #  Legend and room for it.
     nrow = len(typesseen) / 8
     ax.fill_between([0, 0], nethread, nethread + nrow, facecolor="white")
@@ -72,7 +72,6 @@ TASKTYPES = [
     "fof_pair",
     "fof_attach_self",
     "fof_attach_pair",
-    "neutrino_weight",
     "sink_in",
     "sink_ghost1",
     "sink_ghost2",
@@ -188,3 +187,6 @@ SIDS = [
     "( 0,-1, 1)",
     "( 0, 0,-1)",
 ]
+
+#  Phases of the work the tasks send to the GPU, as in cuda_timeline.h.
+PHASES = ["populate", "h2d", "kernel", "d2h", "write_back"]